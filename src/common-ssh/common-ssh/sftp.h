@@ -24,9 +24,11 @@
 #include "ssh.h"
 
 #include <guacamole/object.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 #include <libssh2.h>
 #include <libssh2_sftp.h>
+#include <pthread.h>
 
 /**
  * Maximum number of bytes per path.
@@ -38,6 +40,206 @@
  */
 #define GUAC_COMMON_SSH_SFTP_MAX_DEPTH 1024
 
+/**
+ * The number of bytes read from the SFTP server at a time while downloading
+ * a file, buffered locally until sent to the user as blobs. libssh2 splits
+ * each read into as many concurrent SFTP read requests as are needed to fill
+ * the buffer, and keeps those requests outstanding between reads, such that
+ * downloads are not limited to one SFTP round trip per blob.
+ */
+#define GUAC_COMMON_SSH_SFTP_READ_AHEAD_SIZE 262144
+
+/**
+ * The state of a file being downloaded over SFTP.
+ */
+typedef struct guac_common_ssh_sftp_download {
+
+    /**
+     * The SSH session associated with the SFTP session of the file being
+     * downloaded.
+     */
+    guac_common_ssh_session* session;
+
+    /**
+     * The open file being downloaded.
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * Data read from the file that has not yet been sent to the user.
+     */
+    char buffer[GUAC_COMMON_SSH_SFTP_READ_AHEAD_SIZE];
+
+    /**
+     * The offset of the first byte within buffer that has not yet been sent.
+     */
+    int offset;
+
+    /**
+     * The number of bytes within buffer, including any bytes that have
+     * already been sent.
+     */
+    int length;
+
+} guac_common_ssh_sftp_download;
+
+/**
+ * The number of bytes of received data to accumulate for each upload before
+ * writing that data over SFTP. Up to twice this many bytes may be buffered
+ * for each upload, as the next block of data is received while the previous
+ * block is being written. libssh2 splits each write into as many concurrent
+ * SFTP write requests as are needed to send the block.
+ */
+#define GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE 1048576
+
+/**
+ * The state of a file being uploaded over SFTP.
+ */
+typedef struct guac_common_ssh_sftp_upload {
+
+    /**
+     * The SSH session associated with the SFTP session of the file being
+     * uploaded.
+     */
+    guac_common_ssh_session* session;
+
+    /**
+     * The open file being uploaded.
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * Received data which has not yet been written, and has not yet been
+     * handed to the writer thread. This buffer has room for exactly
+     * GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE bytes.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes currently stored within buffer.
+     */
+    int length;
+
+    /**
+     * The block of data currently being written by the writer thread, if
+     * any. This buffer has room for exactly
+     * GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE bytes.
+     */
+    char* pending_buffer;
+
+    /**
+     * The number of bytes within pending_buffer that are being written.
+     */
+    int pending_length;
+
+    /**
+     * The thread writing pending_buffer, valid only while writing is
+     * non-zero.
+     */
+    pthread_t writer;
+
+    /**
+     * Whether the writer thread is currently running.
+     */
+    int writing;
+
+    /**
+     * Whether any write has failed. Once a write has failed, all further
+     * data is dropped, and the failure is reported in the acknowledgement of
+     * the next blob or of the end of the stream.
+     */
+    int failed;
+
+} guac_common_ssh_sftp_upload;
+
+/**
+ * The amount of time that a cached directory listing remains valid, in
+ * milliseconds. Listings older than this are read again from the SFTP server.
+ */
+#define GUAC_COMMON_SSH_SFTP_LS_CACHE_TTL 5000
+
+/**
+ * The maximum number of directory listings cached for any one SFTP
+ * filesystem. The least-recently-read listing is discarded once this limit is
+ * exceeded.
+ */
+#define GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE 32
+
+/**
+ * The maximum number of entries within a directory listing for that listing
+ * to be cached. Larger directories are still listed, but are read again from
+ * the SFTP server for every request.
+ */
+#define GUAC_COMMON_SSH_SFTP_LS_CACHE_MAX_ENTRIES 16384
+
+/**
+ * A single entry within a directory listing.
+ */
+typedef struct guac_common_ssh_sftp_ls_entry {
+
+    /**
+     * The absolute path of the entry, relative to the root of the filesystem
+     * object.
+     */
+    char* name;
+
+    /**
+     * Non-zero if the entry is a directory (or a symbolic link to a
+     * directory), zero otherwise.
+     */
+    int directory;
+
+} guac_common_ssh_sftp_ls_entry;
+
+/**
+ * The complete contents of a directory, as read from the SFTP server. Each
+ * listing is reference counted, as a cached listing may be sent to several
+ * users at once while also being replaced within the cache.
+ */
+typedef struct guac_common_ssh_sftp_listing {
+
+    /**
+     * The absolute path of the listed directory, relative to the root of the
+     * filesystem object.
+     */
+    char directory_name[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+
+    /**
+     * The time at which the directory was read from the SFTP server.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The number of references to this listing, including the reference held
+     * by the cache if the listing is cached. The listing is freed once this
+     * reaches zero. This must only be accessed while the ls_cache_lock of the
+     * filesystem is held.
+     */
+    unsigned int refcount;
+
+    /**
+     * The entries of the directory, excluding "." and "..".
+     */
+    guac_common_ssh_sftp_ls_entry* entries;
+
+    /**
+     * The number of entries within the entries array.
+     */
+    int length;
+
+    /**
+     * The number of entries that the entries array has room for.
+     */
+    int size;
+
+    /**
+     * The next listing within the cache, or NULL if this is the last (least
+     * recently read) listing or the listing is not cached.
+     */
+    struct guac_common_ssh_sftp_listing* next;
+
+} guac_common_ssh_sftp_listing;
+
 /**
  * Representation of an SFTP-driven filesystem object. Unlike guac_object, this
  * structure is not tied to any particular user.
@@ -50,7 +252,9 @@ typedef struct guac_common_ssh_sftp_filesystem {
     char* name;
 
     /**
-     * The distinct SSH session used for SFTP.
+     * The SSH session used for SFTP. This session may also be in use by other
+     * channels, and so is locked with guac_common_ssh_session_lock_blocking()
+     * for the duration of each SFTP operation.
      */
     guac_common_ssh_session* ssh_session;
 
@@ -80,6 +284,18 @@ typedef struct guac_common_ssh_sftp_filesystem {
      */
     int disable_upload;
 
+    /**
+     * Lock which guards access to the directory listing cache, including the
+     * reference counts of all listings.
+     */
+    pthread_mutex_t ls_cache_lock;
+
+    /**
+     * Recently-read directory listings, most recently read first, shared
+     * between all users of this filesystem.
+     */
+    guac_common_ssh_sftp_listing* ls_cache;
+
 } guac_common_ssh_sftp_filesystem;
 
 /**
@@ -93,20 +309,20 @@ typedef struct guac_common_ssh_sftp_ls_state {
     guac_common_ssh_sftp_filesystem* filesystem;
 
     /**
-     * Reference to the directory currently being listed over SFTP. This
-     * directory must already be open from a call to libssh2_sftp_opendir().
+     * The contents of the directory being listed. A reference to this
+     * listing is held for as long as the listing operation is in progress.
      */
-    LIBSSH2_SFTP_HANDLE* directory;
+    guac_common_ssh_sftp_listing* listing;
 
     /**
-     * The absolute path of the directory being listed.
+     * The index of the next entry within the listing to be written.
      */
-    char directory_name[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+    int index;
 
     /**
-     * The current state of the JSON directory object being written.
+     * The JSON directory object being written.
      */
-    guac_common_json_state json_state;
+    guac_common_json_writer json_writer;
 
 } guac_common_ssh_sftp_ls_state;
 
@@ -120,8 +336,11 @@ typedef struct guac_common_ssh_sftp_ls_state {
  * filesystem guac_object via guac_common_ssh_alloc_sftp_filesystem_object().
  *
  * @param session
- *     The session to use to provide SFTP. This session will automatically be
- *     destroyed when this filesystem is destroyed.
+ *     The session to use to provide SFTP. This session may also be used by
+ *     other channels, such as the terminal of an SSH connection, provided
+ *     that all other use of the session occurs while holding its lock (see
+ *     guac_common_ssh_session_lock()). This session is not destroyed when
+ *     this filesystem is destroyed.
  *
  * @param root_path
  *     The path accessible via SFTP to consider the root path of the filesystem
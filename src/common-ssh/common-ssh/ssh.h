@@ -24,6 +24,7 @@
 
 #include <guacamole/client.h>
 #include <libssh2.h>
+#include <pthread.h>
 
 /**
  * Handler for retrieving additional credentials.
@@ -73,6 +74,29 @@ typedef struct guac_common_ssh_session {
      */
     guac_ssh_credential_handler* credential_handler;
 
+    /**
+     * Lock which must be held while the underlying libssh2 session is in use
+     * by any thread, as libssh2 sessions may not be used by multiple threads
+     * at once (see guac_common_ssh_session_lock()).
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Whether the underlying libssh2 session was in blocking mode before it was
+     * placed in blocking mode by guac_common_ssh_session_lock_blocking().
+     *
+     * NOTE: This value is protected by lock.
+     */
+    int was_blocking;
+
+    /**
+     * A pipe that is written to each time guac_common_ssh_session_unlock_blocking()
+     * is called, if this session has been shared with
+     * guac_common_ssh_session_share(), or -1 for both ends if this session is
+     * not shared.
+     */
+    int share_pipe[2];
+
 } guac_common_ssh_session;
 
 /**
@@ -155,5 +179,70 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
  */
 void guac_common_ssh_destroy_session(guac_common_ssh_session* session);
 
+/**
+ * Acquires exclusive access to the underlying libssh2 session of the given
+ * SSH session. This must be held while using that libssh2 session, or any of
+ * its channels, from any thread that may not be the only thread using the
+ * session. The blocking mode of the session is not changed.
+ *
+ * @param session
+ *     The SSH session to acquire exclusive access to.
+ */
+void guac_common_ssh_session_lock(guac_common_ssh_session* session);
+
+/**
+ * Relinquishes exclusive access to the underlying libssh2 session of the
+ * given SSH session, as acquired with guac_common_ssh_session_lock().
+ *
+ * @param session
+ *     The SSH session to relinquish exclusive access to.
+ */
+void guac_common_ssh_session_unlock(guac_common_ssh_session* session);
+
+/**
+ * Acquires exclusive access to the underlying libssh2 session of the given
+ * SSH session, placing that session in blocking mode until access is
+ * relinquished with guac_common_ssh_session_unlock_blocking(). This allows
+ * blocking operations, such as SFTP requests, to use a session that is
+ * otherwise used in non-blocking mode by another thread.
+ *
+ * @param session
+ *     The SSH session to acquire exclusive access to.
+ */
+void guac_common_ssh_session_lock_blocking(guac_common_ssh_session* session);
+
+/**
+ * Relinquishes exclusive access to the underlying libssh2 session of the
+ * given SSH session, as acquired with guac_common_ssh_session_lock_blocking(),
+ * restoring the blocking mode that session had previously. If the session has
+ * been shared with guac_common_ssh_session_share(), the file descriptor
+ * returned by that function becomes readable.
+ *
+ * @param session
+ *     The SSH session to relinquish exclusive access to.
+ */
+void guac_common_ssh_session_unlock_blocking(guac_common_ssh_session* session);
+
+/**
+ * Prepares the given SSH session for use by blocking operations performed by
+ * other threads, such as SFTP requests, while the calling thread continues to
+ * wait for data on other channels of the same session. While one of those
+ * blocking operations is in progress, libssh2 may receive data on behalf of
+ * the channels of the calling thread, and that data will be readable from
+ * those channels without any further data arriving on the session's socket.
+ * The calling thread must therefore wait on the returned file descriptor in
+ * addition to the session's socket, reading and discarding whatever data is
+ * available from that file descriptor before attempting to read its channels.
+ *
+ * @param session
+ *     The SSH session to share.
+ *
+ * @return
+ *     A non-blocking file descriptor that becomes readable each time a
+ *     blocking operation by another thread completes, or -1 if the session
+ *     could not be shared.
+ */
+int guac_common_ssh_session_share(guac_common_ssh_session* session);
+
 #endif
 
@@ -26,11 +26,13 @@
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/string.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 #include <libssh2.h>
 
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -104,7 +106,10 @@ int guac_common_ssh_sftp_normalize_path(char* fullpath,
 
 /**
  * Translates the last error message received by the SFTP layer of an SSH
- * session into a Guacamole protocol status code.
+ * session into a Guacamole protocol status code. The SSH session must be
+ * locked with guac_common_ssh_session_lock_blocking() from the failed
+ * operation until this function returns, as the last error would otherwise be
+ * overwritten by any operation performed by another thread.
  *
  * @param filesystem
  *     The object (not guac_object) defining the filesystem associated with the
@@ -284,11 +289,475 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 
 }
 
+/**
+ * Frees the given directory listing and all of its entries. The listing must
+ * no longer be referenced.
+ *
+ * @param listing
+ *     The directory listing to free.
+ */
+static void guac_common_ssh_sftp_listing_free(
+        guac_common_ssh_sftp_listing* listing) {
+
+    for (int i = 0; i < listing->length; i++)
+        guac_mem_free(listing->entries[i].name);
+
+    guac_mem_free(listing->entries);
+    guac_mem_free(listing);
+
+}
+
+/**
+ * Releases a reference to the given directory listing, freeing the listing if
+ * no references remain. The ls_cache_lock of the filesystem must be held.
+ *
+ * @param listing
+ *     The directory listing to release.
+ */
+static void guac_common_ssh_sftp_listing_unref(
+        guac_common_ssh_sftp_listing* listing) {
+
+    if (--listing->refcount == 0)
+        guac_common_ssh_sftp_listing_free(listing);
+
+}
+
+/**
+ * Releases a reference to the given directory listing, acquiring the
+ * ls_cache_lock of the given filesystem for the duration of the call.
+ *
+ * @param filesystem
+ *     The SFTP filesystem that the directory listing was read from.
+ *
+ * @param listing
+ *     The directory listing to release.
+ */
+static void guac_common_ssh_sftp_listing_release(
+        guac_common_ssh_sftp_filesystem* filesystem,
+        guac_common_ssh_sftp_listing* listing) {
+
+    pthread_mutex_lock(&filesystem->ls_cache_lock);
+    guac_common_ssh_sftp_listing_unref(listing);
+    pthread_mutex_unlock(&filesystem->ls_cache_lock);
+
+}
+
+/**
+ * Removes all directory listings from the cache of the given filesystem.
+ * Listings which are still being sent to users remain valid until those
+ * operations complete. This must be invoked whenever the contents of the
+ * filesystem may have been changed through this filesystem.
+ *
+ * @param filesystem
+ *     The SFTP filesystem whose directory listing cache should be cleared.
+ */
+static void guac_common_ssh_sftp_ls_cache_clear(
+        guac_common_ssh_sftp_filesystem* filesystem) {
+
+    pthread_mutex_lock(&filesystem->ls_cache_lock);
+
+    guac_common_ssh_sftp_listing* current = filesystem->ls_cache;
+    while (current != NULL) {
+        guac_common_ssh_sftp_listing* next = current->next;
+        guac_common_ssh_sftp_listing_unref(current);
+        current = next;
+    }
+
+    filesystem->ls_cache = NULL;
+
+    pthread_mutex_unlock(&filesystem->ls_cache_lock);
+
+}
+
+/**
+ * Returns a new reference to the cached listing of the given directory, if
+ * such a listing exists and has not expired. Expired listings encountered
+ * while searching the cache are removed. The returned reference must
+ * eventually be released with guac_common_ssh_sftp_listing_release().
+ *
+ * @param filesystem
+ *     The SFTP filesystem whose directory listing cache should be searched.
+ *
+ * @param name
+ *     The absolute path of the directory, relative to the root of the
+ *     filesystem object.
+ *
+ * @return
+ *     A new reference to the cached listing of the given directory, or NULL
+ *     if no valid listing is cached.
+ */
+static guac_common_ssh_sftp_listing* guac_common_ssh_sftp_ls_cache_get(
+        guac_common_ssh_sftp_filesystem* filesystem, const char* name) {
+
+    guac_common_ssh_sftp_listing* found = NULL;
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&filesystem->ls_cache_lock);
+
+    guac_common_ssh_sftp_listing** current = &filesystem->ls_cache;
+    while (*current != NULL) {
+
+        guac_common_ssh_sftp_listing* listing = *current;
+
+        /* Drop any expired listings */
+        if (now - listing->timestamp > GUAC_COMMON_SSH_SFTP_LS_CACHE_TTL) {
+            *current = listing->next;
+            guac_common_ssh_sftp_listing_unref(listing);
+            continue;
+        }
+
+        if (found == NULL && strcmp(listing->directory_name, name) == 0) {
+            listing->refcount++;
+            found = listing;
+        }
+
+        current = &listing->next;
+
+    }
+
+    pthread_mutex_unlock(&filesystem->ls_cache_lock);
+    return found;
+
+}
+
+/**
+ * Adds the given directory listing to the cache of the given filesystem,
+ * replacing any existing listing of the same directory and discarding the
+ * least-recently-read listing if the cache is full. Listings having more than
+ * GUAC_COMMON_SSH_SFTP_LS_CACHE_MAX_ENTRIES entries are not cached. The
+ * reference held by the caller is not affected.
+ *
+ * @param filesystem
+ *     The SFTP filesystem whose directory listing cache should receive the
+ *     listing.
+ *
+ * @param listing
+ *     The directory listing to cache.
+ */
+static void guac_common_ssh_sftp_ls_cache_put(
+        guac_common_ssh_sftp_filesystem* filesystem,
+        guac_common_ssh_sftp_listing* listing) {
+
+    if (listing->length > GUAC_COMMON_SSH_SFTP_LS_CACHE_MAX_ENTRIES)
+        return;
+
+    pthread_mutex_lock(&filesystem->ls_cache_lock);
+
+    /* Add as most recently read listing */
+    listing->refcount++;
+    listing->next = filesystem->ls_cache;
+    filesystem->ls_cache = listing;
+
+    /* Remove any older listing of the same directory, as well as any
+     * listings beyond the size of the cache */
+    int count = 1;
+    guac_common_ssh_sftp_listing** current = &listing->next;
+    while (*current != NULL) {
+
+        guac_common_ssh_sftp_listing* cached = *current;
+
+        if (count >= GUAC_COMMON_SSH_SFTP_LS_CACHE_SIZE
+                || strcmp(cached->directory_name, listing->directory_name) == 0) {
+            *current = cached->next;
+            guac_common_ssh_sftp_listing_unref(cached);
+            continue;
+        }
+
+        count++;
+        current = &cached->next;
+
+    }
+
+    pthread_mutex_unlock(&filesystem->ls_cache_lock);
+
+}
+
+/**
+ * Reads the full contents of the given directory from the SFTP server into a
+ * new directory listing. The returned listing holds a single reference which
+ * must eventually be released with guac_common_ssh_sftp_listing_release().
+ *
+ * @param user
+ *     The user requesting the directory listing.
+ *
+ * @param filesystem
+ *     The SFTP filesystem containing the directory.
+ *
+ * @param fullpath
+ *     The absolute path of the directory on the SFTP server.
+ *
+ * @param name
+ *     The absolute path of the directory, relative to the root of the
+ *     filesystem object.
+ *
+ * @return
+ *     A new directory listing, or NULL if the directory could not be read.
+ */
+static guac_common_ssh_sftp_listing* guac_common_ssh_sftp_listing_read(
+        guac_user* user, guac_common_ssh_sftp_filesystem* filesystem,
+        const char* fullpath, const char* name) {
+
+    LIBSSH2_SFTP* sftp = filesystem->sftp_session;
+    guac_common_ssh_session* session = filesystem->ssh_session;
+
+    char filename[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+
+    guac_common_ssh_sftp_listing* listing =
+        guac_mem_zalloc(sizeof(guac_common_ssh_sftp_listing));
+
+    /* Bail out if directory name is too long to store */
+    if (guac_strlcpy(listing->directory_name, name,
+                sizeof(listing->directory_name))
+            >= sizeof(listing->directory_name)) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to read directory "
+                "\"%s\": Path too long", fullpath);
+        guac_mem_free(listing);
+        return NULL;
+    }
+
+    /* Open as directory */
+    guac_common_ssh_session_lock_blocking(session);
+    LIBSSH2_SFTP_HANDLE* dir = libssh2_sftp_opendir(sftp, fullpath);
+    guac_common_ssh_session_unlock_blocking(session);
+    if (dir == NULL) {
+        guac_user_log(user, GUAC_LOG_INFO,
+                "Unable to read directory \"%s\"", fullpath);
+        guac_mem_free(listing);
+        return NULL;
+    }
+
+    /* Read all directory entries (the session is locked only for each
+     * individual request, such that other channels are not starved while
+     * large directories are read) */
+    for (;;) {
+
+        guac_common_ssh_session_lock_blocking(session);
+        int result = libssh2_sftp_readdir(dir, filename, sizeof(filename),
+                &attributes);
+        guac_common_ssh_session_unlock_blocking(session);
+
+        if (result <= 0)
+            break;
+
+        char absolute_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+
+        /* Skip current and parent directory entries */
+        if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
+            continue;
+
+        /* Concatenate into absolute path - skip if invalid */
+        if (!guac_ssh_append_filename(absolute_path, name, filename)) {
+
+            guac_user_log(user, GUAC_LOG_DEBUG,
+                    "Skipping filename \"%s\" - filename is invalid or "
+                    "resulting path is too long", filename);
+
+            continue;
+        }
+
+        /* Stat explicitly if symbolic link (might point to directory) */
+        if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions)) {
+
+            char link_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
+            if (guac_ssh_append_filename(link_path, fullpath, filename)) {
+                guac_common_ssh_session_lock_blocking(session);
+                libssh2_sftp_stat(sftp, link_path, &attributes);
+                guac_common_ssh_session_unlock_blocking(session);
+            }
+
+        }
+
+        /* Grow entry storage as needed */
+        if (listing->length == listing->size) {
+            listing->size = listing->size ? listing->size * 2 : 64;
+            listing->entries = guac_mem_realloc(listing->entries,
+                    sizeof(guac_common_ssh_sftp_ls_entry), listing->size);
+        }
+
+        guac_common_ssh_sftp_ls_entry* entry =
+            &listing->entries[listing->length++];
+
+        entry->name = guac_strdup(absolute_path);
+        entry->directory = LIBSSH2_SFTP_S_ISDIR(attributes.permissions);
+
+    }
+
+    guac_common_ssh_session_lock_blocking(session);
+    libssh2_sftp_closedir(dir);
+    guac_common_ssh_session_unlock_blocking(session);
+
+    listing->timestamp = guac_timestamp_current();
+    listing->refcount = 1;
+    return listing;
+
+}
+
+/**
+ * Writes the given data to the given file in its entirety, retrying as
+ * necessary until all data has been written.
+ *
+ * @param session
+ *     The SSH session associated with the SFTP session of the file being
+ *     written to.
+ *
+ * @param file
+ *     The file being written to.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     Zero if all data was written successfully, non-zero otherwise.
+ */
+static int guac_common_ssh_sftp_write(guac_common_ssh_session* session,
+        LIBSSH2_SFTP_HANDLE* file, const char* data, int length) {
+
+    while (length > 0) {
+
+        guac_common_ssh_session_lock_blocking(session);
+        ssize_t bytes_written = libssh2_sftp_write(file, data, length);
+        guac_common_ssh_session_unlock_blocking(session);
+
+        if (bytes_written <= 0)
+            return 1;
+
+        data += bytes_written;
+        length -= bytes_written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes the pending buffer of the given upload to the file being uploaded,
+ * noting within the upload any failure to do so.
+ *
+ * @param data
+ *     A pointer to the guac_common_ssh_sftp_upload of the upload.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_common_ssh_sftp_writer_thread(void* data) {
+
+    guac_common_ssh_sftp_upload* upload = (guac_common_ssh_sftp_upload*) data;
+
+    if (guac_common_ssh_sftp_write(upload->session, upload->file,
+                upload->pending_buffer, upload->pending_length))
+        upload->failed = 1;
+
+    return NULL;
+
+}
+
+/**
+ * Waits for the writer thread of the given upload to finish writing its
+ * pending buffer, if that thread is running.
+ *
+ * @param upload
+ *     The upload whose writer thread should be waited for.
+ */
+static void guac_common_ssh_sftp_upload_wait(guac_common_ssh_sftp_upload* upload) {
+
+    if (upload->writing) {
+        pthread_join(upload->writer, NULL);
+        upload->writing = 0;
+    }
+
+}
+
+/**
+ * Writes all data buffered for the given upload, beginning writes of full
+ * buffers in the background where possible. Only one buffer is written in the
+ * background at any time. If a buffer is already being written, this function
+ * blocks until that write completes.
+ *
+ * @param upload
+ *     The upload whose buffered data should be written.
+ *
+ * @param wait
+ *     Non-zero if this function should not return until all buffered data has
+ *     been written, zero if the data may be written in the background.
+ */
+static void guac_common_ssh_sftp_upload_flush(guac_common_ssh_sftp_upload* upload,
+        int wait) {
+
+    /* Only one buffer may be written at a time */
+    guac_common_ssh_sftp_upload_wait(upload);
+
+    if (upload->failed || upload->length == 0)
+        return;
+
+    /* Hand buffered data to a new writer thread */
+    char* buffer = upload->pending_buffer;
+    upload->pending_buffer = upload->buffer;
+    upload->pending_length = upload->length;
+    upload->buffer = buffer;
+    upload->length = 0;
+
+    /* Write directly if a background write is not wanted or not possible */
+    if (wait || pthread_create(&upload->writer, NULL,
+                guac_common_ssh_sftp_writer_thread, upload))
+        guac_common_ssh_sftp_writer_thread(upload);
+    else
+        upload->writing = 1;
+
+}
+
+/**
+ * Allocates the state of a new upload to the given file.
+ *
+ * @param session
+ *     The SSH session associated with the SFTP session of the file being
+ *     uploaded.
+ *
+ * @param file
+ *     The open file being uploaded.
+ *
+ * @return
+ *     A newly-allocated guac_common_ssh_sftp_upload, which must eventually be
+ *     freed with guac_common_ssh_sftp_upload_free().
+ */
+static guac_common_ssh_sftp_upload* guac_common_ssh_sftp_upload_alloc(
+        guac_common_ssh_session* session, LIBSSH2_SFTP_HANDLE* file) {
+
+    guac_common_ssh_sftp_upload* upload = guac_mem_zalloc(sizeof(guac_common_ssh_sftp_upload));
+    upload->session = session;
+    upload->file = file;
+    upload->buffer = guac_mem_alloc(GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE);
+    upload->pending_buffer = guac_mem_alloc(GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE);
+
+    return upload;
+
+}
+
+/**
+ * Frees the given upload state, waiting for any in-progress write to
+ * complete. The file being uploaded is not closed.
+ *
+ * @param upload
+ *     The upload state to free.
+ */
+static void guac_common_ssh_sftp_upload_free(guac_common_ssh_sftp_upload* upload) {
+    guac_common_ssh_sftp_upload_wait(upload);
+    guac_mem_free(upload->buffer);
+    guac_mem_free(upload->pending_buffer);
+    guac_mem_free(upload);
+}
+
 /**
  * Handler for blob messages which continue an inbound SFTP data transfer
- * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * should be written.
+ * (upload). Received data is buffered, with each full buffer written in the
+ * background such that receipt of data may be acknowledged without waiting
+ * for the SFTP server. The data associated with the given stream is expected
+ * to be a pointer to the guac_common_ssh_sftp_upload of the file to which the
+ * data should be written, or NULL if that file could not be opened.
  *
  * @param user
  *     The user receiving the blob message.
@@ -308,34 +777,57 @@ static int guac_ssh_append_path(char* fullpath, const char* path_a,
 static int guac_common_ssh_sftp_blob_handler(guac_user* user,
         guac_stream* stream, void* data, int length) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload* upload = (guac_common_ssh_sftp_upload*) stream->data;
+    char* buffer = (char*) data;
+    int received = length;
+
+    /* Buffer received data, writing each full buffer in the background
+     * (writes are still limited to one buffer at a time, bounding the amount
+     * of data that may be received but not yet written) */
+    while (upload != NULL && length > 0 && !upload->failed) {
+
+        int available = GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE - upload->length;
+        if (available > length)
+            available = length;
+
+        memcpy(upload->buffer + upload->length, buffer, available);
+        upload->length += available;
+        buffer += available;
+        length -= available;
+
+        if (upload->length == GUAC_COMMON_SSH_SFTP_UPLOAD_BUFFER_SIZE)
+            guac_common_ssh_sftp_upload_flush(upload, 0);
 
-    /* Attempt write */
-    if (libssh2_sftp_write(file, data, length) == length) {
-        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes written", length);
-        guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
-                GUAC_PROTOCOL_STATUS_SUCCESS);
-        guac_socket_flush(user->socket);
     }
 
-    /* Inform of any errors */
-    else {
+    /* Inform of any errors (failures of background writes are reported with
+     * the acknowledgement of whichever blob follows) */
+    if (upload == NULL || upload->failed) {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to write to file");
         guac_protocol_send_ack(user->socket, stream, "SFTP: Write failed",
                 GUAC_PROTOCOL_STATUS_SERVER_ERROR);
         guac_socket_flush(user->socket);
     }
 
+    else {
+        guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes received", received);
+        guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
+                GUAC_PROTOCOL_STATUS_SUCCESS);
+        guac_socket_flush(user->socket);
+    }
+
     return 0;
 
 }
 
 /**
  * Handler for end messages which terminate an inbound SFTP data transfer
- * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * has been written and which should now be closed.
+ * (upload). Any data remaining buffered is written before the file is closed,
+ * and any failure to write that data is reported in the acknowledgement. The
+ * data associated with the given stream is expected to be a pointer to the
+ * guac_common_ssh_sftp_upload of the file to which the data has been
+ * written, or NULL if that file could not be opened.
  *
  * @param user
  *     The user receiving the end message.
@@ -349,23 +841,43 @@ static int guac_common_ssh_sftp_blob_handler(guac_user* user,
 static int guac_common_ssh_sftp_end_handler(guac_user* user,
         guac_stream* stream) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload* upload = (guac_common_ssh_sftp_upload*) stream->data;
+    if (upload == NULL) {
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Write failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
+    /* Write any remaining data */
+    guac_common_ssh_sftp_upload_flush(upload, 1);
+    int failed = upload->failed;
 
     /* Attempt to close file */
-    if (libssh2_sftp_close(file) == 0) {
+    guac_common_ssh_session_lock_blocking(upload->session);
+    int closed = (libssh2_sftp_close(upload->file) == 0);
+    guac_common_ssh_session_unlock_blocking(upload->session);
+    guac_common_ssh_sftp_upload_free(upload);
+    stream->data = NULL;
+
+    if (failed) {
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to write to file");
+        guac_protocol_send_ack(user->socket, stream, "SFTP: Write failed",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+    }
+    else if (closed) {
         guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
         guac_protocol_send_ack(user->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
-        guac_socket_flush(user->socket);
     }
     else {
         guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
         guac_protocol_send_ack(user->socket, stream, "SFTP: Close failed",
                 GUAC_PROTOCOL_STATUS_SERVER_ERROR);
-        guac_socket_flush(user->socket);
     }
 
+    guac_socket_flush(user->socket);
     return 0;
 
 }
@@ -376,6 +888,7 @@ int guac_common_ssh_sftp_handle_file_stream(
 
     char fullpath[GUAC_COMMON_SSH_SFTP_MAX_PATH];
     LIBSSH2_SFTP_HANDLE* file;
+    guac_protocol_status status = GUAC_PROTOCOL_STATUS_SUCCESS;
 
     /* Ignore upload if uploads have been disabled */
     if (filesystem->disable_upload) {
@@ -406,10 +919,15 @@ int guac_common_ssh_sftp_handle_file_stream(
         return 0;
     }
 
-    /* Open file via SFTP */
+    /* Open file via SFTP (the status of any failure must be read before
+     * other operations may use the session) */
+    guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
     file = libssh2_sftp_open(filesystem->sftp_session, fullpath,
             LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
             S_IRUSR | S_IWUSR);
+    if (file == NULL)
+        status = guac_sftp_get_status(filesystem);
+    guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
 
     /* Inform of status */
     if (file != NULL) {
@@ -426,7 +944,7 @@ int guac_common_ssh_sftp_handle_file_stream(
         guac_user_log(user, GUAC_LOG_INFO,
                 "Unable to open file \"%s\"", fullpath);
         guac_protocol_send_ack(user->socket, stream, "SFTP: Open failed",
-                guac_sftp_get_status(filesystem));
+                status);
         guac_socket_flush(user->socket);
     }
 
@@ -434,92 +952,169 @@ int guac_common_ssh_sftp_handle_file_stream(
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = (file != NULL) ? guac_common_ssh_sftp_upload_alloc(
+            filesystem->ssh_session, file) : NULL;
+
+    /* Cached directory listings may no longer reflect the uploaded file */
+    if (file != NULL)
+        guac_common_ssh_sftp_ls_cache_clear(filesystem);
     return 0;
 
 }
 
 /**
- * Handler for ack messages which continue an outbound SFTP data transfer
- * (download), signaling the current status and requesting additional data.
- * The data associated with the given stream is expected to be a pointer to an
- * open LIBSSH2_SFTP_HANDLE for the file from which the data is to be read.
+ * Read handler for outbound SFTP data transfers (downloads), reading the next
+ * blob of data from the file being downloaded. Data is read from the SFTP
+ * server GUAC_COMMON_SSH_SFTP_READ_AHEAD_SIZE bytes at a time, with each blob
+ * taken from the data already read wherever possible. The data associated
+ * with the stream is expected to be a pointer to the
+ * guac_common_ssh_sftp_download of the file from which the data is to be
+ * read.
  *
  * @param user
- *     The user receiving the ack message.
+ *     The user receiving the file.
  *
  * @param stream
- *     The Guacamole protocol stream associated with the received ack message.
+ *     The Guacamole protocol stream along which the file is being sent.
  *
- * @param message
- *     An arbitrary human-readable message describing the nature of the
- *     success or failure denoted by the ack message.
+ * @param data
+ *     The guac_common_ssh_sftp_download of the file being sent.
  *
- * @param status
- *     The status code associated with the ack message, which may indicate
- *     success or an error.
+ * @param buffer
+ *     The buffer that should receive the data read from the file.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
  *
  * @return
- *     Zero if the file is read from successfully, or non-zero on error.
+ *     The number of bytes read, zero if the end of the file has been reached,
+ *     or a negative value on error.
  */
-static int guac_common_ssh_sftp_ack_handler(guac_user* user,
-        guac_stream* stream, char* message, guac_protocol_status status) {
+static int guac_common_ssh_sftp_read_handler(guac_user* user,
+        guac_stream* stream, void* data, char* buffer, int length) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    guac_common_ssh_sftp_download* download = (guac_common_ssh_sftp_download*) data;
 
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+    /* Read ahead only once all previously-read data has been sent */
+    if (download->offset == download->length) {
 
-        /* Attempt read into buffer */
-        char buffer[4096];
-        int bytes_read = libssh2_sftp_read(file, buffer, sizeof(buffer)); 
+        guac_common_ssh_session_lock_blocking(download->session);
+        int bytes_read = libssh2_sftp_read(download->file, download->buffer,
+                sizeof(download->buffer));
+        guac_common_ssh_session_unlock_blocking(download->session);
+        if (bytes_read <= 0)
+            return bytes_read;
 
-        /* If bytes read, send as blob */
-        if (bytes_read > 0) {
-            guac_protocol_send_blob(user->socket, stream,
-                    buffer, bytes_read);
+        download->offset = 0;
+        download->length = bytes_read;
 
-            guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes sent to user",
-                    bytes_read);
+    }
 
-        }
+    int available = download->length - download->offset;
+    if (length > available)
+        length = available;
 
-        /* If bytes could not be read, handle EOF or error condition */
-        else {
+    memcpy(buffer, download->buffer + download->offset, length);
+    download->offset += length;
 
-            /* If EOF, send end */
-            if (bytes_read == 0) {
-                guac_user_log(user, GUAC_LOG_DEBUG, "File sent");
-                guac_protocol_send_end(user->socket, stream);
-                guac_user_free_stream(user, stream);
-            }
+    guac_user_log(user, GUAC_LOG_DEBUG, "%i bytes sent to user", length);
+    return length;
 
-            /* Otherwise, fail stream */
-            else {
-                guac_user_log(user, GUAC_LOG_INFO, "Error reading file");
-                guac_protocol_send_end(user->socket, stream);
-                guac_user_free_stream(user, stream);
-            }
+}
 
-            /* Close file */
-            if (libssh2_sftp_close(file) == 0)
-                guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
-            else
-                guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+/**
+ * Complete handler for outbound SFTP data transfers (downloads), closing the
+ * file that was being downloaded and freeing its download state.
+ *
+ * @param user
+ *     The user that was receiving the file.
+ *
+ * @param stream
+ *     The Guacamole protocol stream along which the file was being sent.
+ *
+ * @param data
+ *     The guac_common_ssh_sftp_download of the file that was being sent.
+ *
+ * @param status
+ *     The final status of the transfer.
+ */
+static void guac_common_ssh_sftp_complete_handler(guac_user* user,
+        guac_stream* stream, void* data, guac_protocol_status status) {
 
-        }
+    guac_common_ssh_sftp_download* download = (guac_common_ssh_sftp_download*) data;
 
-        guac_socket_flush(user->socket);
+    if (status == GUAC_PROTOCOL_STATUS_SUCCESS)
+        guac_user_log(user, GUAC_LOG_DEBUG, "File sent");
+    else if (status == GUAC_PROTOCOL_STATUS_SERVER_ERROR)
+        guac_user_log(user, GUAC_LOG_INFO, "Error reading file");
 
-    }
+    /* Close file */
+    guac_common_ssh_session_lock_blocking(download->session);
+    int closed = (libssh2_sftp_close(download->file) == 0);
+    guac_common_ssh_session_unlock_blocking(download->session);
 
-    /* Otherwise, return stream to user */
+    if (closed)
+        guac_user_log(user, GUAC_LOG_DEBUG, "File closed");
     else
+        guac_user_log(user, GUAC_LOG_INFO, "Unable to close file");
+
+    guac_mem_free(download);
+
+}
+
+/**
+ * Allocates a new stream which sends the contents of the given file to the
+ * given user, keeping multiple blobs in flight. The caller must begin the
+ * stream (with a "file" or "body" instruction) once it has been returned.
+ *
+ * @param user
+ *     The user that will receive the file.
+ *
+ * @param session
+ *     The SSH session associated with the SFTP session of the file to send.
+ *
+ * @param file
+ *     The open file to send. This file will be closed automatically once the
+ *     stream has ended.
+ *
+ * @return
+ *     The newly-allocated stream, or NULL if the stream could not be set up,
+ *     in which case the file is closed.
+ */
+static guac_stream* guac_common_ssh_sftp_alloc_download_stream(guac_user* user,
+        guac_common_ssh_session* session, LIBSSH2_SFTP_HANDLE* file) {
+
+    guac_stream* stream = guac_user_alloc_stream(user);
+    if (stream == NULL) {
+        guac_common_ssh_session_lock_blocking(session);
+        libssh2_sftp_close(file);
+        guac_common_ssh_session_unlock_blocking(session);
+        return NULL;
+    }
+
+    /* Downloads receive only bandwidth not needed by the display */
+    stream->priority = GUAC_SOCKET_PRIORITY_BULK;
+
+    guac_common_ssh_sftp_download* download = guac_mem_alloc(sizeof(guac_common_ssh_sftp_download));
+    download->session = session;
+    download->file = file;
+    download->offset = 0;
+    download->length = 0;
+
+    if (guac_user_stream_windowed(user, stream, GUAC_USER_STREAM_WINDOW_SIZE,
+                guac_common_ssh_sftp_read_handler,
+                guac_common_ssh_sftp_complete_handler, download)) {
         guac_user_free_stream(user, stream);
+        guac_common_ssh_session_lock_blocking(session);
+        libssh2_sftp_close(file);
+        guac_common_ssh_session_unlock_blocking(session);
+        guac_mem_free(download);
+        return NULL;
+    }
+
+    return stream;
 
-    return 0;
 }
 
 guac_stream* guac_common_ssh_sftp_download_file(
@@ -539,8 +1134,10 @@ guac_stream* guac_common_ssh_sftp_download_file(
     }
 
     /* Attempt to open file for reading */
+    guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
     file = libssh2_sftp_open(filesystem->sftp_session, filename,
             LIBSSH2_FXF_READ, 0);
+    guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
     if (file == NULL) {
         guac_user_log(user, GUAC_LOG_INFO, 
                 "Unable to read file \"%s\"", filename);
@@ -548,9 +1145,13 @@ guac_stream* guac_common_ssh_sftp_download_file(
     }
 
     /* Allocate stream */
-    stream = guac_user_alloc_stream(user);
-    stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-    stream->data = file;
+    stream = guac_common_ssh_sftp_alloc_download_stream(user,
+            filesystem->ssh_session, file);
+    if (stream == NULL) {
+        guac_user_log(user, GUAC_LOG_INFO,
+                "Unable to allocate stream for file \"%s\"", filename);
+        return NULL;
+    }
 
     /* Send stream start, strip name */
     filename = basename(filename);
@@ -584,107 +1185,63 @@ void guac_common_ssh_sftp_set_upload_path(
 }
 
 /**
- * Handler for ack messages received due to receipt of a "body" or "blob"
- * instruction associated with a SFTP directory list operation.
- *
- * @param user
- *     The user receiving the ack message.
- *
- * @param stream
- *     The Guacamole protocol stream associated with the received ack message.
+ * Read handler for SFTP directory listing streams, supplying the next blob of
+ * the JSON directory object and writing further entries of the listing only
+ * as needed to fill that blob.
  *
- * @param message
- *     An arbitrary human-readable message describing the nature of the
- *     success or failure denoted by this ack message.
- *
- * @param status
- *     The status code associated with this ack message, which may indicate
- *     success or an error.
- *
- * @return
- *     Zero on success, non-zero on error.
+ * @see guac_user_stream_read_handler
  */
-static int guac_common_ssh_sftp_ls_ack_handler(guac_user* user,
-        guac_stream* stream, char* message, guac_protocol_status status) {
-
-    int bytes_read;
-
-    char filename[GUAC_COMMON_SSH_SFTP_MAX_PATH];
-    LIBSSH2_SFTP_ATTRIBUTES attributes;
+static int guac_common_ssh_sftp_ls_read_handler(guac_user* user,
+        guac_stream* stream, void* data, char* buffer, int length) {
 
     guac_common_ssh_sftp_ls_state* list_state =
-        (guac_common_ssh_sftp_ls_state*) stream->data;
-
-    guac_common_ssh_sftp_filesystem* filesystem = list_state->filesystem;
-
-    LIBSSH2_SFTP* sftp = filesystem->sftp_session;
-
-    /* If unsuccessful, free stream and abort */
-    if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
-        libssh2_sftp_closedir(list_state->directory);
-        guac_user_free_stream(user, stream);
-        guac_mem_free(list_state);
-        return 0;
-    }
-
-    /* While directory entries remain */
-    while ((bytes_read = libssh2_sftp_readdir(list_state->directory,
-                filename, sizeof(filename), &attributes)) > 0) {
+        (guac_common_ssh_sftp_ls_state*) data;
 
-        char absolute_path[GUAC_COMMON_SSH_SFTP_MAX_PATH];
-
-        /* Skip current and parent directory entries */
-        if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
-            continue;
-
-        /* Concatenate into absolute path - skip if invalid */
-        if (!guac_ssh_append_filename(absolute_path, 
-                    list_state->directory_name, filename)) {
-
-            guac_user_log(user, GUAC_LOG_DEBUG,
-                    "Skipping filename \"%s\" - filename is invalid or "
-                    "resulting path is too long", filename);
+    guac_common_ssh_sftp_listing* listing = list_state->listing;
+    guac_common_json_writer* json_writer = &list_state->json_writer;
 
-            continue;
-        }
+    /* Write entries until enough JSON is pending to fill a blob */
+    while (list_state->index < listing->length
+            && guac_common_json_writer_pending(json_writer) < length) {
 
-        /* Stat explicitly if symbolic link (might point to directory) */
-        if (LIBSSH2_SFTP_S_ISLNK(attributes.permissions))
-            libssh2_sftp_stat(sftp, absolute_path, &attributes);
+        guac_common_ssh_sftp_ls_entry* entry =
+            &listing->entries[list_state->index++];
 
         /* Determine mimetype */
         const char* mimetype;
-        if (LIBSSH2_SFTP_S_ISDIR(attributes.permissions))
+        if (entry->directory)
             mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
         else
             mimetype = "application/octet-stream";
 
-        /* Write entry, waiting for next ack if a blob is written */
-        if (guac_common_json_write_property(user, stream,
-                    &list_state->json_state, absolute_path, mimetype))
-            break;
+        guac_common_json_writer_property(json_writer, entry->name, mimetype);
 
-    }
+        /* Complete JSON object after final entry */
+        if (list_state->index >= listing->length)
+            guac_common_json_writer_end(json_writer);
 
-    /* Complete JSON and cleanup at end of directory */
-    if (bytes_read <= 0) {
+    }
 
-        /* Complete JSON object */
-        guac_common_json_end_object(user, stream, &list_state->json_state);
-        guac_common_json_flush(user, stream, &list_state->json_state);
+    return guac_common_json_writer_read(json_writer, buffer, length);
 
-        /* Clean up resources */
-        libssh2_sftp_closedir(list_state->directory);
-        guac_mem_free(list_state);
+}
 
-        /* Signal of stream */
-        guac_protocol_send_end(user->socket, stream);
-        guac_user_free_stream(user, stream);
+/**
+ * Complete handler for SFTP directory listing streams, releasing the listing
+ * and all listing state.
+ *
+ * @see guac_user_stream_complete_handler
+ */
+static void guac_common_ssh_sftp_ls_complete_handler(guac_user* user,
+        guac_stream* stream, void* data, guac_protocol_status status) {
 
-    }
+    guac_common_ssh_sftp_ls_state* list_state =
+        (guac_common_ssh_sftp_ls_state*) data;
 
-    guac_socket_flush(user->socket);
-    return 0;
+    guac_common_ssh_sftp_listing_release(list_state->filesystem,
+            list_state->listing);
+    guac_common_json_writer_free(&list_state->json_writer);
+    guac_mem_free(list_state);
 
 }
 
@@ -755,49 +1312,72 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         return 0;
     }
 
+    /* Send recently-read directory listings without contacting the SFTP
+     * server */
+    guac_common_ssh_sftp_listing* listing =
+        guac_common_ssh_sftp_ls_cache_get(filesystem, name);
+
     /* Attempt to read file information */
-    if (libssh2_sftp_stat(sftp, fullpath, &attributes)) {
-        guac_user_log(user, GUAC_LOG_INFO, "Unable to read file \"%s\"",
-                fullpath);
-        return 0;
+    if (listing == NULL) {
+
+        guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
+        int failed = libssh2_sftp_stat(sftp, fullpath, &attributes);
+        guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
+
+        if (failed) {
+            guac_user_log(user, GUAC_LOG_INFO, "Unable to read file \"%s\"",
+                    fullpath);
+            return 0;
+        }
+
     }
 
     /* If directory, send contents of directory */
-    if (LIBSSH2_SFTP_S_ISDIR(attributes.permissions)) {
+    if (listing != NULL || LIBSSH2_SFTP_S_ISDIR(attributes.permissions)) {
+
+        /* Read and cache directory contents if not already cached */
+        if (listing == NULL) {
+
+            listing = guac_common_ssh_sftp_listing_read(user, filesystem,
+                    fullpath, name);
+            if (listing == NULL)
+                return 0;
+
+            guac_common_ssh_sftp_ls_cache_put(filesystem, listing);
 
-        /* Open as directory */
-        LIBSSH2_SFTP_HANDLE* dir = libssh2_sftp_opendir(sftp, fullpath);
-        if (dir == NULL) {
-            guac_user_log(user, GUAC_LOG_INFO,
-                    "Unable to read directory \"%s\"", fullpath);
-            return 0;
         }
 
         /* Init directory listing state */
         guac_common_ssh_sftp_ls_state* list_state =
             guac_mem_alloc(sizeof(guac_common_ssh_sftp_ls_state));
 
-        list_state->directory = dir;
         list_state->filesystem = filesystem;
+        list_state->listing = listing;
+        list_state->index = 0;
 
-        int length = guac_strlcpy(list_state->directory_name, name,
-                sizeof(list_state->directory_name));
+        guac_common_json_writer_init(&list_state->json_writer);
 
-        /* Bail out if directory name is too long to store */
-        if (length >= sizeof(list_state->directory_name)) {
-            guac_user_log(user, GUAC_LOG_INFO, "Unable to read directory "
-                    "\"%s\": Path too long", fullpath);
-            guac_mem_free(list_state);
-            return 0;
-        }
+        /* An empty directory is complete as soon as it begins */
+        if (listing->length == 0)
+            guac_common_json_writer_end(&list_state->json_writer);
 
-        /* Allocate stream for body */
+        /* Allocate stream for body, keeping multiple blobs in flight */
         guac_stream* stream = guac_user_alloc_stream(user);
-        stream->ack_handler = guac_common_ssh_sftp_ls_ack_handler;
-        stream->data = list_state;
+        if (stream == NULL || guac_user_stream_windowed(user, stream,
+                    GUAC_USER_STREAM_WINDOW_SIZE,
+                    guac_common_ssh_sftp_ls_read_handler,
+                    guac_common_ssh_sftp_ls_complete_handler, list_state)) {
 
-        /* Init JSON object state */
-        guac_common_json_begin_object(user, stream, &list_state->json_state);
+            guac_common_ssh_sftp_listing_release(filesystem, listing);
+            guac_common_json_writer_free(&list_state->json_writer);
+            guac_mem_free(list_state);
+
+            if (stream != NULL)
+                guac_user_free_stream(user, stream);
+
+            return 0;
+
+        }
 
         /* Associate new stream with get request */
         guac_protocol_send_body(user->socket, object, stream,
@@ -817,8 +1397,10 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         }
         
         /* Open as normal file */
+        guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
         LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(sftp, fullpath,
             LIBSSH2_FXF_READ, 0);
+        guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
         if (file == NULL) {
             guac_user_log(user, GUAC_LOG_INFO,
                     "Unable to read file \"%s\"", fullpath);
@@ -826,9 +1408,13 @@ static int guac_common_ssh_sftp_get_handler(guac_user* user,
         }
 
         /* Allocate stream for body */
-        guac_stream* stream = guac_user_alloc_stream(user);
-        stream->ack_handler = guac_common_ssh_sftp_ack_handler;
-        stream->data = file;
+        guac_stream* stream = guac_common_ssh_sftp_alloc_download_stream(user,
+                filesystem->ssh_session, file);
+        if (stream == NULL) {
+            guac_user_log(user, GUAC_LOG_INFO,
+                    "Unable to allocate stream for file \"%s\"", fullpath);
+            return 0;
+        }
 
         /* Associate new stream with get request */
         guac_protocol_send_body(user->socket, object, stream,
@@ -893,10 +1479,16 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
         return 0;
     }
 
-    /* Open file via SFTP */
+    /* Open file via SFTP (the status of any failure must be read before
+     * other operations may use the session) */
+    guac_protocol_status status = GUAC_PROTOCOL_STATUS_SUCCESS;
+    guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
     LIBSSH2_SFTP_HANDLE* file = libssh2_sftp_open(sftp, fullpath,
             LIBSSH2_FXF_WRITE | LIBSSH2_FXF_CREAT | LIBSSH2_FXF_TRUNC,
             S_IRUSR | S_IWUSR);
+    if (file == NULL)
+        status = guac_sftp_get_status(filesystem);
+    guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
 
     /* Acknowledge stream if successful */
     if (file != NULL) {
@@ -910,15 +1502,20 @@ static int guac_common_ssh_sftp_put_handler(guac_user* user,
         guac_user_log(user, GUAC_LOG_INFO,
                 "Unable to open file \"%s\"", fullpath);
         guac_protocol_send_ack(user->socket, stream, "SFTP: Open failed",
-                guac_sftp_get_status(filesystem));
+                status);
     }
 
     /* Set handlers for file stream */
     stream->blob_handler = guac_common_ssh_sftp_blob_handler;
     stream->end_handler = guac_common_ssh_sftp_end_handler;
 
-    /* Store file within stream */
-    stream->data = file;
+    /* Store upload state within stream */
+    stream->data = (file != NULL) ? guac_common_ssh_sftp_upload_alloc(
+            filesystem->ssh_session, file) : NULL;
+
+    /* Cached directory listings may no longer reflect the uploaded file */
+    if (file != NULL)
+        guac_common_ssh_sftp_ls_cache_clear(filesystem);
 
     guac_socket_flush(user->socket);
     return 0;
@@ -964,7 +1561,9 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
         const char* name, int disable_download, int disable_upload) {
 
     /* Request SFTP */
+    guac_common_ssh_session_lock_blocking(session);
     LIBSSH2_SFTP* sftp_session = libssh2_sftp_init(session->session);
+    guac_common_ssh_session_unlock_blocking(session);
     if (sftp_session == NULL)
         return NULL;
 
@@ -980,11 +1579,16 @@ guac_common_ssh_sftp_filesystem* guac_common_ssh_create_sftp_filesystem(
     filesystem->disable_download = disable_download;
     filesystem->disable_upload = disable_upload;
 
+    /* No directory listings are initially cached */
+    pthread_mutex_init(&filesystem->ls_cache_lock, NULL);
+    filesystem->ls_cache = NULL;
+
     /* Normalize and store the provided root path */
     if (!guac_common_ssh_sftp_normalize_path(filesystem->root_path,
                 root_path)) {
         guac_client_log(session->client, GUAC_LOG_WARNING, "Cannot create "
                 "SFTP filesystem - \"%s\" is not a valid path.", root_path);
+        pthread_mutex_destroy(&filesystem->ls_cache_lock);
         guac_mem_free(filesystem);
         return NULL;
     }
@@ -1007,7 +1611,13 @@ void guac_common_ssh_destroy_sftp_filesystem(
         guac_common_ssh_sftp_filesystem* filesystem) {
 
     /* Shutdown SFTP session */
+    guac_common_ssh_session_lock_blocking(filesystem->ssh_session);
     libssh2_sftp_shutdown(filesystem->sftp_session);
+    guac_common_ssh_session_unlock_blocking(filesystem->ssh_session);
+
+    /* Free any cached directory listings */
+    guac_common_ssh_sftp_ls_cache_clear(filesystem);
+    pthread_mutex_destroy(&filesystem->ls_cache_lock);
 
     /* Free associated memory */
     guac_mem_free(filesystem->name);
@@ -480,6 +480,8 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
         return NULL;
     }
 
+    guac_client_startup_phase(client, "tcp_connect");
+
     /* Allocate new session */
     guac_common_ssh_session* common_session =
         guac_mem_alloc(sizeof(guac_common_ssh_session));
@@ -559,12 +561,17 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
         return NULL;
     }
 
+    guac_client_startup_phase(client, "ssh_handshake");
+
     /* Store basic session data */
     common_session->client = client;
     common_session->user = user;
     common_session->session = session;
     common_session->fd = fd;
     common_session->credential_handler = credential_handler;
+    common_session->share_pipe[0] = -1;
+    common_session->share_pipe[1] = -1;
+    pthread_mutex_init(&common_session->lock, NULL);
 
     /* Attempt authentication */
     if (guac_common_ssh_authenticate(common_session)) {
@@ -573,6 +580,8 @@ guac_common_ssh_session* guac_common_ssh_create_session(guac_client* client,
         return NULL;
     }
 
+    guac_client_startup_phase(client, "ssh_auth");
+
     /* Warn if keepalive below minimum value */
     if (keepalive < 0) {
         keepalive = 0;
@@ -598,7 +607,71 @@ void guac_common_ssh_destroy_session(guac_common_ssh_session* session) {
     libssh2_session_disconnect(session->session, "Bye");
     libssh2_session_free(session->session);
 
+    /* Close pipe used to signal completion of blocking operations */
+    if (session->share_pipe[0] != -1) {
+        close(session->share_pipe[0]);
+        close(session->share_pipe[1]);
+    }
+
+    pthread_mutex_destroy(&session->lock);
+
     /* Free all other data */
     guac_mem_free(session);
 
 }
+
+void guac_common_ssh_session_lock(guac_common_ssh_session* session) {
+    pthread_mutex_lock(&session->lock);
+}
+
+void guac_common_ssh_session_unlock(guac_common_ssh_session* session) {
+    pthread_mutex_unlock(&session->lock);
+}
+
+void guac_common_ssh_session_lock_blocking(guac_common_ssh_session* session) {
+
+    pthread_mutex_lock(&session->lock);
+
+    session->was_blocking = libssh2_session_get_blocking(session->session);
+    libssh2_session_set_blocking(session->session, 1);
+
+}
+
+void guac_common_ssh_session_unlock_blocking(guac_common_ssh_session* session) {
+
+    libssh2_session_set_blocking(session->session, session->was_blocking);
+    pthread_mutex_unlock(&session->lock);
+
+    /* Wake any thread waiting for data on other channels, as that data may
+     * have been received during the blocking operation (failure to write is
+     * harmless, as it means the pipe already has unread data) */
+    if (session->share_pipe[1] != -1) {
+        char signal = 0;
+        if (write(session->share_pipe[1], &signal, 1) < 0) {
+            /* Pipe is full - thread will already be woken */
+        }
+    }
+
+}
+
+int guac_common_ssh_session_share(guac_common_ssh_session* session) {
+
+    /* Reuse existing pipe if already shared */
+    if (session->share_pipe[0] != -1)
+        return session->share_pipe[0];
+
+    int share_pipe[2];
+    if (pipe(share_pipe))
+        return -1;
+
+    /* Neither end of the pipe may block, as signals are written while other
+     * threads wait and are read only to be discarded */
+    fcntl(share_pipe[0], F_SETFL, fcntl(share_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(share_pipe[1], F_SETFL, fcntl(share_pipe[1], F_GETFL) | O_NONBLOCK);
+
+    session->share_pipe[0] = share_pipe[0];
+    session->share_pipe[1] = share_pipe[1];
+
+    return share_pipe[0];
+
+}
@@ -27,9 +27,20 @@
 #include <guacamole/string.h>
 #include <guacamole/user.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
+/**
+ * The offset basis of the 64-bit FNV-1a hash used to hash clipboard contents.
+ */
+#define GUAC_COMMON_CLIPBOARD_HASH_OFFSET 0xCBF29CE484222325ULL
+
+/**
+ * The prime of the 64-bit FNV-1a hash used to hash clipboard contents.
+ */
+#define GUAC_COMMON_CLIPBOARD_HASH_PRIME 0x100000001B3ULL
+
 guac_common_clipboard* guac_common_clipboard_alloc(int buffer_size) {
 
     guac_common_clipboard* clipboard = guac_mem_alloc(sizeof(guac_common_clipboard));
@@ -38,7 +49,12 @@ guac_common_clipboard* guac_common_clipboard_alloc(int buffer_size) {
     clipboard->mimetype[0] = '\0';
     clipboard->buffer = guac_mem_alloc(buffer_size);
     clipboard->available = buffer_size;
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_CLIPBOARD, buffer_size);
     clipboard->length = 0;
+    clipboard->broadcast_hash = 0;
+    clipboard->broadcast_users_hash = 0;
+    clipboard->broadcast_valid = 0;
+    clipboard->modified = 0;
 
     pthread_mutex_init(&(clipboard->lock), NULL);
 
@@ -53,6 +69,7 @@ void guac_common_clipboard_free(guac_common_clipboard* clipboard) {
 
     /* Free buffer */
     guac_mem_free(clipboard->buffer);
+    guac_mem_account_free(GUAC_MEM_CATEGORY_CLIPBOARD, clipboard->available);
 
     /* Free base structure */
     guac_mem_free(clipboard);
@@ -121,14 +138,108 @@ static void* __send_user_clipboard(guac_user* user, void* data) {
 
 }
 
+/**
+ * Returns a hash of the mimetype, length, and contents of the given
+ * clipboard, with the contents mixed in eight bytes at a time.
+ *
+ * @param clipboard
+ *     The clipboard to hash.
+ *
+ * @return
+ *     The hash of the clipboard.
+ */
+static uint64_t guac_common_clipboard_hash(guac_common_clipboard* clipboard) {
+
+    uint64_t hash = GUAC_COMMON_CLIPBOARD_HASH_OFFSET;
+
+    /* Mix in mimetype, including its null terminator */
+    const char* mimetype = clipboard->mimetype;
+    do {
+        hash = (hash ^ (unsigned char) *mimetype)
+            * GUAC_COMMON_CLIPBOARD_HASH_PRIME;
+    } while (*(mimetype++) != '\0');
+
+    hash = (hash ^ (uint64_t) clipboard->length)
+        * GUAC_COMMON_CLIPBOARD_HASH_PRIME;
+
+    const char* current = clipboard->buffer;
+    int remaining = clipboard->length;
+
+    /* Mix in contents as whole words while possible */
+    while (remaining >= (int) sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, current, sizeof(word));
+        hash = (hash ^ word) * GUAC_COMMON_CLIPBOARD_HASH_PRIME;
+        current += sizeof(word);
+        remaining -= sizeof(word);
+    }
+
+    /* Mix in any trailing bytes individually */
+    while (remaining > 0) {
+        hash = (hash ^ (unsigned char) *(current++))
+            * GUAC_COMMON_CLIPBOARD_HASH_PRIME;
+        remaining--;
+    }
+
+    return hash;
+
+}
+
+/**
+ * Callback for guac_client_foreach_user() which mixes the ID of each
+ * connected user into a running 64-bit FNV-1a hash.
+ *
+ * @param user
+ *     The user whose ID should be mixed into the hash.
+ *
+ * @param data
+ *     A pointer to the uint64_t containing the running hash.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __hash_user(guac_user* user, void* data) {
+
+    uint64_t* hash = (uint64_t*) data;
+
+    /* Mix in user ID, including its null terminator */
+    const char* user_id = user->user_id;
+    do {
+        *hash = (*hash ^ (unsigned char) *user_id)
+            * GUAC_COMMON_CLIPBOARD_HASH_PRIME;
+    } while (*(user_id++) != '\0');
+
+    return NULL;
+
+}
+
 void guac_common_clipboard_send(guac_common_clipboard* clipboard, guac_client* client) {
 
     pthread_mutex_lock(&(clipboard->lock));
 
+    /* Skip broadcast if all users already hold identical contents */
+    uint64_t hash = guac_common_clipboard_hash(clipboard);
+    uint64_t users_hash = GUAC_COMMON_CLIPBOARD_HASH_OFFSET;
+    guac_client_foreach_user(client, __hash_user, &users_hash);
+
+    if (clipboard->broadcast_valid && clipboard->broadcast_hash == hash
+            && clipboard->broadcast_users_hash == users_hash) {
+        guac_client_log(client, GUAC_LOG_DEBUG, "Clipboard is unchanged. "
+                "Skipping broadcast to connected users.");
+        clipboard->modified = 0;
+        pthread_mutex_unlock(&(clipboard->lock));
+        return;
+    }
+
     guac_client_log(client, GUAC_LOG_DEBUG, "Broadcasting clipboard to all connected users.");
     guac_client_foreach_user(client, __send_user_clipboard, clipboard);
     guac_client_log(client, GUAC_LOG_DEBUG, "Broadcast of clipboard complete.");
 
+    clipboard->broadcast_hash = hash;
+    clipboard->broadcast_users_hash = users_hash;
+    clipboard->broadcast_valid = 1;
+    clipboard->modified = 0;
+
     pthread_mutex_unlock(&(clipboard->lock));
 
 }
@@ -138,8 +249,15 @@ void guac_common_clipboard_reset(guac_common_clipboard* clipboard,
 
     pthread_mutex_lock(&(clipboard->lock));
 
+    /* If the contents being replaced were never broadcast (such as contents
+     * received from a single user), users no longer necessarily share the
+     * same clipboard */
+    if (clipboard->modified)
+        clipboard->broadcast_valid = 0;
+
     /* Clear clipboard contents */
     clipboard->length = 0;
+    clipboard->modified = 1;
 
     /* Assign given mimetype */
     guac_strlcpy(clipboard->mimetype, mimetype, sizeof(clipboard->mimetype));
@@ -148,7 +266,7 @@ void guac_common_clipboard_reset(guac_common_clipboard* clipboard,
 
 }
 
-void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length) {
+int guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length) {
 
     pthread_mutex_lock(&(clipboard->lock));
 
@@ -164,6 +282,7 @@ void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char*
     clipboard->length += length;
 
     pthread_mutex_unlock(&(clipboard->lock));
+    return length;
 
 }
 
@@ -24,6 +24,7 @@
 
 #include <guacamole/client.h>
 #include <pthread.h>
+#include <stdint.h>
 
 /**
  * The maximum number of bytes to send in an individual blob when
@@ -75,6 +76,36 @@ typedef struct guac_common_clipboard {
      */
     int available;
 
+    /**
+     * A hash of the mimetype, length, and contents of the clipboard as of
+     * the last time it was broadcast to all users by
+     * guac_common_clipboard_send(). This value is meaningful only if
+     * broadcast_valid is non-zero.
+     */
+    uint64_t broadcast_hash;
+
+    /**
+     * A hash of the IDs of all users that received the clipboard the last
+     * time it was broadcast to all users by guac_common_clipboard_send().
+     * This value is meaningful only if broadcast_valid is non-zero.
+     */
+    uint64_t broadcast_users_hash;
+
+    /**
+     * Non-zero if every user that received the last broadcast is known to
+     * still hold the clipboard contents described by broadcast_hash, zero
+     * otherwise. This is cleared whenever the clipboard is replaced with
+     * contents that were not then broadcast, such as contents received from
+     * a single user.
+     */
+    int broadcast_valid;
+
+    /**
+     * Non-zero if the clipboard has been reset since it was last broadcast,
+     * zero otherwise.
+     */
+    int modified;
+
 } guac_common_clipboard;
 
 /**
@@ -95,7 +126,9 @@ void guac_common_clipboard_free(guac_common_clipboard* clipboard);
 
 /**
  * Sends the contents of the clipboard along the given client, splitting
- * the contents as necessary.
+ * the contents as necessary. If the clipboard contents are identical to the
+ * contents most recently sent by this function, and the same users that
+ * received those contents are known to still hold them, nothing is sent.
  *
  * @param clipboard
  *     The clipboard whose contents should be sent.
@@ -129,8 +162,13 @@ void guac_common_clipboard_reset(guac_common_clipboard* clipboard, const char* m
  *
  * @param length
  *     The number of bytes to append from the data given.
+ *
+ * @return
+ *     The number of bytes actually appended, which will be less than the
+ *     number of bytes given if the clipboard is full and the data has thus
+ *     been truncated.
  */
-void guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length);
+int guac_common_clipboard_append(guac_common_clipboard* clipboard, const char* data, int length);
 
 #endif
 
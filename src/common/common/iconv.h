@@ -22,6 +22,13 @@
 
 #include "config.h"
 
+/**
+ * The maximum number of bytes that any guac_iconv_write implementation may
+ * write for a single character read from the input string. This is the length
+ * of a four-byte UTF-8 sequence, and of a newline written as CRLF in UTF-16.
+ */
+#define GUAC_ICONV_MAX_CHAR_LENGTH 4
+
 /**
  * Function which reads a character from the given string data, returning
  * the Unicode codepoint read, updating the string pointer to point to the
@@ -56,6 +63,42 @@ typedef void guac_iconv_write(char** output, int remaining, int value);
 int guac_iconv(guac_iconv_read* reader, const char** input, int in_remaining,
                guac_iconv_write* writer, char** output, int out_remaining);
 
+/**
+ * Converts characters within a given string from one encoding to another,
+ * exactly as guac_iconv() does, except that conversion stops once fewer than
+ * GUAC_ICONV_MAX_CHAR_LENGTH bytes of output space remain. Unlike
+ * guac_iconv(), no character is ever read without being written in full due
+ * to lack of output space, and this function may thus be invoked repeatedly
+ * with successive output buffers to convert input of arbitrary length in
+ * fixed-size chunks. The input and output string pointers will be updated
+ * based on the number of bytes read or written.
+ *
+ * @param reader
+ *     The reader function to use when reading the input string.
+ *
+ * @param input
+ *     Pointer to the beginning of the input string.
+ *
+ * @param in_remaining
+ *     The number of bytes remaining after the pointer to the input string.
+ *
+ * @param writer
+ *     The writer function to use when writing the output string.
+ *
+ * @param output
+ *     Pointer to the beginning of the output string.
+ *
+ * @param out_remaining
+ *     The number of bytes remaining after the pointer to the output string.
+ *
+ * @return
+ *     Non-zero if the NULL terminator of the input string was read and copied
+ *     into the destination string, zero otherwise.
+ */
+int guac_iconv_chunk(guac_iconv_read* reader, const char** input,
+        int in_remaining, guac_iconv_write* writer, char** output,
+        int out_remaining);
+
 /**
  * Read function for UTF8.
  */
@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <guacamole/protocol-constants.h>
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 
@@ -34,15 +35,21 @@ typedef struct guac_common_json_state {
     /**
      * Buffer of partial JSON data. The individual blobs which make up the JSON
      * body of the object being sent over the Guacamole protocol will be
-     * built here.
+     * built here. Only the first max_size bytes of this buffer are used.
      */
-    char buffer[4096];
+    char buffer[GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH];
 
     /**
      * The number of bytes currently used within the JSON buffer.
      */
     int size;
 
+    /**
+     * The maximum number of bytes of JSON data to send within each blob. This
+     * is the largest blob supported by the user receiving the JSON object.
+     */
+    int max_size;
+
     /**
      * The number of property name/value pairs written to the JSON object thus
      * far.
@@ -51,6 +58,123 @@ typedef struct guac_common_json_state {
 
 } guac_common_json_state;
 
+/**
+ * The initial number of bytes allocated for the buffer of a
+ * guac_common_json_writer. The buffer grows as necessary.
+ */
+#define GUAC_COMMON_JSON_WRITER_INITIAL_SIZE 4096
+
+/**
+ * An arbitrary JSON object, consisting of any number of property name/value
+ * pairs, that is built in memory and read out in arbitrarily-sized pieces.
+ * Unlike guac_common_json_state, which sends each blob as soon as it fills,
+ * a writer is not tied to any particular stream, and is intended to supply
+ * the data of a stream sent with guac_user_stream_windowed(), such that every
+ * blob is as large as the user supports and multiple blobs may be in flight.
+ */
+typedef struct guac_common_json_writer {
+
+    /**
+     * Buffer containing all JSON data that has been written but not yet read.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes currently used within the buffer.
+     */
+    int size;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    int capacity;
+
+    /**
+     * The number of property name/value pairs written to the JSON object thus
+     * far.
+     */
+    int properties_written;
+
+} guac_common_json_writer;
+
+/**
+ * Initializes the given guac_common_json_writer, writing the opening brace of
+ * a new JSON object. The writer must eventually be freed with
+ * guac_common_json_writer_free().
+ *
+ * @param writer
+ *     The writer to initialize.
+ */
+void guac_common_json_writer_init(guac_common_json_writer* writer);
+
+/**
+ * Frees all memory associated with the given guac_common_json_writer,
+ * discarding any data which has not yet been read. The guac_common_json_writer
+ * structure itself is not freed.
+ *
+ * @param writer
+ *     The writer to free.
+ */
+void guac_common_json_writer_free(guac_common_json_writer* writer);
+
+/**
+ * Writes a property name/value pair to the JSON object of the given
+ * guac_common_json_writer, escaping both strings as necessary.
+ *
+ * @param writer
+ *     The writer to write the property to.
+ *
+ * @param name
+ *     The name of the property being written.
+ *
+ * @param value
+ *     The value of the property being written.
+ */
+void guac_common_json_writer_property(guac_common_json_writer* writer,
+        const char* name, const char* value);
+
+/**
+ * Completes the JSON object of the given guac_common_json_writer by writing
+ * the final terminating brace. No further properties may be written.
+ *
+ * @param writer
+ *     The writer whose JSON object should be completed.
+ */
+void guac_common_json_writer_end(guac_common_json_writer* writer);
+
+/**
+ * Returns the number of bytes of JSON data that have been written to the
+ * given guac_common_json_writer but not yet read.
+ *
+ * @param writer
+ *     The writer to test.
+ *
+ * @return
+ *     The number of bytes of JSON data awaiting guac_common_json_writer_read().
+ */
+int guac_common_json_writer_pending(guac_common_json_writer* writer);
+
+/**
+ * Removes up to the given number of bytes of JSON data from the given
+ * guac_common_json_writer, storing that data within the given buffer in the
+ * order it was written.
+ *
+ * @param writer
+ *     The writer to read from.
+ *
+ * @param buffer
+ *     The buffer that should receive the JSON data.
+ *
+ * @param length
+ *     The maximum number of bytes to store within the buffer.
+ *
+ * @return
+ *     The number of bytes stored within the buffer, which will be zero only
+ *     if no JSON data is pending.
+ */
+int guac_common_json_writer_read(guac_common_json_writer* writer,
+        char* buffer, int length);
+
 /**
  * Given a stream, the user to which it belongs, and the current stream state
  * of a JSON object, flushes the contents of the JSON buffer to a blob
@@ -157,7 +281,8 @@ int guac_common_json_write_property(guac_user* user, guac_stream* stream,
  * Given a stream, the user to which it belongs, and the current stream state
  * of a JSON object, initializes the state for writing a new JSON object. Note
  * that although the user and stream must be provided, no instruction or
- * blobs will be written due to any call to this function.
+ * blobs will be written due to any call to this function. Each blob later
+ * written is as large as the given user supports.
  *
  * @param user
  *     The user associated with the given stream.
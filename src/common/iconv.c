@@ -22,6 +22,31 @@
 
 #include <guacamole/unicode.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Bitmask which, when applied to a 64-bit word, is non-zero only if at least
+ * one byte within that word is not ASCII (has its high bit set).
+ */
+#define GUAC_ICONV_HIGH_BITS 0x8080808080808080ULL
+
+/**
+ * A 64-bit word having the value 1 within each of its bytes.
+ */
+#define GUAC_ICONV_LOW_BITS 0x0101010101010101ULL
+
+/**
+ * Evaluates to non-zero if any byte within the given 64-bit word is zero.
+ *
+ * @param word
+ *     The 64-bit word to test.
+ */
+#define GUAC_ICONV_HAS_ZERO_BYTE(word) \
+    (((word) - GUAC_ICONV_LOW_BITS) & ~(word) & GUAC_ICONV_HIGH_BITS)
 
 /**
  * Lookup table for Unicode code points, indexed by CP-1252 codepoint.
@@ -61,10 +86,331 @@ const static int __GUAC_RDP_CP1252_CODEPOINT[32] = {
     0x0178, /* 0x9F */
 };
 
-int guac_iconv(guac_iconv_read* reader, const char** input, int in_remaining,
-               guac_iconv_write* writer, char** output, int out_remaining) {
+/**
+ * Returns the size of each code unit of the encoding read by the given
+ * guac_iconv_read implementation, if that encoding represents each ASCII
+ * character as a single code unit having the same value as that character.
+ *
+ * @param reader
+ *     The guac_iconv_read implementation to test.
+ *
+ * @return
+ *     The size of each code unit in bytes, or zero if the given reader is not
+ *     known to read such an encoding.
+ */
+static int guac_iconv_reader_unit_size(guac_iconv_read* reader) {
+
+    if (reader == GUAC_READ_UTF8 || reader == GUAC_READ_UTF8_NORMALIZED
+            || reader == GUAC_READ_CP1252 || reader == GUAC_READ_CP1252_NORMALIZED
+            || reader == GUAC_READ_ISO8859_1 || reader == GUAC_READ_ISO8859_1_NORMALIZED)
+        return 1;
+
+    if (reader == GUAC_READ_UTF16 || reader == GUAC_READ_UTF16_NORMALIZED)
+        return 2;
+
+    return 0;
+
+}
+
+/**
+ * Returns the size of each code unit of the encoding written by the given
+ * guac_iconv_write implementation, if that encoding represents each ASCII
+ * character as a single code unit having the same value as that character.
+ *
+ * @param writer
+ *     The guac_iconv_write implementation to test.
+ *
+ * @return
+ *     The size of each code unit in bytes, or zero if the given writer is not
+ *     known to write such an encoding.
+ */
+static int guac_iconv_writer_unit_size(guac_iconv_write* writer) {
+
+    if (writer == GUAC_WRITE_UTF8 || writer == GUAC_WRITE_UTF8_CRLF
+            || writer == GUAC_WRITE_CP1252 || writer == GUAC_WRITE_CP1252_CRLF
+            || writer == GUAC_WRITE_ISO8859_1 || writer == GUAC_WRITE_ISO8859_1_CRLF)
+        return 1;
+
+    if (writer == GUAC_WRITE_UTF16 || writer == GUAC_WRITE_UTF16_CRLF)
+        return 2;
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the given code unit is an ASCII character that every
+ * supported reader and writer handles verbatim, regardless of newline
+ * normalization. The null terminator, carriage return, and line feed are
+ * excluded, as are all non-ASCII values.
+ *
+ * @param value
+ *     The code unit to test.
+ *
+ * @return
+ *     Non-zero if the given code unit may be copied verbatim, zero otherwise.
+ */
+static int guac_iconv_is_plain(unsigned int value) {
+    return value != 0 && value != '\r' && value != '\n' && value < 0x80;
+}
+
+/**
+ * Returns the number of leading bytes within the given buffer that may be
+ * copied verbatim, as determined by guac_iconv_is_plain().
+ *
+ * @param buffer
+ *     The buffer to test.
+ *
+ * @param length
+ *     The number of bytes within the buffer.
+ *
+ * @return
+ *     The number of leading bytes within the buffer that may be copied
+ *     verbatim.
+ */
+static int guac_iconv_plain_length(const char* buffer, int length) {
+
+    int offset = 0;
+
+#ifdef __SSE2__
+    /* Test sixteen bytes at a time where possible */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (length - offset >= 16) {
+
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (buffer + offset));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(bytes, zero),
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, cr),
+                    _mm_cmpeq_epi8(bytes, lf)));
+
+        int mask = _mm_movemask_epi8(_mm_or_si128(bytes, special));
+        if (mask)
+            return offset + __builtin_ctz(mask);
+
+        offset += 16;
+
+    }
+#endif
+
+    /* Test remaining bytes a word at a time */
+    while (length - offset >= 8) {
+
+        uint64_t word;
+        memcpy(&word, buffer + offset, sizeof(word));
+
+        if ((word & GUAC_ICONV_HIGH_BITS)
+                || GUAC_ICONV_HAS_ZERO_BYTE(word)
+                || GUAC_ICONV_HAS_ZERO_BYTE(word ^ ('\r' * GUAC_ICONV_LOW_BITS))
+                || GUAC_ICONV_HAS_ZERO_BYTE(word ^ ('\n' * GUAC_ICONV_LOW_BITS)))
+            break;
+
+        offset += 8;
+
+    }
+
+    /* Test any remaining bytes individually */
+    while (offset < length
+            && guac_iconv_is_plain((unsigned char) buffer[offset]))
+        offset++;
+
+    return offset;
+
+}
+
+/**
+ * Returns the number of leading 16-bit code units within the given buffer
+ * that may be copied verbatim, as determined by guac_iconv_is_plain().
+ *
+ * @param buffer
+ *     The buffer to test, containing 16-bit code units in native byte order.
+ *
+ * @param length
+ *     The number of 16-bit code units within the buffer.
+ *
+ * @return
+ *     The number of leading code units within the buffer that may be copied
+ *     verbatim.
+ */
+static int guac_iconv_plain_length16(const char* buffer, int length) {
+
+    int offset = 0;
 
-    while (in_remaining > 0 && out_remaining > 0) {
+#ifdef __SSE2__
+    /* Narrow sixteen code units at a time to bytes. As _mm_packus_epi16()
+     * saturates signed values, any value from 0x0100 through 0x7FFF becomes
+     * 0xFF (not ASCII) and any value of 0x8000 or above becomes 0x00 (the null
+     * terminator), neither of which are copied verbatim. */
+    while (length - offset >= 16) {
+
+        const __m128i* units = (const __m128i*) (buffer + offset * 2);
+        __m128i bytes = _mm_packus_epi16(_mm_loadu_si128(units),
+                _mm_loadu_si128(units + 1));
+
+        int plain = guac_iconv_plain_length((const char*) &bytes, 16);
+        if (plain < 16)
+            return offset + plain;
+
+        offset += 16;
+
+    }
+#endif
+
+    /* Test any remaining code units individually */
+    while (offset < length) {
+
+        uint16_t value;
+        memcpy(&value, buffer + offset * 2, sizeof(value));
+
+        if (!guac_iconv_is_plain(value))
+            break;
+
+        offset++;
+
+    }
+
+    return offset;
+
+}
+
+/**
+ * Copies as many leading characters as possible from the given input string
+ * to the given output string without invoking any guac_iconv_read or
+ * guac_iconv_write implementation, provided that both encodings represent
+ * ASCII characters as single code units. Only characters for which
+ * guac_iconv_is_plain() is true are copied, and copying stops once fewer than
+ * the given number of bytes of output space would remain for the next
+ * character, exactly as guac_iconv_reserved() would.
+ *
+ * @param in_size
+ *     The size of each code unit of the input encoding, in bytes.
+ *
+ * @param input
+ *     Pointer to the beginning of the input string.
+ *
+ * @param in_remaining
+ *     Pointer to the number of bytes remaining after the pointer to the input
+ *     string.
+ *
+ * @param out_size
+ *     The size of each code unit of the output encoding, in bytes.
+ *
+ * @param output
+ *     Pointer to the beginning of the output string.
+ *
+ * @param out_remaining
+ *     Pointer to the number of bytes remaining after the pointer to the
+ *     output string.
+ *
+ * @param out_reserved
+ *     The minimum number of bytes of output space that must remain for
+ *     another character to be read and written.
+ */
+static void guac_iconv_copy_plain(int in_size, const char** input,
+        int* in_remaining, int out_size, char** output, int* out_remaining,
+        int out_reserved) {
+
+    /* Every character copied must leave room for itself, in addition to
+     * satisfying the reservation */
+    if (out_reserved < out_size)
+        out_reserved = out_size;
+
+    if (*out_remaining < out_reserved)
+        return;
+
+    /* Determine the number of characters that would fit */
+    int length = *in_remaining / in_size;
+    int out_length = (*out_remaining - out_reserved) / out_size + 1;
+    if (length > out_length)
+        length = out_length;
+
+    if (in_size == 1)
+        length = guac_iconv_plain_length(*input, length);
+    else
+        length = guac_iconv_plain_length16(*input, length);
+
+    const char* in_current = *input;
+    char* out_current = *output;
+
+    /* Identical code unit sizes require no conversion */
+    if (in_size == out_size)
+        memcpy(out_current, in_current, length * in_size);
+
+    /* Widen ASCII bytes to 16-bit code units */
+    else if (in_size == 1) {
+        for (int i = 0; i < length; i++) {
+            uint16_t value = (unsigned char) in_current[i];
+            memcpy(out_current + i * 2, &value, sizeof(value));
+        }
+    }
+
+    /* Narrow 16-bit ASCII code units to bytes */
+    else {
+        for (int i = 0; i < length; i++) {
+            uint16_t value;
+            memcpy(&value, in_current + i * 2, sizeof(value));
+            out_current[i] = (char) value;
+        }
+    }
+
+    *input += length * in_size;
+    *in_remaining -= length * in_size;
+    *output += length * out_size;
+    *out_remaining -= length * out_size;
+
+}
+
+/**
+ * Converts characters within a given string from one encoding to another,
+ * as guac_iconv() does, stopping once fewer than the given number of bytes
+ * of output space remain.
+ *
+ * @param reader
+ *     The reader function to use when reading the input string.
+ *
+ * @param input
+ *     Pointer to the beginning of the input string.
+ *
+ * @param in_remaining
+ *     The number of bytes remaining after the pointer to the input string.
+ *
+ * @param writer
+ *     The writer function to use when writing the output string.
+ *
+ * @param output
+ *     Pointer to the beginning of the output string.
+ *
+ * @param out_remaining
+ *     The number of bytes remaining after the pointer to the output string.
+ *
+ * @param out_reserved
+ *     The minimum number of bytes of output space that must remain for
+ *     another character to be read and written.
+ *
+ * @return
+ *     Non-zero if the NULL terminator of the input string was read and copied
+ *     into the destination string, zero otherwise.
+ */
+static int guac_iconv_reserved(guac_iconv_read* reader, const char** input,
+        int in_remaining, guac_iconv_write* writer, char** output,
+        int out_remaining, int out_reserved) {
+
+    /* Characters which are represented identically in both encodings may be
+     * copied in bulk */
+    int in_size = guac_iconv_reader_unit_size(reader);
+    int out_size = guac_iconv_writer_unit_size(writer);
+
+    while (in_remaining > 0 && out_remaining >= out_reserved) {
+
+        if (in_size && out_size) {
+
+            guac_iconv_copy_plain(in_size, input, &in_remaining,
+                    out_size, output, &out_remaining, out_reserved);
+
+            if (in_remaining <= 0 || out_remaining < out_reserved)
+                break;
+
+        }
 
         int value;
         const char* read_start;
@@ -91,6 +437,19 @@ int guac_iconv(guac_iconv_read* reader, const char** input, int in_remaining,
 
 }
 
+int guac_iconv(guac_iconv_read* reader, const char** input, int in_remaining,
+               guac_iconv_write* writer, char** output, int out_remaining) {
+    return guac_iconv_reserved(reader, input, in_remaining,
+            writer, output, out_remaining, 1);
+}
+
+int guac_iconv_chunk(guac_iconv_read* reader, const char** input,
+        int in_remaining, guac_iconv_write* writer, char** output,
+        int out_remaining) {
+    return guac_iconv_reserved(reader, input, in_remaining,
+            writer, output, out_remaining, GUAC_ICONV_MAX_CHAR_LENGTH);
+}
+
 int GUAC_READ_UTF8(const char** input, int remaining) {
 
     int value;
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <guacamole/mem.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/stream.h>
@@ -58,11 +59,11 @@ int guac_common_json_write(guac_user* user, guac_stream* stream,
 
         /* Ensure provided data does not exceed size of buffer */
         int blob_length = length;
-        if (blob_length > sizeof(json_state->buffer))
-            blob_length = sizeof(json_state->buffer);
+        if (blob_length > json_state->max_size)
+            blob_length = json_state->max_size;
 
         /* Flush if more room is needed */
-        if (json_state->size + blob_length > sizeof(json_state->buffer)) {
+        if (json_state->size + blob_length > json_state->max_size) {
             guac_common_json_flush(user, stream, json_state);
             blob_written = 1;
         }
@@ -165,6 +166,11 @@ void guac_common_json_begin_object(guac_user* user, guac_stream* stream,
     json_state->size = 0;
     json_state->properties_written = 0;
 
+    /* Send blobs as large as the user supports */
+    json_state->max_size = user->info.max_blob_length;
+    if (json_state->max_size <= 0 || json_state->max_size > sizeof(json_state->buffer))
+        json_state->max_size = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+
     /* Write leading brace - no blob can possibly be written by this */
     assert(!guac_common_json_write(user, stream, json_state, "{", 1));
 
@@ -178,3 +184,136 @@ int guac_common_json_end_object(guac_user* user, guac_stream* stream,
 
 }
 
+/**
+ * Appends the given data to the buffer of the given guac_common_json_writer,
+ * growing that buffer as necessary.
+ *
+ * @param writer
+ *     The writer to append data to.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+static void guac_common_json_writer_append(guac_common_json_writer* writer,
+        const char* data, int length) {
+
+    size_t required = guac_mem_ckd_add_or_die(writer->size, length);
+
+    /* Double buffer size until data fits */
+    if (required > writer->capacity) {
+
+        size_t capacity = writer->capacity;
+        while (capacity < required)
+            capacity = guac_mem_ckd_mul_or_die(capacity, 2);
+
+        writer->buffer = guac_mem_realloc_or_die(writer->buffer, capacity);
+        writer->capacity = capacity;
+
+    }
+
+    memcpy(writer->buffer + writer->size, data, length);
+    writer->size += length;
+
+}
+
+/**
+ * Appends the given string to the buffer of the given guac_common_json_writer
+ * as a JSON string, surrounding the string with quotes and escaping any
+ * quotes and backslashes within the string.
+ *
+ * @param writer
+ *     The writer to append the string to.
+ *
+ * @param str
+ *     The string to append.
+ */
+static void guac_common_json_writer_string(guac_common_json_writer* writer,
+        const char* str) {
+
+    guac_common_json_writer_append(writer, "\"", 1);
+
+    /* Write given string, escaping as necessary */
+    const char* current = str;
+    for (; *current != '\0'; current++) {
+
+        /* Escape all quotes and back-slashes */
+        if (*current == '"' || *current == '\\') {
+
+            /* Write any string content up to current character */
+            if (current != str)
+                guac_common_json_writer_append(writer, str, current - str);
+
+            /* Escape the character that was just read */
+            guac_common_json_writer_append(writer, "\\", 1);
+
+            /* Reset string */
+            str = current;
+
+        }
+
+    }
+
+    /* Write any remaining string content */
+    if (current != str)
+        guac_common_json_writer_append(writer, str, current - str);
+
+    guac_common_json_writer_append(writer, "\"", 1);
+
+}
+
+void guac_common_json_writer_init(guac_common_json_writer* writer) {
+
+    writer->buffer = guac_mem_alloc(GUAC_COMMON_JSON_WRITER_INITIAL_SIZE);
+    writer->capacity = GUAC_COMMON_JSON_WRITER_INITIAL_SIZE;
+    writer->size = 0;
+    writer->properties_written = 0;
+
+    guac_common_json_writer_append(writer, "{", 1);
+
+}
+
+void guac_common_json_writer_free(guac_common_json_writer* writer) {
+    guac_mem_free(writer->buffer);
+}
+
+void guac_common_json_writer_property(guac_common_json_writer* writer,
+        const char* name, const char* value) {
+
+    /* Write leading comma if not first property */
+    if (writer->properties_written != 0)
+        guac_common_json_writer_append(writer, ",", 1);
+
+    guac_common_json_writer_string(writer, name);
+    guac_common_json_writer_append(writer, ":", 1);
+    guac_common_json_writer_string(writer, value);
+
+    writer->properties_written++;
+
+}
+
+void guac_common_json_writer_end(guac_common_json_writer* writer) {
+    guac_common_json_writer_append(writer, "}", 1);
+}
+
+int guac_common_json_writer_pending(guac_common_json_writer* writer) {
+    return writer->size;
+}
+
+int guac_common_json_writer_read(guac_common_json_writer* writer,
+        char* buffer, int length) {
+
+    if (length > writer->size)
+        length = writer->size;
+
+    memcpy(buffer, writer->buffer, length);
+
+    /* Shift any data not yet read to the beginning of the buffer */
+    writer->size -= length;
+    memmove(writer->buffer, writer->buffer + length, writer->size);
+
+    return length;
+
+}
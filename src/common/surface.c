@@ -719,86 +719,191 @@ static void __guac_common_surface_flush_deferred(guac_common_surface* surface) {
 }
 
 /**
- * Transfers a single uint32_t using the given transfer function.
+ * The coefficients of a transfer function, expressed as the exclusive OR of
+ * the four possible products of the source and destination values. Each
+ * coefficient is a mask applied to every bit of the pixel, such that the
+ * result of any transfer function is:
  *
- * @param op The transfer function to use.
- * @param src The source of the uint32_t value.
- * @param dst THe destination which will hold the result of the transfer.
- * @return Non-zero if the destination value was changed, zero otherwise.
+ *     c0 ^ (src & c1) ^ (dst & c2) ^ (src & dst & c3)
+ *
+ * This allows every transfer function to be applied to an entire row by a
+ * single branch-free loop, rather than dispatching on the transfer function
+ * for each pixel.
+ */
+typedef struct guac_common_surface_transfer_masks {
+
+    /**
+     * The constant term of the transfer function.
+     */
+    uint32_t c0;
+
+    /**
+     * The mask applied to the source value.
+     */
+    uint32_t c1;
+
+    /**
+     * The mask applied to the destination value.
+     */
+    uint32_t c2;
+
+    /**
+     * The mask applied to the bitwise AND of the source and destination
+     * values.
+     */
+    uint32_t c3;
+
+} guac_common_surface_transfer_masks;
+
+/**
+ * Returns the coefficients of the given transfer function. The color
+ * components of the result are the result of the boolean operation
+ * associated with the transfer function. The alpha component is fully
+ * opaque for GUAC_TRANSFER_BINARY_BLACK and GUAC_TRANSFER_BINARY_WHITE, taken
+ * from the source for GUAC_TRANSFER_BINARY_SRC and GUAC_TRANSFER_BINARY_NSRC,
+ * and taken from the destination for all other transfer functions.
+ *
+ * @param op
+ *     The transfer function to represent.
+ *
+ * @return
+ *     The coefficients of the given transfer function.
  */
-static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
+static guac_common_surface_transfer_masks __guac_common_surface_transfer_masks(
+        guac_transfer_function op) {
 
-    uint32_t orig = *dst;
+    const uint32_t rgb = 0x00FFFFFF;
+    const uint32_t all = 0xFFFFFFFF;
+    const uint32_t alpha = 0xFF000000;
 
     switch (op) {
 
         case GUAC_TRANSFER_BINARY_BLACK:
-            *dst = 0xFF000000;
-            break;
+            return (guac_common_surface_transfer_masks) { alpha, 0, 0, 0 };
 
         case GUAC_TRANSFER_BINARY_WHITE:
-            *dst = 0xFFFFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { all, 0, 0, 0 };
 
         case GUAC_TRANSFER_BINARY_SRC:
-            *dst = *src;
-            break;
-
-        case GUAC_TRANSFER_BINARY_DEST:
-            /* NOP */
-            break;
+            return (guac_common_surface_transfer_masks) { 0, all, 0, 0 };
 
         case GUAC_TRANSFER_BINARY_NSRC:
-            *dst = *src ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, all, 0, 0 };
 
         case GUAC_TRANSFER_BINARY_NDEST:
-            *dst = *dst ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, 0, all, 0 };
 
         case GUAC_TRANSFER_BINARY_AND:
-            *dst = ((*dst) & (0xFF000000 | *src));
-            break;
+            return (guac_common_surface_transfer_masks) { 0, 0, alpha, rgb };
 
         case GUAC_TRANSFER_BINARY_NAND:
-            *dst = ((*dst) & (0xFF000000 | *src)) ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, 0, alpha, rgb };
 
         case GUAC_TRANSFER_BINARY_OR:
-            *dst = ((*dst) | (0x00FFFFFF & *src));
-            break;
+            return (guac_common_surface_transfer_masks) { 0, rgb, all, rgb };
 
         case GUAC_TRANSFER_BINARY_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, rgb, all, rgb };
 
         case GUAC_TRANSFER_BINARY_XOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src));
-            break;
+            return (guac_common_surface_transfer_masks) { 0, rgb, all, 0 };
 
         case GUAC_TRANSFER_BINARY_XNOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, rgb, all, 0 };
 
         case GUAC_TRANSFER_BINARY_NSRC_AND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF)));
-            break;
+            return (guac_common_surface_transfer_masks) { 0, 0, all, rgb };
 
         case GUAC_TRANSFER_BINARY_NSRC_NAND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, 0, all, rgb };
 
         case GUAC_TRANSFER_BINARY_NSRC_OR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF)));
-            break;
+            return (guac_common_surface_transfer_masks) { rgb, rgb, alpha, rgb };
 
         case GUAC_TRANSFER_BINARY_NSRC_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
+            return (guac_common_surface_transfer_masks) { 0, rgb, alpha, rgb };
+
+        /* GUAC_TRANSFER_BINARY_DEST leaves the destination untouched */
+        default:
+            return (guac_common_surface_transfer_masks) { 0, 0, all, 0 };
 
     }
 
-    return *dst != orig;
+}
+
+/**
+ * Transfers a single row of pixels using the transfer function having the
+ * given coefficients, recording the range of pixels within the row that were
+ * changed.
+ *
+ * @param masks
+ *     The coefficients of the transfer function to use, as returned by
+ *     __guac_common_surface_transfer_masks().
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param step
+ *     The offset between consecutive pixels, either 1 to transfer forwards or
+ *     -1 to transfer backwards.
+ *
+ * @param first
+ *     Storage for the index of the first pixel changed, relative to the given
+ *     source and destination pixels and in the direction of the given step.
+ *     This is only assigned if at least one pixel is changed.
+ *
+ * @param last
+ *     Storage for the index of the last pixel changed, relative to the given
+ *     source and destination pixels and in the direction of the given step.
+ *     This is only assigned if at least one pixel is changed.
+ *
+ * @return
+ *     Non-zero if any pixel within the destination row was changed, zero
+ *     otherwise.
+ */
+static int __guac_common_surface_transfer_row(
+        const guac_common_surface_transfer_masks* masks,
+        const uint32_t* src, uint32_t* dst, int width, int step,
+        int* first, int* last) {
+
+    const uint32_t c0 = masks->c0;
+    const uint32_t c1 = masks->c1;
+    const uint32_t c2 = masks->c2;
+    const uint32_t c3 = masks->c3;
+
+    int changed_first = -1;
+    int changed_last = -1;
+
+    for (int x = 0; x < width; x++) {
+
+        uint32_t s = *src;
+        uint32_t d = *dst;
+        uint32_t result = c0 ^ (s & c1) ^ (d & c2) ^ (s & d & c3);
+
+        if (result != d) {
+            if (changed_first < 0)
+                changed_first = x;
+            changed_last = x;
+            *dst = result;
+        }
+
+        src += step;
+        dst += step;
+
+    }
+
+    if (changed_first < 0)
+        return 0;
+
+    *first = changed_first;
+    *last = changed_last;
+    return 1;
 
 }
 
@@ -1135,7 +1240,7 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
     unsigned char* src_buffer = src->buffer;
     unsigned char* dst_buffer = dst->buffer;
 
-    int x, y;
+    int y;
     int src_stride, dst_stride;
     int step = 1;
 
@@ -1165,24 +1270,23 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
         step = -1;
     }
 
+    /* Dispatch on the transfer function only once for the entire rect */
+    guac_common_surface_transfer_masks masks =
+        __guac_common_surface_transfer_masks(op);
+
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+        int first, last;
 
         /* Transfer each pixel in row */
-        for (x=0; x < rect->width; x++) {
-
-            if (__guac_common_surface_transfer_int(op, src_current, dst_current)) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-            }
-
-            src_current += step;
-            dst_current += step;
+        if (__guac_common_surface_transfer_row(&masks,
+                    (uint32_t*) src_buffer, (uint32_t*) dst_buffer,
+                    rect->width, step, &first, &last)) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            if (y > max_y) max_y = y;
         }
 
         /* Next row */
@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/iconv.h"
+#include "convert-test-data.h"
+
+#include <CUnit/CUnit.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The number of characters within the test text generated by
+ * generate_text(), excluding the null terminator.
+ */
+#define TEST_TEXT_LENGTH 2048
+
+/**
+ * The maximum number of bytes required to encode the test text generated by
+ * generate_text() in any supported encoding, including CRLF line endings and
+ * the null terminator.
+ */
+#define TEST_BUFFER_SIZE ((TEST_TEXT_LENGTH + 1) * GUAC_ICONV_MAX_CHAR_LENGTH)
+
+/**
+ * Generates test text consisting of runs of ASCII characters of varying
+ * length, each followed by either a newline or the given non-ASCII
+ * character, terminated by a null terminator. The varying run lengths ensure
+ * that the boundaries between runs fall at every possible offset relative to
+ * any bulk conversion performed by guac_iconv().
+ *
+ * @param text
+ *     The array of TEST_TEXT_LENGTH + 1 codepoints to populate.
+ *
+ * @param separator
+ *     The codepoint of the non-ASCII character to place between runs which
+ *     are not separated by a newline.
+ */
+static void generate_text(int* text, int separator) {
+
+    int run = 0;
+    int run_length = 1;
+
+    for (int i = 0; i < TEST_TEXT_LENGTH; i++) {
+
+        /* End each run with either a newline or a non-ASCII character */
+        if (run == run_length) {
+            text[i] = (run_length % 2) ? '\n' : separator;
+            run = 0;
+            run_length = run_length % 37 + 1;
+        }
+
+        else
+            text[i] = 'a' + (run++ % 26);
+
+    }
+
+    text[TEST_TEXT_LENGTH] = 0;
+
+}
+
+/**
+ * Encodes the given codepoints one character at a time using the given
+ * guac_iconv_write implementation, up to and including the null terminator.
+ *
+ * @param text
+ *     The null-terminated array of codepoints to encode.
+ *
+ * @param writer
+ *     The guac_iconv_write implementation to use.
+ *
+ * @param output
+ *     The buffer of TEST_BUFFER_SIZE bytes that should receive the encoded
+ *     text.
+ *
+ * @return
+ *     The number of bytes written.
+ */
+static int encode_text(const int* text, guac_iconv_write* writer,
+        char* output) {
+
+    char* current = output;
+
+    do {
+        writer(&current, TEST_BUFFER_SIZE - (current - output), *text);
+    } while (*(text++) != 0);
+
+    return current - output;
+
+}
+
+/**
+ * Verifies that converting the given text from the encoding of one
+ * guac_iconv_write implementation to that of another using guac_iconv()
+ * produces exactly the same output as encoding that text character by
+ * character.
+ *
+ * @param text
+ *     The null-terminated array of codepoints to convert.
+ *
+ * @param in_writer
+ *     The guac_iconv_write implementation to use to produce the input string.
+ *
+ * @param reader
+ *     The guac_iconv_read implementation to use to read the input string.
+ *
+ * @param writer
+ *     The guac_iconv_write implementation to use to write the output string.
+ *
+ * @param expected_writer
+ *     The guac_iconv_write implementation to use to produce the expected
+ *     output string.
+ */
+static void verify_bulk_conversion(const int* text,
+        guac_iconv_write* in_writer, guac_iconv_read* reader,
+        guac_iconv_write* writer, guac_iconv_write* expected_writer) {
+
+    char input[TEST_BUFFER_SIZE];
+    char expected[TEST_BUFFER_SIZE];
+    char output[TEST_BUFFER_SIZE];
+
+    int in_length = encode_text(text, in_writer, input);
+    int expected_length = encode_text(text, expected_writer, expected);
+
+    const char* current_input = input;
+    char* current_output = output;
+
+    CU_ASSERT(guac_iconv(reader, &current_input, in_length,
+                writer, &current_output, sizeof(output)));
+
+    CU_ASSERT_EQUAL(in_length, current_input - input);
+    CU_ASSERT_EQUAL(expected_length, current_output - output);
+    CU_ASSERT_EQUAL(0, memcmp(output, expected, expected_length));
+
+}
+
+/**
+ * Test which verifies that long strings consisting mostly of ASCII characters
+ * are converted between every pair of supported encodings exactly as they
+ * would be if converted one character at a time, with and without newline
+ * normalization.
+ */
+void test_iconv__bulk() {
+
+    int text[TEST_TEXT_LENGTH + 1];
+    generate_text(text, 0xE0 /* "à" */);
+
+    for (int i = 0; i < NUM_SUPPORTED_ENCODINGS; i++) {
+        for (int j = 0; j < NUM_SUPPORTED_ENCODINGS; j++) {
+
+            encoding_test_parameters* from = &test_params[i];
+            encoding_test_parameters* to = &test_params[j];
+
+            printf("# \"%s\" -> \"%s\" ...\n", from->name, to->name);
+
+            verify_bulk_conversion(text, from->writer, from->reader,
+                    to->writer, to->writer);
+
+            verify_bulk_conversion(text, from->writer_crlf,
+                    from->reader_normalized, to->writer, to->writer);
+
+            verify_bulk_conversion(text, from->writer, from->reader,
+                    to->writer_crlf, to->writer_crlf);
+
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that UTF-16 code units which are not ASCII are never
+ * mistaken for ASCII characters during bulk conversion, including code units
+ * whose low byte alone would be ASCII.
+ */
+void test_iconv__bulk_utf16() {
+
+    int text[TEST_TEXT_LENGTH + 1];
+
+    int separators[] = { 0x0141, 0x0A41, 0x8041, 0xFF0D };
+    for (int i = 0; i < sizeof(separators) / sizeof(separators[0]); i++) {
+
+        generate_text(text, separators[i]);
+
+        printf("# U+%04X ...\n", separators[i]);
+        verify_bulk_conversion(text, GUAC_WRITE_UTF16, GUAC_READ_UTF16,
+                GUAC_WRITE_UTF8, GUAC_WRITE_UTF8);
+        verify_bulk_conversion(text, GUAC_WRITE_UTF8, GUAC_READ_UTF8,
+                GUAC_WRITE_UTF16, GUAC_WRITE_UTF16);
+
+    }
+
+}
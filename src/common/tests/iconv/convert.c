@@ -67,6 +67,70 @@ static void verify_conversion(
 
 }
 
+/**
+ * Tests that conversion between character sets using the given guac_iconv_read
+ * and guac_iconv_write implementations matches expectations when performed
+ * with guac_iconv_chunk() using the smallest possible output buffers.
+ *
+ * @param reader
+ *     The guac_iconv_read implementation to use to read the input string.
+ *
+ * @param in_string
+ *     A pointer to the test_string structure describing the input string being
+ *     tested.
+ *
+ * @param writer
+ *     The guac_iconv_write implementation to use to write the output string
+ *     (the converted input string).
+ *
+ * @param out_string
+ *     A pointer to the test_string structure describing the expected result of
+ *     the conversion.
+ */
+static void verify_chunked_conversion(
+        guac_iconv_read* reader,  test_string* in_string,
+        guac_iconv_write* writer, test_string* out_string) {
+
+    char output[4096];
+    char input[4096];
+
+    const char* current_input = input;
+    char* current_output = output;
+
+    memcpy(input, in_string->buffer, in_string->size);
+
+    /* Convert through a series of minimal output chunks */
+    int complete = 0;
+    while (!complete && current_input - input < in_string->size) {
+
+        char chunk[GUAC_ICONV_MAX_CHAR_LENGTH];
+        char* current_chunk = chunk;
+
+        complete = guac_iconv_chunk(reader, &current_input,
+                in_string->size - (current_input - input),
+                writer, &current_chunk, sizeof(chunk));
+
+        /* Each chunk must contain at least one character */
+        CU_ASSERT(current_chunk > chunk);
+        if (current_chunk == chunk)
+            break;
+
+        memcpy(current_output, chunk, current_chunk - chunk);
+        current_output += current_chunk - chunk;
+
+    }
+
+    /* Verify output length */
+    CU_ASSERT_EQUAL(out_string->size, current_output - output);
+
+    /* Verify entire input read */
+    CU_ASSERT_EQUAL(in_string->size, current_input - input);
+
+    /* Verify output content */
+    CU_ASSERT_EQUAL(0, memcmp(output, out_string->buffer, out_string->size));
+
+}
+
 /**
  * Test which verifies that every supported encoding can be correctly converted
  * to every other supported encoding, with all line endings preserved verbatim
@@ -127,3 +191,24 @@ void test_iconv__normalize_crlf() {
     }
 }
 
+/**
+ * Test which verifies that every supported encoding can be correctly converted
+ * to every other supported encoding in fixed-size chunks, without any
+ * characters being lost at chunk boundaries.
+ */
+void test_iconv__chunked() {
+    for (int i = 0; i < NUM_SUPPORTED_ENCODINGS; i++) {
+        for (int j = 0; j < NUM_SUPPORTED_ENCODINGS; j++) {
+
+            encoding_test_parameters* from = &test_params[i];
+            encoding_test_parameters* to = &test_params[j];
+
+            printf("# \"%s\" -> \"%s\" ...\n", from->name, to->name);
+            verify_chunked_conversion(from->reader, &from->test_mixed,
+                    to->writer, &to->test_mixed);
+            verify_chunked_conversion(from->reader_normalized, &from->test_mixed,
+                    to->writer_crlf, &to->test_windows);
+
+        }
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/json.h"
+
+#include <CUnit/CUnit.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Reads all pending data from the given guac_common_json_writer in pieces of
+ * at most the given size, storing the result as a null-terminated string.
+ *
+ * @param writer
+ *     The writer to read from.
+ *
+ * @param piece_size
+ *     The maximum number of bytes to read at a time.
+ *
+ * @param output
+ *     The buffer that should receive the null-terminated result.
+ *
+ * @param size
+ *     The size of the output buffer, in bytes.
+ */
+static void read_all(guac_common_json_writer* writer, int piece_size,
+        char* output, int size) {
+
+    int length = 0;
+    int read;
+
+    while ((read = guac_common_json_writer_read(writer, output + length,
+                    piece_size)) > 0) {
+        length += read;
+        CU_ASSERT_FATAL(length < size);
+    }
+
+    output[length] = '\0';
+
+}
+
+/**
+ * Test which verifies that guac_common_json_writer produces a correctly
+ * escaped JSON object, regardless of the size of the pieces it is read in.
+ */
+void test_json__writer() {
+
+    const char* expected = "{\"/a\":\"x\",\"/b\\\"c\":\"y\\\\z\"}";
+
+    for (int piece_size = 1; piece_size <= 32; piece_size++) {
+
+        char output[256];
+
+        guac_common_json_writer writer;
+        guac_common_json_writer_init(&writer);
+        guac_common_json_writer_property(&writer, "/a", "x");
+        guac_common_json_writer_property(&writer, "/b\"c", "y\\z");
+        guac_common_json_writer_end(&writer);
+
+        CU_ASSERT_EQUAL(strlen(expected),
+                guac_common_json_writer_pending(&writer));
+
+        read_all(&writer, piece_size, output, sizeof(output));
+        CU_ASSERT_STRING_EQUAL(expected, output);
+        CU_ASSERT_EQUAL(0, guac_common_json_writer_pending(&writer));
+
+        guac_common_json_writer_free(&writer);
+
+    }
+
+}
+
+/**
+ * Test which verifies that a guac_common_json_writer grows its buffer as
+ * necessary to contain objects much larger than its initial allocation,
+ * while data is interleaved between writes and reads.
+ */
+void test_json__writer_large() {
+
+    char name[32];
+    char piece[1000];
+    int total = 0;
+
+    guac_common_json_writer writer;
+    guac_common_json_writer_init(&writer);
+
+    /* Property names are "/1" through "/10000", each with value "v" */
+    for (int i = 1; i <= 10000; i++) {
+
+        snprintf(name, sizeof(name), "/%i", i);
+        guac_common_json_writer_property(&writer, name, "v");
+
+        /* Read some data after every hundredth property */
+        if (i % 100 == 0)
+            total += guac_common_json_writer_read(&writer, piece,
+                    sizeof(piece));
+
+    }
+
+    guac_common_json_writer_end(&writer);
+
+    int read;
+    while ((read = guac_common_json_writer_read(&writer, piece,
+                    sizeof(piece))) > 0)
+        total += read;
+
+    /* Each property is "/N":"v" (seven bytes plus the digits of N) followed
+     * by a comma, except for the last, and all are within braces */
+    int expected = 2 - 1;
+    for (int i = 1; i <= 10000; i++)
+        expected += snprintf(name, sizeof(name), "%i", i) + 7 + 1;
+
+    CU_ASSERT_EQUAL(expected, total);
+    guac_common_json_writer_free(&writer);
+
+}
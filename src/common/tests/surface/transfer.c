@@ -0,0 +1,244 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/surface.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of each test surface, in pixels.
+ */
+#define TEST_WIDTH 64
+
+/**
+ * The height of each test surface, in pixels.
+ */
+#define TEST_HEIGHT 64
+
+/**
+ * Every distinct binary transfer function. The NDEST variants share their
+ * values with the NSRC variants and are therefore covered implicitly.
+ */
+static const guac_transfer_function test_functions[] = {
+    GUAC_TRANSFER_BINARY_BLACK,
+    GUAC_TRANSFER_BINARY_WHITE,
+    GUAC_TRANSFER_BINARY_SRC,
+    GUAC_TRANSFER_BINARY_DEST,
+    GUAC_TRANSFER_BINARY_NSRC,
+    GUAC_TRANSFER_BINARY_NDEST,
+    GUAC_TRANSFER_BINARY_AND,
+    GUAC_TRANSFER_BINARY_NAND,
+    GUAC_TRANSFER_BINARY_OR,
+    GUAC_TRANSFER_BINARY_NOR,
+    GUAC_TRANSFER_BINARY_XOR,
+    GUAC_TRANSFER_BINARY_XNOR,
+    GUAC_TRANSFER_BINARY_NSRC_AND,
+    GUAC_TRANSFER_BINARY_NSRC_NAND,
+    GUAC_TRANSFER_BINARY_NSRC_OR,
+    GUAC_TRANSFER_BINARY_NSRC_NOR
+};
+
+/**
+ * Alpha values which every test pixel cycles through, covering fully
+ * transparent, partially transparent, and fully opaque pixels.
+ */
+static const uint32_t test_alpha[] = {
+    0x00000000, 0x01000000, 0x80000000, 0xFE000000, 0xFF000000
+};
+
+/**
+ * Applies the given transfer function to a single pixel exactly as each
+ * function is defined for guac_common_surface, one pixel at a time. This is
+ * the reference against which the row-wide implementation is checked.
+ *
+ * @param op
+ *     The transfer function to apply.
+ *
+ * @param src
+ *     The source pixel.
+ *
+ * @param dst
+ *     The destination pixel.
+ *
+ * @return
+ *     The resulting destination pixel.
+ */
+static uint32_t test_transfer_pixel(guac_transfer_function op,
+        uint32_t src, uint32_t dst) {
+
+    switch (op) {
+
+        case GUAC_TRANSFER_BINARY_BLACK:
+            return 0xFF000000;
+
+        case GUAC_TRANSFER_BINARY_WHITE:
+            return 0xFFFFFFFF;
+
+        case GUAC_TRANSFER_BINARY_SRC:
+            return src;
+
+        case GUAC_TRANSFER_BINARY_DEST:
+            return dst;
+
+        case GUAC_TRANSFER_BINARY_NSRC:
+            return src ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_NDEST:
+            return dst ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_AND:
+            return dst & (0xFF000000 | src);
+
+        case GUAC_TRANSFER_BINARY_NAND:
+            return (dst & (0xFF000000 | src)) ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_OR:
+            return dst | (0x00FFFFFF & src);
+
+        case GUAC_TRANSFER_BINARY_NOR:
+            return (dst | (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_XOR:
+            return dst ^ (0x00FFFFFF & src);
+
+        case GUAC_TRANSFER_BINARY_XNOR:
+            return (dst ^ (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_NSRC_AND:
+            return dst & (0xFF000000 | (src ^ 0x00FFFFFF));
+
+        case GUAC_TRANSFER_BINARY_NSRC_NAND:
+            return (dst & (0xFF000000 | (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+
+        case GUAC_TRANSFER_BINARY_NSRC_OR:
+            return dst | (0x00FFFFFF & (src ^ 0x00FFFFFF));
+
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:
+            return (dst | (0x00FFFFFF & (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+
+    }
+
+    return dst;
+
+}
+
+/**
+ * Fills the given surface with deterministic pseudo-random pixels. The alpha
+ * component of each pixel cycles through test_alpha, while the color
+ * components are arbitrary.
+ *
+ * @param surface
+ *     The surface to fill.
+ *
+ * @param seed
+ *     The initial state of the pseudo-random number generator.
+ */
+static void test_fill(guac_common_surface* surface, uint32_t seed) {
+
+    int alpha_count = sizeof(test_alpha) / sizeof(test_alpha[0]);
+    int index = 0;
+
+    for (int y = 0; y < surface->height; y++) {
+        uint32_t* row = (uint32_t*) (surface->buffer + y * surface->stride);
+        for (int x = 0; x < surface->width; x++) {
+            seed = seed * 1103515245 + 12345;
+            row[x] = test_alpha[index++ % alpha_count]
+                   | (seed & 0x00FFFFFF);
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that guac_common_surface_transfer() produces, for every
+ * binary transfer function and for pixels of any alpha, exactly the pixels
+ * given by the per-pixel definition of that function.
+ */
+void test_surface__transfer() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* Discard all output, including that of any flushed surface */
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Use buffers, which are not created until first drawn */
+    guac_layer src_layer = { .index = -1 };
+    guac_layer dst_layer = { .index = -2 };
+
+    guac_common_surface* src = guac_common_surface_alloc(client, socket,
+            &src_layer, TEST_WIDTH, TEST_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(src);
+
+    uint32_t original[TEST_HEIGHT][TEST_WIDTH];
+
+    int count = sizeof(test_functions) / sizeof(test_functions[0]);
+    for (int i = 0; i < count; i++) {
+
+        guac_transfer_function op = test_functions[i];
+
+        guac_common_surface* dst = guac_common_surface_alloc(client, socket,
+                &dst_layer, TEST_WIDTH, TEST_HEIGHT);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(dst);
+
+        test_fill(src, 0x5EED + i);
+        test_fill(dst, 0xD057 + i);
+
+        for (int y = 0; y < TEST_HEIGHT; y++)
+            memcpy(original[y], dst->buffer + y * dst->stride,
+                    sizeof(original[y]));
+
+        guac_common_surface_transfer(src, 0, 0, TEST_WIDTH, TEST_HEIGHT,
+                op, dst, 0, 0);
+
+        /* Every pixel must match its per-pixel definition */
+        int mismatches = 0;
+        for (int y = 0; y < TEST_HEIGHT; y++) {
+
+            uint32_t* src_row = (uint32_t*) (src->buffer + y * src->stride);
+            uint32_t* dst_row = (uint32_t*) (dst->buffer + y * dst->stride);
+
+            for (int x = 0; x < TEST_WIDTH; x++) {
+                uint32_t expected = test_transfer_pixel(op, src_row[x],
+                        original[y][x]);
+                if (dst_row[x] != expected)
+                    mismatches++;
+            }
+
+        }
+
+        CU_ASSERT_EQUAL(mismatches, 0);
+        guac_common_surface_free(dst);
+
+    }
+
+    guac_common_surface_free(src);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
@@ -0,0 +1,259 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "cgroup.h"
+#include "conf.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * The cgroup v2 directory beneath which each connection process is placed
+ * within its own cgroup, or NULL if connection processes should remain within
+ * the cgroup of guacd.
+ */
+static const char* guacd_cgroup_path = NULL;
+
+/**
+ * The resource limits configured for connection processes.
+ */
+static guacd_config_cgroup* guacd_cgroup_limits = NULL;
+
+/**
+ * Writes the given value to the given interface file of the given cgroup.
+ *
+ * @param cgroup
+ *     The path of the cgroup directory.
+ *
+ * @param file
+ *     The name of the interface file within the cgroup directory, such as
+ *     "cpu.weight".
+ *
+ * @param value
+ *     The value to write.
+ *
+ * @return
+ *     Zero if the value was written successfully, non-zero otherwise, in
+ *     which case errno is set appropriately.
+ */
+static int guacd_cgroup_write(const char* cgroup, const char* file,
+        const char* value) {
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", cgroup, file) >= sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return 1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 1;
+
+    /* Interface files accept each value with a single write */
+    ssize_t length = strlen(value);
+    int result = (write(fd, value, length) != length);
+
+    int write_errno = errno;
+    close(fd);
+    errno = write_errno;
+
+    return result;
+
+}
+
+/**
+ * Returns the path of the cgroup of the connection process having the given
+ * PID, storing that path within the given buffer.
+ *
+ * @param buffer
+ *     The buffer to store the path within. This buffer must be at least
+ *     PATH_MAX bytes.
+ *
+ * @param pid
+ *     The PID of the connection process.
+ *
+ * @return
+ *     Zero if the path was stored successfully, non-zero if the path is too
+ *     long.
+ */
+static int guacd_cgroup_proc_path(char* buffer, pid_t pid) {
+    return snprintf(buffer, PATH_MAX, "%s/proc-%i", guacd_cgroup_path,
+            (int) pid) >= PATH_MAX;
+}
+
+void guacd_cgroup_init(guacd_config* config) {
+
+    if (config->cgroup_path == NULL)
+        return;
+
+    /* Create parent cgroup if necessary */
+    if (mkdir(config->cgroup_path, 0755) && errno != EEXIST) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create cgroup \"%s\": %s. "
+                "Resource limits will not be applied to connection "
+                "processes.", config->cgroup_path, strerror(errno));
+        return;
+    }
+
+    /* Allow limits on CPU and memory to be set for each child cgroup. This
+     * will fail if either controller is not enabled for the parent cgroup
+     * itself, or if the parent cgroup directly contains any processes
+     * (including guacd). */
+    const char* controllers[] = { "+cpu", "+memory" };
+    for (int i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+        if (guacd_cgroup_write(config->cgroup_path, "cgroup.subtree_control",
+                    controllers[i]))
+            guacd_log(GUAC_LOG_WARNING, "Unable to enable the \"%s\" "
+                    "controller within cgroup \"%s\": %s. The corresponding "
+                    "resource limits will not be applied to connection "
+                    "processes.", controllers[i] + 1, config->cgroup_path,
+                    strerror(errno));
+    }
+
+    guacd_cgroup_path = config->cgroup_path;
+    guacd_cgroup_limits = config->cgroups;
+
+    guacd_log(GUAC_LOG_INFO, "Connection processes will be placed within "
+            "cgroups beneath \"%s\".", guacd_cgroup_path);
+
+}
+
+int guacd_cgroup_enter(const char* protocol) {
+
+    if (guacd_cgroup_path == NULL)
+        return 0;
+
+    /* Each limit not set for the protocol falls back to the default */
+    int cpu_weight = 0;
+    long cpu_max = 0;
+    long long memory_max = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+
+        guacd_config_cgroup* limits;
+        for (limits = guacd_cgroup_limits; limits != NULL; limits = limits->next) {
+
+            /* Check protocol-specific limits first, then defaults */
+            if (pass == 0 ? (limits->protocol == NULL
+                        || strcmp(limits->protocol, protocol) != 0)
+                    : limits->protocol != NULL)
+                continue;
+
+            if (cpu_weight == 0) cpu_weight = limits->cpu_weight;
+            if (cpu_max == 0) cpu_max = limits->cpu_max;
+            if (memory_max == 0) memory_max = limits->memory_max;
+
+        }
+
+    }
+
+    char cgroup[PATH_MAX];
+    if (guacd_cgroup_proc_path(cgroup, getpid())) {
+        guacd_log(GUAC_LOG_ERROR, "Path of cgroup for connection process is "
+                "too long.");
+        return 1;
+    }
+
+    if (mkdir(cgroup, 0755) && errno != EEXIST) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create cgroup \"%s\": %s",
+                cgroup, strerror(errno));
+        return 1;
+    }
+
+    /* Apply limits before any real work is done within the new cgroup */
+    char value[64];
+
+    if (cpu_weight != 0) {
+        snprintf(value, sizeof(value), "%i", cpu_weight);
+        if (guacd_cgroup_write(cgroup, "cpu.weight", value))
+            guacd_log(GUAC_LOG_WARNING, "Unable to set CPU weight of "
+                    "connection process: %s", strerror(errno));
+    }
+
+    if (cpu_max != 0) {
+        snprintf(value, sizeof(value), "%li %i",
+                cpu_max * (GUACD_CGROUP_CPU_PERIOD / 1000),
+                GUACD_CGROUP_CPU_PERIOD);
+        if (guacd_cgroup_write(cgroup, "cpu.max", value))
+            guacd_log(GUAC_LOG_WARNING, "Unable to set CPU maximum of "
+                    "connection process: %s", strerror(errno));
+    }
+
+    if (memory_max != 0) {
+        snprintf(value, sizeof(value), "%lli", memory_max);
+        if (guacd_cgroup_write(cgroup, "memory.max", value))
+            guacd_log(GUAC_LOG_WARNING, "Unable to set memory maximum of "
+                    "connection process: %s", strerror(errno));
+    }
+
+    /* Move the current process (PID "0" refers to the writer) */
+    if (guacd_cgroup_write(cgroup, "cgroup.procs", "0")) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to move connection process into "
+                "cgroup \"%s\": %s", cgroup, strerror(errno));
+        rmdir(cgroup);
+        return 1;
+    }
+
+    guacd_log(GUAC_LOG_DEBUG, "Connection process placed within cgroup "
+            "\"%s\".", cgroup);
+
+    return 0;
+
+}
+
+void guacd_cgroup_remove(pid_t pid) {
+
+    if (guacd_cgroup_path == NULL)
+        return;
+
+    char cgroup[PATH_MAX];
+    if (guacd_cgroup_proc_path(cgroup, pid))
+        return;
+
+    /* Kill anything that escaped the process group of the connection process
+     * (cgroup.kill is available only on Linux 5.14 and later, and failure
+     * here is harmless if nothing remains) */
+    guacd_cgroup_write(cgroup, "cgroup.kill", "1");
+
+    /* The cgroup can be removed only once the kernel has finished removing
+     * all processes from it */
+    for (int attempt = 0; attempt < GUACD_CGROUP_REMOVE_ATTEMPTS; attempt++) {
+
+        if (rmdir(cgroup) == 0 || errno == ENOENT)
+            return;
+
+        if (errno != EBUSY)
+            break;
+
+        usleep(GUACD_CGROUP_REMOVE_INTERVAL);
+
+    }
+
+    guacd_log(GUAC_LOG_WARNING, "Unable to remove cgroup \"%s\": %s",
+            cgroup, strerror(errno));
+
+}
@@ -0,0 +1,95 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_CGROUP_H
+#define GUACD_CGROUP_H
+
+#include "config.h"
+
+#include "conf.h"
+
+#include <sys/types.h>
+
+/**
+ * The period over which the CPU time of each connection process is limited,
+ * in microseconds, as written to the "cpu.max" interface file of cgroup v2.
+ */
+#define GUACD_CGROUP_CPU_PERIOD 100000
+
+/**
+ * The number of times guacd will attempt to remove the cgroup of a connection
+ * process which has terminated, as the kernel may still be removing the last
+ * processes from that cgroup.
+ */
+#define GUACD_CGROUP_REMOVE_ATTEMPTS 50
+
+/**
+ * The amount of time to wait between each attempt to remove the cgroup of a
+ * connection process, in microseconds.
+ */
+#define GUACD_CGROUP_REMOVE_INTERVAL 10000
+
+/**
+ * Prepares the given cgroup v2 directory to contain the cgroups of all future
+ * connection processes, enabling the CPU and memory controllers for those
+ * cgroups. The given directory is created if it does not already exist. If
+ * no directory is configured, or the directory cannot be used, connection
+ * processes will remain within the cgroup of guacd.
+ *
+ * The given configuration must remain allocated for as long as connection
+ * processes may be created.
+ *
+ * @param config
+ *     The guacd configuration defining the cgroup directory and the
+ *     resource limits of each protocol.
+ */
+void guacd_cgroup_init(guacd_config* config);
+
+/**
+ * Moves the current process into a new cgroup beneath the directory
+ * configured with guacd_cgroup_init(), applying the resource limits
+ * configured for the given protocol. This function must be called by the
+ * connection process itself, before loading the client plugin of its
+ * protocol, such that any process or thread it later creates is subject to
+ * the same limits. If no cgroup directory is configured, this function has
+ * no effect.
+ *
+ * @param protocol
+ *     The protocol that the current process is being initialized for.
+ *
+ * @return
+ *     Zero if the current process was moved into its own cgroup or no cgroup
+ *     directory is configured, non-zero if the process could not be moved.
+ */
+int guacd_cgroup_enter(const char* protocol);
+
+/**
+ * Terminates any processes remaining within the cgroup of the connection
+ * process having the given PID, removing that cgroup. This function must be
+ * called by the main guacd process after the connection process has
+ * terminated. If no cgroup directory is configured, this function has no
+ * effect.
+ *
+ * @param pid
+ *     The PID of the connection process whose cgroup should be removed.
+ */
+void guacd_cgroup_remove(pid_t pid);
+
+#endif
+
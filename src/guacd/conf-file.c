@@ -28,6 +28,7 @@
 #include <guacamole/string.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,6 +38,379 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+/**
+ * Sets the number of idle processes which should be kept ready for the given
+ * protocol, replacing any size previously set for that protocol.
+ *
+ * @param config
+ *     The configuration to update.
+ *
+ * @param protocol
+ *     The name of the protocol.
+ *
+ * @param value
+ *     The number of idle processes to keep ready for the protocol, as a
+ *     string.
+ *
+ * @return
+ *     Zero if the pool size was set successfully, non-zero if the given value
+ *     is not a valid pool size.
+ */
+static int guacd_conf_set_pool_size(guacd_config* config,
+        const char* protocol, const char* value) {
+
+    /* Parse size, which must be a non-negative integer within range */
+    char* end;
+    errno = 0;
+    long size = strtol(value, &end, 10);
+    if (errno || *value == '\0' || *end != '\0'
+            || size < 0 || size > GUACD_MAX_POOL_SIZE) {
+        guacd_conf_parse_error = "Invalid pool size. Pool sizes must be "
+            "whole numbers no greater than 256.";
+        return 1;
+    }
+
+    /* Update existing pool configuration for protocol, if any */
+    guacd_config_pool* pool;
+    for (pool = config->pools; pool != NULL; pool = pool->next) {
+        if (strcmp(pool->protocol, protocol) == 0) {
+            pool->size = size;
+            return 0;
+        }
+    }
+
+    /* Otherwise, add new pool configuration */
+    pool = guac_mem_alloc(sizeof(guacd_config_pool));
+    pool->protocol = guac_strdup(protocol);
+    pool->size = size;
+    pool->next = config->pools;
+    config->pools = pool;
+
+    return 0;
+
+}
+
+/**
+ * Sets the address of the peer having the given name, replacing any address
+ * previously set for that peer. The address consists of a hostname or
+ * address, optionally followed by a colon and a port. IPv6 addresses must be
+ * enclosed in brackets if a port is given.
+ *
+ * @param config
+ *     The configuration to update.
+ *
+ * @param name
+ *     The name of the peer.
+ *
+ * @param value
+ *     The address of the peer, as a string.
+ *
+ * @return
+ *     Zero if the peer was set successfully, non-zero if the given value is
+ *     not a valid address.
+ */
+static int guacd_conf_set_peer(guacd_config* config,
+        const char* name, const char* value) {
+
+    const char* host = value;
+    size_t host_length;
+    const char* port = GUACD_DEFAULT_BIND_PORT;
+
+    /* Bracketed IPv6 address, optionally followed by port */
+    if (*value == '[') {
+
+        const char* end = strchr(value, ']');
+        if (end == NULL || (end[1] != '\0' && end[1] != ':')) {
+            guacd_conf_parse_error = "Invalid peer address. IPv6 addresses "
+                "must be enclosed in brackets if a port is given.";
+            return 1;
+        }
+
+        host = value + 1;
+        host_length = end - host;
+        if (end[1] == ':')
+            port = end + 2;
+
+    }
+
+    /* Hostname or IPv4 address, optionally followed by port */
+    else {
+
+        const char* colon = strchr(value, ':');
+        if (colon != NULL && strchr(colon + 1, ':') != NULL) {
+            guacd_conf_parse_error = "Invalid peer address. IPv6 addresses "
+                "must be enclosed in brackets if a port is given.";
+            return 1;
+        }
+
+        host_length = (colon != NULL) ? (size_t) (colon - value) : strlen(value);
+        if (colon != NULL)
+            port = colon + 1;
+
+    }
+
+    if (host_length == 0 || *port == '\0') {
+        guacd_conf_parse_error = "Invalid peer address. Peer addresses must "
+            "be a hostname or address, optionally followed by a colon and a "
+            "port.";
+        return 1;
+    }
+
+    /* Update existing peer, if any */
+    guacd_config_peer* peer;
+    for (peer = config->peers; peer != NULL; peer = peer->next) {
+        if (strcmp(peer->name, name) == 0)
+            break;
+    }
+
+    /* Otherwise, add new peer */
+    if (peer == NULL) {
+        peer = guac_mem_alloc(sizeof(guacd_config_peer));
+        peer->name = guac_strdup(name);
+        peer->next = config->peers;
+        config->peers = peer;
+    }
+    else {
+        guac_mem_free(peer->host);
+        guac_mem_free(peer->port);
+    }
+
+    peer->host = guac_strndup(host, host_length);
+    peer->port = guac_strdup(port);
+
+    return 0;
+
+}
+
+/**
+ * Returns the resource limits configured for the given protocol, or the
+ * default resource limits if the protocol is NULL, adding a new set of unset
+ * limits to the configuration if none yet exist.
+ *
+ * @param config
+ *     The configuration to search and update.
+ *
+ * @param protocol
+ *     The name of the protocol, which need not be null-terminated, or NULL
+ *     for the default limits.
+ *
+ * @param length
+ *     The length of the protocol name, in bytes. This is ignored if the
+ *     protocol is NULL.
+ *
+ * @return
+ *     The resource limits configured for the given protocol.
+ */
+static guacd_config_cgroup* guacd_conf_get_cgroup(guacd_config* config,
+        const char* protocol, size_t length) {
+
+    /* Find existing limits, if any */
+    guacd_config_cgroup* cgroup;
+    for (cgroup = config->cgroups; cgroup != NULL; cgroup = cgroup->next) {
+
+        if (protocol == NULL && cgroup->protocol == NULL)
+            return cgroup;
+
+        if (protocol != NULL && cgroup->protocol != NULL
+                && strlen(cgroup->protocol) == length
+                && strncmp(cgroup->protocol, protocol, length) == 0)
+            return cgroup;
+
+    }
+
+    /* Otherwise, add new limits */
+    cgroup = guac_mem_zalloc(sizeof(guacd_config_cgroup));
+    if (protocol != NULL) {
+        cgroup->protocol = guac_mem_zalloc(length + 1);
+        memcpy(cgroup->protocol, protocol, length);
+    }
+
+    cgroup->next = config->cgroups;
+    config->cgroups = cgroup;
+
+    return cgroup;
+
+}
+
+/**
+ * Removes the given suffix from the given cgroup parameter name, determining
+ * the protocol to which that parameter applies. Parameters which consist only
+ * of the suffix (such as "cpu_weight") apply by default to all protocols,
+ * while parameters with a protocol name prefix (such as "rdp_cpu_weight")
+ * apply only to that protocol.
+ *
+ * @param param
+ *     The name of the parameter.
+ *
+ * @param suffix
+ *     The name of the resource limit being checked for, such as
+ *     "cpu_weight".
+ *
+ * @param protocol
+ *     Pointer to the location where the start of the protocol name should be
+ *     stored, or NULL if the parameter applies to all protocols.
+ *
+ * @param length
+ *     Pointer to the location where the length of the protocol name should
+ *     be stored.
+ *
+ * @return
+ *     Non-zero if the parameter sets the resource limit having the given
+ *     suffix, zero otherwise.
+ */
+static int guacd_conf_match_cgroup_param(const char* param,
+        const char* suffix, const char** protocol, size_t* length) {
+
+    size_t param_length = strlen(param);
+    size_t suffix_length = strlen(suffix);
+
+    /* Parameter applies to all protocols */
+    if (strcmp(param, suffix) == 0) {
+        *protocol = NULL;
+        *length = 0;
+        return 1;
+    }
+
+    /* Parameter applies to a single protocol, named before an underscore */
+    if (param_length > suffix_length + 1
+            && strcmp(param + param_length - suffix_length, suffix) == 0
+            && param[param_length - suffix_length - 1] == '_') {
+        *protocol = param;
+        *length = param_length - suffix_length - 1;
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Parses the given amount of memory, which may be given in bytes or with a
+ * "K", "M", "G", or "T" suffix (for kibibytes, mebibytes, gibibytes, or
+ * tebibytes respectively).
+ *
+ * @param value
+ *     The amount of memory, as a string.
+ *
+ * @return
+ *     The amount of memory in bytes, or a non-positive value if the given
+ *     value is not a valid amount of memory.
+ */
+static long long guacd_conf_parse_memory(const char* value) {
+
+    char* end;
+    errno = 0;
+    long long bytes = strtoll(value, &end, 10);
+    if (errno || *value == '\0' || bytes <= 0)
+        return -1;
+
+    /* Apply unit, if any */
+    int shift = 0;
+    switch (*end) {
+        case '\0':          break;
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        case 'T': case 't': shift = 40; end++; break;
+        default: return -1;
+    }
+
+    if (*end != '\0' || bytes > (LLONG_MAX >> shift))
+        return -1;
+
+    return bytes << shift;
+
+}
+
+/**
+ * Sets the cgroup directory or one of the resource limits applied to
+ * connection processes, as configured within the "cgroup" section of the
+ * configuration file.
+ *
+ * @param config
+ *     The configuration to update.
+ *
+ * @param param
+ *     The name of the parameter being set.
+ *
+ * @param value
+ *     The value of the parameter.
+ *
+ * @return
+ *     Zero if the parameter was set successfully, non-zero if the parameter
+ *     or its value are not valid.
+ */
+static int guacd_conf_set_cgroup(guacd_config* config, const char* param,
+        const char* value) {
+
+    const char* protocol;
+    size_t length;
+
+    /* Parent cgroup of all connection processes */
+    if (strcmp(param, "path") == 0) {
+        guac_mem_free(config->cgroup_path);
+        config->cgroup_path = guac_strdup(value);
+        return 0;
+    }
+
+    /* Relative share of CPU time */
+    else if (guacd_conf_match_cgroup_param(param, "cpu_weight", &protocol, &length)) {
+
+        char* end;
+        errno = 0;
+        long weight = strtol(value, &end, 10);
+        if (errno || *value == '\0' || *end != '\0'
+                || weight < 1 || weight > GUACD_MAX_CGROUP_CPU_WEIGHT) {
+            guacd_conf_parse_error = "Invalid CPU weight. CPU weights must be "
+                "whole numbers between 1 and 10000.";
+            return 1;
+        }
+
+        guacd_conf_get_cgroup(config, protocol, length)->cpu_weight = weight;
+        return 0;
+
+    }
+
+    /* Maximum CPU time, as a number of CPUs */
+    else if (guacd_conf_match_cgroup_param(param, "cpu_max", &protocol, &length)) {
+
+        char* end;
+        errno = 0;
+        double cpus = strtod(value, &end);
+        if (errno || *value == '\0' || *end != '\0'
+                || cpus < 0.01 || cpus > 1000000) {
+            guacd_conf_parse_error = "Invalid CPU maximum. CPU maximums must "
+                "be a number of CPUs no smaller than 0.01 (for example, "
+                "\"0.5\" or \"2\").";
+            return 1;
+        }
+
+        guacd_conf_get_cgroup(config, protocol, length)->cpu_max = cpus * 1000 + 0.5;
+        return 0;
+
+    }
+
+    /* Maximum memory */
+    else if (guacd_conf_match_cgroup_param(param, "memory_max", &protocol, &length)) {
+
+        long long bytes = guacd_conf_parse_memory(value);
+        if (bytes <= 0) {
+            guacd_conf_parse_error = "Invalid memory maximum. Memory maximums "
+                "must be a whole number of bytes, optionally followed by "
+                "\"K\", \"M\", \"G\", or \"T\".";
+            return 1;
+        }
+
+        guacd_conf_get_cgroup(config, protocol, length)->memory_max = bytes;
+        return 0;
+
+    }
+
+    guacd_conf_parse_error = "Invalid parameter or section name";
+    return 1;
+
+}
+
 /**
  * Updates the configuration with the given parameter/value pair, flagging
  * errors as necessary.
@@ -62,6 +436,34 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
             return 0;
         }
 
+        /* Number of listener threads */
+        else if (strcmp(param, "listener_threads") == 0) {
+
+            char* end;
+            errno = 0;
+            long threads = strtol(value, &end, 10);
+
+            /* Invalid number of threads */
+            if (errno || *value == '\0' || *end != '\0'
+                    || threads < 1 || threads > GUACD_MAX_LISTENER_THREADS) {
+                guacd_conf_parse_error = "Invalid number of listener threads. "
+                    "The number of listener threads must be a whole number "
+                    "between 1 and 64.";
+                return 1;
+            }
+
+            config->listener_threads = threads;
+            return 0;
+
+        }
+
+        /* UNIX domain socket for shared memory transport */
+        else if (strcmp(param, "shm_socket") == 0) {
+            guac_mem_free(config->shm_socket);
+            config->shm_socket = guac_strdup(value);
+            return 0;
+        }
+
     }
 
     /* Options related to daemon startup */
@@ -91,6 +493,255 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Number of display worker threads per connection process */
+        else if (strcmp(param, "display_worker_threads") == 0) {
+
+            char* end;
+            errno = 0;
+            long threads = strtol(value, &end, 10);
+
+            /* Invalid number of threads */
+            if (errno || *value == '\0' || *end != '\0'
+                    || threads < 0 || threads > GUACD_MAX_DISPLAY_WORKER_THREADS) {
+                guacd_conf_parse_error = "Invalid number of display worker "
+                    "threads. The number of display worker threads must be a "
+                    "whole number no greater than 256, where 0 selects the "
+                    "number of available processors.";
+                return 1;
+            }
+
+            config->display_worker_threads = threads;
+            return 0;
+
+        }
+
+        /* Whether displays share worker threads */
+        else if (strcmp(param, "shared_display_workers") == 0) {
+
+            if (strcmp(value, "true") == 0)
+                config->shared_display_workers = 1;
+            else if (strcmp(value, "false") == 0)
+                config->shared_display_workers = 0;
+
+            /* Invalid boolean */
+            else {
+                guacd_conf_parse_error = "Invalid value for "
+                    "shared_display_workers. Valid values are \"true\" and "
+                    "\"false\".";
+                return 1;
+            }
+
+            return 0;
+
+        }
+
+        /* Lifetime of addresses cached by connection processes */
+        else if (strcmp(param, "dns_cache_ttl") == 0) {
+
+            char* end;
+            errno = 0;
+            long ttl = strtol(value, &end, 10);
+
+            /* Invalid lifetime */
+            if (errno || *value == '\0' || *end != '\0'
+                    || ttl < 0 || ttl > GUACD_MAX_DNS_CACHE_TTL) {
+                guacd_conf_parse_error = "Invalid DNS cache TTL. The DNS "
+                    "cache TTL must be a whole number of seconds no greater "
+                    "than 3600, where 0 disables the cache.";
+                return 1;
+            }
+
+            config->dns_cache_ttl = ttl;
+            return 0;
+
+        }
+
+        /* Amount of session recording data buffered in memory */
+        else if (strcmp(param, "recording_buffer_size") == 0) {
+
+            long long bytes = strcmp(value, "0") == 0
+                ? 0 : guacd_conf_parse_memory(value);
+
+            /* Invalid buffer size */
+            if (bytes < 0 || bytes > GUACD_MAX_RECORDING_BUFFER_SIZE) {
+                guacd_conf_parse_error = "Invalid recording buffer size. The "
+                    "recording buffer size must be a whole number of bytes no "
+                    "greater than 1G, optionally followed by \"K\", \"M\", or "
+                    "\"G\", where 0 disables buffering.";
+                return 1;
+            }
+
+            config->recording_buffer_size = bytes;
+            return 0;
+
+        }
+
+        /* Compression of session recordings */
+        else if (strcmp(param, "recording_compression") == 0) {
+
+            char* end;
+            errno = 0;
+            long level = strtol(value, &end, 10);
+
+            /* Invalid compression level */
+            if (errno || *value == '\0' || *end != '\0'
+                    || level < 0 || level > GUAC_RECORDING_MAX_COMPRESSION) {
+                guacd_conf_parse_error = "Invalid recording compression "
+                    "level. The recording compression level must be a whole "
+                    "number between 1 and 19, where 0 disables compression.";
+                return 1;
+            }
+
+            config->recording_compression = level;
+            return 0;
+
+        }
+
+        /* Quality of image data within session recordings */
+        else if (strcmp(param, "recording_image_quality") == 0) {
+
+            char* end;
+            errno = 0;
+            long quality = strtol(value, &end, 10);
+
+            /* Invalid quality */
+            if (errno || *value == '\0' || *end != '\0'
+                    || quality < 0 || quality > 100) {
+                guacd_conf_parse_error = "Invalid recording image quality. "
+                    "The recording image quality must be a whole number "
+                    "between 1 and 100, where 0 records exactly the image "
+                    "data sent to users.";
+                return 1;
+            }
+
+            config->recording_image_quality = quality;
+            return 0;
+
+        }
+
+        /* Interval between keyframes of session recording indexes */
+        else if (strcmp(param, "recording_index_interval") == 0) {
+
+            char* end;
+            errno = 0;
+            long interval = strtol(value, &end, 10);
+
+            /* Invalid interval */
+            if (errno || *value == '\0' || *end != '\0'
+                    || interval < 0 || interval > INT_MAX / 1000) {
+                guacd_conf_parse_error = "Invalid recording index interval. "
+                    "The recording index interval must be a whole number of "
+                    "seconds, where 0 disables the index.";
+                return 1;
+            }
+
+            config->recording_index_interval = interval;
+            return 0;
+
+        }
+
+        /* Maximum duration of each session recording segment */
+        else if (strcmp(param, "recording_segment_duration") == 0) {
+
+            char* end;
+            errno = 0;
+            long duration = strtol(value, &end, 10);
+
+            /* Invalid duration */
+            if (errno || *value == '\0' || *end != '\0'
+                    || duration < 0 || duration > INT_MAX / 1000) {
+                guacd_conf_parse_error = "Invalid recording segment "
+                    "duration. The recording segment duration must be a "
+                    "whole number of seconds, where 0 does not limit the "
+                    "duration of segments.";
+                return 1;
+            }
+
+            config->recording_segment_duration = duration;
+            return 0;
+
+        }
+
+        /* Maximum size of each session recording segment */
+        else if (strcmp(param, "recording_segment_size") == 0) {
+
+            long long bytes = strcmp(value, "0") == 0
+                ? 0 : guacd_conf_parse_memory(value);
+
+            /* Invalid segment size */
+            if (bytes < 0) {
+                guacd_conf_parse_error = "Invalid recording segment size. The "
+                    "recording segment size must be a whole number of bytes, "
+                    "optionally followed by \"K\", \"M\", \"G\", or \"T\", "
+                    "where 0 does not limit the size of segments.";
+                return 1;
+            }
+
+            config->recording_segment_size = bytes;
+            return 0;
+
+        }
+
+        /* Behavior of session recordings whose buffer is full */
+        else if (strcmp(param, "recording_overflow") == 0) {
+
+            if (strcmp(value, "block") == 0)
+                config->recording_overflow = GUAC_RECORDING_OVERFLOW_BLOCK;
+            else if (strcmp(value, "drop") == 0)
+                config->recording_overflow = GUAC_RECORDING_OVERFLOW_DROP;
+            else if (strcmp(value, "throttle") == 0)
+                config->recording_overflow = GUAC_RECORDING_OVERFLOW_THROTTLE;
+
+            /* Invalid behavior */
+            else {
+                guacd_conf_parse_error = "Invalid value for "
+                    "recording_overflow. Valid values are \"block\", "
+                    "\"drop\", and \"throttle\".";
+                return 1;
+            }
+
+            return 0;
+
+        }
+
+    }
+
+    /* Idle processes to keep ready for each protocol */
+    else if (strcmp(section, "pool") == 0)
+        return guacd_conf_set_pool_size(config, param, value);
+
+    /* Other guacd nodes hosting connections which may be joined */
+    else if (strcmp(section, "peers") == 0)
+        return guacd_conf_set_peer(config, param, value);
+
+    /* Resource limits of connection processes */
+    else if (strcmp(section, "cgroup") == 0)
+        return guacd_conf_set_cgroup(config, param, value);
+
+    /* Metrics listener */
+    else if (strcmp(section, "metrics") == 0) {
+
+        /* Bind host */
+        if (strcmp(param, "bind_host") == 0) {
+            guac_mem_free(config->metrics_bind_host);
+            config->metrics_bind_host = guac_strdup(value);
+            return 0;
+        }
+
+        /* Bind port */
+        else if (strcmp(param, "bind_port") == 0) {
+            guac_mem_free(config->metrics_bind_port);
+            config->metrics_bind_port = guac_strdup(value);
+            return 0;
+        }
+
+        /* UNIX domain socket */
+        else if (strcmp(param, "socket") == 0) {
+            guac_mem_free(config->metrics_socket);
+            config->metrics_socket = guac_strdup(value);
+            return 0;
+        }
+
     }
 
     /* SSL-specific options */
@@ -180,10 +831,29 @@ guacd_config* guacd_conf_load() {
     /* Load defaults */
     conf->bind_host = guac_strdup(GUACD_DEFAULT_BIND_HOST);
     conf->bind_port = guac_strdup(GUACD_DEFAULT_BIND_PORT);
+    conf->listener_threads = GUACD_DEFAULT_LISTENER_THREADS;
+    conf->shm_socket = NULL;
     conf->pidfile = NULL;
     conf->foreground = 0;
     conf->print_version = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->display_worker_threads = 0;
+    conf->shared_display_workers = 0;
+    conf->dns_cache_ttl = 0;
+    conf->recording_buffer_size = GUAC_RECORDING_DEFAULT_BUFFER_SIZE;
+    conf->recording_overflow = GUAC_RECORDING_OVERFLOW_BLOCK;
+    conf->recording_index_interval = 0;
+    conf->recording_compression = 0;
+    conf->recording_image_quality = 0;
+    conf->recording_segment_duration = 0;
+    conf->recording_segment_size = 0;
+    conf->pools = NULL;
+    conf->peers = NULL;
+    conf->cgroup_path = NULL;
+    conf->cgroups = NULL;
+    conf->metrics_bind_host = guac_strdup(GUACD_DEFAULT_METRICS_BIND_HOST);
+    conf->metrics_bind_port = NULL;
+    conf->metrics_socket = NULL;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
@@ -23,6 +23,9 @@
 #include "config.h"
 
 #include <guacamole/client.h>
+#include <guacamole/recording.h>
+
+#include <stdint.h>
 
 /**
  * The default host that guacd should bind to, if no other host is explicitly
@@ -36,6 +39,151 @@
  */
 #define GUACD_DEFAULT_BIND_PORT "4822"
 
+/**
+ * The default host that the metrics listener of guacd should bind to, if a
+ * metrics port is given but no host is explicitly specified.
+ */
+#define GUACD_DEFAULT_METRICS_BIND_HOST "localhost"
+
+/**
+ * The default number of threads that should accept new connections, each
+ * listening on its own socket, if no other number is explicitly specified.
+ */
+#define GUACD_DEFAULT_LISTENER_THREADS 1
+
+/**
+ * The maximum number of threads that may accept new connections.
+ */
+#define GUACD_MAX_LISTENER_THREADS 64
+
+/**
+ * The maximum number of worker threads that each connection process may be
+ * configured to use for encoding graphical updates.
+ */
+#define GUACD_MAX_DISPLAY_WORKER_THREADS 256
+
+/**
+ * The maximum number of seconds that addresses resolved by connection
+ * processes may be configured to remain cached.
+ */
+#define GUACD_MAX_DNS_CACHE_TTL 3600
+
+/**
+ * The maximum number of bytes that each session recording may be configured
+ * to buffer in memory.
+ */
+#define GUACD_MAX_RECORDING_BUFFER_SIZE 1073741824
+
+/**
+ * The maximum number of idle processes that may be kept ready for any one
+ * protocol.
+ */
+#define GUACD_MAX_POOL_SIZE 256
+
+/**
+ * The largest CPU weight that may be given to the processes of any protocol,
+ * as allowed by the "cpu.weight" interface file of cgroup v2.
+ */
+#define GUACD_MAX_CGROUP_CPU_WEIGHT 10000
+
+/**
+ * The resource limits that should be applied to each connection process
+ * using a particular protocol, or to each connection process by default, as
+ * configured within the "cgroup" section of the configuration file. Any limit
+ * that is unset (zero) falls back to the default limits, and is not applied
+ * at all if also unset there.
+ */
+typedef struct guacd_config_cgroup {
+
+    /**
+     * The name of the protocol, as would be given in the "select"
+     * instruction of a new connection, or NULL if these are the limits
+     * applied by default.
+     */
+    char* protocol;
+
+    /**
+     * The relative share of CPU time given to each process, between 1 and
+     * GUACD_MAX_CGROUP_CPU_WEIGHT, or zero if unset.
+     */
+    int cpu_weight;
+
+    /**
+     * The maximum amount of CPU time each process may use, in thousandths of
+     * one CPU, or zero if unset.
+     */
+    long cpu_max;
+
+    /**
+     * The maximum amount of memory each process may use, in bytes, or zero
+     * if unset.
+     */
+    long long memory_max;
+
+    /**
+     * The limits of the next protocol, or NULL if there are no further
+     * protocols.
+     */
+    struct guacd_config_cgroup* next;
+
+} guacd_config_cgroup;
+
+/**
+ * The number of idle processes which guacd should keep ready for new
+ * connections using a particular protocol, as configured within the "pool"
+ * section of the configuration file.
+ */
+typedef struct guacd_config_pool {
+
+    /**
+     * The name of the protocol, as would be given in the "select"
+     * instruction of a new connection.
+     */
+    char* protocol;
+
+    /**
+     * The number of idle processes to keep ready for the protocol.
+     */
+    int size;
+
+    /**
+     * The pool configuration of the next protocol, or NULL if there are no
+     * further protocols.
+     */
+    struct guacd_config_pool* next;
+
+} guacd_config_pool;
+
+/**
+ * Another guacd node within the same pool of guacd nodes, as configured
+ * within the "peers" section of the configuration file. Requests to join
+ * connections which are not hosted locally are forwarded to whichever peer
+ * hosts the requested connection.
+ */
+typedef struct guacd_config_peer {
+
+    /**
+     * The name of the peer, used only when logging.
+     */
+    char* name;
+
+    /**
+     * The hostname or address of the peer.
+     */
+    char* host;
+
+    /**
+     * The port on which the peer accepts unencrypted connections.
+     */
+    char* port;
+
+    /**
+     * The next peer, or NULL if there are no further peers.
+     */
+    struct guacd_config_peer* next;
+
+} guacd_config_peer;
+
 /**
  * The contents of a guacd configuration file.
  */
@@ -51,6 +199,21 @@ typedef struct guacd_config {
      */
     char* bind_port;
 
+    /**
+     * The number of threads that should accept new connections. If greater
+     * than one, each thread listens on its own socket bound to the same
+     * address with SO_REUSEPORT, and the kernel distributes new connections
+     * between those sockets.
+     */
+    int listener_threads;
+
+    /**
+     * The path of the UNIX domain socket on which guacd should accept
+     * connections from co-located proxies using a shared memory transport,
+     * or NULL if no such connections should be accepted.
+     */
+    char* shm_socket;
+
     /**
      * The file to write the PID in, if any.
      */
@@ -83,6 +246,115 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * The number of worker threads that each connection process should use
+     * for encoding graphical updates, or zero if this should be derived from
+     * the processors available to each connection process.
+     */
+    int display_worker_threads;
+
+    /**
+     * Whether all displays within each connection process should share a
+     * single pool of worker threads, rather than each display using worker
+     * threads of its own.
+     */
+    int shared_display_workers;
+
+    /**
+     * The number of seconds that addresses resolved by connection processes
+     * should remain within a cache shared by all connection processes, or
+     * zero if resolved addresses should not be cached.
+     */
+    int dns_cache_ttl;
+
+    /**
+     * The number of bytes that each session recording should buffer in
+     * memory while being written to disk, or zero if session recordings
+     * should be written directly.
+     */
+    size_t recording_buffer_size;
+
+    /**
+     * The behavior of each session recording when its buffer is full.
+     */
+    guac_recording_overflow recording_overflow;
+
+    /**
+     * The minimum number of seconds between keyframes written to the index
+     * of each session recording, or zero if no index should be written.
+     */
+    int recording_index_interval;
+
+    /**
+     * The zstd compression level of each session recording, or zero if
+     * session recordings should not be compressed.
+     */
+    int recording_compression;
+
+    /**
+     * The maximum JPEG quality of image data within each session recording,
+     * or zero if session recordings should contain exactly the image data
+     * sent to connected users.
+     */
+    int recording_image_quality;
+
+    /**
+     * The maximum number of seconds covered by each segment of each session
+     * recording, or zero if segments should not be limited by duration.
+     */
+    int recording_segment_duration;
+
+    /**
+     * The maximum number of bytes of each segment of each session recording,
+     * or zero if segments should not be limited by size.
+     */
+    uint64_t recording_segment_size;
+
+    /**
+     * The number of idle processes to keep ready for each protocol, or NULL
+     * if no processes should be started until needed.
+     */
+    guacd_config_pool* pools;
+
+    /**
+     * The other guacd nodes to which requests to join connections that are
+     * not hosted locally should be forwarded, or NULL if such requests
+     * should simply fail.
+     */
+    guacd_config_peer* peers;
+
+    /**
+     * The cgroup v2 directory beneath which each connection process should be
+     * placed within its own cgroup, or NULL if connection processes should
+     * remain within the cgroup of guacd.
+     */
+    char* cgroup_path;
+
+    /**
+     * The resource limits to apply to connection processes, if cgroup_path
+     * is set, or NULL if no limits have been configured.
+     */
+    guacd_config_cgroup* cgroups;
+
+    /**
+     * The host that the metrics listener should bind to, if metrics_bind_port
+     * is set.
+     */
+    char* metrics_bind_host;
+
+    /**
+     * The TCP port that the metrics listener should bind to, or NULL if
+     * metrics should not be served over TCP.
+     */
+    char* metrics_bind_port;
+
+    /**
+     * The path of the UNIX domain socket that the metrics listener should
+     * bind to, or NULL if metrics should not be served over a UNIX domain
+     * socket. This takes precedence over metrics_bind_port.
+     */
+    char* metrics_socket;
+
 } guacd_config;
 
 #endif
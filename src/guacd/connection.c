@@ -21,9 +21,12 @@
 
 #include "connection.h"
 #include "log.h"
+#include "metrics.h"
 #include "move-fd.h"
+#include "peer.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "proxy.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -32,6 +35,7 @@
 #include <guacamole/plugin.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/unicode.h>
 #include <guacamole/user.h>
 
 #ifdef ENABLE_SSL
@@ -39,7 +43,13 @@
 #include <guacamole/socket-ssl.h>
 #endif
 
+#ifdef ENABLE_SHM
+#include <guacamole/socket-shm.h>
+#include <poll.h>
+#endif
+
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -110,14 +120,18 @@ static void* guacd_connection_write_thread(void* data) {
 
     int length;
 
-    /* Read all buffered data from parser first */
-    while ((length = guac_parser_shift(params->parser, buffer, sizeof(buffer))) > 0) {
-        if (__write_all(params->fd, buffer, length) < 0)
-            break;
-    }
+    /* Read all buffered data from parser first, if not already read */
+    if (params->parser != NULL) {
 
-    /* Parser is no longer needed */
-    guac_parser_free(params->parser);
+        while ((length = guac_parser_shift(params->parser, buffer, sizeof(buffer))) > 0) {
+            if (__write_all(params->fd, buffer, length) < 0)
+                break;
+        }
+
+        /* Parser is no longer needed */
+        guac_parser_free(params->parser);
+
+    }
 
     /* Transfer data from file descriptor to socket */
     while ((length = guac_socket_read(params->socket, buffer, sizeof(buffer))) > 0) {
@@ -158,6 +172,62 @@ void* guacd_connection_io_thread(void* data) {
 
 }
 
+/**
+ * Begins transferring data back and forth between the given socket and the
+ * given file descriptor, proxying unencrypted connections using the shared
+ * event loop, rather than dedicated threads, if possible. Any data already
+ * buffered by the given parser is transferred first. The given parser,
+ * socket, and file descriptor are all freed once the transfer is complete.
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket, which may contain
+ *     buffered, but unparsed, data.
+ *
+ * @param socket
+ *     The socket associated with the user's connection to guacd.
+ *
+ * @param socket_fd
+ *     The file descriptor wrapped by the given socket, if data may be read
+ *     from and written to that file descriptor directly (the connection is
+ *     not encrypted), or -1 if all I/O must go through the given socket.
+ *
+ * @param fd
+ *     The file descriptor that data should be transferred to and from.
+ */
+static void guacd_connection_transfer(guac_parser* parser,
+        guac_socket* socket, int socket_fd, int fd) {
+
+    if (socket_fd != -1) {
+
+        /* Transfer any data already buffered by the parser */
+        char buffer[8192];
+        int length;
+        while ((length = guac_parser_shift(parser, buffer, sizeof(buffer))) > 0) {
+            if (__write_all(fd, buffer, length) < 0)
+                break;
+        }
+
+        guac_parser_free(parser);
+        parser = NULL;
+
+        guac_socket_flush(socket);
+        if (!guacd_proxy_add(socket, socket_fd, fd))
+            return;
+
+    }
+
+    guacd_connection_io_thread_params* params = guac_mem_alloc(sizeof(guacd_connection_io_thread_params));
+    params->parser = parser;
+    params->socket = socket;
+    params->fd = fd;
+
+    /* Start I/O thread */
+    pthread_t io_thread;
+    pthread_create(&io_thread,  NULL, guacd_connection_io_thread,  params);
+    pthread_detach(io_thread);
+
+}
+
 /**
  * Adds the given socket as a new user to the given process, automatically
  * reading/writing from the socket via read/write threads. The given socket,
@@ -178,10 +248,58 @@ void* guacd_connection_io_thread(void* data) {
  *     The socket associated with the user to be added to the existing
  *     process.
  *
+ * @param socket_fd
+ *     The file descriptor wrapped by the given socket, if data may be read
+ *     from and written to that file descriptor directly (the connection is
+ *     not encrypted), or -1 if all I/O must go through the given socket.
+ *
+ * @param shm_fds
+ *     The GUAC_SOCKET_SHM_FD_COUNT file descriptors of the shared memory
+ *     transport wrapped by the given socket, or NULL if the given socket does
+ *     not use a shared memory transport.
+ *
  * @return
  *     Zero if the user was added successfully, non-zero if an error occurred.
  */
-static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* socket) {
+static int guacd_add_user(guacd_proc* proc, guac_parser* parser,
+        guac_socket* socket, int socket_fd, const int* shm_fds) {
+
+#ifdef ENABLE_SHM
+    /* Shared memory transports can likewise be handed directly to the
+     * process, which then maps the same memory itself */
+    if (shm_fds != NULL && guac_parser_length(parser) == 0) {
+
+        guac_socket_flush(socket);
+        if (!guacd_send_fds(proc->fd_socket, shm_fds,
+                    GUAC_SOCKET_SHM_FD_COUNT)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+            return 1;
+        }
+
+        /* The process now has its own copies of the file descriptors */
+        guac_parser_free(parser);
+        guac_socket_free(socket);
+        return 0;
+
+    }
+#endif
+
+    /* Hand unencrypted connections directly to the process if nothing beyond
+     * the handshake has yet been read, removing guacd from the data path */
+    if (socket_fd != -1 && guac_parser_length(parser) == 0) {
+
+        guac_socket_flush(socket);
+        if (!guacd_send_fd(proc->fd_socket, socket_fd)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+            return 1;
+        }
+
+        /* The process now has its own copy of the file descriptor */
+        guac_parser_free(parser);
+        guac_socket_free(socket);
+        return 0;
+
+    }
 
     int sockets[2];
 
@@ -197,22 +315,74 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
     /* Send user file descriptor to process */
     if (!guacd_send_fd(proc->fd_socket, proc_fd)) {
         guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+        close(user_fd);
+        close(proc_fd);
         return 1;
     }
 
     /* Close our end of the process file descriptor */
     close(proc_fd);
 
-    guacd_connection_io_thread_params* params = guac_mem_alloc(sizeof(guacd_connection_io_thread_params));
-    params->parser = parser;
-    params->socket = socket;
-    params->fd = user_fd;
+    guacd_connection_transfer(parser, socket, socket_fd, user_fd);
+    return 0;
 
-    /* Start I/O thread */
-    pthread_t io_thread;
-    pthread_create(&io_thread,  NULL, guacd_connection_io_thread,  params);
-    pthread_detach(io_thread);
+}
+
+/**
+ * Forwards the connection on the given socket to the given peer, which hosts
+ * the connection being joined. The "select" instruction already read is
+ * sent to the peer, followed by all further data, such that the peer handles
+ * the remainder of the handshake and the connection itself. The given
+ * socket and parser will be freed unless forwarding fails.
+ *
+ * @param peer
+ *     The peer hosting the connection being joined.
+ *
+ * @param parser
+ *     The parser associated with the given guac_socket, which has read the
+ *     "select" instruction of the connection.
+ *
+ * @param socket
+ *     The socket associated with the user's connection to guacd.
+ *
+ * @param socket_fd
+ *     The file descriptor wrapped by the given socket, if data may be read
+ *     from and written to that file descriptor directly (the connection is
+ *     not encrypted), or -1 if all I/O must go through the given socket.
+ *
+ * @param identifier
+ *     The ID of the connection being joined.
+ *
+ * @return
+ *     Zero if the connection is now being forwarded, non-zero if forwarding
+ *     has failed.
+ */
+static int guacd_forward_connection(guacd_config_peer* peer,
+        guac_parser* parser, guac_socket* socket, int socket_fd,
+        const char* identifier) {
+
+    int peer_fd = guacd_peer_connect(peer);
+    if (peer_fd < 0)
+        return 1;
+
+    /* Repeat the "select" instruction to the peer, which will ultimately
+     * route the connection locally */
+    char select[8192];
+    int length = snprintf(select, sizeof(select), "6.select,%zu.%s;",
+            guac_utf8_strlen(identifier), identifier);
+
+    if (length < 0 || length >= (int) sizeof(select)
+            || __write_all(peer_fd, select, length) < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to forward connection to peer "
+                "\"%s\".", peer->name);
+        close(peer_fd);
+        return 1;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Forwarding request to join connection \"%s\" "
+            "to peer \"%s\"", identifier, peer->name);
 
+    guacd_connection_transfer(parser, socket, socket_fd, peer_fd);
     return 0;
 
 }
@@ -229,15 +399,36 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
  * @param map
  *     The map of existing client processes.
  *
+ * @param pool
+ *     The pool of idle processes which should be used in preference to
+ *     creating new processes, or NULL if no such processes are kept.
+ *
+ * @param peers
+ *     The other guacd nodes to which requests to join connections that are
+ *     not within the given map should be forwarded, or NULL if such requests
+ *     should simply fail.
+ *
  * @param socket
  *     The socket associated with the new connection that must be routed to
  *     a new or existing process within the given map.
  *
+ * @param socket_fd
+ *     The file descriptor wrapped by the given socket, if data may be read
+ *     from and written to that file descriptor directly (the connection is
+ *     not encrypted), or -1 if all I/O must go through the given socket.
+ *
+ * @param shm_fds
+ *     The GUAC_SOCKET_SHM_FD_COUNT file descriptors of the shared memory
+ *     transport wrapped by the given socket, or NULL if the given socket does
+ *     not use a shared memory transport.
+ *
  * @return
  *     Zero if the connection was successfully routed, non-zero if routing has
  *     failed.
  */
-static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
+static int guacd_route_connection(guacd_proc_map* map, guacd_proc_pool* pool,
+        guacd_config_peer* peers, guac_socket* socket, int socket_fd,
+        const int* shm_fds) {
 
     guac_parser* parser = guac_parser_alloc();
 
@@ -245,8 +436,9 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
     guac_error = GUAC_STATUS_SUCCESS;
     guac_error_message = NULL;
 
-    /* Get protocol from select instruction */
-    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "select")) {
+    /* Read first instruction, which should be "select" unless this is a
+     * lookup from a peer */
+    if (guac_parser_read(parser, socket, GUACD_USEC_TIMEOUT)) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -257,6 +449,37 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
         return 1;
     }
 
+    /* Answer lookups from peers using only the local process map, such that
+     * lookups are never forwarded between peers. Lookups from anything other
+     * than a peer are refused, as they would otherwise allow any client to
+     * test which connection IDs exist. */
+    if (peers != NULL && strcmp(parser->opcode, GUACD_PEER_LOOKUP_OPCODE) == 0
+            && parser->argc == 1) {
+
+        if (!guacd_peer_is_peer_address(peers, socket_fd))
+            guacd_log(GUAC_LOG_WARNING, "Refusing lookup from an address "
+                    "which is not that of any configured peer.");
+
+        else if (guacd_peer_answer(socket, map, parser->argv[0]))
+            guacd_log_guac_error(GUAC_LOG_DEBUG, "Unable to reply to lookup "
+                    "from peer");
+
+        guac_parser_free(parser);
+        return 1;
+
+    }
+
+    if (strcmp(parser->opcode, "select") != 0) {
+
+        /* Log error */
+        guacd_log_handshake_failure();
+        guacd_log(GUAC_LOG_DEBUG, "Error reading \"select\": Instruction "
+                "read did not have expected opcode");
+
+        guac_parser_free(parser);
+        return 1;
+    }
+
     /* Validate args to select */
     if (parser->argc != 1) {
 
@@ -271,6 +494,7 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     guacd_proc* proc;
     int new_process;
+    int idle_process = 0;
 
     const char* identifier = parser->argv[0];
 
@@ -280,6 +504,17 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
         proc = guacd_proc_map_retrieve(map, identifier);
         new_process = 0;
 
+        /* Forward the request to whichever peer hosts the connection, if
+         * any, if the connection is not hosted locally */
+        if (proc == NULL && peers != NULL) {
+
+            guacd_config_peer* owner = guacd_peer_find(peers, identifier);
+            if (owner != NULL && !guacd_forward_connection(owner, parser,
+                        socket, socket_fd, identifier))
+                return 0;
+
+        }
+
         /* Warn and ward off client if requested connection does not exist */
         if (proc == NULL) {
             guacd_log(GUAC_LOG_INFO, "Connection \"%s\" does not exist", identifier);
@@ -293,16 +528,25 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     }
 
-    /* Otherwise, create new client */
+    /* Otherwise, create new client, using an idle process which has already
+     * been started for the requested protocol if possible */
     else {
 
-        guacd_log(GUAC_LOG_INFO, "Creating new client for protocol \"%s\"",
-                identifier);
-
-        /* Create new process */
-        proc = guacd_create_proc(identifier);
+        proc = guacd_proc_pool_take(pool, identifier);
         new_process = 1;
 
+        /* Create new process only if no idle process is available */
+        if (proc != NULL) {
+            guacd_log(GUAC_LOG_INFO, "Using idle client for protocol \"%s\"",
+                    identifier);
+            idle_process = 1;
+        }
+        else {
+            guacd_log(GUAC_LOG_INFO, "Creating new client for protocol \"%s\"",
+                    identifier);
+            proc = guacd_create_proc(identifier);
+        }
+
     }
 
     /* Abort if no process exists for the requested connection */
@@ -313,7 +557,30 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
     }
 
     /* Add new user (in the case of a new process, this will be the owner */
-    int add_user_failed = guacd_add_user(proc, parser, socket);
+    int add_user_failed = guacd_add_user(proc, parser, socket, socket_fd,
+            shm_fds);
+
+    /* An idle process may have terminated while waiting for its first user
+     * (if the plugin for its protocol failed to load, for example). Fall back
+     * to creating a new process, such that any genuine error is reported as
+     * usual. */
+    if (add_user_failed && idle_process) {
+
+        guacd_proc_free(proc);
+
+        guacd_log(GUAC_LOG_DEBUG, "Idle client could not be used. Creating "
+                "new client for protocol \"%s\".", identifier);
+        proc = guacd_create_proc(identifier);
+        if (proc == NULL) {
+            guacd_log_guac_error(GUAC_LOG_INFO, "Connection did not succeed");
+            guac_parser_free(parser);
+            return 1;
+        }
+
+        add_user_failed = guacd_add_user(proc, parser, socket, socket_fd,
+            shm_fds);
+
+    }
 
     /* If new process was created, manage that process */
     if (new_process) {
@@ -331,6 +598,9 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
             /* Wait for child to finish */
             waitpid(proc->pid, NULL, 0);
 
+            /* Retain final counters of process for metrics */
+            guacd_metrics_retire(proc);
+
             /* Remove client */
             if (guacd_proc_map_remove(map, proc->client->connection_id) == NULL)
                 guacd_log(GUAC_LOG_ERROR, "Internal failure removing "
@@ -347,22 +617,75 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
             guac_parser_free(parser);
 
         /* Force process to stop and clean up */
-        guacd_proc_stop(proc);
-
-        /* Free skeleton client */
-        guac_client_free(proc->client);
-
-        /* Clean up */
-        close(proc->fd_socket);
-        guac_mem_free(proc);
+        guacd_proc_free(proc);
 
     }
 
+    /* Otherwise, release the reference acquired when the existing process
+     * was retrieved */
+    else
+        guacd_proc_release(proc);
+
     /* Routing succeeded only if the user was added to a process */
     return add_user_failed;
 
 }
 
+#ifdef ENABLE_SHM
+/**
+ * Receives the file descriptors of a shared memory transport from a proxy
+ * which has just connected along the given UNIX domain socket, creating a
+ * guac_socket which communicates through that transport. The proxy must send
+ * a single 'G' byte along with the file descriptors of the shared memory
+ * region and of the four eventfds of the transport, in that order, within
+ * GUACD_TIMEOUT milliseconds of connecting.
+ *
+ * @param control_fd
+ *     The file descriptor of the connected UNIX domain socket.
+ *
+ * @param fds
+ *     The array which should receive all GUAC_SOCKET_SHM_FD_COUNT file
+ *     descriptors of the transport, including the given socket.
+ *
+ * @return
+ *     A newly-allocated guac_socket which communicates through the received
+ *     transport, or NULL if the transport could not be received or used, in
+ *     which case any received file descriptors (but not the given socket)
+ *     are closed.
+ */
+static guac_socket* guacd_connection_open_shm(int control_fd, int* fds) {
+
+    struct pollfd pending = { .fd = control_fd, .events = POLLIN };
+    if (poll(&pending, 1, GUACD_TIMEOUT) <= 0) {
+        guacd_log(GUAC_LOG_ERROR, "Shared memory transport was not received "
+                "in time.");
+        return NULL;
+    }
+
+    int count = guacd_recv_fds(control_fd, fds + 1, GUAC_SOCKET_SHM_FD_COUNT - 1);
+    if (count != GUAC_SOCKET_SHM_FD_COUNT - 1) {
+        guacd_log(GUAC_LOG_ERROR, "Shared memory transport was not received "
+                "(expected %i file descriptors).", GUAC_SOCKET_SHM_FD_COUNT - 1);
+        for (int i = 0; i < count; i++)
+            close(fds[i + 1]);
+        return NULL;
+    }
+
+    fds[GUAC_SOCKET_SHM_FD_CONTROL] = control_fd;
+
+    guac_socket* socket = guac_socket_open_shm(fds);
+    if (socket == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to use shared memory "
+                "transport");
+        for (int i = 1; i < GUAC_SOCKET_SHM_FD_COUNT; i++)
+            close(fds[i]);
+    }
+
+    return socket;
+
+}
+#endif
+
 void* guacd_connection_thread(void* data) {
 
     guacd_connection_thread_params* params = (guacd_connection_thread_params*) data;
@@ -372,6 +695,32 @@ void* guacd_connection_thread(void* data) {
 
     guac_socket* socket;
 
+    /* Data may be read and written directly unless encrypted */
+    int socket_fd = connected_socket_fd;
+
+#ifdef ENABLE_SHM
+    /* Connections from co-located proxies communicate through shared memory
+     * after sending the transport along the connection itself */
+    if (params->shm) {
+
+        int shm_fds[GUAC_SOCKET_SHM_FD_COUNT];
+        socket = guacd_connection_open_shm(connected_socket_fd, shm_fds);
+        if (socket == NULL) {
+            close(connected_socket_fd);
+            guac_mem_free(params);
+            return NULL;
+        }
+
+        if (guacd_route_connection(map, params->pool, params->peers, socket,
+                    -1, shm_fds))
+            guac_socket_free(socket);
+
+        guac_mem_free(params);
+        return NULL;
+
+    }
+#endif
+
 #ifdef ENABLE_SSL
 
     SSL_CTX* ssl_context = params->ssl_context;
@@ -385,6 +734,18 @@ void* guacd_connection_thread(void* data) {
             guac_mem_free(params);
             return NULL;
         }
+
+        SSL* ssl = ((guac_socket_ssl_data*) socket->data)->ssl;
+        guacd_log(GUAC_LOG_DEBUG, "TLS session %s.", SSL_session_reused(ssl)
+                ? "resumed" : "established with full handshake");
+
+#ifdef BIO_get_ktls_send
+        if (BIO_get_ktls_send(SSL_get_wbio(ssl)))
+            guacd_log(GUAC_LOG_DEBUG, "TLS records will be encrypted by the "
+                    "kernel.");
+#endif
+
+        socket_fd = -1;
     }
     else
         socket = guac_socket_open(connected_socket_fd);
@@ -395,7 +756,8 @@ void* guacd_connection_thread(void* data) {
 #endif
 
     /* Route connection according to Guacamole, creating a new process if needed */
-    if (guacd_route_connection(map, socket))
+    if (guacd_route_connection(map, params->pool, params->peers, socket,
+                socket_fd, NULL))
         guac_socket_free(socket);
 
     guac_mem_free(params);
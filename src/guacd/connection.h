@@ -22,7 +22,9 @@
 
 #include "config.h"
 
+#include "conf.h"
 #include "proc-map.h"
+#include "proc-pool.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -38,6 +40,19 @@ typedef struct guacd_connection_thread_params {
      */
     guacd_proc_map* map;
 
+    /**
+     * The shared pool of idle processes ready for new connections, or NULL if
+     * no such processes are kept.
+     */
+    guacd_proc_pool* pool;
+
+    /**
+     * The other guacd nodes to which requests to join connections that are
+     * not hosted locally should be forwarded, or NULL if such requests should
+     * simply fail.
+     */
+    guacd_config_peer* peers;
+
 #ifdef ENABLE_SSL
     /**
      * SSL context for encrypted connections to guacd. If SSL is not active,
@@ -51,6 +66,15 @@ typedef struct guacd_connection_thread_params {
      */
     int connected_socket_fd;
 
+#ifdef ENABLE_SHM
+    /**
+     * Whether the newly-accepted connection was accepted on the UNIX domain
+     * socket for shared memory transports, in which case the connection is
+     * used only to receive that transport.
+     */
+    int shm;
+#endif
+
 } guacd_connection_thread_params;
 
 /**
@@ -82,7 +106,8 @@ typedef struct guacd_connection_io_thread_params {
     /**
      * The guac_parser which may contain buffered, but unparsed, data from the
      * original guac_socket which must be transferred to the
-     * connection-specific process.
+     * connection-specific process, or NULL if any such data has already been
+     * transferred.
      */
     guac_parser* parser;
 
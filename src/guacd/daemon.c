@@ -19,14 +19,20 @@
 
 #include "config.h"
 
+#include "cgroup.h"
 #include "conf.h"
 #include "conf-args.h"
 #include "conf-file.h"
 #include "connection.h"
 #include "log.h"
+#include "metrics.h"
 #include "proc-map.h"
+#include "proc-pool.h"
 
+#include <guacamole/display.h>
 #include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/tcp.h>
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -47,12 +53,38 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #define GUACD_DEV_NULL "/dev/null"
 #define GUACD_ROOT     "/"
 
+/**
+ * The maximum number of pending connections that may be queued on each
+ * listening socket.
+ */
+#define GUACD_LISTEN_BACKLOG 5
+
+/**
+ * The maximum number of TLS sessions cached by guacd for resumption by
+ * reconnecting clients.
+ */
+#define GUACD_SSL_SESSION_CACHE_SIZE 20480
+
+/**
+ * The number of seconds that a TLS session remains available for resumption
+ * after being established, whether cached by guacd or stored within a session
+ * ticket held by the client.
+ */
+#define GUACD_SSL_SESSION_TIMEOUT 7200
+
+/**
+ * The session ID context associated with all TLS sessions established by
+ * guacd. Sessions may only be resumed within the same context.
+ */
+#define GUACD_SSL_SESSION_ID_CONTEXT "guacd"
+
 /**
  * Redirects the given file descriptor to /dev/null. The given flags must match
  * the read/write flags of the file descriptor given (if the given file
@@ -257,9 +289,9 @@ int stop_everything = 0;
 
 /**
  * A signal handler that will set a flag telling the daemon to immediately stop
- * accepting new connections. Note that the signal itself will cause any pending
- * accept() calls to be interrupted, causing the daemon to unlock and begin
- * cleaning up.
+ * accepting new connections. Note that the signal itself will cause the main
+ * thread to stop waiting within sigsuspend(), causing the daemon to stop all
+ * listener threads and begin cleaning up.
  *
  * @param signal
  *     The signal that was received. Unused in this function since only
@@ -292,6 +324,231 @@ static void stop_process_callback(guacd_proc* proc, void* data) {
 
 }
 
+/**
+ * A thread which accepts new connections on its own listening socket, along
+ * with the state required by the connection threads it spawns.
+ */
+typedef struct guacd_listener {
+
+    /**
+     * The file descriptor of the socket listening for new connections.
+     */
+    int socket_fd;
+
+    /**
+     * The shared map of all connected clients.
+     */
+    guacd_proc_map* map;
+
+    /**
+     * The shared pool of idle processes ready for new connections, or NULL if
+     * no such processes are kept.
+     */
+    guacd_proc_pool* pool;
+
+    /**
+     * The other guacd nodes to which requests to join connections that are
+     * not hosted locally should be forwarded, or NULL if such requests should
+     * simply fail.
+     */
+    guacd_config_peer* peers;
+
+#ifdef ENABLE_SSL
+    /**
+     * SSL context for encrypted connections to guacd. If SSL is not active,
+     * this will be NULL.
+     */
+    SSL_CTX* ssl_context;
+#endif
+
+#ifdef ENABLE_SHM
+    /**
+     * Whether socket_fd is the UNIX domain socket accepting connections from
+     * co-located proxies using shared memory transports.
+     */
+    int shm;
+#endif
+
+    /**
+     * The thread accepting connections on socket_fd.
+     */
+    pthread_t thread;
+
+} guacd_listener;
+
+/**
+ * Accepts connections on the listening socket of the given listener until
+ * cancelled, spawning a new connection thread for each accepted connection.
+ * The thread may only be cancelled while waiting for a connection to be
+ * accepted.
+ *
+ * @param data
+ *     A pointer to the guacd_listener describing the listening socket and the
+ *     state shared with the connection threads spawned.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_listener_thread(void* data) {
+
+    guacd_listener* listener = (guacd_listener*) data;
+
+    /* Client */
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len;
+    int connected_socket_fd;
+
+    /* Allow cancellation only while waiting for connections */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (;;) {
+
+        pthread_t child_thread;
+
+        /* Accept connection */
+        client_addr_len = sizeof(client_addr);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        connected_socket_fd = accept(listener->socket_fd,
+                (struct sockaddr*) &client_addr, &client_addr_len);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (connected_socket_fd < 0) {
+            if (errno == EINTR)
+                guacd_log(GUAC_LOG_DEBUG, "Accepting of further client connection(s) interrupted by signal.");
+            else
+                guacd_log(GUAC_LOG_ERROR, "Could not accept client connection: %s", strerror(errno));
+            continue;
+        }
+
+        /* Set TCP_NODELAY to avoid any latency that would otherwise be added by the OS'
+         * networking stack and Nagle's algorithm (this has no effect for
+         * UNIX domain sockets) */
+        const int SO_TRUE = 1;
+        setsockopt(connected_socket_fd, IPPROTO_TCP, TCP_NODELAY,
+                (const void*) &SO_TRUE, sizeof(SO_TRUE));
+
+        /* Create parameters for connection thread */
+        guacd_connection_thread_params* params = guac_mem_alloc(sizeof(guacd_connection_thread_params));
+        if (params == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Could not create connection thread: %s", strerror(errno));
+            close(connected_socket_fd);
+            continue;
+        }
+
+        params->map = listener->map;
+        params->pool = listener->pool;
+        params->peers = listener->peers;
+        params->connected_socket_fd = connected_socket_fd;
+
+#ifdef ENABLE_SSL
+        params->ssl_context = listener->ssl_context;
+#endif
+
+#ifdef ENABLE_SHM
+        params->shm = listener->shm;
+#endif
+
+        /* Spawn thread to handle connection */
+        pthread_create(&child_thread, NULL, guacd_connection_thread, params);
+        pthread_detach(child_thread);
+
+    }
+
+    return NULL;
+
+}
+
+#ifdef SO_REUSEPORT
+/**
+ * Creates a new socket bound to the given address, for use by an additional
+ * listener thread. The address must already be bound by another socket having
+ * SO_REUSEPORT set, and the new socket will share that address via
+ * SO_REUSEPORT, with the kernel distributing new connections between all such
+ * sockets.
+ *
+ * @param address
+ *     The address to bind the new socket to.
+ *
+ * @return
+ *     The file descriptor of the new socket, now listening for connections,
+ *     or -1 if the socket could not be created.
+ */
+static int guacd_listen_shared(const struct addrinfo* address) {
+
+    int opt_on = 1;
+
+    int socket_fd = socket(address->ai_family, SOCK_STREAM, 0);
+    if (socket_fd < 0)
+        return -1;
+
+    /* Share address with all other listener sockets */
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR,
+                (void*) &opt_on, sizeof(opt_on))
+            || setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT,
+                (void*) &opt_on, sizeof(opt_on))
+            || bind(socket_fd, address->ai_addr, address->ai_addrlen)
+            || listen(socket_fd, GUACD_LISTEN_BACKLOG) < 0) {
+        close(socket_fd);
+        return -1;
+    }
+
+    return socket_fd;
+
+}
+#endif
+
+#ifdef ENABLE_SHM
+/**
+ * Creates a UNIX domain socket at the given path, listening for connections
+ * from co-located proxies using shared memory transports. Any UNIX domain
+ * socket left at the same path by a previous instance of guacd is replaced.
+ *
+ * @param path
+ *     The path of the UNIX domain socket to create.
+ *
+ * @return
+ *     The file descriptor of the listening socket, or -1 if the socket could
+ *     not be created.
+ */
+static int guacd_listen_shm(const char* path) {
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        guacd_log(GUAC_LOG_ERROR, "Shared memory socket path \"%s\" is too "
+                "long.", path);
+        return -1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    /* Replace any socket left behind by a previous instance of guacd, but
+     * never any other kind of file */
+    struct stat file_info;
+    if (lstat(path, &file_info) == 0 && S_ISSOCK(file_info.st_mode))
+        unlink(path);
+
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create shared memory socket: %s",
+                strerror(errno));
+        return -1;
+    }
+
+    if (bind(socket_fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(socket_fd, GUACD_LISTEN_BACKLOG)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to listen on shared memory socket "
+                "\"%s\": %s", path, strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Accepting shared memory transports on UNIX "
+            "socket \"%s\"", path);
+    return socket_fd;
+
+}
+#endif
+
 int main(int argc, char* argv[]) {
 
     /* Server */
@@ -308,11 +565,6 @@ int main(int argc, char* argv[]) {
         .ai_protocol = IPPROTO_TCP
     };
 
-    /* Client */
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len;
-    int connected_socket_fd;
-
 #ifdef ENABLE_SSL
     SSL_CTX* ssl_context = NULL;
 #endif
@@ -349,6 +601,18 @@ int main(int argc, char* argv[]) {
     /* Log start */
     guacd_log(GUAC_LOG_INFO, "Guacamole proxy daemon (guacd) version " VERSION " started");
 
+    /* Additional listener threads require their sockets to share the same
+     * address */
+    int listener_count = config->listener_threads;
+#ifndef SO_REUSEPORT
+    if (listener_count > 1) {
+        guacd_log(GUAC_LOG_WARNING, "Multiple listener threads are not "
+                "supported on this platform. Only one listener thread will be "
+                "used.");
+        listener_count = 1;
+    }
+#endif
+
     /* Get addresses for binding */
     if ((retval = getaddrinfo(config->bind_host, config->bind_port,
                     &hints, &addresses))) {
@@ -391,6 +655,17 @@ int main(int argc, char* argv[]) {
                     strerror(errno));
         }
 
+#ifdef SO_REUSEPORT
+        /* Allow sockets of additional listener threads to share the same
+         * address */
+        if (listener_count > 1 && setsockopt(socket_fd, SOL_SOCKET,
+                    SO_REUSEPORT, (void*) &opt_on, sizeof(opt_on))) {
+            guacd_log(GUAC_LOG_WARNING, "Unable to set socket options for "
+                    "sharing between listener threads: %s", strerror(errno));
+            listener_count = 1;
+        }
+#endif
+
         /* Attempt to bind socket to address */
         if (bind(socket_fd,
                     current_address->ai_addr,
@@ -423,12 +698,45 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    /* Reserve an additional listener for shared memory transports, which is
+     * started after all other listeners */
+    guacd_listener* listeners = guac_mem_zalloc(sizeof(guacd_listener),
+            listener_count + 1);
+    listeners[0].socket_fd = socket_fd;
+
+#ifdef SO_REUSEPORT
+    /* Bind sockets for any additional listener threads to the same address */
+    for (int i = 1; i < listener_count; i++) {
+
+        listeners[i].socket_fd = guacd_listen_shared(current_address);
+
+        /* Continue with only those listener threads having sockets */
+        if (listeners[i].socket_fd < 0) {
+            guacd_log(GUAC_LOG_WARNING, "Unable to bind socket for listener "
+                    "thread: %s. Only %i listener thread(s) will be used.",
+                    strerror(errno), i);
+            listener_count = i;
+            break;
+        }
+
+    }
+#endif
+
 #ifdef ENABLE_SSL
     /* Init SSL if enabled */
     if (config->key_file != NULL || config->cert_file != NULL) {
 
         guacd_log(GUAC_LOG_INFO, "Communication will require SSL/TLS.");
 
+        /* Connections between peers, and thus forwarded connections, are
+         * never encrypted, and must not silently bypass SSL/TLS */
+        if (config->peers != NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Peers cannot be used while SSL/TLS "
+                    "is enabled, as connections between peers are not "
+                    "encrypted.");
+            exit(EXIT_FAILURE);
+        }
+
 #ifdef OPENSSL_REQUIRES_THREADING_CALLBACKS
         /* Init threadsafety in OpenSSL */
         guacd_openssl_init_locks(CRYPTO_num_locks());
@@ -468,6 +776,24 @@ int main(int argc, char* argv[]) {
         else
             guacd_log(GUAC_LOG_WARNING, "No certificate file given - SSL/TLS may not work.");
 
+        /* Allow reconnecting clients to resume TLS sessions, rather than
+         * performing a full handshake for every connection. All connections
+         * are accepted by this process and share the same context, and thus
+         * the same session cache and session ticket keys. */
+        SSL_CTX_set_session_id_context(ssl_context,
+                (const unsigned char*) GUACD_SSL_SESSION_ID_CONTEXT,
+                strlen(GUACD_SSL_SESSION_ID_CONTEXT));
+        SSL_CTX_set_session_cache_mode(ssl_context, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ssl_context, GUACD_SSL_SESSION_CACHE_SIZE);
+        SSL_CTX_set_timeout(ssl_context, GUACD_SSL_SESSION_TIMEOUT);
+
+#ifdef SSL_OP_ENABLE_KTLS
+        /* Offload record encryption to the kernel where supported by the
+         * kernel and negotiated cipher (OpenSSL falls back to encrypting
+         * records itself otherwise) */
+        SSL_CTX_set_options(ssl_context, SSL_OP_ENABLE_KTLS);
+#endif
+
     }
 #endif
 
@@ -524,53 +850,113 @@ int main(int argc, char* argv[]) {
     freeaddrinfo(addresses);
 
     /* Listen for connections */
-    if (listen(socket_fd, 5) < 0) {
+    if (listen(socket_fd, GUACD_LISTEN_BACKLOG) < 0) {
         guacd_log(GUAC_LOG_ERROR, "Could not listen on socket: %s", strerror(errno));
         return 3;
     }
 
-    /* Daemon loop */
-    while (!stop_everything) {
+    /* Block signals requesting that guacd stop within all threads other than
+     * the main thread, with those signals delivered only while the main
+     * thread waits within sigsuspend() below. All threads created from this
+     * point forward inherit this signal mask. */
+    sigset_t stop_signals;
+    sigset_t original_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &original_signals);
+
+    /* Prepare to apply resource limits to connection processes, if
+     * configured */
+    guacd_cgroup_init(config);
+
+    /* Connection processes inherit the display worker thread configuration
+     * set here when forked */
+    guac_display_set_default_worker_threads(config->display_worker_threads);
+    guac_display_set_shared_workers(config->shared_display_workers);
+
+    /* Likewise for the buffering of session recordings */
+    guac_recording_set_default_buffer_size(config->recording_buffer_size);
+    guac_recording_set_default_overflow(config->recording_overflow);
+    guac_recording_set_default_index_interval(config->recording_index_interval);
+    guac_recording_set_default_compression(config->recording_compression);
+    guac_recording_set_default_image_quality(config->recording_image_quality);
+    guac_recording_set_default_segment_duration(config->recording_segment_duration);
+    guac_recording_set_default_segment_size(config->recording_segment_size);
+
+    /* Likewise for the cache of addresses resolved by those processes, which
+     * must exist before the first process is forked to be shared */
+    if (config->dns_cache_ttl > 0
+            && guac_tcp_dns_cache_init(config->dns_cache_ttl))
+        guacd_log_guac_error(GUAC_LOG_WARNING, "Resolved addresses will not "
+                "be cached");
+
+    /* Serve metrics, if configured, before any connection processes are
+     * created, such that those processes know to report their counters */
+    guacd_metrics_start(config, map);
+
+    /* Begin starting idle processes for any protocols configured to have
+     * processes ready in advance */
+    guacd_proc_pool* pool = guacd_proc_pool_alloc(config->pools);
+
+#ifdef ENABLE_SHM
+    /* Accept shared memory transports, if configured, using an additional
+     * listener */
+    if (config->shm_socket != NULL) {
+
+        int shm_socket_fd = guacd_listen_shm(config->shm_socket);
+        if (shm_socket_fd >= 0) {
+            listeners[listener_count].socket_fd = shm_socket_fd;
+            listeners[listener_count].shm = 1;
+            listener_count++;
+        }
+        else
+            guacd_log(GUAC_LOG_WARNING, "Shared memory transports will not "
+                    "be available.");
 
-        pthread_t child_thread;
+    }
+#else
+    if (config->shm_socket != NULL)
+        guacd_log(GUAC_LOG_WARNING, "Shared memory transports are not "
+                "supported on this platform.");
+#endif
 
-        /* Accept connection */
-        client_addr_len = sizeof(client_addr);
-        connected_socket_fd = accept(socket_fd,
-                (struct sockaddr*) &client_addr, &client_addr_len);
+    /* Accept connections from each listener socket within its own thread */
+    int listeners_started = 0;
+    for (int i = 0; i < listener_count; i++) {
 
-        if (connected_socket_fd < 0) {
-            if (errno == EINTR)
-                guacd_log(GUAC_LOG_DEBUG, "Accepting of further client connection(s) interrupted by signal.");
-            else
-                guacd_log(GUAC_LOG_ERROR, "Could not accept client connection: %s", strerror(errno));
-            continue;
-        }
+        guacd_listener* listener = &(listeners[i]);
+        listener->map = map;
+        listener->pool = pool;
+        listener->peers = config->peers;
 
-        /* Set TCP_NODELAY to avoid any latency that would otherwise be added by the OS'
-         * networking stack and Nagle's algorithm */
-        const int SO_TRUE = 1;
-        setsockopt(connected_socket_fd, IPPROTO_TCP, TCP_NODELAY,
-                (const void*) &SO_TRUE, sizeof(SO_TRUE));
+#ifdef ENABLE_SSL
+        listener->ssl_context = ssl_context;
+#endif
 
-        /* Create parameters for connection thread */
-        guacd_connection_thread_params* params = guac_mem_alloc(sizeof(guacd_connection_thread_params));
-        if (params == NULL) {
-            guacd_log(GUAC_LOG_ERROR, "Could not create connection thread: %s", strerror(errno));
-            continue;
+        if (pthread_create(&(listener->thread), NULL,
+                    guacd_listener_thread, listener)) {
+            guacd_log(GUAC_LOG_ERROR, "Could not start listener thread: %s",
+                    strerror(errno));
+            break;
         }
 
-        params->map = map;
-        params->connected_socket_fd = connected_socket_fd;
+        listeners_started++;
 
-#ifdef ENABLE_SSL
-        params->ssl_context = ssl_context;
-#endif
+    }
 
-        /* Spawn thread to handle connection */
-        pthread_create(&child_thread, NULL, guacd_connection_thread, params);
-        pthread_detach(child_thread);
+    if (listeners_started > 1)
+        guacd_log(GUAC_LOG_INFO, "Accepting connections using %i listener "
+                "threads", listeners_started);
+
+    /* Wait for a signal requesting that guacd stop */
+    while (listeners_started > 0 && !stop_everything)
+        sigsuspend(&original_signals);
 
+    /* Stop accepting connections */
+    for (int i = 0; i < listeners_started; i++) {
+        pthread_cancel(listeners[i].thread);
+        pthread_join(listeners[i].thread, NULL);
     }
 
     /* Stop all connections */
@@ -593,12 +979,30 @@ int main(int argc, char* argv[]) {
 
     }
 
-    /* Close socket */
-    if (close(socket_fd) < 0) {
-        guacd_log(GUAC_LOG_ERROR, "Could not close socket: %s", strerror(errno));
-        return 3;
+    /* Stop all idle processes */
+    guacd_proc_pool_free(pool);
+
+    /* Stop serving metrics */
+    guacd_metrics_stop();
+
+    /* Close all listener sockets */
+    for (int i = 0; i < listener_count; i++) {
+
+#ifdef ENABLE_SHM
+        /* Remove the UNIX domain socket for shared memory transports */
+        if (listeners[i].shm)
+            unlink(config->shm_socket);
+#endif
+
+        if (close(listeners[i].socket_fd) < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Could not close socket: %s", strerror(errno));
+            return 3;
+        }
+
     }
 
+    guac_mem_free(listeners);
+
 #ifdef ENABLE_SSL
     if (ssl_context != NULL) {
 #ifdef OPENSSL_REQUIRES_THREADING_CALLBACKS
@@ -23,27 +23,132 @@
 #include <guacamole/client.h>
 #include <guacamole/error.h>
 
+#include <guacamole/timestamp.h>
+
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 int guacd_log_level = GUAC_LOG_INFO;
 
-void vguacd_log(guac_client_log_level level, const char* format,
-        va_list args) {
+/**
+ * A single formatted log message awaiting the background log writer.
+ */
+typedef struct guacd_log_entry {
 
-    const char* priority_name;
-    int priority;
+    /**
+     * The level at which the message was logged.
+     */
+    guac_client_log_level level;
 
-    char message[2048];
+    /**
+     * The formatted message, without trailing newline.
+     */
+    char message[GUACD_LOG_MAX_LENGTH];
 
-    /* Don't bother if the log level is too high */
-    if (level > guacd_log_level)
-        return;
+} guacd_log_entry;
 
-    /* Copy log message into buffer */
-    vsnprintf(message, sizeof(message), format, args);
+/**
+ * Lock which guards all state shared with the background log writer.
+ */
+static pthread_mutex_t guacd_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Lock which is held while writing any message to syslog and STDERR. If both
+ * this lock and the log lock are needed, the log lock must be acquired first.
+ */
+static pthread_mutex_t guacd_log_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever a message is queued for the
+ * background log writer.
+ */
+static pthread_cond_t guacd_log_queued = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Circular queue of all messages awaiting the background log writer.
+ */
+static guacd_log_entry guacd_log_queue[GUACD_LOG_QUEUE_SIZE];
+
+/**
+ * The index of the oldest entry within guacd_log_queue.
+ */
+static int guacd_log_queue_head = 0;
+
+/**
+ * The number of entries currently within guacd_log_queue.
+ */
+static int guacd_log_queue_length = 0;
+
+/**
+ * The number of messages dropped because guacd_log_queue was full, and not
+ * yet reported.
+ */
+static int guacd_log_dropped = 0;
+
+/**
+ * The most recently queued message, against which new messages are compared
+ * to detect repetition. This is meaningful only if guacd_log_last_valid is
+ * non-zero.
+ */
+static char guacd_log_last[GUACD_LOG_MAX_LENGTH];
+
+/**
+ * The level of the most recently queued message.
+ */
+static guac_client_log_level guacd_log_last_level;
+
+/**
+ * Non-zero if guacd_log_last contains the most recently queued message,
+ * zero otherwise.
+ */
+static int guacd_log_last_valid = 0;
+
+/**
+ * The number of times the most recently queued message has been repeated
+ * without yet being reported.
+ */
+static int guacd_log_repeated = 0;
+
+/**
+ * The time at which the first unreported repetition was logged.
+ */
+static guac_timestamp guacd_log_repeated_since;
+
+/**
+ * Non-zero if the background log writer is running within the current
+ * process, zero otherwise.
+ */
+static int guacd_log_writer_running = 0;
+
+/**
+ * Guards the one-time registration of the fork and exit handlers which keep
+ * the log queue consistent and ensure no queued messages are lost.
+ */
+static pthread_once_t guacd_log_handlers_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Writes the given message to syslog and STDERR immediately, from within the
+ * calling thread. The write lock must be held.
+ *
+ * @param level
+ *     The level at which the message was logged.
+ *
+ * @param message
+ *     The formatted message to write.
+ */
+static void guacd_log_write(guac_client_log_level level,
+        const char* message) {
+
+    const char* priority_name;
+    int priority;
 
     /* Convert log level to syslog priority */
     switch (level) {
@@ -94,6 +199,332 @@ void vguacd_log(guac_client_log_level level, const char* format,
 
 }
 
+/**
+ * Adds the given message to the end of the log queue, dropping the message
+ * if the queue is full. The log lock must be held.
+ *
+ * @param level
+ *     The level at which the message was logged.
+ *
+ * @param message
+ *     The formatted message to queue.
+ */
+static void guacd_log_enqueue(guac_client_log_level level,
+        const char* message) {
+
+    if (guacd_log_queue_length == GUACD_LOG_QUEUE_SIZE) {
+        guacd_log_dropped++;
+        return;
+    }
+
+    guacd_log_entry* entry = &guacd_log_queue[(guacd_log_queue_head
+            + guacd_log_queue_length) % GUACD_LOG_QUEUE_SIZE];
+
+    entry->level = level;
+    strcpy(entry->message, message);
+
+    guacd_log_queue_length++;
+    pthread_cond_signal(&guacd_log_queued);
+
+}
+
+/**
+ * Queues a message noting the number of unreported repetitions of the most
+ * recently queued message, if any. The log lock must be held.
+ */
+static void guacd_log_enqueue_repeated() {
+
+    if (guacd_log_repeated == 0)
+        return;
+
+    char message[GUACD_LOG_MAX_LENGTH];
+    snprintf(message, sizeof(message), "Previous message repeated %i more "
+            "time(s).", guacd_log_repeated);
+
+    guacd_log_enqueue(guacd_log_last_level, message);
+    guacd_log_repeated = 0;
+
+}
+
+/**
+ * Removes the oldest message from the log queue, storing a copy within the
+ * given entry. If messages have been dropped since the last call, a message
+ * noting the number of dropped messages is produced instead. The log lock
+ * must be held.
+ *
+ * @param entry
+ *     The entry to populate with the dequeued message.
+ *
+ * @return
+ *     Non-zero if a message was stored in the given entry, zero if there are
+ *     no messages to write.
+ */
+static int guacd_log_dequeue(guacd_log_entry* entry) {
+
+    if (guacd_log_dropped > 0) {
+        entry->level = GUAC_LOG_WARNING;
+        snprintf(entry->message, sizeof(entry->message), "%i log message(s) "
+                "were dropped because they were logged faster than they "
+                "could be written.", guacd_log_dropped);
+        guacd_log_dropped = 0;
+        return 1;
+    }
+
+    if (guacd_log_queue_length == 0)
+        return 0;
+
+    *entry = guacd_log_queue[guacd_log_queue_head];
+    guacd_log_queue_head = (guacd_log_queue_head + 1) % GUACD_LOG_QUEUE_SIZE;
+    guacd_log_queue_length--;
+
+    return 1;
+
+}
+
+/**
+ * Writes all queued messages, including any unreported repetitions, from
+ * within the calling thread. Both the log lock and the write lock must be
+ * held.
+ */
+static void guacd_log_drain() {
+
+    guacd_log_entry entry;
+
+    guacd_log_enqueue_repeated();
+    while (guacd_log_dequeue(&entry))
+        guacd_log_write(entry.level, entry.message);
+
+}
+
+/**
+ * Waits for a message to be queued, or for unreported repetitions to have
+ * gone unreported for GUACD_LOG_REPEAT_INTERVAL milliseconds. The log lock
+ * must be held, and will be released while waiting.
+ */
+static void guacd_log_wait() {
+
+    /* Without repetitions to report, simply wait for the next message */
+    if (guacd_log_repeated == 0) {
+        pthread_cond_wait(&guacd_log_queued, &guacd_log_lock);
+        return;
+    }
+
+    guac_timestamp remaining = guacd_log_repeated_since
+        + GUACD_LOG_REPEAT_INTERVAL - guac_timestamp_current();
+
+    /* Report repetitions which are already overdue */
+    if (remaining <= 0) {
+        guacd_log_enqueue_repeated();
+        return;
+    }
+
+    struct timeval current_time;
+    gettimeofday(&current_time, NULL);
+
+    /* Calculate time at which repetitions must be reported */
+    long nsec = current_time.tv_usec * 1000L + (remaining % 1000) * 1000000L;
+    struct timespec deadline = {
+        .tv_sec  = current_time.tv_sec + remaining / 1000 + nsec / 1000000000L,
+        .tv_nsec = nsec % 1000000000L
+    };
+
+    if (pthread_cond_timedwait(&guacd_log_queued, &guacd_log_lock,
+                &deadline) == ETIMEDOUT)
+        guacd_log_enqueue_repeated();
+
+}
+
+/**
+ * The body of the background log writer thread, writing each queued
+ * message to syslog and STDERR as it arrives.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_log_writer_thread(void* data) {
+
+    guacd_log_entry entry;
+
+    pthread_mutex_lock(&guacd_log_lock);
+
+    for (;;) {
+
+        /* Write each message without holding the log lock, such that
+         * logging threads never wait for I/O (the write lock is acquired
+         * first so that messages written immediately by vguacd_log() cannot
+         * overtake a message already dequeued) */
+        if (guacd_log_dequeue(&entry)) {
+            pthread_mutex_lock(&guacd_log_write_lock);
+            pthread_mutex_unlock(&guacd_log_lock);
+            guacd_log_write(entry.level, entry.message);
+            pthread_mutex_unlock(&guacd_log_write_lock);
+            pthread_mutex_lock(&guacd_log_lock);
+        }
+
+        else
+            guacd_log_wait();
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Handler invoked prior to fork() which acquires the log and write locks and
+ * writes all queued messages, such that nothing is lost or duplicated by
+ * either process and both locks are in a known state within the child.
+ * Holding the write lock also ensures that the background log writer is not
+ * within syslog() or fprintf() at the time of the fork, as the child could
+ * otherwise inherit locks internal to libc that would never be released.
+ */
+static void guacd_log_prepare_fork() {
+    pthread_mutex_lock(&guacd_log_lock);
+    pthread_mutex_lock(&guacd_log_write_lock);
+    guacd_log_drain();
+}
+
+/**
+ * Handler invoked within the parent process after fork(), releasing the log
+ * and write locks acquired by guacd_log_prepare_fork().
+ */
+static void guacd_log_parent_fork() {
+    pthread_mutex_unlock(&guacd_log_write_lock);
+    pthread_mutex_unlock(&guacd_log_lock);
+}
+
+/**
+ * Handler invoked within the child process after fork(), resetting all log
+ * state. The background log writer does not survive fork() and is restarted
+ * by the child when it next logs.
+ */
+static void guacd_log_child_fork() {
+
+    pthread_mutex_init(&guacd_log_lock, NULL);
+    pthread_mutex_init(&guacd_log_write_lock, NULL);
+    pthread_cond_init(&guacd_log_queued, NULL);
+
+    guacd_log_queue_head = 0;
+    guacd_log_queue_length = 0;
+    guacd_log_dropped = 0;
+    guacd_log_last_valid = 0;
+    guacd_log_repeated = 0;
+    guacd_log_writer_running = 0;
+
+}
+
+/**
+ * Handler invoked on process exit which writes any messages that the
+ * background log writer has not yet written.
+ */
+static void guacd_log_exit() {
+    pthread_mutex_lock(&guacd_log_lock);
+    pthread_mutex_lock(&guacd_log_write_lock);
+    guacd_log_drain();
+    pthread_mutex_unlock(&guacd_log_write_lock);
+    pthread_mutex_unlock(&guacd_log_lock);
+}
+
+/**
+ * Registers the fork and exit handlers required by the background log
+ * writer. Registrations are inherited by child processes, and thus need
+ * only be performed once.
+ */
+static void guacd_log_register_handlers() {
+    pthread_atfork(guacd_log_prepare_fork, guacd_log_parent_fork,
+            guacd_log_child_fork);
+    atexit(guacd_log_exit);
+}
+
+/**
+ * Starts the background log writer within the current process if it is not
+ * already running. The log lock must be held.
+ *
+ * @return
+ *     Non-zero if the background log writer is running, zero if it could
+ *     not be started.
+ */
+static int guacd_log_start_writer() {
+
+    if (guacd_log_writer_running)
+        return 1;
+
+    pthread_once(&guacd_log_handlers_once, guacd_log_register_handlers);
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, guacd_log_writer_thread, NULL))
+        return 0;
+
+    pthread_detach(writer);
+    guacd_log_writer_running = 1;
+    return 1;
+
+}
+
+void vguacd_log(guac_client_log_level level, const char* format,
+        va_list args) {
+
+    char message[GUACD_LOG_MAX_LENGTH];
+
+    /* Don't bother if the log level is too high */
+    if (level > guacd_log_level)
+        return;
+
+    /* Copy log message into buffer */
+    vsnprintf(message, sizeof(message), format, args);
+
+    pthread_mutex_lock(&guacd_log_lock);
+
+    /* Fall back to writing directly if no writer thread can be started */
+    if (!guacd_log_start_writer()) {
+        pthread_mutex_lock(&guacd_log_write_lock);
+        guacd_log_drain();
+        guacd_log_write(level, message);
+        pthread_mutex_unlock(&guacd_log_write_lock);
+        pthread_mutex_unlock(&guacd_log_lock);
+        return;
+    }
+
+    /* Collapse consecutive identical messages */
+    if (guacd_log_last_valid && level == guacd_log_last_level
+            && strcmp(message, guacd_log_last) == 0) {
+
+        if (guacd_log_repeated++ == 0) {
+            guacd_log_repeated_since = guac_timestamp_current();
+            pthread_cond_signal(&guacd_log_queued);
+        }
+
+        pthread_mutex_unlock(&guacd_log_lock);
+        return;
+
+    }
+
+    /* Write errors and warnings immediately, along with everything queued
+     * before them, as these are the messages most likely to precede an
+     * abnormal termination that would discard anything still queued */
+    if (level <= GUAC_LOG_WARNING) {
+        pthread_mutex_lock(&guacd_log_write_lock);
+        guacd_log_drain();
+        guacd_log_write(level, message);
+        pthread_mutex_unlock(&guacd_log_write_lock);
+    }
+
+    else {
+        guacd_log_enqueue_repeated();
+        guacd_log_enqueue(level, message);
+    }
+
+    strcpy(guacd_log_last, message);
+    guacd_log_last_level = level;
+    guacd_log_last_valid = 1;
+
+    pthread_mutex_unlock(&guacd_log_lock);
+
+}
+
 void guacd_log(guac_client_log_level level, const char* format, ...) {
     va_list args;
     va_start(args, format);
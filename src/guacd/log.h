@@ -35,9 +35,36 @@ extern int guacd_log_level;
  */
 #define GUACD_LOG_NAME "guacd"
 
+/**
+ * The maximum number of bytes in any single log message, including null
+ * terminator. Longer messages are truncated.
+ */
+#define GUACD_LOG_MAX_LENGTH 2048
+
+/**
+ * The maximum number of formatted messages which may be waiting to be written
+ * by the background log writer. Messages logged while this many messages are
+ * already waiting are dropped, with the number of dropped messages being
+ * logged once space is available.
+ */
+#define GUACD_LOG_QUEUE_SIZE 256
+
+/**
+ * The number of milliseconds that a run of identical, collapsed messages may
+ * remain unreported before the number of repetitions is logged, even if no
+ * other message has been logged.
+ */
+#define GUACD_LOG_REPEAT_INTERVAL 5000
+
 /**
  * Writes a message to guacd's logs. This function takes a format and va_list,
- * similar to vprintf.
+ * similar to vprintf. The message is formatted by the calling thread but is
+ * written to syslog and STDERR by a background thread, such that logging
+ * never waits for I/O. Errors and warnings are the exception, and are
+ * written by the calling thread before this function returns (along with
+ * any messages queued before them), such that they are not lost if the
+ * process terminates abnormally. Consecutive identical messages are collapsed
+ * into a single message noting the number of repetitions.
  */
 void vguacd_log(guac_client_log_level level, const char* format, va_list args);
 
@@ -0,0 +1,974 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "common/list.h"
+#include "conf.h"
+#include "log.h"
+#include "metrics.h"
+#include "proc.h"
+#include "proc-map.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+/**
+ * The flag set within guacd_metrics_report_state when reporting should stop.
+ */
+#define GUACD_METRICS_REPORT_STOPPING 1
+
+/**
+ * Non-zero if metrics are being served by guacd, and thus connection
+ * processes should report their counters, zero otherwise. Connection
+ * processes inherit this value when forked.
+ */
+static int guacd_metrics_enabled = 0;
+
+/**
+ * The file descriptor of the socket listening for metrics requests.
+ */
+static int guacd_metrics_listener_fd = -1;
+
+/**
+ * The path of the UNIX domain socket listening for metrics requests, or NULL
+ * if metrics are served over TCP.
+ */
+static const char* guacd_metrics_socket_path = NULL;
+
+/**
+ * The thread handling all metrics requests.
+ */
+static pthread_t guacd_metrics_thread;
+
+/**
+ * The map containing all active connection processes.
+ */
+static guacd_proc_map* guacd_metrics_map = NULL;
+
+/**
+ * Lock which must be held while accessing the metrics of any connection
+ * process or the totals of connection processes which have ended.
+ */
+static pthread_mutex_t guacd_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The sum of the final counters of all connection processes which have
+ * ended. The users and pending_operations members are unused.
+ */
+static guacd_proc_metrics guacd_metrics_retired;
+
+/**
+ * The number of connection processes which have ended.
+ */
+static uint64_t guacd_metrics_retired_count = 0;
+
+/**
+ * The current connection process, if reporting has started within that
+ * process.
+ */
+static guacd_proc* guacd_metrics_report_proc = NULL;
+
+/**
+ * The thread periodically reporting the counters of the current connection
+ * process.
+ */
+static pthread_t guacd_metrics_report_thread;
+
+/**
+ * The state of reporting within the current connection process, used to
+ * signal the reporting thread to stop.
+ */
+static guac_flag guacd_metrics_report_state;
+
+/**
+ * The sockets of all users currently connected to the current connection
+ * process, or NULL if reporting has not started.
+ */
+static guac_common_list* guacd_metrics_users = NULL;
+
+/**
+ * The total number of bytes received from all users of the current
+ * connection process which have disconnected. The users list must be locked.
+ */
+static uint64_t guacd_metrics_departed_received = 0;
+
+/**
+ * The total number of bytes sent to all users of the current connection
+ * process which have disconnected. The users list must be locked.
+ */
+static uint64_t guacd_metrics_departed_sent = 0;
+
+/**
+ * A growable buffer containing the body of a metrics response.
+ */
+typedef struct guacd_metrics_buffer {
+
+    /**
+     * The contents of the buffer, which is always null-terminated.
+     */
+    char* data;
+
+    /**
+     * The number of bytes currently stored within the buffer, excluding the
+     * null terminator.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    size_t size;
+
+} guacd_metrics_buffer;
+
+/**
+ * Appends formatted text to the given buffer, expanding the buffer as
+ * necessary.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param format
+ *     A printf-style format string.
+ *
+ * @param ...
+ *     Arguments to use when filling the format string for printing.
+ */
+static void guacd_metrics_printf(guacd_metrics_buffer* buffer,
+        const char* format, ...) {
+
+    for (;;) {
+
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer->data + buffer->length,
+                buffer->size - buffer->length, format, args);
+        va_end(args);
+
+        if (written < 0)
+            return;
+
+        if ((size_t) written < buffer->size - buffer->length) {
+            buffer->length += written;
+            return;
+        }
+
+        /* Retry once the buffer is large enough */
+        buffer->size = (buffer->length + written + 1) * 2;
+        buffer->data = guac_mem_realloc(buffer->data, buffer->size);
+
+    }
+
+}
+
+/**
+ * Appends the HELP and TYPE lines describing a metric to the given buffer.
+ *
+ * @param buffer
+ *     The buffer to append to.
+ *
+ * @param name
+ *     The name of the metric.
+ *
+ * @param type
+ *     The Prometheus type of the metric, such as "counter" or "gauge".
+ *
+ * @param help
+ *     A human-readable description of the metric.
+ */
+static void guacd_metrics_describe(guacd_metrics_buffer* buffer,
+        const char* name, const char* type, const char* help) {
+    guacd_metrics_printf(buffer, "# HELP %s %s\n# TYPE %s %s\n",
+            name, help, name, type);
+}
+
+/**
+ * Receives all reports sent by the given connection process since it was
+ * last checked, storing the most recent within the process. The metrics
+ * lock must be held.
+ *
+ * @param proc
+ *     The connection process to receive reports from.
+ */
+static void guacd_metrics_receive(guacd_proc* proc) {
+
+    /* Only the most recent report matters, as all counters are cumulative */
+    guacd_proc_metrics metrics;
+    while (recv(proc->fd_socket, &metrics, sizeof(metrics), MSG_DONTWAIT)
+            == sizeof(metrics))
+        proc->metrics = metrics;
+
+}
+
+/**
+ * Adds the counters of the given connection process to the given totals.
+ *
+ * @param totals
+ *     The totals to add to.
+ *
+ * @param metrics
+ *     The counters of the connection process.
+ */
+static void guacd_metrics_add(guacd_proc_metrics* totals,
+        const guacd_proc_metrics* metrics) {
+
+    totals->users += metrics->users;
+    totals->bytes_received += metrics->bytes_received;
+    totals->bytes_sent += metrics->bytes_sent;
+    totals->frames += metrics->frames;
+    totals->pending_operations += metrics->pending_operations;
+    totals->encode_time += metrics->encode_time;
+
+    for (int i = 0; i < GUAC_DISPLAY_STATS_ENCODE_BUCKETS; i++)
+        totals->encodes[i] += metrics->encodes[i];
+
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT; i++)
+        totals->memory[i] += metrics->memory[i];
+
+}
+
+/**
+ * The state of a metrics request while the counters of each active
+ * connection process are being added together.
+ */
+typedef struct guacd_metrics_collection {
+
+    /**
+     * The buffer receiving the per-connection metrics.
+     */
+    guacd_metrics_buffer* buffer;
+
+    /**
+     * The sum of the counters of all connections, including those which
+     * have ended.
+     */
+    guacd_proc_metrics totals;
+
+    /**
+     * The number of active connections.
+     */
+    int connections;
+
+} guacd_metrics_collection;
+
+/**
+ * Callback for guacd_proc_map_foreach() which adds the counters of an active
+ * connection process to a metrics request, appending the metrics specific to
+ * that connection. The metrics lock must be held.
+ *
+ * @param proc
+ *     The connection process to add.
+ *
+ * @param data
+ *     The guacd_metrics_collection of the metrics request.
+ */
+static void guacd_metrics_collect_proc(guacd_proc* proc, void* data) {
+
+    guacd_metrics_collection* collection = (guacd_metrics_collection*) data;
+
+    /* Counters of connections which have ended are already within the
+     * retired totals */
+    if (proc->metrics_retired)
+        return;
+
+    guacd_metrics_receive(proc);
+    guacd_metrics_add(&collection->totals, &proc->metrics);
+    collection->connections++;
+
+    /* Processes are identified by PID, as connection IDs allow the
+     * connection to be joined */
+    guacd_metrics_printf(collection->buffer,
+            "guacd_connection_users{pid=\"%i\"} %i\n",
+            (int) proc->pid, proc->metrics.users);
+
+}
+
+/**
+ * Callback for guacd_proc_map_foreach() which appends the memory of an active
+ * connection process, by category, to a metrics request. The counters of the
+ * process must already have been received with guacd_metrics_collect_proc().
+ * The metrics lock must be held.
+ *
+ * @param proc
+ *     The connection process whose memory should be appended.
+ *
+ * @param data
+ *     The guacd_metrics_collection of the metrics request.
+ */
+static void guacd_metrics_collect_proc_memory(guacd_proc* proc, void* data) {
+
+    guacd_metrics_collection* collection = (guacd_metrics_collection*) data;
+
+    if (proc->metrics_retired)
+        return;
+
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT; i++)
+        guacd_metrics_printf(collection->buffer,
+                "guacd_connection_memory_bytes{pid=\"%i\",category=\"%s\"} "
+                "%" PRIu64 "\n", (int) proc->pid, guac_mem_category_name(i),
+                proc->metrics.memory[i]);
+
+}
+
+/**
+ * Writes the body of a metrics response, describing all active connections
+ * and all connections which have ended, to the given buffer.
+ *
+ * @param buffer
+ *     The buffer to write to.
+ */
+static void guacd_metrics_write(guacd_metrics_buffer* buffer) {
+
+    guacd_metrics_collection collection = {
+        .buffer = buffer
+    };
+
+    pthread_mutex_lock(&guacd_metrics_lock);
+
+    guacd_metrics_describe(buffer, "guacd_connection_users", "gauge",
+            "Number of users connected to each active connection, by "
+            "process ID.");
+
+    guacd_proc_map_foreach(guacd_metrics_map, guacd_metrics_collect_proc,
+            &collection);
+
+    /* Each metric must be written as a single group, and so the memory of
+     * each connection is written separately from its users */
+    guacd_metrics_describe(buffer, "guacd_connection_memory_bytes", "gauge",
+            "Memory allocated by each active connection, by process ID and "
+            "category.");
+
+    guacd_proc_map_foreach(guacd_metrics_map,
+            guacd_metrics_collect_proc_memory, &collection);
+
+    guacd_metrics_add(&collection.totals, &guacd_metrics_retired);
+    uint64_t connections_total = guacd_metrics_retired_count
+        + collection.connections;
+
+    pthread_mutex_unlock(&guacd_metrics_lock);
+
+    guacd_proc_metrics* totals = &collection.totals;
+
+    guacd_metrics_describe(buffer, "guacd_connections", "gauge",
+            "Number of active connections.");
+    guacd_metrics_printf(buffer, "guacd_connections %i\n",
+            collection.connections);
+
+    guacd_metrics_describe(buffer, "guacd_connections_total", "counter",
+            "Total number of connections, including connections which have "
+            "ended.");
+    guacd_metrics_printf(buffer, "guacd_connections_total %" PRIu64 "\n",
+            connections_total);
+
+    guacd_metrics_describe(buffer, "guacd_users", "gauge",
+            "Number of users connected to all active connections.");
+    guacd_metrics_printf(buffer, "guacd_users %i\n", totals->users);
+
+    guacd_metrics_describe(buffer, "guacd_received_bytes_total", "counter",
+            "Total number of bytes received from users.");
+    guacd_metrics_printf(buffer, "guacd_received_bytes_total %" PRIu64 "\n",
+            totals->bytes_received);
+
+    guacd_metrics_describe(buffer, "guacd_sent_bytes_total", "counter",
+            "Total number of bytes sent to users.");
+    guacd_metrics_printf(buffer, "guacd_sent_bytes_total %" PRIu64 "\n",
+            totals->bytes_sent);
+
+    guacd_metrics_describe(buffer, "guacd_frames_total", "counter",
+            "Total number of frames encoded and sent to users.");
+    guacd_metrics_printf(buffer, "guacd_frames_total %" PRIu64 "\n",
+            totals->frames);
+
+    guacd_metrics_describe(buffer, "guacd_display_pending_operations",
+            "gauge", "Number of display operations queued for the worker "
+            "threads of all active connections.");
+    guacd_metrics_printf(buffer, "guacd_display_pending_operations %" PRIu64 "\n",
+            totals->pending_operations);
+
+    guacd_metrics_describe(buffer, "guacd_memory_bytes", "gauge",
+            "Memory allocated by all active connections, by category.");
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT; i++)
+        guacd_metrics_printf(buffer, "guacd_memory_bytes{category=\"%s\"} "
+                "%" PRIu64 "\n", guac_mem_category_name(i), totals->memory[i]);
+
+    /* Histogram buckets are cumulative, with each bucket other than the
+     * last bounded at twice the bound of the previous bucket */
+    guacd_metrics_describe(buffer, "guacd_encode_seconds", "histogram",
+            "Time taken to encode and send each image update.");
+
+    uint64_t count = 0;
+    uint64_t bound = GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND;
+    for (int i = 0; i < GUAC_DISPLAY_STATS_ENCODE_BUCKETS - 1; i++) {
+        count += totals->encodes[i];
+        guacd_metrics_printf(buffer, "guacd_encode_seconds_bucket{le=\"%g\"} "
+                "%" PRIu64 "\n", bound / 1000000000.0, count);
+        bound <<= 1;
+    }
+
+    count += totals->encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS - 1];
+    guacd_metrics_printf(buffer, "guacd_encode_seconds_bucket{le=\"+Inf\"} "
+            "%" PRIu64 "\n", count);
+    guacd_metrics_printf(buffer, "guacd_encode_seconds_sum %.9f\n",
+            totals->encode_time / 1000000000.0);
+    guacd_metrics_printf(buffer, "guacd_encode_seconds_count %" PRIu64 "\n",
+            count);
+
+}
+
+/**
+ * Writes the entirety of the given data to the given file descriptor.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero if all data was written, non-zero if an error occurred.
+ */
+static int guacd_metrics_write_all(int fd, const char* data, size_t length) {
+
+    while (length > 0) {
+
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+
+        data += written;
+        length -= written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Sends an HTTP response containing the given plain text body over the given
+ * connection.
+ *
+ * @param fd
+ *     The file descriptor of the connection.
+ *
+ * @param status
+ *     The HTTP status line, such as "200 OK".
+ *
+ * @param body
+ *     The response body.
+ *
+ * @param length
+ *     The length of the response body, in bytes.
+ *
+ * @param include_body
+ *     Non-zero if the body should be sent along with the headers, zero if
+ *     only the headers should be sent (in response to HEAD).
+ */
+static void guacd_metrics_respond(int fd, const char* status,
+        const char* body, size_t length, int include_body) {
+
+    char headers[256];
+    int headers_length = snprintf(headers, sizeof(headers),
+            "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n"
+            "\r\n", status, length);
+
+    if (guacd_metrics_write_all(fd, headers, headers_length))
+        return;
+
+    if (include_body)
+        guacd_metrics_write_all(fd, body, length);
+
+}
+
+/**
+ * Reads and responds to a single HTTP request received over the given
+ * connection to the metrics listener.
+ *
+ * @param fd
+ *     The file descriptor of the connection.
+ */
+static void guacd_metrics_handle_request(int fd) {
+
+    /* Do not allow a stalled client to block all other requests */
+    struct timeval timeout = { .tv_sec = GUACD_METRICS_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    /* Read until the end of the request headers */
+    char request[GUACD_METRICS_REQUEST_SIZE];
+    size_t length = 0;
+    for (;;) {
+
+        if (length == sizeof(request) - 1)
+            return;
+
+        ssize_t received = read(fd, request + length,
+                sizeof(request) - 1 - length);
+        if (received <= 0)
+            return;
+
+        length += received;
+        request[length] = '\0';
+
+        if (strstr(request, "\r\n\r\n") != NULL
+                || strstr(request, "\n\n") != NULL)
+            break;
+
+    }
+
+    /* Parse method and path from request line */
+    char* method = request;
+    char* path = strchr(method, ' ');
+    if (path == NULL)
+        return;
+
+    *(path++) = '\0';
+    path[strcspn(path, " ?\r\n")] = '\0';
+
+    int head = (strcmp(method, "HEAD") == 0);
+    if (!head && strcmp(method, "GET") != 0) {
+        static const char message[] = "Method not allowed.\n";
+        guacd_metrics_respond(fd, "405 Method Not Allowed", message,
+                sizeof(message) - 1, 1);
+        return;
+    }
+
+    if (strcmp(path, "/metrics") != 0) {
+        static const char message[] = "Not found.\n";
+        guacd_metrics_respond(fd, "404 Not Found", message,
+                sizeof(message) - 1, !head);
+        return;
+    }
+
+    guacd_metrics_buffer buffer = {
+        .data = guac_mem_alloc(GUACD_METRICS_REQUEST_SIZE),
+        .size = GUACD_METRICS_REQUEST_SIZE
+    };
+
+    guacd_metrics_write(&buffer);
+    guacd_metrics_respond(fd, "200 OK", buffer.data, buffer.length, !head);
+
+    guac_mem_free(buffer.data);
+
+}
+
+/**
+ * Accepts and handles connections to the metrics listener, one at a time,
+ * until cancelled.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_metrics_listener_thread(void* data) {
+
+    for (;;) {
+
+        /* Allow cancellation only while waiting for connections */
+        int fd = accept(guacd_metrics_listener_fd, NULL, NULL);
+        if (fd < 0) {
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Metrics listener failed to accept "
+                    "connection: %s. Metrics are no longer available.",
+                    strerror(errno));
+            break;
+
+        }
+
+        int cancel_state;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+        guacd_metrics_handle_request(fd);
+        close(fd);
+
+        pthread_setcancelstate(cancel_state, NULL);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Creates a socket listening on the given UNIX domain socket path.
+ *
+ * @param path
+ *     The path of the UNIX domain socket. Any existing socket at this path is
+ *     replaced.
+ *
+ * @return
+ *     The file descriptor of the listening socket, or -1 if the socket could
+ *     not be created.
+ */
+static int guacd_metrics_listen_unix(const char* path) {
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        guacd_log(GUAC_LOG_ERROR, "Metrics socket path \"%s\" is too long.",
+                path);
+        return -1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    /* Replace any socket left behind by a previous instance of guacd, but
+     * never any other kind of file */
+    struct stat file_info;
+    if (lstat(path, &file_info) == 0 && S_ISSOCK(file_info.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create metrics socket: %s",
+                strerror(errno));
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(fd, GUACD_METRICS_LISTEN_BACKLOG)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to listen on metrics socket "
+                "\"%s\": %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Serving metrics on UNIX socket \"%s\"", path);
+    return fd;
+
+}
+
+/**
+ * Creates a socket listening on the given TCP host and port.
+ *
+ * @param host
+ *     The host to bind to.
+ *
+ * @param port
+ *     The port to bind to.
+ *
+ * @return
+ *     The file descriptor of the listening socket, or -1 if the socket could
+ *     not be created.
+ */
+static int guacd_metrics_listen_tcp(const char* host, const char* port) {
+
+    struct addrinfo* addresses;
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    int retval = getaddrinfo(host, port, &hints, &addresses);
+    if (retval != 0) {
+        guacd_log(GUAC_LOG_ERROR, "Error parsing given metrics address or "
+                "port: %s", gai_strerror(retval));
+        return -1;
+    }
+
+    /* Bind to the first address that succeeds */
+    int fd = -1;
+    int opt_on = 1;
+    for (struct addrinfo* current = addresses; current != NULL;
+            current = current->ai_next) {
+
+        fd = socket(current->ai_family, SOCK_STREAM, 0);
+        if (fd < 0)
+            continue;
+
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt_on, sizeof(opt_on)) == 0
+                && bind(fd, current->ai_addr, current->ai_addrlen) == 0
+                && listen(fd, GUACD_METRICS_LISTEN_BACKLOG) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+
+    }
+
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to listen for metrics requests on "
+                "host %s, port %s.", host, port);
+        return -1;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Serving metrics on host %s, port %s", host, port);
+    return fd;
+
+}
+
+void guacd_metrics_start(guacd_config* config, guacd_proc_map* map) {
+
+    /* Serve metrics only if requested */
+    if (config->metrics_socket != NULL)
+        guacd_metrics_listener_fd = guacd_metrics_listen_unix(config->metrics_socket);
+    else if (config->metrics_bind_port != NULL)
+        guacd_metrics_listener_fd = guacd_metrics_listen_tcp(
+                config->metrics_bind_host, config->metrics_bind_port);
+    else
+        return;
+
+    if (guacd_metrics_listener_fd < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Metrics will not be available.");
+        return;
+    }
+
+    guacd_metrics_socket_path = config->metrics_socket;
+    guacd_metrics_map = map;
+
+    if (pthread_create(&guacd_metrics_thread, NULL,
+                guacd_metrics_listener_thread, NULL)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to start metrics listener thread. "
+                "Metrics will not be available.");
+        close(guacd_metrics_listener_fd);
+        guacd_metrics_listener_fd = -1;
+        return;
+    }
+
+    guacd_metrics_enabled = 1;
+
+}
+
+void guacd_metrics_stop() {
+
+    if (!guacd_metrics_enabled)
+        return;
+
+    pthread_cancel(guacd_metrics_thread);
+    pthread_join(guacd_metrics_thread, NULL);
+
+    close(guacd_metrics_listener_fd);
+    guacd_metrics_listener_fd = -1;
+
+    if (guacd_metrics_socket_path != NULL)
+        unlink(guacd_metrics_socket_path);
+
+    guacd_metrics_enabled = 0;
+
+}
+
+void guacd_metrics_retire(guacd_proc* proc) {
+
+    if (!guacd_metrics_enabled)
+        return;
+
+    pthread_mutex_lock(&guacd_metrics_lock);
+
+    /* The final report of the process was sent before it terminated */
+    guacd_metrics_receive(proc);
+
+    guacd_proc_metrics* metrics = &proc->metrics;
+    metrics->users = 0;
+    metrics->pending_operations = 0;
+    memset(metrics->memory, 0, sizeof(metrics->memory));
+
+    guacd_metrics_add(&guacd_metrics_retired, metrics);
+    guacd_metrics_retired_count++;
+    proc->metrics_retired = 1;
+
+    pthread_mutex_unlock(&guacd_metrics_lock);
+
+}
+
+/**
+ * Reads the current counters of the current connection process.
+ *
+ * @param metrics
+ *     The structure that should receive the current counters.
+ */
+static void guacd_metrics_collect(guacd_proc_metrics* metrics) {
+
+    guac_client* client = guacd_metrics_report_proc->client;
+
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->users = client->connected_users;
+
+    /* Counters of each user's socket are added to those of all users which
+     * have disconnected */
+    guac_common_list_lock(guacd_metrics_users);
+
+    metrics->bytes_received = guacd_metrics_departed_received;
+    metrics->bytes_sent = guacd_metrics_departed_sent;
+
+    guac_common_list_element* current = guacd_metrics_users->head;
+    while (current != NULL) {
+
+        guac_socket_stats stats;
+        guac_socket_get_stats((guac_socket*) current->data, &stats);
+
+        metrics->bytes_received += stats.bytes_read;
+        metrics->bytes_sent += stats.bytes_written;
+
+        current = current->next;
+
+    }
+
+    guac_common_list_unlock(guacd_metrics_users);
+
+    guac_display_stats display_stats;
+    guac_display_get_process_stats(&display_stats);
+
+    metrics->frames = display_stats.frames;
+    metrics->pending_operations = display_stats.pending_operations;
+    metrics->encode_time = display_stats.encode_time;
+    memcpy(metrics->encodes, display_stats.encodes, sizeof(metrics->encodes));
+
+    guac_mem_stats mem_stats;
+    guac_mem_get_process_stats(&mem_stats);
+    memcpy(metrics->memory, mem_stats.bytes, sizeof(metrics->memory));
+
+}
+
+/**
+ * Sends the current counters of the current connection process to guacd.
+ * If guacd has not yet received previous reports, the report is dropped, as
+ * all counters are cumulative and the next report will supersede it.
+ */
+static void guacd_metrics_send_report() {
+
+    guacd_proc_metrics metrics;
+    guacd_metrics_collect(&metrics);
+
+    send(guacd_metrics_report_proc->fd_socket, &metrics, sizeof(metrics),
+            MSG_DONTWAIT);
+
+}
+
+/**
+ * Sends a report of the counters of the current connection process every
+ * GUACD_METRICS_REPORT_INTERVAL milliseconds until reporting is stopped.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_metrics_report_thread_func(void* data) {
+
+    do {
+        guacd_metrics_send_report();
+    } while (!guac_flag_timedwait_and_lock(&guacd_metrics_report_state,
+                GUACD_METRICS_REPORT_STOPPING, GUACD_METRICS_REPORT_INTERVAL));
+
+    guac_flag_unlock(&guacd_metrics_report_state);
+    return NULL;
+
+}
+
+void guacd_metrics_report_start(guacd_proc* proc) {
+
+    if (!guacd_metrics_enabled)
+        return;
+
+    guacd_metrics_users = guac_common_list_alloc();
+    guacd_metrics_report_proc = proc;
+    guac_flag_init(&guacd_metrics_report_state);
+
+    if (pthread_create(&guacd_metrics_report_thread, NULL,
+                guacd_metrics_report_thread_func, NULL)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to start reporting metrics of "
+                "connection \"%s\".", proc->client->connection_id);
+        guac_flag_destroy(&guacd_metrics_report_state);
+        guacd_metrics_report_proc = NULL;
+    }
+
+}
+
+void guacd_metrics_report_stop() {
+
+    if (guacd_metrics_report_proc == NULL)
+        return;
+
+    guac_flag_set(&guacd_metrics_report_state, GUACD_METRICS_REPORT_STOPPING);
+    pthread_join(guacd_metrics_report_thread, NULL);
+    guac_flag_destroy(&guacd_metrics_report_state);
+
+    guacd_metrics_send_report();
+    guacd_metrics_report_proc = NULL;
+
+}
+
+void* guacd_metrics_add_user(guac_socket* socket) {
+
+    if (guacd_metrics_users == NULL)
+        return NULL;
+
+    guac_common_list_lock(guacd_metrics_users);
+    guac_common_list_element* element = guac_common_list_add(
+            guacd_metrics_users, socket);
+    guac_common_list_unlock(guacd_metrics_users);
+
+    return element;
+
+}
+
+void guacd_metrics_remove_user(void* handle) {
+
+    if (handle == NULL)
+        return;
+
+    guac_common_list_element* element = (guac_common_list_element*) handle;
+
+    /* The final counters of the socket are retained after it is freed */
+    guac_common_list_lock(guacd_metrics_users);
+
+    guac_socket_stats stats;
+    guac_socket_get_stats((guac_socket*) element->data, &stats);
+
+    guacd_metrics_departed_received += stats.bytes_read;
+    guacd_metrics_departed_sent += stats.bytes_written;
+    guac_common_list_remove(guacd_metrics_users, element);
+    guac_common_list_unlock(guacd_metrics_users);
+
+}
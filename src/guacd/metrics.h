@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_METRICS_H
+#define GUACD_METRICS_H
+
+#include "config.h"
+
+#include "conf.h"
+#include "proc.h"
+#include "proc-map.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * The number of milliseconds between each report of the counters of a
+ * connection process to guacd.
+ */
+#define GUACD_METRICS_REPORT_INTERVAL 1000
+
+/**
+ * The maximum number of pending connections to the metrics listener.
+ */
+#define GUACD_METRICS_LISTEN_BACKLOG 16
+
+/**
+ * The maximum size of an HTTP request to the metrics listener, in bytes,
+ * including all headers.
+ */
+#define GUACD_METRICS_REQUEST_SIZE 4096
+
+/**
+ * The number of seconds to wait for an HTTP request to the metrics listener
+ * to be received, or for its response to be sent, before the connection is
+ * closed.
+ */
+#define GUACD_METRICS_TIMEOUT 5
+
+/**
+ * Begins serving metrics describing all connections of guacd over HTTP, in
+ * the text format understood by Prometheus, if a metrics socket or port is
+ * configured. Metrics are served at the "/metrics" path from a single
+ * background thread. Connection processes created from this point forward
+ * report their counters to guacd while they have users, and the metrics of
+ * each request combine the most recent reports of all connections within
+ * the given map with the final reports of all connections that have ended.
+ *
+ * This function must be called before any connection processes are created.
+ * If the configured listener cannot be created, the failure is logged and
+ * guacd continues without serving metrics.
+ *
+ * @param config
+ *     The guacd configuration defining the metrics socket or port, if any.
+ *
+ * @param map
+ *     The map containing all active connection processes.
+ */
+void guacd_metrics_start(guacd_config* config, guacd_proc_map* map);
+
+/**
+ * Stops serving metrics, closing the metrics listener, if any. This function
+ * must be called by the parent process.
+ */
+void guacd_metrics_stop();
+
+/**
+ * Marks the given connection process as having terminated, receiving its
+ * final report and adding its counters to the totals of all connections
+ * which have ended. This function must be called by the parent process
+ * before the process is removed from the map given to guacd_metrics_start(),
+ * and has no effect if metrics are not being served.
+ *
+ * @param proc
+ *     The connection process which has terminated.
+ */
+void guacd_metrics_retire(guacd_proc* proc);
+
+/**
+ * Begins periodically reporting the counters of the current connection
+ * process to guacd from a background thread, if metrics are being served.
+ * This function must be called by the child process, and only once.
+ *
+ * @param proc
+ *     The current connection process.
+ */
+void guacd_metrics_report_start(guacd_proc* proc);
+
+/**
+ * Stops reporting the counters of the current connection process, sending a
+ * final report. This function must be called by the child process before
+ * the guac_client of that process is freed, and has no effect if reporting
+ * was never started.
+ */
+void guacd_metrics_report_stop();
+
+/**
+ * Begins including the counters of the given user socket within the reports
+ * of the current connection process. This function must be called by the
+ * child process.
+ *
+ * @param socket
+ *     The socket of a user that has just connected.
+ *
+ * @return
+ *     An opaque handle which must later be passed to
+ *     guacd_metrics_remove_user(), or NULL if metrics are not being served.
+ */
+void* guacd_metrics_add_user(guac_socket* socket);
+
+/**
+ * Stops including the counters of a user socket within the reports of the
+ * current connection process, adding the final values of those counters to
+ * the totals of all users that have disconnected. This function must be
+ * called by the child process before the socket is freed.
+ *
+ * @param handle
+ *     The handle returned by guacd_metrics_add_user() for the socket, which
+ *     may be NULL.
+ */
+void guacd_metrics_remove_user(void* handle);
+
+#endif
+
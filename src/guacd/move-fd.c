@@ -31,11 +31,16 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-int guacd_send_fd(int sock, int fd) {
+int guacd_send_fds(int sock, const int* fds, int count) {
 
     struct msghdr message = {0};
     char message_data[] = {'G'};
 
+    if (count < 1 || count > GUACD_MAX_MOVED_FDS) {
+        errno = EINVAL;
+        return 0;
+    }
+
     /* Assign data buffer */
     struct iovec io_vector[1];
     io_vector[0].iov_base = message_data;
@@ -44,27 +49,29 @@ int guacd_send_fd(int sock, int fd) {
     message.msg_iovlen = 1;
 
     /* Assign ancillary data buffer */
-    char buffer[CMSG_SPACE(sizeof(fd))] = {0};
+    char buffer[CMSG_SPACE(sizeof(int) * GUACD_MAX_MOVED_FDS)] = {0};
     message.msg_control = buffer;
-    message.msg_controllen = sizeof(buffer);
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
 
     /* Set fields of control message header */
     struct cmsghdr* control = CMSG_FIRSTHDR(&message);
     control->cmsg_level = SOL_SOCKET;
     control->cmsg_type  = SCM_RIGHTS;
-    control->cmsg_len   = CMSG_LEN(sizeof(fd));
+    control->cmsg_len   = CMSG_LEN(sizeof(int) * count);
 
-    /* Add file descriptor to message data */
-    memcpy(CMSG_DATA(control), &fd, sizeof(fd));
+    /* Add file descriptors to message data */
+    memcpy(CMSG_DATA(control), fds, sizeof(int) * count);
 
-    /* Send file descriptor */
+    /* Send file descriptors */
     return (sendmsg(sock, &message, 0) == sizeof(message_data));
 
 }
 
-int guacd_recv_fd(int sock) {
+int guacd_send_fd(int sock, int fd) {
+    return guacd_send_fds(sock, &fd, 1);
+}
 
-    int fd;
+int guacd_recv_fds(int sock, int* fds, int max_count) {
 
     struct msghdr message = {0};
     char message_data[1];
@@ -76,36 +83,65 @@ int guacd_recv_fd(int sock) {
     message.msg_iov    = io_vector;
     message.msg_iovlen = 1;
 
-    /* Assign ancillary data buffer */
-    char buffer[CMSG_SPACE(sizeof(fd))];
+    /* Assign ancillary data buffer, with room for any number of file
+     * descriptors that guacd_send_fds() may send */
+    char buffer[CMSG_SPACE(sizeof(int) * GUACD_MAX_MOVED_FDS)];
     message.msg_control = buffer;
     message.msg_controllen = sizeof(buffer);
 
-    /* Receive file descriptor */
+    /* Receive file descriptors */
     if (recvmsg(sock, &message, 0) == sizeof(message_data)) {
 
-        /* Validate payload */
-        if (message_data[0] != 'G') {
-            errno = EPROTO;
-            return -1;
-        }
+        int count = 0;
 
-        /* Iterate control headers, looking for the sent file descriptor */
+        /* Iterate control headers, looking for the sent file descriptors */
         struct cmsghdr* control;
         for (control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control)) {
 
-            /* Pull file descriptor from data */
-            if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_RIGHTS) {
-                memcpy(&fd, CMSG_DATA(control), sizeof(fd));
-                return fd;
+            if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            /* Pull file descriptors from data, closing any that do not fit */
+            int received = (control->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < received; i++) {
+
+                int fd;
+                memcpy(&fd, CMSG_DATA(control) + sizeof(int) * i, sizeof(fd));
+
+                if (count < max_count)
+                    fds[count++] = fd;
+                else
+                    close(fd);
+
             }
 
         }
 
+        /* Validate payload */
+        if (message_data[0] != 'G' || count == 0) {
+            for (int i = 0; i < count; i++)
+                close(fds[i]);
+            errno = EPROTO;
+            return -1;
+        }
+
+        return count;
+
     } /* end if recvmsg() success */
 
-    /* Failed to receive file descriptor */
+    /* Failed to receive file descriptors */
     return -1;
 
 }
 
+int guacd_recv_fd(int sock) {
+
+    int fd;
+
+    /* Exactly one file descriptor is expected */
+    if (guacd_recv_fds(sock, &fd, 1) != 1)
+        return -1;
+
+    return fd;
+
+}
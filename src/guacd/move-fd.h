@@ -22,6 +22,35 @@
 
 #include "config.h"
 
+/**
+ * The maximum number of file descriptors that may be sent along a socket
+ * within a single message using guacd_send_fds().
+ */
+#define GUACD_MAX_MOVED_FDS 8
+
+/**
+ * Sends the given file descriptors along the given socket within a single
+ * message, allowing the receiving process to use those file descriptors
+ * normally. Returns non-zero on success, zero on error, just as a normal call
+ * to sendmsg() would. If an error does occur, errno will be set
+ * appropriately.
+ *
+ * @param sock
+ *     The file descriptor of an open UNIX domain socket along which the given
+ *     file descriptors should be sent.
+ *
+ * @param fds
+ *     The file descriptors to send along the given UNIX domain socket.
+ *
+ * @param count
+ *     The number of file descriptors to send, which may be no greater than
+ *     GUACD_MAX_MOVED_FDS.
+ *
+ * @return
+ *     Non-zero if the send operation succeeded, zero on error.
+ */
+int guacd_send_fds(int sock, const int* fds, int count);
+
 /**
  * Sends the given file descriptor along the given socket, allowing the
  * receiving process to use that file descriptor normally. Returns non-zero on
@@ -40,6 +69,32 @@
  */
 int guacd_send_fd(int sock, int fd);
 
+/**
+ * Waits for a message containing one or more file descriptors on the given
+ * socket, storing the received file descriptors within the given array. The
+ * file descriptors must have been sent via guacd_send_fds() or
+ * guacd_send_fd(), or by another process sending a single 'G' byte along
+ * with the file descriptors. Any file descriptors beyond the given maximum
+ * are closed. If an error occurs, -1 is returned, and errno will be set
+ * appropriately.
+ *
+ * @param sock
+ *     The file descriptor of an open UNIX domain socket along which the file
+ *     descriptors will be sent.
+ *
+ * @param fds
+ *     The array which should receive the file descriptors.
+ *
+ * @param max_count
+ *     The maximum number of file descriptors that may be stored within the
+ *     given array.
+ *
+ * @return
+ *     The number of file descriptors received, or -1 if an error occurs
+ *     preventing receipt of any file descriptors.
+ */
+int guacd_recv_fds(int sock, int* fds, int max_count);
+
 /**
  * Waits for a file descriptor on the given socket, returning the received file
  * descriptor. The file descriptor must have been sent via guacd_send_fd. If an
@@ -0,0 +1,365 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "conf.h"
+#include "log.h"
+#include "peer.h"
+#include "proc.h"
+#include "proc-map.h"
+
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/unicode.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * Writes an instruction having the given opcode and single argument to the
+ * given socket, without flushing the socket.
+ *
+ * @param socket
+ *     The socket to write the instruction to.
+ *
+ * @param opcode
+ *     The opcode of the instruction.
+ *
+ * @param value
+ *     The sole argument of the instruction.
+ *
+ * @return
+ *     Zero if the instruction was written successfully, non-zero otherwise.
+ */
+static int guacd_peer_write_instruction(guac_socket* socket, const char* opcode,
+        const char* value) {
+
+    return guac_socket_write_int(socket, guac_utf8_strlen(opcode))
+        || guac_socket_write_string(socket, ".")
+        || guac_socket_write_string(socket, opcode)
+        || guac_socket_write_string(socket, ",")
+        || guac_socket_write_int(socket, guac_utf8_strlen(value))
+        || guac_socket_write_string(socket, ".")
+        || guac_socket_write_string(socket, value)
+        || guac_socket_write_string(socket, ";");
+
+}
+
+/**
+ * Connects the given socket to the given address, waiting no longer than
+ * GUACD_PEER_TIMEOUT milliseconds for the connection to be accepted.
+ *
+ * @param fd
+ *     The file descriptor of the socket to connect.
+ *
+ * @param address
+ *     The address to connect to.
+ *
+ * @return
+ *     Zero if the socket is now connected, non-zero otherwise.
+ */
+static int guacd_peer_connect_address(int fd, struct addrinfo* address) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return 1;
+
+    /* Wait for connection to complete only if it did not complete
+     * immediately */
+    if (connect(fd, address->ai_addr, address->ai_addrlen)) {
+
+        if (errno != EINPROGRESS)
+            return 1;
+
+        struct pollfd pending = { .fd = fd, .events = POLLOUT };
+        if (poll(&pending, 1, GUACD_PEER_TIMEOUT) <= 0)
+            return 1;
+
+        int error;
+        socklen_t error_length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length)
+                || error != 0)
+            return 1;
+
+    }
+
+    /* All further I/O is blocking */
+    return fcntl(fd, F_SETFL, flags) < 0;
+
+}
+
+int guacd_peer_connect(guacd_config_peer* peer) {
+
+    struct addrinfo* addresses;
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    int retval = getaddrinfo(peer->host, peer->port, &hints, &addresses);
+    if (retval != 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to resolve address of peer "
+                "\"%s\": %s", peer->name, gai_strerror(retval));
+        return -1;
+    }
+
+    int fd = -1;
+
+    /* Attempt each address in turn until one succeeds */
+    for (struct addrinfo* current = addresses; current != NULL;
+            current = current->ai_next) {
+
+        fd = socket(current->ai_family, current->ai_socktype,
+                current->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        if (!guacd_peer_connect_address(fd, current))
+            break;
+
+        close(fd);
+        fd = -1;
+
+    }
+
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to connect to peer \"%s\".",
+                peer->name);
+        return -1;
+    }
+
+    /* Forwarded connections are as sensitive to latency as any other */
+    const int SO_TRUE = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void*) &SO_TRUE,
+            sizeof(SO_TRUE));
+
+    return fd;
+
+}
+
+/**
+ * Asks the given peer whether that peer hosts the connection having the
+ * given ID.
+ *
+ * @param peer
+ *     The peer to ask.
+ *
+ * @param identifier
+ *     The ID of the connection being located.
+ *
+ * @return
+ *     Non-zero if the given peer hosts the connection, zero if the peer does
+ *     not host the connection or did not reply in time.
+ */
+static int guacd_peer_hosts(guacd_config_peer* peer, const char* identifier) {
+
+    int fd = guacd_peer_connect(peer);
+    if (fd < 0)
+        return 0;
+
+    guac_socket* socket = guac_socket_open(fd);
+    if (socket == NULL) {
+        close(fd);
+        return 0;
+    }
+
+    int hosted = 0;
+
+    if (!guacd_peer_write_instruction(socket, GUACD_PEER_LOOKUP_OPCODE,
+                identifier) && !guac_socket_flush(socket)) {
+
+        guac_parser* parser = guac_parser_alloc();
+
+        if (guac_parser_expect(parser, socket, GUACD_PEER_TIMEOUT * 1000,
+                    GUACD_PEER_LOOKUP_OPCODE))
+            guacd_log_guac_error(GUAC_LOG_WARNING, "Peer did not reply to "
+                    "lookup");
+
+        else
+            hosted = parser->argc == 1 && strcmp(parser->argv[0], "1") == 0;
+
+        guac_parser_free(parser);
+
+    }
+
+    /* Also closes the file descriptor */
+    guac_socket_free(socket);
+
+    return hosted;
+
+}
+
+guacd_config_peer* guacd_peer_find(guacd_config_peer* peers,
+        const char* identifier) {
+
+    for (guacd_config_peer* peer = peers; peer != NULL; peer = peer->next) {
+        if (guacd_peer_hosts(peer, identifier)) {
+            guacd_log(GUAC_LOG_DEBUG, "Connection \"%s\" is hosted by peer "
+                    "\"%s\".", identifier, peer->name);
+            return peer;
+        }
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Locates the raw IPv4 or IPv6 address within the given socket address. IPv4
+ * addresses mapped into IPv6, as seen by listeners bound to IPv6 addresses
+ * that also accept IPv4 connections, are located as the IPv4 addresses they
+ * represent.
+ *
+ * @param address
+ *     The socket address to inspect.
+ *
+ * @param length
+ *     Pointer to a size_t that should receive the length of the raw address,
+ *     in bytes. This is set to zero if the given socket address is neither
+ *     an IPv4 nor an IPv6 address.
+ *
+ * @return
+ *     A pointer to the raw address within the given socket address, or NULL
+ *     if the given socket address is neither an IPv4 nor an IPv6 address.
+ */
+static const void* guacd_peer_raw_address(const struct sockaddr* address,
+        size_t* length) {
+
+    if (address->sa_family == AF_INET) {
+        *length = sizeof(struct in_addr);
+        return &((const struct sockaddr_in*) address)->sin_addr;
+    }
+
+    if (address->sa_family == AF_INET6) {
+
+        const struct in6_addr* addr = &((const struct sockaddr_in6*) address)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(addr)) {
+            *length = sizeof(struct in_addr);
+            return addr->s6_addr + 12;
+        }
+
+        *length = sizeof(struct in6_addr);
+        return addr;
+
+    }
+
+    *length = 0;
+    return NULL;
+
+}
+
+/**
+ * Returns whether the two given socket addresses refer to the same host,
+ * ignoring any difference in port.
+ *
+ * @param a
+ *     The first address to compare.
+ *
+ * @param b
+ *     The second address to compare.
+ *
+ * @return
+ *     Non-zero if both addresses refer to the same host, zero otherwise.
+ */
+static int guacd_peer_address_equals(const struct sockaddr* a,
+        const struct sockaddr* b) {
+
+    size_t a_length;
+    size_t b_length;
+
+    const void* a_data = guacd_peer_raw_address(a, &a_length);
+    const void* b_data = guacd_peer_raw_address(b, &b_length);
+
+    return a_data != NULL && b_data != NULL && a_length == b_length
+        && memcmp(a_data, b_data, a_length) == 0;
+
+}
+
+int guacd_peer_is_peer_address(guacd_config_peer* peers, int fd) {
+
+    if (fd < 0)
+        return 0;
+
+    struct sockaddr_storage remote;
+    socklen_t remote_length = sizeof(remote);
+    if (getpeername(fd, (struct sockaddr*) &remote, &remote_length))
+        return 0;
+
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    for (guacd_config_peer* peer = peers; peer != NULL; peer = peer->next) {
+
+        struct addrinfo* addresses;
+        if (getaddrinfo(peer->host, NULL, &hints, &addresses))
+            continue;
+
+        int matched = 0;
+        for (struct addrinfo* current = addresses; current != NULL;
+                current = current->ai_next) {
+            if (guacd_peer_address_equals((struct sockaddr*) &remote,
+                        current->ai_addr)) {
+                matched = 1;
+                break;
+            }
+        }
+
+        freeaddrinfo(addresses);
+
+        if (matched)
+            return 1;
+
+    }
+
+    return 0;
+
+}
+
+int guacd_peer_answer(guac_socket* socket, guacd_proc_map* map,
+        const char* identifier) {
+
+    /* Only the presence of the process is relevant */
+    guacd_proc* proc = guacd_proc_map_retrieve(map, identifier);
+    if (proc != NULL)
+        guacd_proc_release(proc);
+
+    if (guacd_peer_write_instruction(socket, GUACD_PEER_LOOKUP_OPCODE,
+                proc != NULL ? "1" : "0"))
+        return 1;
+
+    return guac_socket_flush(socket);
+
+}
+
@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PEER_H
+#define GUACD_PEER_H
+
+#include "config.h"
+
+#include "conf.h"
+#include "proc-map.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * The opcode of the instruction sent by a guacd node, in place of "select",
+ * to ask a peer whether that peer hosts a particular connection. The
+ * instruction has a single argument: the ID of the connection. The peer
+ * replies with an instruction having the same opcode and a single argument
+ * which is "1" if the connection is hosted by that peer and "0" otherwise,
+ * and then closes the connection.
+ */
+#define GUACD_PEER_LOOKUP_OPCODE "lookup"
+
+/**
+ * The maximum amount of time to wait for each peer to accept a connection or
+ * to reply to a lookup, in milliseconds. Peers which do not respond in time
+ * are assumed not to host the requested connection.
+ */
+#define GUACD_PEER_TIMEOUT 1000
+
+/**
+ * Establishes a new, unencrypted connection to the given peer, waiting no
+ * longer than GUACD_PEER_TIMEOUT milliseconds for that connection to be
+ * accepted.
+ *
+ * @param peer
+ *     The peer to connect to.
+ *
+ * @return
+ *     The file descriptor of the new connection, or -1 if the connection
+ *     could not be established.
+ */
+int guacd_peer_connect(guacd_config_peer* peer);
+
+/**
+ * Asks each of the given peers, in order, whether that peer hosts the
+ * connection having the given ID, returning the first peer which does. Peers
+ * are asked only when needed, such that no registry of connections needs to
+ * be kept consistent as nodes come and go.
+ *
+ * @param peers
+ *     The peers to ask.
+ *
+ * @param identifier
+ *     The ID of the connection being located.
+ *
+ * @return
+ *     The peer hosting the connection having the given ID, or NULL if no
+ *     peer hosts that connection.
+ */
+guacd_config_peer* guacd_peer_find(guacd_config_peer* peers,
+        const char* identifier);
+
+/**
+ * Returns whether the connection having the given file descriptor originates
+ * from the address of any of the given peers. Each peer's hostname is
+ * resolved at the time of the check, such that the addresses of peers may
+ * change as nodes come and go. Lookups must only be answered for connections
+ * from peers, as a lookup otherwise allows any client to test which
+ * connection IDs exist.
+ *
+ * @param peers
+ *     The peers whose addresses should be checked.
+ *
+ * @param fd
+ *     The file descriptor of the connection to check, or -1 if the connection
+ *     is not a TCP connection whose file descriptor is available.
+ *
+ * @return
+ *     Non-zero if the connection originates from the address of a peer, zero
+ *     otherwise.
+ */
+int guacd_peer_is_peer_address(guacd_config_peer* peers, int fd);
+
+/**
+ * Replies to a lookup received from a peer along the given socket,
+ * indicating whether the connection having the given ID is hosted locally.
+ * Only the given map is consulted. Lookups are never themselves forwarded to
+ * other peers.
+ *
+ * @param socket
+ *     The socket along which the lookup was received.
+ *
+ * @param map
+ *     The map of all connections hosted locally.
+ *
+ * @param identifier
+ *     The ID of the connection being located.
+ *
+ * @return
+ *     Zero if the reply was sent successfully, non-zero otherwise.
+ */
+int guacd_peer_answer(guac_socket* socket, guacd_proc_map* map,
+        const char* identifier);
+
+#endif
+
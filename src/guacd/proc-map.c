@@ -25,14 +25,14 @@
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
 
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * A value to be stored in the buckets, containing the guacd proc itself,
- * as well as a link to the element in the list of all guacd processes.
- */
-typedef struct guacd_proc_map_entry {
+struct guacd_proc_map_entry {
 
     /**
      * The guacd process itself.
@@ -44,7 +44,13 @@ typedef struct guacd_proc_map_entry {
      */
     guac_common_list_element* element;
 
-} guacd_proc_map_entry;
+    /**
+     * The address of the next entry within the same bucket, or zero if this
+     * is the last entry.
+     */
+    atomic_uintptr_t next;
+
+};
 
 /**
  * Returns a hash code based on the given connection ID.
@@ -70,8 +76,7 @@ static unsigned int __guacd_client_hash(const char* str) {
 
 /**
  * Locates the bucket corresponding to the hash code indicated by the given id,
- * where the hash code is dictated by __guacd_client_hash().  Each bucket is an
- * instance of guac_common_list.
+ * where the hash code is dictated by __guacd_client_hash().
  *
  * @param map
  *     The map to retrieve the hash bucket from.
@@ -80,70 +85,202 @@ static unsigned int __guacd_client_hash(const char* str) {
  *     The ID whose hash code determines the bucket being retrieved.
  *
  * @return
- *     The bucket corresponding to the hash code for the given ID, represented
- *     by a guac_common_list.
+ *     The bucket corresponding to the hash code for the given ID.
  */
-static guac_common_list* __guacd_proc_find_bucket(guacd_proc_map* map,
+static guacd_proc_map_bucket* __guacd_proc_find_bucket(guacd_proc_map* map,
         const char* id) {
 
     const int index = __guacd_client_hash(id) % GUACD_PROC_MAP_BUCKETS;
-    return map->__buckets[index];
+    return &(map->__buckets[index]);
 
 }
 
 /**
- * Given a bucket of guacd_proc instances, returns the guacd_proc having the
- * guac_client with the given ID, or NULL if no such client is stored.
+ * Atomically reads the entry address stored at the given location, as stored
+ * within the head of each bucket and the next member of each entry.
+ *
+ * @param location
+ *     The location to read.
+ *
+ * @return
+ *     The entry whose address is stored at the given location, or NULL if
+ *     zero is stored there.
+ */
+static guacd_proc_map_entry* __guacd_proc_map_load(atomic_uintptr_t* location) {
+    return (guacd_proc_map_entry*) atomic_load(location);
+}
+
+/**
+ * Given a bucket of guacd_proc instances, returns the location of the address
+ * of the entry containing the guacd_proc having the guac_client with the
+ * given ID. If no such entry exists, the location of the zero address
+ * terminating the bucket is returned. The bucket lock must be held by the
+ * caller.
  *
  * @param bucket
- *     The bucket of guacd_proc instances to search, represented as a
- *     guac_common_list.
+ *     The bucket of guacd_proc instances to search.
  *
  * @param id
  *     The ID of the guac_client whose corresponding guacd_proc instance should
  *     be located within the bucket.
  *
  * @return
- *     The guac_common_list_element containing the guacd_proc instance
- *     corresponding to the guac_client having the given ID, or NULL of no such
- *     element exists.
+ *     The location of the address of the entry containing the guacd_proc
+ *     instance corresponding to the guac_client having the given ID, which
+ *     will contain zero if no such entry exists.
  */
-static guac_common_list_element* __guacd_proc_find(guac_common_list* bucket,
+static atomic_uintptr_t* __guacd_proc_find(guacd_proc_map_bucket* bucket,
         const char* id) {
 
-    guac_common_list_element* current = bucket->head;
+    atomic_uintptr_t* current = &(bucket->head);
 
-    /* Search for matching element within bucket */
-    while (current != NULL) {
+    /* Search for matching entry within bucket */
+    guacd_proc_map_entry* entry;
+    while ((entry = __guacd_proc_map_load(current)) != NULL) {
 
         /* Check connection ID */
-        guacd_proc* proc = ((guacd_proc_map_entry*) current->data)->proc;
-        if (strcmp(proc->client->connection_id, id) == 0)
+        if (strcmp(entry->proc->client->connection_id, id) == 0)
             break;
 
-        current = current->next;
+        current = &(entry->next);
     }
 
     return current;
 
 }
 
+/**
+ * Returns the reader slot that the current thread should use to record its
+ * presence while retrieving processes from the given map. Each thread
+ * consistently uses the same slot, and different threads will typically use
+ * different slots. The slot is chosen using the address of the current
+ * thread's stack, which is unique to each thread and, unlike pthread_t, is
+ * guaranteed to be convertible to an integer.
+ *
+ * @param map
+ *     The map whose reader slot should be returned.
+ *
+ * @return
+ *     The reader slot that the current thread should use.
+ */
+static guacd_proc_map_readers* __guacd_proc_map_reader_slot(
+        guacd_proc_map* map) {
+
+    /* Thread stacks are at least several pages apart */
+    int stack_marker;
+    uintptr_t stack_address = (uintptr_t) &stack_marker;
+
+    return &(map->__readers[(stack_address >> 16)
+            % GUACD_PROC_MAP_READER_SLOTS]);
+
+}
+
+/**
+ * Records that the current thread is about to read the entries of the given
+ * map without holding any lock. Entries later removed from the map will not
+ * be freed until guacd_proc_map_read_end() is invoked with the values
+ * returned by this function.
+ *
+ * @param map
+ *     The map that is about to be read.
+ *
+ * @param readers
+ *     Pointer to the location where the reader slot used by the current
+ *     thread should be stored.
+ *
+ * @return
+ *     The parity of the read epoch under which the current thread's presence
+ *     was recorded.
+ */
+static unsigned int guacd_proc_map_read_begin(guacd_proc_map* map,
+        guacd_proc_map_readers** readers) {
+
+    guacd_proc_map_readers* slot = __guacd_proc_map_reader_slot(map);
+    *readers = slot;
+
+    for (;;) {
+
+        /* Record presence under current epoch */
+        unsigned int parity = atomic_load(&map->__epoch) & 1;
+        atomic_fetch_add(&slot->count[parity], 1);
+
+        /* The epoch may have advanced before our presence was recorded, in
+         * which case a thread removing an entry may not have seen us, and we
+         * must try again under the new epoch */
+        if ((atomic_load(&map->__epoch) & 1) == parity)
+            return parity;
+
+        atomic_fetch_sub(&slot->count[parity], 1);
+
+    }
+
+}
+
+/**
+ * Records that the current thread has finished reading the entries of the
+ * given map, as previously declared with guacd_proc_map_read_begin().
+ *
+ * @param readers
+ *     The reader slot returned by guacd_proc_map_read_begin().
+ *
+ * @param parity
+ *     The epoch parity returned by guacd_proc_map_read_begin().
+ */
+static void guacd_proc_map_read_end(guacd_proc_map_readers* readers,
+        unsigned int parity) {
+    atomic_fetch_sub(&readers->count[parity], 1);
+}
+
+/**
+ * Waits for all threads which may currently be reading the entries of the
+ * given map to finish doing so. Any entry unlinked from its bucket before
+ * this function is invoked may be safely freed after this function returns.
+ *
+ * @param map
+ *     The map to wait for.
+ */
+static void guacd_proc_map_synchronize(guacd_proc_map* map) {
+
+    pthread_mutex_lock(&map->__epoch_lock);
+
+    /* Advance the epoch twice, waiting for all readers of each parity in turn
+     * to finish, such that readers present under either parity before this
+     * function was invoked have finished */
+    for (int i = 0; i < 2; i++) {
+
+        unsigned int parity = atomic_fetch_add(&map->__epoch, 1) & 1;
+
+        for (int slot = 0; slot < GUACD_PROC_MAP_READER_SLOTS; slot++) {
+            while (atomic_load(&map->__readers[slot].count[parity]) != 0)
+                sched_yield();
+        }
+
+    }
+
+    pthread_mutex_unlock(&map->__epoch_lock);
+
+}
+
 guacd_proc_map* guacd_proc_map_alloc() {
 
     guacd_proc_map* map = guac_mem_alloc(sizeof(guacd_proc_map));
     map->processes = guac_common_list_alloc();
-    guac_common_list** current;
-
-    int i;
 
     /* Init all buckets */
-    current = map->__buckets;
+    for (int i = 0; i < GUACD_PROC_MAP_BUCKETS; i++) {
+        atomic_init(&map->__buckets[i].head, 0);
+        pthread_mutex_init(&map->__buckets[i].lock, NULL);
+    }
 
-    for (i=0; i<GUACD_PROC_MAP_BUCKETS; i++) {
-        *current = guac_common_list_alloc();
-        current++;
+    /* Init reader tracking */
+    atomic_init(&map->__epoch, 0);
+    for (int i = 0; i < GUACD_PROC_MAP_READER_SLOTS; i++) {
+        atomic_init(&map->__readers[i].count[0], 0);
+        atomic_init(&map->__readers[i].count[1], 0);
     }
 
+    pthread_mutex_init(&map->__epoch_lock, NULL);
+
     return map;
 
 }
@@ -151,15 +288,14 @@ guacd_proc_map* guacd_proc_map_alloc() {
 int guacd_proc_map_add(guacd_proc_map* map, guacd_proc* proc) {
 
     const char* identifier = proc->client->connection_id;
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, identifier);
-    guac_common_list_element* found;
+    guacd_proc_map_bucket* bucket = __guacd_proc_find_bucket(map, identifier);
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, identifier);
+    /* Retrieve corresponding entry, if any */
+    pthread_mutex_lock(&bucket->lock);
+    atomic_uintptr_t* found = __guacd_proc_find(bucket, identifier);
 
-    /* If no such element, we can add the new client successfully */
-    if (found == NULL) {
+    /* If no such entry, we can add the new client successfully */
+    if (__guacd_proc_map_load(found) == NULL) {
 
         guacd_proc_map_entry* entry = guac_mem_alloc(sizeof(guacd_proc_map_entry));
 
@@ -168,73 +304,82 @@ int guacd_proc_map_add(guacd_proc_map* map, guacd_proc* proc) {
         guac_common_list_unlock(map->processes);
 
         entry->proc = proc;
+        atomic_init(&entry->next, atomic_load(&bucket->head));
 
-        guac_common_list_add(bucket, entry);
-        guac_common_list_unlock(bucket);
+        /* Publish fully-initialized entry to readers */
+        atomic_store(&bucket->head, (uintptr_t) entry);
+        pthread_mutex_unlock(&bucket->lock);
 
         return 0;
     }
 
     /* Otherwise, fail - already exists */
-    guac_common_list_unlock(bucket);
+    pthread_mutex_unlock(&bucket->lock);
     return 1;
 
 }
 
 guacd_proc* guacd_proc_map_retrieve(guacd_proc_map* map, const char* id) {
 
-    guacd_proc* proc;
+    guacd_proc* proc = NULL;
+    guacd_proc_map_bucket* bucket = __guacd_proc_find_bucket(map, id);
 
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, id);
-    guac_common_list_element* found;
+    /* Entries will not be freed while being read */
+    guacd_proc_map_readers* readers;
+    unsigned int parity = guacd_proc_map_read_begin(map, &readers);
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, id);
+    /* Search for matching entry within bucket */
+    guacd_proc_map_entry* entry = __guacd_proc_map_load(&bucket->head);
+    while (entry != NULL) {
 
-    /* If no such element, fail */
-    if (found == NULL) {
-        guac_common_list_unlock(bucket);
-        return NULL;
-    }
+        /* Keep process valid until released by the caller, even if removed
+         * from the map in the meantime (the reference held by the creator of
+         * the process is not released until after the process has been
+         * removed, which cannot complete until this read has ended) */
+        if (strcmp(entry->proc->client->connection_id, id) == 0) {
+            proc = entry->proc;
+            guacd_proc_acquire(proc);
+            break;
+        }
 
-    proc = ((guacd_proc_map_entry*) found->data)->proc;
+        entry = __guacd_proc_map_load(&entry->next);
+    }
 
-    guac_common_list_unlock(bucket);
+    guacd_proc_map_read_end(readers, parity);
     return proc;
 
 }
 
 guacd_proc* guacd_proc_map_remove(guacd_proc_map* map, const char* id) {
 
-    guacd_proc* proc;
-
-    guac_common_list* bucket = __guacd_proc_find_bucket(map, id);
-    guac_common_list_element* found;
+    guacd_proc_map_bucket* bucket = __guacd_proc_find_bucket(map, id);
 
-    /* Retrieve corresponding element, if any */
-    guac_common_list_lock(bucket);
-    found = __guacd_proc_find(bucket, id);
+    /* Retrieve corresponding entry, if any */
+    pthread_mutex_lock(&bucket->lock);
+    atomic_uintptr_t* found = __guacd_proc_find(bucket, id);
+    guacd_proc_map_entry* entry = __guacd_proc_map_load(found);
 
-    /* If no such element, fail */
-    if (found == NULL) {
-        guac_common_list_unlock(bucket);
+    /* If no such entry, fail */
+    if (entry == NULL) {
+        pthread_mutex_unlock(&bucket->lock);
         return NULL;
     }
 
-    guacd_proc_map_entry* entry = (guacd_proc_map_entry*) found->data;
+    /* Unlink entry, such that future readers will not find it */
+    atomic_store(found, atomic_load(&entry->next));
+    pthread_mutex_unlock(&bucket->lock);
 
     /* Find and remove the key from the process list */
     guac_common_list_lock(map->processes);
     guac_common_list_remove(map->processes, entry->element);
     guac_common_list_unlock(map->processes);
 
-    proc = entry->proc;
-    guac_common_list_remove(bucket, found);
+    /* Free entry only after all readers which may have found it are done */
+    guacd_proc_map_synchronize(map);
 
-    free (entry);
+    guacd_proc* proc = entry->proc;
+    guac_mem_free(entry);
 
-    guac_common_list_unlock(bucket);
     return proc;
 
 }
@@ -261,11 +406,22 @@ void guacd_proc_map_free(guacd_proc_map* map) {
     guac_common_list_free(map->processes, NULL);
 
     /* Free each bucket */
-    guac_common_list** buckets = map->__buckets;
-    int i;
-    for (i = 0; i < GUACD_PROC_MAP_BUCKETS; i++) {
-        guac_common_list_free(*(buckets + i), free);
+    for (int i = 0; i < GUACD_PROC_MAP_BUCKETS; i++) {
+
+        guacd_proc_map_bucket* bucket = &(map->__buckets[i]);
+
+        guacd_proc_map_entry* entry = __guacd_proc_map_load(&bucket->head);
+        while (entry != NULL) {
+            guacd_proc_map_entry* next = __guacd_proc_map_load(&entry->next);
+            guac_mem_free(entry);
+            entry = next;
+        }
+
+        pthread_mutex_destroy(&bucket->lock);
+
     }
 
-}
+    pthread_mutex_destroy(&map->__epoch_lock);
+    guac_mem_free(map);
 
+}
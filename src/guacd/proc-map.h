@@ -26,6 +26,10 @@
 
 #include <guacamole/client.h>
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
 /**
  * The maximum number of concurrent connections to a single instance
  * of guacd.
@@ -42,16 +46,81 @@
  */
 #define GUACD_PROC_MAP_BUCKETS GUACD_CLIENT_MAX_CONNECTIONS*2
 
+/**
+ * The number of slots across which threads retrieving processes from a
+ * process map record their presence, such that concurrent retrievals rarely
+ * modify the same memory.
+ */
+#define GUACD_PROC_MAP_READER_SLOTS 64
+
+/**
+ * The assumed size of a CPU cache line, in bytes. Each reader slot of a
+ * process map occupies its own cache line.
+ */
+#define GUACD_PROC_MAP_CACHE_LINE_SIZE 64
+
+/**
+ * An entry within a bucket of a process map, associating a process with the
+ * connection ID of its client. Entries are never modified after being added
+ * to a bucket, other than to unlink the entry that follows.
+ */
+typedef struct guacd_proc_map_entry guacd_proc_map_entry;
+
+/**
+ * A single hash bucket of a process map, containing all processes whose
+ * connection IDs hash to the same bucket location.
+ */
+typedef struct guacd_proc_map_bucket {
+
+    /**
+     * The address of the first entry within this bucket (a pointer to a
+     * guacd_proc_map_entry), or zero if the bucket is empty. This address,
+     * and the address of the next entry within each entry, may be read at
+     * any time without acquiring the bucket lock.
+     */
+    atomic_uintptr_t head;
+
+    /**
+     * Lock which must be acquired before modifying the entries of this
+     * bucket. This lock is never acquired when retrieving processes.
+     */
+    pthread_mutex_t lock;
+
+} guacd_proc_map_bucket;
+
+/**
+ * The number of threads currently retrieving processes from a process map
+ * which are associated with a particular reader slot, for each of the two
+ * possible parities of the map's read epoch.
+ */
+typedef struct guacd_proc_map_readers {
+
+    /**
+     * The number of threads currently retrieving processes using this slot,
+     * indexed by the parity of the read epoch observed by those threads.
+     */
+    atomic_uint count[2];
+
+    /**
+     * Unused space which ensures that each slot occupies its own cache line.
+     */
+    char __padding[GUACD_PROC_MAP_CACHE_LINE_SIZE - 2 * sizeof(atomic_uint)];
+
+} guacd_proc_map_readers;
+
 /**
  * Set of all active connections to guacd, indexed by connection ID.
+ * Processes may be retrieved without acquiring any lock, and thus without
+ * contending with other retrievals, even when many users join the same
+ * connection at once. Entries removed from the map are freed only after all
+ * retrievals which may have observed those entries have completed.
  */
 typedef struct guacd_proc_map {
 
     /**
-     * Internal hash buckets. Each bucket is a linked list containing all
-     * guac_client instances which hash to this bucket location.
+     * Internal hash buckets.
      */
-    guac_common_list* __buckets[GUACD_PROC_MAP_BUCKETS];
+    guacd_proc_map_bucket __buckets[GUACD_PROC_MAP_BUCKETS];
 
     /**
      * All processes present in the map. For internal use only. To operate on these
@@ -59,6 +128,26 @@ typedef struct guacd_proc_map {
      */
     guac_common_list* processes;
 
+    /**
+     * The current read epoch of this map. Threads retrieving processes
+     * record their presence within the reader slot counter matching the
+     * parity of this epoch, while threads removing processes advance the
+     * epoch and wait for retrievals using the previous parity to complete.
+     */
+    atomic_uint __epoch;
+
+    /**
+     * The presence of all threads currently retrieving processes from this
+     * map.
+     */
+    guacd_proc_map_readers __readers[GUACD_PROC_MAP_READER_SLOTS];
+
+    /**
+     * Lock which is acquired while waiting for in-progress retrievals to
+     * complete, such that only one thread advances the read epoch at a time.
+     */
+    pthread_mutex_t __epoch_lock;
+
 } guacd_proc_map;
 
 /**
@@ -100,7 +189,12 @@ int guacd_proc_map_add(guacd_proc_map* map, guacd_proc* proc);
 
 /**
  * Retrieves the client process having the client with the given ID, or NULL if
- * no such process is stored.
+ * no such process is stored. No locks are acquired, and this function never
+ * blocks, even if the same process is being retrieved by many threads at
+ * once, or the map is concurrently being modified. A reference to the returned process is acquired
+ * on behalf of the caller, such that the process remains valid even if it is
+ * concurrently removed from the map. This reference must be released with
+ * guacd_proc_release() once the process is no longer needed.
  *
  * @param map
  *     The map from which to retrieve the process associated with the client
@@ -118,6 +212,9 @@ guacd_proc* guacd_proc_map_retrieve(guacd_proc_map* map, const char* id);
 /**
  * Removes the client process having the client with the given ID, returning
  * the corresponding process. If no such process exists, NULL is returned.
+ * This function blocks until all retrievals which may have observed the
+ * removed process have completed, such that each either acquired its own
+ * reference to that process or did not find it.
  *
  * @param map
  *     The map from which to remove the process associated with the client
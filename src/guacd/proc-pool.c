@@ -0,0 +1,229 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "conf.h"
+#include "log.h"
+#include "proc.h"
+#include "proc-pool.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * Creates idle processes for each entry of the given pool until all entries
+ * are at their intended size, waiting for further processes to be needed
+ * whenever this is the case, until the pool is freed.
+ *
+ * @param data
+ *     A pointer to the guacd_proc_pool being refilled.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_proc_pool_refill_thread(void* data) {
+
+    guacd_proc_pool* pool = (guacd_proc_pool*) data;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    while (!pool->stopping) {
+
+        /* Find any entry still requiring processes */
+        guacd_proc_pool_entry* entry = pool->entries;
+        while (entry != NULL && entry->pending == 0)
+            entry = entry->next;
+
+        /* Wait for processes to be taken if all entries are full */
+        if (entry == NULL) {
+            pthread_cond_wait(&(pool->modified), &(pool->lock));
+            continue;
+        }
+
+        /* Each required process is attempted only once, such that a process
+         * which cannot be created is not retried until another connection
+         * using the same protocol is requested */
+        entry->pending--;
+        entry->starting++;
+
+        /* Create process without blocking other users of the pool */
+        pthread_mutex_unlock(&(pool->lock));
+        guacd_proc* proc = guacd_create_proc(entry->protocol);
+        pthread_mutex_lock(&(pool->lock));
+
+        entry->starting--;
+
+        if (proc == NULL)
+            continue;
+
+        /* Discard process if the pool is being freed in the meantime */
+        if (pool->stopping) {
+            pthread_mutex_unlock(&(pool->lock));
+            guacd_proc_free(proc);
+            pthread_mutex_lock(&(pool->lock));
+            break;
+        }
+
+        guacd_log(GUAC_LOG_DEBUG, "Started idle process for protocol \"%s\" "
+                "(connection ID \"%s\").", entry->protocol,
+                proc->client->connection_id);
+
+        entry->procs[entry->length++] = proc;
+
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
+
+}
+
+guacd_proc_pool* guacd_proc_pool_alloc(guacd_config_pool* config) {
+
+    guacd_proc_pool* pool = guac_mem_zalloc(sizeof(guacd_proc_pool));
+
+    /* Add an entry for each protocol which should have idle processes */
+    for (; config != NULL; config = config->next) {
+
+        if (config->size <= 0)
+            continue;
+
+        guacd_proc_pool_entry* entry = guac_mem_zalloc(sizeof(guacd_proc_pool_entry));
+        entry->protocol = guac_strdup(config->protocol);
+        entry->size = config->size;
+        entry->pending = config->size;
+        entry->procs = guac_mem_zalloc(sizeof(guacd_proc*), config->size);
+
+        entry->next = pool->entries;
+        pool->entries = entry;
+
+        guacd_log(GUAC_LOG_INFO, "Keeping %i idle process(es) ready for "
+                "protocol \"%s\".", entry->size, entry->protocol);
+
+    }
+
+    /* No pool is needed if no protocol requires idle processes */
+    if (pool->entries == NULL) {
+        guac_mem_free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&(pool->lock), NULL);
+    pthread_cond_init(&(pool->modified), NULL);
+
+    /* Begin creating idle processes */
+    if (pthread_create(&(pool->refill_thread), NULL,
+                guacd_proc_pool_refill_thread, pool)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to start creation of idle "
+                "processes. New processes will be created only as needed.");
+        pool->stopping = 1;
+        guacd_proc_pool_free(pool);
+        return NULL;
+    }
+
+    return pool;
+
+}
+
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol) {
+
+    /* No idle processes exist if there is no pool */
+    if (pool == NULL)
+        return NULL;
+
+    guacd_proc* proc = NULL;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    /* Locate entry for requested protocol */
+    guacd_proc_pool_entry* entry = pool->entries;
+    while (entry != NULL && strcmp(entry->protocol, protocol) != 0)
+        entry = entry->next;
+
+    /* Take the oldest process, if any, which is the most likely to have
+     * finished loading its client plugin */
+    if (entry != NULL && entry->length > 0) {
+
+        proc = entry->procs[0];
+        entry->length--;
+        memmove(entry->procs, entry->procs + 1,
+                sizeof(guacd_proc*) * entry->length);
+
+        /* Schedule creation of a replacement */
+        entry->pending++;
+        pthread_cond_signal(&(pool->modified));
+
+    }
+
+    /* Retry creation of any processes that previously failed, even if none
+     * were available to take */
+    else if (entry != NULL && entry->length + entry->pending
+            + entry->starting < entry->size) {
+        entry->pending = entry->size - entry->length - entry->starting;
+        pthread_cond_signal(&(pool->modified));
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    return proc;
+
+}
+
+void guacd_proc_pool_free(guacd_proc_pool* pool) {
+
+    /* Nothing to free if there is no pool */
+    if (pool == NULL)
+        return;
+
+    /* Stop creating idle processes (the refill thread will not have been
+     * started if the pool is already stopping) */
+    pthread_mutex_lock(&(pool->lock));
+    int started = !pool->stopping;
+    pool->stopping = 1;
+    pthread_cond_signal(&(pool->modified));
+    pthread_mutex_unlock(&(pool->lock));
+
+    if (started)
+        pthread_join(pool->refill_thread, NULL);
+
+    /* Stop and free all remaining idle processes */
+    guacd_proc_pool_entry* entry = pool->entries;
+    while (entry != NULL) {
+
+        guacd_proc_pool_entry* next = entry->next;
+
+        for (int i = 0; i < entry->length; i++)
+            guacd_proc_free(entry->procs[i]);
+
+        guac_mem_free(entry->procs);
+        guac_mem_free(entry->protocol);
+        guac_mem_free(entry);
+
+        entry = next;
+
+    }
+
+    pthread_mutex_destroy(&(pool->lock));
+    pthread_cond_destroy(&(pool->modified));
+    guac_mem_free(pool);
+
+}
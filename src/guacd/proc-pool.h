@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PROC_POOL_H
+#define GUACD_PROC_POOL_H
+
+#include "config.h"
+
+#include "conf.h"
+#include "proc.h"
+
+#include <pthread.h>
+
+/**
+ * The idle processes kept ready for new connections using a single protocol.
+ */
+typedef struct guacd_proc_pool_entry {
+
+    /**
+     * The protocol that all processes within this entry have been
+     * initialized for.
+     */
+    char* protocol;
+
+    /**
+     * The number of idle processes that should be kept ready for this
+     * protocol.
+     */
+    int size;
+
+    /**
+     * The number of processes which must still be created to bring this entry
+     * back up to its intended size.
+     */
+    int pending;
+
+    /**
+     * The number of processes currently being created for this entry.
+     */
+    int starting;
+
+    /**
+     * The number of idle processes currently stored within the procs array.
+     */
+    int length;
+
+    /**
+     * All idle processes currently ready for this protocol, in the order they
+     * were created. This array has room for exactly size processes.
+     */
+    guacd_proc** procs;
+
+    /**
+     * The entry of the next protocol within the pool, or NULL if there are no
+     * further protocols.
+     */
+    struct guacd_proc_pool_entry* next;
+
+} guacd_proc_pool_entry;
+
+/**
+ * A set of idle processes, each having already loaded the client plugin of
+ * its protocol, which are kept ready to be handed their first user as soon as
+ * a new connection using that protocol is requested. New processes are
+ * created in the background to replace those taken from the pool.
+ */
+typedef struct guacd_proc_pool {
+
+    /**
+     * The idle processes of each configured protocol.
+     */
+    guacd_proc_pool_entry* entries;
+
+    /**
+     * Lock which must be acquired before accessing any entry of this pool or
+     * the stopping flag.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever an entry of this pool requires
+     * new processes or the pool is being freed.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Non-zero if this pool is being freed and no further processes should
+     * be created, zero otherwise.
+     */
+    int stopping;
+
+    /**
+     * The thread which creates new idle processes for this pool.
+     */
+    pthread_t refill_thread;
+
+} guacd_proc_pool;
+
+/**
+ * Allocates a new pool of idle processes, beginning creation of those
+ * processes in the background. If no protocol is configured to have any idle
+ * processes, no pool is needed, and NULL is returned.
+ *
+ * @param config
+ *     The number of idle processes to keep ready for each protocol, as read
+ *     from the guacd configuration.
+ *
+ * @return
+ *     A newly-allocated pool of idle processes, or NULL if no processes need
+ *     be kept ready or the pool could not be created.
+ */
+guacd_proc_pool* guacd_proc_pool_alloc(guacd_config_pool* config);
+
+/**
+ * Removes and returns an idle process which has already been initialized for
+ * the given protocol, if any are available, scheduling creation of a
+ * replacement. The returned process has not yet received any users, and is
+ * thus equivalent to a process newly returned by guacd_create_proc(). The
+ * caller takes ownership of the returned process.
+ *
+ * @param pool
+ *     The pool to take an idle process from, or NULL if no pool exists.
+ *
+ * @param protocol
+ *     The protocol that the returned process must have been initialized for.
+ *
+ * @return
+ *     An idle process initialized for the given protocol, or NULL if no such
+ *     process is currently available.
+ */
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol);
+
+/**
+ * Stops creation of any further idle processes, stops all idle processes
+ * remaining within the given pool, and frees the pool. Processes already
+ * taken from the pool are unaffected.
+ *
+ * @param pool
+ *     The pool to free, or NULL if no pool exists.
+ */
+void guacd_proc_pool_free(guacd_proc_pool* pool);
+
+#endif
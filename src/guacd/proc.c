@@ -19,7 +19,9 @@
 
 #include "config.h"
 
+#include "cgroup.h"
 #include "log.h"
+#include "metrics.h"
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
@@ -33,6 +35,10 @@
 #include <guacamole/socket.h>
 #include <guacamole/user.h>
 
+#ifdef ENABLE_SHM
+#include <guacamole/socket-shm.h>
+#endif
+
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
@@ -55,9 +61,17 @@ typedef struct guacd_user_thread_params {
     guacd_proc* proc;
 
     /**
-     * The file descriptor of the joining user's socket.
+     * The file descriptors of the joining user's transport. This is either
+     * the single file descriptor of the user's network connection or, for
+     * users connected through a shared memory transport, the
+     * GUAC_SOCKET_SHM_FD_COUNT file descriptors of that transport.
+     */
+    int fds[GUACD_MAX_MOVED_FDS];
+
+    /**
+     * The number of file descriptors within fds.
      */
-    int fd;
+    int fd_count;
 
     /**
      * Whether the joining user is the connection owner.
@@ -66,6 +80,39 @@ typedef struct guacd_user_thread_params {
 
 } guacd_user_thread_params;
 
+/**
+ * Creates a new guac_socket for the transport made up of the given file
+ * descriptors, as received from guacd.
+ *
+ * @param fds
+ *     The file descriptors of the transport.
+ *
+ * @param fd_count
+ *     The number of file descriptors within fds.
+ *
+ * @return
+ *     A newly-allocated guac_socket for the given transport, or NULL if the
+ *     transport is not supported or the socket cannot be created, in which
+ *     case guac_error is set appropriately and the file descriptors are not
+ *     closed.
+ */
+static guac_socket* guacd_proc_open_transport(const int* fds, int fd_count) {
+
+    if (fd_count == 1)
+        return guac_socket_open_buffered(fds[0],
+                GUACD_USER_OUTPUT_BUFFER_SIZE);
+
+#ifdef ENABLE_SHM
+    if (fd_count == GUAC_SOCKET_SHM_FD_COUNT)
+        return guac_socket_open_shm(fds);
+#endif
+
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "Unrecognized user transport";
+    return NULL;
+
+}
+
 /**
  * Handles a user's entire connection and socket lifecycle.
  *
@@ -84,10 +131,25 @@ static void* guacd_user_thread(void* data) {
     guacd_proc* proc = params->proc;
     guac_client* client = proc->client;
 
-    /* Get guac_socket for user's file descriptor */
-    guac_socket* socket = guac_socket_open(params->fd);
-    if (socket == NULL)
+    /* Get guac_socket for user's file descriptor(s) */
+    guac_socket* fd_socket = guacd_proc_open_transport(params->fds,
+            params->fd_count);
+    if (fd_socket == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to open user transport");
+        for (int i = 0; i < params->fd_count; i++)
+            close(params->fds[i]);
+        guac_mem_free(params);
         return NULL;
+    }
+
+    /* Write output for the user from a dedicated thread, such that a slow
+     * user cannot delay output to other users */
+    guac_socket* socket = guac_socket_queue(fd_socket,
+            GUACD_USER_OUTPUT_BACKLOG);
+    if (socket == NULL) {
+        guac_socket_free(fd_socket);
+        return NULL;
+    }
 
     /* Create skeleton user */
     guac_user* user = guac_user_alloc();
@@ -96,7 +158,9 @@ static void* guacd_user_thread(void* data) {
     user->owner  = params->owner;
 
     /* Handle user connection from handshake until disconnect/completion */
+    void* metrics_handle = guacd_metrics_add_user(socket);
     guac_user_handle_connection(user, GUACD_USEC_TIMEOUT);
+    guacd_metrics_remove_user(metrics_handle);
 
     /* Stop client and prevent future users if all users are disconnected */
     if (client->connected_users == 0) {
@@ -115,25 +179,29 @@ static void* guacd_user_thread(void* data) {
 
 /**
  * Begins a new user connection under a given process, using the given file
- * descriptor. The connection will be managed by a separate and detached thread
- * which is started by this function.
+ * descriptors. The connection will be managed by a separate and detached
+ * thread which is started by this function.
  *
  * @param proc
  *     The process that the user is being added to.
  *
- * @param fd
- *     The file descriptor associated with the user's network connection to
- *     guacd.
+ * @param fds
+ *     The file descriptors of the user's transport, as received from guacd.
+ *
+ * @param fd_count
+ *     The number of file descriptors within fds.
  *
  * @param owner
  *     Non-zero if the user is the owner of the connection being joined (they
  *     are the first user to join), or zero otherwise.
  */
-static void guacd_proc_add_user(guacd_proc* proc, int fd, int owner) {
+static void guacd_proc_add_user(guacd_proc* proc, const int* fds,
+        int fd_count, int owner) {
 
     guacd_user_thread_params* params = guac_mem_alloc(sizeof(guacd_user_thread_params));
     params->proc = proc;
-    params->fd = fd;
+    memcpy(params->fds, fds, sizeof(int) * fd_count);
+    params->fd_count = fd_count;
     params->owner = owner;
 
     /* Start user thread */
@@ -325,6 +393,9 @@ static void signal_stop_handler(int signal) {
 static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
 
     int result = 1;
+
+    /* The client was allocated by the parent process prior to forking */
+    guac_client_startup_phase(proc->client, "fork");
    
     /* Set process group ID to match PID */ 
     if (setpgid(0, 0)) {
@@ -333,6 +404,11 @@ static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
         goto cleanup_process;
     }
 
+    /* Apply any resource limits before loading the client plugin, such that
+     * everything the plugin starts is subject to the same limits (failure
+     * has already been logged, and the connection can still proceed) */
+    guacd_cgroup_enter(protocol);
+
     /* Init client for selected protocol */
     guac_client* client = proc->client;
     if (guac_client_load_plugin(client, protocol)) {
@@ -361,11 +437,29 @@ static void guacd_exec_proc(guacd_proc* proc, const char* protocol) {
     sigaction(SIGINT, &signal_stop_action, NULL);
     sigaction(SIGTERM, &signal_stop_action, NULL);
 
-    /* Add each received file descriptor as a new user */
-    int received_fd;
-    while ((received_fd = guacd_recv_fd(proc->fd_socket)) != -1) {
-
-        guacd_proc_add_user(proc, received_fd, owner);
+    /* The thread which created this process may have had those signals
+     * blocked (all threads of the main guacd process other than the main
+     * thread block them) */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+
+    /* Add each received transport as a new user */
+    int received_fds[GUACD_MAX_MOVED_FDS];
+    int received_count;
+    while ((received_count = guacd_recv_fds(proc->fd_socket, received_fds,
+                    GUACD_MAX_MOVED_FDS)) != -1) {
+
+        /* For processes kept idle within a pool, this includes all time spent
+         * within that pool */
+        if (owner) {
+            guac_client_startup_phase(client, "wait_user");
+            guacd_metrics_report_start(proc);
+        }
+
+        guacd_proc_add_user(proc, received_fds, received_count, owner);
 
         /* Future file descriptors are not owners */
         owner = 0;
@@ -377,6 +471,9 @@ cleanup_client:
     /* Request client to stop/disconnect */
     guac_client_stop(client);
 
+    /* Send final counters while the client still exists */
+    guacd_metrics_report_stop();
+
     /* Attempt to free client cleanly */
     guacd_log(GUAC_LOG_DEBUG, "Requesting termination of client...");
     result = guacd_timed_client_free(client, GUACD_CLIENT_FREE_TIMEOUT);
@@ -437,6 +534,9 @@ guacd_proc* guacd_create_proc(const char* protocol) {
         return NULL;
     }
 
+    /* The caller holds the only reference */
+    atomic_init(&proc->refcount, 1);
+
     /* Associate new client */
     proc->client = guac_client_alloc();
     if (proc->client == NULL) {
@@ -511,6 +611,9 @@ static void guacd_proc_kill(guacd_proc* proc) {
     guacd_log(GUAC_LOG_DEBUG, "All child processes for connection \"%s\" have been terminated.",
         proc->client->connection_id);
 
+    /* Clean up any cgroup of the process */
+    guacd_cgroup_remove(proc->pid);
+
 }
 
 void guacd_proc_stop(guacd_proc* proc) {
@@ -536,3 +639,31 @@ void guacd_proc_stop(guacd_proc* proc) {
     close(proc->fd_socket);
 
 }
+
+void guacd_proc_acquire(guacd_proc* proc) {
+    atomic_fetch_add(&proc->refcount, 1);
+}
+
+void guacd_proc_release(guacd_proc* proc) {
+
+    /* Free only once the last reference is released */
+    if (atomic_fetch_sub(&proc->refcount, 1) != 1)
+        return;
+
+    /* Free skeleton client */
+    guac_client_free(proc->client);
+
+    /* Clean up */
+    close(proc->fd_socket);
+    guac_mem_free(proc);
+
+}
+
+void guacd_proc_free(guacd_proc* proc) {
+
+    /* Force process to stop and clean up */
+    guacd_proc_stop(proc);
+
+    guacd_proc_release(proc);
+
+}
@@ -23,8 +23,12 @@
 #include "config.h"
 
 #include <guacamole/client.h>
+#include <guacamole/display-constants.h>
+#include <guacamole/mem-constants.h>
 #include <guacamole/parser.h>
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <unistd.h>
 
 /**
@@ -48,6 +52,73 @@
  */
 #define GUACD_CLIENT_FREE_TIMEOUT 5
 
+/**
+ * The size of the output buffer of the socket of each user of a connection,
+ * in bytes. This is larger than the default for guac_socket, such that large
+ * image updates are written to guacd using relatively few system calls.
+ */
+#define GUACD_USER_OUTPUT_BUFFER_SIZE 65536
+
+/**
+ * The maximum number of bytes of output that may be queued for delivery to
+ * each user's connection. Users whose connections fall further behind than
+ * this while receiving data broadcast to all users are disconnected, rather
+ * than being allowed to delay all other users of the same connection.
+ */
+#define GUACD_USER_OUTPUT_BACKLOG 16777216
+
+/**
+ * Counters describing the activity of a connection process, as periodically
+ * reported by that process to guacd over its guacd_proc fd_socket. All
+ * counters other than users, pending_operations, and memory are cumulative
+ * for the life of the process.
+ */
+typedef struct guacd_proc_metrics {
+
+    /**
+     * The number of users currently connected.
+     */
+    int users;
+
+    /**
+     * The total number of bytes received from all users.
+     */
+    uint64_t bytes_received;
+
+    /**
+     * The total number of bytes sent to all users.
+     */
+    uint64_t bytes_sent;
+
+    /**
+     * The total number of frames encoded by all displays.
+     */
+    uint64_t frames;
+
+    /**
+     * The number of operations currently queued for display worker threads.
+     */
+    uint64_t pending_operations;
+
+    /**
+     * The number of image updates encoded, grouped by encoding time as
+     * described by guac_display_stats.
+     */
+    uint64_t encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS];
+
+    /**
+     * The total time spent encoding all image updates, in nanoseconds.
+     */
+    uint64_t encode_time;
+
+    /**
+     * The number of bytes of memory currently accounted to each category,
+     * indexed by guac_mem_category.
+     */
+    uint64_t memory[GUAC_MEM_CATEGORY_COUNT];
+
+} guacd_proc_metrics;
+
 /**
  * Process information of the internal remote desktop client.
  */
@@ -78,6 +149,31 @@ typedef struct guacd_proc {
      */
     guac_client* client;
 
+    /**
+     * The number of references to this process held within the parent
+     * process. The thread which created the process holds the first
+     * reference, and each retrieval of the process from a guacd_proc_map
+     * acquires another, such that a process being joined by a new user
+     * cannot be freed while that user is being added. Parent-side resources
+     * are freed only once all references have been released.
+     */
+    atomic_int refcount;
+
+    /**
+     * The most recent counters reported by the child process. This will only
+     * be available to the parent process, and only if the metrics listener
+     * is enabled. Access is restricted to the metrics listener (see
+     * metrics.h).
+     */
+    guacd_proc_metrics metrics;
+
+    /**
+     * Non-zero if the child process has terminated and its final counters
+     * have been added to the totals of all terminated processes, zero
+     * otherwise. Access is restricted to the metrics listener.
+     */
+    int metrics_retired;
+
 } guacd_proc;
 
 /**
@@ -105,5 +201,40 @@ guacd_proc* guacd_create_proc(const char* protocol);
  */
 void guacd_proc_stop(guacd_proc* proc);
 
+/**
+ * Acquires an additional reference to the given process, which must later be
+ * released with guacd_proc_release(). This function must be called by the
+ * parent process, and only while some other reference to the process is
+ * known to be held.
+ *
+ * @param proc
+ *     The process to acquire a reference to.
+ */
+void guacd_proc_acquire(guacd_proc* proc);
+
+/**
+ * Releases a reference to the given process. If no references remain, all
+ * resources associated with the process within the parent process are freed,
+ * including the skeleton guac_client and the parent's end of the process's
+ * fd_socket. This function must be called by the parent process.
+ *
+ * @param proc
+ *     The process to release a reference to.
+ */
+void guacd_proc_release(guacd_proc* proc);
+
+/**
+ * Stops the given process, if not already stopped, and releases the
+ * reference held by the caller that created it, freeing all resources
+ * associated with the process within the parent process once no other
+ * references remain. This function must be called by the parent process, and
+ * will block until all processes associated with the given process have
+ * terminated.
+ *
+ * @param proc
+ *     The process to free.
+ */
+void guacd_proc_free(guacd_proc* proc);
+
 #endif
 
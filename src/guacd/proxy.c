@@ -0,0 +1,732 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "proxy.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct guacd_proxy_connection guacd_proxy_connection;
+
+/**
+ * One direction of data flow within a proxied connection.
+ */
+typedef struct guacd_proxy_channel {
+
+    /**
+     * The file descriptor that data is read from.
+     */
+    int from_fd;
+
+    /**
+     * The file descriptor that data is written to.
+     */
+    int to_fd;
+
+    /**
+     * The read and write ends of the pipe through which data is moved from
+     * from_fd to to_fd using splice(), or -1 if data is instead moved through
+     * the buffer.
+     */
+    int pipe_fd[2];
+
+    /**
+     * Data which has been read from from_fd but not yet written to to_fd, if
+     * data is not being moved through a pipe.
+     */
+    char buffer[GUACD_PROXY_BUFFER_SIZE];
+
+    /**
+     * The offset of the first byte within the buffer that has not yet been
+     * written to to_fd.
+     */
+    int offset;
+
+    /**
+     * The number of bytes within the buffer (starting at offset) or pipe
+     * that have not yet been written to to_fd.
+     */
+    int length;
+
+    /**
+     * Whether the end of the data available from from_fd has been reached.
+     */
+    int eof;
+
+} guacd_proxy_channel;
+
+/**
+ * One side of a proxied connection, as registered with epoll.
+ */
+typedef struct guacd_proxy_endpoint {
+
+    /**
+     * The proxied connection that this endpoint is part of.
+     */
+    guacd_proxy_connection* connection;
+
+    /**
+     * The file descriptor of this side of the connection.
+     */
+    int fd;
+
+    /**
+     * The channel which reads data from this endpoint.
+     */
+    guacd_proxy_channel* inbound;
+
+    /**
+     * The channel which writes data to this endpoint.
+     */
+    guacd_proxy_channel* outbound;
+
+    /**
+     * The epoll events currently requested for this endpoint.
+     */
+    uint32_t events;
+
+} guacd_proxy_endpoint;
+
+struct guacd_proxy_connection {
+
+    /**
+     * The guac_socket wrapping the file descriptor of the user's connection
+     * to guacd.
+     */
+    guac_socket* socket;
+
+    /**
+     * The user's side of the connection (the user's connection to guacd).
+     */
+    guacd_proxy_endpoint client;
+
+    /**
+     * The process side of the connection (the file descriptor used by the
+     * connection-specific process).
+     */
+    guacd_proxy_endpoint process;
+
+    /**
+     * Data flowing from the user to the process.
+     */
+    guacd_proxy_channel upstream;
+
+    /**
+     * Data flowing from the process to the user.
+     */
+    guacd_proxy_channel downstream;
+
+    /**
+     * Whether this connection has been closed and is awaiting cleanup.
+     */
+    int closed;
+
+    /**
+     * The next connection within the list of connections closed while
+     * handling the current batch of events.
+     */
+    guacd_proxy_connection* next_closed;
+
+};
+
+/**
+ * A thread which transfers data for all proxied connections registered with
+ * its epoll instance.
+ */
+typedef struct guacd_proxy_thread {
+
+    /**
+     * The epoll instance with which all connections handled by this thread
+     * are registered.
+     */
+    int epoll_fd;
+
+    /**
+     * Lock which is held by this thread while handling events, and by
+     * guacd_proxy_add() while registering a new connection, such that no
+     * events for a connection are handled until that connection is fully
+     * registered.
+     */
+    pthread_mutex_t lock;
+
+} guacd_proxy_thread;
+
+/**
+ * All threads which transfer data for proxied connections.
+ */
+static guacd_proxy_thread guacd_proxy_threads[GUACD_PROXY_THREADS];
+
+/**
+ * Guards one-time initialization of the proxy threads.
+ */
+static pthread_once_t guacd_proxy_init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Whether the proxy threads were started successfully.
+ */
+static int guacd_proxy_ready = 0;
+
+/**
+ * Lock which guards access to guacd_proxy_next_thread.
+ */
+static pthread_mutex_t guacd_proxy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The index of the proxy thread that should handle the next connection.
+ */
+static int guacd_proxy_next_thread = 0;
+
+/**
+ * Reads as much data as possible from the source of the given channel without
+ * blocking, storing that data within the channel's pipe or buffer. The
+ * channel MUST NOT have any data waiting to be written.
+ *
+ * @param channel
+ *     The channel to read data into.
+ *
+ * @return
+ *     The number of bytes read, zero if the end of the data has been reached,
+ *     or -1 if an error occurs (including if no data can be read without
+ *     blocking).
+ */
+static ssize_t guacd_proxy_read(guacd_proxy_channel* channel) {
+
+#ifdef HAVE_SPLICE
+    if (channel->pipe_fd[1] != -1)
+        return splice(channel->from_fd, NULL, channel->pipe_fd[1], NULL,
+                GUACD_PROXY_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+
+    channel->offset = 0;
+    return read(channel->from_fd, channel->buffer, sizeof(channel->buffer));
+
+}
+
+/**
+ * Writes as much of the data waiting within the given channel to the
+ * channel's destination as possible without blocking.
+ *
+ * @param channel
+ *     The channel to write data from.
+ *
+ * @return
+ *     The number of bytes written, or -1 if an error occurs (including if no
+ *     data can be written without blocking).
+ */
+static ssize_t guacd_proxy_write(guacd_proxy_channel* channel) {
+
+#ifdef HAVE_SPLICE
+    if (channel->pipe_fd[0] != -1)
+        return splice(channel->pipe_fd[0], NULL, channel->to_fd, NULL,
+                channel->length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+
+    return write(channel->to_fd, channel->buffer + channel->offset,
+            channel->length);
+
+}
+
+/**
+ * Transfers as much data as possible along the given channel without
+ * blocking. If the end of the data available from the channel's source is
+ * reached, the sending half of the destination is shut down once all
+ * buffered data has been written.
+ *
+ * @param channel
+ *     The channel to transfer data along.
+ *
+ * @return
+ *     Zero if the channel is still healthy, non-zero if an error prevents
+ *     further data from being transferred.
+ */
+static int guacd_proxy_pump(guacd_proxy_channel* channel) {
+
+    int reads = 0;
+
+    for (;;) {
+
+        /* Write any buffered data first */
+        if (channel->length > 0) {
+
+            ssize_t written = guacd_proxy_write(channel);
+
+            if (written < 0)
+                return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+
+            channel->offset += written;
+            channel->length -= written;
+            continue;
+
+        }
+
+        /* Allow other connections a chance to transfer data */
+        if (channel->eof || reads++ >= GUACD_PROXY_MAX_READS)
+            return 0;
+
+        ssize_t length = guacd_proxy_read(channel);
+
+        if (length < 0)
+            return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+
+        /* Forward end of data to the receiving end */
+        if (length == 0) {
+            channel->eof = 1;
+            shutdown(channel->to_fd, SHUT_WR);
+            return 0;
+        }
+
+        channel->length = length;
+
+    }
+
+}
+
+/**
+ * Prepares the given channel for moving data through a pipe with splice(),
+ * if possible. If splice() is unavailable or the pipe cannot be created, the
+ * channel will instead move data through its buffer.
+ *
+ * @param channel
+ *     The channel to initialize.
+ */
+static void guacd_proxy_channel_init(guacd_proxy_channel* channel) {
+
+    channel->pipe_fd[0] = -1;
+    channel->pipe_fd[1] = -1;
+
+#ifdef HAVE_SPLICE
+    if (pipe2(channel->pipe_fd, O_NONBLOCK | O_CLOEXEC)) {
+        channel->pipe_fd[0] = -1;
+        channel->pipe_fd[1] = -1;
+    }
+#endif
+
+}
+
+/**
+ * Closes the pipe of the given channel, if any.
+ *
+ * @param channel
+ *     The channel to clean up.
+ */
+static void guacd_proxy_channel_destroy(guacd_proxy_channel* channel) {
+
+    if (channel->pipe_fd[0] != -1) {
+        close(channel->pipe_fd[0]);
+        close(channel->pipe_fd[1]);
+    }
+
+}
+
+/**
+ * Updates the epoll events requested for the given endpoint to match the
+ * current state of its channels: readable if its inbound channel can accept
+ * more data, and writable if its outbound channel has data waiting.
+ *
+ * @param epoll_fd
+ *     The epoll instance with which the endpoint is registered.
+ *
+ * @param endpoint
+ *     The endpoint to update.
+ *
+ * @return
+ *     Zero if the events were updated successfully, non-zero otherwise.
+ */
+static int guacd_proxy_update_events(int epoll_fd,
+        guacd_proxy_endpoint* endpoint) {
+
+    uint32_t events = 0;
+
+    if (!endpoint->inbound->eof && endpoint->inbound->length == 0)
+        events |= EPOLLIN;
+
+    if (endpoint->outbound->length > 0)
+        events |= EPOLLOUT;
+
+    if (events == endpoint->events)
+        return 0;
+
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = endpoint
+    };
+
+    endpoint->events = events;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, endpoint->fd, &event);
+
+}
+
+/**
+ * Closes the given proxied connection, deregistering both of its file
+ * descriptors. The connection itself is not freed, as further events for the
+ * connection may still be pending within the current batch of events.
+ *
+ * @param epoll_fd
+ *     The epoll instance with which the connection is registered.
+ *
+ * @param connection
+ *     The connection to close.
+ */
+static void guacd_proxy_close(int epoll_fd,
+        guacd_proxy_connection* connection) {
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->client.fd, NULL);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->process.fd, NULL);
+
+    /* Freeing the socket closes the user's connection */
+    guac_socket_free(connection->socket);
+    close(connection->process.fd);
+
+    guacd_proxy_channel_destroy(&connection->upstream);
+    guacd_proxy_channel_destroy(&connection->downstream);
+
+    connection->closed = 1;
+
+}
+
+/**
+ * Handles the given epoll events for the given endpoint, transferring data
+ * along the channels affected by those events and closing the connection if
+ * it has finished or failed.
+ *
+ * @param epoll_fd
+ *     The epoll instance with which the endpoint is registered.
+ *
+ * @param endpoint
+ *     The endpoint that the events occurred on.
+ *
+ * @param events
+ *     The epoll events that occurred.
+ *
+ * @return
+ *     Non-zero if the connection was closed as a result of these events,
+ *     zero otherwise.
+ */
+static int guacd_proxy_handle(int epoll_fd, guacd_proxy_endpoint* endpoint,
+        uint32_t events) {
+
+    guacd_proxy_connection* connection = endpoint->connection;
+
+    int failed = 0;
+
+    /* A hangup or error on an endpoint that is not otherwise being waited on
+     * can only mean that the connection is gone */
+    if ((events & (EPOLLERR | EPOLLHUP)) && endpoint->events == 0)
+        failed = 1;
+
+    /* Errors and hangups are detected when reading or writing */
+    if (events & (EPOLLERR | EPOLLHUP))
+        events |= endpoint->events;
+
+    if (!failed && (events & EPOLLIN))
+        failed = guacd_proxy_pump(endpoint->inbound);
+
+    if (!failed && (events & EPOLLOUT))
+        failed = guacd_proxy_pump(endpoint->outbound);
+
+    /* The connection is finished once both sides have no more data */
+    if (!failed && connection->upstream.eof && connection->downstream.eof
+            && connection->upstream.length == 0
+            && connection->downstream.length == 0)
+        failed = 1;
+
+    if (!failed)
+        failed = guacd_proxy_update_events(epoll_fd, &connection->client)
+              || guacd_proxy_update_events(epoll_fd, &connection->process);
+
+    if (failed) {
+        guacd_proxy_close(epoll_fd, connection);
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Thread which handles all events for all connections registered with a
+ * single epoll instance.
+ *
+ * @param data
+ *     A pointer to the guacd_proxy_thread describing the epoll instance.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_proxy_thread_main(void* data) {
+
+    guacd_proxy_thread* thread = (guacd_proxy_thread*) data;
+    int epoll_fd = thread->epoll_fd;
+    struct epoll_event events[GUACD_PROXY_MAX_EVENTS];
+
+    for (;;) {
+
+        int count = epoll_wait(epoll_fd, events, GUACD_PROXY_MAX_EVENTS, -1);
+        if (count < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Connection proxy thread failed: %s",
+                    strerror(errno));
+            break;
+
+        }
+
+        pthread_mutex_lock(&thread->lock);
+
+        guacd_proxy_connection* closed = NULL;
+
+        for (int i = 0; i < count; i++) {
+
+            guacd_proxy_endpoint* endpoint =
+                (guacd_proxy_endpoint*) events[i].data.ptr;
+
+            guacd_proxy_connection* connection = endpoint->connection;
+
+            /* Ignore events for connections closed within this batch */
+            if (connection->closed)
+                continue;
+
+            if (guacd_proxy_handle(epoll_fd, endpoint, events[i].events)) {
+                connection->next_closed = closed;
+                closed = connection;
+            }
+
+        }
+
+        /* Free closed connections only once no events can refer to them */
+        while (closed != NULL) {
+            guacd_proxy_connection* next = closed->next_closed;
+            guac_mem_free(closed);
+            closed = next;
+        }
+
+        pthread_mutex_unlock(&thread->lock);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Creates the epoll instances and threads used to proxy all connections. If
+ * this fails, guacd_proxy_ready remains zero.
+ */
+static void guacd_proxy_init(void) {
+
+    for (int i = 0; i < GUACD_PROXY_THREADS; i++) {
+
+        guacd_proxy_thread* thread = &guacd_proxy_threads[i];
+
+        thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (thread->epoll_fd < 0) {
+            guacd_log(GUAC_LOG_WARNING, "Unable to create epoll instance for "
+                    "connection proxy: %s", strerror(errno));
+            return;
+        }
+
+        pthread_mutex_init(&thread->lock, NULL);
+
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, guacd_proxy_thread_main, thread)) {
+            guacd_log(GUAC_LOG_WARNING, "Unable to start connection proxy "
+                    "thread.");
+            pthread_mutex_destroy(&thread->lock);
+            close(thread->epoll_fd);
+            return;
+        }
+
+        pthread_detach(thread_id);
+
+    }
+
+    guacd_proxy_ready = 1;
+
+}
+
+/**
+ * Sets or clears the O_NONBLOCK flag of the given file descriptor.
+ *
+ * @param fd
+ *     The file descriptor to modify.
+ *
+ * @param nonblocking
+ *     Non-zero if the file descriptor should be made non-blocking, zero if
+ *     it should be made blocking.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+static int guacd_proxy_set_nonblocking(int fd, int nonblocking) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return 1;
+
+    if (nonblocking)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~O_NONBLOCK;
+
+    return fcntl(fd, F_SETFL, flags) < 0;
+
+}
+
+/**
+ * Initializes the given endpoint of a new proxied connection, including the
+ * file descriptors of the channels reading from and writing to that endpoint.
+ *
+ * @param connection
+ *     The connection that the endpoint is part of.
+ *
+ * @param endpoint
+ *     The endpoint to initialize.
+ *
+ * @param fd
+ *     The file descriptor of the endpoint.
+ *
+ * @param inbound
+ *     The channel reading from the endpoint.
+ *
+ * @param outbound
+ *     The channel writing to the endpoint.
+ */
+static void guacd_proxy_endpoint_init(guacd_proxy_connection* connection,
+        guacd_proxy_endpoint* endpoint, int fd, guacd_proxy_channel* inbound,
+        guacd_proxy_channel* outbound) {
+
+    endpoint->connection = connection;
+    endpoint->fd = fd;
+    endpoint->inbound = inbound;
+    endpoint->outbound = outbound;
+    endpoint->events = EPOLLIN;
+
+    inbound->from_fd = fd;
+    outbound->to_fd = fd;
+
+}
+
+/**
+ * Registers the given endpoint with the given epoll instance, waiting for the
+ * endpoint to become readable.
+ *
+ * @param epoll_fd
+ *     The epoll instance with which the endpoint should be registered.
+ *
+ * @param endpoint
+ *     The endpoint to register.
+ *
+ * @return
+ *     Zero on success, non-zero if the endpoint could not be registered.
+ */
+static int guacd_proxy_register(int epoll_fd, guacd_proxy_endpoint* endpoint) {
+
+    struct epoll_event event = {
+        .events = endpoint->events,
+        .data.ptr = endpoint
+    };
+
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, endpoint->fd, &event);
+
+}
+
+int guacd_proxy_add(guac_socket* socket, int client_fd, int user_fd) {
+
+    pthread_once(&guacd_proxy_init_once, guacd_proxy_init);
+    if (!guacd_proxy_ready)
+        return 1;
+
+    /* Distribute connections evenly across all threads */
+    pthread_mutex_lock(&guacd_proxy_lock);
+    guacd_proxy_thread* thread = &guacd_proxy_threads[guacd_proxy_next_thread];
+    guacd_proxy_next_thread = (guacd_proxy_next_thread + 1) % GUACD_PROXY_THREADS;
+    pthread_mutex_unlock(&guacd_proxy_lock);
+
+    guacd_proxy_connection* connection =
+        guac_mem_zalloc(sizeof(guacd_proxy_connection));
+    connection->socket = socket;
+
+    guacd_proxy_channel_init(&connection->upstream);
+    guacd_proxy_channel_init(&connection->downstream);
+
+    guacd_proxy_endpoint_init(connection, &connection->client, client_fd,
+            &connection->upstream, &connection->downstream);
+
+    guacd_proxy_endpoint_init(connection, &connection->process, user_fd,
+            &connection->downstream, &connection->upstream);
+
+    if (guacd_proxy_set_nonblocking(client_fd, 1)
+            || guacd_proxy_set_nonblocking(user_fd, 1))
+        goto fail;
+
+    /* Register both sides before the thread may handle any events for
+     * either */
+    pthread_mutex_lock(&thread->lock);
+
+    if (guacd_proxy_register(thread->epoll_fd, &connection->client)) {
+        pthread_mutex_unlock(&thread->lock);
+        goto fail;
+    }
+
+    if (guacd_proxy_register(thread->epoll_fd, &connection->process)) {
+        epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
+        pthread_mutex_unlock(&thread->lock);
+        goto fail;
+    }
+
+    pthread_mutex_unlock(&thread->lock);
+    return 0;
+
+fail:
+    guacd_log(GUAC_LOG_WARNING, "Unable to proxy connection using event "
+            "loop: %s", strerror(errno));
+    guacd_proxy_set_nonblocking(client_fd, 0);
+    guacd_proxy_set_nonblocking(user_fd, 0);
+    guacd_proxy_channel_destroy(&connection->upstream);
+    guacd_proxy_channel_destroy(&connection->downstream);
+    guac_mem_free(connection);
+    return 1;
+
+}
+
+#else
+
+int guacd_proxy_add(guac_socket* socket, int client_fd, int user_fd) {
+
+    /* Proxying via an event loop requires epoll */
+    return 1;
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACD_PROXY_H
+#define GUACD_PROXY_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * The number of threads which transfer data for all connections proxied with
+ * guacd_proxy_add(). Each proxied connection is handled entirely by one of
+ * these threads.
+ */
+#define GUACD_PROXY_THREADS 4
+
+/**
+ * The number of bytes of data that may be buffered within each direction of a
+ * proxied connection while waiting for the receiving side to accept that
+ * data.
+ */
+#define GUACD_PROXY_BUFFER_SIZE 8192
+
+/**
+ * The maximum number of bytes moved by each call to splice() when data is
+ * transferred through a pipe, rather than through a buffer in user space.
+ * This matches the default capacity of a pipe on Linux.
+ */
+#define GUACD_PROXY_PIPE_SIZE 65536
+
+/**
+ * The maximum number of times data will be read from any one side of a
+ * proxied connection in response to a single event, such that a busy
+ * connection cannot starve other connections handled by the same thread.
+ */
+#define GUACD_PROXY_MAX_READS 16
+
+/**
+ * The maximum number of events handled by each proxy thread per wait.
+ */
+#define GUACD_PROXY_MAX_EVENTS 64
+
+/**
+ * Begins transferring data back and forth between the given file descriptor
+ * of a user's connection to guacd and the given file descriptor used by the
+ * process-side guac_socket of that user, using a small pool of threads that
+ * wait for I/O on all proxied connections at once, rather than dedicated
+ * threads for each connection. Where splice() is available, data is moved
+ * between the two file descriptors through a pipe, without being copied
+ * through user space. Once the connection has closed, the given guac_socket
+ * is freed (closing client_fd), and user_fd is closed.
+ *
+ * This is only possible if the user's connection to guacd is not encrypted,
+ * such that data may be read from and written to client_fd directly, and only
+ * on platforms providing epoll. Any data buffered by a guac_parser or other
+ * reader of the given guac_socket MUST have been transferred to user_fd
+ * before calling this function, and any data written to the given guac_socket
+ * MUST have been flushed.
+ *
+ * If the connection cannot be proxied, non-zero is returned, and the given
+ * guac_socket and file descriptors are left untouched, such that the caller
+ * may transfer data by other means.
+ *
+ * @param socket
+ *     The guac_socket directly handling I/O from the user's connection to
+ *     guacd.
+ *
+ * @param client_fd
+ *     The file descriptor of the user's connection to guacd, as wrapped by
+ *     the given guac_socket.
+ *
+ * @param user_fd
+ *     The file descriptor which is being handled by a guac_socket within the
+ *     connection-specific process.
+ *
+ * @return
+ *     Zero if the connection is now being proxied, non-zero if the connection
+ *     cannot be proxied.
+ */
+int guacd_proxy_add(guac_socket* socket, int client_fd, int user_fd);
+
+#endif
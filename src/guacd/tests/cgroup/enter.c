@@ -0,0 +1,319 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "cgroup.h"
+#include "conf.h"
+
+#include <CUnit/CUnit.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The template of the name of the temporary directory acting as the parent
+ * cgroup of all connection processes, as accepted by mkdtemp().
+ */
+#define TEST_CGROUP_TEMPLATE "/tmp/guacd-cgroup-test-XXXXXX"
+
+/**
+ * The interface files which guacd_cgroup_enter() writes within the cgroup of
+ * the connection process.
+ */
+static const char* test_cgroup_files[] = {
+    "cpu.weight",
+    "cpu.max",
+    "memory.max",
+    "cgroup.procs",
+    NULL
+};
+
+/**
+ * The temporary directory acting as the parent cgroup of all connection
+ * processes for the current test.
+ */
+static char test_cgroup_path[] = TEST_CGROUP_TEMPLATE;
+
+/**
+ * Stores the path of the given file within the given directory in the given
+ * buffer, which must be PATH_MAX bytes.
+ *
+ * @param buffer
+ *     The buffer to store the path within.
+ *
+ * @param dir
+ *     The directory containing the file.
+ *
+ * @param file
+ *     The name of the file.
+ */
+static void test_cgroup_path_of(char* buffer, const char* dir,
+        const char* file) {
+    CU_ASSERT_FATAL(snprintf(buffer, PATH_MAX, "%s/%s", dir, file) < PATH_MAX);
+}
+
+/**
+ * Creates the given empty file, as the kernel would provide for an interface
+ * file of a cgroup.
+ *
+ * @param dir
+ *     The directory that should contain the file.
+ *
+ * @param file
+ *     The name of the file.
+ */
+static void test_cgroup_create_file(const char* dir, const char* file) {
+
+    char path[PATH_MAX];
+    test_cgroup_path_of(path, dir, file);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CU_ASSERT_FATAL(fd >= 0);
+    close(fd);
+
+}
+
+/**
+ * Verifies that the given file contains exactly the given value. If the
+ * value is NULL, the file must be empty.
+ *
+ * @param dir
+ *     The directory containing the file.
+ *
+ * @param file
+ *     The name of the file.
+ *
+ * @param expected
+ *     The value that the file should contain, or NULL if the file should be
+ *     empty.
+ */
+static void test_cgroup_assert_file(const char* dir, const char* file,
+        const char* expected) {
+
+    char path[PATH_MAX];
+    test_cgroup_path_of(path, dir, file);
+
+    FILE* stream = fopen(path, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream);
+
+    char value[64] = { 0 };
+    size_t length = fread(value, 1, sizeof(value) - 1, stream);
+    fclose(stream);
+
+    CU_ASSERT_STRING_EQUAL(value, expected != NULL ? expected : "");
+    CU_ASSERT_EQUAL(length, strlen(value));
+
+}
+
+/**
+ * Creates a new temporary parent cgroup, including the interface files of
+ * the parent cgroup itself, and initializes cgroup support using the given
+ * configuration with that cgroup as its cgroup_path.
+ *
+ * @param config
+ *     The configuration to initialize cgroup support with.
+ */
+static void test_cgroup_init(guacd_config* config) {
+
+    strcpy(test_cgroup_path, TEST_CGROUP_TEMPLATE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(test_cgroup_path));
+    test_cgroup_create_file(test_cgroup_path, "cgroup.subtree_control");
+
+    config->cgroup_path = test_cgroup_path;
+    guacd_cgroup_init(config);
+
+}
+
+/**
+ * Creates the cgroup and interface files that the kernel would provide for
+ * the connection process having the given PID.
+ *
+ * @param buffer
+ *     The buffer to store the path of the new cgroup within, which must be
+ *     PATH_MAX bytes.
+ *
+ * @param pid
+ *     The PID of the connection process.
+ */
+static void test_cgroup_create_proc(char* buffer, pid_t pid) {
+
+    char name[32];
+    snprintf(name, sizeof(name), "proc-%i", (int) pid);
+    test_cgroup_path_of(buffer, test_cgroup_path, name);
+    CU_ASSERT_EQUAL_FATAL(mkdir(buffer, 0755), 0);
+
+    for (const char** file = test_cgroup_files; *file != NULL; file++)
+        test_cgroup_create_file(buffer, *file);
+
+}
+
+/**
+ * Removes the temporary parent cgroup created by test_cgroup_init(), along
+ * with the cgroup of the current process, if any.
+ */
+static void test_cgroup_destroy() {
+
+    char cgroup[PATH_MAX];
+    char path[PATH_MAX];
+    char name[32];
+
+    snprintf(name, sizeof(name), "proc-%i", (int) getpid());
+    test_cgroup_path_of(cgroup, test_cgroup_path, name);
+
+    for (const char** file = test_cgroup_files; *file != NULL; file++) {
+        test_cgroup_path_of(path, cgroup, *file);
+        unlink(path);
+    }
+
+    rmdir(cgroup);
+
+    test_cgroup_path_of(path, test_cgroup_path, "cgroup.subtree_control");
+    unlink(path);
+
+    CU_ASSERT_EQUAL(rmdir(test_cgroup_path), 0);
+
+}
+
+/**
+ * Verifies that guacd_cgroup_init() enables the cpu and memory controllers
+ * for the children of the parent cgroup, and that guacd_cgroup_enter()
+ * applies the limits of the given protocol, falling back to the default
+ * limits for any limit not set for that protocol.
+ */
+void test_cgroup__enter_protocol() {
+
+    guacd_config_cgroup defaults = {
+        .cpu_weight = 100,
+        .cpu_max = 1500,
+        .memory_max = 1073741824LL
+    };
+
+    guacd_config_cgroup rdp = {
+        .protocol = "rdp",
+        .cpu_weight = 500,
+        .next = &defaults
+    };
+
+    guacd_config config = { .cgroups = &rdp };
+    test_cgroup_init(&config);
+
+    /* Each controller is enabled with its own write */
+    test_cgroup_assert_file(test_cgroup_path, "cgroup.subtree_control",
+            "+memory");
+
+    char cgroup[PATH_MAX];
+    test_cgroup_create_proc(cgroup, getpid());
+
+    CU_ASSERT_EQUAL(guacd_cgroup_enter("rdp"), 0);
+    test_cgroup_assert_file(cgroup, "cpu.weight", "500");
+    test_cgroup_assert_file(cgroup, "cpu.max", "150000 100000");
+    test_cgroup_assert_file(cgroup, "memory.max", "1073741824");
+    test_cgroup_assert_file(cgroup, "cgroup.procs", "0");
+
+    test_cgroup_destroy();
+
+}
+
+/**
+ * Verifies that guacd_cgroup_enter() applies only the default limits to a
+ * protocol having no limits of its own, and does not write limits which are
+ * unset.
+ */
+void test_cgroup__enter_defaults() {
+
+    guacd_config_cgroup defaults = {
+        .cpu_max = 250
+    };
+
+    guacd_config_cgroup rdp = {
+        .protocol = "rdp",
+        .cpu_weight = 500,
+        .memory_max = 1048576,
+        .next = &defaults
+    };
+
+    guacd_config config = { .cgroups = &rdp };
+    test_cgroup_init(&config);
+
+    char cgroup[PATH_MAX];
+    test_cgroup_create_proc(cgroup, getpid());
+
+    CU_ASSERT_EQUAL(guacd_cgroup_enter("vnc"), 0);
+    test_cgroup_assert_file(cgroup, "cpu.weight", NULL);
+    test_cgroup_assert_file(cgroup, "cpu.max", "25000 100000");
+    test_cgroup_assert_file(cgroup, "memory.max", NULL);
+    test_cgroup_assert_file(cgroup, "cgroup.procs", "0");
+
+    test_cgroup_destroy();
+
+}
+
+/**
+ * Verifies that guacd_cgroup_enter() fails and removes the cgroup it created
+ * if the connection process cannot be moved into that cgroup.
+ */
+void test_cgroup__enter_failure() {
+
+    guacd_config config = { 0 };
+    test_cgroup_init(&config);
+
+    /* No interface files exist within the new cgroup, as if the parent
+     * cgroup were not really a cgroup */
+    CU_ASSERT_NOT_EQUAL(guacd_cgroup_enter("rdp"), 0);
+
+    char name[32];
+    char cgroup[PATH_MAX];
+    snprintf(name, sizeof(name), "proc-%i", (int) getpid());
+    test_cgroup_path_of(cgroup, test_cgroup_path, name);
+
+    struct stat info;
+    CU_ASSERT_NOT_EQUAL(stat(cgroup, &info), 0);
+    CU_ASSERT_EQUAL(errno, ENOENT);
+
+    test_cgroup_destroy();
+
+}
+
+/**
+ * Verifies that guacd_cgroup_remove() removes the cgroup of the connection
+ * process having the given PID.
+ */
+void test_cgroup__remove() {
+
+    guacd_config config = { 0 };
+    test_cgroup_init(&config);
+
+    char cgroup[PATH_MAX];
+    test_cgroup_path_of(cgroup, test_cgroup_path, "proc-4242");
+    CU_ASSERT_EQUAL_FATAL(mkdir(cgroup, 0755), 0);
+
+    guacd_cgroup_remove(4242);
+
+    struct stat info;
+    CU_ASSERT_NOT_EQUAL(stat(cgroup, &info), 0);
+    CU_ASSERT_EQUAL(errno, ENOENT);
+
+    test_cgroup_destroy();
+
+}
+
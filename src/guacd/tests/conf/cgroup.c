@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "conf.h"
+#include "conf-file.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Parses the given contents of a guacd.conf file into the given
+ * configuration, which must already be zeroed.
+ *
+ * @param config
+ *     The configuration to populate.
+ *
+ * @param contents
+ *     The contents of the configuration file.
+ *
+ * @return
+ *     The result of guacd_conf_parse_file(): zero if the configuration was
+ *     parsed successfully, non-zero otherwise.
+ */
+static int test_conf_parse(guacd_config* config, const char* contents) {
+
+    int fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fds), 0);
+
+    ssize_t length = strlen(contents);
+    CU_ASSERT_EQUAL_FATAL(write(fds[1], contents, length), length);
+    close(fds[1]);
+
+    int result = guacd_conf_parse_file(config, fds[0]);
+    close(fds[0]);
+
+    return result;
+
+}
+
+/**
+ * Returns the resource limits that the given configuration defines for the
+ * given protocol.
+ *
+ * @param config
+ *     The configuration to search.
+ *
+ * @param protocol
+ *     The name of the protocol, or NULL for the default limits.
+ *
+ * @return
+ *     The limits defined for the given protocol, or NULL if there are none.
+ */
+static guacd_config_cgroup* test_conf_get_cgroup(guacd_config* config,
+        const char* protocol) {
+
+    guacd_config_cgroup* cgroup;
+    for (cgroup = config->cgroups; cgroup != NULL; cgroup = cgroup->next) {
+
+        if (protocol == NULL ? cgroup->protocol == NULL
+                : cgroup->protocol != NULL
+                    && strcmp(cgroup->protocol, protocol) == 0)
+            return cgroup;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Frees all resource limits and the cgroup path within the given
+ * configuration.
+ *
+ * @param config
+ *     The configuration to free the cgroup section of.
+ */
+static void test_conf_free_cgroups(guacd_config* config) {
+
+    guacd_config_cgroup* cgroup = config->cgroups;
+    while (cgroup != NULL) {
+        guacd_config_cgroup* next = cgroup->next;
+        guac_mem_free(cgroup->protocol);
+        guac_mem_free(cgroup);
+        cgroup = next;
+    }
+
+    guac_mem_free(config->cgroup_path);
+
+}
+
+/**
+ * Verifies that the "cgroup" section accepts the cgroup path along with
+ * default and per-protocol limits, storing fractional CPU maximums as
+ * thousandths of one CPU and memory maximums as bytes.
+ */
+void test_conf_cgroup__limits() {
+
+    guacd_config config = { 0 };
+    CU_ASSERT_EQUAL_FATAL(test_conf_parse(&config,
+                "[cgroup]\n"
+                "path = /sys/fs/cgroup/guacd\n"
+                "cpu_weight = 100\n"
+                "cpu_max = 1.5\n"
+                "memory_max = 512M\n"
+                "rdp_cpu_weight = 500\n"
+                "rdp_cpu_max = 0.25\n"
+                "vnc_memory_max = 2g\n"
+                "kubernetes_memory_max = 1048576\n"), 0);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(config.cgroup_path);
+    CU_ASSERT_STRING_EQUAL(config.cgroup_path, "/sys/fs/cgroup/guacd");
+
+    guacd_config_cgroup* defaults = test_conf_get_cgroup(&config, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(defaults);
+    CU_ASSERT_EQUAL(defaults->cpu_weight, 100);
+    CU_ASSERT_EQUAL(defaults->cpu_max, 1500);
+    CU_ASSERT_EQUAL(defaults->memory_max, 512LL << 20);
+
+    guacd_config_cgroup* rdp = test_conf_get_cgroup(&config, "rdp");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rdp);
+    CU_ASSERT_EQUAL(rdp->cpu_weight, 500);
+    CU_ASSERT_EQUAL(rdp->cpu_max, 250);
+    CU_ASSERT_EQUAL(rdp->memory_max, 0);
+
+    guacd_config_cgroup* vnc = test_conf_get_cgroup(&config, "vnc");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(vnc);
+    CU_ASSERT_EQUAL(vnc->cpu_weight, 0);
+    CU_ASSERT_EQUAL(vnc->cpu_max, 0);
+    CU_ASSERT_EQUAL(vnc->memory_max, 2LL << 30);
+
+    guacd_config_cgroup* kubernetes = test_conf_get_cgroup(&config, "kubernetes");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(kubernetes);
+    CU_ASSERT_EQUAL(kubernetes->memory_max, 1048576);
+
+    test_conf_free_cgroups(&config);
+
+}
+
+/**
+ * Verifies that the smallest allowed CPU maximum is rounded to the nearest
+ * thousandth of one CPU.
+ */
+void test_conf_cgroup__cpu_max_rounding() {
+
+    guacd_config config = { 0 };
+    CU_ASSERT_EQUAL_FATAL(test_conf_parse(&config,
+                "[cgroup]\n"
+                "cpu_max = 0.01\n"
+                "ssh_cpu_max = 0.0125\n"), 0);
+
+    guacd_config_cgroup* defaults = test_conf_get_cgroup(&config, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(defaults);
+    CU_ASSERT_EQUAL(defaults->cpu_max, 10);
+
+    guacd_config_cgroup* ssh = test_conf_get_cgroup(&config, "ssh");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(ssh);
+    CU_ASSERT_EQUAL(ssh->cpu_max, 13);
+
+    test_conf_free_cgroups(&config);
+
+}
+
+/**
+ * Verifies that invalid parameters and values within the "cgroup" section
+ * are rejected.
+ */
+void test_conf_cgroup__invalid() {
+
+    const char* invalid[] = {
+        "[cgroup]\ncpu_weight = 0\n",
+        "[cgroup]\ncpu_weight = 10001\n",
+        "[cgroup]\ncpu_weight = 1.5\n",
+        "[cgroup]\ncpu_max = 0.001\n",
+        "[cgroup]\ncpu_max = 2x\n",
+        "[cgroup]\nmemory_max = 0\n",
+        "[cgroup]\nmemory_max = 512X\n",
+        "[cgroup]\nmemory_max = 512MB\n",
+        "[cgroup]\nmemory_max = 9999999T\n",
+        "[cgroup]\n_cpu_weight = 100\n",
+        "[cgroup]\ncpu_limit = 1\n",
+        NULL
+    };
+
+    for (const char** contents = invalid; *contents != NULL; contents++) {
+        guacd_config config = { 0 };
+        CU_ASSERT_NOT_EQUAL(test_conf_parse(&config, *contents), 0);
+        test_conf_free_cgroups(&config);
+    }
+
+}
+
@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "conf.h"
+#include "conf-file.h"
+
+#include <CUnit/CUnit.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Parses the given contents of a guacd.conf file into the given
+ * configuration, which must already be zeroed.
+ *
+ * @param config
+ *     The configuration to populate.
+ *
+ * @param contents
+ *     The contents of the configuration file.
+ *
+ * @return
+ *     The result of guacd_conf_parse_file(): zero if the configuration was
+ *     parsed successfully, non-zero otherwise.
+ */
+static int test_conf_parse(guacd_config* config, const char* contents) {
+
+    int fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fds), 0);
+
+    ssize_t length = strlen(contents);
+    CU_ASSERT_EQUAL_FATAL(write(fds[1], contents, length), length);
+    close(fds[1]);
+
+    int result = guacd_conf_parse_file(config, fds[0]);
+    close(fds[0]);
+
+    return result;
+
+}
+
+/**
+ * Verifies that the number of display worker threads may be set to any
+ * whole number up to GUACD_MAX_DISPLAY_WORKER_THREADS, including zero.
+ */
+void test_conf_daemon__display_worker_threads() {
+
+    guacd_config config = { 0 };
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = 8\n"), 0);
+    CU_ASSERT_EQUAL(config.display_worker_threads, 8);
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = 256\n"), 0);
+    CU_ASSERT_EQUAL(config.display_worker_threads, GUACD_MAX_DISPLAY_WORKER_THREADS);
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = 0\n"), 0);
+    CU_ASSERT_EQUAL(config.display_worker_threads, 0);
+
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = -1\n"), 0);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = 257\n"), 0);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\ndisplay_worker_threads = 4x\n"), 0);
+
+}
+
+/**
+ * Verifies that shared_display_workers accepts only "true" and "false".
+ */
+void test_conf_daemon__shared_display_workers() {
+
+    guacd_config config = { 0 };
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nshared_display_workers = true\n"), 0);
+    CU_ASSERT_EQUAL(config.shared_display_workers, 1);
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nshared_display_workers = false\n"), 0);
+    CU_ASSERT_EQUAL(config.shared_display_workers, 0);
+
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nshared_display_workers = yes\n"), 0);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nshared_display_workers = 1\n"), 0);
+
+}
+
+
+/**
+ * Verifies that the recording index interval may be set to any whole number
+ * of seconds which can still be represented in milliseconds, including zero.
+ */
+void test_conf_daemon__recording_index_interval() {
+
+    guacd_config config = { 0 };
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nrecording_index_interval = 30\n"), 0);
+    CU_ASSERT_EQUAL(config.recording_index_interval, 30);
+
+    CU_ASSERT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nrecording_index_interval = 0\n"), 0);
+    CU_ASSERT_EQUAL(config.recording_index_interval, 0);
+
+    char contents[64];
+    snprintf(contents, sizeof(contents),
+            "[daemon]\nrecording_index_interval = %i\n", INT_MAX / 1000);
+    CU_ASSERT_EQUAL(test_conf_parse(&config, contents), 0);
+    CU_ASSERT_EQUAL(config.recording_index_interval, INT_MAX / 1000);
+
+    snprintf(contents, sizeof(contents),
+            "[daemon]\nrecording_index_interval = %i\n", INT_MAX / 1000 + 1);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config, contents), 0);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nrecording_index_interval = -1\n"), 0);
+    CU_ASSERT_NOT_EQUAL(test_conf_parse(&config,
+                "[daemon]\nrecording_index_interval = 30s\n"), 0);
+
+}
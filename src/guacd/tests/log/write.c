@@ -0,0 +1,253 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "log.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * The template of the name of the temporary file receiving everything
+ * written to STDERR during a test, as accepted by mkstemp().
+ */
+#define TEST_LOG_TEMPLATE "/tmp/guacd-log-test-XXXXXX"
+
+/**
+ * The number of child processes forked while the parent is logging.
+ */
+#define TEST_LOG_FORKS 200
+
+/**
+ * The number of microseconds to wait for each child process to exit before
+ * considering it hung.
+ */
+#define TEST_LOG_CHILD_TIMEOUT 10000000
+
+/**
+ * The path of the temporary file currently receiving STDERR.
+ */
+static char test_log_path[] = TEST_LOG_TEMPLATE;
+
+/**
+ * The original STDERR, saved while STDERR is redirected to test_log_path.
+ */
+static int test_log_stderr = -1;
+
+/**
+ * Non-zero while the thread started by test_log__fork() should continue
+ * logging, zero otherwise.
+ */
+static atomic_int test_log_running = 0;
+
+/**
+ * Redirects STDERR to a new temporary file, such that all messages logged
+ * by guacd_log() can be read back with test_log_read().
+ */
+static void test_log_capture() {
+
+    strcpy(test_log_path, TEST_LOG_TEMPLATE);
+    int fd = mkstemp(test_log_path);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+
+    test_log_stderr = dup(STDERR_FILENO);
+    CU_ASSERT_NOT_EQUAL_FATAL(test_log_stderr, -1);
+
+    CU_ASSERT_NOT_EQUAL_FATAL(dup2(fd, STDERR_FILENO), -1);
+    close(fd);
+
+}
+
+/**
+ * Reads everything written to STDERR since test_log_capture() was called.
+ * The returned string must eventually be freed with free().
+ *
+ * @return
+ *     A newly-allocated, null-terminated string containing everything
+ *     written to STDERR so far.
+ */
+static char* test_log_read() {
+
+    FILE* file = fopen(test_log_path, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* contents = malloc(length + 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(contents);
+    CU_ASSERT_EQUAL(fread(contents, 1, length, file), (size_t) length);
+    contents[length] = '\0';
+
+    fclose(file);
+    return contents;
+
+}
+
+/**
+ * Restores the STDERR replaced by test_log_capture() and removes the
+ * temporary file that received it.
+ */
+static void test_log_release() {
+    dup2(test_log_stderr, STDERR_FILENO);
+    close(test_log_stderr);
+    unlink(test_log_path);
+}
+
+/**
+ * Logs informational messages continuously until test_log_running is
+ * cleared, pausing briefly between messages so that the log queue does not
+ * overflow.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* test_log_thread(void* data) {
+
+    int count = 0;
+    while (test_log_running) {
+        guacd_log(GUAC_LOG_INFO, "parent message %i", count++);
+        usleep(100);
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Waits for the given child process to exit, killing it if it does not exit
+ * within TEST_LOG_CHILD_TIMEOUT microseconds.
+ *
+ * @param pid
+ *     The ID of the child process to wait for.
+ *
+ * @return
+ *     Non-zero if the child process exited normally within the timeout,
+ *     zero if it had to be killed or did not exit normally.
+ */
+static int test_log_wait(pid_t pid) {
+
+    int status;
+    for (int waited = 0; waited < TEST_LOG_CHILD_TIMEOUT; waited += 1000) {
+
+        if (waitpid(pid, &status, WNOHANG) == pid)
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+        usleep(1000);
+
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return 0;
+
+}
+
+/**
+ * Verifies that errors are written before guacd_log() returns, after any
+ * messages queued before them.
+ */
+void test_log__error_sync() {
+
+    test_log_capture();
+
+    guacd_log(GUAC_LOG_INFO, "queued before error");
+    guacd_log(GUAC_LOG_ERROR, "logged error");
+
+    /* Both messages must be written already, in order */
+    char* contents = test_log_read();
+    char* info = strstr(contents, ":\tqueued before error\n");
+    char* error = strstr(contents, "ERROR:\tlogged error\n");
+
+    CU_ASSERT_PTR_NOT_NULL(info);
+    CU_ASSERT_PTR_NOT_NULL(error);
+    CU_ASSERT(info < error);
+
+    free(contents);
+    test_log_release();
+
+}
+
+/**
+ * Verifies that processes forked while another thread is logging neither
+ * hang when they log nor lose their messages.
+ */
+void test_log__fork() {
+
+    test_log_capture();
+
+    test_log_running = 1;
+    pthread_t thread;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, test_log_thread,
+                NULL), 0);
+
+    /* Each child logs an error and exits without running exit handlers */
+    int exited = 0;
+    for (int i = 0; i < TEST_LOG_FORKS; i++) {
+
+        pid_t pid = fork();
+        CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+
+        if (pid == 0) {
+            guacd_log(GUAC_LOG_ERROR, "child message %i", i);
+            _exit(0);
+        }
+
+        exited += test_log_wait(pid);
+
+    }
+
+    test_log_running = 0;
+    pthread_join(thread, NULL);
+
+    /* Flush everything the parent queued */
+    guacd_log(GUAC_LOG_ERROR, "parent done");
+
+    CU_ASSERT_EQUAL(exited, TEST_LOG_FORKS);
+
+    /* Every child must have written its message */
+    char* contents = test_log_read();
+    int found = 0;
+    for (int i = 0; i < TEST_LOG_FORKS; i++) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "ERROR:\tchild message %i\n", i);
+        if (strstr(contents, expected) != NULL)
+            found++;
+    }
+
+    CU_ASSERT_EQUAL(found, TEST_LOG_FORKS);
+    CU_ASSERT_PTR_NOT_NULL(strstr(contents, "ERROR:\tparent done\n"));
+
+    free(contents);
+    test_log_release();
+
+}
+
@@ -0,0 +1,436 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "batch.h"
+#include "encode.h"
+#include "decoder-pool.h"
+#include "log.h"
+#include "video.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Returns the number of CPUs available to guacenc, or zero if this cannot be
+ * determined.
+ *
+ * @return
+ *     The number of available CPUs, or zero if unknown.
+ */
+static long guacenc_batch_nproc() {
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count > 0)
+        return cpu_count;
+#endif
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the given string ends with the given suffix.
+ *
+ * @param str
+ *     The string to test.
+ *
+ * @param suffix
+ *     The suffix to look for.
+ *
+ * @return
+ *     Non-zero if the string ends with the given suffix, zero otherwise.
+ */
+static int guacenc_batch_has_suffix(const char* str, const char* suffix) {
+
+    size_t length = strlen(str);
+    size_t suffix_length = strlen(suffix);
+
+    return length >= suffix_length
+        && strcmp(str + length - suffix_length, suffix) == 0;
+
+}
+
+/**
+ * Compares two strings, given pointers to each, for sorting with qsort().
+ *
+ * @param a
+ *     A pointer to the first string.
+ *
+ * @param b
+ *     A pointer to the second string.
+ *
+ * @return
+ *     A negative value, zero, or a positive value if the first string sorts
+ *     before, equal to, or after the second string respectively.
+ */
+static int guacenc_batch_compare_paths(const void* a, const void* b) {
+    return strcmp(*((char* const*) a), *((char* const*) b));
+}
+
+/**
+ * Appends the given path to the paths of the given batch, growing the paths
+ * array as necessary. The batch takes ownership of the given path.
+ *
+ * @param batch
+ *     The batch to append the path to.
+ *
+ * @param path
+ *     The path to append, which must have been allocated with guac_mem_alloc()
+ *     or guac_strdup().
+ */
+static void guacenc_batch_append(guacenc_batch* batch, char* path) {
+
+    if (batch->length == batch->size) {
+        batch->size = batch->size ? batch->size * 2 : 16;
+        batch->paths = guac_mem_realloc_or_die(batch->paths,
+                sizeof(char*), batch->size);
+    }
+
+    batch->paths[batch->length++] = path;
+
+}
+
+guacenc_batch* guacenc_batch_alloc() {
+
+    guacenc_batch* batch = guac_mem_zalloc(sizeof(guacenc_batch));
+    pthread_mutex_init(&(batch->lock), NULL);
+    return batch;
+
+}
+
+int guacenc_batch_add(guacenc_batch* batch, const char* path) {
+
+    /* Add anything that is not a directory as-is (failing later if it cannot
+     * be encoded) */
+    struct stat file_stat;
+    if (stat(path, &file_stat) || !S_ISDIR(file_stat.st_mode)) {
+        guacenc_batch_append(batch, guac_strdup(path));
+        return 0;
+    }
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path, strerror(errno));
+        return 1;
+    }
+
+    /* Add all recordings within directory, in order of name */
+    int first = batch->length;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+
+        /* Skip hidden files and the output of previous encodes */
+        const char* name = entry->d_name;
+        if (name[0] == '.'
+                || guacenc_batch_has_suffix(name, ".m4v")
+                || guacenc_batch_has_suffix(name, ".mp4")
+                || guacenc_batch_has_suffix(name, ".png")
+                || guacenc_batch_has_suffix(name, ".webp")
+                || guacenc_batch_has_suffix(name, GUAC_RECORDING_INDEX_SUFFIX))
+            continue;
+
+        size_t length = guac_mem_ckd_add_or_die(strlen(path),
+                strlen(name), 2);
+
+        char* entry_path = guac_mem_alloc(length);
+        snprintf(entry_path, length, "%s/%s", path, name);
+
+        /* Skip anything other than regular files, such as subdirectories */
+        if (stat(entry_path, &file_stat) || !S_ISREG(file_stat.st_mode)) {
+            guac_mem_free(entry_path);
+            continue;
+        }
+
+        guacenc_batch_append(batch, entry_path);
+
+    }
+
+    closedir(dir);
+
+    qsort(batch->paths + first, batch->length - first, sizeof(char*),
+            guacenc_batch_compare_paths);
+
+    return 0;
+
+}
+
+int guacenc_batch_add_list(guacenc_batch* batch, const char* list_path) {
+
+    FILE* list = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (list == NULL) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s", list_path, strerror(errno));
+        return 1;
+    }
+
+    int result = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &line_size, list)) != -1) {
+
+        /* Strip trailing line ending */
+        while (length > 0 && (line[length - 1] == '\n'
+                    || line[length - 1] == '\r'))
+            line[--length] = '\0';
+
+        if (length > 0 && guacenc_batch_add(batch, line))
+            result = 1;
+
+    }
+
+    free(line);
+
+    if (list != stdin)
+        fclose(list);
+
+    return result;
+
+}
+
+/**
+ * Encodes the recording at the given index within the given batch, updating
+ * the counts of skipped, encoded, and failed recordings accordingly.
+ *
+ * @param batch
+ *     The batch containing the recording.
+ *
+ * @param index
+ *     The index of the recording within the paths of the batch.
+ */
+static void guacenc_batch_encode(guacenc_batch* batch, int index) {
+
+    /* Get current filename */
+    const char* path = batch->paths[index];
+    const guacenc_thumbnail_options* thumbnails = batch->thumbnails;
+
+    /* Generate output filename (hardware encoders produce H.264, which
+     * requires a full MP4 container rather than a raw MPEG-4 stream, and
+     * MP4 can equally contain the software fallback, while following a
+     * recording requires fragmented MP4) */
+    char out_path[4096];
+    int len;
+
+    /* When rendering thumbnails, the existence of the contact sheet or the
+     * first thumbnail indicates the recording has already been handled */
+    if (thumbnails != NULL && thumbnails->columns > 0)
+        len = snprintf(out_path, sizeof(out_path),
+                "%s" GUACENC_THUMBNAIL_SHEET_SUFFIX "%s", path,
+                guacenc_thumbnail_extension(thumbnails->format));
+
+    else if (thumbnails != NULL)
+        len = snprintf(out_path, sizeof(out_path), "%s.%i%s", path,
+                thumbnails->interval > 0 ? batch->start : thumbnails->times[0],
+                guacenc_thumbnail_extension(thumbnails->format));
+
+    else
+        len = snprintf(out_path, sizeof(out_path),
+                batch->hwaccel != NULL || batch->follow ? "%s.mp4" : "%s.m4v",
+                path);
+
+    /* Do not write if filename exceeds maximum length */
+    if (len >= sizeof(out_path)) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
+                "Name too long", path);
+        return;
+    }
+
+    /* Skip recordings that have already been encoded */
+    if (batch->batch_mode && access(out_path, F_OK) == 0) {
+        guacenc_log(GUAC_LOG_INFO, "Skipping \"%s\" (\"%s\" already "
+                "exists).", path, out_path);
+        pthread_mutex_lock(&(batch->lock));
+        batch->skipped++;
+        pthread_mutex_unlock(&(batch->lock));
+        return;
+    }
+
+    struct stat file_stat;
+    int64_t size = stat(path, &file_stat) ? 0 : file_stat.st_size;
+
+    /* Attempt encoding, log granular success/failure at debug level */
+    int failed = thumbnails != NULL
+        ? guacenc_thumbnail(path, thumbnails, batch->start, batch->end,
+                batch->force)
+        : guacenc_encode(path, out_path, batch->codec, batch->hwaccel,
+                batch->width, batch->height, batch->bitrate, batch->start,
+                batch->end, batch->force, batch->follow, batch->segments);
+
+    if (failed)
+        guacenc_log(GUAC_LOG_DEBUG, "%s was NOT successfully encoded.", path);
+    else
+        guacenc_log(GUAC_LOG_DEBUG, "%s was successfully encoded.", path);
+
+    pthread_mutex_lock(&(batch->lock));
+
+    if (failed)
+        batch->failures++;
+    else {
+        batch->encoded++;
+        batch->encoded_bytes += size;
+    }
+
+    pthread_mutex_unlock(&(batch->lock));
+
+}
+
+/**
+ * Encodes each recording of the given batch not yet started by another job,
+ * until all recordings have been started.
+ *
+ * @param data
+ *     A pointer to the guacenc_batch being encoded.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_batch_job_thread(void* data) {
+
+    guacenc_batch* batch = (guacenc_batch*) data;
+
+    for (;;) {
+
+        /* Claim next recording, if any */
+        pthread_mutex_lock(&(batch->lock));
+        int index = batch->next;
+        if (index < batch->length)
+            batch->next++;
+        pthread_mutex_unlock(&(batch->lock));
+
+        if (index >= batch->length)
+            break;
+
+        guacenc_batch_encode(batch, index);
+
+    }
+
+    return NULL;
+
+}
+
+int guacenc_batch_run(guacenc_batch* batch) {
+
+    guac_timestamp started = guac_timestamp_current();
+    long cpu_count = guacenc_batch_nproc();
+
+    /* Derive number of jobs from available CPUs if not given */
+    int jobs = batch->jobs;
+    if (jobs <= 0)
+        jobs = cpu_count / GUACENC_BATCH_CPUS_PER_JOB;
+
+    if (jobs > GUACENC_BATCH_MAX_JOBS)
+        jobs = GUACENC_BATCH_MAX_JOBS;
+
+    if (jobs > batch->length)
+        jobs = batch->length;
+
+    if (jobs < 1)
+        jobs = 1;
+
+    /* Share available CPUs between concurrent jobs (and between the time
+     * ranges encoded concurrently within each job), rather than each job
+     * starting as many threads as there are CPUs */
+    int concurrent = jobs * (batch->segments > 1 && !batch->follow
+            && batch->thumbnails == NULL ? batch->segments : 1);
+
+    if (concurrent > 1 && cpu_count > 0) {
+
+        int threads = cpu_count / concurrent;
+        if (threads < 1)
+            threads = 1;
+
+        guacenc_video_set_default_encoder_threads(threads);
+        guacenc_decoder_pool_set_default_threads(threads);
+
+        if (concurrent > jobs)
+            guacenc_log(GUAC_LOG_INFO, "Encoding up to %i recording(s) at "
+                    "once, each as up to %i concurrent time ranges using up "
+                    "to %i thread(s) per stage.", jobs, concurrent / jobs,
+                    threads);
+        else
+            guacenc_log(GUAC_LOG_INFO, "Encoding up to %i recordings at once, "
+                    "each using up to %i thread(s) per stage.", jobs, threads);
+
+    }
+
+    /* Start additional jobs, encoding within the current thread as well */
+    pthread_t threads[GUACENC_BATCH_MAX_JOBS];
+    int started_jobs = 0;
+    for (int i = 1; i < jobs; i++) {
+
+        if (pthread_create(&threads[started_jobs], NULL,
+                    guacenc_batch_job_thread, batch)) {
+            guacenc_log(GUAC_LOG_WARNING, "Unable to start all encoding "
+                    "jobs. Fewer recordings will be encoded at once.");
+            break;
+        }
+
+        started_jobs++;
+
+    }
+
+    guacenc_batch_job_thread(batch);
+
+    for (int i = 0; i < started_jobs; i++)
+        pthread_join(threads[i], NULL);
+
+    /* Report overall throughput of batch */
+    if (batch->batch_mode) {
+
+        guac_timestamp elapsed = guac_timestamp_current() - started;
+        double seconds = elapsed / 1000.0;
+        double mebibytes = batch->encoded_bytes / 1048576.0;
+
+        guacenc_log(GUAC_LOG_INFO, "Encoded %i recording(s) (%.1f MiB) in "
+                "%.1f seconds (%.2f MiB/sec, %.1f recordings/min). Skipped "
+                "%i recording(s) having existing output.", batch->encoded,
+                mebibytes, seconds, elapsed > 0 ? mebibytes / seconds : 0.0,
+                elapsed > 0 ? batch->encoded * 60.0 / seconds : 0.0,
+                batch->skipped);
+
+    }
+
+    return batch->failures;
+
+}
+
+void guacenc_batch_free(guacenc_batch* batch) {
+
+    for (int i = 0; i < batch->length; i++)
+        guac_mem_free(batch->paths[i]);
+
+    guac_mem_free(batch->paths);
+    pthread_mutex_destroy(&(batch->lock));
+    guac_mem_free(batch);
+
+}
@@ -0,0 +1,240 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_BATCH_H
+#define GUACENC_BATCH_H
+
+#include "config.h"
+#include "thumbnail.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The number of CPUs assumed to be kept busy by each recording being
+ * encoded, used to determine how many recordings may be encoded at once if
+ * the number of concurrent jobs is not given explicitly.
+ */
+#define GUACENC_BATCH_CPUS_PER_JOB 4
+
+/**
+ * The maximum number of recordings that may be encoded at once.
+ */
+#define GUACENC_BATCH_MAX_JOBS 64
+
+/**
+ * A set of recordings to be encoded, along with the options applying to all
+ * of those recordings. Recordings are encoded one at a time, in order, or by a
+ * bounded number of concurrent jobs, each encoding the next recording not yet
+ * started.
+ */
+typedef struct guacenc_batch {
+
+    /**
+     * The name of the codec to use for all videos, as defined by ffmpeg /
+     * libavcodec.
+     */
+    const char* codec;
+
+    /**
+     * The name of the type of hardware device to use to encode all videos, or
+     * NULL if videos should be encoded in software.
+     */
+    const char* hwaccel;
+
+    /**
+     * The width of all videos, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of all videos, in pixels.
+     */
+    int height;
+
+    /**
+     * The desired bitrate of all videos, in bits per second.
+     */
+    int bitrate;
+
+    /**
+     * The number of seconds into each recording at which encoding should
+     * begin.
+     */
+    int start;
+
+    /**
+     * The number of seconds into each recording at which encoding should end,
+     * or zero to encode the entire remainder of each recording.
+     */
+    int end;
+
+    /**
+     * Whether recordings should be encoded even if they appear to be in
+     * progress.
+     */
+    bool force;
+
+    /**
+     * Whether in-progress recordings should be followed until complete.
+     */
+    bool follow;
+
+    /**
+     * The maximum number of time ranges of each recording to encode
+     * concurrently, or 1 if each recording should be encoded sequentially.
+     */
+    int segments;
+
+    /**
+     * The thumbnails to render from each recording instead of encoding video,
+     * or NULL if each recording should be encoded as video.
+     */
+    const guacenc_thumbnail_options* thumbnails;
+
+    /**
+     * The number of recordings to encode at once, or zero if this should be
+     * derived from the number of available CPUs. If greater than one, the
+     * threads used within each encode are reduced accordingly.
+     */
+    int jobs;
+
+    /**
+     * Whether recordings whose output already exists should be skipped, and
+     * aggregate throughput logged once all recordings have been encoded.
+     */
+    bool batch_mode;
+
+    /**
+     * The paths of all recordings to be encoded, in order.
+     */
+    char** paths;
+
+    /**
+     * The number of paths within the paths array.
+     */
+    int length;
+
+    /**
+     * The number of paths that the paths array can currently hold.
+     */
+    int size;
+
+    /**
+     * Lock which must be acquired before accessing next or any of the counts
+     * of skipped, encoded, or failed recordings.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The index of the next recording which has not yet begun encoding.
+     */
+    int next;
+
+    /**
+     * The number of recordings which were skipped because their output
+     * already exists.
+     */
+    int skipped;
+
+    /**
+     * The number of recordings successfully encoded.
+     */
+    int encoded;
+
+    /**
+     * The total size of all recordings successfully encoded, in bytes.
+     */
+    int64_t encoded_bytes;
+
+    /**
+     * The number of recordings which could not be encoded.
+     */
+    int failures;
+
+} guacenc_batch;
+
+/**
+ * Allocates a new, empty guacenc_batch. All options are zero, and must be
+ * assigned before guacenc_batch_run() is invoked.
+ *
+ * @return
+ *     A newly-allocated guacenc_batch, which must be freed with
+ *     guacenc_batch_free().
+ */
+guacenc_batch* guacenc_batch_alloc();
+
+/**
+ * Adds the given recording to the given batch. If the path refers to a
+ * directory, every recording within that directory (every regular file that
+ * is not itself an encoded video, thumbnail, or keyframe index) is added, in order of
+ * name.
+ *
+ * @param batch
+ *     The batch to add recordings to.
+ *
+ * @param path
+ *     The path to the recording, or to a directory containing recordings.
+ *
+ * @return
+ *     Zero if all recordings were added, non-zero if the given path is a
+ *     directory that cannot be read.
+ */
+int guacenc_batch_add(guacenc_batch* batch, const char* path);
+
+/**
+ * Adds each recording listed within the given file to the given batch, as if
+ * guacenc_batch_add() were invoked for each line of that file. Empty lines are
+ * ignored.
+ *
+ * @param batch
+ *     The batch to add recordings to.
+ *
+ * @param list_path
+ *     The path to the file listing recordings, one per line, or "-" to read
+ *     the list from standard input.
+ *
+ * @return
+ *     Zero if all listed recordings were added, non-zero if the list cannot
+ *     be read or lists a directory that cannot be read.
+ */
+int guacenc_batch_add_list(guacenc_batch* batch, const char* list_path);
+
+/**
+ * Encodes all recordings within the given batch, returning only after all
+ * recordings have been encoded (or have failed to be encoded).
+ *
+ * @param batch
+ *     The batch of recordings to encode.
+ *
+ * @return
+ *     The number of recordings that could not be encoded.
+ */
+int guacenc_batch_run(guacenc_batch* batch);
+
+/**
+ * Frees the given guacenc_batch and all recording paths within it.
+ *
+ * @param batch
+ *     The batch to free.
+ */
+void guacenc_batch_free(guacenc_batch* batch);
+
+#endif
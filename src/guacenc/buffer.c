@@ -22,6 +22,7 @@
 
 #include <cairo/cairo.h>
 #include <guacamole/mem.h>
+#include <guacamole/rect.h>
 
 #include <assert.h>
 #include <stdlib.h>
@@ -76,6 +77,12 @@ int guacenc_buffer_resize(guacenc_buffer* buffer, int width, int height) {
     if (buffer->width == width && buffer->height == height)
         return 0;
 
+    /* Everything within both the old and new sizes may have changed */
+    guacenc_buffer_mark_dirty(buffer, CAIRO_OPERATOR_SOURCE, 0, 0,
+            buffer->width, buffer->height);
+    guacenc_buffer_mark_dirty(buffer, CAIRO_OPERATOR_SOURCE, 0, 0,
+            width, height);
+
     /* Simply deallocate if new image has absolutely no pixels */
     if (width == 0 || height == 0) {
         guacenc_buffer_free_image(buffer);
@@ -170,3 +177,32 @@ int guacenc_buffer_copy(guacenc_buffer* dst, guacenc_buffer* src) {
 
 }
 
+
+void guacenc_buffer_mark_dirty(guacenc_buffer* buffer, cairo_operator_t op,
+        int x, int y, int width, int height) {
+
+    guac_rect rect;
+
+    switch (op) {
+
+        /* Unbounded operators affect everything outside the drawn area */
+        case CAIRO_OPERATOR_IN:
+        case CAIRO_OPERATOR_OUT:
+        case CAIRO_OPERATOR_DEST_IN:
+        case CAIRO_OPERATOR_DEST_ATOP:
+            guac_rect_init(&rect, 0, 0, buffer->width, buffer->height);
+            break;
+
+        default:
+            guac_rect_init(&rect, x, y, width, height);
+            break;
+
+    }
+
+    /* Ignore draws which cannot have affected the buffer */
+    if (guac_rect_is_empty(&rect))
+        return;
+
+    guac_rect_extend(&buffer->dirty, &rect);
+
+}
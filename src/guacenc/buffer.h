@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <cairo/cairo.h>
+#include <guacamole/rect.h>
 
 #include <stdbool.h>
 
@@ -71,6 +72,14 @@ typedef struct guacenc_buffer {
      */
     cairo_t* cairo;
 
+    /**
+     * The bounding rectangle of all parts of this buffer that have been drawn
+     * to since the dirty rectangle was last reset, or an empty rectangle if
+     * nothing has been drawn. This is used to determine which parts of the
+     * display must be composited again when rendering the next frame.
+     */
+    guac_rect dirty;
+
 } guacenc_buffer;
 
 /**
@@ -150,5 +159,32 @@ int guacenc_buffer_fit(guacenc_buffer* buffer, int x, int y);
  */
 int guacenc_buffer_copy(guacenc_buffer* dst, guacenc_buffer* src);
 
+/**
+ * Records that the given rectangle of the given buffer has been drawn to
+ * using the given Cairo operator, extending the dirty rectangle of the buffer
+ * accordingly. If the operator is unbounded (may modify the buffer outside
+ * the area being drawn), the entire buffer is considered dirty.
+ *
+ * @param buffer
+ *     The buffer that was drawn to.
+ *
+ * @param op
+ *     The Cairo operator used for the draw operation.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the area drawn.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the area drawn.
+ *
+ * @param width
+ *     The width of the area drawn, in pixels.
+ *
+ * @param height
+ *     The height of the area drawn, in pixels.
+ */
+void guacenc_buffer_mark_dirty(guacenc_buffer* buffer, cairo_operator_t op,
+        int x, int y, int width, int height);
+
 #endif
 
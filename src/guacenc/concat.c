@@ -0,0 +1,307 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "concat.h"
+#include "log.h"
+#include "video.h"
+
+#include <guacamole/client.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+
+/**
+ * Opens the file at the given path for reading, locating the video stream
+ * within that file.
+ *
+ * @param path
+ *     The path of the file to open.
+ *
+ * @param stream_index
+ *     A pointer to the int in which the index of the video stream within the
+ *     file should be stored.
+ *
+ * @return
+ *     The AVFormatContext of the opened file, which must be closed with
+ *     avformat_close_input(), or NULL if the file cannot be opened or does
+ *     not contain a video stream.
+ */
+static AVFormatContext* guacenc_concat_open(const char* path,
+        int* stream_index) {
+
+    AVFormatContext* input = NULL;
+    if (avformat_open_input(&input, path, NULL, NULL) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: Cannot open video for "
+                "concatenation.", path);
+        return NULL;
+    }
+
+    if (avformat_find_stream_info(input, NULL) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: Cannot read video stream "
+                "information.", path);
+        avformat_close_input(&input);
+        return NULL;
+    }
+
+    int index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1,
+            NULL, 0);
+    if (index < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: No video stream found.", path);
+        avformat_close_input(&input);
+        return NULL;
+    }
+
+    *stream_index = index;
+    return input;
+
+}
+
+/**
+ * Copies every packet of the given video stream of the given input file to
+ * the given output stream, offsetting the timestamps of each packet such that
+ * the input begins no earlier than the given offset and decoding timestamps
+ * continue to increase beyond those of packets already written.
+ *
+ * @param input
+ *     The input file to copy packets from.
+ *
+ * @param stream_index
+ *     The index of the video stream within the input file.
+ *
+ * @param output
+ *     The output file to copy packets to, which must already have had its
+ *     header written.
+ *
+ * @param out_stream
+ *     The stream within the output file that should receive the packets.
+ *
+ * @param end
+ *     A pointer to the presentation timestamp, in the time base of the output
+ *     stream, at which the input should begin. This is updated to the
+ *     presentation timestamp at which the next input should begin.
+ *
+ * @param last_dts
+ *     A pointer to the decoding timestamp of the last packet written to the
+ *     output stream, in the time base of the output stream, or AV_NOPTS_VALUE
+ *     if no packet has yet been written. This is updated as packets are
+ *     written.
+ *
+ * @return
+ *     Zero if all packets were copied successfully, non-zero otherwise.
+ */
+static int guacenc_concat_copy(AVFormatContext* input, int stream_index,
+        AVFormatContext* output, AVStream* out_stream, int64_t* end,
+        int64_t* last_dts) {
+
+    AVStream* in_stream = input->streams[stream_index];
+
+    /* Duration of each frame, for packets lacking a duration of their own */
+    int64_t frame_duration = av_rescale_q(1,
+            (AVRational) { 1, GUACENC_VIDEO_FRAMERATE },
+            out_stream->time_base);
+
+    AVPacket* packet = av_packet_alloc();
+    if (packet == NULL)
+        return 1;
+
+    int64_t offset = *end;
+    int first = 1;
+    int failed = 0;
+
+    while (av_read_frame(input, packet) >= 0) {
+
+        /* Ignore anything other than the video stream */
+        if (packet->stream_index != stream_index) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        av_packet_rescale_ts(packet, in_stream->time_base,
+                out_stream->time_base);
+
+        /* Shift this input later if its first packet would otherwise not be
+         * decoded after the final packet of the previous input (as can occur
+         * for codecs that reorder frames) */
+        if (first && *last_dts != AV_NOPTS_VALUE
+                && packet->dts != AV_NOPTS_VALUE
+                && packet->dts + offset <= *last_dts)
+            offset = *last_dts + 1 - packet->dts;
+
+        first = 0;
+
+        if (packet->pts != AV_NOPTS_VALUE)
+            packet->pts += offset;
+
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts += offset;
+            *last_dts = packet->dts;
+        }
+
+        /* The next input begins after the latest frame of this input */
+        if (packet->pts != AV_NOPTS_VALUE) {
+            int64_t packet_end = packet->pts + (packet->duration > 0
+                    ? packet->duration : frame_duration);
+            if (packet_end > *end)
+                *end = packet_end;
+        }
+
+        packet->stream_index = out_stream->index;
+        packet->pos = -1;
+
+        /* NOTE: The packet is unreferenced by av_interleaved_write_frame() */
+        if (av_interleaved_write_frame(output, packet) < 0) {
+            failed = 1;
+            break;
+        }
+
+    }
+
+    av_packet_free(&packet);
+    return failed;
+
+}
+
+int guacenc_concat(const char* out_path, char* const* paths, int count) {
+
+    int stream_index;
+    int header_written = 0;
+    int failed = 1;
+
+    AVFormatContext* input = guacenc_concat_open(paths[0], &stream_index);
+    if (input == NULL)
+        return 1;
+
+    /* Allocate output, determining container from the output filename */
+    AVFormatContext* output = NULL;
+    avformat_alloc_output_context2(&output, NULL, NULL, out_path);
+    if (output == NULL) {
+        guacenc_log(GUAC_LOG_ERROR, "Failed to determine container from "
+                "output file name");
+        avformat_close_input(&input);
+        return 1;
+    }
+
+    /* The output stream is identical to the video stream of each input */
+    AVStream* out_stream = avformat_new_stream(output, NULL);
+    if (out_stream == NULL || avcodec_parameters_copy(out_stream->codecpar,
+                input->streams[stream_index]->codecpar) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Could not allocate output stream.");
+        goto fail_output_stream;
+    }
+
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = input->streams[stream_index]->time_base;
+
+    /* Open output file, if the container needs it */
+    if (!(output->oformat->flags & AVFMT_NOFILE)
+            && avio_open(&output->pb, out_path, AVIO_FLAG_WRITE) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Error occurred while opening output "
+                "file.");
+        goto fail_output_stream;
+    }
+
+    if (avformat_write_header(output, NULL) < 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Error occurred while writing output "
+                "file header.");
+        goto fail_output_file;
+    }
+
+    header_written = 1;
+
+    int64_t end = 0;
+    int64_t last_dts = AV_NOPTS_VALUE;
+
+    /* Copy each input in order */
+    for (int i = 0; i < count; i++) {
+
+        if (i > 0) {
+
+            input = guacenc_concat_open(paths[i], &stream_index);
+            if (input == NULL)
+                goto fail_output_file;
+
+            /* Encoded frames can be copied only between identical streams */
+            AVCodecParameters* params = input->streams[stream_index]->codecpar;
+            if (params->codec_id != out_stream->codecpar->codec_id
+                    || params->width != out_stream->codecpar->width
+                    || params->height != out_stream->codecpar->height) {
+                guacenc_log(GUAC_LOG_ERROR, "%s: Video stream cannot be "
+                        "concatenated with that of \"%s\".", paths[i],
+                        paths[0]);
+                goto fail_output_file;
+            }
+
+        }
+
+        int copy_failed = guacenc_concat_copy(input, stream_index, output,
+                out_stream, &end, &last_dts);
+
+        avformat_close_input(&input);
+
+        if (copy_failed) {
+            guacenc_log(GUAC_LOG_ERROR, "%s: Error occurred while copying "
+                    "video.", paths[i]);
+            goto fail_output_file;
+        }
+
+    }
+
+    failed = 0;
+
+fail_output_file:
+
+    if (header_written && av_write_trailer(output) < 0)
+        failed = 1;
+
+    if (!(output->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&output->pb);
+
+    /* Delete the output file if it could not be completely written */
+    if (failed && unlink(out_path) == -1 && errno != ENOENT)
+        guacenc_log(GUAC_LOG_WARNING, "Failed output file \"%s\" could not "
+                "be automatically deleted: %s", out_path, strerror(errno));
+
+fail_output_stream:
+    avformat_free_context(output);
+
+    if (input != NULL)
+        avformat_close_input(&input);
+
+    return failed;
+
+}
+
+#else
+
+int guacenc_concat(const char* out_path, char* const* paths, int count) {
+    guacenc_log(GUAC_LOG_ERROR, "Concatenation of separately-encoded video "
+            "is not supported by this build of libavformat.");
+    return 1;
+}
+
+#endif
+
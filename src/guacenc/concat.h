@@ -0,0 +1,52 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_CONCAT_H
+#define GUACENC_CONCAT_H
+
+#include "config.h"
+
+/**
+ * Concatenates the video within each of the given files, in order, into a
+ * single video written to the file at the given path. No decoding or
+ * re-encoding takes place; the encoded frames of each file are copied
+ * verbatim, with their timestamps offset such that each file begins where
+ * the previous file ends. All files must contain a single video stream that
+ * was encoded with identical codec parameters, such as the separately-encoded
+ * time ranges of a single recording.
+ *
+ * @param out_path
+ *     The full path to the file in which the concatenated video should be
+ *     written. The container format is determined by the filename extension.
+ *
+ * @param paths
+ *     The paths of the files to concatenate, in order.
+ *
+ * @param count
+ *     The number of entries within the paths array.
+ *
+ * @return
+ *     Zero on success, non-zero if the files could not be read, do not
+ *     contain compatible video streams, or the concatenated video could not
+ *     be written.
+ */
+int guacenc_concat(const char* out_path, char* const* paths, int count);
+
+#endif
+
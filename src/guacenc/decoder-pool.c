@@ -0,0 +1,260 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "decoder-pool.h"
+#include "image-stream.h"
+#include "log.h"
+
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * The number of decoding threads that each newly-allocated
+ * guacenc_decoder_pool should use, as set by
+ * guacenc_decoder_pool_set_default_threads(), or zero if one thread should be
+ * used for each available CPU.
+ */
+static int guacenc_decoder_pool_default_threads = 0;
+
+/**
+ * Returns the number of CPUs available to guacenc, or zero if this cannot be
+ * determined.
+ *
+ * @return
+ *     The number of available CPUs, or zero if unknown.
+ */
+static long guacenc_decoder_pool_nproc() {
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count > 0)
+        return cpu_count;
+#endif
+
+    return 0;
+
+}
+
+/**
+ * Decodes the images of each image stream added to the given pool, claiming
+ * the oldest image stream not yet claimed by another thread, until the pool
+ * is freed.
+ *
+ * @param data
+ *     A pointer to the guacenc_decoder_pool that the image streams are being
+ *     added to.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_decoder_pool_thread(void* data) {
+
+    guacenc_decoder_pool* pool = (guacenc_decoder_pool*) data;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    while (!pool->stopping) {
+
+        /* Find the oldest entry that has not yet been claimed */
+        guacenc_decoder_pool_entry* entry = NULL;
+        for (int i = 0; i < pool->length; i++) {
+            guacenc_decoder_pool_entry* current = &(pool->entries[
+                    (pool->start + i) % GUACENC_DECODER_POOL_MAX_PENDING]);
+            if (!current->claimed) {
+                entry = current;
+                break;
+            }
+        }
+
+        /* Wait for further image streams if all have been claimed */
+        if (entry == NULL) {
+            pthread_cond_wait(&(pool->modified), &(pool->lock));
+            continue;
+        }
+
+        entry->claimed = 1;
+
+        /* Decode without blocking other users of the pool (the entry cannot
+         * be removed until it is complete) */
+        guacenc_image_stream* stream = entry->stream;
+        pthread_mutex_unlock(&(pool->lock));
+        guacenc_image_stream_decode(stream);
+        pthread_mutex_lock(&(pool->lock));
+
+        entry->complete = 1;
+        pthread_cond_broadcast(&(pool->modified));
+
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
+
+}
+
+void guacenc_decoder_pool_set_default_threads(int count) {
+    guacenc_decoder_pool_default_threads = count > 0 ? count : 0;
+}
+
+guacenc_decoder_pool* guacenc_decoder_pool_alloc() {
+
+    /* Decode in parallel only if there are multiple CPUs to do so (or
+     * multiple threads have been explicitly requested) */
+    long thread_count = guacenc_decoder_pool_default_threads;
+    if (thread_count == 0)
+        thread_count = guacenc_decoder_pool_nproc();
+
+    if (thread_count <= 1)
+        return NULL;
+
+    if (thread_count > GUACENC_DECODER_POOL_MAX_THREADS)
+        thread_count = GUACENC_DECODER_POOL_MAX_THREADS;
+
+    guacenc_decoder_pool* pool = guac_mem_zalloc(sizeof(guacenc_decoder_pool));
+
+    pthread_mutex_init(&(pool->lock), NULL);
+    pthread_cond_init(&(pool->modified), NULL);
+
+    /* Start as many decoding threads as possible */
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&(pool->threads[i]), NULL,
+                    guacenc_decoder_pool_thread, pool))
+            break;
+        pool->thread_count++;
+    }
+
+    /* Decode images immediately if no threads could be started */
+    if (pool->thread_count == 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Unable to start image decoding "
+                "threads. Images will not be decoded in parallel.");
+        guacenc_decoder_pool_free(pool);
+        return NULL;
+    }
+
+    guacenc_log(GUAC_LOG_DEBUG, "Decoding images using %i threads.",
+            pool->thread_count);
+
+    return pool;
+
+}
+
+int guacenc_decoder_pool_length(guacenc_decoder_pool* pool) {
+
+    pthread_mutex_lock(&(pool->lock));
+    int length = pool->length;
+    pthread_mutex_unlock(&(pool->lock));
+
+    return length;
+
+}
+
+int guacenc_decoder_pool_pending(guacenc_decoder_pool* pool, int index) {
+
+    int pending = 0;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    /* Find the newest entry destined for the given layer or buffer */
+    for (int i = pool->length - 1; i >= 0; i--) {
+        guacenc_decoder_pool_entry* entry = &(pool->entries[
+                (pool->start + i) % GUACENC_DECODER_POOL_MAX_PENDING]);
+        if (entry->stream->index == index) {
+            pending = i + 1;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    return pending;
+
+}
+
+void guacenc_decoder_pool_add(guacenc_decoder_pool* pool,
+        guacenc_image_stream* stream) {
+
+    pthread_mutex_lock(&(pool->lock));
+
+    guacenc_decoder_pool_entry* entry = &(pool->entries[
+            (pool->start + pool->length) % GUACENC_DECODER_POOL_MAX_PENDING]);
+
+    entry->stream = stream;
+    entry->claimed = 0;
+    entry->complete = 0;
+    pool->length++;
+
+    /* Wake a thread to decode the new image */
+    pthread_cond_broadcast(&(pool->modified));
+    pthread_mutex_unlock(&(pool->lock));
+
+}
+
+guacenc_image_stream* guacenc_decoder_pool_take(guacenc_decoder_pool* pool) {
+
+    pthread_mutex_lock(&(pool->lock));
+
+    /* Nothing to take if the pool is empty */
+    if (pool->length == 0) {
+        pthread_mutex_unlock(&(pool->lock));
+        return NULL;
+    }
+
+    /* Wait for the oldest image to finish decoding */
+    guacenc_decoder_pool_entry* entry = &(pool->entries[pool->start]);
+    while (!entry->complete)
+        pthread_cond_wait(&(pool->modified), &(pool->lock));
+
+    guacenc_image_stream* stream = entry->stream;
+    pool->start = (pool->start + 1) % GUACENC_DECODER_POOL_MAX_PENDING;
+    pool->length--;
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    return stream;
+
+}
+
+void guacenc_decoder_pool_free(guacenc_decoder_pool* pool) {
+
+    /* Nothing to free if there is no pool */
+    if (pool == NULL)
+        return;
+
+    /* Stop all decoding threads, allowing any in-progress decoding to finish */
+    pthread_mutex_lock(&(pool->lock));
+    pool->stopping = 1;
+    pthread_cond_broadcast(&(pool->modified));
+    pthread_mutex_unlock(&(pool->lock));
+
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    /* Free all image streams that were never drawn */
+    for (int i = 0; i < pool->length; i++)
+        guacenc_image_stream_free(pool->entries[
+                (pool->start + i) % GUACENC_DECODER_POOL_MAX_PENDING].stream);
+
+    pthread_mutex_destroy(&(pool->lock));
+    pthread_cond_destroy(&(pool->modified));
+    guac_mem_free(pool);
+
+}
@@ -0,0 +1,227 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_DECODER_POOL_H
+#define GUACENC_DECODER_POOL_H
+
+#include "config.h"
+#include "image-stream.h"
+
+#include <pthread.h>
+
+/**
+ * The maximum number of threads that any guacenc_decoder_pool will use to
+ * decode images, regardless of the number of available CPUs.
+ */
+#define GUACENC_DECODER_POOL_MAX_THREADS 16
+
+/**
+ * The maximum number of ended image streams that may be held by any
+ * guacenc_decoder_pool, whether being decoded or waiting to be drawn. This
+ * limits how far decoding may run ahead of drawing, and thus how many decoded
+ * images are held in memory at once.
+ */
+#define GUACENC_DECODER_POOL_MAX_PENDING 64
+
+/**
+ * An image stream which has ended and has been handed to a
+ * guacenc_decoder_pool for decoding.
+ */
+typedef struct guacenc_decoder_pool_entry {
+
+    /**
+     * The ended image stream, owned by the guacenc_decoder_pool until the
+     * entry is removed with guacenc_decoder_pool_take().
+     */
+    guacenc_image_stream* stream;
+
+    /**
+     * Non-zero if a decoding thread has begun decoding the image stream, zero
+     * otherwise.
+     */
+    int claimed;
+
+    /**
+     * Non-zero if decoding of the image stream has finished (successfully or
+     * not), zero otherwise.
+     */
+    int complete;
+
+} guacenc_decoder_pool_entry;
+
+/**
+ * A set of threads which decode the images received along ended image streams
+ * in parallel. Decoded images are returned in exactly the order their streams
+ * were added, such that the caller may draw each image only once all previous
+ * images have been drawn, and only at the point where the affected layer or
+ * buffer is next needed.
+ */
+typedef struct guacenc_decoder_pool {
+
+    /**
+     * The threads decoding images on behalf of this pool.
+     */
+    pthread_t threads[GUACENC_DECODER_POOL_MAX_THREADS];
+
+    /**
+     * The number of threads within the threads array which were successfully
+     * started.
+     */
+    int thread_count;
+
+    /**
+     * Lock which must be acquired before accessing the entries, start,
+     * length, or stopping members of this pool.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever an entry is added or completed,
+     * or the pool is being freed.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Circular buffer of all image streams held by this pool, in the order
+     * they were added.
+     */
+    guacenc_decoder_pool_entry entries[GUACENC_DECODER_POOL_MAX_PENDING];
+
+    /**
+     * The index of the oldest entry within the entries array.
+     */
+    int start;
+
+    /**
+     * The number of entries currently held by this pool.
+     */
+    int length;
+
+    /**
+     * Non-zero if this pool is being freed and all decoding threads should
+     * stop, zero otherwise.
+     */
+    int stopping;
+
+} guacenc_decoder_pool;
+
+/**
+ * Sets the number of decoding threads that each guacenc_decoder_pool
+ * allocated by the current process from this point forward will use. By
+ * default, one decoding thread is used for each available CPU. This allows
+ * the CPUs to be shared fairly when several recordings are encoded at once.
+ *
+ * @param count
+ *     The number of decoding threads each new guacenc_decoder_pool should use
+ *     (up to GUACENC_DECODER_POOL_MAX_THREADS), or zero to use one thread for
+ *     each available CPU. If one, images are not decoded in parallel at all.
+ */
+void guacenc_decoder_pool_set_default_threads(int count);
+
+/**
+ * Allocates a new guacenc_decoder_pool, starting one decoding thread for each
+ * available CPU (up to GUACENC_DECODER_POOL_MAX_THREADS), or the number of
+ * threads set with guacenc_decoder_pool_set_default_threads(). If only a
+ * single thread would be used, or no threads can be started, no pool is
+ * created, and images should be decoded immediately as each image stream
+ * ends.
+ *
+ * @return
+ *     A newly-allocated guacenc_decoder_pool, or NULL if images should not be
+ *     decoded in parallel.
+ */
+guacenc_decoder_pool* guacenc_decoder_pool_alloc();
+
+/**
+ * Returns the number of image streams currently held by the given pool.
+ * If this is GUACENC_DECODER_POOL_MAX_PENDING, no further image streams may
+ * be added until at least one has been removed with
+ * guacenc_decoder_pool_take().
+ *
+ * @param pool
+ *     The pool to inspect.
+ *
+ * @return
+ *     The number of image streams currently held by the given pool.
+ */
+int guacenc_decoder_pool_length(guacenc_decoder_pool* pool);
+
+/**
+ * Returns the number of image streams which must be removed from the given
+ * pool with guacenc_decoder_pool_take() before all images destined for the
+ * given layer or buffer have been removed. As images are removed strictly in
+ * order, this includes any images destined for other layers or buffers which
+ * were added before the last image destined for the given layer or buffer.
+ *
+ * @param pool
+ *     The pool to inspect.
+ *
+ * @param index
+ *     The index of the layer or buffer to check for pending images.
+ *
+ * @return
+ *     The number of image streams that must be removed before no image
+ *     destined for the given layer or buffer remains, or zero if there are no
+ *     such images.
+ */
+int guacenc_decoder_pool_pending(guacenc_decoder_pool* pool, int index);
+
+/**
+ * Adds the given ended image stream to the given pool, such that its image
+ * will be decoded by the first available decoding thread. The pool MUST NOT
+ * already hold GUACENC_DECODER_POOL_MAX_PENDING image streams. Ownership of
+ * the image stream is transferred to the pool until it is removed with
+ * guacenc_decoder_pool_take().
+ *
+ * @param pool
+ *     The pool that should decode the image.
+ *
+ * @param stream
+ *     The image stream that has ended.
+ */
+void guacenc_decoder_pool_add(guacenc_decoder_pool* pool,
+        guacenc_image_stream* stream);
+
+/**
+ * Removes the oldest image stream from the given pool, waiting for its image
+ * to finish decoding if necessary. Ownership of the returned image stream is
+ * transferred to the caller, and its decoded image may be drawn with
+ * guacenc_image_stream_end().
+ *
+ * @param pool
+ *     The pool to remove an image stream from.
+ *
+ * @return
+ *     The oldest image stream held by the pool, now decoded, or NULL if the
+ *     pool holds no image streams.
+ */
+guacenc_image_stream* guacenc_decoder_pool_take(guacenc_decoder_pool* pool);
+
+/**
+ * Stops all decoding threads of the given pool and frees the pool, along with
+ * any image streams it still holds. The images of those streams are never
+ * drawn.
+ *
+ * @param pool
+ *     The pool to free, or NULL if no pool exists.
+ */
+void guacenc_decoder_pool_free(guacenc_decoder_pool* pool);
+
+#endif
+
@@ -74,6 +74,10 @@ int guacenc_display_free_buffer(guacenc_display* display,
         return 1;
     }
 
+    /* Draw any pending images before the buffer is freed, such that they
+     * are not drawn to a future buffer having the same index */
+    guacenc_display_draw_images(display, index);
+
     /* Free buffer (if allocated) */
     guacenc_buffer_free(display->buffers[internal_index]);
 
@@ -87,6 +91,10 @@ int guacenc_display_free_buffer(guacenc_display* display,
 guacenc_buffer* guacenc_display_get_related_buffer(guacenc_display* display,
         int index) {
 
+    /* Bring the requested layer or buffer up-to-date with all ended image
+     * streams */
+    guacenc_display_draw_images(display, index);
+
     /* Retrieve underlying buffer of layer if a layer is requested */
     if (index >= 0) {
 
@@ -24,8 +24,10 @@
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
+#include <guacamole/rect.h>
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -78,9 +80,98 @@ static int guacenc_display_layer_comparator(const void* a, const void* b) {
 
 }
 
+/**
+ * Determines the position of the given layer relative to the default layer,
+ * accounting for the positions of all of its ancestors. Layers which are not
+ * descendants of the default layer are not rendered, and have no such
+ * position.
+ *
+ * @param display
+ *     The display containing the given layer.
+ *
+ * @param layer
+ *     The layer whose position should be determined.
+ *
+ * @param x
+ *     Pointer to an int which will receive the X coordinate of the layer
+ *     relative to the default layer.
+ *
+ * @param y
+ *     Pointer to an int which will receive the Y coordinate of the layer
+ *     relative to the default layer.
+ *
+ * @return
+ *     Zero if the layer is the default layer or a descendant of the default
+ *     layer, non-zero otherwise.
+ */
+static int guacenc_display_get_offset(guacenc_display* display,
+        guacenc_layer* layer, int* x, int* y) {
+
+    int offset_x = 0;
+    int offset_y = 0;
+
+    /* Walk up to the default layer, giving up on any cycle of parents */
+    for (int i = 0; i < GUACENC_DISPLAY_MAX_LAYERS; i++) {
+
+        /* Only the default layer has no parent */
+        int parent_index = layer->parent_index;
+        if (parent_index == GUACENC_LAYER_NO_PARENT) {
+            *x = offset_x;
+            *y = offset_y;
+            return 0;
+        }
+
+        offset_x += layer->x;
+        offset_y += layer->y;
+
+        /* Layers with invalid parents are not rendered */
+        if (parent_index < 0 || parent_index >= GUACENC_DISPLAY_MAX_LAYERS)
+            return 1;
+
+        layer = display->layers[parent_index];
+        if (layer == NULL)
+            return 1;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Determines the area of the default layer which will be covered by the mouse
+ * cursor of the given display when the cursor is next rendered.
+ *
+ * @param display
+ *     The display whose mouse cursor should be located.
+ *
+ * @param rect
+ *     The rectangle to initialize with the area covered by the mouse cursor.
+ *     If the cursor will not be rendered, this will be an empty rectangle.
+ */
+static void guacenc_display_get_cursor_rect(guacenc_display* display,
+        guac_rect* rect) {
+
+    guacenc_cursor* cursor = display->cursor;
+    guacenc_buffer* buffer = cursor->buffer;
+
+    /* Do not render cursor if coordinates are negative */
+    if (cursor->x < 0 || cursor->y < 0) {
+        guac_rect_init(rect, 0, 0, 0, 0);
+        return;
+    }
+
+    guac_rect_init(rect,
+            cursor->x - cursor->hotspot_x,
+            cursor->y - cursor->hotspot_y,
+            buffer->width, buffer->height);
+
+}
+
 /**
  * Renders the mouse cursor on top of the frame buffer of the default layer of
- * the given display.
+ * the given display, recording the area covered such that the cursor can be
+ * removed when the next frame is rendered.
  *
  * @param display
  *     The display whose mouse cursor should be rendered to the frame buffer
@@ -93,10 +184,6 @@ static int guacenc_display_render_cursor(guacenc_display* display) {
 
     guacenc_cursor* cursor = display->cursor;
 
-    /* Do not render cursor if coordinates are negative */
-    if (cursor->x < 0 || cursor->y < 0)
-        return 0;
-
     /* Retrieve default layer (guaranteed to not be NULL) */
     guacenc_layer* def_layer = guacenc_display_get_layer(display, 0);
     assert(def_layer != NULL);
@@ -105,14 +192,16 @@ static int guacenc_display_render_cursor(guacenc_display* display) {
     guacenc_buffer* src = cursor->buffer;
     guacenc_buffer* dst = def_layer->frame;
 
+    guac_rect rect;
+    guacenc_display_get_cursor_rect(display, &rect);
+    display->cursor_rect = rect;
+
     /* Render cursor to layer */
-    if (src->width > 0 && src->height > 0) {
+    if (!guac_rect_is_empty(&rect) && dst->cairo != NULL) {
+        cairo_reset_clip(dst->cairo);
         cairo_set_source_surface(dst->cairo, src->surface,
-                cursor->x - cursor->hotspot_x,
-                cursor->y - cursor->hotspot_y);
-        cairo_rectangle(dst->cairo,
-                cursor->x - cursor->hotspot_x,
-                cursor->y - cursor->hotspot_y,
+                rect.left, rect.top);
+        cairo_rectangle(dst->cairo, rect.left, rect.top,
                 src->width, src->height);
         cairo_fill(dst->cairo);
     }
@@ -122,43 +211,141 @@ static int guacenc_display_render_cursor(guacenc_display* display) {
 
 }
 
+/**
+ * Replaces the given rectangle of the destination buffer with the contents of
+ * the same rectangle of the source buffer. Both buffers must have the same
+ * dimensions.
+ *
+ * @param dst
+ *     The buffer whose contents should be partially replaced.
+ *
+ * @param src
+ *     The buffer whose contents should be copied.
+ *
+ * @param rect
+ *     The rectangle to copy.
+ */
+static void guacenc_display_copy_rect(guacenc_buffer* dst,
+        guacenc_buffer* src, const guac_rect* rect) {
+
+    /* Nothing to copy if the buffers are empty */
+    if (src->surface == NULL || dst->cairo == NULL)
+        return;
+
+    cairo_t* cairo = dst->cairo;
+    cairo_reset_clip(cairo);
+
+    /* Overwrite rectangle of destination with contents of source */
+    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cairo, src->surface, 0, 0);
+    cairo_rectangle(cairo, rect->left, rect->top,
+            guac_rect_width(rect), guac_rect_height(rect));
+    cairo_fill(cairo);
+
+    /* Reset operator of destination to default */
+    cairo_set_operator(cairo, CAIRO_OPERATOR_OVER);
+
+}
+
 int guacenc_display_flatten(guacenc_display* display) {
 
     int i;
-    guacenc_layer* render_order[GUACENC_DISPLAY_MAX_LAYERS];
+    guacenc_layer** render_order = display->render_order;
+
+    /* All layers must be composited in their entirety if any layer has been
+     * allocated, freed, moved, or shaded */
+    bool full = display->layers_modified;
+
+    /* Sort layers by depth, parent, and Z only if they may have changed */
+    if (display->layers_modified) {
+        memcpy(render_order, display->layers, sizeof(display->render_order));
+        __qsort_display = display;
+        qsort(render_order, GUACENC_DISPLAY_MAX_LAYERS,
+                sizeof(guacenc_layer*), guacenc_display_layer_comparator);
+        display->layers_modified = false;
+    }
+
+    /* Determine area of default layer that has changed since the last
+     * frame (unallocated layers are sorted last) */
+    guac_rect damage;
+    guac_rect_init(&damage, 0, 0, 0, 0);
+    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS && render_order[i] != NULL;
+            i++) {
 
-    /* Copy list of layers within display */
-    memcpy(render_order, display->layers, sizeof(render_order));
+        guacenc_layer* layer = render_order[i];
+        guacenc_buffer* buffer = layer->buffer;
 
-    /* Sort layers by depth, parent, and Z */
-    __qsort_display = display;
-    qsort(render_order, GUACENC_DISPLAY_MAX_LAYERS, sizeof(guacenc_layer*),
-            guacenc_display_layer_comparator);
+        /* Resized layers must be composited in their entirety */
+        if (layer->frame->width != buffer->width
+                || layer->frame->height != buffer->height)
+            full = true;
 
-    /* Reset layer frame buffers */
-    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS; i++) {
+        /* Translate dirty rectangle of each rendered layer to the
+         * coordinates of the default layer */
+        int x, y;
+        if (!guac_rect_is_empty(&buffer->dirty)
+                && !guacenc_display_get_offset(display, layer, &x, &y)) {
 
-        /* Pull current layer, ignoring unallocated layers */
-        guacenc_layer* layer = render_order[i];
-        if (layer == NULL)
-            continue;
+            guac_rect dirty;
+            guac_rect_init(&dirty, buffer->dirty.left + x,
+                    buffer->dirty.top + y, guac_rect_width(&buffer->dirty),
+                    guac_rect_height(&buffer->dirty));
+
+            guac_rect_extend(&damage, &dirty);
+
+        }
+
+        /* Further changes are relative to this frame */
+        guac_rect_init(&buffer->dirty, 0, 0, 0, 0);
+
+    }
+
+    /* The cursor must be removed from its previous location and rendered at
+     * its current location */
+    guac_rect cursor_rect;
+    guacenc_display_get_cursor_rect(display, &cursor_rect);
+    guac_rect_extend(&damage, &display->cursor_rect);
+    guac_rect_extend(&damage, &cursor_rect);
+
+    /* The previous frame can be reused as-is if nothing has changed */
+    if (!full && guac_rect_is_empty(&damage))
+        return 0;
+
+    /* Reset layer frame buffers, at least within the changed area */
+    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS && render_order[i] != NULL;
+            i++) {
 
         /* Get source buffer and destination frame buffer */
+        guacenc_layer* layer = render_order[i];
         guacenc_buffer* buffer = layer->buffer;
         guacenc_buffer* frame = layer->frame;
 
         /* Reset frame contents */
-        guacenc_buffer_copy(frame, buffer);
+        if (full) {
+            guacenc_buffer_copy(frame, buffer);
+            continue;
+        }
+
+        /* Layers which are not rendered need not be updated until they are
+         * next moved (at which point all layers are composited again) */
+        int x, y;
+        if (guacenc_display_get_offset(display, layer, &x, &y))
+            continue;
+
+        /* Reset only the changed area */
+        guac_rect rect;
+        guac_rect_init(&rect, damage.left - x, damage.top - y,
+                guac_rect_width(&damage), guac_rect_height(&damage));
+        guacenc_display_copy_rect(frame, buffer, &rect);
 
     }
 
     /* Render each layer, in order */
-    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS; i++) {
+    for (i = 0; i < GUACENC_DISPLAY_MAX_LAYERS && render_order[i] != NULL;
+            i++) {
 
-        /* Pull current layer, ignoring unallocated layers */
+        /* Pull current layer */
         guacenc_layer* layer = render_order[i];
-        if (layer == NULL)
-            continue;
 
         /* Skip fully-transparent layers */
         if (layer->opacity == 0)
@@ -188,11 +375,24 @@ int guacenc_display_flatten(guacenc_display* display) {
         if (cairo == NULL)
             continue;
 
+        /* Determine position of parent for partial renders, ignoring layers
+         * that are not rendered */
+        int x, y;
+        if (!full && guacenc_display_get_offset(display, parent, &x, &y))
+            continue;
+
         /* Render buffer to layer */
         cairo_reset_clip(cairo);
         cairo_rectangle(cairo, layer->x, layer->y, src->width, src->height);
         cairo_clip(cairo);
 
+        /* Further restrict rendering to the changed area */
+        if (!full) {
+            cairo_rectangle(cairo, damage.left - x, damage.top - y,
+                    guac_rect_width(&damage), guac_rect_height(&damage));
+            cairo_clip(cairo);
+        }
+
         cairo_set_source_surface(cairo, surface, layer->x, layer->y);
         cairo_paint_with_alpha(cairo, layer->opacity / 255.0);
 
@@ -202,4 +402,3 @@ int guacenc_display_flatten(guacenc_display* display) {
     return guacenc_display_render_cursor(display);
 
 }
-
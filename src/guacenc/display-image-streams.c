@@ -18,8 +18,10 @@
  */
 
 #include "config.h"
+#include "decoder-pool.h"
 #include "display.h"
 #include "image-stream.h"
+#include "layer.h"
 #include "log.h"
 
 #include <guacamole/client.h>
@@ -79,3 +81,105 @@ int guacenc_display_free_image_stream(guacenc_display* display, int index) {
 
 }
 
+
+/**
+ * Removes the given number of image streams from the decoder pool of the
+ * given display, drawing the image of each to its associated layer or buffer
+ * in the order the streams ended.
+ *
+ * @param display
+ *     The Guacamole video encoder display whose pending images should be
+ *     drawn.
+ *
+ * @param count
+ *     The number of image streams to remove and draw.
+ */
+static void guacenc_display_draw_next_images(guacenc_display* display,
+        int count) {
+
+    while (count-- > 0) {
+
+        guacenc_image_stream* stream =
+            guacenc_decoder_pool_take(display->decoders);
+        if (stream == NULL)
+            break;
+
+        /* Retrieve destination buffer without drawing pending images (the
+         * images preceding this image have already been drawn) */
+        guacenc_buffer* buffer;
+        if (stream->index >= 0) {
+            guacenc_layer* layer = guacenc_display_get_layer(display,
+                    stream->index);
+            buffer = (layer != NULL) ? layer->buffer : NULL;
+        }
+        else
+            buffer = guacenc_display_get_buffer(display, stream->index);
+
+        /* Draw decoded image to the buffer */
+        if (buffer != NULL && guacenc_image_stream_end(stream, buffer))
+            guacenc_log(GUAC_LOG_DEBUG, "Image for layer/buffer %i could "
+                    "not be drawn.", stream->index);
+
+        guacenc_image_stream_free(stream);
+
+    }
+
+}
+
+int guacenc_display_end_image_stream(guacenc_display* display, int index) {
+
+    /* Retrieve image stream */
+    guacenc_image_stream* stream =
+        guacenc_display_get_image_stream(display, index);
+    if (stream == NULL)
+        return 1;
+
+    /* Decode and draw immediately if not decoding in parallel */
+    if (display->decoders == NULL) {
+
+        /* Retrieve destination buffer */
+        guacenc_buffer* buffer =
+            guacenc_display_get_related_buffer(display, stream->index);
+        if (buffer == NULL)
+            return 1;
+
+        /* End image stream, drawing final image to the buffer */
+        int retval = guacenc_image_stream_end(stream, buffer);
+        guacenc_display_free_image_stream(display, index);
+        return retval;
+
+    }
+
+    /* Make room for the new image, drawing the oldest image if necessary */
+    if (guacenc_decoder_pool_length(display->decoders)
+            >= GUACENC_DECODER_POOL_MAX_PENDING)
+        guacenc_display_draw_next_images(display, 1);
+
+    /* Hand stream to decoding threads, drawing its image later */
+    display->image_streams[index] = NULL;
+    guacenc_decoder_pool_add(display->decoders, stream);
+    return 0;
+
+}
+
+void guacenc_display_draw_images(guacenc_display* display, int index) {
+
+    /* Images are already drawn if not decoding in parallel */
+    if (display->decoders == NULL)
+        return;
+
+    guacenc_display_draw_next_images(display,
+            guacenc_decoder_pool_pending(display->decoders, index));
+
+}
+
+void guacenc_display_draw_all_images(guacenc_display* display) {
+
+    /* Images are already drawn if not decoding in parallel */
+    if (display->decoders == NULL)
+        return;
+
+    guacenc_display_draw_next_images(display,
+            guacenc_decoder_pool_length(display->decoders));
+
+}
@@ -52,6 +52,7 @@ guacenc_layer* guacenc_display_get_layer(guacenc_display* display,
 
         /* Store layer within display for future retrieval / management */
         display->layers[index] = layer;
+        display->layers_modified = true;
 
     }
 
@@ -87,11 +88,16 @@ int guacenc_display_free_layer(guacenc_display* display,
         return 1;
     }
 
+    /* Draw any pending images before the layer is freed, such that they
+     * are not drawn to a future layer having the same index */
+    guacenc_display_draw_images(display, index);
+
     /* Free layer (if allocated) */
     guacenc_layer_free(display->layers[index]);
 
     /* Mark layer as freed */
     display->layers[index] = NULL;
+    display->layers_modified = true;
 
     return 0;
 
@@ -39,6 +39,40 @@ int guacenc_display_sync(guacenc_display* display, guac_timestamp timestamp) {
 
     /* Update timestamp of display */
     display->last_sync = timestamp;
+    if (display->first_sync == 0)
+        display->first_sync = timestamp;
+
+    guac_timestamp elapsed = timestamp - display->first_sync;
+
+    /* Render only the frames that thumbnails are due for, never preparing
+     * frames for video */
+    if (display->thumbnails != NULL) {
+
+        if (!guacenc_thumbnails_due(display->thumbnails, elapsed))
+            return 0;
+
+        /* All images must be drawn before the frame can be rendered */
+        guacenc_display_draw_all_images(display);
+
+        /* Flatten display to default layer */
+        if (guacenc_display_flatten(display))
+            return 1;
+
+        guacenc_layer* def_layer = guacenc_display_get_layer(display, 0);
+        assert(def_layer != NULL);
+
+        return guacenc_thumbnails_render(display->thumbnails,
+                def_layer->frame, elapsed);
+
+    }
+
+    /* Encode only the requested part of the recording */
+    if (elapsed < display->start
+            || (display->end != 0 && elapsed > display->end))
+        return 0;
+
+    /* All images must be drawn before the frame can be rendered */
+    guacenc_display_draw_all_images(display);
 
     /* Flatten display to default layer */
     if (guacenc_display_flatten(display))
@@ -58,3 +92,14 @@ int guacenc_display_sync(guacenc_display* display, guac_timestamp timestamp) {
 
 }
 
+
+int guacenc_display_finished(guacenc_display* display) {
+
+    /* Nothing further need be read once all thumbnails are rendered */
+    if (display->thumbnails != NULL && display->thumbnails->finished)
+        return 1;
+
+    return display->end != 0 && display->first_sync != 0
+        && display->last_sync - display->first_sync > display->end;
+
+}
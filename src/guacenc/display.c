@@ -19,6 +19,7 @@
 
 #include "config.h"
 #include "cursor.h"
+#include "decoder-pool.h"
 #include "display.h"
 #include "video.h"
 
@@ -84,23 +85,58 @@ cairo_operator_t guacenc_display_cairo_operator(guac_composite_mode mask) {
 
 }
 
+/**
+ * Allocates a new Guacamole video encoder display having no output. The
+ * video or thumbnails rendered by the display must be assigned by the
+ * caller.
+ *
+ * @return
+ *     The newly-allocated Guacamole video encoder display.
+ */
+static guacenc_display* guacenc_display_alloc_common() {
+
+    /* Allocate display */
+    guacenc_display* display =
+        (guacenc_display*) guac_mem_zalloc(sizeof(guacenc_display));
+
+    /* No render order has yet been determined */
+    display->layers_modified = true;
+
+    /* Allocate special-purpose cursor layer */
+    display->cursor = guacenc_cursor_alloc();
+
+    /* Decode images in parallel, if possible */
+    display->decoders = guacenc_decoder_pool_alloc();
+
+    return display;
+
+}
+
 guacenc_display* guacenc_display_alloc(const char* path, const char* codec,
-        int width, int height, int bitrate) {
+        const char* hwaccel, bool live, int width, int height, int bitrate) {
 
     /* Prepare video encoding */
-    guacenc_video* video = guacenc_video_alloc(path, codec, width, height, bitrate);
+    guacenc_video* video = guacenc_video_alloc(path, codec, hwaccel, live,
+            width, height, bitrate);
     if (video == NULL)
         return NULL;
 
-    /* Allocate display */
-    guacenc_display* display =
-        (guacenc_display*) guac_mem_zalloc(sizeof(guacenc_display));
-
     /* Associate display with video output */
+    guacenc_display* display = guacenc_display_alloc_common();
     display->output = video;
 
-    /* Allocate special-purpose cursor layer */
-    display->cursor = guacenc_cursor_alloc();
+    return display;
+
+}
+
+guacenc_display* guacenc_display_alloc_thumbnails(const char* path,
+        const guacenc_thumbnail_options* options, guac_timestamp start,
+        guac_timestamp end) {
+
+    /* Associate display with thumbnails, without any video output */
+    guacenc_display* display = guacenc_display_alloc_common();
+    display->thumbnails = guacenc_thumbnails_alloc(path, options, start,
+            end);
 
     return display;
 
@@ -114,8 +150,28 @@ int guacenc_display_free(guacenc_display* display) {
     if (display == NULL)
         return 0;
 
-    /* Finalize video */
-    int retval = guacenc_video_free(display->output);
+    /* If reading stopped because the recording continues beyond the end of
+     * the part being encoded, hold the final frame until that end, such that
+     * the video covers exactly the requested part (the final frame itself is
+     * written once more as the video is finalized) */
+    if (display->output != NULL && guacenc_display_finished(display)) {
+
+        guac_timestamp until = display->first_sync + display->end + 1
+            - 1000 / GUACENC_VIDEO_FRAMERATE;
+
+        if (display->output->last_timestamp != 0
+                && until > display->output->last_timestamp)
+            guacenc_video_advance_timeline(display->output, until);
+
+    }
+
+    /* Finalize video or thumbnails */
+    int retval = display->output != NULL
+        ? guacenc_video_free(display->output)
+        : guacenc_thumbnails_free(display->thumbnails);
+
+    /* Stop decoding images */
+    guacenc_decoder_pool_free(display->decoders);
 
     /* Free all buffers */
     for (i = 0; i < GUACENC_DISPLAY_MAX_BUFFERS; i++)
@@ -23,14 +23,19 @@
 #include "config.h"
 #include "buffer.h"
 #include "cursor.h"
+#include "decoder-pool.h"
 #include "image-stream.h"
 #include "layer.h"
+#include "thumbnail.h"
 #include "video.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/timestamp.h>
 
+#include <stdbool.h>
+
 /**
  * The maximum number of buffers that the Guacamole video encoder will handle
  * within a single Guacamole protocol dump.
@@ -75,6 +80,28 @@ typedef struct guacenc_display {
      */
     guacenc_layer* layers[GUACENC_DISPLAY_MAX_LAYERS];
 
+    /**
+     * All currently-allocated layers, sorted in the order they must be
+     * rendered by guacenc_display_flatten(), followed by NULL entries. This
+     * order is recalculated only when layers_modified is set.
+     */
+    guacenc_layer* render_order[GUACENC_DISPLAY_MAX_LAYERS];
+
+    /**
+     * Whether any layer has been allocated, freed, moved, or shaded since the
+     * last frame was rendered. If set, the render order must be recalculated
+     * and all layers must be composited again in their entirety, rather than
+     * only their dirty rectangles.
+     */
+    bool layers_modified;
+
+    /**
+     * The area of the default layer covered by the mouse cursor when the last
+     * frame was rendered, or an empty rectangle if the cursor was not
+     * rendered.
+     */
+    guac_rect cursor_rect;
+
     /**
      * All currently-allocated image streams. The index of the stream
      * corresponds to its position within this array. If a stream has not yet
@@ -90,10 +117,47 @@ typedef struct guacenc_display {
     guac_timestamp last_sync;
 
     /**
-     * The video that this display is recording to.
+     * The timestamp of the first frame of the recording, or 0 if no sync has
+     * yet been read. All parts of the recording selected for encoding are
+     * relative to this timestamp.
+     */
+    guac_timestamp first_sync;
+
+    /**
+     * The number of milliseconds, relative to the first frame of the
+     * recording, which should elapse before any frames are encoded. Frames
+     * before this point still update the display, but are not encoded.
+     */
+    guac_timestamp start;
+
+    /**
+     * The number of milliseconds, relative to the first frame of the
+     * recording, after which no further frames should be encoded, or 0 if
+     * the recording should be encoded until its end.
+     */
+    guac_timestamp end;
+
+    /**
+     * The video that this display is recording to, or NULL if the display is
+     * rendering thumbnails instead.
      */
     guacenc_video* output;
 
+    /**
+     * The thumbnails that this display is rendering, or NULL if the display
+     * is recording to video instead. When rendering thumbnails, frames are
+     * flattened only when a thumbnail is due.
+     */
+    guacenc_thumbnails* thumbnails;
+
+    /**
+     * The pool of threads decoding the images of ended image streams, or NULL
+     * if images are decoded immediately as each image stream ends. Decoded
+     * images are drawn only once the layer or buffer they are destined for is
+     * next needed, in the order their image streams ended.
+     */
+    guacenc_decoder_pool* decoders;
+
 } guacenc_display;
 
 /**
@@ -112,6 +176,19 @@ typedef struct guacenc_display {
  */
 int guacenc_display_sync(guacenc_display* display, guac_timestamp timestamp);
 
+/**
+ * Returns whether the given display has passed the end of the part of the
+ * recording selected for encoding, such that no further instructions need be
+ * read.
+ *
+ * @param display
+ *     The display to test.
+ *
+ * @return
+ *     Non-zero if no further frames will be encoded, zero otherwise.
+ */
+int guacenc_display_finished(guacenc_display* display);
+
 /**
  * Flattens the given display, rendering all child layers to the frame buffers
  * of their parent layers. The frame buffer of the default layer of the display
@@ -140,6 +217,17 @@ int guacenc_display_flatten(guacenc_display* display);
  *     The name of the codec to use for the video encoding, as defined by
  *     ffmpeg / libavcodec.
  *
+ * @param hwaccel
+ *     The name of the type of hardware device which should be used to encode
+ *     the video ("vaapi", "cuda", or "qsv"), or NULL if the video should be
+ *     encoded in software. If hardware-accelerated encoding is not possible,
+ *     the video is encoded in software using the given codec.
+ *
+ * @param live
+ *     Whether the video should be written as fragmented MP4, with each
+ *     fragment flushed to the output file as soon as it is complete, such
+ *     that the video may be played back while it is still being encoded.
+ *
  * @param width
  *     The width of the desired video, in pixels.
  *
@@ -155,11 +243,42 @@ int guacenc_display_flatten(guacenc_display* display);
  *     display could not be allocated.
  */
 guacenc_display* guacenc_display_alloc(const char* path, const char* codec,
-        int width, int height, int bitrate);
+        const char* hwaccel, bool live, int width, int height, int bitrate);
+
+/**
+ * Allocates a new Guacamole video encoder display which renders thumbnails of
+ * the display state at specific points within the recording, rather than
+ * encoding video.
+ *
+ * @param path
+ *     The path to the recording, from which the name of each thumbnail is
+ *     derived.
+ *
+ * @param options
+ *     The options describing which thumbnails should be rendered, and how.
+ *     These options must remain valid until the display is freed.
+ *
+ * @param start
+ *     The number of milliseconds into the recording, relative to the first
+ *     frame, at which rendering of thumbnails at a regular interval should
+ *     begin.
+ *
+ * @param end
+ *     The number of milliseconds into the recording, relative to the first
+ *     frame, after which no further thumbnails should be rendered at a
+ *     regular interval, or zero if thumbnails should be rendered until the
+ *     end of the recording.
+ *
+ * @return
+ *     The newly-allocated Guacamole video encoder display.
+ */
+guacenc_display* guacenc_display_alloc_thumbnails(const char* path,
+        const guacenc_thumbnail_options* options, guac_timestamp start,
+        guac_timestamp end);
 
 /**
  * Frees all memory associated with the given Guacamole video encoder display,
- * and finishes any underlying encoding process. If the given display is NULL,
+ * and finishes any underlying encoding process or thumbnails. If the given display is NULL,
  * this function has no effect.
  *
  * @param display
@@ -352,6 +471,57 @@ guacenc_image_stream* guacenc_display_get_image_stream(
  */
 int guacenc_display_free_image_stream(guacenc_display* display, int index);
 
+/**
+ * Ends the stream having the given index, such that its image will be drawn
+ * to the layer or buffer associated with that stream. If images are being
+ * decoded in parallel, the stream is handed to the decoding threads of the
+ * display and the image is drawn later, once its layer or buffer is next
+ * needed. Otherwise, the image is decoded and drawn immediately. In either
+ * case, the stream is no longer accessible by its index once this function
+ * returns.
+ *
+ * @param display
+ *     The Guacamole video encoder display associated with the image stream
+ *     being ended.
+ *
+ * @param index
+ *     The index of the stream to end. All valid stream indices are
+ *     non-negative.
+ *
+ * @return
+ *     Zero if the image stream was successfully ended, non-zero if the
+ *     stream does not exist or its image could not be drawn.
+ */
+int guacenc_display_end_image_stream(guacenc_display* display, int index);
+
+/**
+ * Draws all images which are still being decoded or are waiting to be drawn
+ * to the layer or buffer having the given index, along with any images
+ * destined for other layers or buffers whose streams ended earlier. Once this
+ * function returns, the layer or buffer reflects all image streams that have
+ * ended. If images are not being decoded in parallel, this function has no
+ * effect.
+ *
+ * @param display
+ *     The Guacamole video encoder display whose pending images should be
+ *     drawn.
+ *
+ * @param index
+ *     The index of the layer or buffer that is about to be used.
+ */
+void guacenc_display_draw_images(guacenc_display* display, int index);
+
+/**
+ * Draws all images which are still being decoded or are waiting to be drawn,
+ * regardless of the layers or buffers they are destined for. If images are
+ * not being decoded in parallel, this function has no effect.
+ *
+ * @param display
+ *     The Guacamole video encoder display whose pending images should be
+ *     drawn.
+ */
+void guacenc_display_draw_all_images(guacenc_display* display);
+
 /**
  * Translates the given Guacamole protocol compositing mode (channel mask) to
  * the corresponding Cairo composition operator. If no such operator exists,
@@ -18,20 +18,33 @@
  */
 
 #include "config.h"
+#include "concat.h"
 #include "display.h"
+#include "encode.h"
+#include "follow.h"
+#include "index.h"
 #include "instructions.h"
 #include "log.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
+#include <guacamole/mem.h>
 #include <guacamole/parser.h>
+#include <guacamole/recording.h>
 #include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -61,8 +74,10 @@ static int guacenc_read_instructions(guacenc_display* display,
     if (parser == NULL)
         return 1;
 
-    /* Continuously read and handle all instructions */
-    while (!guac_parser_read(parser, socket, -1)) {
+    /* Continuously read and handle all instructions, stopping early if the
+     * remainder of the recording will not be encoded */
+    while (!guacenc_display_finished(display)
+            && !guac_parser_read(parser, socket, -1)) {
         if (guacenc_handle_instruction(display, parser->opcode,
                 parser->argc, parser->argv)) {
             guacenc_log(GUAC_LOG_DEBUG, "Handling of \"%s\" instruction "
@@ -71,7 +86,7 @@ static int guacenc_read_instructions(guacenc_display* display,
     }
 
     /* Fail on read/parse error */
-    if (guac_error != GUAC_STATUS_CLOSED) {
+    if (!guacenc_display_finished(display) && guac_error != GUAC_STATUS_CLOSED) {
         guacenc_log(GUAC_LOG_ERROR, "%s: %s",
                 path, guac_status_string(guac_error));
         guac_parser_free(parser);
@@ -84,14 +99,231 @@ static int guacenc_read_instructions(guacenc_display* display,
 
 }
 
-int guacenc_encode(const char* path, const char* out_path, const char* codec,
-        int width, int height, int bitrate, bool force) {
+/**
+ * Maps the entire contents of the given recording into memory, such that
+ * instructions may be parsed directly from that memory rather than being read
+ * through a guac_socket. The mapping is private and writable, as parsing
+ * modifies the data being parsed; modifications are never written back to
+ * the recording.
+ *
+ * @param fd
+ *     The file descriptor of the recording.
+ *
+ * @param length
+ *     A pointer to the size_t in which the length of the mapping should be
+ *     stored.
+ *
+ * @return
+ *     The start of the mapping, which must be unmapped with munmap(), or NULL
+ *     if the recording cannot be mapped (for example, if the recording is
+ *     empty or is not a regular file).
+ */
+static char* guacenc_map_recording(int fd, size_t* length) {
+
+#ifdef HAVE_SYS_MMAN_H
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || !S_ISREG(file_stat.st_mode)
+            || file_stat.st_size <= 0)
+        return NULL;
+
+    char* map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+#ifdef MADV_SEQUENTIAL
+    /* The recording is read once, from beginning to end */
+    madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+#endif
+
+    *length = file_stat.st_size;
+    return map;
+#else
+    return NULL;
+#endif
+
+}
+
+/**
+ * Reads and handles all Guacamole instructions from the given memory mapping
+ * of a recording, as created by guacenc_map_recording(), until the end of
+ * the mapping is reached. Pages containing instructions which have already
+ * been handled are periodically released.
+ *
+ * @param display
+ *     The current internal display of the Guacamole video encoder.
+ *
+ * @param path
+ *     The name of the file being parsed (for logging purposes).
+ *
+ * @param map
+ *     The start of the mapping.
+ *
+ * @param offset
+ *     The offset within the mapping of the first instruction to be read.
+ *
+ * @param length
+ *     The length of the mapping, in bytes.
+ *
+ * @return
+ *     Zero on success, non-zero if parsing of Guacamole protocol data within
+ *     the given mapping fails.
+ */
+static int guacenc_read_mapped_instructions(guacenc_display* display,
+        const char* path, char* map, size_t offset, size_t length) {
+
+    /* Obtain Guacamole protocol parser */
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL)
+        return 1;
+
+    char* current = map + offset;
+    char* end = map + length;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t released = 0;
+#endif
+
+    /* Continuously read and handle all instructions, stopping early if the
+     * remainder of the recording will not be encoded */
+    while (!guacenc_display_finished(display)) {
+
+        if (guac_parser_read_buffer(parser, &current, end))
+            break;
+
+        if (guacenc_handle_instruction(display, parser->opcode,
+                parser->argc, parser->argv)) {
+            guacenc_log(GUAC_LOG_DEBUG, "Handling of \"%s\" instruction "
+                    "failed.", parser->opcode);
+        }
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+        /* Release modified pages that will not be read again */
+        size_t handled = (current - map) / page_size * page_size;
+        if (handled - released >= GUACENC_MAPPED_RELEASE_SIZE) {
+            madvise(map + released, handled - released, MADV_DONTNEED);
+            released = handled;
+        }
+#endif
+
+    }
+
+    /* Fail on parse error */
+    if (!guacenc_display_finished(display) && guac_error != GUAC_STATUS_CLOSED) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s",
+                path, guac_status_string(guac_error));
+        guac_parser_free(parser);
+        return 1;
+    }
+
+    /* Parse complete */
+    guac_parser_free(parser);
+    return 0;
+
+}
+
+/**
+ * Restores the state of the given display from the last keyframe within the
+ * index of the given recording that precedes the part of the recording to be
+ * encoded, seeking the given file descriptor of that recording to the
+ * position that keyframe represents. If the recording has no index, or no
+ * suitable keyframe exists, the display and file descriptor are left
+ * untouched, and the recording must be read from its beginning.
+ *
+ * @param display
+ *     The display whose state should be restored, and whose start time
+ *     determines the keyframe used.
+ *
+ * @param path
+ *     The path to the recording.
+ *
+ * @param fd
+ *     The file descriptor of the recording, which must not yet have been
+ *     read.
+ */
+static void guacenc_seek_keyframe(guacenc_display* display,
+        const char* path, int fd) {
+
+    /* Find the last keyframe before the start of encoding, with nothing to
+     * skip if that keyframe is the start of the recording */
+    guacenc_keyframe keyframe;
+    int selected = guacenc_index_find(path, display->start, &keyframe);
+    if (selected <= 0)
+        return;
+
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL)
+        return;
+
+    guac_socket* index = guacenc_index_open_keyframe(path, parser, selected);
+    if (index == NULL) {
+        guac_parser_free(parser);
+        return;
+    }
+
+    guacenc_log(GUAC_LOG_INFO, "%s: Starting from keyframe %i seconds into "
+            "the recording.", path,
+            (int) ((keyframe.timestamp - keyframe.first) / 1000));
+
+    if (guac_recording_seek(fd, keyframe.offset)) {
+        guacenc_log(GUAC_LOG_WARNING, "%s: Cannot seek to keyframe: %s",
+                path, strerror(errno));
+        guac_socket_free(index);
+        guac_parser_free(parser);
+        return;
+    }
+
+    display->first_sync = keyframe.first;
+
+    /* Restore the state of the display as of the keyframe */
+    guac_timestamp next_timestamp;
+    off_t next_offset;
+    while (!guac_parser_read(parser, index, -1)) {
+
+        if (!guacenc_index_parse_keyframe(parser, &next_timestamp, &next_offset))
+            break;
+
+        if (guacenc_handle_instruction(display, parser->opcode,
+                parser->argc, parser->argv)) {
+            guacenc_log(GUAC_LOG_DEBUG, "Handling of \"%s\" instruction "
+                    "within keyframe failed.", parser->opcode);
+        }
+
+    }
+
+    guac_socket_free(index);
+    guac_parser_free(parser);
+
+    /* The restored state is that of the frame ended by the "sync" that the
+     * keyframe represents, which must be handled for that frame to be
+     * encoded if encoding begins exactly at the keyframe */
+    guacenc_display_sync(display, keyframe.timestamp);
+
+}
+
+/**
+ * Opens the recording at the given path for reading, acquiring a read lock on
+ * that recording unless the lock should be ignored.
+ *
+ * @param path
+ *     The path to the recording to open.
+ *
+ * @param force
+ *     Whether the recording should be opened even if it appears to be an
+ *     in-progress recording (has an associated lock).
+ *
+ * @return
+ *     The file descriptor of the opened recording, or -1 if the recording
+ *     cannot be opened or is in progress.
+ */
+static int guacenc_open_recording(const char* path, bool force) {
 
     /* Open input file */
     int fd = open(path, O_RDONLY);
     if (fd < 0) {
         guacenc_log(GUAC_LOG_ERROR, "%s: %s", path, strerror(errno));
-        return 1;
+        return -1;
     }
 
     /* Lock entire input file for reading by the current process */
@@ -118,29 +350,119 @@ int guacenc_encode(const char* path, const char* out_path, const char* codec,
                     path, strerror(errno));
 
         close(fd);
-        return 1;
+        return -1;
     }
 
-    /* Allocate display for encoding process */
-    guacenc_display* display = guacenc_display_alloc(out_path, codec,
-            width, height, bitrate);
-    if (display == NULL) {
+    return fd;
+
+}
+
+/**
+ * Reads and handles all instructions within the given recording that are
+ * needed by the given display, skipping directly to the part of the
+ * recording the display starts at if the recording has an index, and then
+ * frees the display, finishing its output. The file descriptor of the
+ * recording is closed.
+ *
+ * @param display
+ *     The display to render the recording to.
+ *
+ * @param path
+ *     The path to the recording.
+ *
+ * @param fd
+ *     The file descriptor of the recording, as returned by
+ *     guacenc_open_recording().
+ *
+ * @param out_path
+ *     A human-readable description of the output of the display (for logging
+ *     purposes).
+ *
+ * @param follow
+ *     Whether the recording should continue to be read as it grows until the
+ *     recording is complete (its associated lock has been released), rather
+ *     than stopping at the current end of the file.
+ *
+ * @return
+ *     Zero on success, non-zero if the recording could not be read or the
+ *     output of the display could not be finished.
+ */
+static int guacenc_read_recording(guacenc_display* display, const char* path,
+        int fd, const char* out_path, bool follow) {
+
+    /* Skip directly to the part of the recording being encoded, if the
+     * recording has an index */
+    if (display->start > 0)
+        guacenc_seek_keyframe(display, path, fd);
+
+    /* Parse instructions directly from memory, without copying the recording
+     * through a guac_socket, unless following an in-progress recording
+     * (which may grow beyond any mapping) or unless the recording is
+     * compressed (and must be decompressed as it is read) */
+    size_t length;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    char* map = follow ? NULL : guacenc_map_recording(fd, &length);
+    if (map != NULL && offset >= 0 && (size_t) offset <= length
+            && guac_recording_is_compressed(map + offset, length - offset)) {
+#ifdef HAVE_SYS_MMAN_H
+        munmap(map, length);
+#endif
+        map = NULL;
+    }
+
+    if (map != NULL) {
+
+        close(fd);
+
+        guacenc_log(GUAC_LOG_INFO, "Encoding \"%s\" to \"%s\" ...",
+                path, out_path);
+
+        int failed = offset < 0 || (size_t) offset > length
+            || guacenc_read_mapped_instructions(display, path, map,
+                    offset, length);
+
+#ifdef HAVE_SYS_MMAN_H
+        munmap(map, length);
+#endif
+
+        if (failed) {
+            guacenc_display_free(display);
+            return 1;
+        }
+
+        /* Finish encoding process */
+        return guacenc_display_free(display);
+
+    }
+
+    /* Obtain guac_socket wrapping file descriptor, reading further data as it
+     * is written if following an in-progress recording */
+    guac_socket* file = follow ? guacenc_follow_socket_open(path, fd)
+            : guac_socket_open(fd);
+    if (file == NULL) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: %s", path,
+                guac_status_string(guac_error));
         close(fd);
+        guacenc_display_free(display);
         return 1;
     }
 
-    /* Obtain guac_socket wrapping file descriptor */
-    guac_socket* socket = guac_socket_open(fd);
+    /* Decompress the recording as it is read, if compressed */
+    guac_socket* socket = guac_recording_open_reader(file);
     if (socket == NULL) {
         guacenc_log(GUAC_LOG_ERROR, "%s: %s", path,
                 guac_status_string(guac_error));
-        close(fd);
+        guac_socket_free(file);
         guacenc_display_free(display);
         return 1;
     }
 
     guacenc_log(GUAC_LOG_INFO, "Encoding \"%s\" to \"%s\" ...", path, out_path);
 
+    if (follow)
+        guacenc_log(GUAC_LOG_INFO, "%s: Following recording until it is "
+                "complete.", path);
+
     /* Attempt to read all instructions in the file */
     if (guacenc_read_instructions(display, path, socket)) {
         guac_socket_free(socket);
@@ -154,3 +476,371 @@ int guacenc_encode(const char* path, const char* out_path, const char* codec,
 
 }
 
+/**
+ * A single time range of a recording, encoded as a separate video
+ * concurrently with the other time ranges of that recording.
+ */
+typedef struct guacenc_segment {
+
+    /**
+     * The path to the recording.
+     */
+    const char* path;
+
+    /**
+     * The full path to the temporary file in which the video of this time
+     * range should be written.
+     */
+    char out_path[4096];
+
+    /**
+     * The name of the codec to use for the video encoding.
+     */
+    const char* codec;
+
+    /**
+     * The type of hardware device to use to encode the video, or NULL if the
+     * video should be encoded in software.
+     */
+    const char* hwaccel;
+
+    /**
+     * The width of the video, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the video, in pixels.
+     */
+    int height;
+
+    /**
+     * The bitrate of the video, in bits per second.
+     */
+    int bitrate;
+
+    /**
+     * The number of milliseconds into the recording at which this time range
+     * begins, relative to the first frame of the recording.
+     */
+    guac_timestamp start;
+
+    /**
+     * The number of milliseconds into the recording at which this time range
+     * ends (inclusive), relative to the first frame of the recording, or zero
+     * if this time range continues to the end of the recording.
+     */
+    guac_timestamp end;
+
+    /**
+     * The thread encoding this time range.
+     */
+    pthread_t thread;
+
+    /**
+     * Whether this time range is being encoded within its own thread, rather
+     * than the thread that started encoding of all time ranges.
+     */
+    bool threaded;
+
+    /**
+     * Non-zero if encoding of this time range failed, zero otherwise.
+     */
+    int failed;
+
+} guacenc_segment;
+
+/**
+ * Encodes the time range described by the given guacenc_segment, storing
+ * whether encoding failed within that guacenc_segment. The recording lock is
+ * not checked; the lock is expected to have already been checked prior to
+ * encoding of any time range.
+ *
+ * @param data
+ *     The guacenc_segment describing the time range to encode.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_segment_thread(void* data) {
+
+    guacenc_segment* segment = (guacenc_segment*) data;
+    segment->failed = 1;
+
+    int fd = guacenc_open_recording(segment->path, true);
+    if (fd < 0)
+        return NULL;
+
+    guacenc_display* display = guacenc_display_alloc(segment->out_path,
+            segment->codec, segment->hwaccel, false, segment->width,
+            segment->height, segment->bitrate);
+    if (display == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    display->start = segment->start;
+    display->end = segment->end;
+
+    segment->failed = guacenc_read_recording(display, segment->path, fd,
+            segment->out_path, false);
+
+    return NULL;
+
+}
+
+/**
+ * Encodes the given part of the given recording as separate time ranges, each
+ * beginning at a keyframe within the index of the recording, concurrently
+ * encoding all time ranges into temporary files that are then concatenated
+ * into the final video. Each temporary file is deleted once concatenation
+ * has been attempted.
+ *
+ * @param path
+ *     The path to the recording.
+ *
+ * @param out_path
+ *     The full path to the file in which encoded video should be written.
+ *
+ * @param codec
+ *     The name of the codec to use for the video encoding.
+ *
+ * @param hwaccel
+ *     The type of hardware device to use to encode the video, or NULL if the
+ *     video should be encoded in software.
+ *
+ * @param width
+ *     The width of the video, in pixels.
+ *
+ * @param height
+ *     The height of the video, in pixels.
+ *
+ * @param bitrate
+ *     The bitrate of the video, in bits per second.
+ *
+ * @param start
+ *     The number of seconds into the recording at which encoding should
+ *     begin, relative to the first frame of the recording.
+ *
+ * @param end
+ *     The number of seconds into the recording at which encoding should end,
+ *     relative to the first frame of the recording, or zero if the entire
+ *     remainder of the recording should be encoded.
+ *
+ * @param segments
+ *     The maximum number of time ranges to encode concurrently.
+ *
+ * @return
+ *     Zero on success, a positive value if an error prevented successful
+ *     encoding of the video, or a negative value if the recording cannot be
+ *     divided into multiple time ranges (for example, if the recording has no
+ *     index), in which case nothing has been encoded.
+ */
+static int guacenc_encode_segments(const char* path, const char* out_path,
+        const char* codec, const char* hwaccel, int width, int height,
+        int bitrate, int start, int end, int segments) {
+
+    guac_timestamp* keyframes;
+    int count = guacenc_index_list(path, &keyframes);
+
+    guac_timestamp first = (guac_timestamp) start * 1000;
+    guac_timestamp last = end > 0 ? (guac_timestamp) end * 1000
+        : (count > 0 ? keyframes[count - 1] : 0);
+
+    if (segments > GUACENC_MAX_SEGMENTS)
+        segments = GUACENC_MAX_SEGMENTS;
+
+    /* Divide the part of the recording being encoded at the first keyframe
+     * following each of a set of evenly-spaced points */
+    guac_timestamp boundaries[GUACENC_MAX_SEGMENTS];
+    int ranges = 1;
+    int current = 0;
+    boundaries[0] = first;
+
+    for (int i = 1; i < segments && last > first; i++) {
+
+        guac_timestamp target = first + (last - first) * i / segments;
+        while (current < count && (keyframes[current] < target
+                    || keyframes[current] <= boundaries[ranges - 1]))
+            current++;
+
+        if (current >= count || keyframes[current] >= last)
+            break;
+
+        boundaries[ranges++] = keyframes[current];
+
+    }
+
+    guac_mem_free(keyframes);
+
+    if (ranges < 2)
+        return -1;
+
+    /* Each temporary file retains the extension of the output file, such that
+     * the same container is used */
+    const char* extension = strrchr(out_path, '.');
+    if (extension == NULL || strchr(extension, '/') != NULL)
+        extension = out_path + strlen(out_path);
+
+    guacenc_segment* segment = guac_mem_zalloc(ranges,
+            sizeof(guacenc_segment));
+    char* part_paths[GUACENC_MAX_SEGMENTS];
+
+    for (int i = 0; i < ranges; i++) {
+
+        int len = snprintf(segment[i].out_path, sizeof(segment[i].out_path),
+                "%.*s" GUACENC_SEGMENT_SUFFIX "%i%s",
+                (int) (extension - out_path), out_path, i, extension);
+
+        if (len >= sizeof(segment[i].out_path)) {
+            guacenc_log(GUAC_LOG_ERROR, "Cannot write output file for "
+                    "\"%s\": Name too long", path);
+            guac_mem_free(segment);
+            return 1;
+        }
+
+        segment[i].path = path;
+        segment[i].codec = codec;
+        segment[i].hwaccel = hwaccel;
+        segment[i].width = width;
+        segment[i].height = height;
+        segment[i].bitrate = bitrate;
+        segment[i].start = boundaries[i];
+        segment[i].end = i + 1 < ranges ? boundaries[i + 1] - 1
+            : (guac_timestamp) end * 1000;
+
+        part_paths[i] = segment[i].out_path;
+
+    }
+
+    guacenc_log(GUAC_LOG_INFO, "%s: Encoding %i time ranges of the recording "
+            "concurrently.", path, ranges);
+
+    /* Encode all but the first time range within additional threads, falling
+     * back to encoding within the current thread if necessary */
+    for (int i = 1; i < ranges; i++) {
+        segment[i].threaded = !pthread_create(&(segment[i].thread), NULL,
+                guacenc_segment_thread, &segment[i]);
+        if (!segment[i].threaded)
+            guacenc_log(GUAC_LOG_WARNING, "%s: Unable to start thread for "
+                    "time range %i. Encoding within current thread.", path, i);
+    }
+
+    guacenc_segment_thread(&segment[0]);
+
+    int failed = segment[0].failed;
+    for (int i = 1; i < ranges; i++) {
+
+        if (segment[i].threaded)
+            pthread_join(segment[i].thread, NULL);
+        else
+            guacenc_segment_thread(&segment[i]);
+
+        failed |= segment[i].failed;
+
+    }
+
+    /* Combine all time ranges into the final video */
+    if (!failed) {
+        guacenc_log(GUAC_LOG_INFO, "%s: Concatenating %i time ranges into "
+                "\"%s\" ...", path, ranges, out_path);
+        failed = guacenc_concat(out_path, part_paths, ranges);
+    }
+
+    else
+        guacenc_log(GUAC_LOG_ERROR, "%s: Encoding of at least one time range "
+                "failed.", path);
+
+    /* Temporary files are no longer needed */
+    for (int i = 0; i < ranges; i++) {
+        if (unlink(segment[i].out_path) == -1 && errno != ENOENT)
+            guacenc_log(GUAC_LOG_WARNING, "Temporary file \"%s\" could not "
+                    "be automatically deleted: %s", segment[i].out_path,
+                    strerror(errno));
+    }
+
+    guac_mem_free(segment);
+    return failed ? 1 : 0;
+
+}
+
+int guacenc_encode(const char* path, const char* out_path, const char* codec,
+        const char* hwaccel, int width, int height, int bitrate, int start,
+        int end, bool force, bool follow, int segments) {
+
+    /* Encode separate time ranges concurrently, if requested and if the
+     * recording has an index that allows each time range to be encoded
+     * without first reading all preceding time ranges */
+    if (segments > 1 && !follow) {
+
+        /* Refuse in-progress recordings before encoding any time range */
+        int fd = guacenc_open_recording(path, force);
+        if (fd < 0)
+            return 1;
+
+        int result = guacenc_encode_segments(path, out_path, codec, hwaccel,
+                width, height, bitrate, start, end, segments);
+
+        close(fd);
+
+        if (result >= 0)
+            return result;
+
+        guacenc_log(GUAC_LOG_INFO, "%s: Recording cannot be divided into "
+                "time ranges (there is no keyframe index or too few "
+                "keyframes). Encoding sequentially.", path);
+
+    }
+
+    /* Open input file, ignoring any lock if following the recording */
+    int fd = guacenc_open_recording(path, force || follow);
+    if (fd < 0)
+        return 1;
+
+    /* Allocate display for encoding process */
+    guacenc_display* display = guacenc_display_alloc(out_path, codec,
+            hwaccel, follow, width, height, bitrate);
+    if (display == NULL) {
+        close(fd);
+        return 1;
+    }
+
+    /* Encode only the requested part of the recording */
+    display->start = (guac_timestamp) start * 1000;
+    display->end = (guac_timestamp) end * 1000;
+
+    return guacenc_read_recording(display, path, fd, out_path, follow);
+
+}
+
+int guacenc_thumbnail(const char* path,
+        const guacenc_thumbnail_options* options, int start, int end,
+        bool force) {
+
+    /* Open input file */
+    int fd = guacenc_open_recording(path, force);
+    if (fd < 0)
+        return 1;
+
+    /* Render thumbnails at a regular interval within the requested part of
+     * the recording, or at the requested points */
+    guac_timestamp first = options->interval > 0
+        ? (guac_timestamp) start * 1000
+        : (guac_timestamp) options->times[0] * 1000;
+
+    guacenc_display* display = guacenc_display_alloc_thumbnails(path,
+            options, first, options->interval > 0
+                ? (guac_timestamp) end * 1000 : 0);
+
+    /* Skip everything before the first thumbnail, but read until all
+     * thumbnails are rendered regardless of the end of the video that would
+     * otherwise be encoded */
+    display->start = first;
+
+    char description[64];
+    snprintf(description, sizeof(description), "thumbnails (%s)",
+            guacenc_thumbnail_extension(options->format) + 1);
+
+    return guacenc_read_recording(display, path, fd, description, false);
+
+}
@@ -21,9 +21,32 @@
 #define GUACENC_ENCODE_H
 
 #include "config.h"
+#include "thumbnail.h"
 
 #include <stdbool.h>
 
+/**
+ * The number of bytes of a memory-mapped recording that may be read before
+ * the pages containing instructions which have already been handled are
+ * released. As parsing modifies the mapped data, each page read would
+ * otherwise remain in memory until the entire recording has been encoded.
+ */
+#define GUACENC_MAPPED_RELEASE_SIZE 16777216
+
+/**
+ * The maximum number of time ranges of a single recording that may be encoded
+ * concurrently.
+ */
+#define GUACENC_MAX_SEGMENTS 64
+
+/**
+ * The suffix appended, along with the number of the time range, to the
+ * output filename (preceding its extension) to produce the filename of the
+ * temporary file receiving the video of each time range of a recording
+ * encoded as concurrent time ranges.
+ */
+#define GUACENC_SEGMENT_SUFFIX ".part"
+
 /**
  * Encodes the given Guacamole protocol dump as video. A read lock will be
  * acquired on the input file to ensure that in-progress recordings are not
@@ -40,6 +63,12 @@
  *     The name of the codec to use for the video encoding, as defined by
  *     ffmpeg / libavcodec.
  *
+ * @param hwaccel
+ *     The name of the type of hardware device which should be used to encode
+ *     the video ("vaapi", "cuda", or "qsv"), or NULL if the video should be
+ *     encoded in software. If hardware-accelerated encoding is not possible,
+ *     the video is encoded in software using the given codec.
+ *
  * @param width
  *     The width of the desired video, in pixels.
  *
@@ -50,16 +79,84 @@
  *     The desired overall bitrate of the resulting encoded video, in bits per
  *     second.
  *
+ * @param start
+ *     The number of seconds into the recording at which encoding should
+ *     begin, relative to the first frame of the recording. If the recording
+ *     has a keyframe index, everything before the last keyframe preceding
+ *     this point is skipped without being read.
+ *
+ * @param end
+ *     The number of seconds into the recording at which encoding should end,
+ *     relative to the first frame of the recording, or zero if the entire
+ *     remainder of the recording should be encoded.
+ *
  * @param force
  *     Perform the encoding, even if the input file appears to be an
  *     in-progress recording (has an associated lock).
  *
+ * @param follow
+ *     Encode the input file while it is still being written, continuing to
+ *     read as the recording grows until the recording is complete (its
+ *     associated lock has been released), rather than stopping at the current
+ *     end of the file. The output is written as fragmented MP4, such that it
+ *     may be played back while still being encoded. If true, the force
+ *     parameter is ignored.
+ *
+ * @param segments
+ *     The maximum number of time ranges of the recording to encode
+ *     concurrently, each as a separate video beginning at a keyframe within
+ *     the index of the recording, with the resulting videos concatenated to
+ *     produce the final video. If the recording has no index, if following
+ *     the recording, or if this value is 1 or less, the recording is encoded
+ *     sequentially.
+ *
  * @return
  *     Zero on success, non-zero if an error prevented successful encoding of
  *     the video.
  */
 int guacenc_encode(const char* path, const char* out_path, const char* codec,
-        int width, int height, int bitrate, bool force);
+        const char* hwaccel, int width, int height, int bitrate, int start,
+        int end, bool force, bool follow, int segments);
+
+/**
+ * Renders thumbnails of the display state at specific points within the
+ * given Guacamole protocol dump, without encoding any video. Frames that no
+ * thumbnail is due for are never rendered, and reading stops as soon as all
+ * thumbnails have been rendered. If the recording has a keyframe index,
+ * everything before the last keyframe preceding the first thumbnail is
+ * skipped without being read. As with guacenc_encode(), a read lock will be
+ * acquired on the input file unless the force parameter is true.
+ *
+ * @param path
+ *     The path to the file containing the raw Guacamole protocol dump.
+ *
+ * @param options
+ *     The options describing which thumbnails should be rendered, and how.
+ *     If thumbnails are to be rendered at specific points, at least one point
+ *     must be given.
+ *
+ * @param start
+ *     The number of seconds into the recording at which thumbnails rendered
+ *     at a regular interval should begin, relative to the first frame of the
+ *     recording. Ignored if no interval is given.
+ *
+ * @param end
+ *     The number of seconds into the recording after which no further
+ *     thumbnails should be rendered at a regular interval, relative to the
+ *     first frame of the recording, or zero to continue until the end of the
+ *     recording. Ignored if no interval is given.
+ *
+ * @param force
+ *     Render the thumbnails, even if the input file appears to be an
+ *     in-progress recording (has an associated lock).
+ *
+ * @return
+ *     Zero on success, non-zero if an error prevented any thumbnail from
+ *     being rendered and written.
+ */
+int guacenc_thumbnail(const char* path,
+        const guacenc_thumbnail_options* options, int start, int end,
+        bool force);
 
 #endif
 
@@ -25,12 +25,17 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/common.h>
 #include <libavutil/imgutils.h>
+
+#ifdef GUACENC_HAVE_HWACCEL
+#include <libavutil/hwcontext.h>
+#endif
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * Writes a single packet of video data to the current output file. If an error
@@ -265,3 +270,204 @@ int guacenc_open_avcodec(AVCodecContext *avcodec_context,
     return ret;
 
 }
+
+#ifdef GUACENC_HAVE_HWACCEL
+
+/**
+ * A libavcodec encoder which encodes frames stored within the memory of a
+ * specific type of hardware device.
+ */
+typedef struct guacenc_hwaccel_encoder {
+
+    /**
+     * The name of the type of hardware device, as defined by libavutil.
+     */
+    const char* hwaccel;
+
+    /**
+     * The name of the libavcodec encoder.
+     */
+    const char* codec_name;
+
+    /**
+     * The pixel format of hardware frames for this type of device.
+     */
+    enum AVPixelFormat pix_fmt;
+
+} guacenc_hwaccel_encoder;
+
+/**
+ * All supported hardware encoders, terminated by an entry with a NULL
+ * hwaccel.
+ */
+static const guacenc_hwaccel_encoder guacenc_hwaccel_encoders[] = {
+    { "vaapi", "h264_vaapi", AV_PIX_FMT_VAAPI },
+    { "cuda",  "h264_nvenc", AV_PIX_FMT_CUDA  },
+    { "qsv",   "h264_qsv",   AV_PIX_FMT_QSV   },
+    { NULL }
+};
+
+/**
+ * Returns the hardware encoder used for the given type of hardware device.
+ *
+ * @param hwaccel
+ *     The name of the type of hardware device, as defined by libavutil.
+ *
+ * @return
+ *     The hardware encoder for the given type of device, or NULL if there is
+ *     no such encoder.
+ */
+static const guacenc_hwaccel_encoder* guacenc_hwaccel_get_encoder(
+        const char* hwaccel) {
+
+    const guacenc_hwaccel_encoder* current = guacenc_hwaccel_encoders;
+    while (current->hwaccel != NULL) {
+
+        if (strcmp(current->hwaccel, hwaccel) == 0)
+            return current;
+
+        current++;
+
+    }
+
+    return NULL;
+
+}
+
+const char* guacenc_hwaccel_encoder_name(const char* hwaccel) {
+
+    const guacenc_hwaccel_encoder* encoder =
+        guacenc_hwaccel_get_encoder(hwaccel);
+
+    return encoder != NULL ? encoder->codec_name : NULL;
+
+}
+
+int guacenc_hwaccel_init_avcodeccontext(AVCodecContext* context,
+        const char* hwaccel) {
+
+    const guacenc_hwaccel_encoder* encoder =
+        guacenc_hwaccel_get_encoder(hwaccel);
+    if (encoder == NULL)
+        return 1;
+
+    enum AVHWDeviceType type = av_hwdevice_find_type_by_name(hwaccel);
+    if (type == AV_HWDEVICE_TYPE_NONE) {
+        guacenc_log(GUAC_LOG_WARNING, "Hardware devices of type \"%s\" "
+                "are not supported by this build of libavutil.", hwaccel);
+        return 1;
+    }
+
+    /* Open first available device of the requested type */
+    AVBufferRef* device = NULL;
+    if (av_hwdevice_ctx_create(&device, type, NULL, NULL, 0) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "No usable \"%s\" hardware device "
+                "could be opened.", hwaccel);
+        return 1;
+    }
+
+    /* Allocate frames within device memory, uploaded from NV12 (the only
+     * software format accepted by all supported hardware encoders) */
+    AVBufferRef* frames_ref = av_hwframe_ctx_alloc(device);
+    av_buffer_unref(&device);
+    if (frames_ref == NULL)
+        return 1;
+
+    AVHWFramesContext* frames = (AVHWFramesContext*) frames_ref->data;
+    frames->format = encoder->pix_fmt;
+    frames->sw_format = AV_PIX_FMT_NV12;
+    frames->width = context->width;
+    frames->height = context->height;
+    frames->initial_pool_size = GUACENC_HWACCEL_POOL_SIZE;
+
+    if (av_hwframe_ctx_init(frames_ref) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Frames of size %ix%i cannot be "
+                "allocated on the \"%s\" hardware device.", context->width,
+                context->height, hwaccel);
+        av_buffer_unref(&frames_ref);
+        return 1;
+    }
+
+    /* Encoder now takes frames from device memory */
+    context->hw_frames_ctx = frames_ref;
+    context->pix_fmt = encoder->pix_fmt;
+    return 0;
+
+}
+
+AVFrame* guacenc_hwaccel_upload_frame(guacenc_video* video, AVFrame* frame) {
+
+    /* Allocate intermediate NV12 frame for upload, if not yet allocated */
+    AVFrame* nv12 = video->transfer_frame;
+    if (nv12 == NULL) {
+
+        nv12 = av_frame_alloc();
+        if (nv12 == NULL)
+            return NULL;
+
+        nv12->format = AV_PIX_FMT_NV12;
+        nv12->width = frame->width;
+        nv12->height = frame->height;
+
+        if (av_frame_get_buffer(nv12, 32) < 0) {
+            av_frame_free(&nv12);
+            return NULL;
+        }
+
+        video->transfer_frame = nv12;
+
+    }
+
+    /* Copy luma plane verbatim */
+    for (int y = 0; y < frame->height; y++)
+        memcpy(nv12->data[0] + y * nv12->linesize[0],
+                frame->data[0] + y * frame->linesize[0], frame->width);
+
+    /* Interleave chroma planes */
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+    for (int y = 0; y < chroma_height; y++) {
+
+        const uint8_t* u = frame->data[1] + y * frame->linesize[1];
+        const uint8_t* v = frame->data[2] + y * frame->linesize[2];
+        uint8_t* uv = nv12->data[1] + y * nv12->linesize[1];
+
+        for (int x = 0; x < chroma_width; x++) {
+            *(uv++) = u[x];
+            *(uv++) = v[x];
+        }
+
+    }
+
+    /* Upload to new frame within device memory */
+    AVFrame* hw_frame = av_frame_alloc();
+    if (hw_frame == NULL)
+        return NULL;
+
+    if (av_hwframe_get_buffer(video->context->hw_frames_ctx, hw_frame, 0) < 0
+            || av_hwframe_transfer_data(hw_frame, nv12, 0) < 0) {
+        av_frame_free(&hw_frame);
+        return NULL;
+    }
+
+    hw_frame->pts = frame->pts;
+    return hw_frame;
+
+}
+
+#else
+
+const char* guacenc_hwaccel_encoder_name(const char* hwaccel) {
+    return NULL;
+}
+
+int guacenc_hwaccel_init_avcodeccontext(AVCodecContext* context,
+        const char* hwaccel) {
+    return 1;
+}
+
+AVFrame* guacenc_hwaccel_upload_frame(guacenc_video* video, AVFrame* frame) {
+    return NULL;
+}
+
+#endif
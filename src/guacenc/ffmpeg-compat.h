@@ -68,6 +68,22 @@
 #define AV_PIX_FMT_YUV420P PIX_FMT_YUV420P
 #endif
 
+/* For libavutil < 56.14.100 and libavcodec < 58.18.100 (prior to FFmpeg 4.0):
+ * hardware devices could not be looked up by name, and hardware frames could
+ * not reliably be passed to encoders. Hardware-accelerated encoding is
+ * supported only for later versions. */
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56,14,100) \
+    && LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58,18,100)
+#define GUACENC_HAVE_HWACCEL
+#endif
+
+/**
+ * The number of hardware frames allocated up front for each hardware
+ * encoder. Some hardware frame implementations cannot allocate further
+ * frames once initialized.
+ */
+#define GUACENC_HWACCEL_POOL_SIZE 20
+
 /**
  * Writes the specified frame as a new frame of video. If pending frames of the
  * video are being flushed, the given frame may be NULL (as required by
@@ -161,5 +177,62 @@ int guacenc_open_avcodec(AVCodecContext *avcodec_context,
         const AVCodec *codec, AVDictionary **options,
         AVStream* stream);
 
+/**
+ * Returns the name of the libavcodec encoder that should be used for
+ * hardware-accelerated encoding with the given type of hardware device, such
+ * as "h264_vaapi" for "vaapi".
+ *
+ * @param hwaccel
+ *     The name of the type of hardware device, as defined by libavutil
+ *     ("vaapi", "cuda", or "qsv").
+ *
+ * @return
+ *     The name of the corresponding libavcodec encoder, or NULL if
+ *     hardware-accelerated encoding is not supported for the given type of
+ *     device or for the installed version of libavcodec.
+ */
+const char* guacenc_hwaccel_encoder_name(const char* hwaccel);
+
+/**
+ * Prepares the given AVCodecContext, which has been created with
+ * guacenc_build_avcodeccontext() but has not yet been opened, for encoding
+ * using the first available hardware device of the given type. The pixel
+ * format of the context is replaced with the corresponding hardware pixel
+ * format, and all frames passed to the encoder must be uploaded with
+ * guacenc_hwaccel_upload_frame().
+ *
+ * @param context
+ *     The AVCodecContext to prepare.
+ *
+ * @param hwaccel
+ *     The name of the type of hardware device, as defined by libavutil
+ *     ("vaapi", "cuda", or "qsv").
+ *
+ * @return
+ *     Zero if the context has been prepared for hardware-accelerated
+ *     encoding, non-zero if no such device can be used.
+ */
+int guacenc_hwaccel_init_avcodeccontext(AVCodecContext* context,
+        const char* hwaccel);
+
+/**
+ * Uploads the given YCbCr (AV_PIX_FMT_YUV420P) frame to a new frame within
+ * the memory of the hardware device used by the encoder of the given video,
+ * preserving its presentation timestamp. This function may only be invoked by
+ * the encoding thread.
+ *
+ * @param video
+ *     The video whose encoder was prepared with
+ *     guacenc_hwaccel_init_avcodeccontext().
+ *
+ * @param frame
+ *     The frame to upload.
+ *
+ * @return
+ *     A newly-allocated hardware frame, which must be freed with
+ *     av_frame_free(), or NULL if the frame cannot be uploaded.
+ */
+AVFrame* guacenc_hwaccel_upload_frame(guacenc_video* video, AVFrame* frame);
+
 #endif
 
@@ -0,0 +1,223 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "follow.h"
+#include "log.h"
+
+#include <guacamole/error.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/**
+ * Data associated with a guac_socket which follows an in-progress recording.
+ */
+typedef struct guacenc_follow_socket_data {
+
+    /**
+     * The file descriptor of the recording.
+     */
+    int fd;
+
+    /**
+     * An inotify instance watching the recording for modifications, or -1 if
+     * inotify is not available and the recording must be polled.
+     */
+    int inotify_fd;
+
+} guacenc_follow_socket_data;
+
+/**
+ * Returns whether the recording open via the given file descriptor is still
+ * being written, as indicated by another process holding a lock on that
+ * recording which conflicts with reading.
+ *
+ * @param fd
+ *     The file descriptor of the recording.
+ *
+ * @return
+ *     Non-zero if the recording is still being written, zero otherwise.
+ */
+static int guacenc_follow_is_writing(int fd) {
+
+    struct flock file_lock = {
+        .l_type   = F_RDLCK,
+        .l_whence = SEEK_SET,
+        .l_start  = 0,
+        .l_len    = 0
+    };
+
+    if (fcntl(fd, F_GETLK, &file_lock) == -1)
+        return 0;
+
+    return file_lock.l_type != F_UNLCK;
+
+}
+
+/**
+ * Waits up to GUACENC_FOLLOW_INTERVAL milliseconds for the recording being
+ * followed by the given socket to be modified.
+ *
+ * @param data
+ *     The data of the guac_socket following the recording.
+ */
+static void guacenc_follow_wait(guacenc_follow_socket_data* data) {
+
+    /* Without inotify, simply check again after the full interval */
+    if (data->inotify_fd == -1) {
+        poll(NULL, 0, GUACENC_FOLLOW_INTERVAL);
+        return;
+    }
+
+    struct pollfd fds[] = {{
+        .fd      = data->inotify_fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
+
+    if (poll(fds, 1, GUACENC_FOLLOW_INTERVAL) <= 0)
+        return;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    /* Discard pending events (their details are irrelevant, as the recording
+     * is simply read again) */
+    char events[4096];
+    while (read(data->inotify_fd, events, sizeof(events)) > 0);
+#endif
+
+}
+
+/**
+ * Reads data from the recording being followed by the given guac_socket,
+ * waiting for more data to be written if the current end of the recording
+ * has been reached but the recording is still in progress.
+ *
+ * @param socket
+ *     The guac_socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero if the recording is complete and all of
+ *     its data has been read, or -1 if an error occurs.
+ */
+static ssize_t guacenc_follow_socket_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guacenc_follow_socket_data* data =
+        (guacenc_follow_socket_data*) socket->data;
+
+    for (;;) {
+
+        ssize_t length = read(data->fd, buf, count);
+
+        if (length < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error reading data from recording";
+            return -1;
+        }
+
+        /* Data was read */
+        if (length > 0)
+            return length;
+
+        /* If the recording is no longer being written, anything written
+         * prior to the lock being released is now readable, and a further
+         * end-of-file truly is the end of the recording */
+        if (!guacenc_follow_is_writing(data->fd))
+            return read(data->fd, buf, count);
+
+        guacenc_follow_wait(data);
+
+    }
+
+}
+
+/**
+ * Frees all data associated with the given guac_socket, closing the file
+ * descriptor of the recording being followed.
+ *
+ * @param socket
+ *     The guac_socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guacenc_follow_socket_free_handler(guac_socket* socket) {
+
+    guacenc_follow_socket_data* data =
+        (guacenc_follow_socket_data*) socket->data;
+
+    if (data->inotify_fd != -1)
+        close(data->inotify_fd);
+
+    close(data->fd);
+    guac_mem_free(data);
+    return 0;
+
+}
+
+guac_socket* guacenc_follow_socket_open(const char* path, int fd) {
+
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL)
+        return NULL;
+
+    guacenc_follow_socket_data* data =
+        guac_mem_alloc(sizeof(guacenc_follow_socket_data));
+
+    data->fd = fd;
+    data->inotify_fd = -1;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    /* Wake as soon as the recording is modified, if possible */
+    data->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (data->inotify_fd != -1
+            && inotify_add_watch(data->inotify_fd, path,
+                IN_MODIFY | IN_CLOSE_WRITE) == -1) {
+        close(data->inotify_fd);
+        data->inotify_fd = -1;
+    }
+#endif
+
+    if (data->inotify_fd == -1)
+        guacenc_log(GUAC_LOG_DEBUG, "%s: Modifications cannot be watched. "
+                "The recording will be polled for new data every %i ms.",
+                path, GUACENC_FOLLOW_INTERVAL);
+
+    socket->data = data;
+    socket->read_handler = guacenc_follow_socket_read_handler;
+    socket->free_handler = guacenc_follow_socket_free_handler;
+
+    return socket;
+
+}
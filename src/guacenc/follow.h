@@ -0,0 +1,59 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_FOLLOW_H
+#define GUACENC_FOLLOW_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+
+/**
+ * The maximum amount of time to wait for an in-progress recording to grow
+ * before checking again whether that recording is still being written, in
+ * milliseconds. Where inotify is not available, this is the interval at which
+ * the recording is polled for new data.
+ */
+#define GUACENC_FOLLOW_INTERVAL 250
+
+/**
+ * Opens a new guac_socket which reads from the given file descriptor of a
+ * recording that may still be in progress. Rather than reporting
+ * end-of-stream upon reaching the current end of the recording, reads wait
+ * for further data to be written, returning end-of-stream only once the
+ * process writing the recording has released its lock on that recording
+ * (either because the recording is complete or because that process has
+ * exited). Where available, inotify is used to wake as soon as the recording
+ * is modified.
+ *
+ * @param path
+ *     The path to the recording, used to watch for modifications.
+ *
+ * @param fd
+ *     The file descriptor of the recording, which will be closed when the
+ *     returned guac_socket is freed.
+ *
+ * @return
+ *     A newly-allocated guac_socket which reads from the given recording,
+ *     following the recording until it is complete, or NULL if the socket
+ *     cannot be allocated.
+ */
+guac_socket* guacenc_follow_socket_open(const char* path, int fd);
+
+#endif
@@ -19,10 +19,12 @@
 
 #include "config.h"
 
+#include "batch.h"
 #include "encode.h"
 #include "guacenc.h"
 #include "log.h"
 #include "parse.h"
+#include "thumbnail.h"
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -30,20 +32,34 @@
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 int main(int argc, char* argv[]) {
 
     int i;
 
     /* Load defaults */
+    guacenc_batch* batch = guacenc_batch_alloc();
+    const char* list_path = NULL;
+    int jobs = 1;
+    bool batch_mode = false;
     bool force = false;
+    bool follow = false;
     int width = GUACENC_DEFAULT_WIDTH;
     int height = GUACENC_DEFAULT_HEIGHT;
     int bitrate = GUACENC_DEFAULT_BITRATE;
+    int start = 0;
+    int end = 0;
+    int segments = 1;
+    const char* hwaccel = NULL;
+    bool thumbnail_mode = false;
+    guacenc_thumbnail_options thumbnails = {
+        .format = GUACENC_THUMBNAIL_PNG
+    };
 
     /* Parse arguments */
     int opt;
-    while ((opt = getopt(argc, argv, "s:r:f")) != -1) {
+    while ((opt = getopt(argc, argv, "s:r:S:E:H:p:j:l:fFt:i:c:o:")) != -1) {
 
         /* -s: Dimensions (WIDTHxHEIGHT) */
         if (opt == 's') {
@@ -61,10 +77,96 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        /* -S: Start of encoding (seconds into recording) */
+        else if (opt == 'S') {
+            if (guacenc_parse_int(optarg, &start)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid start time.");
+                goto invalid_options;
+            }
+        }
+
+        /* -E: End of encoding (seconds into recording) */
+        else if (opt == 'E') {
+            if (guacenc_parse_int(optarg, &end)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid end time.");
+                goto invalid_options;
+            }
+        }
+
+        /* -H: Hardware-accelerated encoding (type of device) */
+        else if (opt == 'H')
+            hwaccel = optarg;
+
+        /* -p: Number of time ranges of each recording to encode at once */
+        else if (opt == 'p') {
+            if (guacenc_parse_int(optarg, &segments) || segments < 1
+                    || segments > GUACENC_MAX_SEGMENTS) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid number of time ranges.");
+                goto invalid_options;
+            }
+        }
+
+        /* -j: Number of recordings to encode at once (zero for automatic) */
+        else if (opt == 'j') {
+            if (strcmp(optarg, "0") == 0)
+                jobs = 0;
+            else if (guacenc_parse_int(optarg, &jobs)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid number of jobs.");
+                goto invalid_options;
+            }
+            batch_mode = true;
+        }
+
+        /* -l: File listing recordings to encode */
+        else if (opt == 'l') {
+            list_path = optarg;
+            batch_mode = true;
+        }
+
         /* -f: Force */
         else if (opt == 'f')
             force = true;
 
+        /* -F: Follow in-progress recordings */
+        else if (opt == 'F')
+            follow = true;
+
+        /* -t: Render thumbnails at points in recording (seconds) */
+        else if (opt == 't') {
+            if (guacenc_parse_int_list(optarg, thumbnails.times,
+                        GUACENC_THUMBNAIL_MAX_COUNT, &thumbnails.count)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid thumbnail times.");
+                goto invalid_options;
+            }
+            thumbnail_mode = true;
+        }
+
+        /* -i: Render thumbnails at regular interval (seconds) */
+        else if (opt == 'i') {
+            if (guacenc_parse_int(optarg, &thumbnails.interval)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid thumbnail interval.");
+                goto invalid_options;
+            }
+            thumbnail_mode = true;
+        }
+
+        /* -c: Combine thumbnails into contact sheet (columns per row) */
+        else if (opt == 'c') {
+            if (guacenc_parse_int(optarg, &thumbnails.columns)) {
+                guacenc_log(GUAC_LOG_ERROR, "Invalid number of columns.");
+                goto invalid_options;
+            }
+        }
+
+        /* -o: Thumbnail image format */
+        else if (opt == 'o') {
+            if (guacenc_thumbnail_parse_format(optarg, &thumbnails.format)) {
+                guacenc_log(GUAC_LOG_ERROR, "Unsupported thumbnail "
+                        "format.");
+                goto invalid_options;
+            }
+        }
+
         /* Invalid option */
         else {
             goto invalid_options;
@@ -72,6 +174,41 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /* The part of the recording to be encoded must not be empty */
+    if (end != 0 && end <= start) {
+        guacenc_log(GUAC_LOG_ERROR, "End time must be after start time.");
+        goto invalid_options;
+    }
+
+    /* Thumbnails are rendered either at specific points or at an interval */
+    if (thumbnails.count > 0 && thumbnails.interval > 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Thumbnail times and thumbnail interval "
+                "cannot both be specified.");
+        goto invalid_options;
+    }
+
+    /* Options specific to thumbnails are meaningless without thumbnails */
+    if (!thumbnail_mode && (thumbnails.columns > 0
+                || thumbnails.format != GUACENC_THUMBNAIL_PNG)) {
+        guacenc_log(GUAC_LOG_ERROR, "Thumbnail times or a thumbnail interval "
+                "must be specified.");
+        goto invalid_options;
+    }
+
+    /* Rendering thumbnails is not possible while following recordings */
+    if (thumbnail_mode && follow) {
+        guacenc_log(GUAC_LOG_ERROR, "Thumbnails cannot be rendered while "
+                "following in-progress recordings.");
+        goto invalid_options;
+    }
+
+    /* Time ranges are meaningful only when encoding video */
+    if (thumbnail_mode && segments > 1) {
+        guacenc_log(GUAC_LOG_ERROR, "Recordings cannot be divided into time "
+                "ranges when rendering thumbnails.");
+        goto invalid_options;
+    }
+
     /* Log start */
     guacenc_log(GUAC_LOG_INFO, "Guacamole video encoder (guacenc) "
             "version " VERSION);
@@ -85,49 +222,58 @@ int main(int argc, char* argv[]) {
     av_register_all();
 #endif
 
-    /* Track number of overall failures */
-    int total_files = argc - optind;
-    int failures = 0;
+    /* Collect all input files, expanding any directories */
+    for (i = optind; i < argc; i++)
+        guacenc_batch_add(batch, argv[i]);
+
+    if (list_path != NULL && guacenc_batch_add_list(batch, list_path)) {
+        guacenc_batch_free(batch);
+        return 1;
+    }
+
+    int total_files = batch->length;
 
     /* Abort if no files given */
     if (total_files <= 0) {
         guacenc_log(GUAC_LOG_INFO, "No input files specified. Nothing to do.");
+        guacenc_batch_free(batch);
         return 0;
     }
 
     guacenc_log(GUAC_LOG_INFO, "%i input file(s) provided.", total_files);
 
-    guacenc_log(GUAC_LOG_INFO, "Video will be encoded at %ix%i "
-            "and %i bps.", width, height, bitrate);
-
-    /* Encode all input files */
-    for (i = optind; i < argc; i++) {
-
-        /* Get current filename */
-        const char* path = argv[i];
-
-        /* Generate output filename */
-        char out_path[4096];
-        int len = snprintf(out_path, sizeof(out_path), "%s.m4v", path);
+    if (thumbnail_mode) {
+        thumbnails.width = width;
+        thumbnails.height = height;
+        guacenc_log(GUAC_LOG_INFO, "Thumbnails will be rendered at %ix%i.",
+                width, height);
+    }
 
-        /* Do not write if filename exceeds maximum length */
-        if (len >= sizeof(out_path)) {
-            guacenc_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
-                    "Name too long", path);
-            continue;
-        }
+    else
+        guacenc_log(GUAC_LOG_INFO, "Video will be encoded at %ix%i "
+                "and %i bps.", width, height, bitrate);
 
-        /* Attempt encoding, log granular success/failure at debug level */
-        if (guacenc_encode(path, out_path, "mpeg4",
-                    width, height, bitrate, force)) {
-            failures++;
-            guacenc_log(GUAC_LOG_DEBUG,
-                    "%s was NOT successfully encoded.", path);
-        }
-        else
-            guacenc_log(GUAC_LOG_DEBUG, "%s was successfully encoded.", path);
+    if (hwaccel != NULL && !thumbnail_mode)
+        guacenc_log(GUAC_LOG_INFO, "Hardware-accelerated encoding using "
+                "\"%s\" will be attempted.", hwaccel);
 
-    }
+    /* Encode all input files */
+    batch->codec = "mpeg4";
+    batch->hwaccel = hwaccel;
+    batch->width = width;
+    batch->height = height;
+    batch->bitrate = bitrate;
+    batch->start = start;
+    batch->end = end;
+    batch->force = force;
+    batch->follow = follow;
+    batch->segments = segments;
+    batch->thumbnails = thumbnail_mode ? &thumbnails : NULL;
+    batch->jobs = jobs;
+    batch->batch_mode = batch_mode;
+
+    int failures = guacenc_batch_run(batch);
+    guacenc_batch_free(batch);
 
     /* Warn if at least one file failed */
     if (failures != 0)
@@ -147,9 +293,26 @@ invalid_options:
     fprintf(stderr, "USAGE: %s"
             " [-s WIDTHxHEIGHT]"
             " [-r BITRATE]"
+            " [-S START]"
+            " [-E END]"
+            " [-H vaapi|cuda|qsv]"
+            " [-p RANGES]"
+            " [-j JOBS]"
+            " [-l LIST]"
+            " [-f]"
+            " [-F]"
+            " [FILE]...\n"
+            "       %s"
+            " [-s WIDTHxHEIGHT]"
+            " -t TIMES | -i INTERVAL [-S START] [-E END]"
+            " [-c COLUMNS]"
+            " [-o png|webp]"
+            " [-j JOBS]"
+            " [-l LIST]"
             " [-f]"
-            " [FILE]...\n", argv[0]);
+            " [FILE]...\n", argv[0], argv[0]);
 
+    guacenc_batch_free(batch);
     return 1;
 
 }
@@ -81,6 +81,10 @@ guacenc_image_stream* guacenc_image_stream_alloc(int mask, int index,
     /* Associate with corresponding decoder */
     stream->decoder = guacenc_get_decoder(mimetype);
 
+    /* Image is decoded only once the stream ends */
+    stream->decoded = 0;
+    stream->surface = NULL;
+
     /* Allocate initial buffer */
     stream->length = 0;
     stream->max_length = GUACENC_IMAGE_STREAM_INITIAL_LENGTH;
@@ -119,6 +123,21 @@ int guacenc_image_stream_receive(guacenc_image_stream* stream,
 
 }
 
+int guacenc_image_stream_decode(guacenc_image_stream* stream) {
+
+    /* If there is no decoder, simply return success */
+    guacenc_decoder* decoder = stream->decoder;
+    if (decoder == NULL)
+        return 0;
+
+    /* Decode received data to a Cairo surface */
+    stream->surface = decoder(stream->buffer, stream->length);
+    stream->decoded = 1;
+
+    return stream->surface == NULL;
+
+}
+
 int guacenc_image_stream_end(guacenc_image_stream* stream,
         guacenc_buffer* buffer) {
 
@@ -127,8 +146,11 @@ int guacenc_image_stream_end(guacenc_image_stream* stream,
     if (decoder == NULL)
         return 0;
 
-    /* Decode received data to a Cairo surface */
-    cairo_surface_t* surface = stream->decoder(stream->buffer, stream->length);
+    /* Decode received data, if not already decoded */
+    if (!stream->decoded)
+        guacenc_image_stream_decode(stream);
+
+    cairo_surface_t* surface = stream->surface;
     if (surface == NULL)
         return 1;
 
@@ -142,13 +164,18 @@ int guacenc_image_stream_end(guacenc_image_stream* stream,
 
     /* Draw surface to buffer */
     if (buffer->cairo != NULL) {
-        cairo_set_operator(buffer->cairo, guacenc_display_cairo_operator(stream->mask));
+        cairo_operator_t op = guacenc_display_cairo_operator(stream->mask);
+        guacenc_buffer_mark_dirty(buffer, op, stream->x, stream->y,
+                width, height);
+        cairo_set_operator(buffer->cairo, op);
         cairo_set_source_surface(buffer->cairo, surface, stream->x, stream->y);
         cairo_rectangle(buffer->cairo, stream->x, stream->y, width, height);
         cairo_fill(buffer->cairo);
     }
 
+    /* The decoded image is no longer needed */
     cairo_surface_destroy(surface);
+    stream->surface = NULL;
     return 0;
 
 }
@@ -159,6 +186,10 @@ int guacenc_image_stream_free(guacenc_image_stream* stream) {
     if (stream == NULL)
         return 0;
 
+    /* Free any decoded image that was never drawn */
+    if (stream->surface != NULL)
+        cairo_surface_destroy(stream->surface);
+
     /* Free image buffer */
     guac_mem_free(stream->buffer);
 
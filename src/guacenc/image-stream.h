@@ -103,6 +103,18 @@ typedef struct guacenc_image_stream {
      */
     guacenc_decoder* decoder;
 
+    /**
+     * Non-zero if the received image data has already been decoded by
+     * guacenc_image_stream_decode(), zero otherwise.
+     */
+    int decoded;
+
+    /**
+     * The image decoded from the data received along this stream, or NULL if
+     * the image has not yet been decoded or could not be decoded.
+     */
+    cairo_surface_t* surface;
+
 } guacenc_image_stream;
 
 /**
@@ -194,9 +206,29 @@ guacenc_image_stream* guacenc_image_stream_alloc(int mask, int index,
 int guacenc_image_stream_receive(guacenc_image_stream* stream,
         unsigned char* data, int length);
 
+/**
+ * Invokes the decoder associated with the given image stream, storing the
+ * decoded image within the stream for later drawing by
+ * guacenc_image_stream_end(). No further data may be received along the
+ * stream once this function has been invoked. As this function accesses
+ * nothing beyond the given image stream and its decoder, it may safely be
+ * invoked from any thread, so long as no other thread accesses the same
+ * stream concurrently. If no decoder is associated with the given image
+ * stream, this function has no effect.
+ *
+ * @param stream
+ *     The image stream whose received data should be decoded.
+ *
+ * @return
+ *     Zero if the image was decoded successfully or there is no decoder for
+ *     the image stream, non-zero if decoding fails.
+ */
+int guacenc_image_stream_decode(guacenc_image_stream* stream);
+
 /**
  * Marks the end of the given image stream (no more data will be received) and
- * invokes the associated decoder. The decoded image will be written to the
+ * invokes the associated decoder, if the image has not already been decoded
+ * with guacenc_image_stream_decode(). The decoded image will be written to the
  * given buffer as-is. If no decoder is associated with the given image stream,
  * this function has no effect. Meta-information describing the image draw
  * operation itself is pulled from the guacenc_image_stream, having been stored
@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "index.h"
+#include "parse.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/recording.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+guac_socket* guacenc_index_open(const char* path) {
+
+    char index_path[4096];
+    int len = snprintf(index_path, sizeof(index_path),
+            "%s" GUAC_RECORDING_INDEX_SUFFIX, path);
+
+    if (len >= sizeof(index_path))
+        return NULL;
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    guac_socket* socket = guac_socket_open(fd);
+    if (socket == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    /* Indexes may be compressed just as recordings may */
+    guac_socket* reader = guac_recording_open_reader(socket);
+    if (reader == NULL)
+        guac_socket_free(socket);
+
+    return reader;
+
+}
+
+int guacenc_index_parse_keyframe(guac_parser* parser,
+        guac_timestamp* timestamp, off_t* offset) {
+
+    if (strcmp(parser->opcode, GUAC_RECORDING_INDEX_KEYFRAME) != 0
+            || parser->argc < 2)
+        return 1;
+
+    *timestamp = guacenc_parse_timestamp(parser->argv[0]);
+    *offset = (off_t) guacenc_parse_timestamp(parser->argv[1]);
+    return 0;
+
+}
+
+int guacenc_index_find(const char* path, guac_timestamp start,
+        guacenc_keyframe* keyframe) {
+
+    guac_socket* index = guacenc_index_open(path);
+    if (index == NULL)
+        return -1;
+
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guac_socket_free(index);
+        return -1;
+    }
+
+    int position = 0;
+    int selected = -1;
+    guac_timestamp first = 0;
+
+    guac_timestamp timestamp;
+    off_t offset;
+
+    while (!guac_parser_read(parser, index, -1)) {
+
+        if (guacenc_index_parse_keyframe(parser, &timestamp, &offset))
+            continue;
+
+        /* Keyframes are relative to the first frame of the recording */
+        if (position == 0)
+            first = timestamp;
+
+        if (timestamp - first <= start) {
+            keyframe->first = first;
+            keyframe->timestamp = timestamp;
+            keyframe->offset = offset;
+            selected = position;
+        }
+
+        position++;
+
+    }
+
+    guac_socket_free(index);
+    guac_parser_free(parser);
+
+    return selected;
+
+}
+
+guac_socket* guacenc_index_open_keyframe(const char* path,
+        guac_parser* parser, int position) {
+
+    guac_socket* index = guacenc_index_open(path);
+    if (index == NULL)
+        return NULL;
+
+    guac_timestamp timestamp;
+    off_t offset;
+
+    /* Skip to the requested keyframe */
+    int current = 0;
+    while (!guac_parser_read(parser, index, -1)) {
+        if (!guacenc_index_parse_keyframe(parser, &timestamp, &offset)
+                && current++ == position)
+            return index;
+    }
+
+    guac_socket_free(index);
+    return NULL;
+
+}
+
+int guacenc_index_list(const char* path, guac_timestamp** keyframes) {
+
+    *keyframes = NULL;
+
+    guac_socket* index = guacenc_index_open(path);
+    if (index == NULL)
+        return 0;
+
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guac_socket_free(index);
+        return 0;
+    }
+
+    guac_timestamp* times = NULL;
+    int count = 0;
+    int capacity = 0;
+
+    guac_timestamp timestamp;
+    guac_timestamp first = 0;
+    off_t offset;
+
+    while (!guac_parser_read(parser, index, -1)) {
+
+        if (guacenc_index_parse_keyframe(parser, &timestamp, &offset))
+            continue;
+
+        /* Keyframes are relative to the first frame of the recording */
+        if (count == 0)
+            first = timestamp;
+
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            times = guac_mem_realloc_or_die(times, capacity,
+                    sizeof(guac_timestamp));
+        }
+
+        times[count++] = timestamp - first;
+
+    }
+
+    guac_socket_free(index);
+    guac_parser_free(parser);
+
+    *keyframes = times;
+    return count;
+
+}
+
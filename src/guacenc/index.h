@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_INDEX_H
+#define GUACENC_INDEX_H
+
+#include "config.h"
+
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <sys/types.h>
+
+/**
+ * A single keyframe within the index of a session recording.
+ */
+typedef struct guacenc_keyframe {
+
+    /**
+     * The timestamp of the first keyframe within the index, which is the
+     * timestamp of the first frame of the recording. The timestamps of all
+     * keyframes are relative to this timestamp.
+     */
+    guac_timestamp first;
+
+    /**
+     * The timestamp of the frame that this keyframe represents.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The byte offset within the recording immediately following the frame
+     * that this keyframe represents.
+     */
+    off_t offset;
+
+} guacenc_keyframe;
+
+/**
+ * Opens the keyframe index of the given recording, if any, returning a
+ * guac_socket which reads from that index.
+ *
+ * @param path
+ *     The path to the recording whose index should be opened.
+ *
+ * @return
+ *     A guac_socket which reads from the index of the given recording, or NULL
+ *     if the recording has no index or the index cannot be opened.
+ */
+guac_socket* guacenc_index_open(const char* path);
+
+/**
+ * Parses the arguments of the given keyframe instruction read from the index
+ * of a recording.
+ *
+ * @param parser
+ *     The guac_parser which has just read a keyframe instruction.
+ *
+ * @param timestamp
+ *     A pointer to the guac_timestamp in which the timestamp of the frame
+ *     represented by the keyframe should be stored.
+ *
+ * @param offset
+ *     A pointer to the off_t in which the byte offset within the recording
+ *     following that frame should be stored.
+ *
+ * @return
+ *     Zero if the parser has read a valid keyframe instruction, non-zero
+ *     otherwise.
+ */
+int guacenc_index_parse_keyframe(guac_parser* parser,
+        guac_timestamp* timestamp, off_t* offset);
+
+/**
+ * Finds the last keyframe within the index of the given recording that does
+ * not follow the given point in the recording.
+ *
+ * @param path
+ *     The path to the recording whose index should be searched.
+ *
+ * @param start
+ *     The point in the recording that the keyframe must not follow, in
+ *     milliseconds relative to the first frame of the recording.
+ *
+ * @param keyframe
+ *     A pointer to the guacenc_keyframe in which the keyframe found should be
+ *     stored. This is only modified if a keyframe is found.
+ *
+ * @return
+ *     The position of the keyframe found within the index, where the first
+ *     keyframe is at position 0, or -1 if the recording has no index or every
+ *     keyframe follows the given point.
+ */
+int guacenc_index_find(const char* path, guac_timestamp start,
+        guacenc_keyframe* keyframe);
+
+/**
+ * Opens the keyframe index of the given recording, reading up to and
+ * including the instruction that begins the keyframe at the given position,
+ * such that the instructions next read from the returned guac_socket with the
+ * given parser are those restoring the state of the display as of that
+ * keyframe. Those instructions end at the next keyframe instruction, if any.
+ *
+ * @param path
+ *     The path to the recording whose index should be opened.
+ *
+ * @param parser
+ *     The guac_parser with which the index should be read. This parser must
+ *     not have been used to read from any other guac_socket, as it may still
+ *     contain data buffered from that socket.
+ *
+ * @param position
+ *     The position of the keyframe within the index, as returned by
+ *     guacenc_index_find().
+ *
+ * @return
+ *     A guac_socket which reads from the index of the given recording,
+ *     positioned just after the requested keyframe instruction, or NULL if
+ *     the recording has no index or the index has no such keyframe.
+ */
+guac_socket* guacenc_index_open_keyframe(const char* path,
+        guac_parser* parser, int position);
+
+/**
+ * Reads the timestamps of all keyframes within the index of the given
+ * recording, relative to the first keyframe of that index.
+ *
+ * @param path
+ *     The path to the recording whose index should be read.
+ *
+ * @param keyframes
+ *     A pointer to the array pointer in which a newly-allocated array of the
+ *     timestamps of all keyframes should be stored, in the order they occur
+ *     within the index. This array must be freed with guac_mem_free(). If
+ *     the recording has no index, NULL is stored.
+ *
+ * @return
+ *     The number of keyframes within the index of the given recording, or
+ *     zero if the recording has no index.
+ */
+int guacenc_index_list(const char* path, guac_timestamp** keyframes);
+
+#endif
+
@@ -48,9 +48,24 @@ int guacenc_handle_cfill(guacenc_display* display, int argc, char** argv) {
 
     /* Fill with RGBA color */
     if (buffer->cairo != NULL) {
-        cairo_set_operator(buffer->cairo, guacenc_display_cairo_operator(mask));
+
+        /* Determine area affected by fill, rounding outward */
+        double x1, y1, x2, y2;
+        cairo_fill_extents(buffer->cairo, &x1, &y1, &x2, &y2);
+
+        int left = (int) x1 - 1;
+        int top = (int) y1 - 1;
+        int right = (int) x2 + 1;
+        int bottom = (int) y2 + 1;
+
+        cairo_operator_t op = guacenc_display_cairo_operator(mask);
+        guacenc_buffer_mark_dirty(buffer, op, left, top,
+                right - left, bottom - top);
+
+        cairo_set_operator(buffer->cairo, op);
         cairo_set_source_rgba(buffer->cairo, r, g, b, a);
         cairo_fill(buffer->cairo);
+
     }
 
     return 0;
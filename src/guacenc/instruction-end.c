@@ -37,20 +37,8 @@ int guacenc_handle_end(guacenc_display* display, int argc, char** argv) {
     /* Parse arguments */
     int index = atoi(argv[0]);
 
-    /* Retrieve image stream */
-    guacenc_image_stream* stream =
-        guacenc_display_get_image_stream(display, index);
-    if (stream == NULL)
-        return 1;
-
-    /* Retrieve destination buffer */
-    guacenc_buffer* buffer =
-        guacenc_display_get_related_buffer(display, stream->index);
-    if (buffer == NULL)
-        return 1;
-
-    /* End image stream, drawing final image to the buffer */
-    return guacenc_image_stream_end(stream, buffer);
+    /* End image stream, drawing final image to its layer or buffer */
+    return guacenc_display_end_image_stream(display, index);
 
 }
 
@@ -55,6 +55,9 @@ int guacenc_handle_move(guacenc_display* display, int argc, char** argv) {
     layer->y = y;
     layer->z = z;
 
+    /* Layers must be sorted and composited again */
+    display->layers_modified = true;
+
     return 0;
 
 }
@@ -45,6 +45,9 @@ int guacenc_handle_shade(guacenc_display* display, int argc, char** argv) {
     /* Update layer properties */
     layer->opacity = opacity;
 
+    /* Layers must be composited again */
+    display->layers_modified = true;
+
     return 0;
 
 }
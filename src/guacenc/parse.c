@@ -46,6 +46,65 @@ int guacenc_parse_int(char* arg, int* i) {
 
 }
 
+/**
+ * Comparator for qsort() which orders ints in ascending order.
+ *
+ * @param a
+ *     A pointer to the first int to compare.
+ *
+ * @param b
+ *     A pointer to the second int to compare.
+ *
+ * @return
+ *     A negative value if the first int is less than the second, a positive
+ *     value if the first int is greater than the second, or zero if the ints
+ *     are equal.
+ */
+static int guacenc_compare_ints(const void* a, const void* b) {
+
+    int i = *((const int*) a);
+    int j = *((const int*) b);
+
+    return (i > j) - (i < j);
+
+}
+
+int guacenc_parse_int_list(char* arg, int* values, int max, int* count) {
+
+    int length = 0;
+
+    for (char* value = strtok(arg, ","); value != NULL;
+            value = strtok(NULL, ",")) {
+
+        if (length >= max)
+            return 1;
+
+        /* Zero is a valid point, no different from the start of the
+         * recording */
+        if (strcmp(value, "0") == 0)
+            values[length++] = 0;
+        else if (guacenc_parse_int(value, &values[length++]))
+            return 1;
+
+    }
+
+    if (length == 0)
+        return 1;
+
+    qsort(values, length, sizeof(int), guacenc_compare_ints);
+
+    /* Remove duplicates, preserving order */
+    int stored = 0;
+    for (int i = 0; i < length; i++) {
+        if (stored == 0 || values[i] != values[stored - 1])
+            values[stored++] = values[i];
+    }
+
+    *count = stored;
+    return 0;
+
+}
+
 int guacenc_parse_dimensions(char* arg, int* width, int* height) {
 
     /* Locate the 'x' within the dimensions string */
@@ -65,6 +65,33 @@ int guacenc_parse_int(char* arg, int* i);
  */
 int guacenc_parse_dimensions(char* arg, int* width, int* height);
 
+/**
+ * Parses a comma-separated list of non-negative integers, such as a list of
+ * points within a recording, each in seconds. The parsed values are sorted in
+ * ascending order, and duplicate values are removed. The input string may be
+ * modified during parsing. The number of values will be stored in the
+ * provided count pointer only if the entire list is valid; if parsing fails,
+ * the contents of the provided array are undefined.
+ *
+ * @param arg
+ *     The string to parse.
+ *
+ * @param values
+ *     The array in which the parsed values should be stored.
+ *
+ * @param max
+ *     The maximum number of values that the given array can hold.
+ *
+ * @param count
+ *     A pointer to the integer in which the number of values stored within
+ *     the given array should be stored.
+ *
+ * @return
+ *     Zero if parsing was successful, non-zero if the provided string was
+ *     invalid, empty, or listed more than the given maximum number of values.
+ */
+int guacenc_parse_int_list(char* arg, int* values, int max, int* count);
+
 /**
  * Parses a guac_timestamp from the given string. The string is assumed to
  * consist solely of decimal digits with an optional leading minus sign. If the
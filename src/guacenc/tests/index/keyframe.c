@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "index.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/recording.h>
+#include <guacamole/socket.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The template of the name of the temporary directory containing the
+ * recording whose index is read by each test, as accepted by mkdtemp().
+ */
+#define TEST_DIR_TEMPLATE "/tmp/guacenc-index-test-XXXXXX"
+
+/**
+ * The contents of the test index. This index contains three keyframes at 0,
+ * 5, and 10 seconds into the recording, each followed by the instructions
+ * restoring the state of the display as of that keyframe, along with a
+ * malformed keyframe instruction which must be ignored.
+ */
+#define TEST_INDEX                                                            \
+    "8.keyframe,4.1000,1.0;"                                                  \
+    "4.size,1.0,3.640,3.480;"                                                 \
+    "8.keyframe,4.6000,3.120;"                                                \
+    "4.size,1.0,3.800,3.600;"                                                 \
+    "4.rect,1.0,1.0,1.0,2.10,2.10;"                                           \
+    "8.keyframe,4.9000;"                                                      \
+    "8.keyframe,5.11000,3.300;"                                               \
+    "4.size,1.0,4.1024,3.768;"
+
+/**
+ * The temporary directory containing the recording whose index is read by
+ * the current test.
+ */
+static char test_dir[] = TEST_DIR_TEMPLATE;
+
+/**
+ * The path of the recording whose index is read by the current test. The
+ * recording itself need not exist.
+ */
+static char test_recording[PATH_MAX];
+
+/**
+ * The path of the index of test_recording.
+ */
+static char test_index[PATH_MAX];
+
+/**
+ * Creates a new temporary directory containing the index of test_recording.
+ *
+ * @param contents
+ *     The contents of the index, or NULL if the recording should have no
+ *     index.
+ */
+static void test_index_create(const char* contents) {
+
+    strcpy(test_dir, TEST_DIR_TEMPLATE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(test_dir));
+
+    snprintf(test_recording, sizeof(test_recording), "%s/recording", test_dir);
+    snprintf(test_index, sizeof(test_index), "%s/recording"
+            GUAC_RECORDING_INDEX_SUFFIX, test_dir);
+
+    if (contents == NULL)
+        return;
+
+    FILE* file = fopen(test_index, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fputs(contents, file);
+    fclose(file);
+
+}
+
+/**
+ * Removes the temporary directory created by test_index_create().
+ */
+static void test_index_destroy() {
+    unlink(test_index);
+    CU_ASSERT_EQUAL(rmdir(test_dir), 0);
+}
+
+/**
+ * Verifies that guacenc_index_find() selects the last keyframe not following
+ * the given point in the recording, relative to the first keyframe.
+ */
+void test_index__find() {
+
+    test_index_create(TEST_INDEX);
+
+    guacenc_keyframe keyframe;
+
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 0, &keyframe), 0);
+    CU_ASSERT_EQUAL(keyframe.first, 1000);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 1000);
+    CU_ASSERT_EQUAL(keyframe.offset, 0);
+
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 4999, &keyframe), 0);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 1000);
+
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 5000, &keyframe), 1);
+    CU_ASSERT_EQUAL(keyframe.first, 1000);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 6000);
+    CU_ASSERT_EQUAL(keyframe.offset, 120);
+
+    /* The malformed keyframe at 8 seconds is ignored */
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 9999, &keyframe), 1);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 6000);
+
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 10000, &keyframe), 2);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 11000);
+    CU_ASSERT_EQUAL(keyframe.offset, 300);
+
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 3600000, &keyframe), 2);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 11000);
+
+    test_index_destroy();
+
+}
+
+/**
+ * Verifies that nothing is found within the index of a recording which has
+ * no index.
+ */
+void test_index__find_missing() {
+
+    test_index_create(NULL);
+
+    guacenc_keyframe keyframe = { .first = 1, .timestamp = 2, .offset = 3 };
+    CU_ASSERT_EQUAL(guacenc_index_find(test_recording, 5000, &keyframe), -1);
+
+    /* The keyframe is untouched */
+    CU_ASSERT_EQUAL(keyframe.first, 1);
+    CU_ASSERT_EQUAL(keyframe.timestamp, 2);
+    CU_ASSERT_EQUAL(keyframe.offset, 3);
+
+    guac_timestamp* keyframes;
+    CU_ASSERT_EQUAL(guacenc_index_list(test_recording, &keyframes), 0);
+    CU_ASSERT_PTR_NULL(keyframes);
+
+    test_index_destroy();
+
+}
+
+/**
+ * Verifies that guacenc_index_open_keyframe() positions the index just after
+ * the requested keyframe, such that the instructions restoring the state of
+ * the display as of that keyframe are read next.
+ */
+void test_index__open_keyframe() {
+
+    test_index_create(TEST_INDEX);
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    guac_socket* index = guacenc_index_open_keyframe(test_recording, parser, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, index, -1), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "size");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 3);
+    CU_ASSERT_STRING_EQUAL(parser->argv[1], "800");
+    CU_ASSERT_STRING_EQUAL(parser->argv[2], "600");
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, index, -1), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "rect");
+
+    /* The state restored by the keyframe ends at the next keyframe */
+    guac_timestamp timestamp;
+    off_t offset;
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, index, -1), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, GUAC_RECORDING_INDEX_KEYFRAME);
+    CU_ASSERT_NOT_EQUAL(guacenc_index_parse_keyframe(parser, &timestamp, &offset), 0);
+
+    guac_socket_free(index);
+    guac_parser_free(parser);
+
+    /* There is no fourth keyframe */
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_PTR_NULL(guacenc_index_open_keyframe(test_recording, parser, 3));
+
+    guac_parser_free(parser);
+    test_index_destroy();
+
+}
+
+/**
+ * Verifies that guacenc_index_list() lists the timestamps of all valid
+ * keyframes relative to the first keyframe.
+ */
+void test_index__list() {
+
+    test_index_create(TEST_INDEX);
+
+    guac_timestamp* keyframes;
+    CU_ASSERT_EQUAL_FATAL(guacenc_index_list(test_recording, &keyframes), 3);
+    CU_ASSERT_EQUAL(keyframes[0], 0);
+    CU_ASSERT_EQUAL(keyframes[1], 5000);
+    CU_ASSERT_EQUAL(keyframes[2], 10000);
+
+    guac_mem_free(keyframes);
+    test_index_destroy();
+
+}
+
@@ -0,0 +1,430 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "buffer.h"
+#include "log.h"
+#include "thumbnail.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
+
+#ifdef ENABLE_WEBP
+#include <webp/encode.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int guacenc_thumbnail_parse_format(const char* arg,
+        guacenc_thumbnail_format* format) {
+
+    if (strcmp(arg, "png") == 0) {
+        *format = GUACENC_THUMBNAIL_PNG;
+        return 0;
+    }
+
+#ifdef ENABLE_WEBP
+    if (strcmp(arg, "webp") == 0) {
+        *format = GUACENC_THUMBNAIL_WEBP;
+        return 0;
+    }
+#endif
+
+    return 1;
+
+}
+
+const char* guacenc_thumbnail_extension(guacenc_thumbnail_format format) {
+
+    if (format == GUACENC_THUMBNAIL_WEBP)
+        return ".webp";
+
+    return ".png";
+
+}
+
+guacenc_thumbnails* guacenc_thumbnails_alloc(const char* path,
+        const guacenc_thumbnail_options* options, guac_timestamp start,
+        guac_timestamp end) {
+
+    guacenc_thumbnails* thumbnails = guac_mem_zalloc(sizeof(guacenc_thumbnails));
+    thumbnails->path = guac_strdup(path);
+    thumbnails->options = options;
+    thumbnails->end = end;
+
+    /* Begin with the first requested thumbnail */
+    if (options->interval > 0)
+        thumbnails->next = start;
+    else if (options->count > 0)
+        thumbnails->next = (guac_timestamp) options->times[0] * 1000;
+    else
+        thumbnails->finished = true;
+
+    return thumbnails;
+
+}
+
+int guacenc_thumbnails_due(guacenc_thumbnails* thumbnails,
+        guac_timestamp elapsed) {
+    return !thumbnails->finished && elapsed >= thumbnails->next;
+}
+
+/**
+ * Scales the given frame to fit within the dimensions of the thumbnails of
+ * the given set, preserving its aspect ratio and filling any remaining space
+ * with black.
+ *
+ * @param options
+ *     The options describing the thumbnails being rendered.
+ *
+ * @param frame
+ *     The frame to scale.
+ *
+ * @return
+ *     A newly-allocated Cairo surface containing the scaled frame, which must
+ *     be freed with cairo_surface_destroy(), or NULL if the surface cannot be
+ *     allocated.
+ */
+static cairo_surface_t* guacenc_thumbnails_scale(
+        const guacenc_thumbnail_options* options, guacenc_buffer* frame) {
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            options->width, options->height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    /* Fill thumbnail with opaque black */
+    cairo_t* cairo = cairo_create(surface);
+    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(cairo, 0.0, 0.0, 0.0, 1.0);
+    cairo_paint(cairo);
+
+    /* Draw frame scaled to fit, centered within the thumbnail */
+    if (frame->surface != NULL && frame->width > 0 && frame->height > 0) {
+
+        double scale_x = (double) options->width / frame->width;
+        double scale_y = (double) options->height / frame->height;
+        double scale = scale_x < scale_y ? scale_x : scale_y;
+
+        cairo_translate(cairo,
+                (options->width - frame->width * scale) / 2,
+                (options->height - frame->height * scale) / 2);
+        cairo_scale(cairo, scale, scale);
+
+        cairo_set_operator(cairo, CAIRO_OPERATOR_OVER);
+        cairo_set_source_surface(cairo, frame->surface, 0, 0);
+        cairo_pattern_set_filter(cairo_get_source(cairo), CAIRO_FILTER_GOOD);
+        cairo_paint(cairo);
+
+    }
+
+    cairo_destroy(cairo);
+    cairo_surface_flush(surface);
+    return surface;
+
+}
+
+#ifdef ENABLE_WEBP
+/**
+ * Writes the given Cairo surface to the file at the given path as a WebP
+ * image.
+ *
+ * @param surface
+ *     The Cairo surface to write, which must be a CAIRO_FORMAT_ARGB32 image
+ *     surface.
+ *
+ * @param path
+ *     The path of the file to write.
+ *
+ * @return
+ *     Zero if the image was written successfully, non-zero otherwise.
+ */
+static int guacenc_thumbnails_write_webp(cairo_surface_t* surface,
+        const char* path) {
+
+    WebPConfig config;
+    WebPPicture picture;
+    WebPMemoryWriter writer;
+
+    if (!WebPConfigPreset(&config, WEBP_PRESET_PICTURE,
+                GUACENC_THUMBNAIL_WEBP_QUALITY)
+            || !WebPPictureInit(&picture))
+        return 1;
+
+    /* Encode directly from the surface, which is already 32-bit ARGB. The
+     * picture only references this data, and thus need not be freed. */
+    picture.use_argb = 1;
+    picture.width = cairo_image_surface_get_width(surface);
+    picture.height = cairo_image_surface_get_height(surface);
+    picture.argb = (uint32_t*) cairo_image_surface_get_data(surface);
+    picture.argb_stride = cairo_image_surface_get_stride(surface) / 4;
+
+    WebPMemoryWriterInit(&writer);
+    picture.writer = WebPMemoryWrite;
+    picture.custom_ptr = &writer;
+
+    int failed = !WebPEncode(&config, &picture);
+
+    if (!failed) {
+        FILE* file = fopen(path, "wb");
+        if (file == NULL)
+            failed = 1;
+        else {
+            failed = fwrite(writer.mem, 1, writer.size, file) != writer.size;
+            if (fclose(file))
+                failed = 1;
+        }
+    }
+
+    WebPMemoryWriterClear(&writer);
+    return failed;
+
+}
+#endif
+
+/**
+ * Writes the given Cairo surface to the file at the given path, using the
+ * given image format.
+ *
+ * @param surface
+ *     The Cairo surface to write, which must be a CAIRO_FORMAT_ARGB32 image
+ *     surface.
+ *
+ * @param path
+ *     The path of the file to write.
+ *
+ * @param format
+ *     The image format to write the surface in.
+ *
+ * @return
+ *     Zero if the image was written successfully, non-zero otherwise.
+ */
+static int guacenc_thumbnails_write(cairo_surface_t* surface,
+        const char* path, guacenc_thumbnail_format format) {
+
+    int failed;
+
+    /* Never overwrite existing files */
+    if (access(path, F_OK) == 0) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write \"%s\": File exists",
+                path);
+        return 1;
+    }
+
+#ifdef ENABLE_WEBP
+    if (format == GUACENC_THUMBNAIL_WEBP)
+        failed = guacenc_thumbnails_write_webp(surface, path);
+    else
+#endif
+        failed = cairo_surface_write_to_png(surface, path)
+            != CAIRO_STATUS_SUCCESS;
+
+    if (failed)
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write \"%s\".", path);
+    else
+        guacenc_log(GUAC_LOG_DEBUG, "Wrote \"%s\".", path);
+
+    return failed;
+
+}
+
+int guacenc_thumbnails_render(guacenc_thumbnails* thumbnails,
+        guacenc_buffer* frame, guac_timestamp elapsed) {
+
+    const guacenc_thumbnail_options* options = thumbnails->options;
+    const char* extension = guacenc_thumbnail_extension(options->format);
+
+    cairo_surface_t* surface = NULL;
+    int failed = 0;
+
+    /* Render every thumbnail that has come due since the previous frame, all
+     * of which show this frame */
+    while (guacenc_thumbnails_due(thumbnails, elapsed)) {
+
+        if (surface == NULL) {
+            surface = guacenc_thumbnails_scale(options, frame);
+            if (surface == NULL) {
+                guacenc_log(GUAC_LOG_ERROR, "%s: Cannot allocate thumbnail.",
+                        thumbnails->path);
+                return 1;
+            }
+        }
+
+        /* Name each thumbnail after the point in the recording it
+         * represents */
+        char out_path[4096];
+        int len = snprintf(out_path, sizeof(out_path), "%s.%i%s",
+                thumbnails->path, (int) (thumbnails->next / 1000), extension);
+
+        if (len >= sizeof(out_path)) {
+            guacenc_log(GUAC_LOG_ERROR, "Cannot write thumbnail for \"%s\": "
+                    "Name too long", thumbnails->path);
+            failed = 1;
+        }
+
+        else if (guacenc_thumbnails_write(surface, out_path, options->format))
+            failed = 1;
+
+        /* Retain thumbnail for the contact sheet */
+        if (options->columns > 0)
+            thumbnails->surfaces[thumbnails->rendered] =
+                cairo_surface_reference(surface);
+
+        thumbnails->rendered++;
+
+        /* Advance to next thumbnail, if any */
+        if (thumbnails->rendered >= GUACENC_THUMBNAIL_MAX_COUNT) {
+            if (options->interval > 0)
+                guacenc_log(GUAC_LOG_WARNING, "%s: No more than %i "
+                        "thumbnails will be rendered.", thumbnails->path,
+                        GUACENC_THUMBNAIL_MAX_COUNT);
+            thumbnails->finished = true;
+        }
+
+        else if (options->interval > 0) {
+            thumbnails->next += (guac_timestamp) options->interval * 1000;
+            if (thumbnails->end != 0 && thumbnails->next > thumbnails->end)
+                thumbnails->finished = true;
+        }
+
+        else if (thumbnails->rendered < options->count)
+            thumbnails->next =
+                (guac_timestamp) options->times[thumbnails->rendered] * 1000;
+
+        else
+            thumbnails->finished = true;
+
+    }
+
+    cairo_surface_destroy(surface);
+    return failed;
+
+}
+
+/**
+ * Writes a contact sheet combining all thumbnails rendered within the given
+ * set, arranged in rows of the number of columns requested.
+ *
+ * @param thumbnails
+ *     The set of thumbnails to combine, at least one of which must have been
+ *     rendered.
+ *
+ * @return
+ *     Zero if the contact sheet was written successfully, non-zero otherwise.
+ */
+static int guacenc_thumbnails_write_sheet(guacenc_thumbnails* thumbnails) {
+
+    const guacenc_thumbnail_options* options = thumbnails->options;
+
+    char out_path[4096];
+    int len = snprintf(out_path, sizeof(out_path),
+            "%s" GUACENC_THUMBNAIL_SHEET_SUFFIX "%s", thumbnails->path,
+            guacenc_thumbnail_extension(options->format));
+
+    if (len >= sizeof(out_path)) {
+        guacenc_log(GUAC_LOG_ERROR, "Cannot write contact sheet for \"%s\": "
+                "Name too long", thumbnails->path);
+        return 1;
+    }
+
+    int columns = options->columns;
+    if (columns > thumbnails->rendered)
+        columns = thumbnails->rendered;
+
+    int rows = (thumbnails->rendered + columns - 1) / columns;
+
+    cairo_surface_t* sheet = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            guac_mem_ckd_mul_or_die(columns, options->width),
+            guac_mem_ckd_mul_or_die(rows, options->height));
+
+    if (cairo_surface_status(sheet) != CAIRO_STATUS_SUCCESS) {
+        guacenc_log(GUAC_LOG_ERROR, "%s: Cannot allocate contact sheet of "
+                "%i x %i thumbnails.", thumbnails->path, columns, rows);
+        cairo_surface_destroy(sheet);
+        return 1;
+    }
+
+    /* Arrange thumbnails left to right, top to bottom */
+    cairo_t* cairo = cairo_create(sheet);
+    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(cairo, 0.0, 0.0, 0.0, 1.0);
+    cairo_paint(cairo);
+
+    for (int i = 0; i < thumbnails->rendered; i++) {
+        cairo_set_source_surface(cairo, thumbnails->surfaces[i],
+                (i % columns) * options->width,
+                (i / columns) * options->height);
+        cairo_paint(cairo);
+    }
+
+    cairo_destroy(cairo);
+    cairo_surface_flush(sheet);
+
+    int failed = guacenc_thumbnails_write(sheet, out_path, options->format);
+    cairo_surface_destroy(sheet);
+    return failed;
+
+}
+
+int guacenc_thumbnails_free(guacenc_thumbnails* thumbnails) {
+
+    /* Ignore NULL thumbnails */
+    if (thumbnails == NULL)
+        return 0;
+
+    int failed = 0;
+
+    if (thumbnails->rendered == 0) {
+        guacenc_log(GUAC_LOG_WARNING, "%s: Recording ends before any "
+                "thumbnail could be rendered.", thumbnails->path);
+        failed = 1;
+    }
+
+    else {
+
+        /* Requested points beyond the end of the recording are skipped */
+        const guacenc_thumbnail_options* options = thumbnails->options;
+        if (!thumbnails->finished && options->interval == 0)
+            guacenc_log(GUAC_LOG_WARNING, "%s: Recording ends before %i of "
+                    "%i thumbnail(s) could be rendered.", thumbnails->path,
+                    options->count - thumbnails->rendered, options->count);
+
+        if (options->columns > 0)
+            failed = guacenc_thumbnails_write_sheet(thumbnails);
+
+    }
+
+    for (int i = 0; i < thumbnails->rendered; i++)
+        cairo_surface_destroy(thumbnails->surfaces[i]);
+
+    guac_mem_free(thumbnails->path);
+    guac_mem_free(thumbnails);
+    return failed;
+
+}
+
@@ -0,0 +1,282 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACENC_THUMBNAIL_H
+#define GUACENC_THUMBNAIL_H
+
+#include "config.h"
+#include "buffer.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/timestamp.h>
+
+#include <stdbool.h>
+
+/**
+ * The maximum number of thumbnails that will be rendered from a single
+ * recording.
+ */
+#define GUACENC_THUMBNAIL_MAX_COUNT 256
+
+/**
+ * The quality of thumbnails written as WebP images, from 0 (lowest) to 100
+ * (highest).
+ */
+#define GUACENC_THUMBNAIL_WEBP_QUALITY 80
+
+/**
+ * The suffix of the contact sheet written for each recording, preceding the
+ * filename extension of the image format used.
+ */
+#define GUACENC_THUMBNAIL_SHEET_SUFFIX ".sheet"
+
+/**
+ * The image formats that thumbnails may be written in.
+ */
+typedef enum guacenc_thumbnail_format {
+
+    /**
+     * PNG, supported by all builds of guacenc.
+     */
+    GUACENC_THUMBNAIL_PNG,
+
+    /**
+     * WebP, supported only if guacenc was built against libwebp.
+     */
+    GUACENC_THUMBNAIL_WEBP
+
+} guacenc_thumbnail_format;
+
+/**
+ * The options describing which thumbnails should be rendered from each
+ * recording, and how.
+ */
+typedef struct guacenc_thumbnail_options {
+
+    /**
+     * The image format of each thumbnail and contact sheet.
+     */
+    guacenc_thumbnail_format format;
+
+    /**
+     * The width of each thumbnail, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of each thumbnail, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of seconds into the recording at which each thumbnail should
+     * be rendered, relative to the first frame of the recording, in ascending
+     * order. Ignored if interval is non-zero.
+     */
+    int times[GUACENC_THUMBNAIL_MAX_COUNT];
+
+    /**
+     * The number of entries within the times array.
+     */
+    int count;
+
+    /**
+     * The number of seconds between consecutive thumbnails, or zero if only
+     * the thumbnails listed within the times array should be rendered.
+     */
+    int interval;
+
+    /**
+     * The number of thumbnails within each row of the contact sheet combining
+     * all thumbnails of a recording, or zero if no contact sheet should be
+     * written.
+     */
+    int columns;
+
+} guacenc_thumbnail_options;
+
+/**
+ * The thumbnails being rendered from a single recording.
+ */
+typedef struct guacenc_thumbnails {
+
+    /**
+     * The path to the recording. Each thumbnail is written to a file whose
+     * name is this path followed by the number of seconds into the recording
+     * that the thumbnail represents and the filename extension of the image
+     * format used.
+     */
+    char* path;
+
+    /**
+     * The options describing which thumbnails should be rendered, and how.
+     */
+    const guacenc_thumbnail_options* options;
+
+    /**
+     * The number of thumbnails rendered thus far.
+     */
+    int rendered;
+
+    /**
+     * The number of milliseconds into the recording at which the next
+     * thumbnail should be rendered, relative to the first frame of the
+     * recording.
+     */
+    guac_timestamp next;
+
+    /**
+     * The number of milliseconds into the recording after which no further
+     * thumbnails should be rendered at a regular interval, relative to the
+     * first frame of the recording, or zero if there is no such limit.
+     */
+    guac_timestamp end;
+
+    /**
+     * Whether all requested thumbnails have been rendered, such that the
+     * remainder of the recording need not be read.
+     */
+    bool finished;
+
+    /**
+     * Every thumbnail rendered thus far, in order, if a contact sheet will be
+     * written once all thumbnails are rendered. If no contact sheet will be
+     * written, all entries are NULL.
+     */
+    cairo_surface_t* surfaces[GUACENC_THUMBNAIL_MAX_COUNT];
+
+} guacenc_thumbnails;
+
+/**
+ * Parses the given string as the name of a thumbnail image format ("png" or
+ * "webp").
+ *
+ * @param arg
+ *     The string to parse.
+ *
+ * @param format
+ *     A pointer to the guacenc_thumbnail_format in which the parsed format
+ *     should be stored.
+ *
+ * @return
+ *     Zero if parsing was successful, non-zero if the given string does not
+ *     name an image format supported by this build of guacenc.
+ */
+int guacenc_thumbnail_parse_format(const char* arg,
+        guacenc_thumbnail_format* format);
+
+/**
+ * Returns the filename extension (including the leading period) of images
+ * written in the given format.
+ *
+ * @param format
+ *     The image format.
+ *
+ * @return
+ *     The filename extension of images of the given format.
+ */
+const char* guacenc_thumbnail_extension(guacenc_thumbnail_format format);
+
+/**
+ * Allocates a new set of thumbnails to be rendered from the recording at the
+ * given path. No files are written until the first thumbnail is rendered.
+ *
+ * @param path
+ *     The path to the recording.
+ *
+ * @param options
+ *     The options describing which thumbnails should be rendered, and how.
+ *     These options must remain valid until the thumbnails are freed.
+ *
+ * @param start
+ *     The number of milliseconds into the recording, relative to the first
+ *     frame, at which rendering of thumbnails at a regular interval should
+ *     begin. Ignored if no interval is given.
+ *
+ * @param end
+ *     The number of milliseconds into the recording, relative to the first
+ *     frame, after which no further thumbnails should be rendered at a
+ *     regular interval, or zero if thumbnails should be rendered until the
+ *     end of the recording. Ignored if no interval is given.
+ *
+ * @return
+ *     A newly-allocated set of thumbnails, which must be freed with
+ *     guacenc_thumbnails_free().
+ */
+guacenc_thumbnails* guacenc_thumbnails_alloc(const char* path,
+        const guacenc_thumbnail_options* options, guac_timestamp start,
+        guac_timestamp end);
+
+/**
+ * Returns whether a thumbnail is due to be rendered for a frame at the given
+ * point within the recording.
+ *
+ * @param thumbnails
+ *     The set of thumbnails being rendered.
+ *
+ * @param elapsed
+ *     The number of milliseconds into the recording of the frame, relative to
+ *     the first frame of the recording.
+ *
+ * @return
+ *     Non-zero if guacenc_thumbnails_render() should be invoked with the
+ *     frame once it has been flattened, zero otherwise.
+ */
+int guacenc_thumbnails_due(guacenc_thumbnails* thumbnails,
+        guac_timestamp elapsed);
+
+/**
+ * Renders each due thumbnail from the given frame, scaling the frame to fit
+ * within the dimensions of the thumbnails while preserving its aspect ratio.
+ * Each thumbnail is rendered from the first frame at or after the point in
+ * the recording it represents.
+ *
+ * @param thumbnails
+ *     The set of thumbnails being rendered.
+ *
+ * @param frame
+ *     The flattened frame buffer of the default layer of the display.
+ *
+ * @param elapsed
+ *     The number of milliseconds into the recording of the frame, relative to
+ *     the first frame of the recording.
+ *
+ * @return
+ *     Zero if all due thumbnails were written successfully, non-zero
+ *     otherwise.
+ */
+int guacenc_thumbnails_render(guacenc_thumbnails* thumbnails,
+        guacenc_buffer* frame, guac_timestamp elapsed);
+
+/**
+ * Writes the contact sheet combining all rendered thumbnails, if requested,
+ * and frees the given set of thumbnails. If the given set of thumbnails is
+ * NULL, this function has no effect.
+ *
+ * @param thumbnails
+ *     The set of thumbnails to free, which may be NULL.
+ *
+ * @return
+ *     Zero if at least one thumbnail was rendered and the contact sheet (if
+ *     any) was written successfully, non-zero otherwise.
+ */
+int guacenc_thumbnails_free(guacenc_thumbnails* thumbnails);
+
+#endif
+
@@ -30,6 +30,7 @@
 #endif
 #include <libavutil/common.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 #include <guacamole/client.h>
 #include <guacamole/mem.h>
@@ -41,12 +42,104 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+static void* guacenc_video_encoder_thread(void* data);
+
+/**
+ * The number of threads that libavcodec should use when encoding each
+ * newly-allocated guacenc_video, as set by
+ * guacenc_video_set_default_encoder_threads().
+ */
+static int guacenc_video_default_encoder_threads = GUACENC_VIDEO_ENCODER_THREADS;
+
+void guacenc_video_set_default_encoder_threads(int count) {
+    guacenc_video_default_encoder_threads = count > 0 ? count : 0;
+}
+
+/**
+ * Creates and opens a new encoding context for the given codec, which will
+ * encode frames for the given stream. If a type of hardware device is given,
+ * the context is prepared to encode frames uploaded to the first available
+ * device of that type.
+ *
+ * @param container_format_context
+ *     The format context of the container receiving the encoded video.
+ *
+ * @param video_stream
+ *     The stream within the container receiving the encoded video.
+ *
+ * @param codec
+ *     The codec to use to encode the video.
+ *
+ * @param hwaccel
+ *     The name of the type of hardware device to use to encode the video, as
+ *     defined by libavutil, or NULL if the video should be encoded in
+ *     software.
+ *
+ * @param width
+ *     The width of the video, in pixels.
+ *
+ * @param height
+ *     The height of the video, in pixels.
+ *
+ * @param bitrate
+ *     The desired overall bitrate of the video, in bits per second.
+ *
+ * @return
+ *     The newly-opened encoding context, or NULL if the context could not be
+ *     created or opened.
+ */
+static AVCodecContext* guacenc_video_open_context(
+        AVFormatContext* container_format_context, AVStream* video_stream,
+        const AVCodec* codec, const char* hwaccel, int width, int height,
+        int bitrate) {
+
+    /* Retrieve encoding context */
+    AVCodecContext* avcodec_context =
+            guacenc_build_avcodeccontext(video_stream, codec, bitrate, width,
+                    height, /*gop size*/ 10, /*qmax*/ 31, /*qmin*/ 2,
+                    /*pix fmt*/ AV_PIX_FMT_YUV420P,
+                    /*time base*/ (AVRational) { 1, GUACENC_VIDEO_FRAMERATE });
+
+    if (avcodec_context == NULL) {
+        guacenc_log(GUAC_LOG_ERROR, "Failed to allocate context for "
+                "codec \"%s\".", codec->name);
+        return NULL;
+    }
+
+    /* If format needs global headers, write them */
+    if (container_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+        avcodec_context->flags |= GUACENC_FLAG_GLOBAL_HEADER;
+    }
+
+    /* Allow libavcodec to encode using multiple threads */
+    avcodec_context->thread_count = guacenc_video_default_encoder_threads;
+
+    /* Encode frames within device memory, if requested */
+    if (hwaccel != NULL
+            && guacenc_hwaccel_init_avcodeccontext(avcodec_context, hwaccel)) {
+        avcodec_free_context(&avcodec_context);
+        return NULL;
+    }
+
+    /* Open codec for use */
+    if (guacenc_open_avcodec(avcodec_context, codec, NULL, video_stream) < 0) {
+        guacenc_log(hwaccel != NULL ? GUAC_LOG_WARNING : GUAC_LOG_ERROR,
+                "Failed to open codec \"%s\".", codec->name);
+        avcodec_free_context(&avcodec_context);
+        return NULL;
+    }
+
+    return avcodec_context;
+
+}
+
 guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
-        int width, int height, int bitrate) {
+        const char* hwaccel, bool live, int width, int height, int bitrate) {
 
     const AVOutputFormat *container_format;
     AVFormatContext *container_format_context;
@@ -71,53 +164,71 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
         goto fail_codec;
     }
 
+    /* Pull hardware encoder for requested type of device, if any */
+    const AVCodec* hw_codec = NULL;
+    if (hwaccel != NULL) {
+
+        const char* hw_codec_name = guacenc_hwaccel_encoder_name(hwaccel);
+        if (hw_codec_name != NULL)
+            hw_codec = avcodec_find_encoder_by_name(hw_codec_name);
+
+        if (hw_codec == NULL)
+            guacenc_log(GUAC_LOG_WARNING, "Hardware-accelerated encoding "
+                    "using \"%s\" is not supported by this build of "
+                    "libavcodec.", hwaccel);
+
+    }
+
     /* create stream */
     video_stream = NULL;
-    video_stream = avformat_new_stream(container_format_context, codec);
+    video_stream = avformat_new_stream(container_format_context,
+            hw_codec != NULL ? hw_codec : codec);
     if (video_stream == NULL) {
         guacenc_log(GUAC_LOG_ERROR, "Could not allocate encoder stream. Cannot continue.");
         goto fail_format_context;
     }
     video_stream->id = container_format_context->nb_streams - 1;
 
-    /* Retrieve encoding context */
-    AVCodecContext* avcodec_context =
-            guacenc_build_avcodeccontext(video_stream, codec, bitrate, width,
-                    height, /*gop size*/ 10, /*qmax*/ 31, /*qmin*/ 2,
-                    /*pix fmt*/ AV_PIX_FMT_YUV420P,
-                    /*time base*/ (AVRational) { 1, GUACENC_VIDEO_FRAMERATE });
+    /* Attempt hardware-accelerated encoding first, if requested */
+    AVCodecContext* avcodec_context = NULL;
+    if (hw_codec != NULL)
+        avcodec_context = guacenc_video_open_context(container_format_context,
+                video_stream, hw_codec, hwaccel, width, height, bitrate);
 
+    /* Fall back to encoding in software */
     if (avcodec_context == NULL) {
-        guacenc_log(GUAC_LOG_ERROR, "Failed to allocate context for "
-                "codec \"%s\".", codec_name);
-        goto fail_context;
-    }
 
-    /* If format needs global headers, write them */
-    if (container_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
-        avcodec_context->flags |= GUACENC_FLAG_GLOBAL_HEADER;
-    }
+        if (hwaccel != NULL)
+            guacenc_log(GUAC_LOG_WARNING, "Hardware-accelerated encoding "
+                    "using \"%s\" is not possible. Falling back to encoding "
+                    "in software with codec \"%s\".", hwaccel, codec_name);
+
+        hwaccel = NULL;
+        avcodec_context = guacenc_video_open_context(container_format_context,
+                video_stream, codec, NULL, width, height, bitrate);
+        if (avcodec_context == NULL)
+            goto fail_format_context;
 
-    /* Open codec for use */
-    if (guacenc_open_avcodec(avcodec_context, codec, NULL, video_stream) < 0) {
-        guacenc_log(GUAC_LOG_ERROR, "Failed to open codec \"%s\".", codec_name);
-        goto fail_codec_open;
     }
 
+    else
+        guacenc_log(GUAC_LOG_INFO, "Encoding using hardware device \"%s\" "
+                "with codec \"%s\".", hwaccel, hw_codec->name);
+
     /* Allocate corresponding frame */
     AVFrame* frame = av_frame_alloc();
     if (frame == NULL) {
         goto fail_frame;
     }
 
-    /* Copy necessary data for frame from context */
-    frame->format = avcodec_context->pix_fmt;
+    /* Copy necessary data for frame from context (frames are always prepared
+     * as YCbCr, even if uploaded to a hardware device prior to encoding) */
+    frame->format = AV_PIX_FMT_YUV420P;
     frame->width = avcodec_context->width;
     frame->height = avcodec_context->height;
 
     /* Allocate actual backing data for frame */
-    if (av_image_alloc(frame->data, frame->linesize, frame->width,
-                frame->height, frame->format, 32) < 0) {
+    if (av_frame_get_buffer(frame, 32) < 0) {
         goto fail_frame_data;
     }
 
@@ -130,8 +241,18 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
         }
     }
 
+    /* Write self-contained fragments as soon as each is complete if the video
+     * must be playable while still being encoded */
+    AVDictionary* options = NULL;
+    if (live) {
+        av_dict_set(&options, "movflags",
+                "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set(&options, "flush_packets", "1", 0);
+    }
+
     /* write the stream header, if needed */
-    ret = avformat_write_header(container_format_context, NULL);
+    ret = avformat_write_header(container_format_context, &options);
+    av_dict_free(&options);
     if (ret < 0) {
         guacenc_log(GUAC_LOG_ERROR, "Error occurred while writing output file header.");
         failed_header = true;
@@ -139,7 +260,7 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
     }
 
     /* Allocate video structure */
-    guacenc_video* video = guac_mem_alloc(sizeof(guacenc_video));
+    guacenc_video* video = guac_mem_zalloc(sizeof(guacenc_video));
     if (video == NULL)
         goto fail_alloc_video;
 
@@ -151,14 +272,31 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
     video->width = width;
     video->height = height;
     video->bitrate = bitrate;
+    video->hwaccel = hwaccel;
+    video->started = guac_timestamp_current();
 
     /* No frames have been written or prepared yet */
     video->last_timestamp = 0;
     video->next_pts = 0;
 
+    pthread_mutex_init(&(video->lock), NULL);
+    pthread_cond_init(&(video->modified), NULL);
+
+    /* Begin encoding frames as they are prepared */
+    if (pthread_create(&(video->encoder_thread), NULL,
+                guacenc_video_encoder_thread, video)) {
+        guacenc_log(GUAC_LOG_ERROR, "Unable to start video encoding thread.");
+        goto fail_encoder_thread;
+    }
+
     return video;
 
     /* Free all allocated data in case of failure */
+fail_encoder_thread:
+    pthread_mutex_destroy(&(video->lock));
+    pthread_cond_destroy(&(video->modified));
+    guac_mem_free(video);
+
 fail_alloc_video:
 fail_output_file:
     avio_close(container_format_context->pb);
@@ -169,13 +307,10 @@ fail_output_file:
                 "be automatically deleted: %s", path, strerror(errno));
 
 fail_output_avio:
-    av_freep(&frame->data[0]);
-
 fail_frame_data:
     av_frame_free(&frame);
 
 fail_frame:
-fail_codec_open:
     avcodec_free_context(&avcodec_context);
 
 fail_format_context:
@@ -184,7 +319,6 @@ fail_format_context:
         avformat_free_context(container_format_context);
     }
 
-fail_context:
 fail_codec:
     return NULL;
 
@@ -215,8 +349,25 @@ static int guacenc_video_write_frame(guacenc_video* video, AVFrame* frame) {
     if (frame != NULL)
         frame->pts = video->next_pts;
 
+    /* Upload frame to device memory if encoding using hardware */
+    AVFrame* hw_frame = NULL;
+    if (frame != NULL && video->hwaccel != NULL) {
+
+        hw_frame = guacenc_hwaccel_upload_frame(video, frame);
+        if (hw_frame == NULL) {
+            guacenc_log(GUAC_LOG_WARNING, "Unable to upload frame #%" PRId64
+                    " to hardware device \"%s\".", video->next_pts,
+                    video->hwaccel);
+            return -1;
+        }
+
+        frame = hw_frame;
+
+    }
+
     /* Write frame to video */
     int got_data = guacenc_avcodec_encode_video(video, frame);
+    av_frame_free(&hw_frame);
     if (got_data < 0)
         return -1;
 
@@ -246,6 +397,439 @@ static int guacenc_video_flush_frame(guacenc_video* video) {
 
 }
 
+/**
+ * Allocates a new AVFrame having the given format and dimensions, along with
+ * the backing image data of that frame. The contents of the image data are
+ * undefined.
+ *
+ * @param format
+ *     The pixel format of the new frame.
+ *
+ * @param width
+ *     The width of the new frame, in pixels.
+ *
+ * @param height
+ *     The height of the new frame, in pixels.
+ *
+ * @return
+ *     A newly-allocated AVFrame, which must eventually be freed with
+ *     guacenc_video_frame_free(), or NULL if allocation fails.
+ */
+static AVFrame* guacenc_video_frame_alloc(int format, int width, int height) {
+
+    AVFrame* frame = av_frame_alloc();
+    if (frame == NULL)
+        return NULL;
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+
+    /* Allocate actual (reference-counted) backing data for frame */
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    return frame;
+
+}
+
+/**
+ * Frees the given AVFrame and its backing image data, as allocated by
+ * guacenc_video_frame_alloc(), setting the given pointer to NULL. If the
+ * frame is already NULL, this function has no effect.
+ *
+ * @param frame
+ *     A pointer to the frame to free.
+ */
+static void guacenc_video_frame_free(AVFrame** frame) {
+
+    if (*frame == NULL)
+        return;
+
+    av_frame_free(frame);
+
+}
+
+/**
+ * Converts only the bands of the source image of the given video that contain
+ * the given rows, storing the converted image data within the corresponding
+ * rows of the frame that will be written next. This is possible only if the
+ * source image has exactly the same dimensions as the video, such that no
+ * scaling is required. This function may only be invoked by the encoding
+ * thread.
+ *
+ * @param video
+ *     The video whose next frame should be updated.
+ *
+ * @param y
+ *     The first row of the source image that has changed.
+ *
+ * @param height
+ *     The number of rows of the source image that have changed.
+ *
+ * @return
+ *     Non-zero if the bands containing the given rows were converted, zero if
+ *     the entire source image must be converted instead.
+ */
+static int guacenc_video_convert_bands(guacenc_video* video, int y,
+        int height) {
+
+    AVFrame* src = video->source;
+    AVFrame* dst = video->next_frame;
+
+    /* Each band is converted along with the rows surrounding it */
+    int window = GUACENC_VIDEO_BAND_HEIGHT + GUACENC_VIDEO_BAND_PADDING * 2;
+
+    /* Bands can only be converted independently if unscaled and if every
+     * band (and its padding) lies entirely within the frame */
+    if (src->width != dst->width || src->height != dst->height
+            || src->height < window
+            || src->height % GUACENC_VIDEO_BAND_HEIGHT != 0)
+        return 0;
+
+    /* Prepare conversion context and temporary frame for bands */
+    video->sws_band = sws_getCachedContext(video->sws_band, src->width,
+            window, AV_PIX_FMT_RGB32, dst->width, window, AV_PIX_FMT_YUV420P,
+            SWS_BICUBIC, NULL, NULL, NULL);
+
+    if (video->band == NULL)
+        video->band = guacenc_video_frame_alloc(AV_PIX_FMT_YUV420P,
+                dst->width, window);
+
+    if (video->sws_band == NULL || video->band == NULL)
+        return 0;
+
+    AVFrame* band = video->band;
+
+    int first = y - y % GUACENC_VIDEO_BAND_HEIGHT;
+    for (int row = first; row < y + height;
+            row += GUACENC_VIDEO_BAND_HEIGHT) {
+
+        /* Include padding above and below the band, shifting the converted
+         * rows to remain within the frame (the chroma filter is then clamped
+         * at the frame edge exactly as it would be for the entire frame) */
+        int start = row - GUACENC_VIDEO_BAND_PADDING;
+        if (start < 0)
+            start = 0;
+        else if (start > src->height - window)
+            start = src->height - window;
+
+        const uint8_t* const src_data[4] = {
+            src->data[0] + start * src->linesize[0]
+        };
+
+        sws_scale(video->sws_band, src_data, src->linesize, 0, window,
+                band->data, band->linesize);
+
+        /* Copy only the band itself to the next frame */
+        int offset = row - start;
+        for (int i = 0; i < GUACENC_VIDEO_BAND_HEIGHT; i++)
+            memcpy(dst->data[0] + (row + i) * dst->linesize[0],
+                    band->data[0] + (offset + i) * band->linesize[0],
+                    dst->width);
+
+        for (int plane = 1; plane <= 2; plane++) {
+            for (int i = 0; i < GUACENC_VIDEO_BAND_HEIGHT / 2; i++)
+                memcpy(dst->data[plane]
+                            + (row / 2 + i) * dst->linesize[plane],
+                        band->data[plane]
+                            + (offset / 2 + i) * band->linesize[plane],
+                        (dst->width + 1) / 2);
+        }
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Prepares the context used to scale and convert entire prepared images of
+ * the given dimensions to the YCbCr format of the frame that will be written
+ * next, reusing the existing context if the dimensions have not changed.
+ * Where supported by libswscale, the context divides each image into slices
+ * which are scaled in parallel, using the same number of threads as the
+ * encoder.
+ *
+ * @param video
+ *     The video whose scaling context should be prepared.
+ *
+ * @param width
+ *     The width of the prepared images to be scaled, in pixels.
+ *
+ * @param height
+ *     The height of the prepared images to be scaled, in pixels.
+ *
+ * @return
+ *     Zero if the scaling context is ready for use, non-zero if the context
+ *     could not be created.
+ */
+static int guacenc_video_prepare_scaler(guacenc_video* video, int width,
+        int height) {
+
+    AVFrame* dst = video->next_frame;
+
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+
+    /* Reuse existing context if the source dimensions have not changed */
+    if (video->sws != NULL && video->sws_width == width
+            && video->sws_height == height)
+        return 0;
+
+    sws_freeContext(video->sws);
+    video->sws = sws_alloc_context();
+    if (video->sws == NULL)
+        return 1;
+
+    av_opt_set_int(video->sws, "srcw", width, 0);
+    av_opt_set_int(video->sws, "srch", height, 0);
+    av_opt_set_int(video->sws, "src_format", AV_PIX_FMT_RGB32, 0);
+    av_opt_set_int(video->sws, "dstw", dst->width, 0);
+    av_opt_set_int(video->sws, "dsth", dst->height, 0);
+    av_opt_set_int(video->sws, "dst_format", AV_PIX_FMT_YUV420P, 0);
+    av_opt_set_int(video->sws, "sws_flags", SWS_BICUBIC, 0);
+    av_opt_set_int(video->sws, "threads", guacenc_video_default_encoder_threads, 0);
+
+    if (sws_init_context(video->sws, NULL, NULL) < 0) {
+        sws_freeContext(video->sws);
+        video->sws = NULL;
+        return 1;
+    }
+
+    video->sws_width = width;
+    video->sws_height = height;
+
+#else
+
+    video->sws = sws_getCachedContext(video->sws, width, height,
+            AV_PIX_FMT_RGB32, dst->width, dst->height, AV_PIX_FMT_YUV420P,
+            SWS_BICUBIC, NULL, NULL, NULL);
+
+    if (video->sws == NULL)
+        return 1;
+
+#endif
+
+    return 0;
+
+}
+
+/**
+ * Updates the frame that will be written next using the changed rows of the
+ * prepared image within the given operation, scaling and converting its image
+ * data to the YCbCr format required by the encoder. Where no scaling is
+ * required, only the changed rows are converted. This function may only be
+ * invoked by the encoding thread.
+ *
+ * @param video
+ *     The video whose next frame should be replaced.
+ *
+ * @param operation
+ *     The GUACENC_VIDEO_OPERATION_PREPARE operation containing the changed
+ *     rows of the prepared image.
+ */
+static void guacenc_video_scale_frame(guacenc_video* video,
+        guacenc_video_operation* operation) {
+
+    AVFrame* rows = operation->frame;
+    AVFrame* src = video->source;
+
+    /* Replace copy of prepared image if its size has changed (the operation
+     * will then contain the entire image) */
+    if (src == NULL || src->width != rows->width
+            || src->height != operation->height) {
+
+        guacenc_video_frame_free(&video->source);
+        src = video->source = guacenc_video_frame_alloc(AV_PIX_FMT_RGB32,
+                rows->width, operation->height);
+
+        if (src == NULL) {
+            guacenc_log(GUAC_LOG_WARNING, "Failed to allocate source "
+                    "frame. Frame dropped.");
+            return;
+        }
+
+        memset(src->data[0], 0, src->linesize[0] * src->height);
+
+    }
+
+    /* Apply changed rows to copy of prepared image */
+    for (int i = 0; i < rows->height; i++)
+        memcpy(src->data[0] + (operation->y + i) * src->linesize[0],
+                rows->data[0] + i * rows->linesize[0], rows->width * 4);
+
+    /* The encoder may still hold a reference to the frame that was written
+     * previously, in which case that frame must be copied before it can be
+     * modified */
+    if (av_frame_make_writable(video->next_frame) < 0) {
+        guacenc_log(GUAC_LOG_WARNING, "Failed to allocate destination "
+                "frame. Frame dropped.");
+        return;
+    }
+
+    /* Convert only the changed rows where possible */
+    if (guacenc_video_convert_bands(video, operation->y, rows->height))
+        return;
+
+    /* Obtain destination frame */
+    AVFrame* dst = video->next_frame;
+
+    /* Prepare scaling context, reusing the previous context if the source
+     * dimensions have not changed */
+    if (guacenc_video_prepare_scaler(video, src->width, src->height)) {
+        guacenc_log(GUAC_LOG_WARNING, "Failed to allocate software scaling "
+                "context. Frame dropped.");
+        return;
+    }
+
+    /* Apply scaling, copying the source frame to the destination */
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    if (sws_scale_frame(video->sws, dst, src) < 0)
+        guacenc_log(GUAC_LOG_WARNING, "Failed to scale frame. Frame "
+                "dropped.");
+#else
+    sws_scale(video->sws, (const uint8_t* const*) src->data, src->linesize,
+            0, src->height, dst->data, dst->linesize);
+#endif
+
+}
+
+/**
+ * Performs each operation added to the queue of the given video, in order,
+ * until the video is being freed and no operations remain. If any frame
+ * cannot be written, the remaining operations are still removed from the
+ * queue, but their frames are discarded.
+ *
+ * @param data
+ *     A pointer to the guacenc_video being encoded.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacenc_video_encoder_thread(void* data) {
+
+    guacenc_video* video = (guacenc_video*) data;
+
+    pthread_mutex_lock(&(video->lock));
+
+    for (;;) {
+
+        /* Wait for further operations */
+        if (video->queue_length == 0) {
+
+            /* Stop only once all queued operations are done */
+            if (video->stopping)
+                break;
+
+            pthread_cond_wait(&(video->modified), &(video->lock));
+            continue;
+
+        }
+
+        /* Remove oldest operation, allowing another to be queued */
+        guacenc_video_operation operation = video->queue[video->queue_start];
+        video->queue_start = (video->queue_start + 1) % GUACENC_VIDEO_QUEUE_SIZE;
+        video->queue_length--;
+        pthread_cond_broadcast(&(video->modified));
+
+        int failed = video->failed;
+
+        /* Scale and encode without blocking preparation of further frames */
+        pthread_mutex_unlock(&(video->lock));
+
+        /* Replace the next frame with the newly-prepared frame */
+        if (operation.type == GUACENC_VIDEO_OPERATION_PREPARE) {
+            if (!failed)
+                guacenc_video_scale_frame(video, &operation);
+            guacenc_video_frame_free(&operation.frame);
+        }
+
+        /* Flush frames to bring timeline in sync, duplicating if necessary */
+        else if (!failed) {
+            for (int i = 0; i < operation.count; i++) {
+                if (guacenc_video_flush_frame(video)) {
+                    guacenc_log(GUAC_LOG_ERROR, "Unable to flush frame to "
+                            "video stream.");
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+
+        pthread_mutex_lock(&(video->lock));
+
+        if (failed)
+            video->failed = 1;
+
+    }
+
+    pthread_mutex_unlock(&(video->lock));
+    return NULL;
+
+}
+
+/**
+ * Adds the given operation to the queue of the given video, waiting for the
+ * encoding thread to make room if the queue is full. Consecutive writes of the
+ * prepared frame are combined into a single operation. If the encoding thread
+ * has already failed, the operation is discarded, and any frame it contains
+ * is freed.
+ *
+ * @param video
+ *     The video whose encoding thread should perform the given operation.
+ *
+ * @param operation
+ *     The operation to add to the queue. Ownership of any frame within the
+ *     operation is transferred to the encoding thread.
+ *
+ * @return
+ *     Zero if the operation was added to the queue, non-zero if the encoding
+ *     thread has failed to write a frame.
+ */
+static int guacenc_video_enqueue(guacenc_video* video,
+        guacenc_video_operation operation) {
+
+    pthread_mutex_lock(&(video->lock));
+
+    /* Combine with any write operation that is still queued */
+    if (operation.type == GUACENC_VIDEO_OPERATION_WRITE
+            && video->queue_length > 0 && !video->failed) {
+
+        guacenc_video_operation* last = &(video->queue[
+                (video->queue_start + video->queue_length - 1)
+                % GUACENC_VIDEO_QUEUE_SIZE]);
+
+        if (last->type == GUACENC_VIDEO_OPERATION_WRITE) {
+            last->count += operation.count;
+            pthread_mutex_unlock(&(video->lock));
+            return 0;
+        }
+
+    }
+
+    /* Wait for room within the queue */
+    while (video->queue_length == GUACENC_VIDEO_QUEUE_SIZE && !video->failed)
+        pthread_cond_wait(&(video->modified), &(video->lock));
+
+    /* Discard all further frames once encoding has failed */
+    if (video->failed) {
+        pthread_mutex_unlock(&(video->lock));
+        guacenc_video_frame_free(&operation.frame);
+        return 1;
+    }
+
+    video->queue[(video->queue_start + video->queue_length)
+            % GUACENC_VIDEO_QUEUE_SIZE] = operation;
+    video->queue_length++;
+    pthread_cond_broadcast(&(video->modified));
+
+    pthread_mutex_unlock(&(video->lock));
+    return 0;
+
+}
+
 int guacenc_video_advance_timeline(guacenc_video* video,
         guac_timestamp timestamp) {
 
@@ -266,14 +850,16 @@ int guacenc_video_advance_timeline(guacenc_video* video,
         next_timestamp = video->last_timestamp
                         + elapsed * 1000 / GUACENC_VIDEO_FRAMERATE;
 
-        /* Flush frames to bring timeline in sync, duplicating if necessary */
-        do {
-            if (guacenc_video_flush_frame(video)) {
-                guacenc_log(GUAC_LOG_ERROR, "Unable to flush frame to video "
-                        "stream.");
-                return 1;
-            }
-        } while (--elapsed != 0);
+        /* Have the encoding thread flush frames to bring the timeline in
+         * sync, duplicating if necessary */
+        if (guacenc_video_enqueue(video, (guacenc_video_operation) {
+                    .type  = GUACENC_VIDEO_OPERATION_WRITE,
+                    .count = elapsed
+                })) {
+            guacenc_log(GUAC_LOG_ERROR, "Unable to flush frame to video "
+                    "stream.");
+            return 1;
+        }
 
     }
 
@@ -284,57 +870,46 @@ int guacenc_video_advance_timeline(guacenc_video* video,
 }
 
 /**
- * Converts the given Guacamole video encoder buffer to a frame in the format
- * required by libavcodec / libswscale. Black margins of the specified sizes
- * will be added. No scaling is performed; the image data is copied verbatim.
+ * Copies the image data of the given Guacamole video encoder buffer into the
+ * given frame, within the black margins of the specified sizes, copying only
+ * the rows which differ from the current contents of the frame. No scaling is
+ * performed; the image data is copied verbatim. The frame MUST be exactly
+ * large enough to contain the buffer and its margins.
+ *
+ * @param frame
+ *     The frame to update with the contents of the given buffer.
  *
  * @param buffer
- *     The guacenc_buffer to copy as a new AVFrame.
+ *     The guacenc_buffer to copy into the given frame.
  *
  * @param lsize
- *     The size of the letterboxes to add, in pixels. Letterboxes are the
+ *     The size of the letterboxes to leave, in pixels. Letterboxes are the
  *     horizontal black boxes added to images which are scaled down to fit the
  *     destination because they are too wide (the width is scaled to exactly
  *     fit the destination, resulting in extra space at the top and bottom).
  *
  * @param psize
- *     The size of the pillarboxes to add, in pixels. Pillarboxes are the
+ *     The size of the pillarboxes to leave, in pixels. Pillarboxes are the
  *     vertical black boxes added to images which are scaled down to fit the
  *     destination because they are too tall (the height is scaled to exactly
  *     fit the destination, resulting in extra space on the sides).
  *
+ * @param top
+ *     Pointer to an int which will receive the first row of the frame that
+ *     changed. This value is only set if a row has changed.
+ *
+ * @param bottom
+ *     Pointer to an int which will receive the row following the last row of
+ *     the frame that changed. This value is only set if a row has changed.
+ *
  * @return
- *     A pointer to a newly-allocated AVFrame containing exactly the same image
- *     data as the given buffer. The image data within the frame and the frame
- *     itself must be manually freed later.
+ *     Non-zero if any row of the frame changed, zero if the frame already
+ *     contained exactly the same image data as the given buffer.
  */
-static AVFrame* guacenc_video_frame_convert(guacenc_buffer* buffer, int lsize,
-        int psize) {
-
-    /* Init size of left/right pillarboxes */
-    int left = psize;
-    int right = psize;
+static int guacenc_video_frame_update(AVFrame* frame, guacenc_buffer* buffer,
+        int lsize, int psize, int* top, int* bottom) {
 
-    /* Init size of top/bottom letterboxes */
-    int top = lsize;
-    int bottom = lsize;
-
-    /* Prepare source frame for buffer */
-    AVFrame* frame = av_frame_alloc();
-    if (frame == NULL)
-        return NULL;
-
-    /* Copy buffer properties to frame */
-    frame->format = AV_PIX_FMT_RGB32;
-    frame->width = buffer->width + left + right;
-    frame->height = buffer->height + top + bottom;
-
-    /* Allocate actual backing data for frame */
-    if (av_image_alloc(frame->data, frame->linesize, frame->width,
-                frame->height, frame->format, 32) < 0) {
-        av_frame_free(&frame);
-        return NULL;
-    }
+    int changed = 0;
 
     /* Flush any pending operations */
     cairo_surface_flush(buffer->surface);
@@ -343,58 +918,38 @@ static AVFrame* guacenc_video_frame_convert(guacenc_buffer* buffer, int lsize,
     unsigned char* src_data = buffer->image;
     int src_stride = buffer->stride;
 
-    /* Get pointer to destination image data */
-    unsigned char* dst_data = frame->data[0];
+    /* Get pointer to destination image data, within the left pillarbox and
+     * below the top letterbox */
+    unsigned char* dst_data = frame->data[0] + lsize * frame->linesize[0]
+                            + psize * 4;
     int dst_stride = frame->linesize[0];
 
-    /* Get source/destination dimensions */
-    int width = buffer->width;
-    int height = buffer->height;
-
     /* Source buffer is guaranteed to fit within destination buffer */
-    assert(width <= frame->width);
-    assert(height <= frame->height);
+    assert(buffer->width + psize * 2 == frame->width);
+    assert(buffer->height + lsize * 2 == frame->height);
 
-    /* Add top margin */
-    while (top > 0) {
-        memset(dst_data, 0, frame->width * 4);
-        dst_data += dst_stride;
-        top--;
-    }
+    /* Copy only differing rows from source buffer to destination frame */
+    size_t data_size = buffer->width * 4;
+    for (int y = 0; y < buffer->height; y++) {
 
-    /* Copy all data from source buffer to destination frame */
-    while (height > 0) {
+        if (memcmp(dst_data, src_data, data_size) != 0) {
 
-        /* Calculate size of margin and data regions */
-        int left_size = left * 4;
-        int data_size = width * 4;
-        int right_size = right * 4;
+            memcpy(dst_data, src_data, data_size);
 
-        /* Add left margin */
-        memset(dst_data, 0, left_size);
+            if (!changed)
+                *top = lsize + y;
 
-        /* Copy data */
-        memcpy(dst_data + left_size, src_data, data_size);
+            *bottom = lsize + y + 1;
+            changed = 1;
 
-        /* Add right margin */
-        memset(dst_data + left_size + data_size, 0, right_size);
+        }
 
         dst_data += dst_stride;
         src_data += src_stride;
 
-        height--;
-
     }
 
-    /* Add bottom margin */
-    while (bottom > 0) {
-        memset(dst_data, 0, frame->width * 4);
-        dst_data += dst_stride;
-        bottom--;
-    }
-
-    /* Frame converted */
-    return frame;
+    return changed;
 
 }
 
@@ -407,62 +962,95 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer) {
     if (buffer == NULL || buffer->surface == NULL)
         return;
 
-    /* Obtain destination frame */
-    AVFrame* dst = video->next_frame;
+    /* Obtain destination dimensions (the destination frame itself is owned
+     * by the encoding thread) */
+    int dst_width = video->width;
+    int dst_height = video->height;
 
     /* Determine width of image if height is scaled to match destination */
-    int scaled_width = buffer->width * dst->height / buffer->height;
+    int scaled_width = buffer->width * dst_height / buffer->height;
 
     /* Determine height of image if width is scaled to match destination */
-    int scaled_height = buffer->height * dst->width / buffer->width;
+    int scaled_height = buffer->height * dst_width / buffer->width;
 
     /* If height-based scaling results in a fit width, add pillarboxes */
-    if (scaled_width <= dst->width) {
+    if (scaled_width <= dst_width) {
         lsize = 0;
-        psize = (dst->width - scaled_width)
-               * buffer->height / dst->height / 2;
+        psize = (dst_width - scaled_width)
+               * buffer->height / dst_height / 2;
     }
 
     /* If width-based scaling results in a fit width, add letterboxes */
     else {
-        assert(scaled_height <= dst->height);
+        assert(scaled_height <= dst_height);
         psize = 0;
-        lsize = (dst->height - scaled_height)
-               * buffer->width / dst->width / 2;
+        lsize = (dst_height - scaled_height)
+               * buffer->width / dst_width / 2;
     }
 
-    /* Prepare source frame for buffer */
-    AVFrame* src = guacenc_video_frame_convert(buffer, lsize, psize);
-    if (src == NULL) {
-        guacenc_log(GUAC_LOG_WARNING, "Failed to allocate source frame. "
-                "Frame dropped.");
-        return;
+    /* Determine dimensions of prepared image, including margins */
+    int width = buffer->width + psize * 2;
+    int height = buffer->height + lsize * 2;
+
+    /* Range of rows which differ from the previously-prepared image */
+    int top = 0;
+    int bottom = height;
+
+    /* Replace the previously-prepared image if its size has changed, in
+     * which case the entire image must be handed to the encoding thread */
+    AVFrame* prepared = video->prepared;
+    if (prepared == NULL || prepared->width != width
+            || prepared->height != height) {
+
+        guacenc_video_frame_free(&video->prepared);
+        prepared = video->prepared = guacenc_video_frame_alloc(
+                AV_PIX_FMT_RGB32, width, height);
+
+        if (prepared == NULL) {
+            guacenc_log(GUAC_LOG_WARNING, "Failed to allocate source frame. "
+                    "Frame dropped.");
+            return;
+        }
+
+        /* Black margins are never modified */
+        memset(prepared->data[0], 0, prepared->linesize[0] * height);
+        guacenc_video_frame_update(prepared, buffer, lsize, psize,
+                &top, &bottom);
+
+        top = 0;
+        bottom = height;
+
     }
 
-    /* Prepare scaling context */
-    struct SwsContext* sws = sws_getContext(src->width, src->height,
-            AV_PIX_FMT_RGB32, dst->width, dst->height, AV_PIX_FMT_YUV420P,
-            SWS_BICUBIC, NULL, NULL, NULL);
+    /* Simply continue writing the previous frame if nothing has changed */
+    else if (!guacenc_video_frame_update(prepared, buffer, lsize, psize,
+                &top, &bottom))
+        return;
 
-    /* Abort if scaling context could not be created */
-    if (sws == NULL) {
-        guacenc_log(GUAC_LOG_WARNING, "Failed to allocate software scaling "
-                "context. Frame dropped.");
-        av_freep(&src->data[0]);
-        av_frame_free(&src);
+    /* Copy changed rows for the encoding thread */
+    AVFrame* rows = guacenc_video_frame_alloc(AV_PIX_FMT_RGB32, width,
+            bottom - top);
+    if (rows == NULL) {
+        guacenc_log(GUAC_LOG_WARNING, "Failed to allocate source frame. "
+                "Frame dropped.");
+
+        /* The changed rows must be handed over with the next frame */
+        guacenc_video_frame_free(&video->prepared);
         return;
     }
 
-    /* Apply scaling, copying the source frame to the destination */
-    sws_scale(sws, (const uint8_t* const*) src->data, src->linesize,
-            0, src->height, dst->data, dst->linesize);
-
-    /* Free scaling context */
-    sws_freeContext(sws);
+    for (int i = 0; i < rows->height; i++)
+        memcpy(rows->data[0] + i * rows->linesize[0],
+                prepared->data[0] + (top + i) * prepared->linesize[0],
+                width * 4);
 
-    /* Free source frame */
-    av_freep(&src->data[0]);
-    av_frame_free(&src);
+    /* Hand changed rows to encoding thread for scaling and eventual write */
+    guacenc_video_enqueue(video, (guacenc_video_operation) {
+        .type   = GUACENC_VIDEO_OPERATION_PREPARE,
+        .frame  = rows,
+        .y      = top,
+        .height = height
+    });
 
 }
 
@@ -472,8 +1060,17 @@ int guacenc_video_free(guacenc_video* video) {
     if (video == NULL)
         return 0;
 
+    /* Wait for all queued operations to be performed */
+    pthread_mutex_lock(&(video->lock));
+    video->stopping = 1;
+    pthread_cond_broadcast(&(video->modified));
+    pthread_mutex_unlock(&(video->lock));
+
+    pthread_join(video->encoder_thread, NULL);
+
     /* Write final frame */
     guacenc_video_flush_frame(video);
+    int64_t frames = video->next_pts;
 
     /* Flush any unwritten frames */
     int retval;
@@ -494,9 +1091,22 @@ int guacenc_video_free(guacenc_video* video) {
         avio_close(video->container_format_context->pb);
     }
 
+    /* Report overall throughput */
+    guac_timestamp elapsed = guac_timestamp_current() - video->started;
+    guacenc_log(GUAC_LOG_INFO, "Encoded %" PRId64 " frame(s) in %" PRId64
+            ".%03" PRId64 " seconds (%.1f frames/sec) using %s.",
+            frames, (int64_t) (elapsed / 1000), (int64_t) (elapsed % 1000),
+            elapsed > 0 ? frames * 1000.0 / elapsed : 0.0,
+            video->hwaccel != NULL ? video->hwaccel : "software");
+
     /* Free frame encoding data */
-    av_freep(&video->next_frame->data[0]);
     av_frame_free(&video->next_frame);
+    guacenc_video_frame_free(&video->prepared);
+    guacenc_video_frame_free(&video->source);
+    guacenc_video_frame_free(&video->band);
+    av_frame_free(&video->transfer_frame);
+    sws_freeContext(video->sws);
+    sws_freeContext(video->sws_band);
 
     /* Clean up encoding context */
     if (video->context != NULL) {
@@ -506,6 +1116,9 @@ int guacenc_video_free(guacenc_video* video) {
         avcodec_free_context(&(video->context));
     }
 
+    pthread_mutex_destroy(&(video->lock));
+    pthread_cond_destroy(&(video->modified));
+
     guac_mem_free(video);
     return 0;
 
@@ -34,6 +34,10 @@
 #include <libavformat/avformat.h>
 #endif
 
+#include <libswscale/swscale.h>
+
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -42,6 +46,100 @@
  */
 #define GUACENC_VIDEO_FRAMERATE 25
 
+/**
+ * The number of threads that libavcodec should use when encoding video. A
+ * value of zero allows libavcodec to choose an appropriate number of threads
+ * based on the number of available CPUs.
+ */
+#define GUACENC_VIDEO_ENCODER_THREADS 0
+
+/**
+ * The maximum number of operations which may be waiting for the encoding
+ * thread of a guacenc_video at any one time. Once this many operations are
+ * waiting, further frames will not be accepted until the encoding thread
+ * catches up, limiting the number of copies of frame data held in memory.
+ */
+#define GUACENC_VIDEO_QUEUE_SIZE 8
+
+/**
+ * The number of rows within each horizontal band of a video frame that is
+ * converted independently of the rest of the frame. When a prepared frame
+ * needs no scaling, only the bands containing changed rows are converted.
+ * This value must be a multiple of 2 due to vertical chroma subsampling.
+ */
+#define GUACENC_VIDEO_BAND_HEIGHT 16
+
+/**
+ * The number of additional rows above and below each band that are included
+ * when the band is converted independently, such that the chroma filter
+ * produces exactly the same output as if the entire frame were converted.
+ * This value must be a multiple of 2 due to vertical chroma subsampling.
+ */
+#define GUACENC_VIDEO_BAND_PADDING 8
+
+/**
+ * The type of an operation which must be performed by the encoding thread of
+ * a guacenc_video.
+ */
+typedef enum guacenc_video_operation_type {
+
+    /**
+     * The frame of the operation must be scaled and converted to replace the
+     * frame that will be written next.
+     */
+    GUACENC_VIDEO_OPERATION_PREPARE,
+
+    /**
+     * The frame that was most recently prepared must be written to the video
+     * the number of times given by the operation.
+     */
+    GUACENC_VIDEO_OPERATION_WRITE
+
+} guacenc_video_operation_type;
+
+/**
+ * An operation which has been queued for the encoding thread of a
+ * guacenc_video, in the order dictated by calls to
+ * guacenc_video_advance_timeline() and guacenc_video_prepare_frame().
+ */
+typedef struct guacenc_video_operation {
+
+    /**
+     * The type of this operation.
+     */
+    guacenc_video_operation_type type;
+
+    /**
+     * For GUACENC_VIDEO_OPERATION_PREPARE operations, a copy of the rows of
+     * the prepared image that have changed since the previous prepared image,
+     * including any black margins, which is owned by the encoding thread.
+     * NULL for all other operations.
+     */
+    AVFrame* frame;
+
+    /**
+     * For GUACENC_VIDEO_OPERATION_PREPARE operations, the row within the
+     * prepared image that corresponds to the first row of frame. Zero for all
+     * other operations.
+     */
+    int y;
+
+    /**
+     * For GUACENC_VIDEO_OPERATION_PREPARE operations, the total height of the
+     * prepared image, in pixels. If this differs from the height of the
+     * previous prepared image, frame contains the entire image. Zero for all
+     * other operations.
+     */
+    int height;
+
+    /**
+     * For GUACENC_VIDEO_OPERATION_WRITE operations, the number of times the
+     * prepared frame must be written. Zero for all other operations.
+     */
+    int count;
+
+} guacenc_video_operation;
+
 /**
  * A video which is actively being encoded. Frames can be added to the video
  * as they are generated, along with their associated timestamps, and the
@@ -83,6 +181,27 @@ typedef struct guacenc_video {
      */
     int bitrate;
 
+    /**
+     * The name of the type of hardware device encoding this video, as defined
+     * by libavutil, or NULL if this video is being encoded in software. If
+     * non-NULL, each frame is uploaded to the memory of that device with
+     * guacenc_hwaccel_upload_frame() before being encoded.
+     */
+    const char* hwaccel;
+
+    /**
+     * Intermediate NV12 frame through which frames are uploaded to the memory
+     * of the hardware device encoding this video, or NULL if no frame has yet
+     * been uploaded or this video is being encoded in software.
+     */
+    AVFrame* transfer_frame;
+
+    /**
+     * The time at which encoding of this video began, used to report the
+     * overall encoding throughput once the video has been completely written.
+     */
+    guac_timestamp started;
+
     /**
      * An image data area containing the next frame to be written, encoded as
      * YCbCr image data in the format required by avcodec_encode_video2(), for
@@ -102,14 +221,128 @@ typedef struct guacenc_video {
      */
     guac_timestamp last_timestamp;
 
+    /**
+     * The image most recently handed to the encoding thread by
+     * guacenc_video_prepare_frame(), including any black margins, or NULL if
+     * no frame has yet been prepared. Each newly-prepared image is compared
+     * against this image such that only changed rows need be handed to the
+     * encoding thread. This frame is accessed only by the thread preparing
+     * frames.
+     */
+    AVFrame* prepared;
+
+    /**
+     * The encoding thread's copy of the most recently prepared image, updated
+     * with the changed rows of each GUACENC_VIDEO_OPERATION_PREPARE
+     * operation, or NULL if no frame has yet been prepared.
+     */
+    AVFrame* source;
+
+    /**
+     * Temporary YCbCr frame receiving each independently-converted band of
+     * source, including its padding, or NULL if no band has yet been
+     * converted.
+     */
+    AVFrame* band;
+
+    /**
+     * The scaling context most recently used to convert a prepared frame to
+     * the YCbCr format of next_frame, or NULL if no frame has yet been
+     * prepared. This context is reused for as long as the dimensions of
+     * prepared frames do not change, and scales slices of each frame in
+     * parallel where supported by libswscale.
+     */
+    struct SwsContext* sws;
+
+    /**
+     * The width of the prepared frames that sws was created to convert, in
+     * pixels.
+     */
+    int sws_width;
+
+    /**
+     * The height of the prepared frames that sws was created to convert, in
+     * pixels.
+     */
+    int sws_height;
+
+    /**
+     * The context used to convert individual bands of source to the YCbCr
+     * format of next_frame when no scaling is required, or NULL if no band has
+     * yet been converted.
+     */
+    struct SwsContext* sws_band;
+
+    /**
+     * The thread which scales prepared frames and encodes all frames of this
+     * video, such that encoding may proceed in parallel with the rendering of
+     * further frames. Only this thread may access context, next_frame,
+     * next_pts, source, band, sws and sws_band until the thread has been
+     * joined by guacenc_video_free().
+     */
+    pthread_t encoder_thread;
+
+    /**
+     * Lock which must be acquired before accessing the queue, queue_start,
+     * queue_length, stopping or failed members of this video.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever an operation is added to or
+     * removed from the queue, or the video is being freed.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Circular buffer of all operations awaiting the encoding thread, in the
+     * order they must be performed.
+     */
+    guacenc_video_operation queue[GUACENC_VIDEO_QUEUE_SIZE];
+
+    /**
+     * The index of the oldest operation within the queue.
+     */
+    int queue_start;
+
+    /**
+     * The number of operations currently within the queue.
+     */
+    int queue_length;
+
+    /**
+     * Non-zero if the video is being freed and the encoding thread should stop
+     * once all queued operations have been performed, zero otherwise.
+     */
+    int stopping;
+
+    /**
+     * Non-zero if the encoding thread has failed to write a frame, in which
+     * case all further frames are discarded, zero otherwise.
+     */
+    int failed;
+
 } guacenc_video;
 
+/**
+ * Sets the number of threads that libavcodec should use when encoding each
+ * guacenc_video allocated by the current process from this point forward,
+ * overriding GUACENC_VIDEO_ENCODER_THREADS. This allows the CPUs to be shared
+ * fairly when several recordings are encoded at once.
+ *
+ * @param count
+ *     The number of threads libavcodec should use for each new video, or zero
+ *     to allow libavcodec to choose based on the number of available CPUs.
+ */
+void guacenc_video_set_default_encoder_threads(int count);
+
 /**
  * Allocates a new guacenc_video which encodes video according to the given
  * specifications, saving the output in the given file. If the output file
  * already exists, encoding will be aborted, and the original file contents
  * will be preserved. Frames will be scaled up or down as necessary to fit the
- * given width and height.
+ * given width and height. Scaling and encoding are performed by a dedicated
+ * thread, with frames being handed to that thread as they are prepared.
  *
  * @param path
  *     The full path to the file in which encoded video should be written.
@@ -118,6 +351,17 @@ typedef struct guacenc_video {
  *     The name of the codec to use for the video encoding, as defined by
  *     ffmpeg / libavcodec.
  *
+ * @param hwaccel
+ *     The name of the type of hardware device which should be used to encode
+ *     the video ("vaapi", "cuda", or "qsv"), or NULL if the video should be
+ *     encoded in software. If hardware-accelerated encoding is not possible,
+ *     the video is encoded in software using the given codec.
+ *
+ * @param live
+ *     Whether the video should be written as fragmented MP4, with each
+ *     fragment flushed to the output file as soon as it is complete, such
+ *     that the video may be played back while it is still being encoded.
+ *
  * @param width
  *     The width of the desired video, in pixels.
  *
@@ -129,7 +373,7 @@ typedef struct guacenc_video {
  *     second.
  */
 guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
-        int width, int height, int bitrate);
+        const char* hwaccel, bool live, int width, int height, int bitrate);
 
 /**
  * Advances the timeline of the encoding process to the given timestamp, such
@@ -153,7 +397,9 @@ guacenc_video* guacenc_video_alloc(const char* path, const char* codec_name,
  *
  * @return
  *     Zero if the timeline was adjusted successfully, non-zero if an error
- *     occurs (such as during the encoding of duplicate frames).
+ *     has occurred (such as during the encoding of duplicate frames). As
+ *     frames are encoded in the background, errors may be reported by a later
+ *     call than the one that requested the failed frames.
  */
 int guacenc_video_advance_timeline(guacenc_video* video,
         guac_timestamp timestamp);
@@ -167,7 +413,11 @@ int guacenc_video_advance_timeline(guacenc_video* video,
  * prepared within the same pair of frame boundaries). The prepared frame will
  * not be written until it is implicitly flushed through updates to the video
  * timeline or through reaching the end of the encoding process
- * (guacenc_video_free()).
+ * (guacenc_video_free()). The image data of the given buffer is copied by
+ * this function, and the buffer may be modified freely once this function
+ * returns. Only the rows that differ from the previously-prepared frame are
+ * handed to the encoding thread, and a frame identical to the previous frame
+ * is not handed to the encoding thread at all.
  *
  * @param video
  *     The video in which the given buffer should be queued for possible
@@ -181,8 +431,9 @@ void guacenc_video_prepare_frame(guacenc_video* video, guacenc_buffer* buffer);
 
 /**
  * Frees all resources associated with the given video, finalizing the encoding
- * process. Any buffered frames which have not yet been written will be written
- * at this point.
+ * process. This function waits for the encoding thread to finish all frames
+ * previously handed to it. Any buffered frames which have not yet been written
+ * will be written at this point.
  *
  * @return
  *     Zero if the video was successfully written and freed, non-zero if the
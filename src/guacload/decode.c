@@ -0,0 +1,255 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "decode.h"
+#include "log.h"
+
+#include <stdio.h>
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <jpeglib.h>
+
+#ifdef ENABLE_WEBP
+#include <webp/decode.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+guacload_decoder_mapping guacload_decoder_map[] = {
+    {"image/png",  guacload_png_decoder},
+    {"image/jpeg", guacload_jpeg_decoder},
+#ifdef ENABLE_WEBP
+    {"image/webp", guacload_webp_decoder},
+#endif
+    {NULL,         NULL}
+};
+
+guacload_decoder* guacload_get_decoder(const char* mimetype) {
+
+    /* Search through mapping for the decoder having given mimetype */
+    guacload_decoder_mapping* current = guacload_decoder_map;
+    while (current->mimetype != NULL) {
+
+        /* Return decoder if mimetype matches */
+        if (strcmp(current->mimetype, mimetype) == 0)
+            return current->decoder;
+
+        /* Next candidate decoder */
+        current++;
+
+    }
+
+    /* No such decoder */
+    guacload_log(GUAC_LOG_WARNING, "Support for \"%s\" not present", mimetype);
+    return NULL;
+
+}
+
+/**
+ * The current state of the PNG decoder.
+ */
+typedef struct guacload_png_read_state {
+
+    /**
+     * The buffer of unread image data. This pointer will be updated to point
+     * to the next unread byte when data is read.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes remaining to be read within the buffer.
+     */
+    unsigned int length;
+
+} guacload_png_read_state;
+
+/**
+ * Attempts to fill the given buffer with read image data. The behavior of
+ * this function is dictated by cairo_read_t.
+ *
+ * @param closure
+ *     The current state of the PNG decoding process (an instance of
+ *     guacload_png_read_state).
+ *
+ * @param data
+ *     The data buffer to fill.
+ *
+ * @param length
+ *     The number of bytes to fill within the data buffer.
+ *
+ * @return
+ *     CAIRO_STATUS_SUCCESS if all data was read successfully (the entire
+ *     buffer was filled), CAIRO_STATUS_READ_ERROR otherwise.
+ */
+static cairo_status_t guacload_png_read(void* closure, unsigned char* data,
+        unsigned int length) {
+
+    guacload_png_read_state* state = (guacload_png_read_state*) closure;
+
+    /* If more data is requested than is available in buffer, fail */
+    if (length > state->length)
+        return CAIRO_STATUS_READ_ERROR;
+
+    /* Read chunk into buffer */
+    memcpy(data, state->data, length);
+
+    /* Advance to next chunk */
+    state->length -= length;
+    state->data += length;
+
+    /* Read was successful */
+    return CAIRO_STATUS_SUCCESS;
+
+}
+
+cairo_surface_t* guacload_png_decoder(unsigned char* data, int length) {
+
+    guacload_png_read_state state = {
+        .data = data,
+        .length = length
+    };
+
+    /* Read PNG from data */
+    cairo_surface_t* surface =
+        cairo_image_surface_create_from_png_stream(guacload_png_read, &state);
+
+    /* If surface returned with an error, just return NULL */
+    if (surface != NULL &&
+            cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        guacload_log(GUAC_LOG_WARNING, "Invalid PNG data");
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    /* PNG was read successfully */
+    return surface;
+
+}
+
+cairo_surface_t* guacload_jpeg_decoder(unsigned char* data, int length) {
+
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    /* Create decompressor with standard error handling */
+    jpeg_create_decompress(&cinfo);
+    cinfo.err = jpeg_std_error(&jerr);
+
+    /* Read JPEG directly from memory buffer */
+    jpeg_mem_src(&cinfo, data, length);
+
+    /* Read and validate JPEG header */
+    if (!jpeg_read_header(&cinfo, TRUE)) {
+        guacload_log(GUAC_LOG_WARNING, "Invalid JPEG data");
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+
+    /* Begin decompression */
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    /* Pull JPEG dimensions from decompressor */
+    int width = cinfo.output_width;
+    int height = cinfo.output_height;
+
+    /* Allocate sufficient buffer space for one JPEG scanline */
+    unsigned char* jpeg_scanline = guac_mem_alloc(width, 3);
+
+    /* Create blank Cairo surface (no transparency in JPEG) */
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+
+    /* Pull underlying buffer and its stride */
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* row = cairo_image_surface_get_data(surface);
+
+    /* Read JPEG into surface */
+    while (cinfo.output_scanline < height) {
+
+        /* Read single scanline */
+        unsigned char* buffers[1] = { jpeg_scanline };
+        jpeg_read_scanlines(&cinfo, buffers, 1);
+
+        /* Copy scanline to Cairo surface, translating from 24-bit RGB */
+        uint32_t* current = (uint32_t*) row;
+        const unsigned char* src = jpeg_scanline;
+        for (int x = 0; x < width; x++, src += 3)
+            *(current++) = 0xFF000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+
+        /* Advance to next row of Cairo surface */
+        row += stride;
+
+    }
+
+    /* Scanline buffer is no longer needed */
+    guac_mem_free(jpeg_scanline);
+
+    /* Finish decompression, marking the surface as modified */
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    cairo_surface_mark_dirty(surface);
+
+    /* JPEG was read successfully */
+    return surface;
+
+}
+
+#ifdef ENABLE_WEBP
+cairo_surface_t* guacload_webp_decoder(unsigned char* data, int length) {
+
+    int width, height;
+
+    /* Validate WebP and pull dimensions */
+    if (!WebPGetInfo((uint8_t*) data, length, &width, &height)) {
+        guacload_log(GUAC_LOG_WARNING, "Invalid WebP data");
+        return NULL;
+    }
+
+    /* Create blank Cairo surface */
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            width, height);
+
+    /* Pull underlying buffer and its stride */
+    cairo_surface_flush(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* image = cairo_image_surface_get_data(surface);
+
+    /* Read WebP into surface */
+    uint8_t* result = WebPDecodeBGRAInto((uint8_t*) data, length,
+            (uint8_t*) image, stride * height, stride);
+
+    /* Verify WebP was successfully decoded */
+    if (result == NULL) {
+        guacload_log(GUAC_LOG_WARNING, "Invalid WebP data");
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    /* WebP was read successfully */
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+#endif
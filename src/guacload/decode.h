@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_DECODE_H
+#define GUACLOAD_DECODE_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * Callback function which is provided raw, encoded image data of the given
+ * length. The function is expected to return a new Cairo surface which will
+ * later be freed via cairo_surface_destroy().
+ *
+ * @param data
+ *     The raw encoded image data that this function must decode.
+ *
+ * @param length
+ *     The length of the image data, in bytes.
+ *
+ * @return
+ *     A newly-allocated Cairo surface containing the decoded image, or NULL
+ *     if decoding fails.
+ */
+typedef cairo_surface_t* guacload_decoder(unsigned char* data, int length);
+
+/**
+ * Mapping of image mimetype to corresponding decoder function.
+ */
+typedef struct guacload_decoder_mapping {
+
+    /**
+     * The mimetype of the image that the associated decoder can read.
+     */
+    const char* mimetype;
+
+    /**
+     * The decoder function to use when an image stream of the associated
+     * mimetype is received.
+     */
+    guacload_decoder* decoder;
+
+} guacload_decoder_mapping;
+
+/**
+ * Array of all mimetype/decoder mappings for all supported image types,
+ * terminated by an entry with a NULL mimetype.
+ */
+extern guacload_decoder_mapping guacload_decoder_map[];
+
+/**
+ * Returns the decoder associated with the given mimetype. If no such decoder
+ * exists, NULL is returned.
+ *
+ * @param mimetype
+ *     The image mimetype to return the associated decoder of.
+ *
+ * @return
+ *     The decoder associated with the given mimetype, or NULL if no such
+ *     decoder exists.
+ */
+guacload_decoder* guacload_get_decoder(const char* mimetype);
+
+/**
+ * Decoder implementation which handles "image/png" images.
+ */
+guacload_decoder guacload_png_decoder;
+
+/**
+ * Decoder implementation which handles "image/jpeg" images.
+ */
+guacload_decoder guacload_jpeg_decoder;
+
+#ifdef ENABLE_WEBP
+/**
+ * Decoder implementation which handles "image/webp" images.
+ */
+guacload_decoder guacload_webp_decoder;
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "draw.h"
+#include "session.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/display.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/rect.h>
+
+cairo_operator_t guacload_draw_operator(guac_composite_mode mask) {
+
+    /* Translate Guacamole channel mask into Cairo operator */
+    switch (mask) {
+
+        /* Source */
+        case GUAC_COMP_SRC:
+            return CAIRO_OPERATOR_SOURCE;
+
+        /* Over */
+        case GUAC_COMP_OVER:
+            return CAIRO_OPERATOR_OVER;
+
+        /* In */
+        case GUAC_COMP_IN:
+            return CAIRO_OPERATOR_IN;
+
+        /* Out */
+        case GUAC_COMP_OUT:
+            return CAIRO_OPERATOR_OUT;
+
+        /* Atop */
+        case GUAC_COMP_ATOP:
+            return CAIRO_OPERATOR_ATOP;
+
+        /* Over (source/destination reversed) */
+        case GUAC_COMP_ROVER:
+            return CAIRO_OPERATOR_DEST_OVER;
+
+        /* In (source/destination reversed) */
+        case GUAC_COMP_RIN:
+            return CAIRO_OPERATOR_DEST_IN;
+
+        /* Out (source/destination reversed) */
+        case GUAC_COMP_ROUT:
+            return CAIRO_OPERATOR_DEST_OUT;
+
+        /* Atop (source/destination reversed) */
+        case GUAC_COMP_RATOP:
+            return CAIRO_OPERATOR_DEST_ATOP;
+
+        /* XOR */
+        case GUAC_COMP_XOR:
+            return CAIRO_OPERATOR_XOR;
+
+        /* Additive */
+        case GUAC_COMP_PLUS:
+            return CAIRO_OPERATOR_ADD;
+
+        /* If unrecognized, just default to CAIRO_OPERATOR_OVER */
+        default:
+            return CAIRO_OPERATOR_OVER;
+
+    }
+
+}
+
+/**
+ * Enlarges the given buffer, if necessary, such that it contains the given
+ * rectangle. Buffers are implicitly resized by the Guacamole client as they
+ * are drawn to, while visible layers are not. Layers are never resized by
+ * this function.
+ *
+ * @param index
+ *     The index of the layer or buffer.
+ *
+ * @param layer
+ *     The layer or buffer that will be drawn to.
+ *
+ * @param rect
+ *     The rectangle that will be drawn to.
+ */
+static void guacload_draw_fit(int index, guacload_layer* layer,
+        const guac_rect* rect) {
+
+    if (index >= 0)
+        return;
+
+    guac_rect bounds;
+    guac_display_layer_get_bounds(layer->layer, &bounds);
+
+    if (rect->right > bounds.right || rect->bottom > bounds.bottom)
+        guac_display_layer_resize(layer->layer,
+                rect->right > bounds.right ? rect->right : bounds.right,
+                rect->bottom > bounds.bottom ? rect->bottom : bounds.bottom);
+
+}
+
+int guacload_draw_image(guacload_session* session, int index, int mask,
+        int x, int y, cairo_surface_t* image) {
+
+    guacload_layer* layer = guacload_session_get_layer(session, index);
+    if (layer == NULL)
+        return 1;
+
+    guac_rect dst;
+    guac_rect_init(&dst, x, y, cairo_image_surface_get_width(image),
+            cairo_image_surface_get_height(image));
+
+    guacload_draw_fit(index, layer, &dst);
+
+    guac_display_layer_cairo_context* context =
+        guac_display_layer_open_cairo(layer->layer);
+
+    cairo_t* cairo = context->cairo;
+    cairo_set_operator(cairo, guacload_draw_operator(mask));
+    cairo_set_source_surface(cairo, image, x, y);
+    cairo_rectangle(cairo, x, y, guac_rect_width(&dst), guac_rect_height(&dst));
+    cairo_fill(cairo);
+
+    guac_rect_constrain(&dst, &context->bounds);
+    guac_rect_extend(&context->dirty, &dst);
+
+    guac_display_layer_close_cairo(layer->layer, context);
+    return 0;
+
+}
+
+int guacload_draw_fill(guacload_session* session, int index, int mask,
+        int r, int g, int b, int a) {
+
+    guacload_layer* layer = guacload_session_get_layer(session, index);
+    if (layer == NULL)
+        return 1;
+
+    /* Nothing to fill if no path has been established */
+    guac_rect dst = layer->path;
+    layer->path = (guac_rect) { 0 };
+    if (guac_rect_is_empty(&dst))
+        return 0;
+
+    guacload_draw_fit(index, layer, &dst);
+
+    guac_display_layer_cairo_context* context =
+        guac_display_layer_open_cairo(layer->layer);
+
+    cairo_t* cairo = context->cairo;
+    cairo_set_operator(cairo, guacload_draw_operator(mask));
+    cairo_set_source_rgba(cairo, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
+    cairo_rectangle(cairo, dst.left, dst.top, guac_rect_width(&dst),
+            guac_rect_height(&dst));
+    cairo_fill(cairo);
+
+    guac_rect_constrain(&dst, &context->bounds);
+    guac_rect_extend(&context->dirty, &dst);
+
+    guac_display_layer_close_cairo(layer->layer, context);
+    return 0;
+
+}
+
+int guacload_draw_copy(guacload_session* session, int src_index,
+        const guac_rect* src, int mask, int dst_index, int x, int y) {
+
+    guacload_layer* src_layer = guacload_session_get_layer(session, src_index);
+    guacload_layer* dst_layer = guacload_session_get_layer(session, dst_index);
+    if (src_layer == NULL || dst_layer == NULL)
+        return 1;
+
+    int width = guac_rect_width(src);
+    int height = guac_rect_height(src);
+    if (width <= 0 || height <= 0)
+        return 0;
+
+    guac_rect dst;
+    guac_rect_init(&dst, x, y, width, height);
+
+    guacload_draw_fit(dst_index, dst_layer, &dst);
+
+    /* NOTE: The display lock acquired by opening a context is reentrant, and
+     * both contexts may safely be held at once */
+    guac_display_layer_cairo_context* src_context =
+        guac_display_layer_open_cairo(src_layer->layer);
+
+    guac_display_layer_cairo_context* dst_context =
+        guac_display_layer_open_cairo(dst_layer->layer);
+
+    /* Copies within the same surface must be made through an intermediate
+     * surface, as Cairo does not define the result of drawing a surface to
+     * itself */
+    cairo_surface_t* source = src_context->surface;
+    int source_x = src->left;
+    int source_y = src->top;
+
+    if (src_layer == dst_layer) {
+
+        source = cairo_image_surface_create(
+                cairo_image_surface_get_format(src_context->surface),
+                width, height);
+
+        cairo_t* copy = cairo_create(source);
+        cairo_set_operator(copy, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(copy, src_context->surface,
+                -src->left, -src->top);
+        cairo_paint(copy);
+        cairo_destroy(copy);
+
+        source_x = 0;
+        source_y = 0;
+
+    }
+
+    cairo_t* cairo = dst_context->cairo;
+    cairo_set_operator(cairo, guacload_draw_operator(mask));
+    cairo_set_source_surface(cairo, source, x - source_x, y - source_y);
+    cairo_rectangle(cairo, x, y, width, height);
+    cairo_fill(cairo);
+
+    if (source != src_context->surface)
+        cairo_surface_destroy(source);
+
+    guac_rect_constrain(&dst, &dst_context->bounds);
+    guac_rect_extend(&dst_context->dirty, &dst);
+    dst_context->hint_from = src_layer->layer;
+
+    guac_display_layer_close_cairo(dst_layer->layer, dst_context);
+    guac_display_layer_close_cairo(src_layer->layer, src_context);
+    return 0;
+
+}
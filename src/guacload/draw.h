@@ -0,0 +1,135 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_DRAW_H
+#define GUACLOAD_DRAW_H
+
+#include "config.h"
+#include "session.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/protocol-types.h>
+
+/**
+ * Translates the given Guacamole protocol compositing mode (channel mask) into
+ * the corresponding Cairo composition operator. If no such operator exists,
+ * CAIRO_OPERATOR_OVER will be returned by default.
+ *
+ * @param mask
+ *     The Guacamole protocol compositing mode (channel mask) to translate.
+ *
+ * @return
+ *     The cairo_operator_t that corresponds to the given compositing mode
+ *     (channel mask). CAIRO_OPERATOR_OVER will be returned by default if no
+ *     such operator exists.
+ */
+cairo_operator_t guacload_draw_operator(guac_composite_mode mask);
+
+/**
+ * Draws the given image to the layer or buffer having the given index,
+ * enlarging buffers as necessary to contain the image.
+ *
+ * @param session
+ *     The session of the recording drawing the image.
+ *
+ * @param index
+ *     The index of the destination layer or buffer.
+ *
+ * @param mask
+ *     The Guacamole protocol compositing mode (channel mask) to apply.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param image
+ *     The image to draw.
+ *
+ * @return
+ *     Zero if the image was drawn successfully, non-zero otherwise.
+ */
+int guacload_draw_image(guacload_session* session, int index, int mask,
+        int x, int y, cairo_surface_t* image);
+
+/**
+ * Fills the current path of the layer or buffer having the given index with
+ * the given color, clearing that path.
+ *
+ * @param session
+ *     The session of the recording drawing the fill.
+ *
+ * @param index
+ *     The index of the destination layer or buffer.
+ *
+ * @param mask
+ *     The Guacamole protocol compositing mode (channel mask) to apply.
+ *
+ * @param r
+ *     The red component of the fill color, from 0 to 255 inclusive.
+ *
+ * @param g
+ *     The green component of the fill color, from 0 to 255 inclusive.
+ *
+ * @param b
+ *     The blue component of the fill color, from 0 to 255 inclusive.
+ *
+ * @param a
+ *     The alpha component of the fill color, from 0 to 255 inclusive.
+ *
+ * @return
+ *     Zero if the fill was drawn successfully, non-zero otherwise.
+ */
+int guacload_draw_fill(guacload_session* session, int index, int mask,
+        int r, int g, int b, int a);
+
+/**
+ * Copies the given rectangle of one layer or buffer to another location,
+ * which may be within the same layer or buffer.
+ *
+ * @param session
+ *     The session of the recording drawing the copy.
+ *
+ * @param src_index
+ *     The index of the source layer or buffer.
+ *
+ * @param src
+ *     The rectangle of the source layer or buffer to copy.
+ *
+ * @param mask
+ *     The Guacamole protocol compositing mode (channel mask) to apply.
+ *
+ * @param dst_index
+ *     The index of the destination layer or buffer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle.
+ *
+ * @return
+ *     Zero if the copy was drawn successfully, non-zero otherwise.
+ */
+int guacload_draw_copy(guacload_session* session, int src_index,
+        const guac_rect* src, int mask, int dst_index, int x, int y);
+
+#endif
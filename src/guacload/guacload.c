@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacload.h"
+#include "log.h"
+#include "parse.h"
+#include "report.h"
+#include "session.h"
+
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/timestamp.h>
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char* argv[]) {
+
+    int i;
+
+    /* Load defaults */
+    int sessions_per_file = GUACLOAD_DEFAULT_SESSIONS;
+    double speed = GUACLOAD_DEFAULT_SPEED;
+    int worker_threads = 0;
+    bool shared_workers = false;
+
+    /* Parse arguments */
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:t:S")) != -1) {
+
+        /* -n: Concurrent sessions per recording */
+        if (opt == 'n') {
+            if (guacload_parse_int(optarg, &sessions_per_file)
+                    || sessions_per_file > GUACLOAD_MAX_SESSIONS) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid number of sessions.");
+                goto invalid_options;
+            }
+        }
+
+        /* -s: Replay speed (0 = as fast as possible) */
+        else if (opt == 's') {
+            if (guacload_parse_double(optarg, &speed)) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid replay speed.");
+                goto invalid_options;
+            }
+        }
+
+        /* -t: Display worker threads (0 = one per processor) */
+        else if (opt == 't') {
+            if (strcmp(optarg, "0") == 0)
+                worker_threads = 0;
+            else if (guacload_parse_int(optarg, &worker_threads)) {
+                guacload_log(GUAC_LOG_ERROR, "Invalid number of display "
+                        "worker threads.");
+                goto invalid_options;
+            }
+        }
+
+        /* -S: Share display worker threads between sessions */
+        else if (opt == 'S')
+            shared_workers = true;
+
+        /* Invalid option */
+        else {
+            goto invalid_options;
+        }
+
+    }
+
+    /* Log start */
+    guacload_log(GUAC_LOG_INFO, "Guacamole replay load generator (guacload) "
+            "version " VERSION);
+
+    /* Abort if no files given */
+    int total_files = argc - optind;
+    if (total_files <= 0) {
+        guacload_log(GUAC_LOG_INFO, "No input files specified. Nothing to do.");
+        return 0;
+    }
+
+    /* Configure display worker threads as guacd would */
+    guac_display_set_default_worker_threads(worker_threads);
+    guac_display_set_shared_workers(shared_workers);
+
+    int total_sessions = total_files * sessions_per_file;
+    guacload_log(GUAC_LOG_INFO, "Replaying %i input file(s) as %i concurrent "
+            "session(s).", total_files, total_sessions);
+
+    guacload_session** sessions = guac_mem_zalloc(sizeof(guacload_session*),
+            total_sessions);
+
+    /* Allocate all sessions before starting any, such that all sessions
+     * start as close to simultaneously as possible */
+    int count = 0;
+    for (i = optind; i < argc; i++) {
+        for (int j = 0; j < sessions_per_file; j++) {
+
+            guacload_session* session = guacload_session_alloc(argv[i], speed);
+            if (session == NULL) {
+                guacload_log(GUAC_LOG_ERROR, "%s: Unable to allocate "
+                        "session.", argv[i]);
+                continue;
+            }
+
+            sessions[count++] = session;
+
+        }
+    }
+
+    guac_timestamp started = guac_timestamp_current();
+
+    /* Start all sessions */
+    for (i = 0; i < count; i++) {
+        if (guacload_session_start(sessions[i]))
+            sessions[i]->stats.failed = 1;
+    }
+
+    /* Wait for all sessions to finish */
+    for (i = 0; i < count; i++)
+        guacload_session_join(sessions[i]);
+
+    guac_timestamp duration = guac_timestamp_current() - started;
+
+    guacload_report(stdout, sessions, count, duration);
+
+    /* Sessions which could not be allocated count as failures */
+    int failures = total_sessions - count;
+    for (i = 0; i < count; i++) {
+        if (sessions[i]->stats.failed)
+            failures++;
+        guacload_session_free(sessions[i]);
+    }
+
+    guac_mem_free(sessions);
+
+    /* Warn if at least one session failed */
+    if (failures != 0)
+        guacload_log(GUAC_LOG_WARNING, "Replay failed for %i of %i "
+                "session(s).", failures, total_sessions);
+
+    /* Notify of success */
+    else
+        guacload_log(GUAC_LOG_INFO, "All sessions replayed successfully.");
+
+    /* Replay complete */
+    return 0;
+
+    /* Display usage and exit with error if options are invalid */
+invalid_options:
+
+    fprintf(stderr, "USAGE: %s"
+            " [-n SESSIONS]"
+            " [-s SPEED]"
+            " [-t THREADS]"
+            " [-S]"
+            " [FILE]...\n", argv[0]);
+
+    return 1;
+
+}
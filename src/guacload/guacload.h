@@ -0,0 +1,47 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_H
+#define GUACLOAD_H
+
+#include "config.h"
+
+/**
+ * The default log level below which no messages should be logged.
+ */
+#define GUACLOAD_DEFAULT_LOG_LEVEL GUAC_LOG_INFO
+
+/**
+ * The default number of concurrent sessions replaying each recording.
+ */
+#define GUACLOAD_DEFAULT_SESSIONS 1
+
+/**
+ * The maximum number of concurrent sessions that may replay each recording.
+ */
+#define GUACLOAD_MAX_SESSIONS 1024
+
+/**
+ * The default rate at which recordings are replayed relative to the timing of
+ * the original sessions.
+ */
+#define GUACLOAD_DEFAULT_SPEED 1.0
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "log.h"
+#include "session.h"
+
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/protocol.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+int guacload_handle_blob(guacload_session* session, int argc, char** argv) {
+
+    /* Verify argument count */
+    if (argc < 2) {
+        guacload_log(GUAC_LOG_WARNING, "\"blob\" instruction incomplete");
+        return 1;
+    }
+
+    /* Parse arguments */
+    int index = atoi(argv[0]);
+    char* data = argv[1];
+    int length = guac_protocol_decode_base64(data);
+
+    /* Ignore blobs of streams which are not image streams */
+    guacload_image_stream* stream = guacload_session_get_stream(session, index);
+    if (stream == NULL)
+        return 0;
+
+    /* Grow buffer as necessary to contain the received data */
+    size_t required = stream->length + length;
+    if (required > stream->max_length) {
+
+        size_t new_max_length = stream->max_length * 2;
+        if (new_max_length < required)
+            new_max_length = required;
+
+        stream->buffer = guac_mem_realloc(stream->buffer, new_max_length);
+        stream->max_length = new_max_length;
+
+    }
+
+    memcpy(stream->buffer + stream->length, data, length);
+    stream->length += length;
+
+    return 0;
+
+}
@@ -0,0 +1,59 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "draw.h"
+#include "log.h"
+#include "session.h"
+
+#include <guacamole/client.h>
+#include <guacamole/rect.h>
+
+#include <stdlib.h>
+
+int guacload_handle_copy(guacload_session* session, int argc, char** argv) {
+
+    /* Verify argument count */
+    if (argc < 9) {
+        guacload_log(GUAC_LOG_WARNING, "\"copy\" instruction incomplete");
+        return 1;
+    }
+
+    /* Parse arguments */
+    int sindex = atoi(argv[0]);
+    int sx = atoi(argv[1]);
+    int sy = atoi(argv[2]);
+    int width = atoi(argv[3]);
+    int height = atoi(argv[4]);
+    int mask = atoi(argv[5]);
+    int dindex = atoi(argv[6]);
+    int dx = atoi(argv[7]);
+    int dy = atoi(argv[8]);
+
+    guac_rect src;
+    guac_rect_init(&src, sx, sy, width, height);
+
+    if (guacload_draw_copy(session, sindex, &src, mask, dindex, dx, dy))
+        return 1;
+
+    guacload_session_modified(session);
+    return 0;
+
+}
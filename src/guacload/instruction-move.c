@@ -0,0 +1,61 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "log.h"
+#include "session.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+
+#include <stdlib.h>
+
+int guacload_handle_move(guacload_session* session, int argc, char** argv) {
+
+    /* Verify argument count */
+    if (argc < 5) {
+        guacload_log(GUAC_LOG_WARNING, "\"move\" instruction incomplete");
+        return 1;
+    }
+
+    /* Parse arguments */
+    int layer_index = atoi(argv[0]);
+    int parent_index = atoi(argv[1]);
+    int x = atoi(argv[2]);
+    int y = atoi(argv[3]);
+    int z = atoi(argv[4]);
+
+    /* Only visible layers other than the default layer may be moved */
+    if (layer_index <= 0 || parent_index < 0)
+        return 1;
+
+    guacload_layer* layer = guacload_session_get_layer(session, layer_index);
+    guacload_layer* parent = guacload_session_get_layer(session, parent_index);
+    if (layer == NULL || parent == NULL)
+        return 1;
+
+    guac_display_layer_set_parent(layer->layer, parent->layer);
+    guac_display_layer_move(layer->layer, x, y);
+    guac_display_layer_stack(layer->layer, z);
+
+    guacload_session_modified(session);
+    return 0;
+
+}
@@ -0,0 +1,45 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "log.h"
+#include "parse.h"
+#include "session.h"
+
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+
+int guacload_handle_sync(guacload_session* session, int argc, char** argv) {
+
+    /* Verify argument count */
+    if (argc < 1) {
+        guacload_log(GUAC_LOG_WARNING, "\"sync\" instruction incomplete");
+        return 1;
+    }
+
+    /* Parse arguments */
+    guac_timestamp timestamp = guacload_parse_timestamp(argv[0]);
+
+    guacload_session_end_frame(session, timestamp);
+    return 0;
+
+}
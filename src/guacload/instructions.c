@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "instructions.h"
+#include "log.h"
+#include "session.h"
+
+#include <guacamole/client.h>
+#include <guacamole/opcode.h>
+
+#include <pthread.h>
+
+guacload_instruction_handler_mapping guacload_instruction_handler_map[] = {
+    {"blob",     guacload_handle_blob},
+    {"img",      guacload_handle_img},
+    {"end",      guacload_handle_end},
+    {"sync",     guacload_handle_sync},
+    {"copy",     guacload_handle_copy},
+    {"size",     guacload_handle_size},
+    {"rect",     guacload_handle_rect},
+    {"cfill",    guacload_handle_cfill},
+    {"move",     guacload_handle_move},
+    {"shade",    guacload_handle_shade},
+    {"dispose",  guacload_handle_dispose},
+    {NULL,       NULL}
+};
+
+/**
+ * Index of guacload_instruction_handler_map.
+ */
+static guac_opcode_index guacload_instruction_handler_index;
+
+/**
+ * Guard ensuring that guacload_instruction_handler_index is built only once.
+ */
+static pthread_once_t guacload_instruction_handler_index_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds guacload_instruction_handler_index. This function is invoked through
+ * pthread_once().
+ */
+static void guacload_instruction_handler_index_init(void) {
+    guac_opcode_index_init(&guacload_instruction_handler_index,
+            guacload_instruction_handler_map,
+            sizeof(guacload_instruction_handler_mapping));
+}
+
+int guacload_handle_instruction(guacload_session* session, const char* opcode,
+        int argc, char** argv) {
+
+    pthread_once(&guacload_instruction_handler_index_once,
+            guacload_instruction_handler_index_init);
+
+    /* Locate instruction handler having given opcode */
+    int position = guac_opcode_index_lookup(&guacload_instruction_handler_index,
+            opcode);
+
+    if (position >= 0) {
+
+        /* Invoke defined handler */
+        guacload_instruction_handler* handler =
+            guacload_instruction_handler_map[position].handler;
+
+        if (handler != NULL)
+            return handler(session, argc, argv);
+
+        /* Log defined but unimplemented instructions */
+        guacload_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
+        return 0;
+
+    }
+
+    /* Ignore any unknown instructions */
+    return 0;
+
+}
@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_INSTRUCTIONS_H
+#define GUACLOAD_INSTRUCTIONS_H
+
+#include "config.h"
+#include "session.h"
+
+/**
+ * A callback function which, when invoked, handles a particular Guacamole
+ * instruction. The opcode of the instruction is implied (as it is expected
+ * that there will be a 1:1 mapping of opcode to callback function), while the
+ * arguments for that instruction are included in the parameters given to the
+ * callback.
+ *
+ * @param session
+ *     The session replaying the recording containing the instruction.
+ *
+ * @param argc
+ *     The number of arguments (excluding opcode) passed to the instruction
+ *     being handled by the callback.
+ *
+ * @param argv
+ *     All arguments (excluding opcode) associated with the instruction being
+ *     handled by the callback.
+ *
+ * @return
+ *     Zero if the instruction was handled successfully, non-zero if an error
+ *     occurs.
+ */
+typedef int guacload_instruction_handler(guacload_session* session,
+        int argc, char** argv);
+
+/**
+ * Mapping of instruction opcode to corresponding handler function.
+ */
+typedef struct guacload_instruction_handler_mapping {
+
+    /**
+     * The opcode of the instruction that the associated handler function
+     * should be invoked for.
+     */
+    const char* opcode;
+
+    /**
+     * The handler function to invoke whenever an instruction having the
+     * associated opcode is parsed.
+     */
+    guacload_instruction_handler* handler;
+
+} guacload_instruction_handler_mapping;
+
+/**
+ * Array of all opcode/handler mappings for all supported opcodes, terminated
+ * by an entry with a NULL opcode. All opcodes not listed here can be safely
+ * ignored.
+ */
+extern guacload_instruction_handler_mapping guacload_instruction_handler_map[];
+
+/**
+ * Handles the instruction having the given opcode and arguments, replaying
+ * its effect on the guac_display of the given session.
+ *
+ * @param session
+ *     The session replaying the recording containing the instruction.
+ *
+ * @param opcode
+ *     The opcode of the instruction being handled.
+ *
+ * @param argc
+ *     The number of arguments (excluding opcode) passed to the instruction
+ *     being handled by the callback.
+ *
+ * @param argv
+ *     All arguments (excluding opcode) associated with the instruction being
+ *     handled by the callback.
+ *
+ * @return
+ *     Zero if the instruction was handled successfully, non-zero if an error
+ *     occurs.
+ */
+int guacload_handle_instruction(guacload_session* session,
+        const char* opcode, int argc, char** argv);
+
+/**
+ * Handler for the Guacamole "blob" instruction.
+ */
+guacload_instruction_handler guacload_handle_blob;
+
+/**
+ * Handler for the Guacamole "img" instruction.
+ */
+guacload_instruction_handler guacload_handle_img;
+
+/**
+ * Handler for the Guacamole "end" instruction.
+ */
+guacload_instruction_handler guacload_handle_end;
+
+/**
+ * Handler for the Guacamole "sync" instruction.
+ */
+guacload_instruction_handler guacload_handle_sync;
+
+/**
+ * Handler for the Guacamole "copy" instruction.
+ */
+guacload_instruction_handler guacload_handle_copy;
+
+/**
+ * Handler for the Guacamole "size" instruction.
+ */
+guacload_instruction_handler guacload_handle_size;
+
+/**
+ * Handler for the Guacamole "rect" instruction.
+ */
+guacload_instruction_handler guacload_handle_rect;
+
+/**
+ * Handler for the Guacamole "cfill" instruction.
+ */
+guacload_instruction_handler guacload_handle_cfill;
+
+/**
+ * Handler for the Guacamole "move" instruction.
+ */
+guacload_instruction_handler guacload_handle_move;
+
+/**
+ * Handler for the Guacamole "shade" instruction.
+ */
+guacload_instruction_handler guacload_handle_shade;
+
+/**
+ * Handler for the Guacamole "dispose" instruction.
+ */
+guacload_instruction_handler guacload_handle_dispose;
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_PARSE_H
+#define GUACLOAD_PARSE_H
+
+#include "config.h"
+
+#include <guacamole/timestamp.h>
+
+/**
+ * Parses a string into a single integer. Only positive integers are accepted.
+ * A value will be stored in the provided int pointer only if valid.
+ *
+ * @param arg
+ *     The string to parse.
+ *
+ * @param i
+ *     A pointer to the integer in which the parsed value of the given string
+ *     should be stored.
+ *
+ * @return
+ *     Zero if parsing was successful, non-zero if the provided string was
+ *     invalid.
+ */
+int guacload_parse_int(const char* arg, int* i);
+
+/**
+ * Parses a string into a single floating-point value. Only non-negative
+ * values are accepted. A value will be stored in the provided double pointer
+ * only if valid.
+ *
+ * @param arg
+ *     The string to parse.
+ *
+ * @param d
+ *     A pointer to the double in which the parsed value of the given string
+ *     should be stored.
+ *
+ * @return
+ *     Zero if parsing was successful, non-zero if the provided string was
+ *     invalid.
+ */
+int guacload_parse_double(const char* arg, double* d);
+
+/**
+ * Parses a guac_timestamp from the given string. The string is assumed to
+ * consist solely of decimal digits with an optional leading minus sign. If the
+ * given string contains other characters, the behavior of this function is
+ * undefined.
+ *
+ * @param str
+ *     The string to parse, which must contain only decimal digits and an
+ *     optional leading minus sign.
+ *
+ * @return
+ *     A guac_timestamp having the same value as the provided string.
+ */
+guac_timestamp guacload_parse_timestamp(const char* str);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "report.h"
+#include "session.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/timestamp.h>
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+/**
+ * Summary of a set of frame latencies.
+ */
+typedef struct guacload_latency_summary {
+
+    /**
+     * The average latency, in milliseconds.
+     */
+    double average;
+
+    /**
+     * The 95th percentile latency, in milliseconds.
+     */
+    int p95;
+
+    /**
+     * The largest latency, in milliseconds.
+     */
+    int max;
+
+} guacload_latency_summary;
+
+/**
+ * Comparator for qsort() which orders integers in ascending order.
+ */
+static int guacload_report_compare_int(const void* a, const void* b) {
+    return *((const int*) a) - *((const int*) b);
+}
+
+/**
+ * Summarizes the given latencies, which are sorted in place.
+ *
+ * @param latencies
+ *     The latencies to summarize, in milliseconds.
+ *
+ * @param count
+ *     The number of latencies.
+ *
+ * @param summary
+ *     The summary to populate. If there are no latencies, all values of the
+ *     summary are zero.
+ */
+static void guacload_report_summarize(int* latencies, int count,
+        guacload_latency_summary* summary) {
+
+    *summary = (guacload_latency_summary) { 0 };
+    if (count == 0)
+        return;
+
+    qsort(latencies, count, sizeof(int), guacload_report_compare_int);
+
+    int64_t total = 0;
+    for (int i = 0; i < count; i++)
+        total += latencies[i];
+
+    summary->average = (double) total / count;
+    summary->p95 = latencies[(count - 1) * 95 / 100];
+    summary->max = latencies[count - 1];
+
+}
+
+/**
+ * Returns the total CPU time (user and system) consumed by the current
+ * process thus far, in milliseconds.
+ *
+ * @return
+ *     The total CPU time consumed by the current process, in milliseconds.
+ */
+static guac_timestamp guacload_report_process_cpu() {
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+
+    return (guac_timestamp) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+
+}
+
+/**
+ * Returns the given number of bytes transferred over the given duration as
+ * a rate in kilobytes per second.
+ *
+ * @param bytes
+ *     The number of bytes transferred.
+ *
+ * @param duration
+ *     The duration of the transfer, in milliseconds.
+ *
+ * @return
+ *     The rate of the transfer, in kilobytes per second.
+ */
+static double guacload_report_rate(uint64_t bytes, guac_timestamp duration) {
+
+    if (duration <= 0)
+        return 0;
+
+    return bytes / 1024.0 * 1000.0 / duration;
+
+}
+
+void guacload_report(FILE* output, guacload_session** sessions, int count,
+        guac_timestamp duration) {
+
+    int total_latencies = 0;
+    int total_replayed = 0;
+    int total_sent = 0;
+    int failures = 0;
+    uint64_t total_bytes = 0;
+    guac_timestamp total_replay_cpu = 0;
+
+    fprintf(output, "%7s %8s %8s %9s %9s %9s %10s %10s  %s\n",
+            "SESSION", "FRAMES", "SENT", "AVG (ms)", "P95 (ms)", "MAX (ms)",
+            "CPU (ms)", "KB/s", "RECORDING");
+
+    for (int i = 0; i < count; i++) {
+
+        guacload_session* session = sessions[i];
+        guacload_stats* stats = &session->stats;
+
+        guacload_latency_summary summary;
+        guacload_report_summarize(stats->latencies, stats->latency_count,
+                &summary);
+
+        fprintf(output, "%7i %8i %8i %9.1f %9i %9i %10" PRId64 " %10.1f  %s%s\n",
+                i + 1, stats->frames_replayed, stats->frames_sent,
+                summary.average, summary.p95, summary.max,
+                (int64_t) stats->replay_cpu,
+                guacload_report_rate(stats->bytes_sent, stats->duration),
+                session->path, stats->failed ? " (FAILED)" : "");
+
+        total_latencies += stats->latency_count;
+        total_replayed += stats->frames_replayed;
+        total_sent += stats->frames_sent;
+        total_bytes += stats->bytes_sent;
+        total_replay_cpu += stats->replay_cpu;
+
+        if (stats->failed)
+            failures++;
+
+    }
+
+    /* Summarize latencies across all sessions */
+    int* latencies = guac_mem_alloc(sizeof(int), total_latencies ? total_latencies : 1);
+    int offset = 0;
+    for (int i = 0; i < count; i++) {
+        guacload_stats* stats = &sessions[i]->stats;
+        memcpy(latencies + offset, stats->latencies,
+                sizeof(int) * stats->latency_count);
+        offset += stats->latency_count;
+    }
+
+    guacload_latency_summary summary;
+    guacload_report_summarize(latencies, total_latencies, &summary);
+    guac_mem_free(latencies);
+
+    /* Encoding occurs within display worker threads which may be shared by
+     * all sessions, thus CPU time that includes encoding can only be
+     * attributed to sessions as an average */
+    guac_timestamp process_cpu = guacload_report_process_cpu();
+
+    fprintf(output, "%7s %8i %8i %9.1f %9i %9i %10" PRId64 " %10.1f  %s\n",
+            "TOTAL", total_replayed, total_sent,
+            summary.average, summary.p95, summary.max,
+            (int64_t) total_replay_cpu,
+            guacload_report_rate(total_bytes, duration),
+            "(all sessions)");
+
+    fprintf(output, "\n%i session(s) in %.1f seconds (%i failed).\n", count,
+            duration / 1000.0, failures);
+
+    if (count > 0)
+        fprintf(output, "Process CPU time: %" PRId64 " ms total, %" PRId64
+                " ms per session (including encoding).\n",
+                (int64_t) process_cpu, (int64_t) (process_cpu / count));
+
+}
@@ -0,0 +1,54 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_REPORT_H
+#define GUACLOAD_REPORT_H
+
+#include "config.h"
+#include "session.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stdio.h>
+
+/**
+ * Writes a human-readable report of the measurements taken by the given
+ * sessions to the given file, including the frame latency, CPU time, and
+ * bandwidth of each session, followed by the same measurements aggregated
+ * across all sessions.
+ *
+ * @param output
+ *     The file to write the report to.
+ *
+ * @param sessions
+ *     The sessions whose measurements should be reported. Each session must
+ *     have finished replaying its recording.
+ *
+ * @param count
+ *     The number of sessions.
+ *
+ * @param duration
+ *     The amount of real time taken for all sessions to finish, in
+ *     milliseconds.
+ */
+void guacload_report(FILE* output, guacload_session** sessions, int count,
+        guac_timestamp duration);
+
+#endif
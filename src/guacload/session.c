@@ -0,0 +1,622 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "decode.h"
+#include "draw.h"
+#include "instructions.h"
+#include "log.h"
+#include "session.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/error.h>
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The image mimetypes declared as supported by the synthetic user of each
+ * session, matching those supported by the web application.
+ */
+static const char* guacload_session_image_mimetypes[] = {
+    "image/png",
+    "image/jpeg",
+    "image/webp",
+    NULL
+};
+
+/**
+ * The prefix of every "sync" instruction, which guac_protocol_send_sync()
+ * always writes with a single call to guac_socket_write().
+ */
+#define GUACLOAD_SESSION_SYNC_PREFIX "4.sync,"
+
+/**
+ * Parses the timestamp of the "sync" instruction at the beginning of the
+ * given data, which must begin with GUACLOAD_SESSION_SYNC_PREFIX.
+ *
+ * @param data
+ *     The data written to the socket of the synthetic user.
+ *
+ * @param length
+ *     The number of bytes of data.
+ *
+ * @return
+ *     The timestamp of the "sync" instruction, or -1 if the timestamp cannot
+ *     be parsed.
+ */
+static guac_timestamp guacload_session_parse_sync(const char* data,
+        size_t length) {
+
+    const char* current = data + strlen(GUACLOAD_SESSION_SYNC_PREFIX);
+    const char* end = data + length;
+
+    /* Skip the length prefix of the timestamp element */
+    while (current < end && *current != '.')
+        current++;
+
+    if (++current >= end)
+        return -1;
+
+    guac_timestamp timestamp = 0;
+    while (current < end && *current >= '0' && *current <= '9')
+        timestamp = timestamp * 10 + (*(current++) - '0');
+
+    if (current >= end)
+        return -1;
+
+    return timestamp;
+
+}
+
+/**
+ * Records that a frame has been sent by the guac_display of the given
+ * session, sampling the latency of that frame. The session lock must be held
+ * by the current thread.
+ *
+ * @param session
+ *     The session whose guac_display sent a frame.
+ */
+static void guacload_session_frame_sent(guacload_session* session) {
+
+    guacload_stats* stats = &session->stats;
+    stats->frames_sent++;
+
+    /* Frames that do not include any replayed frame are not sampled (such as
+     * frames sent when the display is first duplicated) */
+    if (!session->pending_frame)
+        return;
+
+    if (stats->latency_count == stats->latency_size) {
+        stats->latency_size = stats->latency_size ? stats->latency_size * 2 : 256;
+        stats->latencies = guac_mem_realloc(stats->latencies,
+                sizeof(int), stats->latency_size);
+    }
+
+    stats->latencies[stats->latency_count++] =
+        guac_timestamp_current() - session->pending_frame;
+
+    session->pending_frame = 0;
+    pthread_cond_broadcast(&session->changed);
+
+}
+
+/**
+ * Handler which is invoked for all data written to the socket of the
+ * synthetic user of a session, counting that data and acknowledging each
+ * frame immediately, as would a client with unlimited bandwidth and no
+ * network latency.
+ */
+static ssize_t guacload_session_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guacload_session* session = (guacload_session*) socket->data;
+    const size_t prefix_length = strlen(GUACLOAD_SESSION_SYNC_PREFIX);
+
+    pthread_mutex_lock(&session->lock);
+
+    session->stats.bytes_sent += count;
+
+    if (count > prefix_length
+            && memcmp(buf, GUACLOAD_SESSION_SYNC_PREFIX, prefix_length) == 0) {
+
+        guacload_session_frame_sent(session);
+
+        guac_timestamp timestamp = guacload_session_parse_sync(buf, count);
+        if (timestamp >= session->user->last_received_timestamp) {
+            session->user->last_received_timestamp = timestamp;
+            session->user->last_frame_duration =
+                guac_timestamp_current() - timestamp;
+        }
+
+    }
+
+    pthread_mutex_unlock(&session->lock);
+    return count;
+
+}
+
+/**
+ * Handler which is invoked when the synthetic user of a session is promoted
+ * from a pending user, synchronizing that user with the current state of the
+ * display.
+ */
+static int guacload_session_join_pending_handler(guac_client* client) {
+
+    guacload_session* session = (guacload_session*) client->data;
+
+    guac_display_dup(session->display, client->pending_socket);
+    guac_socket_flush(client->pending_socket);
+
+    pthread_mutex_lock(&session->lock);
+    session->joined = 1;
+    pthread_cond_broadcast(&session->changed);
+    pthread_mutex_unlock(&session->lock);
+
+    return 0;
+
+}
+
+/**
+ * Handler which is invoked for all messages logged by the guac_client of a
+ * session, forwarding those messages to the log of guacload.
+ */
+static void guacload_session_log_handler(guac_client* client,
+        guac_client_log_level level, const char* format, va_list args) {
+    vguacload_log(level, format, args);
+}
+
+/**
+ * Returns the CPU time consumed by the current thread, in milliseconds.
+ *
+ * @return
+ *     The CPU time consumed by the current thread, in milliseconds.
+ */
+static guac_timestamp guacload_session_thread_cpu() {
+
+    struct timespec current;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &current))
+        return 0;
+
+    return (guac_timestamp) current.tv_sec * 1000
+        + current.tv_nsec / 1000000;
+
+}
+
+/**
+ * Waits for the condition of the given session to be signalled, up to the
+ * given absolute time. The session lock must be held by the current thread.
+ *
+ * @param session
+ *     The session to wait for.
+ *
+ * @param deadline
+ *     The time at which waiting should stop, as returned by
+ *     guac_timestamp_current().
+ *
+ * @return
+ *     Zero if the condition was signalled, non-zero if the deadline has
+ *     passed.
+ */
+static int guacload_session_wait(guacload_session* session,
+        guac_timestamp deadline) {
+
+    guac_timestamp now = guac_timestamp_current();
+    if (now >= deadline)
+        return 1;
+
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+
+    uint64_t nsec = until.tv_nsec + (deadline - now) * 1000000;
+    until.tv_sec += nsec / 1000000000;
+    until.tv_nsec = nsec % 1000000000;
+
+    return pthread_cond_timedwait(&session->changed, &session->lock,
+            &until) == ETIMEDOUT;
+
+}
+
+/**
+ * Reads and handles all instructions within the recording of the given
+ * session.
+ *
+ * @param session
+ *     The session whose recording should be replayed.
+ *
+ * @return
+ *     Zero if the recording was replayed in its entirety, non-zero
+ *     otherwise.
+ */
+static int guacload_session_read_instructions(guacload_session* session) {
+
+    int fd = open(session->path, O_RDONLY);
+    if (fd < 0) {
+        guacload_log(GUAC_LOG_ERROR, "%s: %s", session->path, strerror(errno));
+        return 1;
+    }
+
+    guac_socket* socket = guac_socket_open(fd);
+    if (socket == NULL) {
+        guacload_log(GUAC_LOG_ERROR, "%s: %s", session->path,
+                guac_status_string(guac_error));
+        close(fd);
+        return 1;
+    }
+
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guac_socket_free(socket);
+        return 1;
+    }
+
+    /* Continuously read and handle all instructions */
+    while (!guac_parser_read(parser, socket, -1)) {
+        if (guacload_handle_instruction(session, parser->opcode,
+                parser->argc, parser->argv)) {
+            guacload_log(GUAC_LOG_DEBUG, "Handling of \"%s\" instruction "
+                    "failed.", parser->opcode);
+        }
+    }
+
+    int result = 0;
+
+    /* Fail on read/parse error */
+    if (guac_error != GUAC_STATUS_CLOSED) {
+        guacload_log(GUAC_LOG_ERROR, "%s: %s", session->path,
+                guac_status_string(guac_error));
+        result = 1;
+    }
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    return result;
+
+}
+
+/**
+ * Replays the recording of the given session in its entirety, waiting for
+ * the final frame to be sent. This function is the entry point of the thread
+ * of each session.
+ *
+ * @param data
+ *     The guacload_session whose recording should be replayed.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacload_session_replay(void* data) {
+
+    guacload_session* session = (guacload_session*) data;
+    guac_timestamp deadline;
+
+    /* Frames are not received until the synthetic user has been promoted
+     * from a pending user */
+    deadline = guac_timestamp_current() + GUACLOAD_SESSION_DRAIN_TIMEOUT;
+    pthread_mutex_lock(&session->lock);
+    while (!session->joined && !guacload_session_wait(session, deadline));
+    pthread_mutex_unlock(&session->lock);
+
+    guac_timestamp started = guac_timestamp_current();
+    guac_timestamp started_cpu = guacload_session_thread_cpu();
+
+    int failed = guacload_session_read_instructions(session);
+
+    /* Flush any trailing changes not followed by a "sync" */
+    guac_display_render_thread_notify_frame(session->render_thread);
+
+    guac_timestamp replay_cpu = guacload_session_thread_cpu() - started_cpu;
+
+    /* Wait for all replayed frames to be sent */
+    deadline = guac_timestamp_current() + GUACLOAD_SESSION_DRAIN_TIMEOUT;
+    pthread_mutex_lock(&session->lock);
+
+    while (session->pending_frame && !guacload_session_wait(session, deadline));
+
+    if (session->pending_frame) {
+        guacload_log(GUAC_LOG_WARNING, "%s: Timed out waiting for the final "
+                "frame to be sent.", session->path);
+        failed = 1;
+    }
+
+    session->stats.duration = guac_timestamp_current() - started;
+    session->stats.replay_cpu = replay_cpu;
+    session->stats.failed = failed;
+
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+
+}
+
+guacload_session* guacload_session_alloc(const char* path, double speed) {
+
+    guac_client* client = guac_client_alloc();
+    if (client == NULL)
+        return NULL;
+
+    guacload_session* session = guac_mem_zalloc(sizeof(guacload_session));
+    session->path = path;
+    session->speed = speed;
+    session->client = client;
+
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->changed, NULL);
+
+    client->data = session;
+    client->log_handler = guacload_session_log_handler;
+    client->join_pending_handler = guacload_session_join_pending_handler;
+
+    session->display = guac_display_alloc(client);
+    session->layers[0].layer = guac_display_default_layer(session->display);
+
+    /* All data sent to the synthetic user is counted and discarded */
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = session;
+    socket->write_handler = guacload_session_write_handler;
+    session->socket = socket;
+
+    /* The synthetic user is the owner of the connection, supporting all image
+     * formats supported by the web application */
+    guac_user* user = guac_user_alloc();
+    user->client = client;
+    user->socket = socket;
+    user->owner = 1;
+    user->info.image_mimetypes = guacload_session_image_mimetypes;
+    session->user = user;
+
+    return session;
+
+}
+
+int guacload_session_start(guacload_session* session) {
+
+    session->render_thread = guac_display_render_thread_create(session->display);
+
+    if (guac_client_add_user(session->client, session->user, 0, NULL)) {
+        guacload_log(GUAC_LOG_ERROR, "%s: Unable to add synthetic user.",
+                session->path);
+        return 1;
+    }
+
+    if (pthread_create(&session->thread, NULL, guacload_session_replay, session)) {
+        guacload_log(GUAC_LOG_ERROR, "%s: Unable to start replay thread.",
+                session->path);
+        return 1;
+    }
+
+    session->started = 1;
+    return 0;
+
+}
+
+void guacload_session_join(guacload_session* session) {
+    if (session->started)
+        pthread_join(session->thread, NULL);
+}
+
+void guacload_session_free(guacload_session* session) {
+
+    if (session->render_thread != NULL)
+        guac_display_render_thread_destroy(session->render_thread);
+
+    /* Free any streams left open by the recording */
+    for (int i = 0; i < GUACLOAD_SESSION_MAX_STREAMS; i++) {
+        guacload_image_stream* stream = session->streams[i];
+        if (stream != NULL) {
+            guac_mem_free(stream->buffer);
+            guac_mem_free(stream);
+        }
+    }
+
+    guac_client_remove_user(session->client, session->user);
+    guac_display_free(session->display);
+
+    guac_user_free(session->user);
+    guac_socket_free(session->socket);
+    guac_client_free(session->client);
+
+    pthread_cond_destroy(&session->changed);
+    pthread_mutex_destroy(&session->lock);
+
+    guac_mem_free(session->stats.latencies);
+    guac_mem_free(session);
+
+}
+
+guacload_layer* guacload_session_get_layer(guacload_session* session,
+        int index) {
+
+    guacload_layer* layer;
+
+    /* Non-negative indices refer to visible layers */
+    if (index >= 0) {
+
+        if (index >= GUACLOAD_SESSION_MAX_LAYERS) {
+            guacload_log(GUAC_LOG_DEBUG, "Layer index out of bounds: %i",
+                    index);
+            return NULL;
+        }
+
+        layer = &session->layers[index];
+        if (layer->layer == NULL)
+            layer->layer = guac_display_alloc_layer(session->display, 0);
+
+    }
+
+    /* Negative indices refer to off-screen buffers */
+    else {
+
+        int buffer_index = -1 - index;
+        if (buffer_index >= GUACLOAD_SESSION_MAX_BUFFERS) {
+            guacload_log(GUAC_LOG_DEBUG, "Buffer index out of bounds: %i",
+                    index);
+            return NULL;
+        }
+
+        layer = &session->buffers[buffer_index];
+        if (layer->layer == NULL)
+            layer->layer = guac_display_alloc_buffer(session->display, 0);
+
+    }
+
+    return layer;
+
+}
+
+void guacload_session_free_layer(guacload_session* session, int index) {
+
+    guacload_layer* layer;
+
+    /* The default layer cannot be freed */
+    if (index > 0 && index < GUACLOAD_SESSION_MAX_LAYERS)
+        layer = &session->layers[index];
+    else if (index < 0 && -1 - index < GUACLOAD_SESSION_MAX_BUFFERS)
+        layer = &session->buffers[-1 - index];
+    else
+        return;
+
+    if (layer->layer != NULL) {
+        guac_display_free_layer(layer->layer);
+        layer->layer = NULL;
+        layer->path = (guac_rect) { 0 };
+    }
+
+}
+
+int guacload_session_open_stream(guacload_session* session, int index,
+        int mask, int layer_index, const char* mimetype, int x, int y) {
+
+    if (index < 0 || index >= GUACLOAD_SESSION_MAX_STREAMS) {
+        guacload_log(GUAC_LOG_DEBUG, "Stream index out of bounds: %i", index);
+        return 1;
+    }
+
+    /* Replace any existing stream */
+    guacload_image_stream* stream = session->streams[index];
+    if (stream != NULL) {
+        guac_mem_free(stream->buffer);
+        guac_mem_free(stream);
+    }
+
+    stream = guac_mem_zalloc(sizeof(guacload_image_stream));
+    stream->index = layer_index;
+    stream->mask = mask;
+    stream->x = x;
+    stream->y = y;
+    stream->decoder = guacload_get_decoder(mimetype);
+    stream->max_length = GUACLOAD_SESSION_STREAM_INITIAL_LENGTH;
+    stream->buffer = guac_mem_alloc(stream->max_length);
+
+    session->streams[index] = stream;
+    return 0;
+
+}
+
+guacload_image_stream* guacload_session_get_stream(guacload_session* session,
+        int index) {
+
+    if (index < 0 || index >= GUACLOAD_SESSION_MAX_STREAMS)
+        return NULL;
+
+    return session->streams[index];
+
+}
+
+void guacload_session_close_stream(guacload_session* session, int index) {
+
+    guacload_image_stream* stream = guacload_session_get_stream(session, index);
+    if (stream == NULL)
+        return;
+
+    session->streams[index] = NULL;
+
+    /* Images of unsupported formats are simply ignored */
+    if (stream->decoder != NULL) {
+
+        cairo_surface_t* image = stream->decoder(stream->buffer,
+                stream->length);
+
+        if (image != NULL) {
+            guacload_draw_image(session, stream->index, stream->mask,
+                    stream->x, stream->y, image);
+            cairo_surface_destroy(image);
+            guacload_session_modified(session);
+        }
+
+    }
+
+    guac_mem_free(stream->buffer);
+    guac_mem_free(stream);
+
+}
+
+void guacload_session_modified(guacload_session* session) {
+    guac_display_render_thread_notify_modified(session->render_thread);
+}
+
+void guacload_session_end_frame(guacload_session* session,
+        guac_timestamp timestamp) {
+
+    guac_timestamp now = guac_timestamp_current();
+
+    /* Replay each frame at the same time relative to the first frame as in
+     * the original session, adjusted for the replay speed */
+    if (session->first_sync == 0) {
+        session->first_sync = timestamp;
+        session->start = now;
+    }
+
+    else if (session->speed > 0) {
+
+        guac_timestamp target = session->start
+            + (guac_timestamp) ((timestamp - session->first_sync) / session->speed);
+
+        if (target > now) {
+            guac_timestamp_msleep(target - now);
+            now = guac_timestamp_current();
+        }
+
+    }
+
+    pthread_mutex_lock(&session->lock);
+
+    session->stats.frames_replayed++;
+    if (!session->pending_frame)
+        session->pending_frame = now;
+
+    pthread_mutex_unlock(&session->lock);
+
+    guac_display_render_thread_notify_frame(session->render_thread);
+
+}
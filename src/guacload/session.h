@@ -0,0 +1,484 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACLOAD_SESSION_H
+#define GUACLOAD_SESSION_H
+
+#include "config.h"
+#include "decode.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of buffers that a recording may use.
+ */
+#define GUACLOAD_SESSION_MAX_BUFFERS 4096
+
+/**
+ * The maximum number of layers that a recording may use, including the
+ * default layer.
+ */
+#define GUACLOAD_SESSION_MAX_LAYERS 64
+
+/**
+ * The maximum number of image streams that may be open at any given time.
+ */
+#define GUACLOAD_SESSION_MAX_STREAMS 64
+
+/**
+ * The initial number of bytes to allocate for the data buffer of each image
+ * stream. If this buffer is not sufficiently large, it will be dynamically
+ * reallocated as it grows.
+ */
+#define GUACLOAD_SESSION_STREAM_INITIAL_LENGTH 4096
+
+/**
+ * The maximum amount of time to wait after the end of a recording for all
+ * frames to be sent, in milliseconds.
+ */
+#define GUACLOAD_SESSION_DRAIN_TIMEOUT 5000
+
+/**
+ * A layer or buffer of the recording being replayed, along with the
+ * corresponding layer or buffer of the guac_display driven by the replay.
+ */
+typedef struct guacload_layer {
+
+    /**
+     * The layer or buffer of the guac_display, or NULL if the recording has
+     * not yet used this layer or buffer (or has since disposed of it).
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The bounds of the path most recently established with "rect" and not
+     * yet filled, or an empty rectangle if there is no such path. Multiple
+     * rectangles within the same path are approximated by their bounds.
+     */
+    guac_rect path;
+
+} guacload_layer;
+
+/**
+ * An image stream opened by an "img" instruction of the recording being
+ * replayed, whose data is received through "blob" instructions.
+ */
+typedef struct guacload_image_stream {
+
+    /**
+     * The index of the destination layer or buffer.
+     */
+    int index;
+
+    /**
+     * The Guacamole protocol compositing operation (channel mask) to apply
+     * when drawing the image.
+     */
+    int mask;
+
+    /**
+     * The X coordinate of the upper-left corner of the rectangle within the
+     * destination layer or buffer that the decoded image should be drawn to.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the rectangle within the
+     * destination layer or buffer that the decoded image should be drawn to.
+     */
+    int y;
+
+    /**
+     * Buffer of image data which is built up over time as chunks are received
+     * via "blob" instructions.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The number of bytes currently stored in the buffer.
+     */
+    size_t length;
+
+    /**
+     * The maximum number of bytes that can be stored in the current buffer
+     * before it must be reallocated.
+     */
+    size_t max_length;
+
+    /**
+     * The decoder to use when decoding the data received along this stream,
+     * or NULL if no such decoder exists.
+     */
+    guacload_decoder* decoder;
+
+} guacload_image_stream;
+
+/**
+ * Measurements taken while replaying a recording within a single session.
+ */
+typedef struct guacload_stats {
+
+    /**
+     * The number of frames (as marked by "sync" instructions) within the
+     * recording that have been replayed.
+     */
+    int frames_replayed;
+
+    /**
+     * The number of frames sent by the guac_display. This may be fewer than
+     * the number of frames replayed if the guac_display combined frames that
+     * could not be sent quickly enough.
+     */
+    int frames_sent;
+
+    /**
+     * The total number of bytes sent by the guac_display.
+     */
+    uint64_t bytes_sent;
+
+    /**
+     * The latency of each frame sent, in milliseconds. The latency of a frame
+     * is the time between the end of the oldest replayed frame that it
+     * includes and the "sync" instruction that completes the sent frame.
+     */
+    int* latencies;
+
+    /**
+     * The number of latencies stored within the latencies array.
+     */
+    int latency_count;
+
+    /**
+     * The number of latencies that may be stored within the latencies array
+     * before it must be reallocated.
+     */
+    int latency_size;
+
+    /**
+     * The CPU time consumed by the thread reading, decoding, and drawing the
+     * recording, in milliseconds. This excludes the time spent by the worker
+     * threads of the guac_display encoding frames.
+     */
+    guac_timestamp replay_cpu;
+
+    /**
+     * The amount of real time taken to replay the recording, in milliseconds.
+     */
+    guac_timestamp duration;
+
+    /**
+     * Non-zero if the recording could not be replayed in its entirety, zero
+     * otherwise.
+     */
+    int failed;
+
+} guacload_stats;
+
+/**
+ * A single synthetic connection, replaying a recording through its own
+ * guac_display and counting everything sent by that display to a single
+ * synthetic user.
+ */
+typedef struct guacload_session {
+
+    /**
+     * The path of the recording being replayed.
+     */
+    const char* path;
+
+    /**
+     * The rate at which the recording is replayed relative to the timing of
+     * the original session (2.0 replays twice as fast), or zero if the
+     * recording should be replayed as quickly as possible.
+     */
+    double speed;
+
+    /**
+     * The thread replaying the recording.
+     */
+    pthread_t thread;
+
+    /**
+     * Non-zero if the thread replaying the recording has been started, zero
+     * otherwise.
+     */
+    int started;
+
+    /**
+     * The guac_client that owns the guac_display and synthetic user.
+     */
+    guac_client* client;
+
+    /**
+     * The synthetic user receiving everything sent by the guac_display.
+     */
+    guac_user* user;
+
+    /**
+     * The socket of the synthetic user, which discards all data written
+     * while recording statistics.
+     */
+    guac_socket* socket;
+
+    /**
+     * The guac_display driven by the replayed recording.
+     */
+    guac_display* display;
+
+    /**
+     * The render thread sending the frames of the guac_display, as would be
+     * used by a protocol plugin.
+     */
+    guac_display_render_thread* render_thread;
+
+    /**
+     * All layers of the recording, indexed by layer index.
+     */
+    guacload_layer layers[GUACLOAD_SESSION_MAX_LAYERS];
+
+    /**
+     * All buffers of the recording, indexed by the negated buffer index less
+     * one (buffer -1 is at index 0).
+     */
+    guacload_layer buffers[GUACLOAD_SESSION_MAX_BUFFERS];
+
+    /**
+     * All currently-open image streams, indexed by stream index.
+     */
+    guacload_image_stream* streams[GUACLOAD_SESSION_MAX_STREAMS];
+
+    /**
+     * The timestamp of the first "sync" instruction within the recording, or
+     * zero if no such instruction has yet been read.
+     */
+    guac_timestamp first_sync;
+
+    /**
+     * The time at which the first "sync" instruction of the recording was
+     * replayed.
+     */
+    guac_timestamp start;
+
+    /**
+     * Lock which guards joined, pending_frame, and stats, which are updated
+     * both by the replaying thread and by the threads sending frames.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever the synthetic user joins or all
+     * replayed frames have been sent.
+     */
+    pthread_cond_t changed;
+
+    /**
+     * Non-zero if the synthetic user has been promoted from a pending user
+     * and is now receiving frames, zero otherwise.
+     */
+    int joined;
+
+    /**
+     * The time at which the oldest replayed frame not yet sent by the
+     * guac_display was replayed, or zero if all replayed frames have been
+     * sent.
+     */
+    guac_timestamp pending_frame;
+
+    /**
+     * Measurements taken while replaying the recording.
+     */
+    guacload_stats stats;
+
+} guacload_session;
+
+/**
+ * Allocates a new session which will replay the given recording once
+ * started with guacload_session_start().
+ *
+ * @param path
+ *     The path of the recording to replay. This string must remain valid for
+ *     the lifetime of the session.
+ *
+ * @param speed
+ *     The rate at which the recording should be replayed relative to the
+ *     timing of the original session, or zero to replay the recording as
+ *     quickly as possible.
+ *
+ * @return
+ *     A newly-allocated session, which must eventually be freed with
+ *     guacload_session_free().
+ */
+guacload_session* guacload_session_alloc(const char* path, double speed);
+
+/**
+ * Starts replaying the recording of the given session within a new thread.
+ *
+ * @param session
+ *     The session to start.
+ *
+ * @return
+ *     Zero if the session was started successfully, non-zero otherwise.
+ */
+int guacload_session_start(guacload_session* session);
+
+/**
+ * Waits for the given session, which must have been started with
+ * guacload_session_start(), to finish replaying its recording.
+ *
+ * @param session
+ *     The session to wait for.
+ */
+void guacload_session_join(guacload_session* session);
+
+/**
+ * Frees the given session and all associated resources. If the session was
+ * started, it must first have been joined with guacload_session_join().
+ *
+ * @param session
+ *     The session to free.
+ */
+void guacload_session_free(guacload_session* session);
+
+/**
+ * Returns the layer or buffer having the given index, allocating the
+ * corresponding layer or buffer of the guac_display if it has not yet been
+ * used.
+ *
+ * @param session
+ *     The session of the recording using the layer or buffer.
+ *
+ * @param index
+ *     The index of the layer (non-negative) or buffer (negative).
+ *
+ * @return
+ *     The layer or buffer having the given index, or NULL if the index is
+ *     out of range.
+ */
+guacload_layer* guacload_session_get_layer(guacload_session* session,
+        int index);
+
+/**
+ * Frees the layer or buffer having the given index, if it has been
+ * allocated. The default layer cannot be freed.
+ *
+ * @param session
+ *     The session of the recording using the layer or buffer.
+ *
+ * @param index
+ *     The index of the layer (non-negative) or buffer (negative).
+ */
+void guacload_session_free_layer(guacload_session* session, int index);
+
+/**
+ * Allocates a new image stream having the given index, replacing (and
+ * freeing) any existing stream having the same index.
+ *
+ * @param session
+ *     The session of the recording opening the stream.
+ *
+ * @param index
+ *     The index of the stream.
+ *
+ * @param mask
+ *     The Guacamole protocol compositing operation (channel mask) to apply
+ *     when drawing the image.
+ *
+ * @param layer_index
+ *     The index of the layer or buffer that the image should be drawn to.
+ *
+ * @param mimetype
+ *     The mimetype of the image data that will be received along the stream.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the rectangle that the
+ *     image should be drawn to.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the rectangle that the
+ *     image should be drawn to.
+ *
+ * @return
+ *     Zero if the stream was allocated, non-zero if the stream index is out
+ *     of range.
+ */
+int guacload_session_open_stream(guacload_session* session, int index,
+        int mask, int layer_index, const char* mimetype, int x, int y);
+
+/**
+ * Returns the open image stream having the given index.
+ *
+ * @param session
+ *     The session of the recording using the stream.
+ *
+ * @param index
+ *     The index of the stream.
+ *
+ * @return
+ *     The open image stream having the given index, or NULL if there is no
+ *     such stream.
+ */
+guacload_image_stream* guacload_session_get_stream(guacload_session* session,
+        int index);
+
+/**
+ * Closes the image stream having the given index, if open, decoding all
+ * data received along that stream and drawing the resulting image.
+ *
+ * @param session
+ *     The session of the recording closing the stream.
+ *
+ * @param index
+ *     The index of the stream.
+ */
+void guacload_session_close_stream(guacload_session* session, int index);
+
+/**
+ * Notifies the render thread of the given session that the display has
+ * been modified.
+ *
+ * @param session
+ *     The session whose display has been modified.
+ */
+void guacload_session_modified(guacload_session* session);
+
+/**
+ * Marks the end of a frame of the recording, waiting until the time that
+ * frame ended relative to the start of the recording (adjusted for the
+ * replay speed) before notifying the render thread of the frame boundary.
+ *
+ * @param session
+ *     The session of the recording.
+ *
+ * @param timestamp
+ *     The timestamp of the "sync" instruction which ended the frame.
+ */
+void guacload_session_end_frame(guacload_session* session,
+        guac_timestamp timestamp);
+
+#endif
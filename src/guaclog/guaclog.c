@@ -22,26 +22,318 @@
 #include "guaclog.h"
 #include "interpret.h"
 #include "log.h"
+#include "terms.h"
+
+#include <guacamole/string.h>
 
 #include <getopt.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int main(int argc, char* argv[]) {
+/**
+ * Searches the term index of each of the given logs for the given term,
+ * writing each occurrence found to STDOUT as described by
+ * guaclog_terms_search(). The logs themselves are not read.
+ *
+ * @param term
+ *     The term to search for, which may end with "*" to search for all terms
+ *     having the given prefix.
+ *
+ * @param count
+ *     The number of logs to search.
+ *
+ * @param paths
+ *     The paths of each log to search, or of their term indexes.
+ *
+ * @return
+ *     Zero if the index of every log could be searched, non-zero otherwise.
+ */
+static int guaclog_search(const char* term, int count, char** paths) {
+
+    int failures = 0;
+    int found = 0;
+
+    for (int i = 0; i < count; i++) {
+
+        /* Accept the index itself, as well as the log it describes */
+        const char* path = paths[i];
+        size_t length = strlen(path);
+        size_t suffix_length = strlen(GUACLOG_TERMS_SUFFIX);
+
+        char terms_path[4096];
+        char label[4096];
+        if (length >= suffix_length && strcmp(path + length - suffix_length,
+                    GUACLOG_TERMS_SUFFIX) == 0) {
+            guac_strlcpy(terms_path, path, sizeof(terms_path));
+            guac_strlcpy(label, path, sizeof(label));
+            if (length - suffix_length < sizeof(label))
+                label[length - suffix_length] = '\0';
+            path = label;
+        }
+
+        else if (snprintf(terms_path, sizeof(terms_path),
+                    "%s" GUACLOG_TERMS_SUFFIX, path) >= sizeof(terms_path)) {
+            guaclog_log(GUAC_LOG_ERROR, "Cannot search index of \"%s\": "
+                    "Name too long", path);
+            failures++;
+            continue;
+        }
+
+        int matches = guaclog_terms_search(terms_path, term, path, stdout);
+        if (matches < 0)
+            failures++;
+        else
+            found += matches;
+
+    }
+
+    /* Warn if at least one index could not be searched */
+    if (failures != 0)
+        guaclog_log(GUAC_LOG_WARNING, "Searching failed for %i of %i "
+                "file(s).", failures, count);
+
+    guaclog_log(GUAC_LOG_INFO, "%i occurrence(s) of \"%s\" found.", found,
+            term);
+
+    return failures != 0;
+
+}
 
-    int i;
+/**
+ * A set of logs being interpreted by one or more concurrent jobs, along with
+ * the options applying to all of those logs.
+ */
+typedef struct guaclog_jobs {
+
+    /**
+     * The paths of all logs to interpret, in order.
+     */
+    char** paths;
+
+    /**
+     * The number of paths within the paths array.
+     */
+    int count;
+
+    /**
+     * Whether logs should be interpreted even if they appear to be in
+     * progress.
+     */
+    bool force;
+
+    /**
+     * Whether a term index should be written for each log.
+     */
+    bool index;
+
+    /**
+     * Lock which must be acquired before accessing next or failures.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The index of the next log which has not yet begun being interpreted.
+     */
+    int next;
+
+    /**
+     * The number of logs which could not be interpreted.
+     */
+    int failures;
+
+} guaclog_jobs;
+
+/**
+ * Interprets the log at the given path, writing its human-readable text log
+ * and, if requested, its term index.
+ *
+ * @param jobs
+ *     The set of logs containing the log being interpreted.
+ *
+ * @param path
+ *     The path to the log to interpret.
+ *
+ * @return
+ *     Non-zero if the log could not be interpreted, zero otherwise
+ *     (including if its output could not be named).
+ */
+static int guaclog_interpret_file(guaclog_jobs* jobs, const char* path) {
+
+    /* Generate output filename */
+    char out_path[4096];
+    int len = snprintf(out_path, sizeof(out_path), "%s.txt", path);
+
+    /* Do not write if filename exceeds maximum length */
+    if (len >= sizeof(out_path)) {
+        guaclog_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
+                "Name too long", path);
+        return 0;
+    }
+
+    /* Generate index filename, if requested */
+    char terms_path[4096];
+    len = snprintf(terms_path, sizeof(terms_path),
+            "%s" GUACLOG_TERMS_SUFFIX, path);
+
+    /* Do not write if filename exceeds maximum length */
+    if (jobs->index && len >= sizeof(terms_path)) {
+        guaclog_log(GUAC_LOG_ERROR, "Cannot write index file for \"%s\": "
+                "Name too long", path);
+        return 0;
+    }
+
+    /* Attempt interpreting, log granular success/failure at debug level */
+    if (guaclog_interpret(path, out_path, jobs->index ? terms_path : NULL,
+                jobs->force)) {
+        guaclog_log(GUAC_LOG_DEBUG,
+                "%s was NOT successfully interpreted.", path);
+        return 1;
+    }
+
+    guaclog_log(GUAC_LOG_DEBUG, "%s was successfully interpreted.", path);
+    return 0;
+
+}
+
+/**
+ * Interprets each log of the given set not yet started by another job,
+ * until all logs have been started.
+ *
+ * @param data
+ *     A pointer to the guaclog_jobs being interpreted.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guaclog_job_thread(void* data) {
+
+    guaclog_jobs* jobs = (guaclog_jobs*) data;
+
+    for (;;) {
+
+        /* Claim next log, if any */
+        pthread_mutex_lock(&(jobs->lock));
+        int index = jobs->next;
+        if (index < jobs->count)
+            jobs->next++;
+        pthread_mutex_unlock(&(jobs->lock));
+
+        if (index >= jobs->count)
+            break;
+
+        if (guaclog_interpret_file(jobs, jobs->paths[index])) {
+            pthread_mutex_lock(&(jobs->lock));
+            jobs->failures++;
+            pthread_mutex_unlock(&(jobs->lock));
+        }
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Interprets all logs within the given set using up to the given number of
+ * concurrent jobs, returning only after all logs have been interpreted (or
+ * have failed to be interpreted).
+ *
+ * @param jobs
+ *     The set of logs to interpret.
+ *
+ * @param count
+ *     The maximum number of logs to interpret at once, or zero if this
+ *     should be the number of available processors.
+ *
+ * @return
+ *     The number of logs which could not be interpreted.
+ */
+static int guaclog_run_jobs(guaclog_jobs* jobs, int count) {
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (count <= 0)
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count > GUACLOG_MAX_JOBS)
+        count = GUACLOG_MAX_JOBS;
+
+    if (count > jobs->count)
+        count = jobs->count;
+
+    if (count < 1)
+        count = 1;
+
+    if (count > 1)
+        guaclog_log(GUAC_LOG_INFO, "Interpreting up to %i files at once.",
+                count);
+
+    /* Start additional jobs, interpreting within the current thread as
+     * well */
+    pthread_t threads[GUACLOG_MAX_JOBS];
+    int started = 0;
+    for (int i = 1; i < count; i++) {
+
+        if (pthread_create(&threads[started], NULL, guaclog_job_thread,
+                    jobs)) {
+            guaclog_log(GUAC_LOG_WARNING, "Unable to start all jobs. Fewer "
+                    "files will be interpreted at once.");
+            break;
+        }
+
+        started++;
+
+    }
+
+    guaclog_job_thread(jobs);
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    return jobs->failures;
+
+}
+
+int main(int argc, char* argv[]) {
 
     /* Load defaults */
     bool force = false;
+    bool index = false;
+    int job_count = 1;
+    const char* query = NULL;
 
     /* Parse arguments */
     int opt;
-    while ((opt = getopt(argc, argv, "s:r:f")) != -1) {
+    while ((opt = getopt(argc, argv, "s:r:fij:q:")) != -1) {
 
         /* -f: Force */
         if (opt == 'f')
             force = true;
 
+        /* -j: Number of files to interpret at once (zero for automatic) */
+        else if (opt == 'j') {
+            char* end;
+            long value = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || value < 0
+                    || value > GUACLOG_MAX_JOBS) {
+                guaclog_log(GUAC_LOG_ERROR, "Invalid number of jobs.");
+                goto invalid_options;
+            }
+            job_count = value;
+        }
+
+        /* -i: Write term index */
+        else if (opt == 'i')
+            index = true;
+
+        /* -q: Search term indexes */
+        else if (opt == 'q')
+            query = optarg;
+
         /* Invalid option */
         else {
             goto invalid_options;
@@ -53,11 +345,8 @@ int main(int argc, char* argv[]) {
     guaclog_log(GUAC_LOG_INFO, "Guacamole input log interpreter (guaclog) "
             "version " VERSION);
 
-    /* Track number of overall failures */
-    int total_files = argc - optind;
-    int failures = 0;
-
     /* Abort if no files given */
+    int total_files = argc - optind;
     if (total_files <= 0) {
         guaclog_log(GUAC_LOG_INFO, "No input files specified. Nothing to do.");
         return 0;
@@ -65,34 +354,22 @@ int main(int argc, char* argv[]) {
 
     guaclog_log(GUAC_LOG_INFO, "%i input file(s) provided.", total_files);
 
-    /* Interpret all input files */
-    for (i = optind; i < argc; i++) {
-
-        /* Get current filename */
-        const char* path = argv[i];
-
-        /* Generate output filename */
-        char out_path[4096];
-        int len = snprintf(out_path, sizeof(out_path), "%s.txt", path);
-
-        /* Do not write if filename exceeds maximum length */
-        if (len >= sizeof(out_path)) {
-            guaclog_log(GUAC_LOG_ERROR, "Cannot write output file for \"%s\": "
-                    "Name too long", path);
-            continue;
-        }
+    /* Search the term indexes of all input files rather than interpreting
+     * those files, if requested */
+    if (query != NULL)
+        return guaclog_search(query, argc - optind, argv + optind);
 
-        /* Attempt interpreting, log granular success/failure at debug level */
-        if (guaclog_interpret(path, out_path, force)) {
-            failures++;
-            guaclog_log(GUAC_LOG_DEBUG,
-                    "%s was NOT successfully interpreted.", path);
-        }
-        else
-            guaclog_log(GUAC_LOG_DEBUG, "%s was successfully "
-                    "interpreted.", path);
+    /* Interpret all input files */
+    guaclog_jobs jobs = {
+        .paths = argv + optind,
+        .count = total_files,
+        .force = force,
+        .index = index
+    };
 
-    }
+    pthread_mutex_init(&(jobs.lock), NULL);
+    int failures = guaclog_run_jobs(&jobs, job_count);
+    pthread_mutex_destroy(&(jobs.lock));
 
     /* Warn if at least one file failed */
     if (failures != 0)
@@ -110,8 +387,9 @@ int main(int argc, char* argv[]) {
 invalid_options:
 
     fprintf(stderr, "USAGE: %s"
-            " [-f]"
-            " [FILE]...\n", argv[0]);
+            " [-f] [-i] [-j JOBS]"
+            " [FILE]...\n"
+            "       %s -q TERM [FILE]...\n", argv[0], argv[0]);
 
     return 1;
 
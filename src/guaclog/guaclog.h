@@ -27,5 +27,10 @@
  */
 #define GUACLOG_DEFAULT_LOG_LEVEL GUAC_LOG_INFO
 
+/**
+ * The maximum number of files that may be interpreted at once.
+ */
+#define GUACLOG_MAX_JOBS 64
+
 #endif
 
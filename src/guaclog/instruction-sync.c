@@ -0,0 +1,44 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "state.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+
+int guaclog_handle_sync(guaclog_state* state, int argc, char** argv) {
+
+    /* Verify argument count */
+    if (argc < 1) {
+        guaclog_log(GUAC_LOG_WARNING, "\"sync\" instruction incomplete");
+        return 1;
+    }
+
+    /* Parse arguments */
+    guac_timestamp timestamp = strtoll(argv[0], NULL, 10);
+
+    /* Update interpreter state accordingly */
+    guaclog_state_update_timestamp(state, timestamp);
+    return 0;
+
+}
+
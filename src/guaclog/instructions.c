@@ -22,38 +22,63 @@
 #include "instructions.h"
 #include "log.h"
 
-#include <string.h>
+#include <guacamole/opcode.h>
+
+#include <pthread.h>
 
 guaclog_instruction_handler_mapping guaclog_instruction_handler_map[] = {
-    {"key", guaclog_handle_key},
-    {NULL,  NULL}
+    {"blob",      guaclog_handle_blob},
+    {"clipboard", guaclog_handle_clipboard},
+    {"end",       guaclog_handle_end},
+    {"key",       guaclog_handle_key},
+    {"sync",      guaclog_handle_sync},
+    {NULL,        NULL}
 };
 
+/**
+ * Index of guaclog_instruction_handler_map.
+ */
+static guac_opcode_index guaclog_instruction_handler_index;
+
+/**
+ * Guard ensuring that guaclog_instruction_handler_index is built only once.
+ */
+static pthread_once_t guaclog_instruction_handler_index_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds guaclog_instruction_handler_index. This function is invoked through
+ * pthread_once().
+ */
+static void guaclog_instruction_handler_index_init(void) {
+    guac_opcode_index_init(&guaclog_instruction_handler_index,
+            guaclog_instruction_handler_map,
+            sizeof(guaclog_instruction_handler_mapping));
+}
+
 int guaclog_handle_instruction(guaclog_state* state, const char* opcode,
         int argc, char** argv) {
 
-    /* Search through mapping for instruction handler having given opcode */
-    guaclog_instruction_handler_mapping* current = guaclog_instruction_handler_map;
-    while (current->opcode != NULL) {
+    pthread_once(&guaclog_instruction_handler_index_once,
+            guaclog_instruction_handler_index_init);
 
-        /* Invoke handler if opcode matches (if defined) */
-        if (strcmp(current->opcode, opcode) == 0) {
+    /* Locate instruction handler having given opcode */
+    int position = guac_opcode_index_lookup(&guaclog_instruction_handler_index,
+            opcode);
 
-            /* Invoke defined handler */
-            guaclog_instruction_handler* handler = current->handler;
-            if (handler != NULL)
-                return handler(state, argc, argv);
+    if (position >= 0) {
 
-            /* Log defined but unimplemented instructions */
-            guaclog_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
-            return 0;
+        /* Invoke defined handler */
+        guaclog_instruction_handler* handler =
+            guaclog_instruction_handler_map[position].handler;
 
-        }
+        if (handler != NULL)
+            return handler(state, argc, argv);
 
-        /* Next candidate handler */
-        current++;
+        /* Log defined but unimplemented instructions */
+        guaclog_log(GUAC_LOG_DEBUG, "\"%s\" not implemented", opcode);
+        return 0;
 
-    } /* end opcode search */
+    }
 
     /* Ignore any unknown instructions */
     return 0;
@@ -99,10 +99,30 @@ extern guaclog_instruction_handler_mapping guaclog_instruction_handler_map[];
 int guaclog_handle_instruction(guaclog_state* state,
         const char* opcode, int argc, char** argv);
 
+/**
+ * Handler for the Guacamole "blob" instruction.
+ */
+guaclog_instruction_handler guaclog_handle_blob;
+
+/**
+ * Handler for the Guacamole "clipboard" instruction.
+ */
+guaclog_instruction_handler guaclog_handle_clipboard;
+
+/**
+ * Handler for the Guacamole "end" instruction.
+ */
+guaclog_instruction_handler guaclog_handle_end;
+
 /**
  * Handler for the Guacamole "key" instruction.
  */
 guaclog_instruction_handler guaclog_handle_key;
 
+/**
+ * Handler for the Guacamole "sync" instruction.
+ */
+guaclog_instruction_handler guaclog_handle_sync;
+
 #endif
 
@@ -19,25 +19,343 @@
 
 #include "config.h"
 #include "instructions.h"
+#include "interpret.h"
 #include "log.h"
 #include "state.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
+#include <guacamole/mem.h>
 #include <guacamole/parser.h>
+#include <guacamole/recording.h>
 #include <guacamole/socket.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+/**
+ * Skips the given number of characters of UTF-8 text, without validating
+ * that text. Runs of ASCII characters are skipped several bytes at a time.
+ *
+ * @param current
+ *     The first byte of the text.
+ *
+ * @param end
+ *     The end of the available data, immediately after the last byte
+ *     available.
+ *
+ * @param count
+ *     The number of characters to skip.
+ *
+ * @return
+ *     A pointer to the byte immediately after the skipped characters, or NULL
+ *     if the available data ends first.
+ */
+static char* guaclog_skip_chars(char* current, char* end, size_t count) {
+
+    while (count > 0) {
+
+        /* Skip eight ASCII characters at once where possible */
+        if (count >= sizeof(uint64_t) && end - current >= sizeof(uint64_t)) {
+
+            uint64_t bytes;
+            memcpy(&bytes, current, sizeof(bytes));
+
+            if (!(bytes & 0x8080808080808080ULL)) {
+                current += sizeof(bytes);
+                count -= sizeof(bytes);
+                continue;
+            }
+
+        }
+
+        if (current >= end)
+            return NULL;
+
+        /* Skip the first byte of the character and any continuation bytes */
+        current++;
+        while (current < end && (*current & 0xC0) == 0x80)
+            current++;
+
+        count--;
+
+    }
+
+    return current;
+
+}
+
+/**
+ * Locates the end of the element of a Guacamole instruction which begins at
+ * the given position, reading only its length prefix and skipping its
+ * value.
+ *
+ * @param current
+ *     The first byte of the element (the first digit of its length).
+ *
+ * @param end
+ *     The end of the available data, immediately after the last byte
+ *     available.
+ *
+ * @param value
+ *     A pointer to the char* which should receive the location of the value
+ *     of the element.
+ *
+ * @param status
+ *     A pointer to the guaclog_scan_status which should receive whether the
+ *     element is complete, incomplete, or malformed.
+ *
+ * @return
+ *     A pointer to the terminator of the element ("," or ";"), or NULL if
+ *     the element is incomplete or malformed.
+ */
+static char* guaclog_scan_element(char* current, char* end, char** value,
+        guaclog_scan_status* status) {
+
+    size_t length = 0;
+    int digits = 0;
+
+    /* Read length prefix */
+    for (;;) {
+
+        if (current >= end) {
+            *status = GUACLOG_SCAN_INCOMPLETE;
+            return NULL;
+        }
+
+        char c = *(current++);
+        if (c == '.' && digits > 0)
+            break;
+
+        if (c < '0' || c > '9' || ++digits > GUAC_INSTRUCTION_MAX_DIGITS) {
+            *status = GUACLOG_SCAN_MALFORMED;
+            return NULL;
+        }
+
+        length = length * 10 + c - '0';
+
+    }
+
+    /* Skip value */
+    *value = current;
+    current = guaclog_skip_chars(current, end, length);
+    if (current == NULL || current >= end) {
+        *status = GUACLOG_SCAN_INCOMPLETE;
+        return NULL;
+    }
+
+    if (*current != ',' && *current != ';') {
+        *status = GUACLOG_SCAN_MALFORMED;
+        return NULL;
+    }
+
+    *status = GUACLOG_SCAN_COMPLETE;
+    return current;
+
+}
+
+/**
+ * Returns whether the instruction having the given opcode must be handled
+ * to interpret the log, based on the given interpreter state. Only "key"
+ * instructions are needed for the human-readable log itself, while the
+ * instructions carrying timestamps and clipboard text are additionally
+ * needed only if a term index is being written.
+ *
+ * @param state
+ *     The current state of the Guacamole input log interpreter.
+ *
+ * @param opcode
+ *     The opcode of the instruction, which need not be null-terminated.
+ *
+ * @param length
+ *     The length of the opcode, in bytes.
+ *
+ * @return
+ *     true if the instruction must be handled, false if it may be skipped,
+ *     or if the instruction is a "blob" that must be handled only if it
+ *     belongs to the current clipboard stream.
+ */
+static bool guaclog_wants_opcode(guaclog_state* state, const char* opcode,
+        size_t length) {
+
+#define GUACLOG_OPCODE_IS(name) \
+    (length == sizeof(name) - 1 && memcmp(opcode, name, length) == 0)
+
+    if (GUACLOG_OPCODE_IS("key"))
+        return true;
+
+    if (state->terms == NULL)
+        return false;
+
+    return GUACLOG_OPCODE_IS("sync")
+        || GUACLOG_OPCODE_IS("clipboard")
+        || GUACLOG_OPCODE_IS("end")
+        || (GUACLOG_OPCODE_IS("blob") && state->clipboard_stream >= 0);
+
+#undef GUACLOG_OPCODE_IS
+
+}
+
+/**
+ * Locates the end of the instruction which begins at the given position,
+ * reading only the length prefix of each element and the opcode, and
+ * determining whether that instruction needs to be handled at all. No
+ * validation of the UTF-8 within the instruction is performed, and the
+ * instruction is not modified.
+ *
+ * @param state
+ *     The current state of the Guacamole input log interpreter.
+ *
+ * @param current
+ *     The first byte of the instruction.
+ *
+ * @param end
+ *     The end of the available data, immediately after the last byte
+ *     available.
+ *
+ * @param wanted
+ *     A pointer to the bool which should receive whether the instruction
+ *     must be handled (see guaclog_wants_opcode()).
+ *
+ * @param status
+ *     A pointer to the guaclog_scan_status which should receive whether the
+ *     instruction is complete, incomplete, or malformed.
+ *
+ * @return
+ *     A pointer to the byte immediately after the instruction, or NULL if
+ *     the instruction is incomplete or malformed.
+ */
+static char* guaclog_scan_instruction(guaclog_state* state, char* current,
+        char* end, bool* wanted, guaclog_scan_status* status) {
+
+    char* value;
+    char* terminator = guaclog_scan_element(current, end, &value, status);
+    if (terminator == NULL)
+        return NULL;
+
+    *wanted = guaclog_wants_opcode(state, value, terminator - value);
+
+    /* Blobs are wanted only if they contain clipboard text */
+    bool blob = *wanted && terminator - value == 4
+        && memcmp(value, "blob", 4) == 0;
+
+    for (int elements = 1; *terminator != ';'; elements++) {
+
+        if (elements == GUAC_INSTRUCTION_MAX_ELEMENTS) {
+            *status = GUACLOG_SCAN_MALFORMED;
+            return NULL;
+        }
+
+        terminator = guaclog_scan_element(terminator + 1, end, &value, status);
+        if (terminator == NULL)
+            return NULL;
+
+        if (blob && elements == 1)
+            *wanted = (strtol(value, NULL, 10) == state->clipboard_stream);
+
+    }
+
+    return terminator + 1;
+
+}
+
+/**
+ * Handles all complete instructions within the given block of data which
+ * are needed to interpret the log, skipping all other instructions without
+ * parsing them. Reading stops at the end of the data, or at the first
+ * instruction which is incomplete or malformed.
+ *
+ * @param state
+ *     The current state of the Guacamole input log interpreter.
+ *
+ * @param parser
+ *     The guac_parser to use to parse each instruction handled.
+ *
+ * @param path
+ *     The name of the file being parsed (for logging purposes).
+ *
+ * @param current
+ *     A pointer to the position within the data at which reading should
+ *     begin. This position is updated to point immediately after the last
+ *     complete instruction read.
+ *
+ * @param end
+ *     The end of the available data, immediately after the last byte
+ *     available.
+ *
+ * @return
+ *     GUACLOG_SCAN_COMPLETE if all data was read, GUACLOG_SCAN_INCOMPLETE if
+ *     the data ends with an incomplete instruction, or GUACLOG_SCAN_MALFORMED
+ *     if an instruction is malformed, in which case an error has been
+ *     logged.
+ */
+static guaclog_scan_status guaclog_read_block(guaclog_state* state,
+        guac_parser* parser, const char* path, char** current, char* end) {
+
+    while (*current < end) {
+
+        bool wanted;
+        guaclog_scan_status status;
+        char* next = guaclog_scan_instruction(state, *current, end, &wanted,
+                &status);
+
+        if (next == NULL) {
+
+            /* Use the parser to describe what is wrong */
+            if (status == GUACLOG_SCAN_MALFORMED) {
+                char* instruction = *current;
+                if (!guac_parser_read_buffer(parser, &instruction, end)
+                        || guac_error == GUAC_STATUS_CLOSED)
+                    guaclog_log(GUAC_LOG_ERROR, "%s: Malformed instruction",
+                            path);
+                else
+                    guaclog_log(GUAC_LOG_ERROR, "%s: %s",
+                            path, guac_status_string(guac_error));
+            }
+
+            return status;
+
+        }
+
+        /* Parse and handle only the instructions that matter */
+        if (wanted) {
+
+            char* instruction = *current;
+            if (guac_parser_read_buffer(parser, &instruction, next)) {
+                guaclog_log(GUAC_LOG_ERROR, "%s: %s",
+                        path, guac_status_string(guac_error));
+                return GUACLOG_SCAN_MALFORMED;
+            }
+
+            guaclog_handle_instruction(state, parser->opcode,
+                    parser->argc, parser->argv);
+
+        }
+
+        *current = next;
+
+    }
+
+    return GUACLOG_SCAN_COMPLETE;
+
+}
+
 /**
  * Reads and handles all Guacamole instructions from the given guac_socket
- * until end-of-stream is reached.
+ * until end-of-stream is reached. Data is read in large blocks, with only
+ * the instructions needed to interpret the log being parsed (see
+ * guaclog_read_block()).
  *
  * @param state
  *     The current state of the Guacamole input log interpreter.
@@ -61,27 +379,178 @@ static int guaclog_read_instructions(guaclog_state* state,
     if (parser == NULL)
         return 1;
 
-    /* Continuously read and handle all instructions */
-    while (!guac_parser_read(parser, socket, -1)) {
-        guaclog_handle_instruction(state, parser->opcode,
-                parser->argc, parser->argv);
+    size_t size = GUACLOG_READ_BUFFER_SIZE;
+    size_t length = 0;
+    char* buffer = guac_mem_alloc(size);
+
+    int result = 0;
+    for (;;) {
+
+        /* Grow buffer if a single instruction does not fit */
+        if (length == size) {
+            size = guac_mem_ckd_mul_or_die(size, 2);
+            buffer = guac_mem_realloc_or_die(buffer, size);
+        }
+
+        ssize_t received = guac_socket_read(socket, buffer + length,
+                size - length);
+
+        /* Fail on read error */
+        if (received < 0) {
+            guaclog_log(GUAC_LOG_ERROR, "%s: %s",
+                    path, guac_status_string(guac_error));
+            result = 1;
+            break;
+        }
+
+        /* An incomplete final instruction is ignored, as it would be by
+         * the parser */
+        if (received == 0)
+            break;
+
+        length += received;
+
+        char* current = buffer;
+        if (guaclog_read_block(state, parser, path, &current,
+                    buffer + length) == GUACLOG_SCAN_MALFORMED) {
+            result = 1;
+            break;
+        }
+
+        /* Retain any incomplete instruction until more data is read */
+        length -= current - buffer;
+        memmove(buffer, current, length);
+
     }
 
-    /* Fail on read/parse error */
-    if (guac_error != GUAC_STATUS_CLOSED) {
-        guaclog_log(GUAC_LOG_ERROR, "%s: %s",
-                path, guac_status_string(guac_error));
-        guac_parser_free(parser);
+    guac_mem_free(buffer);
+    guac_parser_free(parser);
+    return result;
+
+}
+
+/**
+ * Maps the entire contents of the given log into memory, such that
+ * instructions may be parsed directly from that memory rather than being read
+ * through a guac_socket. The mapping is private and writable, as parsing
+ * modifies the data being parsed; modifications are never written back to
+ * the log.
+ *
+ * @param fd
+ *     The file descriptor of the log.
+ *
+ * @param length
+ *     A pointer to the size_t in which the length of the mapping should be
+ *     stored.
+ *
+ * @return
+ *     The start of the mapping, which must be unmapped with munmap(), or NULL
+ *     if the log cannot be mapped (for example, if the log is empty or is not
+ *     a regular file).
+ */
+static char* guaclog_map_log(int fd, size_t* length) {
+
+#ifdef HAVE_SYS_MMAN_H
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || !S_ISREG(file_stat.st_mode)
+            || file_stat.st_size <= 0)
+        return NULL;
+
+    char* map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return NULL;
+
+#ifdef MADV_SEQUENTIAL
+    /* The log is read once, from beginning to end */
+    madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+#endif
+
+    *length = file_stat.st_size;
+    return map;
+#else
+    return NULL;
+#endif
+
+}
+
+/**
+ * Reads and handles all Guacamole instructions from the given memory mapping
+ * of a log, as created by guaclog_map_log(), until the end of the mapping is
+ * reached. Pages containing instructions which have already been handled are
+ * periodically released.
+ *
+ * @param state
+ *     The current state of the Guacamole input log interpreter.
+ *
+ * @param path
+ *     The name of the file being parsed (for logging purposes).
+ *
+ * @param map
+ *     The start of the mapping.
+ *
+ * @param length
+ *     The length of the mapping, in bytes.
+ *
+ * @return
+ *     Zero on success, non-zero if parsing of Guacamole protocol data within
+ *     the given mapping fails.
+ */
+static int guaclog_read_mapped_instructions(guaclog_state* state,
+        const char* path, char* map, size_t length) {
+
+    /* Obtain Guacamole protocol parser */
+    guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL)
         return 1;
+
+    char* current = map;
+    char* end = map + length;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t released = 0;
+#endif
+
+    /* Continuously read and handle all instructions, a block at a time */
+    guaclog_scan_status status = GUACLOG_SCAN_COMPLETE;
+    size_t block_size = GUACLOG_MAPPED_RELEASE_SIZE;
+    while (current < end && status == GUACLOG_SCAN_COMPLETE) {
+
+        char* block_start = current;
+        char* block_end = end;
+        if (block_end - current > block_size)
+            block_end = current + block_size;
+
+        status = guaclog_read_block(state, parser, path, &current, block_end);
+
+        /* Instructions may continue beyond the end of the block, with the
+         * next block enlarged if a single instruction does not fit */
+        if (status == GUACLOG_SCAN_INCOMPLETE && block_end != end) {
+            status = GUACLOG_SCAN_COMPLETE;
+            block_size = (current == block_start) ? block_size * 2
+                : GUACLOG_MAPPED_RELEASE_SIZE;
+        }
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+        /* Release pages that will not be read again */
+        size_t handled = (current - map) / page_size * page_size;
+        if (handled - released >= GUACLOG_MAPPED_RELEASE_SIZE) {
+            madvise(map + released, handled - released, MADV_DONTNEED);
+            released = handled;
+        }
+#endif
+
     }
 
-    /* Parse complete */
+    /* Parse complete (ignoring any incomplete final instruction) */
     guac_parser_free(parser);
-    return 0;
+    return status == GUACLOG_SCAN_MALFORMED;
 
 }
 
-int guaclog_interpret(const char* path, const char* out_path, bool force) {
+int guaclog_interpret(const char* path, const char* out_path,
+        const char* terms_path, bool force) {
 
     /* Open input file */
     int fd = open(path, O_RDONLY);
@@ -118,15 +587,51 @@ int guaclog_interpret(const char* path, const char* out_path, bool force) {
     }
 
     /* Allocate input state for interpreting process */
-    guaclog_state* state = guaclog_state_alloc(out_path);
+    guaclog_state* state = guaclog_state_alloc(out_path, terms_path);
     if (state == NULL) {
         close(fd);
         return 1;
     }
 
+    /* Parse instructions directly from memory, without copying the log
+     * through a guac_socket, if possible (compressed logs must instead be
+     * decompressed as they are read) */
+    size_t length;
+    char* map = guaclog_map_log(fd, &length);
+    if (map != NULL && guac_recording_is_compressed(map, length)) {
+#ifdef HAVE_SYS_MMAN_H
+        munmap(map, length);
+#endif
+        map = NULL;
+    }
+
+    if (map != NULL) {
+
+        close(fd);
+
+        guaclog_log(GUAC_LOG_INFO, "Writing input events from \"%s\" "
+                "to \"%s\" ...", path, out_path);
+
+        int failed = guaclog_read_mapped_instructions(state, path, map,
+                length);
+
+#ifdef HAVE_SYS_MMAN_H
+        munmap(map, length);
+#endif
+
+        if (failed) {
+            guaclog_state_free(state);
+            return 1;
+        }
+
+        /* Finish interpreting process */
+        return guaclog_state_free(state);
+
+    }
+
     /* Obtain guac_socket wrapping file descriptor */
-    guac_socket* socket = guac_socket_open(fd);
-    if (socket == NULL) {
+    guac_socket* file = guac_socket_open(fd);
+    if (file == NULL) {
         guaclog_log(GUAC_LOG_ERROR, "%s: %s", path,
                 guac_status_string(guac_error));
         close(fd);
@@ -134,6 +639,16 @@ int guaclog_interpret(const char* path, const char* out_path, bool force) {
         return 1;
     }
 
+    /* Decompress the log as it is read, if compressed */
+    guac_socket* socket = guac_recording_open_reader(file);
+    if (socket == NULL) {
+        guaclog_log(GUAC_LOG_ERROR, "%s: %s", path,
+                guac_status_string(guac_error));
+        guac_socket_free(file);
+        guaclog_state_free(state);
+        return 1;
+    }
+
     guaclog_log(GUAC_LOG_INFO, "Writing input events from \"%s\" "
             "to \"%s\" ...", path, out_path);
 
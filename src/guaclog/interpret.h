@@ -24,6 +24,45 @@
 
 #include <stdbool.h>
 
+/**
+ * The number of bytes of a memory-mapped log that may be read before the
+ * pages containing instructions which have already been handled are
+ * released. As parsing modifies the mapped data, each page read would
+ * otherwise remain in memory until the entire log has been interpreted.
+ */
+#define GUACLOG_MAPPED_RELEASE_SIZE 16777216
+
+/**
+ * The number of bytes initially read at once from logs which cannot be
+ * memory-mapped, such as compressed logs. The buffer receiving this data
+ * grows as needed to contain any single instruction.
+ */
+#define GUACLOG_READ_BUFFER_SIZE 1048576
+
+/**
+ * The result of scanning the Guacamole protocol data within a block of a
+ * log for the boundaries of instructions.
+ */
+typedef enum guaclog_scan_status {
+
+    /**
+     * All data scanned consisted of complete instructions.
+     */
+    GUACLOG_SCAN_COMPLETE,
+
+    /**
+     * The data scanned ended partway through an instruction, which may be
+     * completed by data that follows.
+     */
+    GUACLOG_SCAN_INCOMPLETE,
+
+    /**
+     * The data scanned is not valid Guacamole protocol data.
+     */
+    GUACLOG_SCAN_MALFORMED
+
+} guaclog_scan_status;
+
 /**
  * Interprets all input events within the given Guacamole protocol dump,
  * producing a human-readable log of those input events. A read lock will be
@@ -37,6 +76,11 @@
  * @param out_path
  *     The full path to the file in which interpreted log should be written.
  *
+ * @param terms_path
+ *     The full path to the file in which a searchable index of all terms
+ *     typed or copied to the clipboard should be written, or NULL if no such
+ *     index should be written.
+ *
  * @param force
  *     Interpret even if the input file appears to be an in-progress log (has
  *     an associated lock).
@@ -45,7 +89,8 @@
  *     Zero on success, non-zero if an error prevented successful
  *     interpretation of the log.
  */
-int guaclog_interpret(const char* path, const char* out_path, bool force);
+int guaclog_interpret(const char* path, const char* out_path,
+        const char* terms_path, bool force);
 
 #endif
 
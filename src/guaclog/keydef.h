@@ -24,6 +24,11 @@
 
 #include <stdbool.h>
 
+/**
+ * The X11 keysym of the backspace key.
+ */
+#define GUACLOG_KEYSYM_BACKSPACE 0xFF08
+
 /**
  * A mapping of X11 keysym to its corresponding human-readable name.
  */
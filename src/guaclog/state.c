@@ -34,7 +34,8 @@
 #include <string.h>
 #include <unistd.h>
 
-guaclog_state* guaclog_state_alloc(const char* path) {
+guaclog_state* guaclog_state_alloc(const char* path,
+        const char* terms_path) {
 
     /* Open output file */
     int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
@@ -64,6 +65,15 @@ guaclog_state* guaclog_state_alloc(const char* path) {
     /* No keys are initially tracked */
     state->active_keys = 0;
 
+    /* No clipboard data is initially being received */
+    state->clipboard_stream = -1;
+
+    /* Collect terms for the index, if requested */
+    if (terms_path != NULL) {
+        state->terms = guaclog_terms_alloc();
+        state->terms_path = guac_strdup(terms_path);
+    }
+
     return state;
 
     /* Free all allocated data in case of failure */
@@ -93,8 +103,16 @@ int guaclog_state_free(guaclog_state* state) {
     /* Close output file */
     fclose(state->output);
 
+    /* Write term index, if requested */
+    int result = 0;
+    if (state->terms != NULL) {
+        result = guaclog_terms_write(state->terms, state->terms_path);
+        guaclog_terms_free(state->terms);
+        guac_mem_free(state->terms_path);
+    }
+
     guac_mem_free(state);
-    return 0;
+    return result;
 
 }
 
@@ -211,6 +229,35 @@ static bool guaclog_state_is_shortcut(guaclog_state* state) {
 
 }
 
+/**
+ * Updates the term currently being typed within the term index of the given
+ * interpreter state to reflect the press of the given key. Printable keys
+ * add to the current term (with whitespace ending that term), backspace
+ * removes the last character of the current term, and all other keys end the
+ * current term.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state being updated, which MUST be
+ *     collecting terms for a term index.
+ *
+ * @param keydef
+ *     The guaclog_keydef of the key being pressed.
+ */
+static void guaclog_state_update_terms(guaclog_state* state,
+        guaclog_keydef* keydef) {
+
+    if (keydef->value != NULL)
+        guaclog_terms_append(state->terms, GUACLOG_TERM_SOURCE_KEY,
+                keydef->value, strlen(keydef->value), state->timestamp);
+
+    else if (keydef->keysym == GUACLOG_KEYSYM_BACKSPACE)
+        guaclog_terms_erase(state->terms);
+
+    else
+        guaclog_terms_end(state->terms, GUACLOG_TERM_SOURCE_KEY);
+
+}
+
 int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
 
     int i;
@@ -238,6 +285,10 @@ int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
 
         if (guaclog_state_is_shortcut(state)) {
 
+            /* Shortcuts end any term being typed */
+            if (state->terms != NULL)
+                guaclog_terms_end(state->terms, GUACLOG_TERM_SOURCE_KEY);
+
             fprintf(state->output, "<");
 
             /* Compose log entry by inspecting the state of each tracked key */
@@ -264,6 +315,9 @@ int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
                 fprintf(state->output, "%s", keydef->value);
             else
                 fprintf(state->output, "<%s>", keydef->name);
+
+            if (state->terms != NULL)
+                guaclog_state_update_terms(state, keydef);
         }
 
     }
@@ -273,3 +327,40 @@ int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed) {
 
 }
 
+
+void guaclog_state_update_timestamp(guaclog_state* state,
+        guac_timestamp timestamp) {
+    state->timestamp = timestamp;
+}
+
+void guaclog_state_begin_clipboard(guaclog_state* state, int stream,
+        const char* mimetype) {
+
+    /* End any previous clipboard text */
+    guaclog_state_end_stream(state, state->clipboard_stream);
+
+    /* Only text can be searched */
+    if (state->terms != NULL && strncmp(mimetype, "text/", 5) == 0)
+        state->clipboard_stream = stream;
+
+}
+
+void guaclog_state_update_stream(guaclog_state* state, int stream,
+        const char* data, int length) {
+
+    if (state->terms != NULL && stream == state->clipboard_stream
+            && stream >= 0)
+        guaclog_terms_append(state->terms, GUACLOG_TERM_SOURCE_CLIPBOARD,
+                data, length, state->timestamp);
+
+}
+
+void guaclog_state_end_stream(guaclog_state* state, int stream) {
+
+    if (state->terms != NULL && stream == state->clipboard_stream
+            && stream >= 0) {
+        guaclog_terms_end(state->terms, GUACLOG_TERM_SOURCE_CLIPBOARD);
+        state->clipboard_stream = -1;
+    }
+
+}
@@ -22,6 +22,9 @@
 
 #include "config.h"
 #include "keydef.h"
+#include "terms.h"
+
+#include <guacamole/timestamp.h>
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -71,6 +74,30 @@ typedef struct guaclog_state {
      */
     guaclog_key_state key_states[GUACLOG_MAX_KEYS];
 
+    /**
+     * All terms read so far which should be written to a term index once
+     * interpreting is complete, or NULL if no term index is being written.
+     */
+    guaclog_terms* terms;
+
+    /**
+     * The full path to the file in which the term index should be written,
+     * or NULL if no term index is being written.
+     */
+    char* terms_path;
+
+    /**
+     * The timestamp of the most recent "sync" instruction, or zero if no
+     * "sync" instruction has yet been read.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The index of the stream currently receiving clipboard text, or -1 if
+     * no such stream is open.
+     */
+    int clipboard_stream;
+
 } guaclog_state;
 
 /**
@@ -82,16 +109,23 @@ typedef struct guaclog_state {
  *     The full path to the file in which interpreted, human-readable should be
  *     written.
  *
+ * @param terms_path
+ *     The full path to the file in which a term index of all typed and
+ *     clipboard text should be written (see guaclog_terms_write()), or NULL
+ *     if no term index should be written.
+ *
  * @return
  *     The newly-allocated Guacamole input log interpreter state, or NULL if
  *     the state could not be allocated.
  */
-guaclog_state* guaclog_state_alloc(const char* path);
+guaclog_state* guaclog_state_alloc(const char* path,
+        const char* terms_path);
 
 /**
  * Frees all memory associated with the given Guacamole input log interpreter
- * state, and finishes any remaining interpreting process. If the given state
- * is NULL, this function has no effect.
+ * state, and finishes any remaining interpreting process, writing the term
+ * index if requested. If the given state is NULL, this function has no
+ * effect.
  *
  * @param state
  *     The Guacamole input log interpreter state to free, which may be NULL.
@@ -121,5 +155,66 @@ int guaclog_state_free(guaclog_state* state);
  */
 int guaclog_state_update_key(guaclog_state* state, int keysym, bool pressed);
 
-#endif
+/**
+ * Updates the given Guacamole input log interpreter state, noting the
+ * timestamp of the frame currently being read.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state being updated.
+ *
+ * @param timestamp
+ *     The timestamp of the most recent "sync" instruction.
+ */
+void guaclog_state_update_timestamp(guaclog_state* state,
+        guac_timestamp timestamp);
+
+/**
+ * Updates the given Guacamole input log interpreter state, beginning a new
+ * stream of clipboard data having the given mimetype. Only textual clipboard
+ * data is indexed.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state being updated.
+ *
+ * @param stream
+ *     The index of the stream that will receive the clipboard data.
+ *
+ * @param mimetype
+ *     The mimetype of the clipboard data.
+ */
+void guaclog_state_begin_clipboard(guaclog_state* state, int stream,
+        const char* mimetype);
 
+/**
+ * Updates the given Guacamole input log interpreter state with a blob of
+ * data received along the given stream. Data received along any stream other
+ * than the current clipboard stream is ignored.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state being updated.
+ *
+ * @param stream
+ *     The index of the stream that received the data.
+ *
+ * @param data
+ *     The decoded data received.
+ *
+ * @param length
+ *     The number of bytes of data received.
+ */
+void guaclog_state_update_stream(guaclog_state* state, int stream,
+        const char* data, int length);
+
+/**
+ * Updates the given Guacamole input log interpreter state, marking the end of
+ * the given stream.
+ *
+ * @param state
+ *     The Guacamole input log interpreter state being updated.
+ *
+ * @param stream
+ *     The index of the stream that has ended.
+ */
+void guaclog_state_end_stream(guaclog_state* state, int stream);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "terms.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+#include <guacamole/timestamp.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+guaclog_terms* guaclog_terms_alloc() {
+
+    guaclog_terms* terms = guac_mem_zalloc(sizeof(guaclog_terms));
+    terms->size = GUACLOG_TERMS_INITIAL_SIZE;
+    terms->occurrences = guac_mem_alloc(sizeof(guaclog_term_occurrence),
+            terms->size);
+
+    return terms;
+
+}
+
+void guaclog_terms_free(guaclog_terms* terms) {
+
+    /* Ignore NULL terms */
+    if (terms == NULL)
+        return;
+
+    for (int i = 0; i < terms->count; i++)
+        guac_mem_free(terms->occurrences[i].term);
+
+    guac_mem_free(terms->occurrences);
+    guac_mem_free(terms);
+
+}
+
+/**
+ * Returns the buffer containing the term currently being read from the given
+ * source.
+ *
+ * @param terms
+ *     The set of terms containing the buffer.
+ *
+ * @param source
+ *     The source whose buffer should be returned.
+ *
+ * @return
+ *     The buffer containing the term currently being read from the given
+ *     source.
+ */
+static guaclog_term_buffer* guaclog_terms_get_buffer(guaclog_terms* terms,
+        guaclog_term_source source) {
+
+    if (source == GUACLOG_TERM_SOURCE_CLIPBOARD)
+        return &terms->clipboard;
+
+    return &terms->typed;
+
+}
+
+void guaclog_terms_end(guaclog_terms* terms, guaclog_term_source source) {
+
+    guaclog_term_buffer* buffer = guaclog_terms_get_buffer(terms, source);
+    if (buffer->length == 0)
+        return;
+
+    /* Expand occurrences array as necessary */
+    if (terms->count == terms->size) {
+        terms->size *= 2;
+        terms->occurrences = guac_mem_realloc(terms->occurrences,
+                sizeof(guaclog_term_occurrence), terms->size);
+    }
+
+    guaclog_term_occurrence* occurrence = &terms->occurrences[terms->count++];
+    occurrence->term = guac_mem_alloc(buffer->length + 1);
+    memcpy(occurrence->term, buffer->value, buffer->length);
+    occurrence->term[buffer->length] = '\0';
+    occurrence->timestamp = buffer->timestamp;
+    occurrence->source = source;
+
+    buffer->length = 0;
+
+}
+
+void guaclog_terms_append(guaclog_terms* terms, guaclog_term_source source,
+        const char* text, int length, guac_timestamp timestamp) {
+
+    guaclog_term_buffer* buffer = guaclog_terms_get_buffer(terms, source);
+
+    for (int i = 0; i < length; i++) {
+
+        unsigned char c = text[i];
+
+        /* Whitespace and control characters separate terms */
+        if (c <= ' ' || c == 0x7F) {
+            guaclog_terms_end(terms, source);
+            continue;
+        }
+
+        /* Each term occurs at the time its first character was read */
+        if (buffer->length == 0)
+            buffer->timestamp = timestamp;
+
+        /* Truncate terms which are too long */
+        if (buffer->length < sizeof(buffer->value))
+            buffer->value[buffer->length++] = c;
+
+    }
+
+}
+
+void guaclog_terms_erase(guaclog_terms* terms) {
+
+    guaclog_term_buffer* buffer = &terms->typed;
+
+    /* Remove any continuation bytes of the final UTF-8 character, followed
+     * by the first byte of that character */
+    while (buffer->length > 0
+            && (buffer->value[buffer->length - 1] & 0xC0) == 0x80)
+        buffer->length--;
+
+    if (buffer->length > 0)
+        buffer->length--;
+
+}
+
+/**
+ * Comparator which orders term occurrences by term and then by timestamp,
+ * for use with qsort().
+ *
+ * @param a
+ *     A pointer to the first guaclog_term_occurrence to compare.
+ *
+ * @param b
+ *     A pointer to the second guaclog_term_occurrence to compare.
+ *
+ * @return
+ *     A negative value if the first occurrence should be sorted before the
+ *     second, a positive value if the first occurrence should be sorted after
+ *     the second, or zero if their order does not matter.
+ */
+static int guaclog_terms_compare(const void* a, const void* b) {
+
+    const guaclog_term_occurrence* occurrence_a = (const guaclog_term_occurrence*) a;
+    const guaclog_term_occurrence* occurrence_b = (const guaclog_term_occurrence*) b;
+
+    int result = strcmp(occurrence_a->term, occurrence_b->term);
+    if (result != 0)
+        return result;
+
+    if (occurrence_a->timestamp < occurrence_b->timestamp)
+        return -1;
+
+    return occurrence_a->timestamp > occurrence_b->timestamp;
+
+}
+
+int guaclog_terms_write(guaclog_terms* terms, const char* path) {
+
+    guaclog_terms_end(terms, GUACLOG_TERM_SOURCE_KEY);
+    guaclog_terms_end(terms, GUACLOG_TERM_SOURCE_CLIPBOARD);
+
+    /* Open output file */
+    int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        guaclog_log(GUAC_LOG_ERROR, "Failed to open index file \"%s\": %s",
+                path, strerror(errno));
+        return 1;
+    }
+
+    FILE* output = fdopen(fd, "wb");
+    if (output == NULL) {
+        guaclog_log(GUAC_LOG_ERROR, "Failed to allocate stream for index "
+                "file \"%s\": %s", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    qsort(terms->occurrences, terms->count, sizeof(guaclog_term_occurrence),
+            guaclog_terms_compare);
+
+    fprintf(output, GUACLOG_TERMS_HEADER "\n");
+
+    /* Write each distinct term with all of its occurrences */
+    for (int i = 0; i < terms->count; i++) {
+
+        guaclog_term_occurrence* occurrence = &terms->occurrences[i];
+        bool first = (i == 0 || strcmp(occurrence->term,
+                    terms->occurrences[i - 1].term) != 0);
+
+        if (first)
+            fprintf(output, "%s%s\t", i == 0 ? "" : "\n", occurrence->term);
+        else
+            fprintf(output, " ");
+
+        fprintf(output, "%c%" PRId64,
+                occurrence->source == GUACLOG_TERM_SOURCE_CLIPBOARD ? 'c' : 'k',
+                (int64_t) occurrence->timestamp);
+
+    }
+
+    if (terms->count > 0)
+        fprintf(output, "\n");
+
+    if (fclose(output)) {
+        guaclog_log(GUAC_LOG_ERROR, "Failed to write index file \"%s\": %s",
+                path, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes each occurrence listed within the given line of a term index to the
+ * given stream, as described by guaclog_terms_search().
+ *
+ * @param term
+ *     The term described by the line.
+ *
+ * @param occurrences
+ *     The space-separated list of occurrences of the term.
+ *
+ * @param label
+ *     The label to include with each occurrence.
+ *
+ * @param output
+ *     The stream to which each occurrence should be written.
+ *
+ * @return
+ *     The number of occurrences written.
+ */
+static int guaclog_terms_write_matches(const char* term, char* occurrences,
+        const char* label, FILE* output) {
+
+    int found = 0;
+    char* saveptr;
+
+    for (char* occurrence = strtok_r(occurrences, " ", &saveptr);
+            occurrence != NULL;
+            occurrence = strtok_r(NULL, " ", &saveptr)) {
+
+        const char* source = (*occurrence == 'c') ? "clipboard" : "key";
+        long long timestamp = strtoll(occurrence + 1, NULL, 10);
+
+        fprintf(output, "%s\t%lld\t%s\t%s\n", label, timestamp, source, term);
+        found++;
+
+    }
+
+    return found;
+
+}
+
+int guaclog_terms_search(const char* path, const char* term,
+        const char* label, FILE* output) {
+
+    FILE* input = fopen(path, "rb");
+    if (input == NULL) {
+        guaclog_log(GUAC_LOG_ERROR, "Failed to open index file \"%s\": %s",
+                path, strerror(errno));
+        return -1;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+
+    /* Refuse to search files which are not term indexes */
+    ssize_t length = getline(&line, &line_size, input);
+    if (length <= 0 || strcmp(line, GUACLOG_TERMS_HEADER "\n") != 0) {
+        guaclog_log(GUAC_LOG_ERROR, "\"%s\" is not a guaclog term index.",
+                path);
+        free(line);
+        fclose(input);
+        return -1;
+    }
+
+    /* A trailing "*" matches all terms having the given prefix */
+    size_t term_length = strlen(term);
+    bool prefix = (term_length > 0 && term[term_length - 1] == '*');
+    if (prefix)
+        term_length--;
+
+    int found = 0;
+    while ((length = getline(&line, &line_size, input)) > 0) {
+
+        if (line[length - 1] == '\n')
+            line[length - 1] = '\0';
+
+        char* occurrences = strchr(line, '\t');
+        if (occurrences == NULL)
+            continue;
+
+        *(occurrences++) = '\0';
+
+        /* Terms are sorted, so no later term can match once a term sorts
+         * after every possible match */
+        int result = strncmp(line, term, term_length);
+        if (result > 0)
+            break;
+
+        if (result == 0 && (prefix || line[term_length] == '\0'))
+            found += guaclog_terms_write_matches(line, occurrences, label,
+                    output);
+
+        else if (result == 0 && !prefix)
+            break;
+
+    }
+
+    free(line);
+    fclose(input);
+    return found;
+
+}
+
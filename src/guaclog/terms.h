@@ -0,0 +1,267 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUACLOG_TERMS_H
+#define GUACLOG_TERMS_H
+
+#include "config.h"
+
+#include <guacamole/timestamp.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * The suffix appended to the filename of a log to produce the filename of
+ * its term index.
+ */
+#define GUACLOG_TERMS_SUFFIX ".terms"
+
+/**
+ * The line which begins every term index, identifying the format of the
+ * remainder of the index.
+ */
+#define GUACLOG_TERMS_HEADER "guaclog-terms 1"
+
+/**
+ * The maximum number of bytes within any single indexed term. Longer terms
+ * are truncated.
+ */
+#define GUACLOG_TERMS_MAX_LENGTH 256
+
+/**
+ * The number of term occurrences for which space is initially allocated
+ * within each guaclog_terms.
+ */
+#define GUACLOG_TERMS_INITIAL_SIZE 1024
+
+/**
+ * The origin of a term within a log.
+ */
+typedef enum guaclog_term_source {
+
+    /**
+     * The term was typed by the user, as represented by "key" instructions.
+     */
+    GUACLOG_TERM_SOURCE_KEY,
+
+    /**
+     * The term was part of text received through the clipboard, as
+     * represented by "clipboard" instructions and their streams.
+     */
+    GUACLOG_TERM_SOURCE_CLIPBOARD
+
+} guaclog_term_source;
+
+/**
+ * A single occurrence of a term within a log.
+ */
+typedef struct guaclog_term_occurrence {
+
+    /**
+     * The term itself, as a null-terminated UTF-8 string.
+     */
+    char* term;
+
+    /**
+     * The timestamp of the most recent "sync" instruction preceding the start
+     * of the term, or zero if no such instruction preceded the term.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The origin of the term.
+     */
+    guaclog_term_source source;
+
+} guaclog_term_occurrence;
+
+/**
+ * A term that is still being read, one character at a time.
+ */
+typedef struct guaclog_term_buffer {
+
+    /**
+     * The bytes of the term read so far, which are NOT null-terminated.
+     */
+    char value[GUACLOG_TERMS_MAX_LENGTH];
+
+    /**
+     * The number of bytes within value.
+     */
+    int length;
+
+    /**
+     * The timestamp of the first character of the term.
+     */
+    guac_timestamp timestamp;
+
+} guaclog_term_buffer;
+
+/**
+ * All terms read from a log so far, which together will form the term index
+ * of that log. Each term is a run of characters not containing whitespace or
+ * control characters.
+ */
+typedef struct guaclog_terms {
+
+    /**
+     * Every complete term read so far, in the order read.
+     */
+    guaclog_term_occurrence* occurrences;
+
+    /**
+     * The number of complete terms within the occurrences array.
+     */
+    int count;
+
+    /**
+     * The number of term occurrences for which space has been allocated
+     * within the occurrences array.
+     */
+    int size;
+
+    /**
+     * The term currently being typed by the user.
+     */
+    guaclog_term_buffer typed;
+
+    /**
+     * The term currently being read from clipboard text.
+     */
+    guaclog_term_buffer clipboard;
+
+} guaclog_terms;
+
+/**
+ * Allocates a new, empty set of terms. The set of terms must eventually be
+ * freed with guaclog_terms_free().
+ *
+ * @return
+ *     A newly-allocated, empty set of terms.
+ */
+guaclog_terms* guaclog_terms_alloc();
+
+/**
+ * Frees all memory associated with the given set of terms. If the given set
+ * of terms is NULL, this function has no effect.
+ *
+ * @param terms
+ *     The set of terms to free, which may be NULL.
+ */
+void guaclog_terms_free(guaclog_terms* terms);
+
+/**
+ * Adds the given text to the term currently being read from the given
+ * source. Whitespace and control characters end the current term, and are
+ * not themselves part of any term.
+ *
+ * @param terms
+ *     The set of terms to update.
+ *
+ * @param source
+ *     The origin of the given text.
+ *
+ * @param text
+ *     The UTF-8 text to add.
+ *
+ * @param length
+ *     The number of bytes of text to add.
+ *
+ * @param timestamp
+ *     The timestamp of the most recent "sync" instruction preceding the
+ *     given text.
+ */
+void guaclog_terms_append(guaclog_terms* terms, guaclog_term_source source,
+        const char* text, int length, guac_timestamp timestamp);
+
+/**
+ * Removes the final character of the term currently being typed by the
+ * user, as would happen if the user pressed backspace.
+ *
+ * @param terms
+ *     The set of terms to update.
+ */
+void guaclog_terms_erase(guaclog_terms* terms);
+
+/**
+ * Ends the term currently being read from the given source, if any, adding
+ * that term to the set of complete terms.
+ *
+ * @param terms
+ *     The set of terms to update.
+ *
+ * @param source
+ *     The source whose current term should be ended.
+ */
+void guaclog_terms_end(guaclog_terms* terms, guaclog_term_source source);
+
+/**
+ * Writes the term index of the given set of terms to a new file at the given
+ * path, ending any terms still being read. The index begins with
+ * GUACLOG_TERMS_HEADER, followed by one line for each distinct term, in
+ * ascending byte order. Each line consists of the term, a tab, and a
+ * space-separated list of every occurrence of that term, in the order those
+ * occurrences appear within the log. Each occurrence is the letter "k" (for
+ * typed terms) or "c" (for clipboard terms) followed by its timestamp. The
+ * index can later be searched with guaclog_terms_search() without reading
+ * the log itself.
+ *
+ * @param terms
+ *     The set of terms to write.
+ *
+ * @param path
+ *     The full path to the file which should receive the index. This file
+ *     MUST NOT already exist.
+ *
+ * @return
+ *     Zero if the index was written successfully, non-zero otherwise.
+ */
+int guaclog_terms_write(guaclog_terms* terms, const char* path);
+
+/**
+ * Searches the term index at the given path for the given term, writing one
+ * line to the given stream for each occurrence found. Each line consists of
+ * the given label, the timestamp of the occurrence, the source of the
+ * occurrence ("key" or "clipboard"), and the term itself, separated by tabs.
+ * If the given term ends with "*", all terms beginning with the remainder of
+ * the given term match. As terms are sorted within the index, the search
+ * stops as soon as no further terms could match.
+ *
+ * @param path
+ *     The full path to the term index to search.
+ *
+ * @param term
+ *     The term to search for.
+ *
+ * @param label
+ *     The label to include with each occurrence found, typically the name of
+ *     the log that was indexed.
+ *
+ * @param output
+ *     The stream to which each occurrence found should be written.
+ *
+ * @return
+ *     The number of occurrences found, or -1 if the index cannot be read.
+ */
+int guaclog_terms_search(const char* path, const char* term,
+        const char* label, FILE* output);
+
+#endif
+
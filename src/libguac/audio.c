@@ -27,6 +27,14 @@
 #include "guacamole/user.h"
 #include "raw_encoder.h"
 
+#ifdef ENABLE_OGG
+#include "ogg_encoder.h"
+#endif
+
+#ifdef ENABLE_OPUS
+#include "opus_encoder.h"
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -53,6 +61,114 @@ static void guac_audio_stream_set_encoder(guac_audio_stream* audio,
 
 }
 
+/**
+ * The name of the mimetype parameter that users may include within their
+ * declared audio mimetypes to request a specific frame duration.
+ */
+#define GUAC_AUDIO_FRAME_DURATION_PARAMETER "frame-duration="
+
+/**
+ * Returns the frame duration requested by the "frame-duration" parameter of
+ * the given user-declared mimetype, if any.
+ *
+ * @param declared
+ *     The mimetype declared by the user, which may include parameters
+ *     following a semicolon, separated by commas.
+ *
+ * @return
+ *     The requested frame duration in milliseconds, or zero if no valid
+ *     frame duration was requested.
+ */
+static int guac_audio_parse_frame_duration(const char* declared) {
+
+    const char* parameter = strchr(declared, ';');
+    while (parameter != NULL) {
+
+        parameter++;
+
+        if (strncmp(parameter, GUAC_AUDIO_FRAME_DURATION_PARAMETER,
+                    strlen(GUAC_AUDIO_FRAME_DURATION_PARAMETER)) == 0) {
+            int duration = atoi(parameter + strlen(GUAC_AUDIO_FRAME_DURATION_PARAMETER));
+            return duration > 0 ? duration : 0;
+        }
+
+        parameter = strchr(parameter, ',');
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Searches the audio mimetypes declared by the given user for the mimetype of
+ * the given audio encoder, ignoring any parameters included with the declared
+ * mimetypes.
+ *
+ * @param user
+ *     The user whose supported audio mimetypes should be checked.
+ *
+ * @param encoder
+ *     The audio encoder whose mimetype should be checked.
+ *
+ * @return
+ *     The matching mimetype declared by the user, including any parameters,
+ *     or NULL if the user has not declared support for the mimetype of the
+ *     given audio encoder.
+ */
+static const char* guac_audio_user_supports(guac_user* user,
+        guac_audio_encoder* encoder) {
+
+    size_t length = strlen(encoder->mimetype);
+
+    for (int i = 0; user->info.audio_mimetypes[i] != NULL; i++) {
+
+        const char* declared = user->info.audio_mimetypes[i];
+        if (strncmp(declared, encoder->mimetype, length) == 0
+                && (declared[length] == '\0' || declared[length] == ';'))
+            return declared;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Sets the encoder associated with the given guac_audio_stream if the given
+ * user has declared support for that encoder, applying any frame duration
+ * requested by the user alongside that declaration. The guac_audio_stream
+ * MUST NOT already be associated with an encoder.
+ *
+ * @param user
+ *     The user whose supported audio mimetypes should be checked.
+ *
+ * @param audio
+ *     The guac_audio_stream whose encoder is being set.
+ *
+ * @param encoder
+ *     The encoder to associate with the given guac_audio_stream if supported
+ *     by the given user.
+ *
+ * @return
+ *     Non-zero if the encoder was set, zero if the given user has not
+ *     declared support for the given encoder.
+ */
+static int guac_audio_stream_set_user_encoder(guac_user* user,
+        guac_audio_stream* audio, guac_audio_encoder* encoder) {
+
+    const char* declared = guac_audio_user_supports(user, encoder);
+    if (declared == NULL)
+        return 0;
+
+    /* The duration must be known before the encoder begins */
+    audio->hinted_frame_duration = guac_audio_parse_frame_duration(declared);
+    guac_audio_stream_set_encoder(audio, encoder);
+
+    return 1;
+
+}
+
 /**
  * Assigns a new audio encoder to the given guac_audio_stream based on the
  * audio mimetypes declared as supported by the given user. If no audio encoder
@@ -74,8 +190,6 @@ static void guac_audio_stream_set_encoder(guac_audio_stream* audio,
  */
 static void* guac_audio_assign_encoder(guac_user* user, void* data) {
 
-    int i;
-
     guac_audio_stream* audio = (guac_audio_stream*) data;
     int bps = audio->bps;
 
@@ -84,24 +198,25 @@ static void* guac_audio_assign_encoder(guac_user* user, void* data) {
     if (user == NULL || audio->encoder != NULL)
         return audio->encoder;
 
-    /* For each supported mimetype, check for an associated encoder */
-    for (i=0; user->info.audio_mimetypes[i] != NULL; i++) {
-
-        const char* mimetype = user->info.audio_mimetypes[i];
-
-        /* If 16-bit raw audio is supported, done. */
-        if (bps == 16 && strcmp(mimetype, raw16_encoder->mimetype) == 0) {
-            guac_audio_stream_set_encoder(audio, raw16_encoder);
-            break;
-        }
+    /* Prefer compressed audio over raw PCM regardless of the order the user
+     * declared its supported mimetypes, as compressed audio requires only a
+     * fraction of the bandwidth. Opus is preferred over Ogg Vorbis for its
+     * lower latency. */
+#ifdef ENABLE_OPUS
+    if (guac_audio_stream_set_user_encoder(user, audio, opus_encoder))
+        return audio->encoder;
+#endif
 
-        /* If 8-bit raw audio is supported, done. */
-        if (bps == 8 && strcmp(mimetype, raw8_encoder->mimetype) == 0) {
-            guac_audio_stream_set_encoder(audio, raw8_encoder);
-            break;
-        }
+#ifdef ENABLE_OGG
+    if (guac_audio_stream_set_user_encoder(user, audio, ogg_encoder))
+        return audio->encoder;
+#endif
 
-    } /* end for each mimetype */
+    /* Fall back to raw audio of the same bits per sample, if supported */
+    if (bps == 16)
+        guac_audio_stream_set_user_encoder(user, audio, raw16_encoder);
+    else if (bps == 8)
+        guac_audio_stream_set_user_encoder(user, audio, raw8_encoder);
 
     /* Return assigned encoder, if any */
     return audio->encoder;
@@ -124,6 +239,9 @@ guac_audio_stream* guac_audio_stream_alloc(guac_client* client,
         return NULL;
     }
 
+    /* Audio must not delay display updates */
+    audio->stream->priority = GUAC_SOCKET_PRIORITY_AUDIO;
+
     /* Load PCM properties */
     audio->rate = rate;
     audio->channels = channels;
@@ -36,6 +36,8 @@
 #include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 #include "id.h"
+#include "probe.h"
+#include "socket-queue.h"
 
 #include <dlfcn.h>
 #include <errno.h>
@@ -53,12 +55,37 @@
  */
 #define GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL 250
 
+/**
+ * The number of milliseconds that must elapse without any further users
+ * joining before pending users are promoted, such that a burst of users
+ * joining at once is synchronized with a single copy of the connection state
+ * rather than one copy for each refresh interval spanned by the burst.
+ */
+#define GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL 50
+
+/**
+ * The maximum number of milliseconds that promotion of any pending user may
+ * be deferred while waiting for further users to stop joining.
+ */
+#define GUAC_CLIENT_PENDING_USERS_MAX_DEFERRAL 500
+
+/**
+ * The number of milliseconds between each log message describing the memory
+ * accounted to each category by the current process (60 seconds).
+ */
+#define GUAC_CLIENT_MEMORY_LOG_INTERVAL 60000
+
 /**
  * A value that indicates that the pending users timer has yet to be
  * initialized and started.
  */
 #define GUAC_CLIENT_PENDING_TIMER_UNREGISTERED 0
 
+/**
+ * The smallest number of slots to allocate for the index of connected users.
+ */
+#define GUAC_CLIENT_USER_INDEX_MIN_SIZE 16
+
 /**
  * A value that indicates that the pending users timer has been initialized
  * and started, but that the timer handler is not currently running.
@@ -114,6 +141,12 @@ void guac_client_free_buffer(guac_client* client, guac_layer* layer) {
 
 void guac_client_free_layer(guac_client* client, guac_layer* layer) {
 
+    /* Views of the display from before this point may still contain the
+     * layer, and so can no longer be resumed */
+    pthread_mutex_lock(&(client->__resume_tokens_lock));
+    client->__layers_freed = guac_timestamp_current();
+    pthread_mutex_unlock(&(client->__resume_tokens_lock));
+
     /* Release index to pool */
     guac_pool_free_int(client->__layer_pool, layer->index);
 
@@ -138,31 +171,403 @@ guac_stream* guac_client_alloc_stream(guac_client* client) {
     allocd_stream->data = NULL;
     allocd_stream->ack_handler = NULL;
     allocd_stream->blob_handler = NULL;
+    allocd_stream->base64_blob_handler = NULL;
     allocd_stream->end_handler = NULL;
+    allocd_stream->priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
 
     return allocd_stream;
 
 }
 
+/**
+ * Callback for guac_client_foreach_user() which delivers all data queued for
+ * the given user before any data subsequently written, regardless of
+ * priority.
+ *
+ * @param user
+ *     The user whose queued data should be promoted.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_client_promote_queued_callback(guac_user* user,
+        void* data) {
+
+    if (guac_socket_is_queued(user->socket))
+        guac_socket_queue_promote(user->socket);
+
+    return NULL;
+
+}
+
 void guac_client_free_stream(guac_client* client, guac_stream* stream) {
 
     /* Mark stream as closed */
     int freed_index = stream->index;
     stream->index = GUAC_CLIENT_CLOSED_STREAM_INDEX;
 
+    /* Deliver anything still queued for a lower-priority stream before any
+     * data that may be sent along a new stream reusing the same index */
+    if (stream->priority != GUAC_SOCKET_PRIORITY_INTERACTIVE)
+        guac_client_foreach_user(client, guac_client_promote_queued_callback,
+                NULL);
+
     /* Release index to pool */
     guac_pool_free_int(client->__stream_pool, (freed_index - 1) / 2);
 
 }
 
+/**
+ * Returns the slot within the index of connected users at which a search for
+ * the given user should begin.
+ *
+ * @param client
+ *     The guac_client whose index of connected users is being searched. The
+ *     index must have at least one slot.
+ *
+ * @param user
+ *     The user being searched for.
+ *
+ * @return
+ *     The slot at which a search for the given user should begin.
+ */
+static int guac_client_user_index_slot(guac_client* client, guac_user* user) {
+
+    /* Mix bits of the address, as the low bits of heap allocations vary
+     * little */
+    uint64_t hash = (uint64_t) (uintptr_t) user;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+
+    return (int) (hash & (client->__user_index_size - 1));
+
+}
+
+/**
+ * Stores the given user within the index of connected users, which must
+ * have room for at least one more user. The __users_lock must be held for
+ * writing.
+ *
+ * @param client
+ *     The guac_client whose index of connected users should be updated.
+ *
+ * @param user
+ *     The user to store.
+ */
+static void guac_client_user_index_store(guac_client* client, guac_user* user) {
+
+    int mask = client->__user_index_size - 1;
+    int slot = guac_client_user_index_slot(client, user);
+
+    while (client->__user_index[slot] != NULL) {
+        if (client->__user_index[slot] == user)
+            return;
+        slot = (slot + 1) & mask;
+    }
+
+    client->__user_index[slot] = user;
+    client->__user_index_length++;
+
+}
+
+/**
+ * Adds the given user to the index of connected users, growing the index as
+ * needed such that it is never more than half full. The __users_lock must be
+ * held for writing.
+ *
+ * @param client
+ *     The guac_client whose index of connected users should be updated.
+ *
+ * @param user
+ *     The user to add.
+ */
+static void guac_client_user_index_add(guac_client* client, guac_user* user) {
+
+    /* Grow (or allocate) index if adding the user would leave it more than
+     * half full */
+    if ((client->__user_index_length + 1) * 2 > client->__user_index_size) {
+
+        guac_user** old_index = client->__user_index;
+        int old_size = client->__user_index_size;
+
+        int new_size = old_size ? old_size * 2 : GUAC_CLIENT_USER_INDEX_MIN_SIZE;
+        client->__user_index = guac_mem_zalloc(sizeof(guac_user*), new_size);
+        client->__user_index_size = new_size;
+        client->__user_index_length = 0;
+
+        /* Re-add all existing users */
+        for (int i = 0; i < old_size; i++) {
+            if (old_index[i] != NULL)
+                guac_client_user_index_store(client, old_index[i]);
+        }
+
+        guac_mem_free(old_index);
+
+    }
+
+    guac_client_user_index_store(client, user);
+
+}
+
+/**
+ * Removes the given user from the index of connected users, if present. The
+ * __users_lock must be held for writing.
+ *
+ * @param client
+ *     The guac_client whose index of connected users should be updated.
+ *
+ * @param user
+ *     The user to remove.
+ */
+static void guac_client_user_index_remove(guac_client* client, guac_user* user) {
+
+    if (client->__user_index_size == 0)
+        return;
+
+    int mask = client->__user_index_size - 1;
+    int slot = guac_client_user_index_slot(client, user);
+
+    /* Locate user, if present */
+    while (client->__user_index[slot] != user) {
+        if (client->__user_index[slot] == NULL)
+            return;
+        slot = (slot + 1) & mask;
+    }
+
+    client->__user_index[slot] = NULL;
+    client->__user_index_length--;
+
+    /* Shift back any following users in the same run whose searches would
+     * otherwise stop at the newly-empty slot */
+    int empty = slot;
+    for (slot = (slot + 1) & mask; client->__user_index[slot] != NULL;
+            slot = (slot + 1) & mask) {
+
+        int home = guac_client_user_index_slot(client,
+                client->__user_index[slot]);
+
+        /* Move only if the empty slot lies between the home slot of this
+         * user and its current slot (cyclically) */
+        if (((slot - home) & mask) >= ((slot - empty) & mask)) {
+            client->__user_index[empty] = client->__user_index[slot];
+            client->__user_index[slot] = NULL;
+            empty = slot;
+        }
+
+    }
+
+}
+
+/**
+ * Returns whether the given user is present within the index of connected
+ * users. The __users_lock must be held.
+ *
+ * @param client
+ *     The guac_client whose index of connected users should be searched.
+ *
+ * @param user
+ *     The user to search for. This pointer is never dereferenced, and need
+ *     not point to a valid user.
+ *
+ * @return
+ *     Non-zero if the given user is connected, zero otherwise.
+ */
+static int guac_client_user_index_contains(guac_client* client, guac_user* user) {
+
+    if (client->__user_index_size == 0 || user == NULL)
+        return 0;
+
+    int mask = client->__user_index_size - 1;
+    int slot = guac_client_user_index_slot(client, user);
+
+    while (client->__user_index[slot] != NULL) {
+        if (client->__user_index[slot] == user)
+            return 1;
+        slot = (slot + 1) & mask;
+    }
+
+    return 0;
+
+}
+
+/**
+ * An immutable array of all users connected to a guac_client at a particular
+ * point in time, in the same order as the list of connected users. Snapshots
+ * are replaced whenever users join or leave, allowing the users of a
+ * guac_client to be iterated without holding __users_lock.
+ */
+typedef struct guac_client_user_snapshot {
+
+    /**
+     * The number of references to this snapshot, including the reference
+     * held by the guac_client while this is the current snapshot. This must
+     * only be accessed while holding the __user_snapshot_lock of the
+     * guac_client.
+     */
+    unsigned int refcount;
+
+    /**
+     * The number of users within the users array.
+     */
+    int length;
+
+    /**
+     * All users connected at the time this snapshot was created.
+     */
+    guac_user* users[];
+
+} guac_client_user_snapshot;
+
+/**
+ * Replaces the current snapshot of connected users of the given guac_client
+ * with a new snapshot reflecting the current contents of the list of
+ * connected users. The __users_lock must be held for writing. The previous
+ * snapshot, if any, is returned and must be passed to
+ * guac_client_release_user_snapshot() or
+ * guac_client_retire_user_snapshot().
+ *
+ * @param client
+ *     The guac_client whose snapshot of connected users should be replaced.
+ *
+ * @return
+ *     The previous snapshot of connected users, or NULL if there was none.
+ */
+static guac_client_user_snapshot* guac_client_rebuild_user_snapshot(
+        guac_client* client) {
+
+    /* Count connected users */
+    int length = 0;
+    for (guac_user* user = client->__users; user != NULL; user = user->__next)
+        length++;
+
+    guac_client_user_snapshot* snapshot = guac_mem_alloc(
+            sizeof(guac_client_user_snapshot)
+            + sizeof(guac_user*) * length);
+
+    snapshot->refcount = 1;
+    snapshot->length = 0;
+
+    for (guac_user* user = client->__users; user != NULL; user = user->__next)
+        snapshot->users[snapshot->length++] = user;
+
+    /* Publish new snapshot */
+    pthread_mutex_lock(&(client->__user_snapshot_lock));
+    guac_client_user_snapshot* old_snapshot = client->__user_snapshot;
+    client->__user_snapshot = snapshot;
+    pthread_mutex_unlock(&(client->__user_snapshot_lock));
+
+    return old_snapshot;
+
+}
+
+/**
+ * Acquires a reference to the current snapshot of connected users of the
+ * given guac_client. The reference must be released with
+ * guac_client_release_user_snapshot() once the snapshot is no longer needed.
+ * All users within the snapshot remain valid until then.
+ *
+ * @param client
+ *     The guac_client whose current snapshot of connected users should be
+ *     acquired.
+ *
+ * @return
+ *     The current snapshot of connected users, or NULL if no users have yet
+ *     connected.
+ */
+static guac_client_user_snapshot* guac_client_acquire_user_snapshot(
+        guac_client* client) {
+
+    pthread_mutex_lock(&(client->__user_snapshot_lock));
+
+    guac_client_user_snapshot* snapshot = client->__user_snapshot;
+    if (snapshot != NULL)
+        snapshot->refcount++;
+
+    pthread_mutex_unlock(&(client->__user_snapshot_lock));
+    return snapshot;
+
+}
+
+/**
+ * Releases a reference to the given snapshot of connected users, freeing the
+ * snapshot if no references remain.
+ *
+ * @param client
+ *     The guac_client that the snapshot was acquired from.
+ *
+ * @param snapshot
+ *     The snapshot to release, or NULL to do nothing.
+ */
+static void guac_client_release_user_snapshot(guac_client* client,
+        guac_client_user_snapshot* snapshot) {
+
+    if (snapshot == NULL)
+        return;
+
+    pthread_mutex_lock(&(client->__user_snapshot_lock));
+
+    if (--snapshot->refcount == 0)
+        guac_mem_free(snapshot);
+    else
+        pthread_cond_broadcast(&(client->__user_snapshot_released));
+
+    pthread_mutex_unlock(&(client->__user_snapshot_lock));
+
+}
+
+/**
+ * Releases the reference held by the guac_client to a snapshot of connected
+ * users which has been replaced, waiting until all other references have
+ * been released. Once this function returns, no thread may still be
+ * iterating the users within that snapshot, and any user which is not part of
+ * the current snapshot may be safely freed. This function must not be
+ * invoked while holding __users_lock, as threads iterating the snapshot may
+ * themselves require that lock.
+ *
+ * @param client
+ *     The guac_client that the snapshot belonged to.
+ *
+ * @param snapshot
+ *     The replaced snapshot to retire, or NULL to do nothing.
+ */
+static void guac_client_retire_user_snapshot(guac_client* client,
+        guac_client_user_snapshot* snapshot) {
+
+    if (snapshot == NULL)
+        return;
+
+    pthread_mutex_lock(&(client->__user_snapshot_lock));
+
+    while (snapshot->refcount > 1)
+        pthread_cond_wait(&(client->__user_snapshot_released),
+                &(client->__user_snapshot_lock));
+
+    guac_mem_free(snapshot);
+
+    pthread_mutex_unlock(&(client->__user_snapshot_lock));
+
+}
+
 /**
  * Promote all pending users to full users, calling the join pending handler
- * before, if any.
+ * before, if any. Promotion is deferred while users are still actively
+ * joining (see GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL), such that all users
+ * within a burst of joins are promoted together.
  *
  * @param client
  *     The client for which all pending users should be promoted.
+ *
+ * @return
+ *     The number of milliseconds to wait before pending users should next be
+ *     checked for promotion.
  */
-static void guac_client_promote_pending_users(guac_client* client) {
+static int guac_client_promote_pending_users(guac_client* client) {
+
+    int next_check = GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL;
 
     /* Acquire the lock for reading and modifying the list of pending users */
     guac_rwlock_acquire_write_lock(&(client->__pending_users_lock));
@@ -171,6 +576,16 @@ static void guac_client_promote_pending_users(guac_client* client) {
     if (client->__pending_users == NULL)
         goto promotion_complete;
 
+    /* Wait for any burst of joining users to settle, up to a point */
+    guac_timestamp now = guac_timestamp_current_coarse();
+    if (now - client->__pending_users_last_joined
+                < GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL
+            && now - client->__pending_users_first_joined
+                < GUAC_CLIENT_PENDING_USERS_MAX_DEFERRAL) {
+        next_check = GUAC_CLIENT_PENDING_USERS_SETTLE_INTERVAL;
+        goto promotion_complete;
+    }
+
     /* Run the pending join handler, if one is defined */
     if (client->join_pending_handler) {
 
@@ -215,6 +630,15 @@ static void guac_client_promote_pending_users(guac_client* client) {
         last_user->__next = client->__users;
         client->__users = first_user;
 
+        /* Index all formerly-pending users */
+        for (user = first_user; user != last_user->__next; user = user->__next)
+            guac_client_user_index_add(client, user);
+
+        /* No user has been removed, thus threads still iterating the
+         * previous snapshot may simply continue to do so */
+        guac_client_release_user_snapshot(client,
+                guac_client_rebuild_user_snapshot(client));
+
     }
 
     guac_rwlock_release_lock(&(client->__users_lock));
@@ -225,12 +649,42 @@ promotion_complete:
      * to ensure that all users are always on exactly one of these lists) */
     guac_rwlock_release_lock(&(client->__pending_users_lock));
 
+    return next_check;
+
+}
+
+/**
+ * Logs the number of bytes of memory currently accounted to each category by
+ * the current process (see guac_mem_get_process_stats()), which is the memory
+ * of the given guac_client when running within a guacd connection process.
+ *
+ * @param client
+ *     The client to log the memory of.
+ */
+static void guac_client_log_memory(guac_client* client) {
+
+    guac_mem_stats stats;
+    guac_mem_get_process_stats(&stats);
+
+    char message[256];
+    int length = 0;
+
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT
+            && length < (int) sizeof(message); i++) {
+        length += snprintf(message + length, sizeof(message) - length,
+                "%s%s=%" PRIu64 "KiB", i ? ", " : "",
+                guac_mem_category_name(i), stats.bytes[i] / 1024);
+    }
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Memory usage: %s", message);
+
 }
 
 /**
  * Thread that periodically checks for users that have requested to join the
- * current connection (pending users). The check is performed every
- * GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL milliseconds.
+ * current connection (pending users), and that periodically logs the memory
+ * usage of the connection (see GUAC_CLIENT_MEMORY_LOG_INTERVAL). The check is
+ * performed every GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL milliseconds.
  *
  * @param data
  *     A pointer to the guac_client associated with the connection.
@@ -241,10 +695,20 @@ promotion_complete:
 static void* guac_client_pending_users_thread(void* data) {
 
     guac_client* client = (guac_client*) data;
+    guac_timestamp memory_logged = guac_timestamp_current_coarse();
 
     while (client->state == GUAC_CLIENT_RUNNING) {
-        guac_client_promote_pending_users(client);
-        guac_timestamp_msleep(GUAC_CLIENT_PENDING_USERS_REFRESH_INTERVAL);
+
+        int next_check = guac_client_promote_pending_users(client);
+
+        guac_timestamp now = guac_timestamp_current_coarse();
+        if (now - memory_logged >= GUAC_CLIENT_MEMORY_LOG_INTERVAL) {
+            guac_client_log_memory(client);
+            memory_logged = now;
+        }
+
+        guac_timestamp_msleep(next_check);
+
     }
 
     return NULL;
@@ -286,15 +750,26 @@ guac_client* guac_client_alloc() {
 
     /* Initialize streams */
     client->__output_streams = guac_mem_alloc(sizeof(guac_stream), GUAC_CLIENT_MAX_STREAMS);
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_STREAM,
+            guac_mem_ckd_mul_or_die(sizeof(guac_stream), GUAC_CLIENT_MAX_STREAMS));
 
     for (i=0; i<GUAC_CLIENT_MAX_STREAMS; i++) {
         client->__output_streams[i].index = GUAC_CLIENT_CLOSED_STREAM_INDEX;
+        client->__output_streams[i].priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
     }
 
     /* Init locks */
     guac_rwlock_init(&(client->__users_lock));
     guac_rwlock_init(&(client->__pending_users_lock));
 
+    pthread_mutex_init(&(client->__user_snapshot_lock), NULL);
+    pthread_cond_init(&(client->__user_snapshot_released), NULL);
+    pthread_mutex_init(&(client->__startup_lock), NULL);
+    pthread_mutex_init(&(client->__resume_tokens_lock), NULL);
+
+    /* All startup phases are timed from allocation */
+    client->__startup_start = client->__startup_last = client->last_sent_timestamp;
+
     /* Set up broadcast sockets */
     client->socket = guac_socket_broadcast(client);
     client->pending_socket = guac_socket_broadcast_pending(client);
@@ -303,27 +778,252 @@ guac_client* guac_client_alloc() {
 
 }
 
+/**
+ * Removes the given user from the list of pending users or the list of
+ * connected users of the given guac_client, whichever contains that user. If
+ * the user was connected, the snapshot of connected users is rebuilt and the
+ * previous snapshot returned, and must be passed to
+ * guac_client_release_user_snapshot() or
+ * guac_client_retire_user_snapshot(). The leave handlers for the user are not
+ * invoked by this function.
+ *
+ * @param client
+ *     The guac_client to remove the user from.
+ *
+ * @param user
+ *     The user to remove.
+ *
+ * @return
+ *     The snapshot of connected users that was replaced due to the removal of
+ *     the user, or NULL if no snapshot was replaced.
+ */
+static guac_client_user_snapshot* guac_client_unlink_user(guac_client* client,
+        guac_user* user) {
+
+    guac_client_user_snapshot* old_snapshot = NULL;
+
+    guac_rwlock_acquire_write_lock(&(client->__pending_users_lock));
+    guac_rwlock_acquire_write_lock(&(client->__users_lock));
+
+    int connected = guac_client_user_index_contains(client, user);
+
+    /* Update prev / head */
+    if (user->__prev != NULL)
+        user->__prev->__next = user->__next;
+    else if (client->__users == user)
+        client->__users = user->__next;
+    else if (client->__pending_users == user)
+        client->__pending_users = user->__next;
+
+    /* Update next */
+    if (user->__next != NULL)
+        user->__next->__prev = user->__prev;
+
+    guac_client_user_index_remove(client, user);
+
+    if (connected)
+        old_snapshot = guac_client_rebuild_user_snapshot(client);
+
+    client->connected_users--;
+
+    /* Update owner pointer if user was owner */
+    if (user->owner)
+        client->__owner = NULL;
+
+    guac_rwlock_release_lock(&(client->__users_lock));
+    guac_rwlock_release_lock(&(client->__pending_users_lock));
+
+    return old_snapshot;
+
+}
+
+/**
+ * A resume token issued to a user that has since left the connection (see
+ * guac_client_issue_resume_token()).
+ */
+typedef struct guac_client_resume_token {
+
+    /**
+     * The resume token, or NULL if this entry is unused.
+     */
+    char* token;
+
+    /**
+     * The value of the last_sent_timestamp of the guac_client at the time the
+     * token was issued.
+     */
+    guac_timestamp issued;
+
+    /**
+     * The time after which the token may no longer be claimed.
+     */
+    guac_timestamp expires;
+
+} guac_client_resume_token;
+
+/**
+ * Takes ownership of the resume token of the given user, if any, such that it
+ * may be claimed by a user rejoining the connection until it expires. If the
+ * maximum number of tokens are already retained, the token closest to
+ * expiring is discarded.
+ *
+ * @param client
+ *     The client that the user is leaving.
+ *
+ * @param user
+ *     The user that is leaving.
+ */
+static void guac_client_retain_resume_token(guac_client* client,
+        guac_user* user) {
+
+    if (user->__resume_token == NULL)
+        return;
+
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&(client->__resume_tokens_lock));
+
+    if (client->__resume_tokens == NULL)
+        client->__resume_tokens = guac_mem_zalloc(sizeof(guac_client_resume_token),
+                GUAC_CLIENT_MAX_RESUME_TOKENS);
+
+    /* Reuse the first unused or expired entry, falling back to the entry
+     * that is closest to expiring */
+    guac_client_resume_token* entry = client->__resume_tokens;
+    for (int i = 0; i < GUAC_CLIENT_MAX_RESUME_TOKENS; i++) {
+
+        guac_client_resume_token* current = &(client->__resume_tokens[i]);
+        if (current->token == NULL || current->expires <= now) {
+            entry = current;
+            break;
+        }
+
+        if (current->expires < entry->expires)
+            entry = current;
+
+    }
+
+    guac_mem_free(entry->token);
+    entry->token = user->__resume_token;
+    entry->issued = user->__resume_issued;
+    entry->expires = now + GUAC_CLIENT_RESUME_TOKEN_TIMEOUT;
+
+    user->__resume_token = NULL;
+
+    pthread_mutex_unlock(&(client->__resume_tokens_lock));
+
+}
+
+const char* guac_client_issue_resume_token(guac_client* client,
+        guac_user* user) {
+
+    pthread_mutex_lock(&(client->__resume_tokens_lock));
+
+    if (user->__resume_token == NULL) {
+        user->__resume_token = guac_generate_id(GUAC_CLIENT_RESUME_TOKEN_PREFIX);
+        user->__resume_issued = client->last_sent_timestamp;
+    }
+
+    pthread_mutex_unlock(&(client->__resume_tokens_lock));
+
+    return user->__resume_token;
+
+}
+
+guac_timestamp guac_client_claim_resume_token(guac_client* client,
+        const char* token, guac_timestamp timestamp) {
+
+    guac_timestamp resumed = 0;
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&(client->__resume_tokens_lock));
+
+    for (int i = 0; client->__resume_tokens != NULL
+            && i < GUAC_CLIENT_MAX_RESUME_TOKENS; i++) {
+
+        guac_client_resume_token* current = &(client->__resume_tokens[i]);
+        if (current->token == NULL || strcmp(current->token, token) != 0)
+            continue;
+
+        /* The frame being resumed from must have been sent while the token
+         * was held, and must not contain any layers freed since */
+        if (current->expires > now && timestamp >= current->issued
+                && timestamp <= client->last_sent_timestamp
+                && timestamp > client->__layers_freed)
+            resumed = timestamp;
+
+        /* Each token may be claimed only once */
+        guac_mem_free(current->token);
+        break;
+
+    }
+
+    pthread_mutex_unlock(&(client->__resume_tokens_lock));
+
+    return resumed;
+
+}
+
+/**
+ * Notifies the owner of the given guac_client that the given user has left,
+ * and invokes the leave handler of that user, if any, or the leave handler
+ * of the guac_client otherwise.
+ *
+ * @param client
+ *     The guac_client that the user has left.
+ *
+ * @param user
+ *     The user that has left.
+ */
+static void guac_client_user_left(guac_client* client, guac_user* user) {
+
+    /* Update owner of user having left the connection. */
+    if (!user->owner)
+        guac_client_owner_notify_leave(client, user);
+
+    /* Call handler, if defined */
+    if (user->leave_handler)
+        user->leave_handler(user);
+    else if (client->leave_handler)
+        client->leave_handler(user);
+
+    /* Allow the view of the user to be resumed if they rejoin shortly */
+    guac_client_retain_resume_token(client, user);
+
+}
+
 void guac_client_free(guac_client* client) {
 
     /* Ensure that anything waiting for the client can begin shutting down */
     guac_client_stop(client);
 
+    /* Clean up the thread monitoring for new pending users, if it's been
+     * started. This must be done before acquiring the user locks, as that
+     * thread may be waiting to acquire the pending users lock itself before
+     * it next checks whether the client is still running. */
+    if (client->__pending_users_thread_started)
+        pthread_join(client->__pending_users_thread, NULL);
+
     /* Acquire write locks before referencing user pointers */
     guac_rwlock_acquire_write_lock(&(client->__pending_users_lock));
     guac_rwlock_acquire_write_lock(&(client->__users_lock));
 
     /* Remove all pending users */
-    while (client->__pending_users != NULL)
-        guac_client_remove_user(client, client->__pending_users);
-
-    /* Remove all users */
-    while (client->__users != NULL)
-        guac_client_remove_user(client, client->__users);
+    while (client->__pending_users != NULL) {
+        guac_user* user = client->__pending_users;
+        guac_client_unlink_user(client, user);
+        guac_client_user_left(client, user);
+    }
 
-    /* Clean up the thread monitoring for new pending users, if it's been
-     * started */
-    if (client->__pending_users_thread_started)
-        pthread_join(client->__pending_users_thread, NULL);
+    /* Remove all users (threads iterating any previous snapshot cannot be
+     * waited for here, as the user locks are held, but any such threads are
+     * stopped by the free handler before the final snapshot is freed) */
+    while (client->__users != NULL) {
+        guac_user* user = client->__users;
+        guac_client_release_user_snapshot(client,
+                guac_client_unlink_user(client, user));
+        guac_client_user_left(client, user);
+    }
 
     /* Release the locks */
     guac_rwlock_release_lock(&(client->__users_lock));
@@ -346,10 +1046,23 @@ void guac_client_free(guac_client* client) {
 
     /* Free streams */
     guac_mem_free(client->__output_streams);
+    guac_mem_account_free(GUAC_MEM_CATEGORY_STREAM,
+            guac_mem_ckd_mul_or_die(sizeof(guac_stream), GUAC_CLIENT_MAX_STREAMS));
+
+    /* Free index and final snapshot of connected users */
+    guac_mem_free(client->__user_index);
+    guac_mem_free(client->__user_snapshot);
 
     /* Free stream pool */
     guac_pool_free(client->__stream_pool);
 
+    /* Free any unclaimed resume tokens */
+    if (client->__resume_tokens != NULL) {
+        for (int i = 0; i < GUAC_CLIENT_MAX_RESUME_TOKENS; i++)
+            guac_mem_free(client->__resume_tokens[i].token);
+        guac_mem_free(client->__resume_tokens);
+    }
+
     /* Close associated plugin */
     if (client->__plugin_handle != NULL) {
         if (dlclose(client->__plugin_handle))
@@ -359,6 +1072,11 @@ void guac_client_free(guac_client* client) {
     /* Destroy the reentrant read-write locks */
     guac_rwlock_destroy(&(client->__users_lock));
     guac_rwlock_destroy(&(client->__pending_users_lock));
+    pthread_mutex_destroy(&(client->__startup_lock));
+    pthread_mutex_destroy(&(client->__resume_tokens_lock));
+
+    pthread_cond_destroy(&(client->__user_snapshot_released));
+    pthread_mutex_destroy(&(client->__user_snapshot_lock));
 
     guac_mem_free(client->connection_id);
     guac_mem_free(client);
@@ -385,6 +1103,52 @@ void guac_client_log(guac_client* client, guac_client_log_level level,
 
 }
 
+void guac_client_startup_phase(guac_client* client, const char* phase) {
+
+    pthread_mutex_lock(&(client->__startup_lock));
+
+    if (!client->__startup_complete) {
+
+        guac_timestamp now = guac_timestamp_current();
+
+        /* Append "NAME=DURATIONms", separating each phase with a space */
+        size_t length = strlen(client->__startup_phases);
+        size_t remaining = sizeof(client->__startup_phases) - length;
+        int written = snprintf(client->__startup_phases + length, remaining,
+                "%s%s=%" PRId64 "ms", length ? " " : "", phase,
+                (int64_t) (now - client->__startup_last));
+
+        /* Drop any phase that does not fit in its entirety */
+        if (written < 0 || (size_t) written >= remaining)
+            client->__startup_phases[length] = '\0';
+
+        client->__startup_last = now;
+
+    }
+
+    pthread_mutex_unlock(&(client->__startup_lock));
+
+}
+
+void guac_client_startup_complete(guac_client* client) {
+
+    pthread_mutex_lock(&(client->__startup_lock));
+
+    if (!client->__startup_complete) {
+
+        client->__startup_complete = 1;
+
+        guac_timestamp total = guac_timestamp_current() - client->__startup_start;
+        guac_client_log(client, GUAC_LOG_INFO, "Connection startup: %s%s"
+                "total=%" PRId64 "ms", client->__startup_phases,
+                client->__startup_phases[0] ? " " : "", (int64_t) total);
+
+    }
+
+    pthread_mutex_unlock(&(client->__startup_lock));
+
+}
+
 void guac_client_stop(guac_client* client) {
     client->state = GUAC_CLIENT_STOPPING;
 }
@@ -446,6 +1210,12 @@ static void guac_client_add_pending_user(guac_client* client,
         client->__pending_users_thread_started = 1;
     }
 
+    /* Track the window of time over which pending users have joined */
+    guac_timestamp now = guac_timestamp_current_coarse();
+    if (client->__pending_users == NULL)
+        client->__pending_users_first_joined = now;
+    client->__pending_users_last_joined = now;
+
     user->__prev = NULL;
     user->__next = client->__pending_users;
 
@@ -488,62 +1258,35 @@ int guac_client_add_user(guac_client* client, guac_user* user, int argc, char**
     if (retval == 0 && !user->owner)
         guac_client_owner_notify_join(client, user);
 
+    GUAC_PROBE3(client_add_user, client->connection_id, user->user_id, retval);
     return retval;
 
 }
 
 void guac_client_remove_user(guac_client* client, guac_user* user) {
 
-    guac_rwlock_acquire_write_lock(&(client->__pending_users_lock));
-    guac_rwlock_acquire_write_lock(&(client->__users_lock));
-
-    /* Update prev / head */
-    if (user->__prev != NULL)
-        user->__prev->__next = user->__next;
-    else if (client->__users == user)
-        client->__users = user->__next;
-    else if (client->__pending_users == user)
-        client->__pending_users = user->__next;
-
-    /* Update next */
-    if (user->__next != NULL)
-        user->__next->__prev = user->__prev;
-
-    client->connected_users--;
-
-    /* Update owner pointer if user was owner */
-    if (user->owner)
-        client->__owner = NULL;
-
-    guac_rwlock_release_lock(&(client->__users_lock));
-    guac_rwlock_release_lock(&(client->__pending_users_lock));
-
-    /* Update owner of user having left the connection. */
-    if (!user->owner)
-        guac_client_owner_notify_leave(client, user);
+    /* Wait for any threads still iterating the user (this must be done only
+     * after the user locks have been released, as those threads may
+     * themselves need to acquire those locks) */
+    guac_client_retire_user_snapshot(client,
+            guac_client_unlink_user(client, user));
 
-    /* Call handler, if defined */
-    if (user->leave_handler)
-        user->leave_handler(user);
-    else if (client->leave_handler)
-        client->leave_handler(user);
+    guac_client_user_left(client, user);
+    GUAC_PROBE2(client_remove_user, client->connection_id, user->user_id);
 
 }
 
 void guac_client_foreach_user(guac_client* client, guac_user_callback* callback, void* data) {
 
-    guac_user* current;
-
-    guac_rwlock_acquire_read_lock(&(client->__users_lock));
+    guac_client_user_snapshot* snapshot = guac_client_acquire_user_snapshot(client);
+    if (snapshot == NULL)
+        return;
 
     /* Call function on each user */
-    current = client->__users;
-    while (current != NULL) {
-        callback(current, data);
-        current = current->__next;
-    }
+    for (int i = 0; i < snapshot->length; i++)
+        callback(snapshot->users[i], data);
 
-    guac_rwlock_release_lock(&(client->__users_lock));
+    guac_client_release_user_snapshot(client, snapshot);
 
 }
 
@@ -585,28 +1328,12 @@ void* guac_client_for_owner(guac_client* client, guac_user_callback* callback,
 void* guac_client_for_user(guac_client* client, guac_user* user,
         guac_user_callback* callback, void* data) {
 
-    guac_user* current;
-
-    int user_valid = 0;
     void* retval;
 
     guac_rwlock_acquire_read_lock(&(client->__users_lock));
 
-    /* Loop through all users, searching for a pointer to the given user */
-    current = client->__users;
-    while (current != NULL) {
-
-        /* If the user's pointer exists in the list, they are indeed valid */
-        if (current == user) {
-            user_valid = 1;
-            break;
-        }
-
-        current = current->__next;
-    }
-
     /* Use NULL if user does not actually exist */
-    if (!user_valid)
+    if (!guac_client_user_index_contains(client, user))
         user = NULL;
 
     /* Invoke callback with requested user (if they exist) */
@@ -684,8 +1411,12 @@ int guac_client_load_plugin(guac_client* client, const char* protocol) {
 
     /* Init client */
     client->__plugin_handle = client_plugin_handle;
+    guac_client_startup_phase(client, "load_plugin");
+
+    int result = alias.client_init(client);
+    guac_client_startup_phase(client, "init_plugin");
 
-    return alias.client_init(client);
+    return result;
 
 }
 
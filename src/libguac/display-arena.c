@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "display-arena.h"
+#include "guacamole/mem.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Rounds the given size up to the nearest multiple of
+ * GUAC_DISPLAY_ARENA_ALIGNMENT.
+ *
+ * @param size
+ *     The size to round, in bytes.
+ *
+ * @return
+ *     The given size, rounded up to the nearest multiple of
+ *     GUAC_DISPLAY_ARENA_ALIGNMENT.
+ */
+static size_t guac_display_arena_align(size_t size) {
+    return guac_mem_ckd_add_or_die(size, GUAC_DISPLAY_ARENA_ALIGNMENT - 1)
+        & ~((size_t) GUAC_DISPLAY_ARENA_ALIGNMENT - 1);
+}
+
+/**
+ * Returns the first address at or after the given address that is aligned to
+ * GUAC_DISPLAY_ARENA_ALIGNMENT.
+ *
+ * @param ptr
+ *     The address to align.
+ *
+ * @return
+ *     The first aligned address at or after the given address.
+ */
+static unsigned char* guac_display_arena_align_ptr(unsigned char* ptr) {
+    uintptr_t misalignment = (uintptr_t) ptr % GUAC_DISPLAY_ARENA_ALIGNMENT;
+    return misalignment ? ptr + GUAC_DISPLAY_ARENA_ALIGNMENT - misalignment : ptr;
+}
+
+/**
+ * Replaces the main buffer of the given arena with a new buffer having the
+ * given usable size. Any previous main buffer is freed.
+ *
+ * @param arena
+ *     The arena whose main buffer should be replaced.
+ *
+ * @param size
+ *     The usable size of the new main buffer, in bytes.
+ */
+static void guac_display_arena_replace_buffer(guac_display_arena* arena,
+        size_t size) {
+
+    guac_mem_free_pages(arena->buffer);
+
+    arena->buffer = guac_mem_zalloc_pages(guac_mem_ckd_add_or_die(size,
+                GUAC_DISPLAY_ARENA_ALIGNMENT));
+    guac_mem_tag_pages(arena->buffer, GUAC_MEM_CATEGORY_DISPLAY);
+    arena->base = guac_display_arena_align_ptr(arena->buffer);
+    arena->size = size;
+
+}
+
+void guac_display_arena_init(guac_display_arena* arena) {
+    *arena = (guac_display_arena) { 0 };
+}
+
+void* guac_display_arena_alloc(guac_display_arena* arena, size_t count,
+        size_t size) {
+
+    size_t length = guac_display_arena_align(guac_mem_ckd_mul_or_die(count, size));
+
+    /* Reserve the main buffer upon first use */
+    if (arena->buffer == NULL)
+        guac_display_arena_replace_buffer(arena,
+                length > GUAC_DISPLAY_ARENA_INITIAL_SIZE
+                ? length : GUAC_DISPLAY_ARENA_INITIAL_SIZE);
+
+    if (length <= arena->size - arena->used) {
+        void* block = arena->base + arena->used;
+        arena->used += length;
+        return block;
+    }
+
+    /* Blocks that do not fit are allocated separately until the arena is
+     * next reset, at which point the main buffer is enlarged */
+    unsigned char* overflow = guac_mem_alloc(guac_mem_ckd_add_or_die(length,
+                sizeof(guac_display_arena_overflow),
+                GUAC_DISPLAY_ARENA_ALIGNMENT));
+
+    guac_display_arena_overflow* header = (guac_display_arena_overflow*) overflow;
+    header->next = arena->overflow;
+    arena->overflow = header;
+    arena->overflow_size = guac_mem_ckd_add_or_die(arena->overflow_size, length);
+
+    return guac_display_arena_align_ptr(overflow
+            + sizeof(guac_display_arena_overflow));
+
+}
+
+void* guac_display_arena_zalloc(guac_display_arena* arena, size_t count,
+        size_t size) {
+
+    void* block = guac_display_arena_alloc(arena, count, size);
+    memset(block, 0, guac_mem_ckd_mul_or_die(count, size));
+    return block;
+
+}
+
+/**
+ * Frees all overflow blocks of the given arena.
+ *
+ * @param arena
+ *     The arena whose overflow blocks should be freed.
+ */
+static void guac_display_arena_free_overflow(guac_display_arena* arena) {
+
+    guac_display_arena_overflow* current = arena->overflow;
+    while (current != NULL) {
+        guac_display_arena_overflow* next = current->next;
+        guac_mem_free(current);
+        current = next;
+    }
+
+    arena->overflow = NULL;
+    arena->overflow_size = 0;
+
+}
+
+void guac_display_arena_reset(guac_display_arena* arena) {
+
+    /* Ensure the next frame of similar size fits entirely within the main
+     * buffer */
+    if (arena->overflow != NULL) {
+
+        size_t required = guac_mem_ckd_add_or_die(arena->used, arena->overflow_size);
+        size_t size = guac_mem_ckd_mul_or_die(arena->size, 2);
+        if (size < required)
+            size = required;
+
+        guac_display_arena_free_overflow(arena);
+        guac_display_arena_replace_buffer(arena, size);
+
+    }
+
+    arena->used = 0;
+
+}
+
+void guac_display_arena_destroy(guac_display_arena* arena) {
+    guac_display_arena_free_overflow(arena);
+    guac_mem_free_pages(arena->buffer);
+}
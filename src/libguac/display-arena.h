@@ -0,0 +1,184 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_DISPLAY_ARENA_H
+#define GUAC_DISPLAY_ARENA_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * The alignment of every block allocated from a guac_display_arena, in
+ * bytes. This is the size of a typical cache line, such that blocks written
+ * by different worker threads (such as the task arrays of a display plan) do
+ * not share cache lines.
+ */
+#define GUAC_DISPLAY_ARENA_ALIGNMENT 64
+
+/**
+ * The number of bytes initially reserved for a guac_display_arena when first
+ * used. This is large enough for the plan of a typical frame, including its
+ * operation index. Arenas that prove too small for a frame grow to fit once
+ * that frame has finished.
+ */
+#define GUAC_DISPLAY_ARENA_INITIAL_SIZE ((size_t) 2 * 1024 * 1024)
+
+/**
+ * A block of memory allocated separately from the main buffer of a
+ * guac_display_arena because that buffer did not have enough space remaining.
+ * Each such block is prefixed by this header, followed by any padding needed
+ * to align the block itself.
+ */
+typedef struct guac_display_arena_overflow {
+
+    /**
+     * The next overflow block of the same arena, or NULL if there are no
+     * further blocks.
+     */
+    struct guac_display_arena_overflow* next;
+
+} guac_display_arena_overflow;
+
+/**
+ * A bump allocator providing the temporary memory needed to plan a single
+ * frame, such as the plan itself, its operations and operation index, and
+ * the task arrays and scratch buffers of each planning pass. Memory is only
+ * ever allocated from an arena, never individually freed, and the entire
+ * arena is reset once the frame has been planned and applied. Once the arena
+ * has grown to fit the largest frame seen, planning a frame performs no heap
+ * allocation at all.
+ *
+ * A guac_display_arena is not threadsafe. The arena of a guac_display must
+ * only be used while the pending frame is locked for writing.
+ */
+typedef struct guac_display_arena {
+
+    /**
+     * The main buffer from which memory is allocated, or NULL if the arena
+     * has not yet been used. This buffer has GUAC_DISPLAY_ARENA_ALIGNMENT
+     * bytes more than size, such that base may be aligned.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The first aligned byte of the main buffer, from which all blocks that
+     * fit within the main buffer are allocated.
+     */
+    unsigned char* base;
+
+    /**
+     * The usable size of the main buffer, in bytes, starting at base.
+     */
+    size_t size;
+
+    /**
+     * The number of bytes of the main buffer that have been allocated since
+     * the arena was last reset.
+     */
+    size_t used;
+
+    /**
+     * All blocks allocated since the arena was last reset that did not fit
+     * within the main buffer, or NULL if there are no such blocks.
+     */
+    guac_display_arena_overflow* overflow;
+
+    /**
+     * The total number of bytes allocated within overflow blocks since the
+     * arena was last reset, excluding the headers of those blocks.
+     */
+    size_t overflow_size;
+
+} guac_display_arena;
+
+/**
+ * Initializes the given arena. No memory is reserved until the arena is first
+ * used.
+ *
+ * @param arena
+ *     The arena to initialize.
+ */
+void guac_display_arena_init(guac_display_arena* arena);
+
+/**
+ * Allocates a block of memory from the given arena large enough to hold the
+ * given number of elements of the given size. The block is aligned to
+ * GUAC_DISPLAY_ARENA_ALIGNMENT bytes and remains valid until the arena is
+ * next reset. If the size of the block cannot be represented by a size_t,
+ * the process is aborted.
+ *
+ * @param arena
+ *     The arena to allocate memory from.
+ *
+ * @param count
+ *     The number of elements.
+ *
+ * @param size
+ *     The size of each element, in bytes.
+ *
+ * @return
+ *     A pointer to the newly-allocated block, whose contents are undefined.
+ */
+void* guac_display_arena_alloc(guac_display_arena* arena, size_t count,
+        size_t size);
+
+/**
+ * Allocates a zero-filled block of memory from the given arena large enough
+ * to hold the given number of elements of the given size. This function
+ * behaves identically to guac_display_arena_alloc() except that the contents
+ * of the block are set to zero.
+ *
+ * @param arena
+ *     The arena to allocate memory from.
+ *
+ * @param count
+ *     The number of elements.
+ *
+ * @param size
+ *     The size of each element, in bytes.
+ *
+ * @return
+ *     A pointer to the newly-allocated, zero-filled block.
+ */
+void* guac_display_arena_zalloc(guac_display_arena* arena, size_t count,
+        size_t size);
+
+/**
+ * Releases all memory allocated from the given arena since it was last
+ * reset, invalidating all such blocks. If any blocks did not fit within the
+ * main buffer of the arena, that buffer is replaced with a buffer large
+ * enough to hold all of those blocks at once.
+ *
+ * @param arena
+ *     The arena to reset.
+ */
+void guac_display_arena_reset(guac_display_arena* arena);
+
+/**
+ * Frees all memory associated with the given arena. The arena must be
+ * reinitialized with guac_display_arena_init() before it is used again.
+ *
+ * @param arena
+ *     The arena to destroy.
+ */
+void guac_display_arena_destroy(guac_display_arena* arena);
+
+#endif
@@ -0,0 +1,437 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/mem.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+
+#include <cairo/cairo.h>
+#include <pthread.h>
+#include <string.h>
+
+/**
+ * The number of bytes in each row of the image data stored within each
+ * guac_display_cache_entry.
+ */
+#define GUAC_DISPLAY_CACHE_ENTRY_STRIDE \
+    (GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP)
+
+/**
+ * Returns the hash bucket that should contain entries having the given hash.
+ *
+ * @param cache
+ *     The cache containing the hash bucket.
+ *
+ * @param hash
+ *     The hash of the cell contents.
+ *
+ * @return
+ *     A pointer to the head pointer of the list of entries within the hash
+ *     bucket.
+ */
+static guac_display_cache_entry** guac_display_cache_bucket(guac_display_cache* cache,
+        uint64_t hash) {
+    return &cache->buckets[GUAC_DISPLAY_PLAN_OPERATION_HASH(hash) & (GUAC_DISPLAY_CACHE_BUCKETS - 1)];
+}
+
+/**
+ * Returns the entry having the given hash, if any. The cache must already be
+ * locked.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param hash
+ *     The hash of the cell contents.
+ *
+ * @return
+ *     The entry having the given hash, or NULL if there is no such entry.
+ */
+static guac_display_cache_entry* guac_display_cache_find(guac_display_cache* cache,
+        uint64_t hash) {
+
+    guac_display_cache_entry* entry = *guac_display_cache_bucket(cache, hash);
+    while (entry != NULL) {
+
+        if (entry->hash == hash)
+            return entry;
+
+        entry = entry->next_in_bucket;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Removes the given entry from the LRU list of the given cache. The cache must
+ * already be locked.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove from the LRU list.
+ */
+static void guac_display_cache_unlink(guac_display_cache* cache,
+        guac_display_cache_entry* entry) {
+
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+
+    entry->prev = NULL;
+    entry->next = NULL;
+
+}
+
+/**
+ * Inserts the given entry at the head of the LRU list of the given cache,
+ * marking it as the most recently used entry. The cache must already be
+ * locked, and the entry must not already be within the LRU list.
+ *
+ * @param cache
+ *     The cache that should contain the entry.
+ *
+ * @param entry
+ *     The entry to insert.
+ */
+static void guac_display_cache_link(guac_display_cache* cache,
+        guac_display_cache_entry* entry) {
+
+    entry->prev = NULL;
+    entry->next = cache->head;
+
+    if (cache->head != NULL)
+        cache->head->prev = entry;
+    else
+        cache->tail = entry;
+
+    cache->head = entry;
+
+}
+
+/**
+ * Removes the given entry from the given cache entirely, disposing of its
+ * client-side buffer and freeing all associated memory. The cache must already
+ * be locked.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove and free.
+ */
+static void guac_display_cache_remove(guac_display_cache* cache,
+        guac_display_cache_entry* entry) {
+
+    guac_client* client = cache->client;
+
+    /* Remove from hash bucket */
+    guac_display_cache_entry** current = guac_display_cache_bucket(cache, entry->hash);
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+    *current = entry->next_in_bucket;
+
+    /* Remove from list of entries not yet stored, if present */
+    if (!entry->stored) {
+        current = &cache->pending;
+        while (*current != entry)
+            current = &(*current)->next_pending;
+        *current = entry->next_pending;
+    }
+
+    guac_display_cache_unlink(cache, entry);
+    cache->length--;
+
+    /* Only entries that were actually stored have any client-side data that
+     * needs to be disposed */
+    if (entry->stored)
+        guac_protocol_send_dispose(client->socket, entry->buffer);
+
+    guac_client_free_buffer(client, entry->buffer);
+    guac_mem_free(entry);
+
+}
+
+/**
+ * Evicts least recently used entries from the given cache until the number of
+ * entries does not exceed the given number. Entries last used by the given
+ * frame are never evicted. The cache must already be locked.
+ *
+ * @param cache
+ *     The cache to evict entries from.
+ *
+ * @param length
+ *     The maximum number of entries that should remain.
+ *
+ * @param frame
+ *     The timestamp of the frame being planned, or zero if no frame is being
+ *     planned.
+ *
+ * @return
+ *     Non-zero if the cache now contains no more than the given number of
+ *     entries, zero if entries still in use by the given frame prevented
+ *     eviction.
+ */
+static int guac_display_cache_evict(guac_display_cache* cache, size_t length,
+        guac_timestamp frame) {
+
+    while (cache->length > length) {
+
+        guac_display_cache_entry* entry = cache->tail;
+        if (frame && entry->last_used == frame)
+            return 0;
+
+        guac_display_cache_remove(cache, entry);
+        cache->evictions++;
+
+    }
+
+    return 1;
+
+}
+
+void guac_display_cache_init(guac_display_cache* cache, guac_client* client,
+        size_t size) {
+
+    memset(cache, 0, sizeof(guac_display_cache));
+    pthread_mutex_init(&cache->lock, NULL);
+
+    cache->client = client;
+    cache->capacity = size / GUAC_DISPLAY_CACHE_ENTRY_SIZE;
+
+}
+
+void guac_display_cache_destroy(guac_display_cache* cache) {
+
+    pthread_mutex_lock(&cache->lock);
+
+    guac_client_log(cache->client, GUAC_LOG_DEBUG, "Cell cache: %llu hits, "
+            "%llu misses, %llu evictions.",
+            (unsigned long long) cache->hits,
+            (unsigned long long) cache->misses,
+            (unsigned long long) cache->evictions);
+
+    while (cache->head != NULL)
+        guac_display_cache_remove(cache, cache->head);
+
+    pthread_mutex_unlock(&cache->lock);
+    pthread_mutex_destroy(&cache->lock);
+
+}
+
+void guac_display_cache_set_size(guac_display_cache* cache, size_t size) {
+
+    pthread_mutex_lock(&cache->lock);
+
+    cache->capacity = size / GUAC_DISPLAY_CACHE_ENTRY_SIZE;
+    guac_display_cache_evict(cache, cache->capacity, 0);
+
+    pthread_mutex_unlock(&cache->lock);
+
+}
+
+const guac_layer* guac_display_cache_get(guac_display_cache* cache,
+        uint64_t hash, const unsigned char* data, size_t stride,
+        guac_timestamp frame) {
+
+    const guac_layer* buffer = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Only entries that have actually been stored client-side can be used */
+    guac_display_cache_entry* entry = guac_display_cache_find(cache, hash);
+    if (entry != NULL && entry->stored) {
+
+        /* Verify that the match is not merely a hash collision */
+        const unsigned char* cached = (const unsigned char*) entry->data;
+        const unsigned char* current = data;
+
+        int y;
+        for (y = 0; y < GUAC_DISPLAY_CELL_SIZE; y++) {
+
+            if (memcmp(cached, current, GUAC_DISPLAY_CACHE_ENTRY_STRIDE))
+                break;
+
+            cached += GUAC_DISPLAY_CACHE_ENTRY_STRIDE;
+            current += stride;
+
+        }
+
+        if (y == GUAC_DISPLAY_CELL_SIZE) {
+
+            guac_display_cache_unlink(cache, entry);
+            guac_display_cache_link(cache, entry);
+            entry->last_used = frame;
+
+            buffer = entry->buffer;
+
+        }
+
+    }
+
+    if (buffer != NULL)
+        cache->hits++;
+    else
+        cache->misses++;
+
+    pthread_mutex_unlock(&cache->lock);
+    return buffer;
+
+}
+
+int guac_display_cache_put(guac_display_cache* cache, uint64_t hash,
+        const unsigned char* data, size_t stride, guac_display_layer* layer,
+        int x, int y, guac_timestamp frame) {
+
+    int added = 0;
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Make room for the new entry (if possible) only if there isn't already
+     * an entry for the same hash */
+    if (cache->capacity > 0 && guac_display_cache_find(cache, hash) == NULL
+            && guac_display_cache_evict(cache, cache->capacity - 1, frame)) {
+
+        guac_display_cache_entry* entry = guac_mem_alloc(sizeof(guac_display_cache_entry));
+        entry->hash = hash;
+        entry->buffer = guac_client_alloc_buffer(cache->client);
+        entry->stored = 0;
+        entry->layer = layer;
+        entry->x = x;
+        entry->y = y;
+        entry->added = frame;
+        entry->last_used = frame;
+
+        /* Retain copy of cell contents to allow collisions to be detected */
+        unsigned char* cached = (unsigned char*) entry->data;
+        for (int row = 0; row < GUAC_DISPLAY_CELL_SIZE; row++) {
+            memcpy(cached, data, GUAC_DISPLAY_CACHE_ENTRY_STRIDE);
+            cached += GUAC_DISPLAY_CACHE_ENTRY_STRIDE;
+            data += stride;
+        }
+
+        guac_display_cache_entry** bucket = guac_display_cache_bucket(cache, hash);
+        entry->next_in_bucket = *bucket;
+        *bucket = entry;
+
+        entry->next_pending = cache->pending;
+        cache->pending = entry;
+
+        guac_display_cache_link(cache, entry);
+        cache->length++;
+
+        added = 1;
+
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return added;
+
+}
+
+void guac_display_cache_commit(guac_display_cache* cache) {
+
+    guac_socket* socket = cache->client->socket;
+
+    pthread_mutex_lock(&cache->lock);
+
+    guac_display_cache_entry* entry = cache->pending;
+    while (entry != NULL) {
+
+        guac_protocol_send_copy(socket, entry->layer->layer,
+                entry->x, entry->y, GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE,
+                GUAC_COMP_OVER, entry->buffer, 0, 0);
+
+        entry->stored = 1;
+        entry->layer = NULL;
+
+        guac_display_cache_entry* next = entry->next_pending;
+        entry->next_pending = NULL;
+        entry = next;
+
+    }
+
+    cache->pending = NULL;
+
+    pthread_mutex_unlock(&cache->lock);
+
+}
+
+void guac_display_cache_forget_layer(guac_display_cache* cache,
+        guac_display_layer* layer) {
+
+    pthread_mutex_lock(&cache->lock);
+
+    guac_display_cache_entry* entry = cache->pending;
+    while (entry != NULL) {
+
+        guac_display_cache_entry* next = entry->next_pending;
+
+        if (entry->layer == layer)
+            guac_display_cache_remove(cache, entry);
+
+        entry = next;
+
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+}
+
+void guac_display_cache_dup(guac_display_cache* cache, guac_socket* socket,
+        guac_timestamp since) {
+
+    pthread_mutex_lock(&cache->lock);
+
+    guac_display_cache_entry* entry = cache->head;
+    while (entry != NULL) {
+
+        if (entry->stored && entry->added >= since) {
+
+            cairo_surface_t* cell = cairo_image_surface_create_for_data(
+                    (unsigned char*) entry->data, CAIRO_FORMAT_RGB24,
+                    GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE,
+                    GUAC_DISPLAY_CACHE_ENTRY_STRIDE);
+
+            guac_client_stream_png(cache->client, socket, GUAC_COMP_OVER,
+                    entry->buffer, 0, 0, cell);
+
+            cairo_surface_destroy(cell);
+
+        }
+
+        entry = entry->next;
+
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+}
@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-priv.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+unsigned long guac_display_cgroup_nproc(const char* membership_path,
+        const char* root) {
+
+#ifdef __linux__
+
+    /* Under cgroup v2, the cgroup of the current process is given by the
+     * single line beginning with "0::" */
+    FILE* membership = fopen(membership_path, "r");
+    if (membership == NULL)
+        return 0;
+
+    char line[PATH_MAX];
+    char path[PATH_MAX * 2];
+    int found = 0;
+
+    while (fgets(line, sizeof(line), membership) != NULL) {
+        if (strncmp(line, "0::/", 4) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            found = snprintf(path, sizeof(path), "%s%s", root, line + 3)
+                < sizeof(path);
+            break;
+        }
+    }
+
+    fclose(membership);
+    if (!found)
+        return 0;
+
+    /* The root cgroup itself is given as "/", which must not leave a
+     * trailing slash that would be mistaken for a further level of the
+     * hierarchy */
+    size_t root_length = strlen(root);
+    size_t length = strlen(path);
+    if (length > root_length && path[length - 1] == '/')
+        path[length - 1] = '\0';
+
+    /* Find the most restrictive quota of the cgroup and its ancestors */
+    unsigned long cpu_count = 0;
+    for (;;) {
+
+        length = strlen(path);
+        char* end = path + length;
+
+        char quota_path[sizeof(path) + sizeof("/cpu.max")];
+        snprintf(quota_path, sizeof(quota_path), "%s/cpu.max", path);
+
+        /* Each quota takes the form "QUOTA PERIOD", where QUOTA may be "max"
+         * to indicate that no quota applies */
+        FILE* quota_file = fopen(quota_path, "r");
+        if (quota_file != NULL) {
+
+            long long quota, period;
+            if (fscanf(quota_file, "%lld %lld", &quota, &period) == 2
+                    && quota > 0 && period > 0) {
+                unsigned long quota_cpus = (quota + period - 1) / period;
+                if (cpu_count == 0 || quota_cpus < cpu_count)
+                    cpu_count = quota_cpus;
+            }
+
+            fclose(quota_file);
+
+        }
+
+        /* Stop after the root of the hierarchy (which itself never has a
+         * quota) */
+        if (length <= root_length)
+            break;
+
+        /* Move to parent cgroup */
+        while (end > path + root_length && *end != '/')
+            end--;
+        *end = '\0';
+
+    }
+
+    return cpu_count;
+
+#else
+    return 0;
+#endif
+
+}
+
@@ -18,15 +18,31 @@
  */
 
 #include "display-builtin-cursors.h"
+#include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/assert.h"
+#include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/mem.h"
+#include "guacamole/protocol.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
+#include "guacamole/socket.h"
 
+#include <cairo/cairo.h>
+#include <stdint.h>
 #include <string.h>
 
+/**
+ * The offset basis of the 64-bit FNV-1a hash used to hash cursor images.
+ */
+#define GUAC_DISPLAY_CURSOR_HASH_OFFSET 0xCBF29CE484222325ULL
+
+/**
+ * The prime of the 64-bit FNV-1a hash used to hash cursor images.
+ */
+#define GUAC_DISPLAY_CURSOR_HASH_PRIME 0x100000001B3ULL
+
 guac_display_layer* guac_display_cursor(guac_display* display) {
     return display->cursor_buffer;
 }
@@ -102,3 +118,272 @@ void guac_display_set_cursor(guac_display* display,
     guac_display_end_mouse_frame(display);
 
 }
+
+/**
+ * Returns a hash of the given cursor image and its dimensions, with each
+ * pixel mixed in as a single unit.
+ *
+ * @param data
+ *     The contents of the cursor image.
+ *
+ * @param width
+ *     The width of the cursor image, in pixels.
+ *
+ * @param height
+ *     The height of the cursor image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the provided cursor image.
+ *
+ * @return
+ *     The hash of the cursor image.
+ */
+static uint64_t guac_display_cursor_hash(const unsigned char* data,
+        int width, int height, size_t stride) {
+
+    uint64_t hash = GUAC_DISPLAY_CURSOR_HASH_OFFSET;
+    hash = (hash ^ (uint64_t) width) * GUAC_DISPLAY_CURSOR_HASH_PRIME;
+    hash = (hash ^ (uint64_t) height) * GUAC_DISPLAY_CURSOR_HASH_PRIME;
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+        for (int x = 0; x < width; x++)
+            hash = (hash ^ row[x]) * GUAC_DISPLAY_CURSOR_HASH_PRIME;
+
+        data += stride;
+
+    }
+
+    return hash;
+
+}
+
+/**
+ * Returns whether the given cursor cache entry contains exactly the given
+ * cursor image.
+ *
+ * @param entry
+ *     The cursor cache entry to compare.
+ *
+ * @param data
+ *     The contents of the cursor image.
+ *
+ * @param width
+ *     The width of the cursor image, in pixels.
+ *
+ * @param height
+ *     The height of the cursor image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the provided cursor image.
+ *
+ * @return
+ *     Non-zero if the entry contains the given cursor image, zero
+ *     otherwise.
+ */
+static int guac_display_cursor_cache_matches(
+        const guac_display_cursor_cache_entry* entry,
+        const unsigned char* data, int width, int height, size_t stride) {
+
+    if (entry->width != width || entry->height != height)
+        return 0;
+
+    size_t row_length = guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP);
+    const uint32_t* cached = entry->data;
+
+    for (int y = 0; y < height; y++) {
+
+        if (memcmp(cached, data, row_length))
+            return 0;
+
+        cached += width;
+        data += stride;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Returns the entry of the given display's cursor cache that should receive
+ * a newly-seen cursor image, allocating that entry if it has not yet been
+ * allocated. Unused entries are preferred, followed by the least recently
+ * used entry.
+ *
+ * @param display
+ *     The display whose cursor cache should receive the cursor image.
+ *
+ * @return
+ *     The entry that should receive the cursor image.
+ */
+static guac_display_cursor_cache_entry* guac_display_cursor_cache_claim(
+        guac_display* display) {
+
+    guac_display_cursor_cache_entry* oldest = NULL;
+
+    for (int i = 0; i < GUAC_DISPLAY_CURSOR_CACHE_SIZE; i++) {
+
+        guac_display_cursor_cache_entry* entry = display->cursor_cache[i];
+        if (entry == NULL) {
+            entry = display->cursor_cache[i] = guac_mem_zalloc(sizeof(guac_display_cursor_cache_entry));
+            entry->buffer = guac_client_alloc_buffer(display->client);
+            return entry;
+        }
+
+        if (oldest == NULL || entry->last_used < oldest->last_used)
+            oldest = entry;
+
+    }
+
+    return oldest;
+
+}
+
+void PFR_guac_display_plan_rewrite_as_cached_cursor(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_layer* cursor = display->cursor_buffer;
+
+    int width = cursor->pending_frame.width;
+    int height = cursor->pending_frame.height;
+
+    if (guac_rect_is_empty(&cursor->pending_frame.dirty)
+            || cursor->pending_frame.buffer == NULL
+            || width <= 0 || height <= 0
+            || width > GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION
+            || height > GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION)
+        return;
+
+    /* Nothing to do if the cursor image was marked dirty but did not
+     * actually change */
+    guac_display_plan_operation* first = NULL;
+    guac_display_plan_operation* op = plan->ops;
+    for (int i = 0; i < plan->length; i++, op++) {
+        if (op->layer == cursor && op->type != GUAC_DISPLAY_PLAN_OPERATION_NOP) {
+            first = op;
+            break;
+        }
+    }
+
+    if (first == NULL)
+        return;
+
+    const unsigned char* data = cursor->pending_frame.buffer;
+    size_t stride = cursor->pending_frame.buffer_stride;
+    uint64_t hash = guac_display_cursor_hash(data, width, height, stride);
+
+    for (int i = 0; i < GUAC_DISPLAY_CURSOR_CACHE_SIZE; i++) {
+
+        guac_display_cursor_cache_entry* entry = display->cursor_cache[i];
+        if (entry == NULL)
+            break;
+
+        if (!entry->stored || entry->hash != hash
+                || !guac_display_cursor_cache_matches(entry, data, width, height, stride))
+            continue;
+
+        /* Restore the entire cursor image with a single copy, dropping all
+         * other updates to the cursor */
+        first->type = GUAC_DISPLAY_PLAN_OPERATION_COPY;
+        first->src.layer_rect.layer = entry->buffer;
+        guac_rect_init(&first->src.layer_rect.rect, 0, 0, width, height);
+        guac_rect_init(&first->dest, 0, 0, width, height);
+
+        op = first + 1;
+        for (int j = first - plan->ops + 1; j < plan->length; j++, op++) {
+            if (op->layer == cursor)
+                op->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+        }
+
+        entry->last_used = plan->frame_end;
+        return;
+
+    }
+
+    /* Cache the new cursor image such that it can be restored later */
+    guac_display_cursor_cache_entry* entry = guac_display_cursor_cache_claim(display);
+
+    entry->hash = hash;
+    entry->width = width;
+    entry->height = height;
+    entry->stored = 0;
+    entry->last_used = plan->frame_end;
+
+    size_t row_length = guac_mem_ckd_mul_or_die(width, GUAC_DISPLAY_LAYER_RAW_BPP);
+    uint32_t* cached = entry->data;
+    for (int y = 0; y < height; y++) {
+        memcpy(cached, data, row_length);
+        cached += width;
+        data += stride;
+    }
+
+    display->cursor_cache_pending = entry;
+
+}
+
+void guac_display_cursor_cache_commit(guac_display* display) {
+
+    guac_display_cursor_cache_entry* entry = display->cursor_cache_pending;
+    if (entry == NULL)
+        return;
+
+    guac_socket* socket = display->client->socket;
+
+    /* The cursor image has an alpha channel and must replace any previous
+     * contents of the buffer */
+    guac_protocol_send_rect(socket, entry->buffer, 0, 0,
+            GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION,
+            GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION);
+    guac_protocol_send_cfill(socket, GUAC_COMP_RATOP, entry->buffer,
+            0x00, 0x00, 0x00, 0x00);
+
+    guac_protocol_send_copy(socket, display->cursor_buffer->layer,
+            0, 0, entry->width, entry->height,
+            GUAC_COMP_OVER, entry->buffer, 0, 0);
+
+    entry->stored = 1;
+    display->cursor_cache_pending = NULL;
+
+}
+
+void guac_display_cursor_cache_dup(guac_display* display, guac_socket* socket) {
+
+    for (int i = 0; i < GUAC_DISPLAY_CURSOR_CACHE_SIZE; i++) {
+
+        guac_display_cursor_cache_entry* entry = display->cursor_cache[i];
+        if (entry == NULL)
+            break;
+
+        if (!entry->stored)
+            continue;
+
+        cairo_surface_t* image = cairo_image_surface_create_for_data(
+                (unsigned char*) entry->data, CAIRO_FORMAT_ARGB32,
+                entry->width, entry->height,
+                guac_mem_ckd_mul_or_die(entry->width, GUAC_DISPLAY_LAYER_RAW_BPP));
+
+        guac_client_stream_png(display->client, socket, GUAC_COMP_OVER,
+                entry->buffer, 0, 0, image);
+
+        cairo_surface_destroy(image);
+
+    }
+
+}
+
+void guac_display_cursor_cache_destroy(guac_display* display) {
+
+    for (int i = 0; i < GUAC_DISPLAY_CURSOR_CACHE_SIZE; i++) {
+
+        guac_display_cursor_cache_entry* entry = display->cursor_cache[i];
+        if (entry == NULL)
+            break;
+
+        guac_client_free_buffer(display->client, entry->buffer);
+        guac_mem_free(entry);
+
+    }
+
+}
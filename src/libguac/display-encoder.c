@@ -0,0 +1,395 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Returns the quality corresponding to the given quality level of the encoder
+ * cost model.
+ *
+ * @param level
+ *     The quality level, where zero is the lowest level.
+ *
+ * @return
+ *     The quality corresponding to the given level, from 0 to 100 inclusive.
+ */
+static int guac_display_encoder_level_quality(int level) {
+    return GUAC_DISPLAY_ENCODER_MIN_QUALITY + level * GUAC_DISPLAY_ENCODER_QUALITY_STEP;
+}
+
+/**
+ * Returns the highest quality level of the encoder cost model that does not
+ * exceed the given quality. If the given quality is below the lowest quality
+ * level, the lowest quality level is returned.
+ *
+ * @param quality
+ *     The quality, from 0 to 100 inclusive.
+ *
+ * @return
+ *     The corresponding quality level, where zero is the lowest level.
+ */
+static int guac_display_encoder_quality_level(int quality) {
+
+    int level = (quality - GUAC_DISPLAY_ENCODER_MIN_QUALITY) / GUAC_DISPLAY_ENCODER_QUALITY_STEP;
+
+    if (level < 0)
+        return 0;
+
+    if (level >= GUAC_DISPLAY_ENCODER_QUALITY_LEVELS)
+        return GUAC_DISPLAY_ENCODER_QUALITY_LEVELS - 1;
+
+    return level;
+
+}
+
+/**
+ * Returns the stats within the given model that apply to the given encoding
+ * choice. The model must already be locked.
+ *
+ * @param model
+ *     The model containing the stats.
+ *
+ * @param choice
+ *     The encoding and quality level.
+ *
+ * @return
+ *     The stats applicable to the given encoding and quality level.
+ */
+static guac_display_encoder_stats* guac_display_encoder_get_stats(
+        guac_display_encoder_model* model,
+        const guac_display_encoder_choice* choice) {
+
+    /* Lossless encodings have only one quality level */
+    int level = 0;
+    if (choice->encoding == GUAC_DISPLAY_ENCODING_JPEG
+            || choice->encoding == GUAC_DISPLAY_ENCODING_WEBP)
+        level = guac_display_encoder_quality_level(choice->quality);
+
+    return &model->stats[choice->encoding][level];
+
+}
+
+void guac_display_encoder_init(guac_display_encoder_model* model) {
+
+    pthread_mutex_init(&model->lock, NULL);
+
+    /* Initial estimates are rough and intended only to produce reasonable
+     * choices until actual measurements are available. All byte counts
+     * include the overhead of base64. */
+    for (int level = 0; level < GUAC_DISPLAY_ENCODER_QUALITY_LEVELS; level++) {
+
+        double quality = guac_display_encoder_level_quality(level) / 100.0;
+
+        model->stats[GUAC_DISPLAY_ENCODING_PNG][level] = (guac_display_encoder_stats) {
+            .ns_per_pixel = 40.0,
+            .bytes_per_pixel = 1.5
+        };
+
+        model->stats[GUAC_DISPLAY_ENCODING_JPEG][level] = (guac_display_encoder_stats) {
+            .ns_per_pixel = 10.0 + 10.0 * quality,
+            .bytes_per_pixel = 0.1 + 1.0 * quality * quality
+        };
+
+        model->stats[GUAC_DISPLAY_ENCODING_WEBP][level] = (guac_display_encoder_stats) {
+            .ns_per_pixel = 40.0 + 40.0 * quality,
+            .bytes_per_pixel = 0.07 + 0.7 * quality * quality
+        };
+
+        model->stats[GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS][level] = (guac_display_encoder_stats) {
+            .ns_per_pixel = 200.0,
+            .bytes_per_pixel = 1.0
+        };
+
+        model->stats[GUAC_DISPLAY_ENCODING_PNG_FAST][level] = (guac_display_encoder_stats) {
+            .ns_per_pixel = 15.0,
+            .bytes_per_pixel = 2.0
+        };
+
+    }
+
+}
+
+void guac_display_encoder_destroy(guac_display_encoder_model* model) {
+    pthread_mutex_destroy(&model->lock);
+}
+
+void guac_display_encoder_record(guac_display_encoder_model* model,
+        const guac_display_encoder_choice* choice, uint64_t pixels,
+        uint64_t duration, uint64_t bytes) {
+
+    if (pixels == 0)
+        return;
+
+    double ns_per_pixel = (double) duration / pixels;
+    double bytes_per_pixel = (double) bytes / pixels;
+
+    pthread_mutex_lock(&model->lock);
+
+    guac_display_encoder_stats* stats = guac_display_encoder_get_stats(model, choice);
+
+    /* Replace initial estimates entirely with the first measurement */
+    if (stats->samples == 0) {
+        stats->ns_per_pixel = ns_per_pixel;
+        stats->bytes_per_pixel = bytes_per_pixel;
+    }
+
+    /* Otherwise, update running averages */
+    else {
+        stats->ns_per_pixel += (ns_per_pixel - stats->ns_per_pixel) / GUAC_DISPLAY_ENCODER_HISTORY;
+        stats->bytes_per_pixel += (bytes_per_pixel - stats->bytes_per_pixel) / GUAC_DISPLAY_ENCODER_HISTORY;
+    }
+
+    if (stats->samples < UINT_MAX)
+        stats->samples++;
+
+    pthread_mutex_unlock(&model->lock);
+
+}
+
+void guac_display_encoder_choose(guac_display_encoder_model* model,
+        unsigned int candidates, int max_quality, uint64_t pixels,
+        uint64_t budget, guac_display_encoder_choice* choice) {
+
+    guac_display_encoding lossy[] = {
+        GUAC_DISPLAY_ENCODING_JPEG,
+        GUAC_DISPLAY_ENCODING_WEBP
+    };
+
+    guac_display_encoding fastest = GUAC_DISPLAY_ENCODING_JPEG;
+    double fastest_time = -1;
+
+    pthread_mutex_lock(&model->lock);
+
+    /* Starting with the highest quality level allowed, choose the encoding
+     * that produces the least data among those expected to be fast enough,
+     * falling back to lower quality levels if nothing is fast enough */
+    for (int level = guac_display_encoder_quality_level(max_quality); level >= 0; level--) {
+
+        int found = 0;
+        double smallest_size = 0;
+
+        for (size_t i = 0; i < sizeof(lossy) / sizeof(lossy[0]); i++) {
+
+            guac_display_encoding encoding = lossy[i];
+            if (!(candidates & (1 << encoding)))
+                continue;
+
+            guac_display_encoder_stats* stats = &model->stats[encoding][level];
+            double time = stats->ns_per_pixel * pixels;
+            double size = stats->bytes_per_pixel * pixels;
+
+            /* Track the fastest encoding at the lowest quality level in case
+             * nothing is fast enough */
+            if (level == 0 && (fastest_time < 0 || time < fastest_time)) {
+                fastest = encoding;
+                fastest_time = time;
+            }
+
+            if (time <= budget && (!found || size < smallest_size)) {
+                choice->encoding = encoding;
+                choice->quality = guac_display_encoder_level_quality(level);
+                smallest_size = size;
+                found = 1;
+            }
+
+        }
+
+        if (found) {
+            pthread_mutex_unlock(&model->lock);
+            return;
+        }
+
+    }
+
+    pthread_mutex_unlock(&model->lock);
+
+    choice->encoding = fastest;
+    choice->quality = guac_display_encoder_level_quality(0);
+
+}
+
+uint64_t guac_display_encoder_clock(void) {
+    return guac_timestamp_current_ns();
+}
+
+/**
+ * Data specific to sockets allocated with
+ * guac_display_encoder_counting_socket().
+ */
+typedef struct guac_display_encoder_counting_socket_data {
+
+    /**
+     * The guac_socket to which all socket operations should be delegated.
+     */
+    guac_socket* socket;
+
+    /**
+     * The number of bytes written since the count was last taken with
+     * guac_display_encoder_take_count().
+     */
+    uint64_t count;
+
+} guac_display_encoder_counting_socket_data;
+
+/**
+ * Callback invoked when data must be written to a counting socket. The data
+ * is written to the wrapped socket and counted.
+ *
+ * @param socket
+ *     The counting socket being written to.
+ *
+ * @param buf
+ *     The arbitrary buffer containing the data to be written.
+ *
+ * @param count
+ *     The number of bytes within the buffer.
+ *
+ * @return
+ *     The number of bytes written, or -1 if an error occurs.
+ */
+static ssize_t guac_display_encoder_counting_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) socket->data;
+
+    if (guac_socket_write(data->socket, buf, count))
+        return -1;
+
+    data->count += count;
+    return count;
+
+}
+
+/**
+ * Callback invoked when a counting socket is flushed. The flush is delegated
+ * to the wrapped socket.
+ *
+ * @param socket
+ *     The counting socket being flushed.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+static ssize_t guac_display_encoder_counting_flush_handler(guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) socket->data;
+
+    return guac_socket_flush(data->socket);
+
+}
+
+/**
+ * Callback invoked when an instruction begins being written to a counting
+ * socket. The lock is delegated to the wrapped socket.
+ *
+ * @param socket
+ *     The counting socket being locked.
+ */
+static void guac_display_encoder_counting_lock_handler(guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) socket->data;
+
+    guac_socket_instruction_begin(data->socket);
+
+}
+
+/**
+ * Callback invoked when an instruction is finished being written to a
+ * counting socket. The unlock is delegated to the wrapped socket.
+ *
+ * @param socket
+ *     The counting socket being unlocked.
+ */
+static void guac_display_encoder_counting_unlock_handler(guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) socket->data;
+
+    guac_socket_instruction_end(data->socket);
+
+}
+
+/**
+ * Callback invoked when a counting socket is freed. The wrapped socket is NOT
+ * freed.
+ *
+ * @param socket
+ *     The counting socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_display_encoder_counting_free_handler(guac_socket* socket) {
+    guac_mem_free(socket->data);
+    return 0;
+}
+
+guac_socket* guac_display_encoder_counting_socket(guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        guac_mem_alloc(sizeof(guac_display_encoder_counting_socket_data));
+
+    data->socket = socket;
+    data->count = 0;
+
+    guac_socket* counting_socket = guac_socket_alloc();
+    counting_socket->data = data;
+
+    counting_socket->write_handler  = guac_display_encoder_counting_write_handler;
+    counting_socket->flush_handler  = guac_display_encoder_counting_flush_handler;
+    counting_socket->lock_handler   = guac_display_encoder_counting_lock_handler;
+    counting_socket->unlock_handler = guac_display_encoder_counting_unlock_handler;
+    counting_socket->free_handler   = guac_display_encoder_counting_free_handler;
+
+    return counting_socket;
+
+}
+
+void guac_display_encoder_retarget_counting_socket(guac_socket* counting_socket,
+        guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) counting_socket->data;
+
+    data->socket = socket;
+
+}
+
+uint64_t guac_display_encoder_take_count(guac_socket* socket) {
+
+    guac_display_encoder_counting_socket_data* data =
+        (guac_display_encoder_counting_socket_data*) socket->data;
+
+    uint64_t count = data->count;
+    data->count = 0;
+
+    return count;
+
+}
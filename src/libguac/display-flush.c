@@ -28,8 +28,11 @@
 #include "guacamole/protocol.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
+#include "guacamole/timestamp.h"
 #include "guacamole/user.h"
+#include "probe.h"
 
+#include <stdint.h>
 #include <string.h>
 
 /**
@@ -38,11 +41,12 @@
  */
 #define GUAC_DISPLAY_PLAN_BEGIN_PHASE()                                       \
     do {                                                                      \
-        guac_timestamp phase_start = guac_timestamp_current();
+        uint64_t phase_start = guac_display_encoder_clock();
 
 /**
  * Ends a section related to an optimization phase that should be tracked for
- * performance at the "trace" log level.
+ * performance at the "trace" log level. The time taken is also recorded for
+ * frame tracing (see guac_display_trace).
  *
  * @param display
  *     The guac_display related to the optimizations being performed.
@@ -58,10 +62,12 @@
  *     The total number of optimization phases.
  */
 #define GUAC_DISPLAY_PLAN_END_PHASE(display, phase, n, total)                 \
-        guac_timestamp phase_end = guac_timestamp_current();                  \
+        uint64_t phase_duration = guac_display_encoder_clock() - phase_start; \
+        display->trace.phases[GUAC_DISPLAY_TRACE_PHASE_DRAFT + n - 1] =       \
+            phase_duration;                                                   \
         guac_client_log(display->client, GUAC_LOG_TRACE, "Render planning "   \
                 "phase %i/%i (%s): %ims", n, total, phase,                    \
-                (int) (phase_end - phase_start));                             \
+                (int) (phase_duration / 1000000));                            \
     } while (0)
 
 void guac_display_end_frame(guac_display* display) {
@@ -96,6 +102,58 @@ static void* LFR_guac_display_broadcast_cursor_state(guac_user* user, void* data
 
 }
 
+/**
+ * Releases the separate copy of the contents retained for the last frame of
+ * each layer that has not changed for longer than the idle release timeout of
+ * the given display, instead sharing the buffer of the pending frame (see the
+ * last_frame_shared member of guac_display_layer). Layers with external
+ * buffers, layers awaiting refinement, and layers whose buffers differ in
+ * size between frames are never released. This function has no effect if the
+ * idle release timeout is zero.
+ *
+ * @param display
+ *     The display whose idle layers should be released.
+ *
+ * @param now
+ *     The current time, as returned by guac_timestamp_frame_time().
+ */
+static void PFW_LFW_guac_display_release_idle_layers(guac_display* display,
+        guac_timestamp now) {
+
+    if (display->idle_release_timeout <= 0)
+        return;
+
+    /* Refinements are tracked under the ops FIFO lock (display worker threads
+     * are idle at this point, so no meaningful contention is introduced) */
+    guac_fifo_lock(&display->ops);
+
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+
+        if (!current->last_frame_shared
+                && !current->pending_frame.buffer_is_external
+                && current->pending_frame.buffer != NULL
+                && now - current->last_frame_modified >= display->idle_release_timeout
+                && guac_rect_is_empty(&current->refinement)
+                && current->lossy_cell_count == 0
+                && current->last_frame.buffer_stride == current->pending_frame.buffer_stride
+                && current->last_frame.buffer_width == current->pending_frame.buffer_width
+                && current->last_frame.buffer_height == current->pending_frame.buffer_height) {
+
+            guac_mem_free_pages(current->last_frame.buffer);
+            current->last_frame.buffer = current->pending_frame.buffer;
+            current->last_frame_shared = 1;
+
+        }
+
+        current = current->last_frame.next;
+
+    }
+
+    guac_fifo_unlock(&display->ops);
+
+}
+
 /**
  * Finalizes the current pending frame, storing that state as the copy of the
  * last frame. All layer properties that have changed since the last frame will
@@ -112,12 +170,18 @@ static void* LFR_guac_display_broadcast_cursor_state(guac_user* user, void* data
 static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
 
     guac_client* client = display->client;
+    guac_timestamp now = guac_timestamp_frame_time();
     int retval = 0;
 
     display->last_frame.layers = display->pending_frame.layers;
     guac_display_layer* current = display->pending_frame.layers;
     while (current != NULL) {
 
+        /* Note the first frame to contain each layer, allowing resumed views
+         * of the display to be recognized as lacking that layer */
+        if (current->last_frame_added == 0)
+            current->last_frame_added = now;
+
         /* Skip processing any layers whose buffers have been replaced with
          * NULL (this is intentionally allowed to ensure references to external
          * buffers can be safely removed if necessary, even before guac_display
@@ -140,9 +204,27 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
             size_t buffer_size = guac_mem_ckd_mul_or_die(current->pending_frame.buffer_height,
                     current->pending_frame.buffer_stride);
 
-            guac_mem_free(current->last_frame.buffer);
-            current->last_frame.buffer = guac_mem_zalloc(buffer_size);
+            /* Reuse the existing last_frame buffer if it is already large
+             * enough (as when the layer shrinks), as every byte is about to
+             * be overwritten regardless */
+            size_t last_frame_size = guac_mem_ckd_mul_or_die(current->last_frame.buffer_height,
+                    current->last_frame.buffer_stride);
+
+            if (current->last_frame_shared || current->last_frame.buffer == NULL
+                    || last_frame_size < buffer_size) {
+
+                if (!current->last_frame_shared)
+                    guac_mem_free_pages(current->last_frame.buffer);
+
+                current->last_frame.buffer = guac_mem_zalloc_pages(buffer_size);
+                guac_mem_tag_pages(current->last_frame.buffer,
+                        GUAC_MEM_CATEGORY_DISPLAY);
+
+            }
+
             memcpy(current->last_frame.buffer, current->pending_frame.buffer, buffer_size);
+            current->last_frame_shared = 0;
+            current->last_frame_modified = now;
 
             current->last_frame.buffer_stride = current->pending_frame.buffer_stride;
             current->last_frame.buffer_width = current->pending_frame.buffer_width;
@@ -151,6 +233,9 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
             current->last_frame.dirty = current->pending_frame.dirty;
             current->pending_frame.dirty = (guac_rect) { 0 };
 
+            /* The entire layer must be re-encoded for future joins */
+            LFW_guac_display_layer_free_dup_tiles(current);
+
             retval = 1;
 
         }
@@ -158,19 +243,45 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
         /* Copy over pending frame contents if actually changed (this is not
          * necessary if the last_frame buffer was resized to match
          * pending_frame, as a copy from pending_frame to last_frame is
-         * inherently part of that) */
+         * inherently part of that, nor if both frames share the same buffer,
+         * as the layer can only have been marked dirty without drawing) */
         else if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
 
-            unsigned char* pending_frame = current->pending_frame.buffer;
-            unsigned char* last_frame = current->last_frame.buffer;
-            size_t row_length = guac_mem_ckd_mul_or_die(current->pending_frame.width, 4);
+            /* Only the dirty rect need be copied, as that rect has been
+             * refined to contain every cell that differs from the last frame
+             * (this matters for very large layers, such as the desktop of a
+             * multi-monitor session, where most of the layer is typically
+             * unchanged) */
+            guac_rect copied = current->pending_frame.dirty;
+            guac_rect pending_frame_bounds = {
+                .left = 0,
+                .top = 0,
+                .right = current->pending_frame.width,
+                .bottom = current->pending_frame.height
+            };
+
+            guac_rect_constrain(&copied, &pending_frame_bounds);
+
+            if (!current->last_frame_shared && !guac_rect_is_empty(&copied)) {
+
+                const unsigned char* pending_frame = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->pending_frame, copied);
+                unsigned char* last_frame = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->last_frame, copied);
+                size_t row_length = guac_mem_ckd_mul_or_die(guac_rect_width(&copied), GUAC_DISPLAY_LAYER_RAW_BPP);
+
+                for (int y = copied.top; y < copied.bottom; y++) {
+                    memcpy(last_frame, pending_frame, row_length);
+                    last_frame += current->last_frame.buffer_stride;
+                    pending_frame += current->pending_frame.buffer_stride;
+                }
 
-            for (int y = 0; y < current->pending_frame.height; y++) {
-                memcpy(last_frame, pending_frame, row_length);
-                last_frame += current->last_frame.buffer_stride;
-                pending_frame += current->pending_frame.buffer_stride;
             }
 
+            current->last_frame_modified = now;
+
+            /* Only tiles containing changed cells need be re-encoded for
+             * future joins */
+            LFW_guac_display_layer_invalidate_dup_tiles(current, &copied);
+
             current->last_frame.dirty = current->pending_frame.dirty;
             current->pending_frame.dirty = (guac_rect) { 0 };
 
@@ -246,6 +357,18 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
          * function) */
         current->last_frame.search_for_copies = current->pending_frame.search_for_copies;
         current->pending_frame.search_for_copies = 0;
+        current->pending_frame.copy_hint_count = 0;
+        current->pending_frame_glyph_hints_length = 0;
+
+        /* Image hints must remain valid while the worker threads send the
+         * frame, replacing those of the previous frame */
+        for (int i = 0; i < current->last_frame.image_hint_count; i++)
+            guac_display_image_hint_free(current->last_frame.image_hints[i]);
+
+        memcpy(current->last_frame.image_hints, current->pending_frame.image_hints,
+                sizeof(current->pending_frame.image_hints));
+        current->last_frame.image_hint_count = current->pending_frame.image_hint_count;
+        current->pending_frame.image_hint_count = 0;
 
         /* Commit any change in lossless setting (no need to synchronize this
          * to the client - it affects only how last_frame is interpreted) */
@@ -258,6 +381,8 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
 
     }
 
+    PFW_LFW_guac_display_release_idle_layers(display, now);
+
     display->last_frame.timestamp = display->pending_frame.timestamp;
     display->last_frame.frames = display->pending_frame.frames;
 
@@ -293,6 +418,7 @@ static int PFW_LFW_guac_display_frame_complete(guac_display* display) {
 void guac_display_end_mouse_frame(guac_display* display) {
 
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    PFW_guac_display_merge_regions(display);
 
     if (!display->pending_frame_dirty_excluding_mouse)
         guac_display_end_multiple_frames(display, 0);
@@ -306,20 +432,33 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
     guac_display_plan* plan = NULL;
 
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    PFW_guac_display_merge_regions(display);
     display->pending_frame.frames += frames;
 
     /* Defer rendering of further frames until after any in-progress frame has
      * finished. Graphical changes will meanwhile continue being accumulated in
      * the pending frame. */
 
-    guac_fifo_lock(&display->ops);
-    int defer_frame = display->frame_deferred =
-        (display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY) || display->active_workers;
-    guac_fifo_unlock(&display->ops);
+    /* NOTE: The deferral is noted BEFORE checking whether a frame is in
+     * progress, as the worker thread that finishes that frame checks for
+     * deferred frames only AFTER releasing its reference to the frame. That
+     * thread leaves the frame marked as in progress if any frame was
+     * deferred, such that nothing waiting on render_state proceeds before
+     * the deferred frame has been sent. */
+    atomic_store(&display->frame_deferred, 1);
 
-    if (defer_frame)
+    unsigned int no_frame = 0;
+    if (!atomic_compare_exchange_strong(&display->frame_ops, &no_frame, 1))
         goto finished_with_pending_frame_lock;
 
+    atomic_store(&display->frame_deferred, 0);
+
+    /* Ensure all worker threads are available to assist with the new frame,
+     * even if some terminated while the display was idle */
+    guac_display_resume_workers(display);
+
+    PFW_guac_display_trace_begin_frame(display);
+    GUAC_PROBE2(frame_begin, display, display->pending_frame.frames);
     guac_rwlock_acquire_write_lock(&display->last_frame.lock);
 
     /* PASS 0: Create naive plan, identify minimal dirty rects by comparing the
@@ -332,7 +471,7 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
      * passes. */
     GUAC_DISPLAY_PLAN_BEGIN_PHASE();
     plan = PFW_LFR_guac_display_plan_create(display);
-    GUAC_DISPLAY_PLAN_END_PHASE(display, "draft", 1, 5);
+    GUAC_DISPLAY_PLAN_END_PHASE(display, "draft", 1, 6);
 
     if (plan != NULL) {
 
@@ -342,16 +481,29 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
          * replace those operations with simple rectangle draws. */
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
         PFR_guac_display_plan_rewrite_as_rects(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "rects", 2, 5);
-
-        /* PASS 2 (and 3): Index all modified cells by their graphical contents and
-         * search the previous frame for occurrences of the same content. Where any
-         * draws could instead be represented as copies from the previous frame, do
-         * so instead of sending new image data. */
+        GUAC_DISPLAY_PLAN_END_PHASE(display, "rects", 2, 6);
+
+        /* PASS 2 (and 3): Replace any draws of regions that have simply
+         * scrolled since the previous frame with a single copy. Index all
+         * remaining modified cells by their graphical contents and search the
+         * previous frame for occurrences of the same content. Where any draws
+         * could instead be represented as copies from the previous frame, do
+         * so instead of sending new image data. Remaining draws of cells that
+         * were sent recently are restored from the client-side cache of such
+         * cells, cells drawn entirely from hinted glyphs are sent as copies
+         * of those glyphs, draws of regions hinted as already encoded are
+         * sent using that encoded image data, and recently-used mouse
+         * cursors are restored from the client-side cache of such
+         * cursors. */
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
+        PFR_LFR_guac_display_plan_rewrite_as_scrolls(plan);
         PFR_guac_display_plan_index_dirty_cells(plan);
         PFR_LFR_guac_display_plan_rewrite_as_copies(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "search", 3, 5);
+        PFR_guac_display_plan_rewrite_as_cached(plan);
+        PFR_LFR_guac_display_plan_rewrite_as_glyphs(plan);
+        PFR_guac_display_plan_rewrite_as_hinted_images(plan);
+        PFR_guac_display_plan_rewrite_as_cached_cursor(plan);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, "search", 3, 6);
 
         /* PASS 4 (and 5): Combine adjacent updates in horizontal and vertical
          * directions where doing so would be more efficient. The goal of these
@@ -361,7 +513,15 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
         GUAC_DISPLAY_PLAN_BEGIN_PHASE();
         PFW_guac_display_plan_combine_horizontally(plan);
         PFW_guac_display_plan_combine_vertically(plan);
-        GUAC_DISPLAY_PLAN_END_PHASE(display, "combine", 4, 5);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, "combine", 4, 6);
+
+        /* PASS 6: If delta updates are enabled, retain the previous contents
+         * of any regions that may be sent as delta updates. This must be done
+         * before the pending frame is committed, as committing the frame
+         * overwrites those contents. */
+        GUAC_DISPLAY_PLAN_BEGIN_PHASE();
+        LFR_guac_display_plan_retain_previous(plan);
+        GUAC_DISPLAY_PLAN_END_PHASE(display, "delta", 5, 6);
 
     }
 
@@ -376,14 +536,29 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
 
     GUAC_DISPLAY_PLAN_BEGIN_PHASE();
     frame_nonempty = PFW_LFW_guac_display_frame_complete(display);
-    GUAC_DISPLAY_PLAN_END_PHASE(display, "commit", 5, 5);
+    GUAC_DISPLAY_PLAN_END_PHASE(display, "commit", 6, 6);
 
     guac_rwlock_release_lock(&display->last_frame.lock);
 
+    /* Notify any watchers of render_state that a frame is now in progress
+     * (NOTE: This must not be done while holding the last_frame.lock, as
+     * watchers may themselves hold a read lock while waiting for the frame to
+     * finish) */
+    guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
+    guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+    guac_flag_unlock(&display->render_state);
+
+    guac_fifo_lock(&display->ops);
+    display->frame_encoding_start = guac_timestamp_current();
+    display->trace.frame_queued = guac_display_encoder_clock();
+    display->trace.frame_dequeued = 0;
+    guac_fifo_unlock(&display->ops);
+
     /* Awaken worker threads to perform the rest of the tasks required for the
      * frame (if any such tasks remain) */
+    size_t worker_ops = 0;
     if (plan != NULL) {
-        guac_display_plan_apply(plan);
+        worker_ops = guac_display_plan_apply(plan);
         guac_display_plan_free(plan);
     }
 
@@ -393,11 +568,41 @@ void guac_display_end_multiple_frames(guac_display* display, int frames) {
      * then we must still send at least one operation to awaken the workers,
      * flush any layer changes, and mark the end of the frame with a "sync",
      * even though there is no display plan to optimize.  */
-    if (frame_nonempty) {
+    if (frame_nonempty && !worker_ops) {
+
         guac_display_plan_operation end_frame_op = {
             .type = GUAC_DISPLAY_PLAN_OPERATION_NOP
         };
-        guac_fifo_enqueue(&display->ops, &end_frame_op);
+
+        atomic_fetch_add(&display->frame_ops, 1);
+        if (guac_display_queue_operation(display, &end_frame_op))
+            worker_ops++;
+        else
+            atomic_fetch_sub(&display->frame_ops, 1);
+
+    }
+
+    /* Even if nothing has changed, regions sent at reduced quality may have
+     * stopped changing for long enough to be refined, which is handled by
+     * the worker threads like the refinement of any other frame */
+    if (!worker_ops) {
+        guac_rwlock_acquire_read_lock(&display->last_frame.lock);
+        guac_fifo_lock(&display->ops);
+        display->frame_refining = LFR_guac_display_queue_refinements(display);
+        if (display->frame_refining)
+            worker_ops++;
+        guac_fifo_unlock(&display->ops);
+        guac_rwlock_release_lock(&display->last_frame.lock);
+    }
+
+    /* If there is nothing for the worker threads to do, the frame is already
+     * complete (NOTE: No other frame can have been deferred in the meantime,
+     * as this thread holds the pending_frame.lock) */
+    if (!worker_ops) {
+        guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+        guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
+        guac_flag_unlock(&display->render_state);
+        atomic_store(&display->frame_ops, 0);
     }
 
 finished_with_pending_frame_lock:
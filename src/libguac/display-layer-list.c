@@ -134,7 +134,8 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
         return;
 
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-    unsigned char* buffer = guac_mem_zalloc(height, stride);
+    unsigned char* buffer = guac_mem_zalloc_pages(height, stride);
+    guac_mem_tag_pages(buffer, GUAC_MEM_CATEGORY_DISPLAY);
 
     /* Copy over data from old shared buffer, if that data exists and is
      * relevant */
@@ -154,7 +155,7 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
                 /* All pixels are 32-bit */
                 GUAC_DISPLAY_LAYER_RAW_BPP);
 
-        guac_mem_free(frame_state->buffer);
+        guac_mem_free_pages(frame_state->buffer);
 
     }
 
@@ -167,7 +168,13 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
 
 /**
  * Fully initializes the last and pending frame states for a newly-allocated
- * layer, including its underlying image buffers.
+ * layer, including its underlying image buffers. As the contents of a new
+ * layer are identical in both states, only the pending frame receives its own
+ * buffer, with the last frame initially sharing that buffer until the layer
+ * is first drawn to (see PFW_guac_display_layer_unshare_last_frame()).
+ *
+ * @param layer
+ *     The layer whose last and pending frame states are being initialized.
  *
  * @param last_frame
  *     The guac_display_layer_state representing the state of the layer at the
@@ -178,7 +185,8 @@ static void XFW_guac_display_layer_buffer_resize(guac_display_layer_state* frame
  *     the layer for the upcoming frame to be eventually sent to connected
  *     clients.
  */
-static void PFW_LFW_guac_display_layer_state_init(guac_display_layer_state* last_frame,
+static void PFW_LFW_guac_display_layer_state_init(guac_display_layer* layer,
+        guac_display_layer_state* last_frame,
         guac_display_layer_state* pending_frame) {
 
     last_frame->width = pending_frame->width = GUAC_DISPLAY_RESIZE_FACTOR;
@@ -186,12 +194,15 @@ static void PFW_LFW_guac_display_layer_state_init(guac_display_layer_state* last
     last_frame->opacity = pending_frame->opacity = 0xFF;
     last_frame->parent = pending_frame->parent = GUAC_DEFAULT_LAYER;
 
-    XFW_guac_display_layer_buffer_resize(last_frame,
-            last_frame->width, last_frame->height);
-
     XFW_guac_display_layer_buffer_resize(pending_frame,
             pending_frame->width, pending_frame->height);
 
+    last_frame->buffer = pending_frame->buffer;
+    last_frame->buffer_width = pending_frame->buffer_width;
+    last_frame->buffer_height = pending_frame->buffer_height;
+    last_frame->buffer_stride = pending_frame->buffer_stride;
+    layer->last_frame_shared = 1;
+
 }
 
 /**
@@ -262,7 +273,8 @@ guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* la
     /* Init tracking of pending and last frames (NOTE: We need not acquire the
      * display-wide last_frame.lock here as this new layer will not actually be
      * part of the last frame layer list until the pending frame is flushed) */
-    PFW_LFW_guac_display_layer_state_init(&display_layer->last_frame, &display_layer->pending_frame);
+    PFW_LFW_guac_display_layer_state_init(display_layer,
+            &display_layer->last_frame, &display_layer->pending_frame);
     display_layer->last_frame_buffer = guac_client_alloc_buffer(display->client);
     PFW_guac_display_layer_pending_frame_cells_resize(display_layer,
             display_layer->pending_frame.width,
@@ -284,6 +296,48 @@ guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* la
 
 }
 
+/**
+ * Removes all copies and glyphs hinted for the given layer within the current
+ * pending frame that would copy from the given source layer. This function
+ * MUST be invoked before the source layer is freed. The pending frame lock of
+ * the display MUST be held for writing.
+ *
+ * @param layer
+ *     The layer whose hinted copies should be filtered.
+ *
+ * @param src_layer
+ *     The source layer that is being removed.
+ */
+static void PFW_guac_display_layer_forget_copy_hints(guac_display_layer* layer,
+        const guac_display_layer* src_layer) {
+
+    /* Hints are ignored entirely if too many were given */
+    int count = layer->pending_frame.copy_hint_count;
+    if (count <= GUAC_DISPLAY_MAX_COPY_HINTS) {
+
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            guac_display_copy_hint* hint = &layer->pending_frame.copy_hints[i];
+            if (hint->src_layer != src_layer)
+                layer->pending_frame.copy_hints[kept++] = *hint;
+        }
+
+        layer->pending_frame.copy_hint_count = kept;
+
+    }
+
+    /* Glyphs may likewise no longer be copied from the source layer */
+    size_t kept_glyphs = 0;
+    for (size_t i = 0; i < layer->pending_frame_glyph_hints_length; i++) {
+        guac_display_copy_hint* hint = &layer->pending_frame_glyph_hints[i];
+        if (hint->src_layer != src_layer)
+            layer->pending_frame_glyph_hints[kept_glyphs++] = *hint;
+    }
+
+    layer->pending_frame_glyph_hints_length = kept_glyphs;
+
+}
+
 void guac_display_remove_layer(guac_display_layer* display_layer) {
 
     guac_display* display = display_layer->display;
@@ -309,6 +363,13 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
     if (display_layer->pending_frame.next != NULL)
         display_layer->pending_frame.next->pending_frame.prev = display_layer->pending_frame.prev;
 
+    /* Copies hinted from this layer can no longer be performed */
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL) {
+        PFW_guac_display_layer_forget_copy_hints(current, display_layer);
+        current = current->pending_frame.next;
+    }
+
     guac_rwlock_release_lock(&display->pending_frame.lock);
 
     /*
@@ -334,6 +395,10 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
 
     guac_rwlock_release_lock(&display->last_frame.lock);
 
+    /* Cells of this layer that have not yet been stored within the cache can
+     * no longer be stored */
+    guac_display_cache_forget_layer(&display->cache, display_layer);
+
     /*
      * Layer has now been removed from both pending and last frame lists and
      * can be safely freed
@@ -359,10 +424,24 @@ void guac_display_remove_layer(guac_display_layer* display_layer) {
      * was replaced with an external buffer. */
 
     if (!display_layer->pending_frame.buffer_is_external)
-        guac_mem_free(display_layer->pending_frame.buffer);
+        guac_mem_free_pages(display_layer->pending_frame.buffer);
+
+    if (!display_layer->last_frame_shared)
+        guac_mem_free_pages(display_layer->last_frame.buffer);
 
-    guac_mem_free(display_layer->last_frame.buffer);
     guac_mem_free(display_layer->pending_frame_cells);
+    guac_mem_free(display_layer->pending_frame_glyph_hints);
+    guac_mem_free(display_layer->lossy_cells);
+
+    /* Free any tiles cached for newly-joined users */
+    LFW_guac_display_layer_free_dup_tiles(display_layer);
+
+    /* Free any image hints of either frame */
+    for (int i = 0; i < display_layer->pending_frame.image_hint_count; i++)
+        guac_display_image_hint_free(display_layer->pending_frame.image_hints[i]);
+
+    for (int i = 0; i < display_layer->last_frame.image_hint_count; i++)
+        guac_display_image_hint_free(display_layer->last_frame.image_hints[i]);
 
     guac_mem_free(display_layer);
 
@@ -384,9 +463,12 @@ void PFW_guac_display_layer_resize(guac_display_layer* layer, int width, int hei
     }
 
     /* Skip resizing underlying buffer if it's the caller that's responsible
-     * for resizing the buffer */
-    if (!layer->pending_frame.buffer_is_external)
+     * for resizing the buffer (the last frame must stop sharing the buffer
+     * first, as resizing may free it) */
+    if (!layer->pending_frame.buffer_is_external) {
+        PFW_guac_display_layer_unshare_last_frame(layer);
         XFW_guac_display_layer_buffer_resize(&layer->pending_frame, width, height);
+    }
 
     PFW_guac_display_layer_pending_frame_cells_resize(layer, width, height);
 
@@ -394,3 +476,28 @@ void PFW_guac_display_layer_resize(guac_display_layer* layer, int width, int hei
     layer->pending_frame.height = height;
 
 }
+
+void PFW_guac_display_layer_unshare_last_frame(guac_display_layer* layer) {
+
+    if (!layer->last_frame_shared)
+        return;
+
+    /* The last frame may be read by worker threads (or by a call to
+     * guac_display_dup()) at any time, and so must be locked while its
+     * buffer is replaced */
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_write_lock(&display->last_frame.lock);
+
+    size_t buffer_size = guac_mem_ckd_mul_or_die(layer->last_frame.buffer_height,
+            layer->last_frame.buffer_stride);
+
+    unsigned char* buffer = guac_mem_zalloc_pages(buffer_size);
+    guac_mem_tag_pages(buffer, GUAC_MEM_CATEGORY_DISPLAY);
+    memcpy(buffer, layer->last_frame.buffer, buffer_size);
+
+    layer->last_frame.buffer = buffer;
+    layer->last_frame_shared = 0;
+
+    guac_rwlock_release_lock(&display->last_frame.lock);
+
+}
@@ -20,10 +20,12 @@
 #include "display-priv.h"
 #include "guacamole/assert.h"
 #include "guacamole/display.h"
+#include "guacamole/mem.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
 
 #include <cairo/cairo.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -45,6 +47,218 @@ static void PFW_guac_display_layer_touch(guac_display_layer* layer) {
 
 }
 
+/**
+ * Marks all cells of the given layer that intersect the given rectangle as
+ * damaged, such that they will be compared against the last frame when the
+ * pending frame is flushed. Any part of the rectangle outside the bounds of
+ * the layer's cells is ignored.
+ *
+ * @param layer
+ *     The layer that was modified.
+ *
+ * @param rect
+ *     The region of the layer that was modified.
+ */
+static void PFW_guac_display_layer_mark_damaged(guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    guac_rect damaged = *rect;
+    if (guac_rect_is_empty(&damaged))
+        return;
+
+    guac_rect cell_bounds = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->pending_frame_cells_width * GUAC_DISPLAY_CELL_SIZE,
+        .bottom = layer->pending_frame_cells_height * GUAC_DISPLAY_CELL_SIZE
+    };
+
+    guac_rect_constrain(&damaged, &cell_bounds);
+    if (guac_rect_is_empty(&damaged))
+        return;
+
+    int left   = damaged.left / GUAC_DISPLAY_CELL_SIZE;
+    int top    = damaged.top / GUAC_DISPLAY_CELL_SIZE;
+    int right  = GUAC_DISPLAY_CELL_DIMENSION(damaged.right);
+    int bottom = GUAC_DISPLAY_CELL_DIMENSION(damaged.bottom);
+
+    for (int y = top; y < bottom; y++) {
+
+        guac_display_layer_cell* cell = layer->pending_frame_cells
+            + guac_mem_ckd_mul_or_die(y, layer->pending_frame_cells_width) + left;
+
+        for (int x = left; x < right; x++)
+            (cell++)->damaged = 1;
+
+    }
+
+}
+
+void guac_display_layer_mark_dirty(guac_display_layer* layer, const guac_rect* rect) {
+
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    guac_rect dirty = *rect;
+    guac_rect bounds = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
+
+    guac_rect_constrain(&dirty, &bounds);
+    if (!guac_rect_is_empty(&dirty)) {
+        guac_rect_extend(&layer->pending_frame.dirty, &dirty);
+        PFW_guac_display_layer_mark_damaged(layer, &dirty);
+        PFW_guac_display_layer_touch(layer);
+    }
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
+void guac_display_layer_hint_copy(guac_display_layer* layer,
+        const guac_rect* src, int x, int y) {
+    guac_display_layer_hint_copy_from(layer, layer, src, x, y);
+}
+
+void guac_display_layer_hint_copy_from(guac_display_layer* layer,
+        guac_display_layer* src_layer, const guac_rect* src, int x, int y) {
+
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    int index = layer->pending_frame.copy_hint_count;
+    if (!guac_rect_is_empty(src) && index <= GUAC_DISPLAY_MAX_COPY_HINTS) {
+
+        if (index < GUAC_DISPLAY_MAX_COPY_HINTS) {
+            guac_display_copy_hint* hint = &layer->pending_frame.copy_hints[index];
+            hint->src_layer = src_layer;
+            hint->src = *src;
+            guac_rect_init(&hint->dest, x, y, guac_rect_width(src), guac_rect_height(src));
+        }
+
+        /* Once too many copies have been hinted, the count need only record
+         * that the limit was exceeded, as the layer must then be searched as
+         * usual */
+        layer->pending_frame.copy_hint_count++;
+
+    }
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
+void guac_display_layer_hint_glyph(guac_display_layer* layer,
+        guac_display_layer* src_layer, const guac_rect* src, int x, int y) {
+
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    size_t length = layer->pending_frame_glyph_hints_length;
+    if (!guac_rect_is_empty(src) && length < GUAC_DISPLAY_MAX_GLYPH_HINTS) {
+
+        /* Grow storage for hints as needed, dropping the hint if storage
+         * cannot be grown (it would merely be an optimization) */
+        if (length == layer->pending_frame_glyph_hints_size) {
+
+            size_t size = length ? length * 2 : GUAC_DISPLAY_INITIAL_GLYPH_HINTS;
+            guac_display_copy_hint* hints = guac_mem_realloc(
+                    layer->pending_frame_glyph_hints, size,
+                    sizeof(guac_display_copy_hint));
+
+            if (hints != NULL) {
+                layer->pending_frame_glyph_hints = hints;
+                layer->pending_frame_glyph_hints_size = size;
+            }
+
+        }
+
+        if (length < layer->pending_frame_glyph_hints_size) {
+            guac_display_copy_hint* hint = &layer->pending_frame_glyph_hints[length];
+            hint->src_layer = src_layer;
+            hint->src = *src;
+            guac_rect_init(&hint->dest, x, y, guac_rect_width(src), guac_rect_height(src));
+            layer->pending_frame_glyph_hints_length++;
+        }
+
+    }
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
+void guac_display_layer_hint_image(guac_display_layer* layer,
+        const guac_rect* rect, const char* mimetype, const void* data,
+        size_t length) {
+
+    guac_display* display = layer->display;
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+
+    guac_rect bounds = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
+
+    guac_rect constrained = *rect;
+    guac_rect_constrain(&constrained, &bounds);
+
+    /* Hints are only useful for regions that can be sent lossily and exactly
+     * as hinted */
+    if (layer->opaque && !layer->pending_frame.lossless
+            && layer->pending_frame.buffer != NULL
+            && layer->pending_frame.image_hint_count < GUAC_DISPLAY_MAX_IMAGE_HINTS
+            && !guac_rect_is_empty(rect)
+            && guac_rect_width(&constrained) == guac_rect_width(rect)
+            && guac_rect_height(&constrained) == guac_rect_height(rect)
+            && length > 0
+            && strlen(mimetype) < GUAC_DISPLAY_IMAGE_HINT_MIMETYPE_SIZE) {
+
+        guac_display_image_hint* hint = guac_mem_alloc(sizeof(guac_display_image_hint));
+        hint->rect = *rect;
+        strcpy(hint->mimetype, mimetype);
+
+        hint->data = guac_mem_alloc(length);
+        hint->length = length;
+        memcpy(hint->data, data, length);
+
+        /* Record the contents of the region such that any later change to
+         * that region can be detected */
+        size_t row_length = guac_mem_ckd_mul_or_die(guac_rect_width(rect), GUAC_DISPLAY_LAYER_RAW_BPP);
+        int height = guac_rect_height(rect);
+
+        hint->snapshot = guac_mem_alloc(row_length, height);
+
+        const unsigned char* src = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, *rect);
+        unsigned char* snapshot = hint->snapshot;
+        for (int y = 0; y < height; y++) {
+            memcpy(snapshot, src, row_length);
+            snapshot += row_length;
+            src += layer->pending_frame.buffer_stride;
+        }
+
+        layer->pending_frame.image_hints[layer->pending_frame.image_hint_count++] = hint;
+
+    }
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
+void guac_display_image_hint_free(guac_display_image_hint* hint) {
+
+    if (hint == NULL)
+        return;
+
+    guac_mem_free(hint->data);
+    guac_mem_free(hint->snapshot);
+    guac_mem_free(hint);
+
+}
+
 void guac_display_layer_get_bounds(guac_display_layer* layer, guac_rect* bounds) {
 
     guac_display* display = layer->display;
@@ -191,6 +405,10 @@ guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer*
     guac_display* display = layer->display;
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
 
+    /* The caller may modify the buffer, which must therefore no longer double
+     * as the last frame */
+    PFW_guac_display_layer_unshare_last_frame(layer);
+
     /* Flush any outstanding Cairo operations before directly accessing buffer */
     guac_display_layer_cairo_context* cairo_context = &(layer->pending_frame_cairo_context);
     if (cairo_context->surface != NULL)
@@ -222,7 +440,7 @@ void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_
      * buffer details. */
     if (context->buffer != layer->pending_frame.buffer
             && !layer->pending_frame.buffer_is_external) {
-        guac_mem_free(layer->pending_frame.buffer);
+        guac_mem_free_pages(layer->pending_frame.buffer);
         layer->pending_frame.buffer_is_external = 1;
     }
 
@@ -258,6 +476,7 @@ void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_
     }
 
     guac_rect_extend(&layer->pending_frame.dirty, &context->dirty);
+    PFW_guac_display_layer_mark_damaged(layer, &context->dirty);
     PFW_guac_display_layer_touch(layer);
 
     /* Apply any hinting regarding scroll/copy optimization */
@@ -268,6 +487,225 @@ void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_
 
 }
 
+/**
+ * Returns whether any of the given cells of the given layer have been claimed
+ * by an open region. The display-level regions_lock must be held.
+ *
+ * @param layer
+ *     The layer containing the cells.
+ *
+ * @param cells
+ *     The cells to test, in units of cells rather than pixels.
+ *
+ * @return
+ *     Non-zero if any of the given cells have been claimed, zero otherwise.
+ */
+static int guac_display_layer_cells_claimed(guac_display_layer* layer,
+        const guac_rect* cells) {
+
+    for (int y = cells->top; y < cells->bottom; y++) {
+
+        guac_display_layer_cell* cell = layer->pending_frame_cells
+            + guac_mem_ckd_mul_or_die(y, layer->pending_frame_cells_width) + cells->left;
+
+        for (int x = cells->left; x < cells->right; x++) {
+            if ((cell++)->claimed)
+                return 1;
+        }
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Claims or releases the given cells of the given layer. The display-level
+ * regions_lock must be held.
+ *
+ * @param layer
+ *     The layer containing the cells.
+ *
+ * @param cells
+ *     The cells to claim or release, in units of cells rather than pixels.
+ *
+ * @param claimed
+ *     Non-zero if the cells should be claimed, zero if they should be
+ *     released.
+ */
+static void guac_display_layer_claim_cells(guac_display_layer* layer,
+        const guac_rect* cells, int claimed) {
+
+    for (int y = cells->top; y < cells->bottom; y++) {
+
+        guac_display_layer_cell* cell = layer->pending_frame_cells
+            + guac_mem_ckd_mul_or_die(y, layer->pending_frame_cells_width) + cells->left;
+
+        for (int x = cells->left; x < cells->right; x++)
+            (cell++)->claimed = claimed;
+
+    }
+
+}
+
+guac_display_layer_raw_context* guac_display_layer_open_region(
+        guac_display_layer* layer, const guac_rect* rect) {
+
+    guac_display* display = layer->display;
+
+    /* Acquire shared access to the pending frame, first obtaining exclusive
+     * access just long enough to ensure the buffer no longer doubles as the
+     * last frame if necessary (the buffer cannot become shared again until
+     * the next frame is flushed, which requires exclusive access) */
+    for (;;) {
+
+        guac_rwlock_acquire_read_lock(&display->pending_frame.lock);
+        if (!layer->last_frame_shared)
+            break;
+
+        guac_rwlock_release_lock(&display->pending_frame.lock);
+        guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+        PFW_guac_display_layer_unshare_last_frame(layer);
+        guac_rwlock_release_lock(&display->pending_frame.lock);
+
+    }
+
+    guac_display_layer_region* region = guac_mem_alloc(sizeof(guac_display_layer_region));
+
+    /* Constrain region to the bounds of the layer */
+    guac_rect bounds = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
+
+    region->bounds = *rect;
+    guac_rect_constrain(&region->bounds, &bounds);
+
+    if (guac_rect_is_empty(&region->bounds))
+        region->bounds = region->cells = (guac_rect) { 0 };
+
+    /* Claim all cells touched by the region, waiting for any overlapping
+     * region to be closed first */
+    else {
+
+        guac_rect cell_bounds = {
+            .left   = 0,
+            .top    = 0,
+            .right  = layer->pending_frame_cells_width,
+            .bottom = layer->pending_frame_cells_height
+        };
+
+        region->cells = (guac_rect) {
+            .left   = region->bounds.left / GUAC_DISPLAY_CELL_SIZE,
+            .top    = region->bounds.top / GUAC_DISPLAY_CELL_SIZE,
+            .right  = GUAC_DISPLAY_CELL_DIMENSION(region->bounds.right),
+            .bottom = GUAC_DISPLAY_CELL_DIMENSION(region->bounds.bottom)
+        };
+
+        guac_rect_constrain(&region->cells, &cell_bounds);
+
+        pthread_mutex_lock(&display->regions_lock);
+
+        while (guac_display_layer_cells_claimed(layer, &region->cells))
+            pthread_cond_wait(&display->regions_released, &display->regions_lock);
+
+        guac_display_layer_claim_cells(layer, &region->cells, 1);
+
+        pthread_mutex_unlock(&display->regions_lock);
+
+    }
+
+    region->context = (guac_display_layer_raw_context) {
+        .buffer = layer->pending_frame.buffer,
+        .stride = layer->pending_frame.buffer_stride,
+        .dirty = { 0 },
+        .hint_from = layer,
+        .bounds = region->bounds
+    };
+
+    return &region->context;
+
+}
+
+void guac_display_layer_close_region(guac_display_layer* layer,
+        guac_display_layer_raw_context* context) {
+
+    guac_display* display = layer->display;
+    guac_display_layer_region* region = (guac_display_layer_region*) context;
+
+    /* Accept changes only within the region */
+    guac_rect dirty = context->dirty;
+    guac_rect_constrain(&dirty, &region->bounds);
+
+    /* NOTE: Only a read lock on the pending frame is held here, but all cells
+     * touched by the region's changes are exclusively claimed by the region,
+     * and thus may safely be marked damaged */
+    if (!guac_rect_is_empty(&dirty))
+        PFW_guac_display_layer_mark_damaged(layer, &dirty);
+
+    pthread_mutex_lock(&display->regions_lock);
+
+    /* Defer updating the dirty rect of the pending frame until the frame
+     * ends, when exclusive access is held anyway */
+    if (!guac_rect_is_empty(&dirty)) {
+
+        guac_rect_extend(&layer->pending_frame_regions_dirty, &dirty);
+
+        if (context->hint_from != NULL)
+            context->hint_from->pending_frame_regions_search = 1;
+
+        display->regions_modified = 1;
+
+    }
+
+    /* Allow overlapping regions to be opened */
+    if (!guac_rect_is_empty(&region->cells)) {
+        guac_display_layer_claim_cells(layer, &region->cells, 0);
+        pthread_cond_broadcast(&display->regions_released);
+    }
+
+    pthread_mutex_unlock(&display->regions_lock);
+
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+    guac_mem_free(region);
+
+}
+
+void PFW_guac_display_merge_regions(guac_display* display) {
+
+    pthread_mutex_lock(&display->regions_lock);
+
+    if (display->regions_modified) {
+
+        guac_display_layer* current = display->pending_frame.layers;
+        while (current != NULL) {
+
+            if (!guac_rect_is_empty(&current->pending_frame_regions_dirty)) {
+                guac_rect_extend(&current->pending_frame.dirty,
+                        &current->pending_frame_regions_dirty);
+                PFW_guac_display_layer_touch(current);
+                current->pending_frame_regions_dirty = (guac_rect) { 0 };
+            }
+
+            if (current->pending_frame_regions_search) {
+                current->pending_frame.search_for_copies = 1;
+                current->pending_frame_regions_search = 0;
+            }
+
+            current = current->pending_frame.next;
+
+        }
+
+        display->regions_modified = 0;
+
+    }
+
+    pthread_mutex_unlock(&display->regions_lock);
+
+}
+
 guac_display_layer_cairo_context* guac_display_layer_open_cairo(guac_display_layer* layer) {
 
     guac_display* display = layer->display;
@@ -280,6 +718,10 @@ guac_display_layer_cairo_context* guac_display_layer_open_cairo(guac_display_lay
      * contexts is not safe nor allowed. */
     GUAC_ASSERT(layer->pending_frame.buffer != NULL);
 
+    /* The caller may modify the buffer, which must therefore no longer double
+     * as the last frame */
+    PFW_guac_display_layer_unshare_last_frame(layer);
+
     guac_display_layer_cairo_context* context = &(layer->pending_frame_cairo_context);
 
     context->dirty = (guac_rect) { 0 };
@@ -313,6 +755,7 @@ void guac_display_layer_close_cairo(guac_display_layer* layer, guac_display_laye
     guac_display* display = layer->display;
 
     guac_rect_extend(&layer->pending_frame.dirty, &context->dirty);
+    PFW_guac_display_layer_mark_damaged(layer, &context->dirty);
     PFW_guac_display_layer_touch(layer);
 
     /* Apply any hinting regarding scroll/copy optimization */
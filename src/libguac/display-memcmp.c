@@ -0,0 +1,310 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-memcmp.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+size_t guac_display_memcmp_scalar(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+
+    /* Locate first difference between the buffers, if any */
+    size_t first = 0;
+    while (first < count) {
+
+        if (*(buffer_a++) != *(buffer_b++))
+            break;
+
+        first++;
+
+    }
+
+    /* If we reached the end without finding any differences, no need to search
+     * further - the buffers are identical */
+    if (first >= count)
+        return 0;
+
+    /* Search through all remaining values in the buffers for the last
+     * difference (which may be identical to the first) */
+    size_t last = first;
+    size_t offset = first + 1;
+    while (offset < count) {
+
+        if (*(buffer_a++) != *(buffer_b++))
+            last = offset;
+
+        offset++;
+
+    }
+
+    /* Final difference found - provide caller with the starting offset and
+     * length (in 32-bit quantities) of differences */
+    *pos = first;
+    return last - first + 1;
+
+}
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+/*
+ * NOTE: Each of the accelerated implementations below follows the same
+ * general approach: the first difference is located by scanning forward from
+ * the start of the buffers, and the last difference is located by scanning
+ * backward from the end of the buffers, stopping at the first difference.
+ * Vector comparisons produce a bitmask with one bit per byte compared (four
+ * bits per 32-bit quantity), thus the offset of a differing 32-bit quantity
+ * within a vector is the offset of its lowest/highest differing bit divided
+ * by four.
+ */
+
+__attribute__((target("sse2")))
+size_t guac_display_memcmp_sse2(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+
+    size_t first = 0;
+
+    /* Locate first difference four 32-bit quantities at a time */
+    for (; first + 4 <= count; first += 4) {
+
+        __m128i a = _mm_loadu_si128((const __m128i*) (buffer_a + first));
+        __m128i b = _mm_loadu_si128((const __m128i*) (buffer_b + first));
+
+        unsigned int diff = ~_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) & 0xFFFF;
+        if (diff) {
+            first += __builtin_ctz(diff) / 4;
+            goto found_first;
+        }
+
+    }
+
+    /* Check any trailing quantities that do not fill a vector */
+    for (; first < count; first++) {
+        if (buffer_a[first] != buffer_b[first])
+            goto found_first;
+    }
+
+    /* No differences at all */
+    return 0;
+
+found_first:;
+
+    /* Check any trailing quantities that do not fill a vector for the last
+     * difference (there is guaranteed to be at least one difference at or
+     * after "first", thus this search will terminate before passing it) */
+    size_t end = count;
+    size_t vector_end = first + ((count - first) & ~((size_t) 3));
+    while (end > vector_end) {
+        end--;
+        if (buffer_a[end] != buffer_b[end])
+            goto found_last;
+    }
+
+    /* Locate last difference four 32-bit quantities at a time */
+    for (;;) {
+
+        end -= 4;
+
+        __m128i a = _mm_loadu_si128((const __m128i*) (buffer_a + end));
+        __m128i b = _mm_loadu_si128((const __m128i*) (buffer_b + end));
+
+        unsigned int diff = ~_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)) & 0xFFFF;
+        if (diff) {
+            end += (31 - __builtin_clz(diff)) / 4;
+            break;
+        }
+
+    }
+
+found_last:
+    *pos = first;
+    return end - first + 1;
+
+}
+
+__attribute__((target("avx2")))
+size_t guac_display_memcmp_avx2(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+
+    size_t first = 0;
+
+    /* Locate first difference eight 32-bit quantities at a time */
+    for (; first + 8 <= count; first += 8) {
+
+        __m256i a = _mm256_loadu_si256((const __m256i*) (buffer_a + first));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (buffer_b + first));
+
+        unsigned int diff = ~((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)));
+        if (diff) {
+            first += __builtin_ctz(diff) / 4;
+            goto found_first;
+        }
+
+    }
+
+    /* Check any trailing quantities that do not fill a vector */
+    for (; first < count; first++) {
+        if (buffer_a[first] != buffer_b[first])
+            goto found_first;
+    }
+
+    /* No differences at all */
+    return 0;
+
+found_first:;
+
+    /* Check any trailing quantities that do not fill a vector for the last
+     * difference (there is guaranteed to be at least one difference at or
+     * after "first", thus this search will terminate before passing it) */
+    size_t end = count;
+    size_t vector_end = first + ((count - first) & ~((size_t) 7));
+    while (end > vector_end) {
+        end--;
+        if (buffer_a[end] != buffer_b[end])
+            goto found_last;
+    }
+
+    /* Locate last difference eight 32-bit quantities at a time */
+    for (;;) {
+
+        end -= 8;
+
+        __m256i a = _mm256_loadu_si256((const __m256i*) (buffer_a + end));
+        __m256i b = _mm256_loadu_si256((const __m256i*) (buffer_b + end));
+
+        unsigned int diff = ~((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)));
+        if (diff) {
+            end += (31 - __builtin_clz(diff)) / 4;
+            break;
+        }
+
+    }
+
+found_last:
+    *pos = first;
+    return end - first + 1;
+
+}
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+size_t guac_display_memcmp_neon(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+
+    size_t first = 0;
+
+    /* Skip past identical data four 32-bit quantities at a time, leaving the
+     * exact offset of the difference to be determined by the scalar search
+     * that follows */
+    for (; first + 4 <= count; first += 4) {
+        uint32x4_t eq = vceqq_u32(vld1q_u32(buffer_a + first), vld1q_u32(buffer_b + first));
+        if (vminvq_u32(eq) != 0xFFFFFFFF)
+            break;
+    }
+
+    for (; first < count; first++) {
+        if (buffer_a[first] != buffer_b[first])
+            break;
+    }
+
+    /* No differences at all */
+    if (first >= count)
+        return 0;
+
+    /* Check any trailing quantities that do not fill a vector for the last
+     * difference (there is guaranteed to be at least one difference at or
+     * after "first", thus this search will terminate before passing it) */
+    size_t end = count;
+    size_t vector_end = first + ((count - first) & ~((size_t) 3));
+    while (end > vector_end) {
+        end--;
+        if (buffer_a[end] != buffer_b[end])
+            goto found_last;
+    }
+
+    /* Skip backward past identical data four 32-bit quantities at a time */
+    for (;;) {
+
+        end -= 4;
+
+        uint32x4_t eq = vceqq_u32(vld1q_u32(buffer_a + end), vld1q_u32(buffer_b + end));
+        if (vminvq_u32(eq) != 0xFFFFFFFF) {
+
+            /* Narrow down to the exact last difference within the vector */
+            end += 3;
+            while (buffer_a[end] == buffer_b[end])
+                end--;
+
+            break;
+
+        }
+
+    }
+
+found_last:
+    *pos = first;
+    return end - first + 1;
+
+}
+
+#endif
+
+guac_display_memcmp_function* guac_display_memcmp_select(const char** name) {
+
+    const char* selected_name = "scalar";
+    guac_display_memcmp_function* selected = guac_display_memcmp_scalar;
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        selected_name = "AVX2";
+        selected = guac_display_memcmp_avx2;
+    }
+
+    else if (__builtin_cpu_supports("sse2")) {
+        selected_name = "SSE2";
+        selected = guac_display_memcmp_sse2;
+    }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+    selected_name = "NEON";
+    selected = guac_display_memcmp_neon;
+
+#endif
+
+    if (name != NULL)
+        *name = selected_name;
+
+    return selected;
+
+}
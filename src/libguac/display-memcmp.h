@@ -0,0 +1,120 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_DISPLAY_MEMCMP_H
+#define GUAC_DISPLAY_MEMCMP_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Variant of memcmp() which specifically compares series of 32-bit quantities
+ * and determines the overall location and length of the differences in the two
+ * provided buffers. The length and location determined are the length and
+ * location of the smallest contiguous series of 32-bit quantities that differ
+ * between the buffers.
+ *
+ * All implementations of this function (scalar or otherwise) MUST produce
+ * exactly the same results for the same input.
+ *
+ * @param buffer_a
+ *     The first buffer to compare.
+ *
+ * @param buffer_b
+ *     The buffer to compare with buffer_a.
+ *
+ * @param count
+ *     The number of 32-bit quantities in each buffer.
+ *
+ * @param pos
+ *     A pointer to a size_t that should receive the offset of the difference,
+ *     if the two buffers turn out to contain different data. The value of the
+ *     size_t will only be modified if at least one difference is found.
+ *
+ * @return
+ *     The number of 32-bit quantities after and including the offset returned
+ *     via pos that are different between buffer_a and buffer_b, or zero if
+ *     there are no such differences.
+ */
+typedef size_t guac_display_memcmp_function(const uint32_t* restrict buffer_a,
+        const uint32_t* restrict buffer_b, size_t count, size_t* pos);
+
+/**
+ * Portable, scalar implementation of guac_display_memcmp_function which
+ * compares the given buffers one 32-bit quantity at a time. This
+ * implementation is always available and serves as the reference against
+ * which all other implementations are verified.
+ *
+ * @see guac_display_memcmp_function
+ */
+guac_display_memcmp_function guac_display_memcmp_scalar;
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+/**
+ * Implementation of guac_display_memcmp_function which compares four 32-bit
+ * quantities at a time using SSE2 instructions. This implementation may only
+ * be invoked if the current processor supports SSE2.
+ *
+ * @see guac_display_memcmp_function
+ */
+guac_display_memcmp_function guac_display_memcmp_sse2;
+
+/**
+ * Implementation of guac_display_memcmp_function which compares eight 32-bit
+ * quantities at a time using AVX2 instructions. This implementation may only
+ * be invoked if the current processor supports AVX2.
+ *
+ * @see guac_display_memcmp_function
+ */
+guac_display_memcmp_function guac_display_memcmp_avx2;
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+/**
+ * Implementation of guac_display_memcmp_function which compares four 32-bit
+ * quantities at a time using NEON instructions. NEON is mandatory on AArch64,
+ * and thus this implementation is always safe to invoke when available.
+ *
+ * @see guac_display_memcmp_function
+ */
+guac_display_memcmp_function guac_display_memcmp_neon;
+
+#endif
+
+/**
+ * Returns the fastest implementation of guac_display_memcmp_function that is
+ * supported by the current processor. The scalar implementation is returned
+ * if no accelerated implementation is supported.
+ *
+ * @param name
+ *     A pointer to a const char* that should receive a human-readable name
+ *     for the selected implementation, such as "AVX2", or NULL if no such
+ *     name is needed.
+ *
+ * @return
+ *     The fastest supported implementation of guac_display_memcmp_function.
+ */
+guac_display_memcmp_function* guac_display_memcmp_select(const char** name);
+
+#endif
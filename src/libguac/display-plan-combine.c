@@ -20,8 +20,11 @@
 #include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/display.h"
+#include "guacamole/mem.h"
 #include "guacamole/rect.h"
 
+#include <limits.h>
+
 /**
  * Returns whether the given rectangle crosses the boundaries of any two
  * adjacent cells in a grid, where each cell in the grid is
@@ -61,44 +64,53 @@ static int guac_display_plan_rect_crosses_boundary(const guac_rect* rect) {
  * Returns whether the two rectangles are adjacent and share exactly one common
  * edge.
  *
- * @param op_a
+ * @param a
  *     One of the rectangles to compare.
  *
- * @param op_b
- *     The rectangle to compare op_a with.
+ * @param b
+ *     The rectangle to compare a with.
  *
  * @return
  *     Non-zero if the rectangles are adjacent and share exactly one common
  *     edge, zero otherwise.
  */
-static int guac_display_plan_has_common_edge(const guac_display_plan_operation* op_a,
-        const guac_display_plan_operation* op_b) {
+static int guac_display_plan_rects_share_edge(const guac_rect* a,
+        const guac_rect* b) {
 
-    /* Two operations share a common edge if they are perfectly aligned
+    /* Two rectangles share a common edge if they are perfectly aligned
      * vertically and have the same left/right or right/left edge */
-    if (op_a->dest.top == op_b->dest.top
-            && op_a->dest.bottom == op_b->dest.bottom) {
-
-        return op_a->dest.right == op_b->dest.left
-            || op_a->dest.left == op_b->dest.right;
+    if (a->top == b->top && a->bottom == b->bottom)
+        return a->right == b->left || a->left == b->right;
 
-    }
-
-    /* Two operations share a common edge if they are perfectly aligned
+    /* Two rectangles share a common edge if they are perfectly aligned
      * horizontally and have the same top/bottom or bottom/top edge */
-    else if (op_a->dest.left == op_b->dest.left
-            && op_a->dest.right == op_b->dest.right) {
-
-        return op_a->dest.top == op_b->dest.bottom
-            || op_a->dest.bottom == op_b->dest.top;
-
-    }
+    else if (a->left == b->left && a->right == b->right)
+        return a->top == b->bottom || a->bottom == b->top;
 
-    /* There are no other cases where two operations share a common edge */
+    /* There are no other cases where two rectangles share a common edge */
     return 0;
 
 }
 
+/**
+ * Returns whether the destination rectangles of the two operations are
+ * adjacent and share exactly one common edge.
+ *
+ * @param op_a
+ *     One of the operations to compare.
+ *
+ * @param op_b
+ *     The operation to compare op_a with.
+ *
+ * @return
+ *     Non-zero if the destination rectangles of the operations are adjacent
+ *     and share exactly one common edge, zero otherwise.
+ */
+static int guac_display_plan_has_common_edge(const guac_display_plan_operation* op_a,
+        const guac_display_plan_operation* op_b) {
+    return guac_display_plan_rects_share_edge(&op_a->dest, &op_b->dest);
+}
+
 /**
  * Returns whether the given pair of operations should be combined into a
  * single operation.
@@ -196,6 +208,47 @@ static int guac_display_plan_should_combine(const guac_display_plan_operation* o
 
 }
 
+/**
+ * Unconditionally combines the given pair of operations into a single
+ * operation, storing the result within the first operation and updating the
+ * second operation to be a GUAC_DISPLAY_PLAN_OPERATION_NOP operation. If the
+ * operations differ in type, the combined operation is an image update.
+ *
+ * @param op_a
+ *     The first of the pair of operations to be combined, which will receive
+ *     the combined operation.
+ *
+ * @param op_b
+ *     The second of the pair of operations to be combined, which must not be
+ *     identical to the first.
+ */
+static void guac_display_plan_combine(guac_display_plan_operation* op_a,
+        guac_display_plan_operation* op_b) {
+
+    guac_rect_extend(&op_a->dest, &op_b->dest);
+
+    /* Operations of different types can only be combined as images */
+    if (op_a->type != op_b->type)
+        op_a->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
+
+    /* When combining two copy operations, additionally combine their
+     * source rects (NOT just the destination rects) */
+    else if (op_a->type == GUAC_DISPLAY_PLAN_OPERATION_COPY)
+        guac_rect_extend(&op_a->src.layer_rect.rect, &op_b->src.layer_rect.rect);
+
+    op_a->dirty_size += op_b->dirty_size;
+
+    if (op_b->last_frame > op_a->last_frame)
+        op_a->last_frame = op_b->last_frame;
+
+    /* The combination is in sustained motion only if all of it is */
+    if (op_b->motion_frames < op_a->motion_frames)
+        op_a->motion_frames = op_b->motion_frames;
+
+    op_b->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+
+}
+
 /**
  * Combines the given pair of operations into a single operation if doing so is
  * advantageous (results in an operation of lesser or negligibly-worse cost).
@@ -222,62 +275,346 @@ static int guac_display_plan_combine_if_improved(guac_display_plan_operation* op
     /* Combine any adjacent operations that match the combination criteria
      * (combining produces a net lower cost) */
     if (guac_display_plan_should_combine(op_a, op_b)) {
+        guac_display_plan_combine(op_a, op_b);
+        return 1;
+    }
 
-        guac_rect_extend(&op_a->dest, &op_b->dest);
+    return 0;
 
-        /* Operations of different types can only be combined as images */
-        if (op_a->type != op_b->type)
-            op_a->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
+}
 
-        /* When combining two copy operations, additionally combine their
-         * source rects (NOT just the destination rects) */
-        else if (op_a->type == GUAC_DISPLAY_PLAN_OPERATION_COPY)
-            guac_rect_extend(&op_a->src.layer_rect.rect, &op_b->src.layer_rect.rect);
+/**
+ * Returns the estimated cost of sending a single operation of the given type
+ * covering the given number of pixels, using the same cost model as
+ * guac_display_plan_should_combine().
+ *
+ * @param type
+ *     The type of the operation.
+ *
+ * @param size
+ *     The number of pixels covered by the operation.
+ *
+ * @return
+ *     The estimated cost of the operation.
+ */
+static int guac_display_plan_cost(guac_display_plan_operation_type type,
+        int size) {
 
-        op_a->dirty_size += op_b->dirty_size;
+    int cost = GUAC_DISPLAY_BASE_COST + size;
 
-        if (op_b->last_frame > op_a->last_frame)
-            op_a->last_frame = op_b->last_frame;
+    /* Reduce cost if no image data */
+    if (type != GUAC_DISPLAY_PLAN_OPERATION_IMG)
+        cost /= GUAC_DISPLAY_DATA_FACTOR;
 
-        op_b->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+    return cost;
 
-        return 1;
+}
+
+/**
+ * Returns the type of the operation that would result from combining the
+ * given operation into a combination of type current_type, where that
+ * combination begins with the given first operation and currently covers the
+ * given rectangle. Copies and rectangle fills remain copies and rectangle
+ * fills only if they can be trivially unified as described by
+ * guac_display_plan_should_combine(). All other combinations are image
+ * updates.
+ *
+ * @param current_type
+ *     The type of the combination thus far.
+ *
+ * @param first
+ *     The first operation within the combination.
+ *
+ * @param combined
+ *     The rectangle covered by the combination thus far.
+ *
+ * @param op
+ *     The operation being added to the combination.
+ *
+ * @return
+ *     The type of the combination after op has been added.
+ */
+static guac_display_plan_operation_type guac_display_plan_combined_type(
+        guac_display_plan_operation_type current_type,
+        const guac_display_plan_operation* first, const guac_rect* combined,
+        const guac_display_plan_operation* op) {
+
+    if (current_type == op->type
+            && guac_display_plan_rects_share_edge(combined, &op->dest)) {
+
+        switch (current_type) {
+
+            /* Copies must continue to copy from the same source layer in the
+             * same direction */
+            case GUAC_DISPLAY_PLAN_OPERATION_COPY:
+                if (first->src.layer_rect.layer == op->src.layer_rect.layer
+                        && first->dest.left - first->src.layer_rect.rect.left
+                            == op->dest.left - op->src.layer_rect.rect.left
+                        && first->dest.top - first->src.layer_rect.rect.top
+                            == op->dest.top - op->src.layer_rect.rect.top)
+                    return GUAC_DISPLAY_PLAN_OPERATION_COPY;
+                break;
+
+            /* Rectangle fills must continue to draw the same color */
+            case GUAC_DISPLAY_PLAN_OPERATION_RECT:
+                if (first->src.color == op->src.color)
+                    return GUAC_DISPLAY_PLAN_OPERATION_RECT;
+                break;
+
+            default:
+                break;
+
+        }
 
     }
 
-    return 0;
+    return GUAC_DISPLAY_PLAN_OPERATION_IMG;
+
+}
+
+/**
+ * Partitions a run of horizontally-adjacent operations into the set of
+ * combined operations having the lowest total estimated cost, combining each
+ * resulting group of operations into its first operation. Rather than
+ * greedily combining each operation with its neighbor, each possible grouping
+ * of consecutive operations is considered via dynamic programming: the
+ * lowest cost of each prefix of the run is the lowest cost of any shorter
+ * prefix plus the cost of the single combined operation covering the
+ * remainder. Groups are limited in size exactly as combined images are
+ * limited by guac_display_plan_should_combine(), and the number of groups
+ * considered is thus linear in the length of the run.
+ *
+ * This avoids both failure modes of greedy combination for fragmented
+ * updates: a series of small updates that each individually appear too costly
+ * to combine with their neighbor but together would be cheaper as a single
+ * image, and a chain of negligible increases in cost that together produce a
+ * single, needlessly large image.
+ *
+ * @param ops
+ *     The run of distinct, non-NOP operations to partition, in left-to-right
+ *     order. Each operation that is combined into another is updated to be a
+ *     GUAC_DISPLAY_PLAN_OPERATION_NOP operation.
+ *
+ * @param count
+ *     The number of operations in the run, which must not exceed
+ *     GUAC_DISPLAY_PLAN_MAX_RUN.
+ *
+ * @param heads
+ *     An array of at least count entries which will receive, for each
+ *     operation in the run, the index of the operation that it was combined
+ *     into (or its own index if it was not combined with any preceding
+ *     operation).
+ */
+static void guac_display_plan_partition_run(guac_display_plan_operation** ops,
+        int count, int* heads) {
+
+    /* The lowest total cost of each prefix of the run, and the index of the
+     * first operation of the last group within that lowest-cost partition */
+    int best[GUAC_DISPLAY_PLAN_MAX_RUN + 1];
+    int start[GUAC_DISPLAY_PLAN_MAX_RUN + 1];
+    guac_display_plan_operation_type types[GUAC_DISPLAY_PLAN_MAX_RUN + 1];
+
+    best[0] = 0;
+    for (int i = 1; i <= count; i++)
+        best[i] = INT_MAX;
+
+    for (int i = 0; i < count; i++) {
+
+        guac_display_plan_operation* first = ops[i];
+
+        /* Each operation may always be sent on its own */
+        int cost = best[i] + guac_display_plan_cost(first->type,
+                first->dirty_size);
+
+        if (cost < best[i + 1]) {
+            best[i + 1] = cost;
+            start[i + 1] = i;
+            types[i + 1] = first->type;
+        }
+
+        /* Consider each larger group beginning with this operation until the
+         * group can no longer be sent as a single operation */
+        guac_rect combined = first->dest;
+        guac_display_plan_operation_type type = first->type;
+        for (int j = i + 1; j < count; j++) {
+
+            guac_display_plan_operation* op = ops[j];
+            type = guac_display_plan_combined_type(type, first, &combined, op);
+
+            guac_rect_extend(&combined, &op->dest);
+            if (guac_display_plan_rect_crosses_boundary(&combined))
+                break;
+
+            cost = best[i] + guac_display_plan_cost(type,
+                    guac_rect_width(&combined) * guac_rect_height(&combined));
+
+            if (cost < best[j + 1]) {
+                best[j + 1] = cost;
+                start[j + 1] = i;
+                types[j + 1] = type;
+            }
+
+        }
+
+    }
+
+    /* Combine each group of the lowest-cost partition, working backwards
+     * from the end of the run */
+    for (int end = count; end > 0; end = start[end]) {
+
+        int head = start[end];
+        for (int i = head + 1; i < end; i++) {
+            guac_display_plan_combine(ops[head], ops[i]);
+            heads[i] = head;
+        }
+
+        ops[head]->type = types[end];
+        heads[head] = head;
+
+    }
+
+}
+
+/**
+ * A single task of the pass that combines horizontally-adjacent operations,
+ * covering a contiguous range of rows of cells within a single layer.
+ */
+typedef struct guac_display_plan_combine_task {
+
+    /**
+     * The layer being processed.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The index of the first row of cells to be processed.
+     */
+    int first_row;
+
+    /**
+     * The number of rows of cells to be processed.
+     */
+    int rows;
+
+} guac_display_plan_combine_task;
+
+/**
+ * Combines any horizontally-adjacent operations within the rows of cells of a
+ * guac_display_plan_combine_task, if doing so is advantageous. Operations are
+ * only ever combined with other operations within the same row, and thus each
+ * row may be processed independently. This function is a
+ * guac_display_plan_task_callback.
+ *
+ * @param data
+ *     A pointer to the guac_display_plan_combine_task to perform.
+ */
+static void PFW_guac_display_plan_combine_rows_horizontally(void* data) {
+
+    guac_display_plan_combine_task* task = (guac_display_plan_combine_task*) data;
+    guac_display_layer* current = task->layer;
+
+    guac_display_plan_operation* ops[GUAC_DISPLAY_PLAN_MAX_RUN];
+    int heads[GUAC_DISPLAY_PLAN_MAX_RUN];
+    int cell_ops[GUAC_DISPLAY_PLAN_MAX_RUN];
+
+    /* Loop through all rows of cells, partitioning each run of cells
+     * containing horizontally-adjacent operations into the lowest-cost set of
+     * combined operations */
+
+    guac_display_layer_cell* row = current->pending_frame_cells
+        + task->first_row * current->pending_frame_cells_width;
+
+    for (int y = 0; y < task->rows; y++) {
+
+        int x = 0;
+        while (x < current->pending_frame_cells_width) {
+
+            /* Skip any cells not involved in a combinable operation */
+            guac_display_layer_cell* run = row + x;
+            if (run->related_op == NULL
+                    || run->related_op->type == GUAC_DISPLAY_PLAN_OPERATION_NOP) {
+                x++;
+                continue;
+            }
+
+            /* Gather the distinct operations of the run, noting which
+             * operation each cell belongs to */
+            int count = 0;
+            int length = 0;
+            while (x + length < current->pending_frame_cells_width
+                    && length < GUAC_DISPLAY_PLAN_MAX_RUN) {
+
+                guac_display_plan_operation* op = run[length].related_op;
+                if (op == NULL || op->type == GUAC_DISPLAY_PLAN_OPERATION_NOP)
+                    break;
+
+                if (count == 0 || ops[count - 1] != op)
+                    ops[count++] = op;
+
+                cell_ops[length++] = count - 1;
+
+            }
+
+            guac_display_plan_partition_run(ops, count, heads);
+
+            /* Point each cell at the operation that now covers it */
+            for (int i = 0; i < length; i++)
+                run[i].related_op = ops[heads[cell_ops[i]]];
+
+            x += length;
+
+        }
+
+        row += current->pending_frame_cells_width;
+
+    }
 
 }
 
 void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan) {
 
     guac_display* display = plan->display;
-    guac_display_layer* current = display->pending_frame.layers;
+    guac_display_layer* current;
+
+    /* Determine the number of tasks required to process all modified layers,
+     * splitting each layer into bands of rows of cells */
+    size_t task_count = 0;
+    current = display->pending_frame.layers;
     while (current != NULL) {
 
         /* Process only layers that have been modified */
-        if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
+        if (!guac_rect_is_empty(&current->pending_frame.dirty))
+            task_count += (current->pending_frame_cells_height + GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT - 1)
+                / GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT;
 
-            /* Loop through all cells in left-to-right, top-to-bottom order,
-             * combining any operations that are combinable and horizontally
-             * adjacent. */
+        current = current->pending_frame.next;
 
-            guac_display_layer_cell* cell = current->pending_frame_cells;
-            for (int y = 0; y < current->pending_frame_cells_height; y++) {
+    }
 
-                guac_display_layer_cell* previous = cell++;
-                for (int x = 1; x < current->pending_frame_cells_width; x++) {
+    if (!task_count)
+        return;
 
-                    /* Combine adjacent updates if doing so is advantageous */
-                    if (previous->related_op != NULL && cell->related_op != NULL
-                            && guac_display_plan_combine_if_improved(previous->related_op, cell->related_op)) {
-                        cell->related_op = previous->related_op;
-                    }
+    guac_display_plan_combine_task* tasks = guac_display_arena_alloc(
+            &display->plan_arena, task_count,
+            sizeof(guac_display_plan_combine_task));
 
-                    previous++;
-                    cell++;
+    guac_display_plan_combine_task* task = tasks;
+    current = display->pending_frame.layers;
+    while (current != NULL) {
+
+        if (!guac_rect_is_empty(&current->pending_frame.dirty)) {
+
+            for (int y = 0; y < current->pending_frame_cells_height; y += GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT) {
+
+                int rows = current->pending_frame_cells_height - y;
+                if (rows > GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT)
+                    rows = GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT;
+
+                task->layer = current;
+                task->first_row = y;
+                task->rows = rows;
+                task++;
 
-                }
             }
 
         }
@@ -286,6 +623,9 @@ void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan) {
 
     }
 
+    guac_display_plan_run_tasks(display, PFW_guac_display_plan_combine_rows_horizontally,
+            tasks, sizeof(guac_display_plan_combine_task), task_count);
+
 }
 
 void PFW_guac_display_plan_combine_vertically(guac_display_plan* plan) {
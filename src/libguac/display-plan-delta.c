@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/fifo.h"
+#include "guacamole/mem.h"
+#include "guacamole/rect.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Returns whether the given operation may be sent as a delta update, and thus
+ * whether the previous contents of its destination rect should be retained.
+ * Only image operations on opaque layers that lie entirely within the bounds
+ * of the previous frame can be sent as delta updates, as the client-side
+ * contents of any other region are either undefined or will not show through
+ * transparent pixels. Regions awaiting refinement are also excluded, as their
+ * client-side contents are known to differ from the previous frame. The ops
+ * FIFO of the display must be locked.
+ *
+ * @param op
+ *     The operation to test.
+ *
+ * @return
+ *     Non-zero if the given operation may be sent as a delta update, zero
+ *     otherwise.
+ */
+static int LFR_guac_display_plan_delta_possible(guac_display_plan_operation* op) {
+
+    guac_display_layer* layer = op->layer;
+
+    if (op->type != GUAC_DISPLAY_PLAN_OPERATION_IMG || !layer->opaque
+            || layer->last_frame.buffer == NULL)
+        return 0;
+
+    /* Hinted image data is always sent as-is */
+    if (op->image != NULL)
+        return 0;
+
+    if ((size_t) guac_rect_width(&op->dest) * guac_rect_height(&op->dest) > GUAC_DISPLAY_DELTA_MAX_SIZE)
+        return 0;
+
+    if (op->dest.left < 0 || op->dest.top < 0
+            || op->dest.right > layer->last_frame.width
+            || op->dest.bottom > layer->last_frame.height)
+        return 0;
+
+    return !guac_rect_intersects(&op->dest, &layer->refinement);
+
+}
+
+void LFR_guac_display_plan_retain_previous(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_plan_operation* op;
+
+    /* Clear any stale references to previously-retained contents, as plan
+     * operations are not zeroed upon allocation */
+    op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+        op->previous = NULL;
+        op++;
+    }
+
+    if (!display->delta_updates)
+        return;
+
+    /* The ops FIFO must remain locked while checking whether each operation
+     * overlaps a pending refinement (display worker threads are idle at this
+     * point, so no meaningful contention is introduced) */
+    guac_fifo_lock(&display->ops);
+
+    /* Determine how much storage is needed for all retained contents */
+    size_t required = 0;
+
+    op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (LFR_guac_display_plan_delta_possible(op))
+            required += (size_t) guac_rect_width(&op->dest)
+                * guac_rect_height(&op->dest) * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+        op++;
+
+    }
+
+    if (!required) {
+        guac_fifo_unlock(&display->ops);
+        return;
+    }
+
+    /* Grow storage only as needed, reusing the same buffer for all frames */
+    if (required > display->previous_buffer_size) {
+        guac_mem_free(display->previous_buffer);
+        display->previous_buffer = guac_mem_alloc(required);
+        display->previous_buffer_size = required;
+    }
+
+    /* Copy the previous contents of each retained rect */
+    unsigned char* current = display->previous_buffer;
+
+    op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (LFR_guac_display_plan_delta_possible(op)) {
+
+            guac_display_layer* layer = op->layer;
+
+            size_t row_length = (size_t) guac_rect_width(&op->dest) * GUAC_DISPLAY_LAYER_RAW_BPP;
+            const unsigned char* src = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, op->dest);
+
+            op->previous = current;
+
+            for (int y = op->dest.top; y < op->dest.bottom; y++) {
+                memcpy(current, src, row_length);
+                current += row_length;
+                src += layer->last_frame.buffer_stride;
+            }
+
+        }
+
+        op++;
+
+    }
+
+    guac_fifo_unlock(&display->ops);
+
+}
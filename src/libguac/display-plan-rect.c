@@ -202,12 +202,40 @@ static int guac_display_plan_is_rect_single_color(const unsigned char* restrict
 
 }
 
-void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
+/**
+ * A single task of the pass that rewrites image operations as rect
+ * operations, covering a contiguous range of operations within a plan.
+ */
+typedef struct guac_display_plan_rect_task {
+
+    /**
+     * The first operation in the range of operations to be processed.
+     */
+    guac_display_plan_operation* ops;
+
+    /**
+     * The number of operations in the range.
+     */
+    size_t length;
+
+} guac_display_plan_rect_task;
 
+/**
+ * Rewrites each image operation within the range of operations of a
+ * guac_display_plan_rect_task as a rect operation, if the image data of that
+ * operation consists of a single color. This function is a
+ * guac_display_plan_task_callback.
+ *
+ * @param data
+ *     A pointer to the guac_display_plan_rect_task to perform.
+ */
+static void PFR_guac_display_plan_rewrite_range_as_rects(void* data) {
+
+    guac_display_plan_rect_task* task = (guac_display_plan_rect_task*) data;
     uint32_t color = 0x00000000;
 
-    guac_display_plan_operation* op = plan->ops;
-    for (int i = 0; i < plan->length; i++) {
+    guac_display_plan_operation* op = task->ops;
+    for (size_t i = 0; i < task->length; i++) {
 
         if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG) {
 
@@ -238,3 +266,38 @@ void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
     }
 
 }
+
+void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan) {
+
+    size_t length = plan->length;
+    if (!length)
+        return;
+
+    /* Split the plan into ranges of operations that can be independently
+     * checked for single-color image data */
+    size_t task_count = (length + GUAC_DISPLAY_PLAN_TASK_OPERATIONS - 1)
+        / GUAC_DISPLAY_PLAN_TASK_OPERATIONS;
+
+    guac_display_plan_rect_task* tasks = guac_display_arena_alloc(
+            &plan->display->plan_arena, task_count,
+            sizeof(guac_display_plan_rect_task));
+
+    guac_display_plan_operation* ops = plan->ops;
+    for (size_t i = 0; i < task_count; i++) {
+
+        size_t task_length = length;
+        if (task_length > GUAC_DISPLAY_PLAN_TASK_OPERATIONS)
+            task_length = GUAC_DISPLAY_PLAN_TASK_OPERATIONS;
+
+        tasks[i].ops = ops;
+        tasks[i].length = task_length;
+
+        ops += task_length;
+        length -= task_length;
+
+    }
+
+    guac_display_plan_run_tasks(plan->display, PFR_guac_display_plan_rewrite_range_as_rects,
+            tasks, sizeof(guac_display_plan_rect_task), task_count);
+
+}
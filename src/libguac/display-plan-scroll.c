@@ -0,0 +1,1048 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-plan.h"
+#include "display-priv.h"
+#include "guacamole/fifo.h"
+#include "guacamole/mem.h"
+#include "guacamole/rect.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The multiplier of the polynomial hash used to hash entire rows and columns
+ * of image data. Unlike the multiplier used to hash individual cells, this
+ * value is odd, such that every pixel of a row or column contributes to the
+ * hash regardless of the length of that row or column.
+ */
+#define GUAC_SCROLL_HASH_MULTIPLIER ((uint64_t) 0x100000001B3)
+
+/**
+ * The multiplier used to distribute row hashes across the slots of a
+ * guac_display_scroll_index (Fibonacci hashing).
+ */
+#define GUAC_SCROLL_INDEX_MULTIPLIER ((uint64_t) 0x9E3779B97F4A7C15)
+
+/**
+ * A single slot of the open-addressed table used by
+ * guac_display_plan_find_scroll() to locate the row of the previous frame
+ * having a particular hash.
+ */
+typedef struct guac_display_scroll_index_entry {
+
+    /**
+     * The hash of the row stored in this slot.
+     */
+    uint64_t hash;
+
+    /**
+     * One greater than the index of the row stored in this slot, zero if this
+     * slot is empty, or -1 if multiple rows share the same hash (and thus no
+     * single row can be associated with that hash).
+     */
+    int index;
+
+} guac_display_scroll_index_entry;
+
+/**
+ * Calculates the hash of each row of the given rectangular region of the
+ * image buffer of the given layer state. Four interleaved hashes are computed
+ * for each row and then combined, such that the hashes of consecutive pixels
+ * can be calculated in parallel.
+ *
+ * @param layer_state
+ *     The layer state containing the image buffer to hash.
+ *
+ * @param rect
+ *     The region of the image buffer to hash.
+ *
+ * @param hashes
+ *     The array that should receive the hash of each row. This array must
+ *     have at least as many elements as there are rows in the given region.
+ */
+static void guac_display_scroll_hash_rows(const guac_display_layer_state* layer_state,
+        const guac_rect* rect, uint64_t* restrict hashes) {
+
+    const unsigned char* data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(*layer_state, *rect);
+    int width = guac_rect_width(rect);
+    int height = guac_rect_height(rect);
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+        uint64_t h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+        int x = 0;
+
+        for (; x + 4 <= width; x += 4) {
+            h0 = h0 * GUAC_SCROLL_HASH_MULTIPLIER + row[x];
+            h1 = h1 * GUAC_SCROLL_HASH_MULTIPLIER + row[x + 1];
+            h2 = h2 * GUAC_SCROLL_HASH_MULTIPLIER + row[x + 2];
+            h3 = h3 * GUAC_SCROLL_HASH_MULTIPLIER + row[x + 3];
+        }
+
+        for (; x < width; x++)
+            h0 = h0 * GUAC_SCROLL_HASH_MULTIPLIER + row[x];
+
+        hashes[y] = ((h0 * GUAC_SCROLL_HASH_MULTIPLIER + h1)
+                * GUAC_SCROLL_HASH_MULTIPLIER + h2)
+                * GUAC_SCROLL_HASH_MULTIPLIER + h3;
+
+        data += layer_state->buffer_stride;
+
+    }
+
+}
+
+/**
+ * Calculates the hash of each column of the given rectangular region of the
+ * image buffer of the given layer state. The region is read one row at a time
+ * (rather than one column at a time), with the hashes of all columns updated
+ * for each row.
+ *
+ * @param layer_state
+ *     The layer state containing the image buffer to hash.
+ *
+ * @param rect
+ *     The region of the image buffer to hash.
+ *
+ * @param hashes
+ *     The array that should receive the hash of each column. This array must
+ *     have at least as many elements as there are columns in the given
+ *     region.
+ */
+static void guac_display_scroll_hash_columns(const guac_display_layer_state* layer_state,
+        const guac_rect* rect, uint64_t* restrict hashes) {
+
+    const unsigned char* data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(*layer_state, *rect);
+    int width = guac_rect_width(rect);
+    int height = guac_rect_height(rect);
+
+    memset(hashes, 0, width * sizeof(uint64_t));
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+        for (int x = 0; x < width; x++)
+            hashes[x] = hashes[x] * GUAC_SCROLL_HASH_MULTIPLIER + row[x];
+
+        data += layer_state->buffer_stride;
+
+    }
+
+}
+
+int guac_display_plan_find_scroll(guac_display_arena* arena,
+        const uint64_t* pending_hashes, const uint64_t* last_hashes,
+        int length, guac_display_plan_scroll* scroll) {
+
+    if (length < GUAC_DISPLAY_SCROLL_MIN_LENGTH)
+        return 0;
+
+    /* Index all rows of the previous frame by their hashes, using a table
+     * that is at least half empty */
+    int bits = 1;
+    while ((1 << bits) < length * 2)
+        bits++;
+
+    size_t mask = ((size_t) 1 << bits) - 1;
+    guac_display_scroll_index_entry* index = guac_display_arena_zalloc(arena,
+            (size_t) 1 << bits, sizeof(guac_display_scroll_index_entry));
+
+    for (int i = 0; i < length; i++) {
+
+        uint64_t hash = last_hashes[i];
+        size_t slot = (hash * GUAC_SCROLL_INDEX_MULTIPLIER) >> (64 - bits);
+
+        while (index[slot].index != 0 && index[slot].hash != hash)
+            slot = (slot + 1) & mask;
+
+        /* Rows that occur more than once cannot be attributed to any one
+         * offset */
+        if (index[slot].index != 0)
+            index[slot].index = -1;
+        else {
+            index[slot].hash = hash;
+            index[slot].index = i + 1;
+        }
+
+    }
+
+    /* Each changed row of the current frame that matches a unique row of the
+     * previous frame is a vote for the offset between those rows (NOTE: The
+     * offset of a vote is stored at index offset + length, and can never be
+     * zero, as unchanged rows are not considered) */
+    int* votes = guac_display_arena_zalloc(arena, length * 2, sizeof(int));
+
+    for (int i = 0; i < length; i++) {
+
+        uint64_t hash = pending_hashes[i];
+        if (hash == last_hashes[i])
+            continue;
+
+        size_t slot = (hash * GUAC_SCROLL_INDEX_MULTIPLIER) >> (64 - bits);
+        while (index[slot].index != 0 && index[slot].hash != hash)
+            slot = (slot + 1) & mask;
+
+        if (index[slot].index > 0)
+            votes[i - (index[slot].index - 1) + length]++;
+
+    }
+
+    int best_votes = 0;
+    int offset = 0;
+    for (int i = 1; i < length * 2; i++) {
+        if (votes[i] > best_votes) {
+            best_votes = votes[i];
+            offset = i - length;
+        }
+    }
+
+    if (best_votes < GUAC_DISPLAY_SCROLL_MIN_MATCHES)
+        return 0;
+
+    /* Find the longest contiguous range of rows that match at that offset
+     * (this range may include rows that did not vote, such as rows of solid
+     * background that occur more than once) */
+    int first = offset > 0 ? offset : 0;
+    int last = offset < 0 ? length + offset : length;
+
+    int best_start = 0;
+    int best_length = 0;
+    int run_start = first;
+
+    for (int i = first; i <= last; i++) {
+
+        if (i < last && pending_hashes[i] == last_hashes[i - offset])
+            continue;
+
+        if (i - run_start > best_length) {
+            best_start = run_start;
+            best_length = i - run_start;
+        }
+
+        run_start = i + 1;
+
+    }
+
+    if (best_length < GUAC_DISPLAY_SCROLL_MIN_LENGTH)
+        return 0;
+
+    scroll->offset = offset;
+    scroll->start = best_start;
+    scroll->end = best_start + best_length;
+    return 1;
+
+}
+
+/**
+ * Returns whether the given region of the pending frame of the given layer
+ * contains exactly the same image data as the given region of the last frame
+ * of the given source layer (which may be the same layer). Both regions must
+ * have the same dimensions.
+ *
+ * @param layer
+ *     The layer whose pending frame should be compared.
+ *
+ * @param dest
+ *     The region of the pending frame to compare.
+ *
+ * @param src_layer
+ *     The layer whose last frame should be compared.
+ *
+ * @param src
+ *     The region of the last frame to compare.
+ *
+ * @return
+ *     Non-zero if the regions contain identical image data, zero otherwise.
+ */
+static int PFR_LFR_guac_display_scroll_matches(guac_display_layer* layer,
+        const guac_rect* dest, guac_display_layer* src_layer,
+        const guac_rect* src) {
+
+    const unsigned char* pending = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, *dest);
+    const unsigned char* last = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(src_layer->last_frame, *src);
+
+    size_t length = (size_t) guac_rect_width(dest) * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    for (int y = dest->top; y < dest->bottom; y++) {
+
+        if (memcmp(pending, last, length))
+            return 0;
+
+        pending += layer->pending_frame.buffer_stride;
+        last += src_layer->last_frame.buffer_stride;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Returns whether the given operation is an operation of the given layer that
+ * draws new content that a scroll of that layer could replace.
+ *
+ * @param op
+ *     The operation to test.
+ *
+ * @param layer
+ *     The layer being scrolled.
+ *
+ * @return
+ *     Non-zero if the given operation could be replaced by a scroll of the
+ *     given layer, zero otherwise.
+ */
+static int guac_display_scroll_is_replaceable(const guac_display_plan_operation* op,
+        const guac_display_layer* layer) {
+    return op->layer == layer
+        && (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG
+         || op->type == GUAC_DISPLAY_PLAN_OPERATION_RECT);
+}
+
+/**
+ * Returns whether the first rectangle lies entirely within the second.
+ *
+ * @param rect
+ *     The rectangle to test.
+ *
+ * @param bounds
+ *     The rectangle that must contain the first rectangle.
+ *
+ * @return
+ *     Non-zero if the first rectangle lies entirely within the second, zero
+ *     otherwise.
+ */
+static int guac_display_scroll_rect_within(const guac_rect* rect,
+        const guac_rect* bounds) {
+    return rect->left   >= bounds->left
+        && rect->top    >= bounds->top
+        && rect->right  <= bounds->right
+        && rect->bottom <= bounds->bottom;
+}
+
+/**
+ * Removes the given operation from the cell of its destination layer that it
+ * was created for, such that the operation is not considered when combining
+ * adjacent operations. The operation must not yet have been combined with any
+ * other operation.
+ *
+ * @param op
+ *     The operation to remove from its cell.
+ */
+static void guac_display_scroll_unlink_op(guac_display_plan_operation* op) {
+
+    guac_display_layer* layer = op->layer;
+    guac_display_layer_cell* cell = layer->pending_frame_cells
+        + (op->dest.top / GUAC_DISPLAY_CELL_SIZE) * layer->pending_frame_cells_width
+        + op->dest.left / GUAC_DISPLAY_CELL_SIZE;
+
+    if (cell->related_op == op)
+        cell->related_op = NULL;
+
+}
+
+/**
+ * Trims the destination rect of the given operation such that it no longer
+ * overlaps the given scrolled region, if the remaining portion of that rect
+ * is itself a rectangle. If the entire operation lies within the scrolled
+ * region, the operation is replaced with a no-op.
+ *
+ * @param op
+ *     The operation to trim.
+ *
+ * @param scrolled
+ *     The destination rect of the scroll, which will contain the same image
+ *     data as the pending frame once the scroll has been performed.
+ */
+static void guac_display_scroll_trim_op(guac_display_plan_operation* op,
+        const guac_rect* scrolled) {
+
+    guac_rect* dest = &op->dest;
+    if (!guac_rect_intersects(dest, scrolled))
+        return;
+
+    size_t old_size = (size_t) guac_rect_width(dest) * guac_rect_height(dest);
+
+    if (guac_display_scroll_rect_within(dest, scrolled)) {
+        op->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+        guac_display_scroll_unlink_op(op);
+        return;
+    }
+
+    /* Trim vertically if the operation lies within the columns of the
+     * scrolled region */
+    if (dest->left >= scrolled->left && dest->right <= scrolled->right) {
+        if (dest->top >= scrolled->top)
+            dest->top = scrolled->bottom;
+        else if (dest->bottom <= scrolled->bottom)
+            dest->bottom = scrolled->top;
+    }
+
+    /* Trim horizontally if the operation lies within the rows of the
+     * scrolled region */
+    else if (dest->top >= scrolled->top && dest->bottom <= scrolled->bottom) {
+        if (dest->left >= scrolled->left)
+            dest->left = scrolled->right;
+        else if (dest->right <= scrolled->right)
+            dest->right = scrolled->left;
+    }
+
+    /* Scale the number of changed pixels by the portion of the operation that
+     * remains */
+    size_t new_size = (size_t) guac_rect_width(dest) * guac_rect_height(dest);
+    op->dirty_size = old_size ? op->dirty_size * new_size / old_size : 0;
+
+}
+
+/**
+ * Rewrites the given plan such that the given region of the given layer is
+ * drawn with a single copy from the given region of the last frame of the
+ * given source layer (which is the same layer for scrolls). One of the draw
+ * operations lying entirely within the destination region is replaced with
+ * that copy, while all other such draw operations are removed. If no draw
+ * operation lies entirely within the destination region, the plan is not
+ * modified.
+ *
+ * @param plan
+ *     The plan to modify.
+ *
+ * @param layer
+ *     The layer being scrolled or copied to.
+ *
+ * @param dest
+ *     The region of the layer receiving the scrolled image data.
+ *
+ * @param src_layer
+ *     The layer whose last frame should be copied from.
+ *
+ * @param src
+ *     The region of the last frame of the source layer that should be
+ *     copied.
+ */
+static void guac_display_plan_apply_scroll(guac_display_plan* plan,
+        guac_display_layer* layer, const guac_rect* dest,
+        guac_display_layer* src_layer, const guac_rect* src) {
+
+    /* Locate an operation to reuse for the copy */
+    guac_display_plan_operation* copy = NULL;
+    guac_display_plan_operation* op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (guac_display_scroll_is_replaceable(op, layer)
+                && guac_display_scroll_rect_within(&op->dest, dest)) {
+            copy = op;
+            break;
+        }
+
+        op++;
+
+    }
+
+    if (copy == NULL)
+        return;
+
+    guac_display_scroll_unlink_op(copy);
+
+    copy->type = GUAC_DISPLAY_PLAN_OPERATION_COPY;
+    copy->dest = *dest;
+    copy->dirty_size = (size_t) guac_rect_width(dest) * guac_rect_height(dest);
+    copy->src.layer_rect.layer = src_layer->last_frame_buffer;
+    copy->src.layer_rect.rect = *src;
+
+    /* Remove or trim all other draws that overlap the scrolled region (any
+     * remaining overlap is harmless, as both the copy and the draw produce
+     * the same image data there) */
+    op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (op != copy && guac_display_scroll_is_replaceable(op, layer))
+            guac_display_scroll_trim_op(op, dest);
+
+        op++;
+
+    }
+
+}
+
+/**
+ * Returns whether the given region of the given layer has been sent at
+ * reduced quality and is still awaiting refinement. Copying such regions
+ * would spread that reduced quality elsewhere.
+ *
+ * @param display
+ *     The display containing the given layer.
+ *
+ * @param layer
+ *     The layer to test.
+ *
+ * @param rect
+ *     The region of the layer to test.
+ *
+ * @return
+ *     Non-zero if any part of the given region is awaiting refinement, zero
+ *     otherwise.
+ */
+static int guac_display_scroll_is_refining(guac_display* display,
+        guac_display_layer* layer, const guac_rect* rect) {
+
+    /* The ops FIFO must be locked to check, but display worker threads are
+     * idle at this point, so no meaningful contention is introduced */
+    guac_fifo_lock(&display->ops);
+    int refining = guac_rect_intersects(rect, &layer->refinement);
+    guac_fifo_unlock(&display->ops);
+
+    return refining;
+
+}
+
+/**
+ * Returns whether the given copy, hinted for the given layer with
+ * guac_display_layer_hint_copy(), guac_display_layer_hint_copy_from(), or
+ * guac_display_layer_hint_glyph(), may be performed as a copy from the last
+ * frame of the hinted source layer, verifying the hint against the image data
+ * of both frames. Hints that are inaccurate, that extend beyond the bounds of
+ * either frame, or whose source has an alpha channel while the destination
+ * does not may not be performed.
+ *
+ * @param display
+ *     The display containing the given layer.
+ *
+ * @param layer
+ *     The layer that the copy was hinted for.
+ *
+ * @param hint
+ *     The hinted copy to verify.
+ *
+ * @return
+ *     Non-zero if the hinted copy may be performed, zero otherwise.
+ */
+static int PFR_LFR_guac_display_plan_verify_copy_hint(guac_display* display,
+        guac_display_layer* layer, const guac_display_copy_hint* hint) {
+
+    guac_display_layer* src_layer = hint->src_layer;
+
+    /* Copies from layers that are not opaque would be composited over the
+     * contents of opaque layers (the destinations of copies into layers that
+     * are not opaque are cleared first) */
+    if ((!src_layer->opaque && layer->opaque)
+            || src_layer->last_frame.buffer == NULL)
+        return 0;
+
+    guac_rect pending_frame_bounds = {
+        .left = 0,
+        .top = 0,
+        .right = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
+
+    guac_rect last_frame_bounds = {
+        .left = 0,
+        .top = 0,
+        .right = src_layer->last_frame.width,
+        .bottom = src_layer->last_frame.height
+    };
+
+    if (!guac_display_scroll_rect_within(&hint->src, &last_frame_bounds)
+            || !guac_display_scroll_rect_within(&hint->dest, &pending_frame_bounds))
+        return 0;
+
+    /* Only perform the copy if the image data is truly identical */
+    return PFR_LFR_guac_display_scroll_matches(layer, &hint->dest, src_layer, &hint->src)
+        && !guac_display_scroll_is_refining(display, src_layer, &hint->src);
+
+}
+
+/**
+ * Rewrites the given plan such that each copy explicitly hinted for the given
+ * layer with guac_display_layer_hint_copy() or
+ * guac_display_layer_hint_copy_from() is drawn with a single copy from the
+ * last frame of the hinted source layer. Hints that cannot be verified with
+ * PFR_LFR_guac_display_plan_verify_copy_hint() are ignored.
+ *
+ * @param plan
+ *     The plan to modify.
+ *
+ * @param layer
+ *     The layer whose hinted copies should be applied.
+ */
+static void PFR_LFR_guac_display_plan_apply_copy_hints(guac_display_plan* plan,
+        guac_display_layer* layer) {
+
+    for (int i = 0; i < layer->pending_frame.copy_hint_count; i++) {
+
+        const guac_display_copy_hint* hint = &layer->pending_frame.copy_hints[i];
+        if (!PFR_LFR_guac_display_plan_verify_copy_hint(plan->display, layer, hint))
+            continue;
+
+        guac_display_plan_apply_scroll(plan, layer, &hint->dest,
+                hint->src_layer, &hint->src);
+
+    }
+
+}
+
+/**
+ * Searches the modified region of the given layer for a single vertical or
+ * horizontal scroll, rewriting the given plan to perform that scroll with a
+ * copy if found. Vertical scrolling is checked first, as it is far more
+ * common. If copies have been explicitly hinted for the layer, those hints
+ * are applied instead, and no search is performed.
+ *
+ * @param plan
+ *     The plan to modify.
+ *
+ * @param layer
+ *     The layer to search.
+ */
+static void PFR_LFR_guac_display_plan_rewrite_layer_as_scroll(guac_display_plan* plan,
+        guac_display_layer* layer) {
+
+    if (layer->pending_frame.buffer == NULL)
+        return;
+
+    /* Copies hinted by the caller are far cheaper to verify than to find */
+    if (GUAC_DISPLAY_LAYER_STATE_HAS_COPY_HINTS(layer->pending_frame)) {
+        PFR_LFR_guac_display_plan_apply_copy_hints(plan, layer);
+        return;
+    }
+
+    /* Scrolls are searched for only within opaque layers, as these are the
+     * layers that are typically scrolled */
+    if (!layer->opaque || layer->last_frame.buffer == NULL)
+        return;
+
+    if (!layer->pending_frame.search_for_copies)
+        return;
+
+    /* Only the modified region that is present in both frames can have
+     * scrolled */
+    guac_rect last_frame_bounds = {
+        .left = 0,
+        .top = 0,
+        .right = layer->last_frame.width,
+        .bottom = layer->last_frame.height
+    };
+
+    guac_rect region = layer->pending_frame.dirty;
+    guac_rect_constrain(&region, &last_frame_bounds);
+
+    int width = guac_rect_width(&region);
+    int height = guac_rect_height(&region);
+    if (width < GUAC_DISPLAY_SCROLL_MIN_LENGTH || height < GUAC_DISPLAY_SCROLL_MIN_LENGTH)
+        return;
+
+    int length = width > height ? width : height;
+    guac_display_arena* arena = &plan->display->plan_arena;
+    uint64_t* pending_hashes = guac_display_arena_alloc(arena, length, sizeof(uint64_t));
+    uint64_t* last_hashes = guac_display_arena_alloc(arena, length, sizeof(uint64_t));
+
+    guac_display_plan_scroll scroll;
+    guac_rect dest, src;
+    int found = 0;
+
+    /* Compare entire rows for vertical scrolling */
+    guac_display_scroll_hash_rows(&layer->pending_frame, &region, pending_hashes);
+    guac_display_scroll_hash_rows(&layer->last_frame, &region, last_hashes);
+
+    if (guac_display_plan_find_scroll(arena, pending_hashes, last_hashes, height, &scroll)) {
+        guac_rect_init(&dest, region.left, region.top + scroll.start,
+                width, scroll.end - scroll.start);
+        guac_rect_init(&src, dest.left, dest.top - scroll.offset,
+                width, scroll.end - scroll.start);
+        found = 1;
+    }
+
+    /* Fall back to comparing entire columns for horizontal scrolling */
+    else {
+
+        guac_display_scroll_hash_columns(&layer->pending_frame, &region, pending_hashes);
+        guac_display_scroll_hash_columns(&layer->last_frame, &region, last_hashes);
+
+        if (guac_display_plan_find_scroll(arena, pending_hashes, last_hashes, width, &scroll)) {
+            guac_rect_init(&dest, region.left + scroll.start, region.top,
+                    scroll.end - scroll.start, height);
+            guac_rect_init(&src, dest.left - scroll.offset, dest.top,
+                    scroll.end - scroll.start, height);
+            found = 1;
+        }
+
+    }
+
+    /* Only perform the scroll if the image data is truly identical (not a
+     * collision) */
+    if (!found || !PFR_LFR_guac_display_scroll_matches(layer, &dest, layer, &src))
+        return;
+
+    /* Regions awaiting refinement were sent at reduced quality, and copying
+     * those regions would spread that reduced quality elsewhere */
+    if (guac_display_scroll_is_refining(plan->display, layer, &src))
+        return;
+
+    guac_display_plan_apply_scroll(plan, layer, &dest, layer, &src);
+
+}
+
+void PFR_LFR_guac_display_plan_rewrite_as_scrolls(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL) {
+        PFR_LFR_guac_display_plan_rewrite_layer_as_scroll(plan, current);
+        current = current->pending_frame.next;
+    }
+
+}
+
+/**
+ * Returns whether the given image hint still describes the pending frame of
+ * the given layer, comparing the snapshot taken when the hint was given
+ * against the current contents of the hinted region.
+ *
+ * @param layer
+ *     The layer that the hint was given for.
+ *
+ * @param hint
+ *     The hint to verify.
+ *
+ * @return
+ *     Non-zero if the hinted region is unchanged since the hint was given,
+ *     zero otherwise.
+ */
+static int PFR_guac_display_image_hint_matches(guac_display_layer* layer,
+        const guac_display_image_hint* hint) {
+
+    const unsigned char* pending = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, hint->rect);
+    const unsigned char* snapshot = hint->snapshot;
+
+    size_t length = (size_t) guac_rect_width(&hint->rect) * GUAC_DISPLAY_LAYER_RAW_BPP;
+
+    for (int y = hint->rect.top; y < hint->rect.bottom; y++) {
+
+        if (memcmp(pending, snapshot, length))
+            return 0;
+
+        pending += layer->pending_frame.buffer_stride;
+        snapshot += length;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Rewrites the given plan such that the given hinted region of the given
+ * layer is drawn with a single draw operation that sends the hinted image
+ * data. One of the draw operations lying entirely within the hinted region is
+ * replaced with that draw, while all other such draw operations are removed
+ * or trimmed. If no draw operation lies entirely within the hinted region
+ * (the region is mostly unchanged or has been replaced with copies), the plan
+ * is not modified.
+ *
+ * @param plan
+ *     The plan to modify.
+ *
+ * @param layer
+ *     The layer that the hint was given for.
+ *
+ * @param hint
+ *     The hint to apply.
+ */
+static void guac_display_plan_apply_image_hint(guac_display_plan* plan,
+        guac_display_layer* layer, const guac_display_image_hint* hint) {
+
+    const guac_rect* dest = &hint->rect;
+
+    /* Locate an operation to reuse for the hinted image, refusing to apply
+     * hints that overlap any hint already applied (the order in which
+     * overlapping images are drawn by worker threads is not defined) */
+    guac_display_plan_operation* draw = NULL;
+    guac_display_plan_operation* op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (op->layer == layer && op->image != NULL
+                && guac_rect_intersects(&op->dest, dest))
+            return;
+
+        if (draw == NULL && op->image == NULL
+                && guac_display_scroll_is_replaceable(op, layer)
+                && guac_display_scroll_rect_within(&op->dest, dest))
+            draw = op;
+
+        op++;
+
+    }
+
+    if (draw == NULL)
+        return;
+
+    guac_display_scroll_unlink_op(draw);
+
+    draw->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
+    draw->dest = *dest;
+    draw->dirty_size = (size_t) guac_rect_width(dest) * guac_rect_height(dest);
+    draw->image = hint;
+
+    /* Remove or trim all other draws that overlap the hinted region (any
+     * remaining overlap is harmless, as both draws produce the same image
+     * data there) */
+    op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        if (op != draw && op->image == NULL
+                && guac_display_scroll_is_replaceable(op, layer))
+            guac_display_scroll_trim_op(op, dest);
+
+        op++;
+
+    }
+
+}
+
+void PFR_guac_display_plan_rewrite_as_hinted_images(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL) {
+
+        guac_rect bounds = {
+            .left = 0,
+            .top = 0,
+            .right = current->pending_frame.width,
+            .bottom = current->pending_frame.height
+        };
+
+        /* Hinted image data is lossy and opaque */
+        if (current->opaque && !current->pending_frame.lossless
+                && current->pending_frame.buffer != NULL) {
+
+            for (int i = 0; i < current->pending_frame.image_hint_count; i++) {
+
+                const guac_display_image_hint* hint = current->pending_frame.image_hints[i];
+
+                if (guac_display_scroll_rect_within(&hint->rect, &bounds)
+                        && PFR_guac_display_image_hint_matches(current, hint))
+                    guac_display_plan_apply_image_hint(plan, current, hint);
+
+            }
+
+        }
+
+        current = current->pending_frame.next;
+
+    }
+
+}
+
+/**
+ * Returns the number of cells of the given layer that the given hinted glyph
+ * touches, or zero if the glyph does not lie entirely within the bounds of
+ * the pending frame of that layer (and thus cannot be copied).
+ *
+ * @param layer
+ *     The layer that the glyph was hinted for.
+ *
+ * @param hint
+ *     The hinted glyph.
+ *
+ * @return
+ *     The number of cells touched by the given glyph, or zero if the glyph
+ *     lies outside the bounds of the layer.
+ */
+static size_t guac_display_plan_glyph_cells(const guac_display_layer* layer,
+        const guac_display_copy_hint* hint) {
+
+    guac_rect pending_frame_bounds = {
+        .left = 0,
+        .top = 0,
+        .right = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
+
+    const guac_rect* dest = &hint->dest;
+    if (guac_rect_is_empty(dest)
+            || !guac_display_scroll_rect_within(dest, &pending_frame_bounds))
+        return 0;
+
+    size_t columns = ((dest->right - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT)
+        - (dest->left >> GUAC_DISPLAY_CELL_SIZE_EXPONENT) + 1;
+
+    size_t rows = ((dest->bottom - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT)
+        - (dest->top >> GUAC_DISPLAY_CELL_SIZE_EXPONENT) + 1;
+
+    return columns * rows;
+
+}
+
+/**
+ * Rewrites the given plan such that the draw operation of each cell of the
+ * given layer whose changes are entirely covered by accurate glyphs hinted
+ * with guac_display_layer_hint_glyph() is replaced with copies of those
+ * glyphs, appended to the glyphs array of the plan. Each glyph is split into
+ * one copy per cell that it touches, trimmed to the region of that cell that
+ * has actually changed. Glyphs overlapping another glyph already accepted for
+ * the same cell are ignored, such that the changes of a cell are known to be
+ * covered if the areas of its glyphs add up to that of its draw operation.
+ *
+ * @param plan
+ *     The plan to modify. The glyphs array of this plan must have space for
+ *     at least the number of copies returned by
+ *     guac_display_plan_glyph_cells() for every glyph hinted for the layer.
+ *
+ * @param layer
+ *     The layer whose hinted glyphs should be applied.
+ */
+static void PFR_LFR_guac_display_plan_apply_glyph_hints(guac_display_plan* plan,
+        guac_display_layer* layer) {
+
+    size_t count = layer->pending_frame_glyph_hints_length;
+    if (!count || layer->pending_frame.buffer == NULL)
+        return;
+
+    size_t capacity = 0;
+    for (size_t i = 0; i < count; i++)
+        capacity += guac_display_plan_glyph_cells(layer, &layer->pending_frame_glyph_hints[i]);
+
+    if (!capacity)
+        return;
+
+    guac_display_arena* arena = &plan->display->plan_arena;
+    size_t cells_width = layer->pending_frame_cells_width;
+    size_t cells_height = layer->pending_frame_cells_height;
+
+    /* The copies accepted for each cell are kept as a list of indices into
+     * the copies array (plus one, such that zero marks the end of the list),
+     * along with the number of changed pixels those copies cover */
+    guac_display_plan_glyph* copies = guac_display_arena_alloc(arena,
+            capacity, sizeof(guac_display_plan_glyph));
+    size_t* next = guac_display_arena_alloc(arena, capacity, sizeof(size_t));
+    size_t* first = guac_display_arena_zalloc(arena,
+            cells_width * cells_height, sizeof(size_t));
+    size_t* covered = guac_display_arena_zalloc(arena,
+            cells_width * cells_height, sizeof(size_t));
+
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+
+        const guac_display_copy_hint* hint = &layer->pending_frame_glyph_hints[i];
+        if (!guac_display_plan_glyph_cells(layer, hint)
+                || !PFR_LFR_guac_display_plan_verify_copy_hint(plan->display, layer, hint))
+            continue;
+
+        int offset_x = hint->src.left - hint->dest.left;
+        int offset_y = hint->src.top - hint->dest.top;
+
+        size_t left = hint->dest.left >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+        size_t top = hint->dest.top >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+        size_t right = (hint->dest.right - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+        size_t bottom = (hint->dest.bottom - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+
+        for (size_t y = top; y <= bottom && y < cells_height; y++) {
+            for (size_t x = left; x <= right && x < cells_width; x++) {
+
+                /* Only cells that must otherwise be sent as new image data
+                 * benefit from being copied glyph by glyph */
+                size_t index = y * cells_width + x;
+                guac_display_plan_operation* op = layer->pending_frame_cells[index].related_op;
+                if (op == NULL || op->type != GUAC_DISPLAY_PLAN_OPERATION_IMG
+                        || op->image != NULL)
+                    continue;
+
+                guac_rect dest = hint->dest;
+                guac_rect_constrain(&dest, &op->dest);
+                if (guac_rect_is_empty(&dest))
+                    continue;
+
+                /* Refuse glyphs that overlap glyphs already accepted */
+                size_t current = first[index];
+                while (current && !guac_rect_intersects(&copies[current - 1].dest, &dest))
+                    current = next[current - 1];
+
+                if (current)
+                    continue;
+
+                guac_display_plan_glyph* copy = &copies[length];
+                copy->layer = layer;
+                copy->dest = dest;
+                copy->src.layer = hint->src_layer->last_frame_buffer;
+                guac_rect_init(&copy->src.rect, dest.left + offset_x,
+                        dest.top + offset_y, guac_rect_width(&dest),
+                        guac_rect_height(&dest));
+
+                next[length] = first[index];
+                first[index] = ++length;
+                covered[index] += (size_t) guac_rect_width(&dest) * guac_rect_height(&dest);
+
+            }
+        }
+
+    }
+
+    /* Replace the draw operations of all cells fully covered by glyphs */
+    for (size_t index = 0; index < cells_width * cells_height; index++) {
+
+        if (!first[index])
+            continue;
+
+        guac_display_plan_operation* op = layer->pending_frame_cells[index].related_op;
+        if (covered[index] != (size_t) guac_rect_width(&op->dest) * guac_rect_height(&op->dest))
+            continue;
+
+        guac_display_scroll_unlink_op(op);
+        op->type = GUAC_DISPLAY_PLAN_OPERATION_NOP;
+
+        for (size_t current = first[index]; current; current = next[current - 1])
+            plan->glyphs[plan->glyphs_length++] = copies[current - 1];
+
+    }
+
+}
+
+void PFR_LFR_guac_display_plan_rewrite_as_glyphs(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+
+    /* Reserve space for every copy that could possibly result */
+    size_t capacity = 0;
+    guac_display_layer* current = display->pending_frame.layers;
+    while (current != NULL) {
+
+        for (size_t i = 0; i < current->pending_frame_glyph_hints_length; i++)
+            capacity += guac_display_plan_glyph_cells(current,
+                    &current->pending_frame_glyph_hints[i]);
+
+        current = current->pending_frame.next;
+
+    }
+
+    if (!capacity)
+        return;
+
+    plan->glyphs = guac_display_arena_alloc(&display->plan_arena, capacity,
+            sizeof(guac_display_plan_glyph));
+
+    current = display->pending_frame.layers;
+    while (current != NULL) {
+        PFR_LFR_guac_display_plan_apply_glyph_hints(plan, current);
+        current = current->pending_frame.next;
+    }
+
+}
@@ -25,6 +25,12 @@
 #include <string.h>
 #include <stdint.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 /**
  * Stores the given operation within the ops_by_hash table of the given display
  * plan based on the given hash value. The hash function applied for storing
@@ -114,6 +120,140 @@ static guac_display_plan_operation* guac_display_plan_remove_indexed_op(guac_dis
  */
 typedef void guac_hash_callback(guac_display_plan* plan, int x, int y, uint64_t hash, void* closure);
 
+/**
+ * The multiplier of the polynomial rolling hash used to hash image data. Each
+ * step of the hash multiplies the previous hash value by this value before
+ * adding the next pixel (or row hash).
+ *
+ * IMPORTANT: Because this value is an even number (31 << 1), the contribution
+ * of any value to the hash is shifted left by at least one bit during each
+ * step. After GUAC_DISPLAY_CELL_SIZE (64) steps, that contribution is shifted
+ * entirely out of the 64-bit hash, and thus the hash naturally covers only
+ * the most recent 64 values without any explicit removal of older values.
+ * This is why the hashing algorithm strongly depends on the cell size.
+ */
+#define GUAC_HASH_MULTIPLIER ((uint64_t) 31 << 1)
+
+/**
+ * GUAC_HASH_MULTIPLIER raised to the second power.
+ */
+#define GUAC_HASH_MULTIPLIER_2 (GUAC_HASH_MULTIPLIER * GUAC_HASH_MULTIPLIER)
+
+/**
+ * GUAC_HASH_MULTIPLIER raised to the third power.
+ */
+#define GUAC_HASH_MULTIPLIER_3 (GUAC_HASH_MULTIPLIER_2 * GUAC_HASH_MULTIPLIER)
+
+/**
+ * GUAC_HASH_MULTIPLIER raised to the fourth power.
+ */
+#define GUAC_HASH_MULTIPLIER_4 (GUAC_HASH_MULTIPLIER_3 * GUAC_HASH_MULTIPLIER)
+
+/**
+ * Calculates the hash of each horizontal, 64-pixel segment of the given row
+ * of image data, where each segment ends at the corresponding pixel. The
+ * resulting hash of the segment ending at the Nth pixel is stored as the Nth
+ * element of the provided hashes array. Segments that would begin before the
+ * first pixel of the row are hashed as if the row were padded with zeroes.
+ *
+ * The hash used is the polynomial rolling hash defined by
+ * GUAC_HASH_MULTIPLIER. Rather than evaluate that hash strictly serially (one
+ * pixel after another, with each step depending on the previous step), four
+ * pixels are hashed at a time using the hash value preceding those pixels
+ * together with precomputed powers of GUAC_HASH_MULTIPLIER. The four hash
+ * values of each step are thus independent of each other and can be
+ * calculated in parallel. As all arithmetic is performed modulo 2^64, the
+ * results are identical to those of evaluating the hash serially.
+ *
+ * @param row
+ *     The row of image data to hash.
+ *
+ * @param hashes
+ *     The array that should receive the hash values calculated for each pixel
+ *     of the row. This array must have at least as many elements as there are
+ *     pixels in the row.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ */
+static void guac_hash_row(const uint32_t* restrict row,
+        uint64_t* restrict hashes, int width) {
+
+    uint64_t hash = 0;
+    int x = 0;
+
+    /* Hash four pixels at a time */
+    for (; x + 4 <= width; x += 4) {
+
+        uint64_t p0 = row[x];
+        uint64_t p1 = row[x + 1];
+        uint64_t p2 = row[x + 2];
+        uint64_t p3 = row[x + 3];
+
+        hashes[x]     = GUAC_HASH_MULTIPLIER   * hash + p0;
+        hashes[x + 1] = GUAC_HASH_MULTIPLIER_2 * hash + GUAC_HASH_MULTIPLIER   * p0 + p1;
+        hashes[x + 2] = GUAC_HASH_MULTIPLIER_3 * hash + GUAC_HASH_MULTIPLIER_2 * p0 + GUAC_HASH_MULTIPLIER   * p1 + p2;
+        hashes[x + 3] = GUAC_HASH_MULTIPLIER_4 * hash + GUAC_HASH_MULTIPLIER_3 * p0 + GUAC_HASH_MULTIPLIER_2 * p1 + GUAC_HASH_MULTIPLIER * p2 + p3;
+
+        hash = hashes[x + 3];
+
+    }
+
+    /* Hash any remaining pixels serially */
+    for (; x < width; x++)
+        hashes[x] = hash = GUAC_HASH_MULTIPLIER * hash + row[x];
+
+}
+
+/**
+ * Incorporates the given row hashes (as calculated by guac_hash_row()) into
+ * the given array of ongoing cell hashes. Each cell hash is updated using the
+ * same polynomial rolling hash as guac_hash_row(), but vertically (one row
+ * after another), such that each resulting cell hash covers the 64x64 region
+ * whose bottom-right corner is the corresponding pixel of the current row.
+ *
+ * Each column is independent of all others, and thus several columns are
+ * updated per instruction where the SSE2 or NEON instruction sets are
+ * available. Multiplication by GUAC_HASH_MULTIPLIER is performed as a
+ * difference of shifts ((v << 6) - (v << 1)), as neither instruction set
+ * provides a 64-bit multiply.
+ *
+ * @param cell_hashes
+ *     The array of ongoing cell hashes to update.
+ *
+ * @param row_hashes
+ *     The row hashes of the current row.
+ *
+ * @param width
+ *     The number of elements in each array.
+ */
+static void guac_hash_combine_rows(uint64_t* restrict cell_hashes,
+        const uint64_t* restrict row_hashes, int width) {
+
+    int x = 0;
+
+#if defined(__SSE2__)
+    for (; x + 2 <= width; x += 2) {
+        __m128i cell = _mm_loadu_si128((const __m128i*) (cell_hashes + x));
+        __m128i row = _mm_loadu_si128((const __m128i*) (row_hashes + x));
+        cell = _mm_sub_epi64(_mm_slli_epi64(cell, 6), _mm_slli_epi64(cell, 1));
+        _mm_storeu_si128((__m128i*) (cell_hashes + x), _mm_add_epi64(cell, row));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; x + 2 <= width; x += 2) {
+        uint64x2_t cell = vld1q_u64(cell_hashes + x);
+        uint64x2_t row = vld1q_u64(row_hashes + x);
+        cell = vsubq_u64(vshlq_n_u64(cell, 6), vshlq_n_u64(cell, 1));
+        vst1q_u64(cell_hashes + x, vaddq_u64(cell, row));
+    }
+#endif
+
+    /* Update any remaining columns one at a time */
+    for (; x < width; x++)
+        cell_hashes[x] = GUAC_HASH_MULTIPLIER * cell_hashes[x] + row_hashes[x];
+
+}
+
 /**
  * Iterates through each 64x64 subrectangle within the given rectangular region
  * of the underlying buffer of the given layer state, invoking the given
@@ -147,8 +287,13 @@ static int guac_hash_foreach_image_rect(guac_display_plan* plan,
     const unsigned char* data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(*layer_state, *rect);
 
     int x, y;
+    uint64_t row_hash[GUAC_DISPLAY_MAX_WIDTH];
     uint64_t cell_hash[GUAC_DISPLAY_MAX_WIDTH] = { 0 };
 
+    int width = guac_rect_width(rect);
+    if (width <= 0 || guac_rect_height(rect) <= 0)
+        return 0;
+
     /* NOTE: Because the hash value of the sliding 64x64 window is available
      * only upon reaching the bottom-right corner of that window, we offset the
      * coordinates here by the relative location of the bottom-right corner
@@ -167,31 +312,19 @@ static int guac_hash_foreach_image_rect(guac_display_plan* plan,
 
     for (y = start_y; y < end_y; y++) {
 
-        uint64_t* current_cell_hash = cell_hash;
-
         /* Get current row */
-        uint32_t* row = (uint32_t*) data;
+        const uint32_t* row = (const uint32_t*) data;
         data += stride;
 
-        /* Calculate row segment hashes for entire row */
-        uint64_t row_hash = 0;
-        for (x = start_x; x < end_x; x++) {
-
-            /* Get current pixel */
-            uint32_t pixel = *(row++);
-
-            /* Update hash value for current row segment */
-            row_hash = ((row_hash * 31) << 1) + pixel;
-
-            /* Incorporate row hash value into overall cell hash */
-            uint64_t cell_hash = ((*current_cell_hash * 31) << 1) + row_hash;
-            *(current_cell_hash++) = cell_hash;
-
-            /* Invoke callback for every hash generated, breaking out early if
-             * requested */
-            if (y >= rect->top && x >= rect->left)
-                callback(plan, x, y, cell_hash, closure);
+        /* Calculate row segment hashes for entire row, incorporating those
+         * hashes into the overall cell hashes */
+        guac_hash_row(row, row_hash, width);
+        guac_hash_combine_rows(cell_hash, row_hash, width);
 
+        /* Invoke callback for every complete hash generated */
+        if (y >= rect->top) {
+            for (x = rect->left; x < end_x; x++)
+                callback(plan, x, y, cell_hash[x - start_x], closure);
         }
 
     } /* end for each row */
@@ -243,7 +376,39 @@ static void guac_display_cell_init_rect(guac_rect* rect, int x, int y) {
  *     within the ops_by_hash table of the given display plan.
  */
 static void guac_display_plan_index_op_for_cell(guac_display_plan* plan, int x, int y, uint64_t hash, void* closure) {
-    guac_display_plan_store_indexed_op(plan, hash, (guac_display_plan_operation*) closure);
+    guac_display_plan_operation* op = (guac_display_plan_operation*) closure;
+    op->hash = hash;
+    guac_display_plan_store_indexed_op(plan, hash, op);
+}
+
+/**
+ * Initializes the given rect such that it represents the 64x64 cell
+ * modified by the given operation, returning whether that cell lies entirely
+ * within the bounds of the operation's destination layer. Only such cells
+ * are hashed by PFR_guac_display_plan_index_dirty_cells().
+ *
+ * @param op
+ *     The operation whose cell should be determined.
+ *
+ * @param cell
+ *     The rect to initialize.
+ *
+ * @return
+ *     Non-zero if the cell lies entirely within the bounds of the destination
+ *     layer, zero otherwise.
+ */
+static int guac_display_plan_get_full_cell(const guac_display_plan_operation* op,
+        guac_rect* cell) {
+
+    guac_rect layer_bounds;
+    guac_display_layer_get_bounds(op->layer, &layer_bounds);
+
+    guac_display_cell_init_rect(cell, op->dest.left, op->dest.top);
+
+    guac_rect_constrain(cell, &layer_bounds);
+    return guac_rect_width(cell) == GUAC_DISPLAY_CELL_SIZE
+        && guac_rect_height(cell) == GUAC_DISPLAY_CELL_SIZE;
+
 }
 
 void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan) {
@@ -255,18 +420,9 @@ void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan) {
 
         if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG) {
 
-            guac_display_layer* layer = op->layer;
-
-            guac_rect layer_bounds;
-            guac_display_layer_get_bounds(layer, &layer_bounds);
-
             guac_rect cell;
-            guac_display_cell_init_rect(&cell, op->dest.left, op->dest.top);
-
-            guac_rect_constrain(&cell, &layer_bounds);
-            if (guac_rect_width(&cell) == GUAC_DISPLAY_CELL_SIZE
-                    && guac_rect_height(&cell) == GUAC_DISPLAY_CELL_SIZE) {
-                guac_hash_foreach_image_rect(plan, &layer->pending_frame,
+            if (guac_display_plan_get_full_cell(op, &cell)) {
+                guac_hash_foreach_image_rect(plan, &op->layer->pending_frame,
                         &cell, guac_display_plan_index_op_for_cell, op);
             }
 
@@ -413,8 +569,10 @@ void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan) {
     while (current != NULL) {
 
         /* Search only the layers that are specifically noted as possible
-         * sources for copies */
-        if (current->pending_frame.search_for_copies) {
+         * sources for copies, skipping layers whose copies have instead been
+         * explicitly hinted */
+        if (current->pending_frame.search_for_copies
+                && !GUAC_DISPLAY_LAYER_STATE_HAS_COPY_HINTS(current->pending_frame)) {
 
             guac_rect search_region;
             guac_rect_init(&search_region, 0, 0, current->last_frame.width, current->last_frame.height);
@@ -434,3 +592,47 @@ void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan) {
     }
 
 }
+
+void PFR_guac_display_plan_rewrite_as_cached(guac_display_plan* plan) {
+
+    guac_display* display = plan->display;
+    guac_display_cache* cache = &display->cache;
+
+    guac_display_plan_operation* op = plan->ops;
+    for (int i = 0; i < plan->length; i++) {
+
+        guac_display_layer* layer = op->layer;
+
+        /* Only cells of opaque layers are cached, as restoring a cached cell
+         * is a simple copy that would otherwise be composited over the old
+         * contents of the cell */
+        guac_rect cell;
+        if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG && layer->opaque
+                && layer->pending_frame.buffer != NULL
+                && guac_display_plan_get_full_cell(op, &cell)) {
+
+            const unsigned char* data = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->pending_frame, cell);
+            size_t stride = layer->pending_frame.buffer_stride;
+
+            /* Restore the cell from the cache if the same cell contents were
+             * sent recently, otherwise add the cell to the cache such that it
+             * can be restored later */
+            const guac_layer* buffer = guac_display_cache_get(cache, op->hash, data, stride, plan->frame_end);
+            if (buffer != NULL) {
+                op->type = GUAC_DISPLAY_PLAN_OPERATION_COPY;
+                op->src.layer_rect.layer = buffer;
+                guac_rect_init(&op->src.layer_rect.rect, 0, 0, GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE);
+                op->dest = cell;
+            }
+
+            else
+                guac_display_cache_put(cache, op->hash, data, stride,
+                        layer, cell.left, cell.top, plan->frame_end);
+
+        }
+
+        op++;
+
+    }
+
+}
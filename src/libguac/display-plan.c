@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "display-memcmp.h"
 #include "display-plan.h"
 #include "display-priv.h"
 #include "guacamole/assert.h"
@@ -27,7 +28,10 @@
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
+#include "protocol-batch.h"
 
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cairo/cairo.h>
 
@@ -76,174 +80,199 @@ static void guac_display_plan_mark_dirty(guac_display_layer* layer,
 }
 
 /**
- * Variant of memcmp() which specifically compares series of 32-bit quantities
- * and determines the overall location and length of the differences in the two
- * provided buffers. The length and location determined are the length and
- * location of the smallest contiguous series of 32-bit quantities that differ
- * between the buffers.
- *
- * @param buffer_a
- *     The first buffer to compare.
- *
- * @param buffer_b
- *     The buffer to compare with buffer_a.
+ * A single task of the search for changes between the pending frame and the
+ * last frame, covering a horizontal band of cells within a single layer.
+ */
+typedef struct guac_display_plan_diff_task {
+
+    /**
+     * The layer being searched.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The implementation of guac_display_memcmp_function that should be used
+     * to compare rows of image data.
+     */
+    guac_display_memcmp_function* memcmp_impl;
+
+    /**
+     * The region of the layer that should be searched. The top edge of this
+     * region is aligned with the top edge of a row of cells, and the region is
+     * within the bounds of the layer's pending frame.
+     */
+    guac_rect region;
+
+    /**
+     * The rectangle containing all changes found within the searched region.
+     * If no changes were found, this will be an empty rect.
+     */
+    guac_rect dirty;
+
+    /**
+     * The number of cells within the searched region that were found to have
+     * changed.
+     */
+    size_t op_count;
+
+} guac_display_plan_diff_task;
+
+/**
+ * Determines the region of the given layer that must be searched for changes
+ * since the last frame. The pending frame of the layer is not modified.
  *
- * @param count
- *     The number of 32-bit quantities in each buffer.
+ * @param layer
+ *     The layer to determine the search region of.
  *
- * @param pos
- *     A pointer to a size_t that should receive the offset of the difference,
- *     if the two buffers turn out to contain different data. The value of the
- *     size_t will only be modified if at least one difference is found.
+ * @param region
+ *     The rect that should receive the search region. The top and left edges
+ *     of this region will be aligned with cell boundaries, and the overall
+ *     region will be within the bounds of the layer's pending frame.
  *
  * @return
- *     The number of 32-bit quantities after and including the offset returned
- *     via pos that are different between buffer_a and buffer_b, or zero if
- *     there are no such differences.
+ *     Non-zero if the layer has been modified, and thus its pending frame
+ *     dirty rect must be refined based on the search region (which may still
+ *     be empty), zero if the layer must be skipped entirely.
  */
-static size_t guac_display_memcmp(const uint32_t* restrict buffer_a,
-        const uint32_t* restrict buffer_b, size_t count, size_t* pos) {
+static int PFR_guac_display_plan_get_search_region(guac_display_layer* layer,
+        guac_rect* region) {
+
+    /* Skip processing any layers whose buffers have been replaced with NULL
+     * (this is intentionally allowed to ensure references to external buffers
+     * can be safely removed if necessary, even before guac_display is
+     * freed) */
+    if (layer->pending_frame.buffer == NULL) {
+        GUAC_ASSERT(layer->pending_frame.buffer_is_external);
+        return 0;
+    }
 
-    /* Locate first difference between the buffers, if any */
-    size_t first = 0;
-    while (first < count) {
+    /* Check only within layer dirty region, skipping the layer if unmodified.
+     * This pass should reset and refine that region, but otherwise rely on
+     * proper reporting of modified regions by callers of the open/close layer
+     * functions. */
+    *region = layer->pending_frame.dirty;
+    if (guac_rect_is_empty(region))
+        return 0;
 
-        if (*(buffer_a++) != *(buffer_b++))
-            break;
+    /* Re-align the dirty rect with nearest multiple of 64 to ensure each step
+     * of the dirty rect refinement loop starts at the topmost boundary of a
+     * cell */
+    guac_rect_align(region, GUAC_DISPLAY_CELL_SIZE_EXPONENT);
 
-        first++;
+    guac_rect pending_frame_bounds = {
+        .left = 0,
+        .top = 0,
+        .right = layer->pending_frame.width,
+        .bottom = layer->pending_frame.height
+    };
 
-    }
+    /* Limit size of dirty rect by bounds of backing surface for pending frame
+     * ONLY (bounds checks against the last frame are performed within the
+     * loop such that everything outside the bounds of the last frame is
+     * considered dirty) */
+    guac_rect_constrain(region, &pending_frame_bounds);
 
-    /* If we reached the end without finding any differences, no need to search
-     * further - the buffers are identical */
-    if (first >= count)
-        return 0;
+    return 1;
 
-    /* Search through all remaining values in the buffers for the last
-     * difference (which may be identical to the first) */
-    size_t last = first;
-    size_t offset = first + 1;
-    while (offset < count) {
+}
 
-        if (*(buffer_a++) != *(buffer_b++))
-            last = offset;
+/**
+ * Returns the number of bands of GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT rows of
+ * cells that are needed to cover the given search region.
+ *
+ * @param region
+ *     The search region, as produced by
+ *     PFR_guac_display_plan_get_search_region().
+ *
+ * @return
+ *     The number of bands needed to cover the given region.
+ */
+static size_t guac_display_plan_count_bands(const guac_rect* region) {
 
-        offset++;
+    const int band_height = GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT;
 
-    }
+    int height = guac_rect_height(region);
+    if (height <= 0 || guac_rect_width(region) <= 0)
+        return 0;
 
-    /* Final difference found - provide caller with the starting offset and
-     * length (in 32-bit quantities) of differences */
-    *pos = first;
-    return last - first + 1;
+    return (height + band_height - 1) / band_height;
 
 }
 
-guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
+/**
+ * Searches the region of a guac_display_plan_diff_task for changes between
+ * the pending frame and the last frame of its layer, refining the dirty rects
+ * of each cell to more accurately contain only what has actually changed. This
+ * function is a guac_display_plan_task_callback.
+ *
+ * @param data
+ *     A pointer to the guac_display_plan_diff_task to perform.
+ */
+static void PFW_LFR_guac_display_plan_diff_band(void* data) {
+
+    guac_display_plan_diff_task* task = (guac_display_plan_diff_task*) data;
+    guac_display_layer* current = task->layer;
+    guac_display_memcmp_function* memcmp_impl = task->memcmp_impl;
+    guac_rect dirty = task->region;
 
-    guac_display_layer* current;
-    guac_timestamp frame_end = guac_timestamp_current();
     size_t op_count = 0;
+    task->dirty = (guac_rect) { 0 };
 
-    /* Loop through each layer, searching for modified regions */
-    current = display->pending_frame.layers;
-    while (current != NULL) {
+    const unsigned char* flushed_row = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->last_frame, dirty);
+    unsigned char* buffer_row = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->pending_frame, dirty);
 
-        /* Skip processing any layers whose buffers have been replaced with
-         * NULL (this is intentionally allowed to ensure references to external
-         * buffers can be safely removed if necessary, even before guac_display
-         * is freed) */
-        if (current->pending_frame.buffer == NULL) {
-            GUAC_ASSERT(current->pending_frame.buffer_is_external);
-            continue;
-        }
+    guac_display_layer_cell* cell_row = current->pending_frame_cells
+        + guac_mem_ckd_mul_or_die(dirty.top / GUAC_DISPLAY_CELL_SIZE, current->pending_frame_cells_width)
+        + dirty.left / GUAC_DISPLAY_CELL_SIZE;
 
-        /* Check only within layer dirty region, skipping the layer if
-         * unmodified. This pass should reset and refine that region, but
-         * otherwise rely on proper reporting of modified regions by callers of
-         * the open/close layer functions. */
-        guac_rect dirty = current->pending_frame.dirty;
-        if (guac_rect_is_empty(&dirty)) {
-            current = current->pending_frame.next;
-            continue;
-        }
+    /* Loop through the rough modified region, refining the dirty rects of
+     * each cell to more accurately contain only what has actually changed
+     * since last frame */
+    for (int corner_y = dirty.top; corner_y < dirty.bottom; corner_y += GUAC_DISPLAY_CELL_SIZE) {
 
-        /* Flush any outstanding Cairo operations before directly accessing buffer */
-        guac_display_layer_cairo_context* cairo_context = &(current->pending_frame_cairo_context);
-        if (cairo_context->surface != NULL)
-            cairo_surface_flush(cairo_context->surface);
-
-        /* Re-align the dirty rect with nearest multiple of 64 to ensure each
-         * step of the dirty rect refinement loop starts at the topmost
-         * boundary of a cell */
-        guac_rect_align(&dirty, GUAC_DISPLAY_CELL_SIZE_EXPONENT);
-
-        guac_rect pending_frame_bounds = {
-            .left = 0,
-            .top = 0,
-            .right = current->pending_frame.width,
-            .bottom = current->pending_frame.height
-        };
-
-        /* Limit size of dirty rect by bounds of backing surface for pending
-         * frame ONLY (bounds checks against the last frame are performed
-         * within the loop such that everything outside the bounds of the last
-         * frame is considered dirty) */
-        guac_rect_constrain(&dirty, &pending_frame_bounds);
-
-        const unsigned char* flushed_row = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(current->last_frame, dirty);
-        unsigned char* buffer_row = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->pending_frame, dirty);
-
-        guac_display_layer_cell* cell_row = current->pending_frame_cells
-            + guac_mem_ckd_mul_or_die(dirty.top / GUAC_DISPLAY_CELL_SIZE, current->pending_frame_cells_width)
-            + dirty.left / GUAC_DISPLAY_CELL_SIZE;
-
-        /* Loop through the rough modified region, refining the dirty rects of
-         * each cell to more accurately contain only what has actually changed
-         * since last frame */ 
-        current->pending_frame.dirty = (guac_rect) { 0 };
-        for (int corner_y = dirty.top; corner_y < dirty.bottom; corner_y += GUAC_DISPLAY_CELL_SIZE) {
+        int height = GUAC_DISPLAY_CELL_SIZE;
+        if (corner_y + height > dirty.bottom)
+            height = dirty.bottom - corner_y;
 
-            int height = GUAC_DISPLAY_CELL_SIZE;
-            if (corner_y + height > dirty.bottom)
-                height = dirty.bottom - corner_y;
+        /* Iteration through the pending_frame_cells array and the image
+         * buffer is a bit complex here, as the pending_frame_cells array
+         * contains cells that represent 64x64 regions, while the image
+         * buffers contain absolutely all pixels. The outer loop goes
+         * through just the pending cells, while the following loop goes
+         * through the Y coordinates that make up that cell. */
 
-            /* Iteration through the pending_frame_cells array and the image
-             * buffer is a bit complex here, as the pending_frame_cells array
-             * contains cells that represent 64x64 regions, while the image
-             * buffers contain absolutely all pixels. The outer loop goes
-             * through just the pending cells, while the following loop goes
-             * through the Y coordinates that make up that cell. */
+        for (int y_off = 0; y_off < height; y_off++) {
 
-            for (int y_off = 0; y_off < height; y_off++) {
+            /* At this point, we need to loop through the horizontal
+             * dimension, comparing the 64-pixel rows of image data in the
+             * current line (corner_y + y_off) that are in each applicable
+             * cell. We jump forward by one cell for each comparison. */
 
-                /* At this point, we need to loop through the horizontal
-                 * dimension, comparing the 64-pixel rows of image data in the
-                 * current line (corner_y + y_off) that are in each applicable
-                 * cell. We jump forward by one cell for each comparison. */
+            int y = corner_y + y_off;
 
-                int y = corner_y + y_off;
+            guac_display_layer_cell* current_cell = cell_row;
+            uint32_t* current_flushed = (uint32_t*) flushed_row;
+            uint32_t* current_buffer = (uint32_t*) buffer_row;
+            for (int corner_x = dirty.left; corner_x < dirty.right; corner_x += GUAC_DISPLAY_CELL_SIZE) {
 
-                guac_display_layer_cell* current_cell = cell_row;
-                uint32_t* current_flushed = (uint32_t*) flushed_row;
-                uint32_t* current_buffer = (uint32_t*) buffer_row;
-                for (int corner_x = dirty.left; corner_x < dirty.right; corner_x += GUAC_DISPLAY_CELL_SIZE) {
+                int width = GUAC_DISPLAY_CELL_SIZE;
+                if (corner_x + width > dirty.right)
+                    width = dirty.right - corner_x;
 
-                    int width = GUAC_DISPLAY_CELL_SIZE;
-                    if (corner_x + width > dirty.right)
-                        width = dirty.right - corner_x;
+                /* This SHOULD be impossible, as corner_x would need to
+                 * somehow be outside the bounds of the dirty rect, which
+                 * would have failed the loop condition earlier) */
+                GUAC_ASSERT(width >= 0);
 
-                    /* This SHOULD be impossible, as corner_x would need to
-                     * somehow be outside the bounds of the dirty rect, which
-                     * would have failed the loop condition earlier) */
-                    GUAC_ASSERT(width >= 0);
+                /* Only cells reported as modified can possibly contain
+                 * changes */
+                if (current_cell->damaged) {
 
                     /* Any line that is completely outside the bounds of the
                      * previous frame is dirty (nothing to compare against) */
                     if (y >= current->last_frame.height || corner_x >= current->last_frame.width) {
                         guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x, y, width);
-                        guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
+                        guac_rect_extend(&task->dirty, &current_cell->dirty);
                     }
 
                     /* All other regions must be processed further to determine
@@ -266,31 +295,102 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
                         /* Any region outside the right edge of the previous frame is dirty */
                         if (width > comparable_width) {
                             guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + comparable_width, y, width - comparable_width);
-                            guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
+                            guac_rect_extend(&task->dirty, &current_cell->dirty);
                         }
 
                         /* Mark the relevant region of the cell as dirty if the
                          * current 64-pixel line has changed in any way */
                         size_t length, pos;
-                        if ((length = guac_display_memcmp(current_buffer, current_flushed, comparable_width, &pos)) != 0) {
+                        if ((length = memcmp_impl(current_buffer, current_flushed, comparable_width, &pos)) != 0) {
                             guac_display_plan_mark_dirty(current, current_cell, &op_count, corner_x + pos, y, length);
-                            guac_rect_extend(&current->pending_frame.dirty, &current_cell->dirty);
+                            guac_rect_extend(&task->dirty, &current_cell->dirty);
                         }
 
                     }
 
-                    current_flushed += GUAC_DISPLAY_CELL_SIZE;
-                    current_buffer += GUAC_DISPLAY_CELL_SIZE;
-                    current_cell++;
-
                 }
 
-                flushed_row += current->last_frame.buffer_stride;
-                buffer_row += current->pending_frame.buffer_stride;
+                current_flushed += GUAC_DISPLAY_CELL_SIZE;
+                current_buffer += GUAC_DISPLAY_CELL_SIZE;
+                current_cell++;
 
             }
 
-            cell_row += current->pending_frame_cells_width;
+            flushed_row += current->last_frame.buffer_stride;
+            buffer_row += current->pending_frame.buffer_stride;
+
+        }
+
+        /* All cells within this row of the band have now been compared */
+        guac_display_layer_cell* current_cell = cell_row;
+        for (int corner_x = dirty.left; corner_x < dirty.right; corner_x += GUAC_DISPLAY_CELL_SIZE)
+            (current_cell++)->damaged = 0;
+
+        cell_row += current->pending_frame_cells_width;
+
+    }
+
+    task->op_count = op_count;
+
+}
+
+guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
+
+    guac_display_layer* current;
+    guac_timestamp frame_end = guac_timestamp_update_frame_time();
+    size_t op_count = 0;
+
+    /* Determine the number of tasks required to search all modified layers,
+     * splitting each layer into horizontal bands of cells */
+    size_t task_count = 0;
+    current = display->pending_frame.layers;
+    while (current != NULL) {
+
+        guac_rect region;
+        if (PFR_guac_display_plan_get_search_region(current, &region))
+            task_count += guac_display_plan_count_bands(&region);
+
+        current = current->pending_frame.next;
+
+    }
+
+    guac_display_plan_diff_task* tasks = NULL;
+    if (task_count)
+        tasks = guac_display_arena_alloc(&display->plan_arena, task_count,
+                sizeof(guac_display_plan_diff_task));
+
+    /* Populate tasks covering the modified region of each layer */
+    guac_display_plan_diff_task* task = tasks;
+    current = display->pending_frame.layers;
+    while (current != NULL) {
+
+        guac_rect region;
+        if (!PFR_guac_display_plan_get_search_region(current, &region)) {
+            current = current->pending_frame.next;
+            continue;
+        }
+
+        /* Flush any outstanding Cairo operations before directly accessing buffer */
+        guac_display_layer_cairo_context* cairo_context = &(current->pending_frame_cairo_context);
+        if (cairo_context->surface != NULL)
+            cairo_surface_flush(cairo_context->surface);
+
+        /* The layer's dirty rect will be rebuilt from the results of each
+         * task */
+        current->pending_frame.dirty = (guac_rect) { 0 };
+
+        int band_height = GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT;
+        size_t bands = guac_display_plan_count_bands(&region);
+        for (size_t i = 0; i < bands; i++) {
+
+            task->layer = current;
+            task->memcmp_impl = display->memcmp_impl;
+            task->region = region;
+            task->region.top = region.top + i * band_height;
+            if (task->region.bottom > task->region.top + band_height)
+                task->region.bottom = task->region.top + band_height;
+
+            task++;
 
         }
 
@@ -298,15 +398,36 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
 
     }
 
+    /* Search all bands of all layers in parallel, merging the results */
+    guac_display_plan_run_tasks(display, PFW_LFR_guac_display_plan_diff_band,
+            tasks, sizeof(guac_display_plan_diff_task), task_count);
+
+    for (size_t i = 0; i < task_count; i++) {
+
+        task = &tasks[i];
+        op_count += task->op_count;
+
+        if (!guac_rect_is_empty(&task->dirty))
+            guac_rect_extend(&task->layer->pending_frame.dirty, &task->dirty);
+
+    }
+
     /* If no layer has been modified, there's no need to create a plan */
-    if (!op_count)
+    if (!op_count) {
+        guac_display_arena_reset(&display->plan_arena);
         return NULL;
+    }
 
-    guac_display_plan* plan = guac_mem_alloc(sizeof(guac_display_plan));
+    guac_display_plan* plan = guac_display_arena_alloc(&display->plan_arena,
+            1, sizeof(guac_display_plan));
     plan->display = display;
+    plan->frame_start = display->last_frame.timestamp;
     plan->frame_end = frame_end;
+    plan->glyphs = NULL;
+    plan->glyphs_length = 0;
     plan->length = op_count;
-    plan->ops = guac_mem_alloc(plan->length, sizeof(guac_display_plan_operation));
+    plan->ops = guac_display_arena_alloc(&display->plan_arena, plan->length,
+            sizeof(guac_display_plan_operation));
 
     /* Convert the dirty rectangles stored in each layer's cells to individual
      * image operations for later optimization */
@@ -328,12 +449,24 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
                      * in the way the original operation count was calculated */
                     GUAC_ASSERT(added_ops < op_count);
 
+                    /* Track how long this cell has been in sustained
+                     * motion */
+                    guac_timestamp interval = frame_end - cell->last_frame;
+                    if (interval > 0 && 1000 / interval >= GUAC_DISPLAY_MOTION_FRAMERATE) {
+                        if (cell->motion_frames < GUAC_DISPLAY_MOTION_MIN_FRAMES)
+                            cell->motion_frames++;
+                    }
+                    else
+                        cell->motion_frames = 0;
+
                     current_op->layer = current;
                     current_op->type = GUAC_DISPLAY_PLAN_OPERATION_IMG;
                     current_op->dest = cell->dirty;
                     current_op->dirty_size = cell->dirty_size;
                     current_op->last_frame = cell->last_frame;
                     current_op->current_frame = frame_end;
+                    current_op->motion_frames = cell->motion_frames;
+                    current_op->image = NULL;
 
                     cell->related_op = current_op;
                     cell->dirty_size = 0;
@@ -364,20 +497,149 @@ guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display) {
 }
 
 void guac_display_plan_free(guac_display_plan* plan) {
-    guac_mem_free(plan->ops);
-    guac_mem_free(plan);
+    guac_display_arena_reset(&plan->display->plan_arena);
 }
 
-void guac_display_plan_apply(guac_display_plan* plan) {
+/**
+ * Comparator for qsort() that orders display plan operations such that
+ * operations near the mouse pointer come first, followed by all other
+ * operations, with the largest operations of each group coming first.
+ * Operations of equal size are ordered by layer and then by position, such
+ * that operations that are picked up together by worker threads tend to
+ * reference nearby image data.
+ *
+ * @param a
+ *     A pointer to the first guac_display_plan_operation to compare.
+ *
+ * @param b
+ *     A pointer to the second guac_display_plan_operation to compare.
+ *
+ * @return
+ *     A negative value if the first operation should be performed before the
+ *     second, a positive value if the first operation should be performed
+ *     after the second, or zero if their order does not matter.
+ */
+static int guac_display_plan_largest_first(const void* a, const void* b) {
+
+    const guac_display_plan_operation* op_a = (const guac_display_plan_operation*) a;
+    const guac_display_plan_operation* op_b = (const guac_display_plan_operation*) b;
+
+    if (op_a->focused != op_b->focused)
+        return op_a->focused ? -1 : 1;
+
+    uint64_t size_a = (uint64_t) guac_rect_width(&op_a->dest) * guac_rect_height(&op_a->dest);
+    uint64_t size_b = (uint64_t) guac_rect_width(&op_b->dest) * guac_rect_height(&op_b->dest);
+
+    if (size_a != size_b)
+        return size_a > size_b ? -1 : 1;
+
+    if (op_a->layer != op_b->layer)
+        return (uintptr_t) op_a->layer < (uintptr_t) op_b->layer ? -1 : 1;
+
+    if (op_a->dest.top != op_b->dest.top)
+        return op_a->dest.top - op_b->dest.top;
+
+    return op_a->dest.left - op_b->dest.left;
+
+}
+
+/**
+ * Adds the instructions required to copy the given region of image data to
+ * the given region of the given layer to the given batch. If the layer is
+ * not opaque, the destination is cleared first, such that the copy replaces
+ * the destination rather than being composited over it.
+ *
+ * @param batch
+ *     The batch that the instructions should be added to.
+ *
+ * @param display_layer
+ *     The layer receiving the copy.
+ *
+ * @param src
+ *     The region of image data that should be copied.
+ *
+ * @param dest
+ *     The region of the layer that should receive the copied image data.
+ */
+static void guac_display_plan_batch_copy(guac_protocol_batch* batch,
+        guac_display_layer* display_layer,
+        const guac_display_plan_layer_rect* src, const guac_rect* dest) {
+
+    /* The copy must replace the destination of layers having an alpha
+     * channel, rather than be composited over it, which is achieved by
+     * clearing the destination first (GUAC_COMP_OVER is significantly faster
+     * than GUAC_COMP_SRC on the browser side) */
+    if (!display_layer->opaque) {
+        guac_protocol_batch_rect(batch, display_layer->layer,
+                dest->left, dest->top, guac_rect_width(dest), guac_rect_height(dest));
+        guac_protocol_batch_cfill(batch, GUAC_COMP_RATOP, display_layer->layer,
+                0x00, 0x00, 0x00, 0x00);
+    }
+
+    guac_protocol_batch_copy(batch, src->layer,
+            src->rect.left, src->rect.top,
+            guac_rect_width(&src->rect), guac_rect_height(&src->rect),
+            GUAC_COMP_OVER, display_layer->layer, dest->left, dest->top);
+
+}
+
+size_t guac_display_plan_apply(guac_display_plan* plan) {
 
     guac_display* display = plan->display;
     guac_client* client = display->client;
     guac_display_plan_operation* op = plan->ops;
+    size_t enqueued = 0;
+
+    /* All non-image instructions are sent together, rather than locking the
+     * socket (and, for broadcast sockets, every user's socket) separately
+     * for each element of each instruction */
+    guac_protocol_batch batch;
+    guac_protocol_batch_init(&batch, client->socket);
+
+    /* Allow encoding of this frame to take roughly as long as the time
+     * between this frame and the previous frame, less any time that
+     * connected clients are lagging behind */
+    int budget = plan->frame_end - plan->frame_start
+        - guac_client_get_processing_lag(client);
+
+    if (budget < GUAC_DISPLAY_ENCODER_MIN_BUDGET)
+        budget = GUAC_DISPLAY_ENCODER_MIN_BUDGET;
+    else if (budget > GUAC_DISPLAY_ENCODER_MAX_BUDGET)
+        budget = GUAC_DISPLAY_ENCODER_MAX_BUDGET;
+
+    /* Note which operations affect the region around the mouse pointer
+     * (the cursor position is relative to the default layer) */
+    guac_rect focus;
+    guac_rect_init(&focus,
+            display->pending_frame.cursor_x - GUAC_DISPLAY_FOCUS_RADIUS,
+            display->pending_frame.cursor_y - GUAC_DISPLAY_FOCUS_RADIUS,
+            GUAC_DISPLAY_FOCUS_RADIUS * 2, GUAC_DISPLAY_FOCUS_RADIUS * 2);
+
+    for (int i = 0; i < plan->length; i++) {
+        guac_display_plan_operation* current = &plan->ops[i];
+        current->focused = current->layer == display->default_layer
+            && guac_rect_intersects(&current->dest, &focus);
+    }
+
+    /* Hand operations near the mouse pointer to the worker threads first,
+     * followed by the largest operations, such that the frame does not end
+     * up waiting on a single large operation that was picked up only after
+     * all other operations were complete (NOTE: The operations of a plan
+     * never overlap, and may thus be performed in any order) */
+    qsort(plan->ops, plan->length, sizeof(guac_display_plan_operation),
+            guac_display_plan_largest_first);
 
     /* Do not allow worker threads to move forward with image encoding until
      * AFTER the non-image instructions have finished being written */
     guac_fifo_lock(&display->ops);
 
+    display->frame_encoding_budget = (uint64_t) budget * 1000000;
+    display->frame_encoding_pixels = 0;
+
+    /* Decide which users should receive separate image data for this frame,
+     * if any */
+    PFR_guac_display_update_tiers(display);
+
     /* Immediately send instructions for all updates that do not involve
      * significant processing (do not involve encoding anything). This allows
      * us to use the worker threads solely for encoding, reducing contention
@@ -385,18 +647,32 @@ void guac_display_plan_apply(guac_display_plan* plan) {
     for (int i = 0; i < plan->length; i++) {
 
         guac_display_layer* display_layer = op->layer;
+
+        /* Any region awaiting refinement that is entirely redrawn by this
+         * frame no longer needs to be refined (if the redraw is itself sent
+         * at reduced quality, the worker thread will note this) */
+        if (op->type != GUAC_DISPLAY_PLAN_OPERATION_NOP) {
+
+            guac_rect* refinement = &display_layer->refinement;
+            if (!guac_rect_is_empty(refinement)
+                    && op->dest.left   <= refinement->left
+                    && op->dest.top    <= refinement->top
+                    && op->dest.right  >= refinement->right
+                    && op->dest.bottom >= refinement->bottom)
+                *refinement = (guac_rect) { 0 };
+
+        }
+
         switch (op->type) {
 
             case GUAC_DISPLAY_PLAN_OPERATION_COPY:
-                guac_protocol_send_copy(client->socket, op->src.layer_rect.layer,
-                        op->src.layer_rect.rect.left, op->src.layer_rect.rect.top,
-                        guac_rect_width(&op->src.layer_rect.rect), guac_rect_height(&op->src.layer_rect.rect),
-                        GUAC_COMP_OVER, display_layer->layer, op->dest.left, op->dest.top);
+                guac_display_plan_batch_copy(&batch, display_layer,
+                        &op->src.layer_rect, &op->dest);
                 break;
 
             case GUAC_DISPLAY_PLAN_OPERATION_RECT:
 
-                guac_protocol_send_rect(client->socket, display_layer->layer,
+                guac_protocol_batch_rect(&batch, display_layer->layer,
                         op->dest.left, op->dest.top, guac_rect_width(&op->dest), guac_rect_height(&op->dest));
 
                 int alpha = (op->src.color & 0xFF000000) >> 24;
@@ -407,11 +683,11 @@ void guac_display_plan_apply(guac_display_plan* plan) {
                 /* Clear before drawing if layer is not opaque (transparency
                  * will not be copied correctly otherwise) */
                 if (!display_layer->opaque) {
-                    guac_protocol_send_cfill(client->socket, GUAC_COMP_ROUT, display_layer->layer, 0x00, 0x00, 0x00, 0xFF);
-                    guac_protocol_send_cfill(client->socket, GUAC_COMP_OVER, display_layer->layer, red, green, blue, alpha);
+                    guac_protocol_batch_cfill(&batch, GUAC_COMP_ROUT, display_layer->layer, 0x00, 0x00, 0x00, 0xFF);
+                    guac_protocol_batch_cfill(&batch, GUAC_COMP_OVER, display_layer->layer, red, green, blue, alpha);
                 }
                 else
-                    guac_protocol_send_cfill(client->socket, GUAC_COMP_OVER, display_layer->layer, red, green, blue, 0xFF);
+                    guac_protocol_batch_cfill(&batch, GUAC_COMP_OVER, display_layer->layer, red, green, blue, 0xFF);
 
                 break;
 
@@ -421,7 +697,17 @@ void guac_display_plan_apply(guac_display_plan* plan) {
 
             /* All other operations should be handled by the workers */
             default:
-                guac_fifo_enqueue(&display->ops, op);
+
+                display->frame_encoding_pixels += (uint64_t) guac_rect_width(&op->dest) * guac_rect_height(&op->dest);
+
+                /* Each operation must be counted as part of the frame BEFORE
+                 * any worker thread can possibly complete it */
+                atomic_fetch_add(&display->frame_ops, 1);
+                if (guac_display_queue_operation(display, op))
+                    enqueued++;
+                else
+                    atomic_fetch_sub(&display->frame_ops, 1);
+
                 break;
 
         }
@@ -430,6 +716,18 @@ void guac_display_plan_apply(guac_display_plan* plan) {
 
     }
 
+    /* Cells drawn entirely from hinted glyphs are likewise sent as copies */
+    for (size_t i = 0; i < plan->glyphs_length; i++) {
+        const guac_display_plan_glyph* glyph = &plan->glyphs[i];
+        guac_display_plan_batch_copy(&batch, glyph->layer, &glyph->src,
+                &glyph->dest);
+    }
+
+    /* Image instructions may be sent only once the worker threads are
+     * allowed to proceed, thus the batch must be written before then */
+    guac_protocol_batch_flush(&batch);
+
     guac_fifo_unlock(&display->ops);
+    return enqueued;
 
 }
@@ -20,6 +20,7 @@
 #ifndef GUAC_DISPLAY_PLAN_H
 #define GUAC_DISPLAY_PLAN_H
 
+#include "display-arena.h"
 #include "guacamole/display.h"
 #include "guacamole/rect.h"
 #include "guacamole/timestamp.h"
@@ -58,6 +59,15 @@
  */
 #define GUAC_DISPLAY_MAX_COMBINED_SIZE 9
 
+/**
+ * The maximum number of adjacent cells within a single row that are
+ * partitioned together when combining operations horizontally. Longer runs of
+ * cells are partitioned in pieces of this size. As combined operations may
+ * not cross the 2^GUAC_DISPLAY_MAX_COMBINED_SIZE grid, this limit affects
+ * only runs of cells far longer than any possible combined operation.
+ */
+#define GUAC_DISPLAY_PLAN_MAX_RUN 64
+
 /**
  * The base cost of every update. Each update should be considered to have
  * this starting cost, plus any additional cost estimated from its
@@ -76,12 +86,112 @@
  */
 #define GUAC_DISPLAY_JPEG_FRAMERATE 3
 
+/**
+ * The framerate which, if met or exceeded by every update to a cell for at
+ * least GUAC_DISPLAY_MOTION_MIN_FRAMES consecutive updates, indicates that the
+ * cell contains full-motion content, such as video.
+ */
+#define GUAC_DISPLAY_MOTION_FRAMERATE 10
+
+/**
+ * The number of consecutive updates at GUAC_DISPLAY_MOTION_FRAMERATE or more
+ * that a cell must receive before it is considered to contain full-motion
+ * content. Full-motion content is sent using lossy compression without first
+ * analyzing whether lossless compression would be more efficient.
+ */
+#define GUAC_DISPLAY_MOTION_MIN_FRAMES 8
+
 /**
  * Minimum JPEG bitmap size (area). If the bitmap is smaller than this threshold,
  * it should be compressed as a PNG image to avoid the JPEG compression tax.
  */
 #define GUAC_DISPLAY_JPEG_MIN_BITMAP_SIZE 4096
 
+/**
+ * The maximum number of distinct colors that an image update may contain for
+ * that update to be considered low-color. Low-color updates are always sent
+ * as PNG, as they compress well as palette-based PNG regardless of how
+ * frequently they change, while lossy compression would visibly smear their
+ * sharp edges.
+ */
+#define GUAC_DISPLAY_PNG_MAX_COLORS 16
+
+/**
+ * Minimum size (area) of an image update that may be sent as a reduced-quality
+ * first stage if a newer frame is already waiting by the time that update is
+ * encoded. Smaller updates are cheap enough that they are always sent at the
+ * quality that would otherwise be chosen.
+ */
+#define GUAC_DISPLAY_PROGRESSIVE_MIN_SIZE 65536
+
+/**
+ * The maximum height of each GUAC_DISPLAY_PLAN_OPERATION_REFINE operation, in
+ * pixels. Larger regions requiring refinement are divided into bands of this
+ * height such that they may be refined in parallel and such that refinement
+ * may be preempted by a newer frame without waiting for the entire region.
+ */
+#define GUAC_DISPLAY_REFINEMENT_BAND_HEIGHT 256
+
+/**
+ * The distance from the mouse pointer, in pixels, within which image
+ * operations on the default layer are handed to the worker threads before
+ * all other operations of the same frame. The region around the pointer is
+ * where the user is most likely looking, and thus where latency is most
+ * noticeable.
+ */
+#define GUAC_DISPLAY_FOCUS_RADIUS 128
+
+/**
+ * The default number of milliseconds that a cell sent at reduced quality must
+ * remain unchanged before it is resent losslessly (see
+ * guac_display_set_refinement_delay()).
+ */
+#define GUAC_DISPLAY_DEFAULT_REFINEMENT_DELAY 1000
+
+/**
+ * Maximum size (area) of an image update whose previous contents are retained
+ * such that it may be sent as a delta update (see
+ * guac_display_set_delta_updates()). Larger updates are rarely mostly
+ * unchanged, and retaining their previous contents would cost more memory
+ * and time than is likely to be saved.
+ */
+#define GUAC_DISPLAY_DELTA_MAX_SIZE 65536
+
+/**
+ * The minimum portion of a delta update that must be unchanged since the
+ * previous frame, as the reciprocal of a fraction. A value of 4 requires at
+ * least a quarter of the pixels within the update to be unchanged.
+ */
+#define GUAC_DISPLAY_DELTA_MIN_UNCHANGED_RATIO 4
+
+/**
+ * The first key color tried when sending a delta update, as 24-bit RGB.
+ * Magenta is chosen as it rarely appears within typical screen content.
+ */
+#define GUAC_DISPLAY_DELTA_INITIAL_KEY 0xFF00FF
+
+/**
+ * The maximum number of key colors tried when sending a delta update before
+ * falling back to sending the update normally.
+ */
+#define GUAC_DISPLAY_DELTA_MAX_KEY_ATTEMPTS 8
+
+/**
+ * The minimum number of consecutive rows (or columns) of a layer that must be
+ * found to have moved by the same offset for that movement to be sent as a
+ * single scroll (see PFR_LFR_guac_display_plan_rewrite_as_scrolls()).
+ * Smaller movements are left to the search for individual cells.
+ */
+#define GUAC_DISPLAY_SCROLL_MIN_LENGTH 64
+
+/**
+ * The minimum number of distinct rows (or columns) of a layer that must agree
+ * on the same offset for that offset to be considered a scroll. Rows that
+ * appear more than once within the previous frame (like rows of solid
+ * background) cannot be attributed to any one offset and do not count.
+ */
+#define GUAC_DISPLAY_SCROLL_MIN_MATCHES 8
+
 /**
  * The JPEG compression min block size, as the exponent of a power of two. This
  * defines the optimal rectangle block size factor for JPEG compression.
@@ -141,10 +251,37 @@ typedef enum guac_display_plan_operation_type {
     /**
      * Draw arbitrary image data to the destination rect.
      */
-    GUAC_DISPLAY_PLAN_OPERATION_IMG
+    GUAC_DISPLAY_PLAN_OPERATION_IMG,
+
+    /**
+     * Redraw the destination rect, which was previously sent to connected
+     * clients at reduced quality, at full quality. Operations of this type are
+     * never part of a guac_display_plan. They are instead added directly to
+     * the operation FIFO by the worker thread that finishes a frame, and are
+     * dropped (to be retried after the next frame) if a newer frame is
+     * already waiting by the time they are received.
+     */
+    GUAC_DISPLAY_PLAN_OPERATION_REFINE,
+
+    /**
+     * Assist with constructing the next display plan by performing any
+     * outstanding tasks that have been submitted through
+     * guac_display_plan_run_tasks(). Operations of this type are never part of
+     * a guac_display_plan. They are instead added directly to the operation
+     * FIFO to enlist idle worker threads, and have no associated layer or
+     * destination rect.
+     */
+    GUAC_DISPLAY_PLAN_OPERATION_ASSIST
 
 } guac_display_plan_operation_type;
 
+/**
+ * Image data that was already encoded by the caller and that reproduces a
+ * region of a layer, as hinted with guac_display_layer_hint_image(). This
+ * structure is defined within display-priv.h.
+ */
+typedef struct guac_display_image_hint guac_display_image_hint;
+
 /**
  * A reference to a rectangular region of image data within a layer of the
  * remote Guacamole display.
@@ -164,6 +301,32 @@ typedef struct guac_display_plan_layer_rect {
 
 } guac_display_plan_layer_rect;
 
+/**
+ * A copy of part of a glyph hinted with guac_display_layer_hint_glyph(),
+ * replacing the draw operation of the cell of the destination layer that
+ * contains that part of the glyph.
+ */
+typedef struct guac_display_plan_glyph {
+
+    /**
+     * The destination layer (recipient of the copied glyph).
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The location within the destination layer that will receive the copied
+     * glyph.
+     */
+    guac_rect dest;
+
+    /**
+     * The region of image data that should be copied to the destination
+     * rect.
+     */
+    guac_display_plan_layer_rect src;
+
+} guac_display_plan_glyph;
+
 /**
  * Any one of several operations that may be contained in a guac_display_plan.
  */
@@ -205,6 +368,35 @@ typedef struct guac_display_plan_operation {
      */
     guac_timestamp current_frame;
 
+    /**
+     * The number of consecutive updates, up to and including this operation,
+     * that the destination rect has received at a rate of at least
+     * GUAC_DISPLAY_MOTION_FRAMERATE. If this operation is the combination of
+     * several operations, this is the smallest such count of those
+     * operations. This value is capped at GUAC_DISPLAY_MOTION_MIN_FRAMES.
+     */
+    unsigned int motion_frames;
+
+    /**
+     * The hash of the contents of the 64x64 cell modified by this operation,
+     * as calculated by PFR_guac_display_plan_index_dirty_cells(). This value
+     * applies only to GUAC_DISPLAY_PLAN_OPERATION_IMG operations that modify
+     * a cell lying entirely within the bounds of the destination layer, and
+     * only until operations have been combined.
+     */
+    uint64_t hash;
+
+    /**
+     * The contents of the destination rect as of the previous frame, as
+     * retained by LFR_guac_display_plan_retain_previous(), in the same format
+     * as the layer's image buffer but with rows packed together (a stride of
+     * exactly the width of the destination rect times
+     * GUAC_DISPLAY_LAYER_RAW_BPP). This value applies only to
+     * GUAC_DISPLAY_PLAN_OPERATION_IMG operations, and is NULL if the previous
+     * contents were not retained.
+     */
+    const unsigned char* previous;
+
     union {
 
         /**
@@ -221,8 +413,62 @@ typedef struct guac_display_plan_operation {
 
     } src;
 
+    /**
+     * Image data, already encoded by the caller, that reproduces exactly the
+     * destination rect of the destination layer, or NULL if the destination
+     * rect must be encoded as usual. This value applies only to
+     * GUAC_DISPLAY_PLAN_OPERATION_IMG operations. The hint is owned by the
+     * destination layer and remains valid until the next frame is committed.
+     */
+    const guac_display_image_hint* image;
+
+    /**
+     * Whether the destination rect must be sent losslessly, regardless of
+     * how frequently it has been updated. This value applies only to
+     * GUAC_DISPLAY_PLAN_OPERATION_REFINE operations, and is set for
+     * refinements of regions that were sent at reduced quality and have
+     * since stopped changing.
+     */
+    int lossless;
+
+    /**
+     * Whether the destination rect lies within GUAC_DISPLAY_FOCUS_RADIUS
+     * pixels of the mouse pointer, in which case this operation is handed to
+     * the worker threads before any operation that does not. This value is
+     * assigned by guac_display_plan_apply().
+     */
+    int focused;
+
 } guac_display_plan_operation;
 
+/**
+ * The offset between two sequences of rows (or columns) of image data at which
+ * a contiguous range of those rows best matches, as found by
+ * guac_display_plan_find_scroll().
+ */
+typedef struct guac_display_plan_scroll {
+
+    /**
+     * The number of rows (or columns) that the matching range moved between
+     * the previous frame and the current frame. Positive values indicate
+     * movement toward higher indices (down or right).
+     */
+    int offset;
+
+    /**
+     * The index of the first row (or column) of the matching range, relative
+     * to the current frame.
+     */
+    int start;
+
+    /**
+     * The index of the row (or column) immediately after the last row (or
+     * column) of the matching range, relative to the current frame.
+     */
+    int end;
+
+} guac_display_plan_scroll;
+
 /**
  * A guac_display_plan_operation that has been hashed and stored within a
  * guac_display_plan.
@@ -260,6 +506,12 @@ typedef struct guac_display_plan {
      */
     guac_display* display;
 
+    /**
+     * The time that the previous frame ended, and thus the time that this
+     * frame began.
+     */
+    guac_timestamp frame_start;
+
     /**
      * The time that the frame ended.
      */
@@ -284,6 +536,19 @@ typedef struct guac_display_plan {
      */
     guac_display_plan_indexed_operation ops_by_hash[GUAC_DISPLAY_PLAN_OPERATION_INDEX_SIZE];
 
+    /**
+     * Array of all copies of hinted glyphs that replace draw operations of
+     * entire cells, as found by PFR_LFR_guac_display_plan_rewrite_as_glyphs().
+     * Like the operations of the plan, these copies do not overlap each other
+     * nor any other operation. This is NULL if no glyphs are copied.
+     */
+    guac_display_plan_glyph* glyphs;
+
+    /**
+     * The number of copies stored in the glyphs array.
+     */
+    size_t glyphs_length;
+
 } guac_display_plan;
 
 /**
@@ -301,7 +566,10 @@ typedef struct guac_display_plan {
  * picked up after the currently-pending frame has finished encoded.
  *
  * The returned guac_display_plan must eventually be manually freed by a call
- * to guac_display_plan_free().
+ * to guac_display_plan_free(). The plan, and all other temporary memory used
+ * while planning the frame, is allocated from the plan_arena of the display,
+ * and remains valid only until the plan is freed (or, if no plan is
+ * returned, not at all).
  *
  * IMPORTANT: The calling thread must already hold the write lock for the
  * display's pending_frame.lock, and must at least hold the read lock for the
@@ -319,7 +587,9 @@ typedef struct guac_display_plan {
 guac_display_plan* PFW_LFR_guac_display_plan_create(guac_display* display);
 
 /**
- * Frees all memory associated with the given guac_display_plan.
+ * Frees all memory associated with the given guac_display_plan, resetting the
+ * plan_arena of its display. All other memory allocated from that arena while
+ * planning the frame is released, as well.
  *
  * @param plan
  *     The plan to free.
@@ -336,6 +606,59 @@ void guac_display_plan_free(guac_display_plan* plan);
  */
 void PFR_guac_display_plan_rewrite_as_rects(guac_display_plan* plan);
 
+/**
+ * Searches the given hashes of each row (or column) of a region of image data
+ * for a single, non-zero offset at which the current frame matches the
+ * previous frame, as would be the case if the contents of that region had
+ * scrolled. The offset chosen is the offset that the greatest number of
+ * distinct rows agree upon, and the matching range is the longest contiguous
+ * range of rows having that offset. No pixel data is compared. Any match
+ * should be verified against the image data before being used.
+ *
+ * @param arena
+ *     The arena from which any temporary memory required by the search
+ *     should be allocated.
+ *
+ * @param pending_hashes
+ *     The hash of each row of the region, as of the current frame.
+ *
+ * @param last_hashes
+ *     The hash of each row of the region, as of the previous frame.
+ *
+ * @param length
+ *     The number of rows in the region (the number of elements in each of
+ *     the given arrays).
+ *
+ * @param scroll
+ *     The guac_display_plan_scroll that should receive the offset and
+ *     matching range found, if any.
+ *
+ * @return
+ *     Non-zero if an offset was found that at least
+ *     GUAC_DISPLAY_SCROLL_MIN_MATCHES distinct rows agree upon, with a
+ *     matching range of at least GUAC_DISPLAY_SCROLL_MIN_LENGTH rows, zero
+ *     otherwise.
+ */
+int guac_display_plan_find_scroll(guac_display_arena* arena,
+        const uint64_t* pending_hashes, const uint64_t* last_hashes,
+        int length, guac_display_plan_scroll* scroll);
+
+/**
+ * Walks through all layers modified by the given guac_display_plan, searching
+ * the modified region of each opaque layer for a single vertical or
+ * horizontal offset by which most of that region has moved (scrolled) since
+ * the previous frame. Each scroll found is represented by a single copy
+ * operation pulling from the previous frame, with all draw operations
+ * entirely within the scrolled region removed and any partially-overlapping
+ * draw operations trimmed where possible. This function must be invoked
+ * before guac_display_plan_index_dirty_cells() such that only the remaining
+ * draw operations are searched at the level of individual cells.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_LFR_guac_display_plan_rewrite_as_scrolls(guac_display_plan* plan);
+
 /**
  * Walks through all operations currently in the given guac_display_plan,
  * storing the hashes of each outstanding draw operation within ops_by_hash.
@@ -359,6 +682,63 @@ void PFR_guac_display_plan_index_dirty_cells(guac_display_plan* plan);
  */
 void PFR_LFR_guac_display_plan_rewrite_as_copies(guac_display_plan* plan);
 
+/**
+ * Walks through all operations currently in the given guac_display_plan,
+ * replacing draw operations with simple copies from the display's cache of
+ * recently-sent cells wherever the contents of the modified cell have been
+ * sent recently and are still cached client-side. Draw operations whose cells
+ * are not cached are added to the cache. The display plan must first be
+ * indexed by guac_display_plan_index_dirty_cells() before this function can
+ * be used.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_guac_display_plan_rewrite_as_cached(guac_display_plan* plan);
+
+/**
+ * Walks through all layers modified by the given guac_display_plan, replacing
+ * the draw operation of each cell whose changes are entirely covered by
+ * glyphs hinted with guac_display_layer_hint_glyph() with copies of those
+ * glyphs, stored within the glyphs array of the plan. Each hint is verified
+ * against the image data of both frames, and is ignored if inaccurate. As
+ * only remaining draw operations are replaced, this function must be invoked
+ * after all passes that rewrite entire cells as copies (which require fewer
+ * instructions), and before operations are combined.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_LFR_guac_display_plan_rewrite_as_glyphs(guac_display_plan* plan);
+
+/**
+ * Walks through all layers modified by the given guac_display_plan, replacing
+ * the draw operations covering each region hinted with
+ * guac_display_layer_hint_image() with a single draw operation that sends the
+ * hinted image data as-is. Hints are verified against the contents of the
+ * pending frame, and are ignored if the hinted region has since changed, lies
+ * outside the bounds of the layer, or overlaps another hinted region. This
+ * function must be invoked after all other passes that may rewrite draw
+ * operations as copies, and before operations are combined.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_guac_display_plan_rewrite_as_hinted_images(guac_display_plan* plan);
+
+/**
+ * Replaces the draw operations that update the mouse cursor of the display
+ * with a single copy from the display's cache of recently-sent cursor images
+ * if the new cursor image was sent recently and is still cached client-side.
+ * If the new cursor image is not cached, it is added to the cache, and is
+ * stored client-side once the frame has been sent. This function has no
+ * effect if the mouse cursor has not changed.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void PFR_guac_display_plan_rewrite_as_cached_cursor(guac_display_plan* plan);
+
 /**
  * Walks through all operations currently in the given guac_display_plan,
  * combining horizontally-adjacent operations wherever doing so appears to be
@@ -379,16 +759,34 @@ void PFW_guac_display_plan_combine_horizontally(guac_display_plan* plan);
  */
 void PFW_guac_display_plan_combine_vertically(guac_display_plan* plan);
 
+/**
+ * Walks through all operations currently in the given guac_display_plan,
+ * retaining the previous contents of the destination rects of image
+ * operations that may be sent as delta updates. This must be invoked after
+ * all other passes and prior to the pending frame being copied over the last
+ * frame. If delta updates are disabled, this function only marks all
+ * operations as having no retained contents.
+ *
+ * @param plan
+ *     The guac_display_plan to modify.
+ */
+void LFR_guac_display_plan_retain_previous(guac_display_plan* plan);
+
 /**
  * Enqueues all operations from the given plan within the operation FIFO used
  * by the worker threads of the display associated with that plan. The
  * display's worker threads will immediately begin picking up and performing
  * these operations, with the final operation resulting in a frame boundary
- * ("sync" instruction) being sent to connected users.
+ * ("sync" instruction) being sent to connected users. Operations that do not
+ * require encoding are sent immediately and are not added to the FIFO.
  *
  * @param plan
  *     The guac_display_plan to apply.
+ *
+ * @return
+ *     The number of operations that were added to the operation FIFO. If
+ *     zero, no worker thread will send a frame boundary for this plan.
  */
-void guac_display_plan_apply(guac_display_plan* plan);
+size_t guac_display_plan_apply(guac_display_plan* plan);
 
 #endif
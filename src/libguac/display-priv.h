@@ -20,14 +20,18 @@
 #ifndef GUAC_DISPLAY_PRIV_H
 #define GUAC_DISPLAY_PRIV_H
 
+#include "display-arena.h"
+#include "display-memcmp.h"
 #include "display-plan.h"
 #include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/fifo.h"
+#include "guacamole/flag.h"
 #include "guacamole/rect.h"
 #include "guacamole/socket.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 /**
  * The maximum amount of time to wait after flushing a frame when compensating
@@ -115,6 +119,28 @@
  */
 #define GUAC_DISPLAY_CELL_SIZE_EXPONENT 6
 
+/**
+ * The size of the tiles into which the contents of each layer are divided
+ * when synchronizing newly-joined users with guac_display_dup(), in pixels.
+ * The encoded PNG of each tile is cached until any cell within that tile
+ * changes, such that only changed tiles need be re-encoded for later joins.
+ * This value MUST be a multiple of GUAC_DISPLAY_CELL_SIZE.
+ */
+#define GUAC_DISPLAY_DUP_TILE_SIZE 256
+
+/**
+ * Given the width (or height) of a layer in pixels, calculates the width (or
+ * height) of that layer's dup_tiles array in tiles.
+ *
+ * @param pixels
+ *     The width or height of the layer, in pixels.
+ *
+ * @return
+ *     The width or height of that layer's dup_tiles array, in tiles.
+ */
+#define GUAC_DISPLAY_DUP_TILE_DIMENSION(pixels) \
+    ((pixels + GUAC_DISPLAY_DUP_TILE_SIZE - 1) / GUAC_DISPLAY_DUP_TILE_SIZE)
+
 /**
  * The amount that the width/height of internal storage for graphical data
  * should be rounded up to avoid unnecessary reallocations and copying.
@@ -151,6 +177,86 @@
                 / GUAC_DISPLAY_CELL_SIZE                                      \
                 * 8)
 
+/**
+ * The number of milliseconds that a display worker thread may wait for a new
+ * operation before terminating to release its resources, if other worker
+ * threads remain running. Terminated worker threads are restarted as soon as
+ * the next frame begins (see guac_display_resume_workers()).
+ */
+#define GUAC_DISPLAY_WORKER_IDLE_TIMEOUT 15000
+
+/**
+ * The number of consecutive frames that must each be deferred while a
+ * previous frame is still being encoded before the number of worker threads
+ * of a display is increased (see guac_display_set_worker_threads()). Each
+ * such increase doubles the number of worker threads, up to the maximum
+ * allowed for the display.
+ */
+#define GUAC_DISPLAY_WORKER_BACKLOG_FRAMES 2
+
+/**
+ * The maximum combined network round-trip time and processing lag of a user
+ * that may still be considered part of the fast encoding tier, in
+ * milliseconds, if tiered encoding is enabled (see
+ * guac_display_set_tiered_encoding()). Users that lag further behind are part
+ * of the slow tier.
+ */
+#define GUAC_DISPLAY_TIER_FAST_MAX_LAG 50
+
+/**
+ * The smallest estimated bandwidth available to connected clients, in bytes
+ * per millisecond, at which updates that would otherwise be sent as PNG are
+ * instead sent as PNG encoded for speed rather than size (100 Mbps). At such
+ * rates, the time spent compressing image data typically exceeds the time
+ * saved in transferring it.
+ */
+#define GUAC_DISPLAY_FAST_PNG_MIN_BANDWIDTH 12500
+
+/**
+ * The maximum number of frames that may be tracked as sent but not yet
+ * acknowledged by connected clients for the sake of estimating available
+ * bandwidth. If more frames than this are awaiting acknowledgement, the most
+ * recent frames are merged together.
+ */
+#define GUAC_DISPLAY_SENT_FRAME_HISTORY 64
+
+/**
+ * The maximum number of copies that may be hinted for a single layer within
+ * a single frame with guac_display_layer_hint_copy(). If more copies than
+ * this are hinted, all hints for that layer and frame are ignored, and the
+ * layer is instead searched for copies as if no hints had been given.
+ */
+#define GUAC_DISPLAY_MAX_COPY_HINTS 64
+
+/**
+ * The maximum number of glyphs that may be hinted for a single layer within a
+ * single frame with guac_display_layer_hint_glyph(). Any further hints for
+ * that layer and frame are ignored, and the corresponding glyphs are encoded
+ * as usual.
+ */
+#define GUAC_DISPLAY_MAX_GLYPH_HINTS 65536
+
+/**
+ * The number of glyph hints that storage is initially allocated for when the
+ * first glyph is hinted for a layer. This storage grows as needed, up to
+ * GUAC_DISPLAY_MAX_GLYPH_HINTS, and is retained for reuse by later frames.
+ */
+#define GUAC_DISPLAY_INITIAL_GLYPH_HINTS 256
+
+/**
+ * The maximum number of regions of a single layer within a single frame that
+ * may be hinted as already encoded with guac_display_layer_hint_image(). Any
+ * further hints for that layer and frame are ignored, and the corresponding
+ * regions are encoded as usual.
+ */
+#define GUAC_DISPLAY_MAX_IMAGE_HINTS 16
+
+/**
+ * The maximum length of the mimetype of image data provided to
+ * guac_display_layer_hint_image(), in bytes, including the null terminator.
+ */
+#define GUAC_DISPLAY_IMAGE_HINT_MIMETYPE_SIZE 32
+
 /**
  * Returns the memory address of the given rectangle within the mutable image
  * buffer of the given guac_display_layer_state, where the upper-left corner of
@@ -205,6 +311,113 @@
 #define GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer_state, rect) \
     GUAC_RECT_CONST_BUFFER(rect, (layer_state).buffer, (layer_state).buffer_stride, GUAC_DISPLAY_LAYER_RAW_BPP)
 
+/**
+ * The number of rows of cells that should be covered by each task when
+ * searching a layer for changes in parallel. Each layer is divided into
+ * horizontal bands of this many cell rows, and each band is searched
+ * independently by whichever worker thread claims it.
+ */
+#define GUAC_DISPLAY_PLAN_TASK_BAND_HEIGHT 4
+
+/**
+ * The number of display plan operations that should be covered by each task
+ * when processing the operations of a display plan in parallel.
+ */
+#define GUAC_DISPLAY_PLAN_TASK_OPERATIONS 256
+
+/**
+ * Bitwise flag set on the state flag of guac_display_plan_tasks when all
+ * submitted tasks have been completed.
+ */
+#define GUAC_DISPLAY_PLAN_TASKS_COMPLETE 1
+
+/**
+ * The default amount of memory that may be used to cache the contents of
+ * recently-sent cells, in bytes. This same amount of memory is used both
+ * server-side (to verify that cache hits are not merely hash collisions) and
+ * client-side (within the buffers that actually store the cached cells).
+ */
+#define GUAC_DISPLAY_CACHE_DEFAULT_SIZE 4194304
+
+/**
+ * The amount of memory required to cache a single cell, in bytes.
+ */
+#define GUAC_DISPLAY_CACHE_ENTRY_SIZE \
+    (GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP)
+
+/**
+ * The number of hash buckets within the cache of recently-sent cells. This
+ * value MUST be a power of two.
+ */
+#define GUAC_DISPLAY_CACHE_BUCKETS 4096
+
+/**
+ * The number of distinct quality levels tracked for each lossy encoding by
+ * the encoder cost model. Quality levels are spaced
+ * GUAC_DISPLAY_ENCODER_QUALITY_STEP apart, starting at
+ * GUAC_DISPLAY_ENCODER_MIN_QUALITY.
+ */
+#define GUAC_DISPLAY_ENCODER_QUALITY_LEVELS 7
+
+/**
+ * The lowest quality level that will be used for lossy encodings.
+ */
+#define GUAC_DISPLAY_ENCODER_MIN_QUALITY 30
+
+/**
+ * The difference in quality between adjacent quality levels of the encoder
+ * cost model.
+ */
+#define GUAC_DISPLAY_ENCODER_QUALITY_STEP 10
+
+/**
+ * The weight given to previous measurements relative to each new measurement
+ * when updating the running averages of the encoder cost model. Each new
+ * measurement contributes 1/GUAC_DISPLAY_ENCODER_HISTORY of the updated
+ * average.
+ */
+#define GUAC_DISPLAY_ENCODER_HISTORY 8
+
+/**
+ * The smallest amount of time that will be considered available for encoding
+ * a single frame, in milliseconds, regardless of how quickly frames are
+ * arriving or how much processing lag connected clients are experiencing.
+ */
+#define GUAC_DISPLAY_ENCODER_MIN_BUDGET 5
+
+/**
+ * The largest amount of time that will be considered available for encoding
+ * a single frame, in milliseconds, regardless of how slowly frames are
+ * arriving.
+ */
+#define GUAC_DISPLAY_ENCODER_MAX_BUDGET 1000
+
+/**
+ * The format index used by frame tracing for image updates sent as PNG delta
+ * updates (see guac_display_set_delta_updates()). All other image updates are
+ * traced using the index of their guac_display_encoding.
+ */
+#define GUAC_DISPLAY_TRACE_FORMAT_DELTA GUAC_DISPLAY_ENCODING_COUNT
+
+/**
+ * The format index used by frame tracing for image updates sent using image
+ * data that was already encoded by the caller (see
+ * guac_display_layer_hint_image()).
+ */
+#define GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH (GUAC_DISPLAY_ENCODING_COUNT + 1)
+
+/**
+ * The number of distinct formats tracked by frame tracing, including
+ * GUAC_DISPLAY_TRACE_FORMAT_DELTA and GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH.
+ */
+#define GUAC_DISPLAY_TRACE_FORMATS (GUAC_DISPLAY_ENCODING_COUNT + 2)
+
+/**
+ * The maximum number of bytes within any single record written to the
+ * machine-readable trace stream, including the terminating newline.
+ */
+#define GUAC_DISPLAY_TRACE_RECORD_SIZE 1024
+
 /**
  * Bitwise flag set on the render_state flag in guac_display when rendering of
  * a pending frame is in progress (Guacamole instructions that draw the pending
@@ -315,550 +528,2855 @@ struct guac_display_render_thread {
      */
     unsigned int frames;
 
-};
-
-/**
- * Approximation of how often a region of a layer is modified, as well as what
- * changes have been made to that region since the last frame. This information
- * is used to help advise future optimizations, such as whether lossy
- * compression is appropriate and whether parts of the layer can be copied from
- * other regions rather than resend image data.
- */
-typedef struct guac_display_layer_cell {
+    /**
+     * The estimated rate that connected clients are able to receive data,
+     * in bytes per millisecond, or zero if no estimate is yet available. This
+     * is derived from the rate that sent frames are acknowledged while data
+     * remains continuously in flight.
+     *
+     * IMPORTANT: This member must only be accessed or modified by the render
+     * thread itself.
+     */
+    double bandwidth;
 
     /**
-     * The last time this particular cell was part of a frame (used to
-     * calculate framerate).
+     * The time at which the current bandwidth sample began, or zero if no
+     * sample is in progress.
+     *
+     * IMPORTANT: This member must only be accessed or modified by the render
+     * thread itself.
      */
-    guac_timestamp last_frame;
+    guac_timestamp sample_start;
 
     /**
-     * The region of this cell that has been modified since the last frame was
-     * flushed. If the cell has not been modified at all, this will be an empty
-     * rect.
+     * The number of bytes acknowledged by connected clients since the current
+     * bandwidth sample began.
+     *
+     * IMPORTANT: This member must only be accessed or modified by the render
+     * thread itself.
      */
-    guac_rect dirty;
+    uint64_t sample_bytes;
+
+};
+
+/**
+ * A frame that has been sent to connected clients, for the sake of estimating
+ * available bandwidth based on acknowledgement of that frame.
+ */
+typedef struct guac_display_sent_frame {
 
     /**
-     * The rough number of pixels in the dirty rect that have been modified. If
-     * the cell has not been modified at all, this will be zero.
+     * The timestamp of the frame, as sent within its "sync" instruction.
      */
-    size_t dirty_size;
+    guac_timestamp timestamp;
 
     /**
-     * The display plan operation that is associated with this cell. If a
-     * display plan is not currently being created or optimized, this will be
-     * NULL.
+     * The number of bytes of image data sent as part of the frame.
      */
-    guac_display_plan_operation* related_op;
+    uint64_t bytes;
 
-} guac_display_layer_cell;
+} guac_display_sent_frame;
 
 /**
- * The state of a Guacamole layer or buffer at some point in time. Within
- * guac_display_layer, copies of this structure are used to represent the
- * previous frame and the current, in-progress frame. The previous and
- * in-progress frames are compared during flush to determine what graphical
- * operations need to be sent to connected clients to efficiently transform the
- * remote display from its previous state to the now-current state.
+ * Callback which performs a single task of some larger portion of display
+ * plan construction that has been divided into independent tasks. Each task
+ * may be performed by any thread (including the thread that submitted the
+ * tasks), and tasks may be performed in any order and in parallel.
  *
- * IMPORTANT: The lock of the corresponding guac_display_state must be acquired
- * before reading or modifying the values of any member of this structure.
+ * IMPORTANT: Tasks are performed on behalf of the thread that submitted those
+ * tasks through guac_display_plan_run_tasks(), and thus on behalf of the locks
+ * held by that thread. Tasks MUST NOT acquire any of the locks of the
+ * guac_display.
+ *
+ * @param task
+ *     A pointer to the task to perform.
  */
-typedef struct guac_display_layer_state {
+typedef void guac_display_plan_task_callback(void* task);
+
+/**
+ * The set of tasks currently being performed in parallel as part of display
+ * plan construction. Only one set of tasks exists at any given time.
+ */
+typedef struct guac_display_plan_tasks {
 
     /**
-     * The width of this layer in pixels.
+     * Flag representing whether all tasks have been completed
+     * (GUAC_DISPLAY_PLAN_TASKS_COMPLETE). The lock of this flag additionally
+     * guards access to all other members of this structure.
      */
-    int width;
+    guac_flag state;
 
     /**
-     * The height of this layer in pixels.
+     * The callback that should be invoked to perform each task.
      */
-    int height;
+    guac_display_plan_task_callback* callback;
 
     /**
-     * The layer which contains this layer. This is only applicable to visible
-     * (non-buffer) layers which are not the default layer.
+     * Array of all tasks, each being task_size bytes.
      */
-    const guac_layer* parent;
+    unsigned char* tasks;
 
     /**
-     * The X coordinate of the upper-left corner of this layer, in pixels,
-     * relative to its parent layer. This is only applicable to visible
-     * (non-buffer) layers which are not the default layer.
+     * The size of each task in the tasks array, in bytes.
      */
-    int x;
+    size_t task_size;
 
     /**
-     * The Y coordinate of the upper-left corner of this layer, in pixels,
-     * relative to its parent layer. This is only applicable to visible
-     * (non-buffer) layers which are not the default layer.
+     * The number of tasks in the tasks array.
      */
-    int y;
+    size_t length;
 
     /**
-     * The Z-order of this layer, relative to sibling layers. This is only
-     * applicable to visible (non-buffer) layers which are not the default
-     * layer.
+     * The index of the next task that has not yet been claimed by any thread.
      */
-    int z;
+    size_t next;
 
     /**
-     * The level of opacity applied to this layer. Fully opaque is 255, while
-     * fully transparent is 0. This is only applicable to visible (non-buffer)
-     * layers which are not the default layer.
+     * The number of tasks that have not yet been completed, including tasks
+     * that have been claimed but are still in progress.
      */
-    int opacity;
+    size_t incomplete;
+
+} guac_display_plan_tasks;
+
+/**
+ * A single cell of image data that was sent to connected clients and is now
+ * cached client-side within its own off-screen buffer.
+ */
+typedef struct guac_display_cache_entry guac_display_cache_entry;
+
+struct guac_display_cache_entry {
 
     /**
-     * The number of simultaneous touches that this surface can accept, where 0
-     * indicates that the surface does not support touch events at all.
+     * The hash of the contents of this cell, as calculated when searching for
+     * copies (see display-plan-search.c).
      */
-    int touches;
+    uint64_t hash;
 
     /**
-     * Non-zero if all graphical updates for this surface should use lossless
-     * compression, 0 otherwise. By default, newly-created surfaces will use
-     * lossy compression when heuristics determine it is appropriate.
+     * The off-screen buffer that contains (or will contain) the contents of
+     * this cell client-side.
      */
-    int lossless;
+    guac_layer* buffer;
 
     /**
-     * The raw, 32-bit buffer of ARGB image data. If the layer was allocated as
-     * opaque, the alpha channel of each ARGB pixel will not be considered when
-     * compositing or when encoding images.
-     *
-     * So that large regions of image data can be easily compared, a consistent
-     * value for the alpha channel SHOULD be provided so that each 32-bit pixel
-     * can be compared without having to separately masking the channel.
-     * Optimizations within guac_display, including scroll detection, may
-     * assume that the alpha channel can always be considered when comparing
-     * pixel values for equivalence.
+     * Whether the contents of this cell have actually been copied into the
+     * client-side buffer. Entries that have not yet been stored are added
+     * while planning a frame and are stored only once that frame has been
+     * fully sent, via guac_display_cache_commit().
      */
-    unsigned char* buffer;
+    int stored;
 
     /**
-     * The width of the image data, in pixels. This is not necessarily the same
-     * as the width of the layer.
+     * The layer that will contain the contents of this cell once the current
+     * frame has been sent, if this entry has not yet been stored. Once
+     * stored, this will be NULL.
      */
-    int buffer_width;
+    guac_display_layer* layer;
 
     /**
-     * The height of the image data, in pixels. This is not necessarily the
-     * same as the height of the layer.
+     * The X coordinate of the upper-left corner of this cell within the
+     * layer, if this entry has not yet been stored.
      */
-    int buffer_height;
+    int x;
 
     /**
-     * The number of bytes in each row of image data. This is not necessarily
-     * equivalent to 4 * width.
+     * The Y coordinate of the upper-left corner of this cell within the
+     * layer, if this entry has not yet been stored.
      */
-    size_t buffer_stride;
+    int y;
 
     /**
-     * Non-zero if the image data referenced by the buffer pointer was
-     * allocated externally and should not be automatically freed or managed by
-     * guac_display, zero otherwise.
+     * The timestamp of the frame that added this entry. As each entry is
+     * allocated its own buffer, a view of the display resumed from any
+     * earlier frame lacks the contents of this entry.
      */
-    int buffer_is_external;
+    guac_timestamp added;
 
     /**
-     * The approximate rectangular region containing all pixels within this
-     * layer that have been modified since the frame that occurred before this
-     * frame. If the layer was not modified, this will be an empty rect (zero
-     * width or zero height).
+     * The timestamp of the frame that most recently referenced this entry.
+     * Entries referenced by the frame currently being planned are never
+     * evicted.
      */
-    guac_rect dirty;
+    guac_timestamp last_used;
 
     /**
-     * Whether this layer should be searched for possible scroll/copy
-     * optimizations.
+     * The previous (more recently used) entry in the cache, or NULL if this
+     * is the most recently used entry.
      */
-    int search_for_copies;
+    guac_display_cache_entry* prev;
 
-    /* ---------------- LAYER LIST POINTERS ---------------- */
+    /**
+     * The next (less recently used) entry in the cache, or NULL if this is
+     * the least recently used entry.
+     */
+    guac_display_cache_entry* next;
 
     /**
-     * The layer immediately prior to this layer within the list containing
-     * this layer, or NULL if this is the first layer/buffer in the list.
+     * The next entry within the same hash bucket, or NULL if this is the last
+     * such entry.
      */
-    guac_display_layer* prev;
+    guac_display_cache_entry* next_in_bucket;
 
     /**
-     * The layer immediately following this layer within the list containing
-     * this layer, or NULL if this is the last layer/buffer in the list.
+     * The next entry that has not yet been stored, or NULL if this is the
+     * last such entry.
      */
-    guac_display_layer* next;
+    guac_display_cache_entry* next_pending;
 
-} guac_display_layer_state;
+    /**
+     * The contents of this cell, with each row being exactly
+     * GUAC_DISPLAY_CELL_SIZE pixels.
+     */
+    uint32_t data[GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE];
 
-struct guac_display_layer {
+};
+
+/**
+ * Least-recently-used cache of cells that were recently sent to connected
+ * clients, keyed by the hashes of their contents. Cells that are sent again
+ * after being overwritten (such as when switching between windows) can then
+ * be restored with simple copies rather than resending image data.
+ */
+typedef struct guac_display_cache {
 
     /**
-     * The guac_display instance that allocated this layer/buffer.
+     * Lock which guards access to all other members of this structure.
      */
-    guac_display* display;
+    pthread_mutex_t lock;
 
     /**
-     * The Guacamole layer (or buffer) that this guac_display_layer will draw
-     * to when flushing a frame.
-     *
-     * NOTE: This value is set only during allocation and may safely be
-     * accessed without acquiring the overall layer lock.
+     * The client that owns the client-side buffers of all entries.
      */
-    const guac_layer* layer;
+    guac_client* client;
 
     /**
-     * Whether the graphical data that will be written to this layer/buffer
-     * will only ever be opaque (no alpha channel). Compositing of graphical
-     * updates can be faster when no alpha channel need be considered.
+     * The maximum number of entries that may be present in the cache at any
+     * one time. If zero, caching is disabled.
      */
-    int opaque;
+    size_t capacity;
 
-    /* ---------------- LAYER PREVIOUS FRAME STATE ---------------- */
+    /**
+     * The number of entries currently in the cache.
+     */
+    size_t length;
 
     /**
-     * The state of this layer when the last frame was flushed to connected clients.
-     *
-     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The most recently used entry, or NULL if the cache is empty.
      */
-    guac_display_layer_state last_frame;
+    guac_display_cache_entry* head;
 
     /**
-     * Off-screen buffer storing the contents of the previously-rendered frame
-     * for later use. If graphical updates are recognized as reusing data from
-     * a previous frame, that data will be copied from this buffer. Doing this
-     * simplifies the copy operation (there is no longer any need to perform
-     * those copies in a specific order) and ensures the copies are efficient
-     * on the client side (copying from one part of a graphical surface to
-     * another part of the same surface can be inefficient, particularly if the
-     * regions overlap). In practice, there is ample time between frames for
-     * the client to copy a layer's current contents to an off-screen buffer
-     * while awaiting the next frame.
-     *
-     * NOTE: This value is set only during allocation and may safely be
-     * accessed without acquiring the display-level last_frame.lock.
+     * The least recently used entry, or NULL if the cache is empty.
      */
-    guac_layer* last_frame_buffer;
-
-    /* ---------------- LAYER PENDING FRAME STATE ---------------- */
+    guac_display_cache_entry* tail;
 
     /**
-     * The upcoming state of this layer when the current, in-progress frame is
-     * flushed to connected clients.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * All entries that have not yet been stored client-side, or NULL if there
+     * are no such entries.
      */
-    guac_display_layer_state pending_frame;
+    guac_display_cache_entry* pending;
 
     /**
-     * The Cairo context and surface containing the graphical data of the
-     * pending frame. The actual underlying buffer and details of the graphical
-     * surface are also available via pending_frame_raw_context.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * Hash table of all entries, indexed by the least significant bits of
+     * GUAC_DISPLAY_PLAN_OPERATION_HASH().
      */
-    guac_display_layer_cairo_context pending_frame_cairo_context;
+    guac_display_cache_entry* buckets[GUAC_DISPLAY_CACHE_BUCKETS];
 
     /**
-     * The raw underlying buffer and details of the surface containing the
-     * graphical data of the pending frame. A Cairo context and surface backed
-     * by this buffer are also available via pending_frame_cairo_context.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The total number of cells that were restored from the cache.
      */
-    guac_display_layer_raw_context pending_frame_raw_context;
+    uint64_t hits;
 
     /**
-     * A two-dimensional array of square tiles representing the nature of
-     * changes made to corresponding regions of the display. This is used both
-     * to track how frequently certain regions are being updated (to help
-     * inform whether lossy compression is appropriate), to track what parts of
-     * the frame have actually changed, and to aid in determining whether
-     * adjacent updated regions should be combined into a single update.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The total number of cells that were looked up but not present in the
+     * cache.
      */
-    guac_display_layer_cell* pending_frame_cells;
+    uint64_t misses;
 
     /**
-     * The width of the pending_frame_cells array, in cells.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The total number of entries that were evicted from the cache to make
+     * room for other entries.
      */
-    size_t pending_frame_cells_width;
+    uint64_t evictions;
+
+} guac_display_cache;
+
+/**
+ * The number of distinct mouse cursor images that may be cached client-side
+ * at any one time.
+ */
+#define GUAC_DISPLAY_CURSOR_CACHE_SIZE 16
+
+/**
+ * The largest width or height of any mouse cursor image that may be cached
+ * client-side, in pixels. Larger cursor images are always sent as new image
+ * data.
+ */
+#define GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION 128
+
+/**
+ * A mouse cursor image that was sent to connected clients and is now cached
+ * client-side within its own off-screen buffer, such that switching back to
+ * that cursor requires only a copy.
+ */
+typedef struct guac_display_cursor_cache_entry {
 
     /**
-     * The height of the pending_frame_cells array, in cells.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The hash of the contents of this cursor image, including its
+     * dimensions.
      */
-    size_t pending_frame_cells_height;
+    uint64_t hash;
 
-};
+    /**
+     * The width of this cursor image, in pixels, or zero if this entry is
+     * unused.
+     */
+    int width;
 
-typedef struct guac_display_state {
+    /**
+     * The height of this cursor image, in pixels, or zero if this entry is
+     * unused.
+     */
+    int height;
 
     /**
-     * Lock that guards concurrent access to any member of ANY STRUCTURE that
-     * relates to this guac_display_state, including the members of this
-     * structure. Unless explicitly documented otherwise, this lock MUST be
-     * acquired before accessing or modifying the members of this
-     * guac_display_state or any nested structure.
+     * The off-screen buffer that contains (or will contain) this cursor
+     * image client-side, or NULL if no buffer has yet been allocated.
      */
-    guac_rwlock lock;
+    guac_layer* buffer;
 
     /**
-     * The specific point in time that this guac_display_state represents.
+     * Whether this cursor image has actually been copied into the
+     * client-side buffer. An entry that has not yet been stored is added
+     * while planning a frame and is stored only once that frame has been
+     * fully sent, via guac_display_cursor_cache_commit().
      */
-    guac_timestamp timestamp;
+    int stored;
 
     /**
-     * All layers and buffers that were part of the display at the time that
-     * the frame/snapshot represented by this guac_display_state was updated.
-     * 
-     * NOTE: For each guac_display, there are two distinct lists of layers: the
-     * last frame layer list and the pending frame layer list:
-     *
-     * LAST FRAME LAYER LIST
-     *
-     *  - HEAD: display->last_frame.layers
-     *  - NEXT: layer->last_frame.next
-     *  - PREV: layer->last_frame.prev
-     *
-     * PENDING LAYER LIST
-     *
-     *  - HEAD: display->pending_frame.layers
-     *  - NEXT: layer->pending_frame.next
-     *  - PREV: layer->pending_frame.prev
-     *
-     * Existing layers are deleted only at the time a frame is flushed when a
-     * layer in the last frame layer list is found to no longer exist in the
-     * pending frame layer list. The same goes for the addition of new layers:
-     * they are added only during flush when a layer that was not present in
-     * the last frame layer list is found to be present in the pending frame
-     * layer list.
+     * The timestamp of the frame that most recently referenced this entry.
      */
-    guac_display_layer* layers;
+    guac_timestamp last_used;
 
     /**
-     * The X coordinate of the hotspot of the mouse cursor. The cursor image is
-     * stored/updated via the cursor_buffer member of guac_display.
+     * The contents of this cursor image, with each row being exactly the
+     * width of the cursor image.
      */
-    int cursor_hotspot_x;
+    uint32_t data[GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION * GUAC_DISPLAY_CURSOR_CACHE_MAX_DIMENSION];
+
+} guac_display_cursor_cache_entry;
+
+/**
+ * All image encodings that may be used by the display worker threads to send
+ * image data.
+ */
+typedef enum guac_display_encoding {
 
     /**
-     * The Y coordinate of the hotspot of the mouse cursor. The cursor image is
-     * stored/updated via the cursor_buffer member of guac_display.
+     * Lossless PNG.
      */
-    int cursor_hotspot_y;
+    GUAC_DISPLAY_ENCODING_PNG,
 
     /**
-     * The user that moved or clicked the mouse. This is used to ensure we
-     * don't attempt to synchronize an out-of-date mouse position to the user
-     * that is actively moving the mouse.
-     *
-     * NOTE: This user is NOT guaranteed to still exist in memory. This may be
-     * a dangling pointer and must be validated before deferencing.
+     * Lossy JPEG, which requires the destination layer to be opaque.
      */
-    guac_user* cursor_user;
+    GUAC_DISPLAY_ENCODING_JPEG,
 
     /**
-     * The X coordinate of the mouse cursor.
+     * Lossy WebP, which requires client support for WebP.
      */
-    int cursor_x;
+    GUAC_DISPLAY_ENCODING_WEBP,
 
     /**
-     * The Y coordinate of the mouse cursor.
+     * Lossless WebP, which requires client support for WebP.
      */
-    int cursor_y;
+    GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS,
 
     /**
-     * The mask representing the states of all mouse buttons.
+     * Lossless PNG encoded for speed rather than size, used only while
+     * connected clients have bandwidth to spare (see
+     * GUAC_DISPLAY_FAST_PNG_MIN_BANDWIDTH).
      */
-    int cursor_mask;
+    GUAC_DISPLAY_ENCODING_PNG_FAST,
 
     /**
-     * The number of logical frames that have been rendered to this display
-     * state since the previous display state.
+     * The number of distinct encodings. This value MUST be last.
      */
-    unsigned int frames;
+    GUAC_DISPLAY_ENCODING_COUNT
 
-} guac_display_state;
+} guac_display_encoding;
 
-struct guac_display {
+/**
+ * Running averages of the cost of encoding image data using a particular
+ * encoding and quality level.
+ */
+typedef struct guac_display_encoder_stats {
 
-    /* NOTE: Any member of this structure that requires protection against
-     * concurrent access is protected by its own lock. The overall display does
-     * not have nor need a top-level lock. */
+    /**
+     * The average amount of time required to encode each pixel, in
+     * nanoseconds.
+     */
+    double ns_per_pixel;
 
     /**
-     * The client associated with this display.
+     * The average number of bytes sent for each pixel encoded, including any
+     * protocol overhead.
      */
-    guac_client* client;
+    double bytes_per_pixel;
 
-    /* ---------------- DISPLAY FRAME STATES ---------------- */
+    /**
+     * The number of measurements that have contributed to these averages. If
+     * zero, the averages are initial estimates only.
+     */
+    unsigned int samples;
+
+} guac_display_encoder_stats;
+
+/**
+ * Model of the cost of each possible encoding and quality level, continuously
+ * refined by measurements taken by the display worker threads as image data
+ * is encoded and sent.
+ */
+typedef struct guac_display_encoder_model {
 
     /**
-     * The state of this display at the time the last frame was sent to
-     * connected users.
+     * Lock which guards access to all other members of this structure.
      */
-    guac_display_state last_frame;
+    pthread_mutex_t lock;
 
     /**
-     * The pending state of this display that will become the next frame once
-     * it is sent to connected users.
+     * The costs of each encoding at each quality level. Lossless encodings
+     * use only the first quality level.
      */
-    guac_display_state pending_frame;
+    guac_display_encoder_stats stats[GUAC_DISPLAY_ENCODING_COUNT][GUAC_DISPLAY_ENCODER_QUALITY_LEVELS];
+
+} guac_display_encoder_model;
+
+/**
+ * An encoding and quality level chosen for encoding a particular update.
+ */
+typedef struct guac_display_encoder_choice {
 
     /**
-     * Whether the pending frame has been modified in any way outside of
-     * changing the mouse cursor or moving the mouse. This is used to help
-     * inform whether a frame should be flushed to update connected clients
-     * with respect to mouse cursor changes, or whether those changes can be
-     * safely assumed to be part of a larger frame containing general graphical
-     * updates.
-     *
-     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
-     * modifying or reading this member.
+     * The encoding that should be used.
      */
-    int pending_frame_dirty_excluding_mouse;
+    guac_display_encoding encoding;
 
-    /* ---------------- WELL-KNOWN LAYERS / BUFFERS ---------------- */
+    /**
+     * The quality that should be used, from 0 to 100 inclusive. This value is
+     * only meaningful for lossy encodings.
+     */
+    int quality;
+
+} guac_display_encoder_choice;
+
+/**
+ * The distinct phases of handling a frame that are timed by frame tracing.
+ * The first six phases are the planning phases performed by
+ * guac_display_end_multiple_frames(), and MUST remain in that order.
+ */
+typedef enum guac_display_trace_phase {
 
     /**
-     * The default layer of the client display.
+     * Creation of the naive plan by comparing the pending and last frames.
      */
-    guac_display_layer* default_layer;
+    GUAC_DISPLAY_TRACE_PHASE_DRAFT,
 
     /**
-     * The buffer storing the current mouse cursor. The hotspot position within
-     * the cursor is stored within cursor_hotspot_x and cursor_hotspot_y of
-     * guac_display_state.
+     * Replacement of single-color draws with rectangles.
      */
-    guac_display_layer* cursor_buffer;
+    GUAC_DISPLAY_TRACE_PHASE_RECTS,
 
-    /* ---------------- FRAME ENCODING WORKER THREADS ---------------- */
+    /**
+     * Search for scrolls, copies, and cached cells.
+     */
+    GUAC_DISPLAY_TRACE_PHASE_SEARCH,
 
     /**
-     * The number of worker threads in the worker_threads array.
+     * Combination of adjacent operations.
      */
-    int worker_thread_count;
+    GUAC_DISPLAY_TRACE_PHASE_COMBINE,
 
     /**
-     * Pool of worker threads that automatically pull from the ops FIFO,
-     * sending corresponding Guacamole instructions to all connected clients.
+     * Retention of previous contents for delta updates.
      */
-    pthread_t* worker_threads;
+    GUAC_DISPLAY_TRACE_PHASE_DELTA,
 
     /**
-     * FIFO of all graphical operations required to transform the remote
-     * display state from the previous frame to the next frame. Operations
-     * added to this FIFO will automatically be pulled and processed by a
-     * worker thread.
+     * Commit of the pending frame as the last frame.
      */
-    guac_fifo ops;
+    GUAC_DISPLAY_TRACE_PHASE_COMMIT,
 
     /**
-     * Storage for any items within the ops fifo.
+     * The time between the operations of the frame being made available to
+     * the worker threads and the first of those operations being picked up by
+     * a worker thread.
      */
-    guac_display_plan_operation ops_items[GUAC_DISPLAY_WORKER_FIFO_SIZE];
+    GUAC_DISPLAY_TRACE_PHASE_QUEUE,
 
     /**
-     * The current number of active worker threads.
-     *
-     * IMPORTANT: This member must only be accessed or modified while the ops
-     * FIFO is locked.
+     * The time between the first operation of the frame being picked up by a
+     * worker thread and the last operation of the frame being completed.
      */
-    unsigned int active_workers;
+    GUAC_DISPLAY_TRACE_PHASE_ENCODE,
 
     /**
-     * Whether least one pending frame has been deferred due to the encoding
-     * process being underway for a previous frame at the time it was
-     * completed.
-     *
-     * IMPORTANT: This member must only be accessed or modified while the ops
-     * FIFO is locked.
+     * Sending of everything that marks the end of the frame, including the
+     * final flush of the client socket.
      */
-    int frame_deferred;
+    GUAC_DISPLAY_TRACE_PHASE_FLUSH,
 
     /**
-     * The current state of the rendering process. Code that needs to be aware
-     * of whether a frame is currently in the process of being rendered can
-     * monitor the state of this flag, watching for either the
-     * GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS or
-     * GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS values.
+     * The number of distinct phases. This value MUST be last.
      */
-    guac_flag render_state;
+    GUAC_DISPLAY_TRACE_PHASE_COUNT
 
-};
+} guac_display_trace_phase;
 
 /**
- * Allocates and inserts a new element into the given linked list of display
- * layers, associating it with the given layer and surface.
- *
- * @param head
- *     A pointer to the head pointer of the list of layers. The head pointer
- *     will be updated by this function to point to the newly-allocated
- *     display layer.
- *
- * @param layer
- *     The Guacamole layer to associated with the new display layer.
- *
- * @param opaque
- *     Non-zero if the new layer will only ever contain opaque image contents
- *     (the alpha channel should be ignored), zero otherwise.
- *
- * @return
- *     The newly-allocated display layer, which has been associated with the
- *     provided layer and surface.
+ * Totals describing all image updates of a particular format that have been
+ * traced since the last periodic summary.
  */
-guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* layer, int opaque);
+typedef struct guac_display_trace_format_stats {
 
-/**
- * Removes the given layer from all linked lists containing that layer and
- * frees all associated memory.
- *
- * @param display_layer
- *     The layer to remove.
- */
-void guac_display_remove_layer(guac_display_layer* display_layer);
+    /**
+     * The number of image updates.
+     */
+    uint64_t ops;
+
+    /**
+     * The total number of pixels within all image updates.
+     */
+    uint64_t pixels;
+
+    /**
+     * The total number of bytes sent for all image updates, including any
+     * protocol overhead.
+     */
+    uint64_t bytes;
+
+    /**
+     * The total amount of time spent encoding and sending all image updates,
+     * in nanoseconds.
+     */
+    uint64_t encode_ns;
+
+} guac_display_trace_format_stats;
 
 /**
- * Resizes the given layer to the given dimensions, including any underlying
- * image buffers.
- *
- * @param layer
- *     The layer to resize.
- *
- * @param width
- *     The new width, in pixels.
- *
- * @param height
- *     The new height, in pixels.
+ * Optional instrumentation recording where the time of each frame is spent,
+ * as well as the format, size, and cost of each image update. Traced data may
+ * be periodically summarized within the log and/or written as a
+ * machine-readable stream of records (see guac_display_set_trace_interval()
+ * and guac_display_set_trace_output()).
  */
-void PFW_guac_display_layer_resize(guac_display_layer* layer,
-        int width, int height);
+typedef struct guac_display_trace {
+
+    /**
+     * Lock which guards access to all members of this structure that are not
+     * otherwise documented.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Whether tracing is currently enabled in any form. This member is atomic
+     * such that worker threads may check whether tracing is needed without
+     * acquiring the lock.
+     */
+    atomic_int active;
+
+    /**
+     * The file descriptor of the file or Unix domain socket receiving the
+     * machine-readable trace stream, or -1 if no such stream is being
+     * written.
+     */
+    int fd;
+
+    /**
+     * The number of milliseconds between periodic summaries of traced data
+     * within the log, or zero if no such summaries should be logged.
+     */
+    int interval;
+
+    /**
+     * The time that the current periodic summary began.
+     */
+    guac_timestamp summary_start;
+
+    /**
+     * The number of frames included in the current periodic summary.
+     */
+    uint64_t frames;
+
+    /**
+     * The total time spent within each phase for all frames included in the
+     * current periodic summary, in nanoseconds.
+     */
+    uint64_t phase_total[GUAC_DISPLAY_TRACE_PHASE_COUNT];
+
+    /**
+     * The longest time spent within each phase for any frame included in the
+     * current periodic summary, in nanoseconds.
+     */
+    uint64_t phase_max[GUAC_DISPLAY_TRACE_PHASE_COUNT];
+
+    /**
+     * Totals for all image updates included in the current periodic summary,
+     * indexed by format.
+     */
+    guac_display_trace_format_stats formats[GUAC_DISPLAY_TRACE_FORMATS];
+
+    /**
+     * The sequence number of the frame currently being planned or encoded.
+     *
+     * IMPORTANT: This member must only be modified while the pending frame is
+     * locked for writing and no frame is in progress. Worker threads may read
+     * this member without locking while processing the operations of a frame.
+     */
+    uint64_t frame;
+
+    /**
+     * The time spent within each phase of the frame currently being planned or
+     * encoded, in nanoseconds.
+     *
+     * IMPORTANT: The planning phases of this member must only be modified
+     * while the pending frame is locked for writing and no frame is in
+     * progress, and all other phases must only be modified while the ops FIFO
+     * is locked. Worker threads may read this member while the ops FIFO is
+     * locked.
+     */
+    uint64_t phases[GUAC_DISPLAY_TRACE_PHASE_COUNT];
+
+    /**
+     * The value of guac_display_encoder_clock() when the operations of the
+     * current frame were made available to the worker threads.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frame_queued;
+
+    /**
+     * The value of guac_display_encoder_clock() when the first operation of
+     * the current frame was picked up by a worker thread, or zero if no such
+     * operation has yet been picked up.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frame_dequeued;
+
+} guac_display_trace;
+
+/**
+ * Approximation of how often a region of a layer is modified, as well as what
+ * changes have been made to that region since the last frame. This information
+ * is used to help advise future optimizations, such as whether lossy
+ * compression is appropriate and whether parts of the layer can be copied from
+ * other regions rather than resend image data.
+ */
+typedef struct guac_display_layer_cell {
+
+    /**
+     * The last time this particular cell was part of a frame (used to
+     * calculate framerate).
+     */
+    guac_timestamp last_frame;
+
+    /**
+     * The number of consecutive frames in which this cell was modified at a
+     * rate of at least GUAC_DISPLAY_MOTION_FRAMERATE, capped at
+     * GUAC_DISPLAY_MOTION_MIN_FRAMES. Cells that reach
+     * GUAC_DISPLAY_MOTION_MIN_FRAMES are considered to contain full-motion
+     * content.
+     */
+    unsigned int motion_frames;
+
+    /**
+     * The region of this cell that has been modified since the last frame was
+     * flushed. If the cell has not been modified at all, this will be an empty
+     * rect.
+     */
+    guac_rect dirty;
+
+    /**
+     * The rough number of pixels in the dirty rect that have been modified. If
+     * the cell has not been modified at all, this will be zero.
+     */
+    size_t dirty_size;
+
+    /**
+     * Whether this cell has possibly been modified since the last frame was
+     * flushed. Only cells marked in this way are compared against the last
+     * frame when searching for changes, allowing scattered updates to be
+     * located without comparing everything within the overall bounding
+     * rectangle of those updates.
+     */
+    int damaged;
+
+    /**
+     * Whether this cell lies within a region of its layer that is currently
+     * open for drawing by a call to guac_display_layer_open_region(). No
+     * other region containing this cell may be opened until this cell is
+     * released by guac_display_layer_close_region().
+     *
+     * IMPORTANT: The display-level regions_lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int claimed;
+
+    /**
+     * The display plan operation that is associated with this cell. If a
+     * display plan is not currently being created or optimized, this will be
+     * NULL.
+     */
+    guac_display_plan_operation* related_op;
+
+} guac_display_layer_cell;
+
+/**
+ * The state of a region of a layer opened for drawing with
+ * guac_display_layer_open_region(), including the raw context returned to the
+ * caller.
+ */
+typedef struct guac_display_layer_region {
+
+    /**
+     * The raw context returned by guac_display_layer_open_region(). This MUST
+     * be the first member of this structure, such that the context may be
+     * converted back into the region containing it.
+     */
+    guac_display_layer_raw_context context;
+
+    /**
+     * The bounds of the region, in pixels, as originally provided within the
+     * raw context. Changes are accepted only within these bounds, regardless
+     * of any changes to the bounds of the context.
+     */
+    guac_rect bounds;
+
+    /**
+     * The cells claimed for the region, in units of cells rather than pixels.
+     */
+    guac_rect cells;
+
+} guac_display_layer_region;
+
+/**
+ * Returns whether copies have been explicitly hinted for the given
+ * guac_display_layer_state via guac_display_layer_hint_copy(), without
+ * exceeding GUAC_DISPLAY_MAX_COPY_HINTS. If so, those hints should be used
+ * instead of searching the layer for copies.
+ *
+ * @param layer_state
+ *     The guac_display_layer_state to test.
+ */
+#define GUAC_DISPLAY_LAYER_STATE_HAS_COPY_HINTS(layer_state) \
+    ((layer_state).copy_hint_count > 0                        \
+     && (layer_state).copy_hint_count <= GUAC_DISPLAY_MAX_COPY_HINTS)
+
+/**
+ * A copy into a layer that has been explicitly hinted via
+ * guac_display_layer_hint_copy(), guac_display_layer_hint_copy_from(), or
+ * guac_display_layer_hint_glyph(), rather than discovered by searching the
+ * contents of the layer.
+ */
+typedef struct guac_display_copy_hint {
+
+    /**
+     * The layer or buffer that image data was copied from. This may be the
+     * same layer that received the copy.
+     */
+    guac_display_layer* src_layer;
+
+    /**
+     * The region of the previous frame of src_layer that was copied.
+     */
+    guac_rect src;
+
+    /**
+     * The region of the pending frame of the layer that received the copied
+     * image data. This region is always the same size as src.
+     */
+    guac_rect dest;
+
+} guac_display_copy_hint;
+
+/**
+ * Image data that was already encoded by the caller and that reproduces a
+ * region of a layer exactly as drawn within a single frame, as hinted with
+ * guac_display_layer_hint_image().
+ */
+struct guac_display_image_hint {
+
+    /**
+     * The region of the layer reproduced by the image data.
+     */
+    guac_rect rect;
+
+    /**
+     * The mimetype of the image data.
+     */
+    char mimetype[GUAC_DISPLAY_IMAGE_HINT_MIMETYPE_SIZE];
+
+    /**
+     * The encoded image data.
+     */
+    void* data;
+
+    /**
+     * The number of bytes of encoded image data.
+     */
+    size_t length;
+
+    /**
+     * The contents of the hinted region of the layer at the time the hint was
+     * given, with rows packed together (a stride of exactly the width of the
+     * region times GUAC_DISPLAY_LAYER_RAW_BPP). If the region is modified in
+     * any way after the hint is given, the hint no longer applies.
+     */
+    unsigned char* snapshot;
+
+};
+
+/**
+ * The state of a Guacamole layer or buffer at some point in time. Within
+ * guac_display_layer, copies of this structure are used to represent the
+ * previous frame and the current, in-progress frame. The previous and
+ * in-progress frames are compared during flush to determine what graphical
+ * operations need to be sent to connected clients to efficiently transform the
+ * remote display from its previous state to the now-current state.
+ *
+ * IMPORTANT: The lock of the corresponding guac_display_state must be acquired
+ * before reading or modifying the values of any member of this structure.
+ */
+typedef struct guac_display_layer_state {
+
+    /**
+     * The width of this layer in pixels.
+     */
+    int width;
+
+    /**
+     * The height of this layer in pixels.
+     */
+    int height;
+
+    /**
+     * The layer which contains this layer. This is only applicable to visible
+     * (non-buffer) layers which are not the default layer.
+     */
+    const guac_layer* parent;
+
+    /**
+     * The X coordinate of the upper-left corner of this layer, in pixels,
+     * relative to its parent layer. This is only applicable to visible
+     * (non-buffer) layers which are not the default layer.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of this layer, in pixels,
+     * relative to its parent layer. This is only applicable to visible
+     * (non-buffer) layers which are not the default layer.
+     */
+    int y;
+
+    /**
+     * The Z-order of this layer, relative to sibling layers. This is only
+     * applicable to visible (non-buffer) layers which are not the default
+     * layer.
+     */
+    int z;
+
+    /**
+     * The level of opacity applied to this layer. Fully opaque is 255, while
+     * fully transparent is 0. This is only applicable to visible (non-buffer)
+     * layers which are not the default layer.
+     */
+    int opacity;
+
+    /**
+     * The number of simultaneous touches that this surface can accept, where 0
+     * indicates that the surface does not support touch events at all.
+     */
+    int touches;
+
+    /**
+     * Non-zero if all graphical updates for this surface should use lossless
+     * compression, 0 otherwise. By default, newly-created surfaces will use
+     * lossy compression when heuristics determine it is appropriate.
+     */
+    int lossless;
+
+    /**
+     * The raw, 32-bit buffer of ARGB image data. If the layer was allocated as
+     * opaque, the alpha channel of each ARGB pixel will not be considered when
+     * compositing or when encoding images.
+     *
+     * So that large regions of image data can be easily compared, a consistent
+     * value for the alpha channel SHOULD be provided so that each 32-bit pixel
+     * can be compared without having to separately masking the channel.
+     * Optimizations within guac_display, including scroll detection, may
+     * assume that the alpha channel can always be considered when comparing
+     * pixel values for equivalence.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The width of the image data, in pixels. This is not necessarily the same
+     * as the width of the layer.
+     */
+    int buffer_width;
+
+    /**
+     * The height of the image data, in pixels. This is not necessarily the
+     * same as the height of the layer.
+     */
+    int buffer_height;
+
+    /**
+     * The number of bytes in each row of image data. This is not necessarily
+     * equivalent to 4 * width.
+     */
+    size_t buffer_stride;
+
+    /**
+     * Non-zero if the image data referenced by the buffer pointer was
+     * allocated externally and should not be automatically freed or managed by
+     * guac_display, zero otherwise.
+     */
+    int buffer_is_external;
+
+    /**
+     * The approximate rectangular region containing all pixels within this
+     * layer that have been modified since the frame that occurred before this
+     * frame. If the layer was not modified, this will be an empty rect (zero
+     * width or zero height).
+     */
+    guac_rect dirty;
+
+    /**
+     * Whether this layer should be searched for possible scroll/copy
+     * optimizations.
+     */
+    int search_for_copies;
+
+    /**
+     * The copies that have been explicitly hinted for this layer within this
+     * frame. Only the first copy_hint_count entries are meaningful.
+     */
+    guac_display_copy_hint copy_hints[GUAC_DISPLAY_MAX_COPY_HINTS];
+
+    /**
+     * The number of copies that have been explicitly hinted for this layer
+     * within this frame. If this exceeds GUAC_DISPLAY_MAX_COPY_HINTS, too
+     * many copies were hinted, and all hints for this layer within this frame
+     * are ignored.
+     */
+    int copy_hint_count;
+
+    /**
+     * The regions of this layer that have been hinted as already encoded
+     * within this frame. Only the first image_hint_count entries are
+     * meaningful. Hints are moved to the last frame when the pending frame is
+     * committed, such that they remain valid while the worker threads send
+     * that frame. Each hint is freed with guac_display_image_hint_free().
+     */
+    guac_display_image_hint* image_hints[GUAC_DISPLAY_MAX_IMAGE_HINTS];
+
+    /**
+     * The number of regions of this layer that have been hinted as already
+     * encoded within this frame.
+     */
+    int image_hint_count;
+
+    /* ---------------- LAYER LIST POINTERS ---------------- */
+
+    /**
+     * The layer immediately prior to this layer within the list containing
+     * this layer, or NULL if this is the first layer/buffer in the list.
+     */
+    guac_display_layer* prev;
+
+    /**
+     * The layer immediately following this layer within the list containing
+     * this layer, or NULL if this is the last layer/buffer in the list.
+     */
+    guac_display_layer* next;
+
+} guac_display_layer_state;
+
+/**
+ * A tile of the last frame of a layer, as encoded for newly-joined users by
+ * guac_display_dup().
+ */
+typedef struct guac_display_dup_tile {
+
+    /**
+     * The PNG-encoded contents of this tile, or NULL if the tile has not yet
+     * been encoded or has changed since it was last encoded.
+     */
+    unsigned char* png;
+
+    /**
+     * The size of the PNG data, in bytes.
+     */
+    size_t length;
+
+    /**
+     * The time that the contents of this tile last changed within the last
+     * frame. If this tile was not yet being tracked when it last changed,
+     * this is the time that any part of the layer last changed, and thus
+     * will never be earlier than the true time of that change.
+     */
+    guac_timestamp modified;
+
+} guac_display_dup_tile;
+
+struct guac_display_layer {
+
+    /**
+     * The guac_display instance that allocated this layer/buffer.
+     */
+    guac_display* display;
+
+    /**
+     * The Guacamole layer (or buffer) that this guac_display_layer will draw
+     * to when flushing a frame.
+     *
+     * NOTE: This value is set only during allocation and may safely be
+     * accessed without acquiring the overall layer lock.
+     */
+    const guac_layer* layer;
+
+    /**
+     * Whether the graphical data that will be written to this layer/buffer
+     * will only ever be opaque (no alpha channel). Compositing of graphical
+     * updates can be faster when no alpha channel need be considered.
+     */
+    int opaque;
+
+    /* ---------------- LAYER PREVIOUS FRAME STATE ---------------- */
+
+    /**
+     * The state of this layer when the last frame was flushed to connected clients.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_layer_state last_frame;
+
+    /**
+     * Whether the buffer of last_frame is currently the same buffer as that of
+     * pending_frame, rather than a separate copy. This is the case for newly-
+     * allocated layers that have not yet been drawn to, and for layers that
+     * have not changed for longer than the idle release timeout of the display
+     * (see guac_display_set_idle_release_timeout()). As the contents of both
+     * frames are identical in either case, there is no need to store them
+     * twice. A separate copy is restored by
+     * PFW_guac_display_layer_unshare_last_frame() before the buffer of
+     * pending_frame is next modified or replaced.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * reading this member, and both the pending_frame.lock and last_frame.lock
+     * MUST be acquired for writing before modifying this member.
+     */
+    int last_frame_shared;
+
+    /**
+     * The time that the contents of last_frame last changed, as recorded when
+     * the pending frame is flushed.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_timestamp last_frame_modified;
+
+    /**
+     * The time of the first frame to include this layer within the last
+     * frame, or zero if this layer has not yet been part of any frame. Views
+     * of the display resumed from any earlier frame cannot contain this
+     * layer.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_timestamp last_frame_added;
+
+    /**
+     * Off-screen buffer storing the contents of the previously-rendered frame
+     * for later use. If graphical updates are recognized as reusing data from
+     * a previous frame, that data will be copied from this buffer. Doing this
+     * simplifies the copy operation (there is no longer any need to perform
+     * those copies in a specific order) and ensures the copies are efficient
+     * on the client side (copying from one part of a graphical surface to
+     * another part of the same surface can be inefficient, particularly if the
+     * regions overlap). In practice, there is ample time between frames for
+     * the client to copy a layer's current contents to an off-screen buffer
+     * while awaiting the next frame.
+     *
+     * NOTE: This value is set only during allocation and may safely be
+     * accessed without acquiring the display-level last_frame.lock.
+     */
+    guac_layer* last_frame_buffer;
+
+    /**
+     * Cache of the encoded contents of the last frame of this layer, divided
+     * into GUAC_DISPLAY_DUP_TILE_SIZE tiles covering an area of dup_width by
+     * dup_height pixels and stored in row-major order, or NULL if no tiles
+     * have yet been encoded. Tiles are encoded lazily by guac_display_dup()
+     * and invalidated as the last frame changes.
+     *
+     * IMPORTANT: The display-level last_frame.lock MUST be acquired for
+     * writing before modifying this member outside guac_display_dup(), and
+     * guac_display_dup() MUST hold both the last_frame.lock and render_state
+     * (which serializes all calls to guac_display_dup()).
+     */
+    guac_display_dup_tile* dup_tiles;
+
+    /**
+     * The width of the area covered by dup_tiles, in pixels.
+     */
+    int dup_width;
+
+    /**
+     * The height of the area covered by dup_tiles, in pixels.
+     */
+    int dup_height;
+
+    /**
+     * The region of this layer that was sent to connected clients at reduced
+     * quality, as the first stage of an update that was superseded by a newer
+     * frame while still being encoded, and that has not yet been refined. If
+     * empty, no part of this layer currently requires refinement.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO of the display is locked.
+     */
+    guac_rect refinement;
+
+    /**
+     * For each cell of this layer, in row-major order, the time at which that
+     * cell was most recently sent to connected clients at reduced quality, or
+     * zero if that cell has since been sent losslessly. Cells that remain
+     * unchanged for the refinement delay of the display are resent
+     * losslessly (see guac_display_set_refinement_delay()). This will be NULL
+     * if no part of this layer has ever been sent at reduced quality.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO of the display is locked.
+     */
+    guac_timestamp* lossy_cells;
+
+    /**
+     * The width of the lossy_cells array, in cells.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO of the display is locked.
+     */
+    int lossy_cells_width;
+
+    /**
+     * The height of the lossy_cells array, in cells.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO of the display is locked.
+     */
+    int lossy_cells_height;
+
+    /**
+     * The number of non-zero entries within the lossy_cells array.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO of the display is locked.
+     */
+    int lossy_cell_count;
+
+    /* ---------------- LAYER PENDING FRAME STATE ---------------- */
+
+    /**
+     * The upcoming state of this layer when the current, in-progress frame is
+     * flushed to connected clients.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_layer_state pending_frame;
+
+    /**
+     * The Cairo context and surface containing the graphical data of the
+     * pending frame. The actual underlying buffer and details of the graphical
+     * surface are also available via pending_frame_raw_context.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_layer_cairo_context pending_frame_cairo_context;
+
+    /**
+     * The raw underlying buffer and details of the surface containing the
+     * graphical data of the pending frame. A Cairo context and surface backed
+     * by this buffer are also available via pending_frame_cairo_context.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_layer_raw_context pending_frame_raw_context;
+
+    /**
+     * A two-dimensional array of square tiles representing the nature of
+     * changes made to corresponding regions of the display. This is used both
+     * to track how frequently certain regions are being updated (to help
+     * inform whether lossy compression is appropriate), to track what parts of
+     * the frame have actually changed, and to aid in determining whether
+     * adjacent updated regions should be combined into a single update.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_layer_cell* pending_frame_cells;
+
+    /**
+     * The width of the pending_frame_cells array, in cells.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    size_t pending_frame_cells_width;
+
+    /**
+     * The height of the pending_frame_cells array, in cells.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    size_t pending_frame_cells_height;
+
+    /**
+     * The glyphs that have been hinted for this layer within the pending frame
+     * with guac_display_layer_hint_glyph(), or NULL if no glyphs have ever
+     * been hinted for this layer. Only the first
+     * pending_frame_glyph_hints_length entries are meaningful.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_display_copy_hint* pending_frame_glyph_hints;
+
+    /**
+     * The number of glyphs that have been hinted for this layer within the
+     * pending frame.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    size_t pending_frame_glyph_hints_length;
+
+    /**
+     * The number of glyph hints that pending_frame_glyph_hints has space for.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    size_t pending_frame_glyph_hints_size;
+
+    /**
+     * The union of the dirty rectangles of all regions of this layer that
+     * have been drawn to and closed with guac_display_layer_close_region()
+     * since the pending frame was last merged. As regions are drawn to while
+     * only a read lock on the pending frame is held, this rectangle is merged
+     * into the dirty rectangle of the pending frame only once the frame ends
+     * (see PFW_guac_display_merge_regions()).
+     *
+     * IMPORTANT: The display-level regions_lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    guac_rect pending_frame_regions_dirty;
+
+    /**
+     * Whether any region closed with guac_display_layer_close_region() since
+     * the pending frame was last merged has hinted that this layer should be
+     * searched for possible scroll/copy operations.
+     *
+     * IMPORTANT: The display-level regions_lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int pending_frame_regions_search;
+
+};
+
+typedef struct guac_display_state {
+
+    /**
+     * Lock that guards concurrent access to any member of ANY STRUCTURE that
+     * relates to this guac_display_state, including the members of this
+     * structure. Unless explicitly documented otherwise, this lock MUST be
+     * acquired before accessing or modifying the members of this
+     * guac_display_state or any nested structure.
+     */
+    guac_rwlock lock;
+
+    /**
+     * The specific point in time that this guac_display_state represents.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * All layers and buffers that were part of the display at the time that
+     * the frame/snapshot represented by this guac_display_state was updated.
+     * 
+     * NOTE: For each guac_display, there are two distinct lists of layers: the
+     * last frame layer list and the pending frame layer list:
+     *
+     * LAST FRAME LAYER LIST
+     *
+     *  - HEAD: display->last_frame.layers
+     *  - NEXT: layer->last_frame.next
+     *  - PREV: layer->last_frame.prev
+     *
+     * PENDING LAYER LIST
+     *
+     *  - HEAD: display->pending_frame.layers
+     *  - NEXT: layer->pending_frame.next
+     *  - PREV: layer->pending_frame.prev
+     *
+     * Existing layers are deleted only at the time a frame is flushed when a
+     * layer in the last frame layer list is found to no longer exist in the
+     * pending frame layer list. The same goes for the addition of new layers:
+     * they are added only during flush when a layer that was not present in
+     * the last frame layer list is found to be present in the pending frame
+     * layer list.
+     */
+    guac_display_layer* layers;
+
+    /**
+     * The X coordinate of the hotspot of the mouse cursor. The cursor image is
+     * stored/updated via the cursor_buffer member of guac_display.
+     */
+    int cursor_hotspot_x;
+
+    /**
+     * The Y coordinate of the hotspot of the mouse cursor. The cursor image is
+     * stored/updated via the cursor_buffer member of guac_display.
+     */
+    int cursor_hotspot_y;
+
+    /**
+     * The user that moved or clicked the mouse. This is used to ensure we
+     * don't attempt to synchronize an out-of-date mouse position to the user
+     * that is actively moving the mouse.
+     *
+     * NOTE: This user is NOT guaranteed to still exist in memory. This may be
+     * a dangling pointer and must be validated before deferencing.
+     */
+    guac_user* cursor_user;
+
+    /**
+     * The X coordinate of the mouse cursor.
+     */
+    int cursor_x;
+
+    /**
+     * The Y coordinate of the mouse cursor.
+     */
+    int cursor_y;
+
+    /**
+     * The mask representing the states of all mouse buttons.
+     */
+    int cursor_mask;
+
+    /**
+     * The number of logical frames that have been rendered to this display
+     * state since the previous display state.
+     */
+    unsigned int frames;
+
+} guac_display_state;
+
+/**
+ * A single worker thread of a guac_display, which may be terminated while the
+ * display is idle and later restarted.
+ */
+typedef struct guac_display_worker {
+
+    /**
+     * The display whose operations this worker thread performs.
+     */
+    guac_display* display;
+
+    /**
+     * The thread currently or most recently occupying this slot, if any. If
+     * joinable is set, this thread must be joined before a replacement
+     * thread is started, even if it has already terminated.
+     */
+    pthread_t thread;
+
+    /**
+     * Non-zero if a thread was successfully started within this slot and has
+     * not yet been joined, zero otherwise.
+     *
+     * NOTE: This value is protected by the workers_lock of the display.
+     */
+    int joinable;
+
+    /**
+     * Non-zero if the thread of this slot is running and will continue to
+     * pull operations from the ops FIFO, zero if it has terminated (or is in
+     * the process of terminating) due to inactivity.
+     *
+     * NOTE: This value is protected by the workers_lock of the display.
+     */
+    int running;
+
+} guac_display_worker;
+
+/**
+ * A pool of worker threads shared by any number of guac_display instances,
+ * which performs the operations of those displays in the order that they
+ * become ready, one operation per display at a time.
+ */
+typedef struct guac_display_worker_pool {
+
+    /**
+     * Lock which must be held while accessing the ready queue of this pool,
+     * or the worker_pool_* members of any display using this pool.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever a display is added to the ready
+     * queue.
+     */
+    pthread_cond_t ready;
+
+    /**
+     * Condition which is broadcast whenever a display that is being removed
+     * from this pool is no longer in use by any thread of this pool.
+     */
+    pthread_cond_t released;
+
+    /**
+     * The first display within the ready queue of this pool, or NULL if no
+     * display is known to have operations awaiting a thread of this pool.
+     * Each display within the ready queue points to the next display with
+     * its worker_pool_next member.
+     */
+    guac_display* first;
+
+    /**
+     * The last display within the ready queue of this pool, or NULL if the
+     * ready queue is empty.
+     */
+    guac_display* last;
+
+    /**
+     * The number of threads that were successfully started for this pool.
+     */
+    int thread_count;
+
+} guac_display_worker_pool;
+
+struct guac_display {
+
+    /* NOTE: Any member of this structure that requires protection against
+     * concurrent access is protected by its own lock. The overall display does
+     * not have nor need a top-level lock. */
+
+    /**
+     * The client associated with this display.
+     */
+    guac_client* client;
+
+    /* ---------------- DISPLAY FRAME STATES ---------------- */
+
+    /**
+     * The state of this display at the time the last frame was sent to
+     * connected users.
+     */
+    guac_display_state last_frame;
+
+    /**
+     * The pending state of this display that will become the next frame once
+     * it is sent to connected users.
+     */
+    guac_display_state pending_frame;
+
+    /**
+     * Whether the pending frame has been modified in any way outside of
+     * changing the mouse cursor or moving the mouse. This is used to help
+     * inform whether a frame should be flushed to update connected clients
+     * with respect to mouse cursor changes, or whether those changes can be
+     * safely assumed to be part of a larger frame containing general graphical
+     * updates.
+     *
+     * IMPORTANT: The display-level pending_frame.lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int pending_frame_dirty_excluding_mouse;
+
+    /* ---------------- WELL-KNOWN LAYERS / BUFFERS ---------------- */
+
+    /**
+     * The default layer of the client display.
+     */
+    guac_display_layer* default_layer;
+
+    /**
+     * The buffer storing the current mouse cursor. The hotspot position within
+     * the cursor is stored within cursor_hotspot_x and cursor_hotspot_y of
+     * guac_display_state.
+     */
+    guac_display_layer* cursor_buffer;
+
+    /* ---------------- ACCELERATED IMAGE COMPARISON ---------------- */
+
+    /**
+     * The implementation of guac_display_memcmp_function that should be used
+     * to compare rows of the pending frame against the last frame. This is
+     * selected once, when the guac_display is allocated, based on the
+     * instruction sets supported by the current processor.
+     *
+     * NOTE: This value is set only during allocation and may safely be
+     * accessed without acquiring any lock.
+     */
+    guac_display_memcmp_function* memcmp_impl;
+
+    /* ---------------- FRAME ENCODING WORKER THREADS ---------------- */
+
+    /**
+     * The number of worker threads in the worker_threads array. This is the
+     * greatest number of worker threads that may ever run for this display.
+     * Only workers_target of these threads are started for each frame, and
+     * threads may terminate while the display is idle (see
+     * GUAC_DISPLAY_WORKER_IDLE_TIMEOUT).
+     */
+    int worker_thread_count;
+
+    /**
+     * Pool of worker threads that automatically pull from the ops FIFO,
+     * sending corresponding Guacamole instructions to all connected clients.
+     */
+    guac_display_worker* worker_threads;
+
+    /**
+     * The shared pool of worker threads performing the operations of this
+     * display, or NULL if this display has worker threads of its own (see
+     * guac_display_set_shared_workers()). If non-NULL, worker_threads is
+     * NULL, and worker_thread_count is the number of threads in the shared
+     * pool.
+     *
+     * NOTE: This value is set only during allocation and may safely be
+     * accessed without acquiring any lock.
+     */
+    guac_display_worker_pool* worker_pool;
+
+    /**
+     * The next display within the ready queue of worker_pool, if this display
+     * is within that queue.
+     *
+     * NOTE: This value is protected by the lock of worker_pool.
+     */
+    guac_display* worker_pool_next;
+
+    /**
+     * Non-zero if this display is within the ready queue of worker_pool, zero
+     * otherwise.
+     *
+     * NOTE: This value is protected by the lock of worker_pool.
+     */
+    int worker_pool_queued;
+
+    /**
+     * The number of threads of worker_pool that are currently performing
+     * operations of this display.
+     *
+     * NOTE: This value is protected by the lock of worker_pool.
+     */
+    int worker_pool_active;
+
+    /**
+     * Non-zero if this display has been removed from worker_pool with
+     * guac_display_worker_pool_remove() and must no longer be added to its
+     * ready queue, zero otherwise.
+     *
+     * NOTE: This value is protected by the lock of worker_pool.
+     */
+    int worker_pool_removed;
+
+    /**
+     * The number of worker threads in the worker_threads array that are
+     * currently running.
+     *
+     * NOTE: This value is protected by workers_lock.
+     */
+    int workers_running;
+
+    /**
+     * Non-zero if the worker threads are being stopped by guac_display_stop()
+     * and must no longer be terminated or restarted, zero otherwise.
+     *
+     * NOTE: This value is protected by workers_lock.
+     */
+    int workers_stopped;
+
+    /**
+     * The fewest worker threads that may remain running while this display
+     * is idle, as set by guac_display_set_worker_threads().
+     *
+     * NOTE: This value is protected by workers_lock.
+     */
+    int workers_min;
+
+    /**
+     * The most worker threads that may run for this display, as set by
+     * guac_display_set_worker_threads(). This is never greater than
+     * worker_thread_count.
+     *
+     * NOTE: This value is protected by workers_lock.
+     */
+    int workers_max;
+
+    /**
+     * The number of worker threads that should be running while a frame is
+     * in progress. This increases as frames back up (see
+     * GUAC_DISPLAY_WORKER_BACKLOG_FRAMES) and decreases as worker threads
+     * terminate due to inactivity, always remaining between workers_min and
+     * workers_max.
+     *
+     * NOTE: This value is modified only while workers_lock is held, but is
+     * atomic and may be read without acquiring that lock.
+     */
+    atomic_int workers_target;
+
+    /**
+     * The number of milliseconds that each worker thread may wait for a new
+     * operation before terminating due to inactivity. This is always
+     * GUAC_DISPLAY_WORKER_IDLE_TIMEOUT except within unit tests, which
+     * shorten it to observe idle worker threads terminating, and is read by
+     * each worker thread as it begins waiting.
+     */
+    atomic_int workers_idle_timeout;
+
+    /**
+     * The number of consecutive frames that were deferred because the
+     * previous frame was still being encoded.
+     *
+     * NOTE: This value is protected by workers_lock.
+     */
+    int workers_backlog;
+
+    /**
+     * Lock which must be held while terminating or restarting worker threads
+     * due to inactivity, or while reading or modifying the running state of
+     * any worker thread.
+     */
+    pthread_mutex_t workers_lock;
+
+    /**
+     * Lock which must be held while claiming or releasing cells for regions
+     * opened with guac_display_layer_open_region(), or while reading or
+     * modifying the pending_frame_regions_dirty member of any layer or the
+     * regions_modified member of this display.
+     */
+    pthread_mutex_t regions_lock;
+
+    /**
+     * Condition which is signalled whenever cells claimed for a region are
+     * released, allowing any thread waiting to open an overlapping region to
+     * proceed.
+     */
+    pthread_cond_t regions_released;
+
+    /**
+     * Whether any region has been closed with
+     * guac_display_layer_close_region() since the regions of the pending
+     * frame were last merged.
+     *
+     * IMPORTANT: The display-level regions_lock MUST be acquired before
+     * modifying or reading this member.
+     */
+    int regions_modified;
+
+    /**
+     * FIFO of all graphical operations required to transform the remote
+     * display state from the previous frame to the next frame. Operations
+     * added to this FIFO will automatically be pulled and processed by a
+     * worker thread.
+     */
+    guac_fifo ops;
+
+    /**
+     * Storage for any items within the ops fifo.
+     */
+    guac_display_plan_operation ops_items[GUAC_DISPLAY_WORKER_FIFO_SIZE];
+
+    /**
+     * The tasks currently being performed in parallel as part of constructing
+     * the next display plan, if any. Worker threads assist with these tasks
+     * upon receiving a GUAC_DISPLAY_PLAN_OPERATION_ASSIST operation.
+     */
+    guac_display_plan_tasks plan_tasks;
+
+    /**
+     * Barrier tracking completion of the frame currently being encoded. While
+     * a frame is in progress, this is one greater than the number of
+     * operations of that frame that have been added to the ops FIFO but not
+     * yet completed by a worker thread. The remaining one is held by the
+     * frame itself until everything marking the end of the frame has been
+     * sent, and this is zero only if no frame is in progress.
+     *
+     * A worker thread that completes an operation and thereby reduces this
+     * value to one is the thread responsible for ending the frame. Worker
+     * threads thus need not lock the ops FIFO to determine whether the frame
+     * is complete.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO.
+     */
+    atomic_uint frame_ops;
+
+    /**
+     * Whether least one pending frame has been deferred due to the encoding
+     * process being underway for a previous frame at the time it was
+     * completed.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO. It is set prior to checking frame_ops when a frame is completed,
+     * and checked after frame_ops is reduced to zero when a frame has been
+     * encoded, such that a deferred frame is never missed.
+     */
+    atomic_int frame_deferred;
+
+    /**
+     * Whether the operations currently being processed by the worker threads
+     * are GUAC_DISPLAY_PLAN_OPERATION_REFINE operations that refine a
+     * previous frame, rather than the operations of a new frame.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    int frame_refining;
+
+    /**
+     * The total amount of time that encoding of the current frame should
+     * take, in nanoseconds, if that work is spread evenly across all worker
+     * threads. This is derived from the time elapsed since the previous frame
+     * and the processing lag of connected clients.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frame_encoding_budget;
+
+    /**
+     * The total number of pixels that must be encoded by the worker threads
+     * for the current frame.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frame_encoding_pixels;
+
+    /**
+     * The time at which the operations of the current frame were made
+     * available to the worker threads.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    guac_timestamp frame_encoding_start;
+
+    /**
+     * The number of frames whose operations have been completed by the worker
+     * threads.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frames_encoded;
+
+    /**
+     * The sum of the latencies of all frames counted by frames_encoded, in
+     * milliseconds. The latency of a frame is the time between its operations
+     * being made available to the worker threads and the end of that frame
+     * being sent to connected users.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t frame_latency_total;
+
+    /**
+     * The greatest latency of any frame counted by frames_encoded, in
+     * milliseconds.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    guac_timestamp frame_latency_max;
+
+    /**
+     * Model of the cost of each encoding, as measured by the worker threads,
+     * used to choose encodings that minimize the amount of data sent without
+     * exceeding the time available for encoding each frame.
+     */
+    guac_display_encoder_model encoder_model;
+
+    /**
+     * The current state of the rendering process. Code that needs to be aware
+     * of whether a frame is currently in the process of being rendered can
+     * monitor the state of this flag, watching for either the
+     * GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS or
+     * GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS values.
+     */
+    guac_flag render_state;
+
+    /* ---------------- CLIENT-SIDE CELL CACHE ---------------- */
+
+    /**
+     * Cache of recently-sent cells that are stored client-side and may be
+     * restored with copies rather than resending image data.
+     */
+    guac_display_cache cache;
+
+    /**
+     * Recently-sent mouse cursor images that are stored client-side and may
+     * be restored with copies rather than resending image data. Entries are
+     * allocated only when first needed.
+     *
+     * IMPORTANT: These entries may only be accessed while planning a frame
+     * or while ending the frame in progress, which never occur concurrently.
+     */
+    guac_display_cursor_cache_entry* cursor_cache[GUAC_DISPLAY_CURSOR_CACHE_SIZE];
+
+    /**
+     * The entry within cursor_cache that was added while planning the frame
+     * in progress and must be stored once that frame has been sent, or NULL
+     * if there is no such entry.
+     */
+    guac_display_cursor_cache_entry* cursor_cache_pending;
+
+    /* ---------------- BANDWIDTH ESTIMATION ---------------- */
+
+    /**
+     * The number of bytes of image data sent by the worker threads since the
+     * end of the most recent frame.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO.
+     */
+    atomic_uint_fast64_t frame_bytes;
+
+    /**
+     * Circular buffer of frames that have been sent but not yet acknowledged
+     * by all connected clients, from oldest to newest beginning at
+     * sent_frames_start.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    guac_display_sent_frame sent_frames[GUAC_DISPLAY_SENT_FRAME_HISTORY];
+
+    /**
+     * The index of the oldest frame within sent_frames.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    unsigned int sent_frames_start;
+
+    /**
+     * The number of frames within sent_frames.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    unsigned int sent_frames_length;
+
+    /**
+     * The estimated amount of time that data already sent will remain queued
+     * before connected clients are able to receive it, in milliseconds,
+     * excluding the network round trip itself. This is zero if the
+     * connection is not saturated or if bandwidth has not yet been estimated.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO. It is updated only by the render thread.
+     */
+    atomic_int backlog;
+
+    /**
+     * The estimated bandwidth available to connected clients, in bytes per
+     * millisecond, or zero if bandwidth has not yet been estimated. This is a
+     * copy of the estimate maintained by the render thread.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO. It is updated only by the render thread.
+     */
+    atomic_int bandwidth;
+
+    /**
+     * The number of milliseconds that a cell sent at reduced quality must
+     * remain unchanged before it is resent losslessly, or zero if such cells
+     * are never resent (see guac_display_set_refinement_delay()).
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO.
+     */
+    atomic_int refinement_delay;
+
+    /**
+     * Whether any layer may contain cells that were sent at reduced quality
+     * and have not yet been resent losslessly. While this is set, the render
+     * thread periodically wakes to refine such cells even if nothing else has
+     * changed.
+     *
+     * NOTE: This member is atomic and may be accessed without locking the ops
+     * FIFO.
+     */
+    atomic_int lossy_pending;
+
+    /* ---------------- ENCODING TIERS ---------------- */
+
+    /**
+     * Whether users lagging by more than GUAC_DISPLAY_TIER_FAST_MAX_LAG should
+     * be sent lossy image data separately from all other users, who instead
+     * receive lossless image data.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the
+     * pending frame is locked.
+     */
+    int tiered_encoding;
+
+    /**
+     * The users within the slow tier as of the start of the frame currently
+     * being encoded. All other users are within the fast tier. These pointers
+     * are only ever compared against the pointers of connected users and are
+     * never dereferenced.
+     *
+     * IMPORTANT: This member must only be modified while the pending frame
+     * and the ops FIFO are locked, and only before the operations of a frame
+     * are made available to the worker threads. Tier sockets may read this
+     * member without locking, as it cannot change while a frame is being
+     * encoded.
+     */
+    guac_user** slow_users;
+
+    /**
+     * The number of users within slow_users.
+     */
+    size_t slow_users_length;
+
+    /**
+     * The number of users that slow_users has space for.
+     */
+    size_t slow_users_size;
+
+    /**
+     * The number of users within the fast tier as of the start of the frame
+     * currently being encoded.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    size_t fast_users_length;
+
+    /**
+     * Whether both the fast and slow tiers contain at least one user as of the
+     * start of the frame currently being encoded, and thus whether lossy image
+     * data must be sent separately to each tier.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    int tiers_split;
+
+    /**
+     * Socket that writes only to the users of the fast tier.
+     */
+    guac_socket* fast_tier_socket;
+
+    /**
+     * Socket that writes only to the users of the slow tier.
+     */
+    guac_socket* slow_tier_socket;
+
+    /* ---------------- DELTA UPDATES ---------------- */
+
+    /**
+     * Whether image updates to opaque layers that are sent as PNG should
+     * include only the pixels that actually changed, with all other pixels
+     * made transparent such that the existing client-side contents show
+     * through.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the
+     * pending frame is locked.
+     */
+    int delta_updates;
+
+    /**
+     * Storage for the contents that the destination rects of the current
+     * frame's image operations had as of the previous frame, as retained by
+     * LFR_guac_display_plan_retain_previous(). Each operation references its
+     * own portion of this buffer via its "previous" member. The buffer is
+     * reused for each frame, and is NULL if it has never been needed.
+     *
+     * IMPORTANT: This member must only be modified while both the pending
+     * frame and last frame are locked for writing. Worker threads may read
+     * the portions of this buffer referenced by the operations of the frame
+     * being encoded, as no new frame may be planned until all of those
+     * operations have completed.
+     */
+    unsigned char* previous_buffer;
+
+    /**
+     * The size of previous_buffer, in bytes.
+     */
+    size_t previous_buffer_size;
+
+    /**
+     * Arena providing all temporary memory used while planning each frame,
+     * including the guac_display_plan itself, its operations, and the task
+     * arrays and scratch buffers of each planning pass. The arena is reset
+     * once the plan of each frame has been applied.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the
+     * pending frame is locked for writing.
+     */
+    guac_display_arena plan_arena;
+
+    /**
+     * The number of image updates that have been sent as delta updates.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t delta_update_count;
+
+    /**
+     * The total number of pixels within image updates that were sent as delta
+     * updates.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t delta_total_pixels;
+
+    /**
+     * The number of pixels within image updates that were sent as delta
+     * updates that were left transparent, as they had not changed.
+     *
+     * IMPORTANT: This member must only be accessed or modified while the ops
+     * FIFO is locked.
+     */
+    uint64_t delta_unchanged_pixels;
+
+    /* ---------------- IDLE RELEASE ---------------- */
+
+    /**
+     * The number of milliseconds that a layer must remain unchanged before
+     * the separate copy of its contents retained for the last frame is
+     * released, or zero if such copies are never released (see
+     * guac_display_set_idle_release_timeout()).
+     *
+     * IMPORTANT: This member must only be accessed or modified while the
+     * pending frame is locked.
+     */
+    int idle_release_timeout;
+
+    /* ---------------- TRACING ---------------- */
+
+    /**
+     * Optional instrumentation recording the timing of each frame and the
+     * cost of each image update.
+     */
+    guac_display_trace trace;
+
+};
+
+/**
+ * Allocates and inserts a new element into the given linked list of display
+ * layers, associating it with the given layer and surface.
+ *
+ * @param head
+ *     A pointer to the head pointer of the list of layers. The head pointer
+ *     will be updated by this function to point to the newly-allocated
+ *     display layer.
+ *
+ * @param layer
+ *     The Guacamole layer to associated with the new display layer.
+ *
+ * @param opaque
+ *     Non-zero if the new layer will only ever contain opaque image contents
+ *     (the alpha channel should be ignored), zero otherwise.
+ *
+ * @return
+ *     The newly-allocated display layer, which has been associated with the
+ *     provided layer and surface.
+ */
+guac_display_layer* guac_display_add_layer(guac_display* display, guac_layer* layer, int opaque);
+
+/**
+ * Removes the given layer from all linked lists containing that layer and
+ * frees all associated memory.
+ *
+ * @param display_layer
+ *     The layer to remove.
+ */
+void guac_display_remove_layer(guac_display_layer* display_layer);
+
+/**
+ * Resizes the given layer to the given dimensions, including any underlying
+ * image buffers.
+ *
+ * @param layer
+ *     The layer to resize.
+ *
+ * @param width
+ *     The new width, in pixels.
+ *
+ * @param height
+ *     The new height, in pixels.
+ */
+void PFW_guac_display_layer_resize(guac_display_layer* layer,
+        int width, int height);
+
+/**
+ * Marks any cached tiles of the given layer that intersect the given
+ * rectangle as changed at the time stored within the last_frame_modified
+ * member of the layer, such that those tiles are re-encoded the next time
+ * guac_display_dup() is invoked.
+ *
+ * @param layer
+ *     The layer whose cached tiles should be invalidated.
+ *
+ * @param rect
+ *     The region of the last frame that has changed.
+ */
+void LFW_guac_display_layer_invalidate_dup_tiles(guac_display_layer* layer,
+        const guac_rect* rect);
+
+/**
+ * Frees all cached tiles of the given layer (see the dup_tiles member of
+ * guac_display_layer), as when the size of the layer changes or the layer
+ * itself is being freed.
+ *
+ * @param layer
+ *     The layer whose cached tiles should be freed.
+ */
+void LFW_guac_display_layer_free_dup_tiles(guac_display_layer* layer);
+
+/**
+ * Sends the state of the last frame of the given display over the given
+ * socket, sending only the graphical changes made since the given frame if
+ * the recipient is resuming a view of the display from that frame. The
+ * display-level last_frame.lock and render_state MUST be held, and no frame
+ * may be in the process of being sent. Unlike guac_display_dup(), this
+ * function does not wait for any in-progress frame to be marked complete,
+ * and may thus be used by the worker thread completing a frame.
+ *
+ * @param display
+ *     The display whose state should be sent.
+ *
+ * @param socket
+ *     The socket over which the state of the display should be sent.
+ *
+ * @param since
+ *     The timestamp of the frame from which the recipient is resuming its
+ *     view of the display, or zero if the full state of the display should
+ *     be sent.
+ */
+void LFR_guac_display_dup_state(guac_display* display,
+        guac_socket* socket, guac_timestamp since);
+
+/**
+ * Merges the changes made to all regions closed with
+ * guac_display_layer_close_region() into the pending frame of each affected
+ * layer, as if those changes had been made through a raw context opened with
+ * guac_display_layer_open_raw(). This must be invoked before the pending frame
+ * is inspected for changes.
+ *
+ * @param display
+ *     The display whose regions should be merged.
+ */
+void PFW_guac_display_merge_regions(guac_display* display);
+
+/**
+ * Ensures that the last frame of the given layer has its own copy of the
+ * layer's contents, rather than sharing the buffer of the pending frame (see
+ * the last_frame_shared member of guac_display_layer). This MUST be called
+ * before the buffer of the pending frame is modified, reallocated, or
+ * replaced. If the last frame already has its own copy, this function has no
+ * effect. The display-level last_frame.lock MUST NOT already be held, as it
+ * is acquired for writing by this function if a copy is required.
+ *
+ * @param layer
+ *     The layer whose last frame should receive its own copy of the layer's
+ *     contents.
+ */
+void PFW_guac_display_layer_unshare_last_frame(guac_display_layer* layer);
+
+/**
+ * Frees the given image hint, as created by guac_display_layer_hint_image(),
+ * including its encoded image data.
+ *
+ * @param hint
+ *     The image hint to free, or NULL if there is no hint.
+ */
+void guac_display_image_hint_free(guac_display_image_hint* hint);
 
 /**
  * Worker thread that continuously pulls operations from the operation FIFO of
  * the given guac_display, applying those operations by seding corresponding
- * instructions to connected clients.
+ * instructions to connected clients. If no operations are received for
+ * GUAC_DISPLAY_WORKER_IDLE_TIMEOUT milliseconds and other worker threads are
+ * still running, the worker thread terminates.
  *
  * @param data
- *     A pointer to the guac_display.
+ *     A pointer to the guac_display_worker describing the slot occupied by
+ *     the worker thread.
  *
  * @return
  *     Always NULL.
  */
 void* guac_display_worker_thread(void* data);
 
+/**
+ * Returns the pool of worker threads shared by all guac_display instances of
+ * the current process that use such a pool, starting that pool with the given
+ * number of threads if it has not yet been started. The threads of the pool
+ * persist until the process terminates.
+ *
+ * @param thread_count
+ *     The number of threads to start if the pool has not yet been started.
+ *     This value is ignored if the pool has already been started.
+ *
+ * @return
+ *     The shared pool of worker threads, or NULL if no threads could be
+ *     started for that pool.
+ */
+guac_display_worker_pool* guac_display_worker_pool_get(int thread_count);
+
+/**
+ * Removes the given display from its shared pool of worker threads, waiting
+ * for any operations of that display that are currently being performed by
+ * threads of the pool. After this function returns, no thread of the pool
+ * will access the display. The ops FIFO of the display should already have
+ * been invalidated.
+ *
+ * @param display
+ *     The display to remove from its shared pool of worker threads. The
+ *     worker_pool member of this display MUST be non-NULL.
+ */
+void guac_display_worker_pool_remove(guac_display* display);
+
+/**
+ * Adds the given operation to the ops FIFO of the given display, notifying
+ * the shared pool of worker threads of that display, if any, that the
+ * display has operations ready. All operations for worker threads MUST be
+ * added with this function rather than with guac_fifo_enqueue().
+ *
+ * @param display
+ *     The display that the operation applies to.
+ *
+ * @param op
+ *     The operation to add.
+ *
+ * @return
+ *     Non-zero if the operation was added, zero if the ops FIFO has been
+ *     invalidated or the operation could not be added for any other reason.
+ */
+int guac_display_queue_operation(guac_display* display,
+        const guac_display_plan_operation* op);
+
+/**
+ * Starts or restarts worker threads of the given display until the number of
+ * running worker threads reaches the current target (see workers_target),
+ * such that enough worker threads are available to perform the operations of
+ * the next frame. This function must be called before any operations of a
+ * new frame are added to the ops FIFO. If the display is being stopped, or
+ * uses a shared pool of worker threads, this function has no effect.
+ *
+ * @param display
+ *     The display whose worker threads should be restarted.
+ */
+void guac_display_resume_workers(guac_display* display);
+
+/**
+ * Records whether a newer frame was deferred while the frame that has just
+ * been completed was being encoded, increasing the target number of worker
+ * threads of the given display if frames have backed up for
+ * GUAC_DISPLAY_WORKER_BACKLOG_FRAMES consecutive frames. Any additional
+ * worker threads are started by the next call to
+ * guac_display_resume_workers(). If the display uses a shared pool of worker
+ * threads, this function has no effect.
+ *
+ * @param display
+ *     The display whose frame has just been completed.
+ *
+ * @param backlogged
+ *     Non-zero if a newer frame was deferred while the completed frame was
+ *     being encoded, zero otherwise.
+ */
+void guac_display_worker_backlog(guac_display* display, int backlogged);
+
+/**
+ * Performs all of the given tasks, distributing those tasks across the worker
+ * threads of the given guac_display. The calling thread also performs tasks,
+ * and this function returns only after all tasks have been completed. Idle
+ * worker threads are enlisted through GUAC_DISPLAY_PLAN_OPERATION_ASSIST
+ * operations. If no worker threads are idle, the calling thread will simply
+ * perform all tasks itself.
+ *
+ * IMPORTANT: This function is intended for use only while the display plan is
+ * being constructed, while the calling thread holds the write lock of the
+ * display's pending_frame.lock and there are no outstanding operations in the
+ * operation FIFO. Only one set of tasks may be run at any given time.
+ *
+ * @param display
+ *     The guac_display whose worker threads should assist with the tasks.
+ *
+ * @param callback
+ *     The callback that should be invoked to perform each task.
+ *
+ * @param tasks
+ *     An array of all tasks to perform.
+ *
+ * @param task_size
+ *     The size of each task in the tasks array, in bytes.
+ *
+ * @param length
+ *     The number of tasks in the tasks array.
+ */
+void guac_display_plan_run_tasks(guac_display* display,
+        guac_display_plan_task_callback* callback, void* tasks,
+        size_t task_size, size_t length);
+
+/**
+ * Claims and performs outstanding tasks that were submitted through
+ * guac_display_plan_run_tasks(), returning once there are no further tasks to
+ * claim. If there are no outstanding tasks, this function has no effect.
+ *
+ * @param display
+ *     The guac_display whose outstanding tasks should be performed.
+ */
+void guac_display_plan_assist(guac_display* display);
+
+/**
+ * Adds GUAC_DISPLAY_PLAN_OPERATION_REFINE operations to the operation FIFO
+ * for every region of every layer that requires refinement: regions sent at
+ * reduced quality as the first stage of a preempted update, and cells sent at
+ * reduced quality that have since remained unchanged for the refinement
+ * delay of the display (see guac_display_set_refinement_delay()). Each
+ * operation added is counted as part of the current frame. The ops FIFO and
+ * the last_frame.lock of the display must already be locked.
+ *
+ * @param display
+ *     The display whose layers should be refined.
+ *
+ * @return
+ *     Non-zero if any operations were added to the operation FIFO, zero
+ *     otherwise.
+ */
+int LFR_guac_display_queue_refinements(guac_display* display);
+
+/**
+ * Initializes the given cache of recently-sent cells, allowing up to the
+ * given amount of memory to be used to store cached cells.
+ *
+ * @param cache
+ *     The cache to initialize.
+ *
+ * @param client
+ *     The client that should own the client-side buffers of cached cells.
+ *
+ * @param size
+ *     The maximum amount of memory that may be used to store cached cells,
+ *     in bytes. If less than GUAC_DISPLAY_CACHE_ENTRY_SIZE, caching is
+ *     disabled.
+ */
+void guac_display_cache_init(guac_display_cache* cache, guac_client* client,
+        size_t size);
+
+/**
+ * Frees all entries within the given cache, including their client-side
+ * buffers, and releases any associated resources. The cache must not be used
+ * again unless it is reinitialized with guac_display_cache_init().
+ *
+ * @param cache
+ *     The cache to destroy.
+ */
+void guac_display_cache_destroy(guac_display_cache* cache);
+
+/**
+ * Changes the maximum amount of memory that may be used by the given cache,
+ * evicting entries as necessary.
+ *
+ * @param cache
+ *     The cache to modify.
+ *
+ * @param size
+ *     The maximum amount of memory that may be used to store cached cells,
+ *     in bytes. If less than GUAC_DISPLAY_CACHE_ENTRY_SIZE, caching is
+ *     disabled and all entries are evicted.
+ */
+void guac_display_cache_set_size(guac_display_cache* cache, size_t size);
+
+/**
+ * Searches the given cache for a cell having the given hash and contents
+ * that has already been stored client-side. If found, that cell becomes the
+ * most recently used cell.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param hash
+ *     The hash of the cell contents.
+ *
+ * @param data
+ *     The contents of the cell, which must be GUAC_DISPLAY_CELL_SIZE pixels
+ *     wide and GUAC_DISPLAY_CELL_SIZE pixels high.
+ *
+ * @param stride
+ *     The number of bytes in each row of the provided cell contents.
+ *
+ * @param frame
+ *     The timestamp of the frame being planned.
+ *
+ * @return
+ *     The client-side buffer containing the cached cell, or NULL if no such
+ *     cell has been stored client-side.
+ */
+const guac_layer* guac_display_cache_get(guac_display_cache* cache,
+        uint64_t hash, const unsigned char* data, size_t stride,
+        guac_timestamp frame);
+
+/**
+ * Adds a new entry to the given cache for a cell having the given hash and
+ * contents, evicting the least recently used entry if necessary. The cell is
+ * not actually stored client-side until guac_display_cache_commit() is
+ * invoked after the frame being planned has been sent. If the cache already
+ * contains an entry for the given hash, or if there is no room for a new
+ * entry without evicting an entry referenced by the frame being planned, this
+ * function has no effect.
+ *
+ * @param cache
+ *     The cache to add the entry to.
+ *
+ * @param hash
+ *     The hash of the cell contents.
+ *
+ * @param data
+ *     The contents of the cell, which must be GUAC_DISPLAY_CELL_SIZE pixels
+ *     wide and GUAC_DISPLAY_CELL_SIZE pixels high.
+ *
+ * @param stride
+ *     The number of bytes in each row of the provided cell contents.
+ *
+ * @param layer
+ *     The layer that will contain the cell once the current frame has been
+ *     sent.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the cell within the layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the cell within the layer.
+ *
+ * @param frame
+ *     The timestamp of the frame being planned.
+ *
+ * @return
+ *     Non-zero if a new entry was added, zero otherwise.
+ */
+int guac_display_cache_put(guac_display_cache* cache, uint64_t hash,
+        const unsigned char* data, size_t stride, guac_display_layer* layer,
+        int x, int y, guac_timestamp frame);
+
+/**
+ * Stores all entries that were added since the last call to this function
+ * within their client-side buffers, copying each cell from the layer that
+ * now contains that cell.
+ *
+ * IMPORTANT: This function may only be invoked after all operations of the
+ * frame that added those entries have been sent.
+ *
+ * @param cache
+ *     The cache whose pending entries should be stored.
+ */
+void guac_display_cache_commit(guac_display_cache* cache);
+
+/**
+ * Stores the mouse cursor image that was added to the cursor cache of the
+ * given display while planning the frame in progress, if any, copying that
+ * image from the cursor buffer into its own client-side buffer.
+ *
+ * IMPORTANT: This function may only be invoked after all operations of the
+ * frame in progress have been sent.
+ *
+ * @param display
+ *     The display whose pending cursor image should be stored.
+ */
+void guac_display_cursor_cache_commit(guac_display* display);
+
+/**
+ * Sends the contents of all mouse cursor images stored within the cursor
+ * cache of the given display over the given socket, such that any newly
+ * joined users receive the same client-side buffers as all other users.
+ *
+ * @param display
+ *     The display whose cached cursor images should be sent.
+ *
+ * @param socket
+ *     The socket to send the cached cursor images over.
+ */
+void guac_display_cursor_cache_dup(guac_display* display, guac_socket* socket);
+
+/**
+ * Frees all entries within the cursor cache of the given display, including
+ * their client-side buffers.
+ *
+ * @param display
+ *     The display whose cursor cache should be freed.
+ */
+void guac_display_cursor_cache_destroy(guac_display* display);
+
+/**
+ * Removes any entries that have not yet been stored and that would be
+ * copied from the given layer. This function must be invoked before the
+ * given layer is freed.
+ *
+ * @param cache
+ *     The cache to remove entries from.
+ *
+ * @param layer
+ *     The layer being freed.
+ */
+void guac_display_cache_forget_layer(guac_display_cache* cache,
+        guac_display_layer* layer);
+
+/**
+ * Sends the contents of all stored entries of the given cache over the given
+ * socket, such that a newly-joined user receives identical client-side
+ * buffers. A user resuming a previous view of the display is sent only the
+ * entries added since the frame being resumed from.
+ *
+ * @param cache
+ *     The cache whose stored entries should be sent.
+ *
+ * @param socket
+ *     The socket to send the cached cells over.
+ *
+ * @param since
+ *     The timestamp of the frame from which the recipient is resuming its
+ *     view of the display, or zero if all stored entries should be sent.
+ */
+void guac_display_cache_dup(guac_display_cache* cache, guac_socket* socket,
+        guac_timestamp since);
+
+/**
+ * The file listing the cgroups of the current process, as read by
+ * guac_display_cgroup_nproc().
+ */
+#define GUAC_DISPLAY_CGROUP_MEMBERSHIP "/proc/self/cgroup"
+
+/**
+ * The directory at which the cgroup v2 hierarchy is mounted.
+ */
+#define GUAC_DISPLAY_CGROUP_ROOT "/sys/fs/cgroup"
+
+/**
+ * Returns the number of processors' worth of CPU time that this process may
+ * use, as limited by the "cpu.max" quota of its cgroup v2 cgroup and of each
+ * ancestor of that cgroup. Fractional quotas are rounded up. If no quota
+ * applies, or the quota cannot be determined, zero is returned.
+ *
+ * @param membership_path
+ *     The path of the file listing the cgroups of the current process, in
+ *     the format of "/proc/self/cgroup". This is normally
+ *     GUAC_DISPLAY_CGROUP_MEMBERSHIP.
+ *
+ * @param root
+ *     The directory at which the cgroup v2 hierarchy is mounted, without
+ *     trailing slash. This is normally GUAC_DISPLAY_CGROUP_ROOT.
+ *
+ * @return
+ *     The number of processors' worth of CPU time available under the cgroup
+ *     quota of this process, or zero if there is no such quota or the quota
+ *     cannot be determined.
+ */
+unsigned long guac_display_cgroup_nproc(const char* membership_path,
+        const char* root);
+
+/**
+ * Initializes the given encoder cost model with initial estimates of the cost
+ * of each encoding. These estimates are refined as measurements are recorded
+ * with guac_display_encoder_record().
+ *
+ * @param model
+ *     The model to initialize.
+ */
+void guac_display_encoder_init(guac_display_encoder_model* model);
+
+/**
+ * Releases any resources associated with the given encoder cost model.
+ *
+ * @param model
+ *     The model to destroy.
+ */
+void guac_display_encoder_destroy(guac_display_encoder_model* model);
+
+/**
+ * Updates the given encoder cost model with the measured cost of encoding a
+ * single update.
+ *
+ * @param model
+ *     The model to update.
+ *
+ * @param choice
+ *     The encoding and quality level that was used.
+ *
+ * @param pixels
+ *     The number of pixels that were encoded.
+ *
+ * @param duration
+ *     The amount of time that encoding took, in nanoseconds.
+ *
+ * @param bytes
+ *     The number of bytes sent as a result of encoding.
+ */
+void guac_display_encoder_record(guac_display_encoder_model* model,
+        const guac_display_encoder_choice* choice, uint64_t pixels,
+        uint64_t duration, uint64_t bytes);
+
+/**
+ * Chooses the lossy encoding and quality level that is expected to produce
+ * the least data without exceeding the given time budget, considering only
+ * the given candidate encodings and quality levels no greater than the given
+ * maximum. If no combination is expected to be fast enough, the fastest
+ * combination at the lowest quality level is chosen.
+ *
+ * @param model
+ *     The model to consult.
+ *
+ * @param candidates
+ *     A bitwise OR of (1 << encoding) for each lossy encoding that may be
+ *     chosen. At least one candidate must be given.
+ *
+ * @param max_quality
+ *     The highest quality that should be considered, from 0 to 100
+ *     inclusive.
+ *
+ * @param pixels
+ *     The number of pixels that will be encoded.
+ *
+ * @param budget
+ *     The amount of time that encoding may take, in nanoseconds.
+ *
+ * @param choice
+ *     The guac_display_encoder_choice to populate with the chosen encoding
+ *     and quality level.
+ */
+void guac_display_encoder_choose(guac_display_encoder_model* model,
+        unsigned int candidates, int max_quality, uint64_t pixels,
+        uint64_t budget, guac_display_encoder_choice* choice);
+
+/**
+ * Returns the current value of a monotonic clock with nanosecond resolution
+ * (where supported), for measuring encoding times.
+ *
+ * @return
+ *     The current value of a monotonic clock, in nanoseconds.
+ */
+uint64_t guac_display_encoder_clock(void);
+
+/**
+ * Allocates a new guac_socket which writes all data to the given socket while
+ * counting the number of bytes written. The given socket is not freed when
+ * the returned socket is freed.
+ *
+ * @param socket
+ *     The socket to which all data should be written.
+ *
+ * @return
+ *     A newly-allocated guac_socket that must eventually be freed with
+ *     guac_socket_free().
+ */
+guac_socket* guac_display_encoder_counting_socket(guac_socket* socket);
+
+/**
+ * Changes the socket to which all data written to the given counting socket
+ * is written. The counting socket MUST have been allocated with
+ * guac_display_encoder_counting_socket(), and MUST NOT be in use by any other
+ * thread while the socket is changed. The previous socket is not freed.
+ *
+ * @param counting_socket
+ *     The counting socket to modify.
+ *
+ * @param socket
+ *     The socket to which all data written to the counting socket should now
+ *     be written.
+ */
+void guac_display_encoder_retarget_counting_socket(guac_socket* counting_socket,
+        guac_socket* socket);
+
+/**
+ * Returns the number of bytes written to the given socket since the last call
+ * to this function, resetting that count to zero. The given socket MUST have
+ * been allocated with guac_display_encoder_counting_socket().
+ *
+ * @param socket
+ *     The counting socket to query.
+ *
+ * @return
+ *     The number of bytes written since the last call to this function.
+ */
+uint64_t guac_display_encoder_take_count(guac_socket* socket);
+
+/**
+ * Initializes the given frame tracing state. Tracing is initially disabled.
+ *
+ * @param trace
+ *     The tracing state to initialize.
+ */
+void guac_display_trace_init(guac_display_trace* trace);
+
+/**
+ * Releases all resources associated with the given frame tracing state,
+ * including closing any machine-readable trace stream.
+ *
+ * @param trace
+ *     The tracing state to destroy.
+ */
+void guac_display_trace_destroy(guac_display_trace* trace);
+
+/**
+ * Begins tracing a new frame, assigning that frame the next sequence number
+ * and resetting the time recorded for each of its phases. This must be called
+ * before any planning phases of the frame are recorded.
+ *
+ * @param display
+ *     The display that is beginning a new frame.
+ */
+void PFW_guac_display_trace_begin_frame(guac_display* display);
+
+/**
+ * Notes that the first operation of the current frame has been picked up by
+ * a worker thread, if tracing is enabled and this has not already been
+ * noted. The ops FIFO of the display must already be locked.
+ *
+ * @param display
+ *     The display whose worker thread picked up an operation.
+ */
+void guac_display_trace_dequeued(guac_display* display);
+
+/**
+ * Records the format, size, and cost of a single image update of the current
+ * frame, if tracing is enabled.
+ *
+ * @param display
+ *     The display that sent the image update.
+ *
+ * @param format
+ *     The guac_display_encoding used for the image update, or
+ *     GUAC_DISPLAY_TRACE_FORMAT_DELTA if sent as a delta update, or
+ *     GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH if sent using hinted image data.
+ *
+ * @param pixels
+ *     The number of pixels within the image update.
+ *
+ * @param bytes
+ *     The number of bytes sent for the image update, including any protocol
+ *     overhead.
+ *
+ * @param encode_ns
+ *     The amount of time spent encoding and sending the image update, in
+ *     nanoseconds.
+ */
+void guac_display_trace_op(guac_display* display, int format,
+        uint64_t pixels, uint64_t bytes, uint64_t encode_ns);
+
+/**
+ * Finishes tracing the current frame, if tracing is enabled, writing a record
+ * of its timing to the machine-readable trace stream and logging a periodic
+ * summary if due. The ops FIFO of the display must already be locked.
+ *
+ * @param display
+ *     The display whose frame has ended.
+ *
+ * @param end_start
+ *     The value of guac_display_encoder_clock() when the last operation of
+ *     the frame was completed and the end of the frame began being sent.
+ *
+ * @param bytes
+ *     The total number of bytes of image data sent for the frame.
+ */
+void guac_display_trace_end_frame(guac_display* display, uint64_t end_start,
+        uint64_t bytes);
+
+/**
+ * Allocates a new guac_socket which writes only to the users within one
+ * encoding tier of the given display, as determined by the most recent call
+ * to PFR_guac_display_update_tiers().
+ *
+ * @param display
+ *     The display whose encoding tiers determine which users receive data
+ *     written to the returned socket.
+ *
+ * @param slow
+ *     Non-zero if the returned socket should write to the users of the slow
+ *     tier, zero if the returned socket should write to the users of the fast
+ *     tier.
+ *
+ * @return
+ *     A newly-allocated guac_socket that must eventually be freed with
+ *     guac_socket_free().
+ */
+guac_socket* guac_display_tier_socket(guac_display* display, int slow);
+
+/**
+ * Reassigns all connected users of the given display to the fast and slow
+ * encoding tiers based on their current lag, and recalculates whether image
+ * data must be sent separately to each tier. If tiered encoding is disabled,
+ * all users are considered part of the fast tier and image data is never
+ * sent separately. The ops FIFO must be locked, and this function must only
+ * be invoked before the operations of a new frame are made available to the
+ * worker threads.
+ *
+ * @param display
+ *     The display whose encoding tiers should be updated.
+ */
+void PFR_guac_display_update_tiers(guac_display* display);
+
+/**
+ * Adds a newly-encoded frame to the process-wide counters retrieved with
+ * guac_display_get_process_stats().
+ */
+void guac_display_stats_record_frame(void);
+
+/**
+ * Adds a newly-encoded image update to the process-wide histogram of image
+ * encoding times retrieved with guac_display_get_process_stats().
+ *
+ * @param encode_ns
+ *     The amount of time spent encoding and sending the image update, in
+ *     nanoseconds.
+ */
+void guac_display_stats_record_encode(uint64_t encode_ns);
+
+/**
+ * Adjusts the process-wide count of operations queued for display worker
+ * threads but not yet performed, as retrieved with
+ * guac_display_get_process_stats().
+ *
+ * @param queued
+ *     The number of operations newly queued.
+ *
+ * @param removed
+ *     The number of operations that have been performed or discarded.
+ */
+void guac_display_stats_record_pending(uint64_t queued, uint64_t removed);
+
 #endif
@@ -22,8 +22,12 @@
 #include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/flag.h"
+#include "guacamole/fifo.h"
 #include "guacamole/mem.h"
 #include "guacamole/timestamp.h"
+#include "guacamole/user.h"
+
+#include <stdint.h>
 
 /**
  * The maximum duration of a frame in milliseconds. This ensures we at least
@@ -45,6 +49,187 @@
  */
 #define GUAC_DISPLAY_RENDER_THREAD_MIN_FRAME_DURATION 10
 
+/**
+ * The minimum duration of each sample used to estimate available bandwidth,
+ * in milliseconds. Shorter samples would be dominated by the granularity of
+ * frame acknowledgements.
+ */
+#define GUAC_DISPLAY_RENDER_THREAD_BANDWIDTH_SAMPLE_DURATION 250
+
+/**
+ * The number of bandwidth samples that should be considered when estimating
+ * available bandwidth. Each new sample affects the estimate as if it were
+ * replacing the oldest of this many past samples.
+ */
+#define GUAC_DISPLAY_RENDER_THREAD_BANDWIDTH_HISTORY 4
+
+/**
+ * The acknowledgement state of the connected user that is furthest behind, as
+ * determined by guac_display_render_thread_find_oldest_ack().
+ */
+typedef struct guac_display_render_thread_ack {
+
+    /**
+     * Whether any users are connected at all. If no users are connected, the
+     * remaining members of this structure are undefined.
+     */
+    int found;
+
+    /**
+     * The timestamp of the most recent frame acknowledged by the user that
+     * is furthest behind.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The estimated network round-trip time of that user, in milliseconds.
+     */
+    int rtt;
+
+} guac_display_render_thread_ack;
+
+/**
+ * Callback for guac_client_foreach_user() which updates the given
+ * guac_display_render_thread_ack if the given user has acknowledged fewer
+ * frames than any user seen thus far.
+ *
+ * @param user
+ *     The user to check.
+ *
+ * @param data
+ *     A pointer to the guac_display_render_thread_ack to update.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_render_thread_find_oldest_ack(guac_user* user, void* data) {
+
+    guac_display_render_thread_ack* ack = (guac_display_render_thread_ack*) data;
+
+    if (!ack->found || user->last_received_timestamp < ack->timestamp) {
+        ack->found = 1;
+        ack->timestamp = user->last_received_timestamp;
+        ack->rtt = user->last_frame_duration;
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Updates the estimated bandwidth available to connected clients based on
+ * the frames acknowledged since the last update, and recalculates how long
+ * data already sent will remain queued before reaching those clients. The
+ * estimate is refined only while data remains continuously in flight, as the
+ * rate of acknowledgement otherwise reflects only the rate at which data was
+ * sent.
+ *
+ * @param render_thread
+ *     The render thread whose bandwidth estimate should be updated.
+ *
+ * @return
+ *     The estimated amount of time that data already sent will remain queued,
+ *     excluding the network round trip itself, in milliseconds. This is zero
+ *     if the connection is not saturated or no estimate is yet available.
+ */
+static int guac_display_render_thread_update_backlog(guac_display_render_thread* render_thread) {
+
+    guac_display* display = render_thread->display;
+
+    guac_display_render_thread_ack ack = { .found = 0 };
+    guac_client_foreach_user(display->client, guac_display_render_thread_find_oldest_ack, &ack);
+
+    guac_timestamp now = guac_timestamp_current();
+    uint64_t acked_bytes = 0;
+    uint64_t in_flight = 0;
+
+    guac_fifo_lock(&display->ops);
+
+    /* Remove all frames that have been acknowledged (or that never will be,
+     * if no users are connected), counting the data that has reached
+     * connected users */
+    while (display->sent_frames_length > 0) {
+
+        guac_display_sent_frame* oldest = &display->sent_frames[display->sent_frames_start];
+        if (ack.found && oldest->timestamp > ack.timestamp)
+            break;
+
+        acked_bytes += oldest->bytes;
+        display->sent_frames_start = (display->sent_frames_start + 1) % GUAC_DISPLAY_SENT_FRAME_HISTORY;
+        display->sent_frames_length--;
+
+    }
+
+    /* Count all data that has yet to be acknowledged */
+    for (unsigned int i = 0; i < display->sent_frames_length; i++)
+        in_flight += display->sent_frames[(display->sent_frames_start + i) % GUAC_DISPLAY_SENT_FRAME_HISTORY].bytes;
+
+    /* Note how long the oldest unacknowledged frame has been waiting */
+    int oldest_age = 0;
+    if (display->sent_frames_length > 0)
+        oldest_age = now - display->sent_frames[display->sent_frames_start].timestamp;
+
+    guac_fifo_unlock(&display->ops);
+
+    /* Measure the rate of acknowledgement between acknowledgements, rather
+     * than across arbitrary intervals, such that each sample covers exactly
+     * the data acknowledged within that sample */
+    if (acked_bytes) {
+
+        if (render_thread->sample_start) {
+
+            render_thread->sample_bytes += acked_bytes;
+
+            int elapsed = now - render_thread->sample_start;
+            if (elapsed >= GUAC_DISPLAY_RENDER_THREAD_BANDWIDTH_SAMPLE_DURATION) {
+
+                double sample = (double) render_thread->sample_bytes / elapsed;
+
+                /* Samples taken while the connection is not saturated reflect
+                 * only the rate that data was sent, so higher samples are
+                 * trusted immediately while lower samples reduce the estimate
+                 * only gradually */
+                if (sample > render_thread->bandwidth)
+                    render_thread->bandwidth = sample;
+                else
+                    render_thread->bandwidth += (sample - render_thread->bandwidth)
+                        / GUAC_DISPLAY_RENDER_THREAD_BANDWIDTH_HISTORY;
+
+                render_thread->sample_start = 0;
+
+            }
+
+        }
+
+        /* Begin a new sample with this acknowledgement if data remains in
+         * flight */
+        if (!render_thread->sample_start && in_flight) {
+            render_thread->sample_start = now;
+            render_thread->sample_bytes = 0;
+        }
+
+    }
+
+    /* Samples are only meaningful while data remains continuously in flight */
+    if (!in_flight)
+        render_thread->sample_start = 0;
+
+    /* Data in flight includes data simply still traversing the network, which
+     * does not indicate saturation. The connection is considered saturated
+     * only once acknowledgement of the oldest frame is overdue. */
+    int backlog = 0;
+    if (ack.found && render_thread->bandwidth > 0 && oldest_age > ack.rtt) {
+        backlog = in_flight / render_thread->bandwidth - ack.rtt;
+        if (backlog < 0)
+            backlog = 0;
+    }
+
+    atomic_store(&display->backlog, backlog);
+    atomic_store(&display->bandwidth, (int) render_thread->bandwidth);
+    return backlog;
+
+}
+
 /**
  * The start routine for the display render thread, consisting of a single
  * render loop. The render loop will proceed until signalled to stop,
@@ -68,11 +253,25 @@ static void* guac_display_render_loop(void* data) {
 
         guac_display_render_thread_cursor_state cursor_state = render_thread->cursor_state;
 
-        /* Wait indefinitely for any change to the frame state */
-        guac_flag_wait_and_lock(&render_thread->state,
-                  GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
+        unsigned int awaited_state = GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING
                 | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_READY
-                | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED);
+                | GUAC_DISPLAY_RENDER_THREAD_STATE_FRAME_MODIFIED;
+
+        /* While regions sent at reduced quality await refinement, wake
+         * periodically to refine those that have stopped changing, even if
+         * nothing else changes */
+        int refinement_delay = atomic_load(&display->refinement_delay);
+        if (refinement_delay > 0 && atomic_load(&display->lossy_pending)) {
+            if (!guac_flag_timedwait_and_lock(&render_thread->state,
+                        awaited_state, refinement_delay)) {
+                guac_display_end_multiple_frames(display, 0);
+                continue;
+            }
+        }
+
+        /* Otherwise, wait indefinitely for any change to the frame state */
+        else
+            guac_flag_wait_and_lock(&render_thread->state, awaited_state);
 
         /* Bail out immediately upon upcoming disconnect */
         if (render_thread->state.value & GUAC_DISPLAY_RENDER_THREAD_STATE_STOPPING) {
@@ -85,7 +284,7 @@ static void* guac_display_render_loop(void* data) {
         /* Lacking explicit frame boundaries, handle the change in frame state,
          * continuing to accumulate frame modifications while still within
          * heuristically determined frame boundaries */
-        guac_timestamp frame_start = guac_timestamp_current();
+        guac_timestamp frame_start = guac_timestamp_update_frame_time();
         do {
 
             /* Continue processing messages for up to a reasonable
@@ -119,6 +318,18 @@ static void* guac_display_render_loop(void* data) {
             int processing_lag = guac_client_get_processing_lag(client);
             int required_wait = processing_lag - time_since_last_frame;
 
+            /* If data already sent will take longer still to reach the
+             * client due to limited bandwidth, wait for that data to drain
+             * instead, merging any changes that occur in the meantime into
+             * the same frame */
+            int backlog = guac_display_render_thread_update_backlog(render_thread);
+            if (backlog > required_wait) {
+                guac_client_log(client, GUAC_LOG_TRACE, "Estimated %ims of "
+                        "queued data at %i bytes/ms.", backlog,
+                        (int) render_thread->bandwidth);
+                required_wait = backlog;
+            }
+
             /* Do not exceed a reasonable maximum framerate without an
              * explicit frame boundary terminating the frame early */
             int minimum_wait = GUAC_DISPLAY_RENDER_THREAD_MIN_FRAME_DURATION - frame_duration;
@@ -186,6 +397,9 @@ guac_display_render_thread* guac_display_render_thread_create(guac_display* disp
     render_thread->display = display;
     render_thread->frames = 0;
     render_thread->cursor_state = (guac_display_render_thread_cursor_state) { 0 };
+    render_thread->bandwidth = 0;
+    render_thread->sample_start = 0;
+    render_thread->sample_bytes = 0;
 
     /* Start render thread (this will immediately begin blocking until frame
      * modification or readiness is signalled) */
@@ -205,6 +419,30 @@ void guac_display_render_thread_notify_frame(guac_display_render_thread* render_
     guac_flag_unlock(&render_thread->state);
 }
 
+int guac_display_render_thread_get_delay(guac_display_render_thread* render_thread) {
+
+    guac_display* display = render_thread->display;
+    guac_client* client = display->client;
+
+    /* Account for client-side processing delays exactly as the render loop
+     * does when deciding how long to wait before the next frame */
+    int time_since_last_frame = guac_timestamp_current() - client->last_sent_timestamp;
+    int delay = guac_client_get_processing_lag(client) - time_since_last_frame;
+
+    int backlog = atomic_load(&display->backlog);
+    if (backlog > delay)
+        delay = backlog;
+
+    if (delay < 0)
+        return 0;
+
+    if (delay > GUAC_DISPLAY_MAX_LAG_COMPENSATION)
+        return GUAC_DISPLAY_MAX_LAG_COMPENSATION;
+
+    return delay;
+
+}
+
 void guac_display_render_thread_notify_user_moved_mouse(guac_display_render_thread* render_thread,
         guac_user* user, int x, int y, int mask) {
 
@@ -0,0 +1,89 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/display.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * The total number of frames encoded by all displays of the current process.
+ */
+static atomic_uint_fast64_t guac_display_stats_frames = 0;
+
+/**
+ * The number of operations queued for the worker threads of all displays of
+ * the current process but not yet performed.
+ */
+static atomic_uint_fast64_t guac_display_stats_pending = 0;
+
+/**
+ * The number of image updates encoded by all displays of the current process,
+ * grouped by encoding time as described by guac_display_stats.
+ */
+static atomic_uint_fast64_t guac_display_stats_encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS];
+
+/**
+ * The total time spent encoding all image updates counted by
+ * guac_display_stats_encodes, in nanoseconds.
+ */
+static atomic_uint_fast64_t guac_display_stats_encode_time = 0;
+
+void guac_display_stats_record_frame(void) {
+    atomic_fetch_add_explicit(&guac_display_stats_frames, 1, memory_order_relaxed);
+}
+
+void guac_display_stats_record_encode(uint64_t encode_ns) {
+
+    /* Locate the first bucket covering the given time, falling back to the
+     * last bucket for all longer times */
+    int bucket = 0;
+    uint64_t bound = GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND;
+    while (bucket < GUAC_DISPLAY_STATS_ENCODE_BUCKETS - 1 && encode_ns > bound) {
+        bound <<= 1;
+        bucket++;
+    }
+
+    atomic_fetch_add_explicit(&guac_display_stats_encodes[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&guac_display_stats_encode_time, encode_ns, memory_order_relaxed);
+
+}
+
+void guac_display_stats_record_pending(uint64_t queued, uint64_t removed) {
+
+    if (queued)
+        atomic_fetch_add_explicit(&guac_display_stats_pending, queued, memory_order_relaxed);
+
+    if (removed)
+        atomic_fetch_sub_explicit(&guac_display_stats_pending, removed, memory_order_relaxed);
+
+}
+
+void guac_display_get_process_stats(guac_display_stats* stats) {
+
+    stats->frames = atomic_load_explicit(&guac_display_stats_frames, memory_order_relaxed);
+    stats->pending_operations = atomic_load_explicit(&guac_display_stats_pending, memory_order_relaxed);
+    stats->encode_time = atomic_load_explicit(&guac_display_stats_encode_time, memory_order_relaxed);
+
+    for (int i = 0; i < GUAC_DISPLAY_STATS_ENCODE_BUCKETS; i++)
+        stats->encodes[i] = atomic_load_explicit(&guac_display_stats_encodes[i], memory_order_relaxed);
+
+}
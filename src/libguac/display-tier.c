@@ -0,0 +1,428 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/user.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * Data specific to sockets allocated with guac_display_tier_socket().
+ */
+typedef struct guac_display_tier_socket_data {
+
+    /**
+     * The display whose encoding tiers determine which users receive data
+     * written to the socket.
+     */
+    guac_display* display;
+
+    /**
+     * Whether data written to the socket should be sent to the users of the
+     * slow tier (non-zero) or the fast tier (zero).
+     */
+    int slow;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written, ensuring that
+     * the sockets of the users of the tier are always locked in the same
+     * order by one thread at a time.
+     */
+    pthread_mutex_t socket_lock;
+
+} guac_display_tier_socket_data;
+
+/**
+ * Returns whether the given user was considered part of the slow tier when
+ * the encoding tiers of the given display were last updated by
+ * PFR_guac_display_update_tiers().
+ *
+ * @param display
+ *     The display whose encoding tiers should be checked.
+ *
+ * @param user
+ *     The user to check.
+ *
+ * @return
+ *     Non-zero if the given user is part of the slow tier, zero otherwise.
+ */
+static int guac_display_tier_is_slow(guac_display* display, guac_user* user) {
+
+    for (size_t i = 0; i < display->slow_users_length; i++) {
+        if (display->slow_users[i] == user)
+            return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * A single operation to be performed on the socket of each user within an
+ * encoding tier by guac_display_tier_foreach_user().
+ */
+typedef struct guac_display_tier_operation {
+
+    /**
+     * The data of the tier socket whose users should be affected.
+     */
+    guac_display_tier_socket_data* tier;
+
+    /**
+     * The callback to invoke for each user within the tier.
+     */
+    guac_user_callback* callback;
+
+    /**
+     * Arbitrary data to pass to the callback.
+     */
+    void* data;
+
+} guac_display_tier_operation;
+
+/**
+ * Callback for guac_client_foreach_user() which invokes the callback of the
+ * given guac_display_tier_operation only if the given user is within the
+ * relevant encoding tier.
+ *
+ * @param user
+ *     The user to check.
+ *
+ * @param data
+ *     A pointer to the guac_display_tier_operation to perform.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_filter_callback(guac_user* user, void* data) {
+
+    guac_display_tier_operation* operation = (guac_display_tier_operation*) data;
+    guac_display_tier_socket_data* tier = operation->tier;
+
+    if (guac_display_tier_is_slow(tier->display, user) == tier->slow)
+        operation->callback(user, operation->data);
+
+    return NULL;
+
+}
+
+/**
+ * Invokes the given callback for each user within the encoding tier of the
+ * given tier socket.
+ *
+ * @param socket
+ *     The tier socket whose users should be iterated.
+ *
+ * @param callback
+ *     The callback to invoke for each user within the tier.
+ *
+ * @param data
+ *     Arbitrary data to pass to the callback.
+ */
+static void guac_display_tier_foreach_user(guac_socket* socket,
+        guac_user_callback* callback, void* data) {
+
+    guac_display_tier_socket_data* tier = (guac_display_tier_socket_data*) socket->data;
+
+    guac_display_tier_operation operation = {
+        .tier = tier,
+        .callback = callback,
+        .data = data
+    };
+
+    guac_client_foreach_user(tier->display->client,
+            guac_display_tier_filter_callback, &operation);
+
+}
+
+/**
+ * Single chunk of data, to be written to all users of an encoding tier.
+ */
+typedef struct guac_display_tier_chunk {
+
+    /**
+     * The buffer to write.
+     */
+    const void* buffer;
+
+    /**
+     * The number of bytes in the buffer.
+     */
+    size_t length;
+
+} guac_display_tier_chunk;
+
+/**
+ * Callback which writes a given chunk of data to the socket of the given
+ * user. If the write attempt fails, the user is signalled to stop with
+ * guac_user_stop().
+ *
+ * @param user
+ *     The user that the chunk of data should be written to.
+ *
+ * @param data
+ *     A pointer to a guac_display_tier_chunk which describes the data to be
+ *     written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_write_callback(guac_user* user, void* data) {
+
+    guac_display_tier_chunk* chunk = (guac_display_tier_chunk*) data;
+
+    if (guac_socket_write(user->socket, chunk->buffer, chunk->length))
+        guac_user_stop(user);
+
+    return NULL;
+
+}
+
+/**
+ * Callback invoked when data must be written to a tier socket. The data is
+ * written to the sockets of all users within the tier.
+ *
+ * @param socket
+ *     The tier socket being written to.
+ *
+ * @param buf
+ *     The buffer containing the data to write.
+ *
+ * @param count
+ *     The number of bytes to write from the given buffer.
+ *
+ * @return
+ *     Always the number of bytes given, as failing user-specific writes
+ *     result only in those users being stopped.
+ */
+static ssize_t guac_display_tier_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_display_tier_chunk chunk = {
+        .buffer = buf,
+        .length = count
+    };
+
+    guac_display_tier_foreach_user(socket, guac_display_tier_write_callback, &chunk);
+    return count;
+
+}
+
+/**
+ * Callback which flushes the socket of the given user. If the flush fails,
+ * the user is signalled to stop with guac_user_stop().
+ *
+ * @param user
+ *     The user whose socket should be flushed.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_flush_callback(guac_user* user, void* data) {
+
+    if (guac_socket_flush(user->socket))
+        guac_user_stop(user);
+
+    return NULL;
+
+}
+
+/**
+ * Callback invoked when a tier socket is flushed. The sockets of all users
+ * within the tier are flushed.
+ *
+ * @param socket
+ *     The tier socket being flushed.
+ *
+ * @return
+ *     Always zero, as failing user-specific flushes result only in those
+ *     users being stopped.
+ */
+static ssize_t guac_display_tier_flush_handler(guac_socket* socket) {
+    guac_display_tier_foreach_user(socket, guac_display_tier_flush_callback, NULL);
+    return 0;
+}
+
+/**
+ * Callback which locks the socket of the given user in preparation for the
+ * beginning of a Guacamole protocol instruction.
+ *
+ * @param user
+ *     The user whose socket should be locked.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_lock_callback(guac_user* user, void* data) {
+    guac_socket_instruction_begin(user->socket);
+    return NULL;
+}
+
+/**
+ * Callback invoked when an instruction begins being written to a tier
+ * socket. The sockets of all users within the tier are locked.
+ *
+ * @param socket
+ *     The tier socket being locked.
+ */
+static void guac_display_tier_lock_handler(guac_socket* socket) {
+
+    guac_display_tier_socket_data* tier = (guac_display_tier_socket_data*) socket->data;
+
+    pthread_mutex_lock(&tier->socket_lock);
+    guac_display_tier_foreach_user(socket, guac_display_tier_lock_callback, NULL);
+
+}
+
+/**
+ * Callback which unlocks the socket of the given user at the end of a
+ * Guacamole protocol instruction.
+ *
+ * @param user
+ *     The user whose socket should be unlocked.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_unlock_callback(guac_user* user, void* data) {
+    guac_socket_instruction_end(user->socket);
+    return NULL;
+}
+
+/**
+ * Callback invoked when an instruction is finished being written to a tier
+ * socket. The sockets of all users within the tier are unlocked.
+ *
+ * @param socket
+ *     The tier socket being unlocked.
+ */
+static void guac_display_tier_unlock_handler(guac_socket* socket) {
+
+    guac_display_tier_socket_data* tier = (guac_display_tier_socket_data*) socket->data;
+
+    guac_display_tier_foreach_user(socket, guac_display_tier_unlock_callback, NULL);
+    pthread_mutex_unlock(&tier->socket_lock);
+
+}
+
+/**
+ * Callback invoked when a tier socket is freed. The sockets of the users
+ * within the tier are NOT freed.
+ *
+ * @param socket
+ *     The tier socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_display_tier_free_handler(guac_socket* socket) {
+
+    guac_display_tier_socket_data* tier = (guac_display_tier_socket_data*) socket->data;
+
+    pthread_mutex_destroy(&tier->socket_lock);
+    guac_mem_free(tier);
+
+    return 0;
+
+}
+
+guac_socket* guac_display_tier_socket(guac_display* display, int slow) {
+
+    guac_display_tier_socket_data* tier =
+        guac_mem_alloc(sizeof(guac_display_tier_socket_data));
+
+    tier->display = display;
+    tier->slow = slow;
+    pthread_mutex_init(&tier->socket_lock, NULL);
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = tier;
+
+    socket->write_handler  = guac_display_tier_write_handler;
+    socket->flush_handler  = guac_display_tier_flush_handler;
+    socket->lock_handler   = guac_display_tier_lock_handler;
+    socket->unlock_handler = guac_display_tier_unlock_handler;
+    socket->free_handler   = guac_display_tier_free_handler;
+
+    return socket;
+
+}
+
+/**
+ * Callback for guac_client_foreach_user() which adds the given user to the
+ * slow tier of the given display if that user is lagging by more than
+ * GUAC_DISPLAY_TIER_FAST_MAX_LAG, and otherwise counts that user as part of
+ * the fast tier.
+ *
+ * @param user
+ *     The user to classify.
+ *
+ * @param data
+ *     The display whose tiers are being updated.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_tier_classify_callback(guac_user* user, void* data) {
+
+    guac_display* display = (guac_display*) data;
+
+    if (user->last_frame_duration + user->processing_lag <= GUAC_DISPLAY_TIER_FAST_MAX_LAG) {
+        display->fast_users_length++;
+        return NULL;
+    }
+
+    if (display->slow_users_length == display->slow_users_size) {
+        display->slow_users_size = display->slow_users_size ? display->slow_users_size * 2 : 4;
+        display->slow_users = guac_mem_realloc(display->slow_users,
+                display->slow_users_size, sizeof(guac_user*));
+    }
+
+    display->slow_users[display->slow_users_length++] = user;
+    return NULL;
+
+}
+
+void PFR_guac_display_update_tiers(guac_display* display) {
+
+    display->slow_users_length = 0;
+    display->fast_users_length = 0;
+
+    if (display->tiered_encoding)
+        guac_client_foreach_user(display->client,
+                guac_display_tier_classify_callback, display);
+
+    display->tiers_split = display->slow_users_length > 0
+        && display->fast_users_length > 0;
+
+}
@@ -0,0 +1,405 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "display-priv.h"
+#include "guacamole/client.h"
+#include "guacamole/display.h"
+#include "guacamole/error.h"
+#include "guacamole/timestamp.h"
+#include "probe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * The names of each phase timed by frame tracing, indexed by
+ * guac_display_trace_phase.
+ */
+static const char* GUAC_DISPLAY_TRACE_PHASE_NAMES[GUAC_DISPLAY_TRACE_PHASE_COUNT] = {
+    [GUAC_DISPLAY_TRACE_PHASE_DRAFT]   = "draft",
+    [GUAC_DISPLAY_TRACE_PHASE_RECTS]   = "rects",
+    [GUAC_DISPLAY_TRACE_PHASE_SEARCH]  = "search",
+    [GUAC_DISPLAY_TRACE_PHASE_COMBINE] = "combine",
+    [GUAC_DISPLAY_TRACE_PHASE_DELTA]   = "delta",
+    [GUAC_DISPLAY_TRACE_PHASE_COMMIT]  = "commit",
+    [GUAC_DISPLAY_TRACE_PHASE_QUEUE]   = "queue",
+    [GUAC_DISPLAY_TRACE_PHASE_ENCODE]  = "encode",
+    [GUAC_DISPLAY_TRACE_PHASE_FLUSH]   = "flush"
+};
+
+/**
+ * The names of each format tracked by frame tracing, indexed by
+ * guac_display_encoding, GUAC_DISPLAY_TRACE_FORMAT_DELTA, or
+ * GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH.
+ */
+static const char* GUAC_DISPLAY_TRACE_FORMAT_NAMES[GUAC_DISPLAY_TRACE_FORMATS] = {
+    [GUAC_DISPLAY_ENCODING_PNG]             = "png",
+    [GUAC_DISPLAY_ENCODING_JPEG]            = "jpeg",
+    [GUAC_DISPLAY_ENCODING_WEBP]            = "webp",
+    [GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS]   = "webp-lossless",
+    [GUAC_DISPLAY_ENCODING_PNG_FAST]        = "png-fast",
+    [GUAC_DISPLAY_TRACE_FORMAT_DELTA]       = "png-delta",
+    [GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH] = "passthrough"
+};
+
+/**
+ * Updates whether tracing is active based on the current tracing
+ * configuration. The lock of the given tracing state must already be held.
+ *
+ * @param trace
+ *     The tracing state to update.
+ */
+static void guac_display_trace_update_active(guac_display_trace* trace) {
+    atomic_store(&trace->active, trace->fd != -1 || trace->interval > 0);
+}
+
+/**
+ * Closes the machine-readable trace stream, if open. The lock of the given
+ * tracing state must already be held.
+ *
+ * @param trace
+ *     The tracing state whose trace stream should be closed.
+ */
+static void guac_display_trace_close(guac_display_trace* trace) {
+
+    if (trace->fd != -1) {
+        close(trace->fd);
+        trace->fd = -1;
+    }
+
+    guac_display_trace_update_active(trace);
+
+}
+
+/**
+ * Writes the given record to the machine-readable trace stream, if open. If
+ * the record cannot be written, the trace stream is closed and a warning is
+ * logged. The lock of the trace state of the given display must already be
+ * held.
+ *
+ * @param display
+ *     The display whose trace stream should receive the record.
+ *
+ * @param record
+ *     The record to write, which must be a single newline-terminated line.
+ *
+ * @param length
+ *     The length of the record, in bytes. If this is negative or exceeds
+ *     GUAC_DISPLAY_TRACE_RECORD_SIZE, the record was truncated by snprintf()
+ *     and is dropped.
+ */
+static void guac_display_trace_write(guac_display* display,
+        const char* record, int length) {
+
+    guac_display_trace* trace = &display->trace;
+
+    if (trace->fd == -1 || length < 0 || length >= GUAC_DISPLAY_TRACE_RECORD_SIZE)
+        return;
+
+    while (length > 0) {
+
+        ssize_t written = write(trace->fd, record, length);
+        if (written < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            guac_client_log(display->client, GUAC_LOG_WARNING, "Display "
+                    "trace stream closed: %s", strerror(errno));
+
+            guac_display_trace_close(trace);
+            return;
+
+        }
+
+        record += written;
+        length -= written;
+
+    }
+
+}
+
+/**
+ * Logs a summary of all traced data since the last summary at the "debug"
+ * log level, resetting all totals for the next summary. The lock of the trace
+ * state of the given display must already be held.
+ *
+ * @param display
+ *     The display whose traced data should be summarized.
+ *
+ * @param now
+ *     The current time, as returned by guac_timestamp_current_coarse().
+ */
+static void guac_display_trace_log_summary(guac_display* display,
+        guac_timestamp now) {
+
+    guac_display_trace* trace = &display->trace;
+
+    if (trace->frames) {
+
+        char phases[GUAC_DISPLAY_TRACE_RECORD_SIZE];
+        int length = 0;
+
+        for (int i = 0; i < GUAC_DISPLAY_TRACE_PHASE_COUNT
+                && length < (int) sizeof(phases); i++) {
+            length += snprintf(phases + length, sizeof(phases) - length,
+                    "%s%s %.2fms (%.2fms)", i ? ", " : "",
+                    GUAC_DISPLAY_TRACE_PHASE_NAMES[i],
+                    trace->phase_total[i] / 1000000.0 / trace->frames,
+                    trace->phase_max[i] / 1000000.0);
+        }
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display trace: "
+                "%llu frame(s) in %llums, average (maximum) per frame: %s.",
+                (unsigned long long) trace->frames,
+                (unsigned long long) (now - trace->summary_start), phases);
+
+    }
+
+    for (int i = 0; i < GUAC_DISPLAY_TRACE_FORMATS; i++) {
+
+        guac_display_trace_format_stats* stats = &trace->formats[i];
+        if (!stats->ops || !stats->pixels)
+            continue;
+
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display trace: "
+                "%llu %s update(s) totalling %llu pixels and %llu bytes, "
+                "%.2fns and %.3f bytes per pixel.",
+                (unsigned long long) stats->ops,
+                GUAC_DISPLAY_TRACE_FORMAT_NAMES[i],
+                (unsigned long long) stats->pixels,
+                (unsigned long long) stats->bytes,
+                (double) stats->encode_ns / stats->pixels,
+                (double) stats->bytes / stats->pixels);
+
+    }
+
+    trace->summary_start = now;
+    trace->frames = 0;
+    memset(trace->phase_total, 0, sizeof(trace->phase_total));
+    memset(trace->phase_max, 0, sizeof(trace->phase_max));
+    memset(trace->formats, 0, sizeof(trace->formats));
+
+}
+
+void guac_display_trace_init(guac_display_trace* trace) {
+
+    pthread_mutex_init(&trace->lock, NULL);
+    trace->fd = -1;
+    trace->interval = 0;
+    trace->summary_start = guac_timestamp_current_coarse();
+    atomic_init(&trace->active, 0);
+
+}
+
+void guac_display_trace_destroy(guac_display_trace* trace) {
+    guac_display_trace_close(trace);
+    pthread_mutex_destroy(&trace->lock);
+}
+
+void PFW_guac_display_trace_begin_frame(guac_display* display) {
+
+    guac_display_trace* trace = &display->trace;
+
+    trace->frame++;
+    memset(trace->phases, 0, sizeof(trace->phases));
+
+}
+
+void guac_display_trace_dequeued(guac_display* display) {
+
+    guac_display_trace* trace = &display->trace;
+
+    if (atomic_load(&trace->active) && !trace->frame_dequeued)
+        trace->frame_dequeued = guac_display_encoder_clock();
+
+}
+
+void guac_display_trace_op(guac_display* display, int format,
+        uint64_t pixels, uint64_t bytes, uint64_t encode_ns) {
+
+    guac_display_trace* trace = &display->trace;
+
+    GUAC_PROBE5(op_encode, display, GUAC_DISPLAY_TRACE_FORMAT_NAMES[format],
+            pixels, bytes, encode_ns);
+
+    if (!atomic_load(&trace->active))
+        return;
+
+    pthread_mutex_lock(&trace->lock);
+
+    guac_display_trace_format_stats* stats = &trace->formats[format];
+    stats->ops++;
+    stats->pixels += pixels;
+    stats->bytes += bytes;
+    stats->encode_ns += encode_ns;
+
+    if (trace->fd != -1) {
+
+        char record[GUAC_DISPLAY_TRACE_RECORD_SIZE];
+        int length = snprintf(record, sizeof(record), "{\"type\":\"op\","
+                "\"frame\":%llu,\"format\":\"%s\",\"pixels\":%llu,"
+                "\"bytes\":%llu,\"encode_ns\":%llu}\n",
+                (unsigned long long) trace->frame,
+                GUAC_DISPLAY_TRACE_FORMAT_NAMES[format],
+                (unsigned long long) pixels,
+                (unsigned long long) bytes,
+                (unsigned long long) encode_ns);
+
+        guac_display_trace_write(display, record, length);
+
+    }
+
+    pthread_mutex_unlock(&trace->lock);
+
+}
+
+void guac_display_trace_end_frame(guac_display* display, uint64_t end_start,
+        uint64_t bytes) {
+
+    guac_display_trace* trace = &display->trace;
+
+    if (!atomic_load(&trace->active))
+        return;
+
+    uint64_t end = guac_display_encoder_clock();
+
+    /* Tracing may have been enabled partway through the frame */
+    uint64_t queued = trace->frame_queued ? trace->frame_queued : end_start;
+    uint64_t dequeued = trace->frame_dequeued ? trace->frame_dequeued : queued;
+
+    trace->phases[GUAC_DISPLAY_TRACE_PHASE_QUEUE] = dequeued - queued;
+    trace->phases[GUAC_DISPLAY_TRACE_PHASE_ENCODE] = end_start - dequeued;
+    trace->phases[GUAC_DISPLAY_TRACE_PHASE_FLUSH] = end - end_start;
+
+    pthread_mutex_lock(&trace->lock);
+
+    trace->frames++;
+    for (int i = 0; i < GUAC_DISPLAY_TRACE_PHASE_COUNT; i++) {
+        trace->phase_total[i] += trace->phases[i];
+        if (trace->phases[i] > trace->phase_max[i])
+            trace->phase_max[i] = trace->phases[i];
+    }
+
+    if (trace->fd != -1) {
+
+        char record[GUAC_DISPLAY_TRACE_RECORD_SIZE];
+        int length = snprintf(record, sizeof(record), "{\"type\":\"frame\","
+                "\"frame\":%llu,\"timestamp\":%llu,\"bytes\":%llu",
+                (unsigned long long) trace->frame,
+                (unsigned long long) display->last_frame.timestamp,
+                (unsigned long long) bytes);
+
+        for (int i = 0; i < GUAC_DISPLAY_TRACE_PHASE_COUNT
+                && length >= 0 && length < (int) sizeof(record); i++) {
+            length += snprintf(record + length, sizeof(record) - length,
+                    ",\"%s_ns\":%llu", GUAC_DISPLAY_TRACE_PHASE_NAMES[i],
+                    (unsigned long long) trace->phases[i]);
+        }
+
+        if (length >= 0 && length < (int) sizeof(record))
+            length += snprintf(record + length, sizeof(record) - length, "}\n");
+
+        guac_display_trace_write(display, record, length);
+
+    }
+
+    /* Log a summary of everything traced since the last summary, if due */
+    guac_timestamp now = guac_timestamp_current_coarse();
+    if (trace->interval > 0 && now - trace->summary_start >= trace->interval)
+        guac_display_trace_log_summary(display, now);
+
+    pthread_mutex_unlock(&trace->lock);
+
+}
+
+void guac_display_set_trace_interval(guac_display* display, int interval) {
+
+    guac_display_trace* trace = &display->trace;
+    pthread_mutex_lock(&trace->lock);
+
+    /* Begin a fresh summary with the new interval */
+    trace->interval = interval;
+    guac_display_trace_log_summary(display, guac_timestamp_current_coarse());
+    guac_display_trace_update_active(trace);
+
+    pthread_mutex_unlock(&trace->lock);
+
+}
+
+int guac_display_set_trace_output(guac_display* display, const char* path) {
+
+    guac_display_trace* trace = &display->trace;
+    int fd = -1;
+
+    if (path != NULL) {
+
+        /* Connect to any existing Unix domain socket at the given path, for
+         * consumption by a local collector */
+        struct stat path_stat;
+        if (stat(path, &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+
+            struct sockaddr_un addr = { .sun_family = AF_UNIX };
+            if (strlen(path) >= sizeof(addr.sun_path)) {
+                guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+                guac_error_message = "Path of trace socket is too long";
+                return 1;
+            }
+
+            strcpy(addr.sun_path, path);
+
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd != -1 && connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+                close(fd);
+                fd = -1;
+            }
+
+        }
+
+        /* Otherwise, append to a file at the given path */
+        else
+            fd = open(path, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+
+        if (fd == -1) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Unable to open trace stream";
+            return 1;
+        }
+
+    }
+
+    pthread_mutex_lock(&trace->lock);
+
+    guac_display_trace_close(trace);
+    trace->fd = fd;
+    guac_display_trace_update_active(trace);
+
+    pthread_mutex_unlock(&trace->lock);
+
+    return 0;
+
+}
@@ -19,16 +19,26 @@
 
 #include "display-plan.h"
 #include "display-priv.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
 #include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/fifo.h"
+#include "guacamole/flag.h"
 #include "guacamole/layer.h"
+#include "guacamole/mem.h"
 #include "guacamole/protocol-types.h"
 #include "guacamole/protocol.h"
 #include "guacamole/rect.h"
 #include "guacamole/rwlock.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
+#include "probe.h"
+#include "socket-recording.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
 
 #include <inttypes.h>
 #include <limits.h>
@@ -78,6 +88,419 @@ static cairo_surface_t* LFR_guac_display_layer_cairo_rect(guac_display_layer* di
 
 }
 
+/**
+ * The image encoders owned by a single worker thread. Each worker thread
+ * reuses the same encoders for every update it sends, rather than setting up
+ * and tearing down the underlying libpng, libjpeg and libwebp state for each
+ * update.
+ */
+typedef struct guac_display_worker_encoders {
+
+    /**
+     * The encoder used for all PNG updates.
+     */
+    guac_png_encoder* png;
+
+    /**
+     * The encoder used for all JPEG updates.
+     */
+    guac_jpeg_encoder* jpeg;
+
+#ifdef ENABLE_WEBP
+    /**
+     * The encoder used for all WebP updates.
+     */
+    guac_webp_encoder* webp;
+#endif
+
+    /**
+     * Storage for the image data of delta updates, reused for every delta
+     * update. This is NULL if no delta update has yet been sent.
+     */
+    uint32_t* delta;
+
+    /**
+     * The number of pixels that can be stored within the delta buffer.
+     */
+    size_t delta_size;
+
+} guac_display_worker_encoders;
+
+/**
+ * Encodes and sends the contents of the given rectangle of the given layer
+ * using the given encoding. The graphical contents are read from the layer's
+ * last_frame buffer. If the layer is opaque, that data is encoded in place,
+ * without first being wrapped in a Cairo surface.
+ *
+ * @param display_layer
+ *     The layer whose data should be sent.
+ *
+ * @param encoders
+ *     The encoders owned by the calling worker thread.
+ *
+ * @param socket
+ *     The socket that the encoded image data should be sent over.
+ *
+ * @param dirty
+ *     The region of the layer that should be sent.
+ *
+ * @param choice
+ *     The encoding and quality to use.
+ */
+static void LFR_guac_display_layer_stream(guac_display_layer* display_layer,
+        guac_display_worker_encoders* encoders, guac_socket* socket,
+        guac_rect* dirty, const guac_display_encoder_choice* choice) {
+
+    guac_client* client = display_layer->display->client;
+    const guac_layer* layer = display_layer->layer;
+
+    /* Layers with alpha transparency require the encoders to interpret the
+     * image data as ARGB32, which is only possible using Cairo */
+    if (!display_layer->opaque) {
+
+        cairo_surface_t* rect = LFR_guac_display_layer_cairo_rect(display_layer, dirty);
+
+        switch (choice->encoding) {
+
+            case GUAC_DISPLAY_ENCODING_WEBP:
+            case GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS:
+                guac_client_stream_webp(client, socket, GUAC_COMP_OVER, layer,
+                        dirty->left, dirty->top, rect, choice->quality,
+                        choice->encoding == GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS);
+                break;
+
+            case GUAC_DISPLAY_ENCODING_JPEG:
+                guac_client_stream_jpeg(client, socket, GUAC_COMP_OVER, layer,
+                        dirty->left, dirty->top, rect, choice->quality);
+                break;
+
+            default:
+                guac_client_stream_png(client, socket, GUAC_COMP_OVER,
+                        layer, dirty->left, dirty->top, rect);
+                break;
+
+        }
+
+        cairo_surface_destroy(rect);
+        return;
+
+    }
+
+    const unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(display_layer->last_frame, *dirty);
+    int stride = display_layer->last_frame.buffer_stride;
+    int width = guac_rect_width(dirty);
+    int height = guac_rect_height(dirty);
+
+    /* Allocate new stream for image */
+    guac_stream* stream = guac_client_alloc_stream(client);
+
+    switch (choice->encoding) {
+
+#ifdef ENABLE_WEBP
+        case GUAC_DISPLAY_ENCODING_WEBP:
+        case GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS:
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer,
+                    "image/webp", dirty->left, dirty->top);
+            guac_webp_write_raw(encoders->webp, socket, stream, buffer,
+                    width, height, stride, choice->quality,
+                    choice->encoding == GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS);
+            break;
+#endif
+
+        case GUAC_DISPLAY_ENCODING_JPEG:
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer,
+                    "image/jpeg", dirty->left, dirty->top);
+            guac_jpeg_write_raw(encoders->jpeg, socket, stream, buffer,
+                    width, height, stride, choice->quality);
+            break;
+
+        default:
+            encoders->png->fast = choice->encoding == GUAC_DISPLAY_ENCODING_PNG_FAST;
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer,
+                    "image/png", dirty->left, dirty->top);
+            guac_png_write_raw(encoders->png, socket, stream, buffer,
+                    width, height, stride);
+            break;
+
+    }
+
+    /* Terminate stream */
+    guac_protocol_send_end(socket, stream);
+
+    /* Free allocated stream */
+    guac_client_free_stream(client, stream);
+
+}
+
+/**
+ * Encodes and sends the contents of the given rectangle of the given layer
+ * exactly as LFR_guac_display_layer_stream() does, additionally measuring the
+ * time taken and the amount of data sent. Those measurements are recorded
+ * within the encoder cost model of the display and included in the number of
+ * bytes sent for the current frame.
+ *
+ * @param display_layer
+ *     The layer whose data should be sent.
+ *
+ * @param encoders
+ *     The encoders owned by the calling worker thread.
+ *
+ * @param socket
+ *     The socket that the encoded image data should be sent over. This
+ *     socket MUST have been allocated with
+ *     guac_display_encoder_counting_socket().
+ *
+ * @param dirty
+ *     The region of the layer that should be sent.
+ *
+ * @param choice
+ *     The encoding and quality to use.
+ */
+static void LFR_guac_display_layer_stream_measured(guac_display_layer* display_layer,
+        guac_display_worker_encoders* encoders, guac_socket* socket,
+        guac_rect* dirty, const guac_display_encoder_choice* choice) {
+
+    guac_display* display = display_layer->display;
+
+    uint64_t encode_start = guac_display_encoder_clock();
+    guac_display_encoder_take_count(socket);
+
+    LFR_guac_display_layer_stream(display_layer, encoders, socket, dirty, choice);
+
+    uint64_t encode_duration = guac_display_encoder_clock() - encode_start;
+    uint64_t bytes = guac_display_encoder_take_count(socket);
+    uint64_t pixels = (uint64_t) guac_rect_width(dirty) * guac_rect_height(dirty);
+    atomic_fetch_add(&display->frame_bytes, bytes);
+
+    /* Refine cost model using the actual cost of this update */
+    guac_display_encoder_record(&display->encoder_model, choice,
+            pixels, encode_duration, bytes);
+
+    guac_display_trace_op(display, choice->encoding, pixels, bytes, encode_duration);
+    guac_display_stats_record_encode(encode_duration);
+
+}
+
+/**
+ * Encodes and sends the contents of the given rectangle of the given layer to
+ * the recording of the client alone, as a JPEG image at no more than the
+ * quality configured with guac_recording_set_default_image_quality(). Regions
+ * in sustained motion are recorded at GUAC_DISPLAY_ENCODER_MIN_QUALITY. The
+ * layer MUST be opaque, and the client MUST have such a recording. Neither
+ * the cost model of the display nor the number of bytes sent for the current
+ * frame are affected.
+ *
+ * @param display_layer
+ *     The layer whose data should be sent.
+ *
+ * @param encoders
+ *     The encoders owned by the calling worker thread.
+ *
+ * @param dirty
+ *     The region of the layer that should be sent.
+ *
+ * @param motion
+ *     Non-zero if the region is in sustained motion, zero otherwise.
+ */
+static void LFR_guac_display_layer_stream_recording(guac_display_layer* display_layer,
+        guac_display_worker_encoders* encoders, guac_rect* dirty, int motion) {
+
+    guac_client* client = display_layer->display->client;
+
+    guac_display_encoder_choice choice = {
+        .encoding = GUAC_DISPLAY_ENCODING_JPEG,
+        .quality = client->__recording_image_quality
+    };
+
+    if (motion && choice.quality > GUAC_DISPLAY_ENCODER_MIN_QUALITY)
+        choice.quality = GUAC_DISPLAY_ENCODER_MIN_QUALITY;
+
+    LFR_guac_display_layer_stream(display_layer, encoders,
+            client->__recording_output, dirty, &choice);
+
+}
+
+/**
+ * Sends the image data of the given image hint as-is, drawing that data at
+ * the hinted position within the given layer, without encoding anything. The
+ * amount of data sent is included in the number of bytes sent for the
+ * current frame.
+ *
+ * @param display_layer
+ *     The layer that the hint was given for.
+ *
+ * @param socket
+ *     The socket that the image data should be sent over. This socket MUST
+ *     have been allocated with guac_display_encoder_counting_socket().
+ *
+ * @param hint
+ *     The hint whose image data should be sent.
+ */
+static void LFR_guac_display_layer_stream_hinted(guac_display_layer* display_layer,
+        guac_socket* socket, const guac_display_image_hint* hint) {
+
+    guac_display* display = display_layer->display;
+    guac_client* client = display->client;
+
+    uint64_t send_start = guac_display_encoder_clock();
+    guac_display_encoder_take_count(socket);
+
+    guac_stream* stream = guac_client_alloc_stream(client);
+
+    guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, display_layer->layer,
+            hint->mimetype, hint->rect.left, hint->rect.top);
+    guac_protocol_send_blobs(socket, stream, hint->data, hint->length);
+    guac_protocol_send_end(socket, stream);
+
+    guac_client_free_stream(client, stream);
+
+    uint64_t send_duration = guac_display_encoder_clock() - send_start;
+    uint64_t bytes = guac_display_encoder_take_count(socket);
+    uint64_t pixels = (uint64_t) guac_rect_width(&hint->rect) * guac_rect_height(&hint->rect);
+    atomic_fetch_add(&display->frame_bytes, bytes);
+
+    /* Hinted image data is not representative of the cost of any encoding,
+     * and is thus not recorded in the cost model */
+    guac_display_trace_op(display, GUAC_DISPLAY_TRACE_FORMAT_PASSTHROUGH,
+            pixels, bytes, send_duration);
+
+}
+
+/**
+ * Attempts to send the contents of the given rectangle of the given opaque
+ * layer as a PNG delta update, containing only the pixels that differ from
+ * the given previous contents of that rectangle. All other pixels are
+ * replaced with a key color that is marked as transparent, such that drawing
+ * the update leaves those pixels untouched client-side. The delta update is
+ * sent only if enough pixels are unchanged for the update to be worthwhile
+ * and a suitable key color can be found.
+ *
+ * @param display_layer
+ *     The layer whose data should be sent. This layer must be opaque.
+ *
+ * @param encoders
+ *     The encoders owned by the calling worker thread.
+ *
+ * @param socket
+ *     The socket that the encoded image data should be sent over.
+ *
+ * @param dirty
+ *     The region of the layer that should be sent.
+ *
+ * @param previous
+ *     The contents of the given region as of the previous frame, as retained
+ *     by LFR_guac_display_plan_retain_previous().
+ *
+ * @return
+ *     The number of pixels that were left unchanged by the delta update that
+ *     was sent, or zero if no delta update was sent and the region must be
+ *     sent normally.
+ */
+static uint64_t LFR_guac_display_layer_stream_delta(guac_display_layer* display_layer,
+        guac_display_worker_encoders* encoders, guac_socket* socket,
+        guac_rect* dirty, const unsigned char* previous) {
+
+    guac_client* client = display_layer->display->client;
+
+    const unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(display_layer->last_frame, *dirty);
+    size_t stride = display_layer->last_frame.buffer_stride;
+    int width = guac_rect_width(dirty);
+    int height = guac_rect_height(dirty);
+    size_t pixels = (size_t) width * height;
+
+    /* Count the pixels that have not changed since the previous frame */
+    uint64_t unchanged = 0;
+    const unsigned char* current_row = buffer;
+    const uint32_t* previous_pixel = (const uint32_t*) previous;
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* current_pixel = (const uint32_t*) current_row;
+        for (int x = 0; x < width; x++) {
+            if (((*(current_pixel++) ^ *(previous_pixel++)) & 0xFFFFFF) == 0)
+                unchanged++;
+        }
+
+        current_row += stride;
+
+    }
+
+    /* A delta update is worthwhile only if a reasonable portion of the
+     * region is unchanged (otherwise, the key color merely interrupts runs of
+     * otherwise-compressible data) */
+    if (unchanged * GUAC_DISPLAY_DELTA_MIN_UNCHANGED_RATIO < pixels)
+        return 0;
+
+    /* Grow delta storage only as needed */
+    if (pixels > encoders->delta_size) {
+        guac_mem_free(encoders->delta);
+        encoders->delta = guac_mem_alloc(sizeof(uint32_t), pixels);
+        encoders->delta_size = pixels;
+    }
+
+    /* Find a key color not used by any changed pixel, giving up after a
+     * handful of attempts (this should only fail for regions containing a
+     * very large number of distinct colors) */
+    uint32_t key = GUAC_DISPLAY_DELTA_INITIAL_KEY;
+    for (int attempt = 0;; attempt++) {
+
+        if (attempt == GUAC_DISPLAY_DELTA_MAX_KEY_ATTEMPTS)
+            return 0;
+
+        int conflict = 0;
+        uint32_t* delta_pixel = encoders->delta;
+
+        current_row = buffer;
+        previous_pixel = (const uint32_t*) previous;
+        for (int y = 0; y < height && !conflict; y++) {
+
+            const uint32_t* current_pixel = (const uint32_t*) current_row;
+            for (int x = 0; x < width; x++) {
+
+                uint32_t color = *(current_pixel++) & 0xFFFFFF;
+
+                /* Unchanged pixels are replaced with the key color */
+                if (((color ^ *(previous_pixel++)) & 0xFFFFFF) == 0)
+                    *(delta_pixel++) = key;
+
+                /* Changed pixels must retain their color, which must not be
+                 * the key color */
+                else if (color == key) {
+                    conflict = 1;
+                    break;
+                }
+
+                else
+                    *(delta_pixel++) = color;
+
+            }
+
+            current_row += stride;
+
+        }
+
+        if (!conflict)
+            break;
+
+        /* Try a different, arbitrary, unlikely color */
+        key = (key * 1103515245 + 12345) & 0xFFFFFF;
+
+    }
+
+    guac_stream* stream = guac_client_alloc_stream(client);
+
+    guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, display_layer->layer,
+            "image/png", dirty->left, dirty->top);
+    guac_png_write_keyed(encoders->png, socket, stream,
+            (const unsigned char*) encoders->delta, width, height,
+            width * sizeof(uint32_t), key);
+
+    guac_protocol_send_end(socket, stream);
+    guac_client_free_stream(client, stream);
+
+    return unchanged;
+
+}
+
 /**
  * Sends instructions over the Guacamole connection to clear the given
  * rectangle of the given layer if that layer is non-opaque. This is necessary
@@ -116,18 +539,25 @@ static void guac_display_layer_clear_non_opaque(guac_display_layer* display_laye
 
 /**
  * Returns an appropriate quality between 0 and 100 for lossy encoding
- * depending on the current processing lag calculated for the given client.
+ * depending on the current processing lag calculated for the client of the
+ * given display and on how long data already sent remains queued before
+ * reaching that client.
  *
- * @param client
- *     The client for which the lossy quality is being calculated.
+ * @param display
+ *     The display for which the lossy quality is being calculated.
  *
  * @return
  *     A value between 0 and 100 inclusive which seems appropriate for the
  *     client based on lag measurements.
  */
-static int guac_display_suggest_quality(guac_client* client) {
+static int guac_display_suggest_quality(guac_display* display) {
 
-    int lag = guac_client_get_processing_lag(client);
+    /* Data that remains queued due to limited bandwidth delays the client
+     * just as slow processing does */
+    int lag = guac_client_get_processing_lag(display->client);
+    int backlog = atomic_load(&display->backlog);
+    if (backlog > lag)
+        lag = backlog;
 
     /* Scale quality linearly from 90 to 30 as lag varies from 20ms to 80ms */
     int quality = 90 - (lag - 20);
@@ -214,47 +644,78 @@ static int LFR_guac_display_layer_png_optimality(guac_display_layer* layer,
 }
 
 /**
- * Returns whether the given rectangle would be optimally encoded as JPEG
- * rather than PNG.
+ * Returns whether the given rectangle within the given layer contains no more
+ * than GUAC_DISPLAY_PNG_MAX_COLORS distinct colors. The alpha channel is
+ * considered only for layers that are not opaque. The search stops as soon as
+ * too many colors are found, so this is cheap for the many-colored images
+ * that it rejects.
  *
  * @param layer
- *     The layer to be queried.
+ *     The layer containing the image data to check.
  *
  * @param rect
- *     The rectangle to check.
- *
- * @param framerate
- *     The rate that the region covered by the given rectangle has historically
- *     been being updated within the given layer, in frames per second.
+ *     The rect to check within the given layer.
  *
  * @return
- *     Non-zero if the rectangle would be optimally encoded as JPEG, zero
- *     otherwise.
+ *     Non-zero if the given rectangle contains no more than
+ *     GUAC_DISPLAY_PNG_MAX_COLORS distinct colors, zero otherwise.
  */
-static int LFR_guac_display_layer_should_use_jpeg(guac_display_layer* layer,
-        const guac_rect* rect, int framerate) {
+static int LFR_guac_display_layer_is_low_color(guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    uint32_t colors[GUAC_DISPLAY_PNG_MAX_COLORS];
+    int count = 0;
+
+    uint32_t mask = layer->opaque ? 0x00FFFFFF : 0xFFFFFFFF;
 
-    /* Do not use JPEG if lossless quality is required */
-    if (layer->last_frame.lossless)
+    size_t stride = layer->last_frame.buffer_stride;
+    const unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_CONST_BUFFER(layer->last_frame, *rect);
+
+    /* Image must be at least 1x1 */
+    if (rect->right - rect->left < 1 || rect->bottom - rect->top < 1)
         return 0;
 
-    int rect_width = rect->right - rect->left;
-    int rect_height = rect->bottom - rect->top;
-    int rect_size = rect_width * rect_height;
+    for (int y = rect->top; y < rect->bottom; y++) {
 
-    /* JPEG is preferred if:
-     * - frame rate is high enough
-     * - image size is large enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
-        && rect_size > GUAC_DISPLAY_JPEG_MIN_BITMAP_SIZE
-        && LFR_guac_display_layer_png_optimality(layer, rect) < 0;
+        const uint32_t* row = (const uint32_t*) buffer;
+        for (int x = rect->left; x < rect->right; x++) {
+
+            uint32_t color = *(row++) & mask;
+
+            /* Record the color if not already seen, bailing out if there are
+             * now too many colors */
+            int i;
+            for (i = 0; i < count; i++) {
+                if (colors[i] == color)
+                    break;
+            }
+
+            if (i == count) {
+                if (count == GUAC_DISPLAY_PNG_MAX_COLORS)
+                    return 0;
+                colors[count++] = color;
+            }
+
+        }
+
+        buffer += stride;
+
+    }
+
+    return 1;
 
 }
 
 /**
- * Returns whether the given rectangle would be optimally encoded as WebP
- * rather than PNG.
+ * Chooses the encoding and quality level that should be used to send the
+ * given rectangle of the given layer. Whether lossy encodings are considered
+ * at all is decided based on the contents of the rectangle, how frequently it
+ * is updated, and whether lossless quality is required. If lossy encodings
+ * are appropriate, the encoding and quality level are then chosen based on
+ * the measured costs of each encoding, such that the amount of data sent is
+ * minimized without encoding taking longer than the given time budget.
+ * Lossless updates of opaque layers are encoded for speed rather than size
+ * while connected clients have bandwidth to spare.
  *
  * @param layer
  *     The layer to be queried.
@@ -266,204 +727,1510 @@ static int LFR_guac_display_layer_should_use_jpeg(guac_display_layer* layer,
  *     The rate that the region covered by the given rectangle has historically
  *     been being updated within the given layer, in frames per second.
  *
- * @return
- *     Non-zero if the rectangle would be optimally encoded as WebP, zero
- *     otherwise.
+ * @param motion
+ *     Non-zero if the region covered by the given rectangle has been updated
+ *     at a high rate for long enough to be considered full-motion content
+ *     (see GUAC_DISPLAY_MOTION_MIN_FRAMES), zero otherwise.
+ *
+ * @param budget
+ *     The amount of time that encoding the given rectangle may take, in
+ *     nanoseconds.
+ *
+ * @param choice
+ *     The guac_display_encoder_choice to populate with the chosen encoding
+ *     and quality level.
  */
-static int LFR_guac_display_layer_should_use_webp(guac_display_layer* layer,
-        const guac_rect* rect, int framerate) {
+static void LFR_guac_display_layer_choose_encoding(guac_display_layer* layer,
+        const guac_rect* rect, int framerate, int motion, uint64_t budget,
+        guac_display_encoder_choice* choice) {
 
-    /* Do not use WebP if not supported */
-    if (!guac_client_supports_webp(layer->display->client))
-        return 0;
+    guac_display* display = layer->display;
+    guac_client* client = display->client;
+
+    int rect_width = rect->right - rect->left;
+    int rect_height = rect->bottom - rect->top;
+    int rect_size = rect_width * rect_height;
+
+    /* Spend as little time as possible compressing lossless updates if
+     * bandwidth is plentiful and not already saturated. PNG is supported by
+     * all clients, and so fast PNG requires no client support beyond that. */
+    int fast_png = layer->opaque
+        && atomic_load(&display->bandwidth) >= GUAC_DISPLAY_FAST_PNG_MIN_BANDWIDTH
+        && atomic_load(&display->backlog) == 0;
+
+    /* Use PNG unless a lossy format is reasonable */
+    choice->encoding = fast_png ? GUAC_DISPLAY_ENCODING_PNG_FAST : GUAC_DISPLAY_ENCODING_PNG;
+    choice->quality = 100;
 
-    /* WebP is preferred if:
+    /* Lossy formats are considered only if:
      * - frame rate is high enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_DISPLAY_JPEG_FRAMERATE
-        && LFR_guac_display_layer_png_optimality(layer, rect) < 0;
+     * - the image contains more than a handful of colors
+     * - PNG is not more optimal based on image contents (full-motion content
+     *   such as video is already known to favor lossy formats and need not
+     *   be analyzed each frame) */
+    if (framerate < GUAC_DISPLAY_JPEG_FRAMERATE
+            || LFR_guac_display_layer_is_low_color(layer, rect)
+            || (!motion && LFR_guac_display_layer_png_optimality(layer, rect) >= 0))
+        return;
+
+    int webp = guac_client_supports_webp(client);
+
+    /* Prefer lossless WebP if lossless quality is required (and WebP is
+     * supported), unless fast PNG is cheaper to encode and bandwidth is not
+     * a concern */
+    if (layer->last_frame.lossless) {
+        if (webp && !fast_png)
+            choice->encoding = GUAC_DISPLAY_ENCODING_WEBP_LOSSLESS;
+        return;
+    }
 
-}
+    unsigned int candidates = 0;
 
-void* guac_display_worker_thread(void* data) {
+    if (webp)
+        candidates |= 1 << GUAC_DISPLAY_ENCODING_WEBP;
 
-    int framerate;
-    int has_outstanding_frames = 0;
+    /* JPEG is considered only if the image size is large enough and the
+     * layer is opaque */
+    if (layer->opaque && rect_size > GUAC_DISPLAY_JPEG_MIN_BITMAP_SIZE)
+        candidates |= 1 << GUAC_DISPLAY_ENCODING_JPEG;
 
-    guac_display* display = (guac_display*) data;
-    guac_client* client = display->client;
-    guac_socket* socket = client->socket;
+    if (candidates)
+        guac_display_encoder_choose(&display->encoder_model, candidates,
+                guac_display_suggest_quality(display), rect_size, budget,
+                choice);
 
-    guac_display_plan_operation op;
-    while (guac_fifo_dequeue_and_lock(&display->ops, &op)) {
+}
+
+/**
+ * Records whether the given rectangle of the given layer was just sent to
+ * connected clients at reduced quality. Cells touched by a lossy update are
+ * marked with the current time, while cells entirely covered by a lossless
+ * update are cleared. The lossy_cells array of the layer is resized to match
+ * the layer if necessary. The ops FIFO and the last_frame.lock of the display
+ * must already be locked.
+ *
+ * @param layer
+ *     The layer that was updated.
+ *
+ * @param rect
+ *     The rectangle of the layer that was updated.
+ *
+ * @param lossy
+ *     Non-zero if the update was sent at reduced quality, zero if the update
+ *     was sent losslessly.
+ */
+static void LFR_guac_display_layer_track_lossy(guac_display_layer* layer,
+        const guac_rect* rect, int lossy) {
 
-        /* Notify any watchers of render_state that a frame is now in progress */
-        guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
-        guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
-        guac_flag_unlock(&display->render_state);
+    guac_display* display = layer->display;
 
-        /* NOTE: Any thread that locks the operation queue can know that there
-         * are no pending operations in progress if the queue is empty and
-         * there are no active workers */
-        display->active_workers++;
-        guac_fifo_unlock(&display->ops);
+    int width = layer->last_frame.width;
+    int height = layer->last_frame.height;
 
-        guac_rwlock_acquire_read_lock(&display->last_frame.lock);
-        guac_display_layer* display_layer = op.layer;
-        switch (op.type) {
-
-            case GUAC_DISPLAY_PLAN_OPERATION_IMG:
-
-                framerate = INT_MAX;
-                if (op.current_frame > op.last_frame)
-                    framerate = 1000 / (op.current_frame - op.last_frame);
-
-                guac_rect* dirty = &op.dest;
-
-                /* TODO: Determine whether to use PNG/WebP/JPEG purely
-                 * based on whether lossless encoding is required, the
-                 * expected time until another frame is received (time
-                 * since last frame), and estimated encoding times. The
-                 * time allowed per update should be divided up
-                 * proportionately based on the dirty_size of the update. */
-
-                /* TODO: Stream PNG/WebP/JPEG using progressive encoding such
-                 * that a frame that is currently being encoded can be
-                 * preempted by the next frame, with the connected client then
-                 * simply receiving a lower-quality intermediate frame. If
-                 * necessary, progressive encoding can be achieved by manually
-                 * dividing images into multiple reduced-resolution stages,
-                 * such that each image streamed is actually only one quarter
-                 * the size of the original image. Compositing via Guacamole
-                 * protocol instructions can reassemble those stages. */
-
-                cairo_surface_t* rect = LFR_guac_display_layer_cairo_rect(display_layer, dirty);
-                const guac_layer* layer = display_layer->layer;
-
-                /* Clear relevant rect of destination layer if necessary to
-                 * ensure fresh data is not drawn on top of old data for layers
-                 * with alpha transparency */
-                guac_display_layer_clear_non_opaque(display_layer, dirty);
-
-                /* Prefer WebP when reasonable */
-                if (LFR_guac_display_layer_should_use_webp(display_layer, dirty, framerate))
-                    guac_client_stream_webp(client, socket, GUAC_COMP_OVER, layer,
-                            dirty->left, dirty->top, rect,
-                            guac_display_suggest_quality(client),
-                            display_layer->last_frame.lossless ? 1 : 0);
-
-                /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (display_layer->opaque && LFR_guac_display_layer_should_use_jpeg(display_layer, dirty, framerate))
-                    guac_client_stream_jpeg(client, socket, GUAC_COMP_OVER, layer,
-                            dirty->left, dirty->top, rect,
-                            guac_display_suggest_quality(client));
-
-                /* Use PNG if no lossy formats are appropriate */
-                else
-                    guac_client_stream_png(client, socket, GUAC_COMP_OVER,
-                            layer, dirty->left, dirty->top, rect);
+    int cells_width = (width + GUAC_DISPLAY_CELL_SIZE - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    int cells_height = (height + GUAC_DISPLAY_CELL_SIZE - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
 
-                cairo_surface_destroy(rect);
-                break;
+    /* Nothing need be tracked for cells that have never been lossy */
+    if (!lossy && layer->lossy_cell_count == 0)
+        return;
 
-            case GUAC_DISPLAY_PLAN_OPERATION_COPY:
-            case GUAC_DISPLAY_PLAN_OPERATION_RECT:
-                guac_client_log(client, GUAC_LOG_DEBUG, "Operation type %i "
-                        "should NOT be present in the set of operations given "
-                        "to guac_display worker thread. All operations except "
-                        "IMG and NOP are handled during the initial, "
-                        "single-threaded flush step. This is likely a bug.",
-                        op.type);
-                break;
+    /* Resize tracking to match the layer, preserving any overlapping cells */
+    if (layer->lossy_cells == NULL || layer->lossy_cells_width != cells_width
+            || layer->lossy_cells_height != cells_height) {
 
-            case GUAC_DISPLAY_PLAN_OPERATION_NOP:
-                /* Do nothing */
-                break;
+        guac_timestamp* lossy_cells = guac_mem_zalloc(sizeof(guac_timestamp),
+                cells_width, cells_height);
 
+        int count = 0;
+        if (layer->lossy_cells != NULL) {
+            for (int y = 0; y < cells_height && y < layer->lossy_cells_height; y++) {
+                for (int x = 0; x < cells_width && x < layer->lossy_cells_width; x++) {
+                    guac_timestamp sent = layer->lossy_cells[y * layer->lossy_cells_width + x];
+                    lossy_cells[y * cells_width + x] = sent;
+                    if (sent)
+                        count++;
+                }
+            }
         }
 
-        guac_fifo_lock(&display->ops);
+        guac_mem_free(layer->lossy_cells);
+        layer->lossy_cells = lossy_cells;
+        layer->lossy_cells_width = cells_width;
+        layer->lossy_cells_height = cells_height;
+        layer->lossy_cell_count = count;
+
+    }
+
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, width, height);
 
-        /* If we're the only active worker and there are no further operations
-         * pending, we've reached the end of the frame, and this is the worker
-         * that will be sending that boundary to connected users */
-        if (!(display->ops.state.value & GUAC_FIFO_STATE_NONEMPTY) && display->active_workers == 1) {
-
-            /* Update the mouse cursor if it's been changed since the
-             * last frame */
-            guac_display_layer* cursor = display->cursor_buffer;
-            if (!guac_rect_is_empty(&cursor->last_frame.dirty)) {
-                guac_protocol_send_cursor(client->socket,
-                        display->last_frame.cursor_hotspot_x,
-                        display->last_frame.cursor_hotspot_y,
-                        cursor->layer, 0, 0,
-                        cursor->last_frame.width,
-                        cursor->last_frame.height);
+    guac_rect updated = *rect;
+    guac_rect_constrain(&updated, &bounds);
+    if (guac_rect_is_empty(&updated))
+        return;
+
+    guac_timestamp now = guac_timestamp_current();
+
+    int left = updated.left >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    int top = updated.top >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    int right = (updated.right + GUAC_DISPLAY_CELL_SIZE - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+    int bottom = (updated.bottom + GUAC_DISPLAY_CELL_SIZE - 1) >> GUAC_DISPLAY_CELL_SIZE_EXPONENT;
+
+    for (int y = top; y < bottom; y++) {
+        for (int x = left; x < right; x++) {
+
+            guac_timestamp* sent = &layer->lossy_cells[y * cells_width + x];
+
+            if (lossy) {
+                if (!*sent)
+                    layer->lossy_cell_count++;
+                *sent = now;
+                continue;
+            }
+
+            /* A lossless update replaces a lossy cell only if it covers the
+             * entirety of that cell */
+            guac_rect cell;
+            guac_rect_init(&cell, x << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    y << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    GUAC_DISPLAY_CELL_SIZE, GUAC_DISPLAY_CELL_SIZE);
+            guac_rect_constrain(&cell, &bounds);
+
+            if (*sent && updated.left <= cell.left && updated.top <= cell.top
+                    && updated.right >= cell.right && updated.bottom >= cell.bottom) {
+                layer->lossy_cell_count--;
+                *sent = 0;
             }
 
-            /* Allow connected clients to move forward with rendering */
-            guac_client_end_multiple_frames(client, display->last_frame.frames);
+        }
+    }
+
+    if (lossy)
+        atomic_store(&display->lossy_pending, 1);
+
+}
+
+/**
+ * Adds a lossless GUAC_DISPLAY_PLAN_OPERATION_REFINE operation to the
+ * operation FIFO for each horizontal run of cells of the given layer that was
+ * sent at reduced quality and has since remained unchanged for at least the
+ * given delay. Each operation added is counted as part of the current frame.
+ * The cells themselves are cleared only once the lossless update is actually
+ * sent. The ops FIFO and the last_frame.lock of the display must already be
+ * locked.
+ *
+ * @param layer
+ *     The layer whose unchanged lossy cells should be refined.
+ *
+ * @param now
+ *     The current time, as returned by guac_timestamp_current().
+ *
+ * @param delay
+ *     The number of milliseconds that a lossy cell must remain unchanged
+ *     before it is refined.
+ *
+ * @return
+ *     Non-zero if any operations were added to the operation FIFO, zero
+ *     otherwise.
+ */
+static int LFR_guac_display_layer_queue_lossless_refinements(
+        guac_display_layer* layer, guac_timestamp now, int delay) {
+
+    guac_display* display = layer->display;
+    int queued = 0;
 
-            /* While connected clients moves forward with rendering,
-             * commit any changed contents to client-side backing buffer */
-            guac_display_layer* current = display->last_frame.layers;
-            while (current != NULL) {
+    if (layer->lossy_cell_count == 0)
+        return 0;
 
-                /* Save a copy of the changed region if the layer has
-                 * been modified since the last frame */
-                guac_rect* dirty = &current->last_frame.dirty;
-                if (!guac_rect_is_empty(dirty)) {
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, layer->last_frame.width, layer->last_frame.height);
 
-                    int x = dirty->left;
-                    int y = dirty->top;
-                    int width = guac_rect_width(dirty);
-                    int height = guac_rect_height(dirty);
+    for (int y = 0; y < layer->lossy_cells_height; y++) {
 
-                    /* Ensure destination region is cleared out first if the alpha channel need be considered,
-                     * as GUAC_COMP_OVER is significantly faster than GUAC_COMP_SRC on the browser side */
-                    if (!current->opaque) {
-                        guac_protocol_send_rect(client->socket, current->last_frame_buffer, x, y, width, height);
-                        guac_protocol_send_cfill(client->socket, GUAC_COMP_RATOP, current->last_frame_buffer,
-                                0x00, 0x00, 0x00, 0x00);
-                    }
+        guac_timestamp* row = &layer->lossy_cells[y * layer->lossy_cells_width];
 
-                    guac_protocol_send_copy(client->socket,
-                            current->layer, x, y, width, height,
-                            GUAC_COMP_OVER, current->last_frame_buffer, x, y);
+        int x = 0;
+        while (x < layer->lossy_cells_width) {
 
-                }
+            /* Skip past any cells that are lossless or still changing */
+            if (!row[x] || now - row[x] < delay) {
+                x++;
+                continue;
+            }
 
-                current = current->last_frame.next;
+            /* Find the end of the current run of unchanged lossy cells */
+            int start = x;
+            while (x < layer->lossy_cells_width && row[x] && now - row[x] >= delay)
+                x++;
+
+            guac_display_plan_operation op = {
+                .type     = GUAC_DISPLAY_PLAN_OPERATION_REFINE,
+                .layer    = layer,
+                .lossless = 1
+            };
+
+            guac_rect_init(&op.dest, start << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    y << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    (x - start) << GUAC_DISPLAY_CELL_SIZE_EXPONENT,
+                    GUAC_DISPLAY_CELL_SIZE);
+            guac_rect_constrain(&op.dest, &bounds);
+
+            /* Cells no longer within the layer need no refinement */
+            if (guac_rect_is_empty(&op.dest)) {
+                for (int i = start; i < x; i++)
+                    row[i] = 0;
+                layer->lossy_cell_count -= x - start;
+                continue;
+            }
 
+            atomic_fetch_add(&display->frame_ops, 1);
+            if (guac_display_queue_operation(display, &op))
+                queued = 1;
+            else {
+                atomic_fetch_sub(&display->frame_ops, 1);
+                return queued;
             }
 
-            /* This is now absolutely everything for the current frame,
-             * and it's safe to flush any outstanding data */
-            guac_socket_flush(client->socket);
+        }
 
-            /* Notify any watchers of render_state that a frame is no longer in progress */
-            guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
-            guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
-            guac_flag_unlock(&display->render_state);
+    }
 
-            has_outstanding_frames = display->frame_deferred;
+    return queued;
 
-        }
+}
 
-        display->active_workers--;
-        guac_fifo_unlock(&display->ops);
+int LFR_guac_display_queue_refinements(guac_display* display) {
 
-        guac_rwlock_release_lock(&display->last_frame.lock);
+    int queued = 0;
 
-        /* Trigger additional flush if frames were completed while we were
-         * still processing the previous frame */
-        if (has_outstanding_frames) {
-            guac_display_end_multiple_frames(display, 0);
-            has_outstanding_frames = 0;
+    /* Unchanged lossy cells are refined only with bandwidth to spare */
+    int delay = atomic_load(&display->refinement_delay);
+    int refine_lossy = delay > 0 && atomic_load(&display->backlog) == 0;
+    int lossy_remaining = 0;
+    guac_timestamp now = guac_timestamp_current();
+
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+
+        guac_rect* refinement = &current->refinement;
+
+        /* Ignore any part of the region that no longer exists due to the
+         * layer having been resized */
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, current->last_frame.width, current->last_frame.height);
+        if (!guac_rect_is_empty(refinement))
+            guac_rect_constrain(refinement, &bounds);
+
+        /* Divide the region into bands that can be refined in parallel */
+        if (!guac_rect_is_empty(refinement)) {
+            for (int y = refinement->top; y < refinement->bottom; y += GUAC_DISPLAY_REFINEMENT_BAND_HEIGHT) {
+
+                guac_display_plan_operation op = {
+                    .type  = GUAC_DISPLAY_PLAN_OPERATION_REFINE,
+                    .layer = current
+                };
+
+                guac_rect_init(&op.dest, refinement->left, y,
+                        guac_rect_width(refinement), GUAC_DISPLAY_REFINEMENT_BAND_HEIGHT);
+                guac_rect_constrain(&op.dest, refinement);
+
+                atomic_fetch_add(&display->frame_ops, 1);
+                if (guac_display_queue_operation(display, &op))
+                    queued = 1;
+                else
+                    atomic_fetch_sub(&display->frame_ops, 1);
+
+            }
         }
 
+        *refinement = (guac_rect) { 0 };
+
+        /* Resend losslessly any lossy cells that have stopped changing */
+        if (refine_lossy && LFR_guac_display_layer_queue_lossless_refinements(current, now, delay))
+            queued = 1;
+
+        lossy_remaining += current->lossy_cell_count;
+        current = current->last_frame.next;
+
     }
 
-    return NULL;
+    /* Remaining lossy cells that cannot be refined yet will be checked again
+     * the next time the render thread wakes (the cells just queued remain
+     * counted until they are actually sent) */
+    if (refine_lossy && !lossy_remaining)
+        atomic_store(&display->lossy_pending, 0);
+
+    return queued;
+
+}
+
+void guac_display_plan_assist(guac_display* display) {
+
+    guac_display_plan_tasks* plan_tasks = &display->plan_tasks;
+
+    guac_flag_lock(&plan_tasks->state);
+    while (plan_tasks->next < plan_tasks->length) {
+
+        /* Claim next available task */
+        guac_display_plan_task_callback* callback = plan_tasks->callback;
+        void* task = plan_tasks->tasks + plan_tasks->task_size * plan_tasks->next;
+        plan_tasks->next++;
+
+        /* Perform the task without blocking other threads from claiming
+         * other tasks */
+        guac_flag_unlock(&plan_tasks->state);
+        callback(task);
+        guac_flag_lock(&plan_tasks->state);
+
+        /* Notify the thread that submitted the tasks if this was the last
+         * task that remained in progress */
+        plan_tasks->incomplete--;
+        if (plan_tasks->incomplete == 0)
+            guac_flag_set(&plan_tasks->state, GUAC_DISPLAY_PLAN_TASKS_COMPLETE);
+
+    }
+    guac_flag_unlock(&plan_tasks->state);
+
+}
+
+void guac_display_plan_run_tasks(guac_display* display,
+        guac_display_plan_task_callback* callback, void* tasks,
+        size_t task_size, size_t length) {
+
+    guac_display_plan_tasks* plan_tasks = &display->plan_tasks;
+
+    if (length == 0)
+        return;
+
+    guac_flag_clear_and_lock(&plan_tasks->state, GUAC_DISPLAY_PLAN_TASKS_COMPLETE);
+    plan_tasks->callback = callback;
+    plan_tasks->tasks = tasks;
+    plan_tasks->task_size = task_size;
+    plan_tasks->length = length;
+    plan_tasks->next = 0;
+    plan_tasks->incomplete = length;
+    guac_flag_unlock(&plan_tasks->state);
+
+    /* Enlist the help of as many worker threads as are useful, keeping one
+     * task for the current thread (NOTE: Any ASSIST operations that are not
+     * picked up until after all tasks are complete will simply be ignored by
+     * the worker that receives them) */
+    size_t assistants = length - 1;
+    size_t workers = atomic_load(&display->workers_target);
+    if (assistants > workers)
+        assistants = workers;
+
+    guac_display_plan_operation assist_op = {
+        .type = GUAC_DISPLAY_PLAN_OPERATION_ASSIST
+    };
+
+    for (size_t i = 0; i < assistants; i++) {
+        if (!guac_display_queue_operation(display, &assist_op))
+            break;
+    }
+
+    /* Perform tasks alongside the worker threads, waiting for any tasks that
+     * are still being performed by other threads after none remain to be
+     * claimed */
+    guac_display_plan_assist(display);
+    guac_flag_wait_and_lock(&plan_tasks->state, GUAC_DISPLAY_PLAN_TASKS_COMPLETE);
+
+    /* Clear out references to the now-complete tasks */
+    plan_tasks->tasks = NULL;
+    plan_tasks->length = 0;
+    plan_tasks->next = 0;
+    guac_flag_unlock(&plan_tasks->state);
+
+}
+
+/**
+ * Records the frame that has just been sent to connected clients, including
+ * the number of bytes of image data sent for that frame, such that available
+ * bandwidth can be estimated once that frame has been acknowledged. If too
+ * many frames are already awaiting acknowledgement, the frame is merged with
+ * the most recent of those frames. The ops FIFO of the display must already
+ * be locked.
+ *
+ * @param display
+ *     The display that has just sent a frame.
+ */
+static void guac_display_record_sent_frame(guac_display* display) {
+
+    guac_timestamp timestamp = display->client->last_sent_timestamp;
+    uint64_t bytes = atomic_exchange(&display->frame_bytes, 0);
+
+    if (display->sent_frames_length == GUAC_DISPLAY_SENT_FRAME_HISTORY) {
+        guac_display_sent_frame* newest = &display->sent_frames[
+            (display->sent_frames_start + display->sent_frames_length - 1)
+                % GUAC_DISPLAY_SENT_FRAME_HISTORY];
+        newest->timestamp = timestamp;
+        newest->bytes += bytes;
+        return;
+    }
+
+    display->sent_frames[(display->sent_frames_start + display->sent_frames_length)
+        % GUAC_DISPLAY_SENT_FRAME_HISTORY] = (guac_display_sent_frame) {
+        .timestamp = timestamp,
+        .bytes = bytes
+    };
+
+    display->sent_frames_length++;
+
+}
+
+/**
+ * Sends everything that must follow the operations of a frame to mark the end
+ * of that frame, including updates to the mouse cursor and the client-side
+ * copies of the previous frame and of cached cells. The ops FIFO and the
+ * last_frame.lock of the display must already be locked.
+ *
+ * @param display
+ *     The display whose frame has ended.
+ */
+static void LFR_guac_display_end_frame(guac_display* display) {
+
+    guac_client* client = display->client;
+
+    /* Update the mouse cursor if it's been changed since the
+     * last frame */
+    guac_display_layer* cursor = display->cursor_buffer;
+    if (!guac_rect_is_empty(&cursor->last_frame.dirty)) {
+        guac_protocol_send_cursor(client->socket,
+                display->last_frame.cursor_hotspot_x,
+                display->last_frame.cursor_hotspot_y,
+                cursor->layer, 0, 0,
+                cursor->last_frame.width,
+                cursor->last_frame.height);
+    }
+
+    /* Allow connected clients to move forward with rendering */
+    guac_client_end_multiple_frames(client, display->last_frame.frames);
+
+    /* Track how long connected clients waited for the frame after encoding
+     * began */
+    guac_timestamp latency = guac_timestamp_current() - display->frame_encoding_start;
+    guac_client_log(client, GUAC_LOG_TRACE, "Frame encoded in %ims.", (int) latency);
+
+    display->frames_encoded++;
+    guac_display_stats_record_frame();
+    display->frame_latency_total += latency;
+    if (latency > display->frame_latency_max)
+        display->frame_latency_max = latency;
+
+    /* While connected clients moves forward with rendering,
+     * commit any changed contents to client-side backing buffer */
+    guac_display_layer* current = display->last_frame.layers;
+    while (current != NULL) {
+
+        /* Save a copy of the changed region if the layer has
+         * been modified since the last frame */
+        guac_rect* dirty = &current->last_frame.dirty;
+        if (!guac_rect_is_empty(dirty)) {
+
+            int x = dirty->left;
+            int y = dirty->top;
+            int width = guac_rect_width(dirty);
+            int height = guac_rect_height(dirty);
+
+            /* Ensure destination region is cleared out first if the alpha channel need be considered,
+             * as GUAC_COMP_OVER is significantly faster than GUAC_COMP_SRC on the browser side */
+            if (!current->opaque) {
+                guac_protocol_send_rect(client->socket, current->last_frame_buffer, x, y, width, height);
+                guac_protocol_send_cfill(client->socket, GUAC_COMP_RATOP, current->last_frame_buffer,
+                        0x00, 0x00, 0x00, 0x00);
+            }
+
+            guac_protocol_send_copy(client->socket,
+                    current->layer, x, y, width, height,
+                    GUAC_COMP_OVER, current->last_frame_buffer, x, y);
+
+        }
+
+        current = current->last_frame.next;
+
+    }
+
+    /* Store any newly-cached cells within their client-side
+     * buffers now that those cells have been fully drawn */
+    guac_display_cache_commit(&display->cache);
+    guac_display_cursor_cache_commit(display);
+
+}
+
+/**
+ * Determines whether the given worker thread, having received no operations
+ * for GUAC_DISPLAY_WORKER_IDLE_TIMEOUT milliseconds, should terminate. A
+ * worker thread may terminate only if more than the minimum number of worker
+ * threads for the display remain running and the display is not being
+ * stopped. If the worker thread should terminate, it is marked as no longer
+ * running, and the target number of worker threads is reduced accordingly
+ * such that the thread is not restarted merely because the display is next
+ * updated.
+ *
+ * @param worker
+ *     The slot of the idle worker thread.
+ *
+ * @return
+ *     Non-zero if the worker thread should terminate, zero otherwise.
+ */
+static int guac_display_worker_idle(guac_display_worker* worker) {
+
+    guac_display* display = worker->display;
+    int terminate = 0;
+
+    pthread_mutex_lock(&display->workers_lock);
+
+    if (!display->workers_stopped
+            && display->workers_running > display->workers_min) {
+
+        worker->running = 0;
+        display->workers_running--;
+        terminate = 1;
+
+        if (atomic_load(&display->workers_target) > display->workers_running)
+            atomic_store(&display->workers_target, display->workers_running);
+
+    }
+
+    pthread_mutex_unlock(&display->workers_lock);
+
+    return terminate;
+
+}
+
+void guac_display_resume_workers(guac_display* display) {
+
+    /* Threads of a shared pool never terminate due to inactivity */
+    if (display->worker_pool != NULL)
+        return;
+
+    pthread_mutex_lock(&display->workers_lock);
+
+    /* Nothing to do if enough workers are running (as is the case at all
+     * times other than after a period of inactivity or a backlog of frames) */
+    int resumed = 0;
+    int target = atomic_load(&display->workers_target);
+    if (!display->workers_stopped && display->workers_running < target) {
+
+        for (int i = 0; i < display->worker_thread_count
+                && display->workers_running < target; i++) {
+
+            guac_display_worker* worker = &display->worker_threads[i];
+            if (worker->running)
+                continue;
+
+            /* The previous thread has already committed to terminating and
+             * requires no further locks, so this will not block for long */
+            if (worker->joinable) {
+                pthread_join(worker->thread, NULL);
+                worker->joinable = 0;
+            }
+
+            if (pthread_create(&worker->thread, NULL,
+                        guac_display_worker_thread, worker))
+                break;
+
+            worker->joinable = 1;
+            worker->running = 1;
+            display->workers_running++;
+            resumed++;
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&display->workers_lock);
+
+    if (resumed)
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Started %i "
+                "display worker thread(s). %i of at most %i worker thread(s) "
+                "are now running.", resumed, target, display->worker_thread_count);
+
+}
+
+void guac_display_worker_backlog(guac_display* display, int backlogged) {
+
+    /* Threads of a shared pool are never added or removed */
+    if (display->worker_pool != NULL)
+        return;
+
+    pthread_mutex_lock(&display->workers_lock);
+
+    int target = atomic_load(&display->workers_target);
+    int increased = 0;
+
+    /* Double the number of workers only if frames have consistently been
+     * backing up, not merely due to a single large update */
+    if (!backlogged)
+        display->workers_backlog = 0;
+
+    else if (++display->workers_backlog >= GUAC_DISPLAY_WORKER_BACKLOG_FRAMES) {
+
+        display->workers_backlog = 0;
+
+        if (target < display->workers_max) {
+            target *= 2;
+            if (target > display->workers_max)
+                target = display->workers_max;
+            atomic_store(&display->workers_target, target);
+            increased = 1;
+        }
+
+    }
+
+    pthread_mutex_unlock(&display->workers_lock);
+
+    if (increased)
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Frames are backing "
+                "up. Increasing number of display worker threads to %i.",
+                target);
+
+}
+
+/**
+ * The resources used by a single thread to perform the operations of
+ * guac_display worker threads. A thread performing the operations of several
+ * displays (see guac_display_worker_pool_thread()) uses the same context for
+ * all of them, binding the context to each display in turn.
+ */
+typedef struct guac_display_worker_context {
+
+    /**
+     * The display whose operations are currently being performed.
+     */
+    guac_display* display;
+
+    /**
+     * Socket that counts the number of bytes of image data sent to all users
+     * of the current display.
+     */
+    guac_socket* socket;
+
+    /**
+     * Socket that counts the number of bytes of image data sent only to the
+     * users in the fast encoding tier of the current display.
+     */
+    guac_socket* fast_socket;
+
+    /**
+     * Socket that counts the number of bytes of image data sent only to the
+     * users in the slow encoding tier of the current display.
+     */
+    guac_socket* slow_socket;
+
+    /**
+     * Socket that counts the number of bytes of image data sent to all users
+     * of the current display, but not to any recording receiving its own,
+     * lower-quality image data (see guac_recording_set_default_image_quality()).
+     * This is NULL until first needed.
+     */
+    guac_socket* live_socket;
+
+    /**
+     * The image encoders used for all updates.
+     */
+    guac_display_worker_encoders encoders;
+
+    /**
+     * The number of delta updates sent for the current display that have not
+     * yet been added to the statistics of that display.
+     */
+    uint64_t delta_update_count;
+
+    /**
+     * The total number of pixels covered by the delta updates counted by
+     * delta_update_count.
+     */
+    uint64_t delta_total_pixels;
+
+    /**
+     * The number of pixels of the delta updates counted by
+     * delta_update_count that were unchanged.
+     */
+    uint64_t delta_unchanged_pixels;
+
+} guac_display_worker_context;
+
+/**
+ * Initializes the given worker context, allocating its image encoders. The
+ * context is not yet bound to any display.
+ *
+ * @param context
+ *     The context to initialize.
+ */
+static void guac_display_worker_context_init(guac_display_worker_context* context) {
+
+    *context = (guac_display_worker_context) {
+        .encoders = {
+            .png = guac_png_encoder_alloc(),
+            .jpeg = guac_jpeg_encoder_alloc(),
+#ifdef ENABLE_WEBP
+            .webp = guac_webp_encoder_alloc(),
+#endif
+        }
+    };
+
+}
+
+/**
+ * Binds the given worker context to the given display, such that all image
+ * data is sent through sockets that count the number of bytes sent for each
+ * update to that display. Any statistics of the previously bound display must
+ * already have been committed with guac_display_worker_context_commit().
+ *
+ * @param context
+ *     The context to bind.
+ *
+ * @param display
+ *     The display whose operations will be performed with the context.
+ */
+static void guac_display_worker_context_bind(guac_display_worker_context* context,
+        guac_display* display) {
+
+    if (context->display == display)
+        return;
+
+    context->display = display;
+
+    if (context->socket == NULL) {
+        context->socket = guac_display_encoder_counting_socket(display->client->socket);
+        context->fast_socket = guac_display_encoder_counting_socket(display->fast_tier_socket);
+        context->slow_socket = guac_display_encoder_counting_socket(display->slow_tier_socket);
+    }
+    else {
+        guac_display_encoder_retarget_counting_socket(context->socket, display->client->socket);
+        guac_display_encoder_retarget_counting_socket(context->fast_socket, display->fast_tier_socket);
+        guac_display_encoder_retarget_counting_socket(context->slow_socket, display->slow_tier_socket);
+    }
+
+    /* Image data is sent separately to users and to the recording only for
+     * clients whose recordings receive lower-quality image data */
+    guac_socket* live_socket = display->client->__recording_live_socket;
+    if (live_socket != NULL) {
+        if (context->live_socket == NULL)
+            context->live_socket = guac_display_encoder_counting_socket(live_socket);
+        else
+            guac_display_encoder_retarget_counting_socket(context->live_socket, live_socket);
+    }
+
+}
+
+/**
+ * Adds the delta update statistics accumulated by the given worker context to
+ * the overall statistics of the display it is bound to, resetting those
+ * statistics within the context.
+ *
+ * @param context
+ *     The context whose statistics should be committed.
+ */
+static void guac_display_worker_context_commit(guac_display_worker_context* context) {
+
+    guac_display* display = context->display;
+    if (display == NULL || context->delta_update_count == 0)
+        return;
+
+    guac_fifo_lock(&display->ops);
+    display->delta_update_count += context->delta_update_count;
+    display->delta_total_pixels += context->delta_total_pixels;
+    display->delta_unchanged_pixels += context->delta_unchanged_pixels;
+    guac_fifo_unlock(&display->ops);
+
+    context->delta_update_count = 0;
+    context->delta_total_pixels = 0;
+    context->delta_unchanged_pixels = 0;
+
+}
+
+/**
+ * Frees all resources associated with the given worker context, committing
+ * any statistics that have not yet been committed.
+ *
+ * @param context
+ *     The context to destroy.
+ */
+static void guac_display_worker_context_destroy(guac_display_worker_context* context) {
+
+    guac_display_worker_context_commit(context);
+
+    guac_png_encoder_free(context->encoders.png);
+    guac_jpeg_encoder_free(context->encoders.jpeg);
+#ifdef ENABLE_WEBP
+    guac_webp_encoder_free(context->encoders.webp);
+#endif
+    guac_mem_free(context->encoders.delta);
+
+    if (context->socket != NULL) {
+        guac_socket_free(context->socket);
+        guac_socket_free(context->fast_socket);
+        guac_socket_free(context->slow_socket);
+    }
+
+    if (context->live_socket != NULL)
+        guac_socket_free(context->live_socket);
+
+}
+
+/**
+ * Performs the given operation, which has just been removed from the ops FIFO
+ * of the display that the given worker context is bound to. The ops FIFO of
+ * that display MUST be locked when this function is called, and is unlocked
+ * by this function.
+ *
+ * @param context
+ *     The worker context to use to perform the operation.
+ *
+ * @param op
+ *     The operation to perform.
+ */
+static void guac_display_worker_perform(guac_display_worker_context* context,
+        guac_display_plan_operation* op) {
+
+    int framerate;
+    int has_outstanding_frames = 0;
+
+    guac_display* display = context->display;
+    guac_client* client = display->client;
+
+    guac_socket* socket = context->socket;
+    guac_socket* fast_socket = context->fast_socket;
+    guac_socket* slow_socket = context->slow_socket;
+    guac_socket* live_socket = context->live_socket;
+    guac_display_worker_encoders* encoders = &context->encoders;
+
+    guac_display_stats_record_pending(0, 1);
+
+    /* Requests for assistance with constructing the display plan are not
+     * part of any frame and must be handled before acquiring the
+     * last_frame.lock (the thread constructing the plan holds the write
+     * lock for the duration) */
+    if (op->type == GUAC_DISPLAY_PLAN_OPERATION_ASSIST) {
+
+        guac_fifo_unlock(&display->ops);
+        guac_display_plan_assist(display);
+        return;
+
+    }
+
+    /* Divide the time available for encoding the current frame
+     * proportionately between its updates, considering that updates are
+     * encoded in parallel by all running worker threads. Refinement of a previous
+     * frame is not subject to any time budget, as it is preempted by any
+     * newer frame. */
+    uint64_t budget = display->frame_encoding_budget;
+    if (op->type == GUAC_DISPLAY_PLAN_OPERATION_REFINE)
+        budget = UINT64_MAX;
+    else if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG && display->frame_encoding_pixels) {
+        uint64_t pixels = (uint64_t) guac_rect_width(&op->dest) * guac_rect_height(&op->dest);
+        budget = (double) budget * atomic_load(&display->workers_target) * pixels
+            / display->frame_encoding_pixels;
+    }
+
+    /* If a newer frame is already waiting, any content encoded now will
+     * likely be visible only briefly */
+    int preempted = atomic_load(&display->frame_deferred);
+
+    /* Whether lossy image data must be sent separately to lagging users
+     * (refinements are nevertheless always sent to all users, as users
+     * may change tiers between frames) */
+    int tiers_split = display->tiers_split;
+
+    /* Any region of the current layer that will need to be refined after
+     * this operation */
+    guac_rect refine_later = { 0 };
+
+    /* Any region of the current layer whose image data has been replaced by
+     * this operation, and whether that data was sent at reduced quality */
+    guac_rect sent = { 0 };
+    int sent_lossy = 0;
+
+    guac_display_trace_dequeued(display);
+    guac_fifo_unlock(&display->ops);
+
+    GUAC_PROBE4(op_start, display, op->type, guac_rect_width(&op->dest),
+            guac_rect_height(&op->dest));
+
+    guac_rwlock_acquire_read_lock(&display->last_frame.lock);
+    guac_display_layer* display_layer = op->layer;
+    switch (op->type) {
+
+        case GUAC_DISPLAY_PLAN_OPERATION_IMG:
+        case GUAC_DISPLAY_PLAN_OPERATION_REFINE:
+
+            framerate = INT_MAX;
+            if (op->current_frame > op->last_frame)
+                framerate = 1000 / (op->current_frame - op->last_frame);
+
+            /* Content that has stopped changing is refined losslessly
+             * (a zero framerate rules out lossy formats) */
+            if (op->type == GUAC_DISPLAY_PLAN_OPERATION_REFINE && op->lossless)
+                framerate = 0;
+
+            guac_rect* dirty = &op->dest;
+
+            /* Whether the recording of the client receives its own,
+             * lower-quality image data rather than the data sent to users
+             * (see guac_recording_set_default_image_quality()) */
+            int recording_split = client->__recording_output != NULL
+                && display_layer->opaque;
+
+            /* Refining a region is wasted effort if a newer frame may
+             * well replace that region anyway. Try again after that frame
+             * instead. */
+            if (op->type == GUAC_DISPLAY_PLAN_OPERATION_REFINE && preempted) {
+
+                /* Lossless refinements need not be tracked, as the cells
+                 * concerned remain marked as lossy until actually sent */
+                if (!op->lossless)
+                    refine_later = *dirty;
+
+                break;
+
+            }
+
+            /* Send image data already encoded by the caller as-is (hints
+             * apply only to opaque layers that allow lossy updates). Users
+             * within the fast tier still receive lossless updates. */
+            if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG && op->image != NULL) {
+
+                if (tiers_split) {
+
+                    guac_display_encoder_choice lossless = {
+                        .encoding = GUAC_DISPLAY_ENCODING_PNG,
+                        .quality = 100
+                    };
+
+                    LFR_guac_display_layer_stream_measured(display_layer,
+                            encoders, fast_socket, dirty, &lossless);
+                    LFR_guac_display_layer_stream_hinted(display_layer,
+                            slow_socket, op->image);
+
+                }
+
+                else
+                    LFR_guac_display_layer_stream_hinted(display_layer,
+                            socket, op->image);
+
+                break;
+
+            }
+
+            const guac_layer* layer = display_layer->layer;
+
+            /* Clear relevant rect of destination layer if necessary to
+             * ensure fresh data is not drawn on top of old data for layers
+             * with alpha transparency */
+            guac_display_layer_clear_non_opaque(display_layer, dirty);
+
+            int motion = op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG
+                && op->motion_frames >= GUAC_DISPLAY_MOTION_MIN_FRAMES;
+
+            guac_display_encoder_choice choice;
+            LFR_guac_display_layer_choose_encoding(display_layer, dirty,
+                    framerate, motion, budget, &choice);
+
+            /* If a newer frame is already waiting, send large lossy
+             * updates as a quick, low-quality first stage that is refined
+             * only if the newer frame does not replace it. (NOTE: This is
+             * done by reducing quality rather than resolution, as the
+             * Guacamole protocol cannot scale image data while copying or
+             * transferring it.) */
+            if (op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG && preempted
+                    && display_layer->opaque
+                    && guac_rect_width(dirty) * guac_rect_height(dirty) >= GUAC_DISPLAY_PROGRESSIVE_MIN_SIZE
+                    && (choice.encoding == GUAC_DISPLAY_ENCODING_JPEG || choice.encoding == GUAC_DISPLAY_ENCODING_WEBP)
+                    && choice.quality > GUAC_DISPLAY_ENCODER_MIN_QUALITY) {
+                choice.quality = GUAC_DISPLAY_ENCODER_MIN_QUALITY;
+                refine_later = *dirty;
+            }
+
+            uint64_t pixels = (uint64_t) guac_rect_width(dirty) * guac_rect_height(dirty);
+
+            /* Send only what has changed since the previous frame if
+             * possible (delta updates are not representative of the
+             * usual cost of PNG and are thus not recorded in the cost
+             * model) */
+            uint64_t unchanged = 0;
+            if (op->previous != NULL && (choice.encoding == GUAC_DISPLAY_ENCODING_PNG
+                        || choice.encoding == GUAC_DISPLAY_ENCODING_PNG_FAST)) {
+
+                encoders->png->fast = choice.encoding == GUAC_DISPLAY_ENCODING_PNG_FAST;
+
+                uint64_t encode_start = guac_display_encoder_clock();
+                guac_display_encoder_take_count(socket);
+
+                unchanged = LFR_guac_display_layer_stream_delta(display_layer,
+                        encoders, socket, dirty, op->previous);
+
+                uint64_t bytes = guac_display_encoder_take_count(socket);
+                atomic_fetch_add(&display->frame_bytes, bytes);
+
+                if (unchanged) {
+                    uint64_t encode_duration = guac_display_encoder_clock() - encode_start;
+                    guac_display_trace_op(display, GUAC_DISPLAY_TRACE_FORMAT_DELTA,
+                            pixels, bytes, encode_duration);
+                    guac_display_stats_record_encode(encode_duration);
+                }
+
+            }
+
+            if (unchanged) {
+                context->delta_update_count++;
+                context->delta_total_pixels += pixels;
+                context->delta_unchanged_pixels += unchanged;
+            }
+
+            /* If users are split across encoding tiers, only the lagging
+             * users receive lossy updates, while all other users receive
+             * the same update losslessly */
+            else if (tiers_split && op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG
+                    && (choice.encoding == GUAC_DISPLAY_ENCODING_JPEG
+                        || choice.encoding == GUAC_DISPLAY_ENCODING_WEBP)) {
+
+                guac_display_encoder_choice lossless = {
+                    .encoding = GUAC_DISPLAY_ENCODING_PNG,
+                    .quality = 100
+                };
+
+                LFR_guac_display_layer_stream_measured(display_layer,
+                        encoders, fast_socket, dirty, &lossless);
+                LFR_guac_display_layer_stream_measured(display_layer,
+                        encoders, slow_socket, dirty, &choice);
+
+                sent = *dirty;
+                sent_lossy = 1;
+
+            }
+
+            else {
+
+                /* Recordings that receive their own image data never
+                 * receive refinements */
+                LFR_guac_display_layer_stream_measured(display_layer,
+                        encoders, recording_split ? live_socket : socket,
+                        dirty, &choice);
+
+                sent = *dirty;
+                sent_lossy = choice.encoding == GUAC_DISPLAY_ENCODING_JPEG
+                    || choice.encoding == GUAC_DISPLAY_ENCODING_WEBP;
+
+            }
+
+            /* Delta updates are sent to users and recording alike, while
+             * all other image data sent only to users must be separately
+             * encoded for the recording */
+            if (recording_split && !unchanged
+                    && op->type == GUAC_DISPLAY_PLAN_OPERATION_IMG)
+                LFR_guac_display_layer_stream_recording(display_layer,
+                        encoders, dirty, motion);
+
+            /* The copy of the previous frame retained client-side for
+             * reference must match the refined content, not the
+             * reduced-quality content it replaces (only opaque layers are
+             * ever refined, so there is no need to clear first) */
+            if (op->type == GUAC_DISPLAY_PLAN_OPERATION_REFINE)
+                guac_protocol_send_copy(client->socket, layer,
+                        dirty->left, dirty->top, guac_rect_width(dirty), guac_rect_height(dirty),
+                        GUAC_COMP_OVER, display_layer->last_frame_buffer, dirty->left, dirty->top);
+
+            break;
+
+        case GUAC_DISPLAY_PLAN_OPERATION_COPY:
+        case GUAC_DISPLAY_PLAN_OPERATION_RECT:
+            guac_client_log(client, GUAC_LOG_DEBUG, "Operation type %i "
+                    "should NOT be present in the set of operations given "
+                    "to guac_display worker thread. All operations except "
+                    "IMG and NOP are handled during the initial, "
+                    "single-threaded flush step. This is likely a bug.",
+                    op->type);
+            break;
+
+        case GUAC_DISPLAY_PLAN_OPERATION_NOP:
+            /* Do nothing */
+            break;
+
+        /* Handled prior to entering this switch */
+        case GUAC_DISPLAY_PLAN_OPERATION_ASSIST:
+            break;
+
+    }
+
+    /* Track any region that was sent at reduced quality (or was not
+     * refined after all) */
+    if (!guac_rect_is_empty(&refine_later) || !guac_rect_is_empty(&sent)) {
+
+        guac_fifo_lock(&display->ops);
+
+        if (!guac_rect_is_empty(&refine_later))
+            guac_rect_extend(&display_layer->refinement, &refine_later);
+
+        /* Track regions sent at reduced quality such that they can be
+         * refined losslessly once they stop changing */
+        if (!guac_rect_is_empty(&sent))
+            LFR_guac_display_layer_track_lossy(display_layer, &sent, sent_lossy);
+
+        guac_fifo_unlock(&display->ops);
+
+    }
+
+    /* If only the reference held by the frame itself remains, all other
+     * operations of the frame have been completed, and this is the worker
+     * that will be sending that boundary to connected users */
+    if (atomic_fetch_sub(&display->frame_ops, 1) == 2) {
+
+        guac_fifo_lock(&display->ops);
+
+        uint64_t end_start = guac_display_encoder_clock();
+        uint64_t frame_bytes = atomic_load(&display->frame_bytes);
+        int refined = display->frame_refining;
+
+        /* The end of refinement of a previous frame need only be marked
+         * with its own "sync", as nothing else has changed */
+        if (refined)
+            guac_client_end_multiple_frames(client, 0);
+        else
+            LFR_guac_display_end_frame(display);
+
+        guac_display_record_sent_frame(display);
+
+        /* Refine anything sent at reduced quality, unless there is
+         * already a newer frame to deal with first */
+        display->frame_refining = !atomic_load(&display->frame_deferred)
+            && LFR_guac_display_queue_refinements(display);
+
+        /* This is now absolutely everything for the current frame,
+         * and it's safe to flush any outstanding data */
+        guac_socket_flush(client->socket);
+
+        /* Refinements are traced only as individual image updates, having
+         * no planning phases of their own */
+        if (!refined) {
+            guac_display_trace_end_frame(display, end_start, frame_bytes);
+            GUAC_PROBE3(frame_end, display, display->last_frame.timestamp,
+                    frame_bytes);
+        }
+
+        int frame_complete = !display->frame_refining;
+        guac_fifo_unlock(&display->ops);
+
+        /* Refinement of the frame is considered part of that frame, and
+         * the frame is otherwise now complete */
+        if (frame_complete) {
+
+            /* Periodically write the full state of the display as a
+             * keyframe of any recording index. This is done before the
+             * frame is marked complete, while the last_frame.lock still
+             * prevents the next frame from being sent, and with
+             * render_state locked to serialize this with any
+             * guac_display_dup() */
+            if (client->__recording_index != NULL) {
+                guac_socket* index = guac_socket_recording_begin_keyframe(
+                        client->__recording_index, client->last_sent_timestamp);
+                if (index != NULL) {
+                    guac_flag_lock(&display->render_state);
+                    LFR_guac_display_dup_state(display, index, 0);
+                    guac_flag_unlock(&display->render_state);
+                    guac_socket_flush(index);
+                }
+            }
+
+            /* Likewise begin each new segment of any segmented recording
+             * with the full state of the display, such that each segment
+             * can be played back independently */
+            guac_socket* segments = client->__recording_segments;
+            if (segments != NULL && guac_socket_recording_begin_segment(
+                        segments, client->last_sent_timestamp)) {
+                guac_flag_lock(&display->render_state);
+                LFR_guac_display_dup_state(display, segments, 0);
+                guac_flag_unlock(&display->render_state);
+                guac_socket_flush(segments);
+            }
+
+            /* Release the reference held by the frame, checking for
+             * deferred frames only after doing so (see
+             * guac_display_end_multiple_frames()) */
+            atomic_fetch_sub(&display->frame_ops, 1);
+            has_outstanding_frames = atomic_load(&display->frame_deferred);
+
+            /* Notify any watchers of render_state that a frame is no
+             * longer in progress, unless a frame was deferred while this
+             * one was being sent. That frame is rendered as soon as the
+             * last_frame.lock is released below, and remains in progress
+             * until it, too, is complete. A frame ended by anything that
+             * waited for this notification thus finds frame_ops released,
+             * and is not deferred. */
+            if (!has_outstanding_frames) {
+                guac_flag_set_and_lock(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+                guac_flag_clear(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_IN_PROGRESS);
+                guac_flag_unlock(&display->render_state);
+            }
+
+            /* Add worker threads if frames keep arriving faster than they
+             * can be encoded */
+            guac_display_worker_backlog(display, has_outstanding_frames);
+
+        }
+
+    }
+
+    guac_rwlock_release_lock(&display->last_frame.lock);
+
+    GUAC_PROBE2(op_end, display, op->type);
+
+    /* Trigger additional flush if frames were completed while we were
+     * still processing the previous frame */
+    if (has_outstanding_frames)
+        guac_display_end_multiple_frames(display, 0);
+
+}
+
+void* guac_display_worker_thread(void* data) {
+
+    guac_display_worker* worker = (guac_display_worker*) data;
+    guac_display* display = worker->display;
+
+    guac_display_worker_context context;
+    guac_display_worker_context_init(&context);
+    guac_display_worker_context_bind(&context, display);
+
+    guac_display_plan_operation op;
+    for (;;) {
+
+        /* Terminate if the FIFO is invalidated, or if this thread has been
+         * idle for long enough that its resources should be released */
+        if (!guac_fifo_timed_dequeue_and_lock(&display->ops, &op,
+                    atomic_load(&display->workers_idle_timeout))) {
+
+            if (!guac_fifo_is_valid(&display->ops)
+                    || guac_display_worker_idle(worker))
+                break;
+
+            continue;
+
+        }
+
+        guac_display_worker_perform(&context, &op);
+
+    }
+
+    /* Statistics describing the delta updates sent by this worker thread are
+     * added to the overall statistics of the display as this thread
+     * terminates */
+    guac_display_worker_context_destroy(&context);
+    return NULL;
+
+}
+
+/**
+ * The pool of worker threads shared by all guac_display instances of the
+ * current process that do not have worker threads of their own, or NULL if
+ * no such pool has yet been needed.
+ */
+static guac_display_worker_pool* guac_display_shared_worker_pool = NULL;
+
+/**
+ * Lock which must be held while creating or retrieving
+ * guac_display_shared_worker_pool.
+ */
+static pthread_mutex_t guac_display_shared_worker_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Adds the given display to the end of the ready queue of its worker pool, if
+ * not already present. The lock of the worker pool must be held.
+ *
+ * @param display
+ *     The display to add to the ready queue.
+ */
+static void guac_display_worker_pool_enqueue(guac_display* display) {
+
+    guac_display_worker_pool* pool = display->worker_pool;
+
+    if (display->worker_pool_queued || display->worker_pool_removed)
+        return;
+
+    display->worker_pool_next = NULL;
+    if (pool->last != NULL)
+        pool->last->worker_pool_next = display;
+    else
+        pool->first = display;
+
+    pool->last = display;
+    display->worker_pool_queued = 1;
+
+    pthread_cond_signal(&pool->ready);
+
+}
+
+/**
+ * Thread of a shared worker pool that performs the operations of all
+ * displays using that pool. Displays are served in the order that they
+ * became ready, one operation at a time, with each display returning to the
+ * end of the ready queue after each of its operations, such that a display
+ * with many outstanding operations cannot starve other displays.
+ *
+ * @param data
+ *     A pointer to the guac_display_worker_pool.
+ *
+ * @return
+ *     Always NULL. This thread does not terminate.
+ */
+static void* guac_display_worker_pool_thread(void* data) {
+
+    guac_display_worker_pool* pool = (guac_display_worker_pool*) data;
+
+    guac_display_worker_context context;
+    guac_display_worker_context_init(&context);
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;) {
+
+        /* Wait for any display to have operations ready */
+        guac_display* display = pool->first;
+        if (display == NULL) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+            continue;
+        }
+
+        pool->first = display->worker_pool_next;
+        if (pool->first == NULL)
+            pool->last = NULL;
+
+        display->worker_pool_queued = 0;
+        display->worker_pool_active++;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        /* The ready queue may be behind the state of the FIFO, as other
+         * threads of the pool may have already performed any operations */
+        guac_display_plan_operation op;
+        int performed = guac_fifo_timed_dequeue_and_lock(&display->ops, &op, 0);
+        if (performed) {
+
+            guac_display_worker_context_bind(&context, display);
+            guac_display_worker_perform(&context, &op);
+            guac_display_worker_context_commit(&context);
+
+            /* Never retain a reference to a display beyond its operations,
+             * as the display may be freed (and another allocated at the
+             * same address) once those operations are complete */
+            context.display = NULL;
+
+        }
+
+        pthread_mutex_lock(&pool->lock);
+
+        /* Further operations of the display, if any, wait behind the
+         * operations of all other ready displays */
+        if (performed)
+            guac_display_worker_pool_enqueue(display);
+
+        /* A display being removed may be freed as soon as it is no longer in
+         * use by any thread of the pool */
+        if (--display->worker_pool_active == 0 && display->worker_pool_removed)
+            pthread_cond_broadcast(&pool->released);
+
+    }
+
+    return NULL;
+
+}
+
+guac_display_worker_pool* guac_display_worker_pool_get(int thread_count) {
+
+    pthread_mutex_lock(&guac_display_shared_worker_pool_lock);
+
+    guac_display_worker_pool* pool = guac_display_shared_worker_pool;
+    if (pool == NULL) {
+
+        pool = guac_mem_zalloc(sizeof(guac_display_worker_pool));
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->ready, NULL);
+        pthread_cond_init(&pool->released, NULL);
+
+        /* The threads of the pool persist for the life of the process and
+         * are never joined */
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+        for (int i = 0; i < thread_count; i++) {
+            pthread_t thread;
+            if (pthread_create(&thread, &attr, guac_display_worker_pool_thread, pool) == 0)
+                pool->thread_count++;
+        }
+
+        pthread_attr_destroy(&attr);
+
+        /* A pool without threads is useless, but is retained such that
+         * creation is not retried for every display */
+        guac_display_shared_worker_pool = pool;
+
+    }
+
+    pthread_mutex_unlock(&guac_display_shared_worker_pool_lock);
+
+    return pool->thread_count > 0 ? pool : NULL;
+
+}
+
+void guac_display_worker_pool_remove(guac_display* display) {
+
+    guac_display_worker_pool* pool = display->worker_pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* Remove display from the ready queue */
+    if (display->worker_pool_queued) {
+
+        guac_display* previous = NULL;
+        guac_display* current = pool->first;
+        while (current != display) {
+            previous = current;
+            current = current->worker_pool_next;
+        }
+
+        if (previous != NULL)
+            previous->worker_pool_next = display->worker_pool_next;
+        else
+            pool->first = display->worker_pool_next;
+
+        if (pool->last == display)
+            pool->last = previous;
+
+        display->worker_pool_queued = 0;
+
+    }
+
+    /* Wait for any operations of the display that are still being performed
+     * by threads of the pool */
+    display->worker_pool_removed = 1;
+    while (display->worker_pool_active > 0)
+        pthread_cond_wait(&pool->released, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+}
+
+int guac_display_queue_operation(guac_display* display,
+        const guac_display_plan_operation* op) {
+
+    /* Count the operation before it becomes visible to worker threads, such
+     * that the count cannot be decremented first */
+    guac_display_stats_record_pending(1, 0);
+    if (!guac_fifo_enqueue(&display->ops, op)) {
+        guac_display_stats_record_pending(0, 1);
+        return 0;
+    }
+
+    /* Displays without worker threads of their own must notify the shared
+     * pool that operations are ready */
+    guac_display_worker_pool* pool = display->worker_pool;
+    if (pool != NULL) {
+        pthread_mutex_lock(&pool->lock);
+        guac_display_worker_pool_enqueue(display);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return 1;
 
 }
@@ -18,8 +18,10 @@
  */
 
 #include "config.h"
+#include "display-memcmp.h"
 #include "display-plan.h"
 #include "display-priv.h"
+#include "encode-png.h"
 #include "guacamole/client.h"
 #include "guacamole/display.h"
 #include "guacamole/fifo.h"
@@ -37,6 +39,7 @@
 #endif
 
 #include <cairo/cairo.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <sched.h>
 #include <unistd.h>
@@ -46,6 +49,21 @@
  */
 #define GUAC_DISPLAY_CPU_THREAD_FACTOR 1
 
+/**
+ * The number of worker threads that each newly-allocated guac_display should
+ * use, as set by guac_display_set_default_worker_threads(), or zero if the
+ * number of worker threads should be derived from the number of available
+ * processors.
+ */
+static int guac_display_default_worker_threads = 0;
+
+/**
+ * Whether each newly-allocated guac_display should use the worker threads
+ * shared by all displays of the current process, as set by
+ * guac_display_set_shared_workers(), rather than worker threads of its own.
+ */
+static int guac_display_shared_workers = 0;
+
 /**
  * Returns the number of processors available to this process. If possible,
  * limits on otherwise available processors like CPU affinity will be taken
@@ -56,7 +74,7 @@
  *     The number of available processors, or zero if this value cannot be
  *     determined for any reason.
  */
-static unsigned long guac_display_nproc() {
+static unsigned long guac_display_host_nproc() {
 
 #if defined(HAVE_SCHED_GETAFFINITY)
 
@@ -111,6 +129,38 @@ static unsigned long guac_display_nproc() {
 
 }
 
+/**
+ * Returns the number of processors that this process may make full use of,
+ * taking into account both the processors available to this process and any
+ * cgroup CPU quota limiting the CPU time of those processors, whichever is
+ * smaller. If the number of available processors cannot be determined, zero
+ * is returned.
+ *
+ * @return
+ *     The number of processors that this process may make full use of, or
+ *     zero if this value cannot be determined for any reason.
+ */
+static unsigned long guac_display_nproc() {
+
+    unsigned long cpu_count = guac_display_host_nproc();
+    unsigned long quota_count = guac_display_cgroup_nproc(
+            GUAC_DISPLAY_CGROUP_MEMBERSHIP, GUAC_DISPLAY_CGROUP_ROOT);
+
+    if (quota_count > 0 && (cpu_count == 0 || quota_count < cpu_count))
+        return quota_count;
+
+    return cpu_count;
+
+}
+
+void guac_display_set_default_worker_threads(int count) {
+    guac_display_default_worker_threads = count > 0 ? count : 0;
+}
+
+void guac_display_set_shared_workers(int shared) {
+    guac_display_shared_workers = shared;
+}
+
 guac_display* guac_display_alloc(guac_client* client) {
 
     /* Allocate and init core properties (really just the client pointer) */
@@ -122,41 +172,140 @@ guac_display* guac_display_alloc(guac_client* client) {
     guac_rwlock_init(&display->pending_frame.lock);
     display->last_frame.timestamp = display->pending_frame.timestamp = guac_timestamp_current();
 
+    /* Select the fastest available means of comparing frames */
+    const char* memcmp_name;
+    display->memcmp_impl = guac_display_memcmp_select(&memcmp_name);
+    guac_client_log(client, GUAC_LOG_DEBUG, "Using %s implementation for "
+            "frame comparison.", memcmp_name);
+
+    /* Init cache of recently-sent cells */
+    guac_display_cache_init(&display->cache, client, GUAC_DISPLAY_CACHE_DEFAULT_SIZE);
+
+    /* Init model of encoding costs used by worker threads to choose between
+     * image encodings */
+    guac_display_encoder_init(&display->encoder_model);
+
+    /* Init optional instrumentation of frame timing (disabled by default) */
+    guac_display_trace_init(&display->trace);
+
+    /* Init arena holding the temporary memory used to plan each frame */
+    guac_display_arena_init(&display->plan_arena);
+
     /* It's safe to discard const of the default layer here, as
      * guac_display_free_layer() function is specifically written to consider
      * the default layer as const */
     display->default_layer = guac_display_add_layer(display, (guac_layer*) GUAC_DEFAULT_LAYER, 1);
     display->cursor_buffer = guac_display_alloc_buffer(display, 0);
 
+    /* Init sockets used to send image data separately to each encoding tier
+     * (all users are initially part of the fast tier) */
+    display->fast_tier_socket = guac_display_tier_socket(display, 0);
+    display->slow_tier_socket = guac_display_tier_socket(display, 1);
+
+    /* Resend regions sent at reduced quality losslessly once they stop
+     * changing */
+    atomic_store(&display->refinement_delay, GUAC_DISPLAY_DEFAULT_REFINEMENT_DELAY);
+
     /* Init operation FIFO used by worker threads */
     guac_fifo_init(&display->ops, display->ops_items,
             GUAC_DISPLAY_WORKER_FIFO_SIZE, sizeof(guac_display_plan_operation));
 
+    /* There is initially no frame in progress */
+    atomic_init(&display->frame_ops, 0);
+    atomic_init(&display->frame_deferred, 0);
+    atomic_init(&display->frame_bytes, 0);
+    atomic_init(&display->backlog, 0);
+    atomic_init(&display->bandwidth, 0);
+
     /* Init flag used to notify threads that need to monitor whether a frame is
      * currently being rendered */
     guac_flag_init(&display->render_state);
     guac_flag_set(&display->render_state, GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
 
-    int cpu_count = guac_display_nproc();
-    if (cpu_count <= 0) {
-        guac_client_log(client, GUAC_LOG_WARNING, "Number of available "
-                "processors could not be determined. Assuming single-processor.");
-        cpu_count = 1;
+    /* Init tracking of tasks performed in parallel during plan construction
+     * (there are initially no tasks, and thus all tasks are complete) */
+    guac_flag_init(&display->plan_tasks.state);
+    guac_flag_set(&display->plan_tasks.state, GUAC_DISPLAY_PLAN_TASKS_COMPLETE);
+
+    /* Use the explicitly-requested number of worker threads, if any,
+     * otherwise deriving the number of worker threads from the number of
+     * available processors */
+    if (guac_display_default_worker_threads > 0) {
+        display->worker_thread_count = guac_display_default_worker_threads;
     }
     else {
-        guac_client_log(client, GUAC_LOG_INFO, "Local system reports %i "
-                "processor(s) are available.", cpu_count);
+
+        int cpu_count = guac_display_nproc();
+        if (cpu_count <= 0) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Number of available "
+                    "processors could not be determined. Assuming single-processor.");
+            cpu_count = 1;
+        }
+        else {
+            guac_client_log(client, GUAC_LOG_INFO, "Local system reports %i "
+                    "processor(s) are available.", cpu_count);
+        }
+
+        display->worker_thread_count = cpu_count * GUAC_DISPLAY_CPU_THREAD_FACTOR;
+
+    }
+
+    pthread_mutex_init(&display->workers_lock, NULL);
+    pthread_mutex_init(&display->regions_lock, NULL);
+    pthread_cond_init(&display->regions_released, NULL);
+
+    /* Use the worker threads shared by all displays of this process, if
+     * requested */
+    if (guac_display_shared_workers) {
+
+        display->worker_pool = guac_display_worker_pool_get(display->worker_thread_count);
+        if (display->worker_pool != NULL) {
+
+            display->worker_thread_count = display->worker_pool->thread_count;
+            display->workers_min = display->worker_thread_count;
+            display->workers_max = display->worker_thread_count;
+            atomic_init(&display->workers_target, display->worker_thread_count);
+            guac_client_log(client, GUAC_LOG_INFO, "Graphical updates will "
+                    "be encoded using %i worker thread(s) shared with all "
+                    "other displays.", display->worker_thread_count);
+
+            return display;
+
+        }
+
+        guac_client_log(client, GUAC_LOG_WARNING, "Shared worker threads "
+                "could not be started. Display will use its own worker "
+                "threads.");
+
     }
 
-    display->worker_thread_count = cpu_count * GUAC_DISPLAY_CPU_THREAD_FACTOR;
-    display->worker_threads = guac_mem_alloc(display->worker_thread_count, sizeof(pthread_t));
+    display->worker_threads = guac_mem_zalloc(display->worker_thread_count, sizeof(guac_display_worker));
     guac_client_log(client, GUAC_LOG_INFO, "Graphical updates will be encoded "
-            "using %i worker thread(s).", display->worker_thread_count);
+            "using up to %i worker thread(s).", display->worker_thread_count);
+
+    /* Start with as few worker threads as allowed, adding more only as frames
+     * back up (see guac_display_worker_backlog()) */
+    display->workers_min = 1;
+    display->workers_max = display->worker_thread_count;
+    atomic_init(&display->workers_target, display->workers_min);
+    atomic_init(&display->workers_idle_timeout, GUAC_DISPLAY_WORKER_IDLE_TIMEOUT);
+
+    for (int i = 0; i < display->worker_thread_count; i++)
+        display->worker_threads[i].display = display;
 
     /* Now that the core of the display has been fully initialized, it's safe
      * to start the worker threads */
-    for (int i = 0; i < display->worker_thread_count; i++)
-        pthread_create(&(display->worker_threads[i]), NULL, guac_display_worker_thread, display);
+    for (int i = 0; i < display->workers_min; i++) {
+
+        guac_display_worker* worker = &display->worker_threads[i];
+
+        if (pthread_create(&worker->thread, NULL, guac_display_worker_thread, worker) == 0) {
+            worker->joinable = 1;
+            worker->running = 1;
+            display->workers_running++;
+        }
+
+    }
 
     return display;
 
@@ -178,10 +327,31 @@ void guac_display_stop(guac_display* display) {
         guac_fifo_invalidate(&display->ops);
         guac_fifo_unlock(&display->ops);
 
-        /* Wait for all worker threads to terminate (they should nearly immediately
-         * terminate following invalidation of the FIFO) */
-        for (int i = 0; i < display->worker_thread_count; i++)
-            pthread_join(display->worker_threads[i], NULL);
+        /* Displays using the shared worker threads need only wait for those
+         * threads to finish with the display */
+        if (display->worker_pool != NULL)
+            guac_display_worker_pool_remove(display);
+
+        else {
+
+            /* Prevent worker threads from being terminated or restarted due to
+             * inactivity while they are being joined below. Once this flag is
+             * set, the thread of each slot no longer changes. */
+            pthread_mutex_lock(&display->workers_lock);
+            display->workers_stopped = 1;
+            pthread_mutex_unlock(&display->workers_lock);
+
+            /* Wait for all worker threads to terminate (they should nearly
+             * immediately terminate following invalidation of the FIFO, and
+             * any thread that terminated due to inactivity must still be
+             * joined) */
+            for (int i = 0; i < display->worker_thread_count; i++) {
+                guac_display_worker* worker = &display->worker_threads[i];
+                if (worker->joinable)
+                    pthread_join(worker->thread, NULL);
+            }
+
+        }
 
         /* All worker threads are now terminated and may be safely cleaned up */
         guac_mem_free(display->worker_threads);
@@ -215,9 +385,33 @@ void guac_display_free(guac_display* display) {
 
     guac_display_stop(display);
 
+    if (display->frames_encoded)
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display: %llu frames "
+                "encoded, %llums average latency, %llums maximum latency.",
+                (unsigned long long) display->frames_encoded,
+                (unsigned long long) (display->frame_latency_total / display->frames_encoded),
+                (unsigned long long) display->frame_latency_max);
+
+    if (display->delta_update_count)
+        guac_client_log(display->client, GUAC_LOG_DEBUG, "Display: %llu delta "
+                "updates, %llu of %llu pixels left unchanged.",
+                (unsigned long long) display->delta_update_count,
+                (unsigned long long) display->delta_unchanged_pixels,
+                (unsigned long long) display->delta_total_pixels);
+
+    /* Operations still queued when the FIFO was invalidated will never be
+     * performed */
+    guac_display_stats_record_pending(0, display->ops.item_count);
+
     /* All locks, FIFOs, etc. are now unused and can be safely destroyed */
     guac_flag_destroy(&display->render_state);
+    guac_flag_destroy(&display->plan_tasks.state);
     guac_fifo_destroy(&display->ops);
+    pthread_mutex_destroy(&display->workers_lock);
+    pthread_cond_destroy(&display->regions_released);
+    pthread_mutex_destroy(&display->regions_lock);
+    guac_display_encoder_destroy(&display->encoder_model);
+    guac_display_trace_destroy(&display->trace);
     guac_rwlock_destroy(&display->last_frame.lock);
     guac_rwlock_destroy(&display->pending_frame.lock);
 
@@ -231,23 +425,210 @@ void guac_display_free(guac_display* display) {
     while (display->last_frame.layers != NULL)
         guac_display_free_layer(display->last_frame.layers);
 
+    /* Free all cached cells only after all layers have been freed (freeing a
+     * layer also removes any of that layer's cells from the cache) */
+    guac_display_cache_destroy(&display->cache);
+    guac_display_cursor_cache_destroy(display);
+
+    guac_socket_free(display->fast_tier_socket);
+    guac_socket_free(display->slow_tier_socket);
+    guac_mem_free(display->slow_users);
+
+    guac_mem_free(display->previous_buffer);
+    guac_display_arena_destroy(&display->plan_arena);
     guac_mem_free(display);
 
 }
 
-void guac_display_dup(guac_display* display, guac_socket* socket) {
+/**
+ * Frees all cached tiles of the given layer. This is the shared
+ * implementation of LFW_guac_display_layer_free_dup_tiles() and of the
+ * discarding of stale tiles by guac_display_dup(), the latter of which is
+ * only guarded by the last_frame.lock held for reading together with
+ * render_state.
+ *
+ * @param layer
+ *     The layer whose cached tiles should be freed.
+ */
+static void guac_display_layer_discard_dup_tiles(guac_display_layer* layer) {
+
+    if (layer->dup_tiles == NULL)
+        return;
+
+    int count = GUAC_DISPLAY_DUP_TILE_DIMENSION(layer->dup_width)
+              * GUAC_DISPLAY_DUP_TILE_DIMENSION(layer->dup_height);
+
+    for (int i = 0; i < count; i++)
+        guac_mem_free(layer->dup_tiles[i].png);
+
+    guac_mem_free(layer->dup_tiles);
+    layer->dup_tiles = NULL;
+    layer->dup_width = 0;
+    layer->dup_height = 0;
+
+}
+
+void LFW_guac_display_layer_free_dup_tiles(guac_display_layer* layer) {
+    guac_display_layer_discard_dup_tiles(layer);
+}
+
+void LFW_guac_display_layer_invalidate_dup_tiles(guac_display_layer* layer,
+        const guac_rect* rect) {
+
+    if (layer->dup_tiles == NULL || guac_rect_is_empty(rect))
+        return;
+
+    guac_rect tiles = {
+        .left   = 0,
+        .top    = 0,
+        .right  = layer->dup_width,
+        .bottom = layer->dup_height
+    };
+
+    guac_rect changed = *rect;
+    guac_rect_constrain(&changed, &tiles);
+    if (guac_rect_is_empty(&changed))
+        return;
+
+    int tiles_width = GUAC_DISPLAY_DUP_TILE_DIMENSION(layer->dup_width);
+
+    int left = changed.left / GUAC_DISPLAY_DUP_TILE_SIZE;
+    int top = changed.top / GUAC_DISPLAY_DUP_TILE_SIZE;
+    int right = GUAC_DISPLAY_DUP_TILE_DIMENSION(changed.right);
+    int bottom = GUAC_DISPLAY_DUP_TILE_DIMENSION(changed.bottom);
+
+    for (int y = top; y < bottom; y++) {
+        for (int x = left; x < right; x++) {
+            guac_display_dup_tile* tile = &layer->dup_tiles[y * tiles_width + x];
+            guac_mem_free(tile->png);
+            tile->modified = layer->last_frame_modified;
+        }
+    }
+
+}
+
+/**
+ * Sends the contents of the last frame of the given layer over the given
+ * socket as PNG images, one for each GUAC_DISPLAY_DUP_TILE_SIZE tile that has
+ * changed since the given time. Tiles that have not changed since they were
+ * last sent by guac_display_dup() are sent from cache, while all other tiles
+ * are encoded and cached for future calls. The display-level last_frame.lock
+ * and render_state MUST be held.
+ *
+ * @param display
+ *     The display containing the layer.
+ *
+ * @param layer
+ *     The layer whose contents should be sent.
+ *
+ * @param width
+ *     The width of the layer, in pixels.
+ *
+ * @param height
+ *     The height of the layer, in pixels.
+ *
+ * @param since
+ *     The time of the frame that the client-side copy of the layer already
+ *     reflects, such that tiles last changed before that frame need not be
+ *     sent, or zero if all tiles should be sent.
+ *
+ * @param mode
+ *     The composite mode that should be used to draw each tile.
+ *
+ * @param socket
+ *     The socket over which the contents of the layer should be sent.
+ */
+static void LFR_guac_display_layer_dup_tiles(guac_display* display,
+        guac_display_layer* layer, int width, int height,
+        guac_timestamp since, guac_composite_mode mode, guac_socket* socket) {
 
     guac_client* client = display->client;
-    guac_rwlock_acquire_read_lock(&display->last_frame.lock);
 
-    /* Wait for any pending frame to finish being sent to established users of
-     * the connection before syncing any new users (doing otherwise could
-     * result in trailing instructions of that pending frame getting sent to
-     * new users after they finish joining, even though they are already in
-     * sync with that frame, and those trailing instructions may not have the
-     * intended meaning in context of the new users' remote displays) */
-    guac_flag_wait_and_lock(&display->render_state,
-            GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+    /* Discard any cached tiles covering a different area */
+    if (layer->dup_width != width || layer->dup_height != height)
+        guac_display_layer_discard_dup_tiles(layer);
+
+    int tiles_width = GUAC_DISPLAY_DUP_TILE_DIMENSION(width);
+    int tiles_height = GUAC_DISPLAY_DUP_TILE_DIMENSION(height);
+
+    /* Changes made before tiles were tracked can only be dated as far as the
+     * most recent change to any part of the layer */
+    if (layer->dup_tiles == NULL) {
+
+        layer->dup_tiles = guac_mem_zalloc(sizeof(guac_display_dup_tile),
+                tiles_width, tiles_height);
+        layer->dup_width = width;
+        layer->dup_height = height;
+
+        for (int i = 0; i < tiles_width * tiles_height; i++)
+            layer->dup_tiles[i].modified = layer->last_frame_modified;
+
+    }
+
+    guac_display_dup_tile* tile = layer->dup_tiles;
+    for (int y = 0; y < tiles_height; y++) {
+        for (int x = 0; x < tiles_width; x++, tile++) {
+
+            /* Skip tiles that the client already has (a change made within
+             * the same millisecond as the given frame may postdate it) */
+            if (tile->modified < since)
+                continue;
+
+            guac_rect tile_rect = {
+                .left   = x * GUAC_DISPLAY_DUP_TILE_SIZE,
+                .top    = y * GUAC_DISPLAY_DUP_TILE_SIZE,
+                .right  = (x + 1) * GUAC_DISPLAY_DUP_TILE_SIZE,
+                .bottom = (y + 1) * GUAC_DISPLAY_DUP_TILE_SIZE
+            };
+
+            if (tile_rect.right > width)
+                tile_rect.right = width;
+
+            if (tile_rect.bottom > height)
+                tile_rect.bottom = height;
+
+            /* Encode tile only if not already cached */
+            if (tile->png == NULL) {
+
+                unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(layer->last_frame, tile_rect);
+                cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
+                            layer->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+                            guac_rect_width(&tile_rect), guac_rect_height(&tile_rect),
+                            layer->last_frame.buffer_stride);
+
+                tile->png = guac_png_encode(rect, &tile->length);
+                cairo_surface_destroy(rect);
+
+                if (tile->png == NULL) {
+                    guac_client_log(client, GUAC_LOG_DEBUG, "Unable to encode "
+                            "layer contents for newly-joined users.");
+                    continue;
+                }
+
+            }
+
+            guac_stream* stream = guac_client_alloc_stream(client);
+
+            guac_protocol_send_img(socket, stream, mode, layer->layer,
+                    "image/png", tile_rect.left, tile_rect.top);
+            guac_protocol_send_blobs(socket, stream, tile->png, tile->length);
+            guac_protocol_send_end(socket, stream);
+
+            guac_client_free_stream(client, stream);
+
+        }
+    }
+
+}
+
+void LFR_guac_display_dup_state(guac_display* display,
+        guac_socket* socket, guac_timestamp since) {
+
+    guac_client* client = display->client;
+
+    /* Tiles resent to a resumed view must replace, rather than be composited
+     * over, any stale contents */
+    guac_composite_mode mode = since ? GUAC_COMP_SRC : GUAC_COMP_OVER;
 
     /* Sync the state of all layers/buffers */
     guac_display_layer* current = display->last_frame.layers;
@@ -264,22 +645,19 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
 
         if (width > 0 && height > 0) {
 
-            /* Get Cairo surface covering layer bounds */
-            unsigned char* buffer = GUAC_DISPLAY_LAYER_STATE_MUTABLE_BUFFER(current->last_frame, layer_bounds);
-            cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                        current->opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
-                        width, height, current->last_frame.buffer_stride);
-
-            /* Send PNG for rect */
-            guac_client_stream_png(client, socket, GUAC_COMP_OVER, layer, 0, 0, rect);
+            /* Send PNG for each tile, reusing any tiles already encoded (a
+             * layer added after the frame being resumed from must be sent in
+             * full, as its index may have previously been used by another
+             * layer or buffer) */
+            LFR_guac_display_layer_dup_tiles(display, current, width, height,
+                    current->last_frame_added >= since ? 0 : since, mode,
+                    socket);
 
             /* Resync copy of previous frame */
             guac_protocol_send_copy(socket,
                     layer, 0, 0, width, height,
                     GUAC_COMP_OVER, current->last_frame_buffer, 0, 0);
 
-            cairo_surface_destroy(rect);
-
         }
 
         /* Resync any properties that are specific to non-buffer layers */
@@ -309,6 +687,10 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
 
     }
 
+    /* Sync the contents of all buffers containing cached cells */
+    guac_display_cache_dup(&display->cache, socket, since);
+    guac_display_cursor_cache_dup(display, socket);
+
     /* Synchronize mouse cursor */
     guac_display_layer* cursor = display->cursor_buffer;
     guac_protocol_send_cursor(socket,
@@ -325,6 +707,92 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
     /* The initial frame synchronizing the newly-joined users is now complete */
     guac_protocol_send_sync(socket, client->last_sent_timestamp, display->last_frame.frames);
 
+}
+
+/**
+ * Callback for guac_client_foreach_pending_user() which sets the int pointed
+ * to by the given data to a non-zero value if the given user is resuming a
+ * previous view of the display.
+ *
+ * @param user
+ *     The pending user to check.
+ *
+ * @param data
+ *     A pointer to an int that should be set to a non-zero value if the user
+ *     is resuming a previous view of the display.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_display_check_resuming(guac_user* user, void* data) {
+
+    if (user->info.resume_timestamp != 0)
+        *((int*) data) = 1;
+
+    return NULL;
+
+}
+
+/**
+ * Callback for guac_client_foreach_pending_user() which sends the state of
+ * the last frame of the given guac_display to the given user alone, including
+ * only the changes made since the frame that the user is resuming from, if
+ * any. The display-level last_frame.lock and render_state MUST be held.
+ *
+ * @param user
+ *     The pending user to synchronize.
+ *
+ * @param data
+ *     The guac_display whose state should be sent.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* LFR_guac_display_dup_pending_user(guac_user* user, void* data) {
+
+    guac_display* display = (guac_display*) data;
+
+    if (user->info.resume_timestamp != 0)
+        guac_user_log(user, GUAC_LOG_DEBUG, "Resuming view of display from "
+                "frame %" PRIu64 ".", (uint64_t) user->info.resume_timestamp);
+
+    LFR_guac_display_dup_state(display, user->socket,
+            user->info.resume_timestamp);
+
+    guac_socket_flush(user->socket);
+    return NULL;
+
+}
+
+void guac_display_dup(guac_display* display, guac_socket* socket) {
+
+    guac_client* client = display->client;
+
+    /* Pending users that are resuming a previous view of the display need
+     * only the changes made since, and so must be synchronized individually
+     * rather than via the given broadcast socket */
+    int resuming = 0;
+    if (socket == client->pending_socket)
+        guac_client_foreach_pending_user(client, guac_display_check_resuming,
+                &resuming);
+
+    guac_rwlock_acquire_read_lock(&display->last_frame.lock);
+
+    /* Wait for any pending frame to finish being sent to established users of
+     * the connection before syncing any new users (doing otherwise could
+     * result in trailing instructions of that pending frame getting sent to
+     * new users after they finish joining, even though they are already in
+     * sync with that frame, and those trailing instructions may not have the
+     * intended meaning in context of the new users' remote displays) */
+    guac_flag_wait_and_lock(&display->render_state,
+            GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+
+    if (resuming)
+        guac_client_foreach_pending_user(client,
+                LFR_guac_display_dup_pending_user, display);
+    else
+        LFR_guac_display_dup_state(display, socket, 0);
+
     /* Further rendering for the current connection can now safely continue */
     guac_flag_unlock(&display->render_state);
     guac_rwlock_release_lock(&display->last_frame.lock);
@@ -333,6 +801,76 @@ void guac_display_dup(guac_display* display, guac_socket* socket) {
 
 }
 
+void guac_display_set_cache_size(guac_display* display, size_t size) {
+
+    /* Cached cells may be referenced by any plan currently being created or
+     * applied, all of which occurs while the pending frame is locked */
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    guac_display_cache_set_size(&display->cache, size);
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+
+}
+
+void guac_display_set_delta_updates(guac_display* display, int enabled) {
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    display->delta_updates = enabled;
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+}
+
+void guac_display_set_tiered_encoding(guac_display* display, int enabled) {
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    display->tiered_encoding = enabled;
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+}
+
+void guac_display_set_idle_release_timeout(guac_display* display, int timeout) {
+    guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
+    display->idle_release_timeout = timeout;
+    guac_rwlock_release_lock(&display->pending_frame.lock);
+}
+
+void guac_display_set_refinement_delay(guac_display* display, int delay) {
+    atomic_store(&display->refinement_delay, delay);
+}
+
+void guac_display_set_worker_threads(guac_display* display, int min, int max) {
+
+    /* Threads of a shared pool are never added or removed */
+    if (display->worker_pool != NULL)
+        return;
+
+    if (max <= 0 || max > display->worker_thread_count)
+        max = display->worker_thread_count;
+
+    if (min <= 0)
+        min = 1;
+    else if (min > max)
+        min = max;
+
+    pthread_mutex_lock(&display->workers_lock);
+
+    display->workers_min = min;
+    display->workers_max = max;
+
+    int target = atomic_load(&display->workers_target);
+    if (target < min)
+        target = min;
+    else if (target > max)
+        target = max;
+
+    atomic_store(&display->workers_target, target);
+
+    pthread_mutex_unlock(&display->workers_lock);
+
+    guac_client_log(display->client, GUAC_LOG_DEBUG, "Graphical updates will "
+            "be encoded using between %i and %i worker thread(s).", min, max);
+
+    /* Start any additional threads required by the new minimum now, rather
+     * than waiting for the display to be updated */
+    guac_display_resume_workers(display);
+
+}
+
 void guac_display_notify_user_left(guac_display* display, guac_user* user) {
     guac_rwlock_acquire_write_lock(&display->pending_frame.lock);
 
@@ -165,6 +165,31 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
 
 }
 
+guac_jpeg_encoder* guac_jpeg_encoder_alloc() {
+
+    guac_jpeg_encoder* encoder = guac_mem_zalloc(sizeof(guac_jpeg_encoder));
+
+    /* The compression structure (including any Huffman tables and other
+     * state allocated from its permanent pool) is retained across images */
+    encoder->cinfo.err = jpeg_std_error(&encoder->jerr);
+    jpeg_create_compress(&encoder->cinfo);
+
+    return encoder;
+
+}
+
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder) {
+
+    jpeg_destroy_compress(&encoder->cinfo);
+
+#ifndef JCS_EXTENSIONS
+    guac_mem_free(encoder->scanline_data);
+#endif
+
+    guac_mem_free(encoder);
+
+}
+
 int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface, int quality) {
 
@@ -186,54 +211,74 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    guac_jpeg_encoder* encoder = guac_jpeg_encoder_alloc();
+    int retval = guac_jpeg_write_raw(encoder, socket, stream, data, width,
+            height, stride, quality);
+    guac_jpeg_encoder_free(encoder);
+
+    return retval;
+
+}
+
+int guac_jpeg_write_raw(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, int quality) {
+
+    j_compress_ptr cinfo = &encoder->cinfo;
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extensions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+
+    /* Grow the buffer for the write scan line (which is where we will put
+     * the converted pixels, BGRx -> RGB) if it is too small for this image */
+    size_t scanline_size = guac_mem_ckd_mul_or_die(cinfo->image_width, cinfo->input_components);
+    if (scanline_size > encoder->scanline_size) {
+        guac_mem_free(encoder->scanline_data);
+        encoder->scanline_data = guac_mem_alloc(scanline_size);
+        encoder->scanline_size = scanline_size;
+    }
 
-    /* Create a buffer for the write scan line which is where we will
-     * put the converted pixels (BGRx -> RGB) */
-    unsigned char *scanline_data = guac_mem_zalloc(cinfo.image_width, cinfo.input_components);
+    unsigned char *scanline_data = encoder->scanline_data;
 #endif
 
-    /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    /* Initialize the JPEG compressor. NOTE: The defaults are deliberately
+     * left alone beyond quality. They produce baseline, Huffman-coded JPEG
+     * (arithmetic coding is not supported by browsers) with 4:2:0 chroma
+     * subsampling, which is already the least costly subsampling to encode.
+     * Full chroma resolution roughly halves encoding speed and is not worth
+     * it for the photographic content that is sent as JPEG. */
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
-        row_pointer[0] = &data[row_offset];
+        row_pointer[0] = (JSAMPROW) &data[row_offset];
 #else
         /* For standard JPEG libraries we have to convert the
          * scanline from 24 bit (4 byte) BGRx to 24 bit (3 byte) RGB */
-        unsigned char *inptr = data + row_offset;
+        const unsigned char *inptr = data + row_offset;
         unsigned char *outptr = scanline_data;
 
         for (int x = 0; x < width; ++x) {
@@ -249,19 +294,12 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
-#ifndef JCS_EXTENSIONS
-    guac_mem_free(scanline_data);
-#endif
-
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
-
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
+    /* Finalize compression (leaving the compression structure ready for the
+     * next image) */
+    jpeg_finish_compress(cinfo);
     return 0;
 
 }
-
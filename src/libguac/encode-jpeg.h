@@ -27,6 +27,62 @@
 
 #include <cairo/cairo.h>
 
+#include <stddef.h>
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+/**
+ * Reusable state for encoding JPEG images. Reusing the same encoder for
+ * multiple images avoids rebuilding the libjpeg compression structure and
+ * reallocating buffers for each image. An encoder may only be used by one
+ * thread at a time.
+ */
+typedef struct guac_jpeg_encoder {
+
+    /**
+     * The libjpeg compression structure, retained across images.
+     */
+    struct jpeg_compress_struct cinfo;
+
+    /**
+     * The libjpeg error handler associated with cinfo.
+     */
+    struct jpeg_error_mgr jerr;
+
+#ifndef JCS_EXTENSIONS
+    /**
+     * Buffer of converted (24-bit RGB) pixels for the scanline currently
+     * being written, or NULL if no such buffer has yet been allocated.
+     */
+    unsigned char* scanline_data;
+
+    /**
+     * The size of scanline_data, in bytes.
+     */
+    size_t scanline_size;
+#endif
+
+} guac_jpeg_encoder;
+
+/**
+ * Allocates a new guac_jpeg_encoder that can be used to encode any number of
+ * JPEG images with guac_jpeg_write_raw(). The encoder must eventually be
+ * freed with guac_jpeg_encoder_free().
+ *
+ * @return
+ *     A newly-allocated guac_jpeg_encoder.
+ */
+guac_jpeg_encoder* guac_jpeg_encoder_alloc();
+
+/**
+ * Frees the given guac_jpeg_encoder and all associated resources.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder);
+
 /**
  * Encodes the given surface as a JPEG, and sends the resulting data over the
  * given stream and socket as blobs.
@@ -49,5 +105,44 @@
 int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface, int quality);
 
+/**
+ * Encodes the given opaque image data as a JPEG, and sends the resulting data
+ * over the given stream and socket as blobs. The image data is read in place,
+ * without first being wrapped in a Cairo surface.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_RGB24 (32
+ *     bits per pixel, with the upper 8 bits unused).
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @param quality
+ *     JPEG image quality.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_jpeg_write_raw(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, int quality);
+
 #endif
 
@@ -45,7 +45,8 @@
 typedef struct guac_png_write_state {
 
     /**
-     * The socket over which all PNG blobs will be written.
+     * The socket over which all PNG blobs will be written, or NULL if PNG
+     * data should instead be appended to the output buffer.
      */
     guac_socket* socket;
 
@@ -64,8 +65,50 @@ typedef struct guac_png_write_state {
      */
     int buffer_size;
 
+    /**
+     * Dynamically-allocated buffer receiving all PNG data if socket is NULL,
+     * or NULL if no PNG data has yet been written.
+     */
+    unsigned char* output;
+
+    /**
+     * The number of bytes of PNG data stored within the output buffer.
+     */
+    size_t output_length;
+
+    /**
+     * The number of bytes allocated for the output buffer.
+     */
+    size_t output_size;
+
 } guac_png_write_state;
 
+/**
+ * Initializes the given write state such that PNG data is sent over the given
+ * socket as blobs associated with the given stream. If the socket is NULL,
+ * PNG data is instead collected within the output buffer of the write state.
+ *
+ * @param write_state
+ *     The write state to initialize.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over, or NULL to collect PNG data within
+ *     the output buffer.
+ *
+ * @param stream
+ *     The stream to associate with each blob, which is ignored if the socket
+ *     is NULL.
+ */
+static void guac_png_write_state_init(guac_png_write_state* write_state,
+        guac_socket* socket, guac_stream* stream) {
+    write_state->socket = socket;
+    write_state->stream = stream;
+    write_state->buffer_size = 0;
+    write_state->output = NULL;
+    write_state->output_length = 0;
+    write_state->output_size = 0;
+}
+
 /**
  * Writes the contents of the PNG write state as a blob to its associated
  * socket.
@@ -75,9 +118,26 @@ typedef struct guac_png_write_state {
  */
 static void guac_png_flush_data(guac_png_write_state* write_state) {
 
+    /* Collect data within output buffer if not writing to a socket */
+    if (write_state->socket == NULL) {
+
+        size_t required = write_state->output_length + write_state->buffer_size;
+        if (required > write_state->output_size) {
+            write_state->output_size = guac_mem_ckd_mul_or_die(required, 2);
+            write_state->output = guac_mem_realloc_or_die(write_state->output,
+                    write_state->output_size);
+        }
+
+        memcpy(write_state->output + write_state->output_length,
+                write_state->buffer, write_state->buffer_size);
+        write_state->output_length = required;
+
+    }
+
     /* Send blob */
-    guac_protocol_send_blob(write_state->socket, write_state->stream,
-            write_state->buffer, write_state->buffer_size);
+    else
+        guac_protocol_send_blob(write_state->socket, write_state->stream,
+                write_state->buffer, write_state->buffer_size);
 
     /* Clear buffer */
     write_state->buffer_size = 0;
@@ -169,39 +229,29 @@ static cairo_status_t guac_png_cairo_write_handler(void* closure,
  * Implementation of guac_png_write() which uses Cairo's own PNG encoder to
  * write PNG data, rather than using libpng directly.
  *
- * @param socket
- *     The socket to send PNG blobs over.
- *
- * @param stream
- *     The stream to associate with each blob.
+ * @param write_state
+ *     The write state receiving all PNG data.
  *
  * @param surface
- *     The Cairo surface to write to the given stream and socket as PNG blobs.
+ *     The Cairo surface to write as PNG data.
  *
  * @return
  *     Zero if the encoding operation is successful, non-zero otherwise.
  */
-static int guac_png_cairo_write(guac_socket* socket, guac_stream* stream,
+static int guac_png_cairo_write(guac_png_write_state* write_state,
         cairo_surface_t* surface) {
 
-    guac_png_write_state write_state;
-
-    /* Init write state */
-    write_state.socket = socket;
-    write_state.stream = stream;
-    write_state.buffer_size = 0;
-
     /* Write surface as PNG */
     if (cairo_surface_write_to_png_stream(surface,
                 guac_png_cairo_write_handler,
-                &write_state) != CAIRO_STATUS_SUCCESS) {
+                write_state) != CAIRO_STATUS_SUCCESS) {
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "Cairo PNG backend failed";
         return -1;
     }
 
     /* Flush remaining PNG data */
-    guac_png_flush_data(&write_state);
+    guac_png_flush_data(write_state);
     return 0;
 
 }
@@ -266,41 +316,67 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
-int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+guac_png_encoder* guac_png_encoder_alloc() {
+    return guac_mem_zalloc(sizeof(guac_png_encoder));
+}
+
+void guac_png_encoder_free(guac_png_encoder* encoder) {
+    guac_mem_free(encoder->row);
+    guac_mem_free(encoder);
+}
+
+/**
+ * Shared implementation of guac_png_write_raw() and guac_png_write_keyed(),
+ * encoding the given image data as PNG and optionally marking all pixels of a
+ * single color as fully transparent.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param write_state
+ *     The write state receiving all PNG data.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_RGB24 (32
+ *     bits per pixel, with the upper 8 bits unused).
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @param key
+ *     Pointer to the 24-bit RGB color that should be marked as fully
+ *     transparent, or NULL if the image should be fully opaque.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+static int guac_png_write_rgb(guac_png_encoder* encoder,
+        guac_png_write_state* write_state, const unsigned char* data,
+        int width, int height, int stride, const uint32_t* key) {
 
     png_structp png;
     png_infop png_info;
-    png_byte** png_rows;
+    png_byte* row;
     int bpp;
 
     int x, y;
 
-    guac_png_write_state write_state;
-
-    /* Get image surface properties and data */
-    cairo_format_t format = cairo_image_surface_get_format(surface);
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
-
-    /* If not RGB24, use Cairo PNG writer */
-    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
-
-    /* Flush pending operations to surface */
-    cairo_surface_flush(surface);
-
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
-
-    /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+    /* Attempt to build palette, resorting to 24-bit RGB if not possible */
+    guac_palette* palette = &encoder->palette;
+    if (guac_palette_build(palette, data, width, height, stride))
+        palette = NULL;
 
     /* Calculate BPP from palette size */
-    if      (palette->size <= 2)  bpp = 1;
+    if      (palette == NULL)     bpp = 8;
+    else if (palette->size <= 2)  bpp = 1;
     else if (palette->size <= 4)  bpp = 2;
     else if (palette->size <= 16) bpp = 4;
     else                          bpp = 8;
@@ -308,7 +384,6 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     /* Set up PNG writer */
     png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png) {
-        guac_palette_free(palette);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create write structure";
         return -1;
@@ -317,55 +392,36 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     png_info = png_create_info_struct(png);
     if (!png_info) {
         png_destroy_write_struct(&png, NULL);
-        guac_palette_free(palette);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create info structure";
         return -1;
     }
 
+    /* Grow the row buffer reused for every row of the image, if necessary
+     * (it must be large enough for one index or one 24-bit RGB color per
+     * pixel) */
+    size_t row_size = guac_mem_ckd_mul_or_die(sizeof(png_byte), width, 3);
+    if (row_size > encoder->row_size) {
+        guac_mem_free(encoder->row);
+        encoder->row = (png_byte*) guac_mem_alloc(row_size);
+        encoder->row_size = row_size;
+    }
+
+    row = encoder->row;
+
     /* Set error handler */
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &png_info);
-        guac_palette_free(palette);
         guac_error = GUAC_STATUS_IO_ERROR;
         guac_error_message = "libpng output error";
         return -1;
     }
 
-    /* Init write state */
-    write_state.socket = socket;
-    write_state.stream = stream;
-    write_state.buffer_size = 0;
-
     /* Set up writer */
-    png_set_write_fn(png, &write_state,
+    png_set_write_fn(png, write_state,
             guac_png_write_handler,
             guac_png_flush_handler);
 
-    /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) guac_mem_alloc(sizeof(png_byte*), height);
-    for (y=0; y<height; y++) {
-
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) guac_mem_alloc(sizeof(png_byte), width);
-        png_rows[y] = row;
-
-        /* Copy data from surface into current row */
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
-
-        }
-
-        /* Advance to next data row */
-        data += stride;
-
-    }
-
     /* Write image info */
     png_set_IHDR(
         png,
@@ -373,33 +429,179 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
         width,
         height,
         bpp,
-        PNG_COLOR_TYPE_PALETTE,
+        palette != NULL ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGB,
         PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_DEFAULT,
         PNG_FILTER_TYPE_DEFAULT
     );
 
     /* Write palette */
-    png_set_PLTE(png, png_info, palette->colors, palette->size);
+    if (palette != NULL)
+        png_set_PLTE(png, png_info, palette->colors, palette->size);
+
+    /* Mark the key color as transparent, if any. For palette images, this
+     * requires an alpha value for each palette entry up to and including
+     * that of the key color. */
+    if (key != NULL) {
+
+        if (palette != NULL) {
+            int index = guac_palette_find(palette, *key & 0xFFFFFF);
+            if (index >= 0) {
+                png_byte alpha[256];
+                memset(alpha, 0xFF, index);
+                alpha[index] = 0x00;
+                png_set_tRNS(png, png_info, alpha, index + 1, NULL);
+            }
+        }
 
-    /* Write image */
-    png_set_rows(png, png_info, png_rows);
-    png_write_png(png, png_info, PNG_TRANSFORM_PACKING, NULL);
+        else {
+            png_color_16 color = {
+                .red   = (*key >> 16) & 0xFF,
+                .green = (*key >> 8)  & 0xFF,
+                .blue  =  *key        & 0xFF
+            };
+            png_set_tRNS(png, png_info, NULL, 0, &color);
+        }
 
-    /* Finish write */
-    png_destroy_write_struct(&png, &png_info);
+    }
+
+    /* Trade compression ratio for speed if requested, using the cheapest
+     * filter that still helps RGB images (filtering rarely helps palette
+     * images at all) */
+    if (encoder->fast) {
+        png_set_compression_level(png, GUAC_PNG_FAST_COMPRESSION_LEVEL);
+        png_set_filter(png, PNG_FILTER_TYPE_BASE,
+                palette != NULL ? PNG_FILTER_NONE : PNG_FILTER_SUB);
+    }
+
+    png_write_info(png, png_info);
+
+    /* Pack multiple palette indices per byte where the bit depth allows */
+    png_set_packing(png);
+
+    /* Convert and write each row of image data, one row at a time */
+    for (y=0; y<height; y++) {
+
+        const uint32_t* current = (const uint32_t*) data;
+
+        /* Store index of each pixel color if using a palette */
+        if (palette != NULL) {
+            for (x=0; x<width; x++)
+                row[x] = guac_palette_find(palette, current[x] & 0xFFFFFF);
+        }
+
+        /* Otherwise, store each color directly */
+        else {
+            png_byte* rgb = row;
+            for (x=0; x<width; x++) {
+                uint32_t color = current[x];
+                *(rgb++) = (color >> 16) & 0xFF; /* R */
+                *(rgb++) = (color >> 8)  & 0xFF; /* G */
+                *(rgb++) =  color        & 0xFF; /* B */
+            }
+        }
+
+        png_write_row(png, row);
 
-    /* Free palette */
-    guac_palette_free(palette);
+        /* Advance to next data row */
+        data += stride;
+
+    }
 
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        guac_mem_free(png_rows[y]);
-    guac_mem_free(png_rows);
+    /* Finish write */
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &png_info);
 
     /* Ensure all data is written */
-    guac_png_flush_data(&write_state);
+    guac_png_flush_data(write_state);
     return 0;
 
 }
 
+/**
+ * Shared implementation of guac_png_write() and guac_png_encode(), encoding
+ * the given surface as PNG data using whichever encoder best suits its format.
+ *
+ * @param write_state
+ *     The write state receiving all PNG data.
+ *
+ * @param surface
+ *     The Cairo surface to encode.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+static int guac_png_write_surface(guac_png_write_state* write_state,
+        cairo_surface_t* surface) {
+
+    /* Get image surface properties and data */
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    /* If not RGB24, use Cairo PNG writer */
+    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
+        return guac_png_cairo_write(write_state, surface);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    guac_png_encoder* encoder = guac_png_encoder_alloc();
+    int retval = guac_png_write_rgb(encoder, write_state, data, width,
+            height, stride, NULL);
+    guac_png_encoder_free(encoder);
+
+    return retval;
+
+}
+
+int guac_png_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface) {
+
+    guac_png_write_state write_state;
+    guac_png_write_state_init(&write_state, socket, stream);
+
+    return guac_png_write_surface(&write_state, surface);
+
+}
+
+unsigned char* guac_png_encode(cairo_surface_t* surface, size_t* length) {
+
+    guac_png_write_state write_state;
+    guac_png_write_state_init(&write_state, NULL, NULL);
+
+    if (guac_png_write_surface(&write_state, surface)) {
+        guac_mem_free(write_state.output);
+        return NULL;
+    }
+
+    *length = write_state.output_length;
+    return write_state.output;
+
+}
+
+int guac_png_write_raw(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride) {
+
+    guac_png_write_state write_state;
+    guac_png_write_state_init(&write_state, socket, stream);
+
+    return guac_png_write_rgb(encoder, &write_state, data, width, height,
+            stride, NULL);
+
+}
+
+int guac_png_write_keyed(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, uint32_t key) {
+
+    guac_png_write_state write_state;
+    guac_png_write_state_init(&write_state, socket, stream);
+
+    return guac_png_write_rgb(encoder, &write_state, data, width, height,
+            stride, &key);
+
+}
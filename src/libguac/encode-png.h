@@ -24,8 +24,70 @@
 
 #include "guacamole/socket.h"
 #include "guacamole/stream.h"
+#include "palette.h"
 
 #include <cairo/cairo.h>
+#include <png.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The zlib compression level used for PNG images written by encoders in fast
+ * mode (see guac_png_encoder), equivalent to Z_BEST_SPEED.
+ */
+#define GUAC_PNG_FAST_COMPRESSION_LEVEL 1
+
+/**
+ * Reusable state for encoding PNG images. Reusing the same encoder for
+ * multiple images avoids reallocating the palette and row buffers for each
+ * image. An encoder may only be used by one thread at a time.
+ */
+typedef struct guac_png_encoder {
+
+    /**
+     * Storage for the palette of the image currently being encoded.
+     */
+    guac_palette palette;
+
+    /**
+     * Buffer containing the converted contents of the row currently being
+     * written, or NULL if no such buffer has yet been allocated.
+     */
+    png_byte* row;
+
+    /**
+     * The size of the row buffer, in bytes.
+     */
+    size_t row_size;
+
+    /**
+     * Non-zero if images should be encoded as quickly as possible rather than
+     * as compactly as possible, zero otherwise. Images encoded in fast mode
+     * are still lossless, but use minimal zlib compression and only the
+     * cheapest PNG row filter. This may be changed freely between images.
+     */
+    int fast;
+
+} guac_png_encoder;
+
+/**
+ * Allocates a new guac_png_encoder that can be used to encode any number of
+ * PNG images with guac_png_write_raw(). The encoder must eventually be freed
+ * with guac_png_encoder_free().
+ *
+ * @return
+ *     A newly-allocated guac_png_encoder.
+ */
+guac_png_encoder* guac_png_encoder_alloc();
+
+/**
+ * Frees the given guac_png_encoder and all associated resources.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_png_encoder_free(guac_png_encoder* encoder);
 
 /**
  * Encodes the given surface as a PNG, and sends the resulting data over the
@@ -46,5 +108,101 @@
 int guac_png_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface);
 
+/**
+ * Encodes the given surface as a PNG, storing the resulting data within a
+ * newly-allocated buffer rather than sending that data over a socket. The
+ * encoded data is identical to the data that guac_png_write() would send.
+ *
+ * @param surface
+ *     The Cairo surface to encode.
+ *
+ * @param length
+ *     Pointer to a size_t that should receive the size of the encoded PNG
+ *     data, in bytes. This value is only set if encoding succeeds.
+ *
+ * @return
+ *     A newly-allocated buffer containing the encoded PNG data, which must
+ *     eventually be freed with guac_mem_free(), or NULL if encoding fails.
+ */
+unsigned char* guac_png_encode(cairo_surface_t* surface, size_t* length);
+
+/**
+ * Encodes the given opaque image data as a PNG, and sends the resulting data
+ * over the given stream and socket as blobs. The image data is read in place,
+ * without first being wrapped in a Cairo surface.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_RGB24 (32
+ *     bits per pixel, with the upper 8 bits unused).
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_png_write_raw(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride);
+
+/**
+ * Writes the given raw image data as PNG image data, just as
+ * guac_png_write_raw() does, except that all pixels having the given key color
+ * are marked as fully transparent. The remaining pixels are fully opaque.
+ * Drawing such an image with GUAC_COMP_OVER leaves the client-side contents
+ * beneath key-colored pixels untouched.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_RGB24 (32
+ *     bits per pixel, with the upper 8 bits unused).
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @param key
+ *     The 24-bit RGB color that should be treated as fully transparent. The
+ *     upper 8 bits of this value are ignored.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_png_write_keyed(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, uint32_t key);
+
 #endif
 
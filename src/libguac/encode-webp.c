@@ -21,6 +21,7 @@
 
 #include "encode-webp.h"
 #include "guacamole/error.h"
+#include "guacamole/mem.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
 #include "palette.h"
@@ -162,8 +163,52 @@ static int guac_webp_stream_write(const uint8_t* data, size_t data_size,
     return 1;
 }
 
-int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless) {
+/**
+ * Encodes the given image data as a WebP, and sends the resulting data over
+ * the given stream and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_ARGB32 or
+ *     CAIRO_FORMAT_RGB24, depending on whether the alpha channel is used.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @param alpha
+ *     Non-zero if the upper 8 bits of each pixel are an alpha channel (as in
+ *     CAIRO_FORMAT_ARGB32), zero if those bits are unused and the image is
+ *     opaque (as in CAIRO_FORMAT_RGB24).
+ *
+ * @param quality
+ *     The WebP image quality to use.
+ *
+ * @param lossless
+ *     Zero for a lossy image, non-zero for lossless.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+static int guac_webp_write_data(guac_webp_encoder* encoder,
+        guac_socket* socket, guac_stream* stream, const unsigned char* data,
+        int width, int height, int stride, int alpha, int quality,
+        int lossless) {
 
     guac_webp_stream_writer writer;
     WebPPicture picture;
@@ -171,21 +216,6 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
 
     int x, y;
 
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    cairo_format_t format = cairo_image_surface_get_format(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
-
-    if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
-        guac_error = GUAC_STATUS_INTERNAL_ERROR;
-        guac_error_message = "Invalid Cairo image format. Unable to create WebP.";
-        return -1;
-    }
-
-    /* Flush pending operations to surface */
-    cairo_surface_flush(surface);
-
     /* Configure WebP compression bits */
     WebPConfig config;
     if (!WebPConfigPreset(&config, WEBP_PRESET_DEFAULT, quality))
@@ -210,10 +240,19 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     picture.width = width;
     picture.height = height;
 
-    /* Allocate and init writer */
-    if (!WebPPictureAlloc(&picture)) {
-        return -1;
+    /* Grow the encoder's ARGB buffer if necessary. The picture only
+     * references this buffer, which WebPPictureFree() thus does not free. */
+    size_t argb_size = guac_mem_ckd_mul_or_die(sizeof(uint32_t), width, height);
+    if (argb_size > encoder->argb_size) {
+        guac_mem_free(encoder->argb);
+        encoder->argb = guac_mem_alloc(argb_size);
+        encoder->argb_size = argb_size;
     }
+
+    picture.argb = encoder->argb;
+    picture.argb_stride = width;
+
+    /* Init writer */
     picture.writer = guac_webp_stream_write;
     picture.custom_ptr = &writer;
     guac_webp_stream_writer_init(&writer, socket, stream);
@@ -223,7 +262,7 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     for (y = 0; y < height; y++) {
 
         /* Get pixels at start of each row */
-        uint32_t* src = (uint32_t*) data;
+        const uint32_t* src = (const uint32_t*) data;
         uint32_t* dst = argb_output;
 
         /* For each pixel in row */
@@ -231,7 +270,7 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
 
             /* Pull pixel data, removing alpha channel if necessary */
             uint32_t src_pixel = *src;
-            if (format != CAIRO_FORMAT_ARGB32)
+            if (!alpha)
                 src_pixel |= 0xFF000000;
 
             /* Store converted pixel data */
@@ -262,3 +301,46 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
 
 }
 
+int guac_webp_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless) {
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Invalid Cairo image format. Unable to create WebP.";
+        return -1;
+    }
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    guac_webp_encoder* encoder = guac_webp_encoder_alloc();
+    int retval = guac_webp_write_data(encoder, socket, stream, data, width,
+            height, stride, format == CAIRO_FORMAT_ARGB32, quality, lossless);
+    guac_webp_encoder_free(encoder);
+
+    return retval;
+
+}
+
+guac_webp_encoder* guac_webp_encoder_alloc() {
+    return guac_mem_zalloc(sizeof(guac_webp_encoder));
+}
+
+void guac_webp_encoder_free(guac_webp_encoder* encoder) {
+    guac_mem_free(encoder->argb);
+    guac_mem_free(encoder);
+}
+
+int guac_webp_write_raw(guac_webp_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, int quality, int lossless) {
+    return guac_webp_write_data(encoder, socket, stream, data, width, height,
+            stride, 0, quality, lossless);
+}
+
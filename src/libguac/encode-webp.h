@@ -27,6 +27,48 @@
 
 #include <cairo/cairo.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Reusable state for encoding WebP images. Reusing the same encoder for
+ * multiple images avoids reallocating the buffer that image data is
+ * converted into before encoding. An encoder may only be used by one thread
+ * at a time.
+ */
+typedef struct guac_webp_encoder {
+
+    /**
+     * Buffer of 32-bit ARGB pixels that image data is converted into prior
+     * to encoding, or NULL if no such buffer has yet been allocated.
+     */
+    uint32_t* argb;
+
+    /**
+     * The size of the argb buffer, in bytes.
+     */
+    size_t argb_size;
+
+} guac_webp_encoder;
+
+/**
+ * Allocates a new guac_webp_encoder that can be used to encode any number of
+ * WebP images with guac_webp_write_raw(). The encoder must eventually be
+ * freed with guac_webp_encoder_free().
+ *
+ * @return
+ *     A newly-allocated guac_webp_encoder.
+ */
+guac_webp_encoder* guac_webp_encoder_alloc();
+
+/**
+ * Frees the given guac_webp_encoder and all associated resources.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_webp_encoder_free(guac_webp_encoder* encoder);
+
 /**
  * Encodes the given surface as a WebP, and sends the resulting data over the
  * given stream and socket as blobs.
@@ -55,4 +97,49 @@
 int guac_webp_write(guac_socket* socket, guac_stream* stream,
         cairo_surface_t* surface, int quality, int lossless);
 
+/**
+ * Encodes the given opaque image data as a WebP, and sends the resulting data
+ * over the given stream and socket as blobs. The image data is read in place,
+ * without first being wrapped in a Cairo surface.
+ *
+ * @param encoder
+ *     The encoder to use, which may have been used for any number of
+ *     previous images.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param data
+ *     The image data to encode, in the same format as CAIRO_FORMAT_RGB24 (32
+ *     bits per pixel, with the upper 8 bits unused).
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes between the start of each row of image data and
+ *     the start of the next row.
+ *
+ * @param quality
+ *     The WebP image quality to use. For lossy images, larger values indicate
+ *     improving quality at the expense of larger file size. For lossless
+ *     images, this dictates the quality of compression, with larger values
+ *     producing smaller files at the expense of speed.
+ *
+ * @param lossless
+ *     Zero for a lossy image, non-zero for lossless.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_webp_write_raw(guac_webp_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, const unsigned char* data, int width, int height,
+        int stride, int quality, int lossless);
+
 #endif
@@ -102,6 +102,37 @@ struct guac_audio_stream {
      */
     int bps;
 
+    /**
+     * The bitrate, in bits per second, that encoders producing compressed
+     * audio should target, or zero to use the encoder's default. Encoders
+     * which do not compress audio ignore this value. This may be changed at
+     * any time, taking effect as further PCM data is written.
+     */
+    int bitrate;
+
+    /**
+     * The duration of audio, in milliseconds, that encoders should encode
+     * within each frame or packet, or zero to use the duration hinted by the
+     * client (see hinted_frame_duration), if any, or otherwise the encoder's
+     * default. Shorter frames reduce latency at the cost of additional
+     * bandwidth. Encoders which do not divide audio into frames, or which
+     * support only certain durations, ignore, clamp, or round this value.
+     * This may be changed at any time, taking effect as further PCM data is
+     * written.
+     */
+    int frame_duration;
+
+    /**
+     * The duration of audio, in milliseconds, that the user whose declared
+     * audio support determined the encoder of this stream has requested be
+     * encoded within each frame or packet, or zero if no such duration was
+     * requested. Users request a duration by including a "frame-duration"
+     * parameter within a mimetype declared during the handshake, such as
+     * "audio/L16;frame-duration=20". This value is used only if
+     * frame_duration is zero.
+     */
+    int hinted_frame_duration;
+
     /**
      * Encoder-specific state data.
      */
@@ -32,6 +32,14 @@
  */
 #define GUAC_CLIENT_MAX_STREAMS 512
 
+/**
+ * The maximum number of bytes of startup phase timings that will be recorded
+ * for any one guac_client (see guac_client_startup_phase()), including the
+ * null terminator. Phases recorded beyond this limit are omitted from the
+ * startup summary.
+ */
+#define GUAC_CLIENT_STARTUP_PHASES_SIZE 512
+
 /**
  * The index of a closed stream.
  */
@@ -42,6 +50,25 @@
  */
 #define GUAC_CLIENT_ID_PREFIX '$'
 
+/**
+ * The character prefix which identifies a resume token (see
+ * guac_client_issue_resume_token()).
+ */
+#define GUAC_CLIENT_RESUME_TOKEN_PREFIX '!'
+
+/**
+ * The number of milliseconds after a user leaves the connection that the
+ * resume token issued to that user remains valid.
+ */
+#define GUAC_CLIENT_RESUME_TOKEN_TIMEOUT 30000
+
+/**
+ * The maximum number of resume tokens of users that have left the connection
+ * that will be retained at any one time. If further users leave, the tokens
+ * closest to expiring are discarded to make room.
+ */
+#define GUAC_CLIENT_MAX_RESUME_TOKENS 64
+
 /**
  * The flag set in the mouse button mask when the left mouse button is down.
  */
@@ -180,6 +180,49 @@ struct guac_client {
      */
     guac_user* __users;
 
+    /**
+     * Open-addressed hash table of all users within the __users list, keyed
+     * by the address of each user, allowing user pointers to be validated
+     * without walking the list. Empty slots are NULL. This table is allocated
+     * when the first user is promoted from the pending users list, and must
+     * only be accessed while holding __users_lock.
+     */
+    guac_user** __user_index;
+
+    /**
+     * The number of slots within __user_index. This is always zero or a
+     * power of two.
+     */
+    int __user_index_size;
+
+    /**
+     * The number of users stored within __user_index.
+     */
+    int __user_index_length;
+
+    /**
+     * Immutable snapshot of the __users list, replaced each time users are
+     * promoted or removed, allowing guac_client_foreach_user() to iterate all
+     * connected users without acquiring __users_lock. This will be NULL until
+     * the first user is promoted from the pending users list, and must only
+     * be accessed while holding __user_snapshot_lock.
+     */
+    struct guac_client_user_snapshot* __user_snapshot;
+
+    /**
+     * Lock which is acquired when the current snapshot of connected users is
+     * being replaced, or when a reference to any snapshot is being acquired
+     * or released.
+     */
+    pthread_mutex_t __user_snapshot_lock;
+
+    /**
+     * Condition which is signalled whenever a reference to a snapshot of
+     * connected users is released, allowing the removal of a user to wait
+     * until no thread is still iterating a snapshot containing that user.
+     */
+    pthread_cond_t __user_snapshot_released;
+
     /**
      * Lock which is acquired when the pending users list is being manipulated,
      * or iterated, or when checking/altering the
@@ -208,6 +251,20 @@ struct guac_client {
      */
     guac_user* __pending_users;
 
+    /**
+     * The time at which the least recently joined user within the pending
+     * users list joined, if that list is non-empty. The __pending_users_lock
+     * must be acquired before checking or altering this value.
+     */
+    guac_timestamp __pending_users_first_joined;
+
+    /**
+     * The time at which the most recently joined user within the pending
+     * users list joined, if that list is non-empty. The __pending_users_lock
+     * must be acquired before checking or altering this value.
+     */
+    guac_timestamp __pending_users_last_joined;
+
     /**
      * The user that first created this connection. This user will also have
      * their "owner" flag set to a non-zero value. If the owner has left the
@@ -311,6 +368,103 @@ struct guac_client {
      */
     void* __plugin_handle;
 
+    /**
+     * Lock which must be held while recording startup phases or checking
+     * whether startup has completed.
+     */
+    pthread_mutex_t __startup_lock;
+
+    /**
+     * The time at which this client was allocated, from which the total
+     * startup time of the connection is measured.
+     */
+    guac_timestamp __startup_start;
+
+    /**
+     * The time at which the most recent startup phase ended, or at which this
+     * client was allocated if no phase has yet ended.
+     */
+    guac_timestamp __startup_last;
+
+    /**
+     * The names and durations of all startup phases that have ended so far,
+     * formatted as space-separated "NAME=DURATIONms" pairs.
+     */
+    char __startup_phases[GUAC_CLIENT_STARTUP_PHASES_SIZE];
+
+    /**
+     * Non-zero if startup of the connection has completed and the startup
+     * summary has been logged, zero otherwise.
+     */
+    int __startup_complete;
+
+    /**
+     * Lock which must be held while issuing, retaining, or claiming resume
+     * tokens, or while accessing __layers_freed.
+     */
+    pthread_mutex_t __resume_tokens_lock;
+
+    /**
+     * The time that a layer of this client was most recently freed with
+     * guac_client_free_layer(), or zero if no layer has yet been freed. Views
+     * of the display from any earlier frame may still contain that layer,
+     * and so cannot be resumed. This must only be accessed while holding
+     * __resume_tokens_lock.
+     */
+    guac_timestamp __layers_freed;
+
+    /**
+     * Array of GUAC_CLIENT_MAX_RESUME_TOKENS resume tokens of users that have
+     * left this connection, each of which may be claimed by a user rejoining
+     * the connection until it expires (see guac_client_claim_resume_token()).
+     * This will be NULL until the first user having a resume token leaves,
+     * and must only be accessed while holding __resume_tokens_lock.
+     */
+    struct guac_client_resume_token* __resume_tokens;
+
+    /**
+     * The socket of a session recording of this client which is maintaining
+     * a keyframe index, as set by guac_recording_create(), or NULL if no such
+     * recording exists. Each guac_display of this client periodically writes
+     * a snapshot of its full state to that index. This socket is freed along
+     * with the socket of the client itself.
+     */
+    guac_socket* __recording_index;
+
+    /**
+     * The socket of a session recording of this client which is divided into
+     * segments, as set by guac_recording_create(), or NULL if no such
+     * recording exists. Each guac_display of this client writes a snapshot of
+     * its full state to that recording at the start of each new segment.
+     * This socket is freed along with the socket of the client itself.
+     */
+    guac_socket* __recording_segments;
+
+    /**
+     * The socket of a session recording of this client which receives its
+     * own, lower-quality copy of all image data sent by each guac_display of
+     * this client, as set by guac_recording_create() if
+     * guac_recording_set_default_image_quality() has been used, or NULL if
+     * no such recording exists. All other output is copied to this socket
+     * via the socket of the client as usual. This socket is freed along with
+     * the socket of the client itself.
+     */
+    guac_socket* __recording_output;
+
+    /**
+     * The socket that sends output to all connected users but NOT to the
+     * recording at __recording_output, or NULL if __recording_output is NULL.
+     * This socket is freed along with the socket of the client itself.
+     */
+    guac_socket* __recording_live_socket;
+
+    /**
+     * The maximum JPEG quality of image data sent to the recording at
+     * __recording_output, between 1 and 100 inclusive. This value is only
+     * meaningful if __recording_output is non-NULL.
+     */
+    int __recording_image_quality;
+
 };
 
 /**
@@ -321,6 +475,35 @@ struct guac_client {
  */
 guac_client* guac_client_alloc();
 
+/**
+ * Records that the given phase of connection startup has just ended, such as
+ * loading the protocol plugin or establishing the TCP connection to the
+ * remote desktop server. The duration of the phase is measured from the end
+ * of the previous phase, or from the allocation of the client if this is the
+ * first phase. Phases ending after startup has completed (see
+ * guac_client_startup_complete()) are ignored. This function is threadsafe.
+ *
+ * @param client
+ *     The guac_client whose connection is starting.
+ *
+ * @param phase
+ *     A short name for the phase that has just ended, consisting only of
+ *     lowercase letters, digits, and underscores, such as "tcp_connect".
+ */
+void guac_client_startup_phase(guac_client* client, const char* phase);
+
+/**
+ * Records that startup of the connection of the given client has completed,
+ * logging a single line summarizing the duration of each startup phase
+ * recorded with guac_client_startup_phase() and the total startup time. Calls
+ * after the first for the same client have no effect. This function is
+ * threadsafe.
+ *
+ * @param client
+ *     The guac_client whose connection has finished starting.
+ */
+void guac_client_startup_complete(guac_client* client);
+
 /**
  * Free all resources associated with the given client.
  *
@@ -422,7 +605,10 @@ void guac_client_free_buffer(guac_client* client, guac_layer* layer);
 
 /**
  * Returns the given layer to the pool of available layers, such that it
- * can be reused by any subsequent call to guac_client_allow_layer().
+ * can be reused by any subsequent call to guac_client_allow_layer(). Any
+ * client-side copy of the layer should already have been disposed, as views
+ * of the display from earlier frames can no longer be resumed (see
+ * guac_client_claim_resume_token()).
  *
  * @param client The proxy client to return the layer to.
  * @param layer The buffer to return to the pool of available layer.
@@ -500,6 +686,55 @@ void guac_client_remove_user(guac_client* client, guac_user* user);
 void guac_client_foreach_user(guac_client* client,
         guac_user_callback* callback, void* data);
 
+/**
+ * Issues a resume token to the given user, which is joining the connection of
+ * the given client. Once the user leaves, the token remains valid for
+ * GUAC_CLIENT_RESUME_TOKEN_TIMEOUT milliseconds, during which it may be
+ * presented by a user rejoining the same connection to resume the view of the
+ * display that the original user had when leaving, rather than receiving the
+ * full state of the display (see guac_client_claim_resume_token()). Only one
+ * token is ever issued to any one user, and repeated calls for the same user
+ * return the same token. This function is threadsafe.
+ *
+ * @param client
+ *     The client that the user is joining.
+ *
+ * @param user
+ *     The user to issue a resume token to.
+ *
+ * @return
+ *     The resume token issued to the user, which remains owned by the user,
+ *     or NULL if a token could not be generated.
+ */
+const char* guac_client_issue_resume_token(guac_client* client,
+        guac_user* user);
+
+/**
+ * Claims the given resume token, previously issued with
+ * guac_client_issue_resume_token() to a user that has since left the
+ * connection of the given client, on behalf of a user rejoining that
+ * connection. Each token may be claimed only once, regardless of whether the
+ * timestamp provided is valid. This function is threadsafe.
+ *
+ * @param client
+ *     The client that the user is rejoining.
+ *
+ * @param token
+ *     The resume token presented by the rejoining user.
+ *
+ * @param timestamp
+ *     The timestamp of the last frame that the rejoining user received while
+ *     previously connected.
+ *
+ * @return
+ *     The given timestamp, if the token is valid and has not expired and the
+ *     timestamp refers to a frame sent while the token was held, such that
+ *     the view of the display of the rejoining user may be resumed from that
+ *     frame, or zero otherwise.
+ */
+guac_timestamp guac_client_claim_resume_token(guac_client* client,
+        const char* token, guac_timestamp timestamp);
+
 /**
  * Calls the given function on all pending users of the given client. The
  * function will be given a reference to a guac_user and the specified
@@ -49,6 +49,21 @@
  */
 #define GUAC_DISPLAY_LAYER_RAW_BPP 4
 
+/**
+ * The number of buckets within the histogram of image encoding times
+ * maintained for each process (see guac_display_get_process_stats()). Each
+ * bucket except the last covers encoding times up to twice the upper bound
+ * of the previous bucket, starting with GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND.
+ * The last bucket covers all longer encoding times.
+ */
+#define GUAC_DISPLAY_STATS_ENCODE_BUCKETS 12
+
+/**
+ * The upper bound of the first bucket of the histogram of image encoding
+ * times, in nanoseconds.
+ */
+#define GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND 125000
+
 /**
  * @}
  */
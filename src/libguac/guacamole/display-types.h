@@ -69,6 +69,12 @@ typedef struct guac_display_layer_cairo_context guac_display_layer_cairo_context
  */
 typedef struct guac_display_layer_raw_context guac_display_layer_raw_context;
 
+/**
+ * Counters describing the graphical updates encoded by all guac_display
+ * instances of the current process.
+ */
+typedef struct guac_display_stats guac_display_stats;
+
 /**
  * Pre-defined mouse cursor graphics.
  */
@@ -49,6 +49,7 @@
 #include "socket.h"
 
 #include <cairo/cairo.h>
+#include <stdint.h>
 #include <unistd.h>
 
 /**
@@ -114,6 +115,36 @@ struct guac_display_layer_cairo_context {
 
 };
 
+struct guac_display_stats {
+
+    /**
+     * The total number of frames encoded and sent by all displays.
+     */
+    uint64_t frames;
+
+    /**
+     * The number of operations currently queued for the worker threads of
+     * all displays, but not yet performed.
+     */
+    uint64_t pending_operations;
+
+    /**
+     * The total number of image updates encoded by all displays, grouped by
+     * the time taken to encode each update. The upper bound of bucket N,
+     * other than the last bucket, is GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND << N
+     * nanoseconds. Each update is counted only within the first bucket that
+     * covers its encoding time.
+     */
+    uint64_t encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS];
+
+    /**
+     * The total time spent encoding all image updates counted by encodes, in
+     * nanoseconds.
+     */
+    uint64_t encode_time;
+
+};
+
 struct guac_display_layer_raw_context {
 
     /**
@@ -173,7 +204,9 @@ struct guac_display_layer_raw_context {
      * A rectangle covering the region of the guac_display_layer that has
      * changed since the last frame. This rectangle is initially empty and must
      * be manually updated to cover any additional changed regions before
-     * closing the guac_display_layer_raw_context.
+     * closing the guac_display_layer_raw_context. Callers that modify many
+     * small, scattered regions should instead report those regions
+     * individually with guac_display_layer_mark_dirty().
      */
     guac_rect dirty;
 
@@ -189,6 +222,57 @@ struct guac_display_layer_raw_context {
 
 };
 
+/**
+ * Sets the number of worker threads that each guac_display allocated by the
+ * current process from this point forward will use to encode graphical
+ * updates. By default, one worker thread is used for each processor
+ * available to the current process, taking into account CPU affinity and any
+ * cgroup CPU quota. This is the greatest number of worker threads that each
+ * guac_display may use. Each guac_display starts with fewer worker threads,
+ * adding more only while graphical updates are backing up, and those worker
+ * threads terminate again while the display is idle (see
+ * guac_display_set_worker_threads()).
+ *
+ * @param count
+ *     The greatest number of worker threads each new guac_display should use,
+ *     or zero to derive the number of worker threads from the available
+ *     processors.
+ */
+void guac_display_set_default_worker_threads(int count);
+
+/**
+ * Sets whether each guac_display allocated by the current process from this
+ * point forward should use a pool of worker threads shared by all such
+ * displays, rather than worker threads of its own. Shared worker threads
+ * perform the operations of each display in turn, such that a busy display
+ * cannot starve the others, and keep the total number of threads bounded
+ * regardless of the number of displays.
+ *
+ * The shared pool is started when first needed, with the number of threads
+ * that display would otherwise have used (see
+ * guac_display_set_default_worker_threads()), and its threads persist until
+ * the process terminates. As with any threads, the shared pool is not
+ * inherited by child processes created with fork(). By default, each
+ * guac_display uses its own worker threads.
+ *
+ * @param shared
+ *     Non-zero if new displays should use the shared pool of worker
+ *     threads, zero if each new display should use its own worker threads.
+ */
+void guac_display_set_shared_workers(int shared);
+
+/**
+ * Retrieves counters describing the graphical updates encoded by all
+ * guac_display instances of the current process, including displays that
+ * have since been freed. The counters are maintained independently and are
+ * not copied atomically with respect to each other.
+ *
+ * @param stats
+ *     The guac_display_stats structure that should receive the current values
+ *     of the counters.
+ */
+void guac_display_get_process_stats(guac_display_stats* stats);
+
 /**
  * Allocates a new guac_display representing the remote display shared by all
  * connected users of the given guac_client. The dimensions of the display
@@ -251,6 +335,12 @@ void guac_display_free(guac_display* display);
  * new users join a particular guac_client, this function should be used to
  * synchronize those users with the current display state.
  *
+ * If the given socket is the pending_socket of the guac_client and any
+ * pending users are resuming a previous view of the display (see the
+ * resume_timestamp member of guac_user_info), each pending user is instead
+ * synchronized individually over its own socket, with resuming users sent
+ * only the changes made since the frame they are resuming from.
+ *
  * @param display
  *     The display that should be synchronized to all users at the other end of
  *     the given guac_socket.
@@ -260,6 +350,178 @@ void guac_display_free(guac_display* display);
  */
 void guac_display_dup(guac_display* display, guac_socket* socket);
 
+/**
+ * Sets the maximum amount of memory that the given guac_display may use to
+ * cache the contents of recently-sent regions of the display. Regions that
+ * are sent again while still cached (such as when switching between windows)
+ * are restored from off-screen buffers on the client side rather than resent
+ * as new image data. This same amount of memory will be used by each
+ * connected client. By default, 4 MiB of memory is used.
+ *
+ * @param display
+ *     The guac_display whose cache size should be set.
+ *
+ * @param size
+ *     The maximum amount of memory that may be used for caching, in bytes.
+ *     If zero, caching is disabled and any previously-cached regions are
+ *     released.
+ */
+void guac_display_set_cache_size(guac_display* display, size_t size);
+
+/**
+ * Sets whether image updates to opaque layers that are sent as PNG should
+ * include only the pixels that changed since the previous frame. Unchanged
+ * pixels are made transparent, such that the existing contents of the layer
+ * show through, and such that those pixels compress to almost nothing. This
+ * greatly reduces the size of updates in which only a small part of the
+ * updated region has actually changed (such as editing text), at the cost of
+ * retaining a copy of the previous contents of each update while it is
+ * being encoded. Delta updates are disabled by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param enabled
+ *     Non-zero if delta updates should be used, zero otherwise.
+ */
+void guac_display_set_delta_updates(guac_display* display, int enabled);
+
+/**
+ * Sets whether connected users that are lagging significantly behind should
+ * be sent image data separately from all other users. If enabled, users
+ * whose combined network round-trip time and processing lag is low (such as
+ * users on the local network) always receive lossless image data, while
+ * lagging users continue to receive whatever lossy image data is best suited
+ * to their connection. Otherwise, all users receive the same image data,
+ * chosen to suit the most lagging user. Separate image data is sent only
+ * while users of both kinds are connected, and only for updates that would
+ * otherwise be lossy. Tiered encoding is disabled by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param enabled
+ *     Non-zero if lagging users should be sent image data separately, zero
+ *     otherwise.
+ */
+void guac_display_set_tiered_encoding(guac_display* display, int enabled);
+
+/**
+ * Sets how long a layer must remain unchanged before the server-side copy of
+ * its previous frame is released. The display normally keeps two copies of
+ * the contents of each layer: the pending contents being drawn, and the
+ * contents last sent to connected clients. While a layer is unchanged, these
+ * copies are identical, and releasing the latter halves the memory used by
+ * that layer. The copy is restored automatically the next time the layer is
+ * drawn to. Idle layers are checked for release each time a frame is
+ * flushed. Layers that have never been drawn to never require a separate copy
+ * regardless of this setting. Idle release is disabled by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param timeout
+ *     The number of milliseconds that a layer must remain unchanged before
+ *     its copy of the previous frame is released, or zero to never release
+ *     such copies.
+ */
+void guac_display_set_idle_release_timeout(guac_display* display, int timeout);
+
+/**
+ * Sets how long a region that was sent to connected clients at reduced
+ * quality (as JPEG or lossy WebP) must remain unchanged before it is resent
+ * losslessly. Such lossless refinements are sent only while no newer frame is
+ * waiting and no data sent previously is still queued due to limited
+ * bandwidth, such that lossy compression of content in motion does not leave
+ * compression artifacts behind once that content stops moving. Refinement
+ * occurs after GUAC_DISPLAY_DEFAULT_REFINEMENT_DELAY milliseconds by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param delay
+ *     The number of milliseconds that a region sent at reduced quality must
+ *     remain unchanged before it is resent losslessly, or zero to never
+ *     resend such regions.
+ */
+void guac_display_set_refinement_delay(guac_display* display, int delay);
+
+/**
+ * Sets the bounds on the number of worker threads that the given display may
+ * use to encode graphical updates. The display starts with the minimum number
+ * of worker threads, doubling the number of worker threads each time frames
+ * consistently arrive faster than they can be encoded, up to the maximum.
+ * Worker threads beyond the minimum terminate again after the display has
+ * been idle for a period of time. By default, a display uses between one and
+ * the number of worker threads set with
+ * guac_display_set_default_worker_threads().
+ *
+ * The maximum cannot exceed the number of worker threads set with
+ * guac_display_set_default_worker_threads(), and is reduced to that number if
+ * larger. Worker threads already running in excess of a reduced maximum
+ * terminate once they are next idle. If the display uses the worker threads
+ * shared by all displays (see guac_display_set_shared_workers()), this
+ * function has no effect.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param min
+ *     The fewest worker threads that the display should keep running while
+ *     idle, or zero to keep only a single worker thread running.
+ *
+ * @param max
+ *     The most worker threads that the display may use, or zero to allow as
+ *     many worker threads as set with
+ *     guac_display_set_default_worker_threads().
+ */
+void guac_display_set_worker_threads(guac_display* display, int min, int max);
+
+/**
+ * Sets how often a summary of where the time of each frame was spent, and of
+ * the format, size, and encoding cost of the image updates sent, should be
+ * logged at the "debug" level. The summary covers all frames since the
+ * previous summary, and is logged as frames end, once the given interval has
+ * elapsed. Periodic summaries are disabled by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param interval
+ *     The number of milliseconds between summaries, or zero to disable
+ *     periodic summaries.
+ */
+void guac_display_set_trace_interval(guac_display* display, int interval);
+
+/**
+ * Sets the destination of a machine-readable stream of trace records
+ * describing each frame and image update. Each record is a single line
+ * containing a JSON object whose "type" property is either "frame" (the
+ * sequence number, timestamp, and bytes sent for a frame, as well as the time
+ * spent within each phase of that frame, in nanoseconds) or "op" (the frame,
+ * format, number of pixels, number of bytes, and encoding time in nanoseconds
+ * of a single image update). If the given path refers to an existing Unix
+ * domain socket, the stream is written to a connection to that socket.
+ * Otherwise, the stream is appended to the file at the given path, creating
+ * that file if necessary. Any previous trace stream is closed. If the stream
+ * later cannot be written, it is closed and a warning is logged. No trace
+ * stream is written by default.
+ *
+ * @param display
+ *     The display to configure.
+ *
+ * @param path
+ *     The path of the Unix domain socket or file that should receive the
+ *     trace stream, or NULL to stop writing any trace stream.
+ *
+ * @return
+ *     Zero if the trace stream was successfully opened (or closed, if the
+ *     given path is NULL), non-zero otherwise. If an error occurs, guac_error
+ *     and guac_error_message are set appropriately, and any previous trace
+ *     stream remains open.
+ */
+int guac_display_set_trace_output(guac_display* display, const char* path);
+
 /**
  * Notifies the given guac_display that a specific user has left the connection
  * and need no longer be considered for future updates/events. This SHOULD
@@ -634,6 +896,178 @@ void guac_display_layer_resize(guac_display_layer* layer, int width, int height)
  */
 guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer* layer);
 
+/**
+ * Marks the given rectangle of the given layer as having been modified within
+ * the current pending frame. This is an alternative to updating the dirty
+ * rect of an open raw or Cairo context, and should be preferred for callers
+ * that may report many small, scattered updates within the same frame. Only
+ * the 64x64 cells touched by regions marked with this function are compared
+ * against the previous frame, whereas everything within the dirty rect of a
+ * context is compared regardless of which parts were actually modified.
+ *
+ * This function may be called regardless of whether a raw or Cairo context is
+ * currently open for the layer.
+ *
+ * @param layer
+ *     The layer that was modified.
+ *
+ * @param rect
+ *     The region of the layer that was modified. Any part of this region that
+ *     is outside the bounds of the layer is ignored.
+ */
+void guac_display_layer_mark_dirty(guac_display_layer* layer, const guac_rect* rect);
+
+/**
+ * Hints that the given rectangle of the given layer, as of the previous
+ * frame, has been copied to the given position within the current pending
+ * frame. Where the hinted copy is verified to be accurate, the destination is
+ * sent as a single copy from the previous frame, and the costly search for
+ * copies and scrolling that would otherwise be performed for the layer is
+ * skipped for the current frame. Hints that turn out to be inaccurate (for
+ * example, if the copied region was modified beforehand) are ignored and do
+ * not affect correctness. The destination must still be marked as modified
+ * as usual, such as with guac_display_layer_mark_dirty().
+ *
+ * This function may be called regardless of whether a raw or Cairo context is
+ * currently open for the layer.
+ *
+ * @param layer
+ *     The layer that the copy occurred within.
+ *
+ * @param src
+ *     The region of the layer that was copied, as of the previous frame.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination of the
+ *     copy.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination of the
+ *     copy.
+ */
+void guac_display_layer_hint_copy(guac_display_layer* layer,
+        const guac_rect* src, int x, int y);
+
+/**
+ * Hints that the given rectangle of the given source layer or buffer, as of
+ * the previous frame, has been copied to the given position within the
+ * current pending frame of the given layer. This behaves identically to
+ * guac_display_layer_hint_copy(), except that the source of the copy may be
+ * any layer or buffer of the same display, such as an off-screen buffer
+ * mirroring a cached image that has already been sent. A copy from a source
+ * that was itself modified within the current frame is verified against (and
+ * sent from) the previous contents of that source. Hinted copies from a
+ * source having an alpha channel are applied only if the receiving layer also
+ * has an alpha channel, in which case the copy replaces the destination
+ * exactly rather than being composited over it.
+ *
+ * This function may be called regardless of whether a raw or Cairo context is
+ * currently open for either layer.
+ *
+ * @param layer
+ *     The layer that received the copy.
+ *
+ * @param src_layer
+ *     The layer or buffer that image data was copied from.
+ *
+ * @param src
+ *     The region of src_layer that was copied, as of the previous frame.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination of the
+ *     copy within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination of the
+ *     copy within the given layer.
+ */
+void guac_display_layer_hint_copy_from(guac_display_layer* layer,
+        guac_display_layer* src_layer, const guac_rect* src, int x, int y);
+
+/**
+ * Hints that a glyph, such as a single character of text, has been drawn
+ * within the current pending frame of the given layer at the given position
+ * by copying the given rectangle of the given source layer or buffer, as of
+ * the previous frame. Such a source is typically an off-screen buffer holding
+ * a copy of each glyph in use (a glyph atlas). Any 64x64 cell of the layer
+ * whose changes are entirely covered by accurate glyph hints is then sent as
+ * copies of those glyphs rather than as new image data.
+ *
+ * Unlike guac_display_layer_hint_copy_from(), which applies only to copies
+ * replacing entire cells, a glyph may be smaller than a cell, many glyphs may
+ * be hinted within each frame, and hinting glyphs does not prevent the layer
+ * from being searched for scrolling and other copies, which take precedence
+ * over any hinted glyphs. As with all other hints, hints that turn out to be
+ * inaccurate are ignored and do not affect correctness, the destination must
+ * still be marked as modified as usual, and hinted copies from a source
+ * having an alpha channel are applied only if the receiving layer also has an
+ * alpha channel.
+ *
+ * This function may be called regardless of whether a raw or Cairo context is
+ * currently open for either layer.
+ *
+ * @param layer
+ *     The layer that received the glyph.
+ *
+ * @param src_layer
+ *     The layer or buffer that the glyph was copied from.
+ *
+ * @param src
+ *     The region of src_layer containing the glyph, as of the previous frame.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination of the
+ *     glyph within the given layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination of the
+ *     glyph within the given layer.
+ */
+void guac_display_layer_hint_glyph(guac_display_layer* layer,
+        guac_display_layer* src_layer, const guac_rect* src, int x, int y);
+
+/**
+ * Hints that the given rectangle of the current pending frame of the given
+ * layer is reproduced exactly by the given image data, which has already been
+ * encoded (such as JPEG data received from a remote desktop server and
+ * decoded into the layer by the caller). If that rectangle would otherwise
+ * need to be encoded and sent, the given image data is sent as-is instead,
+ * avoiding the cost of encoding the same content again.
+ *
+ * The current contents of the rectangle are recorded when this function is
+ * invoked, and thus this function must be invoked only after the rectangle
+ * has been drawn. If the rectangle is modified in any way before the frame is
+ * flushed, the hint is ignored. Hints are also ignored for layers that are
+ * not opaque or that have been set as lossless, and for rectangles that do
+ * not lie entirely within the bounds of the layer. As the image data is sent
+ * to connected users as-is, it must be in a format that all users support,
+ * such as "image/jpeg" or "image/png".
+ *
+ * This function may be called regardless of whether a raw or Cairo context is
+ * currently open for the layer, but the rectangle must already have been
+ * drawn to the pending frame buffer itself (not merely to a replacement
+ * buffer within an open raw context).
+ *
+ * @param layer
+ *     The layer that was drawn to.
+ *
+ * @param rect
+ *     The rectangle of the layer reproduced by the given image data.
+ *
+ * @param mimetype
+ *     The mimetype of the given image data.
+ *
+ * @param data
+ *     The encoded image data. This data is copied, and need not remain valid
+ *     after this function returns.
+ *
+ * @param length
+ *     The number of bytes of encoded image data.
+ */
+void guac_display_layer_hint_image(guac_display_layer* layer,
+        const guac_rect* rect, const char* mimetype, const void* data,
+        size_t length);
+
 /**
  * Ends a drawing operation that was started with a call to
  * guac_display_layer_open_raw() and relinquishes exclusive access to the
@@ -653,6 +1087,65 @@ guac_display_layer_raw_context* guac_display_layer_open_raw(guac_display_layer*
  */
 void guac_display_layer_close_raw(guac_display_layer* layer, guac_display_layer_raw_context* context);
 
+/**
+ * Begins a drawing operation for the given region of the given layer,
+ * returning a raw context that can be used to draw directly to that region
+ * of the layer's current pending frame. Unlike guac_display_layer_open_raw(),
+ * this does not acquire exclusive access to the display. Any number of
+ * threads may draw to regions of the same or different layers concurrently,
+ * provided those regions do not touch the same 64x64 cells. Opening a region
+ * that touches cells of an open region blocks until that region is closed.
+ *
+ * The bounds of the returned context are the given region, constrained to the
+ * bounds of the layer, and the buffer must not be addressed outside those
+ * bounds. Coordinates within the buffer are relative to the layer, not the
+ * region, so the buffer may be addressed as usual with
+ * GUAC_DISPLAY_LAYER_RAW_BUFFER(). As with guac_display_layer_open_raw(), it
+ * is the responsibility of the caller to ensure the dirty rect within the
+ * returned context is updated to contain the part of the region modified.
+ * The dirty rects of all regions are merged into the pending frame once the
+ * frame ends. The buffer of the returned context must not be replaced.
+ *
+ * A thread may hold only one region at a time, and must not call any other
+ * function that acquires access to the same display (such as
+ * guac_display_layer_open_raw() or guac_display_end_frame()) until the region
+ * is closed with guac_display_layer_close_region(). Frames cannot be flushed
+ * while any region is open.
+ *
+ * @param layer
+ *     The layer to draw to.
+ *
+ * @param rect
+ *     The region of the layer to draw to.
+ *
+ * @return
+ *     A mutable graphical context containing the current raw pending frame
+ *     state of the given layer, restricted to the given region. This context
+ *     must be released with guac_display_layer_close_region().
+ */
+guac_display_layer_raw_context* guac_display_layer_open_region(
+        guac_display_layer* layer, const guac_rect* rect);
+
+/**
+ * Ends a drawing operation that was started with a call to
+ * guac_display_layer_open_region(), releasing the region such that other
+ * threads may open regions overlapping it, and freeing the given context.
+ * All graphical changes made within the region and recorded within the dirty
+ * rect of the context will be included in the current pending frame.
+ *
+ * This function MUST NOT be called by any thread other than the thread that
+ * called guac_display_layer_open_region() to obtain the given context.
+ *
+ * @param layer
+ *     The layer that finished being drawn to.
+ *
+ * @param context
+ *     The raw context of the drawing operation that has completed, as returned
+ *     by a previous call to guac_display_layer_open_region().
+ */
+void guac_display_layer_close_region(guac_display_layer* layer,
+        guac_display_layer_raw_context* context);
+
 /**
  * Fills a rectangle of image data within the given raw context with a single
  * color. All pixels within the rectangle are replaced with the given color. If
@@ -795,6 +1288,24 @@ void guac_display_render_thread_notify_modified(guac_display_render_thread* rend
  */
 void guac_display_render_thread_notify_frame(guac_display_render_thread* render_thread);
 
+/**
+ * Returns the amount of time that the given render thread would currently
+ * wait before sending a further frame, allowing connected clients to catch up
+ * with frames already sent. This accounts for both client-side processing lag
+ * and any data still queued due to limited bandwidth. Sources of graphical
+ * updates that can control the rate at which those updates are produced may
+ * use this value to avoid producing updates faster than they can be sent.
+ *
+ * @param render_thread
+ *     The render thread to query.
+ *
+ * @return
+ *     The amount of time that the render thread would currently wait before
+ *     sending a further frame, in milliseconds, or zero if connected clients
+ *     are keeping up with the frames sent.
+ */
+int guac_display_render_thread_get_delay(guac_display_render_thread* render_thread);
+
 /**
  * Notifies the given render thread that a specific user has changed the state
  * of the mouse, such as through moving the pointer or pressing/releasing a
@@ -0,0 +1,77 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef GUAC_MEM_TYPES_H
+#define GUAC_MEM_TYPES_H
+
+/**
+ * Type definitions related to the accounting of memory allocated by libguac
+ * and its users.
+ *
+ * @file mem-types.h
+ */
+
+/**
+ * The categories of memory that are accounted for separately by
+ * guac_mem_account_alloc() and guac_mem_account_free(). There are exactly
+ * GUAC_MEM_CATEGORY_COUNT categories, numbered consecutively from zero.
+ */
+typedef enum guac_mem_category {
+
+    /**
+     * Memory not belonging to any other category, including memory allocated
+     * with guac_mem_zalloc_pages() that has not been tagged with a category
+     * using guac_mem_tag_pages().
+     */
+    GUAC_MEM_CATEGORY_OTHER = 0,
+
+    /**
+     * The image buffers of the layers of a guac_display.
+     */
+    GUAC_MEM_CATEGORY_DISPLAY = 1,
+
+    /**
+     * The scrollback and on-screen contents of terminal emulators.
+     */
+    GUAC_MEM_CATEGORY_TERMINAL = 2,
+
+    /**
+     * The contents of clipboards.
+     */
+    GUAC_MEM_CATEGORY_CLIPBOARD = 3,
+
+    /**
+     * The buffers of session recordings.
+     */
+    GUAC_MEM_CATEGORY_RECORDING = 4,
+
+    /**
+     * The streams of connections and their users.
+     */
+    GUAC_MEM_CATEGORY_STREAM = 5
+
+} guac_mem_category;
+
+/**
+ * The number of bytes of memory currently accounted to each category
+ * (guac_mem_category) by the current process.
+ */
+typedef struct guac_mem_stats guac_mem_stats;
+
+#endif
+
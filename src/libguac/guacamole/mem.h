@@ -28,9 +28,22 @@
  * @file mem.h
  */
 
+#include "mem-constants.h"
+#include "mem-types.h"
 #include "private/mem.h"
 
 #include <stddef.h>
+#include <stdint.h>
+
+struct guac_mem_stats {
+
+    /**
+     * The number of bytes currently accounted to each category, indexed by
+     * guac_mem_category.
+     */
+    uint64_t bytes[GUAC_MEM_CATEGORY_COUNT];
+
+};
 
 /**
  * Allocates a contiguous block of memory with the specified size, returning a
@@ -90,6 +103,41 @@
         (const size_t[]) { __VA_ARGS__ }                                      \
     )
 
+/**
+ * Allocates a contiguous block of memory with the specified size and with all
+ * bytes initialized to zero, returning a pointer to the first byte of that
+ * block of memory. The block is allocated directly from the operating system
+ * in a manner suited to large, long-lived buffers that are repeatedly scanned
+ * in their entirety, such as image buffers. Where supported, the block is
+ * backed by huge pages (reducing TLB misses) and placed on the memory of the
+ * NUMA node of the calling thread (avoiding cross-node memory traffic). If
+ * either is not supported, or if the block is too small to benefit, the block
+ * is allocated normally. If multiple sizes are provided, these sizes are
+ * multiplied together to produce the final size of the new block. If memory
+ * of the specified size cannot be allocated, or if multiplying the sizes would
+ * result in integer overflow, guac_error is set appropriately and NULL is
+ * returned.
+ *
+ * IMPORTANT: Unlike the other allocation functions of libguac, the pointer
+ * returned by guac_mem_zalloc_pages() MUST be freed with a subsequent call to
+ * guac_mem_free_pages(). It MUST NOT be freed with guac_mem_free() or
+ * free(), nor resized with guac_mem_realloc().
+ *
+ * @param ...
+ *     A series of one or more size_t values that should be multiplied together
+ *     to produce the desired block size. At least one value MUST be provided.
+ *
+ * @returns
+ *     A pointer to the first byte of the allocated block of memory, or NULL if
+ *     such a block could not be allocated. If a block of memory could not be
+ *     allocated, guac_error is set appropriately.
+ */
+#define guac_mem_zalloc_pages(...) \
+    PRIV_guac_mem_zalloc_pages(                                               \
+        sizeof((const size_t[]) { __VA_ARGS__ }) / sizeof(const size_t),      \
+        (const size_t[]) { __VA_ARGS__ }                                      \
+    )
+
 /**
  * Multiplies together each of the given values, storing the result in a size_t
  * variable via the provided pointer. If the result of the multiplication
@@ -393,6 +441,17 @@
  */
 #define guac_mem_free(mem) (PRIV_guac_mem_free(mem), (mem) = NULL, (void) 0)
 
+/**
+ * Frees the memory block at the given pointer, which MUST have been allocated
+ * with guac_mem_zalloc_pages(). The pointer is automatically assigned a value
+ * of NULL after memory is freed. If the provided pointer is already NULL, this
+ * macro has no effect.
+ *
+ * @param mem
+ *     A pointer to the memory to be freed.
+ */
+#define guac_mem_free_pages(mem) (PRIV_guac_mem_free_pages(mem), (mem) = NULL, (void) 0)
+
 /**
  * Frees the memory block at the given const pointer, which MUST have been
  * allocated with guac_mem_alloc(), guac_mem_zalloc(), guac_mem_realloc(), or
@@ -409,5 +468,76 @@
  */
 #define guac_mem_free_const(mem) PRIV_guac_mem_free((void*) (mem))
 
+/**
+ * Records that a block of memory of the given size has been allocated for
+ * the given category, adding its size to the total reported for that category
+ * by guac_mem_get_process_stats(). As blocks allocated with guac_mem_alloc()
+ * and similar must remain compatible with free(), their sizes are not known
+ * to libguac and must be accounted for explicitly by the code allocating
+ * them. Each call to this function should eventually be balanced by a call
+ * to guac_mem_account_free() with the same category and size.
+ *
+ * @param category
+ *     The category of the memory allocated.
+ *
+ * @param size
+ *     The number of bytes allocated.
+ */
+void guac_mem_account_alloc(guac_mem_category category, size_t size);
+
+/**
+ * Records that a block of memory of the given size, previously accounted for
+ * with guac_mem_account_alloc(), has been freed.
+ *
+ * @param category
+ *     The category of the memory freed.
+ *
+ * @param size
+ *     The number of bytes freed.
+ */
+void guac_mem_account_free(guac_mem_category category, size_t size);
+
+/**
+ * Moves the given block of memory, which MUST have been allocated with
+ * guac_mem_zalloc_pages(), to the given category. Blocks allocated with
+ * guac_mem_zalloc_pages() are automatically accounted for under
+ * GUAC_MEM_CATEGORY_OTHER until tagged otherwise, and are automatically
+ * removed from their category when freed with guac_mem_free_pages(). If the
+ * given pointer is NULL, this function has no effect.
+ *
+ * @param mem
+ *     The block of memory to tag.
+ *
+ * @param category
+ *     The category that the block should be accounted under.
+ */
+void guac_mem_tag_pages(void* mem, guac_mem_category category);
+
+/**
+ * Retrieves the number of bytes of memory currently accounted to each
+ * category by the current process. As guacd creates a separate process for
+ * each connection, these totals describe the memory of a single connection
+ * (guac_client) when read from within a connection process. The totals are
+ * maintained independently and are not copied atomically with respect to
+ * each other.
+ *
+ * @param stats
+ *     The guac_mem_stats structure that should receive the current totals.
+ */
+void guac_mem_get_process_stats(guac_mem_stats* stats);
+
+/**
+ * Returns a short, human-readable name for the given category of memory,
+ * such as "display", suitable for inclusion within log messages and metrics.
+ *
+ * @param category
+ *     The category to return the name of.
+ *
+ * @return
+ *     The name of the given category, or "unknown" if the given value is not
+ *     a valid category.
+ */
+const char* guac_mem_category_name(guac_mem_category category);
+
 #endif
 
@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_OPCODE_H
+#define GUAC_OPCODE_H
+
+/**
+ * Provides a lookup table mapping instruction opcodes to the entries of an
+ * opcode/handler mapping array, such as the arrays used to dispatch received
+ * instructions to their handlers.
+ *
+ * @file opcode.h
+ */
+
+#include "opcode-types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of slots within the hash table of a guac_opcode_index.
+ * This must be a power of two no greater than 256, as each slot stores the
+ * position of its mapping within a single byte.
+ */
+#define GUAC_OPCODE_INDEX_MAX_SLOTS 256
+
+struct guac_opcode_index {
+
+    /**
+     * The indexed array of mappings. Each mapping must begin with the opcode
+     * of that mapping as a "char*" or "const char*", and the array must be
+     * terminated by a mapping having a NULL opcode.
+     */
+    const void* map;
+
+    /**
+     * The size of each mapping within the indexed array, in bytes.
+     */
+    size_t stride;
+
+    /**
+     * The number of non-terminating mappings within the indexed array.
+     */
+    int length;
+
+    /**
+     * The seed of the hash function which maps each indexed opcode to its own
+     * slot within the hash table, without collisions.
+     */
+    uint32_t seed;
+
+    /**
+     * The number of slots within the hash table, minus one, or zero if no
+     * collision-free hash function could be found for the indexed opcodes, in
+     * which case opcodes are located by searching the array of mappings
+     * linearly.
+     */
+    unsigned int mask;
+
+    /**
+     * The hash table, where each slot contains the position of the mapping
+     * whose opcode hashes to that slot plus one, or zero if no opcode hashes
+     * to that slot.
+     */
+    unsigned char slots[GUAC_OPCODE_INDEX_MAX_SLOTS];
+
+};
+
+/**
+ * Builds an index of the given NULL-terminated array of opcode/handler
+ * mappings, searching for a seeded hash function that maps each opcode within
+ * the array to its own slot. The array must not be modified while the index
+ * is in use. If no such hash function can be found (such as when the array
+ * contains duplicate opcodes or more than 255 mappings), the index remains
+ * usable but falls back to searching the array linearly. Building an index is
+ * comparatively expensive and should be done once, such as via
+ * pthread_once(), with each lookup thereafter being inexpensive and
+ * threadsafe.
+ *
+ * @param index
+ *     The guac_opcode_index to initialize.
+ *
+ * @param map
+ *     The array of mappings to index. Each mapping must begin with the opcode
+ *     of that mapping as a "char*" or "const char*", and the array must be
+ *     terminated by a mapping having a NULL opcode.
+ *
+ * @param stride
+ *     The size of each mapping within the array, in bytes. This will
+ *     typically be the sizeof() the mapping structure.
+ *
+ * @return
+ *     Zero if a collision-free hash function was found for the opcodes
+ *     within the array, non-zero if lookups will instead search the array
+ *     linearly.
+ */
+int guac_opcode_index_init(guac_opcode_index* index, const void* map,
+        size_t stride);
+
+/**
+ * Returns the position of the mapping having the given opcode within the
+ * array of mappings indexed by the given guac_opcode_index. If multiple
+ * mappings have the same opcode, the position of the first such mapping is
+ * returned.
+ *
+ * @param index
+ *     The guac_opcode_index to search, which must have been initialized with
+ *     guac_opcode_index_init().
+ *
+ * @param opcode
+ *     The opcode to search for.
+ *
+ * @return
+ *     The position of the mapping having the given opcode within the indexed
+ *     array, or -1 if no such mapping exists.
+ */
+int guac_opcode_index_lookup(const guac_opcode_index* index,
+        const char* opcode);
+
+#endif
+
@@ -31,6 +31,23 @@
  */
 #define GUAC_INSTRUCTION_MAX_LENGTH 8192
 
+/**
+ * The maximum number of characters per instruction for users that have
+ * negotiated support for larger blobs during the handshake (see
+ * GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH). This must be large enough to contain
+ * a blob of GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH bytes encoded as base64.
+ *
+ * @see guac_parser_set_max_length()
+ */
+#define GUAC_INSTRUCTION_LARGE_MAX_LENGTH 98304
+
+/**
+ * The number of bytes of instruction buffer allocated by guac_parser for each
+ * character of the maximum instruction length, allowing for every character
+ * to be a 4-byte UTF-8 character.
+ */
+#define GUAC_INSTRUCTION_BUFFER_RATIO 4
+
 /**
  * The maximum number of digits to allow per length prefix.
  */
@@ -83,7 +83,36 @@ struct guac_parser {
      * provided as a convenience to be used to buffer instructions until
      * those instructions are complete and ready to be parsed.
      */
-    char __instructionbuf[32768];
+    char* __instructionbuf;
+
+    /**
+     * The size of the instruction buffer, in bytes.
+     */
+    int __instructionbuf_size;
+
+    /**
+     * The maximum number of characters allowed within any element of an
+     * instruction. By default, this is GUAC_INSTRUCTION_MAX_LENGTH.
+     */
+    int __max_length;
+
+    /**
+     * Whether elements containing raw binary data are accepted, as enabled
+     * with guac_parser_enable_binary().
+     */
+    int __binary;
+
+    /**
+     * Whether the current element contains raw binary data, in which case
+     * __element_length is a number of bytes rather than characters.
+     */
+    int __element_binary;
+
+    /**
+     * The number of bytes within each currently parsed element if that
+     * element contains raw binary data, or -1 for elements containing text.
+     */
+    int __binary_lengths[GUAC_INSTRUCTION_MAX_ELEMENTS];
 
 };
 
@@ -111,6 +140,66 @@ guac_parser* guac_parser_alloc();
  */
 int guac_parser_append(guac_parser* parser, void* buffer, int length);
 
+/**
+ * Raises the maximum number of characters allowed within any element of the
+ * instructions read by the given parser, growing the parser's internal buffer
+ * as necessary. The limit is never lowered; if the given length is not
+ * greater than the current limit, this function has no effect. Any data
+ * already buffered by the parser is preserved.
+ *
+ * As the parser's internal buffer may be reallocated, any pointers to the
+ * elements of a completed instruction that were obtained prior to calling
+ * this function become invalid. The opcode and argv members of the parser
+ * itself are updated accordingly and remain valid.
+ *
+ * @param parser
+ *     The parser whose maximum instruction length should be raised.
+ *
+ * @param length
+ *     The new maximum number of characters allowed within any element of an
+ *     instruction, such as GUAC_INSTRUCTION_LARGE_MAX_LENGTH.
+ *
+ * @return
+ *     Zero on success, or non-zero if the parser's buffer could not be
+ *     grown, in which case guac_error will be set appropriately and the
+ *     parser remains usable with its previous limit.
+ */
+int guac_parser_set_max_length(guac_parser* parser, int length);
+
+/**
+ * Allows the given parser to accept elements containing raw binary data, in
+ * addition to elements containing text. A binary element is prefixed by its
+ * length in bytes followed by '#', rather than by its length in characters
+ * followed by '.', and its content is not interpreted in any way. The
+ * content of each binary element is still followed by a null terminator
+ * within the parsed instruction, but may contain null bytes of its own, and
+ * the length of that content can be determined only with
+ * guac_parser_binary_length(). Binary elements must not be accepted unless
+ * support for them has been negotiated with the remote end.
+ *
+ * @param parser
+ *     The parser that should accept binary elements.
+ */
+void guac_parser_enable_binary(guac_parser* parser);
+
+/**
+ * Returns the number of bytes within the given argument of the instruction
+ * most recently read by the given parser, if that argument was received as a
+ * binary element (see guac_parser_enable_binary()).
+ *
+ * @param parser
+ *     The parser which has read an instruction.
+ *
+ * @param index
+ *     The index of the argument within the argv array of the parser.
+ *
+ * @return
+ *     The number of bytes within the given argument if that argument was
+ *     received as a binary element, or -1 if the argument contains text or
+ *     does not exist.
+ */
+int guac_parser_binary_length(guac_parser* parser, int index);
+
 /**
  * Returns the number of unparsed bytes stored in the given parser's internal
  * buffers.
@@ -161,6 +250,36 @@ void guac_parser_free(guac_parser* parser);
  */
 int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout);
 
+/**
+ * Reads a single instruction from the given block of data, such as the
+ * contents of a memory-mapped file, without copying that data into the
+ * parser's internal buffer. The next instruction is parsed directly from
+ * *current using guac_parser_append(), beginning a new instruction if the
+ * previous instruction was completed, and *current is advanced past all data
+ * parsed. As with guac_parser_append(), the opcode and arguments of the
+ * instruction read refer to (and modify) the given data, which must remain
+ * valid until the instruction is no longer needed.
+ *
+ * If an error occurs reading the instruction, non-zero is returned, and
+ * guac_error is set appropriately. If the end of the data is reached before
+ * the instruction is complete, guac_error is set to GUAC_STATUS_CLOSED.
+ *
+ * @param parser
+ *     The guac_parser to use to read the instruction.
+ *
+ * @param current
+ *     A pointer to the position within the data at which parsing should
+ *     continue. This position is updated to point immediately after all data
+ *     parsed.
+ *
+ * @param end
+ *     The end of the data, immediately after the last byte available.
+ *
+ * @return
+ *     Zero if an instruction was read, non-zero otherwise.
+ */
+int guac_parser_read_buffer(guac_parser* parser, char** current, char* end);
+
 /**
  * Reads a single instruction from the given guac_socket. This operates
  * identically to guac_parser_read(), except that an error is returned if
@@ -27,15 +27,15 @@
  */
 
 /**
- * Represents a single integer within a larger pool of integers.
+ * A portion of the bitmap tracking the integers freed back into a guac_pool.
  */
-typedef struct guac_pool_int guac_pool_int;
+typedef struct guac_pool_chunk guac_pool_chunk;
 
 /**
  * A pool of integers. Integers can be removed from and later free'd back
  * into the pool. New integers are returned when the pool is exhausted,
  * or when the pool has not met some minimum size. Old, free'd integers
- * are returned otherwise.
+ * are returned otherwise, lowest first.
  */
 typedef struct guac_pool guac_pool;
 
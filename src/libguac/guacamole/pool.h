@@ -29,7 +29,39 @@
 
 #include "pool-types.h"
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * The number of integers tracked by each chunk of the bitmap of freed
+ * integers within a guac_pool. Chunks are allocated only as integers within
+ * their range are freed.
+ */
+#define GUAC_POOL_CHUNK_SIZE 4096
+
+/**
+ * The maximum number of chunks within the bitmap of freed integers of a
+ * guac_pool. Integers beyond the range of the final chunk (4194304 and above)
+ * are still unique, but are never reused once freed.
+ */
+#define GUAC_POOL_MAX_CHUNKS 1024
+
+/**
+ * The number of 64-bit words within each chunk of the bitmap of freed
+ * integers within a guac_pool.
+ */
+#define GUAC_POOL_CHUNK_WORDS (GUAC_POOL_CHUNK_SIZE / 64)
+
+struct guac_pool_chunk {
+
+    /**
+     * One bit for each integer within the range of this chunk, where a set
+     * bit indicates that the corresponding integer has been freed and may be
+     * reused.
+     */
+    _Atomic uint64_t words[GUAC_POOL_CHUNK_WORDS];
+
+};
 
 struct guac_pool {
 
@@ -43,43 +75,23 @@ struct guac_pool {
     /**
      * The number of integers currently in use.
      */
-    int active;
+    atomic_int active;
 
     /**
      * The next integer to be released (after no more integers remain in the
      * pool.
      */
-    int __next_value;
-
-    /**
-     * The first integer in the pool, if any.
-     */
-    guac_pool_int* __head;
-
-    /**
-     * The last integer in the pool, if any.
-     */
-    guac_pool_int* __tail;
-
-    /**
-     * Lock which is acquired when the pool is being modified or accessed.
-     */
-    pthread_mutex_t __lock;
-
-};
-
-struct guac_pool_int {
-
-    /**
-     * The integer value of this pool entry.
-     */
-    int value;
+    atomic_int __next_value;
 
     /**
-     * The next available (unused) guac_pool_int in the list of
-     * allocated but free'd ints.
+     * Bitmap of all freed integers awaiting reuse, divided into a table of
+     * GUAC_POOL_MAX_CHUNKS chunks of GUAC_POOL_CHUNK_SIZE integers each. The
+     * table is NULL until the first integer is freed, and each chunk is NULL
+     * until an integer within its range has been freed. Freed integers are
+     * claimed by atomically clearing their bits, such that the pool never
+     * needs to be locked.
      */
-    guac_pool_int* __next;
+    _Atomic(_Atomic(guac_pool_chunk*)*) __chunks;
 
 };
 
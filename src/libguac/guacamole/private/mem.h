@@ -93,6 +93,34 @@ void* PRIV_guac_mem_alloc(size_t factor_count, const size_t* factors);
  */
 void* PRIV_guac_mem_zalloc(size_t factor_count, const size_t* factors);
 
+/**
+ * Allocates a contiguous block of memory with the specified size and with all
+ * bytes initialized to zero, returning a pointer to the first byte of that
+ * block of memory. The block is backed by huge pages and placed on the memory
+ * of the NUMA node of the calling thread where supported. If multiple sizes
+ * are provided, these sizes are multiplied together to produce the final size
+ * of the new block. If memory of the specified size cannot be allocated, or if
+ * multiplying the sizes would result in integer overflow, guac_error is set
+ * appropriately and NULL is returned.
+ *
+ * The pointer returned by PRIV_guac_mem_zalloc_pages() MUST be freed with a
+ * subsequent call to guac_mem_free_pages() or PRIV_guac_mem_free_pages().
+ *
+ * @param factor_count
+ *     The number of factors to multiply together to produce the desired block
+ *     size.
+ *
+ * @param factors
+ *     An array of one or more size_t values that should be multiplied together
+ *     to produce the desired block size. At least one value MUST be provided.
+ *
+ * @returns
+ *     A pointer to the first byte of the allocated block of memory, or NULL if
+ *     such a block could not be allocated. If a block of memory could not be
+ *     allocated, guac_error is set appropriately.
+ */
+void* PRIV_guac_mem_zalloc_pages(size_t factor_count, const size_t* factors);
+
 /**
  * Multiplies together each of the given values, storing the result in a size_t
  * variable via the provided pointer. If the result of the multiplication
@@ -313,5 +341,15 @@ void* PRIV_guac_mem_realloc_or_die(void* mem, size_t factor_count, const size_t*
  */
 void PRIV_guac_mem_free(void* mem);
 
+/**
+ * Frees the memory block at the given pointer, which MUST have been allocated
+ * with guac_mem_zalloc_pages() or PRIV_guac_mem_zalloc_pages(). If the
+ * provided pointer is NULL, this function has no effect.
+ *
+ * @param mem
+ *     A pointer to the memory to be freed.
+ */
+void PRIV_guac_mem_free_pages(void* mem);
+
 #endif
 
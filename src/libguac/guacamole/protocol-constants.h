@@ -49,6 +49,27 @@
  */
 #define GUAC_PROTOCOL_BLOB_MAX_LENGTH 6048
 
+/**
+ * The maximum number of bytes that may be sent in any one blob instruction to
+ * a user that has negotiated support for larger blobs using the "blobsize"
+ * handshake instruction. Blobs of this size remain within
+ * GUAC_INSTRUCTION_LARGE_MAX_LENGTH once encoded as base64.
+ *
+ * @see guac_user_info.max_blob_length
+ */
+#define GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH 65536
+
+/**
+ * The maximum number of bytes that may result from decoding the given number
+ * of base64 characters.
+ *
+ * @param length
+ *     The number of base64 characters being decoded.
+ *
+ * @see guac_protocol_decode_base64_buffer()
+ */
+#define GUAC_PROTOCOL_BASE64_DECODED_LENGTH(length) ((length) / 4 * 3 + ((length) % 4) * 3 / 4)
+
 /**
  * The name of the layer parameter defining the number of simultaneous points
  * of contact supported by a layer. This parameter should be set to a non-zero
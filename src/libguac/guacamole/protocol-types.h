@@ -337,7 +337,16 @@ typedef enum guac_message_type {
      * left their connection. There should be a single argument provided, the
      * name of the user who has left.
      */
-    GUAC_MESSAGE_USER_LEFT = 0x0002
+    GUAC_MESSAGE_USER_LEFT = 0x0002,
+
+    /**
+     * A message that notifies users that the remote system is being woken
+     * with Wake-on-LAN, and that the connection will proceed as soon as that
+     * system responds. Two arguments are provided: the hostname or address of
+     * the remote system, and the number of whole seconds that have elapsed
+     * since the system was first asked to wake.
+     */
+    GUAC_MESSAGE_WOL_WAKING = 0x0003
 
 } guac_message_type;
 
@@ -324,6 +324,74 @@ int guac_protocol_send_nop(guac_socket* socket);
  */
 int guac_protocol_send_ready(guac_socket* socket, const char* id);
 
+/**
+ * Sends a blobsize instruction over the given guac_socket connection,
+ * confirming the maximum number of bytes that may be sent within any one blob
+ * instruction in either direction. This instruction is sent only in response
+ * to a "blobsize" instruction received from the client during the handshake.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket connection to use.
+ *
+ * @param size
+ *     The maximum number of bytes that may be sent within any one blob, as
+ *     negotiated with the client.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_send_blobsize(guac_socket* socket, int size);
+
+/**
+ * Sends a binary instruction over the given guac_socket connection,
+ * confirming that instruction elements containing raw binary data may be sent
+ * in either direction. A binary element is prefixed by its length in bytes
+ * followed by '#', rather than by its length in characters followed by '.'.
+ * This instruction is sent only in response to a "binary" instruction
+ * received from the client during the handshake.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket connection to use.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_send_binary(guac_socket* socket);
+
+/**
+ * Sends a resume instruction over the given guac_socket connection, providing
+ * the token that the client may present during the handshake of a later
+ * connection to resume its current view of the display, and confirming
+ * whether the view of a previous connection is being resumed. This
+ * instruction is sent only in response to a "resume" instruction received
+ * from the client during the handshake.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket connection to use.
+ *
+ * @param token
+ *     The resume token issued to the user.
+ *
+ * @param timestamp
+ *     The timestamp of the frame from which the previous view of the user is
+ *     being resumed, such that only changes made since that frame will be
+ *     sent, or zero if the full state of the display will be sent.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_send_resume(guac_socket* socket, const char* token,
+        guac_timestamp timestamp);
+
 /**
  * Sends a set instruction over the given guac_socket connection.
  *
@@ -525,7 +593,10 @@ int guac_protocol_send_pipe(guac_socket* socket, const guac_stream* stream,
 
 /**
  * Writes a block of data to the currently in-progress blob which was already
- * created.
+ * created. The data is sent as base64 unless the recipient of the given
+ * socket has negotiated support for binary elements (see
+ * guac_socket_enable_binary()), in which case the data is sent as raw,
+ * length-prefixed bytes.
  *
  * If an error occurs sending the instruction, a non-zero value is
  * returned, and guac_error is set appropriately.
@@ -1128,6 +1199,36 @@ int guac_protocol_send_name(guac_socket* socket, const char* name);
  */
 int guac_protocol_decode_base64(char* base64);
 
+/**
+ * Decodes the given base64-encoded string into the given buffer, which need
+ * not be (and usually is not) the buffer containing the string itself. The
+ * base64 string must be NULL-terminated. At most the given number of bytes
+ * are written to the buffer; any data that would decode to bytes beyond the
+ * end of the buffer is ignored.
+ *
+ * This allows handlers of encoded blobs to decode directly into their final
+ * destination (see guac_user_base64_blob_handler), rather than decoding
+ * in-place and then copying the result.
+ *
+ * @param base64
+ *     The base64-encoded string to decode.
+ *
+ * @param buffer
+ *     The buffer that should receive the decoded data. This may be the same
+ *     buffer as the base64 string, in which case the string is decoded
+ *     in-place.
+ *
+ * @param length
+ *     The number of bytes available within the buffer. A buffer of
+ *     GUAC_PROTOCOL_BASE64_DECODED_LENGTH(strlen(base64)) bytes is always
+ *     sufficient.
+ *
+ * @return
+ *     The number of bytes written to the buffer.
+ */
+int guac_protocol_decode_base64_buffer(const char* base64, void* buffer,
+        int length);
+
 /**
  * Given a string representation of a protocol version, return the enum value of
  * that protocol version, or GUAC_PROTOCOL_VERSION_UNKNOWN if the value is not a
@@ -21,6 +21,10 @@
 #define GUAC_RECORDING_H
 
 #include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * Provides functions and structures to be use for session recording.
@@ -48,6 +52,86 @@
  */
 #define GUAC_COMMON_RECORDING_MAX_NAME_LENGTH 2048
 
+/**
+ * The default number of bytes of recording data that may be buffered in
+ * memory while waiting to be written to the recording file, as used by all
+ * recordings unless overridden with guac_recording_set_default_buffer_size().
+ */
+#define GUAC_RECORDING_DEFAULT_BUFFER_SIZE 16777216
+
+/**
+ * The suffix appended to the filename of a session recording to produce the
+ * filename of its keyframe index, if any.
+ */
+#define GUAC_RECORDING_INDEX_SUFFIX ".idx"
+
+/**
+ * The suffix appended, along with the number of the segment, to the filename
+ * of a segmented session recording to produce the filename of each segment
+ * after the first. The first segment is written to the recording file
+ * itself.
+ */
+#define GUAC_RECORDING_SEGMENT_SUFFIX ".seg"
+
+/**
+ * The opcode of the instruction which begins each keyframe within the index
+ * of a session recording. Each such instruction has two arguments: the
+ * timestamp of the frame that the keyframe represents, as sent within the
+ * "sync" instruction ending that frame, and the byte offset within the
+ * recording of the first instruction following that frame. For compressed
+ * recordings, this offset is relative to the uncompressed recording data, and
+ * corresponds to the start of an independently-decodable compressed frame
+ * (see guac_recording_seek()). All instructions
+ * following the keyframe instruction, up to the next keyframe instruction or
+ * the end of the index, reconstruct the full state of the display as of that
+ * frame, such that playback may continue from that byte offset without
+ * reading any earlier part of the recording.
+ */
+#define GUAC_RECORDING_INDEX_KEYFRAME "keyframe"
+
+/**
+ * The number of bytes of keyframe data that may be buffered in memory while
+ * being written to the keyframe index of a session recording.
+ */
+#define GUAC_RECORDING_INDEX_BUFFER_SIZE 4194304
+
+/**
+ * The maximum zstd compression level that may be used for session
+ * recordings.
+ */
+#define GUAC_RECORDING_MAX_COMPRESSION 19
+
+/**
+ * The behavior of a session recording when data is produced faster than it
+ * can be written to the recording file, and the in-memory buffer of that
+ * recording is full.
+ */
+typedef enum guac_recording_overflow {
+
+    /**
+     * Output to all connected users waits for room within the buffer, such
+     * that the recording is always complete. This is the default.
+     */
+    GUAC_RECORDING_OVERFLOW_BLOCK,
+
+    /**
+     * Entire frames are omitted from the recording until there is room within
+     * the buffer, such that output to connected users is never delayed by the
+     * recording. Playback of a recording that has omitted frames may show
+     * stale or partially-updated regions of the display until those regions
+     * are next redrawn.
+     */
+    GUAC_RECORDING_OVERFLOW_DROP,
+
+    /**
+     * Output to all connected users waits for room within the buffer, as with
+     * GUAC_RECORDING_OVERFLOW_BLOCK, but a warning is periodically logged
+     * while output is being delayed.
+     */
+    GUAC_RECORDING_OVERFLOW_THROTTLE
+
+} guac_recording_overflow;
+
 /**
  * An in-progress session recording, attached to a guac_client instance such
  * that output Guacamole instructions may be dynamically intercepted and
@@ -97,6 +181,122 @@ typedef struct guac_recording {
 
 } guac_recording;
 
+/**
+ * Sets the number of bytes of recording data that each guac_recording created
+ * by the current process from this point forward may buffer in memory while
+ * that data is written to the recording file by a dedicated thread. By
+ * default, GUAC_RECORDING_DEFAULT_BUFFER_SIZE bytes are buffered.
+ *
+ * @param size
+ *     The number of bytes each new recording may buffer, or zero if recording
+ *     data should instead be written to the recording file immediately, by
+ *     whichever thread produces that data.
+ */
+void guac_recording_set_default_buffer_size(size_t size);
+
+/**
+ * Sets the behavior of each guac_recording created by the current process
+ * from this point forward when its in-memory buffer is full. By default,
+ * GUAC_RECORDING_OVERFLOW_BLOCK is used. This has no effect if recording data
+ * is not buffered.
+ *
+ * @param overflow
+ *     The behavior of each new recording when its buffer is full.
+ */
+void guac_recording_set_default_overflow(guac_recording_overflow overflow);
+
+/**
+ * Sets the interval at which each guac_recording created by the current
+ * process from this point forward will write snapshots of the full display
+ * state to a keyframe index alongside the recording. The index is written to
+ * a file having the same name as the recording, with GUAC_RECORDING_INDEX_SUFFIX
+ * appended. Players may use the index to begin playback at any point within
+ * the recording without first reading the entire recording up to that
+ * point. An index is written only for recordings which include output and
+ * whose data is buffered (see guac_recording_set_default_buffer_size()). By
+ * default, no index is written.
+ *
+ * @param interval
+ *     The minimum number of seconds between keyframes, or zero if no index
+ *     should be written.
+ */
+void guac_recording_set_default_index_interval(int interval);
+
+/**
+ * Sets the zstd compression level of each guac_recording created by the
+ * current process from this point forward. Compressed recordings consist of
+ * a series of independently-decodable zstd frames, each beginning at a frame
+ * boundary ("sync" instruction) of the recording and preceded by a skippable
+ * frame noting the offset of that frame within the uncompressed recording
+ * data, such that playback may still begin at any keyframe within the index.
+ * Compressed recordings may be read with guac_recording_open_reader() or with
+ * the standard zstd utility. Only recordings whose data is buffered (see
+ * guac_recording_set_default_buffer_size()) and whose file is newly created
+ * are compressed, and compression is only available if libguac was built
+ * with libzstd. By default, recordings are not compressed.
+ *
+ * @param level
+ *     The zstd compression level to use, between 1 and
+ *     GUAC_RECORDING_MAX_COMPRESSION inclusive, or zero if recordings should
+ *     not be compressed.
+ */
+void guac_recording_set_default_compression(int level);
+
+/**
+ * Sets the maximum quality of the image data within each guac_recording
+ * created by the current process from this point forward. Rather than
+ * containing exactly the image data sent to connected users, recordings that
+ * include output then receive their own JPEG encoding of each image update to
+ * an opaque layer, at no more than the given quality, with regions in
+ * sustained motion recorded at the lowest quality used for any image data.
+ * Refinements of previously-lossy image data are sent only to connected
+ * users. This reduces the size of recordings, and the cost of later
+ * processing those recordings, without affecting connected users. By
+ * default, recordings contain exactly the image data sent to users.
+ *
+ * @param quality
+ *     The maximum JPEG quality of recorded image data, between 1 and 100
+ *     inclusive, or zero if recordings should contain exactly the image data
+ *     sent to connected users.
+ */
+void guac_recording_set_default_image_quality(int quality);
+
+/**
+ * Sets the maximum amount of time covered by each segment of each
+ * guac_recording created by the current process from this point forward.
+ * Segmented recordings are divided into separate files at frame boundaries,
+ * with each segment after the first written to a file having the same name
+ * as the recording with GUAC_RECORDING_SEGMENT_SUFFIX and the number of that
+ * segment appended (".seg2", ".seg3", etc.). Each segment begins with a full
+ * snapshot of the display, and thus can be played back independently of all
+ * other segments. Recordings are segmented only if they include output and
+ * their data is buffered (see guac_recording_set_default_buffer_size()).
+ * Segmented recordings have no keyframe index, and, if compression has been
+ * requested with guac_recording_set_default_compression(), each segment is
+ * compressed in the background once closed rather than as it is written. By
+ * default, recordings are not segmented by duration.
+ *
+ * @param duration
+ *     The maximum number of seconds covered by each segment, or zero if
+ *     segments should not be limited by duration.
+ */
+void guac_recording_set_default_segment_duration(int duration);
+
+/**
+ * Sets the maximum size of each segment of each guac_recording created by the
+ * current process from this point forward, beginning a new segment at the
+ * first frame boundary after this many bytes have been written to the
+ * current segment. Segments are otherwise as described for
+ * guac_recording_set_default_segment_duration(), and a new segment is begun
+ * as soon as either limit is reached. By default, recordings are not
+ * segmented by size.
+ *
+ * @param size
+ *     The maximum number of bytes of each uncompressed segment, or zero if
+ *     segments should not be limited by size.
+ */
+void guac_recording_set_default_segment_size(uint64_t size);
+
 /**
  * Replaces the socket of the given client such that all further Guacamole
  * protocol output will be copied into a file within the given path and having
@@ -173,6 +373,71 @@ guac_recording* guac_recording_create(guac_client* client,
  */
 void guac_recording_free(guac_recording* recording);
 
+/**
+ * Returns whether the given data is the beginning of a compressed session
+ * recording, as written when guac_recording_set_default_compression() has
+ * been used, or as produced by compressing an existing recording with the
+ * standard zstd utility. Uncompressed recordings always begin with a
+ * Guacamole protocol instruction, and are never mistaken for compressed
+ * recordings.
+ *
+ * @param data
+ *     The data to test, which should be the first bytes of the recording, or
+ *     the first bytes following a position sought with
+ *     guac_recording_seek().
+ *
+ * @param length
+ *     The number of bytes of data available.
+ *
+ * @return
+ *     Non-zero if the given data is compressed, zero otherwise.
+ */
+int guac_recording_is_compressed(const void* data, size_t length);
+
+/**
+ * Allocates a new guac_socket which reads the Guacamole protocol data of a
+ * session recording from the given guac_socket, transparently decompressing
+ * that data if the recording is compressed (see
+ * guac_recording_is_compressed()). Uncompressed recordings are read as-is.
+ * If the recording is compressed but libguac was built without libzstd,
+ * reads from the returned socket fail with guac_error set to
+ * GUAC_STATUS_NOT_SUPPORTED. The given socket is freed when the returned
+ * socket is freed.
+ *
+ * @param socket
+ *     The guac_socket from which the raw contents of the recording should be
+ *     read, beginning at either the start of the recording or a position
+ *     sought with guac_recording_seek().
+ *
+ * @return
+ *     A newly-allocated guac_socket which reads the uncompressed contents of
+ *     the recording, or NULL if the socket cannot be allocated, in which case
+ *     guac_error is set appropriately and the given socket is not freed.
+ */
+guac_socket* guac_recording_open_reader(guac_socket* socket);
+
+/**
+ * Seeks the given file descriptor of a session recording to the given
+ * offset within the uncompressed recording data, such as an offset read from
+ * a keyframe within the index of that recording. If the recording is
+ * compressed, the file descriptor is positioned at the start of the
+ * compressed frame beginning at that offset, and further data must be read
+ * with guac_recording_open_reader().
+ *
+ * @param fd
+ *     The file descriptor of the recording, which must be open for reading.
+ *
+ * @param position
+ *     The offset within the uncompressed recording data to seek to.
+ *
+ * @return
+ *     Zero if the file descriptor now refers to the given position, non-zero
+ *     otherwise, in which case errno is set appropriately. A compressed
+ *     recording having no frame that begins at the given position cannot be
+ *     sought, and errno is set to EINVAL.
+ */
+int guac_recording_seek(int fd, uint64_t position);
+
 /**
  * Reports the current mouse position and button state within the recording.
  *
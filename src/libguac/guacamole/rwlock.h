@@ -21,6 +21,8 @@
 #define __GUAC_RWLOCK_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 /**
  * This file implements reentrant read-write locks using thread-local storage
@@ -36,7 +38,30 @@
  * Any lock that's locked using one of the functions defined in this file
  * must _only_ be unlocked using the unlock function defined here to avoid
  * unexpected behavior.
+ *
+ * Read locks are reader-biased in the manner of BRAVO ("Biased Locking for
+ * Reader-Writer Locks", Dice and Kogan, 2019). While a lock is biased toward
+ * readers, a read lock is acquired by publishing the lock within a slot of a
+ * process-wide table of readers, with the slot chosen by hashing the lock and
+ * the current thread. Concurrent readers then touch only their own slots
+ * rather than the shared state of the underlying pthread rwlock. Writers
+ * revoke the bias and wait for all published readers to leave before
+ * proceeding, and the bias is restored by readers only after a period
+ * proportional to the time that revocation took, bounding the overhead
+ * imposed on writers.
+ */
+
+/**
+ * The number of slots within the process-wide table of readers holding
+ * reader-biased read locks. This must be a power of two.
+ */
+#define GUAC_RWLOCK_READER_SLOTS 4096
+
+/**
+ * The multiple of the time taken to revoke reader bias for which reader bias
+ * remains disabled following that revocation.
  */
+#define GUAC_RWLOCK_INHIBIT_MULTIPLIER 9
 
 /**
  * A structure packaging together a pthread rwlock along with a key to a
@@ -59,11 +84,27 @@ typedef struct guac_rwlock {
      */
     pthread_key_t key;
 
+    /**
+     * Non-zero if read locks may currently be acquired through the
+     * process-wide table of readers, without acquiring the underlying pthread
+     * rwlock, zero otherwise.
+     */
+    atomic_int reader_bias;
+
+    /**
+     * The value of the monotonic clock, in nanoseconds, before which reader
+     * bias must not be restored. This is written only while the underlying
+     * pthread rwlock is held for writing, and read only while it is held for
+     * reading.
+     */
+    int64_t inhibit_until;
+
 } guac_rwlock;
 
 /**
- * Initialize the provided guac reentrant rwlock. The lock will be configured to be
- * visible to child processes.
+ * Initialize the provided guac reentrant rwlock. The underlying pthread rwlock
+ * will be configured to be visible to child processes, however the table of
+ * readers tracking reader-biased read locks is private to the current process.
  *
  * @param lock
  *     The guac reentrant rwlock to be initialized.
@@ -48,5 +48,29 @@
  */
 #define GUAC_SOCKET_BASE64_ENCODED_BUFFER_SIZE 1024
 
+/**
+ * The number of distinct guac_socket_priority values.
+ */
+#define GUAC_SOCKET_PRIORITIES 3
+
+/**
+ * The default maximum number of bytes of nested data sent within each "nest"
+ * instruction written by a nested socket (see guac_socket_nest()). As some of
+ * the 8 KB space available for each instruction will be taken up by the
+ * "nest" opcode and other parameters, and 1 KB will be more than enough space
+ * for that extra data, this space is reduced to an even 7 KB.
+ */
+#define GUAC_SOCKET_NEST_CHUNK_SIZE 7168
+
+/**
+ * The maximum number of bytes of nested data that may be sent within each
+ * "nest" instruction written by a nested socket to a receiver that accepts
+ * instructions of up to GUAC_INSTRUCTION_LARGE_MAX_LENGTH characters (see
+ * guac_socket_nest_chunked()). As with GUAC_SOCKET_NEST_CHUNK_SIZE, 1 KB of
+ * the space available for each instruction is reserved for the "nest" opcode
+ * and other parameters.
+ */
+#define GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE 97280
+
 #endif
 
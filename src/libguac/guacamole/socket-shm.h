@@ -0,0 +1,206 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_SHM_H
+#define GUAC_SOCKET_SHM_H
+
+/**
+ * Provides an implementation of guac_socket which communicates with a
+ * co-located process through a pair of ring buffers within shared memory,
+ * using eventfd file descriptors to signal the availability of data and
+ * space. This header will only be available if libguac was built with shared
+ * memory transport support.
+ *
+ * The process on the other end of the socket (the "peer") creates all shared
+ * memory and eventfd file descriptors, initializes a guac_socket_shm_region
+ * within the shared memory, and passes those file descriptors to guacd over
+ * a UNIX domain socket. The ring buffers are lock-free and safe for exactly
+ * one reader and one writer each.
+ *
+ * As the peer can write to the entire region, libguac never trusts the state
+ * of either ring: a ring whose head and tail are further apart than
+ * GUAC_SOCKET_SHM_RING_SIZE is treated as a protocol error, closing the
+ * socket.
+ *
+ * @file socket-shm.h
+ */
+
+#include "socket-types.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * The value of the magic member of every valid guac_socket_shm_region.
+ */
+#define GUAC_SOCKET_SHM_MAGIC 0x47534D52
+
+/**
+ * The version of the layout of guac_socket_shm_region described by this
+ * header, as stored within the version member of that structure.
+ */
+#define GUAC_SOCKET_SHM_VERSION 1
+
+/**
+ * The number of bytes of data within each ring buffer of a shared memory
+ * region. This MUST be a power of two.
+ */
+#define GUAC_SOCKET_SHM_RING_SIZE 1048576
+
+/**
+ * The number of file descriptors that make up a shared memory transport, as
+ * required by guac_socket_open_shm().
+ */
+#define GUAC_SOCKET_SHM_FD_COUNT 6
+
+/**
+ * The index of the connected UNIX domain socket shared with the peer, used
+ * only to detect that the peer has disconnected. The peer MUST NOT send any
+ * further data along this socket once the transport is established.
+ */
+#define GUAC_SOCKET_SHM_FD_CONTROL 0
+
+/**
+ * The index of the file descriptor of the shared memory containing the
+ * guac_socket_shm_region. This MUST be a file descriptor from memfd_create()
+ * created with MFD_ALLOW_SEALING, sealed with both F_SEAL_SHRINK and
+ * F_SEAL_SEAL after being sized to hold the region, such that the peer cannot
+ * later truncate the memory out from under libguac.
+ */
+#define GUAC_SOCKET_SHM_FD_REGION 1
+
+/**
+ * The index of the eventfd signalled by the peer when data has been added to
+ * the input ring.
+ */
+#define GUAC_SOCKET_SHM_FD_INPUT_DATA 2
+
+/**
+ * The index of the eventfd signalled by libguac when space has been freed
+ * within the input ring.
+ */
+#define GUAC_SOCKET_SHM_FD_INPUT_SPACE 3
+
+/**
+ * The index of the eventfd signalled by libguac when data has been added to
+ * the output ring.
+ */
+#define GUAC_SOCKET_SHM_FD_OUTPUT_DATA 4
+
+/**
+ * The index of the eventfd signalled by the peer when space has been freed
+ * within the output ring.
+ */
+#define GUAC_SOCKET_SHM_FD_OUTPUT_SPACE 5
+
+/**
+ * A single-producer, single-consumer ring buffer within shared memory. The
+ * producer and consumer each signal the other through an eventfd only if the
+ * other has declared that it is waiting, such that no system calls are
+ * needed while both sides are keeping up.
+ */
+typedef struct guac_socket_shm_ring {
+
+    /**
+     * The total number of bytes ever added to this ring by the producer,
+     * modulo 2^32. Only the producer may change this value.
+     */
+    _Atomic uint32_t head;
+
+    /**
+     * The total number of bytes ever removed from this ring by the consumer,
+     * modulo 2^32. Only the consumer may change this value.
+     */
+    _Atomic uint32_t tail;
+
+    /**
+     * Non-zero if the consumer is about to wait for data, in which case the
+     * producer must signal the eventfd for data once more data is available.
+     * The producer resets this to zero when signalling.
+     */
+    _Atomic uint32_t data_waiting;
+
+    /**
+     * Non-zero if the producer is about to wait for space, in which case the
+     * consumer must signal the eventfd for space once space is freed. The
+     * consumer resets this to zero when signalling.
+     */
+    _Atomic uint32_t space_waiting;
+
+    /**
+     * The data within this ring. Byte N of the stream of data passing
+     * through this ring is stored at offset (N % GUAC_SOCKET_SHM_RING_SIZE).
+     */
+    unsigned char data[GUAC_SOCKET_SHM_RING_SIZE];
+
+} guac_socket_shm_ring;
+
+/**
+ * The layout of the shared memory underlying a shared memory transport.
+ */
+typedef struct guac_socket_shm_region {
+
+    /**
+     * Always GUAC_SOCKET_SHM_MAGIC.
+     */
+    uint32_t magic;
+
+    /**
+     * The version of this layout, currently GUAC_SOCKET_SHM_VERSION.
+     */
+    uint32_t version;
+
+    /**
+     * The ring containing data sent by the peer and read by libguac.
+     */
+    guac_socket_shm_ring input;
+
+    /**
+     * The ring containing data written by libguac and read by the peer.
+     */
+    guac_socket_shm_ring output;
+
+} guac_socket_shm_region;
+
+/**
+ * Creates a new guac_socket which reads from and writes to the ring buffers
+ * of a shared memory transport. Data written to the socket is made visible
+ * to the peer when the socket is flushed, or when the output ring becomes
+ * full. Freeing this guac_socket will automatically close all of the given
+ * file descriptors, and the peer is considered disconnected once it closes
+ * its end of the control socket.
+ *
+ * The shared memory MUST be sealed against shrinking, as described for
+ * GUAC_SOCKET_SHM_FD_REGION, and is refused otherwise.
+ *
+ * If an error occurs, NULL is returned and guac_error is set appropriately.
+ * The given file descriptors are not closed in that case.
+ *
+ * @param fds
+ *     The GUAC_SOCKET_SHM_FD_COUNT file descriptors making up the transport,
+ *     ordered as described by the GUAC_SOCKET_SHM_FD_* constants.
+ *
+ * @return
+ *     A newly-allocated guac_socket which communicates through the given
+ *     shared memory transport, or NULL if an error occurs.
+ */
+guac_socket* guac_socket_open_shm(const int* fds);
+
+#endif
@@ -31,6 +31,15 @@
 
 #include <openssl/ssl.h>
 #include <pthread.h>
+#include <stddef.h>
+
+/**
+ * The size of the output buffer of each SSL socket, in bytes. This is the
+ * maximum amount of plaintext which may be sent within a single TLS record,
+ * such that data written in small pieces is coalesced into as few records as
+ * possible, each encrypted and sent as a whole.
+ */
+#define GUAC_SOCKET_SSL_OUTPUT_BUFFER_SIZE 16384
 
 /**
  * SSL socket-specific data.
@@ -60,6 +69,23 @@ typedef struct guac_socket_ssl_data {
      */
     pthread_mutex_t socket_lock;
 
+    /**
+     * Lock which protects access to the output buffer of this socket,
+     * guaranteeing atomicity of writes and flushes.
+     */
+    pthread_mutex_t buffer_lock;
+
+    /**
+     * The number of bytes currently within the output buffer.
+     */
+    size_t written;
+
+    /**
+     * The output buffer, containing the plaintext of data written to this
+     * socket which has not yet been sent within a TLS record.
+     */
+    char out_buf[GUAC_SOCKET_SSL_OUTPUT_BUFFER_SIZE];
+
 } guac_socket_ssl_data;
 
 /**
@@ -32,6 +32,12 @@
  */
 typedef struct guac_socket guac_socket;
 
+/**
+ * Counters describing the output of a guac_socket, as returned by
+ * guac_socket_get_stats().
+ */
+typedef struct guac_socket_stats guac_socket_stats;
+
 /**
  * Possible current states of a guac_socket.
  */
@@ -49,5 +55,34 @@ typedef enum guac_socket_state {
 
 } guac_socket_state;
 
+/**
+ * The relative priority of data written to a guac_socket. Sockets which
+ * queue data for delivery by a separate thread (see guac_socket_queue())
+ * deliver higher-priority data first, while sockets which write data
+ * immediately ignore priority altogether.
+ */
+typedef enum guac_socket_priority {
+
+    /**
+     * Data which directly affects the responsiveness of the connection, such
+     * as display updates, cursor changes, and "sync" instructions. This is
+     * the priority of all data by default.
+     */
+    GUAC_SOCKET_PRIORITY_INTERACTIVE,
+
+    /**
+     * Audio data, which must be delivered steadily but should not delay
+     * display updates.
+     */
+    GUAC_SOCKET_PRIORITY_AUDIO,
+
+    /**
+     * Bulk data, such as file downloads and print jobs, which should receive
+     * only whatever bandwidth is not needed for data of higher priority.
+     */
+    GUAC_SOCKET_PRIORITY_BULK
+
+} guac_socket_priority;
+
 #endif
 
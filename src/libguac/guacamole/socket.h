@@ -36,6 +36,43 @@
 #include <stdint.h>
 #include <unistd.h>
 
+struct guac_socket_stats {
+
+    /**
+     * The total number of bytes written to the socket.
+     */
+    uint64_t bytes_written;
+
+    /**
+     * The total number of bytes read from the socket.
+     */
+    uint64_t bytes_read;
+
+    /**
+     * The total amount of time spent within the write and flush handlers of
+     * the socket, in nanoseconds. This includes any time that those handlers
+     * spent blocked waiting for the underlying connection.
+     */
+    uint64_t write_blocked;
+
+    /**
+     * The total number of times the socket has been flushed.
+     */
+    uint64_t flushes;
+
+    /**
+     * The number of bytes written to the socket since it was last flushed.
+     */
+    uint64_t in_flight;
+
+    /**
+     * The largest number of bytes that have been written to the socket
+     * between consecutive flushes.
+     */
+    uint64_t max_in_flight;
+
+};
+
 struct guac_socket {
 
     /**
@@ -118,6 +155,32 @@ struct guac_socket {
      */
     pthread_t __keep_alive_thread;
 
+    /**
+     * Lock which guards access to the output counters of this socket.
+     */
+    pthread_mutex_t __stats_lock;
+
+    /**
+     * Counters describing the output of this socket.
+     */
+    guac_socket_stats __stats;
+
+    /**
+     * The priority of the data currently being written as part of the
+     * current instruction, as set with guac_socket_set_priority(). This is
+     * reset to GUAC_SOCKET_PRIORITY_INTERACTIVE at the end of each
+     * instruction.
+     */
+    guac_socket_priority __priority;
+
+    /**
+     * Whether the recipient of the data written to this socket has negotiated
+     * support for elements containing raw binary data, as declared with
+     * guac_socket_enable_binary(). If non-zero, blobs are sent as raw,
+     * length-prefixed bytes rather than as base64.
+     */
+    int __binary;
+
 };
 
 /**
@@ -146,6 +209,19 @@ void guac_socket_free(guac_socket* socket);
  */
 void guac_socket_require_keep_alive(guac_socket* socket);
 
+/**
+ * Declares that the recipient of the data written to the given socket has
+ * negotiated support for instruction elements containing raw binary data,
+ * such that functions like guac_protocol_send_blob() may send that data
+ * without first encoding it as base64. This must only be invoked for sockets
+ * that have exactly one recipient, and only once support has been confirmed
+ * with that recipient.
+ *
+ * @param socket
+ *     The guac_socket whose recipient supports binary elements.
+ */
+void guac_socket_enable_binary(guac_socket* socket);
+
 /**
  * Marks the beginning of a Guacamole protocol instruction.
  *
@@ -162,6 +238,25 @@ void guac_socket_instruction_begin(guac_socket* socket);
  */
 void guac_socket_instruction_end(guac_socket* socket);
 
+/**
+ * Sets the priority of the data written to the given socket for the remainder
+ * of the current instruction. This function may only be invoked between
+ * guac_socket_instruction_begin() and guac_socket_instruction_end(), and the
+ * priority reverts to GUAC_SOCKET_PRIORITY_INTERACTIVE once the instruction
+ * has ended. Data written to queued sockets (see guac_socket_queue()) is
+ * delivered in order of priority, with data of equal priority delivered in
+ * the order written. Other sockets ignore priority.
+ *
+ * @param socket
+ *     The guac_socket currently being used to write an instruction.
+ *
+ * @param priority
+ *     The priority of the data which will be written for the remainder of
+ *     the current instruction.
+ */
+void guac_socket_set_priority(guac_socket* socket,
+        guac_socket_priority priority);
+
 /**
  * Allocates and initializes a new guac_socket object with the given open
  * file descriptor. The file descriptor will be automatically closed when
@@ -177,6 +272,35 @@ void guac_socket_instruction_end(guac_socket* socket);
  */
 guac_socket* guac_socket_open(int fd);
 
+/**
+ * Allocates and initializes a new guac_socket object with the given open
+ * file descriptor, exactly as guac_socket_open() does, but buffering up to the
+ * given number of bytes of output before writing that output to the file
+ * descriptor. Larger buffers reduce the number of system calls needed to send
+ * large amounts of data, such as image updates, at the cost of memory. Data
+ * that would not fit within the remaining space of the buffer is written
+ * together with the buffered data in a single vectored write, without first
+ * being copied into the buffer. The file descriptor will be automatically
+ * closed when the allocated guac_socket is freed.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is returned,
+ * and guac_error is set appropriately.
+ *
+ * @param fd
+ *     An open file descriptor that this guac_socket object should manage.
+ *
+ * @param buffer_size
+ *     The size of the output buffer, in bytes. Sizes smaller than
+ *     GUAC_SOCKET_OUTPUT_BUFFER_SIZE are rounded up to
+ *     GUAC_SOCKET_OUTPUT_BUFFER_SIZE.
+ *
+ * @return
+ *     A newly allocated guac_socket object associated with the given file
+ *     descriptor, or NULL if an error occurs while allocating the guac_socket
+ *     object.
+ */
+guac_socket* guac_socket_open_buffered(int fd, size_t buffer_size);
+
 /**
  * Allocates and initializes a new guac_socket which writes all data via
  * nest instructions to the given existing, open guac_socket. Freeing the
@@ -201,6 +325,49 @@ guac_socket* guac_socket_open(int fd);
  */
 guac_socket* guac_socket_nest(guac_socket* parent, int index);
 
+/**
+ * Allocates and initializes a new guac_socket which writes all data via
+ * nest instructions to the given existing, open guac_socket, sending at most
+ * the given number of bytes of nested data within each nest instruction.
+ * Small writes are combined within a buffer, while larger writes are framed
+ * within nest instructions written directly from the buffer provided by the
+ * caller. Freeing the returned guac_socket has no effect on the underlying,
+ * nested guac_socket.
+ *
+ * Any chunk size larger than GUAC_SOCKET_NEST_CHUNK_SIZE requires that the
+ * receiving end accept correspondingly larger instructions. Chunks of up to
+ * GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE bytes may be sent to any receiver that
+ * accepts instructions of up to GUAC_INSTRUCTION_LARGE_MAX_LENGTH characters.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is returned,
+ * and guac_error is set appropriately.
+ *
+ * @deprecated
+ *     The "nest" instruction and the corresponding guac_socket
+ *     implementation are no longer necessary, having been replaced by
+ *     the streaming instructions ("blob", "ack", "end"). Code using nested
+ *     sockets or the "nest" instruction should instead write to a normal
+ *     socket directly.
+ *
+ * @param parent
+ *     The guac_socket this new guac_socket should write nest instructions to.
+ *
+ * @param index
+ *     The stream index to use for the written nest instructions.
+ *
+ * @param chunk_size
+ *     The maximum number of bytes of nested data to send within each nest
+ *     instruction, no greater than GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE, or zero
+ *     to use GUAC_SOCKET_NEST_CHUNK_SIZE.
+ *
+ * @return
+ *     A newly allocated guac_socket object associated with the given
+ *     guac_socket and stream index, or NULL if an error occurs while
+ *     allocating the guac_socket object.
+ */
+guac_socket* guac_socket_nest_chunked(guac_socket* parent, int index,
+        int chunk_size);
+
 /**
  * Allocates and initializes a new guac_socket which delegates all socket
  * operations to the given primary socket, while simultaneously duplicating all
@@ -233,6 +400,42 @@ guac_socket* guac_socket_nest(guac_socket* parent, int index);
  */
 guac_socket* guac_socket_tee(guac_socket* primary, guac_socket* secondary);
 
+/**
+ * Allocates and initializes a new guac_socket which queues all written data
+ * for delivery to the given socket by a dedicated writer thread, such that
+ * writes to the returned guac_socket need not wait for the underlying
+ * connection. Flushing the returned guac_socket signals the writer thread to
+ * send everything queued so far, but does not wait for that data to be sent.
+ * All read operations are delegated to the given socket. Freeing the returned
+ * guac_socket waits for all queued data to be sent and frees the given
+ * socket.
+ *
+ * At most max_backlog bytes may be queued at any one time. Writes performed
+ * with guac_socket_write() and similar functions wait for room within the
+ * queue, just as a write to the underlying connection would block. Data
+ * written by broadcast sockets (see guac_socket_broadcast()) is instead
+ * written without waiting, and a queued socket that would exceed its backlog
+ * limit due to such a write fails, discarding everything queued. The
+ * user associated with that socket is then stopped with guac_user_stop(),
+ * rather than allowing that user to delay all other users.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is
+ * returned, guac_error is set appropriately, and the given socket is not
+ * freed.
+ *
+ * @param socket
+ *     The guac_socket to which all queued data should be written.
+ *
+ * @param max_backlog
+ *     The maximum number of bytes that may be queued at any one time.
+ *
+ * @return
+ *     A newly allocated guac_socket object which queues data for delivery to
+ *     the given socket, or NULL if an error occurs while allocating the
+ *     guac_socket object.
+ */
+guac_socket* guac_socket_queue(guac_socket* socket, size_t max_backlog);
+
 /**
  * Allocates and initializes a new guac_socket which duplicates all
  * instructions written across the sockets of each connected user of the
@@ -285,6 +488,21 @@ guac_socket* guac_socket_broadcast(guac_client* client);
  */
 guac_socket* guac_socket_broadcast_pending(guac_client* client);
 
+/**
+ * Retrieves the current values of the counters of the given guac_socket,
+ * such as the number of bytes written or read and the amount of time spent
+ * blocked while writing. The counters are copied atomically with respect
+ * to each other.
+ *
+ * @param socket
+ *     The guac_socket to retrieve the counters of.
+ *
+ * @param stats
+ *     The guac_socket_stats structure that should receive the current values
+ *     of the counters.
+ */
+void guac_socket_get_stats(guac_socket* socket, guac_socket_stats* stats);
+
 /**
  * Writes the given unsigned int to the given guac_socket object. The data
  * written may be buffered until the buffer is flushed automatically or
@@ -26,6 +26,7 @@
  * @file stream.h
  */
 
+#include "socket-types.h"
 #include "user-fntypes.h"
 #include "stream-types.h"
 
@@ -105,6 +106,46 @@ struct guac_stream {
      */
     guac_user_end_handler* end_handler;
 
+    /**
+     * Handler for blob events sent by the Guacamole web-client which receives
+     * the blob still encoded as base64, allowing that data to be decoded
+     * directly into a buffer chosen by the handler. If set, this handler is
+     * invoked instead of blob_handler.
+     *
+     * Example:
+     * @code
+     *     int base64_blob_handler(guac_user* user, guac_stream* stream,
+     *             const char* base64, int length) {
+     *         char* buffer = get_destination_buffer(stream, length);
+     *         length = guac_protocol_decode_base64_buffer(base64, buffer, length);
+     *         ...
+     *     }
+     *
+     *     int my_pipe_handler(guac_user* user, guac_stream* stream,
+     *             char* mimetype, char* name) {
+     *         stream->base64_blob_handler = base64_blob_handler;
+     *     }
+     * @endcode
+     */
+    guac_user_base64_blob_handler* base64_blob_handler;
+
+    /**
+     * The priority of the data sent along this stream, relative to other
+     * data sent to the same users. This is GUAC_SOCKET_PRIORITY_INTERACTIVE
+     * when the stream is allocated, and may be lowered for streams carrying
+     * data that should not delay display updates, such as file downloads.
+     *
+     * Example:
+     * @code
+     *     guac_stream* stream = guac_user_alloc_stream(user);
+     *     stream->priority = GUAC_SOCKET_PRIORITY_BULK;
+     *
+     *     guac_protocol_send_file(user->socket, stream,
+     *         "application/octet-stream", "file.txt");
+     * @endcode
+     */
+    guac_socket_priority priority;
+
 };
 
 #endif
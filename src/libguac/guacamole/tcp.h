@@ -30,6 +30,40 @@
 
 #include <stddef.h>
 
+/**
+ * The number of milliseconds to wait for a connection attempt to succeed
+ * before another connection attempt is started in parallel to the next
+ * resolved address, as recommended by RFC 8305 ("Happy Eyeballs").
+ */
+#define GUAC_TCP_CONNECTION_ATTEMPT_DELAY 250
+
+/**
+ * The maximum number of resolved addresses that will be attempted by
+ * guac_tcp_connect() for any one hostname and port.
+ */
+#define GUAC_TCP_MAX_ADDRESSES 16
+
+/**
+ * The number of distinct hostname and port combinations whose resolved
+ * addresses may be stored within the cache created by
+ * guac_tcp_dns_cache_init().
+ */
+#define GUAC_TCP_DNS_CACHE_SIZE 256
+
+/**
+ * The maximum length of any hostname stored within the cache created by
+ * guac_tcp_dns_cache_init(), in bytes, including the null terminator.
+ * Longer hostnames are never cached.
+ */
+#define GUAC_TCP_DNS_CACHE_MAX_HOSTNAME 256
+
+/**
+ * The maximum length of any port stored within the cache created by
+ * guac_tcp_dns_cache_init(), in bytes, including the null terminator.
+ * Longer ports are never cached.
+ */
+#define GUAC_TCP_DNS_CACHE_MAX_PORT 32
+
 /**
  * Given a hostname or IP address and port, attempt to connect to that system,
  * returning the file descriptor of an open socket if the connection succeeds,
@@ -37,6 +71,15 @@
  * eventually be freed with a call to close(). If this function fails,
  * guac_error will be set appropriately.
  *
+ * If the hostname resolves to multiple addresses, connections are attempted
+ * as described by RFC 8305 ("Happy Eyeballs"), alternating between address
+ * families and starting a new attempt every
+ * GUAC_TCP_CONNECTION_ATTEMPT_DELAY milliseconds (or as soon as the previous
+ * attempt fails) while earlier attempts are still in progress. The first
+ * attempt to succeed is used, and all others are abandoned. If a cache of
+ * resolved addresses has been created with guac_tcp_dns_cache_init(), that
+ * cache is consulted before the hostname is resolved.
+ *
  * @param hostname
  *     The hostname or IP address to which to attempt connections.
  *
@@ -44,7 +87,8 @@
  *     The TCP port to which to attempt to connect.
  *
  * @param timeout
- *     The number of seconds to try the TCP connection before timing out.
+ *     The number of seconds to wait for each connection attempt to succeed
+ *     before abandoning that attempt.
  *
  * @return
  *     A valid socket if the connection succeeds, or a negative integer if it
@@ -52,4 +96,23 @@
  */
 int guac_tcp_connect(const char* hostname, const char* port, const int timeout);
 
+/**
+ * Creates a cache of the addresses resolved by guac_tcp_connect(), shared by
+ * the calling process and all processes that it subsequently forks, such that
+ * repeated connections to the same hostname and port by any of those
+ * processes need not resolve that hostname again. Only successful
+ * resolutions are cached. This function must be invoked only once, before
+ * any such processes are forked, and only while no other threads may be
+ * invoking guac_tcp_connect().
+ *
+ * @param ttl
+ *     The number of seconds that resolved addresses should remain within the
+ *     cache. This must be greater than zero.
+ *
+ * @return
+ *     Zero if the cache was created successfully, non-zero otherwise, in
+ *     which case guac_error is set appropriately and no cache is used.
+ */
+int guac_tcp_dns_cache_init(int ttl);
+
 #endif // GUAC_TCP_H
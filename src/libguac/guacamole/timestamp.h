@@ -28,6 +28,8 @@
 
 #include "timestamp-types.h"
 
+#include <stdint.h>
+
 /**
  * Returns an arbitrary timestamp. The difference between return values of any
  * two calls is equal to the amount of time in milliseconds between those 
@@ -39,6 +41,61 @@
  */
 guac_timestamp guac_timestamp_current();
 
+/**
+ * Returns an arbitrary timestamp, as would be returned by
+ * guac_timestamp_current(), but read from a coarse clock where one is
+ * available. Coarse timestamps are considerably cheaper to obtain, but may
+ * lag the timestamps returned by guac_timestamp_current() by up to a few
+ * milliseconds (one tick of the system timer). Coarse timestamps share the
+ * same reference point as those returned by guac_timestamp_current() and
+ * may be compared with them, and so are suitable for timeouts, idle
+ * tracking, and logging, but not for measuring the durations of individual
+ * frames.
+ *
+ * @return
+ *     An arbitrary millisecond timestamp, with the same reference point as
+ *     guac_timestamp_current().
+ */
+guac_timestamp guac_timestamp_current_coarse();
+
+/**
+ * Returns an arbitrary timestamp in nanoseconds. The difference between
+ * return values of any two calls is equal to the amount of time in
+ * nanoseconds between those calls (to the resolution of the underlying
+ * clock). The return value from a single call will not have any useful (or
+ * defined) meaning.
+ *
+ * @return
+ *     An arbitrary nanosecond timestamp.
+ */
+uint64_t guac_timestamp_current_ns();
+
+/**
+ * Reads the current time as with guac_timestamp_current(), storing that time
+ * as the frame time of the current thread. Code which must repeatedly know
+ * the time at which the frame currently being rendered began may then read
+ * that time at negligible cost using guac_timestamp_frame_time().
+ *
+ * @return
+ *     The current millisecond timestamp, as would be returned by
+ *     guac_timestamp_current(), which is now the frame time of the current
+ *     thread.
+ */
+guac_timestamp guac_timestamp_update_frame_time();
+
+/**
+ * Returns the frame time most recently stored for the current thread by
+ * guac_timestamp_update_frame_time(), without reading any clock. If no frame
+ * time has yet been stored for the current thread, the current time is read
+ * and stored as the frame time as if guac_timestamp_update_frame_time() had
+ * been invoked.
+ *
+ * @return
+ *     The millisecond timestamp of the start of the frame currently being
+ *     rendered by the current thread.
+ */
+guac_timestamp guac_timestamp_frame_time();
+
 /**
  * Sleeps for the given number of milliseconds.
  *
@@ -64,5 +64,18 @@
  */
 #define GUAC_USER_STREAM_INDEX_MIMETYPE "application/vnd.glyptodon.guacamole.stream-index+json"
 
+/**
+ * The default number of unacknowledged blobs that may be in flight at any one
+ * time along a stream sent using guac_user_stream_windowed().
+ */
+#define GUAC_USER_STREAM_WINDOW_SIZE 16
+
+/**
+ * The number of milliseconds between log messages summarizing the output
+ * statistics of each user (see guac_user_get_stats()). These messages are
+ * logged at the debug level.
+ */
+#define GUAC_USER_STATS_INTERVAL 60000
+
 #endif
 
@@ -335,6 +335,35 @@ typedef int guac_user_argv_handler(guac_user* user, guac_stream* stream,
 typedef int guac_user_blob_handler(guac_user* user, guac_stream* stream,
         void* data, int length);
 
+/**
+ * Handler for Guacamole stream blob instructions which receives the blob data
+ * still encoded as base64, exactly as received within the instruction. The
+ * handler is expected to decode that data directly into its final destination
+ * using guac_protocol_decode_base64_buffer(), avoiding the additional copy
+ * that would otherwise be necessary when the decoded data must ultimately be
+ * placed within a buffer belonging to the handler.
+ *
+ * @param user
+ *     The user sending the blob.
+ *
+ * @param stream
+ *     The stream on which the blob was received.
+ *
+ * @param base64
+ *     The base64-encoded data of the blob, as a null-terminated string. This
+ *     string is only valid for the duration of the call to the handler.
+ *
+ * @param length
+ *     The maximum number of bytes that may result from decoding the blob. A
+ *     buffer of this size is always sufficient for
+ *     guac_protocol_decode_base64_buffer().
+ *
+ * @return
+ *     Zero if the blob was handled successfully, or non-zero on error.
+ */
+typedef int guac_user_base64_blob_handler(guac_user* user, guac_stream* stream,
+        const char* base64, int length);
+
 /**
  * Handler for Guacamole stream "ack" instructions. A user will send "ack"
  * instructions to acknowledge the successful receipt of blobs along a stream
@@ -364,6 +393,56 @@ typedef int guac_user_blob_handler(guac_user* user, guac_stream* stream,
 typedef int guac_user_ack_handler(guac_user* user, guac_stream* stream,
         char* error, guac_protocol_status status);
 
+/**
+ * Handler which supplies the data of a stream sent using
+ * guac_user_stream_windowed(), one blob at a time.
+ *
+ * @param user
+ *     The user receiving the stream.
+ *
+ * @param stream
+ *     The stream being sent.
+ *
+ * @param data
+ *     The arbitrary data provided when the stream was started.
+ *
+ * @param buffer
+ *     The buffer that should receive the data of the next blob.
+ *
+ * @param length
+ *     The maximum number of bytes that may be stored within the buffer.
+ *
+ * @return
+ *     The number of bytes stored within the buffer, zero if the end of the
+ *     stream has been reached, or a negative value if an error prevents
+ *     further data from being read.
+ */
+typedef int guac_user_stream_read_handler(guac_user* user,
+        guac_stream* stream, void* data, char* buffer, int length);
+
+/**
+ * Handler which is invoked exactly once when a stream sent using
+ * guac_user_stream_windowed() has ended, allowing any resources associated
+ * with that stream to be released. The stream itself is freed automatically
+ * after this handler returns.
+ *
+ * @param user
+ *     The user that was receiving the stream.
+ *
+ * @param stream
+ *     The stream that has ended.
+ *
+ * @param data
+ *     The arbitrary data provided when the stream was started.
+ *
+ * @param status
+ *     GUAC_PROTOCOL_STATUS_SUCCESS if all data was sent successfully,
+ *     GUAC_PROTOCOL_STATUS_SERVER_ERROR if the read handler failed, or the
+ *     error status sent by the user if the user aborted the stream.
+ */
+typedef void guac_user_stream_complete_handler(guac_user* user,
+        guac_stream* stream, void* data, guac_protocol_status status);
+
 /**
  * Handler for Guacamole stream "end" instructions. End instructions are sent
  * by the user when a stream is closing because its end has been reached.
@@ -38,5 +38,11 @@ typedef struct guac_user guac_user;
  */
 typedef struct guac_user_info guac_user_info;
 
+/**
+ * Statistics describing the responsiveness of a connected user and the output
+ * sent to that user, as returned by guac_user_get_stats().
+ */
+typedef struct guac_user_stats guac_user_stats;
+
 #endif
 
@@ -31,6 +31,7 @@
 #include "client-types.h"
 #include "layer-types.h"
 #include "pool-types.h"
+#include "socket.h"
 #include "socket-types.h"
 #include "stream-types.h"
 #include "timestamp-types.h"
@@ -110,6 +111,65 @@ struct guac_user_info {
      */
     const char* name;
 
+    /**
+     * The maximum number of bytes of data that may be sent to or received
+     * from this user within any one blob instruction. This will be
+     * GUAC_PROTOCOL_BLOB_MAX_LENGTH unless the client requested larger blobs
+     * using the "blobsize" handshake instruction, in which case this will be
+     * the size negotiated with the client, which will never exceed
+     * GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH.
+     */
+    int max_blob_length;
+
+    /**
+     * Non-zero if the client requested that instruction elements containing
+     * raw binary data be allowed using the "binary" handshake instruction,
+     * zero otherwise. If binary elements are allowed, blobs are sent to and
+     * may be received from this user as raw, length-prefixed bytes rather
+     * than as base64.
+     */
+    int binary;
+
+    /**
+     * Non-zero if the client requested a resume token using the "resume"
+     * handshake instruction, zero otherwise. If requested, a token is issued
+     * to the user once the handshake has completed, which the client may
+     * present when rejoining the same connection to resume its current view
+     * of the display (see guac_client_issue_resume_token()).
+     */
+    int resume;
+
+    /**
+     * The timestamp of the last frame received by the client prior to
+     * rejoining the connection, if the user is resuming a previous view of
+     * the display with a valid resume token, or zero otherwise. A pending
+     * user that is resuming is sent only the changes made to the display
+     * since that frame by guac_display_dup().
+     */
+    guac_timestamp resume_timestamp;
+
+};
+
+struct guac_user_stats {
+
+    /**
+     * The duration of the last frame rendered by the user, in milliseconds,
+     * as stored within the last_frame_duration member of guac_user.
+     */
+    int last_frame_duration;
+
+    /**
+     * The overall lag experienced by the user relative to the stream of
+     * frames, roughly excluding network lag, as stored within the
+     * processing_lag member of guac_user.
+     */
+    int processing_lag;
+
+    /**
+     * The output counters of the user's socket.
+     */
+    guac_socket_stats socket;
+
 };
 
 struct guac_user {
@@ -214,6 +274,21 @@ struct guac_user {
      */
     guac_object* __objects;
 
+    /**
+     * The resume token issued to this user by
+     * guac_client_issue_resume_token(), or NULL if no token has been issued.
+     * Once this user leaves, ownership of the token passes to the guac_client,
+     * which retains it until it is claimed or has expired.
+     */
+    char* __resume_token;
+
+    /**
+     * The value of the last_sent_timestamp of the guac_client at the time
+     * __resume_token was issued. A resumed view of the display cannot
+     * predate this frame.
+     */
+    guac_timestamp __resume_issued;
+
     /**
      * Arbitrary user-specific data.
      */
@@ -538,6 +613,26 @@ struct guac_user {
      */
     guac_user_touch_handler* touch_handler;
 
+    /**
+     * Whether mouse motion received from this user may be coalesced. If
+     * non-zero, "mouse" instructions that only move the mouse (the button
+     * mask has not changed) are not passed to mouse_handler while further
+     * input from the user is already waiting to be handled. Only the most
+     * recent position is then passed to mouse_handler, before the next
+     * change in button state or the next instruction of any other kind is
+     * handled, or once no further input is waiting. Changes in button state
+     * are never coalesced. This is zero (disabled) by default.
+     *
+     * Example:
+     * @code
+     *     int guac_user_init(guac_user* user, int argc, char** argv) {
+     *         user->mouse_handler = mouse_handler;
+     *         user->coalesce_mouse = 1;
+     *     }
+     * @endcode
+     */
+    int coalesce_mouse;
+
 };
 
 /**
@@ -627,6 +722,20 @@ guac_stream* guac_user_alloc_stream(guac_user* user);
  */
 void guac_user_free_stream(guac_user* user, guac_stream* stream);
 
+/**
+ * Retrieves statistics describing the responsiveness of the given user and
+ * the output sent to that user, including how much data has been written to
+ * the user's socket and how long those writes have blocked. These statistics
+ * may be used to decide how quickly data should be sent to the user.
+ *
+ * @param user
+ *     The user to retrieve statistics for.
+ *
+ * @param stats
+ *     The guac_user_stats structure that should receive the statistics.
+ */
+void guac_user_get_stats(guac_user* user, guac_user_stats* stats);
+
 /**
  * Signals the given user that it must disconnect, or advises cooperating
  * services that the given user is no longer connected.
@@ -741,6 +850,53 @@ void guac_user_free_object(guac_user* user, guac_object* object);
 void guac_user_stream_argv(guac_user* user, guac_socket* socket,
         const char* mimetype, const char* name, const char* value);
 
+/**
+ * Sends the data of the given stream as a series of blobs while keeping up to
+ * the given number of blobs in flight, rather than waiting for each blob to
+ * be acknowledged before sending the next. This avoids limiting throughput to
+ * one blob per round trip. Each blob is as large as the user supports (see
+ * guac_user_info.max_blob_length).
+ *
+ * This function replaces the ack handler and data of the given stream, and
+ * does not itself send anything. The caller must send the instruction which
+ * begins the stream (such as "file" or "body") after calling this function.
+ * The acknowledgement of that instruction begins the transfer. Each later
+ * acknowledgement allows another blob to be sent. Once the read handler
+ * reports the end of the data and every blob has been acknowledged, the
+ * stream is ended, the complete handler is invoked, and the stream is freed.
+ * Ending only after every blob has been acknowledged ensures that late
+ * acknowledgements cannot be mistaken for those of a different stream
+ * which later reuses the same index.
+ *
+ * @param user
+ *     The user that should receive the stream.
+ *
+ * @param stream
+ *     The stream to send, which must have been allocated with
+ *     guac_user_alloc_stream().
+ *
+ * @param window_size
+ *     The maximum number of blobs which may be awaiting acknowledgement at
+ *     any one time, such as GUAC_USER_STREAM_WINDOW_SIZE.
+ *
+ * @param read_handler
+ *     The handler which should be invoked to read the data of each blob.
+ *
+ * @param complete_handler
+ *     The handler which should be invoked once the stream has ended, or NULL
+ *     if no such handler is needed.
+ *
+ * @param data
+ *     Arbitrary data to pass to the read and complete handlers.
+ *
+ * @return
+ *     Zero if the stream is ready to be started, or non-zero if memory
+ *     for tracking the stream could not be allocated.
+ */
+int guac_user_stream_windowed(guac_user* user, guac_stream* stream,
+        int window_size, guac_user_stream_read_handler* read_handler,
+        guac_user_stream_complete_handler* complete_handler, void* data);
+
 /**
  * Streams the image data of the given surface over an image stream ("img"
  * instruction) as PNG-encoded data. The image stream will be automatically
@@ -39,6 +39,26 @@
  */
 #define GUAC_WOL_DEFAULT_CONNECTION_TIMEOUT 10
 
+/**
+ * The number of seconds to wait for each connection attempt made to probe
+ * whether a remote system is awake. This is deliberately short, as a system
+ * which is awake normally accepts or refuses connections immediately.
+ */
+#define GUAC_WOL_PROBE_TIMEOUT 1
+
+/**
+ * The number of milliseconds to wait before the first probe of whether a
+ * remote system has woken after the Wake-on-LAN packet is sent. This delay
+ * doubles after each failed probe, up to GUAC_WOL_PROBE_MAX_DELAY.
+ */
+#define GUAC_WOL_PROBE_INITIAL_DELAY 250
+
+/**
+ * The maximum number of milliseconds to wait between probes of whether a
+ * remote system has woken.
+ */
+#define GUAC_WOL_PROBE_MAX_DELAY 4000
+
 /**
  * The value for the local IPv4 broadcast address.
  */
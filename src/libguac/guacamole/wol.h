@@ -27,6 +27,7 @@
  * @file wol.h
  */
 
+#include "client-types.h"
 #include "wol-constants.h"
 
 /**
@@ -53,11 +54,11 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
         const unsigned short udp_port);
 
 /**
- * Send the wake-up packet to the specified destination, returning zero if the
- * wake was sent successfully, or non-zero if an error occurs sending the
- * wake packet.  Note that the return value does not specify whether the
- * system actually wakes up successfully, only whether or not the packet
- * is transmitted.
+ * Send the wake-up packet to the specified destination, and wait until the
+ * remote system is reachable, returning zero if the system becomes
+ * reachable, or non-zero if an error occurs sending the wake packet or the
+ * system does not become reachable in time. This is identical to
+ * guac_wol_wake_and_probe(), except that progress is not reported.
  * 
  * @param mac_addr
  *     The MAC address to place in the magic Wake-on-LAN packet.
@@ -69,12 +70,12 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
  *     The UDP port to use when sending the WoL packet.
  *
  * @param wait_time
- *     The number of seconds to wait between connection attempts after the WOL
- *     packet has been sent.
+ *     The number of seconds to allow for each connection attempt after the
+ *     WOL packet has been sent, in addition to the given timeout.
  *
  * @param retries
- *     The number of attempts to make to connect to the system before giving up
- *     on the connection.
+ *     The number of connection attempts to allow for before giving up on the
+ *     connection.
  *
  * @param hostname
  *     The hostname or IP address of the system that has been woken up and to
@@ -85,16 +86,77 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
  *     attempted after the system has been woken.
  *
  * @param timeout
- *     The number of seconds to wait when attempting the connection to the
- *     remote system when checking to see if it is awake.
+ *     The number of seconds to allow for each connection attempt, in
+ *     addition to the given wait time.
  * 
  * @return 
- *     Zero if the packet is successfully sent to the destination; non-zero
- *     if the packet cannot be sent.
+ *     Zero if the packet is successfully sent to the destination and the
+ *     remote system becomes reachable; non-zero otherwise.
  */
 int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
         const unsigned short udp_port, int wait_time, int retries,
         const char* hostname, const char* port, const int timeout);
 
-#endif /* GUAC_WOL_H */
+/**
+ * Send the wake-up packet to the specified destination, and wait until the
+ * remote system is reachable, returning zero if the system becomes
+ * reachable, or non-zero if an error occurs sending the wake packet or the
+ * system does not become reachable in time. If the system is already
+ * reachable, no packet is sent.
+ *
+ * Rather than waiting through a fixed interval between connection attempts,
+ * whether the system is reachable is probed with short connection attempts
+ * (see GUAC_WOL_PROBE_TIMEOUT), backing off exponentially from
+ * GUAC_WOL_PROBE_INITIAL_DELAY to GUAC_WOL_PROBE_MAX_DELAY between probes,
+ * such that the connection proceeds soon after the system is up. The wake
+ * packet is sent again after each failed probe, in case an earlier packet
+ * was lost. Probing stops once retries × (wait_time + timeout) seconds have
+ * elapsed, the longest that a system may have been waited for by earlier
+ * versions of this function.
+ *
+ * While waiting, each user of the given client is sent a
+ * GUAC_MESSAGE_WOL_WAKING message, at most once per second.
+ *
+ * @param client
+ *     The guac_client whose users should be notified of progress while
+ *     waiting, or NULL if progress should not be reported.
+ *
+ * @param mac_addr
+ *     The MAC address to place in the magic Wake-on-LAN packet.
+ * 
+ * @param broadcast_addr
+ *     The broadcast address to which to send the magic Wake-on-LAN packet.
+ * 
+ * @param udp_port
+ *     The UDP port to use when sending the WoL packet.
+ *
+ * @param wait_time
+ *     The number of seconds to allow for each connection attempt after the
+ *     WOL packet has been sent, in addition to the given timeout.
+ *
+ * @param retries
+ *     The number of connection attempts to allow for before giving up on the
+ *     connection.
+ *
+ * @param hostname
+ *     The hostname or IP address of the system that has been woken up and to
+ *     to which the connection will be attempted.
+ *
+ * @param port
+ *     The TCP port of the remote system on which the connection will be
+ *     attempted after the system has been woken.
+ *
+ * @param timeout
+ *     The number of seconds to allow for each connection attempt, in
+ *     addition to the given wait time.
+ *
+ * @return
+ *     Zero if the packet is successfully sent to the destination and the
+ *     remote system becomes reachable; non-zero otherwise.
+ */
+int guac_wol_wake_and_probe(guac_client* client, const char* mac_addr,
+        const char* broadcast_addr, const unsigned short udp_port,
+        int wait_time, int retries, const char* hostname, const char* port,
+        const int timeout);
 
+#endif /* GUAC_WOL_H */
@@ -17,11 +17,24 @@
  * under the License.
  */
 
+#include "config.h"
 #include "guacamole/assert.h"
 #include "guacamole/error.h"
 #include "guacamole/mem.h"
 #include "guacamole/private/mem.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
+
+#include <limits.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -42,6 +55,10 @@
  * It is further OK for guac_mem_free() to be incompatible with free() and only
  * usable on memory blocks allocated through guac_mem_alloc() and similar.
  *
+ * The sole exception is guac_mem_zalloc_pages(), which is new and documented
+ * as requiring guac_mem_free_pages(). It must never be used to implement any
+ * existing function whose memory may be passed to free().
+ *
  * ============================================================================
  */
 
@@ -246,3 +263,304 @@ void PRIV_guac_mem_free(void* mem) {
     free(mem);
 }
 
+/**
+ * The size of each huge page, in bytes. Blocks allocated with
+ * PRIV_guac_mem_zalloc_pages() that are at least this large are mapped
+ * directly from the operating system, aligned to this size, and rounded up to
+ * a multiple of this size, such that they may be backed entirely by huge
+ * pages. Smaller blocks are allocated normally.
+ */
+#define GUAC_MEM_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+/**
+ * The number of bytes reserved at the beginning of each block allocated with
+ * PRIV_guac_mem_zalloc_pages() for the guac_mem_pages_header describing that
+ * block. This is the size of a typical cache line, such that the memory
+ * following the header remains suitably aligned.
+ */
+#define GUAC_MEM_PAGES_HEADER_SIZE 64
+
+/**
+ * Information describing a block of memory allocated with
+ * PRIV_guac_mem_zalloc_pages(), stored immediately before the pointer
+ * returned for that block.
+ */
+typedef struct guac_mem_pages_header {
+
+    /**
+     * The length of the memory mapping containing the block, including this
+     * header, or zero if the block was allocated with calloc() (and must thus
+     * be freed with free()).
+     */
+    size_t length;
+
+    /**
+     * The usable size of the block, excluding this header, as accounted to
+     * the category of the block.
+     */
+    size_t size;
+
+    /**
+     * The category that the block is currently accounted under.
+     */
+    guac_mem_category category;
+
+} guac_mem_pages_header;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+
+/**
+ * Requests that the physical memory backing the given memory mapping be
+ * allocated from the NUMA node of the CPU currently running the calling
+ * thread, if that node can be determined. Memory is still allocated from
+ * other nodes if the preferred node has none available. This must be invoked
+ * before the mapping is first accessed. If NUMA support is unavailable, this
+ * function has no effect.
+ *
+ * @param mapping
+ *     The address of the memory mapping.
+ *
+ * @param length
+ *     The length of the memory mapping, in bytes.
+ */
+static void guac_mem_pages_prefer_local_node(void* mapping, size_t length) {
+
+#if defined(HAVE_LIBNUMA) && defined(HAVE_SCHED_GETCPU)
+
+    if (numa_available() < 0)
+        return;
+
+    int cpu = sched_getcpu();
+    if (cpu < 0)
+        return;
+
+    int node = numa_node_of_cpu(cpu);
+    if (node < 0 || node >= (int) (sizeof(unsigned long) * CHAR_BIT))
+        return;
+
+    /* Failure here only means the memory will be allocated according to the
+     * default policy */
+    unsigned long nodemask = 1UL << node;
+    mbind(mapping, length, MPOL_PREFERRED, &nodemask,
+            sizeof(nodemask) * CHAR_BIT, 0);
+
+#endif
+
+}
+
+/**
+ * Maps a new, zeroed region of anonymous memory of the given length from the
+ * operating system, preferring explicitly-reserved huge pages, then
+ * transparent huge pages, with the mapping aligned to GUAC_MEM_HUGE_PAGE_SIZE
+ * in either case.
+ *
+ * @param length
+ *     The length of the region to map, in bytes. This MUST be a multiple of
+ *     GUAC_MEM_HUGE_PAGE_SIZE.
+ *
+ * @return
+ *     The address of the new mapping, or NULL if no such mapping could be
+ *     created.
+ */
+static void* guac_mem_pages_map(size_t length) {
+
+    void* mapping;
+
+#ifdef MAP_HUGETLB
+
+    /* Use reserved huge pages if the system has any available (this fails
+     * immediately if not enough are reserved) */
+    int hugetlb_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+    hugetlb_flags |= MAP_HUGE_2MB;
+#endif
+
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, hugetlb_flags, -1, 0);
+    if (mapping != MAP_FAILED)
+        return mapping;
+
+#endif
+
+    /* Otherwise, map normal pages with enough slack to align the mapping with
+     * a huge page boundary, trimming away the slack afterward */
+    size_t reserved;
+    if (PRIV_guac_mem_ckd_add(&reserved, 2, (const size_t[]) { length, GUAC_MEM_HUGE_PAGE_SIZE }))
+        return NULL;
+
+    unsigned char* region = mmap(NULL, reserved, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED)
+        return NULL;
+
+    uintptr_t start = ((uintptr_t) region + GUAC_MEM_HUGE_PAGE_SIZE - 1)
+        & ~((uintptr_t) GUAC_MEM_HUGE_PAGE_SIZE - 1);
+
+    size_t head = start - (uintptr_t) region;
+    size_t tail = reserved - head - length;
+
+    if (head)
+        munmap(region, head);
+
+    if (tail)
+        munmap(region + head + length, tail);
+
+    mapping = region + head;
+
+#ifdef MADV_HUGEPAGE
+    /* Request transparent huge pages, if supported (this is only a hint) */
+    madvise(mapping, length, MADV_HUGEPAGE);
+#endif
+
+    return mapping;
+
+}
+
+#endif
+
+void* PRIV_guac_mem_zalloc_pages(size_t factor_count, const size_t* factors) {
+
+    size_t size = 0;
+
+    if (PRIV_guac_mem_ckd_mul(&size, factor_count, factors)
+            || PRIV_guac_mem_ckd_add(&size, 2, (const size_t[]) { size, GUAC_MEM_PAGES_HEADER_SIZE })) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        return NULL;
+    }
+    else if (size == GUAC_MEM_PAGES_HEADER_SIZE)
+        return NULL;
+
+    guac_mem_pages_header* header = NULL;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+
+    /* Map blocks large enough to benefit from huge pages directly, rounding
+     * up to a whole number of huge pages */
+    if (size >= GUAC_MEM_HUGE_PAGE_SIZE
+            && size <= SIZE_MAX - GUAC_MEM_HUGE_PAGE_SIZE) {
+
+        size_t length = (size + GUAC_MEM_HUGE_PAGE_SIZE - 1)
+            & ~(GUAC_MEM_HUGE_PAGE_SIZE - 1);
+
+        void* mapping = guac_mem_pages_map(length);
+        if (mapping != NULL) {
+            guac_mem_pages_prefer_local_node(mapping, length);
+            header = (guac_mem_pages_header*) mapping;
+            header->length = length;
+        }
+
+    }
+
+#endif
+
+    /* Fall back to allocating normally if mapping is not possible or not
+     * worthwhile */
+    if (header == NULL) {
+
+        header = calloc(1, size);
+        if (header == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            return NULL;
+        }
+
+        header->length = 0;
+
+    }
+
+    header->size = size - GUAC_MEM_PAGES_HEADER_SIZE;
+    header->category = GUAC_MEM_CATEGORY_OTHER;
+    guac_mem_account_alloc(header->category, header->size);
+
+    return (unsigned char*) header + GUAC_MEM_PAGES_HEADER_SIZE;
+
+}
+
+void PRIV_guac_mem_free_pages(void* mem) {
+
+    if (mem == NULL)
+        return;
+
+    guac_mem_pages_header* header = (guac_mem_pages_header*)
+        ((unsigned char*) mem - GUAC_MEM_PAGES_HEADER_SIZE);
+
+    guac_mem_account_free(header->category, header->size);
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+    if (header->length) {
+        munmap(header, header->length);
+        return;
+    }
+#endif
+
+    free(header);
+
+}
+
+/**
+ * The number of bytes currently accounted to each category of memory by the
+ * current process, indexed by guac_mem_category.
+ */
+static atomic_uint_fast64_t guac_mem_stats_bytes[GUAC_MEM_CATEGORY_COUNT];
+
+/**
+ * The name of each category of memory, indexed by guac_mem_category.
+ */
+static const char* const guac_mem_category_names[GUAC_MEM_CATEGORY_COUNT] = {
+    [GUAC_MEM_CATEGORY_OTHER]     = "other",
+    [GUAC_MEM_CATEGORY_DISPLAY]   = "display",
+    [GUAC_MEM_CATEGORY_TERMINAL]  = "terminal",
+    [GUAC_MEM_CATEGORY_CLIPBOARD] = "clipboard",
+    [GUAC_MEM_CATEGORY_RECORDING] = "recording",
+    [GUAC_MEM_CATEGORY_STREAM]    = "stream"
+};
+
+void guac_mem_account_alloc(guac_mem_category category, size_t size) {
+
+    if (category < 0 || category >= GUAC_MEM_CATEGORY_COUNT || !size)
+        return;
+
+    atomic_fetch_add_explicit(&guac_mem_stats_bytes[category], size,
+            memory_order_relaxed);
+
+}
+
+void guac_mem_account_free(guac_mem_category category, size_t size) {
+
+    if (category < 0 || category >= GUAC_MEM_CATEGORY_COUNT || !size)
+        return;
+
+    atomic_fetch_sub_explicit(&guac_mem_stats_bytes[category], size,
+            memory_order_relaxed);
+
+}
+
+void guac_mem_tag_pages(void* mem, guac_mem_category category) {
+
+    if (mem == NULL || category < 0 || category >= GUAC_MEM_CATEGORY_COUNT)
+        return;
+
+    guac_mem_pages_header* header = (guac_mem_pages_header*)
+        ((unsigned char*) mem - GUAC_MEM_PAGES_HEADER_SIZE);
+
+    guac_mem_account_free(header->category, header->size);
+    header->category = category;
+    guac_mem_account_alloc(header->category, header->size);
+
+}
+
+void guac_mem_get_process_stats(guac_mem_stats* stats) {
+
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT; i++)
+        stats->bytes[i] = atomic_load_explicit(&guac_mem_stats_bytes[i],
+                memory_order_relaxed);
+
+}
+
+const char* guac_mem_category_name(guac_mem_category category) {
+
+    if (category < 0 || category >= GUAC_MEM_CATEGORY_COUNT)
+        return "unknown";
+
+    return guac_mem_category_names[category];
+
+}
@@ -0,0 +1,259 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/mem.h"
+#include "guacamole/audio.h"
+#include "guacamole/client.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/user.h"
+#include "ogg_encoder.h"
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisenc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Appends the given Ogg page to the Vorbis stream headers stored within the
+ * given encoder state, such that those headers can later be sent to users
+ * that join after the stream has begun.
+ *
+ * @param state
+ *     The encoder state receiving the page.
+ *
+ * @param page
+ *     The Ogg page to store.
+ */
+static void ogg_encoder_store_header_page(ogg_encoder_state* state,
+        ogg_page* page) {
+
+    int length = page->header_len + page->body_len;
+
+    state->headers = guac_mem_realloc_or_die(state->headers,
+            guac_mem_ckd_add_or_die(state->headers_length, length));
+
+    memcpy(state->headers + state->headers_length,
+            page->header, page->header_len);
+    memcpy(state->headers + state->headers_length + page->header_len,
+            page->body, page->body_len);
+
+    state->headers_length += length;
+
+}
+
+/**
+ * Sends the given Ogg page along the given audio stream to all users.
+ *
+ * @param audio
+ *     The audio stream to send the page along.
+ *
+ * @param page
+ *     The Ogg page to send.
+ */
+static void ogg_encoder_send_page(guac_audio_stream* audio, ogg_page* page) {
+
+    guac_socket* socket = audio->client->socket;
+
+    guac_protocol_send_blobs(socket, audio->stream,
+            page->header, page->header_len);
+    guac_protocol_send_blobs(socket, audio->stream,
+            page->body, page->body_len);
+
+}
+
+/**
+ * Compresses any audio that the Vorbis encoder has buffered and is ready to
+ * encode, sending each resulting Ogg page to all users.
+ *
+ * @param audio
+ *     The audio stream whose buffered audio should be encoded.
+ */
+static void ogg_encoder_encode(guac_audio_stream* audio) {
+
+    ogg_encoder_state* state = (ogg_encoder_state*) audio->data;
+
+    /* Encode all blocks of audio that are ready */
+    while (vorbis_analysis_blockout(&(state->vorbis_state),
+                &(state->vorbis_block)) == 1) {
+
+        vorbis_analysis(&(state->vorbis_block), NULL);
+        vorbis_bitrate_addblock(&(state->vorbis_block));
+
+        /* Packetize encoded audio, sending each complete page */
+        while (vorbis_bitrate_flushpacket(&(state->vorbis_state),
+                    &(state->ogg_packet))) {
+
+            ogg_stream_packetin(&(state->ogg_state), &(state->ogg_packet));
+
+            while (ogg_stream_pageout(&(state->ogg_state),
+                        &(state->ogg_page)) != 0)
+                ogg_encoder_send_page(audio, &(state->ogg_page));
+
+        }
+
+    }
+
+}
+
+static void ogg_encoder_begin_handler(guac_audio_stream* audio) {
+
+    /* Allocate stream state */
+    ogg_encoder_state* state = guac_mem_zalloc(sizeof(ogg_encoder_state));
+
+    /* Init state */
+    vorbis_info_init(&(state->info));
+    vorbis_encode_init_vbr(&(state->info), audio->channels, audio->rate,
+            GUAC_OGG_ENCODER_QUALITY);
+
+    vorbis_analysis_init(&(state->vorbis_state), &(state->info));
+    vorbis_block_init(&(state->vorbis_state), &(state->vorbis_block));
+
+    vorbis_comment_init(&(state->comment));
+    vorbis_comment_add_tag(&(state->comment), "ENCODER", "libguac");
+
+    ogg_stream_init(&(state->ogg_state), rand());
+
+    /* Write stream headers */
+    ogg_packet header;
+    ogg_packet header_comm;
+    ogg_packet header_code;
+
+    vorbis_analysis_headerout(&(state->vorbis_state), &(state->comment),
+            &header, &header_comm, &header_code);
+
+    ogg_stream_packetin(&(state->ogg_state), &header);
+    ogg_stream_packetin(&(state->ogg_state), &header_comm);
+    ogg_stream_packetin(&(state->ogg_state), &header_code);
+
+    /* Headers must be on their own pages, apart from any audio data */
+    while (ogg_stream_flush(&(state->ogg_state), &(state->ogg_page)) != 0)
+        ogg_encoder_store_header_page(state, &(state->ogg_page));
+
+    audio->data = state;
+
+    /* Broadcast existence of stream, followed by its headers */
+    guac_protocol_send_audio(audio->client->socket, audio->stream,
+            "audio/ogg");
+    guac_protocol_send_blobs(audio->client->socket, audio->stream,
+            state->headers, state->headers_length);
+
+}
+
+static void ogg_encoder_join_handler(guac_audio_stream* audio,
+        guac_user* user) {
+
+    ogg_encoder_state* state = (ogg_encoder_state*) audio->data;
+
+    /* Notify user of existence of stream, sending the stream headers
+     * required to decode any further audio */
+    guac_protocol_send_audio(user->socket, audio->stream, "audio/ogg");
+    guac_protocol_send_blobs(user->socket, audio->stream,
+            state->headers, state->headers_length);
+
+}
+
+static void ogg_encoder_end_handler(guac_audio_stream* audio) {
+
+    ogg_encoder_state* state = (ogg_encoder_state*) audio->data;
+
+    /* Encode and send whatever audio remains, marking the end of the Vorbis
+     * stream */
+    vorbis_analysis_wrote(&(state->vorbis_state), 0);
+    ogg_encoder_encode(audio);
+
+    /* Send end of stream */
+    guac_protocol_send_end(audio->client->socket, audio->stream);
+
+    /* Clean up encoder */
+    ogg_stream_clear(&(state->ogg_state));
+    vorbis_block_clear(&(state->vorbis_block));
+    vorbis_dsp_clear(&(state->vorbis_state));
+    vorbis_comment_clear(&(state->comment));
+    vorbis_info_clear(&(state->info));
+
+    /* Free state information */
+    guac_mem_free(state->headers);
+    guac_mem_free(state);
+
+}
+
+static void ogg_encoder_write_handler(guac_audio_stream* audio,
+        const unsigned char* pcm_data, int length) {
+
+    ogg_encoder_state* state = (ogg_encoder_state*) audio->data;
+
+    int bytes_per_sample = audio->bps / 8;
+    int bytes_per_frame = bytes_per_sample * audio->channels;
+    int frames = length / bytes_per_frame;
+
+    while (frames > 0) {
+
+        /* Submit at most GUAC_OGG_ENCODER_MAX_FRAMES at a time */
+        int chunk_frames = frames;
+        if (chunk_frames > GUAC_OGG_ENCODER_MAX_FRAMES)
+            chunk_frames = GUAC_OGG_ENCODER_MAX_FRAMES;
+
+        float** buffer = vorbis_analysis_buffer(&(state->vorbis_state),
+                chunk_frames);
+
+        /* Convert interleaved PCM samples to non-interleaved floating point
+         * (16-bit PCM is signed, while 8-bit PCM is unsigned) */
+        for (int i = 0; i < chunk_frames; i++) {
+            for (int channel = 0; channel < audio->channels; channel++) {
+
+                float sample;
+                if (bytes_per_sample == 2) {
+                    int16_t value = (int16_t) (pcm_data[0] | (pcm_data[1] << 8));
+                    sample = value / 32768.0f;
+                }
+                else
+                    sample = (pcm_data[0] - 128) / 128.0f;
+
+                buffer[channel][i] = sample;
+                pcm_data += bytes_per_sample;
+
+            }
+        }
+
+        vorbis_analysis_wrote(&(state->vorbis_state), chunk_frames);
+        frames -= chunk_frames;
+
+        /* Encode and send the audio submitted */
+        ogg_encoder_encode(audio);
+
+    }
+
+}
+
+/* Ogg Vorbis encoder handlers */
+guac_audio_encoder _ogg_encoder = {
+    .mimetype      = "audio/ogg",
+    .begin_handler = ogg_encoder_begin_handler,
+    .write_handler = ogg_encoder_write_handler,
+    .join_handler  = ogg_encoder_join_handler,
+    .end_handler   = ogg_encoder_end_handler
+};
+
+/* Actual encoder definition */
+guac_audio_encoder* ogg_encoder = &_ogg_encoder;
@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_OGG_ENCODER_H
+#define GUAC_OGG_ENCODER_H
+
+#include "config.h"
+
+#include "guacamole/audio.h"
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisenc.h>
+
+/**
+ * The quality of the Vorbis audio produced by the Ogg encoder, as a value
+ * between -0.1 (lowest quality, smallest size) and 1.0 (highest quality,
+ * largest size). A quality of 0.4 corresponds to roughly 128 kbps for 44.1 kHz
+ * stereo audio, roughly a tenth of the bandwidth of the equivalent raw PCM.
+ */
+#define GUAC_OGG_ENCODER_QUALITY 0.4
+
+/**
+ * The maximum number of PCM frames (one sample for each channel) to submit
+ * to the Vorbis encoder at once.
+ */
+#define GUAC_OGG_ENCODER_MAX_FRAMES 8192
+
+/**
+ * The current state of the Ogg Vorbis encoder. PCM data is compressed with
+ * Vorbis as it is provided, with each resulting Ogg page sent as soon as it
+ * is complete.
+ */
+typedef struct ogg_encoder_state {
+
+    /**
+     * Ogg state, tracking the pages of the Ogg stream being produced.
+     */
+    ogg_stream_state ogg_state;
+
+    /**
+     * The most recently produced Ogg page.
+     */
+    ogg_page ogg_page;
+
+    /**
+     * The most recently produced Vorbis packet.
+     */
+    ogg_packet ogg_packet;
+
+    /**
+     * Static information describing the Vorbis stream being produced.
+     */
+    vorbis_info info;
+
+    /**
+     * User comments (metadata) of the Vorbis stream being produced.
+     */
+    vorbis_comment comment;
+
+    /**
+     * The state of the Vorbis encoder.
+     */
+    vorbis_dsp_state vorbis_state;
+
+    /**
+     * Working space of the Vorbis encoder for each block of audio.
+     */
+    vorbis_block vorbis_block;
+
+    /**
+     * The Ogg pages containing the Vorbis stream headers, which must be
+     * received by each user before any audio data can be decoded. These
+     * pages are resent to each user that joins once the stream has begun.
+     */
+    unsigned char* headers;
+
+    /**
+     * The number of bytes within the headers buffer.
+     */
+    int headers_length;
+
+} ogg_encoder_state;
+
+/**
+ * Audio encoder which compresses PCM data with Ogg Vorbis.
+ */
+extern guac_audio_encoder* ogg_encoder;
+
+#endif
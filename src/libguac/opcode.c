@@ -0,0 +1,186 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/opcode.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The number of hash function seeds to try for each hash table size before
+ * moving on to the next larger hash table size.
+ */
+#define GUAC_OPCODE_INDEX_MAX_SEEDS 1024
+
+/**
+ * Returns the opcode of the mapping at the given position within the array
+ * indexed by the given guac_opcode_index.
+ *
+ * @param index
+ *     The guac_opcode_index whose array contains the mapping.
+ *
+ * @param position
+ *     The position of the mapping within the array.
+ *
+ * @return
+ *     The opcode of the mapping at the given position, or NULL if that
+ *     mapping is the terminating mapping of the array.
+ */
+static const char* guac_opcode_index_get(const guac_opcode_index* index,
+        int position) {
+    return *((const char* const*) ((const char*) index->map
+                + position * index->stride));
+}
+
+/**
+ * Hashes the given opcode using a seeded variant of 32-bit FNV-1a, mixing
+ * the high bits of the result into the low bits that select a slot.
+ *
+ * @param opcode
+ *     The opcode to hash.
+ *
+ * @param seed
+ *     The seed of the hash function.
+ *
+ * @return
+ *     The hash of the given opcode.
+ */
+static uint32_t guac_opcode_hash(const char* opcode, uint32_t seed) {
+
+    uint32_t hash = 2166136261u ^ (seed * 2654435761u);
+    while (*opcode != '\0') {
+        hash ^= (unsigned char) *(opcode++);
+        hash *= 16777619u;
+    }
+
+    return hash ^ (hash >> 16);
+
+}
+
+/**
+ * Attempts to populate the hash table of the given guac_opcode_index using
+ * the given table size and hash function seed, succeeding only if no two
+ * opcodes hash to the same slot.
+ *
+ * @param index
+ *     The guac_opcode_index whose hash table should be populated.
+ *
+ * @param mask
+ *     The number of slots to use within the hash table, minus one. The
+ *     number of slots must be a power of two.
+ *
+ * @param seed
+ *     The seed of the hash function.
+ *
+ * @return
+ *     Non-zero if every opcode was assigned its own slot, zero otherwise.
+ */
+static int guac_opcode_index_try(guac_opcode_index* index, unsigned int mask,
+        uint32_t seed) {
+
+    memset(index->slots, 0, sizeof(index->slots));
+
+    for (int i = 0; i < index->length; i++) {
+
+        unsigned int slot = guac_opcode_hash(guac_opcode_index_get(index, i),
+                seed) & mask;
+
+        /* Each slot may contain only one opcode */
+        if (index->slots[slot] != 0)
+            return 0;
+
+        index->slots[slot] = i + 1;
+
+    }
+
+    index->mask = mask;
+    index->seed = seed;
+    return 1;
+
+}
+
+int guac_opcode_index_init(guac_opcode_index* index, const void* map,
+        size_t stride) {
+
+    index->map = map;
+    index->stride = stride;
+    index->mask = 0;
+    index->seed = 0;
+    memset(index->slots, 0, sizeof(index->slots));
+
+    index->length = 0;
+    while (guac_opcode_index_get(index, index->length) != NULL)
+        index->length++;
+
+    /* Empty arrays need not be hashed */
+    if (index->length == 0)
+        return 0;
+
+    /* Each slot can refer to only 255 distinct mappings */
+    if (index->length >= GUAC_OPCODE_INDEX_MAX_SLOTS)
+        return 1;
+
+    /* Start with a table at least twice as large as the number of opcodes,
+     * growing the table each time the available seeds are exhausted */
+    unsigned int size = 2;
+    while (size < (unsigned int) index->length * 2)
+        size <<= 1;
+
+    for (; size <= GUAC_OPCODE_INDEX_MAX_SLOTS; size <<= 1) {
+        for (uint32_t seed = 0; seed < GUAC_OPCODE_INDEX_MAX_SEEDS; seed++) {
+            if (guac_opcode_index_try(index, size - 1, seed))
+                return 0;
+        }
+    }
+
+    /* Fall back to linear search (there are likely duplicate opcodes) */
+    memset(index->slots, 0, sizeof(index->slots));
+    return 1;
+
+}
+
+int guac_opcode_index_lookup(const guac_opcode_index* index,
+        const char* opcode) {
+
+    /* With a collision-free hash, only one opcode can possibly match */
+    if (index->mask != 0) {
+
+        int slot = index->slots[guac_opcode_hash(opcode, index->seed)
+            & index->mask];
+
+        if (slot != 0 && strcmp(guac_opcode_index_get(index, slot - 1),
+                    opcode) == 0)
+            return slot - 1;
+
+        return -1;
+
+    }
+
+    for (int i = 0; i < index->length; i++) {
+        if (strcmp(guac_opcode_index_get(index, i), opcode) == 0)
+            return i;
+    }
+
+    return -1;
+
+}
+
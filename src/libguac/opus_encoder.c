@@ -0,0 +1,317 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/mem.h"
+#include "guacamole/audio.h"
+#include "guacamole/client.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
+#include "guacamole/user.h"
+#include "opus_encoder.h"
+
+#include <opus/opus.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Returns whether Opus can encode audio at the given sample rate without
+ * that audio first being resampled.
+ *
+ * @param rate
+ *     The sample rate to test, in samples per second.
+ *
+ * @return
+ *     Non-zero if Opus supports the given sample rate, zero otherwise.
+ */
+static int opus_encoder_supports_rate(int rate) {
+    return rate == 8000
+        || rate == 12000
+        || rate == 16000
+        || rate == 24000
+        || rate == 48000;
+}
+
+/**
+ * Sends the "audio" instruction describing the given audio stream over the
+ * given socket.
+ *
+ * @param audio
+ *     The audio stream being described.
+ *
+ * @param socket
+ *     The socket to send the "audio" instruction over.
+ */
+static void opus_encoder_send_audio(guac_audio_stream* audio,
+        guac_socket* socket) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    char mimetype[256];
+
+    /* Produce mimetype string from format info */
+    snprintf(mimetype, sizeof(mimetype), "audio/opus;rate=%i,channels=%i",
+            state->rate, audio->channels);
+
+    /* Associate stream */
+    guac_protocol_send_audio(socket, audio->stream, mimetype);
+
+}
+
+/**
+ * Applies the bitrate and frame duration currently set on (or hinted for) the
+ * given audio stream to its Opus encoder, using the defaults of the Opus encoder for any
+ * parameter that is not set. Bitrates are clamped to the range supported by
+ * Opus, and frame durations are rounded down to the nearest duration that
+ * Opus supports. This must only be invoked while the frame buffer is empty.
+ *
+ * @param audio
+ *     The audio stream whose parameters should be applied.
+ */
+static void opus_encoder_apply_parameters(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    /* Update bitrate only if changed */
+    int bitrate = audio->bitrate;
+    if (bitrate <= 0)
+        bitrate = GUAC_OPUS_ENCODER_DEFAULT_BITRATE;
+    else if (bitrate < GUAC_OPUS_ENCODER_MIN_BITRATE)
+        bitrate = GUAC_OPUS_ENCODER_MIN_BITRATE;
+    else if (bitrate > GUAC_OPUS_ENCODER_MAX_BITRATE)
+        bitrate = GUAC_OPUS_ENCODER_MAX_BITRATE;
+
+    if (bitrate != state->bitrate) {
+        opus_encoder_ctl(state->encoder, OPUS_SET_BITRATE(bitrate));
+        state->bitrate = bitrate;
+    }
+
+    /* Round frame duration down to the nearest duration supported by Opus
+     * (excluding 2.5 ms, which cannot be requested in whole milliseconds) */
+    int duration = audio->frame_duration;
+    if (duration <= 0)
+        duration = audio->hinted_frame_duration;
+    if (duration <= 0)
+        duration = GUAC_OPUS_ENCODER_DEFAULT_FRAME_DURATION;
+    else if (duration >= GUAC_OPUS_ENCODER_MAX_FRAME_DURATION)
+        duration = GUAC_OPUS_ENCODER_MAX_FRAME_DURATION;
+    else if (duration >= 40)
+        duration = 40;
+    else if (duration >= 20)
+        duration = 20;
+    else if (duration >= 10)
+        duration = 10;
+    else
+        duration = 5;
+
+    state->frame_size = state->rate * duration / 1000;
+
+}
+
+/**
+ * Compresses the complete frame currently stored within the frame buffer of
+ * the given audio stream, sending the resulting Opus packet to all users as a
+ * single blob. Any changes to the bitrate or frame duration of the audio
+ * stream are applied once the frame has been encoded.
+ *
+ * @param audio
+ *     The audio stream whose buffered frame should be encoded.
+ */
+static void opus_encoder_encode_frame(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    opus_int32 length = opus_encode(state->encoder, state->frame,
+            state->frame_size, state->packet, sizeof(state->packet));
+
+    /* Each packet must be received within its own blob, as Opus packets do
+     * not delimit themselves */
+    if (length > 0)
+        guac_protocol_send_blob(audio->client->socket, audio->stream,
+                state->packet, length);
+    else if (length < 0)
+        guac_client_log(audio->client, GUAC_LOG_DEBUG, "Opus encoding of "
+                "audio frame failed: %s", opus_strerror(length));
+
+    state->frame_length = 0;
+    opus_encoder_apply_parameters(audio);
+
+}
+
+/**
+ * Appends a single PCM frame to the frame buffer of the given audio stream,
+ * encoding and sending the buffered frame if it is now complete.
+ *
+ * @param audio
+ *     The audio stream receiving the PCM frame.
+ *
+ * @param samples
+ *     The 16-bit samples of the PCM frame, one for each channel.
+ */
+static void opus_encoder_append(guac_audio_stream* audio,
+        const opus_int16* samples) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    memcpy(state->frame + state->frame_length * audio->channels, samples,
+            sizeof(opus_int16) * audio->channels);
+
+    if (++state->frame_length == state->frame_size)
+        opus_encoder_encode_frame(audio);
+
+}
+
+static void opus_encoder_begin_handler(guac_audio_stream* audio) {
+
+    /* Allocate stream state */
+    opus_encoder_state* state = guac_mem_zalloc(sizeof(opus_encoder_state));
+    audio->data = state;
+
+    /* Encode at the provided rate if possible, resampling otherwise */
+    if (opus_encoder_supports_rate(audio->rate))
+        state->rate = audio->rate;
+    else
+        state->rate = GUAC_OPUS_ENCODER_RATE;
+
+    state->step = (double) audio->rate / state->rate;
+    state->position = 1.0;
+
+    state->frame = guac_mem_zalloc(sizeof(opus_int16), audio->channels,
+            GUAC_OPUS_ENCODER_RATE * GUAC_OPUS_ENCODER_MAX_FRAME_DURATION / 1000);
+
+    /* Init encoder */
+    int error;
+    state->encoder = opus_encoder_create(state->rate, audio->channels,
+            OPUS_APPLICATION_AUDIO, &error);
+
+    if (state->encoder == NULL)
+        guac_client_log(audio->client, GUAC_LOG_ERROR, "Unable to create "
+                "Opus encoder: %s. Sound will be dropped.",
+                opus_strerror(error));
+    else
+        opus_encoder_apply_parameters(audio);
+
+    /* Broadcast existence of stream */
+    opus_encoder_send_audio(audio, audio->client->socket);
+
+}
+
+static void opus_encoder_join_handler(guac_audio_stream* audio,
+        guac_user* user) {
+
+    /* Notify user of existence of stream */
+    opus_encoder_send_audio(audio, user->socket);
+
+}
+
+static void opus_encoder_end_handler(guac_audio_stream* audio) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    if (state->encoder != NULL) {
+
+        /* Pad any partial frame with silence, such that the remaining audio
+         * is not lost */
+        if (state->frame_length > 0) {
+            memset(state->frame + state->frame_length * audio->channels, 0,
+                    sizeof(opus_int16) * audio->channels
+                    * (state->frame_size - state->frame_length));
+            state->frame_length = state->frame_size;
+            opus_encoder_encode_frame(audio);
+        }
+
+        opus_encoder_destroy(state->encoder);
+
+    }
+
+    /* Send end of stream */
+    guac_protocol_send_end(audio->client->socket, audio->stream);
+
+    /* Free state information */
+    guac_mem_free(state->frame);
+    guac_mem_free(state);
+
+}
+
+static void opus_encoder_write_handler(guac_audio_stream* audio,
+        const unsigned char* pcm_data, int length) {
+
+    opus_encoder_state* state = (opus_encoder_state*) audio->data;
+
+    /* Drop audio if no encoder is available */
+    if (state->encoder == NULL)
+        return;
+
+    int bytes_per_sample = audio->bps / 8;
+    int bytes_per_frame = bytes_per_sample * audio->channels;
+    int frames = length / bytes_per_frame;
+
+    for (int i = 0; i < frames; i++) {
+
+        /* Convert PCM samples to signed 16-bit (16-bit PCM is signed, while
+         * 8-bit PCM is unsigned) */
+        opus_int16 current[2];
+        for (int channel = 0; channel < audio->channels; channel++) {
+
+            if (bytes_per_sample == 2)
+                current[channel] = (opus_int16) (pcm_data[0] | (pcm_data[1] << 8));
+            else
+                current[channel] = (opus_int16) ((pcm_data[0] - 128) << 8);
+
+            pcm_data += bytes_per_sample;
+
+        }
+
+        /* Produce all encoded PCM frames that fall between the previous PCM
+         * frame and this one, interpolating linearly (if the rate is not
+         * changing, this produces exactly the previous PCM frame) */
+        while (state->position < 1.0) {
+
+            opus_int16 resampled[2];
+            for (int channel = 0; channel < audio->channels; channel++)
+                resampled[channel] = (opus_int16) (state->last[channel]
+                        + (current[channel] - state->last[channel])
+                        * state->position);
+
+            opus_encoder_append(audio, resampled);
+            state->position += state->step;
+
+        }
+
+        state->position -= 1.0;
+        memcpy(state->last, current, sizeof(opus_int16) * audio->channels);
+
+    }
+
+}
+
+/* Opus encoder handlers */
+guac_audio_encoder _opus_encoder = {
+    .mimetype      = "audio/opus",
+    .begin_handler = opus_encoder_begin_handler,
+    .write_handler = opus_encoder_write_handler,
+    .join_handler  = opus_encoder_join_handler,
+    .end_handler   = opus_encoder_end_handler
+};
+
+/* Actual encoder definition */
+guac_audio_encoder* opus_encoder = &_opus_encoder;
+
@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_OPUS_ENCODER_H
+#define GUAC_OPUS_ENCODER_H
+
+#include "config.h"
+
+#include "guacamole/audio.h"
+
+#include <opus/opus.h>
+
+/**
+ * The sample rate to encode audio at if the PCM data provided to the audio
+ * stream is not at a rate supported natively by Opus (8, 12, 16, 24, or
+ * 48 kHz), in which case that PCM data is resampled to this rate.
+ */
+#define GUAC_OPUS_ENCODER_RATE 48000
+
+/**
+ * The bitrate that the Opus encoder should target, in bits per second, if no
+ * bitrate is set on the audio stream.
+ */
+#define GUAC_OPUS_ENCODER_DEFAULT_BITRATE 64000
+
+/**
+ * The smallest bitrate that Opus can target, in bits per second.
+ */
+#define GUAC_OPUS_ENCODER_MIN_BITRATE 500
+
+/**
+ * The largest bitrate that Opus can target, in bits per second.
+ */
+#define GUAC_OPUS_ENCODER_MAX_BITRATE 512000
+
+/**
+ * The duration of each Opus frame, in milliseconds, if no frame duration is
+ * set on the audio stream.
+ */
+#define GUAC_OPUS_ENCODER_DEFAULT_FRAME_DURATION 20
+
+/**
+ * The largest duration of any Opus frame, in milliseconds.
+ */
+#define GUAC_OPUS_ENCODER_MAX_FRAME_DURATION 60
+
+/**
+ * The maximum size of a single encoded Opus packet, in bytes. This value is
+ * recommended by the libopus documentation, and is small enough that each
+ * packet can be sent within a single blob.
+ */
+#define GUAC_OPUS_ENCODER_MAX_PACKET_SIZE 4000
+
+/**
+ * The current state of the Opus encoder. PCM data is converted to 16-bit
+ * samples (resampled if necessary) and collected into frames of the current
+ * frame duration, with each frame compressed and sent as a single Opus packet
+ * within its own blob as soon as that frame is complete.
+ */
+typedef struct opus_encoder_state {
+
+    /**
+     * The underlying Opus encoder, or NULL if the encoder could not be
+     * created, in which case all PCM data is dropped.
+     */
+    OpusEncoder* encoder;
+
+    /**
+     * The sample rate that audio is being encoded at. This is the rate of the
+     * PCM data provided to the audio stream if Opus supports that rate, and
+     * GUAC_OPUS_ENCODER_RATE otherwise.
+     */
+    int rate;
+
+    /**
+     * The number of PCM frames of the provided audio that elapse for each
+     * PCM frame of encoded audio. This is 1 if no resampling is needed.
+     */
+    double step;
+
+    /**
+     * The position of the next resampled PCM frame, relative to the most
+     * recent PCM frame provided to the audio stream, in units of provided
+     * PCM frames.
+     */
+    double position;
+
+    /**
+     * The most recent PCM frame provided to the audio stream, with one
+     * sample for each channel.
+     */
+    opus_int16 last[2];
+
+    /**
+     * The bitrate currently targeted by the Opus encoder, in bits per second.
+     */
+    int bitrate;
+
+    /**
+     * The number of PCM frames within each Opus frame, as determined by the
+     * current frame duration.
+     */
+    int frame_size;
+
+    /**
+     * Interleaved 16-bit PCM samples of the Opus frame currently being
+     * collected. This buffer has room for the largest possible frame.
+     */
+    opus_int16* frame;
+
+    /**
+     * The number of PCM frames currently stored within the frame buffer.
+     */
+    int frame_length;
+
+    /**
+     * Buffer receiving each encoded Opus packet.
+     */
+    unsigned char packet[GUAC_OPUS_ENCODER_MAX_PACKET_SIZE];
+
+} opus_encoder_state;
+
+/**
+ * Audio encoder which compresses PCM data with Opus.
+ */
+extern guac_audio_encoder* opus_encoder;
+
+#endif
+
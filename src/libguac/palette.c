@@ -31,8 +31,6 @@
 
 guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
-    int x, y;
-
     int width = cairo_image_surface_get_width(surface);
     int height = cairo_image_surface_get_height(surface);
     int stride = cairo_image_surface_get_stride(surface);
@@ -41,11 +39,29 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
     /* Allocate palette */
     guac_palette* palette = (guac_palette*) guac_mem_zalloc(sizeof(guac_palette));
 
+    if (guac_palette_build(palette, data, width, height, stride)) {
+        guac_palette_free(palette);
+        return NULL;
+    }
+
+    return palette;
+
+}
+
+int guac_palette_build(guac_palette* palette, const unsigned char* data,
+        int width, int height, int stride) {
+
+    int x, y;
+
+    /* Reset any previous contents */
+    memset(palette->entries, 0, sizeof(palette->entries));
+    palette->size = 0;
+
     for (y=0; y<height; y++) {
         for (x=0; x<width; x++) {
 
             /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
+            int color = ((const uint32_t*) data)[x] & 0xFFFFFF;
 
             /* Calculate hash code */
             int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
@@ -63,10 +79,8 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
                     png_color* c;
 
                     /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+                    if (palette->size == 256)
+                        return 1;
 
                     /* Store in palette */
                     c = &(palette->colors[palette->size]);
@@ -97,7 +111,7 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
     }
 
-    return palette;
+    return 0;
 
 }
 
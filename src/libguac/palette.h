@@ -39,6 +39,9 @@ typedef struct guac_palette {
 } guac_palette;
 
 guac_palette* guac_palette_alloc(cairo_surface_t* surface);
+
+int guac_palette_build(guac_palette* palette, const unsigned char* data,
+        int width, int height, int stride);
 int guac_palette_find(guac_palette* palette, int color);
 void guac_palette_free(guac_palette* palette);
 
@@ -24,17 +24,89 @@
 #include "guacamole/parser.h"
 #include "guacamole/socket.h"
 #include "guacamole/unicode.h"
+#include "probe.h"
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Bitmask which, when applied to a 64-bit word, is non-zero only if at least
+ * one byte within that word is not ASCII (has its high bit set).
+ */
+#define GUAC_PARSER_NON_ASCII_MASK 0x8080808080808080ULL
+
+/**
+ * Returns the number of leading bytes within the given buffer that are ASCII
+ * characters, stopping at the first byte having its high bit set or at the
+ * end of the buffer. As each ASCII character is exactly one byte in UTF-8,
+ * the returned value is also the number of characters that may be skipped
+ * without determining the size of each character individually.
+ *
+ * @param buffer
+ *     The buffer to test.
+ *
+ * @param length
+ *     The number of bytes within the buffer.
+ *
+ * @return
+ *     The number of leading ASCII bytes within the buffer.
+ */
+static int guac_parser_ascii_length(const char* buffer, int length) {
+
+    int offset = 0;
+
+#ifdef __SSE2__
+    /* Test sixteen bytes at a time where possible (SSE2 is always available
+     * on x86-64, and the high bit of each byte is exactly what
+     * _mm_movemask_epi8() extracts) */
+    while (length - offset >= 16) {
+
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(
+                    (const __m128i*) (buffer + offset)));
+
+        if (mask)
+            return offset + __builtin_ctz(mask);
+
+        offset += 16;
+
+    }
+#endif
+
+    /* Test remaining bytes a word at a time */
+    while (length - offset >= 8) {
+
+        uint64_t word;
+        memcpy(&word, buffer + offset, sizeof(word));
+
+        if (word & GUAC_PARSER_NON_ASCII_MASK)
+            break;
+
+        offset += 8;
+
+    }
+
+    /* Test any remaining bytes individually */
+    while (offset < length && !(buffer[offset] & 0x80))
+        offset++;
+
+    return offset;
+
+}
+
 static void guac_parser_reset(guac_parser* parser) {
     parser->opcode = NULL;
     parser->argc = 0;
     parser->state = GUAC_PARSE_LENGTH;
     parser->__elementc = 0;
     parser->__element_length = 0;
+    parser->__element_binary = 0;
 }
 
 guac_parser* guac_parser_alloc() {
@@ -47,6 +119,22 @@ guac_parser* guac_parser_alloc() {
         return NULL;
     }
 
+    /* Allocate buffer sufficient for the default maximum instruction length */
+    parser->__max_length = GUAC_INSTRUCTION_MAX_LENGTH;
+    parser->__instructionbuf_size = GUAC_INSTRUCTION_MAX_LENGTH
+        * GUAC_INSTRUCTION_BUFFER_RATIO;
+
+    parser->__instructionbuf = guac_mem_alloc(parser->__instructionbuf_size);
+    if (parser->__instructionbuf == NULL) {
+        guac_mem_free(parser);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory to allocate parser buffer";
+        return NULL;
+    }
+
+    /* Binary elements are not accepted unless negotiated */
+    parser->__binary = 0;
+
     /* Init parse start/end markers */
     parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
     parser->__instructionbuf_unparsed_end = parser->__instructionbuf;
@@ -82,8 +170,10 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
             if (c >= '0' && c <= '9')
                 parsed_length = parsed_length*10 + c - '0';
 
-            /* If period, switch to parsing content */
-            else if (c == '.') {
+            /* If period (or hash, for binary elements), switch to parsing
+             * content */
+            else if (c == '.' || (c == '#' && parser->__binary)) {
+                parser->__element_binary = (c == '#');
                 parser->__elementv[parser->__elementc++] = char_buffer;
                 parser->state = GUAC_PARSE_CONTENT;
                 break;
@@ -98,7 +188,7 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
         }
 
         /* If too long, parse error */
-        if (parsed_length > GUAC_INSTRUCTION_MAX_LENGTH) {
+        if (parsed_length > parser->__max_length) {
             parser->state = GUAC_PARSE_ERROR;
             return 0;
         }
@@ -106,6 +196,11 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
         /* Save length */
         parser->__element_length = parsed_length;
 
+        /* Record the size of binary elements, which may contain nulls */
+        if (parser->state == GUAC_PARSE_CONTENT)
+            parser->__binary_lengths[parser->__elementc - 1] =
+                parser->__element_binary ? parsed_length : -1;
+
     } /* end parse length */
 
     /* Parse element content */
@@ -113,6 +208,23 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         while (bytes_parsed < length && parser->__element_length >= 0) {
 
+            /* Skip any run of ASCII characters that lies entirely within the
+             * element in bulk (element content is very often ASCII, such as
+             * the base64 data of blobs). Binary content is skipped in its
+             * entirety, as it is counted in bytes. */
+            int run = length - bytes_parsed;
+            if (run > parser->__element_length)
+                run = parser->__element_length;
+
+            if (!parser->__element_binary)
+                run = guac_parser_ascii_length(char_buffer, run);
+            if (run > 0) {
+                bytes_parsed += run;
+                char_buffer += run;
+                parser->__element_length -= run;
+                continue;
+            }
+
             /* Get length of current character */
             char c = *char_buffer;
             int char_length = guac_utf8_charsize((unsigned char) c);
@@ -164,12 +276,64 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
 }
 
+void guac_parser_enable_binary(guac_parser* parser) {
+    parser->__binary = 1;
+}
+
+int guac_parser_binary_length(guac_parser* parser, int index) {
+
+    /* Arguments begin with the element following the opcode */
+    if (index < 0 || index >= parser->argc)
+        return -1;
+
+    return parser->__binary_lengths[index + 1];
+
+}
+
+int guac_parser_set_max_length(guac_parser* parser, int length) {
+
+    /* The limit is never lowered */
+    if (length <= parser->__max_length)
+        return 0;
+
+    size_t buffer_size = guac_mem_ckd_mul_or_die(length,
+            GUAC_INSTRUCTION_BUFFER_RATIO);
+
+    char* old_buffer = parser->__instructionbuf;
+    char* new_buffer = guac_mem_realloc(old_buffer, buffer_size);
+    if (new_buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory to grow parser buffer";
+        return 1;
+    }
+
+    /* Update tracking pointers to refer to the new buffer */
+    parser->__instructionbuf_unparsed_start =
+        new_buffer + (parser->__instructionbuf_unparsed_start - old_buffer);
+    parser->__instructionbuf_unparsed_end =
+        new_buffer + (parser->__instructionbuf_unparsed_end - old_buffer);
+
+    /* Update parsed elements, if any */
+    for (int i = 0; i < parser->__elementc; i++)
+        parser->__elementv[i] = new_buffer + (parser->__elementv[i] - old_buffer);
+
+    if (parser->opcode != NULL)
+        parser->opcode = parser->__elementv[0];
+
+    parser->__instructionbuf = new_buffer;
+    parser->__instructionbuf_size = buffer_size;
+    parser->__max_length = length;
+
+    return 0;
+
+}
+
 int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout) {
 
     char* unparsed_end   = parser->__instructionbuf_unparsed_end;
     char* unparsed_start = parser->__instructionbuf_unparsed_start;
     char* instr_start    = parser->__instructionbuf_unparsed_start;
-    char* buffer_end     = parser->__instructionbuf + sizeof(parser->__instructionbuf);
+    char* buffer_end     = parser->__instructionbuf + parser->__instructionbuf_size;
 
     /* Begin next instruction if previous was ended */
     if (parser->state == GUAC_PARSE_COMPLETE)
@@ -263,6 +427,47 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
 
     parser->__instructionbuf_unparsed_start = unparsed_start;
     parser->__instructionbuf_unparsed_end = unparsed_end;
+
+    GUAC_PROBE3(parser_read, socket, parser->opcode, parser->argc);
+    return 0;
+
+}
+
+int guac_parser_read_buffer(guac_parser* parser, char** current, char* end) {
+
+    /* Begin next instruction if previous was ended */
+    if (parser->state == GUAC_PARSE_COMPLETE)
+        guac_parser_reset(parser);
+
+    while (parser->state != GUAC_PARSE_COMPLETE
+        && parser->state != GUAC_PARSE_ERROR) {
+
+        /* Never pass more data than can be represented as an int */
+        size_t remaining = end - *current;
+        if (remaining > INT_MAX)
+            remaining = INT_MAX;
+
+        int parsed = guac_parser_append(parser, *current, remaining);
+
+        /* No further data can be parsed once the end has been reached */
+        if (parsed == 0 && parser->state != GUAC_PARSE_ERROR) {
+            guac_error = GUAC_STATUS_CLOSED;
+            guac_error_message = "End of data reached while reading "
+                                 "instruction";
+            return -1;
+        }
+
+        *current += parsed;
+
+    }
+
+    /* Fail on error */
+    if (parser->state == GUAC_PARSE_ERROR) {
+        guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+        guac_error_message = "Instruction parse error";
+        return -1;
+    }
+
     return 0;
 
 }
@@ -314,6 +519,7 @@ int guac_parser_shift(guac_parser* parser, void* buffer, int length) {
 }
 
 void guac_parser_free(guac_parser* parser) {
+    guac_mem_free(parser->__instructionbuf);
     guac_mem_free(parser);
 }
 
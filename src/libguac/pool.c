@@ -24,12 +24,13 @@
 #include "guacamole/pool.h"
 
 #include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 guac_pool* guac_pool_alloc(int size) {
 
-    pthread_mutexattr_t lock_attributes;
-    guac_pool* pool = guac_mem_alloc(sizeof(guac_pool));
+    guac_pool* pool = guac_mem_zalloc(sizeof(guac_pool));
 
     /* If unable to allocate, just return NULL. */
     if (pool == NULL)
@@ -37,15 +38,9 @@ guac_pool* guac_pool_alloc(int size) {
 
     /* Initialize empty pool */
     pool->min_size = size;
-    pool->active = 0;
-    pool->__next_value = 0;
-    pool->__head = NULL;
-    pool->__tail = NULL;
-
-    /* Init lock */
-    pthread_mutexattr_init(&lock_attributes);
-    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&(pool->__lock), &lock_attributes);
+    atomic_init(&pool->active, 0);
+    atomic_init(&pool->__next_value, 0);
+    atomic_init(&pool->__chunks, NULL);
 
     return pool;
 
@@ -53,18 +48,18 @@ guac_pool* guac_pool_alloc(int size) {
 
 void guac_pool_free(guac_pool* pool) {
 
-    /* Free all ints in pool */
-    guac_pool_int* current = pool->__head;
-    while (current != NULL) {
+    /* Free all allocated portions of the bitmap */
+    _Atomic(guac_pool_chunk*)* chunks = atomic_load(&pool->__chunks);
+    if (chunks != NULL) {
 
-        guac_pool_int* old = current;
-        current = current->__next;
+        for (int i = 0; i < GUAC_POOL_MAX_CHUNKS; i++) {
+            guac_pool_chunk* chunk = atomic_load(&chunks[i]);
+            guac_mem_free(chunk);
+        }
 
-        guac_mem_free(old);
-    }
+        guac_mem_free(chunks);
 
-    /* Destroy lock */
-    pthread_mutex_destroy(&(pool->__lock));
+    }
 
     /* Free pool */
     guac_mem_free(pool);
@@ -72,62 +67,171 @@ void guac_pool_free(guac_pool* pool) {
 }
 
 /**
- * Returns the next available integer from the given guac_pool. All integers
- * returned are non-negative, and are returned in sequence, starting from 0.
+ * Returns the table of chunks of the bitmap of freed integers, allocating
+ * that table if it does not yet exist. If multiple threads attempt to
+ * allocate the table concurrently, only the first allocation is kept.
  *
- * Unlike the public guac_pool_next_int() function, this function is NOT atomic
- * and depends on the caller having already acquired the pool's lock.
+ * @param pool
+ *     The guac_pool containing the bitmap.
+ *
+ * @return
+ *     The table of chunks of the bitmap, or NULL if the table does not yet
+ *     exist and could not be allocated.
+ */
+static _Atomic(guac_pool_chunk*)* guac_pool_get_chunks(guac_pool* pool) {
+
+    _Atomic(guac_pool_chunk*)* chunks = atomic_load(&pool->__chunks);
+    if (chunks != NULL)
+        return chunks;
+
+    _Atomic(guac_pool_chunk*)* new_chunks = guac_mem_alloc(
+            sizeof(_Atomic(guac_pool_chunk*)), GUAC_POOL_MAX_CHUNKS);
+    if (new_chunks == NULL)
+        return NULL;
+
+    for (int i = 0; i < GUAC_POOL_MAX_CHUNKS; i++)
+        atomic_init(&new_chunks[i], NULL);
+
+    /* Attempt to install the new table, deferring to any table installed by
+     * another thread in the meantime */
+    if (atomic_compare_exchange_strong(&pool->__chunks, &chunks, new_chunks))
+        return new_chunks;
+
+    guac_mem_free(new_chunks);
+    return chunks;
+
+}
+
+/**
+ * Returns the chunk of the bitmap of freed integers that contains the given
+ * integer, allocating that chunk if it does not yet exist. If multiple
+ * threads attempt to allocate the same chunk concurrently, only the first
+ * allocation is kept.
  *
  * @param pool
- *     The guac_pool to retrieve an integer from.
+ *     The guac_pool containing the bitmap.
+ *
+ * @param value
+ *     The integer whose chunk should be returned. This integer must be
+ *     within the range of the bitmap.
  *
  * @return
- *     The next available integer, which may be either an integer not yet
- *     returned by a call to guac_pool_next_int, or an integer which was
- *     previously returned but has since been freed.
+ *     The chunk of the bitmap containing the given integer, or NULL if that
+ *     chunk does not yet exist and could not be allocated.
  */
-static int __guac_pool_next_int(guac_pool* pool) {
+static guac_pool_chunk* guac_pool_get_chunk(guac_pool* pool, int value) {
 
-    int value;
+    _Atomic(guac_pool_chunk*)* chunks = guac_pool_get_chunks(pool);
+    if (chunks == NULL)
+        return NULL;
 
-    /* It's unlikely that any usage of guac_pool will ever manage to reach
-     * INT_MAX concurrent requests for integers, but we definitely should bail
-     * out if ever this does happen. Tracing this sort of issue down would be
-     * extremely difficult without fail-fast behavior. */
-    GUAC_ASSERT(pool->__next_value < INT_MAX);
-    GUAC_ASSERT(pool->active < INT_MAX);
+    _Atomic(guac_pool_chunk*)* slot = &chunks[value / GUAC_POOL_CHUNK_SIZE];
 
-    pool->active++;
+    guac_pool_chunk* chunk = atomic_load(slot);
+    if (chunk != NULL)
+        return chunk;
 
-    /* If more integers are needed, return a new one. */
-    if (pool->__head == NULL || pool->__next_value < pool->min_size)
-        value = pool->__next_value++;
+    guac_pool_chunk* new_chunk = guac_mem_zalloc(sizeof(guac_pool_chunk));
+    if (new_chunk == NULL)
+        return NULL;
 
-    /* Otherwise, reuse a previously freed integer */
-    else {
+    /* Attempt to install a new, empty chunk, deferring to any chunk
+     * installed by another thread in the meantime */
+    if (atomic_compare_exchange_strong(slot, &chunk, new_chunk))
+        return new_chunk;
 
-        value = pool->__head->value;
+    guac_mem_free(new_chunk);
+    return chunk;
 
-        /* If only one element exists, reset pool to empty. */
-        if (pool->__tail == pool->__head) {
-            guac_mem_free(pool->__head);
-            pool->__head = NULL;
-            pool->__tail = NULL;
-        }
+}
+
+/**
+ * Claims the lowest freed integer that is below the given limit, clearing
+ * its bit within the bitmap of freed integers.
+ *
+ * @param pool
+ *     The guac_pool to claim an integer from.
+ *
+ * @param limit
+ *     The exclusive upper bound of the integer claimed.
+ *
+ * @return
+ *     The claimed integer, or -1 if no freed integer below the given limit
+ *     could be claimed.
+ */
+static int guac_pool_claim_freed(guac_pool* pool, int limit) {
+
+    /* No freed integer can be at or beyond the next new integer */
+    int next_value = atomic_load(&pool->__next_value);
+    if (limit > next_value)
+        limit = next_value;
+
+    /* Nothing has been freed if the bitmap does not yet exist */
+    _Atomic(guac_pool_chunk*)* chunks = atomic_load(&pool->__chunks);
+    if (chunks == NULL)
+        return -1;
+
+    int chunk_count = (limit + GUAC_POOL_CHUNK_SIZE - 1) / GUAC_POOL_CHUNK_SIZE;
+    if (chunk_count > GUAC_POOL_MAX_CHUNKS)
+        chunk_count = GUAC_POOL_MAX_CHUNKS;
+
+    for (int i = 0; i < chunk_count; i++) {
+
+        guac_pool_chunk* chunk = atomic_load(&chunks[i]);
+        if (chunk == NULL)
+            continue;
+
+        for (int j = 0; j < GUAC_POOL_CHUNK_WORDS; j++) {
+
+            int base = i * GUAC_POOL_CHUNK_SIZE + j * 64;
+            if (base >= limit)
+                return -1;
+
+            /* Repeatedly attempt to clear the lowest set bit of the current
+             * word until successful or until no bits remain */
+            uint64_t word = atomic_load(&chunk->words[j]);
+            while (word != 0) {
+
+                int value = base + __builtin_ctzll(word);
+                if (value >= limit)
+                    return -1;
+
+                if (atomic_compare_exchange_weak(&chunk->words[j], &word,
+                            word & (word - 1))) {
+                    return value;
+                }
+
+            }
 
-        /* Otherwise, advance head. */
-        else {
-            guac_pool_int* old_head = pool->__head;
-            pool->__head = old_head->__next;
-            guac_mem_free(old_head);
         }
 
     }
 
-    /* Again, this should never happen and would be a sign of some fairly
-     * fundamental assumption failing. It's important for such things to fail
-     * fast. */
-    GUAC_ASSERT(value >= 0);
+    return -1;
+
+}
+
+/**
+ * Claims a new integer that has never been returned by the given guac_pool,
+ * if such an integer would be below the given limit.
+ *
+ * @param pool
+ *     The guac_pool to claim an integer from.
+ *
+ * @param limit
+ *     The exclusive upper bound of the integer claimed.
+ *
+ * @return
+ *     The claimed integer, or -1 if all integers below the given limit have
+ *     already been returned at least once.
+ */
+static int guac_pool_claim_new(guac_pool* pool, int limit) {
+
+    int value = atomic_load(&pool->__next_value);
+    do {
+        if (value >= limit)
+            return -1;
+    } while (!atomic_compare_exchange_weak(&pool->__next_value, &value, value + 1));
 
     return value;
 
@@ -135,9 +239,13 @@ static int __guac_pool_next_int(guac_pool* pool) {
 
 int guac_pool_next_int(guac_pool* pool) {
 
-    pthread_mutex_lock(&(pool->__lock));
-    int value = __guac_pool_next_int(pool);
-    pthread_mutex_unlock(&(pool->__lock));
+    int value = guac_pool_next_int_below(pool, INT_MAX);
+
+    /* It's unlikely that any usage of guac_pool will ever manage to reach
+     * INT_MAX concurrent requests for integers, but we definitely should bail
+     * out if ever this does happen. Tracing this sort of issue down would be
+     * extremely difficult without fail-fast behavior. */
+    GUAC_ASSERT(value >= 0);
 
     return value;
 
@@ -145,26 +253,40 @@ int guac_pool_next_int(guac_pool* pool) {
 
 int guac_pool_next_int_below(guac_pool* pool, int limit) {
 
-    pthread_mutex_lock(&(pool->__lock));
-
-    int value;
-
-    /* Explicitly bail out now if there we would need to return a new integer,
-     * but can't without reaching the given limit */
-    if (pool->active >= limit || (pool->__next_value >= limit && pool->__head == NULL)) {
-        value = -1;
-    }
-
-    /* In all other cases, attempt to obtain the requested integer (either
-     * reusing a freed integer or allocating a new one), but verify that some
-     * fundamental misuse of guac_pool hasn't resulted in values defying
-     * expectations */
-    else {
-        value = __guac_pool_next_int(pool);
-        GUAC_ASSERT(value < limit);
+    /* Explicitly bail out now if there are already as many integers in use as
+     * there are integers below the given limit */
+    int active = atomic_load(&pool->active);
+    do {
+        if (active >= limit)
+            return -1;
+    } while (!atomic_compare_exchange_weak(&pool->active, &active, active + 1));
+
+    int value = -1;
+
+    /* Reuse the lowest previously freed integer only once the minimum number
+     * of integers has been returned, falling back to a new integer */
+    int reuse = (atomic_load(&pool->__next_value) >= pool->min_size);
+    if (reuse)
+        value = guac_pool_claim_freed(pool, limit);
+
+    if (value < 0)
+        value = guac_pool_claim_new(pool, limit);
+
+    /* If no new integers remain below the limit, the minimum size has
+     * necessarily been reached, and a freed integer may be available after
+     * all */
+    if (value < 0 && !reuse)
+        value = guac_pool_claim_freed(pool, limit);
+
+    /* Release the reservation made above if no integer could be claimed */
+    if (value < 0) {
+        atomic_fetch_sub(&pool->active, 1);
+        return -1;
     }
 
-    pthread_mutex_unlock(&(pool->__lock));
+    /* Verify that some fundamental misuse of guac_pool hasn't resulted in
+     * values defying expectations */
+    GUAC_ASSERT(value < limit);
 
     return value;
 
@@ -184,29 +306,26 @@ int guac_pool_next_int_below_or_die(guac_pool* pool, int limit) {
 
 void guac_pool_free_int(guac_pool* pool, int value) {
 
-    /* Allocate and initialize new returned value */
-    guac_pool_int* pool_int = guac_mem_alloc(sizeof(guac_pool_int));
-    pool_int->value = value;
-    pool_int->__next = NULL;
+    GUAC_ASSERT(value >= 0);
+
+    /* Integers beyond the range of the bitmap are never reused, nor are
+     * integers whose portion of the bitmap could not be allocated */
+    guac_pool_chunk* chunk = NULL;
+    if (value < GUAC_POOL_CHUNK_SIZE * GUAC_POOL_MAX_CHUNKS)
+        chunk = guac_pool_get_chunk(pool, value);
 
-    /* Acquire exclusive access */
-    pthread_mutex_lock(&(pool->__lock));
+    if (chunk != NULL) {
 
-    GUAC_ASSERT(pool->active > 0);
-    pool->active--;
+        int offset = value % GUAC_POOL_CHUNK_SIZE;
+        uint64_t bit = UINT64_C(1) << (offset % 64);
 
-    /* If pool empty, store as sole entry. */
-    if (pool->__tail == NULL)
-        pool->__head = pool->__tail = pool_int;
+        /* Each integer may be freed only once for each time it is returned */
+        uint64_t previous = atomic_fetch_or(&chunk->words[offset / 64], bit);
+        GUAC_ASSERT(!(previous & bit));
 
-    /* Otherwise, append to end of pool. */
-    else {
-        pool->__tail->__next = pool_int;
-        pool->__tail = pool_int;
     }
 
-    /* Value has been freed */
-    pthread_mutex_unlock(&(pool->__lock));
+    int active = atomic_fetch_sub(&pool->active, 1);
+    GUAC_ASSERT(active > 0);
 
 }
-
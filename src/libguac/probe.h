@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef GUAC_PROBE_H
+#define GUAC_PROBE_H
+
+/**
+ * Static tracepoints (USDT probes) marking significant events within libguac,
+ * such as the beginning and end of each frame, for use with tracing tools like
+ * bpftrace and perf. Each probe belongs to the "libguac" provider. Where
+ * supported (see the --with-sdt option of configure), each probe compiles to a
+ * single no-op instruction, with its arguments evaluated only as needed to
+ * make them available to any attached tracer. Otherwise, probes compile to
+ * nothing at all, and their arguments are not evaluated.
+ *
+ * As probe arguments are evaluated regardless of whether a tracer is attached,
+ * arguments should be values that are already at hand, not values that must
+ * be computed.
+ *
+ * @file probe.h
+ */
+
+#include "config.h"
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+/**
+ * Fires the libguac probe having the given name, without any arguments.
+ */
+#define GUAC_PROBE(name) \
+    DTRACE_PROBE(libguac, name)
+
+/**
+ * Fires the libguac probe having the given name with one argument.
+ */
+#define GUAC_PROBE1(name, a) \
+    DTRACE_PROBE1(libguac, name, a)
+
+/**
+ * Fires the libguac probe having the given name with two arguments.
+ */
+#define GUAC_PROBE2(name, a, b) \
+    DTRACE_PROBE2(libguac, name, a, b)
+
+/**
+ * Fires the libguac probe having the given name with three arguments.
+ */
+#define GUAC_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(libguac, name, a, b, c)
+
+/**
+ * Fires the libguac probe having the given name with four arguments.
+ */
+#define GUAC_PROBE4(name, a, b, c, d) \
+    DTRACE_PROBE4(libguac, name, a, b, c, d)
+
+/**
+ * Fires the libguac probe having the given name with five arguments.
+ */
+#define GUAC_PROBE5(name, a, b, c, d, e) \
+    DTRACE_PROBE5(libguac, name, a, b, c, d, e)
+
+#else
+
+#define GUAC_PROBE(name) do {} while (0)
+#define GUAC_PROBE1(name, a) do {} while (0)
+#define GUAC_PROBE2(name, a, b) do {} while (0)
+#define GUAC_PROBE3(name, a, b, c) do {} while (0)
+#define GUAC_PROBE4(name, a, b, c, d) do {} while (0)
+#define GUAC_PROBE5(name, a, b, c, d, e) do {} while (0)
+
+#endif
+
+#endif
+
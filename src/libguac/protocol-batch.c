@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/layer.h"
+#include "guacamole/protocol-types.h"
+#include "guacamole/socket.h"
+#include "protocol-batch.h"
+#include "protocol-format.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Appends the given opcode to the buffer of the given batch as the first
+ * element of a new instruction, including its length prefix. The caller must
+ * already have ensured that at least GUAC_PROTOCOL_BATCH_MAX_INSTRUCTION bytes
+ * are available.
+ *
+ * @param batch
+ *     The batch to append the opcode to.
+ *
+ * @param opcode
+ *     The opcode to append, including its length prefix (for example,
+ *     "4.copy").
+ */
+static void guac_protocol_batch_append_opcode(guac_protocol_batch* batch,
+        const char* opcode) {
+
+    size_t length = strlen(opcode);
+    memcpy(batch->buffer + batch->length, opcode, length);
+    batch->length += length;
+
+}
+
+/**
+ * Appends the given integer to the buffer of the given batch as a further
+ * element of the instruction currently being formatted, including its
+ * leading comma and length prefix. The caller must already have ensured that
+ * there is sufficient room.
+ *
+ * @param batch
+ *     The batch to append the integer to.
+ *
+ * @param value
+ *     The integer to append.
+ */
+static void guac_protocol_batch_append_int(guac_protocol_batch* batch,
+        int value) {
+
+    batch->buffer[batch->length++] = ',';
+    batch->length += guac_protocol_format_length_int(
+            batch->buffer + batch->length, value);
+
+}
+
+/**
+ * Terminates the instruction currently being formatted within the given
+ * batch.
+ *
+ * @param batch
+ *     The batch containing the instruction to terminate.
+ */
+static void guac_protocol_batch_end_instruction(guac_protocol_batch* batch) {
+    batch->buffer[batch->length++] = ';';
+}
+
+/**
+ * Ensures that the buffer of the given batch has room for at least one more
+ * instruction, writing the current contents of the batch to its socket if
+ * necessary.
+ *
+ * @param batch
+ *     The batch that must have room for another instruction.
+ *
+ * @return
+ *     Zero on success, non-zero if the contents of the batch had to be
+ *     written and that write failed.
+ */
+static int guac_protocol_batch_reserve(guac_protocol_batch* batch) {
+
+    if (sizeof(batch->buffer) - batch->length < GUAC_PROTOCOL_BATCH_MAX_INSTRUCTION)
+        return guac_protocol_batch_flush(batch);
+
+    return 0;
+
+}
+
+void guac_protocol_batch_init(guac_protocol_batch* batch, guac_socket* socket) {
+    batch->socket = socket;
+    batch->length = 0;
+}
+
+int guac_protocol_batch_flush(guac_protocol_batch* batch) {
+
+    if (batch->length == 0)
+        return 0;
+
+    guac_socket_instruction_begin(batch->socket);
+    int ret_val = guac_socket_write(batch->socket, batch->buffer,
+            batch->length);
+    guac_socket_instruction_end(batch->socket);
+
+    batch->length = 0;
+    return ret_val;
+
+}
+
+int guac_protocol_batch_cfill(guac_protocol_batch* batch,
+        guac_composite_mode mode, const guac_layer* layer,
+        int r, int g, int b, int a) {
+
+    if (guac_protocol_batch_reserve(batch))
+        return 1;
+
+    guac_protocol_batch_append_opcode(batch, "5.cfill");
+    guac_protocol_batch_append_int(batch, mode);
+    guac_protocol_batch_append_int(batch, layer->index);
+    guac_protocol_batch_append_int(batch, r);
+    guac_protocol_batch_append_int(batch, g);
+    guac_protocol_batch_append_int(batch, b);
+    guac_protocol_batch_append_int(batch, a);
+    guac_protocol_batch_end_instruction(batch);
+
+    return 0;
+
+}
+
+int guac_protocol_batch_copy(guac_protocol_batch* batch,
+        const guac_layer* srcl, int srcx, int srcy, int w, int h,
+        guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
+
+    if (guac_protocol_batch_reserve(batch))
+        return 1;
+
+    guac_protocol_batch_append_opcode(batch, "4.copy");
+    guac_protocol_batch_append_int(batch, srcl->index);
+    guac_protocol_batch_append_int(batch, srcx);
+    guac_protocol_batch_append_int(batch, srcy);
+    guac_protocol_batch_append_int(batch, w);
+    guac_protocol_batch_append_int(batch, h);
+    guac_protocol_batch_append_int(batch, mode);
+    guac_protocol_batch_append_int(batch, dstl->index);
+    guac_protocol_batch_append_int(batch, dstx);
+    guac_protocol_batch_append_int(batch, dsty);
+    guac_protocol_batch_end_instruction(batch);
+
+    return 0;
+
+}
+
+int guac_protocol_batch_rect(guac_protocol_batch* batch,
+        const guac_layer* layer, int x, int y, int width, int height) {
+
+    if (guac_protocol_batch_reserve(batch))
+        return 1;
+
+    guac_protocol_batch_append_opcode(batch, "4.rect");
+    guac_protocol_batch_append_int(batch, layer->index);
+    guac_protocol_batch_append_int(batch, x);
+    guac_protocol_batch_append_int(batch, y);
+    guac_protocol_batch_append_int(batch, width);
+    guac_protocol_batch_append_int(batch, height);
+    guac_protocol_batch_end_instruction(batch);
+
+    return 0;
+
+}
+
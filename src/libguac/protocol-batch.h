@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_PROTOCOL_BATCH_H
+#define GUAC_PROTOCOL_BATCH_H
+
+#include "config.h"
+
+#include "guacamole/layer.h"
+#include "guacamole/protocol-types.h"
+#include "guacamole/socket.h"
+
+#include <stddef.h>
+
+/**
+ * The number of bytes of formatted instructions that a guac_protocol_batch
+ * may hold before those instructions are written to the underlying socket.
+ */
+#define GUAC_PROTOCOL_BATCH_SIZE 8192
+
+/**
+ * The maximum number of bytes that any single instruction formatted by a
+ * guac_protocol_batch may occupy. Each instruction consists of an opcode and
+ * at most nine integer elements, each of which occupies at most
+ * GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH bytes plus its leading comma. Integer
+ * elements are formatted in place, and the precomputed elements of small
+ * integers are copied in fixed-size blocks which may extend slightly beyond
+ * the end of the element, so this value includes ample slack.
+ */
+#define GUAC_PROTOCOL_BATCH_MAX_INSTRUCTION 256
+
+/**
+ * Buffer of formatted Guacamole protocol instructions that are written to a
+ * guac_socket together, within a single instruction lock and a single write.
+ * This avoids the per-element writes and per-instruction locking of the
+ * guac_protocol_send_*() functions when sending many small instructions, as
+ * is the case for the copy, rect, and cfill instructions of a frame. The
+ * instructions produced are byte-for-byte identical to those produced by the
+ * corresponding guac_protocol_send_*() functions.
+ *
+ * A guac_protocol_batch may only be used by one thread at a time.
+ */
+typedef struct guac_protocol_batch {
+
+    /**
+     * The socket that all instructions within this batch will be written to.
+     */
+    guac_socket* socket;
+
+    /**
+     * The number of bytes of formatted instructions currently stored within
+     * the buffer.
+     */
+    size_t length;
+
+    /**
+     * Formatted instructions that have not yet been written to the socket.
+     */
+    char buffer[GUAC_PROTOCOL_BATCH_SIZE];
+
+} guac_protocol_batch;
+
+/**
+ * Initializes the given guac_protocol_batch such that instructions are
+ * written to the given socket.
+ *
+ * @param batch
+ *     The batch to initialize.
+ *
+ * @param socket
+ *     The socket that all instructions within the batch should be written
+ *     to.
+ */
+void guac_protocol_batch_init(guac_protocol_batch* batch, guac_socket* socket);
+
+/**
+ * Writes all instructions within the given batch to its socket, within a
+ * single instruction lock, and empties the batch. The socket itself is not
+ * flushed. If the batch is empty, this function has no effect.
+ *
+ * @param batch
+ *     The batch to write.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_batch_flush(guac_protocol_batch* batch);
+
+/**
+ * Adds a "cfill" instruction to the given batch, as would be sent by
+ * guac_protocol_send_cfill(). The batch is written to its socket first if
+ * there is insufficient room.
+ *
+ * @param batch
+ *     The batch to add the instruction to.
+ *
+ * @param mode
+ *     The composite mode to use.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param r
+ *     The red component of the color of the fill.
+ *
+ * @param g
+ *     The green component of the color of the fill.
+ *
+ * @param b
+ *     The blue component of the color of the fill.
+ *
+ * @param a
+ *     The alpha component of the color of the fill.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_batch_cfill(guac_protocol_batch* batch,
+        guac_composite_mode mode, const guac_layer* layer,
+        int r, int g, int b, int a);
+
+/**
+ * Adds a "copy" instruction to the given batch, as would be sent by
+ * guac_protocol_send_copy(). The batch is written to its socket first if
+ * there is insufficient room.
+ *
+ * @param batch
+ *     The batch to add the instruction to.
+ *
+ * @param srcl
+ *     The source layer.
+ *
+ * @param srcx
+ *     The X coordinate of the source rectangle.
+ *
+ * @param srcy
+ *     The Y coordinate of the source rectangle.
+ *
+ * @param w
+ *     The width of the source rectangle.
+ *
+ * @param h
+ *     The height of the source rectangle.
+ *
+ * @param mode
+ *     The composite mode to use.
+ *
+ * @param dstl
+ *     The destination layer.
+ *
+ * @param dstx
+ *     The X coordinate of the destination, where the source rectangle should
+ *     be copied.
+ *
+ * @param dsty
+ *     The Y coordinate of the destination, where the source rectangle should
+ *     be copied.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_batch_copy(guac_protocol_batch* batch,
+        const guac_layer* srcl, int srcx, int srcy, int w, int h,
+        guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty);
+
+/**
+ * Adds a "rect" instruction to the given batch, as would be sent by
+ * guac_protocol_send_rect(). The batch is written to its socket first if
+ * there is insufficient room.
+ *
+ * @param batch
+ *     The batch to add the instruction to.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the rectangle.
+ *
+ * @param width
+ *     The width of the rectangle.
+ *
+ * @param height
+ *     The height of the rectangle.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+int guac_protocol_batch_rect(guac_protocol_batch* batch,
+        const guac_layer* layer, int x, int y, int width, int height);
+
+#endif
+
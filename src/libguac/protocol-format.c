@@ -0,0 +1,183 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "protocol-format.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The number of integers whose formatted elements are precomputed.
+ */
+#define GUAC_PROTOCOL_FORMAT_CACHED_COUNT \
+    (GUAC_PROTOCOL_FORMAT_CACHED_MAX - GUAC_PROTOCOL_FORMAT_CACHED_MIN + 1)
+
+/**
+ * A precomputed Guacamole protocol element representing a single integer,
+ * including its length prefix.
+ */
+typedef struct guac_protocol_format_token {
+
+    /**
+     * The formatted element, which is not null-terminated. The longest
+     * cached element, such as "4.-256", occupies six bytes.
+     */
+    char value[7];
+
+    /**
+     * The number of bytes within value.
+     */
+    unsigned char length;
+
+} guac_protocol_format_token;
+
+/**
+ * Precomputed elements for all integers between
+ * GUAC_PROTOCOL_FORMAT_CACHED_MIN and GUAC_PROTOCOL_FORMAT_CACHED_MAX
+ * inclusive, indexed by value less GUAC_PROTOCOL_FORMAT_CACHED_MIN.
+ */
+static guac_protocol_format_token
+    guac_protocol_format_tokens[GUAC_PROTOCOL_FORMAT_CACHED_COUNT];
+
+/**
+ * Guard ensuring that guac_protocol_format_tokens is populated only once.
+ */
+static pthread_once_t guac_protocol_format_tokens_once = PTHREAD_ONCE_INIT;
+
+int guac_protocol_format_int(char* buffer, int64_t value) {
+
+    static const char pairs[] =
+        "00010203040506070809" "10111213141516171819"
+        "20212223242526272829" "30313233343536373839"
+        "40414243444546474849" "50515253545556575859"
+        "60616263646566676869" "70717273747576777879"
+        "80818283848586878889" "90919293949596979899";
+
+    /* Work with the magnitude as unsigned such that INT64_MIN is handled
+     * correctly */
+    uint64_t magnitude = value < 0 ? 0u - (uint64_t) value : (uint64_t) value;
+
+    /* Produce digits right-to-left, two at a time */
+    char digits[GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS];
+    char* end = digits + sizeof(digits);
+    char* current = end;
+
+    while (magnitude >= 100) {
+        const char* pair = pairs + (magnitude % 100) * 2;
+        magnitude /= 100;
+        *(--current) = pair[1];
+        *(--current) = pair[0];
+    }
+
+    if (magnitude >= 10) {
+        const char* pair = pairs + magnitude * 2;
+        *(--current) = pair[1];
+        *(--current) = pair[0];
+    }
+    else
+        *(--current) = '0' + magnitude;
+
+    if (value < 0)
+        *(--current) = '-';
+
+    int length = end - current;
+    memcpy(buffer, current, length);
+    return length;
+
+}
+
+/**
+ * Formats the given integer as a Guacamole protocol element without
+ * consulting the table of precomputed elements.
+ *
+ * @param buffer
+ *     The buffer that should receive the formatted element. This buffer must
+ *     have room for at least GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH bytes.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of bytes written to the given buffer.
+ */
+static int guac_protocol_format_length_int_uncached(char* buffer,
+        int64_t value) {
+
+    char digits[GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS];
+    int length = guac_protocol_format_int(digits, value);
+
+    /* The value consists only of ASCII characters, thus its length in
+     * characters is simply its length in bytes, which never exceeds two
+     * digits */
+    char* output = buffer;
+
+    if (length >= 10)
+        *(output++) = '0' + length / 10;
+
+    *(output++) = '0' + length % 10;
+    *(output++) = '.';
+
+    memcpy(output, digits, length);
+    return output - buffer + length;
+
+}
+
+/**
+ * Populates guac_protocol_format_tokens. This function is invoked through
+ * pthread_once().
+ */
+static void guac_protocol_format_tokens_init(void) {
+
+    char buffer[GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH];
+
+    for (int i = 0; i < GUAC_PROTOCOL_FORMAT_CACHED_COUNT; i++) {
+
+        guac_protocol_format_token* token = &guac_protocol_format_tokens[i];
+
+        int length = guac_protocol_format_length_int_uncached(buffer,
+                i + GUAC_PROTOCOL_FORMAT_CACHED_MIN);
+
+        memcpy(token->value, buffer, length);
+        token->length = length;
+
+    }
+
+}
+
+int guac_protocol_format_length_int(char* buffer, int64_t value) {
+
+    if (value < GUAC_PROTOCOL_FORMAT_CACHED_MIN
+            || value > GUAC_PROTOCOL_FORMAT_CACHED_MAX)
+        return guac_protocol_format_length_int_uncached(buffer, value);
+
+    pthread_once(&guac_protocol_format_tokens_once,
+            guac_protocol_format_tokens_init);
+
+    const guac_protocol_format_token* token =
+        &guac_protocol_format_tokens[value - GUAC_PROTOCOL_FORMAT_CACHED_MIN];
+
+    memcpy(buffer, token->value, sizeof(token->value));
+    return token->length;
+
+}
+
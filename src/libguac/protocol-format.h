@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_PROTOCOL_FORMAT_H
+#define GUAC_PROTOCOL_FORMAT_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+/**
+ * The maximum number of bytes written by guac_protocol_format_int(), which is
+ * the length of the longest 64-bit integer, including its sign.
+ */
+#define GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS 20
+
+/**
+ * The maximum number of bytes written by guac_protocol_format_length_int(),
+ * which is the length of the longest 64-bit integer (20 characters,
+ * including its sign) together with its two-digit length prefix and the
+ * period separating that prefix from the value.
+ */
+#define GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH 23
+
+/**
+ * The smallest integer whose formatted Guacamole protocol element is
+ * precomputed, rather than formatted each time it is written. Small negative
+ * values are commonly used as the indices of buffers.
+ */
+#define GUAC_PROTOCOL_FORMAT_CACHED_MIN -256
+
+/**
+ * The largest integer whose formatted Guacamole protocol element is
+ * precomputed, rather than formatted each time it is written. Layer indices,
+ * stream indices, composite modes, and color components all generally fall
+ * within this range.
+ */
+#define GUAC_PROTOCOL_FORMAT_CACHED_MAX 1023
+
+/**
+ * Formats the given integer in decimal. The result is not null-terminated.
+ *
+ * @param buffer
+ *     The buffer that should receive the formatted integer. This buffer must
+ *     have room for at least GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS bytes.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of bytes written to the given buffer.
+ */
+int guac_protocol_format_int(char* buffer, int64_t value);
+
+/**
+ * Formats the given integer as the value of a Guacamole protocol element,
+ * including its length prefix and the period separating that prefix from the
+ * value (for example, "3.-12"). The result is not null-terminated. Integers
+ * between GUAC_PROTOCOL_FORMAT_CACHED_MIN and GUAC_PROTOCOL_FORMAT_CACHED_MAX
+ * inclusive are copied from a precomputed table.
+ *
+ * @param buffer
+ *     The buffer that should receive the formatted element. This buffer must
+ *     have room for at least GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH bytes.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of bytes written to the given buffer.
+ */
+int guac_protocol_format_length_int(char* buffer, int64_t value);
+
+#endif
+
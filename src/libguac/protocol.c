@@ -28,10 +28,12 @@
 #include "guacamole/stream.h"
 #include "guacamole/unicode.h"
 #include "palette.h"
+#include "protocol-format.h"
 
 #include <cairo/cairo.h>
 
 #include <inttypes.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -73,18 +75,44 @@ guac_protocol_version_mapping guac_protocol_version_table[] = {
 
 ssize_t __guac_socket_write_length_string(guac_socket* socket, const char* str) {
 
+    /* Write the length prefix and separating period together */
+    char prefix[GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS + 1];
+    int length = guac_protocol_format_int(prefix, guac_utf8_strlen(str));
+    prefix[length++] = '.';
+
     return
-           guac_socket_write_int(socket, guac_utf8_strlen(str))
-        || guac_socket_write_string(socket, ".")
+           guac_socket_write(socket, prefix, length)
         || guac_socket_write_string(socket, str);
 
 }
 
 ssize_t __guac_socket_write_length_int(guac_socket* socket, int64_t i) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
-    return __guac_socket_write_length_string(socket, buffer);
+    char buffer[GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH];
+    int length = guac_protocol_format_length_int(buffer, i);
+    return guac_socket_write(socket, buffer, length);
+
+}
+
+/**
+ * Writes the given integer as a further element of the instruction currently
+ * being written, including the leading comma and the length prefix of that
+ * element, using a single write to the given socket.
+ *
+ * @param socket
+ *     The socket to which the element should be written.
+ *
+ * @param i
+ *     The integer to write.
+ *
+ * @return
+ *     Zero on success, non-zero on error.
+ */
+static ssize_t __guac_socket_write_element_int(guac_socket* socket, int64_t i) {
+
+    char buffer[GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH + 1] = { ',' };
+    int length = guac_protocol_format_length_int(buffer + 1, i);
+    return guac_socket_write(socket, buffer, length + 1);
 
 }
 
@@ -141,8 +169,7 @@ int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
         || __guac_socket_write_length_int(socket, stream->index)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
+        || __guac_socket_write_element_int(socket, status)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -208,12 +235,9 @@ int guac_protocol_send_arc(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "3.arc,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, radius)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, radius)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_double(socket, startAngle)
         || guac_socket_write_string(socket, ",")
@@ -233,6 +257,7 @@ int guac_protocol_send_audio(guac_socket* socket, const guac_stream* stream,
     int ret_val;
 
     guac_socket_instruction_begin(socket);
+    guac_socket_set_priority(socket, stream->priority);
     ret_val = 
            guac_socket_write_string(socket, "5.audio,")
         || __guac_socket_write_length_int(socket, stream->index)
@@ -253,6 +278,23 @@ int guac_protocol_send_blob(guac_socket* socket, const guac_stream* stream,
     int ret_val;
 
     guac_socket_instruction_begin(socket);
+    guac_socket_set_priority(socket, stream->priority);
+
+    /* Send data as-is if binary elements have been negotiated */
+    if (socket->__binary) {
+        ret_val =
+               guac_socket_write_string(socket, "4.blob,")
+            || __guac_socket_write_length_int(socket, stream->index)
+            || guac_socket_write_string(socket, ",")
+            || guac_socket_write_int(socket, count)
+            || guac_socket_write_string(socket, "#")
+            || guac_socket_write(socket, data, count)
+            || guac_socket_write_string(socket, ";");
+
+        guac_socket_instruction_end(socket);
+        return ret_val;
+    }
+
     ret_val =
            guac_socket_write_string(socket, "4.blob,")
         || __guac_socket_write_length_int(socket, stream->index)
@@ -304,8 +346,7 @@ int guac_protocol_send_body(guac_socket* socket, const guac_object* object,
     ret_val =
            guac_socket_write_string(socket, "4.body,")
         || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, stream->index)
+        || __guac_socket_write_element_int(socket, stream->index)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_string(socket, mimetype)
         || guac_socket_write_string(socket, ",")
@@ -327,16 +368,11 @@ int guac_protocol_send_cfill(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "5.cfill,")
         || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
+        || __guac_socket_write_element_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, r)
+        || __guac_socket_write_element_int(socket, g)
+        || __guac_socket_write_element_int(socket, b)
+        || __guac_socket_write_element_int(socket, a)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -426,22 +462,14 @@ int guac_protocol_send_copy(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "4.copy,")
         || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
+        || __guac_socket_write_element_int(socket, srcx)
+        || __guac_socket_write_element_int(socket, srcy)
+        || __guac_socket_write_element_int(socket, w)
+        || __guac_socket_write_element_int(socket, h)
+        || __guac_socket_write_element_int(socket, mode)
+        || __guac_socket_write_element_int(socket, dstl->index)
+        || __guac_socket_write_element_int(socket, dstx)
+        || __guac_socket_write_element_int(socket, dsty)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -460,22 +488,14 @@ int guac_protocol_send_cstroke(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "7.cstroke,")
         || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
+        || __guac_socket_write_element_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, cap)
+        || __guac_socket_write_element_int(socket, join)
+        || __guac_socket_write_element_int(socket, thickness)
+        || __guac_socket_write_element_int(socket, r)
+        || __guac_socket_write_element_int(socket, g)
+        || __guac_socket_write_element_int(socket, b)
+        || __guac_socket_write_element_int(socket, a)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -491,18 +511,12 @@ int guac_protocol_send_cursor(guac_socket* socket, int x, int y,
     ret_val =
            guac_socket_write_string(socket, "6.cursor,")
         || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, srcl->index)
+        || __guac_socket_write_element_int(socket, srcx)
+        || __guac_socket_write_element_int(socket, srcy)
+        || __guac_socket_write_element_int(socket, w)
+        || __guac_socket_write_element_int(socket, h)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -519,18 +533,12 @@ int guac_protocol_send_curve(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "5.curve,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
+        || __guac_socket_write_element_int(socket, cp1x)
+        || __guac_socket_write_element_int(socket, cp1y)
+        || __guac_socket_write_element_int(socket, cp2x)
+        || __guac_socket_write_element_int(socket, cp2y)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -597,6 +605,7 @@ int guac_protocol_send_end(guac_socket* socket, const guac_stream* stream) {
     int ret_val;
 
     guac_socket_instruction_begin(socket);
+    guac_socket_set_priority(socket, stream->priority);
     ret_val =
            guac_socket_write_string(socket, "3.end,")
         || __guac_socket_write_length_int(socket, stream->index)
@@ -616,8 +625,7 @@ int guac_protocol_send_error(guac_socket* socket, const char* error,
     ret_val =
            guac_socket_write_string(socket, "5.error,")
         || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
+        || __guac_socket_write_element_int(socket, status)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -682,6 +690,7 @@ int guac_protocol_send_file(guac_socket* socket, const guac_stream* stream,
     int ret_val;
 
     guac_socket_instruction_begin(socket);
+    guac_socket_set_priority(socket, stream->priority);
     ret_val =
            guac_socket_write_string(socket, "4.file,")
         || __guac_socket_write_length_int(socket, stream->index)
@@ -757,10 +766,8 @@ int guac_protocol_send_lfill(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "5.lfill,")
         || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
+        || __guac_socket_write_element_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, srcl->index)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -777,10 +784,8 @@ int guac_protocol_send_line(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "4.line,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -799,16 +804,11 @@ int guac_protocol_send_lstroke(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "7.lstroke,")
         || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
+        || __guac_socket_write_element_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, cap)
+        || __guac_socket_write_element_int(socket, join)
+        || __guac_socket_write_element_int(socket, thickness)
+        || __guac_socket_write_element_int(socket, srcl->index)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -825,12 +825,9 @@ int guac_protocol_send_mouse(guac_socket* socket, int x, int y,
     ret_val =
            guac_socket_write_string(socket, "5.mouse,")
         || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, button_mask)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, timestamp)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, button_mask)
+        || __guac_socket_write_element_int(socket, timestamp)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -848,20 +845,15 @@ int guac_protocol_send_touch(guac_socket* socket, int id, int x, int y,
     ret_val =
            guac_socket_write_string(socket, "5.touch,")
         || __guac_socket_write_length_int(socket, id)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x_radius)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y_radius)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, x_radius)
+        || __guac_socket_write_element_int(socket, y_radius)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_double(socket, angle)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_double(socket, force)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, timestamp)
+        || __guac_socket_write_element_int(socket, timestamp)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -878,14 +870,10 @@ int guac_protocol_send_move(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "4.move,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, parent->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, z)
+        || __guac_socket_write_element_int(socket, parent->index)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, z)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -968,16 +956,12 @@ int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
     ret_val =
            guac_socket_write_string(socket, "3.img,")
         || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, mode)
+        || __guac_socket_write_element_int(socket, layer->index)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1030,6 +1014,50 @@ int guac_protocol_send_ready(guac_socket* socket, const char* id) {
 
 }
 
+int guac_protocol_send_binary(guac_socket* socket) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val = guac_socket_write_string(socket, "6.binary;");
+    guac_socket_instruction_end(socket);
+
+    return ret_val;
+
+}
+
+int guac_protocol_send_blobsize(guac_socket* socket, int size) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "8.blobsize,")
+        || __guac_socket_write_length_int(socket, size)
+        || guac_socket_write_string(socket, ";");
+
+    guac_socket_instruction_end(socket);
+    return ret_val;
+
+}
+
+int guac_protocol_send_resume(guac_socket* socket, const char* token,
+        guac_timestamp timestamp) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "6.resume,")
+        || __guac_socket_write_length_string(socket, token)
+        || __guac_socket_write_element_int(socket, timestamp)
+        || guac_socket_write_string(socket, ";");
+
+    guac_socket_instruction_end(socket);
+    return ret_val;
+
+}
+
 int guac_protocol_send_rect(guac_socket* socket,
         const guac_layer* layer, int x, int y, int width, int height) {
 
@@ -1039,14 +1067,10 @@ int guac_protocol_send_rect(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "4.rect,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, width)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, height)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
+        || __guac_socket_write_element_int(socket, width)
+        || __guac_socket_write_element_int(socket, height)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1117,8 +1141,7 @@ int guac_protocol_send_set_int(guac_socket* socket, const guac_layer* layer,
         || __guac_socket_write_length_int(socket, layer->index)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, value)
+        || __guac_socket_write_element_int(socket, value)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1150,8 +1173,7 @@ int guac_protocol_send_shade(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "5.shade,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
+        || __guac_socket_write_element_int(socket, a)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1168,10 +1190,8 @@ int guac_protocol_send_size(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "4.size,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
+        || __guac_socket_write_element_int(socket, w)
+        || __guac_socket_write_element_int(socket, h)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1188,10 +1208,8 @@ int guac_protocol_send_start(guac_socket* socket, const guac_layer* layer,
     ret_val =
            guac_socket_write_string(socket, "5.start,")
         || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
+        || __guac_socket_write_element_int(socket, x)
+        || __guac_socket_write_element_int(socket, y)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1208,8 +1226,7 @@ int guac_protocol_send_sync(guac_socket* socket, guac_timestamp timestamp,
     ret_val = 
            guac_socket_write_string(socket, "4.sync,")
         || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, frames)
+        || __guac_socket_write_element_int(socket, frames)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1227,22 +1244,14 @@ int guac_protocol_send_transfer(guac_socket* socket,
     ret_val =
            guac_socket_write_string(socket, "8.transfer,")
         || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, fn)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
+        || __guac_socket_write_element_int(socket, srcx)
+        || __guac_socket_write_element_int(socket, srcy)
+        || __guac_socket_write_element_int(socket, w)
+        || __guac_socket_write_element_int(socket, h)
+        || __guac_socket_write_element_int(socket, fn)
+        || __guac_socket_write_element_int(socket, dstl->index)
+        || __guac_socket_write_element_int(socket, dstx)
+        || __guac_socket_write_element_int(socket, dsty)
         || guac_socket_write_string(socket, ";");
 
     guac_socket_instruction_end(socket);
@@ -1304,8 +1313,7 @@ int guac_protocol_send_video(guac_socket* socket, const guac_stream* stream,
     ret_val = 
            guac_socket_write_string(socket, "5.video,")
         || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
+        || __guac_socket_write_element_int(socket, layer->index)
         || guac_socket_write_string(socket, ",")
         || __guac_socket_write_length_string(socket, mimetype)
         || guac_socket_write_string(socket, ";");
@@ -1339,18 +1347,19 @@ static int __guac_base64_value(char c) {
 
 }
 
-int guac_protocol_decode_base64(char* base64) {
+int guac_protocol_decode_base64_buffer(const char* base64, void* buffer,
+        int length) {
 
-    char* input = base64;
-    char* output = base64;
+    const char* input = base64;
+    unsigned char* output = (unsigned char*) buffer;
 
-    int length = 0;
+    int decoded = 0;
     int bits_read = 0;
     int value = 0;
     char current;
 
-    /* For all characters in string */
-    while ((current = *(input++)) != 0) {
+    /* For all characters in string, until the buffer is full */
+    while (decoded < length && (current = *(input++)) != 0) {
 
         /* If we've reached padding, then we're done */
         if (current == '=')
@@ -1364,13 +1373,21 @@ int guac_protocol_decode_base64(char* base64) {
         if (bits_read >= 8) {
             *(output++) = (value >> (bits_read % 8)) & 0xFF;
             bits_read -= 8;
-            length++;
+            decoded++;
         }
 
     }
 
     /* Return number of bytes written */
-    return length;
+    return decoded;
+
+}
+
+int guac_protocol_decode_base64(char* base64) {
+
+    /* Decoding never writes beyond the character currently being read, and
+     * thus can safely be performed in-place */
+    return guac_protocol_decode_base64_buffer(base64, base64, INT_MAX);
 
 }
 
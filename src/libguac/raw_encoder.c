@@ -45,6 +45,57 @@ static void raw_encoder_send_audio(guac_audio_stream* audio,
 
 }
 
+/**
+ * Returns the number of bytes of PCM data, rounded down to a whole number of
+ * PCM frames, spanning the given duration of audio for the given audio
+ * stream.
+ *
+ * @param audio
+ *     The audio stream whose PCM format should be used.
+ *
+ * @param duration
+ *     The duration of audio, in milliseconds.
+ *
+ * @return
+ *     The number of bytes of PCM data spanning the given duration.
+ */
+static size_t raw_encoder_duration_length(guac_audio_stream* audio,
+        int duration) {
+
+    size_t frame_size = audio->channels * audio->bps / 8;
+    size_t length = guac_mem_ckd_mul_or_die(duration, audio->rate,
+            audio->channels, audio->bps) / 8 / 1000;
+
+    return length - length % frame_size;
+
+}
+
+/**
+ * Applies the frame duration currently set on (or hinted for) the given audio
+ * stream, clamped to the range supported by the raw encoder, such that
+ * buffered PCM data is sent once that duration of audio has been buffered.
+ * This must only be invoked while the buffer is empty.
+ *
+ * @param audio
+ *     The audio stream whose frame duration should be applied.
+ */
+static void raw_encoder_apply_frame_duration(guac_audio_stream* audio) {
+
+    raw_encoder_state* state = (raw_encoder_state*) audio->data;
+
+    int duration = audio->frame_duration;
+    if (duration <= 0)
+        duration = audio->hinted_frame_duration;
+
+    if (duration <= 0 || duration > GUAC_RAW_ENCODER_BUFFER_SIZE)
+        duration = GUAC_RAW_ENCODER_BUFFER_SIZE;
+    else if (duration < GUAC_RAW_ENCODER_MIN_BUFFER_SIZE)
+        duration = GUAC_RAW_ENCODER_MIN_BUFFER_SIZE;
+
+    state->length = raw_encoder_duration_length(audio, duration);
+
+}
+
 static void raw_encoder_begin_handler(guac_audio_stream* audio) {
 
     raw_encoder_state* state;
@@ -52,13 +103,14 @@ static void raw_encoder_begin_handler(guac_audio_stream* audio) {
     /* Broadcast existence of stream */
     raw_encoder_send_audio(audio, audio->client->socket);
 
-    /* Allocate and init encoder state */
+    /* Allocate and init encoder state, with room for the largest possible
+     * frame duration */
     audio->data = state = guac_mem_alloc(sizeof(raw_encoder_state));
     state->written = 0;
-    state->length = guac_mem_ckd_mul_or_die(GUAC_RAW_ENCODER_BUFFER_SIZE,
-            audio->rate, audio->channels, audio->bps) / 8 / 1000;
+    state->buffer = guac_mem_alloc(raw_encoder_duration_length(audio,
+                GUAC_RAW_ENCODER_BUFFER_SIZE));
 
-    state->buffer = guac_mem_alloc(state->length);
+    raw_encoder_apply_frame_duration(audio);
 
 }
 
@@ -127,6 +179,10 @@ static void raw_encoder_flush_handler(guac_audio_stream* audio) {
     /* All data has been flushed */
     state->written = 0;
 
+    /* Any change in frame duration can take effect now that the buffer is
+     * empty */
+    raw_encoder_apply_frame_duration(audio);
+
 }
 
 /* 8-bit raw encoder handlers */
@@ -30,12 +30,21 @@
 #define GUAC_RAW_ENCODER_BLOB_SIZE 6048
 
 /**
- * The size of the raw encoder output PCM buffer, in milliseconds. The
- * equivalent size in bytes will vary by PCM rate, number of channels, and bits
- * per sample.
+ * The size of the raw encoder output PCM buffer, in milliseconds, if no frame
+ * duration is set on the audio stream or hinted by the client. This is also
+ * the largest duration of audio that may be buffered. The equivalent size in
+ * bytes will vary by PCM rate, number of channels, and bits per sample.
  */
 #define GUAC_RAW_ENCODER_BUFFER_SIZE 250
 
+/**
+ * The smallest duration of audio, in milliseconds, that the raw encoder will
+ * buffer before sending that audio, regardless of the requested frame
+ * duration. Shorter durations would produce blobs dominated by the overhead
+ * of the instructions carrying them.
+ */
+#define GUAC_RAW_ENCODER_MIN_BUFFER_SIZE 5
+
 /**
  * The current state of the raw encoder. The raw encoder performs very minimal
  * processing, buffering provided PCM data only as necessary to ensure audio
@@ -49,7 +58,10 @@ typedef struct raw_encoder_state {
     unsigned char* buffer;
 
     /**
-     * Size of the PCM buffer, in bytes.
+     * The number of bytes of PCM data to buffer before that data is sent, as
+     * determined by the current frame duration. This never exceeds the size
+     * of the PCM buffer, which can always hold GUAC_RAW_ENCODER_BUFFER_SIZE
+     * milliseconds of audio.
      */
     size_t length;
 
@@ -0,0 +1,502 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket.h"
+#include "socket-recording.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * The number of bytes which must be read from the start of a recording to
+ * determine whether that recording is compressed.
+ */
+#define GUAC_RECORDING_MAGIC_SIZE 4
+
+/**
+ * The format of the data read by a recording reader, as determined by the
+ * first bytes read from the underlying socket.
+ */
+typedef enum guac_recording_reader_format {
+
+    /**
+     * Not enough data has yet been read to determine the format.
+     */
+    GUAC_RECORDING_READER_UNKNOWN,
+
+    /**
+     * The recording is not compressed, and is read as-is.
+     */
+    GUAC_RECORDING_READER_PLAIN,
+
+    /**
+     * The recording is compressed with zstd.
+     */
+    GUAC_RECORDING_READER_ZSTD
+
+} guac_recording_reader_format;
+
+/**
+ * Data specific to the recording reader implementation of guac_socket.
+ */
+typedef struct guac_recording_reader_data {
+
+    /**
+     * The guac_socket from which the raw contents of the recording are read.
+     */
+    guac_socket* socket;
+
+    /**
+     * The format of the recording being read.
+     */
+    guac_recording_reader_format format;
+
+    /**
+     * The raw bytes read while determining the format of the recording.
+     */
+    unsigned char magic[GUAC_RECORDING_MAGIC_SIZE];
+
+    /**
+     * The number of bytes stored within the magic buffer.
+     */
+    size_t magic_length;
+
+    /**
+     * The number of bytes within the magic buffer that have already been
+     * returned by the read handler of an uncompressed recording.
+     */
+    size_t magic_offset;
+
+#ifdef HAVE_LIBZSTD
+    /**
+     * The zstd decompression context used to decompress the recording, or
+     * NULL if the recording is not compressed.
+     */
+    ZSTD_DCtx* dctx;
+
+    /**
+     * Buffer containing compressed data read from the underlying socket.
+     */
+    char* input_buffer;
+
+    /**
+     * The compressed data within the input buffer which has not yet been
+     * decompressed.
+     */
+    ZSTD_inBuffer input;
+
+    /**
+     * Whether the most recent decompression filled the buffer provided by the
+     * caller, in which case further decompressed data may be available
+     * without reading from the underlying socket.
+     */
+    int output_pending;
+#endif
+
+} guac_recording_reader_data;
+
+/**
+ * Reads a little-endian integer having the given number of bytes from the
+ * given buffer.
+ *
+ * @param buffer
+ *     The buffer containing the integer.
+ *
+ * @param bytes
+ *     The number of bytes within the integer.
+ *
+ * @return
+ *     The value of the integer.
+ */
+static uint64_t guac_recording_load_le(const unsigned char* buffer,
+        int bytes) {
+
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | buffer[i];
+
+    return value;
+
+}
+
+int guac_recording_is_compressed(const void* data, size_t length) {
+
+    if (length < GUAC_RECORDING_MAGIC_SIZE)
+        return 0;
+
+    uint64_t magic = guac_recording_load_le(data, GUAC_RECORDING_MAGIC_SIZE);
+    return magic == GUAC_SOCKET_RECORDING_ZSTD_MAGIC
+        || (magic & ~0xFULL) == GUAC_SOCKET_RECORDING_SKIPPABLE_MAGIC;
+
+}
+
+/**
+ * Reads the first bytes of the recording from the underlying socket of the
+ * given recording reader, determining whether that recording is compressed.
+ *
+ * @param data
+ *     The data associated with the recording reader.
+ *
+ * @return
+ *     Zero if the format of the recording has been determined, non-zero if
+ *     an error occurs while reading the recording, in which case guac_error
+ *     is set appropriately.
+ */
+static int guac_recording_reader_detect(guac_recording_reader_data* data) {
+
+    /* Read until enough data is available or the recording ends */
+    while (data->magic_length < sizeof(data->magic)) {
+
+        ssize_t length = guac_socket_read(data->socket,
+                data->magic + data->magic_length,
+                sizeof(data->magic) - data->magic_length);
+
+        if (length < 0)
+            return 1;
+
+        if (length == 0)
+            break;
+
+        data->magic_length += length;
+
+    }
+
+    if (!guac_recording_is_compressed(data->magic, data->magic_length)) {
+        data->format = GUAC_RECORDING_READER_PLAIN;
+        return 0;
+    }
+
+#ifdef HAVE_LIBZSTD
+    data->dctx = ZSTD_createDCtx();
+    if (data->dctx == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate decompression context for "
+            "recording";
+        return 1;
+    }
+
+    /* Decompress the bytes already read before anything else */
+    size_t input_size = ZSTD_DStreamInSize();
+    data->input_buffer = guac_mem_alloc(input_size);
+    memcpy(data->input_buffer, data->magic, data->magic_length);
+    data->input.src = data->input_buffer;
+    data->input.size = data->magic_length;
+    data->input.pos = 0;
+
+    data->format = GUAC_RECORDING_READER_ZSTD;
+    return 0;
+#else
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "Recording is compressed, but zstd support is not "
+        "available";
+    return 1;
+#endif
+
+}
+
+#ifdef HAVE_LIBZSTD
+/**
+ * Decompresses data from the underlying socket of the given recording reader
+ * into the given buffer, reading further compressed data as necessary.
+ *
+ * @param data
+ *     The data associated with the recording reader.
+ *
+ * @param buf
+ *     The buffer in which decompressed data should be stored.
+ *
+ * @param count
+ *     The maximum number of bytes to store within the buffer.
+ *
+ * @return
+ *     The number of bytes stored within the buffer, zero if the end of the
+ *     recording has been reached, or -1 if an error occurs, in which case
+ *     guac_error is set appropriately.
+ */
+static ssize_t guac_recording_reader_decompress(
+        guac_recording_reader_data* data, void* buf, size_t count) {
+
+    ZSTD_outBuffer output = { .dst = buf, .size = count, .pos = 0 };
+
+    while (output.pos == 0) {
+
+        /* Read further compressed data only once everything read previously
+         * has been decompressed */
+        if (data->input.pos == data->input.size && !data->output_pending) {
+
+            ssize_t length = guac_socket_read(data->socket,
+                    data->input_buffer, ZSTD_DStreamInSize());
+
+            if (length <= 0)
+                return length;
+
+            data->input.size = length;
+            data->input.pos = 0;
+
+        }
+
+        size_t result = ZSTD_decompressStream(data->dctx, &output, &data->input);
+        if (ZSTD_isError(result)) {
+            guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+            guac_error_message = "Compressed recording is corrupt";
+            return -1;
+        }
+
+        data->output_pending = (output.pos == output.size);
+
+    }
+
+    return output.pos;
+
+}
+#endif
+
+/**
+ * Callback function which reads the uncompressed contents of the recording
+ * being read by the given recording reader, decompressing that recording if
+ * necessary.
+ *
+ * @param socket
+ *     The recording reader to read from.
+ *
+ * @param buf
+ *     The buffer in which the data read should be stored.
+ *
+ * @param count
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero if the end of the recording has been
+ *     reached, or -1 if an error occurs, in which case guac_error is set
+ *     appropriately.
+ */
+static ssize_t guac_recording_reader_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_recording_reader_data* data = (guac_recording_reader_data*) socket->data;
+
+    if (data->format == GUAC_RECORDING_READER_UNKNOWN
+            && guac_recording_reader_detect(data))
+        return -1;
+
+#ifdef HAVE_LIBZSTD
+    if (data->format == GUAC_RECORDING_READER_ZSTD)
+        return guac_recording_reader_decompress(data, buf, count);
+#endif
+
+    /* Return any bytes read while determining the format before reading
+     * anything further */
+    size_t remaining = data->magic_length - data->magic_offset;
+    if (remaining > 0) {
+
+        if (count > remaining)
+            count = remaining;
+
+        memcpy(buf, data->magic + data->magic_offset, count);
+        data->magic_offset += count;
+        return count;
+
+    }
+
+    return guac_socket_read(data->socket, buf, count);
+
+}
+
+/**
+ * Callback function which waits for data to be available for reading from
+ * the given recording reader, returning immediately if data read previously
+ * from the underlying socket has not yet been returned.
+ *
+ * @param socket
+ *     The recording reader to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait, in microseconds, or a negative
+ *     value to wait indefinitely.
+ *
+ * @return
+ *     Positive if data is available for reading, zero if the timeout
+ *     elapsed, or negative if an error occurs.
+ */
+static int guac_recording_reader_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_recording_reader_data* data = (guac_recording_reader_data*) socket->data;
+
+    if (data->magic_offset < data->magic_length
+            && data->format != GUAC_RECORDING_READER_ZSTD)
+        return 1;
+
+#ifdef HAVE_LIBZSTD
+    if (data->format == GUAC_RECORDING_READER_ZSTD
+            && (data->input.pos < data->input.size || data->output_pending))
+        return 1;
+#endif
+
+    return guac_socket_select(data->socket, usec_timeout);
+
+}
+
+/**
+ * Callback function which frees all data associated with the given recording
+ * reader, including its underlying socket.
+ *
+ * @param socket
+ *     The recording reader being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_recording_reader_free_handler(guac_socket* socket) {
+
+    guac_recording_reader_data* data = (guac_recording_reader_data*) socket->data;
+
+#ifdef HAVE_LIBZSTD
+    ZSTD_freeDCtx(data->dctx);
+    guac_mem_free(data->input_buffer);
+#endif
+
+    guac_socket_free(data->socket);
+    guac_mem_free(data);
+    return 0;
+
+}
+
+guac_socket* guac_recording_open_reader(guac_socket* socket) {
+
+    guac_recording_reader_data* data = guac_mem_zalloc(sizeof(guac_recording_reader_data));
+    data->socket = socket;
+
+    /* Associate reader-specific data with new socket */
+    guac_socket* reader = guac_socket_alloc();
+    if (reader == NULL) {
+        guac_mem_free(data);
+        return NULL;
+    }
+
+    reader->data = data;
+
+    /* Assign handlers */
+    reader->read_handler   = guac_recording_reader_read_handler;
+    reader->select_handler = guac_recording_reader_select_handler;
+    reader->free_handler   = guac_recording_reader_free_handler;
+
+    return reader;
+
+}
+
+int guac_recording_seek(int fd, uint64_t position) {
+
+    unsigned char magic[GUAC_RECORDING_MAGIC_SIZE];
+    ssize_t length = pread(fd, magic, sizeof(magic), 0);
+    if (length < 0)
+        return 1;
+
+    /* Offsets within uncompressed recordings are file offsets */
+    if (!guac_recording_is_compressed(magic, length))
+        return lseek(fd, position, SEEK_SET) == -1;
+
+#if defined(HAVE_LIBZSTD) && defined(HAVE_SYS_MMAN_H)
+    struct stat file_stat;
+    if (fstat(fd, &file_stat))
+        return 1;
+
+    size_t size = file_stat.st_size;
+    const unsigned char* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return 1;
+
+    /* Walk each frame of the recording, without decompressing anything,
+     * until the frame beginning at the requested position is found */
+    size_t offset = 0;
+    int found = 0;
+    while (size - offset >= GUAC_RECORDING_MAGIC_SIZE) {
+
+        uint64_t frame_magic = guac_recording_load_le(map + offset, 4);
+
+        /* Skippable frames consist of the magic number, a 32-bit size, and
+         * content (the uncompressed offset of the following frame if written
+         * by a recording socket) */
+        if ((frame_magic & ~0xFULL) == GUAC_SOCKET_RECORDING_SKIPPABLE_MAGIC) {
+
+            if (size - offset < 8)
+                break;
+
+            uint64_t frame_size = guac_recording_load_le(map + offset + 4, 4);
+            if (frame_size > size - offset - 8)
+                break;
+
+            if (frame_magic == GUAC_SOCKET_RECORDING_SEEK_MAGIC
+                    && frame_size == GUAC_SOCKET_RECORDING_SEEK_SIZE - 8) {
+
+                /* Frames are written in order */
+                uint64_t frame_position = guac_recording_load_le(map + offset + 8, 8);
+                if (frame_position >= position) {
+                    found = (frame_position == position);
+                    break;
+                }
+
+            }
+
+            offset += 8 + frame_size;
+            continue;
+
+        }
+
+        size_t frame_size = ZSTD_findFrameCompressedSize(map + offset,
+                size - offset);
+        if (ZSTD_isError(frame_size))
+            break;
+
+        offset += frame_size;
+
+    }
+
+    munmap((void*) map, size);
+
+    if (!found) {
+        errno = EINVAL;
+        return 1;
+    }
+
+    return lseek(fd, offset, SEEK_SET) == -1;
+#else
+    errno = ENOTSUP;
+    return 1;
+#endif
+
+}
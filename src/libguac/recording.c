@@ -19,10 +19,12 @@
 
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
+#include "guacamole/error.h"
 #include "guacamole/protocol.h"
 #include "guacamole/recording.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
+#include "socket-recording.h"
 
 #ifdef __MINGW32__
 #include <direct.h>
@@ -32,11 +34,109 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+/**
+ * The number of bytes of recording data that each newly-created
+ * guac_recording may buffer in memory, as set by
+ * guac_recording_set_default_buffer_size(), or zero if recording data should
+ * not be buffered.
+ */
+static size_t guac_recording_default_buffer_size =
+    GUAC_RECORDING_DEFAULT_BUFFER_SIZE;
+
+/**
+ * The behavior of each newly-created guac_recording when its buffer is full,
+ * as set by guac_recording_set_default_overflow().
+ */
+static guac_recording_overflow guac_recording_default_overflow =
+    GUAC_RECORDING_OVERFLOW_BLOCK;
+
+/**
+ * The minimum number of seconds between keyframes written to the index of
+ * each newly-created guac_recording, as set by
+ * guac_recording_set_default_index_interval(), or zero if no index should be
+ * written.
+ */
+static int guac_recording_default_index_interval = 0;
+
+/**
+ * The zstd compression level of each newly-created guac_recording, as set by
+ * guac_recording_set_default_compression(), or zero if recordings should not
+ * be compressed.
+ */
+static int guac_recording_default_compression = 0;
+
+/**
+ * The maximum JPEG quality of image data within each newly-created
+ * guac_recording, as set by guac_recording_set_default_image_quality(), or
+ * zero if recordings should contain exactly the image data sent to connected
+ * users.
+ */
+static int guac_recording_default_image_quality = 0;
+
+/**
+ * The maximum number of seconds covered by each segment of each
+ * newly-created guac_recording, as set by
+ * guac_recording_set_default_segment_duration(), or zero if segments should
+ * not be limited by duration.
+ */
+static int guac_recording_default_segment_duration = 0;
+
+/**
+ * The maximum number of bytes of each segment of each newly-created
+ * guac_recording, as set by guac_recording_set_default_segment_size(), or
+ * zero if segments should not be limited by size.
+ */
+static uint64_t guac_recording_default_segment_size = 0;
+
+void guac_recording_set_default_buffer_size(size_t size) {
+    guac_recording_default_buffer_size = size;
+}
+
+void guac_recording_set_default_overflow(guac_recording_overflow overflow) {
+    guac_recording_default_overflow = overflow;
+}
+
+void guac_recording_set_default_index_interval(int interval) {
+    guac_recording_default_index_interval = interval > 0 ? interval : 0;
+}
+
+void guac_recording_set_default_compression(int level) {
+
+    if (level > GUAC_RECORDING_MAX_COMPRESSION)
+        level = GUAC_RECORDING_MAX_COMPRESSION;
+
+    guac_recording_default_compression = level > 0 ? level : 0;
+
+}
+
+void guac_recording_set_default_image_quality(int quality) {
+
+    if (quality > 100)
+        quality = 100;
+
+    guac_recording_default_image_quality = quality > 0 ? quality : 0;
+
+}
+
+void guac_recording_set_default_segment_duration(int duration) {
+
+    if (duration > INT_MAX / 1000)
+        duration = INT_MAX / 1000;
+
+    guac_recording_default_segment_duration = duration > 0 ? duration : 0;
+
+}
+
+void guac_recording_set_default_segment_size(uint64_t size) {
+    guac_recording_default_segment_size = size;
+}
+
 /**
  * Attempts to open a new recording within the given path and having the given
  * name. If opening the file fails for any reason, or if such a file already
@@ -141,6 +241,142 @@ static int guac_recording_open(const char* path,
 
 }
 
+/**
+ * Creates the keyframe index of the recording having the given filename,
+ * associating that index with the given recording socket and with the given
+ * client, such that each guac_display of the client will periodically write
+ * keyframes to the index. If the index cannot be created, a warning is
+ * logged, and the recording continues without an index.
+ *
+ * @param client
+ *     The client being recorded.
+ *
+ * @param socket
+ *     The recording socket writing to the recording file, as returned by
+ *     guac_socket_recording().
+ *
+ * @param filename
+ *     The full path to the recording file.
+ *
+ * @param compression
+ *     The zstd compression level to use for the index, or zero if the index
+ *     should not be compressed.
+ */
+static void guac_recording_create_index(guac_client* client,
+        guac_socket* socket, const char* filename, int compression) {
+
+    char index_filename[GUAC_COMMON_RECORDING_MAX_NAME_LENGTH
+        + sizeof(GUAC_RECORDING_INDEX_SUFFIX)];
+
+    snprintf(index_filename, sizeof(index_filename),
+            "%s" GUAC_RECORDING_INDEX_SUFFIX, filename);
+
+    /* Any index left behind by a previous recording of the same name no
+     * longer applies */
+    int fd = open(index_filename, O_CREAT | O_WRONLY | O_TRUNC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                "written without a keyframe index: %s", strerror(errno));
+        return;
+    }
+
+    guac_socket* index = guac_socket_recording(client, fd,
+            GUAC_RECORDING_INDEX_BUFFER_SIZE, GUAC_RECORDING_OVERFLOW_BLOCK,
+            compression);
+    if (index == NULL) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                "written without a keyframe index: %s",
+                guac_status_string(guac_error));
+        close(fd);
+        return;
+    }
+
+    guac_socket_recording_set_index(socket, index,
+            guac_recording_default_index_interval * 1000);
+    client->__recording_index = socket;
+
+    guac_client_log(client, GUAC_LOG_INFO, "Keyframe index of recording "
+            "will be saved to \"%s\".", index_filename);
+
+}
+
+/**
+ * Divides the recording having the given filename into segments, as limited
+ * by guac_recording_set_default_segment_duration() and
+ * guac_recording_set_default_segment_size(), associating the given recording
+ * socket with the given client such that each guac_display of the client
+ * will begin each new segment with the full state of the display.
+ *
+ * @param client
+ *     The client being recorded.
+ *
+ * @param socket
+ *     The recording socket writing to the recording file, as returned by
+ *     guac_socket_recording().
+ *
+ * @param filename
+ *     The full path to the recording file.
+ *
+ * @param compression
+ *     The zstd compression level to use for each closed segment, or zero if
+ *     segments should not be compressed.
+ */
+static void guac_recording_create_segments(guac_client* client,
+        guac_socket* socket, const char* filename, int compression) {
+
+    guac_socket_recording_set_segments(socket, filename,
+            guac_recording_default_segment_duration * 1000,
+            guac_recording_default_segment_size, compression);
+    client->__recording_segments = socket;
+
+    guac_client_log(client, GUAC_LOG_INFO, "Recording will be divided into "
+            "segments, each after the first saved to \"%s"
+            GUAC_RECORDING_SEGMENT_SUFFIX "N\".", filename);
+
+}
+
+/**
+ * Returns the zstd compression level that should be used for the recording
+ * file having the given file descriptor, logging a warning if recordings
+ * should be compressed but the given recording cannot be. Only newly-created
+ * recordings are compressed, as appending compressed data to an existing
+ * recording would render that recording unreadable by tools expecting a
+ * single format.
+ *
+ * @param client
+ *     The client being recorded.
+ *
+ * @param fd
+ *     The file descriptor of the recording file.
+ *
+ * @return
+ *     The zstd compression level to use, or zero if the recording should not
+ *     be compressed.
+ */
+static int guac_recording_compression(guac_client* client, int fd) {
+
+    if (guac_recording_default_compression == 0)
+        return 0;
+
+#ifdef HAVE_LIBZSTD
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || file_stat.st_size != 0) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Recording will be written "
+                "without compression, as it is being appended to an existing "
+                "file.");
+        return 0;
+    }
+
+    return guac_recording_default_compression;
+#else
+    guac_client_log(client, GUAC_LOG_WARNING, "Recording will be written "
+            "without compression, as zstd support is not available.");
+    return 0;
+#endif
+
+}
+
 guac_recording* guac_recording_create(guac_client* client,
         const char* path, const char* name, int create_path,
         int include_output, int include_mouse, int include_touch,
@@ -169,9 +405,81 @@ guac_recording* guac_recording_create(guac_client* client,
         return NULL;
     }
 
+    /* Write the recording from a dedicated thread, such that output to
+     * connected users need not wait for the recording file, falling back to
+     * writing the recording directly if this is not possible */
+    guac_socket* socket = NULL;
+    int compression = guac_recording_compression(client, fd);
+    int segmented = include_output
+        && (guac_recording_default_segment_duration > 0
+            || guac_recording_default_segment_size > 0);
+
+    if (guac_recording_default_buffer_size > 0) {
+
+        /* Segments are compressed only once closed */
+        socket = guac_socket_recording(client, fd,
+                guac_recording_default_buffer_size,
+                guac_recording_default_overflow,
+                segmented ? 0 : compression);
+
+        if (socket == NULL)
+            guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                    "written without buffering: %s",
+                    guac_status_string(guac_error));
+
+    }
+
+    /* Segments can only be begun within a buffered recording containing the
+     * output of the display, each beginning with a snapshot of the display
+     * much like a keyframe */
+    if (segmented) {
+        if (socket != NULL)
+            guac_recording_create_segments(client, socket, filename,
+                    compression);
+        else {
+            guac_client_log(client, GUAC_LOG_WARNING, "Recording will not "
+                    "be divided into segments, as recording data is not "
+                    "buffered.");
+            segmented = 0;
+        }
+    }
+
+    /* Keyframes can only be written for a buffered recording containing the
+     * output of the display */
+    if (include_output && guac_recording_default_index_interval > 0) {
+        if (segmented)
+            guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                    "written without a keyframe index, as each segment of "
+                    "the recording already begins with a snapshot of the "
+                    "display.");
+        else if (socket != NULL)
+            guac_recording_create_index(client, socket, filename,
+                    compression);
+        else
+            guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                    "written without a keyframe index, as recording data "
+                    "is not buffered.");
+    }
+
+    if (socket == NULL) {
+
+        if (compression)
+            guac_client_log(client, GUAC_LOG_WARNING, "Recording will be "
+                    "written without compression, as recording data is not "
+                    "buffered.");
+
+        socket = guac_socket_open(fd);
+
+    }
+
+    else if (compression)
+        guac_client_log(client, GUAC_LOG_DEBUG, "Recording will be "
+                "compressed using zstd level %i%s.", compression,
+                segmented ? " as each segment is closed" : "");
+
     /* Create recording structure with reference to underlying socket */
     guac_recording* recording = guac_mem_alloc(sizeof(guac_recording));
-    recording->socket = guac_socket_open(fd);
+    recording->socket = socket;
     recording->include_output = include_output;
     recording->include_mouse = include_mouse;
     recording->include_touch = include_touch;
@@ -179,8 +487,23 @@ guac_recording* guac_recording_create(guac_client* client,
 
     /* Replace client socket with wrapped recording socket only if including
      * output within the recording */
-    if (include_output)
-        client->socket = guac_socket_tee(client->socket, recording->socket);
+    if (include_output) {
+
+        guac_socket* live_socket = client->socket;
+        client->socket = guac_socket_tee(live_socket, recording->socket);
+
+        /* Allow image data to be encoded separately for the recording at
+         * lower quality, if requested */
+        if (guac_recording_default_image_quality > 0) {
+            client->__recording_output = recording->socket;
+            client->__recording_live_socket = live_socket;
+            client->__recording_image_quality = guac_recording_default_image_quality;
+            guac_client_log(client, GUAC_LOG_DEBUG, "Image data within "
+                    "recording will be limited to JPEG quality %i.",
+                    guac_recording_default_image_quality);
+        }
+
+    }
 
     /* Recording creation succeeded */
     guac_client_log(client, GUAC_LOG_INFO,
@@ -203,13 +526,31 @@ void guac_recording_free(guac_recording* recording) {
 
 }
 
+/**
+ * Marks the end of an input event written to the given recording. If the
+ * recording does not include broadcast output, nothing else will flush the
+ * recording socket, and the event must be flushed explicitly to be written to
+ * the recording file as it occurs.
+ *
+ * @param recording
+ *     The guac_recording that an input event was just written to.
+ */
+static void guac_recording_end_event(guac_recording* recording) {
+
+    if (!recording->include_output)
+        guac_socket_flush(recording->socket);
+
+}
+
 void guac_recording_report_mouse(guac_recording* recording,
         int x, int y, int button_mask) {
 
     /* Report mouse location only if recording should contain mouse events */
-    if (recording->include_mouse)
+    if (recording->include_mouse) {
         guac_protocol_send_mouse(recording->socket, x, y, button_mask,
                 guac_timestamp_current());
+        guac_recording_end_event(recording);
+    }
 
 }
 
@@ -218,9 +559,11 @@ void guac_recording_report_touch(guac_recording* recording,
         double angle, double force) {
 
     /* Report touches only if recording should contain touch events */
-    if (recording->include_touch)
+    if (recording->include_touch) {
         guac_protocol_send_touch(recording->socket, id, x, y,
                 x_radius, y_radius, angle, force, guac_timestamp_current());
+        guac_recording_end_event(recording);
+    }
 
 }
 
@@ -228,9 +571,11 @@ void guac_recording_report_key(guac_recording* recording,
         int keysym, int pressed) {
 
     /* Report key state only if recording should contain key events */
-    if (recording->include_keys)
+    if (recording->include_keys) {
         guac_protocol_send_key(recording->socket, keysym, pressed,
                 guac_timestamp_current());
+        guac_recording_end_event(recording);
+    }
 
 }
 
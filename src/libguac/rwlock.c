@@ -18,9 +18,12 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include "guacamole/error.h"
 #include "guacamole/rwlock.h"
+#include "guacamole/timestamp.h"
 
 /**
  * The value indicating that the current thread holds neither the read or write
@@ -38,6 +41,115 @@
  */
 #define GUAC_REENTRANT_LOCK_WRITE_LOCK 2
 
+/**
+ * The value indicating that the current thread holds the read lock through
+ * its slot within the table of readers, rather than through the underlying
+ * pthread rwlock.
+ */
+#define GUAC_REENTRANT_LOCK_BIASED_READ_LOCK 3
+
+/**
+ * The process-wide table of readers. Each slot points to the guac_rwlock
+ * whose read lock is held through that slot, or is NULL if the slot is
+ * unused.
+ */
+static _Atomic(guac_rwlock*) guac_rwlock_readers[GUAC_RWLOCK_READER_SLOTS];
+
+/**
+ * Returns the slot within the table of readers that the current thread must
+ * use when acquiring a reader-biased read lock on the given lock. The same
+ * slot is always returned for the same thread and lock.
+ *
+ * @param lock
+ *     The lock being acquired.
+ *
+ * @return
+ *     The slot that the current thread must use for the given lock.
+ */
+static _Atomic(guac_rwlock*)* guac_rwlock_get_slot(guac_rwlock* lock) {
+
+    uint64_t hash = (uint64_t) (uintptr_t) lock
+        ^ ((uint64_t) (uintptr_t) pthread_self() * UINT64_C(0x9E3779B97F4A7C15));
+
+    hash ^= hash >> 29;
+    hash *= UINT64_C(0xBF58476D1CE4E5B9);
+    hash ^= hash >> 32;
+
+    return &guac_rwlock_readers[hash & (GUAC_RWLOCK_READER_SLOTS - 1)];
+
+}
+
+/**
+ * Attempts to acquire the read lock of the given lock through the table of
+ * readers, succeeding only if the lock is currently biased toward readers and
+ * the slot of the current thread is unused.
+ *
+ * @param lock
+ *     The lock to acquire.
+ *
+ * @return
+ *     Non-zero if the read lock was acquired, zero otherwise.
+ */
+static int guac_rwlock_acquire_biased(guac_rwlock* lock) {
+
+    if (!atomic_load(&lock->reader_bias))
+        return 0;
+
+    _Atomic(guac_rwlock*)* slot = guac_rwlock_get_slot(lock);
+
+    guac_rwlock* expected = NULL;
+    if (!atomic_compare_exchange_strong(slot, &expected, lock))
+        return 0;
+
+    /* Writers revoke bias before checking for readers, thus the bias must
+     * still be in effect after this reader has been published */
+    if (atomic_load(&lock->reader_bias))
+        return 1;
+
+    atomic_store(slot, NULL);
+    return 0;
+
+}
+
+/**
+ * Releases a read lock that was acquired through the table of readers by
+ * guac_rwlock_acquire_biased().
+ *
+ * @param lock
+ *     The lock to release.
+ */
+static void guac_rwlock_release_biased(guac_rwlock* lock) {
+    atomic_store(guac_rwlock_get_slot(lock), NULL);
+}
+
+/**
+ * Revokes any bias of the given lock toward readers, waiting for all readers
+ * that acquired the lock through the table of readers to release it. Bias is
+ * then inhibited for GUAC_RWLOCK_INHIBIT_MULTIPLIER times the duration of the
+ * revocation. The underlying pthread rwlock must already be held for writing.
+ *
+ * @param lock
+ *     The lock whose reader bias should be revoked.
+ */
+static void guac_rwlock_revoke_bias(guac_rwlock* lock) {
+
+    if (!atomic_load(&lock->reader_bias))
+        return;
+
+    atomic_store(&lock->reader_bias, 0);
+
+    int64_t start = (int64_t) guac_timestamp_current_ns();
+
+    for (int i = 0; i < GUAC_RWLOCK_READER_SLOTS; i++) {
+        while (atomic_load(&guac_rwlock_readers[i]) == lock)
+            sched_yield();
+    }
+
+    int64_t now = (int64_t) guac_timestamp_current_ns();
+    lock->inhibit_until = now + (now - start) * GUAC_RWLOCK_INHIBIT_MULTIPLIER;
+
+}
+
 void guac_rwlock_init(guac_rwlock* lock) {
 
     /* Configure to allow sharing this lock with child processes */
@@ -51,6 +163,10 @@ void guac_rwlock_init(guac_rwlock* lock) {
     /* Initialize the  flags to 0, as threads won't have acquired it yet */
     pthread_key_create(&(lock->key), (void *) 0);
 
+    /* Bias toward readers only once the lock has been read */
+    atomic_init(&lock->reader_bias, 0);
+    lock->inhibit_until = 0;
+
 }
 
 void guac_rwlock_destroy(guac_rwlock* lock) {
@@ -181,9 +297,13 @@ int guac_rwlock_acquire_write_lock(guac_rwlock* reentrant_rwlock) {
      */
     if (flag == GUAC_REENTRANT_LOCK_READ_LOCK)
         pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+    else if (flag == GUAC_REENTRANT_LOCK_BIASED_READ_LOCK)
+        guac_rwlock_release_biased(reentrant_rwlock);
 
-    /* Acquire the write lock */
+    /* Acquire the write lock, waiting for any readers that bypassed the
+     * underlying pthread rwlock */
     pthread_rwlock_wrlock(&(reentrant_rwlock->lock));
+    guac_rwlock_revoke_bias(reentrant_rwlock);
 
     /* Mark that the current thread has the lock, and increment the count */
     pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
@@ -213,6 +333,7 @@ int guac_rwlock_acquire_read_lock(guac_rwlock* reentrant_rwlock) {
     /* The current thread may read if either the read or write lock is held */
     if (
             flag == GUAC_REENTRANT_LOCK_READ_LOCK ||
+            flag == GUAC_REENTRANT_LOCK_BIASED_READ_LOCK ||
             flag == GUAC_REENTRANT_LOCK_WRITE_LOCK
     ) {
 
@@ -224,9 +345,22 @@ int guac_rwlock_acquire_read_lock(guac_rwlock* reentrant_rwlock) {
         return 0;
     }
 
+    /* Acquire the lock without touching the underlying pthread rwlock if
+     * possible */
+    if (guac_rwlock_acquire_biased(reentrant_rwlock)) {
+        pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
+                    GUAC_REENTRANT_LOCK_BIASED_READ_LOCK, 1));
+        return 0;
+    }
+
     /* Acquire the lock */
     pthread_rwlock_rdlock(&(reentrant_rwlock->lock));
 
+    /* Restore bias toward readers once any inhibition has elapsed */
+    if (!atomic_load(&reentrant_rwlock->reader_bias)
+            && (int64_t) guac_timestamp_current_ns() >= reentrant_rwlock->inhibit_until)
+        atomic_store(&reentrant_rwlock->reader_bias, 1);
+
     /* Set the flag that the current thread has the read lock */
     pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
                 GUAC_REENTRANT_LOCK_READ_LOCK, 1));
@@ -258,7 +392,10 @@ int guac_rwlock_release_lock(guac_rwlock* reentrant_rwlock) {
     /* Release the lock if this is the last locked level */
     if (count == 1) {
 
-        pthread_rwlock_unlock(&(reentrant_rwlock->lock));
+        if (flag == GUAC_REENTRANT_LOCK_BIASED_READ_LOCK)
+            guac_rwlock_release_biased(reentrant_rwlock);
+        else
+            pthread_rwlock_unlock(&(reentrant_rwlock->lock));
 
         /* Set the flag that the current thread holds no locks */
         pthread_setspecific(reentrant_rwlock->key, get_value_from_flag_and_count(
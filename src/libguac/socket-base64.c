@@ -0,0 +1,368 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "socket-base64.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * All 64 characters used by base64, in order of the 6-bit values that they
+ * represent.
+ */
+static const char GUAC_SOCKET_BASE64_CHARACTERS[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t guac_socket_base64_scalar(const unsigned char* restrict src,
+        size_t length, char* restrict dst) {
+
+    char* current = dst;
+
+    /* Encode bytes in groups of three */
+    while (length >= 3) {
+
+        uint32_t value = (src[0] << 16) | (src[1] << 8) | src[2];
+
+        current[0] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 18) & 0x3F];
+        current[1] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 12) & 0x3F];
+        current[2] = GUAC_SOCKET_BASE64_CHARACTERS[(value >>  6) & 0x3F];
+        current[3] = GUAC_SOCKET_BASE64_CHARACTERS[ value        & 0x3F];
+
+        src     += 3;
+        length  -= 3;
+        current += 4;
+
+    }
+
+    /* Take care of partial remnants, padding with '=' */
+    if (length == 2) {
+
+        uint32_t value = (src[0] << 16) | (src[1] << 8);
+
+        current[0] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 18) & 0x3F];
+        current[1] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 12) & 0x3F];
+        current[2] = GUAC_SOCKET_BASE64_CHARACTERS[(value >>  6) & 0x3F];
+        current[3] = '=';
+        current += 4;
+
+    }
+
+    else if (length == 1) {
+
+        uint32_t value = src[0] << 16;
+
+        current[0] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 18) & 0x3F];
+        current[1] = GUAC_SOCKET_BASE64_CHARACTERS[(value >> 12) & 0x3F];
+        current[2] = '=';
+        current[3] = '=';
+        current += 4;
+
+    }
+
+    return current - dst;
+
+}
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+/*
+ * NOTE: The x86 implementations below follow the approach described by
+ * Wojciech Muła and Daniel Lemire ("Faster Base64 Encoding and Decoding Using
+ * AVX2 Instructions", 2018). Each group of three input bytes is first
+ * shuffled into a 32-bit lane, the four 6-bit values within that lane are
+ * then moved into separate bytes using multiplications (which act as
+ * per-field shifts), and each 6-bit value is finally translated to its
+ * character by adding an offset looked up according to the range that the
+ * value falls within.
+ */
+
+/**
+ * Splits the first twelve bytes of the given vector into sixteen 6-bit
+ * values, one per byte, in the order those values are encoded.
+ *
+ * @param input
+ *     The vector containing the bytes to split within its first twelve bytes.
+ *
+ * @return
+ *     A vector containing the sixteen 6-bit values.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i guac_socket_base64_ssse3_split(__m128i input) {
+
+    /* Arrange each group of three bytes such that each of its 6-bit values
+     * can be isolated by masking and multiplying 16-bit quantities */
+    input = _mm_shuffle_epi8(input, _mm_set_epi8(
+                10, 11,  9, 10,
+                 7,  8,  6,  7,
+                 4,  5,  3,  4,
+                 1,  2,  0,  1));
+
+    /* Values 0 and 2 of each group (shifted right by 10 and 6 bits) */
+    __m128i even = _mm_mulhi_epu16(
+            _mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)),
+            _mm_set1_epi32(0x04000040));
+
+    /* Values 1 and 3 of each group (shifted left by 8 and 4 bits) */
+    __m128i odd = _mm_mullo_epi16(
+            _mm_and_si128(input, _mm_set1_epi32(0x003F03F0)),
+            _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(even, odd);
+
+}
+
+/**
+ * Translates each of the sixteen 6-bit values of the given vector to its
+ * corresponding base64 character.
+ *
+ * @param values
+ *     The vector containing sixteen 6-bit values, one per byte.
+ *
+ * @return
+ *     A vector containing the sixteen corresponding base64 characters.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i guac_socket_base64_ssse3_translate(__m128i values) {
+
+    /* Offsets to add to each range of values: 0-25 map to 13, 26-51 map to
+     * 0, 52-61 map to 1-10, 62 maps to 11, and 63 maps to 12 */
+    const __m128i offsets = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A',      0,        0);
+
+    __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), values);
+
+}
+
+__attribute__((target("ssse3")))
+size_t guac_socket_base64_ssse3(const unsigned char* restrict src,
+        size_t length, char* restrict dst) {
+
+    char* current = dst;
+
+    /* Each iteration consumes twelve bytes, but loads sixteen */
+    while (length >= 16) {
+
+        __m128i input = _mm_loadu_si128((const __m128i*) src);
+        __m128i output = guac_socket_base64_ssse3_translate(
+                guac_socket_base64_ssse3_split(input));
+
+        _mm_storeu_si128((__m128i*) current, output);
+
+        src     += 12;
+        length  -= 12;
+        current += 16;
+
+    }
+
+    return (current - dst) + guac_socket_base64_scalar(src, length, current);
+
+}
+
+/**
+ * Splits the first twelve bytes of each 128-bit lane of the given vector into
+ * sixteen 6-bit values, one per byte, in the order those values are encoded.
+ *
+ * @param input
+ *     The vector containing the bytes to split within the first twelve bytes
+ *     of each 128-bit lane.
+ *
+ * @return
+ *     A vector containing the thirty-two 6-bit values.
+ */
+__attribute__((target("avx2")))
+static inline __m256i guac_socket_base64_avx2_split(__m256i input) {
+
+    /* Identical to guac_socket_base64_ssse3_split(), as each of the
+     * instructions involved operates on each 128-bit lane separately */
+    input = _mm256_shuffle_epi8(input, _mm256_broadcastsi128_si256(_mm_set_epi8(
+                10, 11,  9, 10,
+                 7,  8,  6,  7,
+                 4,  5,  3,  4,
+                 1,  2,  0,  1)));
+
+    __m256i even = _mm256_mulhi_epu16(
+            _mm256_and_si256(input, _mm256_set1_epi32(0x0FC0FC00)),
+            _mm256_set1_epi32(0x04000040));
+
+    __m256i odd = _mm256_mullo_epi16(
+            _mm256_and_si256(input, _mm256_set1_epi32(0x003F03F0)),
+            _mm256_set1_epi32(0x01000010));
+
+    return _mm256_or_si256(even, odd);
+
+}
+
+/**
+ * Translates each of the thirty-two 6-bit values of the given vector to its
+ * corresponding base64 character.
+ *
+ * @param values
+ *     The vector containing thirty-two 6-bit values, one per byte.
+ *
+ * @return
+ *     A vector containing the thirty-two corresponding base64 characters.
+ */
+__attribute__((target("avx2")))
+static inline __m256i guac_socket_base64_avx2_translate(__m256i values) {
+
+    /* Identical to guac_socket_base64_ssse3_translate() */
+    const __m256i offsets = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A',      0,        0));
+
+    __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+    return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), values);
+
+}
+
+__attribute__((target("avx2")))
+size_t guac_socket_base64_avx2(const unsigned char* restrict src,
+        size_t length, char* restrict dst) {
+
+    char* current = dst;
+
+    /* Each iteration consumes twenty-four bytes, twelve per 128-bit lane, but
+     * loads twenty-eight */
+    while (length >= 28) {
+
+        __m256i input = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) src)),
+                _mm_loadu_si128((const __m128i*) (src + 12)), 1);
+
+        __m256i output = guac_socket_base64_avx2_translate(
+                guac_socket_base64_avx2_split(input));
+
+        _mm256_storeu_si256((__m256i*) current, output);
+
+        src     += 24;
+        length  -= 24;
+        current += 32;
+
+    }
+
+    return (current - dst) + guac_socket_base64_ssse3(src, length, current);
+
+}
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+size_t guac_socket_base64_neon(const unsigned char* restrict src,
+        size_t length, char* restrict dst) {
+
+    char* current = dst;
+
+    /* The entire alphabet fits within the four registers of a single table
+     * lookup */
+    const uint8_t* characters = (const uint8_t*) GUAC_SOCKET_BASE64_CHARACTERS;
+    uint8x16x4_t table = { {
+        vld1q_u8(characters),
+        vld1q_u8(characters + 16),
+        vld1q_u8(characters + 32),
+        vld1q_u8(characters + 48)
+    } };
+
+    /* Each iteration encodes sixteen groups of three bytes, loaded such that
+     * each register contains the same byte of every group */
+    while (length >= 48) {
+
+        uint8x16x3_t input = vld3q_u8(src);
+        uint8x16x4_t output;
+
+        output.val[0] = vshrq_n_u8(input.val[0], 2);
+        output.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(input.val[0], vdupq_n_u8(0x03)), 4),
+                vshrq_n_u8(input.val[1], 4));
+        output.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(input.val[1], vdupq_n_u8(0x0F)), 2),
+                vshrq_n_u8(input.val[2], 6));
+        output.val[3] = vandq_u8(input.val[2], vdupq_n_u8(0x3F));
+
+        output.val[0] = vqtbl4q_u8(table, output.val[0]);
+        output.val[1] = vqtbl4q_u8(table, output.val[1]);
+        output.val[2] = vqtbl4q_u8(table, output.val[2]);
+        output.val[3] = vqtbl4q_u8(table, output.val[3]);
+
+        /* Interleave the characters of each group when storing */
+        vst4q_u8((uint8_t*) current, output);
+
+        src     += 48;
+        length  -= 48;
+        current += 64;
+
+    }
+
+    return (current - dst) + guac_socket_base64_scalar(src, length, current);
+
+}
+
+#endif
+
+guac_socket_base64_function* guac_socket_base64_select(const char** name) {
+
+    const char* selected_name = "scalar";
+    guac_socket_base64_function* selected = guac_socket_base64_scalar;
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        selected_name = "AVX2";
+        selected = guac_socket_base64_avx2;
+    }
+
+    else if (__builtin_cpu_supports("ssse3")) {
+        selected_name = "SSSE3";
+        selected = guac_socket_base64_ssse3;
+    }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+    selected_name = "NEON";
+    selected = guac_socket_base64_neon;
+
+#endif
+
+    if (name != NULL)
+        *name = selected_name;
+
+    return selected;
+
+}
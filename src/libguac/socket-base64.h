@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_BASE64_H
+#define GUAC_SOCKET_BASE64_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * Encodes the given buffer of arbitrary data as base64, including any
+ * trailing '=' padding characters. The encoded data is NOT null-terminated.
+ *
+ * All implementations of this function (scalar or otherwise) MUST produce
+ * exactly the same results for the same input.
+ *
+ * @param src
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes within src.
+ *
+ * @param dst
+ *     The buffer that should receive the encoded data. This buffer MUST have
+ *     space for at least GUAC_SOCKET_BASE64_ENCODED_LENGTH(length)
+ *     characters.
+ *
+ * @return
+ *     The number of characters written to dst, which is always
+ *     GUAC_SOCKET_BASE64_ENCODED_LENGTH(length).
+ */
+typedef size_t guac_socket_base64_function(const unsigned char* restrict src,
+        size_t length, char* restrict dst);
+
+/**
+ * The number of characters produced when encoding the given number of bytes
+ * as base64, including any padding.
+ *
+ * @param length
+ *     The number of bytes being encoded.
+ */
+#define GUAC_SOCKET_BASE64_ENCODED_LENGTH(length) (((length) + 2) / 3 * 4)
+
+/**
+ * The maximum number of bytes encoded at once when guac_socket_write_base64()
+ * encodes data directly from the caller's buffer rather than copying that
+ * data into the ready buffer of the socket. This value MUST be a multiple of
+ * three such that no padding is produced between chunks.
+ */
+#define GUAC_SOCKET_BASE64_CHUNK_SIZE 6144
+
+/**
+ * Portable, scalar implementation of guac_socket_base64_function which
+ * encodes the given data three bytes at a time. This implementation is always
+ * available and serves as the reference against which all other
+ * implementations are verified.
+ *
+ * @see guac_socket_base64_function
+ */
+guac_socket_base64_function guac_socket_base64_scalar;
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+/**
+ * Implementation of guac_socket_base64_function which encodes twelve bytes at
+ * a time using SSSE3 instructions. This implementation may only be invoked if
+ * the current processor supports SSSE3.
+ *
+ * @see guac_socket_base64_function
+ */
+guac_socket_base64_function guac_socket_base64_ssse3;
+
+/**
+ * Implementation of guac_socket_base64_function which encodes twenty-four
+ * bytes at a time using AVX2 instructions. This implementation may only be
+ * invoked if the current processor supports AVX2.
+ *
+ * @see guac_socket_base64_function
+ */
+guac_socket_base64_function guac_socket_base64_avx2;
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+/**
+ * Implementation of guac_socket_base64_function which encodes forty-eight
+ * bytes at a time using NEON instructions. NEON is mandatory on AArch64, and
+ * thus this implementation is always safe to invoke when available.
+ *
+ * @see guac_socket_base64_function
+ */
+guac_socket_base64_function guac_socket_base64_neon;
+
+#endif
+
+/**
+ * Returns the fastest implementation of guac_socket_base64_function that is
+ * supported by the current processor. The scalar implementation is returned
+ * if no accelerated implementation is supported.
+ *
+ * @param name
+ *     A pointer to a const char* that should receive a human-readable name
+ *     for the selected implementation, such as "AVX2", or NULL if no such
+ *     name is needed.
+ *
+ * @return
+ *     The fastest supported implementation of guac_socket_base64_function.
+ */
+guac_socket_base64_function* guac_socket_base64_select(const char** name);
+
+#endif
@@ -24,6 +24,7 @@
 #include "guacamole/error.h"
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
+#include "socket-queue.h"
 
 #include <pthread.h>
 #include <stdlib.h>
@@ -85,6 +86,21 @@ typedef struct __write_chunk {
      */
     size_t length;
 
+    /**
+     * A shared copy of the buffer which may be queued by reference for any
+     * users whose sockets are queued sockets (see guac_socket_queue()), or
+     * NULL if no such copy has yet been made. A shared copy is made only for
+     * writes of at least GUAC_SOCKET_QUEUE_SHARED_THRESHOLD bytes, and only
+     * once a user with a queued socket is encountered.
+     */
+    guac_socket_queue_chunk* shared;
+
+    /**
+     * The priority of the data being written, as set on the broadcast
+     * socket with guac_socket_set_priority().
+     */
+    guac_socket_priority priority;
+
 } __write_chunk;
 
 /**
@@ -116,7 +132,10 @@ static ssize_t __guac_socket_broadcast_read_handler(guac_socket* socket,
 /**
  * Callback invoked by the broadcast handler which write a given chunk of
  * data to that user's socket. If the write attempt fails, the user is
- * signalled to stop with guac_user_stop().
+ * signalled to stop with guac_user_stop(). Users with queued sockets (see
+ * guac_socket_queue()) are written to without waiting for room within their
+ * queues, such that a user that has fallen too far behind is stopped rather
+ * than delaying all other users.
  *
  * @param user
  *     The user that the chunk of data should be written to.
@@ -130,9 +149,35 @@ static ssize_t __guac_socket_broadcast_read_handler(guac_socket* socket,
 static void* __write_chunk_callback(guac_user* user, void* data) {
 
     __write_chunk* chunk = (__write_chunk*) data;
-
-    /* Attempt write, disconnect on failure */
-    if (guac_socket_write(user->socket, chunk->buffer, chunk->length))
+    guac_socket* socket = user->socket;
+
+    /* The user's socket is locked for the duration of the broadcast
+     * instruction, and shares that instruction's priority */
+    guac_socket_set_priority(socket, chunk->priority);
+
+    /* Write directly to sockets that are not queued */
+    if (!guac_socket_is_queued(socket)) {
+        if (guac_socket_write(socket, chunk->buffer, chunk->length))
+            guac_user_stop(user);
+        return NULL;
+    }
+
+    /* Copy larger writes only once, sharing that copy with all queues */
+    if (chunk->shared == NULL
+            && chunk->length >= GUAC_SOCKET_QUEUE_SHARED_THRESHOLD)
+        chunk->shared = guac_socket_queue_chunk_alloc(chunk->buffer,
+                chunk->length);
+
+    /* Attempt write, disconnect on failure (including if the user's queue is
+     * full) */
+    int result;
+    if (chunk->shared != NULL)
+        result = guac_socket_queue_write_chunk(socket, chunk->shared);
+    else
+        result = guac_socket_queue_write_nonblocking(socket, chunk->buffer,
+                chunk->length);
+
+    if (result)
         guac_user_stop(user);
 
     return NULL;
@@ -168,10 +213,17 @@ static ssize_t __guac_socket_broadcast_write_handler(guac_socket* socket,
     __write_chunk chunk;
     chunk.buffer = buf;
     chunk.length = count;
+    chunk.shared = NULL;
+    chunk.priority = socket->__priority;
 
     /* Broadcast chunk to the users */
     data->broadcast_handler(data->client, __write_chunk_callback, &chunk);
 
+    /* Release our reference to any shared copy (the copy will be freed once
+     * all queues have written it) */
+    if (chunk.shared != NULL)
+        guac_socket_queue_chunk_release(chunk.shared);
+
     return count;
 
 }
@@ -34,6 +34,49 @@
 
 #ifdef ENABLE_WINSOCK
 #include <winsock2.h>
+#else
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <errno.h>
+#include <limits.h>
+#include <liburing.h>
+
+/**
+ * The number of entries within the submission queue of the io_uring instance
+ * of each socket. At most one write is in flight at any time.
+ */
+#define GUAC_SOCKET_FD_URING_ENTRIES 4
+
+/**
+ * The number of times the current process has been forked. An io_uring
+ * instance cannot be safely shared with a child process, and is used only by
+ * the process that set it up.
+ */
+static unsigned int guac_socket_fd_fork_generation = 1;
+
+/**
+ * Ensures the atfork handler maintaining guac_socket_fd_fork_generation is
+ * registered only once.
+ */
+static pthread_once_t guac_socket_fd_atfork_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Records within the child process that the current process has been
+ * forked.
+ */
+static void guac_socket_fd_atfork_child() {
+    guac_socket_fd_fork_generation++;
+}
+
+/**
+ * Registers guac_socket_fd_atfork_child() to be invoked within the child
+ * process each time the current process is forked.
+ */
+static void guac_socket_fd_register_atfork() {
+    pthread_atfork(NULL, NULL, guac_socket_fd_atfork_child);
+}
 #endif
 
 /**
@@ -49,13 +92,12 @@ typedef struct guac_socket_fd_data {
     /**
      * The number of bytes currently in the main write buffer.
      */
-    int written;
+    size_t written;
 
     /**
-     * The main write buffer. Bytes written go here before being flushed
-     * to the open file descriptor.
+     * The size of the main write buffer, in bytes.
      */
-    char out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
+    size_t out_buf_size;
 
     /**
      * Lock which is acquired when an instruction is being written, and
@@ -69,8 +111,236 @@ typedef struct guac_socket_fd_data {
      */
     pthread_mutex_t buffer_lock;
 
+#ifdef HAVE_LIBURING
+    /**
+     * The io_uring instance through which the contents of the write buffer
+     * are written when flushed, valid only if ring_generation is equal to
+     * guac_socket_fd_fork_generation.
+     */
+    struct io_uring ring;
+
+    /**
+     * The value of guac_socket_fd_fork_generation at the time ring was set
+     * up, zero if ring has not yet been set up, or UINT_MAX if io_uring
+     * cannot be used, in which case all writes are performed directly.
+     */
+    unsigned int ring_generation;
+
+    /**
+     * The write buffer whose contents are currently being written by ring,
+     * or NULL if no write is in flight. This is always whichever of
+     * initial_buf and spare_buf is not out_buf.
+     */
+    char* pending_buf;
+
+    /**
+     * The number of bytes of pending_buf that have been written thus far.
+     */
+    size_t pending_written;
+
+    /**
+     * The total number of bytes of pending_buf that must be written.
+     */
+    size_t pending_length;
+
+    /**
+     * A second write buffer of out_buf_size bytes, registered with ring
+     * together with initial_buf, such that one buffer can be filled while
+     * the other is being written. This is NULL if ring has not been set up.
+     */
+    char* spare_buf;
+#endif
+
+    /**
+     * The main write buffer, containing out_buf_size bytes. Bytes written go
+     * here before being flushed to the open file descriptor. Unless writes
+     * are submitted via io_uring, this is always initial_buf.
+     */
+    char* out_buf;
+
+    /**
+     * Storage for the initial write buffer, containing out_buf_size bytes.
+     */
+    char initial_buf[];
+
 } guac_socket_fd_data;
 
+#ifdef HAVE_LIBURING
+/**
+ * Returns whether writes to the given socket may be submitted via its
+ * io_uring instance, setting up that instance if this has not yet been
+ * attempted. This function must ONLY be called if the buffer lock has already
+ * been acquired.
+ *
+ * @param data
+ *     The data associated with the socket.
+ *
+ * @return
+ *     Non-zero if writes may be submitted via io_uring, zero if writes must
+ *     be performed directly.
+ */
+static int guac_socket_fd_uring_available(guac_socket_fd_data* data) {
+
+    if (data->ring_generation == guac_socket_fd_fork_generation)
+        return 1;
+
+    /* Rings set up by another process, and rings that could not be set up,
+     * are never used */
+    if (data->ring_generation != 0)
+        return 0;
+
+    pthread_once(&guac_socket_fd_atfork_init, guac_socket_fd_register_atfork);
+
+    /* Fall back to direct writes if io_uring is unavailable (such as within
+     * containers that restrict the relevant syscalls) */
+    data->ring_generation = UINT_MAX;
+    if (io_uring_queue_init(GUAC_SOCKET_FD_URING_ENTRIES, &data->ring, 0))
+        return 0;
+
+    data->spare_buf = guac_mem_alloc(data->out_buf_size);
+
+    /* Register both write buffers, avoiding the cost of mapping them for
+     * each write */
+    struct iovec buffers[2] = {
+        { .iov_base = data->initial_buf, .iov_len = data->out_buf_size },
+        { .iov_base = data->spare_buf,   .iov_len = data->out_buf_size }
+    };
+
+    if (io_uring_register_buffers(&data->ring, buffers, 2)) {
+        io_uring_queue_exit(&data->ring);
+        guac_mem_free(data->spare_buf);
+        return 0;
+    }
+
+    data->ring_generation = guac_socket_fd_fork_generation;
+    return 1;
+
+}
+
+/**
+ * Submits a write of the remaining contents of the write buffer currently in
+ * flight for the given socket. This function must ONLY be called if the
+ * buffer lock has already been acquired.
+ *
+ * @param data
+ *     The data associated with the socket.
+ *
+ * @return
+ *     Zero if the write was submitted successfully, or a negative value if
+ *     an error occurs, in which case guac_error is set appropriately.
+ */
+static int guac_socket_fd_uring_submit(guac_socket_fd_data* data) {
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&data->ring);
+
+    /* At most one write is ever in flight, so there is always space */
+    io_uring_prep_write_fixed(sqe, data->fd,
+            data->pending_buf + data->pending_written,
+            data->pending_length - data->pending_written,
+            (__u64) -1, data->pending_buf == data->initial_buf ? 0 : 1);
+
+    int retval = io_uring_submit(&data->ring);
+    if (retval < 0) {
+        errno = -retval;
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to socket";
+        data->pending_buf = NULL;
+        return -1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Waits for any write in flight for the given socket to complete, resubmitting
+ * the remainder of any partial write. If the write has already completed, its
+ * completion is reaped without waiting. This function must ONLY be called if
+ * the buffer lock has already been acquired.
+ *
+ * @param data
+ *     The data associated with the socket.
+ *
+ * @return
+ *     Zero if no write is in flight or the write in flight completed
+ *     successfully, or a negative value if an error occurs, in which case
+ *     guac_error is set appropriately.
+ */
+static int guac_socket_fd_uring_wait(guac_socket_fd_data* data) {
+
+    while (data->pending_buf != NULL) {
+
+        struct io_uring_cqe* cqe;
+        int retval = io_uring_wait_cqe(&data->ring, &cqe);
+        if (retval == -EINTR)
+            continue;
+
+        if (retval == 0) {
+            retval = cqe->res;
+            io_uring_cqe_seen(&data->ring, cqe);
+        }
+
+        /* Record errors in guac_error */
+        if (retval < 0) {
+            errno = -retval;
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to socket";
+            data->pending_buf = NULL;
+            return -1;
+        }
+
+        data->pending_written += retval;
+
+        /* Continue with any unwritten remainder */
+        if (data->pending_written < data->pending_length) {
+            if (guac_socket_fd_uring_submit(data))
+                return -1;
+        }
+
+        else
+            data->pending_buf = NULL;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Submits the contents of the output buffer of the given socket to be
+ * written asynchronously via io_uring, such that the next flush need only
+ * reap the completion of that write. Writing continues into the other of the
+ * two registered write buffers. This function must ONLY be called if the
+ * buffer lock has already been acquired and guac_socket_fd_uring_available()
+ * has returned non-zero.
+ *
+ * @param data
+ *     The data associated with the socket.
+ *
+ * @return
+ *     Zero if the contents of the output buffer were submitted successfully,
+ *     or a negative value if an error occurs, in which case guac_error is
+ *     set appropriately.
+ */
+static int guac_socket_fd_uring_flush(guac_socket_fd_data* data) {
+
+    /* The other buffer cannot be reused until its write has completed */
+    if (guac_socket_fd_uring_wait(data))
+        return -1;
+
+    data->pending_buf = data->out_buf;
+    data->pending_written = 0;
+    data->pending_length = data->written;
+
+    data->out_buf = (data->out_buf == data->initial_buf)
+        ? data->spare_buf : data->initial_buf;
+    data->written = 0;
+
+    return guac_socket_fd_uring_submit(data);
+
+}
+#endif
+
 /**
  * Writes the entire contents of the given buffer to the file descriptor
  * associated with the given socket, retrying as necessary until the whole
@@ -126,6 +396,101 @@ ssize_t guac_socket_fd_write(guac_socket* socket,
 
 }
 
+/**
+ * Writes the entire contents of the output buffer of the given socket,
+ * followed by the entire contents of the given buffer, to the associated file
+ * descriptor, retrying as necessary until everything is written, and aborting
+ * if an error occurs. Where possible, both are written with the same
+ * vectored write, such that the given buffer need not first be copied into
+ * the output buffer. The output buffer is empty upon success. This function
+ * must ONLY be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket associated with the file descriptor to which the given
+ *     buffer should be written.
+ *
+ * @param buf
+ *     The buffer of data to write to the given guac_socket after the
+ *     contents of the output buffer.
+ *
+ * @param count
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if everything was written successfully, or a negative value if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_fd_write_vectored(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+#ifdef HAVE_LIBURING
+    /* Data written directly must follow any write still in flight */
+    if (data->ring_generation == guac_socket_fd_fork_generation
+            && guac_socket_fd_uring_wait(data))
+        return -1;
+#endif
+
+#ifdef ENABLE_WINSOCK
+
+    /* WSA only works with send(), so simply write each buffer in turn */
+    if (guac_socket_fd_write(socket, data->out_buf, data->written))
+        return -1;
+
+    data->written = 0;
+    return guac_socket_fd_write(socket, buf, count);
+
+#else
+
+    struct iovec iov[2] = {
+        { .iov_base = data->out_buf,  .iov_len = data->written },
+        { .iov_base = (void*) buf,    .iov_len = count         }
+    };
+
+    struct iovec* current = iov;
+    int remaining = 2;
+
+    /* Skip output buffer entirely if empty */
+    if (current->iov_len == 0) {
+        current++;
+        remaining--;
+    }
+
+    /* Write until completely written */
+    while (remaining > 0) {
+
+        ssize_t retval = writev(data->fd, current, remaining);
+
+        /* Record errors in guac_error */
+        if (retval < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to socket";
+            return retval;
+        }
+
+        /* Advance past all fully-written buffers */
+        while (remaining > 0 && (size_t) retval >= current->iov_len) {
+            retval -= current->iov_len;
+            current++;
+            remaining--;
+        }
+
+        /* Advance within any partially-written buffer */
+        if (remaining > 0) {
+            current->iov_base = (char*) current->iov_base + retval;
+            current->iov_len -= retval;
+        }
+
+    }
+
+    data->written = 0;
+    return 0;
+
+#endif
+
+}
+
 /**
  * Attempts to read from the underlying file descriptor of the given
  * guac_socket, populating the given buffer.
@@ -185,6 +550,12 @@ static ssize_t guac_socket_fd_flush(guac_socket* socket) {
     /* Flush remaining bytes in buffer */
     if (data->written > 0) {
 
+#ifdef HAVE_LIBURING
+        /* Write asynchronously if possible */
+        if (guac_socket_fd_uring_available(data))
+            return guac_socket_fd_uring_flush(data) ? 1 : 0;
+#endif
+
         /* Write ALL bytes in buffer immediately */
         if (guac_socket_fd_write(socket, data->out_buf, data->written))
             return 1;
@@ -246,45 +617,28 @@ static ssize_t guac_socket_fd_flush_handler(guac_socket* socket) {
 static ssize_t guac_socket_fd_write_buffered(guac_socket* socket,
         const void* buf, size_t count) {
 
-    size_t original_count = count;
-    const char* current = buf;
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
-    /* Append to buffer, flush if necessary */
-    while (count > 0) {
-
-        int chunk_size;
-        int remaining = sizeof(data->out_buf) - data->written;
-
-        /* If no space left in buffer, flush and retry */
-        if (remaining == 0) {
-
-            /* Abort if error occurs during flush */
-            if (guac_socket_fd_flush(socket))
-                return -1;
-
-            /* Retry buffer append */
-            continue;
-
-        }
-
-        /* Calculate size of chunk to be written to buffer */
-        chunk_size = count;
-        if (chunk_size > remaining)
-            chunk_size = remaining;
+    /* If the data will not fit within the remaining space of the buffer, the
+     * buffer would need to be flushed anyway. Write the buffer and the data
+     * together instead of copying the data into the buffer piece by piece,
+     * flushing each time the buffer fills. */
+    if (count > data->out_buf_size - data->written) {
 
-        /* Update output buffer */
-        memcpy(data->out_buf + data->written, current, chunk_size);
-        data->written += chunk_size;
+        /* Abort if error occurs during write */
+        if (guac_socket_fd_write_vectored(socket, buf, count))
+            return -1;
 
-        /* Update provided buffer */
-        current += chunk_size;
-        count   -= chunk_size;
+        return count;
 
     }
 
-    /* All bytes have been written, possibly some to the internal buffer */
-    return original_count;
+    /* Otherwise, simply append to buffer */
+    memcpy(data->out_buf + data->written, buf, count);
+    data->written += count;
+
+    /* All bytes have been written to the internal buffer */
+    return count;
 
 }
 
@@ -376,6 +730,16 @@ static int guac_socket_fd_free_handler(guac_socket* socket) {
 
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
+#ifdef HAVE_LIBURING
+    /* Finish writing all flushed data before closing the file descriptor */
+    if (data->ring_generation == guac_socket_fd_fork_generation) {
+        guac_socket_fd_uring_wait(data);
+        io_uring_queue_exit(&data->ring);
+    }
+
+    guac_mem_free(data->spare_buf);
+#endif
+
     /* Destroy locks */
     pthread_mutex_destroy(&(data->socket_lock));
     pthread_mutex_destroy(&(data->buffer_lock));
@@ -419,18 +783,38 @@ static void guac_socket_fd_unlock_handler(guac_socket* socket) {
 }
 
 guac_socket* guac_socket_open(int fd) {
+    return guac_socket_open_buffered(fd, GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+}
+
+guac_socket* guac_socket_open_buffered(int fd, size_t buffer_size) {
 
     pthread_mutexattr_t lock_attributes;
 
+    /* The output buffer must be large enough to hold at least a typical
+     * instruction */
+    if (buffer_size < GUAC_SOCKET_OUTPUT_BUFFER_SIZE)
+        buffer_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
     /* Allocate socket and associated data */
     guac_socket* socket = guac_socket_alloc();
-    guac_socket_fd_data* data = guac_mem_alloc(sizeof(guac_socket_fd_data));
+    guac_socket_fd_data* data = guac_mem_alloc(
+            guac_mem_ckd_add_or_die(sizeof(guac_socket_fd_data), buffer_size));
 
     /* Store file descriptor as socket data */
     data->fd = fd;
     data->written = 0;
+    data->out_buf_size = buffer_size;
+    data->out_buf = data->initial_buf;
     socket->data = data;
 
+#ifdef HAVE_LIBURING
+    /* The io_uring instance is set up only upon first flush, by the process
+     * that actually uses the socket */
+    data->ring_generation = 0;
+    data->pending_buf = NULL;
+    data->spare_buf = NULL;
+#endif
+
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
 
@@ -23,6 +23,7 @@
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/unicode.h"
+#include "protocol-format.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -31,11 +32,16 @@
 
 /**
  * The maximum number of bytes to buffer before sending a "nest" instruction.
- * As some of the 8 KB space available for each instruction will be taken up by
- * the "nest" opcode and other parameters, and 1 KB will be more than enough
- * space for that extra data, this space is reduced to an even 7 KB.
+ * Writes that would not fit within a buffer of this size are instead sent
+ * directly from the buffer provided by the caller.
  */
-#define GUAC_SOCKET_NEST_BUFFER_SIZE 7168
+#define GUAC_SOCKET_NEST_BUFFER_SIZE GUAC_SOCKET_NEST_CHUNK_SIZE
+
+/**
+ * The smallest chunk size accepted by guac_socket_nest_chunked(), being
+ * enough space for the largest possible UTF-8 character.
+ */
+#define GUAC_SOCKET_NEST_MIN_CHUNK_SIZE 4
 
 /**
  * Internal data associated with an open socket which writes via a series of
@@ -54,15 +60,26 @@ typedef struct guac_socket_nest_data {
      */
     int index;
 
+    /**
+     * The maximum number of bytes of nested data to send within each "nest"
+     * instruction.
+     */
+    size_t chunk_size;
+
+    /**
+     * The maximum number of bytes that may be stored within the main write
+     * buffer, which is the smaller of chunk_size and the size of that buffer.
+     */
+    size_t buffer_limit;
+
     /**
      * The number of bytes currently in the main write buffer.
      */
-    int written;
+    size_t written;
 
     /**
-     * The main write buffer. Bytes written go here before being flushed
-     * as nest instructions. Space is included for the null terminator
-     * required by guac_protocol_send_nest().
+     * The main write buffer. Small writes are combined here before being
+     * flushed as nest instructions.
      */
     char buffer[GUAC_SOCKET_NEST_BUFFER_SIZE];
 
@@ -80,10 +97,106 @@ typedef struct guac_socket_nest_data {
 
 } guac_socket_nest_data;
 
+/**
+ * Determines how many bytes at the beginning of the given buffer consist only
+ * of complete UTF-8 characters, considering no more than the given number of
+ * bytes.
+ *
+ * @param buf
+ *     The buffer to inspect.
+ *
+ * @param max
+ *     The maximum number of bytes of the buffer to consider.
+ *
+ * @param chars
+ *     A pointer to the number of characters counted thus far, which will be
+ *     incremented by the number of complete characters found.
+ *
+ * @return
+ *     The number of bytes at the beginning of the given buffer that consist
+ *     only of complete characters.
+ */
+static size_t guac_socket_nest_complete_length(const char* buf, size_t max,
+        size_t* chars) {
+
+    size_t length = 0;
+    while (length < max) {
+
+        size_t size = guac_utf8_charsize(buf[length]);
+        if (length + size > max)
+            break;
+
+        length += size;
+        (*chars)++;
+
+    }
+
+    return length;
+
+}
+
+/**
+ * Writes a single "nest" instruction containing the given data to the parent
+ * socket. The data is provided in two consecutive parts, such that buffered
+ * data can be sent together with data provided by the caller without first
+ * copying either. Together, the two parts must consist only of complete UTF-8
+ * characters.
+ *
+ * @param data
+ *     The internal data of the nested socket.
+ *
+ * @param head
+ *     The first part of the data to send.
+ *
+ * @param head_length
+ *     The number of bytes in the first part.
+ *
+ * @param tail
+ *     The second part of the data to send.
+ *
+ * @param tail_length
+ *     The number of bytes in the second part.
+ *
+ * @param chars
+ *     The total number of UTF-8 characters within both parts.
+ *
+ * @return
+ *     Zero if the instruction was written successfully, non-zero otherwise.
+ */
+static int guac_socket_nest_send(guac_socket_nest_data* data,
+        const char* head, size_t head_length,
+        const char* tail, size_t tail_length, size_t chars) {
+
+    guac_socket* parent = data->parent;
+
+    /* Format everything preceding the nested data with a single write */
+    char prefix[sizeof("4.nest,") + GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH
+        + GUAC_PROTOCOL_FORMAT_INT_MAX_DIGITS + 2];
+
+    int length = sizeof("4.nest,") - 1;
+    memcpy(prefix, "4.nest,", length);
+    length += guac_protocol_format_length_int(prefix + length, data->index);
+    prefix[length++] = ',';
+    length += guac_protocol_format_int(prefix + length, chars);
+    prefix[length++] = '.';
+
+    guac_socket_instruction_begin(parent);
+    int retval =
+           guac_socket_write(parent, prefix, length)
+        || guac_socket_write(parent, head, head_length)
+        || guac_socket_write(parent, tail, tail_length)
+        || guac_socket_write(parent, ";", 1);
+    guac_socket_instruction_end(parent);
+
+    return retval;
+
+}
+
 /**
  * Flushes the contents of the output buffer of the given socket immediately,
  * without first locking access to the output buffer. This function must ONLY
- * be called if the buffer lock has already been acquired.
+ * be called if the buffer lock has already been acquired. Any partial,
+ * multi-byte character at the end of the buffer remains buffered.
  *
  * @param socket
  *     The guac_socket to flush.
@@ -95,35 +208,21 @@ static ssize_t guac_socket_nest_flush(guac_socket* socket) {
 
     guac_socket_nest_data* data = (guac_socket_nest_data*) socket->data;
 
-    /* Flush remaining bytes in buffer */
-    if (data->written > 0) {
+    /* Determine length of buffer containing complete UTF-8 characters
+     * (buffer may end with a partial, multi-byte character) */
+    size_t chars = 0;
+    size_t length = guac_socket_nest_complete_length(data->buffer,
+            data->written, &chars);
 
-        /* Determine length of buffer containing complete UTF-8 characters
-         * (buffer may end with a partial, multi-byte character) */
-        int length = 0;
-        while (length < data->written)
-            length += guac_utf8_charsize(*(data->buffer + length));
+    if (length == 0)
+        return 0;
 
-        /* Add null terminator, preserving overwritten character for later
-         * restoration (guac_protocol_send_nest() requires null-terminated
-         * strings) */
-        char overwritten = data->buffer[length];
-        data->buffer[length] = '\0';
+    if (guac_socket_nest_send(data, data->buffer, length, NULL, 0, chars))
+        return 1;
 
-        /* Write ALL bytes in buffer as nest instruction */
-        int retval = guac_protocol_send_nest(data->parent, data->index, data->buffer);
-
-        /* Restore original value overwritten by null terminator */
-        data->buffer[length] = overwritten;
-
-        if (retval)
-            return 1;
-
-        /* Shift any remaining data to beginning of buffer */
-        memcpy(data->buffer, data->buffer + length, data->written - length);
-        data->written -= length;
-
-    }
+    /* Shift any remaining data to beginning of buffer */
+    memmove(data->buffer, data->buffer + length, data->written - length);
+    data->written -= length;
 
     return 0;
 
@@ -158,10 +257,12 @@ static ssize_t guac_socket_nest_flush_handler(guac_socket* socket) {
 }
 
 /**
- * Writes the contents of the buffer to the output buffer of the given socket,
- * flushing the output buffer as necessary, without first locking access to the
- * output buffer. This function must ONLY be called if the buffer lock has
- * already been acquired.
+ * Writes the contents of the buffer to the given socket without first locking
+ * access to the output buffer. This function must ONLY be called if the
+ * buffer lock has already been acquired. Data that fits within the output
+ * buffer is appended to that buffer. Any other data is sent immediately as
+ * "nest" instructions framed directly around the given buffer, preceded by
+ * the contents of the output buffer.
  *
  * @param socket
  *     The guac_socket to write the given buffer to.
@@ -183,51 +284,66 @@ static ssize_t guac_socket_nest_write_buffered(guac_socket* socket,
     const char* current = buf;
     guac_socket_nest_data* data = (guac_socket_nest_data*) socket->data;
 
-    /* Append to buffer, flush if necessary */
-    while (count > 0) {
-
-        int chunk_size;
-
-        /* Calculate space remaining, including one extra byte for the null
-         * terminator added upon flush */
-        int remaining = sizeof(data->buffer) - data->written - 1;
+    /* Send directly anything that would not fit in the buffer */
+    while (count > data->buffer_limit - data->written) {
+
+        /* Include any partial character at the end of the buffer, counting
+         * that character as complete once the bytes needed to complete it
+         * are sent from the provided buffer */
+        size_t chars = 0;
+        size_t length = guac_socket_nest_complete_length(data->buffer,
+                data->written, &chars);
+
+        size_t needed = 0;
+        if (length < data->written) {
+            needed = guac_utf8_charsize(data->buffer[length])
+                - (data->written - length);
+            chars++;
+        }
 
-        /* If no space left in buffer, flush and retry */
-        if (remaining == 0) {
+        /* If the partial character cannot be completed within the same
+         * chunk, send the rest of the buffer alone and retry */
+        if (needed > count || data->written + needed > data->chunk_size) {
 
-            /* Abort if error occurs during flush */
             if (guac_socket_nest_flush(socket))
                 return -1;
 
-            /* Retry buffer append */
             continue;
 
         }
 
-        /* Calculate size of chunk to be written to buffer */
-        chunk_size = count;
-        if (chunk_size > remaining)
-            chunk_size = remaining;
+        /* Send the buffer together with as much of the provided data as fits
+         * within the same chunk, ending on a character boundary */
+        size_t max = data->chunk_size - data->written - needed;
+        if (max > count - needed)
+            max = count - needed;
+
+        size_t tail = needed + guac_socket_nest_complete_length(
+                current + needed, max, &chars);
 
-        /* Update output buffer */
-        memcpy(data->buffer + data->written, current, chunk_size);
-        data->written += chunk_size;
+        if (guac_socket_nest_send(data, data->buffer, data->written,
+                    current, tail, chars))
+            return -1;
 
-        /* Update provided buffer */
-        current += chunk_size;
-        count   -= chunk_size;
+        data->written = 0;
+        current += tail;
+        count   -= tail;
 
     }
 
+    /* Buffer whatever remains, including any partial character */
+    memcpy(data->buffer + data->written, current, count);
+    data->written += count;
+
     /* All bytes have been written, possibly some to the internal buffer */
     return original_count;
 
 }
 
 /**
- * Appends the provided data to the internal buffer for future writing. The
- * actual write attempt will occur only upon flush, or when the internal buffer
- * is full.
+ * Appends the provided data to the internal buffer for future writing, or
+ * writes that data immediately if it is too large to be buffered. A buffered
+ * write occurs only upon flush, or when the internal buffer is full.
  *
  * @param socket
  *     The guac_socket being write to.
@@ -312,6 +428,19 @@ static void guac_socket_nest_unlock_handler(guac_socket* socket) {
 }
 
 guac_socket* guac_socket_nest(guac_socket* parent, int index) {
+    return guac_socket_nest_chunked(parent, index, 0);
+}
+
+guac_socket* guac_socket_nest_chunked(guac_socket* parent, int index,
+        int chunk_size) {
+
+    /* Use the default chunk size unless a valid chunk size is given */
+    if (chunk_size <= 0)
+        chunk_size = GUAC_SOCKET_NEST_CHUNK_SIZE;
+    else if (chunk_size > GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE)
+        chunk_size = GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE;
+    else if (chunk_size < GUAC_SOCKET_NEST_MIN_CHUNK_SIZE)
+        chunk_size = GUAC_SOCKET_NEST_MIN_CHUNK_SIZE;
 
     /* Allocate socket and associated data */
     guac_socket* socket = guac_socket_alloc();
@@ -320,6 +449,10 @@ guac_socket* guac_socket_nest(guac_socket* parent, int index) {
     /* Store nested socket details as socket data */
     data->parent = parent;
     data->index = index;
+    data->chunk_size = chunk_size;
+    data->buffer_limit = chunk_size;
+    if (data->buffer_limit > sizeof(data->buffer))
+        data->buffer_limit = sizeof(data->buffer);
     socket->data = data;
 
     /* Set relevant handlers */
@@ -0,0 +1,912 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+#include "socket-queue.h"
+#include "socket-stats.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The initial number of chunks which may be stored within the queue of a
+ * queued socket before that queue must be grown.
+ */
+#define GUAC_SOCKET_QUEUE_INITIAL_ENTRIES 64
+
+/**
+ * The number of bytes of each priority that the writer thread of a queued
+ * socket may write within a single round, indexed by guac_socket_priority.
+ * Once every priority having queued data has used its budget, a new round
+ * begins. Higher-priority data is always written first, while these budgets
+ * ensure that lower-priority data continues to make some progress even if
+ * higher-priority data is queued continuously.
+ */
+static const size_t guac_socket_queue_budgets[GUAC_SOCKET_PRIORITIES] = {
+    GUAC_SOCKET_QUEUE_INTERACTIVE_BUDGET,
+    GUAC_SOCKET_QUEUE_AUDIO_BUDGET,
+    GUAC_SOCKET_QUEUE_BULK_BUDGET
+};
+
+/**
+ * A circular array of chunks of the same priority awaiting delivery, in
+ * order.
+ */
+typedef struct guac_socket_queue_fifo {
+
+    /**
+     * Circular array of all chunks of this priority awaiting delivery, in
+     * order.
+     */
+    guac_socket_queue_chunk** entries;
+
+    /**
+     * The number of chunks that may be stored within the entries array.
+     */
+    int capacity;
+
+    /**
+     * The index of the oldest chunk within the entries array.
+     */
+    int head;
+
+    /**
+     * The number of chunks currently stored within the entries array.
+     */
+    int count;
+
+    /**
+     * The number of bytes of this priority written by the writer thread
+     * during the current round.
+     */
+    size_t sent;
+
+} guac_socket_queue_fifo;
+
+/**
+ * Data specific to the queued implementation of guac_socket.
+ */
+typedef struct guac_socket_queue_data {
+
+    /**
+     * The guac_socket to which all queued data is written by the writer
+     * thread, and to which all read operations are delegated.
+     */
+    guac_socket* socket;
+
+    /**
+     * The maximum number of bytes that may be queued at any one time. Writes
+     * which would exceed this limit either wait for queued data to be written
+     * or fail the queued socket, depending on how the data was written.
+     */
+    size_t max_backlog;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which guards access to all members of this structure that are
+     * related to the queue itself, including the condition used to signal the
+     * writer thread.
+     */
+    pthread_mutex_t queue_lock;
+
+    /**
+     * Condition which is signalled whenever the writer thread should check
+     * whether there is work to be done.
+     */
+    pthread_cond_t queue_changed;
+
+    /**
+     * Condition which is signalled by the writer thread whenever queued data
+     * has been written, or the queued socket has failed.
+     */
+    pthread_cond_t queue_drained;
+
+    /**
+     * All chunks awaiting delivery, separated by priority and indexed by
+     * guac_socket_priority.
+     */
+    guac_socket_queue_fifo fifos[GUAC_SOCKET_PRIORITIES];
+
+    /**
+     * The total number of chunks currently awaiting delivery, across all
+     * priorities.
+     */
+    int count;
+
+    /**
+     * The total number of bytes within all chunks that have been queued but
+     * not yet written to the underlying socket, including any chunk currently
+     * being written by the writer thread.
+     */
+    size_t backlog;
+
+    /**
+     * Whether the queued socket has been flushed since the writer thread last
+     * began writing queued data.
+     */
+    int flush_requested;
+
+    /**
+     * Whether the writer thread should exit once all queued data has been
+     * written.
+     */
+    int stopping;
+
+    /**
+     * Whether the queued socket has failed, either due to the backlog limit
+     * being exceeded or due to an error writing to the underlying socket.
+     * Once failed, all queued data is discarded and all further writes fail.
+     */
+    int failed;
+
+    /**
+     * The error which caused the queued socket to fail, if any.
+     */
+    guac_status error;
+
+    /**
+     * A human-readable description of the error which caused the queued
+     * socket to fail, if any.
+     */
+    const char* error_message;
+
+    /**
+     * The thread which writes all queued data to the underlying socket.
+     */
+    pthread_t writer_thread;
+
+} guac_socket_queue_data;
+
+guac_socket_queue_chunk* guac_socket_queue_chunk_alloc(const void* buf,
+        size_t length) {
+
+    guac_socket_queue_chunk* chunk = guac_mem_alloc(guac_mem_ckd_add_or_die(
+                sizeof(guac_socket_queue_chunk), length));
+
+    if (chunk == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for shared chunk";
+        return NULL;
+    }
+
+    atomic_init(&chunk->refcount, 1);
+    chunk->shared = 1;
+    chunk->length = length;
+    chunk->capacity = length;
+    memcpy(chunk->data, buf, length);
+
+    return chunk;
+
+}
+
+void guac_socket_queue_chunk_release(guac_socket_queue_chunk* chunk) {
+
+    if (atomic_fetch_sub(&chunk->refcount, 1) == 1)
+        guac_mem_free(chunk);
+
+}
+
+/**
+ * Appends the given chunk to the end of the given FIFO, growing the FIFO as
+ * necessary.
+ *
+ * @param fifo
+ *     The FIFO to append the chunk to.
+ *
+ * @param chunk
+ *     The chunk to append.
+ */
+static void guac_socket_queue_fifo_push(guac_socket_queue_fifo* fifo,
+        guac_socket_queue_chunk* chunk) {
+
+    /* Double the size of the FIFO if full, unwrapping any entries that wrap
+     * around the end of the array */
+    if (fifo->count == fifo->capacity) {
+
+        fifo->entries = guac_mem_realloc_or_die(fifo->entries,
+                fifo->capacity, 2, sizeof(guac_socket_queue_chunk*));
+
+        for (int i = 0; i < fifo->head; i++)
+            fifo->entries[fifo->capacity + i] = fifo->entries[i];
+
+        fifo->capacity *= 2;
+
+    }
+
+    fifo->entries[(fifo->head + fifo->count) % fifo->capacity] = chunk;
+    fifo->count++;
+
+}
+
+/**
+ * Removes and returns the oldest chunk within the given FIFO, which MUST NOT
+ * be empty.
+ *
+ * @param fifo
+ *     The FIFO to remove the chunk from.
+ *
+ * @return
+ *     The oldest chunk within the given FIFO.
+ */
+static guac_socket_queue_chunk* guac_socket_queue_fifo_pop(
+        guac_socket_queue_fifo* fifo) {
+
+    guac_socket_queue_chunk* chunk = fifo->entries[fifo->head];
+    fifo->head = (fifo->head + 1) % fifo->capacity;
+    fifo->count--;
+
+    return chunk;
+
+}
+
+/**
+ * Returns the most recently queued chunk within the given FIFO, or NULL if
+ * the FIFO is empty.
+ *
+ * @param fifo
+ *     The FIFO to inspect.
+ *
+ * @return
+ *     The most recently queued chunk within the given FIFO, or NULL if the
+ *     FIFO is empty.
+ */
+static guac_socket_queue_chunk* guac_socket_queue_fifo_tail(
+        guac_socket_queue_fifo* fifo) {
+
+    if (fifo->count == 0)
+        return NULL;
+
+    return fifo->entries[(fifo->head + fifo->count - 1) % fifo->capacity];
+
+}
+
+/**
+ * Marks the given queued socket as failed due to the given error, discarding
+ * all queued data and waking the writer thread such that it may exit. The
+ * queue lock of the socket MUST already be acquired.
+ *
+ * @param data
+ *     The data associated with the queued socket that has failed.
+ *
+ * @param error
+ *     The error which caused the socket to fail.
+ *
+ * @param error_message
+ *     A human-readable description of the error which caused the socket to
+ *     fail.
+ */
+static void guac_socket_queue_fail(guac_socket_queue_data* data,
+        guac_status error, const char* error_message) {
+
+    if (!data->failed) {
+        data->failed = 1;
+        data->error = error;
+        data->error_message = error_message;
+    }
+
+    /* Discard all queued data */
+    for (int priority = 0; priority < GUAC_SOCKET_PRIORITIES; priority++) {
+        guac_socket_queue_fifo* fifo = &data->fifos[priority];
+        while (fifo->count > 0) {
+            guac_socket_queue_chunk* chunk = guac_socket_queue_fifo_pop(fifo);
+            data->count--;
+            data->backlog -= chunk->length;
+            guac_socket_queue_chunk_release(chunk);
+        }
+    }
+
+    pthread_cond_signal(&data->queue_changed);
+    pthread_cond_broadcast(&data->queue_drained);
+
+}
+
+/**
+ * Appends the given chunk to the end of the queue of the given queued
+ * socket having the given priority. The queue lock of the socket MUST
+ * already be acquired, and the caller's reference to the chunk is transferred
+ * to the queue.
+ *
+ * @param data
+ *     The data associated with the queued socket being written to.
+ *
+ * @param priority
+ *     The priority of the chunk.
+ *
+ * @param chunk
+ *     The chunk to append.
+ */
+static void guac_socket_queue_push(guac_socket_queue_data* data,
+        guac_socket_priority priority, guac_socket_queue_chunk* chunk) {
+    guac_socket_queue_fifo_push(&data->fifos[priority], chunk);
+    data->count++;
+}
+
+/**
+ * Removes and returns the next chunk that the writer thread of the given
+ * queued socket should write. Chunks are taken from the highest priority
+ * having queued data whose budget for the current round has not been used,
+ * beginning a new round if every priority having queued data has used its
+ * budget. The queue lock of the socket MUST already be acquired, and the
+ * queue MUST NOT be empty.
+ *
+ * @param data
+ *     The data associated with the queued socket being written.
+ *
+ * @param priority
+ *     Storage for the priority of the returned chunk.
+ *
+ * @return
+ *     The next chunk to write.
+ */
+static guac_socket_queue_chunk* guac_socket_queue_pop(
+        guac_socket_queue_data* data, guac_socket_priority* priority) {
+
+    int next = -1;
+
+    for (int i = 0; i < GUAC_SOCKET_PRIORITIES; i++) {
+        guac_socket_queue_fifo* fifo = &data->fifos[i];
+        if (fifo->count > 0 && fifo->sent < guac_socket_queue_budgets[i]) {
+            next = i;
+            break;
+        }
+    }
+
+    /* Begin a new round if all budgets have been used */
+    if (next == -1) {
+        for (int i = 0; i < GUAC_SOCKET_PRIORITIES; i++) {
+            data->fifos[i].sent = 0;
+            if (next == -1 && data->fifos[i].count > 0)
+                next = i;
+        }
+    }
+
+    guac_socket_queue_fifo* fifo = &data->fifos[next];
+    guac_socket_queue_chunk* chunk = guac_socket_queue_fifo_pop(fifo);
+    fifo->sent += chunk->length;
+    data->count--;
+
+    *priority = next;
+    return chunk;
+
+}
+
+/**
+ * Thread which writes all data queued within a queued socket to the
+ * underlying socket, in order. The writer waits until the queued socket is
+ * flushed or enough data has been queued, writes everything queued, and then
+ * flushes the underlying socket.
+ *
+ * @param arg
+ *     The queued socket whose data should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_queue_writer_thread(void* arg) {
+
+    guac_socket* socket = (guac_socket*) arg;
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    pthread_mutex_lock(&data->queue_lock);
+
+    for (;;) {
+
+        /* Wait until there is a reason to send data */
+        while (!data->failed && !data->stopping && (data->count == 0
+                    || (!data->flush_requested
+                        && data->backlog < GUAC_SOCKET_QUEUE_WAKE_THRESHOLD)))
+            pthread_cond_wait(&data->queue_changed, &data->queue_lock);
+
+        /* Stop once failed or when stopping with nothing left to send */
+        if (data->failed || data->count == 0)
+            break;
+
+        data->flush_requested = 0;
+
+        /* Send everything queued, including anything queued while sending */
+        while (!data->failed && data->count > 0) {
+
+            guac_socket_priority priority;
+            guac_socket_queue_chunk* chunk = guac_socket_queue_pop(data,
+                    &priority);
+
+            /* Flush interactive data as soon as it has all been written,
+             * rather than leaving it buffered behind data of lower
+             * priority */
+            int flush = priority == GUAC_SOCKET_PRIORITY_INTERACTIVE
+                && data->fifos[priority].count == 0 && data->count > 0;
+
+            pthread_mutex_unlock(&data->queue_lock);
+            int result = guac_socket_write(data->socket, chunk->data,
+                    chunk->length);
+            if (!result && flush)
+                result = guac_socket_flush(data->socket);
+            pthread_mutex_lock(&data->queue_lock);
+
+            data->backlog -= chunk->length;
+            guac_socket_queue_chunk_release(chunk);
+            pthread_cond_broadcast(&data->queue_drained);
+
+            if (result)
+                guac_socket_queue_fail(data, guac_error, guac_error_message);
+
+        }
+
+        if (data->failed)
+            break;
+
+        /* Flush once caught up */
+        pthread_mutex_unlock(&data->queue_lock);
+        int result = guac_socket_flush(data->socket);
+        pthread_mutex_lock(&data->queue_lock);
+
+        if (result)
+            guac_socket_queue_fail(data, guac_error, guac_error_message);
+
+    }
+
+    pthread_mutex_unlock(&data->queue_lock);
+    return NULL;
+
+}
+
+/**
+ * Callback function which reads from the underlying socket.
+ *
+ * @param socket
+ *     The queued socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the given buffer.
+ *
+ * @return
+ *     The value returned by guac_socket_read() when invoked on the underlying
+ *     socket with the given parameters.
+ */
+static ssize_t guac_socket_queue_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate read to wrapped socket */
+    return guac_socket_read(data->socket, buf, count);
+
+}
+
+/**
+ * Queues the given data for delivery by the writer thread of the given queued
+ * socket. If a shared chunk is provided, a reference to that chunk is queued.
+ * Otherwise, a copy of the data is queued, coalescing that copy with the most
+ * recently queued chunk if possible. If the backlog limit of the socket would
+ * be exceeded, this function either waits for enough queued data to be
+ * written or fails the socket, depending on the value of the block parameter.
+ *
+ * If an error occurs, a non-zero value is returned, and guac_error is set
+ * appropriately.
+ *
+ * @param socket
+ *     The queued socket to write to.
+ *
+ * @param buf
+ *     The buffer of data to write. This is ignored if a shared chunk is
+ *     provided.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written. This is ignored if a
+ *     shared chunk is provided.
+ *
+ * @param shared
+ *     The shared chunk to queue, or NULL if a copy of the given buffer should
+ *     be queued instead.
+ *
+ * @param block
+ *     Non-zero if this function should wait for room within the queue when
+ *     the backlog limit would otherwise be exceeded, or zero if the socket
+ *     should instead fail immediately.
+ *
+ * @return
+ *     Zero if the data was successfully queued, non-zero otherwise.
+ */
+static int guac_socket_queue_append(guac_socket* socket, const void* buf,
+        size_t count, guac_socket_queue_chunk* shared, int block) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+    guac_socket_priority priority = socket->__priority;
+
+    if (shared != NULL) {
+        buf = shared->data;
+        count = shared->length;
+    }
+
+    pthread_mutex_lock(&data->queue_lock);
+
+    /* Allow the writer to catch up, if permitted, ensuring that it is
+     * actually writing. Writes larger than the entire backlog limit are
+     * allowed only once the queue is otherwise empty. */
+    while (block && !data->failed && data->backlog > 0
+            && count > data->max_backlog - data->backlog) {
+        data->flush_requested = 1;
+        pthread_cond_signal(&data->queue_changed);
+        pthread_cond_wait(&data->queue_drained, &data->queue_lock);
+    }
+
+    /* Drop the receiving end entirely if it has fallen too far behind */
+    if (!data->failed && data->backlog > 0
+            && count > data->max_backlog - data->backlog)
+        guac_socket_queue_fail(data, GUAC_STATUS_NO_SPACE,
+                "Too much data is queued for delivery to socket");
+
+    if (data->failed) {
+        guac_error = data->error;
+        guac_error_message = data->error_message;
+        pthread_mutex_unlock(&data->queue_lock);
+        return 1;
+    }
+
+    /* Shared chunks are queued by reference */
+    if (shared != NULL) {
+        atomic_fetch_add(&shared->refcount, 1);
+        guac_socket_queue_push(data, priority, shared);
+    }
+
+    else {
+
+        /* Append to the most recently queued chunk if it has room (chunks
+         * that are no longer queued may be in use by the writer thread, and
+         * shared chunks may be in use by other queues, so neither may be
+         * touched) */
+        guac_socket_queue_chunk* tail =
+            guac_socket_queue_fifo_tail(&data->fifos[priority]);
+
+        if (tail != NULL && !tail->shared
+                && tail->capacity - tail->length >= count) {
+            memcpy(tail->data + tail->length, buf, count);
+            tail->length += count;
+        }
+
+        /* Otherwise, copy into a new chunk, leaving room for further
+         * writes */
+        else {
+
+            size_t capacity = count;
+            if (capacity < GUAC_SOCKET_QUEUE_CHUNK_SIZE)
+                capacity = GUAC_SOCKET_QUEUE_CHUNK_SIZE;
+
+            guac_socket_queue_chunk* chunk = guac_mem_alloc(
+                    guac_mem_ckd_add_or_die(sizeof(guac_socket_queue_chunk),
+                        capacity));
+
+            if (chunk == NULL) {
+                guac_socket_queue_fail(data, GUAC_STATUS_NO_MEMORY,
+                        "Could not allocate memory for queued data");
+                guac_error = data->error;
+                guac_error_message = data->error_message;
+                pthread_mutex_unlock(&data->queue_lock);
+                return 1;
+            }
+
+            atomic_init(&chunk->refcount, 1);
+            chunk->shared = 0;
+            chunk->length = count;
+            chunk->capacity = capacity;
+            memcpy(chunk->data, buf, count);
+
+            guac_socket_queue_push(data, priority, chunk);
+
+        }
+
+    }
+
+    /* Start writing early if enough data is queued */
+    data->backlog += count;
+    if (data->backlog >= GUAC_SOCKET_QUEUE_WAKE_THRESHOLD)
+        pthread_cond_signal(&data->queue_changed);
+
+    pthread_mutex_unlock(&data->queue_lock);
+    return 0;
+
+}
+
+/**
+ * Callback function which queues a copy of the given data for delivery by the
+ * writer thread. If the backlog limit of the socket would be exceeded, this
+ * function waits for enough queued data to be written, just as a write to the
+ * underlying socket would block.
+ *
+ * @param socket
+ *     The queued socket to write to.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_queue_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    if (guac_socket_queue_append(socket, buf, count, NULL, 1))
+        return -1;
+
+    return count;
+
+}
+
+void guac_socket_queue_promote(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+    guac_socket_queue_fifo* interactive =
+        &data->fifos[GUAC_SOCKET_PRIORITY_INTERACTIVE];
+
+    pthread_mutex_lock(&data->queue_lock);
+
+    /* Move all lower-priority data behind any queued interactive data, in
+     * order of priority */
+    for (int i = GUAC_SOCKET_PRIORITY_INTERACTIVE + 1;
+            i < GUAC_SOCKET_PRIORITIES; i++) {
+        guac_socket_queue_fifo* fifo = &data->fifos[i];
+        while (fifo->count > 0)
+            guac_socket_queue_fifo_push(interactive,
+                    guac_socket_queue_fifo_pop(fifo));
+    }
+
+    pthread_mutex_unlock(&data->queue_lock);
+
+}
+
+int guac_socket_is_queued(guac_socket* socket) {
+    return socket->write_handler == guac_socket_queue_write_handler;
+}
+
+int guac_socket_queue_write_nonblocking(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    /* Update timestamp of last write, as guac_socket_write() would */
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    if (guac_socket_queue_append(socket, buf, count, NULL, 0))
+        return 1;
+
+    guac_socket_stats_record_write(socket, count, 0);
+    return 0;
+
+}
+
+int guac_socket_queue_write_chunk(guac_socket* socket,
+        guac_socket_queue_chunk* chunk) {
+
+    /* Update timestamp of last write, as guac_socket_write() would */
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    if (guac_socket_queue_append(socket, NULL, 0, chunk, 0))
+        return 1;
+
+    guac_socket_stats_record_write(socket, chunk->length, 0);
+    return 0;
+
+}
+
+/**
+ * Callback function which signals the writer thread to send all queued data
+ * and flush the underlying socket. This function does not wait for that data
+ * to actually be sent.
+ *
+ * @param socket
+ *     The queued socket to flush.
+ *
+ * @return
+ *     Zero if the flush was successfully requested, or non-zero if the queued
+ *     socket has failed.
+ */
+static ssize_t guac_socket_queue_flush_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    pthread_mutex_lock(&data->queue_lock);
+
+    if (data->failed) {
+        guac_error = data->error;
+        guac_error_message = data->error_message;
+        pthread_mutex_unlock(&data->queue_lock);
+        return 1;
+    }
+
+    data->flush_requested = 1;
+    pthread_cond_signal(&data->queue_changed);
+
+    pthread_mutex_unlock(&data->queue_lock);
+    return 0;
+
+}
+
+/**
+ * Callback function which acquires exclusive access to the queued socket,
+ * such that the data of instructions written in parallel is never
+ * interleaved within the queue.
+ *
+ * @param socket
+ *     The queued socket on which guac_socket_instruction_begin() was invoked.
+ */
+static void guac_socket_queue_lock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which relinquishes exclusive access to the queued socket.
+ *
+ * @param socket
+ *     The queued socket on which guac_socket_instruction_end() was invoked.
+ */
+static void guac_socket_queue_unlock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which delegates the select operation to the underlying
+ * socket.
+ *
+ * @param socket
+ *     The queued socket on which guac_socket_select() was invoked.
+ *
+ * @param usec_timeout
+ *     The timeout to specify when invoking guac_socket_select() on the
+ *     underlying socket.
+ *
+ * @return
+ *     The value returned by guac_socket_select() when invoked with the
+ *     given parameters on the underlying socket.
+ */
+static int guac_socket_queue_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate select to wrapped socket */
+    return guac_socket_select(data->socket, usec_timeout);
+
+}
+
+/**
+ * Callback function which waits for all queued data to be written, stops the
+ * writer thread, and frees all underlying data associated with the given
+ * queued socket, including the underlying socket.
+ *
+ * @param socket
+ *     The queued socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_socket_queue_free_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Send anything remaining and stop the writer thread */
+    pthread_mutex_lock(&data->queue_lock);
+    data->stopping = 1;
+    pthread_cond_signal(&data->queue_changed);
+    pthread_mutex_unlock(&data->queue_lock);
+
+    pthread_join(data->writer_thread, NULL);
+
+    /* Discard anything that could not be sent */
+    guac_socket_queue_fail(data, GUAC_STATUS_CLOSED, "Socket is closed");
+
+    /* Free underlying socket */
+    guac_socket_free(data->socket);
+
+    pthread_cond_destroy(&data->queue_changed);
+    pthread_cond_destroy(&data->queue_drained);
+    pthread_mutex_destroy(&data->queue_lock);
+    pthread_mutex_destroy(&data->socket_lock);
+
+    for (int priority = 0; priority < GUAC_SOCKET_PRIORITIES; priority++)
+        guac_mem_free(data->fifos[priority].entries);
+
+    guac_mem_free(data);
+    return 0;
+
+}
+
+guac_socket* guac_socket_queue(guac_socket* socket, size_t max_backlog) {
+
+    guac_socket_queue_data* data = guac_mem_zalloc(sizeof(guac_socket_queue_data));
+    data->socket = socket;
+    data->max_backlog = max_backlog;
+
+    for (int priority = 0; priority < GUAC_SOCKET_PRIORITIES; priority++) {
+        guac_socket_queue_fifo* fifo = &data->fifos[priority];
+        fifo->capacity = GUAC_SOCKET_QUEUE_INITIAL_ENTRIES;
+        fifo->entries = guac_mem_alloc(sizeof(guac_socket_queue_chunk*),
+                fifo->capacity);
+    }
+
+    pthread_mutex_init(&(data->socket_lock), NULL);
+    pthread_mutex_init(&(data->queue_lock), NULL);
+    pthread_cond_init(&(data->queue_changed), NULL);
+    pthread_cond_init(&(data->queue_drained), NULL);
+
+    /* Associate queue-specific data with new socket */
+    guac_socket* queued = guac_socket_alloc();
+    queued->data = data;
+
+    /* Start writing queued data in the background */
+    if (pthread_create(&(data->writer_thread), NULL,
+                guac_socket_queue_writer_thread, queued)) {
+
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Could not start writer thread for queued socket";
+
+        pthread_cond_destroy(&(data->queue_changed));
+        pthread_cond_destroy(&(data->queue_drained));
+        pthread_mutex_destroy(&(data->queue_lock));
+        pthread_mutex_destroy(&(data->socket_lock));
+
+        for (int priority = 0; priority < GUAC_SOCKET_PRIORITIES; priority++)
+            guac_mem_free(data->fifos[priority].entries);
+
+        guac_mem_free(data);
+
+        queued->data = NULL;
+        guac_socket_free(queued);
+        return NULL;
+
+    }
+
+    /* Assign handlers */
+    queued->read_handler   = guac_socket_queue_read_handler;
+    queued->write_handler  = guac_socket_queue_write_handler;
+    queued->select_handler = guac_socket_queue_select_handler;
+    queued->flush_handler  = guac_socket_queue_flush_handler;
+    queued->lock_handler   = guac_socket_queue_lock_handler;
+    queued->unlock_handler = guac_socket_queue_unlock_handler;
+    queued->free_handler   = guac_socket_queue_free_handler;
+
+    return queued;
+
+}
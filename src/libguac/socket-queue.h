@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_QUEUE_H
+#define GUAC_SOCKET_QUEUE_H
+
+#include "config.h"
+#include "guacamole/socket.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * The minimum capacity of each chunk allocated to hold a copy of data written
+ * to a queued socket, in bytes. Smaller writes are coalesced within the most
+ * recently queued chunk until that chunk is full.
+ */
+#define GUAC_SOCKET_QUEUE_CHUNK_SIZE 8192
+
+/**
+ * The number of queued bytes beyond which the writer thread of a queued
+ * socket begins writing that data, even if the queued socket has not yet been
+ * flushed.
+ */
+#define GUAC_SOCKET_QUEUE_WAKE_THRESHOLD 65536
+
+/**
+ * The minimum number of bytes within a single write to a broadcast socket for
+ * that data to be copied once and shared by reference between the queues of
+ * all receiving users, rather than copied separately into each queue.
+ */
+#define GUAC_SOCKET_QUEUE_SHARED_THRESHOLD 4096
+
+/**
+ * The number of bytes of GUAC_SOCKET_PRIORITY_INTERACTIVE data that the
+ * writer thread of a queued socket may write before allowing data of lower
+ * priority to be written, if data of lower priority is waiting.
+ */
+#define GUAC_SOCKET_QUEUE_INTERACTIVE_BUDGET 262144
+
+/**
+ * The number of bytes of GUAC_SOCKET_PRIORITY_AUDIO data that the writer
+ * thread of a queued socket may write before allowing data of other
+ * priorities to be written, if data of other priorities is waiting.
+ */
+#define GUAC_SOCKET_QUEUE_AUDIO_BUDGET 65536
+
+/**
+ * The number of bytes of GUAC_SOCKET_PRIORITY_BULK data that the writer
+ * thread of a queued socket may write before allowing data of other
+ * priorities to be written, if data of other priorities is waiting.
+ */
+#define GUAC_SOCKET_QUEUE_BULK_BUDGET 16384
+
+/**
+ * A reference-counted chunk of data awaiting delivery by the writer thread of
+ * one or more queued sockets.
+ */
+typedef struct guac_socket_queue_chunk {
+
+    /**
+     * The number of references to this chunk. The chunk is freed when the
+     * last reference is released with guac_socket_queue_chunk_release().
+     */
+    atomic_int refcount;
+
+    /**
+     * Whether this chunk may be referenced by more than one queue. Shared
+     * chunks are never modified after being allocated.
+     */
+    int shared;
+
+    /**
+     * The number of bytes of data currently stored within this chunk.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes that may be stored within this chunk.
+     */
+    size_t capacity;
+
+    /**
+     * The data stored within this chunk.
+     */
+    char data[];
+
+} guac_socket_queue_chunk;
+
+/**
+ * Allocates a new shared chunk containing a copy of the given data, with a
+ * single reference held by the caller. Shared chunks may be queued for
+ * delivery by any number of queued sockets with guac_socket_queue_write_chunk()
+ * without being copied again.
+ *
+ * If the chunk cannot be allocated, NULL is returned, and guac_error is set
+ * appropriately.
+ *
+ * @param buf
+ *     The data to copy into the new chunk.
+ *
+ * @param length
+ *     The number of bytes of data to copy.
+ *
+ * @return
+ *     A newly allocated chunk containing a copy of the given data, or NULL if
+ *     the chunk could not be allocated.
+ */
+guac_socket_queue_chunk* guac_socket_queue_chunk_alloc(const void* buf,
+        size_t length);
+
+/**
+ * Releases a single reference to the given chunk, freeing the chunk if no
+ * references remain.
+ *
+ * @param chunk
+ *     The chunk to release.
+ */
+void guac_socket_queue_chunk_release(guac_socket_queue_chunk* chunk);
+
+/**
+ * Returns whether the given guac_socket was created with guac_socket_queue()
+ * and thus accepts chunks via guac_socket_queue_write_chunk().
+ *
+ * @param socket
+ *     The guac_socket to test.
+ *
+ * @return
+ *     Non-zero if the given guac_socket is a queued socket, zero otherwise.
+ */
+int guac_socket_is_queued(guac_socket* socket);
+
+/**
+ * Moves all data currently queued for delivery by the given queued socket at
+ * less than GUAC_SOCKET_PRIORITY_INTERACTIVE priority behind any queued
+ * interactive data, such that all data already queued is delivered before
+ * any data subsequently written, regardless of priority. This must be
+ * invoked whenever a stream carrying lower-priority data is freed, as data
+ * sent along a new stream that reuses the same index would otherwise be
+ * delivered before the end of the old stream.
+ *
+ * @param socket
+ *     The queued socket whose queued data should be promoted. This socket
+ *     MUST have been created with guac_socket_queue().
+ */
+void guac_socket_queue_promote(guac_socket* socket);
+
+/**
+ * Queues a copy of the given data for delivery by the given queued socket,
+ * exactly as guac_socket_write() would, except that this function never waits
+ * for room within the queue. If the backlog limit of the socket would be
+ * exceeded, the socket instead fails, discarding all queued data, and all
+ * further writes to that socket will also fail. This allows a receiver that
+ * has fallen too far behind to be dropped without delaying other writers.
+ *
+ * If an error occurs, including the socket's backlog limit being exceeded, a
+ * non-zero value is returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The queued socket to write to. This socket MUST have been created with
+ *     guac_socket_queue().
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+int guac_socket_queue_write_nonblocking(guac_socket* socket,
+        const void* buf, size_t count);
+
+/**
+ * Queues the given shared chunk for delivery by the given queued socket,
+ * exactly as guac_socket_queue_write_nonblocking() would queue a copy of the
+ * contents of that chunk, but without copying that data. The queued socket
+ * acquires its own reference to the chunk, and the caller's reference is
+ * unaffected.
+ *
+ * If an error occurs, including the socket's backlog limit being exceeded, a
+ * non-zero value is returned, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The queued socket to write to. This socket MUST have been created with
+ *     guac_socket_queue().
+ *
+ * @param chunk
+ *     The shared chunk to queue, as returned by
+ *     guac_socket_queue_chunk_alloc().
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+int guac_socket_queue_write_chunk(guac_socket* socket,
+        guac_socket_queue_chunk* chunk);
+
+#endif
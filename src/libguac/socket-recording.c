@@ -0,0 +1,1636 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/client.h"
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket.h"
+#include "guacamole/string.h"
+#include "guacamole/timestamp.h"
+#include "socket-recording.h"
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * The number of nanoseconds in a single second.
+ */
+#define NANOS_PER_SECOND 1000000000L
+
+/**
+ * Data specific to the recording implementation of guac_socket.
+ */
+typedef struct guac_socket_recording_data {
+
+    /**
+     * The guac_client being recorded.
+     */
+    guac_client* client;
+
+    /**
+     * The file descriptor of the recording file.
+     */
+    int fd;
+
+    /**
+     * The behavior of this socket when its buffer is full.
+     */
+    guac_recording_overflow overflow;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which guards access to all members of this structure that are
+     * related to the buffer, including the conditions used to signal changes
+     * to the buffer.
+     */
+    pthread_mutex_t buffer_lock;
+
+    /**
+     * Condition which is signalled whenever the writer thread should check
+     * whether there is work to be done.
+     */
+    pthread_cond_t buffer_changed;
+
+    /**
+     * Condition which is signalled by the writer thread whenever buffered
+     * data has been written, making room for further data.
+     */
+    pthread_cond_t buffer_drained;
+
+    /**
+     * Ring buffer containing all data awaiting delivery to the recording
+     * file.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes that may be stored within the ring buffer.
+     */
+    size_t size;
+
+    /**
+     * The offset of the oldest committed byte within the ring buffer.
+     */
+    size_t head;
+
+    /**
+     * The number of bytes, beginning at head, that belong to complete frames
+     * and will be written to the recording file, including any bytes
+     * currently being written by the writer thread.
+     */
+    size_t committed;
+
+    /**
+     * The number of bytes, immediately following the committed bytes, that
+     * belong to the frame currently being written. These bytes may still be
+     * discarded if the buffer overflows.
+     */
+    size_t pending;
+
+    /**
+     * The number of pending bytes which make up complete instructions. Any
+     * pending bytes beyond this point belong to an instruction that is still
+     * being written.
+     */
+    size_t boundary;
+
+    /**
+     * The total number of bytes committed since this socket was created,
+     * which is the offset within the recording file of the first byte that
+     * has not yet been committed.
+     */
+    uint64_t position;
+
+    /**
+     * Whether an instruction is currently being written, as signalled with
+     * guac_socket_instruction_begin().
+     */
+    int in_instruction;
+
+    /**
+     * Whether data is currently being discarded due to the buffer having
+     * overflowed while the current frame was being written.
+     */
+    int dropping;
+
+    /**
+     * Whether data should stop being discarded as soon as the instruction
+     * currently being written is complete, the socket having been flushed
+     * while that instruction was being written.
+     */
+    int resume_requested;
+
+    /**
+     * Whether the writer thread should immediately write all committed data,
+     * regardless of how much is committed.
+     */
+    int flush_requested;
+
+    /**
+     * Whether the writer thread should exit once all committed data has been
+     * written.
+     */
+    int stopping;
+
+    /**
+     * Whether writing to the recording file has failed. Once failed, all
+     * data is discarded.
+     */
+    int failed;
+
+    /**
+     * The total number of frames that have been discarded due to the buffer
+     * overflowing.
+     */
+    int frames_dropped;
+
+    /**
+     * The time that a warning regarding overflow of the buffer was last
+     * logged, or zero if no such warning has yet been logged.
+     */
+    guac_timestamp last_warning;
+
+    /**
+     * The guac_socket to which keyframes should be written, or NULL if this
+     * recording has no keyframe index.
+     */
+    guac_socket* index;
+
+    /**
+     * The minimum amount of time between keyframes, in milliseconds.
+     */
+    int index_interval;
+
+    /**
+     * The timestamp of the frame represented by the most recent keyframe, or
+     * zero if no keyframe has yet been written.
+     */
+    guac_timestamp last_keyframe;
+
+    /**
+     * The thread which writes all committed data to the recording file.
+     */
+    pthread_t writer_thread;
+
+    /**
+     * The full path to the first segment of the recording, or NULL if the
+     * recording is not divided into segments.
+     */
+    char* path;
+
+    /**
+     * The maximum amount of time covered by each segment, in milliseconds,
+     * or zero if segments are not limited by duration.
+     */
+    int segment_duration;
+
+    /**
+     * The maximum number of bytes of each segment, or zero if segments are
+     * not limited by size.
+     */
+    uint64_t segment_size;
+
+    /**
+     * The number of the segment currently being written by the writer
+     * thread, where the first segment is numbered 1. This member is only
+     * accessed by the writer thread once segments have been enabled.
+     */
+    int segment;
+
+    /**
+     * The timestamp of the first frame of the most recently begun segment,
+     * or zero if no frame has yet been ended since segments were enabled.
+     */
+    guac_timestamp segment_start;
+
+    /**
+     * The offset within the recording data of the first byte of the most
+     * recently begun segment.
+     */
+    uint64_t segment_position;
+
+    /**
+     * The offset within the recording data at which the writer thread must
+     * begin a new segment, as requested by
+     * guac_socket_recording_begin_segment(), or zero if no new segment has
+     * been requested.
+     */
+    uint64_t segment_break;
+
+    /**
+     * The zstd compression level to use when compressing each closed
+     * segment, or zero if segments are left uncompressed.
+     */
+    int segment_compression;
+
+    /**
+     * Lock which guards access to the members of this structure related to
+     * the compression of closed segments.
+     */
+    pthread_mutex_t compressor_lock;
+
+    /**
+     * Condition which is signalled whenever a segment is closed, or when the
+     * compressor thread should stop.
+     */
+    pthread_cond_t segment_closed;
+
+    /**
+     * The number of the most recently closed segment, or zero if no segment
+     * has yet been closed.
+     */
+    int segments_closed;
+
+    /**
+     * Whether the compressor thread should exit once all closed segments
+     * have been compressed.
+     */
+    int compressor_stopping;
+
+    /**
+     * The thread which compresses each closed segment, if segment_compression
+     * is non-zero.
+     */
+    pthread_t compressor_thread;
+
+#ifdef HAVE_LIBZSTD
+    /**
+     * The zstd compression context used to compress all data written to the
+     * recording file, or NULL if data is written uncompressed.
+     */
+    ZSTD_CCtx* cctx;
+
+    /**
+     * Buffer receiving compressed data from the zstd compression context
+     * before that data is written to the recording file.
+     */
+    char* compressed;
+
+    /**
+     * The number of bytes that may be stored within the compressed buffer.
+     */
+    size_t compressed_size;
+
+    /**
+     * Whether a zstd frame is currently being written. This member is only
+     * accessed by the writer thread.
+     */
+    int in_frame;
+
+    /**
+     * The number of uncompressed bytes within the zstd frame currently being
+     * written. This member is only accessed by the writer thread.
+     */
+    size_t frame_length;
+
+    /**
+     * The offset within the uncompressed recording data of the first byte
+     * that has not yet been compressed. This member is only modified by the
+     * writer thread.
+     */
+    uint64_t compressed_position;
+
+    /**
+     * The offset within the uncompressed recording data at which a new zstd
+     * frame must begin, as requested by guac_socket_recording_begin_keyframe(),
+     * or zero if no new frame has been requested.
+     */
+    uint64_t frame_break;
+
+    /**
+     * The offset within the uncompressed recording data of the end of the
+     * frame most recently committed by a flush. Only at such offsets may a
+     * zstd frame end without splitting a frame of the recording.
+     */
+    uint64_t flushed;
+#endif
+
+} guac_socket_recording_data;
+
+/**
+ * Logs a warning noting that the recording cannot keep up with the data being
+ * recorded, unless such a warning was logged recently. The buffer lock of the
+ * socket MUST already be acquired.
+ *
+ * @param data
+ *     The data associated with the recording socket whose buffer is full.
+ */
+static void guac_socket_recording_warn(guac_socket_recording_data* data) {
+
+    guac_timestamp now = guac_timestamp_current();
+    if (data->last_warning != 0
+            && now - data->last_warning < GUAC_SOCKET_RECORDING_WARNING_INTERVAL)
+        return;
+
+    data->last_warning = now;
+
+    if (data->overflow == GUAC_RECORDING_OVERFLOW_DROP)
+        guac_client_log(data->client, GUAC_LOG_WARNING, "Session recording "
+                "cannot be written quickly enough. %i frame(s) have been "
+                "omitted from the recording so far.", data->frames_dropped);
+    else
+        guac_client_log(data->client, GUAC_LOG_WARNING, "Session recording "
+                "cannot be written quickly enough. Output to all users is "
+                "being delayed until the recording catches up.");
+
+}
+
+/**
+ * Commits the given number of pending bytes, such that those bytes will be
+ * written to the recording file by the writer thread and can no longer be
+ * discarded. The given number of bytes MUST be either the total number of
+ * pending bytes or the number of pending bytes making up complete
+ * instructions. The buffer lock of the socket MUST already be acquired.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param length
+ *     The number of pending bytes to commit.
+ */
+static void guac_socket_recording_commit(guac_socket_recording_data* data,
+        size_t length) {
+
+    data->committed += length;
+    data->position += length;
+    data->pending -= length;
+    data->boundary = 0;
+
+    if (data->committed >= GUAC_SOCKET_RECORDING_WRITE_THRESHOLD)
+        pthread_cond_signal(&data->buffer_changed);
+
+}
+
+/**
+ * Waits for the buffer of the given recording socket to change, or for
+ * GUAC_SOCKET_RECORDING_WRITE_INTERVAL milliseconds to elapse, whichever
+ * happens first. The buffer lock of the socket MUST already be acquired.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     Non-zero if the interval elapsed without the buffer being changed, zero
+ *     otherwise.
+ */
+static int guac_socket_recording_timedwait(guac_socket_recording_data* data) {
+
+    struct timespec ts_timeout;
+    clock_gettime(CLOCK_MONOTONIC, &ts_timeout);
+
+    uint64_t nsec_timeout = GUAC_SOCKET_RECORDING_WRITE_INTERVAL * 1000000L
+        + ts_timeout.tv_nsec;
+    ts_timeout.tv_sec += nsec_timeout / NANOS_PER_SECOND;
+    ts_timeout.tv_nsec = nsec_timeout % NANOS_PER_SECOND;
+
+    return pthread_cond_timedwait(&data->buffer_changed, &data->buffer_lock,
+            &ts_timeout) == ETIMEDOUT;
+
+}
+
+/**
+ * Writes the given region of the ring buffer of a recording socket to the
+ * recording file, using a single writev() call for regions that wrap around
+ * the end of the buffer wherever possible.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param offset
+ *     The offset of the first byte to write within the ring buffer.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero if all data was written successfully, non-zero otherwise, in which
+ *     case errno is set appropriately.
+ */
+static int guac_socket_recording_write_region(guac_socket_recording_data* data,
+        size_t offset, size_t length) {
+
+    while (length > 0) {
+
+        size_t first = data->size - offset;
+        if (first > length)
+            first = length;
+
+        struct iovec iov[2] = {
+            { .iov_base = data->buffer + offset, .iov_len = first },
+            { .iov_base = data->buffer,          .iov_len = length - first }
+        };
+
+        ssize_t written = writev(data->fd, iov, first < length ? 2 : 1);
+        if (written < 0) {
+
+            /* Retry if interrupted by a signal */
+            if (errno == EINTR)
+                continue;
+
+            return 1;
+
+        }
+
+        offset = (offset + written) % data->size;
+        length -= written;
+
+    }
+
+    return 0;
+
+}
+
+#ifdef HAVE_LIBZSTD
+/**
+ * Writes the entirety of the given buffer to the given file descriptor,
+ * retrying as necessary until all data has been written.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param buffer
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero if all data was written successfully, non-zero otherwise, in which
+ *     case errno is set appropriately.
+ */
+static int guac_socket_recording_write_all(int fd, const void* buffer,
+        size_t length) {
+
+    const char* current = buffer;
+
+    while (length > 0) {
+
+        ssize_t written = write(fd, current, length);
+        if (written < 0) {
+
+            /* Retry if interrupted by a signal */
+            if (errno == EINTR)
+                continue;
+
+            return 1;
+
+        }
+
+        current += written;
+        length -= written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Stores the given value within the given buffer as a little-endian integer
+ * having the given number of bytes.
+ *
+ * @param buffer
+ *     The buffer in which the value should be stored.
+ *
+ * @param value
+ *     The value to store.
+ *
+ * @param bytes
+ *     The number of bytes to store, starting with the least-significant byte
+ *     of the value.
+ */
+static void guac_socket_recording_store_le(unsigned char* buffer,
+        uint64_t value, int bytes) {
+
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = value & 0xFF;
+        value >>= 8;
+    }
+
+}
+
+/**
+ * Compresses the given data, writing all resulting compressed data to the
+ * recording file. If no zstd frame is currently being written, a new frame is
+ * begun, preceded by the skippable frame noting the offset of that frame
+ * within the uncompressed data. This function may only be invoked by the
+ * writer thread.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param buffer
+ *     The uncompressed data to compress, or NULL if no further data is being
+ *     compressed and the current frame is only being flushed or ended.
+ *
+ * @param length
+ *     The number of bytes of uncompressed data to compress.
+ *
+ * @param mode
+ *     ZSTD_e_continue if further data will be added to the current frame
+ *     later, ZSTD_e_flush if all data compressed so far should additionally
+ *     be written to the recording file, or ZSTD_e_end if the current frame
+ *     should be ended.
+ *
+ * @return
+ *     Zero if all data was compressed and written successfully, non-zero
+ *     otherwise, in which case errno is set appropriately.
+ */
+static int guac_socket_recording_compress(guac_socket_recording_data* data,
+        const char* buffer, size_t length, ZSTD_EndDirective mode) {
+
+    /* There is nothing to flush or end if no frame has been begun */
+    if (!data->in_frame) {
+
+        if (length == 0)
+            return 0;
+
+        unsigned char header[GUAC_SOCKET_RECORDING_SEEK_SIZE];
+        guac_socket_recording_store_le(header, GUAC_SOCKET_RECORDING_SEEK_MAGIC, 4);
+        guac_socket_recording_store_le(header + 4, sizeof(header) - 8, 4);
+        guac_socket_recording_store_le(header + 8, data->compressed_position, 8);
+
+        if (guac_socket_recording_write_all(data->fd, header, sizeof(header)))
+            return 1;
+
+        data->in_frame = 1;
+        data->frame_length = 0;
+
+    }
+
+    ZSTD_inBuffer input = { .src = buffer, .size = length, .pos = 0 };
+
+    for (;;) {
+
+        ZSTD_outBuffer output = {
+            .dst  = data->compressed,
+            .size = data->compressed_size,
+            .pos  = 0
+        };
+
+        /* Compression fails only if memory cannot be allocated */
+        size_t remaining = ZSTD_compressStream2(data->cctx, &output, &input, mode);
+        if (ZSTD_isError(remaining)) {
+            errno = ENOMEM;
+            return 1;
+        }
+
+        if (guac_socket_recording_write_all(data->fd, output.dst, output.pos))
+            return 1;
+
+        /* Flushing and ending a frame may require several passes */
+        if (mode == ZSTD_e_continue ? input.pos == input.size : remaining == 0)
+            break;
+
+    }
+
+    data->compressed_position += length;
+    data->frame_length += length;
+
+    if (mode == ZSTD_e_end)
+        data->in_frame = 0;
+
+    return 0;
+
+}
+
+/**
+ * Compresses the given region of the ring buffer of a recording socket,
+ * writing all resulting compressed data to the recording file. Zstd frames
+ * are ended at the requested frame break, if within the region, and at the
+ * end of the region if the region ends at a frame boundary and the current
+ * frame is large enough. All compressed data is flushed to the recording file
+ * regardless, such that readers of an in-progress recording receive all data
+ * written thus far. This function may only be invoked by the writer thread.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param offset
+ *     The offset of the first byte to compress within the ring buffer.
+ *
+ * @param length
+ *     The number of bytes to compress.
+ *
+ * @param frame_break
+ *     The offset within the uncompressed data at which a new zstd frame must
+ *     begin, or zero if no new frame has been requested.
+ *
+ * @param boundary
+ *     The offset within the uncompressed data of the end of the frame most
+ *     recently committed by a flush.
+ *
+ * @return
+ *     Zero if all data was compressed and written successfully, non-zero
+ *     otherwise, in which case errno is set appropriately.
+ */
+static int guac_socket_recording_compress_region(
+        guac_socket_recording_data* data, size_t offset, size_t length,
+        uint64_t frame_break, uint64_t boundary) {
+
+    while (length > 0) {
+
+        /* End the current frame exactly where a keyframe begins */
+        if (data->in_frame && data->compressed_position == frame_break
+                && guac_socket_recording_compress(data, NULL, 0, ZSTD_e_end))
+            return 1;
+
+        size_t chunk = data->size - offset;
+        if (chunk > length)
+            chunk = length;
+
+        if (frame_break > data->compressed_position
+                && frame_break - data->compressed_position < chunk)
+            chunk = frame_break - data->compressed_position;
+
+        if (guac_socket_recording_compress(data, data->buffer + offset, chunk,
+                    ZSTD_e_continue))
+            return 1;
+
+        offset = (offset + chunk) % data->size;
+        length -= chunk;
+
+    }
+
+    int end = data->compressed_position == frame_break
+        || (data->compressed_position == boundary
+            && data->frame_length >= GUAC_SOCKET_RECORDING_FRAME_SIZE);
+
+    return guac_socket_recording_compress(data, NULL, 0,
+            end ? ZSTD_e_end : ZSTD_e_flush);
+
+}
+#endif
+
+/**
+ * Stores the full path to the given segment of a segmented recording within
+ * the given buffer. The first segment is the recording file itself, while
+ * each later segment has the same name as the recording with
+ * GUAC_RECORDING_SEGMENT_SUFFIX and the number of that segment appended.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param segment
+ *     The number of the segment, where the first segment is numbered 1.
+ *
+ * @param buffer
+ *     The buffer in which the path should be stored. This buffer MUST be at
+ *     least GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH bytes.
+ */
+static void guac_socket_recording_segment_path(
+        guac_socket_recording_data* data, int segment, char* buffer) {
+
+    if (segment == 1)
+        snprintf(buffer, GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH, "%s",
+                data->path);
+    else
+        snprintf(buffer, GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH,
+                "%s" GUAC_RECORDING_SEGMENT_SUFFIX "%i", data->path, segment);
+
+}
+
+#ifdef HAVE_LIBZSTD
+/**
+ * Compresses all data read from the given file descriptor as a single zstd
+ * frame, writing the compressed data to the other given file descriptor.
+ *
+ * @param in
+ *     The file descriptor of the uncompressed data.
+ *
+ * @param out
+ *     The file descriptor that should receive the compressed data.
+ *
+ * @param level
+ *     The zstd compression level to use.
+ *
+ * @return
+ *     Zero if all data was compressed and written successfully, non-zero
+ *     otherwise, in which case errno is set appropriately.
+ */
+static int guac_socket_recording_compress_fd(int in, int out, int level) {
+
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        errno = ENOMEM;
+        return 1;
+    }
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+    size_t input_size = ZSTD_CStreamInSize();
+    size_t output_size = ZSTD_CStreamOutSize();
+    char* input_buffer = guac_mem_alloc(input_size);
+    char* output_buffer = guac_mem_alloc(output_size);
+
+    int result = 0;
+    for (;;) {
+
+        ssize_t length = read(in, input_buffer, input_size);
+        if (length < 0) {
+
+            /* Retry if interrupted by a signal */
+            if (errno == EINTR)
+                continue;
+
+            result = 1;
+            break;
+
+        }
+
+        /* The frame ends with the end of the file */
+        ZSTD_EndDirective mode = (length == 0) ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer input = { .src = input_buffer, .size = length, .pos = 0 };
+
+        size_t remaining;
+        do {
+
+            ZSTD_outBuffer output = {
+                .dst  = output_buffer,
+                .size = output_size,
+                .pos  = 0
+            };
+
+            /* Compression fails only if memory cannot be allocated */
+            remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                errno = ENOMEM;
+                result = 1;
+                break;
+            }
+
+            if (guac_socket_recording_write_all(out, output.dst, output.pos)) {
+                result = 1;
+                break;
+            }
+
+        } while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+
+        if (result || length == 0)
+            break;
+
+    }
+
+    guac_mem_free(input_buffer);
+    guac_mem_free(output_buffer);
+    ZSTD_freeCCtx(cctx);
+    return result;
+
+}
+
+/**
+ * Replaces the given closed segment of a segmented recording with a
+ * zstd-compressed copy of that segment, readable with
+ * guac_recording_open_reader() or the standard zstd utility. The compressed
+ * copy is written to a temporary file alongside the segment, replacing the
+ * segment only once complete, such that the segment remains readable
+ * throughout.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param segment
+ *     The number of the closed segment to compress.
+ *
+ * @return
+ *     Zero if the segment was compressed successfully, non-zero otherwise, in
+ *     which case errno is set appropriately and the segment is left
+ *     uncompressed.
+ */
+static int guac_socket_recording_compress_segment(
+        guac_socket_recording_data* data, int segment) {
+
+    char path[GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH];
+    char temp_path[GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH
+        + sizeof(GUAC_SOCKET_RECORDING_TEMP_SUFFIX)];
+
+    guac_socket_recording_segment_path(data, segment, path);
+    snprintf(temp_path, sizeof(temp_path),
+            "%s" GUAC_SOCKET_RECORDING_TEMP_SUFFIX, path);
+
+    int in = open(path, O_RDONLY);
+    if (in == -1)
+        return 1;
+
+    int out = open(temp_path, O_CREAT | O_WRONLY | O_TRUNC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+    if (out == -1) {
+        close(in);
+        return 1;
+    }
+
+    int result = guac_socket_recording_compress_fd(in, out,
+            data->segment_compression);
+
+    close(in);
+    if (close(out))
+        result = 1;
+
+    if (result || rename(temp_path, path)) {
+        int error = errno;
+        unlink(temp_path);
+        errno = error;
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Thread which compresses each closed segment of a segmented recording, in
+ * order, such that neither the writer thread nor threads writing to the
+ * recording socket ever wait for compression. The thread exits once
+ * compressor_stopping is set and all closed segments have been compressed.
+ *
+ * @param arg
+ *     The data associated with the recording socket.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_recording_compressor_thread(void* arg) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) arg;
+    int compressed = 0;
+
+    pthread_mutex_lock(&data->compressor_lock);
+
+    for (;;) {
+
+        /* Wait until there is a closed segment to compress */
+        while (!data->compressor_stopping
+                && compressed == data->segments_closed)
+            pthread_cond_wait(&data->segment_closed, &data->compressor_lock);
+
+        if (compressed == data->segments_closed)
+            break;
+
+        int segment = ++compressed;
+        pthread_mutex_unlock(&data->compressor_lock);
+
+        if (guac_socket_recording_compress_segment(data, segment))
+            guac_client_log(data->client, GUAC_LOG_WARNING, "Segment %i of "
+                    "session recording could not be compressed and has been "
+                    "left uncompressed: %s", segment, strerror(errno));
+
+        pthread_mutex_lock(&data->compressor_lock);
+
+    }
+
+    pthread_mutex_unlock(&data->compressor_lock);
+    return NULL;
+
+}
+#endif
+
+/**
+ * Notes that the given segment of a segmented recording has been closed and
+ * will receive no further data, such that the segment will be compressed in
+ * the background if segments are compressed.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ *
+ * @param segment
+ *     The number of the segment that has been closed.
+ */
+static void guac_socket_recording_close_segment(
+        guac_socket_recording_data* data, int segment) {
+
+    if (data->segment_compression == 0)
+        return;
+
+    pthread_mutex_lock(&data->compressor_lock);
+    data->segments_closed = segment;
+    pthread_cond_signal(&data->segment_closed);
+    pthread_mutex_unlock(&data->compressor_lock);
+
+}
+
+/**
+ * Closes the segment currently being written by the writer thread, replacing
+ * the recording file with a newly-created file for the next segment. If the
+ * next segment cannot be created, a warning is logged, and the current
+ * segment continues to receive data. This function may only be invoked by
+ * the writer thread.
+ *
+ * @param data
+ *     The data associated with the recording socket.
+ */
+static void guac_socket_recording_next_segment(
+        guac_socket_recording_data* data) {
+
+    char path[GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH];
+    guac_socket_recording_segment_path(data, data->segment + 1, path);
+
+    /* Any segment left behind by a previous recording of the same name no
+     * longer applies */
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC,
+            S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1) {
+        guac_client_log(data->client, GUAC_LOG_WARNING, "Session recording "
+                "will continue within its current segment, as the next "
+                "segment could not be created: %s", strerror(errno));
+        return;
+    }
+
+    close(data->fd);
+    guac_socket_recording_close_segment(data, data->segment);
+
+    data->fd = fd;
+    data->segment++;
+
+    guac_client_log(data->client, GUAC_LOG_DEBUG, "Session recording "
+            "continues within \"%s\".", path);
+
+}
+
+/**
+ * Thread which writes all committed data of a recording socket to the
+ * recording file, in order. The writer waits until enough data has been
+ * committed, until some committed data has waited for
+ * GUAC_SOCKET_RECORDING_WRITE_INTERVAL milliseconds, or until a thread is
+ * waiting for room within the buffer, and then writes everything committed at
+ * once.
+ *
+ * @param arg
+ *     The recording socket whose data should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_recording_writer_thread(void* arg) {
+
+    guac_socket* socket = (guac_socket*) arg;
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    for (;;) {
+
+        /* Wait until there is a reason to write data */
+        while (!data->failed && !data->stopping && !data->flush_requested
+                && data->committed < GUAC_SOCKET_RECORDING_WRITE_THRESHOLD) {
+
+            if (data->committed == 0)
+                pthread_cond_wait(&data->buffer_changed, &data->buffer_lock);
+
+            /* Write any committed data that has waited long enough */
+            else if (guac_socket_recording_timedwait(data))
+                break;
+
+        }
+
+        data->flush_requested = 0;
+
+        /* Stop once failed or when stopping with nothing left to write */
+        if (data->failed || (data->stopping && data->committed == 0))
+            break;
+
+        if (data->committed == 0)
+            continue;
+
+        /* Write everything committed without blocking further writes to the
+         * socket (the committed region is never modified by those writes) */
+        size_t offset = data->head;
+        size_t length = data->committed;
+
+#ifdef HAVE_LIBZSTD
+        uint64_t frame_break = data->frame_break;
+        uint64_t boundary = data->flushed;
+#endif
+
+        /* Note how much of the committed data belongs to the current segment,
+         * if a new segment has been requested within that data */
+        uint64_t segment_break = data->segment_break;
+        uint64_t start = data->position - data->committed;
+        int next_segment = segment_break != 0
+            && segment_break - start <= length;
+
+        size_t first = next_segment ? segment_break - start : length;
+
+        pthread_mutex_unlock(&data->buffer_lock);
+
+        int result;
+#ifdef HAVE_LIBZSTD
+        if (data->cctx != NULL)
+            result = guac_socket_recording_compress_region(data, offset,
+                    length, frame_break, boundary);
+        else
+#endif
+        result = guac_socket_recording_write_region(data, offset, first);
+
+        /* Write the remainder to the new segment, if any */
+        if (!result && next_segment) {
+            guac_socket_recording_next_segment(data);
+            result = guac_socket_recording_write_region(data,
+                    (offset + first) % data->size, length - first);
+        }
+
+        pthread_mutex_lock(&data->buffer_lock);
+
+        /* Allow further segments once the requested segment has begun */
+        if (next_segment && data->segment_break == segment_break)
+            data->segment_break = 0;
+
+#ifdef HAVE_LIBZSTD
+        /* Allow further keyframes once the requested frame has begun */
+        if (frame_break != 0 && data->frame_break == frame_break
+                && data->compressed_position >= frame_break)
+            data->frame_break = 0;
+#endif
+
+        data->head = (offset + length) % data->size;
+        data->committed -= length;
+
+        /* Discard everything if the recording can no longer be written */
+        if (result) {
+            guac_client_log(data->client, GUAC_LOG_ERROR, "Session "
+                    "recording could not be written: %s. No further data "
+                    "will be recorded.", strerror(errno));
+            data->failed = 1;
+            data->head = 0;
+            data->committed = 0;
+            data->pending = 0;
+            data->boundary = 0;
+        }
+
+        pthread_cond_broadcast(&data->buffer_drained);
+
+    }
+
+#ifdef HAVE_LIBZSTD
+    /* End the final frame, such that the recording can be decompressed in
+     * its entirety */
+    if (data->cctx != NULL && !data->failed
+            && guac_socket_recording_compress(data, NULL, 0, ZSTD_e_end))
+        guac_client_log(data->client, GUAC_LOG_ERROR, "End of session "
+                "recording could not be written: %s", strerror(errno));
+#endif
+
+    pthread_mutex_unlock(&data->buffer_lock);
+    return NULL;
+
+}
+
+/**
+ * Callback function which copies the given data into the buffer of the
+ * recording socket as part of the frame currently being written. If the
+ * buffer is full, this function either waits for room within the buffer or
+ * discards the frame, depending on the overflow behavior of the socket.
+ *
+ * @param socket
+ *     The recording socket to write to.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written, which is always count, even if the data
+ *     was discarded.
+ */
+static ssize_t guac_socket_recording_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    const char* current = buf;
+    size_t remaining = count;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    while (remaining > 0 && !data->failed && !data->dropping) {
+
+        size_t available = data->size - data->committed - data->pending;
+
+        /* Copy as much as possible into the buffer, wrapping around the end
+         * of the buffer as necessary */
+        if (available > 0) {
+
+            size_t length = remaining;
+            if (length > available)
+                length = available;
+
+            size_t offset = (data->head + data->committed + data->pending)
+                % data->size;
+
+            size_t first = data->size - offset;
+            if (first > length)
+                first = length;
+
+            memcpy(data->buffer + offset, current, first);
+            memcpy(data->buffer, current + first, length - first);
+
+            data->pending += length;
+            current += length;
+            remaining -= length;
+            continue;
+
+        }
+
+        /* Discard the current frame entirely, along with everything else
+         * until the next flush, if dropping frames on overflow */
+        if (data->overflow == GUAC_RECORDING_OVERFLOW_DROP) {
+            data->pending = 0;
+            data->boundary = 0;
+            data->dropping = 1;
+            data->frames_dropped++;
+            guac_socket_recording_warn(data);
+            break;
+        }
+
+        if (data->overflow == GUAC_RECORDING_OVERFLOW_THROTTLE)
+            guac_socket_recording_warn(data);
+
+        /* Otherwise, as all data will be written eventually, the current
+         * frame can be committed as-is, allowing the writer thread to make
+         * room for the remainder */
+        guac_socket_recording_commit(data, data->pending);
+        data->flush_requested = 1;
+        pthread_cond_signal(&data->buffer_changed);
+
+        pthread_cond_wait(&data->buffer_drained, &data->buffer_lock);
+
+    }
+
+    /* Data written outside an instruction is complete as-is */
+    if (!data->in_instruction)
+        data->boundary = data->pending;
+
+    pthread_mutex_unlock(&data->buffer_lock);
+    return count;
+
+}
+
+/**
+ * Callback function which marks the end of the frame currently being
+ * written, committing that frame such that it will be written to the
+ * recording file. If data was being discarded due to the buffer overflowing,
+ * data will again be buffered from this point forward. If an instruction is
+ * currently being written by another thread, only the complete instructions
+ * of the frame are committed, with the remainder becoming part of the next
+ * frame.
+ *
+ * @param socket
+ *     The recording socket to flush.
+ *
+ * @return
+ *     Always zero.
+ */
+static ssize_t guac_socket_recording_flush_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    /* Resume buffering data, waiting for any partially-discarded instruction
+     * to be completed */
+    if (data->dropping) {
+        if (data->in_instruction)
+            data->resume_requested = 1;
+        else
+            data->dropping = 0;
+    }
+
+    else {
+        guac_socket_recording_commit(data, data->in_instruction
+                ? data->boundary : data->pending);
+#ifdef HAVE_LIBZSTD
+        data->flushed = data->position;
+#endif
+    }
+
+    pthread_mutex_unlock(&data->buffer_lock);
+    return 0;
+
+}
+
+/**
+ * Callback function which acquires exclusive access to the recording socket,
+ * such that the data of instructions written in parallel is never
+ * interleaved, and such that frames are never split within an instruction.
+ *
+ * @param socket
+ *     The recording socket on which guac_socket_instruction_begin() was
+ *     invoked.
+ */
+static void guac_socket_recording_lock_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(data->socket_lock));
+
+    pthread_mutex_lock(&data->buffer_lock);
+    data->in_instruction = 1;
+    pthread_mutex_unlock(&data->buffer_lock);
+
+}
+
+/**
+ * Callback function which relinquishes exclusive access to the recording
+ * socket, marking the end of the instruction being written.
+ *
+ * @param socket
+ *     The recording socket on which guac_socket_instruction_end() was
+ *     invoked.
+ */
+static void guac_socket_recording_unlock_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    data->in_instruction = 0;
+    data->boundary = data->pending;
+
+    /* Resume buffering data if flushed while discarding this instruction */
+    if (data->resume_requested) {
+        data->resume_requested = 0;
+        data->dropping = 0;
+    }
+
+    pthread_mutex_unlock(&data->buffer_lock);
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which waits for all committed data to be written, stops
+ * the writer thread, closes the recording file, and frees all underlying data
+ * associated with the given recording socket.
+ *
+ * @param socket
+ *     The recording socket being freed.
+ *
+ * @return
+ *     Always zero.
+ */
+static int guac_socket_recording_free_handler(guac_socket* socket) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    /* Write anything remaining and stop the writer thread */
+    pthread_mutex_lock(&data->buffer_lock);
+
+    if (!data->dropping)
+        guac_socket_recording_commit(data, data->pending);
+
+    data->stopping = 1;
+    pthread_cond_signal(&data->buffer_changed);
+    pthread_mutex_unlock(&data->buffer_lock);
+
+    pthread_join(data->writer_thread, NULL);
+
+    if (data->frames_dropped)
+        guac_client_log(data->client, GUAC_LOG_INFO, "%i frame(s) were "
+                "omitted from the session recording as the recording could "
+                "not be written quickly enough.", data->frames_dropped);
+
+    close(data->fd);
+
+    /* Compress the final segment, waiting for all closed segments to be
+     * compressed such that no segment is left uncompressed */
+    if (data->path != NULL) {
+
+        guac_socket_recording_close_segment(data, data->segment);
+
+#ifdef HAVE_LIBZSTD
+        if (data->segment_compression != 0) {
+            pthread_mutex_lock(&data->compressor_lock);
+            data->compressor_stopping = 1;
+            pthread_cond_signal(&data->segment_closed);
+            pthread_mutex_unlock(&data->compressor_lock);
+            pthread_join(data->compressor_thread, NULL);
+        }
+#endif
+
+        pthread_cond_destroy(&data->segment_closed);
+        pthread_mutex_destroy(&data->compressor_lock);
+        guac_mem_free(data->path);
+
+    }
+
+    /* Free index only after all keyframes referring to the recording have
+     * been written */
+    if (data->index != NULL)
+        guac_socket_free(data->index);
+
+    pthread_cond_destroy(&data->buffer_changed);
+    pthread_cond_destroy(&data->buffer_drained);
+    pthread_mutex_destroy(&data->buffer_lock);
+    pthread_mutex_destroy(&data->socket_lock);
+
+    guac_mem_account_free(GUAC_MEM_CATEGORY_RECORDING, data->size);
+
+#ifdef HAVE_LIBZSTD
+    ZSTD_freeCCtx(data->cctx);
+    guac_mem_free(data->compressed);
+    guac_mem_account_free(GUAC_MEM_CATEGORY_RECORDING, data->compressed_size);
+#endif
+
+    guac_mem_free(data->buffer);
+    guac_mem_free(data);
+    return 0;
+
+}
+
+guac_socket* guac_socket_recording(guac_client* client, int fd,
+        size_t buffer_size, guac_recording_overflow overflow,
+        int compression) {
+
+    char* buffer = guac_mem_alloc(buffer_size);
+    if (buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate buffer for recording";
+        return NULL;
+    }
+
+    guac_socket_recording_data* data = guac_mem_zalloc(sizeof(guac_socket_recording_data));
+    data->client = client;
+    data->fd = fd;
+    data->overflow = overflow;
+    data->buffer = buffer;
+    data->size = buffer_size;
+
+#ifdef HAVE_LIBZSTD
+    /* Compress data as it is written, if requested */
+    if (compression > 0) {
+
+        data->cctx = ZSTD_createCCtx();
+        if (data->cctx == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not allocate compression context for "
+                "recording";
+            guac_mem_free(data->buffer);
+            guac_mem_free(data);
+            return NULL;
+        }
+
+        ZSTD_CCtx_setParameter(data->cctx, ZSTD_c_compressionLevel, compression);
+        ZSTD_CCtx_setParameter(data->cctx, ZSTD_c_checksumFlag, 1);
+
+        data->compressed_size = ZSTD_CStreamOutSize();
+        data->compressed = guac_mem_alloc(data->compressed_size);
+
+    }
+#endif
+
+    /* The writer thread waits with timeouts measured against the monotonic
+     * clock, which is not subject to changes in system time */
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&(data->socket_lock), NULL);
+    pthread_mutex_init(&(data->buffer_lock), NULL);
+    pthread_cond_init(&(data->buffer_changed), &cond_attr);
+    pthread_cond_init(&(data->buffer_drained), NULL);
+
+    pthread_condattr_destroy(&cond_attr);
+
+    /* Associate recording-specific data with new socket */
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = data;
+
+    /* Start writing buffered data in the background */
+    if (pthread_create(&(data->writer_thread), NULL,
+                guac_socket_recording_writer_thread, socket)) {
+
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Could not start writer thread for recording";
+
+        pthread_cond_destroy(&(data->buffer_changed));
+        pthread_cond_destroy(&(data->buffer_drained));
+        pthread_mutex_destroy(&(data->buffer_lock));
+        pthread_mutex_destroy(&(data->socket_lock));
+
+#ifdef HAVE_LIBZSTD
+        ZSTD_freeCCtx(data->cctx);
+        guac_mem_free(data->compressed);
+#endif
+
+        guac_mem_free(data->buffer);
+        guac_mem_free(data);
+
+        socket->data = NULL;
+        guac_socket_free(socket);
+        return NULL;
+
+    }
+
+    /* Assign handlers */
+    socket->write_handler  = guac_socket_recording_write_handler;
+    socket->flush_handler  = guac_socket_recording_flush_handler;
+    socket->lock_handler   = guac_socket_recording_lock_handler;
+    socket->unlock_handler = guac_socket_recording_unlock_handler;
+    socket->free_handler   = guac_socket_recording_free_handler;
+
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_RECORDING, data->size);
+
+#ifdef HAVE_LIBZSTD
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_RECORDING, data->compressed_size);
+#endif
+
+    return socket;
+
+}
+
+void guac_socket_recording_set_index(guac_socket* socket, guac_socket* index,
+        int interval) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+    data->index = index;
+    data->index_interval = interval;
+    pthread_mutex_unlock(&data->buffer_lock);
+
+}
+
+/**
+ * Writes the given integer to the given guac_socket as a single element of
+ * an instruction, including its length prefix and the given terminator.
+ *
+ * @param socket
+ *     The guac_socket to write to.
+ *
+ * @param value
+ *     The integer value of the element.
+ *
+ * @param terminator
+ *     The character which should follow the element: "," if further elements
+ *     follow, or ";" if this is the last element of the instruction.
+ */
+static void guac_socket_recording_write_element(guac_socket* socket,
+        uint64_t value, const char* terminator) {
+
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+
+    guac_socket_write_int(socket, length);
+    guac_socket_write_string(socket, ".");
+    guac_socket_write_string(socket, buffer);
+    guac_socket_write_string(socket, terminator);
+
+}
+
+guac_socket* guac_socket_recording_begin_keyframe(guac_socket* socket,
+        guac_timestamp timestamp) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    /* Write keyframes only as often as requested */
+    guac_socket* index = data->index;
+    if (index == NULL || data->failed || (data->last_keyframe != 0
+                && timestamp - data->last_keyframe < data->index_interval)) {
+        pthread_mutex_unlock(&data->buffer_lock);
+        return NULL;
+    }
+
+#ifdef HAVE_LIBZSTD
+    /* A keyframe of a compressed recording can refer only to the start of a
+     * zstd frame, and no further keyframe is written until the frame
+     * requested by the previous keyframe has begun */
+    if (data->cctx != NULL) {
+
+        if (data->frame_break != 0) {
+            pthread_mutex_unlock(&data->buffer_lock);
+            return NULL;
+        }
+
+        data->frame_break = data->position;
+
+    }
+#endif
+
+    data->last_keyframe = timestamp;
+    uint64_t position = data->position;
+
+    pthread_mutex_unlock(&data->buffer_lock);
+
+    /* Mark where the data of the new keyframe begins */
+    guac_socket_instruction_begin(index);
+    guac_socket_write_int(index, strlen(GUAC_RECORDING_INDEX_KEYFRAME));
+    guac_socket_write_string(index, "." GUAC_RECORDING_INDEX_KEYFRAME ",");
+    guac_socket_recording_write_element(index, timestamp, ",");
+    guac_socket_recording_write_element(index, position, ";");
+    guac_socket_instruction_end(index);
+
+    return index;
+
+}
+
+void guac_socket_recording_set_segments(guac_socket* socket,
+        const char* path, int duration, uint64_t size, int compression) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_init(&(data->compressor_lock), NULL);
+    pthread_cond_init(&(data->segment_closed), NULL);
+
+#ifdef HAVE_LIBZSTD
+    /* Compress closed segments in the background, if requested */
+    if (compression > 0) {
+        data->segment_compression = compression;
+        if (pthread_create(&(data->compressor_thread), NULL,
+                    guac_socket_recording_compressor_thread, data)) {
+            guac_client_log(data->client, GUAC_LOG_WARNING, "Segments of "
+                    "session recording will not be compressed: %s",
+                    strerror(errno));
+            data->segment_compression = 0;
+        }
+    }
+#endif
+
+    pthread_mutex_lock(&data->buffer_lock);
+    data->path = guac_strdup(path);
+    data->segment_duration = duration;
+    data->segment_size = size;
+    data->segment = 1;
+    pthread_mutex_unlock(&data->buffer_lock);
+
+}
+
+int guac_socket_recording_begin_segment(guac_socket* socket,
+        guac_timestamp timestamp) {
+
+    guac_socket_recording_data* data = (guac_socket_recording_data*) socket->data;
+
+    pthread_mutex_lock(&data->buffer_lock);
+
+    /* No further segment is begun until the previously-requested segment
+     * has begun */
+    if (data->path == NULL || data->failed || data->segment_break != 0) {
+        pthread_mutex_unlock(&data->buffer_lock);
+        return 0;
+    }
+
+    /* The first segment begins with the first frame */
+    if (data->segment_start == 0) {
+        data->segment_start = timestamp;
+        pthread_mutex_unlock(&data->buffer_lock);
+        return 0;
+    }
+
+    uint64_t length = data->position - data->segment_position;
+    int due = length > 0 && ((data->segment_duration > 0
+                && timestamp - data->segment_start >= data->segment_duration)
+            || (data->segment_size > 0 && length >= data->segment_size));
+
+    if (due) {
+        data->segment_start = timestamp;
+        data->segment_position = data->position;
+        data->segment_break = data->position;
+    }
+
+    pthread_mutex_unlock(&data->buffer_lock);
+    return due;
+
+}
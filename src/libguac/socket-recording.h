@@ -0,0 +1,266 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_RECORDING_H
+#define GUAC_SOCKET_RECORDING_H
+
+#include "config.h"
+#include "guacamole/client.h"
+#include "guacamole/recording.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of bytes of complete frames which must be buffered by a
+ * recording socket before its writer thread writes that data to the
+ * recording file, rather than waiting for further data to write at once.
+ */
+#define GUAC_SOCKET_RECORDING_WRITE_THRESHOLD 65536
+
+/**
+ * The maximum amount of time that complete frames may remain buffered by a
+ * recording socket before being written to the recording file, even if less
+ * than GUAC_SOCKET_RECORDING_WRITE_THRESHOLD bytes are buffered, in
+ * milliseconds.
+ */
+#define GUAC_SOCKET_RECORDING_WRITE_INTERVAL 250
+
+/**
+ * The minimum amount of time between warnings logged by a recording socket
+ * that cannot keep up with the data being recorded, in milliseconds.
+ */
+#define GUAC_SOCKET_RECORDING_WARNING_INTERVAL 10000
+
+/**
+ * The number of bytes of uncompressed recording data after which a
+ * compressed recording socket ends the current zstd frame, beginning a new
+ * frame at the next frame boundary. Larger frames compress better, while
+ * smaller frames allow decompression to begin at more points within the
+ * recording.
+ */
+#define GUAC_SOCKET_RECORDING_FRAME_SIZE 1048576
+
+/**
+ * The magic number, as a little-endian 32-bit integer, of the zstd skippable
+ * frame which precedes each compressed frame of a compressed recording. The
+ * content of this skippable frame is the offset of the following compressed
+ * frame within the uncompressed recording data, as a little-endian 64-bit
+ * integer.
+ */
+#define GUAC_SOCKET_RECORDING_SEEK_MAGIC 0x184D2A5A
+
+/**
+ * The total size of the skippable frame which precedes each compressed frame
+ * of a compressed recording, including the magic number and frame size
+ * fields, in bytes.
+ */
+#define GUAC_SOCKET_RECORDING_SEEK_SIZE 16
+
+/**
+ * The magic number which begins every zstd frame, as a little-endian 32-bit
+ * integer.
+ */
+#define GUAC_SOCKET_RECORDING_ZSTD_MAGIC 0xFD2FB528
+
+/**
+ * The magic number which begins every zstd skippable frame, as a
+ * little-endian 32-bit integer, excluding the lowest four bits, which may
+ * take any value.
+ */
+#define GUAC_SOCKET_RECORDING_SKIPPABLE_MAGIC 0x184D2A50
+
+/**
+ * The maximum number of bytes in the full path to any segment of a segmented
+ * recording, including the null terminator.
+ */
+#define GUAC_SOCKET_RECORDING_MAX_PATH_LENGTH \
+    (GUAC_COMMON_RECORDING_MAX_NAME_LENGTH + 32)
+
+/**
+ * The suffix appended to the path of a closed segment to produce the path of
+ * the temporary file receiving the compressed copy of that segment.
+ */
+#define GUAC_SOCKET_RECORDING_TEMP_SUFFIX ".tmp"
+
+/**
+ * Allocates a new guac_socket which buffers all data written to it within a
+ * fixed-size ring buffer, writing that data to the given file descriptor from
+ * a dedicated thread using as few, large writes as possible. Threads writing
+ * to the returned socket therefore never wait for the recording file itself,
+ * unless the buffer is full.
+ *
+ * Data written between flushes is considered a single frame, and is not
+ * written to the file descriptor until the socket is flushed. If the buffer
+ * is full, the given overflow behavior determines whether writes wait for
+ * room within the buffer or whether the frame being written is discarded,
+ * along with all further data up to the next flush. Frames are only ever
+ * discarded whole, and never split within an instruction.
+ *
+ * If a compression level is given, the writer thread compresses all data
+ * with zstd as it is written, ending the current zstd frame at the first
+ * frame boundary after GUAC_SOCKET_RECORDING_FRAME_SIZE bytes, at the
+ * position of each keyframe written with
+ * guac_socket_recording_begin_keyframe(), and when the socket is freed. Each
+ * zstd frame is preceded by a skippable frame noting its offset within the
+ * uncompressed data (see GUAC_SOCKET_RECORDING_SEEK_MAGIC).
+ *
+ * If the writer thread encounters an error writing to the file descriptor,
+ * the error is logged, and all further data is silently discarded.
+ *
+ * If the socket cannot be allocated, NULL is returned, guac_error is set
+ * appropriately, and the given file descriptor is left open.
+ *
+ * @param client
+ *     The guac_client being recorded, to be used for logging any failures or
+ *     overflow of the buffer.
+ *
+ * @param fd
+ *     The file descriptor of the recording file. This file descriptor will be
+ *     closed when the returned socket is freed.
+ *
+ * @param buffer_size
+ *     The number of bytes that may be buffered by the returned socket. This
+ *     MUST be greater than zero.
+ *
+ * @param overflow
+ *     The behavior of the returned socket when its buffer is full.
+ *
+ * @param compression
+ *     The zstd compression level to use, or zero if data should be written
+ *     uncompressed. This is ignored if libguac was built without libzstd.
+ *
+ * @return
+ *     A newly-allocated guac_socket which writes to the given file descriptor
+ *     in the background, or NULL if the socket cannot be allocated.
+ */
+guac_socket* guac_socket_recording(guac_client* client, int fd,
+        size_t buffer_size, guac_recording_overflow overflow,
+        int compression);
+
+/**
+ * Associates the given keyframe index with the given recording socket, such
+ * that keyframes may be written to that index with
+ * guac_socket_recording_begin_keyframe(). The index is automatically freed
+ * when the recording socket is freed.
+ *
+ * @param socket
+ *     The recording socket to associate with the given index. This socket
+ *     MUST have been created with guac_socket_recording().
+ *
+ * @param index
+ *     The guac_socket to which keyframes should be written.
+ *
+ * @param interval
+ *     The minimum amount of time between keyframes, in milliseconds.
+ */
+void guac_socket_recording_set_index(guac_socket* socket, guac_socket* index,
+        int interval);
+
+/**
+ * Begins a new keyframe within the index associated with the given recording
+ * socket, if the socket has an index and enough time has elapsed since the
+ * previous keyframe. The keyframe instruction written to the index refers to
+ * the current position within the recording, which is the end of all data
+ * written to the recording socket as of its last flush. If the recording is
+ * compressed, a new zstd frame will begin at that position, and no keyframe
+ * is written while a previous keyframe is still awaiting its frame. The caller MUST
+ * write the full state of the display as of that position to the returned
+ * index and flush that index, and MUST ensure that no further frames are
+ * written to the recording in the meantime.
+ *
+ * @param socket
+ *     The recording socket to begin a keyframe for. This socket MUST have
+ *     been created with guac_socket_recording().
+ *
+ * @param timestamp
+ *     The timestamp of the frame most recently written to the recording, as
+ *     sent within the "sync" instruction ending that frame.
+ *
+ * @return
+ *     The guac_socket to which the state of the display should be written
+ *     for the new keyframe, or NULL if no keyframe should be written.
+ */
+guac_socket* guac_socket_recording_begin_keyframe(guac_socket* socket,
+        guac_timestamp timestamp);
+
+/**
+ * Divides the recording written by the given recording socket into segments,
+ * each limited by duration and/or size, such that no single file grows for
+ * the life of the session. The recording file given to guac_socket_recording()
+ * becomes the first segment, and each later segment is written to a new file
+ * having the same name with GUAC_RECORDING_SEGMENT_SUFFIX and the number of
+ * that segment appended. New segments are requested at frame boundaries with
+ * guac_socket_recording_begin_segment(). If a compression level is given,
+ * each segment is compressed with zstd by a dedicated thread once closed,
+ * with the final segment compressed when the socket is freed.
+ *
+ * @param socket
+ *     The recording socket to divide into segments. This socket MUST have
+ *     been created with guac_socket_recording() without compression.
+ *
+ * @param path
+ *     The full path to the recording file given to guac_socket_recording().
+ *
+ * @param duration
+ *     The maximum amount of time covered by each segment, in milliseconds,
+ *     or zero if segments should not be limited by duration.
+ *
+ * @param size
+ *     The maximum number of bytes of each segment, or zero if segments should
+ *     not be limited by size.
+ *
+ * @param compression
+ *     The zstd compression level to use for each closed segment, or zero if
+ *     segments should be left uncompressed. This is ignored if libguac was
+ *     built without libzstd.
+ */
+void guac_socket_recording_set_segments(guac_socket* socket,
+        const char* path, int duration, uint64_t size, int compression);
+
+/**
+ * Begins a new segment of the given segmented recording socket at the current
+ * position within the recording, which is the end of all data written to the
+ * recording socket as of its last flush, if the current segment has reached
+ * its duration or size limit. All later data is written to the new segment.
+ * No further segment is begun until the writer thread has begun the
+ * previously-requested segment. If a new segment is begun, the caller MUST
+ * write the full state of the display to the recording socket and flush that
+ * socket, such that the new segment can be played back independently, and
+ * MUST ensure that no further frames are written to the recording in the
+ * meantime.
+ *
+ * @param socket
+ *     The recording socket to begin a segment for. This socket MUST have been
+ *     created with guac_socket_recording().
+ *
+ * @param timestamp
+ *     The timestamp of the frame most recently written to the recording, as
+ *     sent within the "sync" instruction ending that frame.
+ *
+ * @return
+ *     Non-zero if a new segment has begun and the full state of the display
+ *     must be written to the recording socket, zero otherwise.
+ */
+int guac_socket_recording_begin_segment(guac_socket* socket,
+        guac_timestamp timestamp);
+
+#endif
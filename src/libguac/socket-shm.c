@@ -0,0 +1,547 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/mem.h"
+#include "guacamole/socket.h"
+#include "guacamole/socket-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Data associated with an open socket which communicates through a shared
+ * memory transport.
+ */
+typedef struct guac_socket_shm_data {
+
+    /**
+     * The file descriptors making up the transport, ordered as described by
+     * the GUAC_SOCKET_SHM_FD_* constants.
+     */
+    int fds[GUAC_SOCKET_SHM_FD_COUNT];
+
+    /**
+     * The shared memory region, mapped into the address space of this
+     * process.
+     */
+    guac_socket_shm_region* region;
+
+    /**
+     * Whether the peer has disconnected.
+     */
+    atomic_int closed;
+
+    /**
+     * The value of the head of the output ring when the peer was last
+     * signalled, or would have been signalled had it been waiting.
+     */
+    uint32_t published;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+    /**
+     * Lock which protects access to the output ring, guaranteeing atomicity
+     * of writes and flushes.
+     */
+    pthread_mutex_t buffer_lock;
+
+} guac_socket_shm_data;
+
+/**
+ * Signals the given eventfd, waking the peer.
+ *
+ * @param fd
+ *     The eventfd to signal.
+ */
+static void guac_socket_shm_signal(int fd) {
+    uint64_t value = 1;
+    while (write(fd, &value, sizeof(value)) < 0 && errno == EINTR);
+}
+
+/**
+ * Waits for the given eventfd to be signalled by the peer, or for the peer to
+ * disconnect, clearing the signal if received.
+ *
+ * @param socket
+ *     The guac_socket whose peer is expected to signal the eventfd.
+ *
+ * @param fd
+ *     The eventfd to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     A positive value if the eventfd was signalled or the peer has
+ *     disconnected, zero if the timeout elapsed, or a negative value if an
+ *     error occurs.
+ */
+static int guac_socket_shm_wait(guac_socket* socket, int fd,
+        int usec_timeout) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = data->fds[GUAC_SOCKET_SHM_FD_CONTROL], .events = POLLIN }
+    };
+
+    /* Round timeout up to poll()'s granularity */
+    int timeout = usec_timeout < 0 ? -1 : (usec_timeout + 999) / 1000;
+
+    int retval = poll(fds, 2, timeout);
+    if (retval <= 0)
+        return retval;
+
+    /* The peer sends nothing along the control socket, so any activity
+     * there is the peer disconnecting */
+    if (fds[1].revents)
+        atomic_store(&data->closed, 1);
+
+    /* Clear the signal */
+    if (fds[0].revents & POLLIN) {
+        uint64_t value;
+        if (read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            return -1;
+    }
+
+    return 1;
+
+}
+
+/**
+ * Handles a ring whose head and tail are more than GUAC_SOCKET_SHM_RING_SIZE
+ * bytes apart, which can only be the result of the peer corrupting the shared
+ * state of that ring. The transport is considered closed from that point
+ * onward, the control socket is shut down such that the peer sees the
+ * disconnect, and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket whose ring has been corrupted.
+ */
+static void guac_socket_shm_corrupted(guac_socket* socket) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+
+    atomic_store(&data->closed, 1);
+    shutdown(data->fds[GUAC_SOCKET_SHM_FD_CONTROL], SHUT_RDWR);
+
+    guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+    guac_error_message = "Peer of shared memory socket corrupted the state "
+        "of a ring";
+
+}
+
+/**
+ * Makes all data written to the output ring thus far visible to the peer,
+ * signalling the peer if it is waiting for that data. This function must ONLY
+ * be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ */
+static void guac_socket_shm_publish(guac_socket* socket) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    guac_socket_shm_ring* ring = &data->region->output;
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == data->published)
+        return;
+
+    data->published = head;
+
+    /* The store to head by guac_socket_shm_write_handler() is ordered before
+     * this exchange, and thus the peer either sees the new head or has
+     * declared that it is waiting */
+    if (atomic_exchange(&ring->data_waiting, 0))
+        guac_socket_shm_signal(data->fds[GUAC_SOCKET_SHM_FD_OUTPUT_DATA]);
+
+}
+
+/**
+ * Reads data from the input ring of the given socket, waiting for data to
+ * become available if the ring is empty.
+ *
+ * @param socket
+ *     The guac_socket being read from.
+ *
+ * @param buf
+ *     The buffer which should receive the data read.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the buffer.
+ *
+ * @return
+ *     The number of bytes read, zero if the peer has disconnected, or -1 if
+ *     an error occurs.
+ */
+static ssize_t guac_socket_shm_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    guac_socket_shm_ring* ring = &data->region->input;
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t available;
+
+    /* Wait until data is available */
+    while ((available = atomic_load_explicit(&ring->head,
+                    memory_order_acquire) - tail) == 0) {
+
+        if (atomic_load(&data->closed))
+            return 0;
+
+        /* Declare intent to wait, verifying that no data arrived meanwhile */
+        atomic_store(&ring->data_waiting, 1);
+        if (atomic_load(&ring->head) != tail)
+            continue;
+
+        if (guac_socket_shm_wait(socket,
+                    data->fds[GUAC_SOCKET_SHM_FD_INPUT_DATA], -1) < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error waiting for data from shared memory";
+            return -1;
+        }
+
+    }
+
+    /* The peer controls the head, and must never claim more data than the
+     * ring can hold */
+    if (available > GUAC_SOCKET_SHM_RING_SIZE) {
+        guac_socket_shm_corrupted(socket);
+        return -1;
+    }
+
+    if (count > available)
+        count = available;
+
+    /* Copy data, which may wrap around the end of the ring */
+    size_t offset = tail % GUAC_SOCKET_SHM_RING_SIZE;
+    size_t first = GUAC_SOCKET_SHM_RING_SIZE - offset;
+    if (first > count)
+        first = count;
+
+    memcpy(buf, ring->data + offset, first);
+    memcpy((char*) buf + first, ring->data, count - first);
+
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+
+    /* Wake the peer if it is waiting for space */
+    if (atomic_exchange(&ring->space_waiting, 0))
+        guac_socket_shm_signal(data->fds[GUAC_SOCKET_SHM_FD_INPUT_SPACE]);
+
+    return count;
+
+}
+
+/**
+ * Writes data to the output ring of the given socket, waiting for space to
+ * become available if the ring is full. Data is not guaranteed to be visible
+ * to the peer until the socket is flushed.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The buffer containing the data to write.
+ *
+ * @param count
+ *     The number of bytes within the buffer.
+ *
+ * @return
+ *     The number of bytes written, which may be less than the number of bytes
+ *     requested, or -1 if an error occurs.
+ */
+static ssize_t guac_socket_shm_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    guac_socket_shm_ring* ring = &data->region->output;
+
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t space;
+
+    /* Wait until space is available */
+    while ((space = GUAC_SOCKET_SHM_RING_SIZE - (head
+                    - atomic_load_explicit(&ring->tail,
+                        memory_order_acquire))) == 0) {
+
+        if (atomic_load(&data->closed)) {
+            pthread_mutex_unlock(&(data->buffer_lock));
+            guac_error = GUAC_STATUS_CLOSED;
+            guac_error_message = "Peer of shared memory socket disconnected";
+            return -1;
+        }
+
+        /* The peer cannot free space for data it cannot see */
+        guac_socket_shm_publish(socket);
+
+        /* Declare intent to wait, verifying that no space was freed
+         * meanwhile */
+        atomic_store(&ring->space_waiting, 1);
+        if (GUAC_SOCKET_SHM_RING_SIZE - (head - atomic_load(&ring->tail)) != 0)
+            continue;
+
+        if (guac_socket_shm_wait(socket,
+                    data->fds[GUAC_SOCKET_SHM_FD_OUTPUT_SPACE], -1) < 0) {
+            pthread_mutex_unlock(&(data->buffer_lock));
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error waiting for space within shared memory";
+            return -1;
+        }
+
+    }
+
+    /* The peer controls the tail, and must never free more space than the
+     * ring can hold (a tail beyond the head wraps the space computed above
+     * past the size of the ring) */
+    if (space > GUAC_SOCKET_SHM_RING_SIZE) {
+        guac_socket_shm_corrupted(socket);
+        pthread_mutex_unlock(&(data->buffer_lock));
+        return -1;
+    }
+
+    if (count > space)
+        count = space;
+
+    /* Copy data, which may wrap around the end of the ring */
+    size_t offset = head % GUAC_SOCKET_SHM_RING_SIZE;
+    size_t first = GUAC_SOCKET_SHM_RING_SIZE - offset;
+    if (first > count)
+        first = count;
+
+    memcpy(ring->data + offset, buf, first);
+    memcpy(ring->data, (const char*) buf + first, count - first);
+
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+
+    pthread_mutex_unlock(&(data->buffer_lock));
+    return count;
+
+}
+
+/**
+ * Makes all data written to the given socket visible to the peer.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static ssize_t guac_socket_shm_flush_handler(guac_socket* socket) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+
+    pthread_mutex_lock(&(data->buffer_lock));
+    guac_socket_shm_publish(socket);
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+    return 0;
+
+}
+
+/**
+ * Waits for data to become available within the input ring of the given
+ * socket, such that the next read operation will not block.
+ *
+ * @param socket
+ *     The guac_socket to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait for data, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     A positive value on success, zero if the timeout elapsed and no data is
+ *     available, or a negative value if an error occurs.
+ */
+static int guac_socket_shm_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    guac_socket_shm_ring* ring = &data->region->input;
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    /* Data (or disconnection) is immediately readable, or the peer must be
+     * told to signal once it is */
+    if (atomic_load(&ring->head) == tail && !atomic_load(&data->closed)) {
+
+        atomic_store(&ring->data_waiting, 1);
+        if (atomic_load(&ring->head) == tail) {
+
+            int retval = guac_socket_shm_wait(socket,
+                    data->fds[GUAC_SOCKET_SHM_FD_INPUT_DATA], usec_timeout);
+
+            if (retval < 0) {
+                guac_error = GUAC_STATUS_SEE_ERRNO;
+                guac_error_message = "Error while waiting for data on socket";
+                return retval;
+            }
+
+            if (retval == 0) {
+                guac_error = GUAC_STATUS_TIMEOUT;
+                guac_error_message = "Timeout while waiting for data on socket";
+                return 0;
+            }
+
+        }
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Frees all implementation-specific data associated with the given socket,
+ * closing all file descriptors making up the transport, but not the socket
+ * object itself.
+ *
+ * @param socket
+ *     The guac_socket whose associated data should be freed.
+ *
+ * @return
+ *     Zero if the data was successfully freed, non-zero otherwise. This
+ *     implementation always succeeds, and will always return zero.
+ */
+static int guac_socket_shm_free_handler(guac_socket* socket) {
+
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+
+    pthread_mutex_destroy(&(data->socket_lock));
+    pthread_mutex_destroy(&(data->buffer_lock));
+
+    munmap(data->region, sizeof(guac_socket_shm_region));
+
+    for (int i = 0; i < GUAC_SOCKET_SHM_FD_COUNT; i++)
+        close(data->fds[i]);
+
+    guac_mem_free(data);
+    return 0;
+
+}
+
+/**
+ * Acquires exclusive access to the given socket.
+ *
+ * @param socket
+ *     The guac_socket to which exclusive access is required.
+ */
+static void guac_socket_shm_lock_handler(guac_socket* socket) {
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    pthread_mutex_lock(&(data->socket_lock));
+}
+
+/**
+ * Relinquishes exclusive access to the given socket.
+ *
+ * @param socket
+ *     The guac_socket to which exclusive access is no longer required.
+ */
+static void guac_socket_shm_unlock_handler(guac_socket* socket) {
+    guac_socket_shm_data* data = (guac_socket_shm_data*) socket->data;
+    pthread_mutex_unlock(&(data->socket_lock));
+}
+
+guac_socket* guac_socket_open_shm(const int* fds) {
+
+    /* The peer must be unable to shrink the shared memory once mapped, as
+     * accessing pages beyond its end would raise SIGBUS */
+    int seals = fcntl(fds[GUAC_SOCKET_SHM_FD_REGION], F_GET_SEALS);
+    if (seals == -1 || !(seals & F_SEAL_SHRINK) || !(seals & F_SEAL_SEAL)) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Shared memory of transport is not sealed "
+            "against shrinking";
+        return NULL;
+    }
+
+    /* The shared memory must be large enough to contain the region */
+    struct stat region_stat;
+    if (fstat(fds[GUAC_SOCKET_SHM_FD_REGION], &region_stat)
+            || region_stat.st_size < (off_t) sizeof(guac_socket_shm_region)) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Shared memory is too small for the transport";
+        return NULL;
+    }
+
+    guac_socket_shm_region* region = mmap(NULL,
+            sizeof(guac_socket_shm_region), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fds[GUAC_SOCKET_SHM_FD_REGION], 0);
+
+    if (region == MAP_FAILED) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to map shared memory of transport";
+        return NULL;
+    }
+
+    /* Refuse regions not initialized for this version of the layout */
+    if (region->magic != GUAC_SOCKET_SHM_MAGIC
+            || region->version != GUAC_SOCKET_SHM_VERSION) {
+        munmap(region, sizeof(guac_socket_shm_region));
+        guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+        guac_error_message = "Shared memory of transport is not initialized "
+            "for a supported version of the transport";
+        return NULL;
+    }
+
+    guac_socket* socket = guac_socket_alloc();
+    guac_socket_shm_data* data = guac_mem_zalloc(sizeof(guac_socket_shm_data));
+
+    memcpy(data->fds, fds, sizeof(data->fds));
+    data->region = region;
+    data->published = atomic_load(&region->output.head);
+    socket->data = data;
+
+    pthread_mutex_init(&(data->socket_lock), NULL);
+    pthread_mutex_init(&(data->buffer_lock), NULL);
+
+    socket->read_handler   = guac_socket_shm_read_handler;
+    socket->write_handler  = guac_socket_shm_write_handler;
+    socket->select_handler = guac_socket_shm_select_handler;
+    socket->lock_handler   = guac_socket_shm_lock_handler;
+    socket->unlock_handler = guac_socket_shm_unlock_handler;
+    socket->flush_handler  = guac_socket_shm_flush_handler;
+    socket->free_handler   = guac_socket_shm_free_handler;
+
+    return socket;
+
+}
@@ -25,8 +25,11 @@
 #include "guacamole/socket.h"
 #include "wait-fd.h"
 
+#include <limits.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <openssl/ssl.h>
 
@@ -49,25 +52,212 @@ static ssize_t __guac_socket_ssl_read_handler(guac_socket* socket,
 
 }
 
-static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
+/**
+ * Encrypts and sends the entire contents of the given buffer over the SSL
+ * connection of the given socket, retrying as necessary until the whole
+ * buffer is sent, and aborting if an error occurs. Data sent with a single
+ * call to this function is split into as few TLS records as possible.
+ *
+ * @param socket
+ *     The guac_socket associated with the SSL connection over which the
+ *     given buffer should be sent.
+ *
+ * @param buf
+ *     The buffer of data to send.
+ *
+ * @param count
+ *     The number of bytes within the given buffer.
+ *
+ * @return
+ *     Zero if the entire buffer was sent successfully, non-zero if an error
+ *     occurs.
+ */
+static int __guac_socket_ssl_write(guac_socket* socket,
         const void* buf, size_t count) {
 
-    /* Write data to socket */
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
-    int retval;
+    const char* buffer = buf;
 
-    retval = SSL_write(data->ssl, buf, count);
+    while (count > 0) {
 
-    /* Record errors in guac_error */
-    if (retval <= 0) {
-        guac_error = GUAC_STATUS_SEE_ERRNO;
-        guac_error_message = "Error writing data to secure socket";
+        /* SSL_write() accepts at most INT_MAX bytes per call */
+        int length = count > INT_MAX ? INT_MAX : (int) count;
+        int retval = SSL_write(data->ssl, buffer, length);
+
+        /* Record errors in guac_error */
+        if (retval <= 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to secure socket";
+            return 1;
+        }
+
+        buffer += retval;
+        count -= retval;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Sends the contents of the output buffer of the given socket immediately,
+ * without first locking access to the output buffer. This function must ONLY
+ * be called if the buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static int __guac_socket_ssl_flush(guac_socket* socket) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    /* Send remaining bytes in buffer as a single record */
+    if (data->written > 0) {
+
+        if (__guac_socket_ssl_write(socket, data->out_buf, data->written))
+            return 1;
+
+        data->written = 0;
     }
 
+    return 0;
+
+}
+
+/**
+ * Sends the contents of the output buffer of the given socket, writing all
+ * pending data over the SSL connection.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero if the flush operation was successful, non-zero otherwise.
+ */
+static ssize_t __guac_socket_ssl_flush_handler(guac_socket* socket) {
+
+    int retval;
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Flush contents of buffer */
+    retval = __guac_socket_ssl_flush(socket);
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
     return retval;
 
 }
 
+/**
+ * Appends the given data to the output buffer of the given socket, sending
+ * the buffer once it contains a full TLS record's worth of data. Data which
+ * would span several full records is sent directly, without first being
+ * copied into the output buffer. This function must ONLY be called if the
+ * buffer lock has already been acquired.
+ *
+ * @param socket
+ *     The guac_socket to write the given buffer to.
+ *
+ * @param buf
+ *     The buffer to write to the given socket.
+ *
+ * @param count
+ *     The number of bytes in the given buffer.
+ *
+ * @return
+ *     Zero if the data was written successfully, non-zero if an error occurs.
+ */
+static int __guac_socket_ssl_write_buffered(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+    const char* buffer = buf;
+
+    /* Top off any partially-filled buffer, sending it as a full record */
+    if (data->written > 0) {
+
+        size_t remaining = sizeof(data->out_buf) - data->written;
+        size_t length = count < remaining ? count : remaining;
+
+        memcpy(data->out_buf + data->written, buffer, length);
+        data->written += length;
+        buffer += length;
+        count -= length;
+
+        if (data->written == sizeof(data->out_buf)
+                && __guac_socket_ssl_flush(socket))
+            return 1;
+
+    }
+
+    /* Send all whole records directly, bypassing the buffer */
+    size_t direct = count - count % sizeof(data->out_buf);
+    if (direct > 0) {
+
+        if (__guac_socket_ssl_write(socket, buffer, direct))
+            return 1;
+
+        buffer += direct;
+        count -= direct;
+
+    }
+
+    /* Retain the remainder (less than one record) until the next write or
+     * flush (the buffer is necessarily empty if anything remains) */
+    memcpy(data->out_buf + data->written, buffer, count);
+    data->written += count;
+
+    return 0;
+
+}
+
+/**
+ * Writes the given data to the given socket, coalescing the data of
+ * consecutive writes within TLS records of the maximum possible size. The
+ * data is not guaranteed to be sent until the socket is flushed.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The arbitrary buffer containing the data to be written.
+ *
+ * @param count
+ *     The number of bytes contained within the buffer.
+ *
+ * @return
+ *     The number of bytes written, or -1 if an error occurs.
+ */
+static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    int retval;
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    /* Acquire exclusive access to buffer */
+    pthread_mutex_lock(&(data->buffer_lock));
+
+    /* Write provided data to buffer */
+    retval = __guac_socket_ssl_write_buffered(socket, buf, count);
+
+    /* Relinquish exclusive access to buffer */
+    pthread_mutex_unlock(&(data->buffer_lock));
+
+    if (retval)
+        return -1;
+
+    return count;
+
+}
+
 static int __guac_socket_ssl_select_handler(guac_socket* socket, int usec_timeout) {
 
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
@@ -99,6 +289,7 @@ static int __guac_socket_ssl_free_handler(guac_socket* socket) {
     close(data->fd);
 
     pthread_mutex_destroy(&(data->socket_lock));
+    pthread_mutex_destroy(&(data->buffer_lock));
 
     guac_mem_free(data);
     return 0;
@@ -166,6 +357,11 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
     pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutex_init(&(data->buffer_lock), &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
+
+    /* Output buffer is initially empty */
+    data->written = 0;
 
     /* Store file descriptor as socket data */
     data->fd = fd;
@@ -174,6 +370,7 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_ssl_read_handler;
     socket->write_handler  = __guac_socket_ssl_write_handler;
+    socket->flush_handler  = __guac_socket_ssl_flush_handler;
     socket->select_handler = __guac_socket_ssl_select_handler;
     socket->free_handler   = __guac_socket_ssl_free_handler;
     socket->lock_handler   = __guac_socket_ssl_lock_handler;
@@ -0,0 +1,58 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_SOCKET_STATS_H
+#define GUAC_SOCKET_STATS_H
+
+#include "config.h"
+#include "guacamole/socket.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Returns an arbitrary timestamp in nanoseconds, suitable for measuring the
+ * time spent within socket handlers. The difference between return values of
+ * any two calls is equal to the amount of time in nanoseconds between those
+ * calls.
+ *
+ * @return
+ *     An arbitrary nanosecond timestamp.
+ */
+uint64_t guac_socket_stats_clock(void);
+
+/**
+ * Updates the output counters of the given socket to account for data that
+ * has been written to that socket, including data written without invoking
+ * the socket's write handler (such as by broadcast sockets writing to queued
+ * sockets).
+ *
+ * @param socket
+ *     The socket that was written to.
+ *
+ * @param length
+ *     The number of bytes written.
+ *
+ * @param blocked
+ *     The amount of time spent writing the data, in nanoseconds.
+ */
+void guac_socket_stats_record_write(guac_socket* socket, size_t length,
+        uint64_t blocked);
+
+#endif
@@ -18,12 +18,15 @@
  */
 
 #include "config.h"
+#include "socket-base64.h"
+#include "socket-stats.h"
 
 #include "guacamole/mem.h"
 #include "guacamole/error.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
 #include "guacamole/timestamp.h"
+#include "probe.h"
 
 #include <inttypes.h>
 #include <pthread.h>
@@ -80,17 +83,54 @@ static void* __guac_socket_keep_alive_thread(void* data) {
 
 }
 
+uint64_t guac_socket_stats_clock(void) {
+    return guac_timestamp_current_ns();
+}
+
+void guac_socket_stats_record_write(guac_socket* socket, size_t length,
+        uint64_t blocked) {
+
+    pthread_mutex_lock(&(socket->__stats_lock));
+
+    guac_socket_stats* stats = &(socket->__stats);
+    stats->bytes_written += length;
+    stats->write_blocked += blocked;
+    stats->in_flight += length;
+
+    if (stats->in_flight > stats->max_in_flight)
+        stats->max_in_flight = stats->in_flight;
+
+    pthread_mutex_unlock(&(socket->__stats_lock));
+
+}
+
+void guac_socket_get_stats(guac_socket* socket, guac_socket_stats* stats) {
+    pthread_mutex_lock(&(socket->__stats_lock));
+    *stats = socket->__stats;
+    pthread_mutex_unlock(&(socket->__stats_lock));
+}
+
 static ssize_t __guac_socket_write(guac_socket* socket,
         const void* buf, size_t count) {
 
     /* Update timestamp of last write */
     socket->last_write_timestamp = guac_timestamp_current();
 
-    /* If handler defined, call it. */
-    if (socket->write_handler)
-        return socket->write_handler(socket, buf, count);
+    /* If handler defined, call it, recording how long the handler takes */
+    if (socket->write_handler) {
+
+        uint64_t start = guac_socket_stats_clock();
+        ssize_t written = socket->write_handler(socket, buf, count);
+
+        guac_socket_stats_record_write(socket, written > 0 ? written : 0,
+                guac_socket_stats_clock() - start);
+
+        return written;
+
+    }
 
     /* Otherwise, pretend everything was written. */
+    guac_socket_stats_record_write(socket, count, 0);
     return count;
 
 }
@@ -121,8 +161,19 @@ ssize_t guac_socket_write(guac_socket* socket,
 ssize_t guac_socket_read(guac_socket* socket, void* buf, size_t count) {
 
     /* If handler defined, call it. */
-    if (socket->read_handler)
-        return socket->read_handler(socket, buf, count);
+    if (socket->read_handler) {
+
+        ssize_t length = socket->read_handler(socket, buf, count);
+
+        if (length > 0) {
+            pthread_mutex_lock(&(socket->__stats_lock));
+            socket->__stats.bytes_read += length;
+            pthread_mutex_unlock(&(socket->__stats_lock));
+        }
+
+        return length;
+
+    }
 
     /* Otherwise, pretend nothing was read. */
     return 0;
@@ -159,6 +210,16 @@ guac_socket* guac_socket_alloc() {
     /* No keep alive ping by default */
     socket->__keep_alive_enabled = 0;
 
+    /* All data is interactive unless stated otherwise */
+    socket->__priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
+
+    /* All elements are text unless binary elements are negotiated */
+    socket->__binary = 0;
+
+    /* No output yet */
+    pthread_mutex_init(&(socket->__stats_lock), NULL);
+    memset(&(socket->__stats), 0, sizeof(socket->__stats));
+
     /* No handlers yet */
     socket->read_handler   = NULL;
     socket->write_handler  = NULL;
@@ -181,6 +242,10 @@ void guac_socket_require_keep_alive(guac_socket* socket) {
 
 }
 
+void guac_socket_enable_binary(guac_socket* socket) {
+    socket->__binary = 1;
+}
+
 void guac_socket_instruction_begin(guac_socket* socket) {
 
     /* Call instruction begin handler if defined */
@@ -191,12 +256,20 @@ void guac_socket_instruction_begin(guac_socket* socket) {
 
 void guac_socket_instruction_end(guac_socket* socket) {
 
+    /* Priority applies only to the instruction that set it */
+    socket->__priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
+
     /* Call instruction end handler if defined */
     if (socket->unlock_handler)
         socket->unlock_handler(socket);
 
 }
 
+void guac_socket_set_priority(guac_socket* socket,
+        guac_socket_priority priority) {
+    socket->__priority = priority;
+}
+
 void guac_socket_free(guac_socket* socket) {
 
     guac_socket_flush(socket);
@@ -214,6 +287,7 @@ void guac_socket_free(guac_socket* socket) {
         pthread_join(socket->__keep_alive_thread, NULL);
     }
 
+    pthread_mutex_destroy(&(socket->__stats_lock));
     guac_mem_free(socket);
 }
 
@@ -312,33 +386,36 @@ ssize_t __guac_socket_encode_base64(int a, int b, int c, char* output) {
     return 0;
 }
 
-ssize_t guac_socket_flush_base64(guac_socket* socket) {
-    const unsigned char* src = socket->__ready_buf;
+/**
+ * The fastest base64 implementation supported by the current processor, as
+ * selected by guac_socket_base64_init().
+ */
+static guac_socket_base64_function* guac_socket_base64_encode =
+    guac_socket_base64_scalar;
 
-    int encodedCount = 0;
-    int remaining = socket->__ready;
+/**
+ * Control variable guaranteeing that guac_socket_base64_init() is invoked
+ * exactly once.
+ */
+static pthread_once_t guac_socket_base64_once = PTHREAD_ONCE_INIT;
 
-    /* Encode bytes in groups of three */
-    while (remaining > 2) {
-        __guac_socket_encode_base64(src[0], src[1], src[2], socket->__encoded_buf + encodedCount);
+/**
+ * Selects the base64 implementation used by all sockets. This function is
+ * invoked exactly once via pthread_once().
+ */
+static void guac_socket_base64_init() {
+    guac_socket_base64_encode = guac_socket_base64_select(NULL);
+}
 
-        remaining -= 3;
-        src += 3;
-        encodedCount += 4;
-    }
+ssize_t guac_socket_flush_base64(guac_socket* socket) {
 
-    /* Take care of partial remnants */
-    if (remaining == 2) {
-        __guac_socket_encode_base64(src[0], src[1], -1, socket->__encoded_buf + encodedCount);
-        encodedCount += 4;
-    }
-    else if (remaining == 1) {
-        __guac_socket_encode_base64(src[0], -1, -1, socket->__encoded_buf + encodedCount);
-        encodedCount += 4;
-    }
+    pthread_once(&guac_socket_base64_once, guac_socket_base64_init);
+
+    size_t encoded_count = guac_socket_base64_encode(socket->__ready_buf,
+            socket->__ready, socket->__encoded_buf);
 
     /* Write buffer to socket */
-    int retval = guac_socket_write(socket, socket->__encoded_buf, encodedCount);
+    int retval = guac_socket_write(socket, socket->__encoded_buf, encoded_count);
     if (retval < 0)
         return retval;
 
@@ -355,7 +432,34 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
     int len;
     int retval;
 
+    pthread_once(&guac_socket_base64_once, guac_socket_base64_init);
+
     while (remaining > 0) {
+
+        /* If nothing is waiting in the ready buffer, encode large amounts of
+         * data directly rather than copying that data into the ready buffer
+         * first. As GUAC_SOCKET_BASE64_CHUNK_SIZE and the size of the ready
+         * buffer are multiples of three, the encoded result is identical. */
+        if (socket->__ready == 0 && remaining >= GUAC_SOCKET_BASE64_READY_BUFFER_SIZE) {
+
+            char encoded[GUAC_SOCKET_BASE64_ENCODED_LENGTH(GUAC_SOCKET_BASE64_CHUNK_SIZE)];
+
+            size_t chunk = GUAC_SOCKET_BASE64_CHUNK_SIZE;
+            if (remaining < chunk)
+                chunk = remaining - remaining % 3;
+
+            size_t encoded_count = guac_socket_base64_encode(src, chunk, encoded);
+
+            retval = guac_socket_write(socket, encoded, encoded_count);
+            if (retval < 0)
+                return retval;
+
+            src += chunk;
+            remaining -= chunk;
+            continue;
+
+        }
+
         /* Fill ready buffer as much as possible */
         len = GUAC_SOCKET_BASE64_READY_BUFFER_SIZE - socket->__ready;
         if (remaining < len)
@@ -381,11 +485,23 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
 
 ssize_t guac_socket_flush(guac_socket* socket) {
 
-    /* If handler defined, call it. */
+    ssize_t result = 0;
+    uint64_t start = guac_socket_stats_clock();
+
+    /* If handler defined, call it. Otherwise, do nothing. */
     if (socket->flush_handler)
-        return socket->flush_handler(socket);
+        result = socket->flush_handler(socket);
 
-    /* Otherwise, do nothing */
-    return 0;
+    uint64_t blocked = guac_socket_stats_clock() - start;
+    GUAC_PROBE3(socket_flush, socket, result, blocked);
+
+    /* Record flush and the time taken */
+    pthread_mutex_lock(&(socket->__stats_lock));
+    socket->__stats.write_blocked += blocked;
+    socket->__stats.flushes++;
+    socket->__stats.in_flight = 0;
+    pthread_mutex_unlock(&(socket->__stats_lock));
+
+    return result;
 
 }
@@ -20,136 +20,565 @@
 #include "config.h"
 #include "guacamole/error.h"
 #include "guacamole/tcp.h"
+#include "guacamole/timestamp.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-int guac_tcp_connect(const char* hostname, const char* port, const int timeout) {
+/**
+ * A single resolved address.
+ */
+typedef struct guac_tcp_address {
+
+    /**
+     * The address family of the address, such as AF_INET or AF_INET6.
+     */
+    int family;
+
+    /**
+     * The number of bytes of the address structure that are meaningful.
+     */
+    socklen_t length;
+
+    /**
+     * The address itself.
+     */
+    struct sockaddr_storage address;
+
+} guac_tcp_address;
+
+/**
+ * The addresses resolved for a single hostname and port, as stored within
+ * the shared cache of resolved addresses.
+ */
+typedef struct guac_tcp_dns_cache_entry {
+
+    /**
+     * The hostname that was resolved.
+     */
+    char hostname[GUAC_TCP_DNS_CACHE_MAX_HOSTNAME];
+
+    /**
+     * The port that was resolved.
+     */
+    char port[GUAC_TCP_DNS_CACHE_MAX_PORT];
+
+    /**
+     * The time after which this entry is no longer valid, as returned by
+     * guac_timestamp_current(), or zero if this entry is unused.
+     */
+    guac_timestamp expires;
+
+    /**
+     * The number of addresses stored within the addresses array.
+     */
+    int count;
+
+    /**
+     * The resolved addresses, in the order returned by getaddrinfo().
+     */
+    guac_tcp_address addresses[GUAC_TCP_MAX_ADDRESSES];
+
+} guac_tcp_dns_cache_entry;
+
+/**
+ * A cache of resolved addresses, stored within memory shared between the
+ * process that created the cache and all processes forked from it.
+ */
+typedef struct guac_tcp_dns_cache {
+
+    /**
+     * Lock which must be held while reading or modifying any entry. This lock
+     * is shared between processes.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * The number of milliseconds that each entry remains valid.
+     */
+    guac_timestamp ttl;
+
+    /**
+     * All entries of the cache.
+     */
+    guac_tcp_dns_cache_entry entries[GUAC_TCP_DNS_CACHE_SIZE];
+
+} guac_tcp_dns_cache;
+
+/**
+ * The cache of resolved addresses created with guac_tcp_dns_cache_init(), or
+ * NULL if no such cache has been created.
+ */
+static guac_tcp_dns_cache* guac_tcp_dns_cache_shared = NULL;
+
+/**
+ * Acquires the lock of the given cache. If another process terminated while
+ * holding that lock, the cache may have been left partially modified, and
+ * all entries are discarded.
+ *
+ * @param cache
+ *     The cache to lock.
+ *
+ * @return
+ *     Zero if the lock was acquired, non-zero otherwise.
+ */
+static int guac_tcp_dns_cache_lock(guac_tcp_dns_cache* cache) {
+
+    int retval = pthread_mutex_lock(&cache->lock);
+
+#if HAVE_DECL_PTHREAD_MUTEXATTR_SETROBUST
+    if (retval == EOWNERDEAD) {
+        memset(cache->entries, 0, sizeof(cache->entries));
+        retval = pthread_mutex_consistent(&cache->lock);
+    }
+#endif
+
+    return retval;
+
+}
+
+/**
+ * Retrieves the addresses cached for the given hostname and port, if any.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param hostname
+ *     The hostname that was resolved.
+ *
+ * @param port
+ *     The port that was resolved.
+ *
+ * @param addresses
+ *     The array which should receive the cached addresses. This array must
+ *     have room for GUAC_TCP_MAX_ADDRESSES addresses.
+ *
+ * @return
+ *     The number of addresses stored within the given array, or zero if no
+ *     addresses are cached for the given hostname and port.
+ */
+static int guac_tcp_dns_cache_get(guac_tcp_dns_cache* cache,
+        const char* hostname, const char* port, guac_tcp_address* addresses) {
+
+    if (guac_tcp_dns_cache_lock(cache))
+        return 0;
+
+    int count = 0;
+    guac_timestamp now = guac_timestamp_current();
 
-    int retval;
+    for (int i = 0; i < GUAC_TCP_DNS_CACHE_SIZE; i++) {
 
-    int fd = EBADFD;
-    struct addrinfo* addresses;
-    struct addrinfo* current_address;
+        guac_tcp_dns_cache_entry* entry = &cache->entries[i];
+        if (entry->expires > now && strcmp(entry->hostname, hostname) == 0
+                && strcmp(entry->port, port) == 0) {
+            count = entry->count;
+            memcpy(addresses, entry->addresses,
+                    sizeof(guac_tcp_address) * count);
+            break;
+        }
+
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return count;
 
-    char connected_address[1024];
-    char connected_port[64];
+}
 
+/**
+ * Stores the given addresses within the cache, replacing any addresses
+ * already cached for the same hostname and port. If the cache is full, the
+ * entry closest to expiring is replaced. Hostnames and ports too long to be
+ * stored are not cached.
+ *
+ * @param cache
+ *     The cache to update.
+ *
+ * @param hostname
+ *     The hostname that was resolved.
+ *
+ * @param port
+ *     The port that was resolved.
+ *
+ * @param addresses
+ *     The resolved addresses.
+ *
+ * @param count
+ *     The number of resolved addresses, which must be no greater than
+ *     GUAC_TCP_MAX_ADDRESSES.
+ */
+static void guac_tcp_dns_cache_put(guac_tcp_dns_cache* cache,
+        const char* hostname, const char* port,
+        const guac_tcp_address* addresses, int count) {
+
+    if (strlen(hostname) >= GUAC_TCP_DNS_CACHE_MAX_HOSTNAME
+            || strlen(port) >= GUAC_TCP_DNS_CACHE_MAX_PORT)
+        return;
+
+    if (guac_tcp_dns_cache_lock(cache))
+        return;
+
+    /* Prefer the existing entry for the same hostname and port, falling back
+     * to whichever entry expires first (unused entries expire at zero) */
+    guac_tcp_dns_cache_entry* replaced = &cache->entries[0];
+    for (int i = 0; i < GUAC_TCP_DNS_CACHE_SIZE; i++) {
+
+        guac_tcp_dns_cache_entry* entry = &cache->entries[i];
+        if (strcmp(entry->hostname, hostname) == 0
+                && strcmp(entry->port, port) == 0) {
+            replaced = entry;
+            break;
+        }
+
+        if (entry->expires < replaced->expires)
+            replaced = entry;
+
+    }
+
+    strcpy(replaced->hostname, hostname);
+    strcpy(replaced->port, port);
+    replaced->expires = guac_timestamp_current() + cache->ttl;
+    replaced->count = count;
+    memcpy(replaced->addresses, addresses, sizeof(guac_tcp_address) * count);
+
+    pthread_mutex_unlock(&cache->lock);
+
+}
+
+/**
+ * Resolves the given hostname and port, consulting the shared cache of
+ * resolved addresses first, if such a cache has been created.
+ *
+ * @param hostname
+ *     The hostname or IP address to resolve.
+ *
+ * @param port
+ *     The TCP port to resolve.
+ *
+ * @param addresses
+ *     The array which should receive the resolved addresses, in order of
+ *     preference. This array must have room for GUAC_TCP_MAX_ADDRESSES
+ *     addresses.
+ *
+ * @param count
+ *     Pointer to an int which should receive the number of resolved
+ *     addresses.
+ *
+ * @return
+ *     Zero if the hostname and port were resolved successfully, or the
+ *     non-zero error code returned by getaddrinfo() otherwise.
+ */
+static int guac_tcp_resolve(const char* hostname, const char* port,
+        guac_tcp_address* addresses, int* count) {
+
+    guac_tcp_dns_cache* cache = guac_tcp_dns_cache_shared;
+    if (cache != NULL) {
+        *count = guac_tcp_dns_cache_get(cache, hostname, port, addresses);
+        if (*count > 0)
+            return 0;
+    }
+
+    struct addrinfo* resolved;
     struct addrinfo hints = {
         .ai_family   = AF_UNSPEC,
         .ai_socktype = SOCK_STREAM,
         .ai_protocol = IPPROTO_TCP
     };
 
+    int retval = getaddrinfo(hostname, port, &hints, &resolved);
+    if (retval)
+        return retval;
+
+    *count = 0;
+    for (struct addrinfo* current = resolved;
+            current != NULL && *count < GUAC_TCP_MAX_ADDRESSES;
+            current = current->ai_next) {
+
+        if (current->ai_addrlen > sizeof(struct sockaddr_storage))
+            continue;
+
+        guac_tcp_address* address = &addresses[(*count)++];
+        address->family = current->ai_family;
+        address->length = current->ai_addrlen;
+        memcpy(&address->address, current->ai_addr, current->ai_addrlen);
+
+    }
+
+    freeaddrinfo(resolved);
+
+    if (cache != NULL && *count > 0)
+        guac_tcp_dns_cache_put(cache, hostname, port, addresses, *count);
+
+    return 0;
+
+}
+
+/**
+ * Reorders the given addresses such that address families alternate,
+ * beginning with the family of the first address, as recommended by
+ * RFC 8305. The relative order of the addresses within each family is
+ * preserved.
+ *
+ * @param addresses
+ *     The addresses to reorder, in order of preference.
+ *
+ * @param count
+ *     The number of addresses.
+ */
+static void guac_tcp_interleave(guac_tcp_address* addresses, int count) {
+
+    if (count <= 2)
+        return;
+
+    guac_tcp_address preferred[GUAC_TCP_MAX_ADDRESSES];
+    guac_tcp_address other[GUAC_TCP_MAX_ADDRESSES];
+    int preferred_count = 0;
+    int other_count = 0;
+
+    /* Split addresses by whether they share the family of the first */
+    for (int i = 0; i < count; i++) {
+        if (addresses[i].family == addresses[0].family)
+            preferred[preferred_count++] = addresses[i];
+        else
+            other[other_count++] = addresses[i];
+    }
+
+    /* Merge, alternating between the two groups */
+    int p = 0;
+    int o = 0;
+    for (int i = 0; i < count; i++) {
+        if (o >= other_count || (p < preferred_count && p <= o))
+            addresses[i] = preferred[p++];
+        else
+            addresses[i] = other[o++];
+    }
+
+}
+
+/**
+ * Begins a non-blocking connection attempt to the given address.
+ *
+ * @param address
+ *     The address to connect to.
+ *
+ * @param flags
+ *     Pointer to an int which should receive the file status flags of the
+ *     new socket prior to it being made non-blocking.
+ *
+ * @param connected
+ *     Pointer to an int which is set to non-zero if the connection was
+ *     established immediately, or to zero if the connection is in progress.
+ *
+ * @return
+ *     The file descriptor of the new socket, or -1 if the attempt failed,
+ *     in which case guac_error is set appropriately.
+ */
+static int guac_tcp_start_attempt(const guac_tcp_address* address,
+        int* flags, int* connected) {
+
+    int fd = socket(address->family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to create socket.";
+        return -1;
+    }
+
+    /* Get current socket options */
+    if ((*flags = fcntl(fd, F_GETFL, NULL)) < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to retrieve socket options.";
+        close(fd);
+        return -1;
+    }
+
+    /* Set socket to non-blocking */
+    if (fcntl(fd, F_SETFL, *flags | O_NONBLOCK) < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to set non-blocking socket.";
+        close(fd);
+        return -1;
+    }
+
+    *connected = 0;
+    if (connect(fd, (const struct sockaddr*) &address->address,
+                address->length) == 0)
+        *connected = 1;
+
+    else if (errno != EINPROGRESS) {
+        guac_error = GUAC_STATUS_REFUSED;
+        guac_error_message = "Unable to connect via socket.";
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+
+}
+
+int guac_tcp_connect(const char* hostname, const char* port, const int timeout) {
+
+    guac_tcp_address addresses[GUAC_TCP_MAX_ADDRESSES];
+    int count;
+
     /* Get addresses for requested hostname and port. */
-    if ((retval = getaddrinfo(hostname, port, &hints, &addresses))) {
+    int retval = guac_tcp_resolve(hostname, port, addresses, &count);
+    if (retval) {
         guac_error = GUAC_STATUS_INVALID_ARGUMENT;
         guac_error_message = "Error parsing address or port.";
         return retval;
     }
 
-    /* Attempt connection to each address until success */
-    for (current_address = addresses; current_address != NULL; current_address = current_address->ai_next) {
+    guac_tcp_interleave(addresses, count);
 
-        /* Resolve hostname */
-        if ((retval = getnameinfo(current_address->ai_addr,
-                current_address->ai_addrlen,
-                connected_address, sizeof(connected_address),
-                connected_port, sizeof(connected_port),
-                NI_NUMERICHOST | NI_NUMERICSERV))) {
+    /* Connection attempts currently in progress */
+    struct pollfd pending[GUAC_TCP_MAX_ADDRESSES];
+    int pending_flags[GUAC_TCP_MAX_ADDRESSES];
+    guac_timestamp pending_started[GUAC_TCP_MAX_ADDRESSES];
+    int active = 0;
 
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Error resolving host.";
+    int next = 0;
+    guac_timestamp next_start = 0;
+    guac_timestamp attempt_timeout = (guac_timestamp) timeout * 1000;
+
+    int fd = -1;
+    int flags = 0;
+
+    while (fd < 0 && (active > 0 || next < count)) {
+
+        guac_timestamp now = guac_timestamp_current();
+
+        /* Start the next attempt once the previous attempt has had its
+         * chance, or immediately if no attempts remain in progress */
+        if (next < count && (active == 0 || now >= next_start)) {
+
+            int connected;
+            int attempt_flags;
+            int attempt_fd = guac_tcp_start_attempt(&addresses[next++],
+                    &attempt_flags, &connected);
+
+            if (attempt_fd >= 0 && connected) {
+                fd = attempt_fd;
+                flags = attempt_flags;
+                break;
+            }
+
+            if (attempt_fd >= 0) {
+                pending[active].fd = attempt_fd;
+                pending[active].events = POLLOUT;
+                pending_flags[active] = attempt_flags;
+                pending_started[active] = now;
+                active++;
+            }
+
+            next_start = now + GUAC_TCP_CONNECTION_ATTEMPT_DELAY;
             continue;
+
         }
 
-        /* Get socket or return the error. */
-        fd = socket(current_address->ai_family, SOCK_STREAM, 0);
-        if (fd < 0) {
-            freeaddrinfo(addresses);
-            return fd;
+        /* Wait until an attempt completes, the earliest attempt times out,
+         * or the next attempt is due */
+        guac_timestamp wait = attempt_timeout;
+        for (int i = 0; i < active; i++) {
+            guac_timestamp remaining = pending_started[i] + attempt_timeout - now;
+            if (remaining < wait)
+                wait = remaining;
         }
 
-        /* Variable to store current socket options. */
-        int opt;
+        if (next < count && next_start - now < wait)
+            wait = next_start - now;
 
-        /* Get current socket options */
-        if ((opt = fcntl(fd, F_GETFL, NULL)) < 0) {
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Failed to retrieve socket options.";
-            close(fd);
-            continue;
-        }
+        if (wait < 0)
+            wait = 0;
 
-        /* Set socket to non-blocking */
-        if (fcntl(fd, F_SETFL, opt | O_NONBLOCK) < 0) {
+        if (poll(pending, active, wait) < 0 && errno != EINTR) {
             guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Failed to set non-blocking socket.";
-            close(fd);
-            continue;
+            guac_error_message = "Error attempting to connect via socket.";
+            break;
         }
 
-        /* Structure that stores our timeout setting. */
-        struct timeval tv;
-        tv.tv_sec = timeout;
-        tv.tv_usec = 0;
-
-        /* Connect and wait for timeout */
-        if ((retval = connect(fd, current_address->ai_addr, current_address->ai_addrlen)) < 0) {
-            if (errno == EINPROGRESS) {
-                /* Set up timeout. */
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(fd, &fdset);
-                
-                retval = select(fd + 1, NULL, &fdset, NULL, &tv);
+        now = guac_timestamp_current();
+
+        /* Check every attempt, removing those which have failed */
+        for (int i = 0; i < active && fd < 0;) {
+
+            int failed = 0;
+
+            if (pending[i].revents) {
+
+                int error;
+                socklen_t error_length = sizeof(error);
+
+                /* Successful connection */
+                if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR,
+                            &error, &error_length) == 0 && error == 0) {
+                    fd = pending[i].fd;
+                    flags = pending_flags[i];
+                }
+
+                else {
+                    guac_error = GUAC_STATUS_REFUSED;
+                    guac_error_message = "Unable to connect via socket.";
+                    failed = 1;
+                }
+
             }
-            
-            else {
+
+            else if (now - pending_started[i] >= attempt_timeout) {
                 guac_error = GUAC_STATUS_REFUSED;
-                guac_error_message = "Unable to connect via socket.";
-                close(fd);
-                continue;
+                guac_error_message = "Timeout connecting via socket.";
+                failed = 1;
             }
-        }
 
-        /* Successful connection */
-        if (retval > 0) {
-            /* Restore previous socket options. */
-            if (fcntl(fd, F_SETFL, opt) < 0) {
-                guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-                guac_error_message = "Failed to reset socket options.";
-                close(fd);
+            /* Remove completed attempts, moving successful attempts out of
+             * the set of attempts to be abandoned */
+            if (failed || fd >= 0) {
+
+                if (failed)
+                    close(pending[i].fd);
+
+                active--;
+                pending[i] = pending[active];
+                pending_flags[i] = pending_flags[active];
+                pending_started[i] = pending_started[active];
+
+                /* Failed attempts need not delay the next attempt */
+                if (failed)
+                    next_start = now;
+
                 continue;
+
             }
 
-            break;
-        }
+            i++;
 
-        if (retval == 0) {
-            guac_error = GUAC_STATUS_REFUSED;
-            guac_error_message = "Timeout connecting via socket.";
         }
-        else {
-            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
-            guac_error_message = "Error attempting to connect via socket.";
-        }
-
-        /* Some error has occurred - free resources before next iteration. */
-        close(fd);
 
     }
 
-    /* Free addrinfo */
-    freeaddrinfo(addresses);
+    /* Abandon all other attempts */
+    for (int i = 0; i < active; i++)
+        close(pending[i].fd);
+
+    /* Restore previous socket options. */
+    if (fd >= 0 && fcntl(fd, F_SETFL, flags) < 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Failed to reset socket options.";
+        close(fd);
+        return -1;
+    }
 
     /* If unable to connect to anything, set error status. */
-    if (current_address == NULL) {
+    if (fd < 0) {
         guac_error = GUAC_STATUS_REFUSED;
         guac_error_message = "Unable to connect to remote host.";
     }
@@ -158,3 +587,57 @@ int guac_tcp_connect(const char* hostname, const char* port, const int timeout)
     return fd;
 
 }
+
+int guac_tcp_dns_cache_init(int ttl) {
+
+    if (ttl <= 0) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "The lifetime of cached addresses must be "
+            "positive.";
+        return 1;
+    }
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+
+    /* Anonymous mappings are zeroed, thus all entries begin unused */
+    guac_tcp_dns_cache* cache = mmap(NULL, sizeof(guac_tcp_dns_cache),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate cache of resolved addresses.";
+        return 1;
+    }
+
+    /* The cache is modified by all processes sharing the mapping, any one of
+     * which may terminate at any time */
+    pthread_mutexattr_t lock_attributes;
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+#if HAVE_DECL_PTHREAD_MUTEXATTR_SETROBUST
+    pthread_mutexattr_setrobust(&lock_attributes, PTHREAD_MUTEX_ROBUST);
+#endif
+
+    int retval = pthread_mutex_init(&cache->lock, &lock_attributes);
+    pthread_mutexattr_destroy(&lock_attributes);
+
+    if (retval) {
+        munmap(cache, sizeof(guac_tcp_dns_cache));
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to initialize lock of cache of resolved "
+            "addresses.";
+        return 1;
+    }
+
+    cache->ttl = (guac_timestamp) ttl * 1000;
+    guac_tcp_dns_cache_shared = cache;
+    return 0;
+
+#else
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "Caching of resolved addresses is not supported on "
+        "this platform.";
+    return 1;
+#endif
+
+}
+
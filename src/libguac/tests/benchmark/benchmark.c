@@ -0,0 +1,283 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The result of a single benchmark.
+ */
+typedef struct benchmark_result {
+
+    /**
+     * The name of the benchmark.
+     */
+    const char* name;
+
+    /**
+     * The number of operations performed within each repetition.
+     */
+    int iterations;
+
+    /**
+     * The median time taken by all repetitions, in nanoseconds.
+     */
+    uint64_t median;
+
+    /**
+     * The time taken by the fastest repetition, in nanoseconds.
+     */
+    uint64_t fastest;
+
+    /**
+     * The number of bytes of input processed within each repetition, or zero
+     * if a throughput in bytes is not meaningful.
+     */
+    uint64_t bytes;
+
+} benchmark_result;
+
+/**
+ * All results recorded thus far.
+ */
+static benchmark_result benchmark_results[BENCHMARK_MAX_RESULTS];
+
+/**
+ * The number of results within benchmark_results.
+ */
+static int benchmark_result_count = 0;
+
+/**
+ * The names (or name prefixes) of the benchmarks selected on the command
+ * line.
+ */
+static char** benchmark_filters = NULL;
+
+/**
+ * The number of entries within benchmark_filters.
+ */
+static int benchmark_filter_count = 0;
+
+int benchmark_selected(const char* name) {
+
+    if (benchmark_filter_count == 0)
+        return 1;
+
+    for (int i = 0; i < benchmark_filter_count; i++) {
+        if (strncmp(name, benchmark_filters[i],
+                    strlen(benchmark_filters[i])) == 0)
+            return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Comparator for qsort() which orders durations in ascending order.
+ *
+ * @param a
+ *     Pointer to the first duration to compare.
+ *
+ * @param b
+ *     Pointer to the second duration to compare.
+ *
+ * @return
+ *     A negative value, zero, or a positive value if the first duration is
+ *     less than, equal to, or greater than the second duration respectively.
+ */
+static int benchmark_compare_durations(const void* a, const void* b) {
+
+    uint64_t duration_a = *((const uint64_t*) a);
+    uint64_t duration_b = *((const uint64_t*) b);
+
+    return (duration_a > duration_b) - (duration_a < duration_b);
+
+}
+
+void benchmark_record(const char* name, int iterations, uint64_t* durations,
+        uint64_t bytes) {
+
+    if (benchmark_result_count == BENCHMARK_MAX_RESULTS) {
+        fprintf(stderr, "Too many benchmark results. Result of \"%s\" "
+                "dropped.\n", name);
+        return;
+    }
+
+    qsort(durations, BENCHMARK_REPETITIONS, sizeof(uint64_t),
+            benchmark_compare_durations);
+
+    benchmark_result* result = &benchmark_results[benchmark_result_count++];
+    result->name = name;
+    result->iterations = iterations;
+    result->median = durations[BENCHMARK_REPETITIONS / 2];
+    result->fastest = durations[0];
+    result->bytes = bytes;
+
+    /* Report progress in human-readable form, as the JSON results are only
+     * written once all benchmarks have completed */
+    fprintf(stderr, "%-40s %12.1f ns/op\n", name,
+            (double) result->median / iterations);
+
+}
+
+void benchmark_run(const char* name, benchmark_function* function,
+        void* data, int iterations) {
+
+    if (!benchmark_selected(name))
+        return;
+
+    uint64_t durations[BENCHMARK_REPETITIONS];
+    uint64_t bytes = function(data, iterations);
+
+    for (int i = 0; i < BENCHMARK_REPETITIONS; i++) {
+        uint64_t start = benchmark_clock();
+        function(data, iterations);
+        durations[i] = benchmark_clock() - start;
+    }
+
+    benchmark_record(name, iterations, durations, bytes);
+
+}
+
+uint64_t benchmark_clock(void) {
+
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+
+    return (uint64_t) current.tv_sec * 1000000000 + current.tv_nsec;
+
+}
+
+uint32_t benchmark_random(uint32_t* state) {
+
+    /* Xorshift (see "Xorshift RNGs" by George Marsaglia) */
+    uint32_t value = *state;
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+
+    return *state = value;
+
+}
+
+/**
+ * Write handler for sockets allocated with benchmark_socket_alloc(), which
+ * discards all written data.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes given.
+ */
+static ssize_t benchmark_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+    return count;
+}
+
+guac_socket* benchmark_socket_alloc(void) {
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->write_handler = benchmark_socket_write;
+
+    return socket;
+
+}
+
+/**
+ * Writes all recorded results to STDOUT as a single JSON object.
+ */
+static void benchmark_write_results(void) {
+
+    printf("{\n    \"repetitions\": %i,\n    \"benchmarks\": [",
+            BENCHMARK_REPETITIONS);
+
+    for (int i = 0; i < benchmark_result_count; i++) {
+
+        benchmark_result* result = &benchmark_results[i];
+
+        double ns_per_op = (double) result->median / result->iterations;
+        double min_ns_per_op = (double) result->fastest / result->iterations;
+
+        printf("%s\n        {\n", i > 0 ? "," : "");
+        printf("            \"name\": \"%s\",\n", result->name);
+        printf("            \"iterations\": %i,\n", result->iterations);
+        printf("            \"ns_per_op\": %.1f,\n", ns_per_op);
+        printf("            \"min_ns_per_op\": %.1f,\n", min_ns_per_op);
+        printf("            \"ops_per_sec\": %.1f", 1e9 / ns_per_op);
+
+        if (result->bytes)
+            printf(",\n            \"bytes_per_sec\": %.1f",
+                    result->bytes * 1e9 / result->median);
+
+        printf("\n        }");
+
+    }
+
+    printf("\n    ]\n}\n");
+
+}
+
+/**
+ * Runs all benchmarks (or only those named on the command line), writing the
+ * results to STDOUT as JSON and progress to STDERR.
+ *
+ * @param argc
+ *     The number of command-line arguments.
+ *
+ * @param argv
+ *     The command-line arguments, each of which (apart from the program name)
+ *     is the name or name prefix of a benchmark to run.
+ *
+ * @return
+ *     Zero, always.
+ */
+int main(int argc, char** argv) {
+
+    benchmark_filters = argv + 1;
+    benchmark_filter_count = argc - 1;
+
+    benchmark_parser();
+    benchmark_socket();
+    benchmark_protocol();
+    benchmark_display();
+    benchmark_encode();
+    benchmark_fifo();
+    benchmark_rwlock();
+    benchmark_pool();
+
+    benchmark_write_results();
+    return 0;
+
+}
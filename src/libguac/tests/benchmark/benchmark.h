@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_BENCHMARK_H
+#define GUAC_BENCHMARK_H
+
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+
+/**
+ * The number of times each benchmark is repeated. The median of all
+ * repetitions is reported as the result of the benchmark, such that the
+ * result is not skewed by any single unusually fast or slow repetition.
+ */
+#define BENCHMARK_REPETITIONS 5
+
+/**
+ * The maximum number of results that may be recorded by a single run of the
+ * benchmark suite.
+ */
+#define BENCHMARK_MAX_RESULTS 128
+
+/**
+ * Function which performs the operation being benchmarked the given number
+ * of times.
+ *
+ * @param data
+ *     The arbitrary data provided when the benchmark was run.
+ *
+ * @param iterations
+ *     The number of times that the operation should be performed.
+ *
+ * @return
+ *     The total number of bytes of input processed by all iterations, or
+ *     zero if a throughput in bytes is not meaningful for the operation.
+ */
+typedef uint64_t benchmark_function(void* data, int iterations);
+
+/**
+ * Returns whether the benchmark having the given name was selected on the
+ * command line. If no benchmarks were named on the command line, all
+ * benchmarks are selected. Benchmarks may be selected by any prefix of their
+ * name.
+ *
+ * @param name
+ *     The name of the benchmark to test.
+ *
+ * @return
+ *     Non-zero if the benchmark should be run, zero otherwise.
+ */
+int benchmark_selected(const char* name);
+
+/**
+ * Runs the given benchmark BENCHMARK_REPETITIONS times after first running
+ * it once without measurement (to warm caches and any lazily-initialized
+ * state), recording the result under the given name. If the benchmark was
+ * not selected on the command line, this function has no effect.
+ *
+ * @param name
+ *     The name that the result should be recorded under.
+ *
+ * @param function
+ *     The function performing the operation being benchmarked.
+ *
+ * @param data
+ *     Arbitrary data to pass to the given function.
+ *
+ * @param iterations
+ *     The number of operations to perform within each repetition.
+ */
+void benchmark_run(const char* name, benchmark_function* function,
+        void* data, int iterations);
+
+/**
+ * Records the result of a benchmark which has been timed by the caller,
+ * rather than through benchmark_run(). The caller is responsible for
+ * checking benchmark_selected().
+ *
+ * @param name
+ *     The name that the result should be recorded under.
+ *
+ * @param iterations
+ *     The number of operations performed within each repetition.
+ *
+ * @param durations
+ *     The time taken by each of the BENCHMARK_REPETITIONS repetitions, in
+ *     nanoseconds. The contents of this array are reordered by this
+ *     function.
+ *
+ * @param bytes
+ *     The number of bytes of input processed within each repetition, or zero
+ *     if a throughput in bytes is not meaningful for the operation.
+ */
+void benchmark_record(const char* name, int iterations, uint64_t* durations,
+        uint64_t bytes);
+
+/**
+ * Returns the current value of a monotonic clock, in nanoseconds.
+ *
+ * @return
+ *     The current value of a monotonic clock, in nanoseconds.
+ */
+uint64_t benchmark_clock(void);
+
+/**
+ * Returns the next value of a simple pseudo-random sequence. The sequence is
+ * fully determined by the initial value of the given state, such that all
+ * benchmarks process identical data on every run.
+ *
+ * @param state
+ *     The state of the sequence, which is updated by this call. This state
+ *     must not be zero.
+ *
+ * @return
+ *     The next pseudo-random value of the sequence.
+ */
+uint32_t benchmark_random(uint32_t* state);
+
+/**
+ * Allocates a new guac_socket which discards all data written to it.
+ *
+ * @return
+ *     A newly-allocated guac_socket which must eventually be freed with
+ *     guac_socket_free().
+ */
+guac_socket* benchmark_socket_alloc(void);
+
+/**
+ * Benchmarks parsing of typical inbound instructions with
+ * guac_parser_append().
+ */
+void benchmark_parser(void);
+
+/**
+ * Benchmarks base64-encoded writes with guac_socket_write_base64().
+ */
+void benchmark_socket(void);
+
+/**
+ * Benchmarks formatting of typical outbound instructions with
+ * guac_protocol_send_copy().
+ */
+void benchmark_protocol(void);
+
+/**
+ * Benchmarks planning of frames by guac_display for synthetic scrolling,
+ * video, and text editing workloads.
+ */
+void benchmark_display(void);
+
+/**
+ * Benchmarks each image encoder against photographic and text-like image
+ * data.
+ */
+void benchmark_encode(void);
+
+/**
+ * Benchmarks throughput of guac_fifo with varying numbers of consuming
+ * threads.
+ */
+void benchmark_fifo(void);
+
+/**
+ * Benchmarks contention of guac_rwlock read locks with varying numbers of
+ * reading threads.
+ */
+void benchmark_rwlock(void);
+
+/**
+ * Benchmarks contention of guac_pool as integers are allocated and freed by
+ * varying numbers of threads.
+ */
+void benchmark_pool(void);
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+#include "display-priv.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/rect.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of the synthetic display, in pixels.
+ */
+#define BENCHMARK_DISPLAY_WIDTH 1920
+
+/**
+ * The height of the synthetic display, in pixels.
+ */
+#define BENCHMARK_DISPLAY_HEIGHT 1080
+
+/**
+ * The width of each synthetic text glyph, in pixels.
+ */
+#define BENCHMARK_GLYPH_WIDTH 8
+
+/**
+ * The height of each synthetic text glyph, in pixels. This is also the
+ * distance scrolled by each frame of the scrolling benchmark.
+ */
+#define BENCHMARK_GLYPH_HEIGHT 16
+
+/**
+ * The number of distinct synthetic text glyphs.
+ */
+#define BENCHMARK_GLYPHS 64
+
+/**
+ * The number of glyphs typed by each frame of the text editing benchmark.
+ */
+#define BENCHMARK_GLYPHS_PER_EDIT 4
+
+/**
+ * The number of tokens of text redrawn by each frame of the syntax
+ * highlighting benchmark.
+ */
+#define BENCHMARK_HIGHLIGHT_TOKENS 24
+
+/**
+ * The maximum length of each token of text redrawn by the syntax highlighting
+ * benchmark, in glyphs.
+ */
+#define BENCHMARK_HIGHLIGHT_TOKEN_LENGTH 12
+
+/**
+ * The width of the region updated by each frame of the video benchmark, in
+ * pixels.
+ */
+#define BENCHMARK_VIDEO_WIDTH 640
+
+/**
+ * The height of the region updated by each frame of the video benchmark, in
+ * pixels.
+ */
+#define BENCHMARK_VIDEO_HEIGHT 360
+
+/**
+ * The number of frames rendered within each repetition of each display
+ * benchmark.
+ */
+#define BENCHMARK_DISPLAY_FRAMES 30
+
+/**
+ * Function which makes the changes to the display that make up a single
+ * frame of a synthetic workload.
+ *
+ * @param context
+ *     The raw context of the default layer of the display.
+ *
+ * @param frame
+ *     The number of frames drawn by this workload thus far.
+ *
+ * @param random
+ *     The state of the pseudo-random sequence to use for any generated
+ *     content.
+ */
+typedef void benchmark_display_scenario(guac_display_layer_raw_context* context,
+        int frame, uint32_t* random);
+
+/**
+ * Returns a pointer to the pixel at the given coordinates within the given
+ * raw context.
+ *
+ * @param context
+ *     The raw context containing the pixel.
+ *
+ * @param x
+ *     The X coordinate of the pixel.
+ *
+ * @param y
+ *     The Y coordinate of the pixel.
+ *
+ * @return
+ *     A pointer to the pixel at the given coordinates.
+ */
+static uint32_t* benchmark_display_pixel(guac_display_layer_raw_context* context,
+        int x, int y) {
+    return (uint32_t*) (context->buffer + y * context->stride) + x;
+}
+
+/**
+ * Draws one of BENCHMARK_GLYPHS synthetic text glyphs at the given
+ * coordinates. Each glyph is an arbitrary but fixed pattern of dark pixels on
+ * a light background, such that repeated glyphs have identical content, as
+ * with real text.
+ *
+ * @param context
+ *     The raw context to draw the glyph within.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the glyph.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the glyph.
+ *
+ * @param glyph
+ *     The glyph to draw, which may be any value. Values are reduced modulo
+ *     BENCHMARK_GLYPHS.
+ */
+static void benchmark_display_draw_glyph(guac_display_layer_raw_context* context,
+        int x, int y, uint32_t glyph) {
+
+    uint32_t pattern = (glyph % BENCHMARK_GLYPHS) * 0x9E3779B9 + 1;
+
+    for (int dy = 0; dy < BENCHMARK_GLYPH_HEIGHT; dy++) {
+
+        uint32_t* row = benchmark_display_pixel(context, x, y + dy);
+        uint32_t bits = benchmark_random(&pattern);
+
+        /* Leave a blank margin below each line of text */
+        if (dy >= BENCHMARK_GLYPH_HEIGHT - 3)
+            bits = 0;
+
+        for (int dx = 0; dx < BENCHMARK_GLYPH_WIDTH; dx++)
+            row[dx] = (bits & (1 << dx)) ? 0xFF202020 : 0xFFF0F0F0;
+
+    }
+
+}
+
+/**
+ * Draws a full line of synthetic text spanning the width of the display,
+ * with its upper edge at the given Y coordinate.
+ *
+ * @param context
+ *     The raw context to draw the text within.
+ *
+ * @param y
+ *     The Y coordinate of the upper edge of the line of text.
+ *
+ * @param random
+ *     The state of the pseudo-random sequence determining the glyphs drawn.
+ */
+static void benchmark_display_draw_line(guac_display_layer_raw_context* context,
+        int y, uint32_t* random) {
+
+    for (int x = 0; x + BENCHMARK_GLYPH_WIDTH <= BENCHMARK_DISPLAY_WIDTH;
+            x += BENCHMARK_GLYPH_WIDTH)
+        benchmark_display_draw_glyph(context, x, y, benchmark_random(random));
+
+}
+
+/**
+ * Fills the entire display with synthetic text.
+ *
+ * @param context
+ *     The raw context of the default layer of the display.
+ *
+ * @param random
+ *     The state of the pseudo-random sequence determining the glyphs drawn.
+ */
+static void benchmark_display_draw_page(guac_display_layer_raw_context* context,
+        uint32_t* random) {
+
+    for (int y = 0; y + BENCHMARK_GLYPH_HEIGHT <= BENCHMARK_DISPLAY_HEIGHT;
+            y += BENCHMARK_GLYPH_HEIGHT)
+        benchmark_display_draw_line(context, y, random);
+
+    guac_rect_init(&context->dirty, 0, 0, BENCHMARK_DISPLAY_WIDTH,
+            BENCHMARK_DISPLAY_HEIGHT);
+
+}
+
+/**
+ * Scrolls the entire display up by one line of text, drawing a new line of
+ * text at the bottom, as a terminal would when printing continuous output.
+ * The entire display is marked as dirty, as is typical of remote desktop
+ * protocols that do not themselves report scrolling.
+ */
+static void benchmark_display_scroll(guac_display_layer_raw_context* context,
+        int frame, uint32_t* random) {
+
+    int lines = BENCHMARK_DISPLAY_HEIGHT / BENCHMARK_GLYPH_HEIGHT;
+
+    memmove(context->buffer,
+            context->buffer + BENCHMARK_GLYPH_HEIGHT * context->stride,
+            (lines - 1) * BENCHMARK_GLYPH_HEIGHT * context->stride);
+
+    benchmark_display_draw_line(context,
+            (lines - 1) * BENCHMARK_GLYPH_HEIGHT, random);
+
+    guac_rect_init(&context->dirty, 0, 0, BENCHMARK_DISPLAY_WIDTH,
+            BENCHMARK_DISPLAY_HEIGHT);
+
+}
+
+/**
+ * Replaces the contents of a video-sized region in the middle of the display
+ * with moving gradients overlaid with noise, as a video player would.
+ */
+static void benchmark_display_video(guac_display_layer_raw_context* context,
+        int frame, uint32_t* random) {
+
+    guac_rect video;
+    guac_rect_init(&video,
+            (BENCHMARK_DISPLAY_WIDTH - BENCHMARK_VIDEO_WIDTH) / 2,
+            (BENCHMARK_DISPLAY_HEIGHT - BENCHMARK_VIDEO_HEIGHT) / 2,
+            BENCHMARK_VIDEO_WIDTH, BENCHMARK_VIDEO_HEIGHT);
+
+    for (int y = video.top; y < video.bottom; y++) {
+
+        uint32_t* row = benchmark_display_pixel(context, 0, y);
+
+        for (int x = video.left; x < video.right; x++) {
+            uint32_t noise = benchmark_random(random) & 0x0F0F0F;
+            uint32_t red   = (x + frame * 3) & 0xFF;
+            uint32_t green = (y + frame * 2) & 0xFF;
+            uint32_t blue  = (x + y - frame) & 0xFF;
+            row[x] = 0xFF000000 | (((red << 16) | (green << 8) | blue) ^ noise);
+        }
+
+    }
+
+    context->dirty = video;
+
+}
+
+/**
+ * Types a few glyphs of text at a cursor that advances across the display
+ * and wraps at its edges, as a text editor would.
+ */
+static void benchmark_display_text_edit(guac_display_layer_raw_context* context,
+        int frame, uint32_t* random) {
+
+    int columns = BENCHMARK_DISPLAY_WIDTH / BENCHMARK_GLYPH_WIDTH;
+    int lines = BENCHMARK_DISPLAY_HEIGHT / BENCHMARK_GLYPH_HEIGHT;
+
+    for (int i = 0; i < BENCHMARK_GLYPHS_PER_EDIT; i++) {
+
+        int position = frame * BENCHMARK_GLYPHS_PER_EDIT + i;
+        int x = (position % columns) * BENCHMARK_GLYPH_WIDTH;
+        int y = (position / columns % lines) * BENCHMARK_GLYPH_HEIGHT;
+
+        benchmark_display_draw_glyph(context, x, y, benchmark_random(random));
+
+        guac_rect glyph;
+        guac_rect_init(&glyph, x, y, BENCHMARK_GLYPH_WIDTH,
+                BENCHMARK_GLYPH_HEIGHT);
+        guac_rect_extend(&context->dirty, &glyph);
+
+    }
+
+}
+
+/**
+ * Redraws many short tokens of text scattered across the display, as an
+ * editor would when re-highlighting the syntax of a file. This produces
+ * fragmented updates consisting of many small, nearby changes.
+ */
+static void benchmark_display_highlight(guac_display_layer_raw_context* context,
+        int frame, uint32_t* random) {
+
+    int columns = BENCHMARK_DISPLAY_WIDTH / BENCHMARK_GLYPH_WIDTH;
+    int lines = BENCHMARK_DISPLAY_HEIGHT / BENCHMARK_GLYPH_HEIGHT;
+
+    for (int i = 0; i < BENCHMARK_HIGHLIGHT_TOKENS; i++) {
+
+        int length = 1 + benchmark_random(random) % BENCHMARK_HIGHLIGHT_TOKEN_LENGTH;
+        int column = benchmark_random(random) % (columns - length);
+        int line = benchmark_random(random) % lines;
+
+        int x = column * BENCHMARK_GLYPH_WIDTH;
+        int y = line * BENCHMARK_GLYPH_HEIGHT;
+
+        for (int j = 0; j < length; j++)
+            benchmark_display_draw_glyph(context, x + j * BENCHMARK_GLYPH_WIDTH,
+                    y, benchmark_random(random));
+
+        guac_rect token;
+        guac_rect_init(&token, x, y, length * BENCHMARK_GLYPH_WIDTH,
+                BENCHMARK_GLYPH_HEIGHT);
+        guac_rect_extend(&context->dirty, &token);
+
+    }
+
+}
+
+/**
+ * Ends the current frame of the given display, waiting for that frame to be
+ * completely encoded and sent before returning.
+ *
+ * @param display
+ *     The display whose frame should be ended.
+ */
+static void benchmark_display_end_frame(guac_display* display) {
+
+    guac_display_end_frame(display);
+
+    guac_flag_wait_and_lock(&display->render_state,
+            GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS);
+    guac_flag_unlock(&display->render_state);
+
+}
+
+/**
+ * Renders BENCHMARK_DISPLAY_FRAMES frames of the given workload, adding the
+ * time taken by each timed phase of those frames to the given durations.
+ *
+ * @param display
+ *     The display to render frames to.
+ *
+ * @param scenario
+ *     The function making the changes that make up each frame.
+ *
+ * @param frame
+ *     Pointer to the number of frames drawn by the workload thus far, which
+ *     is updated by this function.
+ *
+ * @param random
+ *     The state of the pseudo-random sequence to use for generated content.
+ *
+ * @param durations
+ *     The durations of each timed phase, in nanoseconds, in the order
+ *     create, search, combine, and entire frame.
+ */
+static void benchmark_display_render(guac_display* display,
+        benchmark_display_scenario* scenario, int* frame, uint32_t* random,
+        uint64_t* durations) {
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+
+    for (int i = 0; i < BENCHMARK_DISPLAY_FRAMES; i++) {
+
+        guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+        scenario(context, (*frame)++, random);
+        guac_display_layer_close_raw(layer, context);
+
+        uint64_t start = benchmark_clock();
+        benchmark_display_end_frame(display);
+        durations[3] += benchmark_clock() - start;
+
+        /* Planning phases are timed by the display's own frame tracing */
+        durations[0] += display->trace.phases[GUAC_DISPLAY_TRACE_PHASE_DRAFT];
+        durations[1] += display->trace.phases[GUAC_DISPLAY_TRACE_PHASE_SEARCH];
+        durations[2] += display->trace.phases[GUAC_DISPLAY_TRACE_PHASE_COMBINE];
+
+    }
+
+}
+
+/**
+ * Benchmarks the given synthetic workload on a newly-allocated display,
+ * recording the time taken by plan creation, by the search for scrolls,
+ * copies, and cached content, by the combination of adjacent operations, and
+ * by each frame as a whole (including encoding).
+ *
+ * @param names
+ *     The names to record the results under, in the order create, search,
+ *     combine, and entire frame.
+ *
+ * @param scenario
+ *     The function making the changes that make up each frame.
+ */
+static void benchmark_display_scenario_run(const char* const* names,
+        benchmark_display_scenario* scenario) {
+
+    int selected = 0;
+    for (int i = 0; i < 4; i++)
+        selected |= benchmark_selected(names[i]);
+
+    if (!selected)
+        return;
+
+    guac_client* client = guac_client_alloc();
+    guac_display* display = guac_display_alloc(client);
+    guac_display_layer* layer = guac_display_default_layer(display);
+
+    uint32_t random = 0xD15B1A7;
+    int frame = 0;
+
+    /* Start from a display full of text, which must first be sent in its
+     * entirety */
+    guac_display_layer_resize(layer, BENCHMARK_DISPLAY_WIDTH,
+            BENCHMARK_DISPLAY_HEIGHT);
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+    benchmark_display_draw_page(context, &random);
+    guac_display_layer_close_raw(layer, context);
+    benchmark_display_end_frame(display);
+
+    /* Warm up with one repetition that is not recorded */
+    uint64_t ignored[4] = { 0 };
+    benchmark_display_render(display, scenario, &frame, &random, ignored);
+
+    uint64_t durations[4][BENCHMARK_REPETITIONS];
+    for (int i = 0; i < BENCHMARK_REPETITIONS; i++) {
+
+        uint64_t phases[4] = { 0 };
+        benchmark_display_render(display, scenario, &frame, &random, phases);
+
+        for (int phase = 0; phase < 4; phase++)
+            durations[phase][i] = phases[phase];
+
+    }
+
+    for (int phase = 0; phase < 4; phase++) {
+        if (benchmark_selected(names[phase]))
+            benchmark_record(names[phase], BENCHMARK_DISPLAY_FRAMES,
+                    durations[phase], 0);
+    }
+
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
+void benchmark_display(void) {
+
+    static const char* const scroll[] = {
+        "display_plan_create/scroll",
+        "display_plan_search/scroll",
+        "display_plan_combine/scroll",
+        "display_frame/scroll"
+    };
+
+    static const char* const video[] = {
+        "display_plan_create/video",
+        "display_plan_search/video",
+        "display_plan_combine/video",
+        "display_frame/video"
+    };
+
+    static const char* const text_edit[] = {
+        "display_plan_create/text_edit",
+        "display_plan_search/text_edit",
+        "display_plan_combine/text_edit",
+        "display_frame/text_edit"
+    };
+
+    static const char* const highlight[] = {
+        "display_plan_create/highlight",
+        "display_plan_search/highlight",
+        "display_plan_combine/highlight",
+        "display_frame/highlight"
+    };
+
+    benchmark_display_scenario_run(scroll, benchmark_display_scroll);
+    benchmark_display_scenario_run(video, benchmark_display_video);
+    benchmark_display_scenario_run(text_edit, benchmark_display_text_edit);
+    benchmark_display_scenario_run(highlight, benchmark_display_highlight);
+
+}
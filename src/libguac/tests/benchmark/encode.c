@@ -0,0 +1,247 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "benchmark.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
+
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <stdint.h>
+
+/**
+ * The width and height of each image encoded, in pixels. This is the size of
+ * the larger image updates typically produced by guac_display.
+ */
+#define BENCHMARK_ENCODE_SIZE 256
+
+/**
+ * The quality to use for lossy encodings.
+ */
+#define BENCHMARK_ENCODE_QUALITY 90
+
+/**
+ * The state of each encoder benchmark.
+ */
+typedef struct benchmark_encode_state {
+
+    /**
+     * The socket receiving all encoded image data.
+     */
+    guac_socket* socket;
+
+    /**
+     * The stream to associate with all encoded image data.
+     */
+    guac_stream stream;
+
+    /**
+     * The image data to encode, in the same format as CAIRO_FORMAT_RGB24.
+     */
+    uint32_t image[BENCHMARK_ENCODE_SIZE * BENCHMARK_ENCODE_SIZE];
+
+    /**
+     * The PNG encoder being benchmarked.
+     */
+    guac_png_encoder* png;
+
+    /**
+     * The JPEG encoder being benchmarked.
+     */
+    guac_jpeg_encoder* jpeg;
+
+#ifdef ENABLE_WEBP
+    /**
+     * The WebP encoder being benchmarked.
+     */
+    guac_webp_encoder* webp;
+#endif
+
+} benchmark_encode_state;
+
+/**
+ * Encodes the benchmark image as PNG the given number of times.
+ *
+ * @param data
+ *     The benchmark_encode_state of the benchmark.
+ *
+ * @param iterations
+ *     The number of times to encode the image.
+ *
+ * @return
+ *     The total number of bytes of image data encoded.
+ */
+static uint64_t benchmark_encode_png(void* data, int iterations) {
+
+    benchmark_encode_state* state = (benchmark_encode_state*) data;
+
+    for (int i = 0; i < iterations; i++)
+        guac_png_write_raw(state->png, state->socket, &state->stream,
+                (unsigned char*) state->image, BENCHMARK_ENCODE_SIZE,
+                BENCHMARK_ENCODE_SIZE, BENCHMARK_ENCODE_SIZE * 4);
+
+    return (uint64_t) sizeof(state->image) * iterations;
+
+}
+
+/**
+ * Encodes the benchmark image as JPEG the given number of times.
+ *
+ * @param data
+ *     The benchmark_encode_state of the benchmark.
+ *
+ * @param iterations
+ *     The number of times to encode the image.
+ *
+ * @return
+ *     The total number of bytes of image data encoded.
+ */
+static uint64_t benchmark_encode_jpeg(void* data, int iterations) {
+
+    benchmark_encode_state* state = (benchmark_encode_state*) data;
+
+    for (int i = 0; i < iterations; i++)
+        guac_jpeg_write_raw(state->jpeg, state->socket, &state->stream,
+                (unsigned char*) state->image, BENCHMARK_ENCODE_SIZE,
+                BENCHMARK_ENCODE_SIZE, BENCHMARK_ENCODE_SIZE * 4,
+                BENCHMARK_ENCODE_QUALITY);
+
+    return (uint64_t) sizeof(state->image) * iterations;
+
+}
+
+#ifdef ENABLE_WEBP
+/**
+ * Encodes the benchmark image as lossy WebP the given number of times.
+ *
+ * @param data
+ *     The benchmark_encode_state of the benchmark.
+ *
+ * @param iterations
+ *     The number of times to encode the image.
+ *
+ * @return
+ *     The total number of bytes of image data encoded.
+ */
+static uint64_t benchmark_encode_webp(void* data, int iterations) {
+
+    benchmark_encode_state* state = (benchmark_encode_state*) data;
+
+    for (int i = 0; i < iterations; i++)
+        guac_webp_write_raw(state->webp, state->socket, &state->stream,
+                (unsigned char*) state->image, BENCHMARK_ENCODE_SIZE,
+                BENCHMARK_ENCODE_SIZE, BENCHMARK_ENCODE_SIZE * 4,
+                BENCHMARK_ENCODE_QUALITY, 0);
+
+    return (uint64_t) sizeof(state->image) * iterations;
+
+}
+#endif
+
+/**
+ * Fills the benchmark image with photographic content (smooth gradients
+ * with fine noise), which favors lossy encodings.
+ *
+ * @param state
+ *     The benchmark_encode_state whose image should be filled.
+ */
+static void benchmark_encode_fill_photo(benchmark_encode_state* state) {
+
+    uint32_t random = 0xF070;
+
+    for (int y = 0; y < BENCHMARK_ENCODE_SIZE; y++) {
+        for (int x = 0; x < BENCHMARK_ENCODE_SIZE; x++) {
+            uint32_t noise = benchmark_random(&random) & 0x070707;
+            uint32_t color = (x << 16) | (y << 8) | ((x + y) / 2);
+            state->image[y * BENCHMARK_ENCODE_SIZE + x] = color ^ noise;
+        }
+    }
+
+}
+
+/**
+ * Fills the benchmark image with text-like content (few colors with sharp
+ * edges), which favors lossless encodings.
+ *
+ * @param state
+ *     The benchmark_encode_state whose image should be filled.
+ */
+static void benchmark_encode_fill_text(benchmark_encode_state* state) {
+
+    for (int y = 0; y < BENCHMARK_ENCODE_SIZE; y++) {
+        for (int x = 0; x < BENCHMARK_ENCODE_SIZE; x += 8) {
+
+            /* Choose one of 16 distinct 8x16 glyphs for each glyph position,
+             * leaving a blank margin below each line of glyphs */
+            uint32_t glyph = (x / 8 * 7 + y / 16 * 13) % 16;
+            uint32_t pattern = (glyph + 1) * 0x9E3779B9 + (y % 16) * 0x85EBCA6B;
+            uint32_t bits = (y % 16 < 13) ? benchmark_random(&pattern) : 0;
+
+            for (int dx = 0; dx < 8; dx++)
+                state->image[y * BENCHMARK_ENCODE_SIZE + x + dx] =
+                    (bits & (1 << dx)) ? 0x202020 : 0xF0F0F0;
+
+        }
+    }
+
+}
+
+void benchmark_encode(void) {
+
+    static benchmark_encode_state state = {
+        .stream = { .index = 1 }
+    };
+
+    state.socket = benchmark_socket_alloc();
+    state.png = guac_png_encoder_alloc();
+    state.jpeg = guac_jpeg_encoder_alloc();
+#ifdef ENABLE_WEBP
+    state.webp = guac_webp_encoder_alloc();
+#endif
+
+    benchmark_encode_fill_photo(&state);
+    benchmark_run("encode_png/photo", benchmark_encode_png, &state, 20);
+    benchmark_run("encode_jpeg/photo", benchmark_encode_jpeg, &state, 50);
+#ifdef ENABLE_WEBP
+    benchmark_run("encode_webp/photo", benchmark_encode_webp, &state, 20);
+#endif
+
+    benchmark_encode_fill_text(&state);
+    benchmark_run("encode_png/text", benchmark_encode_png, &state, 20);
+    benchmark_run("encode_jpeg/text", benchmark_encode_jpeg, &state, 50);
+#ifdef ENABLE_WEBP
+    benchmark_run("encode_webp/text", benchmark_encode_webp, &state, 20);
+#endif
+
+#ifdef ENABLE_WEBP
+    guac_webp_encoder_free(state.webp);
+#endif
+    guac_jpeg_encoder_free(state.jpeg);
+    guac_png_encoder_free(state.png);
+    guac_socket_free(state.socket);
+
+}
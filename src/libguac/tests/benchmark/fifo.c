@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/fifo.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The maximum number of items that may be queued at once, equal to the
+ * capacity of the queue of operations used by guac_display.
+ */
+#define BENCHMARK_FIFO_MAX_ITEMS 1024
+
+/**
+ * The maximum number of threads dequeuing items concurrently.
+ */
+#define BENCHMARK_FIFO_MAX_WORKERS 8
+
+/**
+ * An item passed through the FIFO, roughly the size of an operation queued
+ * by guac_display.
+ */
+typedef struct benchmark_fifo_item {
+
+    /**
+     * Whether the thread dequeuing this item should stop.
+     */
+    int stop;
+
+    /**
+     * Arbitrary padding.
+     */
+    char padding[60];
+
+} benchmark_fifo_item;
+
+/**
+ * A guac_fifo of benchmark_fifo_item.
+ */
+typedef struct benchmark_fifo_queue {
+
+    /**
+     * The base FIFO implementation.
+     */
+    guac_fifo base;
+
+    /**
+     * Storage for all items in this FIFO.
+     */
+    benchmark_fifo_item items[BENCHMARK_FIFO_MAX_ITEMS];
+
+    /**
+     * The number of threads dequeuing items from this FIFO.
+     */
+    int workers;
+
+} benchmark_fifo_queue;
+
+/**
+ * Dequeues items from the given FIFO until an item requesting that the
+ * thread stop is received.
+ *
+ * @param data
+ *     The benchmark_fifo_queue to dequeue items from.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* benchmark_fifo_worker(void* data) {
+
+    benchmark_fifo_queue* fifo = (benchmark_fifo_queue*) data;
+
+    benchmark_fifo_item item;
+    while (guac_fifo_dequeue(&fifo->base, &item) && !item.stop);
+
+    return NULL;
+
+}
+
+/**
+ * Passes the given number of items through a FIFO from a single producer to
+ * the number of worker threads dictated by the given benchmark_fifo_queue.
+ *
+ * @param data
+ *     The benchmark_fifo_queue to use.
+ *
+ * @param iterations
+ *     The number of items to pass through the FIFO.
+ *
+ * @return
+ *     Always zero, as a throughput in bytes is not meaningful.
+ */
+static uint64_t benchmark_fifo_throughput(void* data, int iterations) {
+
+    benchmark_fifo_queue* fifo = (benchmark_fifo_queue*) data;
+    guac_fifo_init(&fifo->base, fifo->items, BENCHMARK_FIFO_MAX_ITEMS,
+            sizeof(benchmark_fifo_item));
+
+    pthread_t workers[BENCHMARK_FIFO_MAX_WORKERS];
+    for (int i = 0; i < fifo->workers; i++)
+        pthread_create(&workers[i], NULL, benchmark_fifo_worker, fifo);
+
+    benchmark_fifo_item item;
+    memset(&item, 0, sizeof(item));
+
+    for (int i = 0; i < iterations; i++)
+        guac_fifo_enqueue(&fifo->base, &item);
+
+    /* Stop all workers once all other items have been dequeued */
+    item.stop = 1;
+    for (int i = 0; i < fifo->workers; i++)
+        guac_fifo_enqueue(&fifo->base, &item);
+
+    for (int i = 0; i < fifo->workers; i++)
+        pthread_join(workers[i], NULL);
+
+    guac_fifo_destroy(&fifo->base);
+    return 0;
+
+}
+
+void benchmark_fifo(void) {
+
+    static const char* const names[] = {
+        "fifo_throughput/1_worker",
+        "fifo_throughput/2_workers",
+        "fifo_throughput/4_workers",
+        "fifo_throughput/8_workers"
+    };
+
+    static benchmark_fifo_queue fifo;
+
+    for (int i = 0; i < 4; i++) {
+        fifo.workers = 1 << i;
+        benchmark_run(names[i], benchmark_fifo_throughput, &fifo, 200000);
+    }
+
+}
@@ -0,0 +1,160 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/mem.h>
+#include <guacamole/parser.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The approximate number of bytes of instructions parsed by each iteration
+ * of the parser benchmark.
+ */
+#define BENCHMARK_PARSER_DATA_SIZE 65536
+
+/**
+ * The state of the parser benchmark.
+ */
+typedef struct benchmark_parser_state {
+
+    /**
+     * The parser being benchmarked.
+     */
+    guac_parser* parser;
+
+    /**
+     * The original instruction data, which is never modified.
+     */
+    char* data;
+
+    /**
+     * Copy of the original instruction data which is parsed (and thus
+     * modified) by each iteration.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of instruction data.
+     */
+    int length;
+
+} benchmark_parser_state;
+
+/**
+ * Parses all instructions within a fresh copy of the instruction data the
+ * given number of times.
+ *
+ * @param data
+ *     The benchmark_parser_state of the benchmark.
+ *
+ * @param iterations
+ *     The number of times to parse the instruction data.
+ *
+ * @return
+ *     The total number of bytes parsed.
+ */
+static uint64_t benchmark_parser_append(void* data, int iterations) {
+
+    benchmark_parser_state* state = (benchmark_parser_state*) data;
+
+    for (int i = 0; i < iterations; i++) {
+
+        /* The parser modifies the data it parses */
+        memcpy(state->buffer, state->data, state->length);
+
+        char* current = state->buffer;
+        char* end = state->buffer + state->length;
+        while (current < end) {
+            if (guac_parser_read_buffer(state->parser, &current, end)) {
+                fprintf(stderr, "Benchmark instruction data could not be "
+                        "parsed.\n");
+                return 0;
+            }
+        }
+
+    }
+
+    return (uint64_t) state->length * iterations;
+
+}
+
+void benchmark_parser(void) {
+
+    benchmark_parser_state state = {
+        .parser = guac_parser_alloc(),
+        .data = guac_mem_alloc(BENCHMARK_PARSER_DATA_SIZE + 1024),
+        .buffer = guac_mem_alloc(BENCHMARK_PARSER_DATA_SIZE + 1024)
+    };
+
+    uint32_t random = 0xC0FFEE;
+
+    /* Build a representative mix of the instructions received from users:
+     * mostly mouse movement, with some key events, frame acknowledgements, and
+     * occasional blobs of uploaded data */
+    while (state.length < BENCHMARK_PARSER_DATA_SIZE) {
+
+        char* current = state.data + state.length;
+        uint32_t value = benchmark_random(&random);
+
+        switch (value % 8) {
+
+            case 0:
+                state.length += sprintf(current, "3.key,5.%05u,1.%u;",
+                        (value >> 8) % 65536, (value >> 4) & 1);
+                break;
+
+            case 1:
+                state.length += sprintf(current, "4.sync,13.%013u;",
+                        value);
+                break;
+
+            case 2:
+                state.length += sprintf(current, "4.blob,1.%u,684.",
+                        (value >> 4) % 10);
+                for (int i = 0; i < 684; i++)
+                    state.data[state.length++] =
+                        'A' + benchmark_random(&random) % 26;
+                state.data[state.length++] = ';';
+                break;
+
+            default: {
+                char x[16], y[16];
+                int x_length = sprintf(x, "%u", (value >> 4) % 1920);
+                int y_length = sprintf(y, "%u", (value >> 16) % 1080);
+                state.length += sprintf(current, "5.mouse,%i.%s,%i.%s,1.0;",
+                        x_length, x, y_length, y);
+                break;
+            }
+
+        }
+
+    }
+
+    benchmark_run("parser_append", benchmark_parser_append, &state, 200);
+
+    guac_mem_free(state.buffer);
+    guac_mem_free(state.data);
+    guac_parser_free(state.parser);
+
+}
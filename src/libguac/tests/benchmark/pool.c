@@ -0,0 +1,142 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "benchmark.h"
+
+#include <guacamole/pool.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of threads allocating and freeing integers concurrently.
+ */
+#define BENCHMARK_POOL_MAX_THREADS 8
+
+/**
+ * The number of integers that each thread holds at any one time, similar to
+ * the number of layers, buffers, or streams that a typical connection has
+ * in use.
+ */
+#define BENCHMARK_POOL_HELD 16
+
+/**
+ * The state of the guac_pool contention benchmark.
+ */
+typedef struct benchmark_pool_state {
+
+    /**
+     * The pool from which all threads allocate integers.
+     */
+    guac_pool* pool;
+
+    /**
+     * The number of threads allocating and freeing integers concurrently.
+     */
+    int threads;
+
+    /**
+     * The number of integers that each thread should allocate and free.
+     */
+    int allocations;
+
+} benchmark_pool_state;
+
+/**
+ * Repeatedly allocates integers from the pool of the given
+ * benchmark_pool_state, freeing each integer once BENCHMARK_POOL_HELD further
+ * integers have been allocated, as happens when buffers are allocated and
+ * freed by protocol plugins.
+ *
+ * @param data
+ *     The benchmark_pool_state of the benchmark.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* benchmark_pool_thread(void* data) {
+
+    benchmark_pool_state* state = (benchmark_pool_state*) data;
+
+    int held[BENCHMARK_POOL_HELD];
+    for (int i = 0; i < BENCHMARK_POOL_HELD; i++)
+        held[i] = guac_pool_next_int(state->pool);
+
+    for (int i = 0; i < state->allocations; i++) {
+        int slot = i % BENCHMARK_POOL_HELD;
+        guac_pool_free_int(state->pool, held[slot]);
+        held[slot] = guac_pool_next_int(state->pool);
+    }
+
+    for (int i = 0; i < BENCHMARK_POOL_HELD; i++)
+        guac_pool_free_int(state->pool, held[i]);
+
+    return NULL;
+
+}
+
+/**
+ * Allocates and frees the given number of integers, divided evenly between
+ * the number of threads dictated by the given benchmark_pool_state.
+ *
+ * @param data
+ *     The benchmark_pool_state of the benchmark.
+ *
+ * @param iterations
+ *     The total number of integers to allocate and free.
+ *
+ * @return
+ *     Always zero, as a throughput in bytes is not meaningful.
+ */
+static uint64_t benchmark_pool_alloc_free(void* data, int iterations) {
+
+    benchmark_pool_state* state = (benchmark_pool_state*) data;
+    state->allocations = iterations / state->threads;
+
+    pthread_t threads[BENCHMARK_POOL_MAX_THREADS];
+    for (int i = 0; i < state->threads; i++)
+        pthread_create(&threads[i], NULL, benchmark_pool_thread, state);
+
+    for (int i = 0; i < state->threads; i++)
+        pthread_join(threads[i], NULL);
+
+    return 0;
+
+}
+
+void benchmark_pool(void) {
+
+    static const char* const names[] = {
+        "pool_alloc_free/1_thread",
+        "pool_alloc_free/2_threads",
+        "pool_alloc_free/4_threads",
+        "pool_alloc_free/8_threads"
+    };
+
+    benchmark_pool_state state;
+    state.pool = guac_pool_alloc(0);
+
+    for (int i = 0; i < 4; i++) {
+        state.threads = 1 << i;
+        benchmark_run(names[i], benchmark_pool_alloc_free, &state, 800000);
+    }
+
+    guac_pool_free(state.pool);
+
+}
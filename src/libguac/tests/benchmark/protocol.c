@@ -0,0 +1,71 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+
+/**
+ * Sends the given number of "copy" instructions with typical parameters,
+ * tiling a 1920x1080 layer with 64x64 copies from a buffer.
+ *
+ * @param data
+ *     The socket receiving all instructions.
+ *
+ * @param iterations
+ *     The number of instructions to send.
+ *
+ * @return
+ *     Always zero, as a throughput in bytes is not meaningful for this
+ *     benchmark.
+ */
+static uint64_t benchmark_protocol_send_copy(void* data, int iterations) {
+
+    guac_socket* socket = (guac_socket*) data;
+
+    const guac_layer layer = { .index = 1 };
+    const guac_layer buffer = { .index = -3 };
+
+    for (int i = 0; i < iterations; i++) {
+        int x = (i * 64) % 1920;
+        int y = (i / 30 * 64) % 1080;
+        guac_protocol_send_copy(socket, &buffer, 0, 0, 64, 64,
+                GUAC_COMP_OVER, &layer, x, y);
+    }
+
+    guac_socket_flush(socket);
+    return 0;
+
+}
+
+void benchmark_protocol(void) {
+
+    guac_socket* socket = benchmark_socket_alloc();
+
+    benchmark_run("protocol_send_copy", benchmark_protocol_send_copy,
+            socket, 200000);
+
+    guac_socket_free(socket);
+
+}
@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/rwlock.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of threads acquiring read locks concurrently.
+ */
+#define BENCHMARK_RWLOCK_MAX_READERS 8
+
+/**
+ * The state of the read lock contention benchmark.
+ */
+typedef struct benchmark_rwlock_state {
+
+    /**
+     * The lock being read-locked.
+     */
+    guac_rwlock lock;
+
+    /**
+     * The number of threads acquiring read locks concurrently.
+     */
+    int readers;
+
+    /**
+     * The number of read locks that each thread should acquire.
+     */
+    int acquisitions;
+
+} benchmark_rwlock_state;
+
+/**
+ * Repeatedly acquires and releases a read lock on the lock of the given
+ * benchmark_rwlock_state, including a nested (reentrant) acquisition, as is
+ * common within guac_client and guac_display.
+ *
+ * @param data
+ *     The benchmark_rwlock_state of the benchmark.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* benchmark_rwlock_reader(void* data) {
+
+    benchmark_rwlock_state* state = (benchmark_rwlock_state*) data;
+
+    for (int i = 0; i < state->acquisitions; i++) {
+        guac_rwlock_acquire_read_lock(&state->lock);
+        guac_rwlock_acquire_read_lock(&state->lock);
+        guac_rwlock_release_lock(&state->lock);
+        guac_rwlock_release_lock(&state->lock);
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Acquires the given number of read locks, divided evenly between the number
+ * of threads dictated by the given benchmark_rwlock_state.
+ *
+ * @param data
+ *     The benchmark_rwlock_state of the benchmark.
+ *
+ * @param iterations
+ *     The total number of read locks to acquire.
+ *
+ * @return
+ *     Always zero, as a throughput in bytes is not meaningful.
+ */
+static uint64_t benchmark_rwlock_read(void* data, int iterations) {
+
+    benchmark_rwlock_state* state = (benchmark_rwlock_state*) data;
+    state->acquisitions = iterations / state->readers;
+
+    pthread_t readers[BENCHMARK_RWLOCK_MAX_READERS];
+    for (int i = 0; i < state->readers; i++)
+        pthread_create(&readers[i], NULL, benchmark_rwlock_reader, state);
+
+    for (int i = 0; i < state->readers; i++)
+        pthread_join(readers[i], NULL);
+
+    return 0;
+
+}
+
+void benchmark_rwlock(void) {
+
+    static const char* const names[] = {
+        "rwlock_read/1_reader",
+        "rwlock_read/2_readers",
+        "rwlock_read/4_readers",
+        "rwlock_read/8_readers"
+    };
+
+    benchmark_rwlock_state state;
+    guac_rwlock_init(&state.lock);
+
+    for (int i = 0; i < 4; i++) {
+        state.readers = 1 << i;
+        benchmark_run(names[i], benchmark_rwlock_read, &state, 800000);
+    }
+
+    guac_rwlock_destroy(&state.lock);
+
+}
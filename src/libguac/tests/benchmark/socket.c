@@ -0,0 +1,91 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "benchmark.h"
+
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+
+/**
+ * The number of bytes written by each iteration of the base64 benchmark,
+ * equal to the size of the blocks of image data typically sent within blobs.
+ */
+#define BENCHMARK_SOCKET_DATA_SIZE 6048
+
+/**
+ * The state of the base64 benchmark.
+ */
+typedef struct benchmark_socket_state {
+
+    /**
+     * The socket receiving all base64-encoded data.
+     */
+    guac_socket* socket;
+
+    /**
+     * The data to encode.
+     */
+    unsigned char data[BENCHMARK_SOCKET_DATA_SIZE];
+
+} benchmark_socket_state;
+
+/**
+ * Writes the benchmark data as base64 the given number of times.
+ *
+ * @param data
+ *     The benchmark_socket_state of the benchmark.
+ *
+ * @param iterations
+ *     The number of times to write the benchmark data.
+ *
+ * @return
+ *     The total number of bytes encoded.
+ */
+static uint64_t benchmark_socket_write_base64(void* data, int iterations) {
+
+    benchmark_socket_state* state = (benchmark_socket_state*) data;
+
+    for (int i = 0; i < iterations; i++) {
+        guac_socket_write_base64(state->socket, state->data,
+                sizeof(state->data));
+        guac_socket_flush_base64(state->socket);
+    }
+
+    guac_socket_flush(state->socket);
+    return (uint64_t) sizeof(state->data) * iterations;
+
+}
+
+void benchmark_socket(void) {
+
+    static benchmark_socket_state state;
+    state.socket = benchmark_socket_alloc();
+
+    uint32_t random = 0xBA5E64;
+    for (int i = 0; i < BENCHMARK_SOCKET_DATA_SIZE; i++)
+        state.data[i] = benchmark_random(&random);
+
+    benchmark_run("socket_write_base64", benchmark_socket_write_base64,
+            &state, 5000);
+
+    guac_socket_free(state.socket);
+
+}
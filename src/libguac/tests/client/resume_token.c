@@ -0,0 +1,115 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <guacamole/string.h>
+#include <guacamole/user.h>
+
+/**
+ * Joins a new user to the given client, issuing a resume token to that user,
+ * and then removes that user from the client again, such that the token may
+ * be claimed.
+ *
+ * @param client
+ *     The client to join and leave.
+ *
+ * @return
+ *     A newly-allocated copy of the resume token issued to the user, which
+ *     must be freed with guac_mem_free().
+ */
+static char* join_and_leave(guac_client* client) {
+
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    user->client = client;
+    user->owner = 1;
+
+    const char* token = guac_client_issue_resume_token(client, user);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(token);
+
+    /* Only one token is issued to any one user */
+    CU_ASSERT_PTR_EQUAL(guac_client_issue_resume_token(client, user), token);
+
+    char* copy = guac_strdup(token);
+
+    CU_ASSERT_EQUAL_FATAL(guac_client_add_user(client, user, 0, NULL), 0);
+    guac_client_remove_user(client, user);
+    guac_user_free(user);
+
+    return copy;
+
+}
+
+/**
+ * Test which verifies that a resume token may be claimed exactly once after
+ * the user it was issued to has left, and only for a frame sent while that
+ * user held the token.
+ */
+void test_client__resume_token_claim() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_timestamp frame = client->last_sent_timestamp;
+    char* token = join_and_leave(client);
+
+    /* Unknown tokens cannot be claimed */
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, "!invalid", frame), 0);
+
+    /* A valid token can be claimed only once */
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame), frame);
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame), 0);
+    guac_mem_free(token);
+
+    /* Frames from before the token was issued, or that have not yet been
+     * sent, cannot be resumed from, and the token is still consumed */
+    token = join_and_leave(client);
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame - 1), 0);
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame), 0);
+    guac_mem_free(token);
+
+    token = join_and_leave(client);
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame + 1), 0);
+    guac_mem_free(token);
+
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that views of the display from before a layer was freed
+ * cannot be resumed, as those views may still contain that layer.
+ */
+void test_client__resume_token_layer_freed() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_timestamp frame = client->last_sent_timestamp;
+    char* token = join_and_leave(client);
+
+    guac_client_free_layer(client, guac_client_alloc_layer(client));
+    CU_ASSERT_EQUAL(guac_client_claim_resume_token(client, token, frame), 0);
+
+    guac_mem_free(token);
+    guac_client_free(client);
+
+}
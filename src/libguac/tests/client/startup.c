@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+
+#include <string.h>
+
+/**
+ * Test which verifies that each startup phase recorded with
+ * guac_client_startup_phase() is appended to the startup summary in order, and
+ * that phases recorded after startup has completed are ignored.
+ */
+void test_client__startup_phases() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    /* No phases have yet ended */
+    CU_ASSERT_STRING_EQUAL(client->__startup_phases, "");
+
+    guac_client_startup_phase(client, "first");
+    guac_client_startup_phase(client, "second");
+
+    /* Both phases should be present in order, each with a duration */
+    char* first = strstr(client->__startup_phases, "first=");
+    char* second = strstr(client->__startup_phases, " second=");
+    CU_ASSERT_PTR_EQUAL_FATAL(first, client->__startup_phases);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(second);
+    CU_ASSERT_PTR_NOT_NULL(strstr(first, "ms second="));
+
+    /* Phases ending after startup has completed are ignored */
+    guac_client_startup_complete(client);
+    CU_ASSERT_TRUE(client->__startup_complete);
+    guac_client_startup_phase(client, "third");
+    CU_ASSERT_PTR_NULL(strstr(client->__startup_phases, "third"));
+
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that phases which do not fit within the space available
+ * for the startup summary are omitted entirely rather than truncated.
+ */
+void test_client__startup_phases_overflow() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    for (int i = 0; i < GUAC_CLIENT_STARTUP_PHASES_SIZE; i++)
+        guac_client_startup_phase(client, "phase");
+
+    /* Every recorded phase should be complete */
+    size_t length = strlen(client->__startup_phases);
+    CU_ASSERT(length < GUAC_CLIENT_STARTUP_PHASES_SIZE);
+    CU_ASSERT_STRING_EQUAL(client->__startup_phases + length - 2, "ms");
+
+    guac_client_free(client);
+
+}
+
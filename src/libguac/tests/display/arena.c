@@ -0,0 +1,92 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "display-arena.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Test which verifies that blocks allocated from a guac_display_arena are
+ * aligned, do not overlap, and are allocated from the same memory again once
+ * the arena is reset.
+ */
+void test_display_arena__reuse() {
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    unsigned char* a = guac_display_arena_alloc(&arena, 3, 7);
+    unsigned char* b = guac_display_arena_alloc(&arena, 1, 100);
+    unsigned char* c = guac_display_arena_zalloc(&arena, 10, sizeof(int));
+
+    CU_ASSERT_EQUAL((uintptr_t) a % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+    CU_ASSERT_EQUAL((uintptr_t) b % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+    CU_ASSERT_EQUAL((uintptr_t) c % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+
+    CU_ASSERT_TRUE(b >= a + 21);
+    CU_ASSERT_TRUE(c >= b + 100);
+
+    int zeroes[10] = { 0 };
+    CU_ASSERT_EQUAL(memcmp(c, zeroes, sizeof(zeroes)), 0);
+
+    /* Blocks that fit within the main buffer are reused after reset */
+    guac_display_arena_reset(&arena);
+    CU_ASSERT_PTR_EQUAL(guac_display_arena_alloc(&arena, 3, 7), a);
+    CU_ASSERT_PTR_EQUAL(guac_display_arena_alloc(&arena, 1, 100), b);
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that allocations exceeding the space remaining within a
+ * guac_display_arena succeed, and that the arena grows to fit the same
+ * allocations without overflow once reset.
+ */
+void test_display_arena__grow() {
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    size_t large = GUAC_DISPLAY_ARENA_INITIAL_SIZE / 2 + 1;
+
+    unsigned char* a = guac_display_arena_alloc(&arena, 1, large);
+    unsigned char* b = guac_display_arena_alloc(&arena, 1, large);
+    memset(a, 0xAA, large);
+    memset(b, 0xBB, large);
+
+    CU_ASSERT_EQUAL((uintptr_t) b % GUAC_DISPLAY_ARENA_ALIGNMENT, 0);
+    CU_ASSERT_PTR_NOT_NULL(arena.overflow);
+    CU_ASSERT_EQUAL(a[large - 1], 0xAA);
+
+    guac_display_arena_reset(&arena);
+    CU_ASSERT_PTR_NULL(arena.overflow);
+    CU_ASSERT_TRUE(arena.size >= large * 2);
+
+    /* The same allocations now fit entirely within the main buffer */
+    guac_display_arena_alloc(&arena, 1, large);
+    guac_display_arena_alloc(&arena, 1, large);
+    CU_ASSERT_PTR_NULL(arena.overflow);
+
+    guac_display_arena_destroy(&arena);
+
+}
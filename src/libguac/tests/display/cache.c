@@ -0,0 +1,202 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The number of bytes in each row of the test cell buffers.
+ */
+#define TEST_STRIDE (GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_LAYER_RAW_BPP)
+
+/**
+ * Fills the given cell buffer with a pattern derived from the given value,
+ * such that cells filled using different values contain different data.
+ *
+ * @param cell
+ *     The cell buffer to fill.
+ *
+ * @param value
+ *     The value to derive the pattern from.
+ */
+static void fill_cell(uint32_t* cell, uint32_t value) {
+    for (int i = 0; i < GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE; i++)
+        cell[i] = value * 0x01000193 + i;
+}
+
+/**
+ * Test which verifies that cells added to the cache can be retrieved only
+ * after being stored client-side with guac_display_cache_commit(), and only
+ * if their contents are identical (not merely a matching hash).
+ */
+void test_display_cache__hit() {
+
+    uint32_t cell[GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE];
+    uint32_t other[GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE];
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_layer layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.layer = GUAC_DEFAULT_LAYER;
+
+    guac_display_cache cache;
+    guac_display_cache_init(&cache, client, 4 * GUAC_DISPLAY_CACHE_ENTRY_SIZE);
+
+    fill_cell(cell, 1);
+    fill_cell(other, 2);
+
+    /* Nothing is initially cached */
+    CU_ASSERT_PTR_NULL(guac_display_cache_get(&cache, 0x1234, (unsigned char*) cell, TEST_STRIDE, 1));
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 0x1234, (unsigned char*) cell, TEST_STRIDE, &layer, 64, 128, 1));
+
+    /* Adding the same hash twice has no effect */
+    CU_ASSERT_FALSE(guac_display_cache_put(&cache, 0x1234, (unsigned char*) cell, TEST_STRIDE, &layer, 64, 128, 1));
+    CU_ASSERT_EQUAL(cache.length, 1);
+
+    /* Cells that have not yet been stored client-side cannot be used */
+    CU_ASSERT_PTR_NULL(guac_display_cache_get(&cache, 0x1234, (unsigned char*) cell, TEST_STRIDE, 1));
+
+    guac_display_cache_commit(&cache);
+    CU_ASSERT_PTR_NULL(cache.pending);
+
+    /* Stored cells can be used only if their contents match */
+    CU_ASSERT_PTR_NOT_NULL(guac_display_cache_get(&cache, 0x1234, (unsigned char*) cell, TEST_STRIDE, 2));
+    CU_ASSERT_PTR_NULL(guac_display_cache_get(&cache, 0x1234, (unsigned char*) other, TEST_STRIDE, 2));
+
+    CU_ASSERT_EQUAL(cache.hits, 1);
+    CU_ASSERT_EQUAL(cache.misses, 3);
+
+    guac_display_cache_destroy(&cache);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that the least recently used cells are evicted once the
+ * cache is full, except for cells referenced by the frame being planned.
+ */
+void test_display_cache__eviction() {
+
+    uint32_t cell[GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE];
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_layer layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.layer = GUAC_DEFAULT_LAYER;
+
+    guac_display_cache cache;
+    guac_display_cache_init(&cache, client, 2 * GUAC_DISPLAY_CACHE_ENTRY_SIZE);
+
+    fill_cell(cell, 1);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 1, (unsigned char*) cell, TEST_STRIDE, &layer, 0, 0, 1));
+
+    fill_cell(cell, 2);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 2, (unsigned char*) cell, TEST_STRIDE, &layer, 0, 0, 1));
+
+    guac_display_cache_commit(&cache);
+
+    /* Using the first cell makes the second cell least recently used */
+    fill_cell(cell, 1);
+    CU_ASSERT_PTR_NOT_NULL(guac_display_cache_get(&cache, 1, (unsigned char*) cell, TEST_STRIDE, 2));
+
+    /* The cache is full, and both cells were referenced by the current frame
+     * (the first by lookup, the second by a new entry) */
+    fill_cell(cell, 3);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 3, (unsigned char*) cell, TEST_STRIDE, &layer, 0, 0, 2));
+    fill_cell(cell, 4);
+    CU_ASSERT_FALSE(guac_display_cache_put(&cache, 4, (unsigned char*) cell, TEST_STRIDE, &layer, 0, 0, 2));
+
+    CU_ASSERT_EQUAL(cache.length, 2);
+    CU_ASSERT_EQUAL(cache.evictions, 1);
+
+    guac_display_cache_commit(&cache);
+
+    /* The second cell should have been the one evicted */
+    fill_cell(cell, 2);
+    CU_ASSERT_PTR_NULL(guac_display_cache_get(&cache, 2, (unsigned char*) cell, TEST_STRIDE, 3));
+    fill_cell(cell, 3);
+    CU_ASSERT_PTR_NOT_NULL(guac_display_cache_get(&cache, 3, (unsigned char*) cell, TEST_STRIDE, 3));
+
+    /* Shrinking the cache evicts all but the most recently used cell */
+    guac_display_cache_set_size(&cache, GUAC_DISPLAY_CACHE_ENTRY_SIZE);
+    CU_ASSERT_EQUAL(cache.length, 1);
+    CU_ASSERT_PTR_NOT_NULL(guac_display_cache_get(&cache, 3, (unsigned char*) cell, TEST_STRIDE, 4));
+
+    /* Disabling the cache evicts everything */
+    guac_display_cache_set_size(&cache, 0);
+    CU_ASSERT_EQUAL(cache.length, 0);
+    CU_ASSERT_FALSE(guac_display_cache_put(&cache, 3, (unsigned char*) cell, TEST_STRIDE, &layer, 0, 0, 5));
+
+    guac_display_cache_destroy(&cache);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that cells which have not yet been stored are removed
+ * if the layer they would be copied from is freed.
+ */
+void test_display_cache__forget_layer() {
+
+    uint32_t cell[GUAC_DISPLAY_CELL_SIZE * GUAC_DISPLAY_CELL_SIZE];
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_layer layer_a;
+    memset(&layer_a, 0, sizeof(layer_a));
+    layer_a.layer = GUAC_DEFAULT_LAYER;
+
+    guac_display_layer layer_b;
+    memset(&layer_b, 0, sizeof(layer_b));
+    layer_b.layer = GUAC_DEFAULT_LAYER;
+
+    guac_display_cache cache;
+    guac_display_cache_init(&cache, client, 4 * GUAC_DISPLAY_CACHE_ENTRY_SIZE);
+
+    fill_cell(cell, 1);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 1, (unsigned char*) cell, TEST_STRIDE, &layer_a, 0, 0, 1));
+    fill_cell(cell, 2);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 2, (unsigned char*) cell, TEST_STRIDE, &layer_b, 0, 0, 1));
+    fill_cell(cell, 3);
+    CU_ASSERT_TRUE(guac_display_cache_put(&cache, 3, (unsigned char*) cell, TEST_STRIDE, &layer_a, 0, 0, 1));
+
+    guac_display_cache_forget_layer(&cache, &layer_a);
+    CU_ASSERT_EQUAL(cache.length, 1);
+
+    guac_display_cache_commit(&cache);
+
+    fill_cell(cell, 2);
+    CU_ASSERT_PTR_NOT_NULL(guac_display_cache_get(&cache, 2, (unsigned char*) cell, TEST_STRIDE, 2));
+    fill_cell(cell, 1);
+    CU_ASSERT_PTR_NULL(guac_display_cache_get(&cache, 1, (unsigned char*) cell, TEST_STRIDE, 2));
+
+    guac_display_cache_destroy(&cache);
+    guac_client_free(client);
+
+}
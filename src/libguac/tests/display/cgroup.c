@@ -0,0 +1,316 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of files and directories that may be created within the
+ * fake cgroup hierarchy of a single test.
+ */
+#define TEST_MAX_ENTRIES 16
+
+/**
+ * The template of the name of the temporary directory containing each fake
+ * cgroup hierarchy, as accepted by mkdtemp().
+ */
+#define TEST_BASE_TEMPLATE "/tmp/guac-cgroup-test-XXXXXX"
+
+/**
+ * A fake cgroup v2 hierarchy, along with a fake "/proc/self/cgroup", created
+ * within a temporary directory.
+ */
+typedef struct test_hierarchy {
+
+    /**
+     * The temporary directory containing the fake "/proc/self/cgroup" and,
+     * beneath its "cgroup" subdirectory, the fake hierarchy.
+     */
+    char base[sizeof(TEST_BASE_TEMPLATE)];
+
+    /**
+     * The path of the fake "/proc/self/cgroup".
+     */
+    char membership[PATH_MAX];
+
+    /**
+     * The directory at which the fake hierarchy is "mounted".
+     */
+    char root[PATH_MAX];
+
+    /**
+     * Every file and directory created within the temporary directory, in
+     * order of creation, such that they can be removed in reverse order.
+     */
+    char entries[TEST_MAX_ENTRIES][PATH_MAX];
+
+    /**
+     * The number of entries within the entries array.
+     */
+    int entry_count;
+
+} test_hierarchy;
+
+/**
+ * Creates a new, empty fake cgroup hierarchy within a temporary directory.
+ *
+ * @param hierarchy
+ *     The test_hierarchy to initialize.
+ */
+static void hierarchy_init(test_hierarchy* hierarchy) {
+
+    strcpy(hierarchy->base, TEST_BASE_TEMPLATE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(hierarchy->base));
+
+    snprintf(hierarchy->membership, sizeof(hierarchy->membership),
+            "%s/membership", hierarchy->base);
+    snprintf(hierarchy->root, sizeof(hierarchy->root), "%s/cgroup",
+            hierarchy->base);
+
+    hierarchy->entry_count = 0;
+
+}
+
+/**
+ * Creates the given directory within the temporary directory of the given
+ * fake hierarchy.
+ *
+ * @param hierarchy
+ *     The fake hierarchy to modify.
+ *
+ * @param relative_path
+ *     The path of the directory to create, relative to the temporary
+ *     directory.
+ */
+static void hierarchy_mkdir(test_hierarchy* hierarchy,
+        const char* relative_path) {
+
+    CU_ASSERT_FATAL(hierarchy->entry_count < TEST_MAX_ENTRIES);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", hierarchy->base, relative_path);
+    strcpy(hierarchy->entries[hierarchy->entry_count++], path);
+    CU_ASSERT_EQUAL_FATAL(mkdir(path, 0700), 0);
+
+}
+
+/**
+ * Writes the given contents to the given file within the temporary directory
+ * of the given fake hierarchy.
+ *
+ * @param hierarchy
+ *     The fake hierarchy to modify.
+ *
+ * @param relative_path
+ *     The path of the file to write, relative to the temporary directory.
+ *
+ * @param contents
+ *     The contents to write to the file.
+ */
+static void hierarchy_write(test_hierarchy* hierarchy,
+        const char* relative_path, const char* contents) {
+
+    CU_ASSERT_FATAL(hierarchy->entry_count < TEST_MAX_ENTRIES);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", hierarchy->base, relative_path);
+    strcpy(hierarchy->entries[hierarchy->entry_count++], path);
+
+    FILE* file = fopen(path, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    fputs(contents, file);
+    fclose(file);
+
+}
+
+/**
+ * Removes every file and directory created within the given fake hierarchy,
+ * including its temporary directory.
+ *
+ * @param hierarchy
+ *     The fake hierarchy to remove.
+ */
+static void hierarchy_destroy(test_hierarchy* hierarchy) {
+
+    for (int i = hierarchy->entry_count - 1; i >= 0; i--)
+        remove(hierarchy->entries[i]);
+
+    rmdir(hierarchy->base);
+
+}
+
+/**
+ * Calls guac_display_cgroup_nproc() against the given fake hierarchy.
+ *
+ * @param hierarchy
+ *     The fake hierarchy to read.
+ *
+ * @return
+ *     The value returned by guac_display_cgroup_nproc().
+ */
+static unsigned long hierarchy_nproc(test_hierarchy* hierarchy) {
+    return guac_display_cgroup_nproc(hierarchy->membership, hierarchy->root);
+}
+
+/**
+ * Verifies that no quota is reported if the cgroups of the current process
+ * cannot be read at all.
+ */
+void test_display_cgroup__no_membership() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 0);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
+/**
+ * Verifies that no quota is reported if the current process belongs only to
+ * cgroup v1 hierarchies.
+ */
+void test_display_cgroup__v1_only() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    hierarchy_mkdir(&hierarchy, "cgroup");
+    hierarchy_mkdir(&hierarchy, "cgroup/app");
+    hierarchy_write(&hierarchy, "cgroup/app/cpu.max", "100000 100000\n");
+    hierarchy_write(&hierarchy, "membership",
+            "12:cpu,cpuacct:/app\n"
+            "11:memory:/app\n");
+
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 0);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
+/**
+ * Verifies that a quota of "max" is interpreted as no quota.
+ */
+void test_display_cgroup__max() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    hierarchy_mkdir(&hierarchy, "cgroup");
+    hierarchy_mkdir(&hierarchy, "cgroup/app");
+    hierarchy_write(&hierarchy, "cgroup/app/cpu.max", "max 100000\n");
+    hierarchy_write(&hierarchy, "membership", "0::/app\n");
+
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 0);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
+/**
+ * Verifies that whole and fractional quotas are converted to a number of
+ * processors, with fractional quotas rounded up.
+ */
+void test_display_cgroup__fractional() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    hierarchy_mkdir(&hierarchy, "cgroup");
+    hierarchy_mkdir(&hierarchy, "cgroup/app");
+    hierarchy_write(&hierarchy, "membership", "0::/app\n");
+
+    hierarchy_write(&hierarchy, "cgroup/app/cpu.max", "300000 100000\n");
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 3);
+
+    hierarchy_write(&hierarchy, "cgroup/app/cpu.max", "150000 100000\n");
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 2);
+
+    hierarchy_write(&hierarchy, "cgroup/app/cpu.max", "10000 100000\n");
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 1);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
+/**
+ * Verifies that the most restrictive quota of the cgroup of the current
+ * process and of all its ancestors is reported, including where cgroups
+ * lacking any quota lie between cgroups having quotas.
+ */
+void test_display_cgroup__ancestors() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    hierarchy_mkdir(&hierarchy, "cgroup");
+    hierarchy_mkdir(&hierarchy, "cgroup/guacd.slice");
+    hierarchy_mkdir(&hierarchy, "cgroup/guacd.slice/connections");
+    hierarchy_mkdir(&hierarchy, "cgroup/guacd.slice/connections/proc-1");
+    hierarchy_write(&hierarchy, "cgroup/guacd.slice/cpu.max",
+            "200000 100000\n");
+    hierarchy_write(&hierarchy, "cgroup/guacd.slice/connections/proc-1/cpu.max",
+            "max 100000\n");
+    hierarchy_write(&hierarchy, "membership",
+            "12:cpu,cpuacct:/ignored\n"
+            "0::/guacd.slice/connections/proc-1\n");
+
+    /* Only the quota of the grandparent applies */
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 2);
+
+    /* A tighter quota lower in the hierarchy takes precedence */
+    hierarchy_write(&hierarchy, "cgroup/guacd.slice/connections/proc-1/cpu.max",
+            "100000 100000\n");
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 1);
+
+    /* A looser quota lower in the hierarchy does not */
+    hierarchy_write(&hierarchy, "cgroup/guacd.slice/connections/proc-1/cpu.max",
+            "800000 100000\n");
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 2);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
+/**
+ * Verifies that no quota is reported for a process within the root cgroup,
+ * which never has a quota of its own.
+ */
+void test_display_cgroup__root() {
+
+    test_hierarchy hierarchy;
+    hierarchy_init(&hierarchy);
+
+    hierarchy_mkdir(&hierarchy, "cgroup");
+    hierarchy_write(&hierarchy, "membership", "0::/\n");
+
+    CU_ASSERT_EQUAL(hierarchy_nproc(&hierarchy), 0);
+
+    hierarchy_destroy(&hierarchy);
+
+}
+
@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+
+/**
+ * Bitmask of both lossy encodings.
+ */
+#define TEST_LOSSY_CANDIDATES \
+    ((1 << GUAC_DISPLAY_ENCODING_JPEG) | (1 << GUAC_DISPLAY_ENCODING_WEBP))
+
+/**
+ * Records the given per-pixel costs for the given encoding at each of the
+ * given model's quality levels.
+ *
+ * @param model
+ *     The model to update.
+ *
+ * @param encoding
+ *     The encoding whose costs should be recorded.
+ *
+ * @param ns_per_pixel
+ *     The time required to encode each pixel, in nanoseconds.
+ *
+ * @param bytes_per_pixel
+ *     The number of bytes sent for each pixel.
+ */
+static void record_all_levels(guac_display_encoder_model* model,
+        guac_display_encoding encoding, uint64_t ns_per_pixel,
+        uint64_t bytes_per_pixel) {
+
+    for (int level = 0; level < GUAC_DISPLAY_ENCODER_QUALITY_LEVELS; level++) {
+
+        guac_display_encoder_choice choice = {
+            .encoding = encoding,
+            .quality = GUAC_DISPLAY_ENCODER_MIN_QUALITY + level * GUAC_DISPLAY_ENCODER_QUALITY_STEP
+        };
+
+        guac_display_encoder_record(model, &choice, 1000,
+                1000 * ns_per_pixel, 1000 * bytes_per_pixel);
+
+    }
+
+}
+
+/**
+ * Test which verifies that the encoding producing the least data is chosen
+ * at the highest allowed quality if time allows, and that measurements
+ * recorded for each encoding affect that choice.
+ */
+void test_display_encoder__smallest() {
+
+    guac_display_encoder_model model;
+    guac_display_encoder_init(&model);
+
+    guac_display_encoder_choice choice;
+
+    /* WebP produces less data when time is plentiful */
+    record_all_levels(&model, GUAC_DISPLAY_ENCODING_JPEG, 10, 2);
+    record_all_levels(&model, GUAC_DISPLAY_ENCODING_WEBP, 50, 1);
+
+    guac_display_encoder_choose(&model, TEST_LOSSY_CANDIDATES, 90, 1000, UINT64_MAX, &choice);
+    CU_ASSERT_EQUAL(choice.encoding, GUAC_DISPLAY_ENCODING_WEBP);
+    CU_ASSERT_EQUAL(choice.quality, 90);
+
+    /* Only candidates may be chosen */
+    guac_display_encoder_choose(&model, 1 << GUAC_DISPLAY_ENCODING_JPEG, 90, 1000, UINT64_MAX, &choice);
+    CU_ASSERT_EQUAL(choice.encoding, GUAC_DISPLAY_ENCODING_JPEG);
+
+    /* Quality never exceeds the requested maximum */
+    guac_display_encoder_choose(&model, TEST_LOSSY_CANDIDATES, 55, 1000, UINT64_MAX, &choice);
+    CU_ASSERT_EQUAL(choice.quality, 50);
+
+    guac_display_encoder_destroy(&model);
+
+}
+
+/**
+ * Test which verifies that faster encodings and lower quality levels are
+ * chosen when the time budget does not allow for the smallest encoding.
+ */
+void test_display_encoder__budget() {
+
+    guac_display_encoder_model model;
+    guac_display_encoder_init(&model);
+
+    guac_display_encoder_choice choice;
+
+    record_all_levels(&model, GUAC_DISPLAY_ENCODING_JPEG, 10, 2);
+    record_all_levels(&model, GUAC_DISPLAY_ENCODING_WEBP, 50, 1);
+
+    /* WebP is too slow, but JPEG is fast enough */
+    guac_display_encoder_choose(&model, TEST_LOSSY_CANDIDATES, 90, 1000, 20000, &choice);
+    CU_ASSERT_EQUAL(choice.encoding, GUAC_DISPLAY_ENCODING_JPEG);
+    CU_ASSERT_EQUAL(choice.quality, 90);
+
+    /* WebP is fast enough only at lower quality levels */
+    guac_display_encoder_choice slow = {
+        .encoding = GUAC_DISPLAY_ENCODING_WEBP,
+        .quality = 90
+    };
+
+    for (int i = 0; i < 100; i++)
+        guac_display_encoder_record(&model, &slow, 1000, 1000000, 1000);
+
+    guac_display_encoder_choose(&model, 1 << GUAC_DISPLAY_ENCODING_WEBP, 90, 1000, 100000, &choice);
+    CU_ASSERT_EQUAL(choice.encoding, GUAC_DISPLAY_ENCODING_WEBP);
+    CU_ASSERT_EQUAL(choice.quality, 80);
+
+    /* The fastest encoding at the lowest quality is used if nothing is fast
+     * enough */
+    guac_display_encoder_choose(&model, TEST_LOSSY_CANDIDATES, 90, 1000, 1, &choice);
+    CU_ASSERT_EQUAL(choice.encoding, GUAC_DISPLAY_ENCODING_JPEG);
+    CU_ASSERT_EQUAL(choice.quality, GUAC_DISPLAY_ENCODER_MIN_QUALITY);
+
+    guac_display_encoder_destroy(&model);
+
+}
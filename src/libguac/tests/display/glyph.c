@@ -0,0 +1,361 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/fifo.h>
+#include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/rect.h>
+#include <guacamole/timestamp.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The width of the default layer of the test display, in pixels. This is
+ * exactly two cells wide.
+ */
+#define TEST_DISPLAY_WIDTH 128
+
+/**
+ * The height of the default layer of the test display, in pixels. This is
+ * exactly one cell high.
+ */
+#define TEST_DISPLAY_HEIGHT 64
+
+/**
+ * The width of each test glyph, in pixels.
+ */
+#define TEST_GLYPH_WIDTH 8
+
+/**
+ * The height of each test glyph, in pixels.
+ */
+#define TEST_GLYPH_HEIGHT 16
+
+/**
+ * The number of distinct test glyphs within the test glyph atlas.
+ */
+#define TEST_GLYPHS 2
+
+/**
+ * The maximum number of milliseconds to wait for each frame to be fully
+ * encoded before failing.
+ */
+#define TEST_FRAME_TIMEOUT 5000
+
+/**
+ * The template of the name of the temporary directory containing the
+ * recording of the test display, as accepted by mkdtemp().
+ */
+#define TEST_DIR_TEMPLATE "/tmp/guac-glyph-test-XXXXXX"
+
+/**
+ * The trailing elements of each "copy" instruction that copies exactly one
+ * test glyph to the default layer: the width and height of the copied region,
+ * the channel mask (GUAC_COMP_OVER), and the default layer itself.
+ */
+#define TEST_GLYPH_COPY ",1.8,2.16,2.14,1.0,"
+
+/**
+ * The trailing elements of each "copy" instruction that copies the left or
+ * right half of a test glyph to the default layer.
+ */
+#define TEST_HALF_GLYPH_COPY ",1.4,2.16,2.14,1.0,"
+
+/**
+ * The opcode of the "img" instruction, as it appears at the start of each
+ * "img" instruction. Only the default layer is drawn to as image data after
+ * the first frame of the test.
+ */
+#define TEST_IMG "3.img,"
+
+/**
+ * Draws the test glyph having the given index to the given position within
+ * the given raw context.
+ *
+ * @param context
+ *     The raw context to draw to.
+ *
+ * @param glyph
+ *     The index of the test glyph to draw.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the glyph.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the glyph.
+ */
+static void draw_glyph(guac_display_layer_raw_context* context, int glyph,
+        int x, int y) {
+
+    for (int dy = 0; dy < TEST_GLYPH_HEIGHT; dy++) {
+        uint32_t* row = (uint32_t*) (context->buffer + (y + dy) * context->stride) + x;
+        for (int dx = 0; dx < TEST_GLYPH_WIDTH; dx++)
+            row[dx] = 0xFF000000 | ((glyph + 1) * 0x3F1F0F + dx * 31 + dy * 7);
+    }
+
+    guac_rect dirty;
+    guac_rect_init(&dirty, x, y, TEST_GLYPH_WIDTH, TEST_GLYPH_HEIGHT);
+    guac_rect_extend(&context->dirty, &dirty);
+
+}
+
+/**
+ * Draws the test glyph having the given index to the given position within
+ * the given layer, hinting that the glyph was copied from the slot of the
+ * given glyph within the given atlas.
+ *
+ * @param layer
+ *     The layer to draw to.
+ *
+ * @param atlas
+ *     The buffer containing each test glyph.
+ *
+ * @param glyph
+ *     The index of the test glyph to draw.
+ *
+ * @param hinted
+ *     The index of the test glyph that should be hinted as copied.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the glyph.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the glyph.
+ */
+static void copy_glyph(guac_display_layer* layer, guac_display_layer* atlas,
+        int glyph, int hinted, int x, int y) {
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+    draw_glyph(context, glyph, x, y);
+    guac_display_layer_close_raw(layer, context);
+
+    guac_rect src;
+    guac_rect_init(&src, hinted * TEST_GLYPH_WIDTH, 0,
+            TEST_GLYPH_WIDTH, TEST_GLYPH_HEIGHT);
+    guac_display_layer_hint_glyph(layer, atlas, &src, x, y);
+
+}
+
+/**
+ * Ends the current frame of the given display, waiting for that frame to be
+ * fully encoded by the worker threads of the display and for its "sync" to
+ * be sent. The frame is considered sent once the number of frames encoded by
+ * the display increases, rather than once render_state indicates that no
+ * frame is in progress, such that each frame ended by this function is
+ * always sent separately from the next.
+ *
+ * @param display
+ *     The display whose frame should be ended.
+ */
+static void end_frame(guac_display* display) {
+
+    guac_fifo_lock(&display->ops);
+    uint64_t encoded = display->frames_encoded;
+    guac_fifo_unlock(&display->ops);
+
+    guac_display_end_frame(display);
+
+    int waited = 0;
+    for (;;) {
+
+        guac_fifo_lock(&display->ops);
+        int sent = display->frames_encoded > encoded;
+        guac_fifo_unlock(&display->ops);
+
+        if (sent)
+            break;
+
+        CU_ASSERT_FATAL(waited < TEST_FRAME_TIMEOUT);
+        guac_timestamp_msleep(1);
+        waited++;
+
+    }
+
+}
+
+/**
+ * Counts the occurrences of the given string within the given frame of the
+ * given recording, where each frame is terminated by a "sync" instruction.
+ *
+ * @param recording
+ *     The null-terminated contents of the recording.
+ *
+ * @param frame
+ *     The index of the frame to search, where the first frame has index 0.
+ *
+ * @param needle
+ *     The string to search for.
+ *
+ * @return
+ *     The number of occurrences of the given string within the given frame.
+ */
+static int count_in_frame(const char* recording, int frame, const char* needle) {
+
+    const char* start = recording;
+    for (int i = 0; i < frame && start != NULL; i++) {
+        start = strstr(start, "4.sync,");
+        if (start != NULL)
+            start += strlen("4.sync,");
+    }
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(start);
+
+    const char* end = strstr(start, "4.sync,");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(end);
+
+    int count = 0;
+    const char* current = start;
+    while ((current = strstr(current, needle)) != NULL && current < end) {
+        current += strlen(needle);
+        count++;
+    }
+
+    return count;
+
+}
+
+/**
+ * Reads the entire contents of the file at the given path into a new,
+ * null-terminated buffer.
+ *
+ * @param path
+ *     The path of the file to read.
+ *
+ * @return
+ *     A newly-allocated buffer containing the contents of the file, which
+ *     must be freed with guac_mem_free().
+ */
+static char* read_file(const char* path) {
+
+    FILE* file = fopen(path, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    fseek(file, 0, SEEK_END);
+    size_t length = ftell(file);
+    rewind(file);
+
+    char* buffer = guac_mem_alloc(length + 1);
+    CU_ASSERT_EQUAL_FATAL(fread(buffer, 1, length, file), length);
+    buffer[length] = '\0';
+
+    fclose(file);
+    return buffer;
+
+}
+
+/**
+ * Test which verifies that cells whose changes consist entirely of glyphs
+ * hinted with guac_display_layer_hint_glyph() are sent as copies of those
+ * glyphs from the atlas they were drawn from, with glyphs that straddle cells
+ * split between those cells, while cells containing any other changes or
+ * glyphs whose hints are inaccurate are sent as image data.
+ */
+void test_display__glyph_hints() {
+
+    char dir[] = TEST_DIR_TEMPLATE;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(dir));
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/recording", dir);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_recording* recording = guac_recording_create(client, dir,
+            "recording", 0, 1, 0, 0, 0, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(recording);
+
+    guac_display* display = guac_display_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+    guac_display_layer_resize(layer, TEST_DISPLAY_WIDTH, TEST_DISPLAY_HEIGHT);
+
+    /* Frame 0: Send each glyph within the atlas */
+    guac_display_layer* atlas = guac_display_alloc_buffer(display, 1);
+    guac_display_layer_resize(atlas, TEST_GLYPHS * TEST_GLYPH_WIDTH,
+            TEST_GLYPH_HEIGHT);
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(atlas);
+    for (int glyph = 0; glyph < TEST_GLYPHS; glyph++)
+        draw_glyph(context, glyph, glyph * TEST_GLYPH_WIDTH, 0);
+    guac_display_layer_close_raw(atlas, context);
+
+    end_frame(display);
+
+    /* Frame 1: Fill the top row of the first cell with hinted glyphs, while
+     * drawing unhinted image data to the second cell */
+    for (int x = 0; x < 64; x += TEST_GLYPH_WIDTH)
+        copy_glyph(layer, atlas, x / TEST_GLYPH_WIDTH % TEST_GLYPHS,
+                x / TEST_GLYPH_WIDTH % TEST_GLYPHS, x, 0);
+
+    context = guac_display_layer_open_raw(layer);
+    draw_glyph(context, 0, 96, 32);
+    guac_display_layer_close_raw(layer, context);
+
+    end_frame(display);
+
+    /* Frame 2: Draw a hinted glyph straddling both cells */
+    copy_glyph(layer, atlas, 1, 1, 60, 16);
+    end_frame(display);
+
+    /* Frame 3: Draw a glyph with an inaccurate hint to the first cell, and
+     * both a hinted glyph and unhinted image data to the second cell */
+    copy_glyph(layer, atlas, 0, 1, 0, 32);
+    copy_glyph(layer, atlas, 0, 0, 80, 48);
+
+    context = guac_display_layer_open_raw(layer);
+    draw_glyph(context, 1, 112, 48);
+    guac_display_layer_close_raw(layer, context);
+
+    end_frame(display);
+
+    guac_display_free(display);
+    guac_recording_free(recording);
+    guac_client_free(client);
+
+    char* recorded = read_file(path);
+
+    CU_ASSERT_EQUAL(count_in_frame(recorded, 1, TEST_GLYPH_COPY), 8);
+    CU_ASSERT_EQUAL(count_in_frame(recorded, 1, TEST_IMG), 1);
+
+    CU_ASSERT_EQUAL(count_in_frame(recorded, 2, TEST_HALF_GLYPH_COPY), 2);
+    CU_ASSERT_EQUAL(count_in_frame(recorded, 2, TEST_IMG), 0);
+
+    /* The image data of both cells may have been combined */
+    CU_ASSERT_EQUAL(count_in_frame(recorded, 3, TEST_GLYPH_COPY), 0);
+    CU_ASSERT_NOT_EQUAL(count_in_frame(recorded, 3, TEST_IMG), 0);
+
+    guac_mem_free(recorded);
+
+    unlink(path);
+    CU_ASSERT_EQUAL(rmdir(dir), 0);
+
+}
+
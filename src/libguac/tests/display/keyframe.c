@@ -0,0 +1,201 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/mem.h>
+#include <guacamole/recording.h>
+#include <guacamole/rect.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The width and height of the default layer of the test display, in pixels.
+ */
+#define TEST_DISPLAY_SIZE 64
+
+/**
+ * The maximum number of milliseconds to wait for each frame to be fully
+ * encoded before failing.
+ */
+#define TEST_FRAME_TIMEOUT 5000
+
+/**
+ * The template of the name of the temporary directory containing the test
+ * recording, as accepted by mkdtemp().
+ */
+#define TEST_DIR_TEMPLATE "/tmp/guac-keyframe-test-XXXXXX"
+
+/**
+ * Fills the default layer of the given display with a solid color, and waits
+ * for the resulting frame to be fully encoded by the worker threads of the
+ * display.
+ *
+ * @param display
+ *     The display to draw to.
+ *
+ * @param color
+ *     The color to fill the default layer with, as a 32-bit ARGB value.
+ */
+static void draw_frame(guac_display* display, uint32_t color) {
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+    guac_display_layer_resize(layer, TEST_DISPLAY_SIZE, TEST_DISPLAY_SIZE);
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+
+    for (int y = 0; y < TEST_DISPLAY_SIZE; y++) {
+        uint32_t* row = (uint32_t*) (context->buffer + y * context->stride);
+        for (int x = 0; x < TEST_DISPLAY_SIZE; x++)
+            row[x] = color;
+    }
+
+    guac_rect_init(&context->dirty, 0, 0, TEST_DISPLAY_SIZE, TEST_DISPLAY_SIZE);
+    guac_display_layer_close_raw(layer, context);
+
+    guac_display_end_frame(display);
+
+    CU_ASSERT_FATAL(guac_flag_timedwait_and_lock(&display->render_state,
+                GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS,
+                TEST_FRAME_TIMEOUT));
+    guac_flag_unlock(&display->render_state);
+
+}
+
+/**
+ * Reads the entire contents of the file at the given path into a new,
+ * null-terminated buffer.
+ *
+ * @param path
+ *     The path of the file to read.
+ *
+ * @param length
+ *     A pointer to the size_t in which the length of the file should be
+ *     stored.
+ *
+ * @return
+ *     A newly-allocated buffer containing the contents of the file, which
+ *     must be freed with guac_mem_free().
+ */
+static char* read_file(const char* path, size_t* length) {
+
+    FILE* file = fopen(path, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+
+    fseek(file, 0, SEEK_END);
+    *length = ftell(file);
+    rewind(file);
+
+    char* buffer = guac_mem_alloc(*length + 1);
+    CU_ASSERT_EQUAL_FATAL(fread(buffer, 1, *length, file), *length);
+    buffer[*length] = '\0';
+
+    fclose(file);
+    return buffer;
+
+}
+
+/**
+ * Test which verifies that a completed frame of a display whose client is
+ * being recorded with a keyframe index results in a keyframe that refers to
+ * the end of that frame within the recording, followed by the full state of
+ * the display.
+ */
+void test_display__recording_keyframe() {
+
+    char dir[] = TEST_DIR_TEMPLATE;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(dir));
+
+    char recording_path[PATH_MAX];
+    char index_path[PATH_MAX];
+    snprintf(recording_path, sizeof(recording_path), "%s/recording", dir);
+    snprintf(index_path, sizeof(index_path), "%s/recording"
+            GUAC_RECORDING_INDEX_SUFFIX, dir);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_recording_set_default_index_interval(1);
+    guac_recording* recording = guac_recording_create(client, dir,
+            "recording", 0, 1, 0, 0, 0, 0);
+    guac_recording_set_default_index_interval(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(recording);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client->__recording_index);
+
+    guac_display* display = guac_display_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    /* The first completed frame always results in a keyframe */
+    draw_frame(display, 0xFF336699);
+
+    /* Freeing the client flushes the recording and the index */
+    guac_display_free(display);
+    guac_recording_free(recording);
+    guac_client_free(client);
+
+    size_t recording_length;
+    size_t index_length;
+    char* recorded = read_file(recording_path, &recording_length);
+    char* index = read_file(index_path, &index_length);
+
+    int timestamp_length;
+    int offset_length;
+    long long timestamp;
+    long long offset;
+    CU_ASSERT_EQUAL_FATAL(sscanf(index, "8.keyframe,%i.%lld,%i.%lld;",
+                &timestamp_length, &timestamp, &offset_length, &offset), 4);
+
+    /* The keyframe refers to the end of the frame, which follows the "sync"
+     * having the timestamp of the keyframe */
+    char sync[64];
+    snprintf(sync, sizeof(sync), "4.sync,%i.%lld,", timestamp_length,
+            timestamp);
+
+    CU_ASSERT_TRUE_FATAL(offset > 0 && offset <= recording_length);
+    CU_ASSERT_EQUAL(recorded[offset - 1], ';');
+
+    char* sync_start = strstr(recorded, sync);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sync_start);
+    CU_ASSERT_TRUE(sync_start < recorded + offset);
+    CU_ASSERT_PTR_NULL(strstr(recorded + offset, "4.sync,"));
+
+    /* The keyframe is followed by the full state of the display */
+    char size[64];
+    snprintf(size, sizeof(size), "4.size,1.0,2.%i,2.%i;",
+            TEST_DISPLAY_SIZE, TEST_DISPLAY_SIZE);
+    CU_ASSERT_PTR_NOT_NULL(strstr(index, size));
+
+    guac_mem_free(recorded);
+    guac_mem_free(index);
+
+    unlink(recording_path);
+    unlink(index_path);
+    CU_ASSERT_EQUAL(rmdir(dir), 0);
+
+}
+
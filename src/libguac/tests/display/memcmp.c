@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-memcmp.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The maximum number of 32-bit quantities in each randomly-generated test
+ * buffer. This is intentionally not a multiple of any vector width.
+ */
+#define TEST_MAX_COUNT 203
+
+/**
+ * The number of random buffer pairs to compare for each implementation.
+ */
+#define TEST_ITERATIONS 20000
+
+/**
+ * Verifies that the given implementation of guac_display_memcmp_function
+ * produces exactly the same results as the scalar reference implementation
+ * for many random pairs of buffers having random lengths and containing a
+ * random number of differences at random locations.
+ *
+ * @param impl
+ *     The implementation to test.
+ */
+static void verify_memcmp_matches_scalar(guac_display_memcmp_function* impl) {
+
+    uint32_t buffer_a[TEST_MAX_COUNT];
+    uint32_t buffer_b[TEST_MAX_COUNT];
+
+    srand(0x47554143);
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+
+        size_t count = rand() % (TEST_MAX_COUNT + 1);
+
+        for (size_t j = 0; j < count; j++)
+            buffer_a[j] = buffer_b[j] = rand();
+
+        /* Introduce between zero and three differences (a third of all
+         * comparisons will thus involve identical buffers) */
+        int differences = count ? rand() % 4 : 0;
+        for (int j = 0; j < differences; j++)
+            buffer_b[rand() % count] ^= 1 << (rand() % 32);
+
+        size_t expected_pos = (size_t) -1;
+        size_t expected_length = guac_display_memcmp_scalar(buffer_a, buffer_b, count, &expected_pos);
+
+        size_t pos = (size_t) -1;
+        size_t length = impl(buffer_a, buffer_b, count, &pos);
+
+        CU_ASSERT_EQUAL_FATAL(length, expected_length);
+        CU_ASSERT_EQUAL_FATAL(pos, expected_pos);
+
+    }
+
+}
+
+/**
+ * Test which verifies that the scalar reference implementation of
+ * guac_display_memcmp_function locates the first and last differences of
+ * known buffers correctly.
+ */
+void test_display_memcmp__scalar() {
+
+    uint32_t buffer_a[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint32_t buffer_b[] = { 1, 2, 0, 4, 5, 0, 7, 8 };
+
+    size_t pos = (size_t) -1;
+
+    /* Identical buffers should not touch pos */
+    CU_ASSERT_EQUAL(guac_display_memcmp_scalar(buffer_a, buffer_a, 8, &pos), 0);
+    CU_ASSERT_EQUAL(pos, (size_t) -1);
+
+    /* Differences span from offset 2 through offset 5 */
+    CU_ASSERT_EQUAL(guac_display_memcmp_scalar(buffer_a, buffer_b, 8, &pos), 4);
+    CU_ASSERT_EQUAL(pos, 2);
+
+    /* Only the first difference is within the first four values */
+    CU_ASSERT_EQUAL(guac_display_memcmp_scalar(buffer_a, buffer_b, 4, &pos), 1);
+    CU_ASSERT_EQUAL(pos, 2);
+
+}
+
+/**
+ * Test which verifies that the implementation of guac_display_memcmp_function
+ * returned by guac_display_memcmp_select() behaves identically to the scalar
+ * reference implementation.
+ */
+void test_display_memcmp__selected() {
+
+    const char* name = NULL;
+    guac_display_memcmp_function* impl = guac_display_memcmp_select(&name);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(impl);
+    CU_ASSERT_PTR_NOT_NULL(name);
+
+    verify_memcmp_matches_scalar(impl);
+
+}
+
+/**
+ * Test which verifies that each accelerated implementation of
+ * guac_display_memcmp_function supported by the current processor behaves
+ * identically to the scalar reference implementation.
+ */
+void test_display_memcmp__accelerated() {
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+        verify_memcmp_matches_scalar(guac_display_memcmp_sse2);
+
+    if (__builtin_cpu_supports("avx2"))
+        verify_memcmp_matches_scalar(guac_display_memcmp_avx2);
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    verify_memcmp_matches_scalar(guac_display_memcmp_neon);
+#endif
+
+}
@@ -0,0 +1,227 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * The width of the layer drawn to by each test, in pixels.
+ */
+#define TEST_WIDTH 256
+
+/**
+ * The height of the layer drawn to by each test, in pixels.
+ */
+#define TEST_HEIGHT 256
+
+/**
+ * A region to be drawn to by a thread other than the main test thread.
+ */
+typedef struct test_region {
+
+    /**
+     * The layer to draw to.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The region of the layer to draw to.
+     */
+    guac_rect rect;
+
+    /**
+     * The color to fill the region with.
+     */
+    uint32_t color;
+
+    /**
+     * Non-zero once the region has been opened, zero otherwise.
+     */
+    volatile int opened;
+
+} test_region;
+
+/**
+ * Opens the region described by the given test_region, fills it with the
+ * color given, and closes the region again.
+ *
+ * @param data
+ *     The test_region describing the region to draw.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* draw_region(void* data) {
+
+    test_region* region = (test_region*) data;
+
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_region(region->layer, &region->rect);
+
+    region->opened = 1;
+
+    guac_display_layer_raw_context_set(context, &context->bounds,
+            region->color);
+    guac_rect_extend(&context->dirty, &context->bounds);
+
+    guac_display_layer_close_region(region->layer, context);
+    return NULL;
+
+}
+
+/**
+ * Returns the color of the given pixel within the pending frame of the given
+ * layer.
+ *
+ * @param layer
+ *     The layer to read from.
+ *
+ * @param x
+ *     The X coordinate of the pixel.
+ *
+ * @param y
+ *     The Y coordinate of the pixel.
+ *
+ * @return
+ *     The color of the pixel.
+ */
+static uint32_t get_pixel(guac_display_layer* layer, int x, int y) {
+
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(layer);
+
+    guac_rect pixel;
+    guac_rect_init(&pixel, x, y, 1, 1);
+
+    uint32_t color = *((uint32_t*) GUAC_DISPLAY_LAYER_RAW_BUFFER(context,
+                pixel));
+
+    guac_display_layer_close_raw(layer, context);
+    return color;
+
+}
+
+/**
+ * Test which verifies that a region may be opened and drawn to while another
+ * region touching different cells of the same layer remains open.
+ */
+void test_display_region__disjoint() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display* display = guac_display_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+    guac_display_layer_resize(layer, TEST_WIDTH, TEST_HEIGHT);
+
+    /* Hold the left half of the layer open */
+    guac_rect left;
+    guac_rect_init(&left, 0, 0, TEST_WIDTH / 2, TEST_HEIGHT);
+
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_region(layer, &left);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(context);
+    CU_ASSERT_EQUAL(context->bounds.left, 0);
+    CU_ASSERT_EQUAL(context->bounds.right, TEST_WIDTH / 2);
+
+    /* Drawing to the right half must complete without waiting for the left */
+    test_region right = {
+        .layer = layer,
+        .color = 0xFF00FF00
+    };
+    guac_rect_init(&right.rect, TEST_WIDTH / 2, 0, TEST_WIDTH / 2, TEST_HEIGHT);
+
+    pthread_t thread;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, draw_region, &right), 0);
+    pthread_join(thread, NULL);
+    CU_ASSERT_TRUE(right.opened);
+
+    guac_display_layer_raw_context_set(context, &context->bounds, 0xFFFF0000);
+    guac_rect_extend(&context->dirty, &context->bounds);
+    guac_display_layer_close_region(layer, context);
+
+    /* Both regions must be visible within the pending frame */
+    CU_ASSERT_EQUAL(get_pixel(layer, 0, 0), 0xFFFF0000);
+    CU_ASSERT_EQUAL(get_pixel(layer, TEST_WIDTH - 1, TEST_HEIGHT - 1), 0xFF00FF00);
+
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that opening a region overlapping a region that is
+ * already open blocks until the open region is closed.
+ */
+void test_display_region__overlapping() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display* display = guac_display_alloc(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+    guac_display_layer_resize(layer, TEST_WIDTH, TEST_HEIGHT);
+
+    guac_rect first;
+    guac_rect_init(&first, 0, 0, 100, 100);
+
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_region(layer, &first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(context);
+
+    /* The second region shares only the cell at (64, 64) with the first */
+    test_region second = {
+        .layer = layer,
+        .color = 0xFF0000FF
+    };
+    guac_rect_init(&second.rect, 90, 90, 100, 100);
+
+    pthread_t thread;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&thread, NULL, draw_region, &second), 0);
+
+    /* The second region must not be opened while the first is open */
+    usleep(100000);
+    CU_ASSERT_FALSE(second.opened);
+
+    guac_display_layer_raw_context_set(context, &context->bounds, 0xFFFF0000);
+    guac_rect_extend(&context->dirty, &context->bounds);
+    guac_display_layer_close_region(layer, context);
+
+    pthread_join(thread, NULL);
+    CU_ASSERT_TRUE(second.opened);
+
+    /* The second region was drawn last, and so must cover the overlap */
+    CU_ASSERT_EQUAL(get_pixel(layer, 0, 0), 0xFFFF0000);
+    CU_ASSERT_EQUAL(get_pixel(layer, 95, 95), 0xFF0000FF);
+
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-arena.h"
+#include "display-plan.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+
+/**
+ * The number of rows in each test region.
+ */
+#define TEST_LENGTH 300
+
+/**
+ * Fills the given array of row hashes with distinct values, as would be the
+ * case for rows of typical text or other detailed content.
+ *
+ * @param hashes
+ *     The array to fill. This array must have at least TEST_LENGTH elements.
+ *
+ * @param seed
+ *     An arbitrary value that determines the values produced. Different seeds
+ *     produce different values.
+ */
+static void fill_distinct(uint64_t* hashes, uint64_t seed) {
+    for (int i = 0; i < TEST_LENGTH; i++)
+        hashes[i] = (seed + i) * 0x9E3779B97F4A7C15;
+}
+
+/**
+ * Test which verifies that content moved up or down by a fixed offset is
+ * detected as a scroll covering exactly the rows that moved.
+ */
+void test_display_scroll__vertical() {
+
+    uint64_t last[TEST_LENGTH];
+    uint64_t pending[TEST_LENGTH];
+
+    guac_display_plan_scroll scroll;
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    /* Scroll down by 37 rows, with new content appearing at the top */
+    fill_distinct(last, 1);
+    fill_distinct(pending, 100000);
+    for (int i = 37; i < TEST_LENGTH; i++)
+        pending[i] = last[i - 37];
+
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+    CU_ASSERT_EQUAL(scroll.offset, 37);
+    CU_ASSERT_EQUAL(scroll.start, 37);
+    CU_ASSERT_EQUAL(scroll.end, TEST_LENGTH);
+
+    /* Scroll up by 5 rows, with new content appearing at the bottom and a
+     * few unrelated changes in the middle */
+    fill_distinct(pending, 100000);
+    for (int i = 0; i < TEST_LENGTH - 5; i++)
+        pending[i] = last[i + 5];
+
+    pending[20] = 42;
+
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+    CU_ASSERT_EQUAL(scroll.offset, -5);
+    CU_ASSERT_EQUAL(scroll.start, 21);
+    CU_ASSERT_EQUAL(scroll.end, TEST_LENGTH - 5);
+
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that rows of repeated content (such as solid
+ * background) do not by themselves result in a scroll, but are included
+ * within a scroll that is otherwise detected.
+ */
+void test_display_scroll__repeated() {
+
+    uint64_t last[TEST_LENGTH];
+    uint64_t pending[TEST_LENGTH];
+
+    guac_display_plan_scroll scroll;
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    /* Solid background that has merely been redrawn is not a scroll */
+    for (int i = 0; i < TEST_LENGTH; i++)
+        last[i] = pending[i] = 7;
+
+    CU_ASSERT_FALSE(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+
+    /* Moving a block of distinct rows over solid background by 10 rows is a
+     * scroll that also covers the background, which matches at any offset */
+    fill_distinct(pending, 1);
+    for (int i = 0; i < TEST_LENGTH; i++)
+        last[i] = i >= 100 && i < 200 ? pending[i] : 7;
+
+    for (int i = 0; i < TEST_LENGTH; i++)
+        pending[i] = i >= 110 && i < 210 ? last[i - 10] : 7;
+
+    CU_ASSERT_TRUE_FATAL(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+    CU_ASSERT_EQUAL(scroll.offset, 10);
+    CU_ASSERT_EQUAL(scroll.start, 10);
+    CU_ASSERT_EQUAL(scroll.end, TEST_LENGTH);
+
+
+    guac_display_arena_destroy(&arena);
+
+}
+
+/**
+ * Test which verifies that no scroll is reported for unrelated content, nor
+ * for movements that are too small to be worth representing as a scroll.
+ */
+void test_display_scroll__none() {
+
+    uint64_t last[TEST_LENGTH];
+    uint64_t pending[TEST_LENGTH];
+
+    guac_display_plan_scroll scroll;
+
+    guac_display_arena arena;
+    guac_display_arena_init(&arena);
+
+    /* Entirely new content */
+    fill_distinct(last, 1);
+    fill_distinct(pending, 100000);
+    CU_ASSERT_FALSE(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+
+    /* Too few rows moved */
+    for (int i = 0; i < GUAC_DISPLAY_SCROLL_MIN_LENGTH - 1; i++)
+        pending[i + 3] = last[i];
+
+    CU_ASSERT_FALSE(guac_display_plan_find_scroll(&arena, pending, last, TEST_LENGTH, &scroll));
+
+    /* Region too small */
+    CU_ASSERT_FALSE(guac_display_plan_find_scroll(&arena, pending, last,
+                GUAC_DISPLAY_SCROLL_MIN_LENGTH - 1, &scroll));
+
+
+    guac_display_arena_destroy(&arena);
+
+}
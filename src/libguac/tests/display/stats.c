@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+#include "guacamole/display.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+
+/**
+ * Test which verifies that each image update recorded within the
+ * process-wide display statistics is counted within the first histogram
+ * bucket covering its encoding time, with all longer times counted within
+ * the last bucket.
+ */
+void test_display__stats_encode_buckets() {
+
+    guac_display_stats before;
+    guac_display_stats after;
+
+    guac_display_get_process_stats(&before);
+
+    /* Exactly at the bound of the first bucket, just beyond it, and far
+     * beyond the bound of every bucket */
+    guac_display_stats_record_encode(GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND);
+    guac_display_stats_record_encode(GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND + 1);
+    guac_display_stats_record_encode(UINT64_C(1000000000000));
+
+    guac_display_get_process_stats(&after);
+
+    CU_ASSERT_EQUAL(after.encodes[0] - before.encodes[0], 1);
+    CU_ASSERT_EQUAL(after.encodes[1] - before.encodes[1], 1);
+    CU_ASSERT_EQUAL(after.encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS - 1]
+            - before.encodes[GUAC_DISPLAY_STATS_ENCODE_BUCKETS - 1], 1);
+    CU_ASSERT_EQUAL(after.encode_time - before.encode_time,
+            2 * GUAC_DISPLAY_STATS_ENCODE_MIN_BOUND + 1 + UINT64_C(1000000000000));
+
+}
+
+/**
+ * Test which verifies that the process-wide count of pending display
+ * operations tracks operations as they are queued and removed.
+ */
+void test_display__stats_pending() {
+
+    guac_display_stats before;
+    guac_display_stats after;
+
+    guac_display_get_process_stats(&before);
+
+    guac_display_stats_record_pending(5, 0);
+    guac_display_get_process_stats(&after);
+    CU_ASSERT_EQUAL(after.pending_operations, before.pending_operations + 5);
+
+    guac_display_stats_record_pending(0, 5);
+    guac_display_get_process_stats(&after);
+    CU_ASSERT_EQUAL(after.pending_operations, before.pending_operations);
+
+}
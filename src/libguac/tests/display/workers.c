@@ -0,0 +1,264 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "display-priv.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/rect.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * The width and height of the default layer of each test display, in pixels.
+ */
+#define TEST_DISPLAY_SIZE 512
+
+/**
+ * The number of rows and columns of separate squares drawn by draw_frame().
+ */
+#define TEST_DISPLAY_SQUARES 4
+
+/**
+ * The maximum number of milliseconds to wait for each frame drawn by
+ * draw_frame() to be fully encoded before failing.
+ */
+#define TEST_FRAME_TIMEOUT 5000
+
+/**
+ * The number of milliseconds that idle worker threads wait before
+ * terminating within test_display_workers__idle().
+ */
+#define TEST_IDLE_TIMEOUT 10
+
+/**
+ * The maximum number of milliseconds to wait for idle worker threads to
+ * terminate before failing.
+ */
+#define TEST_IDLE_WAIT 5000
+
+/**
+ * Returns the number of worker threads of the given display that are
+ * currently running.
+ *
+ * @param display
+ *     The display to check.
+ *
+ * @return
+ *     The number of running worker threads.
+ */
+static int get_running_workers(guac_display* display) {
+
+    pthread_mutex_lock(&display->workers_lock);
+    int running = display->workers_running;
+    pthread_mutex_unlock(&display->workers_lock);
+
+    return running;
+
+}
+
+/**
+ * Draws a grid of TEST_DISPLAY_SQUARES by TEST_DISPLAY_SQUARES separate
+ * squares to the default layer of the given display, each filled with a
+ * pattern derived from the given value, and waits for the resulting frame to
+ * be fully encoded by the worker threads of the display. As the squares are
+ * separated by unchanged space, each frame consists of several operations.
+ *
+ * @param display
+ *     The display to draw to.
+ *
+ * @param value
+ *     The value to derive the pattern from.
+ */
+static void draw_frame(guac_display* display, uint32_t value) {
+
+    guac_display_layer* layer = guac_display_default_layer(display);
+    guac_display_layer_resize(layer, TEST_DISPLAY_SIZE, TEST_DISPLAY_SIZE);
+
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(layer);
+
+    int spacing = TEST_DISPLAY_SIZE / TEST_DISPLAY_SQUARES;
+    for (int y = 0; y < TEST_DISPLAY_SIZE; y++) {
+        uint32_t* row = (uint32_t*) (context->buffer + y * context->stride);
+        for (int x = 0; x < TEST_DISPLAY_SIZE; x++) {
+            if (x % spacing < spacing / 2 && y % spacing < spacing / 2)
+                row[x] = 0xFF000000 | ((value * 0x01000193 + x * y) & 0xFFFFFF);
+        }
+    }
+
+    guac_rect_init(&context->dirty, 0, 0, TEST_DISPLAY_SIZE, TEST_DISPLAY_SIZE);
+    guac_display_layer_close_raw(layer, context);
+
+    guac_display_end_frame(display);
+
+    CU_ASSERT_FATAL(guac_flag_timedwait_and_lock(&display->render_state,
+                GUAC_DISPLAY_RENDER_STATE_FRAME_NOT_IN_PROGRESS,
+                TEST_FRAME_TIMEOUT));
+    guac_flag_unlock(&display->render_state);
+
+}
+
+/**
+ * Test which verifies that displays allocated after a call to
+ * guac_display_set_default_worker_threads() may use up to that many worker
+ * threads, starting with only one.
+ */
+void test_display_workers__default_count() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_set_default_worker_threads(3);
+    guac_display* display = guac_display_alloc(client);
+    guac_display_set_default_worker_threads(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    CU_ASSERT_PTR_NULL(display->worker_pool);
+    CU_ASSERT_EQUAL(display->worker_thread_count, 3);
+    CU_ASSERT_EQUAL(display->workers_min, 1);
+    CU_ASSERT_EQUAL(display->workers_max, 3);
+    CU_ASSERT_EQUAL(atomic_load(&display->workers_target), 1);
+    CU_ASSERT_EQUAL(get_running_workers(display), 1);
+
+    /* All running worker threads must be joined when the display is freed */
+    draw_frame(display, 1);
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that worker threads beyond the minimum for a display
+ * terminate once idle, that those threads are not restarted merely because
+ * the display is updated again, and that threads are added back as frames
+ * back up.
+ */
+void test_display_workers__idle() {
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_set_default_worker_threads(4);
+    guac_display* display = guac_display_alloc(client);
+    guac_display_set_default_worker_threads(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(display);
+
+    /* Start three worker threads that terminate quickly once idle */
+    atomic_store(&display->workers_idle_timeout, TEST_IDLE_TIMEOUT);
+    guac_display_set_worker_threads(display, 3, 4);
+    guac_display_resume_workers(display);
+    CU_ASSERT_EQUAL(get_running_workers(display), 3);
+
+    /* Only threads beyond the minimum may terminate */
+    guac_display_set_worker_threads(display, 1, 4);
+    for (int waited = 0; waited < TEST_IDLE_WAIT
+            && get_running_workers(display) > 1; waited += TEST_IDLE_TIMEOUT)
+        usleep(TEST_IDLE_TIMEOUT * 1000);
+
+    CU_ASSERT_EQUAL_FATAL(get_running_workers(display), 1);
+    CU_ASSERT_EQUAL(atomic_load(&display->workers_target), 1);
+
+    /* Idle threads are not restarted for the next frame, which also wakes
+     * the remaining thread such that it next waits with the usual timeout
+     * (and cannot terminate once further threads are added below) */
+    atomic_store(&display->workers_idle_timeout, GUAC_DISPLAY_WORKER_IDLE_TIMEOUT);
+    draw_frame(display, 2);
+    CU_ASSERT_EQUAL(get_running_workers(display), 1);
+
+    /* A single deferred frame does not add threads, but consecutive deferred
+     * frames double the number of threads */
+    guac_display_worker_backlog(display, 1);
+    CU_ASSERT_EQUAL(atomic_load(&display->workers_target), 1);
+    guac_display_worker_backlog(display, 1);
+    CU_ASSERT_EQUAL(atomic_load(&display->workers_target), 2);
+
+    guac_display_resume_workers(display);
+    CU_ASSERT_EQUAL(get_running_workers(display), 2);
+
+    draw_frame(display, 1);
+    guac_display_free(display);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that displays allocated after a call to
+ * guac_display_set_shared_workers() share a single pool of worker threads,
+ * and that the frames of each such display are fully encoded by that pool.
+ */
+void test_display_workers__shared() {
+
+    guac_display_stats before;
+    guac_display_stats after;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_display_set_default_worker_threads(2);
+    guac_display_set_shared_workers(1);
+    guac_display* first = guac_display_alloc(client);
+    guac_display* second = guac_display_alloc(client);
+    guac_display_set_shared_workers(0);
+    guac_display_set_default_worker_threads(0);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(second);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first->worker_pool);
+    CU_ASSERT_PTR_EQUAL(first->worker_pool, second->worker_pool);
+    CU_ASSERT_PTR_NULL(first->worker_threads);
+    CU_ASSERT_PTR_NULL(second->worker_threads);
+    CU_ASSERT_EQUAL(first->worker_thread_count, first->worker_pool->thread_count);
+
+    /* Dedicated worker threads are never added to a shared pool */
+    guac_display_worker_backlog(first, 1);
+    guac_display_worker_backlog(first, 1);
+    CU_ASSERT_EQUAL(atomic_load(&first->workers_target), first->worker_thread_count);
+
+    guac_display_get_process_stats(&before);
+
+    /* Frames of both displays, interleaved, are performed by the pool */
+    for (int i = 0; i < 4; i++) {
+        draw_frame(first, i);
+        draw_frame(second, i + 100);
+    }
+
+    guac_display_get_process_stats(&after);
+    CU_ASSERT_EQUAL(after.pending_operations, before.pending_operations);
+
+    /* Neither display remains within the ready queue of the pool once
+     * removed */
+    guac_display_free(first);
+    guac_display_free(second);
+
+    guac_display_worker_pool* pool = guac_display_worker_pool_get(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+    pthread_mutex_lock(&pool->lock);
+    CU_ASSERT_PTR_NULL(pool->first);
+    CU_ASSERT_PTR_NULL(pool->last);
+    pthread_mutex_unlock(&pool->lock);
+
+    guac_client_free(client);
+
+}
+
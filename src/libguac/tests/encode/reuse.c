@@ -0,0 +1,314 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "encode-jpeg.h"
+#include "encode-png.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The width and height of the smaller of the two test images, in pixels.
+ */
+#define TEST_SMALL_SIZE 48
+
+/**
+ * The width and height of the larger of the two test images, in pixels.
+ */
+#define TEST_LARGE_SIZE 96
+
+/**
+ * All data written to a guac_socket allocated with test_socket_alloc().
+ */
+typedef struct test_output {
+
+    /**
+     * The data written so far.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of data written so far.
+     */
+    size_t length;
+
+} test_output;
+
+/**
+ * Write handler for sockets allocated with test_socket_alloc(), which appends
+ * all written data to the test_output associated with the socket.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes given.
+ */
+static ssize_t test_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    test_output* output = (test_output*) socket->data;
+
+    output->data = guac_mem_realloc(output->data, output->length + count);
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+
+    return count;
+
+}
+
+/**
+ * Allocates a new guac_socket that stores all data written to it within the
+ * given test_output.
+ *
+ * @param output
+ *     The test_output that should receive all data written.
+ *
+ * @return
+ *     A newly-allocated guac_socket.
+ */
+static guac_socket* test_socket_alloc(test_output* output) {
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = output;
+    socket->write_handler = test_socket_write;
+
+    return socket;
+
+}
+
+/**
+ * Fills the given image buffer with a pattern that uses either only a few
+ * colors (allowing a PNG palette to be used) or many colors (preventing use
+ * of a palette).
+ *
+ * @param image
+ *     The image buffer to fill, in the same format as CAIRO_FORMAT_RGB24.
+ *
+ * @param size
+ *     The width and height of the image, in pixels.
+ *
+ * @param colors
+ *     The number of distinct colors that should be used, or zero to use far
+ *     more colors than can fit in a palette.
+ */
+static void fill_image(uint32_t* image, int size, int colors) {
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+
+            uint32_t color = (x * 0x000301) ^ (y * 0x050007);
+            if (colors)
+                color = ((x + y) % colors) * 0x102030;
+
+            /* The upper 8 bits are unused and may contain anything */
+            image[y * size + x] = 0x55000000 | (color & 0xFFFFFF);
+
+        }
+    }
+
+}
+
+/**
+ * Verifies that the given output matches the expected output exactly.
+ *
+ * @param expected
+ *     The expected output.
+ *
+ * @param actual
+ *     The output to compare against the expected output.
+ */
+static void assert_output_equal(const test_output* expected,
+        const test_output* actual) {
+
+    CU_ASSERT_NOT_EQUAL_FATAL(expected->length, 0);
+    CU_ASSERT_EQUAL_FATAL(expected->length, actual->length);
+    CU_ASSERT_EQUAL(memcmp(expected->data, actual->data, expected->length), 0);
+
+}
+
+/**
+ * Test which verifies that a PNG encoder which has already been used to
+ * encode a larger image that cannot use a palette produces exactly the same
+ * output for a smaller, palette-based image as a newly-allocated encoder.
+ */
+void test_encode_reuse__png() {
+
+    uint32_t small[TEST_SMALL_SIZE * TEST_SMALL_SIZE];
+    uint32_t large[TEST_LARGE_SIZE * TEST_LARGE_SIZE];
+
+    fill_image(small, TEST_SMALL_SIZE, 5);
+    fill_image(large, TEST_LARGE_SIZE, 0);
+
+    guac_stream stream = { .index = 1 };
+
+    test_output fresh = { 0 };
+    test_output reused = { 0 };
+    test_output ignored = { 0 };
+
+    guac_socket* fresh_socket = test_socket_alloc(&fresh);
+    guac_socket* reused_socket = test_socket_alloc(&reused);
+    guac_socket* ignored_socket = test_socket_alloc(&ignored);
+
+    guac_png_encoder* encoder = guac_png_encoder_alloc();
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, fresh_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4), 0);
+    guac_png_encoder_free(encoder);
+
+    encoder = guac_png_encoder_alloc();
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, ignored_socket, &stream,
+                (unsigned char*) large, TEST_LARGE_SIZE, TEST_LARGE_SIZE,
+                TEST_LARGE_SIZE * 4), 0);
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, reused_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4), 0);
+    guac_png_encoder_free(encoder);
+
+    guac_socket_flush(fresh_socket);
+    guac_socket_flush(reused_socket);
+    assert_output_equal(&fresh, &reused);
+
+    guac_socket_free(fresh_socket);
+    guac_socket_free(reused_socket);
+    guac_socket_free(ignored_socket);
+
+    guac_mem_free(fresh.data);
+    guac_mem_free(reused.data);
+    guac_mem_free(ignored.data);
+
+}
+
+/**
+ * Test which verifies that a PNG encoder which has already been used to
+ * encode an image in fast mode produces exactly the same output for a
+ * subsequent image outside fast mode as a newly-allocated encoder.
+ */
+void test_encode_reuse__png_fast() {
+
+    uint32_t small[TEST_SMALL_SIZE * TEST_SMALL_SIZE];
+    uint32_t large[TEST_LARGE_SIZE * TEST_LARGE_SIZE];
+
+    fill_image(small, TEST_SMALL_SIZE, 0);
+    fill_image(large, TEST_LARGE_SIZE, 0);
+
+    guac_stream stream = { .index = 1 };
+
+    test_output fresh = { 0 };
+    test_output reused = { 0 };
+    test_output ignored = { 0 };
+
+    guac_socket* fresh_socket = test_socket_alloc(&fresh);
+    guac_socket* reused_socket = test_socket_alloc(&reused);
+    guac_socket* ignored_socket = test_socket_alloc(&ignored);
+
+    guac_png_encoder* encoder = guac_png_encoder_alloc();
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, fresh_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4), 0);
+    guac_png_encoder_free(encoder);
+
+    encoder = guac_png_encoder_alloc();
+    encoder->fast = 1;
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, ignored_socket, &stream,
+                (unsigned char*) large, TEST_LARGE_SIZE, TEST_LARGE_SIZE,
+                TEST_LARGE_SIZE * 4), 0);
+    encoder->fast = 0;
+    CU_ASSERT_EQUAL(guac_png_write_raw(encoder, reused_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4), 0);
+    guac_png_encoder_free(encoder);
+
+    guac_socket_flush(fresh_socket);
+    guac_socket_flush(reused_socket);
+    assert_output_equal(&fresh, &reused);
+
+    guac_socket_free(fresh_socket);
+    guac_socket_free(reused_socket);
+    guac_socket_free(ignored_socket);
+
+    guac_mem_free(fresh.data);
+    guac_mem_free(reused.data);
+    guac_mem_free(ignored.data);
+
+}
+
+/**
+ * Test which verifies that a JPEG encoder which has already been used to
+ * encode a larger image at a different quality produces exactly the same
+ * output as a newly-allocated encoder.
+ */
+void test_encode_reuse__jpeg() {
+
+    uint32_t small[TEST_SMALL_SIZE * TEST_SMALL_SIZE];
+    uint32_t large[TEST_LARGE_SIZE * TEST_LARGE_SIZE];
+
+    fill_image(small, TEST_SMALL_SIZE, 0);
+    fill_image(large, TEST_LARGE_SIZE, 0);
+
+    guac_stream stream = { .index = 1 };
+
+    test_output fresh = { 0 };
+    test_output reused = { 0 };
+    test_output ignored = { 0 };
+
+    guac_socket* fresh_socket = test_socket_alloc(&fresh);
+    guac_socket* reused_socket = test_socket_alloc(&reused);
+    guac_socket* ignored_socket = test_socket_alloc(&ignored);
+
+    guac_jpeg_encoder* encoder = guac_jpeg_encoder_alloc();
+    CU_ASSERT_EQUAL(guac_jpeg_write_raw(encoder, fresh_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4, 60), 0);
+    guac_jpeg_encoder_free(encoder);
+
+    encoder = guac_jpeg_encoder_alloc();
+    CU_ASSERT_EQUAL(guac_jpeg_write_raw(encoder, ignored_socket, &stream,
+                (unsigned char*) large, TEST_LARGE_SIZE, TEST_LARGE_SIZE,
+                TEST_LARGE_SIZE * 4, 90), 0);
+    CU_ASSERT_EQUAL(guac_jpeg_write_raw(encoder, reused_socket, &stream,
+                (unsigned char*) small, TEST_SMALL_SIZE, TEST_SMALL_SIZE,
+                TEST_SMALL_SIZE * 4, 60), 0);
+    guac_jpeg_encoder_free(encoder);
+
+    guac_socket_flush(fresh_socket);
+    guac_socket_flush(reused_socket);
+    assert_output_equal(&fresh, &reused);
+
+    guac_socket_free(fresh_socket);
+    guac_socket_free(reused_socket);
+    guac_socket_free(ignored_socket);
+
+    guac_mem_free(fresh.data);
+    guac_mem_free(reused.data);
+    guac_mem_free(ignored.data);
+
+}
+
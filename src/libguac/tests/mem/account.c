@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+
+/**
+ * Test which verifies that memory explicitly accounted for with
+ * guac_mem_account_alloc() and guac_mem_account_free() is reflected within
+ * the totals of its category alone.
+ */
+void test_mem__account_explicit() {
+
+    guac_mem_stats before;
+    guac_mem_get_process_stats(&before);
+
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_CLIPBOARD, 12345);
+
+    guac_mem_stats during;
+    guac_mem_get_process_stats(&during);
+
+    CU_ASSERT_EQUAL(during.bytes[GUAC_MEM_CATEGORY_CLIPBOARD],
+            before.bytes[GUAC_MEM_CATEGORY_CLIPBOARD] + 12345);
+    CU_ASSERT_EQUAL(during.bytes[GUAC_MEM_CATEGORY_TERMINAL],
+            before.bytes[GUAC_MEM_CATEGORY_TERMINAL]);
+
+    guac_mem_account_free(GUAC_MEM_CATEGORY_CLIPBOARD, 12345);
+
+    guac_mem_stats after;
+    guac_mem_get_process_stats(&after);
+
+    CU_ASSERT_EQUAL(after.bytes[GUAC_MEM_CATEGORY_CLIPBOARD],
+            before.bytes[GUAC_MEM_CATEGORY_CLIPBOARD]);
+
+}
+
+/**
+ * Test which verifies that blocks allocated with guac_mem_zalloc_pages() are
+ * accounted for automatically, moving between categories when tagged and
+ * leaving the totals of all categories unchanged once freed.
+ */
+void test_mem__account_pages() {
+
+    size_t sizes[] = { 1, 4096, 4 * 1024 * 1024 };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+
+        guac_mem_stats before;
+        guac_mem_get_process_stats(&before);
+
+        void* ptr = guac_mem_zalloc_pages(sizes[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ptr);
+
+        guac_mem_stats allocated;
+        guac_mem_get_process_stats(&allocated);
+        CU_ASSERT_EQUAL(allocated.bytes[GUAC_MEM_CATEGORY_OTHER],
+                before.bytes[GUAC_MEM_CATEGORY_OTHER] + sizes[i]);
+
+        guac_mem_tag_pages(ptr, GUAC_MEM_CATEGORY_DISPLAY);
+
+        guac_mem_stats tagged;
+        guac_mem_get_process_stats(&tagged);
+        CU_ASSERT_EQUAL(tagged.bytes[GUAC_MEM_CATEGORY_OTHER],
+                before.bytes[GUAC_MEM_CATEGORY_OTHER]);
+        CU_ASSERT_EQUAL(tagged.bytes[GUAC_MEM_CATEGORY_DISPLAY],
+                before.bytes[GUAC_MEM_CATEGORY_DISPLAY] + sizes[i]);
+
+        guac_mem_free_pages(ptr);
+
+        guac_mem_stats after;
+        guac_mem_get_process_stats(&after);
+        CU_ASSERT_EQUAL(after.bytes[GUAC_MEM_CATEGORY_OTHER],
+                before.bytes[GUAC_MEM_CATEGORY_OTHER]);
+        CU_ASSERT_EQUAL(after.bytes[GUAC_MEM_CATEGORY_DISPLAY],
+                before.bytes[GUAC_MEM_CATEGORY_DISPLAY]);
+
+    }
+
+}
+
+/**
+ * Test which verifies that each category of memory has a distinct name, and
+ * that invalid categories are named "unknown".
+ */
+void test_mem__account_names() {
+
+    CU_ASSERT_STRING_EQUAL(guac_mem_category_name(GUAC_MEM_CATEGORY_DISPLAY), "display");
+    CU_ASSERT_STRING_EQUAL(guac_mem_category_name(GUAC_MEM_CATEGORY_COUNT), "unknown");
+
+    for (int i = 0; i < GUAC_MEM_CATEGORY_COUNT; i++) {
+        for (int j = i + 1; j < GUAC_MEM_CATEGORY_COUNT; j++)
+            CU_ASSERT_STRING_NOT_EQUAL(guac_mem_category_name(i),
+                    guac_mem_category_name(j));
+    }
+
+}
+
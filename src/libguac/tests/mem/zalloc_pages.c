@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Test which verifies that guac_mem_zalloc_pages() returns NULL for all inputs
+ * involving at least one zero value.
+ */
+void test_mem__zalloc_pages_fail_zero() {
+
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(0));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(0, 0));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(1, 0));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(3, 2, 0));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(99, 99, 99, 0, 99));
+
+}
+
+/**
+ * Returns whether all bytes within the given memory region are zero.
+ *
+ * @param ptr
+ *     The first byte of the memory region to test.
+ *
+ * @param length
+ *     The number of bytes within the memory region.
+ *
+ * @returns
+ *     Non-zero if all bytes within the memory region have the value of zero,
+ *     zero otherwise.
+ */
+static int is_all_zeroes(void* ptr, size_t length) {
+
+    int result = 0;
+
+    unsigned char* current = (unsigned char*) ptr;
+    for (size_t i = 0; i < length; i++)
+        result |= *(current++);
+
+    return !result;
+
+}
+
+/**
+ * Test which verifies that guac_mem_zalloc_pages() successfully allocates
+ * zeroed, writable blocks of memory both smaller and larger than a huge page,
+ * and that guac_mem_free_pages() frees those blocks and assigns NULL.
+ */
+void test_mem__zalloc_pages_success() {
+
+    const size_t sizes[] = {
+        123,
+        2 * 1024 * 1024 - 1,
+        2 * 1024 * 1024,
+        3 * 1024 * 1024 + 7
+    };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+
+        unsigned char* ptr = guac_mem_zalloc_pages(sizes[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(ptr);
+        CU_ASSERT(is_all_zeroes(ptr, sizes[i]));
+
+        /* The entire block must be writable */
+        memset(ptr, 0xFF, sizes[i]);
+
+        guac_mem_free_pages(ptr);
+        CU_ASSERT_PTR_NULL(ptr);
+
+    }
+
+}
+
+/**
+ * Test which verifies that guac_mem_zalloc_pages() fails to allocate blocks of
+ * memory that exceed the capacity of a size_t.
+ */
+void test_mem__zalloc_pages_fail_large() {
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(123, 456, SIZE_MAX));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(SIZE_MAX / 2, SIZE_MAX / 2));
+    CU_ASSERT_PTR_NULL(guac_mem_zalloc_pages(SIZE_MAX - 1));
+}
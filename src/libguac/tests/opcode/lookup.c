@@ -0,0 +1,135 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <CUnit/CUnit.h>
+#include <guacamole/opcode.h>
+
+#include <stddef.h>
+
+/**
+ * An arbitrary opcode/handler mapping, having the same layout as the
+ * mappings used to dispatch instructions.
+ */
+typedef struct test_mapping {
+
+    /**
+     * The opcode of this mapping.
+     */
+    const char* opcode;
+
+    /**
+     * An arbitrary value associated with the opcode.
+     */
+    int value;
+
+} test_mapping;
+
+/**
+ * A mapping containing every opcode within the Guacamole protocol that may be
+ * sent to guacd, plus several opcodes that share prefixes or lengths.
+ */
+static test_mapping test_map[] = {
+    { "sync",       0 },
+    { "touch",      1 },
+    { "mouse",      2 },
+    { "key",        3 },
+    { "clipboard",  4 },
+    { "disconnect", 5 },
+    { "size",       6 },
+    { "file",       7 },
+    { "pipe",       8 },
+    { "ack",        9 },
+    { "blob",       10 },
+    { "end",        11 },
+    { "get",        12 },
+    { "put",        13 },
+    { "audio",      14 },
+    { "argv",       15 },
+    { "nop",        16 },
+    { "",           17 },
+    { "a",          18 },
+    { "b",          19 },
+    { "ab",         20 },
+    { "ba",         21 },
+    { NULL,         -1 }
+};
+
+/**
+ * Test which verifies that every opcode within an indexed array is found at
+ * its own position, and that opcodes absent from the array are not found.
+ */
+void test_opcode__lookup() {
+
+    guac_opcode_index index;
+    CU_ASSERT_EQUAL(guac_opcode_index_init(&index, test_map,
+                sizeof(test_mapping)), 0);
+
+    for (int i = 0; test_map[i].opcode != NULL; i++)
+        CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, test_map[i].opcode),
+                test_map[i].value);
+
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "syn"), -1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "syncs"), -1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "SYNC"), -1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "c"), -1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "img"), -1);
+
+}
+
+/**
+ * Test which verifies that indexing an array containing duplicate opcodes
+ * falls back to searching that array linearly, finding the first of the
+ * duplicates.
+ */
+void test_opcode__duplicates() {
+
+    test_mapping duplicates[] = {
+        { "mouse", 0 },
+        { "key",   1 },
+        { "mouse", 2 },
+        { NULL,    -1 }
+    };
+
+    guac_opcode_index index;
+    CU_ASSERT_NOT_EQUAL(guac_opcode_index_init(&index, duplicates,
+                sizeof(test_mapping)), 0);
+
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "mouse"), 0);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "key"), 1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "size"), -1);
+
+}
+
+/**
+ * Test which verifies that nothing is found within an indexed empty array.
+ */
+void test_opcode__empty() {
+
+    test_mapping empty[] = {
+        { NULL, -1 }
+    };
+
+    guac_opcode_index index;
+    CU_ASSERT_EQUAL(guac_opcode_index_init(&index, empty,
+                sizeof(test_mapping)), 0);
+
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, "sync"), -1);
+    CU_ASSERT_EQUAL(guac_opcode_index_lookup(&index, ""), -1);
+
+}
+
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 /**
@@ -75,3 +76,201 @@ void test_parser__append() {
 
 }
 
+
+/**
+ * Test which verifies that guac_parser correctly parses lengthy elements
+ * containing a mixture of ASCII and multi-byte UTF-8 characters, regardless
+ * of how that data is split across calls to guac_parser_append().
+ */
+void test_parser__append_bulk() {
+
+    /* Build element containing ASCII runs of varying length, each followed by
+     * a multibyte character ("\xC3\xA9" is 2 bytes, "\xE2\x82\xAC" is 3) */
+    char content[4096] = "";
+    int characters = 0;
+    for (int i = 0; i < 40; i++) {
+
+        for (int j = 0; j < i * 3; j++)
+            strcat(content, "Q");
+
+        strcat(content, i % 2 ? "\xC3\xA9" : "\xE2\x82\xAC");
+        characters += i * 3 + 1;
+
+    }
+
+    /* Instruction input, followed by data beyond the end of the instruction */
+    char buffer[8192];
+    int instruction_length = snprintf(buffer, sizeof(buffer),
+            "4.blob,1.0,%i.%s;", characters, content);
+    strcpy(buffer + instruction_length, "XXXXXXXXXX");
+
+    /* Try every possible step size up to an arbitrary limit, such that
+     * available data ends at every possible position within characters */
+    for (int step = 1; step <= 37; step++) {
+
+        char copy[8192];
+        memcpy(copy, buffer, sizeof(copy));
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        /* Make data available step bytes at a time, as if read in pieces */
+        char* current = copy;
+        char* end = copy;
+        while (parser->state != GUAC_PARSE_COMPLETE
+                && parser->state != GUAC_PARSE_ERROR
+                && end < copy + instruction_length + 10) {
+
+            end += step;
+            if (end > copy + instruction_length + 10)
+                end = copy + instruction_length + 10;
+
+            int parsed;
+            while ((parsed = guac_parser_append(parser, current, end - current)) > 0)
+                current += parsed;
+
+        }
+
+        /* Parse must complete at exactly the end of the instruction */
+        CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+        CU_ASSERT_PTR_EQUAL(current, copy + instruction_length);
+
+        /* Validate resulting structure and content */
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->opcode,  "blob");
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+        CU_ASSERT_STRING_EQUAL(parser->argv[1], content);
+
+        guac_parser_free(parser);
+
+    }
+
+}
+
+/**
+ * Test which verifies that guac_parser rejects elements longer than
+ * GUAC_INSTRUCTION_MAX_LENGTH by default, but accepts such elements once the
+ * limit has been raised with guac_parser_set_max_length().
+ */
+void test_parser__append_max_length() {
+
+    static char buffer[GUAC_INSTRUCTION_MAX_LENGTH * 2 + 32];
+    int length = GUAC_INSTRUCTION_MAX_LENGTH * 2;
+
+    /* Build single-element instruction exceeding the default limit */
+    int prefix_length = sprintf(buffer, "%i.", length);
+    memset(buffer + prefix_length, 'A', length);
+    strcpy(buffer + prefix_length + length, ";");
+
+    /* The default limit must be enforced */
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    guac_parser_append(parser, buffer, prefix_length);
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+    guac_parser_free(parser);
+
+    /* A raised limit must allow the same instruction */
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL_FATAL(guac_parser_set_max_length(parser,
+                GUAC_INSTRUCTION_LARGE_MAX_LENGTH), 0);
+
+    char* current = buffer;
+    int remaining = prefix_length + length + 1;
+    int parsed;
+    while ((parsed = guac_parser_append(parser, current, remaining)) > 0) {
+        current += parsed;
+        remaining -= parsed;
+    }
+
+    CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_EQUAL(remaining, 0);
+    CU_ASSERT_EQUAL(strlen(parser->opcode), length);
+
+    guac_parser_free(parser);
+
+}
+
+/**
+ * Test which verifies that guac_parser accepts elements containing raw binary
+ * data only once enabled with guac_parser_enable_binary(), and that such
+ * elements may contain arbitrary bytes (including nulls, terminators, and
+ * bytes which are not valid UTF-8), regardless of how that data is split
+ * across calls to guac_parser_append().
+ */
+void test_parser__append_binary() {
+
+    /* Binary content containing every possible byte value */
+    unsigned char content[256];
+    for (int i = 0; i < sizeof(content); i++)
+        content[i] = (unsigned char) (255 - i);
+
+    /* Instruction input, followed by data beyond the end of the instruction */
+    char buffer[512];
+    int instruction_length = sprintf(buffer, "4.blob,1.0,256#");
+    memcpy(buffer + instruction_length, content, sizeof(content));
+    instruction_length += sizeof(content);
+    memcpy(buffer + instruction_length, ";XXXXXXXXXX", 11);
+    instruction_length++;
+
+    /* Binary elements must be rejected unless enabled */
+    char copy[512];
+    memcpy(copy, buffer, sizeof(copy));
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    char* current = copy;
+    int parsed;
+    while ((parsed = guac_parser_append(parser, current,
+                    instruction_length - (current - copy))) > 0)
+        current += parsed;
+
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+    guac_parser_free(parser);
+
+    /* Try every possible step size up to an arbitrary limit */
+    for (int step = 1; step <= 37; step++) {
+
+        memcpy(copy, buffer, sizeof(copy));
+
+        parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+        guac_parser_enable_binary(parser);
+
+        /* Make data available step bytes at a time, as if read in pieces */
+        current = copy;
+        char* end = copy;
+        while (parser->state != GUAC_PARSE_COMPLETE
+                && parser->state != GUAC_PARSE_ERROR
+                && end < copy + instruction_length + 10) {
+
+            end += step;
+            if (end > copy + instruction_length + 10)
+                end = copy + instruction_length + 10;
+
+            while ((parsed = guac_parser_append(parser, current, end - current)) > 0)
+                current += parsed;
+
+        }
+
+        /* Parse must complete at exactly the end of the instruction */
+        CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+        CU_ASSERT_PTR_EQUAL(current, copy + instruction_length);
+
+        /* Validate resulting structure and content */
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->opcode,  "blob");
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], "0");
+        CU_ASSERT_EQUAL(guac_parser_binary_length(parser, 0), -1);
+        CU_ASSERT_EQUAL_FATAL(guac_parser_binary_length(parser, 1),
+                sizeof(content));
+        CU_ASSERT_EQUAL(guac_parser_binary_length(parser, 2), -1);
+        CU_ASSERT(memcmp(parser->argv[1], content, sizeof(content)) == 0);
+
+        guac_parser_free(parser);
+
+    }
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+
+#include <string.h>
+
+/**
+ * Test which verifies that guac_parser_read_buffer() reads each of several
+ * consecutive instructions directly from a block of data, advancing through
+ * that data, and reports GUAC_STATUS_CLOSED once only an incomplete
+ * instruction remains.
+ */
+void test_parser__read_buffer() {
+
+    char buffer[] = "4.test,8.testdata,5.zxcvb;"
+                    "5.test2,10.hellohello;"
+                    "3.end;"
+                    "7.partial,3.abc";
+
+    char* current = buffer;
+    char* end = buffer + sizeof(buffer) - 1;
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    /* First instruction */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_PTR_EQUAL(current, buffer + 26);
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_STRING_EQUAL(parser->opcode,  "test");
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "testdata");
+    CU_ASSERT_STRING_EQUAL(parser->argv[1], "zxcvb");
+
+    /* Second instruction */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->opcode,  "test2");
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "hellohello");
+
+    /* Third instruction (no arguments) */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_EQUAL(parser->argc, 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "end");
+
+    /* Incomplete final instruction */
+    CU_ASSERT_NOT_EQUAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_CLOSED);
+    CU_ASSERT_PTR_EQUAL(current, end);
+
+    guac_parser_free(parser);
+
+}
+
+/**
+ * Test which verifies that guac_parser_read_buffer() fails with
+ * GUAC_STATUS_PROTOCOL_ERROR if the data is not valid Guacamole protocol.
+ */
+void test_parser__read_buffer_invalid() {
+
+    char buffer[] = "4.test;x.invalid;";
+    char* current = buffer;
+    char* end = buffer + sizeof(buffer) - 1;
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+
+    CU_ASSERT_NOT_EQUAL(guac_parser_read_buffer(parser, &current, end), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_PROTOCOL_ERROR);
+
+    guac_parser_free(parser);
+
+}
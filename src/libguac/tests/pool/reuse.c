@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/pool.h>
+
+/**
+ * The minimum size of the guac_pool instance being tested.
+ */
+#define POOL_SIZE 16
+
+/**
+ * Test which verifies that, once the minimum size of a guac_pool has been
+ * reached, freed integers are reused lowest first, with new integers
+ * returned only once all freed integers are again in use.
+ */
+void test_pool__reuse_lowest() {
+
+    guac_pool* pool = guac_pool_alloc(POOL_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+
+    /* Obtain all integers up to the minimum size */
+    for (int i = 0; i < POOL_SIZE; i++)
+        CU_ASSERT_EQUAL(i, guac_pool_next_int(pool));
+
+    /* Free a few integers out of order */
+    guac_pool_free_int(pool, 9);
+    guac_pool_free_int(pool, 3);
+    guac_pool_free_int(pool, 12);
+
+    /* Freed integers should be reused lowest first */
+    CU_ASSERT_EQUAL(3, guac_pool_next_int(pool));
+    CU_ASSERT_EQUAL(9, guac_pool_next_int(pool));
+    CU_ASSERT_EQUAL(12, guac_pool_next_int(pool));
+
+    /* With nothing left to reuse, the next integer should be new */
+    CU_ASSERT_EQUAL(POOL_SIZE, guac_pool_next_int(pool));
+    CU_ASSERT_EQUAL(POOL_SIZE + 1, pool->active);
+
+    guac_pool_free(pool);
+
+}
+
+/**
+ * Test which verifies that guac_pool_next_int_below() never returns an
+ * integer at or beyond the given limit, returning -1 once all integers below
+ * that limit are in use, and reusing integers below that limit once freed.
+ */
+void test_pool__next_int_below() {
+
+    guac_pool* pool = guac_pool_alloc(0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pool);
+
+    /* Exhaust all integers below the limit */
+    for (int i = 0; i < POOL_SIZE; i++)
+        CU_ASSERT_EQUAL(i, guac_pool_next_int_below(pool, POOL_SIZE));
+
+    CU_ASSERT_EQUAL(-1, guac_pool_next_int_below(pool, POOL_SIZE));
+    CU_ASSERT_EQUAL(POOL_SIZE, pool->active);
+
+    /* Freed integers below the limit should again be available */
+    guac_pool_free_int(pool, 5);
+    CU_ASSERT_EQUAL(5, guac_pool_next_int_below(pool, POOL_SIZE));
+    CU_ASSERT_EQUAL(-1, guac_pool_next_int_below(pool, POOL_SIZE));
+
+    /* Integers beyond the limit remain available without that limit */
+    CU_ASSERT_EQUAL(POOL_SIZE, guac_pool_next_int(pool));
+
+    guac_pool_free(pool);
+
+}
@@ -20,6 +20,8 @@
 #include <CUnit/CUnit.h>
 #include <guacamole/protocol.h>
 
+#include <string.h>
+
 /**
  * Tests that libguac's in-place base64 decoding function properly decodes
  * valid base64 and fails for invalid base64.
@@ -53,3 +55,33 @@ void test_protocol__decode_base64() {
 
 }
 
+
+/**
+ * Tests that libguac's buffer-based base64 decoding function decodes into a
+ * separate buffer without modifying the original string, and never writes
+ * beyond the end of that buffer.
+ */
+void test_protocol__decode_base64_buffer() {
+
+    const char test_AVOCADO[] = "QVZPQ0FETw==";
+    const char test_GUACAMOLE[] = "R1VBQ0FNT0xF";
+
+    char buffer[16];
+
+    /* The maximum decoded length must always be sufficient */
+    CU_ASSERT_EQUAL(GUAC_PROTOCOL_BASE64_DECODED_LENGTH(strlen(test_GUACAMOLE)), 9);
+    CU_ASSERT_TRUE(GUAC_PROTOCOL_BASE64_DECODED_LENGTH(strlen(test_AVOCADO)) >= 7);
+
+    /* Decode into separate buffer, leaving original intact */
+    CU_ASSERT_EQUAL(guac_protocol_decode_base64_buffer(test_AVOCADO,
+                buffer, sizeof(buffer)), 7);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "AVOCADO", 7);
+    CU_ASSERT_STRING_EQUAL(test_AVOCADO, "QVZPQ0FETw==");
+
+    /* Decoding must stop once the buffer is full */
+    memset(buffer, 'X', sizeof(buffer));
+    CU_ASSERT_EQUAL(guac_protocol_decode_base64_buffer(test_GUACAMOLE,
+                buffer, 4), 4);
+    CU_ASSERT_NSTRING_EQUAL(buffer, "GUACXXXX", 8);
+
+}
@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "protocol-batch.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/layer.h>
+#include <guacamole/mem.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * All data written to a guac_socket allocated with test_socket_alloc().
+ */
+typedef struct test_output {
+
+    /**
+     * The data written so far.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of data written so far.
+     */
+    size_t length;
+
+    /**
+     * The number of times data has been written.
+     */
+    int writes;
+
+} test_output;
+
+/**
+ * Write handler for sockets allocated with test_socket_alloc(), which appends
+ * all written data to the test_output associated with the socket.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes given.
+ */
+static ssize_t test_socket_write(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    test_output* output = (test_output*) socket->data;
+
+    output->data = guac_mem_realloc(output->data, output->length + count);
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+    output->writes++;
+
+    return count;
+
+}
+
+/**
+ * Allocates a new guac_socket that stores all data written to it within the
+ * given test_output.
+ *
+ * @param output
+ *     The test_output that should receive all data written.
+ *
+ * @return
+ *     A newly-allocated guac_socket.
+ */
+static guac_socket* test_socket_alloc(test_output* output) {
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = output;
+    socket->write_handler = test_socket_write;
+
+    return socket;
+
+}
+
+/**
+ * Test which verifies that instructions formatted by guac_protocol_batch are
+ * identical to those sent by the corresponding guac_protocol_send_*()
+ * functions, including for extreme integer values.
+ */
+void test_protocol__batch_identical() {
+
+    const guac_layer layer = { .index = 3 };
+    const guac_layer buffer = { .index = -12 };
+
+    test_output expected = { 0 };
+    test_output actual = { 0 };
+
+    guac_socket* expected_socket = test_socket_alloc(&expected);
+    guac_socket* actual_socket = test_socket_alloc(&actual);
+
+    guac_protocol_batch batch;
+    guac_protocol_batch_init(&batch, actual_socket);
+
+    guac_protocol_send_rect(expected_socket, &layer, 0, 9, 10, 1234567);
+    guac_protocol_send_cfill(expected_socket, GUAC_COMP_RATOP, &layer,
+            0x00, 0x7F, 0x80, 0xFF);
+    guac_protocol_send_copy(expected_socket, &buffer, INT_MAX, INT_MIN,
+            -1, 99, GUAC_COMP_OVER, &layer, 100, -100);
+
+    CU_ASSERT_EQUAL(guac_protocol_batch_rect(&batch, &layer, 0, 9, 10, 1234567), 0);
+    CU_ASSERT_EQUAL(guac_protocol_batch_cfill(&batch, GUAC_COMP_RATOP, &layer,
+                0x00, 0x7F, 0x80, 0xFF), 0);
+    CU_ASSERT_EQUAL(guac_protocol_batch_copy(&batch, &buffer, INT_MAX, INT_MIN,
+                -1, 99, GUAC_COMP_OVER, &layer, 100, -100), 0);
+
+    /* Nothing is written until the batch is flushed, at which point all
+     * instructions are written at once */
+    CU_ASSERT_EQUAL(actual.writes, 0);
+    CU_ASSERT_EQUAL(guac_protocol_batch_flush(&batch), 0);
+    CU_ASSERT_EQUAL(actual.writes, 1);
+
+    CU_ASSERT_EQUAL_FATAL(actual.length, expected.length);
+    CU_ASSERT_EQUAL(memcmp(actual.data, expected.data, expected.length), 0);
+
+    guac_socket_free(expected_socket);
+    guac_socket_free(actual_socket);
+
+    guac_mem_free(expected.data);
+    guac_mem_free(actual.data);
+
+}
+
+/**
+ * Test which verifies that a guac_protocol_batch writes its contents to the
+ * socket as it fills, such that any number of instructions may be added to a
+ * single batch without any being lost or reordered.
+ */
+void test_protocol__batch_overflow() {
+
+    const guac_layer layer = { .index = 1 };
+
+    test_output expected = { 0 };
+    test_output actual = { 0 };
+
+    guac_socket* expected_socket = test_socket_alloc(&expected);
+    guac_socket* actual_socket = test_socket_alloc(&actual);
+
+    guac_protocol_batch batch;
+    guac_protocol_batch_init(&batch, actual_socket);
+
+    for (int i = 0; i < 5000; i++) {
+        guac_protocol_send_copy(expected_socket, &layer, i, i * 3, 64, 64,
+                GUAC_COMP_OVER, &layer, i * 7, -i);
+        CU_ASSERT_EQUAL_FATAL(guac_protocol_batch_copy(&batch, &layer, i,
+                    i * 3, 64, 64, GUAC_COMP_OVER, &layer, i * 7, -i), 0);
+    }
+
+    CU_ASSERT_EQUAL(guac_protocol_batch_flush(&batch), 0);
+
+    /* Flushing an empty batch has no effect */
+    int writes = actual.writes;
+    CU_ASSERT_EQUAL(guac_protocol_batch_flush(&batch), 0);
+    CU_ASSERT_EQUAL(actual.writes, writes);
+    CU_ASSERT(writes > 1);
+
+    CU_ASSERT_EQUAL_FATAL(actual.length, expected.length);
+    CU_ASSERT_EQUAL(memcmp(actual.data, expected.data, expected.length), 0);
+
+    guac_socket_free(expected_socket);
+    guac_socket_free(actual_socket);
+
+    guac_mem_free(expected.data);
+    guac_mem_free(actual.data);
+
+}
+
@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "protocol-format.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The number of "copy" instructions sent by test_protocol__format_copy().
+ */
+#define TEST_COPY_INSTRUCTIONS 20000
+
+/**
+ * Verifies that guac_protocol_format_int() and
+ * guac_protocol_format_length_int() produce exactly what snprintf() would
+ * produce for the given value.
+ *
+ * @param value
+ *     The integer to format.
+ */
+static void test_format_value(int64_t value) {
+
+    char expected[64];
+    char expected_value[64];
+    char actual[GUAC_PROTOCOL_FORMAT_INT_MAX_LENGTH];
+
+    int value_length = snprintf(expected_value, sizeof(expected_value),
+            "%" PRId64, value);
+    int length = snprintf(expected, sizeof(expected), "%i.%s", value_length,
+            expected_value);
+
+    CU_ASSERT_EQUAL_FATAL(guac_protocol_format_int(actual, value),
+            value_length);
+    CU_ASSERT_EQUAL_FATAL(memcmp(actual, expected_value, value_length), 0);
+
+    CU_ASSERT_EQUAL_FATAL(guac_protocol_format_length_int(actual, value),
+            length);
+    CU_ASSERT_EQUAL_FATAL(memcmp(actual, expected, length), 0);
+
+}
+
+/**
+ * Test which verifies that integers are formatted correctly both within and
+ * outside the range of precomputed values, including at the boundaries of
+ * that range and at the limits of 64-bit integers.
+ */
+void test_protocol__format_int() {
+
+    for (int64_t value = -100000; value <= 100000; value++)
+        test_format_value(value);
+
+    for (int64_t value = 1; value > 0 && value <= INT64_MAX / 10; value *= 10) {
+        test_format_value(value - 1);
+        test_format_value(value);
+        test_format_value(-value);
+        test_format_value(-value + 1);
+    }
+
+    test_format_value(GUAC_PROTOCOL_FORMAT_CACHED_MIN - 1);
+    test_format_value(GUAC_PROTOCOL_FORMAT_CACHED_MIN);
+    test_format_value(GUAC_PROTOCOL_FORMAT_CACHED_MAX);
+    test_format_value(GUAC_PROTOCOL_FORMAT_CACHED_MAX + 1);
+    test_format_value(INT64_MAX);
+    test_format_value(INT64_MIN);
+    test_format_value(INT64_MIN + 1);
+
+}
+
+/**
+ * Write handler for the socket used by test_protocol__format_copy(),
+ * which discards all written data, counting only the number of bytes
+ * written.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes given.
+ */
+static ssize_t test_socket_discard(guac_socket* socket, const void* buf,
+        size_t count) {
+    *((size_t*) socket->data) += count;
+    return count;
+}
+
+/**
+ * Test which sends a large number of "copy" instructions with typical
+ * parameters over a socket which discards its output, verifying the total
+ * amount of data written. The rate at which such instructions are formatted
+ * is measured separately by the "protocol_send_copy" benchmark.
+ */
+void test_protocol__format_copy() {
+
+    const guac_layer layer = { .index = 1 };
+    const guac_layer buffer = { .index = -3 };
+
+    size_t written = 0;
+    size_t expected = 0;
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = &written;
+    socket->write_handler = test_socket_discard;
+
+    for (int i = 0; i < TEST_COPY_INSTRUCTIONS; i++) {
+        int x = (i * 64) % 1920;
+        int y = (i / 30 * 64) % 1080;
+        CU_ASSERT_EQUAL_FATAL(guac_protocol_send_copy(socket, &buffer, 0, 0,
+                    64, 64, GUAC_COMP_OVER, &layer, x, y), 0);
+    }
+
+    /* Determine the expected length of the same instructions independently
+     * of libguac */
+    for (int i = 0; i < TEST_COPY_INSTRUCTIONS; i++) {
+        char instruction[256];
+        int x = (i * 64) % 1920;
+        int y = (i / 30 * 64) % 1080;
+        char x_value[16], y_value[16];
+        int x_length = snprintf(x_value, sizeof(x_value), "%i", x);
+        int y_length = snprintf(y_value, sizeof(y_value), "%i", y);
+        expected += snprintf(instruction, sizeof(instruction),
+                "4.copy,2.-3,1.0,1.0,2.64,2.64,2.14,1.1,%i.%s,%i.%s;",
+                x_length, x_value, y_length, y_value);
+    }
+
+    guac_socket_flush(socket);
+    CU_ASSERT_EQUAL(written, expected);
+
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,148 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/rwlock.h>
+
+#include <pthread.h>
+
+/**
+ * The number of times the lock is acquired by each thread of the
+ * test_rwlock__exclusion test.
+ */
+#define RWLOCK_TEST_ITERATIONS 10000
+
+/**
+ * The state shared by all threads of the test_rwlock__exclusion test.
+ */
+typedef struct rwlock_test_state {
+
+    /**
+     * The lock being tested.
+     */
+    guac_rwlock lock;
+
+    /**
+     * A value which is incremented twice by each writer while the write lock
+     * is held, and thus must always be even while the read lock is held.
+     */
+    int value;
+
+    /**
+     * The number of times that a reader observed an odd value.
+     */
+    int violations;
+
+} rwlock_test_state;
+
+/**
+ * Repeatedly acquires the read lock of the given rwlock_test_state
+ * (reentrantly), recording any violation of mutual exclusion.
+ *
+ * @param data
+ *     The rwlock_test_state of the test.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* rwlock_test_reader(void* data) {
+
+    rwlock_test_state* state = (rwlock_test_state*) data;
+
+    for (int i = 0; i < RWLOCK_TEST_ITERATIONS; i++) {
+
+        guac_rwlock_acquire_read_lock(&state->lock);
+        guac_rwlock_acquire_read_lock(&state->lock);
+
+        if (state->value % 2)
+            state->violations++;
+
+        guac_rwlock_release_lock(&state->lock);
+        guac_rwlock_release_lock(&state->lock);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Test which verifies that read locks may be acquired reentrantly, that a
+ * read lock may be upgraded to a write lock by the same thread, and that the
+ * lock is fully released only once every acquisition has been released.
+ */
+void test_rwlock__reentrant() {
+
+    guac_rwlock lock;
+    guac_rwlock_init(&lock);
+
+    /* Read locks may be acquired repeatedly (the second acquisition of a
+     * read lock may be reader-biased) */
+    for (int i = 0; i < 2; i++) {
+        CU_ASSERT_EQUAL(0, guac_rwlock_acquire_read_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_acquire_read_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_acquire_write_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_acquire_read_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_release_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_release_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_release_lock(&lock));
+        CU_ASSERT_EQUAL(0, guac_rwlock_release_lock(&lock));
+    }
+
+    /* Releasing a lock that is not held must fail */
+    CU_ASSERT_NOT_EQUAL(0, guac_rwlock_release_lock(&lock));
+
+    /* The write lock must be available once all locks are released */
+    CU_ASSERT_EQUAL(0, pthread_rwlock_trywrlock(&lock.lock));
+    pthread_rwlock_unlock(&lock.lock);
+
+    guac_rwlock_destroy(&lock);
+
+}
+
+/**
+ * Test which verifies that readers never observe the state protected by the
+ * lock while that state is being modified by a writer, regardless of whether
+ * those readers acquired the read lock with reader bias.
+ */
+void test_rwlock__exclusion() {
+
+    rwlock_test_state state = { .value = 0, .violations = 0 };
+    guac_rwlock_init(&state.lock);
+
+    pthread_t readers[2];
+    for (int i = 0; i < 2; i++)
+        pthread_create(&readers[i], NULL, rwlock_test_reader, &state);
+
+    for (int i = 0; i < RWLOCK_TEST_ITERATIONS; i++) {
+        guac_rwlock_acquire_write_lock(&state.lock);
+        state.value++;
+        state.value++;
+        guac_rwlock_release_lock(&state.lock);
+    }
+
+    for (int i = 0; i < 2; i++)
+        pthread_join(readers[i], NULL);
+
+    CU_ASSERT_EQUAL(0, state.violations);
+    CU_ASSERT_EQUAL(2 * RWLOCK_TEST_ITERATIONS, state.value);
+
+    guac_rwlock_destroy(&state.lock);
+
+}
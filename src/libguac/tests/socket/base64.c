@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "socket-base64.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of bytes in each randomly-generated test buffer. This is
+ * intentionally not a multiple of any vector width.
+ */
+#define TEST_MAX_LENGTH 517
+
+/**
+ * The number of random buffers to encode for each implementation.
+ */
+#define TEST_ITERATIONS 20000
+
+/**
+ * The total number of bytes written by write_base64_data().
+ */
+#define TEST_DATA_LENGTH 50000
+
+/**
+ * Verifies that the given implementation of guac_socket_base64_function
+ * produces exactly the same results as the scalar reference implementation
+ * for many random buffers having random lengths.
+ *
+ * @param impl
+ *     The implementation to test.
+ */
+static void verify_base64_matches_scalar(guac_socket_base64_function* impl) {
+
+    unsigned char data[TEST_MAX_LENGTH];
+    char expected[GUAC_SOCKET_BASE64_ENCODED_LENGTH(TEST_MAX_LENGTH)];
+    char encoded[GUAC_SOCKET_BASE64_ENCODED_LENGTH(TEST_MAX_LENGTH)];
+
+    srand(0x47554143);
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+
+        size_t length = rand() % (TEST_MAX_LENGTH + 1);
+
+        for (size_t j = 0; j < length; j++)
+            data[j] = rand();
+
+        size_t expected_length = guac_socket_base64_scalar(data, length, expected);
+        size_t encoded_length = impl(data, length, encoded);
+
+        CU_ASSERT_EQUAL_FATAL(expected_length, GUAC_SOCKET_BASE64_ENCODED_LENGTH(length));
+        CU_ASSERT_EQUAL_FATAL(encoded_length, expected_length);
+        CU_ASSERT_EQUAL_FATAL(memcmp(encoded, expected, expected_length), 0);
+
+    }
+
+}
+
+/**
+ * Test which verifies that the scalar reference implementation of
+ * guac_socket_base64_function produces the test vectors of RFC 4648.
+ */
+void test_socket__base64_scalar() {
+
+    static const char* vectors[][2] = {
+        { "",       ""         },
+        { "f",      "Zg=="     },
+        { "fo",     "Zm8="     },
+        { "foo",    "Zm9v"     },
+        { "foob",   "Zm9vYg==" },
+        { "fooba",  "Zm9vYmE=" },
+        { "foobar", "Zm9vYmFy" }
+    };
+
+    char encoded[16];
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+
+        const char* data = vectors[i][0];
+        const char* expected = vectors[i][1];
+
+        size_t length = guac_socket_base64_scalar((const unsigned char*) data,
+                strlen(data), encoded);
+
+        CU_ASSERT_EQUAL_FATAL(length, strlen(expected));
+        CU_ASSERT_NSTRING_EQUAL(encoded, expected, length);
+
+    }
+
+    /* Every possible 6-bit value must map to the expected character */
+    unsigned char all[48];
+    for (int i = 0; i < 16; i++) {
+        all[i * 3]     = (i * 4) << 2 | (i * 4 + 1) >> 4;
+        all[i * 3 + 1] = (i * 4 + 1) << 4 | (i * 4 + 2) >> 2;
+        all[i * 3 + 2] = (i * 4 + 2) << 6 | (i * 4 + 3);
+    }
+
+    char all_encoded[64];
+    CU_ASSERT_EQUAL_FATAL(guac_socket_base64_scalar(all, sizeof(all), all_encoded), 64);
+    CU_ASSERT_NSTRING_EQUAL(all_encoded,
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", 64);
+
+}
+
+/**
+ * Test which verifies that the implementation of guac_socket_base64_function
+ * returned by guac_socket_base64_select() behaves identically to the scalar
+ * reference implementation.
+ */
+void test_socket__base64_selected() {
+
+    const char* name = NULL;
+    guac_socket_base64_function* impl = guac_socket_base64_select(&name);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(impl);
+    CU_ASSERT_PTR_NOT_NULL(name);
+
+    verify_base64_matches_scalar(impl);
+
+}
+
+/**
+ * Test which verifies that each accelerated implementation of
+ * guac_socket_base64_function supported by the current processor behaves
+ * identically to the scalar reference implementation.
+ */
+void test_socket__base64_accelerated() {
+
+#if defined(HAVE_X86_CPU_DISPATCH)
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("ssse3"))
+        verify_base64_matches_scalar(guac_socket_base64_ssse3);
+
+    if (__builtin_cpu_supports("avx2"))
+        verify_base64_matches_scalar(guac_socket_base64_avx2);
+
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    verify_base64_matches_scalar(guac_socket_base64_neon);
+#endif
+
+}
+
+/**
+ * Returns the byte expected at the given offset within the data written by
+ * write_base64_data().
+ *
+ * @param offset
+ *     The offset of the byte, relative to the start of the data.
+ *
+ * @return
+ *     The byte expected at the given offset.
+ */
+static unsigned char expected_byte(int offset) {
+    return (unsigned char) (offset * 7 + offset / 251);
+}
+
+/**
+ * Writes TEST_DATA_LENGTH bytes of data as base64 using a guac_socket
+ * wrapping the given file descriptor, in chunks of varying size that are both
+ * smaller and larger than the ready buffer of that socket. The given file
+ * descriptor is automatically closed as a result of calling this function.
+ *
+ * @param fd
+ *     The file descriptor to write data to.
+ */
+static void write_base64_data(int fd) {
+
+    /* Sizes of successive writes (repeated as necessary) */
+    static const int chunk_sizes[] = { 1, 100, 5000, 20000, 768, 2, 7 };
+
+    static unsigned char data[TEST_DATA_LENGTH];
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = expected_byte(i);
+
+    /* Open guac socket */
+    guac_socket* socket = guac_socket_open(fd);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        close(fd);
+        return;
+    }
+
+    /* Write all data in chunks of varying size */
+    int offset = 0;
+    for (int i = 0; offset < TEST_DATA_LENGTH; i++) {
+
+        int length = chunk_sizes[i % (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))];
+        if (length > TEST_DATA_LENGTH - offset)
+            length = TEST_DATA_LENGTH - offset;
+
+        guac_socket_write_base64(socket, data + offset, length);
+        offset += length;
+
+    }
+
+    guac_socket_flush_base64(socket);
+    guac_socket_flush(socket);
+
+    /* Close and free socket */
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Tests that guac_socket_write_base64() produces exactly the same output as
+ * encoding the same data all at once, regardless of how that data is split
+ * across calls. A child process is forked to write the data which is read and
+ * verified by the parent process.
+ */
+void test_socket__base64_write() {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write data within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_base64_data(write_fd);
+        exit(0);
+    }
+
+    close(write_fd);
+
+    /* Read everything available into buffer */
+    static char buffer[GUAC_SOCKET_BASE64_ENCODED_LENGTH(TEST_DATA_LENGTH) + 1];
+    int numread;
+    int offset = 0;
+
+    while ((numread = read(read_fd, buffer + offset,
+                    sizeof(buffer) - offset)) > 0) {
+        offset += numread;
+    }
+
+    close(read_fd);
+
+    /* Encode the same data all at once for comparison */
+    static unsigned char data[TEST_DATA_LENGTH];
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = expected_byte(i);
+
+    static char expected[GUAC_SOCKET_BASE64_ENCODED_LENGTH(TEST_DATA_LENGTH)];
+    size_t expected_length = guac_socket_base64_scalar(data, TEST_DATA_LENGTH, expected);
+
+    /* Verify length and contents of read data */
+    CU_ASSERT_EQUAL_FATAL(offset, expected_length);
+    CU_ASSERT_EQUAL(memcmp(buffer, expected, expected_length), 0);
+
+}
@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * The total number of bytes written by write_data().
+ */
+#define TEST_DATA_LENGTH 100000
+
+/**
+ * The size of the output buffer of the guac_socket used by write_data().
+ */
+#define TEST_BUFFER_SIZE 16384
+
+/**
+ * Returns the byte expected at the given offset within the data written by
+ * write_data().
+ *
+ * @param offset
+ *     The offset of the byte, relative to the start of the data.
+ *
+ * @return
+ *     The byte expected at the given offset.
+ */
+static char expected_byte(int offset) {
+    return (char) (offset * 7 + offset / 251);
+}
+
+/**
+ * Writes TEST_DATA_LENGTH bytes of data using a guac_socket wrapping the given
+ * file descriptor, in chunks of varying size that are both smaller and larger
+ * than the output buffer of that socket. The given file descriptor is
+ * automatically closed as a result of calling this function.
+ *
+ * @param fd
+ *     The file descriptor to write data to.
+ */
+static void write_data(int fd) {
+
+    /* Sizes of successive writes (repeated as necessary) */
+    static const int chunk_sizes[] = { 1, 100, 5000, 20000, TEST_BUFFER_SIZE, 3, 40000 };
+
+    static char data[TEST_DATA_LENGTH];
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = expected_byte(i);
+
+    /* Open guac socket */
+    guac_socket* socket = guac_socket_open_buffered(fd, TEST_BUFFER_SIZE);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        close(fd);
+        return;
+    }
+
+    /* Write all data in chunks of varying size */
+    int offset = 0;
+    for (int i = 0; offset < TEST_DATA_LENGTH; i++) {
+
+        int length = chunk_sizes[i % (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))];
+        if (length > TEST_DATA_LENGTH - offset)
+            length = TEST_DATA_LENGTH - offset;
+
+        guac_socket_write(socket, data + offset, length);
+        offset += length;
+
+    }
+
+    guac_socket_flush(socket);
+
+    /* Close and free socket */
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Tests that the file descriptor implementation of guac_socket writes data of
+ * any size intact and in order, regardless of whether that data is buffered
+ * or written together with the buffer contents. A child process is forked to
+ * write the data which is read and verified by the parent process.
+ */
+void test_socket__fd_write_buffered() {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write data within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_data(write_fd);
+        exit(0);
+    }
+
+    close(write_fd);
+
+    /* Read everything available into buffer */
+    static char buffer[TEST_DATA_LENGTH + 1];
+    int numread;
+    int offset = 0;
+
+    while ((numread = read(read_fd, buffer + offset,
+                    sizeof(buffer) - offset)) > 0) {
+        offset += numread;
+    }
+
+    close(read_fd);
+
+    /* Verify length and contents of read data */
+    CU_ASSERT_EQUAL_FATAL(offset, TEST_DATA_LENGTH);
+
+    int mismatched = 0;
+    for (int i = 0; i < TEST_DATA_LENGTH; i++) {
+        if (buffer[i] != expected_byte(i))
+            mismatched++;
+    }
+
+    CU_ASSERT_EQUAL(mismatched, 0);
+
+}
@@ -0,0 +1,234 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/mem.h>
+#include <guacamole/socket.h>
+#include <guacamole/unicode.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A single UTF-8 character of each possible length (1, 2, 3, and 4 bytes),
+ * such that data repeating this sequence contains multi-byte characters that
+ * straddle any chunk boundary.
+ */
+#define UTF8_MIXED "z\xc3\xa1\xe7\x8a\xac\xf0\x90\xac\x80"
+
+/**
+ * The number of times UTF8_MIXED is repeated within the large write tested.
+ */
+#define TEST_REPEAT 5000
+
+/**
+ * All data written to the socket allocated by write_and_verify().
+ */
+typedef struct test_output {
+
+    /**
+     * The bytes written thus far.
+     */
+    char* data;
+
+    /**
+     * The number of bytes written thus far.
+     */
+    size_t length;
+
+} test_output;
+
+/**
+ * Write handler which appends all written data to the test_output associated
+ * with the given socket.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @param buf
+ *     The data being written.
+ *
+ * @param count
+ *     The number of bytes being written.
+ *
+ * @return
+ *     The number of bytes written, which is always the number of bytes given.
+ */
+static ssize_t test_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_output* output = (test_output*) socket->data;
+
+    output->data = guac_mem_realloc(output->data, output->length + count);
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+
+    return count;
+
+}
+
+/**
+ * Verifies that the given output consists entirely of "nest" instructions for
+ * stream 123, each containing no more than the given number of bytes of
+ * nested data with an accurate length prefix, and that the nested data of
+ * those instructions together is identical to the given data.
+ *
+ * @param output
+ *     The output to verify.
+ *
+ * @param expected
+ *     The nested data expected.
+ *
+ * @param expected_length
+ *     The number of bytes of nested data expected.
+ *
+ * @param chunk_size
+ *     The maximum number of bytes of nested data allowed per instruction.
+ *
+ * @return
+ *     The number of "nest" instructions within the output.
+ */
+static int verify_output(test_output* output, const char* expected,
+        size_t expected_length, size_t chunk_size) {
+
+    const char* current = output->data;
+    const char* end = output->data + output->length;
+
+    size_t nested = 0;
+    int instructions = 0;
+
+    while (current < end) {
+
+        CU_ASSERT_EQUAL_FATAL(strncmp(current, "4.nest,3.123,", 13), 0);
+        current += 13;
+
+        /* Parse length of nested data, in characters */
+        char* period;
+        long chars = strtol(current, &period, 10);
+        CU_ASSERT_EQUAL_FATAL(*period, '.');
+        current = period + 1;
+
+        /* Advance past the given number of characters */
+        const char* start = current;
+        for (long i = 0; i < chars; i++)
+            current += guac_utf8_charsize(*current);
+
+        size_t length = current - start;
+        CU_ASSERT_FATAL(length <= chunk_size);
+        CU_ASSERT_FATAL(nested + length <= expected_length);
+        CU_ASSERT_EQUAL_FATAL(memcmp(start, expected + nested, length), 0);
+        nested += length;
+
+        CU_ASSERT_EQUAL_FATAL(*current, ';');
+        current++;
+
+        instructions++;
+
+    }
+
+    CU_ASSERT_EQUAL(nested, expected_length);
+    return instructions;
+
+}
+
+/**
+ * Writes a small write, a large write consisting of many multi-byte
+ * characters, and a further small write to a nested socket having the given
+ * chunk size, verifying that the resulting "nest" instructions contain
+ * exactly the data written.
+ *
+ * @param chunk_size
+ *     The chunk size to pass to guac_socket_nest_chunked().
+ *
+ * @param expected_chunk_size
+ *     The maximum number of bytes of nested data expected per instruction.
+ *
+ * @return
+ *     The number of "nest" instructions written.
+ */
+static int write_and_verify(int chunk_size, size_t expected_chunk_size) {
+
+    test_output output = { 0 };
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->data = &output;
+    socket->write_handler = test_write_handler;
+
+    guac_socket* nested = guac_socket_nest_chunked(socket, 123, chunk_size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(nested);
+
+    /* Build the data that will be written: the large write begins with the
+     * final byte of a character started by the preceding small write */
+    size_t large_length = TEST_REPEAT * (sizeof(UTF8_MIXED) - 1);
+    size_t total = 2 + 1 + large_length + 1;
+    char* expected = guac_mem_alloc(total);
+
+    memcpy(expected, "a\xc3", 2);
+    expected[2] = '\xa1';
+    for (int i = 0; i < TEST_REPEAT; i++)
+        memcpy(expected + 3 + i * (sizeof(UTF8_MIXED) - 1), UTF8_MIXED,
+                sizeof(UTF8_MIXED) - 1);
+    expected[total - 1] = 'b';
+
+    CU_ASSERT_EQUAL(guac_socket_write(nested, expected, 2), 0);
+    CU_ASSERT_EQUAL(guac_socket_write(nested, expected + 2, large_length + 1), 0);
+    CU_ASSERT_EQUAL(guac_socket_write(nested, expected + total - 1, 1), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(nested), 0);
+
+    int instructions = verify_output(&output, expected, total,
+            expected_chunk_size);
+
+    guac_socket_free(nested);
+    guac_socket_free(socket);
+    guac_mem_free(expected);
+    guac_mem_free(output.data);
+
+    return instructions;
+
+}
+
+/**
+ * Tests that a nested socket correctly frames writes too large to be buffered,
+ * splitting those writes into chunks that do not exceed the default chunk size
+ * and that never divide a multi-byte character.
+ */
+void test_socket__nested_large_write() {
+
+    int instructions = write_and_verify(0, GUAC_SOCKET_NEST_CHUNK_SIZE);
+
+    /* The data written cannot fit within fewer instructions */
+    CU_ASSERT(instructions >= (int) ((TEST_REPEAT * (sizeof(UTF8_MIXED) - 1))
+                / GUAC_SOCKET_NEST_CHUNK_SIZE));
+
+}
+
+/**
+ * Tests that a nested socket with a larger chunk size sends writes too large
+ * to be buffered within correspondingly fewer instructions.
+ */
+void test_socket__nested_large_chunks() {
+
+    /* Everything up to the large write is sent within a single chunk, with
+     * only the final small write sent separately upon flush */
+    CU_ASSERT_EQUAL(write_and_verify(GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE,
+                GUAC_SOCKET_NEST_LARGE_CHUNK_SIZE), 2);
+
+}
+
@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "socket-queue.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Writes the given string to the given socket as a single instruction having
+ * the given priority.
+ *
+ * @param socket
+ *     The socket to write to.
+ *
+ * @param priority
+ *     The priority of the instruction.
+ *
+ * @param str
+ *     The string to write.
+ */
+static void write_instruction(guac_socket* socket,
+        guac_socket_priority priority, const char* str) {
+
+    guac_socket_instruction_begin(socket);
+    guac_socket_set_priority(socket, priority);
+    guac_socket_write_string(socket, str);
+    guac_socket_instruction_end(socket);
+
+}
+
+/**
+ * Writes several instructions of varying priority to a queued socket wrapping
+ * the write end of a new pipe, optionally promoting all queued data partway
+ * through, and verifies that the data read from the pipe matches the given
+ * string.
+ *
+ * @param promote
+ *     Non-zero if guac_socket_queue_promote() should be invoked after the
+ *     lower-priority instructions are written, zero otherwise.
+ *
+ * @param expected
+ *     The data that should be read from the pipe.
+ */
+static void verify_order(int promote, const char* expected) {
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    guac_socket* socket = guac_socket_queue(guac_socket_open(write_fd), 65536);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Nothing is written until the socket is flushed, as far less than
+     * GUAC_SOCKET_QUEUE_WAKE_THRESHOLD bytes are queued */
+    write_instruction(socket, GUAC_SOCKET_PRIORITY_BULK, "bulk1;");
+    write_instruction(socket, GUAC_SOCKET_PRIORITY_AUDIO, "audio;");
+    write_instruction(socket, GUAC_SOCKET_PRIORITY_BULK, "bulk2;");
+
+    if (promote)
+        guac_socket_queue_promote(socket);
+
+    write_instruction(socket, GUAC_SOCKET_PRIORITY_INTERACTIVE, "sync;");
+
+    guac_socket_flush(socket);
+    guac_socket_free(socket);
+
+    char buffer[64];
+    int length = 0;
+    int numread;
+
+    while ((numread = read(read_fd, buffer + length,
+                    sizeof(buffer) - 1 - length)) > 0)
+        length += numread;
+
+    close(read_fd);
+
+    buffer[length] = '\0';
+    CU_ASSERT_STRING_EQUAL(buffer, expected);
+
+}
+
+/**
+ * Tests that queued sockets deliver data in order of priority, with data of
+ * equal priority delivered in the order written.
+ */
+void test_socket__queue_priority() {
+    verify_order(0, "sync;audio;bulk1;bulk2;");
+}
+
+/**
+ * Tests that promoting the data queued by a queued socket results in that
+ * data being delivered before any data subsequently written, regardless of
+ * priority.
+ */
+void test_socket__queue_promote() {
+    verify_order(1, "audio;bulk1;bulk2;sync;");
+}
+
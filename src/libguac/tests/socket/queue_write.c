@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "socket-queue.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * The total number of bytes written by write_data().
+ */
+#define TEST_DATA_LENGTH 100000
+
+/**
+ * Returns the byte expected at the given offset within the data written by
+ * write_data().
+ *
+ * @param offset
+ *     The offset of the byte, relative to the start of the data.
+ *
+ * @return
+ *     The byte expected at the given offset.
+ */
+static char expected_byte(int offset) {
+    return (char) (offset * 7 + offset / 251);
+}
+
+/**
+ * Writes TEST_DATA_LENGTH bytes of data using a queued guac_socket wrapping a
+ * guac_socket for the given file descriptor, in chunks of varying size. The
+ * given file descriptor is automatically closed as a result of calling this
+ * function.
+ *
+ * @param fd
+ *     The file descriptor to write data to.
+ *
+ * @param max_backlog
+ *     The maximum number of bytes that may be queued by the queued socket.
+ *
+ * @param shared
+ *     Non-zero if some chunks should be written as shared chunks and without
+ *     waiting for room within the queue, as broadcast sockets do, or zero if
+ *     all chunks should be written with guac_socket_write().
+ */
+static void write_data(int fd, size_t max_backlog, int shared) {
+
+    /* Sizes of successive writes (repeated as necessary) */
+    static const int chunk_sizes[] = { 1, 100, 5000, 20000, 8192, 3, 40000 };
+
+    static char data[TEST_DATA_LENGTH];
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        data[i] = expected_byte(i);
+
+    /* Open queued guac socket */
+    guac_socket* fd_socket = guac_socket_open(fd);
+    guac_socket* socket = guac_socket_queue(fd_socket, max_backlog);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        guac_socket_free(fd_socket);
+        return;
+    }
+
+    /* Write all data in chunks of varying size */
+    int offset = 0;
+    for (int i = 0; offset < TEST_DATA_LENGTH; i++) {
+
+        int length = chunk_sizes[i % (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))];
+        if (length > TEST_DATA_LENGTH - offset)
+            length = TEST_DATA_LENGTH - offset;
+
+        /* Alternate between all means of writing */
+        if (shared && i % 3 == 1) {
+            guac_socket_queue_chunk* chunk = guac_socket_queue_chunk_alloc(
+                    data + offset, length);
+            guac_socket_queue_write_chunk(socket, chunk);
+            guac_socket_queue_chunk_release(chunk);
+        }
+        else if (shared && i % 3 == 2)
+            guac_socket_queue_write_nonblocking(socket, data + offset, length);
+        else
+            guac_socket_write(socket, data + offset, length);
+
+        offset += length;
+
+    }
+
+    guac_socket_flush(socket);
+
+    /* Close and free socket (this frees the wrapped socket, as well) */
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Forks a child process which writes data using write_data(), reading and
+ * verifying that data within the current process.
+ *
+ * @param max_backlog
+ *     The maximum number of bytes that may be queued by the queued socket of
+ *     the child process.
+ *
+ * @param shared
+ *     Non-zero if the child process should write some chunks as shared
+ *     chunks, zero otherwise.
+ */
+static void verify_write(size_t max_backlog, int shared) {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write data within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_data(write_fd, max_backlog, shared);
+        exit(0);
+    }
+
+    close(write_fd);
+
+    /* Read everything available into buffer */
+    static char buffer[TEST_DATA_LENGTH + 1];
+    int numread;
+    int offset = 0;
+
+    while ((numread = read(read_fd, buffer + offset,
+                    sizeof(buffer) - offset)) > 0) {
+        offset += numread;
+    }
+
+    close(read_fd);
+
+    /* Verify length and contents of read data */
+    CU_ASSERT_EQUAL_FATAL(offset, TEST_DATA_LENGTH);
+
+    int mismatched = 0;
+    for (int i = 0; i < TEST_DATA_LENGTH; i++) {
+        if (buffer[i] != expected_byte(i))
+            mismatched++;
+    }
+
+    CU_ASSERT_EQUAL(mismatched, 0);
+
+}
+
+/**
+ * Tests that the queued implementation of guac_socket writes all data intact
+ * and in order, waiting for room within the queue when writes would exceed
+ * the backlog limit, including writes that are larger than the entire limit.
+ */
+void test_socket__queue_write() {
+    verify_write(16384, 0);
+}
+
+/**
+ * Tests that data written to the queued implementation of guac_socket as
+ * shared chunks or without waiting for room within the queue is written
+ * intact and in the same order as data written with guac_socket_write().
+ */
+void test_socket__queue_write_shared() {
+    verify_write(TEST_DATA_LENGTH, 1);
+}
+
+/**
+ * Tests that writing to a queued guac_socket without waiting for room within
+ * the queue fails the socket if the backlog limit would be exceeded,
+ * discarding all queued data and causing all further writes to fail.
+ */
+void test_socket__queue_overflow() {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    guac_socket* socket = guac_socket_queue(guac_socket_open(write_fd), 1024);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    static char data[2048];
+
+    /* Data which fits within the backlog is queued (but not yet written, as
+     * the socket has not been flushed) */
+    CU_ASSERT_EQUAL(guac_socket_queue_write_nonblocking(socket, data, 512), 0);
+
+    /* Data which would exceed the backlog fails the socket, as do any further
+     * writes */
+    CU_ASSERT_NOT_EQUAL(guac_socket_queue_write_nonblocking(socket, data, 1024), 0);
+    CU_ASSERT_NOT_EQUAL(guac_socket_write(socket, data, 1), 0);
+    CU_ASSERT_NOT_EQUAL(guac_socket_flush(socket), 0);
+
+    /* Freeing the socket closes the pipe without anything being written */
+    guac_socket_free(socket);
+
+    char buffer[1];
+    CU_ASSERT_EQUAL(read(read_fd, buffer, sizeof(buffer)), 0);
+
+    close(read_fd);
+
+}
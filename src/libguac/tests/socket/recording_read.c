@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "socket-recording.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/recording.h>
+#include <guacamole/socket.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Test data consisting of several complete frames, each ending with a "sync"
+ * instruction.
+ */
+#define TEST_DATA                   \
+    "4.size,1.0,3.640,3.480;"       \
+    "4.rect,1.0,1.0,1.0,2.64,2.64;" \
+    "4.sync,4.1000;"                \
+    "4.cfill,1.0,1.0,1.0,1.0,1.0;"  \
+    "4.sync,4.2000;"
+
+/**
+ * Reads everything from the given guac_socket, freeing the socket once the
+ * end of the data is reached.
+ *
+ * @param socket
+ *     The guac_socket to read from.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param size
+ *     The number of bytes available within the buffer.
+ *
+ * @return
+ *     The number of bytes read, or -1 if an error occurs.
+ */
+static int read_all(guac_socket* socket, char* buffer, int size) {
+
+    int numread;
+    int offset = 0;
+
+    while ((numread = guac_socket_read(socket, buffer + offset,
+                    size - offset)) > 0) {
+        offset += numread;
+    }
+
+    guac_socket_free(socket);
+    return numread < 0 ? -1 : offset;
+
+}
+
+/**
+ * Tests that guac_recording_is_compressed() distinguishes compressed
+ * recordings from uncompressed recordings.
+ */
+void test_socket__recording_is_compressed() {
+
+    static const unsigned char zstd_frame[] = { 0x28, 0xB5, 0x2F, 0xFD };
+    static const unsigned char skippable_frame[] = { 0x5A, 0x2A, 0x4D, 0x18 };
+
+    CU_ASSERT_TRUE(guac_recording_is_compressed(zstd_frame, sizeof(zstd_frame)));
+    CU_ASSERT_TRUE(guac_recording_is_compressed(skippable_frame, sizeof(skippable_frame)));
+    CU_ASSERT_FALSE(guac_recording_is_compressed(zstd_frame, 3));
+    CU_ASSERT_FALSE(guac_recording_is_compressed(TEST_DATA, strlen(TEST_DATA)));
+
+}
+
+/**
+ * Tests that guac_recording_open_reader() reads uncompressed recordings
+ * as-is, including recordings too short to be compressed.
+ */
+void test_socket__recording_read_plain() {
+
+    static const char* recordings[] = { TEST_DATA, "0.;" };
+
+    for (int i = 0; i < sizeof(recordings) / sizeof(recordings[0]); i++) {
+
+        int fd[2];
+        CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+        int length = strlen(recordings[i]);
+        CU_ASSERT_EQUAL_FATAL(write(fd[1], recordings[i], length), length);
+        close(fd[1]);
+
+        guac_socket* reader = guac_recording_open_reader(guac_socket_open(fd[0]));
+        CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+
+        char buffer[1024];
+        CU_ASSERT_EQUAL_FATAL(read_all(reader, buffer, sizeof(buffer)), length);
+        CU_ASSERT_NSTRING_EQUAL(buffer, recordings[i], length);
+
+    }
+
+}
+
+/**
+ * Tests that recordings written by a compressed recording socket are
+ * compressed, and are read intact by guac_recording_open_reader(), both from
+ * the beginning and from a keyframe sought with guac_recording_seek().
+ */
+void test_socket__recording_read_compressed() {
+
+#ifdef HAVE_LIBZSTD
+    char recording_path[] = "/tmp/test-recording-XXXXXX";
+    char index_path[] = "/tmp/test-recording-index-XXXXXX";
+
+    int fd = mkstemp(recording_path);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+
+    int index_fd = mkstemp(index_path);
+    CU_ASSERT_NOT_EQUAL_FATAL(index_fd, -1);
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_recording(client, fd, 16384,
+            GUAC_RECORDING_OVERFLOW_BLOCK, 3);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket* index = guac_socket_recording(client, index_fd, 16384,
+            GUAC_RECORDING_OVERFLOW_BLOCK, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+
+    guac_socket_recording_set_index(socket, index, 1000);
+
+    /* Write the test data, as a keyframe, twice */
+    guac_socket_write_string(socket, TEST_DATA);
+    guac_socket_flush(socket);
+    CU_ASSERT_PTR_NOT_NULL(guac_socket_recording_begin_keyframe(socket, 2000));
+
+    guac_socket_write_string(socket, TEST_DATA);
+    guac_socket_flush(socket);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+    int length = strlen(TEST_DATA);
+    char buffer[1024];
+
+    /* The recording must be compressed */
+    fd = open(recording_path, O_RDONLY);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+    CU_ASSERT_EQUAL_FATAL(read(fd, buffer, 4), 4);
+    CU_ASSERT_TRUE(guac_recording_is_compressed(buffer, 4));
+
+    /* The entire recording must be read intact */
+    CU_ASSERT_EQUAL_FATAL(lseek(fd, 0, SEEK_SET), 0);
+    guac_socket* reader = guac_recording_open_reader(guac_socket_open(fd));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+    CU_ASSERT_EQUAL_FATAL(read_all(reader, buffer, sizeof(buffer)), length * 2);
+    CU_ASSERT_NSTRING_EQUAL(buffer, TEST_DATA, length);
+    CU_ASSERT_NSTRING_EQUAL(buffer + length, TEST_DATA, length);
+
+    /* Reading from the keyframe must produce only the second copy */
+    fd = open(recording_path, O_RDONLY);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+    CU_ASSERT_EQUAL_FATAL(guac_recording_seek(fd, length), 0);
+    reader = guac_recording_open_reader(guac_socket_open(fd));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+    CU_ASSERT_EQUAL_FATAL(read_all(reader, buffer, sizeof(buffer)), length);
+    CU_ASSERT_NSTRING_EQUAL(buffer, TEST_DATA, length);
+
+    /* Positions not at the start of a frame cannot be sought */
+    fd = open(recording_path, O_RDONLY);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+    CU_ASSERT_NOT_EQUAL(guac_recording_seek(fd, 1), 0);
+    close(fd);
+
+    unlink(recording_path);
+    unlink(index_path);
+#endif
+
+}
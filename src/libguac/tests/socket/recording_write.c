@@ -0,0 +1,370 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "socket-recording.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/client.h>
+#include <guacamole/recording.h>
+#include <guacamole/socket.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of bytes that may be buffered by each recording socket tested.
+ */
+#define TEST_BUFFER_SIZE 16384
+
+/**
+ * The number of bytes within each frame written by write_frames().
+ */
+#define TEST_FRAME_SIZE 4096
+
+/**
+ * The number of frames written by write_frames().
+ */
+#define TEST_FRAMES 256
+
+/**
+ * Writes TEST_FRAMES frames of TEST_FRAME_SIZE bytes each using a recording
+ * guac_socket for the given file descriptor, flushing the socket after each
+ * frame. Each byte of each frame is the index of that frame, and each frame
+ * is written in several parts, with each part written as an individual
+ * instruction. The given file descriptor is automatically closed as a result
+ * of calling this function.
+ *
+ * @param fd
+ *     The file descriptor to write data to.
+ *
+ * @param overflow
+ *     The behavior of the recording socket when its buffer is full.
+ */
+static void write_frames(int fd, guac_recording_overflow overflow) {
+
+    /* Sizes of successive parts of each frame */
+    static const int part_sizes[] = { 1, 100, 3000, 995 };
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_recording(client, fd, TEST_BUFFER_SIZE,
+            overflow, 0);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        close(fd);
+        guac_client_free(client);
+        return;
+    }
+
+    static char frame[TEST_FRAME_SIZE];
+    for (int i = 0; i < TEST_FRAMES; i++) {
+
+        memset(frame, i, sizeof(frame));
+
+        int offset = 0;
+        for (int j = 0; j < sizeof(part_sizes) / sizeof(part_sizes[0]); j++) {
+            guac_socket_instruction_begin(socket);
+            guac_socket_write(socket, frame + offset, part_sizes[j]);
+            guac_socket_instruction_end(socket);
+            offset += part_sizes[j];
+        }
+
+        guac_socket_flush(socket);
+
+    }
+
+    /* Close and free socket, writing anything remaining */
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+/**
+ * Forks a child process which writes data using write_frames(), reading that
+ * data within the current process.
+ *
+ * @param overflow
+ *     The behavior of the recording socket of the child process when its
+ *     buffer is full.
+ *
+ * @param delay
+ *     The number of seconds to wait before reading any data, such that the
+ *     buffer of the recording socket will overflow.
+ *
+ * @param buffer
+ *     The buffer to read data into, which must be able to hold all frames.
+ *
+ * @return
+ *     The number of bytes read.
+ */
+static int read_frames(guac_recording_overflow overflow, int delay,
+        char* buffer) {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write data within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_frames(write_fd, overflow);
+        exit(0);
+    }
+
+    close(write_fd);
+    sleep(delay);
+
+    /* Read everything available into buffer */
+    int numread;
+    int offset = 0;
+
+    while ((numread = read(read_fd, buffer + offset,
+                    TEST_FRAMES * TEST_FRAME_SIZE - offset)) > 0) {
+        offset += numread;
+    }
+
+    close(read_fd);
+    return offset;
+
+}
+
+/**
+ * Tests that the recording implementation of guac_socket writes all frames
+ * intact and in order when configured to wait for room within its buffer,
+ * even while the recording file is not being read.
+ */
+void test_socket__recording_write() {
+
+    static char buffer[TEST_FRAMES * TEST_FRAME_SIZE];
+    CU_ASSERT_EQUAL_FATAL(read_frames(GUAC_RECORDING_OVERFLOW_BLOCK, 1,
+                buffer), TEST_FRAMES * TEST_FRAME_SIZE);
+
+    int mismatched = 0;
+    for (int i = 0; i < TEST_FRAMES * TEST_FRAME_SIZE; i++) {
+        if (buffer[i] != (char) (i / TEST_FRAME_SIZE))
+            mismatched++;
+    }
+
+    CU_ASSERT_EQUAL(mismatched, 0);
+
+}
+
+/**
+ * Tests that the recording implementation of guac_socket omits only entire
+ * frames when configured to drop frames on overflow, with all remaining
+ * frames written intact and in order.
+ */
+void test_socket__recording_drop() {
+
+    static char buffer[TEST_FRAMES * TEST_FRAME_SIZE];
+    int length = read_frames(GUAC_RECORDING_OVERFLOW_DROP, 1, buffer);
+
+    /* Some, but not all, frames should have been omitted */
+    CU_ASSERT_TRUE(length > 0);
+    CU_ASSERT_TRUE(length < TEST_FRAMES * TEST_FRAME_SIZE);
+    CU_ASSERT_EQUAL_FATAL(length % TEST_FRAME_SIZE, 0);
+
+    /* Each remaining frame should be intact and follow the previous frame */
+    int previous = -1;
+    int mismatched = 0;
+    for (int offset = 0; offset < length; offset += TEST_FRAME_SIZE) {
+
+        int index = (unsigned char) buffer[offset];
+        CU_ASSERT_TRUE(index > previous);
+        previous = index;
+
+        for (int i = 0; i < TEST_FRAME_SIZE; i++) {
+            if ((unsigned char) buffer[offset + i] != index)
+                mismatched++;
+        }
+
+    }
+
+    CU_ASSERT_EQUAL(mismatched, 0);
+
+}
+
+/**
+ * Tests that keyframes are written to the index of a recording socket only
+ * as often as requested, with each keyframe referring to the position within
+ * the recording following everything flushed so far.
+ */
+void test_socket__recording_keyframe() {
+
+    int recording_fd[2];
+    int index_fd[2];
+
+    /* Create pipes */
+    CU_ASSERT_EQUAL_FATAL(pipe(recording_fd), 0);
+    CU_ASSERT_EQUAL_FATAL(pipe(index_fd), 0);
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_recording(client, recording_fd[1],
+            TEST_BUFFER_SIZE, GUAC_RECORDING_OVERFLOW_BLOCK, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket* index = guac_socket_recording(client, index_fd[1],
+            TEST_BUFFER_SIZE, GUAC_RECORDING_OVERFLOW_BLOCK, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+
+    guac_socket_recording_set_index(socket, index, 1000);
+
+    /* The first keyframe is always written */
+    guac_socket_write_string(socket, "4.sync,4.1000;");
+    guac_socket_flush(socket);
+    CU_ASSERT_PTR_EQUAL(guac_socket_recording_begin_keyframe(socket, 1000), index);
+
+    /* Unflushed data is not part of any keyframe */
+    guac_socket_write_string(socket, "4.sync,4.1500;");
+    CU_ASSERT_PTR_NULL(guac_socket_recording_begin_keyframe(socket, 1500));
+    guac_socket_flush(socket);
+
+    /* Further keyframes are written once the interval has elapsed */
+    guac_socket_write_string(socket, "4.sync,4.2000;");
+    guac_socket_flush(socket);
+    CU_ASSERT_PTR_EQUAL(guac_socket_recording_begin_keyframe(socket, 2000), index);
+
+    /* Freeing the recording socket also frees the index */
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+    char buffer[256];
+    int length = read(index_fd[0], buffer, sizeof(buffer) - 1);
+    CU_ASSERT_TRUE_FATAL(length > 0);
+    buffer[length] = '\0';
+
+    CU_ASSERT_STRING_EQUAL(buffer,
+            "8.keyframe,4.1000,2.14;"
+            "8.keyframe,4.2000,2.42;");
+
+    close(recording_fd[0]);
+    close(index_fd[0]);
+
+}
+
+/**
+ * Reads the entire contents of the file at the given path into the given
+ * buffer, null-terminating the result.
+ *
+ * @param path
+ *     The path of the file to read.
+ *
+ * @param buffer
+ *     The buffer to read the file into.
+ *
+ * @param size
+ *     The number of bytes available within the buffer.
+ *
+ * @return
+ *     The number of bytes read, or -1 if the file could not be read.
+ */
+static int read_file(const char* path, char* buffer, int size) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    int numread;
+    int offset = 0;
+
+    while ((numread = read(fd, buffer + offset, size - offset - 1)) > 0)
+        offset += numread;
+
+    close(fd);
+    buffer[offset] = '\0';
+    return offset;
+
+}
+
+/**
+ * Tests that a segmented recording socket begins new segments only once the
+ * current segment has reached its duration limit, with each segment
+ * containing exactly the frames flushed after the segment was begun.
+ */
+void test_socket__recording_segment() {
+
+    char dir[] = "/tmp/test-recording-XXXXXX";
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mkdtemp(dir));
+
+    /* Leave room for the segment suffix and number beyond the full path of
+     * the recording */
+    char path[256];
+    char segment_path[sizeof(path) + 16];
+    snprintf(path, sizeof(path), "%s/recording", dir);
+    snprintf(segment_path, sizeof(segment_path),
+            "%s" GUAC_RECORDING_SEGMENT_SUFFIX "2", path);
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    CU_ASSERT_NOT_EQUAL_FATAL(fd, -1);
+
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_recording(client, fd,
+            TEST_BUFFER_SIZE, GUAC_RECORDING_OVERFLOW_BLOCK, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket_recording_set_segments(socket, path, 1000, 0, 0);
+
+    /* The first segment begins with the first frame */
+    guac_socket_write_string(socket, "4.sync,4.1000;");
+    guac_socket_flush(socket);
+    CU_ASSERT_FALSE(guac_socket_recording_begin_segment(socket, 1000));
+
+    guac_socket_write_string(socket, "4.sync,4.1500;");
+    guac_socket_flush(socket);
+    CU_ASSERT_FALSE(guac_socket_recording_begin_segment(socket, 1500));
+
+    /* A new segment begins once the duration limit has been reached */
+    guac_socket_write_string(socket, "4.sync,4.2000;");
+    guac_socket_flush(socket);
+    CU_ASSERT_TRUE(guac_socket_recording_begin_segment(socket, 2000));
+
+    /* Unflushed data belongs to the new segment */
+    guac_socket_write_string(socket, "4.sync,4.2500;");
+    CU_ASSERT_FALSE(guac_socket_recording_begin_segment(socket, 2500));
+    guac_socket_flush(socket);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+    char buffer[256];
+    CU_ASSERT_TRUE(read_file(path, buffer, sizeof(buffer)) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer,
+            "4.sync,4.1000;4.sync,4.1500;4.sync,4.2000;");
+
+    CU_ASSERT_TRUE(read_file(segment_path, buffer, sizeof(buffer)) > 0);
+    CU_ASSERT_STRING_EQUAL(buffer, "4.sync,4.2500;");
+
+    unlink(segment_path);
+    unlink(path);
+    rmdir(dir);
+
+}
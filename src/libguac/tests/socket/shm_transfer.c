@@ -0,0 +1,339 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+#include <guacamole/socket-shm.h>
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * The total number of bytes written through the transport by
+ * test_socket__shm_write(). This is deliberately larger than a ring, such
+ * that the writer must repeatedly wait for space.
+ */
+#define TEST_DATA_LENGTH (GUAC_SOCKET_SHM_RING_SIZE * 3 + 12345)
+
+/**
+ * Returns the byte expected at the given offset within the data written by
+ * test_socket__shm_write().
+ *
+ * @param offset
+ *     The offset of the byte, relative to the start of the data.
+ *
+ * @return
+ *     The byte expected at the given offset.
+ */
+static char expected_byte(int offset) {
+    return (char) (offset * 7 + offset / 251);
+}
+
+/**
+ * Creates all file descriptors of a new shared memory transport, acting as
+ * the peer, and maps its shared memory region into memory. The ends of the
+ * control socket and the shared memory region used by the peer are returned
+ * separately.
+ *
+ * @param fds
+ *     The array which should receive the GUAC_SOCKET_SHM_FD_COUNT file
+ *     descriptors to be given to guac_socket_open_shm().
+ *
+ * @param peer_control
+ *     Receives the peer's end of the control socket.
+ *
+ * @param seals
+ *     The seals to apply to the shared memory once it has been sized.
+ *
+ * @return
+ *     The initialized shared memory region, or NULL on failure.
+ */
+static guac_socket_shm_region* create_transport(int* fds, int* peer_control,
+        int seals) {
+
+    int region_fd = memfd_create("guac-shm-test", MFD_ALLOW_SEALING);
+    if (region_fd < 0)
+        return NULL;
+
+    if (ftruncate(region_fd, sizeof(guac_socket_shm_region))
+            || (seals && fcntl(region_fd, F_ADD_SEALS, seals)))
+        return NULL;
+
+    guac_socket_shm_region* region = mmap(NULL,
+            sizeof(guac_socket_shm_region), PROT_READ | PROT_WRITE,
+            MAP_SHARED, region_fd, 0);
+    if (region == MAP_FAILED)
+        return NULL;
+
+    region->magic = GUAC_SOCKET_SHM_MAGIC;
+    region->version = GUAC_SOCKET_SHM_VERSION;
+
+    int control[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, control))
+        return NULL;
+
+    fds[GUAC_SOCKET_SHM_FD_CONTROL]      = control[0];
+    fds[GUAC_SOCKET_SHM_FD_REGION]       = region_fd;
+    fds[GUAC_SOCKET_SHM_FD_INPUT_DATA]   = eventfd(0, 0);
+    fds[GUAC_SOCKET_SHM_FD_INPUT_SPACE]  = eventfd(0, 0);
+    fds[GUAC_SOCKET_SHM_FD_OUTPUT_DATA]  = eventfd(0, 0);
+    fds[GUAC_SOCKET_SHM_FD_OUTPUT_SPACE] = eventfd(0, 0);
+
+    *peer_control = control[1];
+    return region;
+
+}
+
+/**
+ * Tests that instructions placed within the input ring of a shared memory
+ * transport by the peer are read intact, and that the peer disconnecting is
+ * seen as the end of the stream.
+ */
+void test_socket__shm_read() {
+
+    int fds[GUAC_SOCKET_SHM_FD_COUNT];
+    int peer_control;
+
+    guac_socket_shm_region* region = create_transport(fds, &peer_control,
+            F_SEAL_SHRINK | F_SEAL_SEAL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(region);
+
+    /* Send a single instruction as the peer */
+    const char instruction[] = "4.test,5.hello;";
+    memcpy(region->input.data, instruction, sizeof(instruction) - 1);
+    atomic_store(&region->input.head, sizeof(instruction) - 1);
+
+    guac_socket* socket = guac_socket_open_shm(fds);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 1000000), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "hello");
+
+    /* All data must have been consumed */
+    CU_ASSERT_EQUAL(atomic_load(&region->input.tail), sizeof(instruction) - 1);
+
+    /* Nothing further is available until the peer disconnects */
+    CU_ASSERT_EQUAL(guac_socket_select(socket, 1000), 0);
+
+    close(peer_control);
+    CU_ASSERT_EQUAL(guac_socket_select(socket, 1000000), 1);
+
+    char buffer[16];
+    CU_ASSERT_EQUAL(guac_socket_read(socket, buffer, sizeof(buffer)), 0);
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    munmap(region, sizeof(guac_socket_shm_region));
+
+}
+
+/**
+ * Tests that data written to a shared memory transport arrives at the peer
+ * intact and in order, even if far larger than the output ring. A child
+ * process is forked to write the data which is read and verified by the
+ * parent process, acting as the peer.
+ */
+void test_socket__shm_write() {
+
+    int fds[GUAC_SOCKET_SHM_FD_COUNT];
+    int peer_control;
+
+    guac_socket_shm_region* region = create_transport(fds, &peer_control,
+            F_SEAL_SHRINK | F_SEAL_SEAL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(region);
+
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Write all data within the child process */
+    if (childpid == 0) {
+
+        close(peer_control);
+
+        guac_socket* socket = guac_socket_open_shm(fds);
+        if (socket == NULL)
+            exit(1);
+
+        char chunk[10000];
+        for (int offset = 0; offset < TEST_DATA_LENGTH; offset += sizeof(chunk)) {
+
+            int length = sizeof(chunk);
+            if (length > TEST_DATA_LENGTH - offset)
+                length = TEST_DATA_LENGTH - offset;
+
+            for (int i = 0; i < length; i++)
+                chunk[i] = expected_byte(offset + i);
+
+            if (guac_socket_write(socket, chunk, length))
+                exit(1);
+
+        }
+
+        guac_socket_flush(socket);
+        guac_socket_free(socket);
+        exit(0);
+
+    }
+
+    /* Read all data as the peer, polling for data and signalling whenever
+     * the writer is waiting for space */
+    guac_socket_shm_ring* ring = &region->output;
+    int offset = 0;
+    int mismatches = 0;
+    while (offset < TEST_DATA_LENGTH) {
+
+        uint32_t tail = atomic_load(&ring->tail);
+        uint32_t available = atomic_load(&ring->head) - tail;
+        if (available == 0) {
+            usleep(100);
+            continue;
+        }
+
+        for (uint32_t i = 0; i < available; i++) {
+            if ((char) ring->data[(tail + i) % GUAC_SOCKET_SHM_RING_SIZE]
+                    != expected_byte(offset + i))
+                mismatches++;
+        }
+
+        offset += available;
+        atomic_store(&ring->tail, tail + available);
+
+        if (atomic_exchange(&ring->space_waiting, 0)) {
+            uint64_t value = 1;
+            CU_ASSERT_EQUAL(write(fds[GUAC_SOCKET_SHM_FD_OUTPUT_SPACE],
+                        &value, sizeof(value)), sizeof(value));
+        }
+
+    }
+
+    int status;
+    CU_ASSERT_EQUAL(waitpid(childpid, &status, 0), childpid);
+    CU_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    CU_ASSERT_EQUAL(offset, TEST_DATA_LENGTH);
+    CU_ASSERT_EQUAL(mismatches, 0);
+
+    for (int i = 0; i < GUAC_SOCKET_SHM_FD_COUNT; i++)
+        close(fds[i]);
+
+    close(peer_control);
+    munmap(region, sizeof(guac_socket_shm_region));
+
+}
+
+/**
+ * Tests that shared memory which the peer could still shrink is refused, as
+ * truncating memory that is already mapped would crash the process reading
+ * it.
+ */
+void test_socket__shm_unsealed() {
+
+    int fds[GUAC_SOCKET_SHM_FD_COUNT];
+    int peer_control;
+
+    /* Without any seals */
+    guac_socket_shm_region* region = create_transport(fds, &peer_control, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(region);
+    CU_ASSERT_PTR_NULL(guac_socket_open_shm(fds));
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_INVALID_ARGUMENT);
+
+    /* Sealed against shrinking, but the seals could still be removed */
+    CU_ASSERT_EQUAL(fcntl(fds[GUAC_SOCKET_SHM_FD_REGION], F_ADD_SEALS,
+                F_SEAL_SHRINK), 0);
+    CU_ASSERT_PTR_NULL(guac_socket_open_shm(fds));
+
+    /* Fully sealed */
+    CU_ASSERT_EQUAL(fcntl(fds[GUAC_SOCKET_SHM_FD_REGION], F_ADD_SEALS,
+                F_SEAL_SEAL), 0);
+
+    guac_socket* socket = guac_socket_open_shm(fds);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket_free(socket);
+    close(peer_control);
+    munmap(region, sizeof(guac_socket_shm_region));
+
+}
+
+/**
+ * Tests that a peer claiming more data or space than a ring can hold is
+ * treated as a protocol error which closes the socket, rather than causing
+ * data to be copied beyond the bounds of the ring.
+ */
+void test_socket__shm_corrupted() {
+
+    int fds[GUAC_SOCKET_SHM_FD_COUNT];
+    int peer_control;
+
+    guac_socket_shm_region* region = create_transport(fds, &peer_control,
+            F_SEAL_SHRINK | F_SEAL_SEAL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(region);
+
+    guac_socket* socket = guac_socket_open_shm(fds);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* A tail beyond the head would otherwise appear as more than an entire
+     * ring of free space */
+    atomic_store(&region->output.tail, 5);
+
+    static char data[GUAC_SOCKET_SHM_RING_SIZE + 4096];
+    CU_ASSERT_NOT_EQUAL(guac_socket_write(socket, data, sizeof(data)), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_PROTOCOL_ERROR);
+    CU_ASSERT_EQUAL(atomic_load(&region->output.head), 0);
+
+    guac_socket_free(socket);
+    close(peer_control);
+    munmap(region, sizeof(guac_socket_shm_region));
+
+    /* A head more than an entire ring beyond the tail */
+    region = create_transport(fds, &peer_control, F_SEAL_SHRINK | F_SEAL_SEAL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(region);
+
+    atomic_store(&region->input.head, GUAC_SOCKET_SHM_RING_SIZE + 1);
+
+    socket = guac_socket_open_shm(fds);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    char buffer[16];
+    CU_ASSERT_EQUAL(guac_socket_read(socket, buffer, sizeof(buffer)), -1);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_PROTOCOL_ERROR);
+    CU_ASSERT_EQUAL(atomic_load(&region->input.tail), 0);
+
+    guac_socket_free(socket);
+    close(peer_control);
+    munmap(region, sizeof(guac_socket_shm_region));
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+
+/**
+ * Test which verifies that the output counters of a guac_socket account for
+ * all bytes written and all flushes, and that the number of bytes written
+ * between flushes is tracked correctly.
+ */
+void test_socket__stats() {
+
+    static const char data[1000] = { 0 };
+    guac_socket_stats stats;
+
+    /* A socket without handlers pretends that all data is written */
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket_get_stats(socket, &stats);
+    CU_ASSERT_EQUAL(stats.bytes_written, 0);
+    CU_ASSERT_EQUAL(stats.flushes, 0);
+    CU_ASSERT_EQUAL(stats.in_flight, 0);
+    CU_ASSERT_EQUAL(stats.max_in_flight, 0);
+
+    /* Write 1300 bytes, flush, then write a further 200 bytes */
+    CU_ASSERT_EQUAL(guac_socket_write(socket, data, 1000), 0);
+    CU_ASSERT_EQUAL(guac_socket_write(socket, data, 300), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "4.sync,"), 0);
+    CU_ASSERT_EQUAL(guac_socket_write(socket, data, 193), 0);
+
+    guac_socket_get_stats(socket, &stats);
+    CU_ASSERT_EQUAL(stats.bytes_written, 1500);
+    CU_ASSERT_EQUAL(stats.flushes, 1);
+    CU_ASSERT_EQUAL(stats.in_flight, 200);
+    CU_ASSERT_EQUAL(stats.max_in_flight, 1300);
+
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Read handler which pretends that the full amount of data requested has been
+ * read, without modifying the given buffer.
+ *
+ * @param socket
+ *     The guac_socket being read from.
+ *
+ * @param buf
+ *     The buffer that would receive the data read.
+ *
+ * @param count
+ *     The number of bytes requested.
+ *
+ * @return
+ *     Always the number of bytes requested.
+ */
+static ssize_t test_socket__stats_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+    return count;
+}
+
+/**
+ * Test which verifies that the counters of a guac_socket account for all
+ * bytes read, and that reads are not counted as output.
+ */
+void test_socket__stats_read() {
+
+    char buffer[100];
+    guac_socket_stats stats;
+
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->read_handler = test_socket__stats_read_handler;
+
+    CU_ASSERT_EQUAL(guac_socket_read(socket, buffer, sizeof(buffer)), 100);
+    CU_ASSERT_EQUAL(guac_socket_read(socket, buffer, 25), 25);
+
+    guac_socket_get_stats(socket, &stats);
+    CU_ASSERT_EQUAL(stats.bytes_read, 125);
+    CU_ASSERT_EQUAL(stats.bytes_written, 0);
+
+    guac_socket_free(socket);
+
+}
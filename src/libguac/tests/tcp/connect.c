@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/tcp.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Creates a socket listening on an ephemeral port of the IPv4 loopback
+ * address, storing that port as a string within the given buffer.
+ *
+ * @param port
+ *     The buffer which should receive the port being listened on.
+ *
+ * @param length
+ *     The size of the given buffer, in bytes.
+ *
+ * @return
+ *     The file descriptor of the listening socket, or -1 if the socket could
+ *     not be created.
+ */
+static int listen_loopback(char* port, size_t length) {
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0
+    };
+
+    socklen_t address_length = sizeof(address);
+    if (bind(fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(fd, 4)
+            || getsockname(fd, (struct sockaddr*) &address, &address_length)) {
+        close(fd);
+        return -1;
+    }
+
+    snprintf(port, length, "%i", ntohs(address.sin_port));
+    return fd;
+
+}
+
+/**
+ * Verifies that guac_tcp_connect() connects to a listening socket given its
+ * numeric address.
+ */
+void test_tcp__connect() {
+
+    char port[16];
+    int listen_fd = listen_loopback(port, sizeof(port));
+    CU_ASSERT_FATAL(listen_fd >= 0);
+
+    int fd = guac_tcp_connect("127.0.0.1", port, 5);
+    CU_ASSERT(fd >= 0);
+
+    int accepted_fd = accept(listen_fd, NULL, NULL);
+    CU_ASSERT(accepted_fd >= 0);
+
+    /* Data sent along the returned socket must arrive, with the socket
+     * having been made blocking again */
+    CU_ASSERT_EQUAL(write(fd, "x", 1), 1);
+
+    char value;
+    CU_ASSERT_EQUAL(read(accepted_fd, &value, 1), 1);
+    CU_ASSERT_EQUAL(value, 'x');
+
+    close(accepted_fd);
+    close(fd);
+    close(listen_fd);
+
+}
+
+/**
+ * Verifies that guac_tcp_connect() fails with a negative value if the
+ * connection is refused.
+ */
+void test_tcp__connect_refused() {
+
+    /* Obtain a port on which nothing is listening */
+    char port[16];
+    int listen_fd = listen_loopback(port, sizeof(port));
+    CU_ASSERT_FATAL(listen_fd >= 0);
+    close(listen_fd);
+
+    CU_ASSERT(guac_tcp_connect("127.0.0.1", port, 5) < 0);
+
+}
+
+/**
+ * Verifies that guac_tcp_connect() falls back to further addresses if the
+ * connection to an address is refused, using a hostname which may resolve
+ * to both the IPv6 and IPv4 loopback addresses while listening only on the
+ * IPv4 loopback address. The same connection is made a second time with a
+ * cache of resolved addresses in use, which must not change the result.
+ */
+void test_tcp__connect_fallback() {
+
+    char port[16];
+    int listen_fd = listen_loopback(port, sizeof(port));
+    CU_ASSERT_FATAL(listen_fd >= 0);
+
+    CU_ASSERT_EQUAL(guac_tcp_dns_cache_init(60), 0);
+
+    for (int i = 0; i < 2; i++) {
+
+        int fd = guac_tcp_connect("localhost", port, 5);
+        CU_ASSERT(fd >= 0);
+
+        int accepted_fd = accept(listen_fd, NULL, NULL);
+        CU_ASSERT(accepted_fd >= 0);
+
+        close(accepted_fd);
+        close(fd);
+
+    }
+
+    close(listen_fd);
+
+}
+
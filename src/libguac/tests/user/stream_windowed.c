@@ -0,0 +1,172 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/user.h>
+
+/**
+ * The number of blobs of data provided by test_read_handler().
+ */
+#define TEST_BLOBS 10
+
+/**
+ * The number of blobs allowed in flight by each test.
+ */
+#define TEST_WINDOW 4
+
+/**
+ * The state of a windowed stream under test.
+ */
+typedef struct test_stream_state {
+
+    /**
+     * The number of blobs of data read so far.
+     */
+    int blobs_read;
+
+    /**
+     * The number of times the complete handler has been invoked.
+     */
+    int completed;
+
+    /**
+     * The status passed to the complete handler.
+     */
+    guac_protocol_status status;
+
+} test_stream_state;
+
+/**
+ * Read handler which provides TEST_BLOBS blobs of arbitrary data, tracking
+ * the number of blobs read within the test_stream_state provided as data.
+ */
+static int test_read_handler(guac_user* user, guac_stream* stream,
+        void* data, char* buffer, int length) {
+
+    test_stream_state* state = (test_stream_state*) data;
+
+    /* Signal end of stream after all blobs have been read */
+    if (state->blobs_read == TEST_BLOBS)
+        return 0;
+
+    CU_ASSERT_EQUAL(state->completed, 0);
+    CU_ASSERT_TRUE(length >= GUAC_PROTOCOL_BLOB_MAX_LENGTH);
+
+    buffer[0] = 'X';
+    state->blobs_read++;
+    return 1;
+
+}
+
+/**
+ * Complete handler which records its invocation within the
+ * test_stream_state provided as data.
+ */
+static void test_complete_handler(guac_user* user, guac_stream* stream,
+        void* data, guac_protocol_status status) {
+
+    test_stream_state* state = (test_stream_state*) data;
+    state->completed++;
+    state->status = status;
+
+}
+
+/**
+ * Test which verifies that guac_user_stream_windowed() keeps the expected
+ * number of blobs in flight, and ends the stream only after every blob has
+ * been acknowledged.
+ */
+void test_user__stream_windowed() {
+
+    test_stream_state state = { 0 };
+
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    user->socket = guac_socket_alloc();
+
+    guac_stream* stream = guac_user_alloc_stream(user);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream);
+    CU_ASSERT_EQUAL_FATAL(guac_user_stream_windowed(user, stream, TEST_WINDOW,
+                test_read_handler, test_complete_handler, &state), 0);
+
+    /* Nothing is read until the start of the stream is acknowledged */
+    CU_ASSERT_EQUAL(state.blobs_read, 0);
+
+    /* Acknowledging the start of the stream fills the window */
+    stream->ack_handler(user, stream, "OK", GUAC_PROTOCOL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.blobs_read, TEST_WINDOW);
+
+    /* Each further acknowledgement allows exactly one more blob */
+    for (int acked = 1; acked <= TEST_BLOBS - TEST_WINDOW; acked++) {
+        stream->ack_handler(user, stream, "OK", GUAC_PROTOCOL_STATUS_SUCCESS);
+        CU_ASSERT_EQUAL(state.blobs_read, TEST_WINDOW + acked);
+    }
+
+    /* The stream must not end until the final blob is acknowledged */
+    for (int remaining = TEST_WINDOW; remaining > 0; remaining--) {
+        CU_ASSERT_EQUAL(state.completed, 0);
+        stream->ack_handler(user, stream, "OK", GUAC_PROTOCOL_STATUS_SUCCESS);
+    }
+
+    CU_ASSERT_EQUAL(state.blobs_read, TEST_BLOBS);
+    CU_ASSERT_EQUAL(state.completed, 1);
+    CU_ASSERT_EQUAL(state.status, GUAC_PROTOCOL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(stream->index, GUAC_USER_CLOSED_STREAM_INDEX);
+
+    guac_socket_free(user->socket);
+    guac_user_free(user);
+
+}
+
+/**
+ * Test which verifies that a stream sent using guac_user_stream_windowed() is
+ * ended immediately, without reading further data, if the user acknowledges
+ * a blob with an error.
+ */
+void test_user__stream_windowed_abort() {
+
+    test_stream_state state = { 0 };
+
+    guac_user* user = guac_user_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(user);
+    user->socket = guac_socket_alloc();
+
+    guac_stream* stream = guac_user_alloc_stream(user);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream);
+    CU_ASSERT_EQUAL_FATAL(guac_user_stream_windowed(user, stream, TEST_WINDOW,
+                test_read_handler, test_complete_handler, &state), 0);
+
+    stream->ack_handler(user, stream, "OK", GUAC_PROTOCOL_STATUS_SUCCESS);
+    CU_ASSERT_EQUAL(state.blobs_read, TEST_WINDOW);
+
+    stream->ack_handler(user, stream, "ABORTED",
+            GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+
+    CU_ASSERT_EQUAL(state.blobs_read, TEST_WINDOW);
+    CU_ASSERT_EQUAL(state.completed, 1);
+    CU_ASSERT_EQUAL(state.status, GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+    CU_ASSERT_EQUAL(stream->index, GUAC_USER_CLOSED_STREAM_INDEX);
+
+    guac_socket_free(user->socket);
+    guac_user_free(user);
+
+}
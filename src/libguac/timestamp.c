@@ -19,29 +19,35 @@
 
 #include "config.h"
 
+#include "guacamole/mem.h"
 #include "guacamole/timestamp.h"
 
+#include <stdint.h>
 #include <sys/time.h>
 
 #if defined(HAVE_CLOCK_GETTIME) || defined(HAVE_NANOSLEEP)
 #include <time.h>
 #endif
 
-guac_timestamp guac_timestamp_current() {
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+uint64_t guac_timestamp_current_ns() {
 
 #ifdef HAVE_CLOCK_GETTIME
 
     struct timespec current;
 
-    /* Get current time, monotonically increasing */ 
+    /* Get current time, monotonically increasing */
 #ifdef CLOCK_MONOTONIC
     clock_gettime(CLOCK_MONOTONIC, &current);
 #else
     clock_gettime(CLOCK_REALTIME, &current);
-#endif    
+#endif
 
-    /* Calculate milliseconds */
-    return (guac_timestamp) current.tv_sec * 1000 + current.tv_nsec / 1000000;
+    /* Calculate nanoseconds */
+    return (uint64_t) current.tv_sec * 1000000000 + current.tv_nsec;
 
 #else
 
@@ -49,12 +55,120 @@ guac_timestamp guac_timestamp_current() {
 
     /* Get current time */
     gettimeofday(&current, NULL);
-    
+
+    /* Calculate nanoseconds */
+    return (uint64_t) current.tv_sec * 1000000000 + (uint64_t) current.tv_usec * 1000;
+
+#endif
+
+}
+
+guac_timestamp guac_timestamp_current() {
+    return (guac_timestamp) (guac_timestamp_current_ns() / 1000000);
+}
+
+guac_timestamp guac_timestamp_current_coarse() {
+
+    /* NOTE: The coarse clock shares its reference point with the clock read
+     * by guac_timestamp_current() only if both are monotonic */
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC) && defined(CLOCK_MONOTONIC_COARSE)
+
+    struct timespec current;
+
+    /* Get current time from the coarse clock, falling back to the precise
+     * clock if the coarse clock is unavailable at runtime */
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &current))
+        return guac_timestamp_current();
+
     /* Calculate milliseconds */
-    return (guac_timestamp) current.tv_sec * 1000 + current.tv_usec / 1000;
+    return (guac_timestamp) current.tv_sec * 1000 + current.tv_nsec / 1000000;
+
+#else
+    return guac_timestamp_current();
+#endif
+
+}
+
+#ifdef HAVE_LIBPTHREAD
+
+/* PThread implementation of the per-thread frame time */
+
+static pthread_key_t  __guac_timestamp_frame_time_key;
+static pthread_once_t __guac_timestamp_frame_time_key_init = PTHREAD_ONCE_INIT;
+
+static void __guac_timestamp_free_frame_time(void* frame_time) {
+
+    /* Free memory allocated to frame time variable */
+    guac_mem_free(frame_time);
+
+}
+
+static void __guac_timestamp_alloc_frame_time_key() {
+
+    /* Create key, destroy any allocated variable on thread exit */
+    pthread_key_create(&__guac_timestamp_frame_time_key,
+            __guac_timestamp_free_frame_time);
+
+}
+
+/**
+ * Returns a pointer to the frame time of the current thread, allocating
+ * storage for that frame time if it has not yet been allocated. Newly
+ * allocated frame times are zero.
+ *
+ * @return
+ *     A pointer to the frame time of the current thread.
+ */
+static guac_timestamp* __guac_timestamp_frame_time() {
+
+    /* Init frame time key, if not already initialized */
+    pthread_once(&__guac_timestamp_frame_time_key_init,
+            __guac_timestamp_alloc_frame_time_key);
+
+    /* Retrieve thread-local frame time variable */
+    guac_timestamp* frame_time = (guac_timestamp*)
+        pthread_getspecific(__guac_timestamp_frame_time_key);
+
+    /* Allocate thread-local frame time variable if not already allocated */
+    if (frame_time == NULL) {
+        frame_time = guac_mem_zalloc(sizeof(guac_timestamp));
+        pthread_setspecific(__guac_timestamp_frame_time_key, frame_time);
+    }
+
+    return frame_time;
+
+}
+
+#else
+
+/* Default (not-threadsafe) implementation */
+static guac_timestamp __guac_timestamp_frame_time_unsafe_storage;
+
+static guac_timestamp* __guac_timestamp_frame_time() {
+    return &__guac_timestamp_frame_time_unsafe_storage;
+}
 
 #endif
 
+guac_timestamp guac_timestamp_update_frame_time() {
+
+    guac_timestamp* frame_time = __guac_timestamp_frame_time();
+    *frame_time = guac_timestamp_current();
+
+    return *frame_time;
+
+}
+
+guac_timestamp guac_timestamp_frame_time() {
+
+    guac_timestamp* frame_time = __guac_timestamp_frame_time();
+
+    /* Store the current time if no frame time has yet been stored */
+    if (*frame_time == 0)
+        *frame_time = guac_timestamp_current();
+
+    return *frame_time;
+
 }
 
 void guac_timestamp_msleep(int duration) {
@@ -22,14 +22,18 @@
 #include "guacamole/mem.h"
 #include "guacamole/client.h"
 #include "guacamole/object.h"
+#include "guacamole/opcode.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
 #include "guacamole/string.h"
 #include "guacamole/timestamp.h"
 #include "guacamole/user.h"
+#include "probe.h"
+#include "socket-base64.h"
 #include "user-handlers.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -67,9 +71,81 @@ __guac_instruction_handler_mapping __guac_handshake_handler_map[] = {
     {"image",    __guac_handshake_image_handler},
     {"timezone", __guac_handshake_timezone_handler},
     {"name",     __guac_handshake_name_handler},
+    {"blobsize", __guac_handshake_blobsize_handler},
+    {"binary",   __guac_handshake_binary_handler},
+    {"resume",   __guac_handshake_resume_handler},
     {NULL,       NULL}
 };
 
+/**
+ * Index of __guac_instruction_handler_map.
+ */
+static guac_opcode_index __guac_instruction_handler_index;
+
+/**
+ * Index of __guac_handshake_handler_map.
+ */
+static guac_opcode_index __guac_handshake_handler_index;
+
+/**
+ * Guard ensuring that the indexes of the handler maps are built only once.
+ */
+static pthread_once_t __guac_handler_index_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Builds the indexes of all handler maps. This function is invoked through
+ * pthread_once().
+ */
+static void __guac_handler_index_init(void) {
+
+    guac_opcode_index_init(&__guac_instruction_handler_index,
+            __guac_instruction_handler_map,
+            sizeof(__guac_instruction_handler_mapping));
+
+    guac_opcode_index_init(&__guac_handshake_handler_index,
+            __guac_handshake_handler_map,
+            sizeof(__guac_instruction_handler_mapping));
+
+}
+
+/**
+ * Returns the position of the mapping having the given opcode within the
+ * given handler map, using the index of that map if it is one of the handler
+ * maps defined by libguac.
+ *
+ * @param map
+ *     The array that holds the opcode to handler mappings.
+ *
+ * @param opcode
+ *     The opcode to search for.
+ *
+ * @return
+ *     The position of the mapping having the given opcode within the given
+ *     map, or -1 if no such mapping exists.
+ */
+static int __guac_handler_lookup(__guac_instruction_handler_mapping* map,
+        const char* opcode) {
+
+    pthread_once(&__guac_handler_index_once, __guac_handler_index_init);
+
+    if (map == __guac_instruction_handler_map)
+        return guac_opcode_index_lookup(&__guac_instruction_handler_index,
+                opcode);
+
+    if (map == __guac_handshake_handler_map)
+        return guac_opcode_index_lookup(&__guac_handshake_handler_index,
+                opcode);
+
+    /* Search any other map linearly */
+    for (int i = 0; map[i].opcode != NULL; i++) {
+        if (strcmp(opcode, map[i].opcode) == 0)
+            return i;
+    }
+
+    return -1;
+
+}
+
 /**
  * Parses a 64-bit integer from the given string. It is assumed that the string
  * will contain only decimal digits, with an optional leading minus sign.
@@ -157,6 +233,9 @@ int __guac_handle_sync(guac_user* user, int argc, char** argv) {
             "at %" PRIu64 "ms (processing_lag=%ims, estimated_rtt=%ims)",
             timestamp, current, user->processing_lag, user->last_frame_duration);
 
+    GUAC_PROBE4(user_sync, user->user_id, timestamp, user->processing_lag,
+            user->last_frame_duration);
+
     if (user->sync_handler)
         return user->sync_handler(user, timestamp);
     return 0;
@@ -315,6 +394,7 @@ static guac_stream* __init_input_stream(guac_user* user, int stream_index) {
     stream->data = NULL;
     stream->ack_handler = NULL;
     stream->blob_handler = NULL;
+    stream->base64_blob_handler = NULL;
     stream->end_handler = NULL;
 
     return stream;
@@ -493,6 +573,13 @@ int __guac_handle_blob(guac_user* user, int argc, char** argv) {
     if (stream == NULL)
         return 0;
 
+    /* Let stream handler decode blob itself if it prefers to do so */
+    if (stream->base64_blob_handler) {
+        int length = GUAC_PROTOCOL_BASE64_DECODED_LENGTH(strlen(argv[1]));
+        return stream->base64_blob_handler(user, stream, argv[1],
+            length);
+    }
+
     /* Call stream handler if defined */
     if (stream->blob_handler) {
         int length = guac_protocol_decode_base64(argv[1]);
@@ -512,6 +599,46 @@ int __guac_handle_blob(guac_user* user, int argc, char** argv) {
     return 0;
 }
 
+int __guac_handle_binary_blob(guac_user* user, const char* stream_index,
+        char* data, int length) {
+
+    guac_stream* stream = __get_open_input_stream(user, atoi(stream_index));
+
+    /* Fail if no such stream */
+    if (stream == NULL)
+        return 0;
+
+    /* Stream handlers which decode blobs themselves still require base64 */
+    if (stream->base64_blob_handler) {
+
+        char* base64 = guac_mem_alloc(guac_mem_ckd_add_or_die(
+                    GUAC_SOCKET_BASE64_ENCODED_LENGTH((size_t) length), 1));
+
+        size_t base64_length = guac_socket_base64_select(NULL)(
+                (const unsigned char*) data, length, base64);
+        base64[base64_length] = '\0';
+
+        int result = stream->base64_blob_handler(user, stream, base64,
+                length);
+
+        guac_mem_free(base64);
+        return result;
+
+    }
+
+    /* Call stream handler if defined */
+    if (stream->blob_handler)
+        return stream->blob_handler(user, stream, data, length);
+
+    /* Fall back to global handler if defined */
+    if (user->blob_handler)
+        return user->blob_handler(user, stream, data, length);
+
+    guac_protocol_send_ack(user->socket, stream,
+            "File transfer unsupported", GUAC_PROTOCOL_STATUS_UNSUPPORTED);
+    return 0;
+}
+
 int __guac_handle_end(guac_user* user, int argc, char** argv) {
 
     int result = 0;
@@ -720,6 +847,51 @@ int __guac_handshake_timezone_handler(guac_user* user, int argc, char** argv) {
     
 }
 
+int __guac_handshake_blobsize_handler(guac_user* user, int argc, char** argv) {
+
+    /* Ignore if size is not provided */
+    if (argc < 1) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "Received \"blobsize\" "
+                "instruction lacked required arguments.");
+        return 0;
+    }
+
+    /* Restrict requested size to the supported range */
+    int size = atoi(argv[0]);
+    if (size > GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH)
+        size = GUAC_PROTOCOL_LARGE_BLOB_MAX_LENGTH;
+    else if (size < GUAC_PROTOCOL_BLOB_MAX_LENGTH)
+        size = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+
+    user->info.max_blob_length = size;
+    return 0;
+
+}
+
+int __guac_handshake_binary_handler(guac_user* user, int argc, char** argv) {
+    user->info.binary = 1;
+    return 0;
+}
+
+int __guac_handshake_resume_handler(guac_user* user, int argc, char** argv) {
+
+    user->info.resume = 1;
+
+    /* A token and timestamp are provided only if resuming a previous view */
+    if (argc < 2)
+        return 0;
+
+    user->info.resume_timestamp = guac_client_claim_resume_token(user->client,
+            argv[0], __guac_parse_int(argv[1]));
+
+    if (user->info.resume_timestamp == 0)
+        guac_user_log(user, GUAC_LOG_DEBUG, "Resume token is not valid. The "
+                "full state of the connection will be sent instead.");
+
+    return 0;
+
+}
+
 char** guac_copy_mimetypes(char** mimetypes, int count) {
 
     int i;
@@ -760,16 +932,10 @@ void guac_free_mimetypes(char** mimetypes) {
 int __guac_user_call_opcode_handler(__guac_instruction_handler_mapping* map,
         guac_user* user, const char* opcode, int argc, char** argv) {
 
-    /* For each defined instruction */
-    __guac_instruction_handler_mapping* current = map;
-    while (current->opcode != NULL) {
-
-        /* If recognized, call handler */
-        if (strcmp(opcode, current->opcode) == 0)
-            return current->handler(user, argc, argv);
-
-        current++;
-    }
+    /* If recognized, call handler */
+    int position = __guac_handler_lookup(map, opcode);
+    if (position >= 0)
+        return map[position].handler(user, argc, argv);
 
     /* If unrecognized, log and ignore */
     guac_user_log(user, GUAC_LOG_DEBUG, "Handler not found for \"%s\"",
@@ -147,6 +147,31 @@ __guac_instruction_handler __guac_handle_ack;
  */
 __guac_instruction_handler __guac_handle_blob;
 
+/**
+ * Internal handler for blob instructions whose data was received as a binary
+ * element (see guac_parser_enable_binary()), and thus need not be decoded.
+ * The blob handler of the stream or user will be invoked if defined, exactly
+ * as with __guac_handle_blob().
+ *
+ * @param user
+ *     The user that sent the blob instruction.
+ *
+ * @param stream_index
+ *     The index of the stream receiving the blob, as received within the
+ *     first argument of the blob instruction.
+ *
+ * @param data
+ *     The raw data of the blob.
+ *
+ * @param length
+ *     The number of bytes of data within the blob.
+ *
+ * @return
+ *     Zero if the blob was handled successfully, non-zero otherwise.
+ */
+int __guac_handle_binary_blob(guac_user* user, const char* stream_index,
+        char* data, int length);
+
 /**
  * Internal initial handler for the end instruction. When a end instruction
  * is received, this handler will be called. The client's end handler will
@@ -231,6 +256,34 @@ __guac_instruction_handler __guac_handshake_name_handler;
  */
 __guac_instruction_handler __guac_handshake_timezone_handler;
 
+/**
+ * Internal handler function that is called when the blobsize instruction is
+ * received during the handshake process, specifying the largest blob that the
+ * client is able to send and receive. Support for blobs larger than
+ * GUAC_PROTOCOL_BLOB_MAX_LENGTH is confirmed to the client with a "blobsize"
+ * instruction once the handshake has completed.
+ */
+__guac_instruction_handler __guac_handshake_blobsize_handler;
+
+/**
+ * Internal handler function that is called when the binary instruction is
+ * received during the handshake process, requesting that instruction elements
+ * containing raw binary data be allowed. Support for binary elements is
+ * confirmed to the client with a "binary" instruction once the handshake has
+ * completed.
+ */
+__guac_instruction_handler __guac_handshake_binary_handler;
+
+/**
+ * Internal handler function that is called when the resume instruction is
+ * received during the handshake process, requesting a resume token and, if
+ * a token and frame timestamp are provided, that the view of the display of
+ * a user that previously left the connection be resumed from that frame. The
+ * new token is provided to the client with a "resume" instruction once the
+ * handshake has completed.
+ */
+__guac_instruction_handler __guac_handshake_resume_handler;
+
 /**
  * Instruction handler mapping table. This is a NULL-terminated array of
  * __guac_instruction_handler_mapping structures, each mapping an opcode
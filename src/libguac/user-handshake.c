@@ -25,9 +25,11 @@
 #include "guacamole/parser.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 #include "user-handlers.h"
 
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
@@ -55,6 +57,37 @@ typedef struct guac_user_input_thread_params {
 
 } guac_user_input_thread_params;
 
+/**
+ * The state of mouse motion coalescing for a user whose input is being
+ * handled by the user input thread.
+ */
+typedef struct guac_user_mouse_state {
+
+    /**
+     * Whether a coalesced mouse event is waiting to be passed to the mouse
+     * handler of the user.
+     */
+    int pending;
+
+    /**
+     * The X coordinate of the coalesced mouse event, if any.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the coalesced mouse event, if any.
+     */
+    int y;
+
+    /**
+     * The button mask most recently received from the user, or -1 if no
+     * mouse events have yet been received. This is also the button mask of
+     * the coalesced mouse event, if any.
+     */
+    int mask;
+
+} guac_user_mouse_state;
+
 /**
  * Prints an error message using the logging facilities of the given user,
  * automatically including any information present in guac_error.
@@ -115,6 +148,143 @@ static void guac_user_log_handshake_failure(guac_user* user) {
 
 }
 
+/**
+ * Logs a summary of the output statistics of the given user at the debug
+ * level, as returned by guac_user_get_stats().
+ *
+ * @param user
+ *     The user whose output statistics should be logged.
+ */
+static void guac_user_log_stats(guac_user* user) {
+
+    guac_user_stats stats;
+    guac_user_get_stats(user, &stats);
+
+    guac_user_log(user, GUAC_LOG_DEBUG, "Output statistics: %" PRIu64 " "
+            "bytes written in %" PRIu64 " flushes, %" PRIu64 " ms blocked "
+            "writing, at most %" PRIu64 " bytes written between flushes, %i "
+            "ms processing lag.", stats.socket.bytes_written,
+            stats.socket.flushes, stats.socket.write_blocked / 1000000,
+            stats.socket.max_in_flight, stats.processing_lag);
+
+}
+
+/**
+ * Returns whether further input from the user is already waiting to be
+ * handled, either within the buffer of the given parser or on the given
+ * socket.
+ *
+ * @param parser
+ *     The parser handling input from the user.
+ *
+ * @param socket
+ *     The socket of the user.
+ *
+ * @return
+ *     Non-zero if further input is waiting, zero otherwise.
+ */
+static int guac_user_input_waiting(guac_parser* parser, guac_socket* socket) {
+    return guac_parser_length(parser) > 0 || guac_socket_select(socket, 0) > 0;
+}
+
+/**
+ * Passes the coalesced mouse event of the given user to that user's mouse
+ * handler, if any such event is pending.
+ *
+ * @param user
+ *     The user whose coalesced mouse event should be handled.
+ *
+ * @param mouse
+ *     The state of mouse motion coalescing for the given user.
+ *
+ * @return
+ *     Zero if no mouse event was pending or the mouse event was handled
+ *     successfully, non-zero otherwise.
+ */
+static int guac_user_flush_mouse(guac_user* user,
+        guac_user_mouse_state* mouse) {
+
+    if (!mouse->pending)
+        return 0;
+
+    mouse->pending = 0;
+
+    if (user->mouse_handler)
+        return user->mouse_handler(user, mouse->x, mouse->y, mouse->mask);
+
+    return 0;
+
+}
+
+/**
+ * Handles the instruction most recently read by the given parser, calling
+ * the appropriate handler of the given user. If mouse coalescing is enabled
+ * for the user, mouse motion is deferred while further input is waiting, and
+ * any deferred motion is handled before anything else changes.
+ *
+ * @param user
+ *     The user that sent the instruction.
+ *
+ * @param parser
+ *     The parser which has just read the instruction.
+ *
+ * @param socket
+ *     The socket of the user.
+ *
+ * @param mouse
+ *     The state of mouse motion coalescing for the given user.
+ *
+ * @return
+ *     Zero if the instruction was handled successfully, non-zero otherwise.
+ */
+static int guac_user_input_dispatch(guac_user* user, guac_parser* parser,
+        guac_socket* socket, guac_user_mouse_state* mouse) {
+
+    if (user->coalesce_mouse && parser->argc >= 3
+            && strcmp(parser->opcode, "mouse") == 0) {
+
+        int mask = atoi(parser->argv[2]);
+
+        /* Defer motion while there is more input to handle */
+        if (mask == mouse->mask) {
+
+            mouse->x = atoi(parser->argv[0]);
+            mouse->y = atoi(parser->argv[1]);
+            mouse->pending = 1;
+
+            if (guac_user_input_waiting(parser, socket))
+                return 0;
+
+            return guac_user_flush_mouse(user, mouse);
+
+        }
+
+        /* Changes in button state are handled immediately, after any
+         * deferred motion */
+        if (guac_user_flush_mouse(user, mouse))
+            return 1;
+
+        mouse->mask = mask;
+
+    }
+
+    /* Deferred motion must be handled before any other instruction */
+    else if (guac_user_flush_mouse(user, mouse))
+        return 1;
+
+    /* Blobs received as binary elements need not be decoded */
+    if (parser->argc >= 2 && strcmp(parser->opcode, "blob") == 0) {
+        int length = guac_parser_binary_length(parser, 1);
+        if (length >= 0)
+            return __guac_handle_binary_blob(user, parser->argv[0],
+                    parser->argv[1], length);
+    }
+
+    return __guac_user_call_opcode_handler(__guac_instruction_handler_map,
+            user, parser->opcode, parser->argc, parser->argv);
+
+}
+
 /**
  * The thread which handles all user input, calling event handlers for received
  * instructions.
@@ -138,9 +308,20 @@ static void* guac_user_input_thread(void* data) {
     guac_client* client = user->client;
     guac_socket* socket = user->socket;
 
+    guac_timestamp last_stats_logged = guac_timestamp_current();
+
+    guac_user_mouse_state mouse = { .pending = 0, .mask = -1 };
+
     /* Guacamole user input loop */
     while (client->state == GUAC_CLIENT_RUNNING && user->active) {
 
+        /* Periodically summarize output to user */
+        guac_timestamp now = guac_timestamp_current();
+        if (now - last_stats_logged >= GUAC_USER_STATS_INTERVAL) {
+            guac_user_log_stats(user);
+            last_stats_logged = now;
+        }
+
         /* Read instruction, stop on error */
         if (guac_parser_read(parser, socket, usec_timeout)) {
 
@@ -163,8 +344,7 @@ static void* guac_user_input_thread(void* data) {
         guac_error_message = NULL;
 
         /* Call handler, stop on error */
-        if (__guac_user_call_opcode_handler(__guac_instruction_handler_map, 
-                user, parser->opcode, parser->argc, parser->argv)) {
+        if (guac_user_input_dispatch(user, parser, socket, &mouse)) {
 
             /* Log error */
             guac_user_log_guac_error(user, GUAC_LOG_WARNING,
@@ -299,6 +479,10 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     user->info.video_mimetypes = NULL;
     user->info.name = NULL;
     user->info.timezone = NULL;
+    user->info.max_blob_length = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+    user->info.binary = 0;
+    user->info.resume = 0;
+    user->info.resume_timestamp = 0;
     
     /* Count number of arguments. */
     int num_args;
@@ -324,8 +508,43 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
         return 1;
     }
 
+    /* Accept correspondingly larger instructions if larger blobs were
+     * requested, falling back to the standard size if not possible */
+    if (user->info.max_blob_length > GUAC_PROTOCOL_BLOB_MAX_LENGTH
+            && guac_parser_set_max_length(parser,
+                GUAC_INSTRUCTION_LARGE_MAX_LENGTH)) {
+        guac_user_log(user, GUAC_LOG_WARNING, "Unable to accept larger "
+                "blobs from user. Falling back to standard blob size.");
+        user->info.max_blob_length = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+    }
+
     /* Acknowledge connection availability */
     guac_protocol_send_ready(socket, client->connection_id);
+
+    /* Confirm support for larger blobs only if requested by the client (the
+     * "blobsize" instruction is otherwise unknown to the client) */
+    if (user->info.max_blob_length > GUAC_PROTOCOL_BLOB_MAX_LENGTH)
+        guac_protocol_send_blobsize(socket, user->info.max_blob_length);
+
+    /* Likewise confirm support for binary elements only if requested, with
+     * all further elements in either direction potentially binary */
+    if (user->info.binary) {
+        guac_protocol_send_binary(socket);
+        guac_parser_enable_binary(parser);
+        guac_socket_enable_binary(socket);
+    }
+
+    /* Issue a resume token only if requested, confirming whether the previous
+     * view of the user is being resumed */
+    if (user->info.resume) {
+        const char* token = guac_client_issue_resume_token(client, user);
+        if (token != NULL)
+            guac_protocol_send_resume(socket, token,
+                    user->info.resume_timestamp);
+        else
+            user->info.resume_timestamp = 0;
+    }
+
     guac_socket_flush(socket);
     
     /* Verify argument count. */
@@ -335,6 +554,9 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
         return 1;
     }
     
+    if (user->owner)
+        guac_client_startup_phase(client, "handshake");
+
     /* Attempt to join user to connection. */
     if (guac_client_add_user(client, user, (parser->argc - 1), parser->argv + 1))
         guac_client_log(client, GUAC_LOG_ERROR, "User \"%s\" could NOT "
@@ -33,6 +33,7 @@
 #include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 #include "id.h"
+#include "socket-queue.h"
 #include "user-handlers.h"
 
 #include <errno.h>
@@ -57,16 +58,29 @@ guac_user* guac_user_alloc() {
     user->processing_lag = 0;
     user->active = 1;
 
+    /* Larger blobs are used only if negotiated during the handshake */
+    user->info.max_blob_length = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+    user->info.binary = 0;
+
+    /* Views of the display are resumed only if requested during the
+     * handshake */
+    user->info.resume = 0;
+    user->info.resume_timestamp = 0;
+
     /* Allocate stream pool */
     user->__stream_pool = guac_pool_alloc(0);
 
     /* Initialize streams */
     user->__input_streams = guac_mem_alloc(sizeof(guac_stream), GUAC_USER_MAX_STREAMS);
     user->__output_streams = guac_mem_alloc(sizeof(guac_stream), GUAC_USER_MAX_STREAMS);
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_STREAM,
+            guac_mem_ckd_mul_or_die(sizeof(guac_stream), GUAC_USER_MAX_STREAMS, 2));
 
     for (i=0; i<GUAC_USER_MAX_STREAMS; i++) {
         user->__input_streams[i].index = GUAC_USER_CLOSED_STREAM_INDEX;
+        user->__input_streams[i].priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
         user->__output_streams[i].index = GUAC_USER_CLOSED_STREAM_INDEX;
+        user->__output_streams[i].priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
     }
 
     /* Allocate object pool */
@@ -86,6 +100,8 @@ void guac_user_free(guac_user* user) {
     /* Free streams */
     guac_mem_free(user->__input_streams);
     guac_mem_free(user->__output_streams);
+    guac_mem_account_free(GUAC_MEM_CATEGORY_STREAM,
+            guac_mem_ckd_mul_or_die(sizeof(guac_stream), GUAC_USER_MAX_STREAMS, 2));
 
     /* Free stream pool */
     guac_pool_free(user->__stream_pool);
@@ -96,6 +112,9 @@ void guac_user_free(guac_user* user) {
     /* Free object pool */
     guac_pool_free(user->__object_pool);
 
+    /* Free any resume token not passed to the client */
+    guac_mem_free(user->__resume_token);
+
     /* Clean up user */
     guac_mem_free(user->user_id);
     guac_mem_free(user);
@@ -118,7 +137,9 @@ guac_stream* guac_user_alloc_stream(guac_user* user) {
     allocd_stream->data = NULL;
     allocd_stream->ack_handler = NULL;
     allocd_stream->blob_handler = NULL;
+    allocd_stream->base64_blob_handler = NULL;
     allocd_stream->end_handler = NULL;
+    allocd_stream->priority = GUAC_SOCKET_PRIORITY_INTERACTIVE;
 
     return allocd_stream;
 
@@ -130,6 +151,12 @@ void guac_user_free_stream(guac_user* user, guac_stream* stream) {
     int freed_index = stream->index;
     stream->index = GUAC_USER_CLOSED_STREAM_INDEX;
 
+    /* Deliver anything still queued for a lower-priority stream before any
+     * data that may be sent along a new stream reusing the same index */
+    if (stream->priority != GUAC_SOCKET_PRIORITY_INTERACTIVE
+            && guac_socket_is_queued(user->socket))
+        guac_socket_queue_promote(user->socket);
+
     /* Release index to pool */
     guac_pool_free_int(user->__stream_pool, freed_index / 2);
 
@@ -174,6 +201,12 @@ int guac_user_handle_instruction(guac_user* user, const char* opcode, int argc,
 
 }
 
+void guac_user_get_stats(guac_user* user, guac_user_stats* stats) {
+    stats->last_frame_duration = user->last_frame_duration;
+    stats->processing_lag = user->processing_lag;
+    guac_socket_get_stats(user->socket, &(stats->socket));
+}
+
 void guac_user_stop(guac_user* user) {
     user->active = 0;
 }
@@ -249,6 +282,165 @@ void guac_user_stream_argv(guac_user* user, guac_socket* socket,
 
 }
 
+/**
+ * The state of a stream being sent using guac_user_stream_windowed().
+ */
+typedef struct guac_user_stream_window {
+
+    /**
+     * The handler which reads the data of each blob.
+     */
+    guac_user_stream_read_handler* read_handler;
+
+    /**
+     * The handler to invoke once the stream has ended, or NULL if none.
+     */
+    guac_user_stream_complete_handler* complete_handler;
+
+    /**
+     * The arbitrary data to pass to read_handler and complete_handler.
+     */
+    void* data;
+
+    /**
+     * The maximum number of blobs that may be awaiting acknowledgement.
+     */
+    int window;
+
+    /**
+     * The number of instructions sent along the stream (including the
+     * instruction that began the stream) that have not yet been
+     * acknowledged.
+     */
+    int in_flight;
+
+    /**
+     * Non-zero if read_handler has signalled the end of the data (or an
+     * error), and thus must not be invoked again.
+     */
+    int finished;
+
+    /**
+     * The status to report to complete_handler once all data has been
+     * acknowledged.
+     */
+    guac_protocol_status status;
+
+    /**
+     * The size of buffer, in bytes.
+     */
+    int buffer_size;
+
+    /**
+     * Buffer receiving the data of each blob prior to that blob being sent.
+     */
+    char buffer[];
+
+} guac_user_stream_window;
+
+/**
+ * Ends the given windowed stream, freeing its tracking state and the stream
+ * itself after invoking its complete handler with the given status.
+ *
+ * @param user
+ *     The user receiving the stream.
+ *
+ * @param stream
+ *     The stream to end.
+ *
+ * @param status
+ *     The status to pass to the complete handler.
+ */
+static void guac_user_stream_window_end(guac_user* user, guac_stream* stream,
+        guac_protocol_status status) {
+
+    guac_user_stream_window* window = (guac_user_stream_window*) stream->data;
+
+    if (window->complete_handler)
+        window->complete_handler(user, stream, window->data, status);
+
+    guac_mem_free(window);
+    guac_user_free_stream(user, stream);
+
+}
+
+/**
+ * Ack handler for streams sent using guac_user_stream_windowed(), sending
+ * further blobs as acknowledgements free up space within the window.
+ */
+static int guac_user_stream_window_ack_handler(guac_user* user,
+        guac_stream* stream, char* message, guac_protocol_status status) {
+
+    guac_user_stream_window* window = (guac_user_stream_window*) stream->data;
+
+    /* Abort stream if user reports an error */
+    if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
+        guac_user_stream_window_end(user, stream, status);
+        return 0;
+    }
+
+    if (window->in_flight > 0)
+        window->in_flight--;
+
+    /* Keep window full until all data has been read */
+    while (!window->finished && window->in_flight < window->window) {
+
+        int length = window->read_handler(user, stream, window->data,
+                window->buffer, window->buffer_size);
+
+        if (length > 0) {
+            guac_protocol_send_blob(user->socket, stream, window->buffer, length);
+            window->in_flight++;
+        }
+
+        else {
+            window->finished = 1;
+            if (length < 0)
+                window->status = GUAC_PROTOCOL_STATUS_SERVER_ERROR;
+        }
+
+    }
+
+    /* End stream only once all blobs have been acknowledged */
+    if (window->finished && window->in_flight == 0) {
+        guac_protocol_send_end(user->socket, stream);
+        guac_user_stream_window_end(user, stream, window->status);
+    }
+
+    guac_socket_flush(user->socket);
+    return 0;
+
+}
+
+int guac_user_stream_windowed(guac_user* user, guac_stream* stream,
+        int window_size, guac_user_stream_read_handler* read_handler,
+        guac_user_stream_complete_handler* complete_handler, void* data) {
+
+    int buffer_size = user->info.max_blob_length;
+
+    guac_user_stream_window* window = guac_mem_alloc(
+            guac_mem_ckd_add_or_die(sizeof(guac_user_stream_window), buffer_size));
+    if (window == NULL)
+        return 1;
+
+    window->read_handler = read_handler;
+    window->complete_handler = complete_handler;
+    window->data = data;
+    window->window = window_size > 0 ? window_size : 1;
+    window->finished = 0;
+    window->status = GUAC_PROTOCOL_STATUS_SUCCESS;
+    window->buffer_size = buffer_size;
+
+    /* The instruction beginning the stream is the first to be acknowledged */
+    window->in_flight = 1;
+
+    stream->data = window;
+    stream->ack_handler = guac_user_stream_window_ack_handler;
+
+    return 0;
+
+}
+
 void guac_user_stream_png(guac_user* user, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface) {
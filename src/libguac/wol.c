@@ -19,7 +19,10 @@
 
 #include "config.h"
 
+#include "guacamole/client.h"
 #include "guacamole/error.h"
+#include "guacamole/protocol.h"
+#include "guacamole/socket.h"
 #include "guacamole/tcp.h"
 #include "guacamole/timestamp.h"
 #include "guacamole/wol.h"
@@ -336,21 +339,73 @@ int guac_wol_wake(const char* mac_addr, const char* broadcast_addr,
     return -1;
 }
 
-int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
-        const unsigned short udp_port, int wait_time, int retries,
-        const char* hostname, const char* port, const int timeout) {
+/**
+ * Returns whether the remote system at the given hostname and port currently
+ * accepts TCP connections, attempting a single connection which is closed
+ * immediately if it succeeds.
+ *
+ * @param hostname
+ *     The hostname or IP address of the remote system.
+ *
+ * @param port
+ *     The TCP port of the remote system.
+ *
+ * @param timeout
+ *     The number of seconds to wait for the connection to be accepted.
+ *
+ * @return
+ *     Non-zero if the remote system accepted the connection, zero otherwise.
+ */
+static int guac_wol_probe(const char* hostname, const char* port,
+        int timeout) {
 
-    /* Attempt to connect, first. */
     int sockfd = guac_tcp_connect(hostname, port, timeout);
-
-    /* If connection succeeds, no need to wake the system. */
-    if (sockfd > 0) {
-        close(sockfd);
+    if (sockfd < 0)
         return 0;
-    }
 
-    /* Close the fd to avoid resource leak. */
     close(sockfd);
+    return 1;
+
+}
+
+/**
+ * Notifies all users of the given client that the remote system is still
+ * being woken.
+ *
+ * @param client
+ *     The guac_client whose users should be notified.
+ *
+ * @param hostname
+ *     The hostname or IP address of the remote system.
+ *
+ * @param elapsed
+ *     The number of whole seconds that have elapsed since the remote system
+ *     was first asked to wake.
+ */
+static void guac_wol_report_progress(guac_client* client,
+        const char* hostname, int elapsed) {
+
+    char elapsed_str[16];
+    snprintf(elapsed_str, sizeof(elapsed_str), "%i", elapsed);
+
+    const char* args[] = { hostname, elapsed_str, NULL };
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Waiting for \"%s\" to wake "
+            "(%i seconds elapsed).", hostname, elapsed);
+
+    guac_protocol_send_msg(client->socket, GUAC_MESSAGE_WOL_WAKING, args);
+    guac_socket_flush(client->socket);
+
+}
+
+int guac_wol_wake_and_probe(guac_client* client, const char* mac_addr,
+        const char* broadcast_addr, const unsigned short udp_port,
+        int wait_time, int retries, const char* hostname, const char* port,
+        const int timeout) {
+
+    /* If the system is already reachable, no need to wake the system. */
+    if (guac_wol_probe(hostname, port, GUAC_WOL_PROBE_TIMEOUT))
+        return 0;
 
     /* Send the magic WOL packet and store return value. */
     int retval = guac_wol_wake(mac_addr, broadcast_addr, udp_port);
@@ -359,23 +414,39 @@ int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
     if (retval)
         return retval;
 
-    /* Try to connect on the specified TCP port and hostname or IP. */
-    for (int i = 0; i < retries; i++) {
+    guac_timestamp start = guac_timestamp_current();
+    guac_timestamp deadline = start
+        + (guac_timestamp) retries * (wait_time + timeout) * 1000;
+
+    int delay = GUAC_WOL_PROBE_INITIAL_DELAY;
+    int reported = 0;
+
+    /* Probe until the system is reachable, backing off exponentially */
+    for (;;) {
+
+        guac_timestamp now = guac_timestamp_current();
+        if (now >= deadline)
+            break;
 
-        sockfd = guac_tcp_connect(hostname, port, timeout);
+        guac_timestamp_msleep(delay < deadline - now ? delay : deadline - now);
 
-        /* Connection succeeded - close socket and exit. */
-        if (sockfd > 0) {
-            close(sockfd);
+        if (guac_wol_probe(hostname, port, GUAC_WOL_PROBE_TIMEOUT))
             return 0;
+
+        /* Report progress no more than once per second */
+        int elapsed = (guac_timestamp_current() - start) / 1000;
+        if (client != NULL && elapsed > reported) {
+            guac_wol_report_progress(client, hostname, elapsed);
+            reported = elapsed;
         }
 
-        /**
-         * Connection did not succed - close the socket and sleep for the
-         * specified amount of time before retrying.
-         */
-        close(sockfd);
-        guac_timestamp_msleep(wait_time * 1000);
+        /* Earlier packets may have been lost */
+        guac_wol_wake(mac_addr, broadcast_addr, udp_port);
+
+        delay *= 2;
+        if (delay > GUAC_WOL_PROBE_MAX_DELAY)
+            delay = GUAC_WOL_PROBE_MAX_DELAY;
+
     }
 
     /* Failed to connect, set error message and return an error. */
@@ -384,3 +455,12 @@ int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
     return -1;
 
 }
+
+int guac_wol_wake_and_wait(const char* mac_addr, const char* broadcast_addr,
+        const unsigned short udp_port, int wait_time, int retries,
+        const char* hostname, const char* port, const int timeout) {
+
+    return guac_wol_wake_and_probe(NULL, mac_addr, broadcast_addr, udp_port,
+            wait_time, retries, hostname, port, timeout);
+
+}
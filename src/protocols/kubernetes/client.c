@@ -21,6 +21,7 @@
 #include "client.h"
 #include "kubernetes.h"
 #include "settings.h"
+#include "terminal/terminal.h"
 #include "user.h"
 
 #include <guacamole/argv.h>
@@ -143,6 +144,9 @@ int guac_client_init(guac_client* client) {
                 "not render correctly.");
     }
 
+    /* Begin loading fonts while awaiting the user */
+    guac_terminal_preload_fonts();
+
     /* Success */
     return 0;
 
@@ -21,11 +21,13 @@
 #include "terminal/terminal.h"
 
 #include <guacamole/client.h>
+#include <guacamole/mem.h>
 #include <libwebsockets.h>
 
 #include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 void guac_kubernetes_receive_data(guac_client* client,
         const char* buffer, size_t length) {
@@ -39,10 +41,24 @@ void guac_kubernetes_receive_data(guac_client* client,
 
     switch (channel) {
 
-        /* Write STDOUT / STDERR directly to terminal as output */
+        /* Collect STDOUT / STDERR for writing to terminal as output */
         case GUAC_KUBERNETES_CHANNEL_STDOUT:
         case GUAC_KUBERNETES_CHANNEL_STDERR:
-            guac_terminal_write(kubernetes_client->term, buffer, length);
+
+            /* Make room for received data, if necessary */
+            if (kubernetes_client->output_length + length
+                    > sizeof(kubernetes_client->output_buffer))
+                guac_kubernetes_flush_output(client);
+
+            /* Write data too large to be collected directly */
+            if (length > sizeof(kubernetes_client->output_buffer)) {
+                guac_terminal_write(kubernetes_client->term, buffer, length);
+                break;
+            }
+
+            memcpy(kubernetes_client->output_buffer
+                    + kubernetes_client->output_length, buffer, length);
+            kubernetes_client->output_length += length;
             break;
 
         /* Ignore data on other channels */
@@ -54,52 +70,138 @@ void guac_kubernetes_receive_data(guac_client* client,
 
 }
 
-void guac_kubernetes_send_message(guac_client* client,
-        int channel, const char* data, int length) {
+void guac_kubernetes_flush_output(guac_client* client) {
 
     guac_kubernetes_client* kubernetes_client =
         (guac_kubernetes_client*) client->data;
 
-    pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
+    if (kubernetes_client->output_length == 0)
+        return;
 
-    /* Add message to buffer if space is available */
-    if (kubernetes_client->outbound_messages_waiting
-            < GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES) {
+    guac_terminal_write(kubernetes_client->term,
+            kubernetes_client->output_buffer,
+            kubernetes_client->output_length);
 
-        /* Calculate storage position of next message */
-        int index = (kubernetes_client->outbound_messages_top
-                  + kubernetes_client->outbound_messages_waiting)
-                  % GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES;
+    kubernetes_client->output_length = 0;
 
-        /* Obtain pointer to message slot at calculated position */
-        guac_kubernetes_message* message =
-            &(kubernetes_client->outbound_messages[index]);
+}
+
+void guac_kubernetes_close_channel(guac_client* client, int channel) {
+
+    guac_kubernetes_client* kubernetes_client =
+        (guac_kubernetes_client*) client->data;
+
+    if (!kubernetes_client->supports_close)
+        return;
+
+    char data = channel;
+    guac_kubernetes_send_message(client, GUAC_KUBERNETES_CHANNEL_CLOSE,
+            &data, 1);
+
+}
+
+guac_kubernetes_message* guac_kubernetes_alloc_message(int channel) {
 
-        /* Copy details of message into buffer */
-        message->channel = channel;
-        memcpy(message->data, data, length);
-        message->length = length;
+    guac_kubernetes_message* message =
+        guac_mem_alloc(sizeof(guac_kubernetes_message));
 
-        /* One more message is now waiting */
-        kubernetes_client->outbound_messages_waiting++;
+    message->channel = channel;
+    message->length = 0;
+    message->next = NULL;
 
-        /* Notify libwebsockets that we need a callback to send pending
-         * messages */
-        lws_callback_on_writable(kubernetes_client->wsi);
-        lws_cancel_service(kubernetes_client->context);
+    return message;
+
+}
+
+/**
+ * Waits for pending messages to be removed from the outbound message queue of
+ * the given Kubernetes connection, or until GUAC_KUBERNETES_SERVICE_INTERVAL
+ * milliseconds have elapsed, whichever is sooner. The outbound_message_lock
+ * must be held.
+ *
+ * @param kubernetes_client
+ *     The Kubernetes client whose outbound message queue should be awaited.
+ */
+static void guac_kubernetes_outbound_timedwait(
+        guac_kubernetes_client* kubernetes_client) {
+
+    struct timespec ts_timeout;
+    clock_gettime(CLOCK_REALTIME, &ts_timeout);
+
+    uint64_t nsec_timeout = GUAC_KUBERNETES_SERVICE_INTERVAL * 1000000L
+        + ts_timeout.tv_nsec;
+    ts_timeout.tv_sec += nsec_timeout / 1000000000L;
+    ts_timeout.tv_nsec = nsec_timeout % 1000000000L;
+
+    pthread_cond_timedwait(&(kubernetes_client->outbound_message_written),
+            &(kubernetes_client->outbound_message_lock), &ts_timeout);
+
+}
+
+void guac_kubernetes_queue_message(guac_client* client,
+        guac_kubernetes_message* message) {
+
+    guac_kubernetes_client* kubernetes_client =
+        (guac_kubernetes_client*) client->data;
+
+    pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
+
+    /* Apply backpressure to STDIN rather than dropping data, waiting for
+     * pending data to be written while the connection remains open */
+    if (message->channel == GUAC_KUBERNETES_CHANNEL_STDIN) {
+
+        while (kubernetes_client->outbound_length
+                    >= GUAC_KUBERNETES_MAX_OUTBOUND_LENGTH
+                && client->state == GUAC_CLIENT_RUNNING)
+            guac_kubernetes_outbound_timedwait(kubernetes_client);
+
+        kubernetes_client->outbound_length += message->length;
 
     }
 
-    /* Warn if data has to be dropped */
+    /* Add message to end of queue */
+    message->next = NULL;
+    if (kubernetes_client->outbound_messages_tail != NULL)
+        kubernetes_client->outbound_messages_tail->next = message;
     else
-        guac_client_log(client, GUAC_LOG_WARNING, "Send buffer could not be "
-                "flushed in time to handle additional data. Outbound "
-                "message dropped.");
+        kubernetes_client->outbound_messages_head = message;
+
+    kubernetes_client->outbound_messages_tail = message;
+
+    /* Notify libwebsockets that we need a callback to send pending
+     * messages */
+    lws_callback_on_writable(kubernetes_client->wsi);
+    lws_cancel_service(kubernetes_client->context);
 
     pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
 
 }
 
+void guac_kubernetes_send_message(guac_client* client,
+        int channel, const char* data, int length) {
+
+    /* Split data across as many messages as necessary */
+    while (length > 0) {
+
+        guac_kubernetes_message* message =
+            guac_kubernetes_alloc_message(channel);
+
+        int chunk_length = length;
+        if (chunk_length > sizeof(message->data))
+            chunk_length = sizeof(message->data);
+
+        memcpy(message->data, data, chunk_length);
+        message->length = chunk_length;
+
+        guac_kubernetes_queue_message(client, message);
+
+        data += chunk_length;
+        length -= chunk_length;
+
+    }
+
+}
+
 bool guac_kubernetes_write_pending_message(guac_client* client) {
 
     bool messages_remain;
@@ -108,31 +210,82 @@ bool guac_kubernetes_write_pending_message(guac_client* client) {
 
     pthread_mutex_lock(&(kubernetes_client->outbound_message_lock));
 
-    /* Send one message from top of buffer */
-    if (kubernetes_client->outbound_messages_waiting > 0) {
+    guac_kubernetes_message* message =
+        kubernetes_client->outbound_messages_head;
 
-        /* Obtain pointer to message at top */
-        int top = kubernetes_client->outbound_messages_top;
-        guac_kubernetes_message* message =
-            &(kubernetes_client->outbound_messages[top]);
+    /* Send pending messages from top of queue */
+    if (message != NULL) {
+
+        int channel = message->channel;
+
+        /* Write the oldest message directly from its own buffer unless it can
+         * be combined with the following messages */
+        guac_kubernetes_message* next = message->next;
+        if (channel != GUAC_KUBERNETES_CHANNEL_STDIN || next == NULL
+                || next->channel != channel
+                || message->length + next->length
+                    > GUAC_KUBERNETES_MAX_FRAME_SIZE) {
+
+            /* Write message including channel index */
+            lws_write(kubernetes_client->wsi,
+                    ((unsigned char*) message) + LWS_PRE,
+                    message->length + 1, LWS_WRITE_BINARY);
+
+        }
+
+        /* Otherwise, pack as many consecutive messages along the same channel
+         * as possible into a single frame */
+        else {
+
+            unsigned char* frame = kubernetes_client->outbound_frame + LWS_PRE;
+            int length = 0;
 
-        /* Write message including channel index */
-        lws_write(kubernetes_client->wsi,
-                ((unsigned char*) message) + LWS_PRE,
-                message->length + 1, LWS_WRITE_BINARY);
+            frame[0] = channel;
 
-        /* Advance top to next message */
-        kubernetes_client->outbound_messages_top++;
-        kubernetes_client->outbound_messages_top %=
-            GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES;
+            do {
+                memcpy(frame + 1 + length, message->data, message->length);
+                length += message->length;
+                next = message->next;
+                if (kubernetes_client->outbound_messages_tail == message)
+                    kubernetes_client->outbound_messages_tail = NULL;
+                kubernetes_client->outbound_length -= message->length;
+                guac_mem_free(message);
+                message = next;
+            } while (message != NULL && message->channel == channel
+                    && length + message->length
+                        <= GUAC_KUBERNETES_MAX_FRAME_SIZE);
 
-        /* One less message is waiting */
-        kubernetes_client->outbound_messages_waiting--;
+            kubernetes_client->outbound_messages_head = message;
+
+            /* Write combined frame including channel index */
+            lws_write(kubernetes_client->wsi, frame, length + 1,
+                    LWS_WRITE_BINARY);
+
+            message = NULL;
+
+        }
+
+        /* Remove single written message from queue */
+        if (message != NULL) {
+
+            kubernetes_client->outbound_messages_head = message->next;
+            if (kubernetes_client->outbound_messages_tail == message)
+                kubernetes_client->outbound_messages_tail = NULL;
+
+            if (channel == GUAC_KUBERNETES_CHANNEL_STDIN)
+                kubernetes_client->outbound_length -= message->length;
+
+            guac_mem_free(message);
+
+        }
+
+        /* Wake any thread awaiting room within the queue */
+        pthread_cond_broadcast(&(kubernetes_client->outbound_message_written));
 
     }
 
     /* Record whether messages remained at time of completion */
-    messages_remain = (kubernetes_client->outbound_messages_waiting > 0);
+    messages_remain = (kubernetes_client->outbound_messages_head != NULL);
 
     pthread_mutex_unlock(&(kubernetes_client->outbound_message_lock));
 
@@ -140,3 +293,23 @@ bool guac_kubernetes_write_pending_message(guac_client* client) {
 
 }
 
+void guac_kubernetes_free_pending_messages(guac_client* client) {
+
+    guac_kubernetes_client* kubernetes_client =
+        (guac_kubernetes_client*) client->data;
+
+    guac_kubernetes_message* current =
+        kubernetes_client->outbound_messages_head;
+
+    while (current != NULL) {
+        guac_kubernetes_message* next = current->next;
+        guac_mem_free(current);
+        current = next;
+    }
+
+    kubernetes_client->outbound_messages_head = NULL;
+    kubernetes_client->outbound_messages_tail = NULL;
+    kubernetes_client->outbound_length = 0;
+
+}
+
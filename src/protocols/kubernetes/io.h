@@ -33,6 +33,21 @@
  */
 #define GUAC_KUBERNETES_MAX_MESSAGE_SIZE 1024
 
+/**
+ * The maximum amount of data to include in any single WebSocket frame sent to
+ * Kubernetes, excluding the channel index. Consecutive pending messages along
+ * the same channel are combined into frames of up to this size.
+ */
+#define GUAC_KUBERNETES_MAX_FRAME_SIZE 16384
+
+/**
+ * The maximum number of bytes of STDIN data which may be pending within the
+ * outbound message queue. Once this limit is reached, further reads from the
+ * terminal's STDIN block until enough pending data has been written to
+ * Kubernetes.
+ */
+#define GUAC_KUBERNETES_MAX_OUTBOUND_LENGTH 262144
+
 /**
  * The index of the Kubernetes channel used for STDIN.
  */
@@ -53,6 +68,22 @@
  */
 #define GUAC_KUBERNETES_CHANNEL_RESIZE 4
 
+/**
+ * The index of the Kubernetes channel used to close other channels. The data
+ * of each message along this channel is the index of the channel being
+ * closed. This channel is only available if the Kubernetes server supports
+ * GUAC_KUBERNETES_LWS_PROTOCOL_V5.
+ */
+#define GUAC_KUBERNETES_CHANNEL_CLOSE 255
+
+/**
+ * The maximum amount of STDOUT and STDERR data to collect from Kubernetes
+ * before writing that data to the terminal. Data received within the same
+ * iteration of the libwebsockets event loop is written to the terminal at
+ * once, up to this size.
+ */
+#define GUAC_KUBERNETES_MAX_OUTPUT_LENGTH 65536
+
 /**
  * An outbound message to be received by Kubernetes over WebSocket.
  */
@@ -81,11 +112,20 @@ typedef struct guac_kubernetes_message {
      */
     int length;
 
+    /**
+     * The next message within the outbound message queue, or NULL if this is
+     * the newest message.
+     */
+    struct guac_kubernetes_message* next;
+
 } guac_kubernetes_message;
 
 /**
  * Handles data received from Kubernetes over WebSocket, decoding the channel
- * index of the received data and forwarding that data accordingly.
+ * index of the received data and forwarding that data accordingly. Terminal
+ * output is collected rather than being written immediately, and must
+ * eventually be written with guac_kubernetes_flush_output(). This function
+ * must only be invoked by the thread running the libwebsockets event loop.
  *
  * @param client
  *     The guac_client associated with the connection to Kubernetes.
@@ -99,12 +139,69 @@ typedef struct guac_kubernetes_message {
 void guac_kubernetes_receive_data(guac_client* client,
         const char* buffer, size_t length);
 
+/**
+ * Writes any STDOUT and STDERR data collected by
+ * guac_kubernetes_receive_data() to the terminal with a single write. This
+ * function must only be invoked by the thread running the libwebsockets event
+ * loop, and should be invoked after each iteration of that loop.
+ *
+ * @param client
+ *     The guac_client associated with the connection to Kubernetes.
+ */
+void guac_kubernetes_flush_output(guac_client* client);
+
+/**
+ * Notifies the Kubernetes server that no further data will be sent along the
+ * given channel. If the Kubernetes server does not support closing channels,
+ * this function has no effect.
+ *
+ * @param client
+ *     The guac_client associated with the Kubernetes connection.
+ *
+ * @param channel
+ *     The Kubernetes channel to close, such as GUAC_KUBERNETES_CHANNEL_STDIN.
+ */
+void guac_kubernetes_close_channel(guac_client* client, int channel);
+
+/**
+ * Allocates a new, empty outbound message for the given channel. The data of
+ * the message may be populated directly before the message is added to the
+ * outbound message queue with guac_kubernetes_queue_message(), avoiding any
+ * further copies.
+ *
+ * @param channel
+ *     The Kubernetes channel on which the message will be sent, such as
+ *     GUAC_KUBERNETES_CHANNEL_STDIN.
+ *
+ * @return
+ *     A newly-allocated, empty message.
+ */
+guac_kubernetes_message* guac_kubernetes_alloc_message(int channel);
+
+/**
+ * Adds the given message to the outbound message queue, to be sent to the
+ * Kubernetes server when the WebSocket connection is next available for
+ * writing. Ownership of the message is transferred to the queue. If the
+ * message is along the STDIN channel and the queue already contains
+ * GUAC_KUBERNETES_MAX_OUTBOUND_LENGTH or more bytes of STDIN data, this
+ * function blocks until that data has been written or the connection has
+ * stopped, such that the writer of STDIN is slowed rather than data being
+ * dropped.
+ *
+ * @param client
+ *     The guac_client associated with the Kubernetes connection.
+ *
+ * @param message
+ *     The message to send, as allocated with guac_kubernetes_alloc_message().
+ */
+void guac_kubernetes_queue_message(guac_client* client,
+        guac_kubernetes_message* message);
+
 /**
  * Requests that the given data be sent along the given channel to the
  * Kubernetes server when the WebSocket connection is next available for
- * writing. If the WebSocket connection has not been available for writing for
- * long enough that the outbound message buffer is full, the request to send
- * this particular message will be dropped.
+ * writing. The data is copied into one or more messages which are added to
+ * the outbound message queue with guac_kubernetes_queue_message().
  *
  * @param client
  *     The guac_client associated with the Kubernetes connection.
@@ -125,7 +222,9 @@ void guac_kubernetes_send_message(guac_client* client,
 /**
  * Writes the oldest pending message within the outbound message queue,
  * as scheduled with guac_kubernetes_send_message(), removing that message
- * from the queue. This function MAY NOT be invoked outside the libwebsockets
+ * from the queue. Any following messages along the same channel are combined
+ * with that message into a single WebSocket frame of up to
+ * GUAC_KUBERNETES_MAX_FRAME_SIZE bytes. This function MAY NOT be invoked outside the libwebsockets
  * event callback and MUST only be invoked in the context of a
  * LWS_CALLBACK_CLIENT_WRITEABLE event. If no messages are pending, this
  * function has no effect.
@@ -139,5 +238,15 @@ void guac_kubernetes_send_message(guac_client* client,
  */
 bool guac_kubernetes_write_pending_message(guac_client* client);
 
+/**
+ * Frees all messages remaining within the outbound message queue. This
+ * function must only be invoked once the connection has stopped and no other
+ * thread may access the queue.
+ *
+ * @param client
+ *     The guac_client associated with the Kubernetes connection.
+ */
+void guac_kubernetes_free_pending_messages(guac_client* client);
+
 #endif
 
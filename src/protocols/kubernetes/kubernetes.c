@@ -34,8 +34,31 @@
 #include <libwebsockets.h>
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * Returns whether the Kubernetes server accepted
+ * GUAC_KUBERNETES_LWS_PROTOCOL_V5 for the given WebSocket connection, rather
+ * than GUAC_KUBERNETES_LWS_PROTOCOL_V4.
+ *
+ * @param wsi
+ *     The established WebSocket connection to the Kubernetes server.
+ *
+ * @return
+ *     true if the Kubernetes server accepted GUAC_KUBERNETES_LWS_PROTOCOL_V5,
+ *     false otherwise.
+ */
+static bool guac_kubernetes_is_protocol_v5(struct lws* wsi) {
+
+    const struct lws_protocols* protocol = lws_get_protocol(wsi);
+
+    return protocol != NULL
+        && strcmp(protocol->name, GUAC_KUBERNETES_LWS_PROTOCOL_V5) == 0;
+
+}
 
 /**
  * Callback invoked by libwebsockets for events related to a WebSocket being
@@ -96,9 +119,22 @@ static int guac_kubernetes_lws_callback(struct lws* wsi,
 
         /* Connected / logged in */
         case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            guac_client_startup_phase(client, "websocket_connect");
             guac_client_log(client, GUAC_LOG_INFO,
                     "Kubernetes connection successful.");
 
+            /* Channels may be explicitly closed only in newer versions of
+             * the Kubernetes WebSocket protocol */
+            kubernetes_client->supports_close =
+                guac_kubernetes_is_protocol_v5(wsi);
+
+            guac_client_log(client, GUAC_LOG_DEBUG, "Using Kubernetes "
+                    "WebSocket protocol \"%s\".",
+                    kubernetes_client->supports_close
+                    ? GUAC_KUBERNETES_LWS_PROTOCOL_V5
+                    : GUAC_KUBERNETES_LWS_PROTOCOL_V4);
+            guac_client_startup_complete(client);
+
             /* Allow terminal to render */
             guac_terminal_start(kubernetes_client->term);
 
@@ -156,7 +192,11 @@ static int guac_kubernetes_lws_callback(struct lws* wsi,
  */
 struct lws_protocols guac_kubernetes_lws_protocols[] = {
     {
-        .name = GUAC_KUBERNETES_LWS_PROTOCOL,
+        .name = GUAC_KUBERNETES_LWS_PROTOCOL_V5,
+        .callback = guac_kubernetes_lws_callback
+    },
+    {
+        .name = GUAC_KUBERNETES_LWS_PROTOCOL_V4,
         .callback = guac_kubernetes_lws_callback
     },
     { 0 }
@@ -179,15 +219,26 @@ static void* guac_kubernetes_input_thread(void* data) {
     guac_kubernetes_client* kubernetes_client =
         (guac_kubernetes_client*) client->data;
 
-    char buffer[GUAC_KUBERNETES_MAX_MESSAGE_SIZE];
-    int bytes_read;
+    /* Write all data read, reading directly into each outbound message */
+    for (;;) {
+
+        guac_kubernetes_message* message =
+            guac_kubernetes_alloc_message(GUAC_KUBERNETES_CHANNEL_STDIN);
 
-    /* Write all data read */
-    while ((bytes_read = guac_terminal_read_stdin(kubernetes_client->term, buffer, sizeof(buffer))) > 0) {
+        int bytes_read = guac_terminal_read_stdin(kubernetes_client->term,
+                message->data, sizeof(message->data));
 
-        /* Send received data to Kubernetes along STDIN channel */
-        guac_kubernetes_send_message(client, GUAC_KUBERNETES_CHANNEL_STDIN,
-                buffer, bytes_read);
+        /* Inform Kubernetes once no further input will be sent */
+        if (bytes_read <= 0) {
+            guac_mem_free(message);
+            guac_kubernetes_close_channel(client, GUAC_KUBERNETES_CHANNEL_STDIN);
+            break;
+        }
+
+        /* Send received data to Kubernetes along STDIN channel, blocking
+         * while too much data is already pending */
+        message->length = bytes_read;
+        guac_kubernetes_queue_message(client, message);
 
     }
 
@@ -286,6 +337,9 @@ void* guac_kubernetes_client_thread(void* data) {
         .uid = -1,
         .gid = -1,
         .protocols = guac_kubernetes_lws_protocols,
+#ifdef HAVE_STRUCT_LWS_CONTEXT_CREATION_INFO_FD_LIMIT_PER_THREAD
+        .fd_limit_per_thread = GUAC_KUBERNETES_MAX_FDS,
+#endif
         .user = client
     };
 
@@ -296,7 +350,7 @@ void* guac_kubernetes_client_thread(void* data) {
         .address = settings->hostname,
         .origin = settings->hostname,
         .port = settings->port,
-        .protocol = GUAC_KUBERNETES_LWS_PROTOCOL,
+        .protocol = GUAC_KUBERNETES_LWS_PROTOCOLS,
         .userdata = client
     };
 
@@ -306,7 +360,13 @@ void* guac_kubernetes_client_thread(void* data) {
      * IP addresses are used. */
     if (settings->use_ssl) {
 #ifdef HAVE_LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT
-        context_info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+        context_info.options |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+#endif
+#ifdef HAVE_LWS_SERVER_OPTION_DISABLE_OS_CA_CERTS
+        /* Skip loading the CA certificates of the operating system if the
+         * server certificate will not be verified anyway */
+        if (settings->ignore_cert)
+            context_info.options |= LWS_SERVER_OPTION_DISABLE_OS_CA_CERTS;
 #endif
 #ifdef HAVE_LCCSCF_USE_SSL
         connection_info.ssl_connection = LCCSCF_USE_SSL
@@ -336,8 +396,9 @@ void* guac_kubernetes_client_thread(void* data) {
         goto fail;
     }
 
-    /* Init outbound message buffer */
+    /* Init outbound message queue */
     pthread_mutex_init(&(kubernetes_client->outbound_message_lock), NULL);
+    pthread_cond_init(&(kubernetes_client->outbound_message_written), NULL);
 
     /* Start input thread */
     if (pthread_create(&(input_thread), NULL, guac_kubernetes_input_thread, (void*) client)) {
@@ -358,6 +419,9 @@ void* guac_kubernetes_client_thread(void* data) {
                     GUAC_KUBERNETES_SERVICE_INTERVAL) < 0)
             break;
 
+        /* Write all output received during this iteration at once */
+        guac_kubernetes_flush_output(client);
+
     }
 
     /* Kill client and Wait for input thread to die */
@@ -379,6 +443,9 @@ fail:
     if (kubernetes_client->context != NULL)
         lws_context_destroy(kubernetes_client->context);
 
+    /* Free any messages which could not be sent */
+    guac_kubernetes_free_pending_messages(client);
+
     guac_client_log(client, GUAC_LOG_INFO, "Kubernetes connection ended.");
     return NULL;
 
@@ -30,19 +30,28 @@
 #include <libwebsockets.h>
 
 #include <pthread.h>
+#include <stdbool.h>
 
 /**
- * The name of the WebSocket protocol specific to Kubernetes which should be
- * sent to the Kubernetes server when attaching to a pod.
+ * The name of the newest WebSocket protocol specific to Kubernetes supported
+ * by this client. This version of the protocol additionally allows each
+ * channel to be explicitly closed.
  */
-#define GUAC_KUBERNETES_LWS_PROTOCOL "v4.channel.k8s.io"
+#define GUAC_KUBERNETES_LWS_PROTOCOL_V5 "v5.channel.k8s.io"
 
 /**
- * The maximum number of messages to allow within the outbound message buffer.
- * If messages are sent despite the buffer being full, those messages will be
- * dropped.
+ * The name of the oldest WebSocket protocol specific to Kubernetes supported
+ * by this client, used if the Kubernetes server does not support
+ * GUAC_KUBERNETES_LWS_PROTOCOL_V5.
  */
-#define GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES 8
+#define GUAC_KUBERNETES_LWS_PROTOCOL_V4 "v4.channel.k8s.io"
+
+/**
+ * The WebSocket protocols which should be sent to the Kubernetes server when
+ * attaching to a pod, in order of preference.
+ */
+#define GUAC_KUBERNETES_LWS_PROTOCOLS \
+    GUAC_KUBERNETES_LWS_PROTOCOL_V5 "," GUAC_KUBERNETES_LWS_PROTOCOL_V4
 
 /**
  * The maximum number of milliseconds to wait for a libwebsockets event to
@@ -50,6 +59,16 @@
  */
 #define GUAC_KUBERNETES_SERVICE_INTERVAL 1000
 
+/**
+ * The maximum number of file descriptors that the libwebsockets context of
+ * each Kubernetes connection may use. Only a single WebSocket connection is
+ * made per context, so this need only cover that connection and the handful
+ * of descriptors used internally by libwebsockets. Without this limit,
+ * libwebsockets allocates tables sized by the process-wide file descriptor
+ * limit, which may be very large.
+ */
+#define GUAC_KUBERNETES_MAX_FDS 64
+
 /**
  * Kubernetes-specific client data.
  */
@@ -71,32 +90,67 @@ typedef struct guac_kubernetes_client {
     struct lws* wsi;
 
     /**
-     * Outbound message ring buffer for outbound WebSocket messages. As
-     * libwebsockets uses an event loop for all operations, outbound messages
-     * may be sent only in context of a particular event received via a
-     * callback. Until that event is received, pending data must accumulate in
-     * a buffer.
+     * Whether the Kubernetes server accepted GUAC_KUBERNETES_LWS_PROTOCOL_V5,
+     * and thus supports closing channels with GUAC_KUBERNETES_CHANNEL_CLOSE
+     * messages.
      */
-    guac_kubernetes_message outbound_messages[GUAC_KUBERNETES_MAX_OUTBOUND_MESSAGES];
+    bool supports_close;
 
     /**
-     * The number of messages currently waiting in the outbound message
-     * buffer.
+     * STDOUT and STDERR data received from Kubernetes which has not yet been
+     * written to the terminal. Data received within the same iteration of
+     * the libwebsockets event loop is collected here such that it may be
+     * written to the terminal at once. This buffer must only be accessed by
+     * the thread running the libwebsockets event loop.
      */
-    int outbound_messages_waiting;
+    char output_buffer[GUAC_KUBERNETES_MAX_OUTPUT_LENGTH];
 
     /**
-     * The index of the oldest entry in the outbound message buffer. Newer
-     * messages follow this entry.
+     * The number of bytes currently stored within output_buffer.
      */
-    int outbound_messages_top;
+    int output_length;
 
     /**
-     * Lock which is acquired when the outbound message buffer is being read
+     * The oldest message within the outbound message queue, or NULL if no
+     * messages are pending. As libwebsockets uses an event loop for all
+     * operations, outbound messages may be sent only in context of a
+     * particular event received via a callback. Until that event is
+     * received, pending messages accumulate in this queue.
+     */
+    guac_kubernetes_message* outbound_messages_head;
+
+    /**
+     * The newest message within the outbound message queue, or NULL if no
+     * messages are pending.
+     */
+    guac_kubernetes_message* outbound_messages_tail;
+
+    /**
+     * The total number of bytes of STDIN data within the outbound message
+     * queue.
+     */
+    int outbound_length;
+
+    /**
+     * Lock which is acquired when the outbound message queue is being read
      * or manipulated.
      */
     pthread_mutex_t outbound_message_lock;
 
+    /**
+     * Condition which is signalled whenever pending messages are removed from
+     * the outbound message queue.
+     */
+    pthread_cond_t outbound_message_written;
+
+    /**
+     * Buffer into which consecutive pending messages along the same channel
+     * are combined before being written as a single WebSocket frame,
+     * including the leading LWS_PRE bytes of padding required by lws_write()
+     * and the channel index.
+     */
+    unsigned char outbound_frame[LWS_PRE + 1 + GUAC_KUBERNETES_MAX_FRAME_SIZE];
+
     /**
      * The Kubernetes client thread.
      */
@@ -77,6 +77,10 @@ int guac_kubernetes_user_join_handler(guac_user* user, int argc, char** argv) {
         user->key_handler = guac_kubernetes_user_key_handler;
         user->mouse_handler = guac_kubernetes_user_mouse_handler;
 
+        /* Handle only the most recent position if mouse motion is
+         * received faster than it can be handled */
+        user->coalesce_mouse = 1;
+
         /* Inbound (client to server) clipboard transfer */
         if (!settings->disable_paste)
             user->clipboard_handler = guac_kubernetes_clipboard_handler;
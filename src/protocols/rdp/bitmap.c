@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bitmap.h"
+#include "rdp.h"
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/graphics.h>
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/rect.h>
+#include <winpr/wtypes.h>
+
+#include <string.h>
+
+BOOL guac_rdp_bitmap_new(rdpContext* context, rdpBitmap* bitmap) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    /* No buffer until the bitmap has been drawn more than once */
+    ((guac_rdp_bitmap*) bitmap)->layer = NULL;
+    ((guac_rdp_bitmap*) bitmap)->used = 0;
+
+    return rdp_client->gdi_bitmap.New(context, bitmap);
+
+}
+
+void guac_rdp_bitmap_free(rdpContext* context, rdpBitmap* bitmap) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_display_layer* buffer = ((guac_rdp_bitmap*) bitmap)->layer;
+
+    /* Free buffer mirroring the bitmap, if any */
+    if (buffer != NULL)
+        guac_display_free_layer(buffer);
+
+    rdp_client->gdi_bitmap.Free(context, bitmap);
+
+}
+
+/**
+ * Allocates an off-screen buffer containing a copy of the image data of the
+ * given bitmap, as decoded by FreeRDP's GDI. The buffer is sent to connected
+ * users with the next frame.
+ *
+ * @param context
+ *     The rdpContext associated with the current RDP session.
+ *
+ * @param bitmap
+ *     The bitmap to mirror.
+ *
+ * @return
+ *     A newly-allocated buffer containing a copy of the given bitmap.
+ */
+static guac_display_layer* guac_rdp_bitmap_mirror(rdpContext* context,
+        rdpBitmap* bitmap) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_display_layer* buffer = guac_display_alloc_buffer(rdp_client->display, 1);
+    guac_display_layer_resize(buffer, bitmap->width, bitmap->height);
+
+    guac_display_layer_raw_context* dst_context = guac_display_layer_open_raw(buffer);
+
+    guac_rect dst_rect = {
+        .left   = 0,
+        .top    = 0,
+        .right  = bitmap->width,
+        .bottom = bitmap->height
+    };
+
+    guac_rect_constrain(&dst_rect, &dst_context->bounds);
+
+    /* Bitmaps decoded by the GDI share the native format of the primary
+     * surface (and thus of the guac_display) */
+    HGDI_BITMAP src = ((gdiBitmap*) bitmap)->bitmap;
+    guac_display_layer_raw_context_put(dst_context, &dst_rect,
+            src->data, src->scanline);
+
+    guac_rect_extend(&dst_context->dirty, &dst_rect);
+    guac_display_layer_close_raw(buffer, dst_context);
+
+    return buffer;
+
+}
+
+BOOL guac_rdp_bitmap_memblt(rdpContext* context, MEMBLT_ORDER* memblt) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    rdpGdi* gdi = context->gdi;
+
+    if (!rdp_client->gdi_memblt(context, memblt))
+        return FALSE;
+
+    guac_rdp_bitmap* bitmap = (guac_rdp_bitmap*) memblt->bitmap;
+
+    /* Only exact copies drawn directly to the primary surface correspond to
+     * copies within the default layer */
+    if (bitmap == NULL || gdi->drawing != gdi->primary
+            || memblt->cacheId == GUAC_RDP_BITMAP_OFFSCREEN_CACHE_ID
+            || (memblt->bRop & 0xFF) != GUAC_RDP_BITMAP_ROP3_SRCCOPY)
+        return TRUE;
+
+    /* Bitmaps drawn only once are not worth mirroring, as they would then be
+     * sent twice */
+    if (bitmap->layer == NULL) {
+
+        if (bitmap->used++ == 0)
+            return TRUE;
+
+        bitmap->layer = guac_rdp_bitmap_mirror(context, (rdpBitmap*) bitmap);
+
+    }
+
+    guac_rect src_rect;
+    guac_rect_init(&src_rect, memblt->nXSrc, memblt->nYSrc,
+            memblt->nWidth, memblt->nHeight);
+
+    /* Any part of the draw that was clipped, or that the buffer does not yet
+     * contain as of the previous frame, is simply ignored when the hint is
+     * verified */
+    guac_display_layer_hint_copy_from(guac_display_default_layer(rdp_client->display),
+            bitmap->layer, &src_rect, memblt->nLeftRect, memblt->nTopRect);
+
+    return TRUE;
+
+}
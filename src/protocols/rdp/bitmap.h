@@ -0,0 +1,117 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_RDP_BITMAP_H
+#define GUAC_RDP_BITMAP_H
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/graphics.h>
+#include <guacamole/display.h>
+#include <winpr/wtypes.h>
+
+/**
+ * The ternary raster operation which copies the source bitmap directly to
+ * the destination (SRCCOPY). Only MemBlt orders using this operation produce
+ * an exact copy of the cached bitmap, and thus may be sent as copies from the
+ * buffer mirroring that bitmap.
+ */
+#define GUAC_RDP_BITMAP_ROP3_SRCCOPY 0xCC
+
+/**
+ * The cache ID used by MemBlt orders that draw from an offscreen bitmap,
+ * rather than from the bitmap cache. Offscreen bitmaps are themselves drawn
+ * to by the server, and thus cannot be mirrored by a buffer that is sent only
+ * once.
+ */
+#define GUAC_RDP_BITMAP_OFFSCREEN_CACHE_ID 0xFF
+
+/**
+ * Guacamole-specific rdpBitmap data, extending the bitmap data maintained by
+ * FreeRDP's GDI such that bitmaps drawn repeatedly from the bitmap cache can
+ * be mirrored within off-screen buffers of the guac_display. Draws of those
+ * bitmaps are then hinted to the guac_display as copies from an already-sent
+ * buffer, rather than being encoded again as new image data.
+ */
+typedef struct guac_rdp_bitmap {
+
+    /**
+     * FreeRDP GDI bitmap data - MUST GO FIRST.
+     */
+    gdiBitmap bitmap;
+
+    /**
+     * The off-screen buffer mirroring this bitmap, or NULL if this bitmap has
+     * not (yet) been drawn often enough to warrant a buffer.
+     */
+    guac_display_layer* layer;
+
+    /**
+     * The number of times this bitmap has been drawn via MemBlt orders.
+     */
+    int used;
+
+} guac_rdp_bitmap;
+
+/**
+ * Initializes the Guacamole-specific data of the given bitmap, in addition to
+ * the data initialized by FreeRDP's GDI.
+ *
+ * @param context
+ *     The rdpContext associated with the current RDP session.
+ *
+ * @param bitmap
+ *     The bitmap to initialize.
+ *
+ * @return
+ *     TRUE if successful, FALSE otherwise.
+ */
+BOOL guac_rdp_bitmap_new(rdpContext* context, rdpBitmap* bitmap);
+
+/**
+ * Frees all Guacamole-related data associated with the given bitmap, allowing
+ * FreeRDP's GDI to free the rest safely.
+ *
+ * @param context
+ *     The rdpContext associated with the current RDP session.
+ *
+ * @param bitmap
+ *     The bitmap to free.
+ */
+void guac_rdp_bitmap_free(rdpContext* context, rdpBitmap* bitmap);
+
+/**
+ * Handler for MemBlt orders, which draw a cached bitmap to the current
+ * drawing surface. The order is drawn by FreeRDP's GDI as usual, and, if the
+ * order draws to the primary surface an exact copy of a bitmap that has been
+ * drawn before, a copy from the off-screen buffer mirroring that bitmap is
+ * additionally hinted to the guac_display.
+ *
+ * @param context
+ *     The rdpContext associated with the current RDP session.
+ *
+ * @param memblt
+ *     The received MemBlt order.
+ *
+ * @return
+ *     TRUE if successful, FALSE otherwise.
+ */
+BOOL guac_rdp_bitmap_memblt(rdpContext* context, MEMBLT_ORDER* memblt);
+
+#endif
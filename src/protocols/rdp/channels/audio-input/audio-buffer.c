@@ -30,9 +30,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 /**
@@ -63,30 +65,6 @@ static int guac_rdp_audio_buffer_is_future(const struct timespec* ts) {
 
 }
 
-/**
- * Returns whether the given audio buffer may be flushed. An audio buffer may
- * be flushed if the audio buffer is not currently being freed, at least one
- * packet of audio data is available within the buffer, and flushing the next
- * packet of audio data now would not violate scheduling/throttling rules for
- * outbound audio data.
- *
- * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
- * invoking this function.
- *
- * @param audio_buffer
- *     The guac_rdp_audio_buffer to test.
- *
- * @return
- *     Non-zero if the given audio buffer may be flushed, zero if the audio
- *     buffer cannot be flushed for any reason.
- */
-static int guac_rdp_audio_buffer_may_flush(guac_rdp_audio_buffer* audio_buffer) {
-    return !audio_buffer->stopping
-        && audio_buffer->packet_size > 0
-        && audio_buffer->bytes_written >= audio_buffer->packet_size
-        && !guac_rdp_audio_buffer_is_future(&audio_buffer->next_flush);
-}
-
 /**
  * Returns the duration of the given quantity of audio data in milliseconds.
  *
@@ -121,12 +99,89 @@ static size_t guac_rdp_audio_buffer_length(const guac_rdp_audio_format* format,
     return guac_mem_ckd_mul_or_die(duration, format->rate, format->bps, format->channels) / 1000;
 }
 
+/**
+ * Returns the number of bytes of audio data that should be buffered before
+ * flushing begins (or resumes after the buffer runs dry), as determined by
+ * the current target latency. The returned value is limited such that at
+ * least one further packet will always fit within the packet buffer.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The guac_rdp_audio_buffer to calculate the target length of.
+ *
+ * @return
+ *     The number of bytes of audio data that should be buffered before
+ *     flushing begins.
+ */
+static size_t guac_rdp_audio_buffer_target_length(guac_rdp_audio_buffer* audio_buffer) {
+
+    size_t length = guac_rdp_audio_buffer_length(&audio_buffer->out_format,
+            audio_buffer->target_latency);
+
+    size_t max_length = audio_buffer->packet_buffer_size - audio_buffer->packet_size;
+    if (length > max_length)
+        length = max_length;
+
+    return length;
+
+}
+
+/**
+ * Returns whether the given audio buffer contains enough audio data to be
+ * flushed. At least one packet of audio data must be available within the
+ * buffer, and, if the buffer is refilling after running dry, the amount of
+ * audio data required by the target latency must also be available.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The guac_rdp_audio_buffer to test.
+ *
+ * @return
+ *     Non-zero if the given audio buffer contains enough audio data to be
+ *     flushed, zero otherwise.
+ */
+static int guac_rdp_audio_buffer_has_packet(guac_rdp_audio_buffer* audio_buffer) {
+    return audio_buffer->packet_size > 0
+        && audio_buffer->bytes_written >= audio_buffer->packet_size
+        && (!audio_buffer->buffering || audio_buffer->bytes_written
+                >= guac_rdp_audio_buffer_target_length(audio_buffer));
+}
+
+/**
+ * Returns whether the given audio buffer may be flushed. An audio buffer may
+ * be flushed if the audio buffer is not currently being freed, enough audio
+ * data is available within the buffer (see
+ * guac_rdp_audio_buffer_has_packet()), and flushing the next packet of audio
+ * data now would not violate scheduling/throttling rules for outbound audio
+ * data.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The guac_rdp_audio_buffer to test.
+ *
+ * @return
+ *     Non-zero if the given audio buffer may be flushed, zero if the audio
+ *     buffer cannot be flushed for any reason.
+ */
+static int guac_rdp_audio_buffer_may_flush(guac_rdp_audio_buffer* audio_buffer) {
+    return !audio_buffer->stopping
+        && guac_rdp_audio_buffer_has_packet(audio_buffer)
+        && !guac_rdp_audio_buffer_is_future(&audio_buffer->next_flush);
+}
+
 /**
  * Notifies the given guac_rdp_audio_buffer that a single packet of audio data
  * has just been flushed, updating the scheduled time of the next flush. The
  * timing of the next flush will be set such that the overall real time audio
  * generation rate is not exceeded, but will be adjusted as necessary to
- * compensate for latency induced by differences in audio packet size/duration.
+ * compensate for latency induced by differences in audio packet size/duration
+ * beyond the target latency determined by observed jitter.
  *
  * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
  * invoking this function.
@@ -148,9 +203,15 @@ static void guac_rdp_audio_buffer_schedule_flush(guac_rdp_audio_buffer* audio_bu
         / audio_buffer->out_format.channels;
 
     /* Amortize the additional latency from packet data buffered beyond the
-     * desired packet size over each remaining packet such that we gradually
-     * approach an effective additional latency of 0 */
-    int packets_remaining = audio_buffer->bytes_written / audio_buffer->packet_size;
+     * target latency over each remaining packet such that we gradually
+     * approach an effective additional latency of only what is needed to
+     * absorb jitter */
+    int packets_remaining = 0;
+    size_t target_length = guac_rdp_audio_buffer_target_length(audio_buffer);
+    if (audio_buffer->bytes_written > target_length)
+        packets_remaining = (audio_buffer->bytes_written - target_length)
+            / audio_buffer->packet_size;
+
     if (packets_remaining > 1)
         delta_nsecs = delta_nsecs * (packets_remaining - 1) / packets_remaining;
 
@@ -188,7 +249,7 @@ static void guac_rdp_audio_buffer_wait(guac_rdp_audio_buffer* audio_buffer) {
         /* If sufficient data exists for a flush, wait until next possible
          * flush OR until some other state change occurs (such as the buffer
          * being closed) */
-        if (audio_buffer->bytes_written && audio_buffer->bytes_written >= audio_buffer->packet_size)
+        if (guac_rdp_audio_buffer_has_packet(audio_buffer))
             pthread_cond_timedwait(&audio_buffer->modified, &audio_buffer->lock,
                     &audio_buffer->next_flush);
 
@@ -236,9 +297,12 @@ static void* guac_rdp_audio_buffer_flush_thread(void* data) {
 
         }
 
-        guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Current audio input latency: %i ms (%i bytes waiting in buffer)",
+        guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Current audio input latency: %i ms (%i bytes waiting in buffer, target latency %i ms)",
                 guac_rdp_audio_buffer_duration(&audio_buffer->out_format, audio_buffer->bytes_written),
-                audio_buffer->bytes_written);
+                audio_buffer->bytes_written, audio_buffer->target_latency);
+
+        /* Any required audio has now been buffered */
+        audio_buffer->buffering = 0;
 
         /* Only actually invoke if defined */
         if (audio_buffer->flush_handler) {
@@ -342,6 +406,123 @@ static void* guac_rdp_audio_buffer_ack(guac_user* user, void* data) {
 
 }
 
+/**
+ * Returns the value of the normalized sinc function, sin(pi * x) / (pi * x),
+ * at the given point.
+ *
+ * @param x
+ *     The point at which the sinc function should be evaluated.
+ *
+ * @return
+ *     The value of the normalized sinc function at the given point.
+ */
+static double guac_rdp_audio_buffer_sinc(double x) {
+
+    if (x == 0)
+        return 1;
+
+    return sin(M_PI * x) / (M_PI * x);
+
+}
+
+/**
+ * Returns the value of a Blackman window spanning all taps of the resampler
+ * at the given offset from the center of that window.
+ *
+ * @param x
+ *     The offset from the center of the window, in input frames.
+ *
+ * @return
+ *     The value of the window at the given offset, between 0 and 1.
+ */
+static double guac_rdp_audio_buffer_window(double x) {
+
+    double half_width = GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS / 2;
+    if (x <= -half_width || x >= half_width)
+        return 0;
+
+    return 0.42 + 0.5 * cos(M_PI * x / half_width)
+                + 0.08 * cos(2 * M_PI * x / half_width);
+
+}
+
+/**
+ * Resets the resampler of the given audio buffer, calculating the
+ * coefficients of its polyphase low-pass filter for the current input and
+ * output formats and clearing its history. If either format is not yet
+ * known, the resampler is left disabled, and received audio data is ignored.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The guac_rdp_audio_buffer whose resampler should be reset.
+ */
+static void guac_rdp_audio_buffer_reset_resampler(guac_rdp_audio_buffer* audio_buffer) {
+
+    int in_rate = audio_buffer->in_format.rate;
+    int out_rate = audio_buffer->out_format.rate;
+
+    /* Resampling is impossible until both formats are known */
+    audio_buffer->resample_step = 0;
+    if (in_rate <= 0 || out_rate <= 0 || audio_buffer->in_format.channels <= 0)
+        return;
+
+    audio_buffer->resample_step = (double) in_rate / out_rate;
+    audio_buffer->resample_position = 1.0;
+    memset(audio_buffer->history, 0, sizeof(audio_buffer->history));
+
+    /* Filter out any frequencies that cannot be represented at the lower of
+     * the two rates */
+    double cutoff = GUAC_RDP_AUDIO_BUFFER_RESAMPLER_CUTOFF;
+    if (out_rate < in_rate)
+        cutoff = cutoff * out_rate / in_rate;
+
+    /* Output frames fall between the two input frames at the center of the
+     * history */
+    int center = GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS / 2 - 1;
+
+    for (int phase = 0; phase <= GUAC_RDP_AUDIO_BUFFER_RESAMPLER_PHASES; phase++) {
+
+        double offset = (double) phase / GUAC_RDP_AUDIO_BUFFER_RESAMPLER_PHASES;
+        double sum = 0;
+
+        /* Windowed sinc centered at the fractional position of this phase */
+        for (int tap = 0; tap < GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS; tap++) {
+            double x = tap - center - offset;
+            double coefficient = cutoff * guac_rdp_audio_buffer_sinc(cutoff * x)
+                    * guac_rdp_audio_buffer_window(x);
+            audio_buffer->filter[phase][tap] = coefficient;
+            sum += coefficient;
+        }
+
+        /* Normalize for unity gain */
+        for (int tap = 0; tap < GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS; tap++)
+            audio_buffer->filter[phase][tap] /= sum;
+
+    }
+
+}
+
+/**
+ * Resets all jitter tracking of the given audio buffer, such that the target
+ * latency is determined solely by audio data received after this function
+ * is invoked.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The guac_rdp_audio_buffer whose jitter tracking should be reset.
+ */
+static void guac_rdp_audio_buffer_reset_jitter(guac_rdp_audio_buffer* audio_buffer) {
+    audio_buffer->received_duration = 0;
+    audio_buffer->last_received = 0;
+    audio_buffer->last_transit = 0;
+    audio_buffer->jitter = 0;
+    audio_buffer->target_latency = GUAC_RDP_AUDIO_BUFFER_MIN_LATENCY;
+}
+
 void guac_rdp_audio_buffer_set_stream(guac_rdp_audio_buffer* audio_buffer,
         guac_user* user, guac_stream* stream, int rate, int channels, int bps) {
 
@@ -354,6 +535,10 @@ void guac_rdp_audio_buffer_set_stream(guac_rdp_audio_buffer* audio_buffer,
     audio_buffer->in_format.channels = channels;
     audio_buffer->in_format.bps = bps;
 
+    /* Begin resampling and tracking jitter of new stream */
+    guac_rdp_audio_buffer_reset_resampler(audio_buffer);
+    guac_rdp_audio_buffer_reset_jitter(audio_buffer);
+
     /* Acknowledge stream creation (if buffer is ready to receive) */
     guac_rdp_audio_buffer_ack_params ack_params = { audio_buffer, "OK", GUAC_PROTOCOL_STATUS_SUCCESS };
     guac_client_for_user(audio_buffer->client, user, guac_rdp_audio_buffer_ack, &ack_params);
@@ -379,6 +564,8 @@ void guac_rdp_audio_buffer_set_output(guac_rdp_audio_buffer* audio_buffer,
     audio_buffer->out_format.channels = channels;
     audio_buffer->out_format.bps = bps;
 
+    guac_rdp_audio_buffer_reset_resampler(audio_buffer);
+
     pthread_cond_broadcast(&(audio_buffer->modified));
     pthread_mutex_unlock(&(audio_buffer->lock));
 
@@ -392,6 +579,7 @@ void guac_rdp_audio_buffer_begin(guac_rdp_audio_buffer* audio_buffer,
 
     /* Reset buffer state to provided values */
     audio_buffer->bytes_written = 0;
+    audio_buffer->buffering = 1;
     audio_buffer->flush_handler = flush_handler;
     audio_buffer->data = data;
 
@@ -433,148 +621,244 @@ void guac_rdp_audio_buffer_begin(guac_rdp_audio_buffer* audio_buffer,
 }
 
 /**
- * Reads a single sample from the given buffer of data, using the input
- * format defined within the given audio buffer. Each read sample is
- * translated to a signed 16-bit value, even if the input format is 8-bit.
- * The offset into the given buffer will be determined according to the
- * input and output formats, the number of bytes sent thus far, and the
- * number of bytes received (excluding the contents of the buffer).
+ * Reads the samples of a single input frame from the given buffer of data,
+ * using the input format defined within the given audio buffer, and adds that
+ * frame to the resampler history. Each sample is translated to a floating
+ * point value between -1 and 1, regardless of whether the input format is 8-
+ * or 16-bit.
  *
  * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
  * invoking this function.
  *
  * @param audio_buffer
- *     The audio buffer dictating the format of the given data buffer, as
- *     well as the offset from which the sample should be read.
+ *     The audio buffer dictating the format of the given data buffer and
+ *     whose resampler history should receive the frame.
  *
  * @param buffer
- *     The buffer of raw PCM audio data from which the sample should be read.
- *     This buffer MUST NOT contain data already taken into account by the
- *     audio buffer's total_bytes_received counter.
+ *     The raw PCM audio data of the input frame. This buffer MUST contain at
+ *     least one complete frame in the input format.
+ */
+static void guac_rdp_audio_buffer_push_frame(
+        guac_rdp_audio_buffer* audio_buffer, const char* buffer) {
+
+    int in_bps = audio_buffer->in_format.bps;
+    int in_channels = audio_buffer->in_format.channels;
+    if (in_channels > GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS)
+        in_channels = GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS;
+
+    for (int channel = 0; channel < in_channels; channel++) {
+
+        float sample;
+
+        /* Simply read sample directly if input is 16-bit */
+        if (in_bps == 2)
+            sample = *((int16_t*) buffer) / 32768.0f;
+
+        /* Scale to the same range if input is 8-bit */
+        else
+            sample = *((int8_t*) buffer) / 128.0f;
+
+        /* Shift sample into history, discarding the oldest */
+        float* history = audio_buffer->history[channel];
+        memmove(history, history + 1,
+                sizeof(float) * (GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS - 1));
+        history[GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS - 1] = sample;
+
+        buffer += in_bps;
+
+    }
+
+}
+
+/**
+ * Produces a single sample of the output frame at the current resampler
+ * position, filtering the resampler history of the given input channel with
+ * the polyphase filter coefficients nearest that position. The resulting
+ * sample is translated to a signed 16-bit value, even if the output format is
+ * 8-bit.
  *
- * @param length
- *     The number of bytes within the given buffer of PCM data.
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The audio buffer whose resampler should produce the sample.
  *
- * @param sample
- *     A pointer to the int16_t in which the read sample should be stored. If
- *     the input format is 8-bit, the sample will be shifted left by 8 bits
- *     to produce a 16-bit sample.
+ * @param channel
+ *     The input channel whose history should be filtered.
  *
  * @return
- *     Non-zero if a sample was successfully read, zero if no data remains
- *     within the given buffer that has not already been mapped to an
- *     output sample.
+ *     The resampled value as a signed 16-bit sample.
  */
-static int guac_rdp_audio_buffer_read_sample(
-        guac_rdp_audio_buffer* audio_buffer, const char* buffer, int length,
-        int16_t* sample) {
+static int16_t guac_rdp_audio_buffer_read_sample(
+        guac_rdp_audio_buffer* audio_buffer, int channel) {
 
-    int in_bps = audio_buffer->in_format.bps;
-    int in_rate = audio_buffer->in_format.rate;
-    int in_channels = audio_buffer->in_format.channels;
+    int phase = (int) (audio_buffer->resample_position
+            * GUAC_RDP_AUDIO_BUFFER_RESAMPLER_PHASES + 0.5);
 
-    int out_bps = audio_buffer->out_format.bps;
-    int out_rate = audio_buffer->out_format.rate;
-    int out_channels = audio_buffer->out_format.channels;
+    const float* coefficients = audio_buffer->filter[phase];
+    const float* history = audio_buffer->history[channel];
 
-    /* Calculate position within audio output */
-    int current_sample  = audio_buffer->total_bytes_sent / out_bps;
-    int current_frame   = current_sample / out_channels;
-    int current_channel = current_sample % out_channels;
+    float value = 0;
+    for (int tap = 0; tap < GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS; tap++)
+        value += coefficients[tap] * history[tap];
 
-    /* Map output channel to input channel */
-    if (current_channel >= in_channels)
-        current_channel = in_channels - 1;
+    /* Clamp to 16-bit range (filter ringing may overshoot) */
+    value *= 32768.0f;
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
 
-    /* Transform output position to input position */
-    current_frame = (int) current_frame * ((double) in_rate / out_rate);
-    current_sample = current_frame * in_channels + current_channel;
+    return (int16_t) value;
 
-    /* Calculate offset within given buffer from absolute input position */
-    int offset = current_sample * in_bps
-               - audio_buffer->total_bytes_received;
+}
 
-    /* It should be impossible for the offset to ever go negative */
-    assert(offset >= 0);
+/**
+ * Updates the observed jitter and target latency of the given audio buffer
+ * to take into account the receipt of the given duration of audio data at the
+ * current time. Jitter is estimated as described by RFC 3550, with the
+ * position of received data within the audio stream serving as its
+ * timestamp.
+ *
+ * IMPORTANT: The guac_rdp_audio_buffer's lock MUST already be held when
+ * invoking this function.
+ *
+ * @param audio_buffer
+ *     The audio buffer receiving audio data.
+ *
+ * @param duration
+ *     The duration of the audio data received, in milliseconds.
+ */
+static void guac_rdp_audio_buffer_update_jitter(
+        guac_rdp_audio_buffer* audio_buffer, double duration) {
 
-    /* Apply offset to buffer */
-    buffer += offset;
-    length -= offset;
+    guac_timestamp now = guac_timestamp_current();
 
-    /* Read only if sufficient data is present in the given buffer */
-    if (length < in_bps)
-        return 0;
+    audio_buffer->received_duration += duration;
+    double transit = now - audio_buffer->received_duration;
 
-    /* Simply read sample directly if input is 16-bit */
-    if (in_bps == 2) {
-        *sample = *((int16_t*) buffer);
-        return 1;
-    }
+    /* Jitter can be observed only relative to prior received data */
+    if (audio_buffer->last_received != 0) {
+
+        double deviation = fabs(transit - audio_buffer->last_transit);
+        audio_buffer->jitter += (deviation - audio_buffer->jitter)
+            / GUAC_RDP_AUDIO_BUFFER_JITTER_SMOOTHING;
+
+        int target_latency = audio_buffer->jitter
+            * GUAC_RDP_AUDIO_BUFFER_JITTER_MULTIPLIER;
+
+        if (target_latency < GUAC_RDP_AUDIO_BUFFER_MIN_LATENCY)
+            target_latency = GUAC_RDP_AUDIO_BUFFER_MIN_LATENCY;
+        else if (target_latency > GUAC_RDP_AUDIO_BUFFER_MAX_LATENCY)
+            target_latency = GUAC_RDP_AUDIO_BUFFER_MAX_LATENCY;
+
+        audio_buffer->target_latency = target_latency;
 
-    /* Translate to 16-bit if input is 8-bit */
-    if (in_bps == 1) {
-        *sample = *buffer << 8;
-        return 1;
     }
 
-    /* Accepted audio formats are required to be 8- or 16-bit */
-    return 0;
+    audio_buffer->last_received = now;
+    audio_buffer->last_transit = transit;
 
 }
 
 void guac_rdp_audio_buffer_write(guac_rdp_audio_buffer* audio_buffer,
         char* buffer, int length) {
 
-    int16_t sample;
-
     pthread_mutex_lock(&(audio_buffer->lock));
 
     guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Received %i bytes (%i ms) of audio data",
             length, guac_rdp_audio_buffer_duration(&audio_buffer->in_format, length));
 
-    /* Ignore packet if there is no buffer */
-    if (audio_buffer->packet_buffer_size == 0 || audio_buffer->packet == NULL) {
+    /* Ignore packet if there is no buffer (or the formats of the received
+     * and expected audio are not yet both known) */
+    if (audio_buffer->packet_buffer_size == 0 || audio_buffer->packet == NULL
+            || audio_buffer->resample_step == 0) {
         guac_client_log(audio_buffer->client, GUAC_LOG_DEBUG, "Dropped %i "
                 "bytes of received audio data (buffer full or closed).", length);
         pthread_mutex_unlock(&(audio_buffer->lock));
         return;
     }
 
-    /* Truncate received samples if exceeding size of buffer */
-    int available = audio_buffer->packet_buffer_size - audio_buffer->bytes_written;
-    if (length > available) {
-        guac_client_log(audio_buffer->client, GUAC_LOG_DEBUG, "Truncating %i "
-                "bytes of received audio data to %i bytes (insufficient space "
-                "in buffer).", length, available);
-        length = available;
+    int in_frame_size = audio_buffer->in_format.bps * audio_buffer->in_format.channels;
+    int frames = length / in_frame_size;
+
+    guac_rdp_audio_buffer_update_jitter(audio_buffer,
+            frames * 1000.0 / audio_buffer->in_format.rate);
+
+    /* If the next packet was due to be flushed but could not be, the buffer
+     * has run dry, and flushing must wait until the target latency has been
+     * reached again */
+    if (!audio_buffer->buffering
+            && audio_buffer->bytes_written < audio_buffer->packet_size
+            && !guac_rdp_audio_buffer_is_future(&audio_buffer->next_flush)) {
+        guac_client_log(audio_buffer->client, GUAC_LOG_TRACE, "Audio input "
+                "buffer ran dry. Buffering %i ms of audio before resuming.",
+                audio_buffer->target_latency);
+        audio_buffer->buffering = 1;
     }
 
     int out_bps = audio_buffer->out_format.bps;
+    int out_channels = audio_buffer->out_format.channels;
+    int out_frame_size = out_bps * out_channels;
+
+    int in_channels = audio_buffer->in_format.channels;
+    if (in_channels > GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS)
+        in_channels = GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS;
 
-    /* Continuously write packets until no data remains */
-    while (guac_rdp_audio_buffer_read_sample(audio_buffer,
-                buffer, length, &sample) > 0) {
+    int dropped = 0;
 
-        char* current = audio_buffer->packet + audio_buffer->bytes_written;
+    for (int i = 0; i < frames; i++) {
 
-        /* Store as 16-bit or 8-bit, depending on output format */
-        if (out_bps == 2)
-            *((int16_t*) current) = sample;
-        else if (out_bps == 1)
-            *current = sample >> 8;
+        guac_rdp_audio_buffer_push_frame(audio_buffer, buffer);
+        buffer += in_frame_size;
 
-        /* Accepted audio formats are required to be 8- or 16-bit */
-        else
-            assert(0);
+        /* Produce all output frames that fall before the next input frame */
+        while (audio_buffer->resample_position < 1.0) {
+
+            /* Drop output frames that do not fit within the buffer */
+            if (audio_buffer->bytes_written + out_frame_size
+                    > audio_buffer->packet_buffer_size) {
+                dropped += out_frame_size;
+                audio_buffer->resample_position += audio_buffer->resample_step;
+                continue;
+            }
 
-        /* Update byte counters */
-        audio_buffer->bytes_written += out_bps;
-        audio_buffer->total_bytes_sent += out_bps;
+            for (int channel = 0; channel < out_channels; channel++) {
 
-    } /* end packet write loop */
+                /* Map output channel to input channel */
+                int in_channel = channel;
+                if (in_channel >= in_channels)
+                    in_channel = in_channels - 1;
 
-    /* Track current position in audio stream */
-    audio_buffer->total_bytes_received += length;
+                int16_t sample = guac_rdp_audio_buffer_read_sample(audio_buffer, in_channel);
+                char* current = audio_buffer->packet + audio_buffer->bytes_written;
+
+                /* Store as 16-bit or 8-bit, depending on output format */
+                if (out_bps == 2)
+                    *((int16_t*) current) = sample;
+                else if (out_bps == 1)
+                    *current = sample >> 8;
+
+                /* Accepted audio formats are required to be 8- or 16-bit */
+                else
+                    assert(0);
+
+                audio_buffer->bytes_written += out_bps;
+
+            }
+
+            audio_buffer->resample_position += audio_buffer->resample_step;
+
+        }
+
+        audio_buffer->resample_position -= 1.0;
+
+    } /* end frame write loop */
+
+    if (dropped > 0)
+        guac_client_log(audio_buffer->client, GUAC_LOG_DEBUG, "Dropped %i "
+                "bytes of resampled audio data (insufficient space in "
+                "buffer).", dropped);
 
     pthread_cond_broadcast(&(audio_buffer->modified));
     pthread_mutex_unlock(&(audio_buffer->lock));
@@ -607,9 +891,8 @@ void guac_rdp_audio_buffer_end(guac_rdp_audio_buffer* audio_buffer) {
     audio_buffer->packet_buffer_size = 0;
     audio_buffer->flush_handler = NULL;
 
-    /* Reset I/O counters */
-    audio_buffer->total_bytes_sent = 0;
-    audio_buffer->total_bytes_received = 0;
+    /* Reset jitter tracking */
+    guac_rdp_audio_buffer_reset_jitter(audio_buffer);
 
     /* Free packet (if any) */
     guac_mem_free(audio_buffer->packet);
@@ -21,6 +21,7 @@
 #define GUAC_RDP_CHANNELS_AUDIO_INPUT_AUDIO_BUFFER_H
 
 #include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
 #include <guacamole/user.h>
 #include <pthread.h>
 #include <time.h>
@@ -34,6 +35,61 @@
  */
 #define GUAC_RDP_AUDIO_BUFFER_MIN_DURATION 250
 
+/**
+ * The smallest amount of audio data, in milliseconds, that should be buffered
+ * before flushing begins (or resumes after the buffer runs dry), regardless
+ * of how consistently audio data is being received.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_MIN_LATENCY 20
+
+/**
+ * The largest amount of audio data, in milliseconds, that should be buffered
+ * before flushing begins (or resumes after the buffer runs dry), regardless
+ * of how inconsistently audio data is being received. This must be less than
+ * GUAC_RDP_AUDIO_BUFFER_MIN_DURATION.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_MAX_LATENCY 200
+
+/**
+ * The multiple of the observed jitter (the average variation in the arrival
+ * time of received audio data) that should be buffered before flushing
+ * begins (or resumes after the buffer runs dry).
+ */
+#define GUAC_RDP_AUDIO_BUFFER_JITTER_MULTIPLIER 3
+
+/**
+ * The weight given to each new observation of jitter within the running
+ * average maintained by the audio buffer, as the reciprocal of a fraction. A
+ * value of 16 matches the jitter estimate defined by RFC 3550.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_JITTER_SMOOTHING 16
+
+/**
+ * The maximum number of input channels that the resampler of each
+ * guac_rdp_audio_buffer will process. Any additional channels within received
+ * audio data are ignored.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS 2
+
+/**
+ * The number of input frames considered by the resampler when producing each
+ * output frame. This must be even.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS 16
+
+/**
+ * The number of distinct fractional positions between input frames for which
+ * the resampler maintains filter coefficients. Each output frame is produced
+ * using the coefficients of the nearest such position.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_RESAMPLER_PHASES 64
+
+/**
+ * The cutoff frequency of the resampler's low-pass filter, as a fraction of
+ * the lower of the input and output Nyquist frequencies.
+ */
+#define GUAC_RDP_AUDIO_BUFFER_RESAMPLER_CUTOFF 0.9
+
 /**
  * A buffer of arbitrary audio data. Received audio data can be written to this
  * buffer, and will automatically be flushed via a given handler once the
@@ -145,16 +201,70 @@ struct guac_rdp_audio_buffer {
     int bytes_written;
 
     /**
-     * The total number of bytes having ever been received by the Guacamole
-     * server for the current audio stream.
+     * The total duration of audio data having ever been received by the
+     * Guacamole server for the current audio stream, in milliseconds.
+     */
+    double received_duration;
+
+    /**
+     * The time that audio data was most recently received for the current
+     * audio stream, or zero if no audio data has yet been received.
+     */
+    guac_timestamp last_received;
+
+    /**
+     * The difference between the time that audio data was most recently
+     * received and the position of the end of that data within the current
+     * audio stream, in milliseconds. Variation in this value between
+     * receipts of audio data is the jitter of the audio stream.
+     */
+    double last_transit;
+
+    /**
+     * Running average of the jitter of the current audio stream, in
+     * milliseconds.
+     */
+    double jitter;
+
+    /**
+     * The amount of audio data, in milliseconds, that should be buffered
+     * before flushing begins (or resumes after the buffer runs dry), as
+     * determined by the observed jitter.
+     */
+    int target_latency;
+
+    /**
+     * Non-zero if flushing is paused until at least target_latency
+     * milliseconds of audio data have been buffered, zero otherwise. This is
+     * the case when flushing first begins and whenever the buffer runs dry.
+     */
+    int buffering;
+
+    /**
+     * The coefficients of the resampler's low-pass filter, with one set of
+     * GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS coefficients for each fractional
+     * position between input frames (including both ends of that range).
+     */
+    float filter[GUAC_RDP_AUDIO_BUFFER_RESAMPLER_PHASES + 1][GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS];
+
+    /**
+     * The most recent GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS input frames,
+     * oldest first, with each sample converted to a floating point value
+     * between -1 and 1.
+     */
+    float history[GUAC_RDP_AUDIO_BUFFER_MAX_CHANNELS][GUAC_RDP_AUDIO_BUFFER_RESAMPLER_TAPS];
+
+    /**
+     * The number of input frames that elapse for each output frame.
      */
-    int total_bytes_received;
+    double resample_step;
 
     /**
-     * The total number of bytes having ever been sent to the RDP server for
-     * the current audio stream.
+     * The position of the next output frame, in units of input frames,
+     * relative to the input frame at the center of the resampler's history.
+     * Output frames are produced while this position is less than 1.
      */
-    int total_bytes_sent;
+    double resample_position;
 
     /**
      * All audio data being prepared for sending to the AUDIO_INPUT channel.
@@ -472,12 +472,8 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
         return CHANNEL_RC_OK;
     }
 
-    int output_buf_size = clipboard->clipboard->available;
-    char* received_data = guac_mem_alloc(output_buf_size);
-
     guac_iconv_read* remote_reader;
     const char* input = (char*) format_data_response->requestedFormatData;
-    char* output = received_data;
 
     /* Find correct source encoding */
     switch (clipboard->requested_format) {
@@ -501,7 +497,6 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
         default:
             guac_client_log(client, GUAC_LOG_DEBUG, "Requested clipboard data "
                     "in unsupported format (0x%X).", clipboard->requested_format);
-            guac_mem_free(received_data);
             return CHANNEL_RC_OK;
 
     }
@@ -513,17 +508,40 @@ static UINT guac_rdp_cliprdr_format_data_response(CliprdrClientContext* cliprdr,
     data_len = format_data_response->dataLen;
     #endif
 
-    /* Convert, store, and forward the clipboard data received from RDP
-     * server */
-    if (guac_iconv(remote_reader, &input, data_len,
-            GUAC_WRITE_UTF8, &output, output_buf_size)) {
-        int length = strnlen(received_data, output_buf_size);
-        guac_common_clipboard_reset(clipboard->clipboard, "text/plain");
-        guac_common_clipboard_append(clipboard->clipboard, received_data, length);
-        guac_common_clipboard_send(clipboard->clipboard, client);
+    /* Convert and store the clipboard data received from RDP server in
+     * chunks, such that the converted data need not be buffered anywhere
+     * other than the clipboard itself */
+    guac_common_clipboard_reset(clipboard->clipboard, "text/plain");
+
+    const char* input_end = input + data_len;
+    int complete = 0;
+    while (!complete && input < input_end) {
+
+        char chunk[GUAC_COMMON_CLIPBOARD_BLOCK_SIZE];
+        char* output = chunk;
+
+        complete = guac_iconv_chunk(remote_reader, &input, input_end - input,
+                GUAC_WRITE_UTF8, &output, sizeof(chunk));
+
+        /* Omit null terminator from stored data */
+        int length = output - chunk;
+        if (complete)
+            length--;
+
+        /* Stop once the clipboard is full */
+        if (guac_common_clipboard_append(clipboard->clipboard, chunk,
+                    length) < length) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Clipboard data "
+                    "received from the RDP server has been truncated, as it "
+                    "exceeds the size of the clipboard (%i bytes).",
+                    clipboard->clipboard->available);
+            break;
+        }
+
     }
 
-    guac_mem_free(received_data);
+    /* Forward the received clipboard data to all users */
+    guac_common_clipboard_send(clipboard->clipboard, client);
 
     return CHANNEL_RC_OK;
 
@@ -44,6 +44,8 @@ guac_rdp_disp* guac_rdp_disp_alloc(guac_client* client) {
 
     /* No requests have been made */
     disp->last_request = guac_timestamp_current();
+    disp->last_change = 0;
+    disp->first_change = 0;
     disp->requested_width  = 0;
     disp->requested_height = 0;
     disp->reconnect_needed = 0;
@@ -177,6 +179,16 @@ void guac_rdp_disp_set_size(guac_rdp_disp* disp, guac_rdp_settings* settings,
     if (width % 2 == 1)
         width -= 1;
 
+    /* Note when the requested size changes, such that the update can be
+     * deferred until the size stops changing */
+    if (width != disp->requested_width || height != disp->requested_height) {
+
+        disp->last_change = guac_timestamp_current();
+        if (disp->first_change == 0)
+            disp->first_change = disp->last_change;
+
+    }
+
     /* Store deferred size */
     disp->requested_width = width;
     disp->requested_height = height;
@@ -202,6 +214,16 @@ void guac_rdp_disp_update_size(guac_rdp_disp* disp,
     if (now - disp->last_request <= GUAC_RDP_DISP_UPDATE_INTERVAL)
         return;
 
+    /* Wait for the requested size to stop changing, unless it has already
+     * been changing for too long */
+    if (now - disp->last_change < GUAC_RDP_DISP_SETTLE_INTERVAL
+            && now - disp->first_change < GUAC_RDP_DISP_MAX_SETTLE_DELAY)
+        return;
+
+    /* The requested size has now settled, whether or not it differs from
+     * the current size */
+    disp->first_change = 0;
+
     /* Do NOT send requests unless the size will change */
     if (rdp_inst != NULL
             && width == guac_rdp_get_width(rdp_inst)
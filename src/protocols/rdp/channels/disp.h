@@ -43,6 +43,24 @@
  */
 #define GUAC_RDP_DISP_UPDATE_INTERVAL 500
 
+/**
+ * The amount of time that the requested display size must remain unchanged
+ * before that size is sent to the RDP server, in milliseconds. While a browser
+ * window is being resized interactively, the requested size changes far more
+ * often than this, and sending each intermediate size would only cause the
+ * RDP server to repeatedly resize and repaint its entire desktop.
+ */
+#define GUAC_RDP_DISP_SETTLE_INTERVAL 250
+
+/**
+ * The maximum amount of time that a change in requested display size may be
+ * delayed while waiting for the requested size to stop changing, in
+ * milliseconds. If the requested size changes continuously for this long (as
+ * during a lengthy resize of the browser window), the current requested size
+ * is sent regardless, such that the remote desktop still follows the window.
+ */
+#define GUAC_RDP_DISP_MAX_SETTLE_DELAY 2000
+
 /**
  * Display size update module.
  */
@@ -64,6 +82,18 @@ typedef struct guac_rdp_disp {
      */
     guac_timestamp last_request;
 
+    /**
+     * The timestamp of the most recent change in requested screen size.
+     */
+    guac_timestamp last_change;
+
+    /**
+     * The timestamp of the first change in requested screen size since a
+     * display update request was last sent, or 0 if no such change has been
+     * made.
+     */
+    guac_timestamp first_change;
+
     /**
      * The last requested screen width, in pixels.
      */
@@ -126,9 +156,10 @@ void guac_rdp_disp_free(guac_rdp_disp* disp);
 void guac_rdp_disp_load_plugin(rdpContext* context);
 
 /**
- * Requests a display size update, which may then be sent immediately to the
- * RDP server. If an update was recently sent, this update may be delayed until
- * the RDP server has had time to settle. The width/height values provided may
+ * Requests a display size update, which will be sent to the RDP server once
+ * the requested size has stopped changing. If an update was recently sent,
+ * this update may be further delayed until the RDP server has had time to
+ * settle. The width/height values provided may
  * be automatically altered to comply with the restrictions imposed by the
  * display update channel.
  *
@@ -160,8 +191,9 @@ void guac_rdp_disp_set_size(guac_rdp_disp* disp, guac_rdp_settings* settings,
 
 /**
  * Sends an actual display update request to the RDP server based on previous
- * calls to guac_rdp_disp_set_size(). If an update was recently sent, the
- * update may be delayed until a future call to this function. If the RDP
+ * calls to guac_rdp_disp_set_size(). If the requested size is still
+ * changing, or if an update was recently sent, the update may be delayed
+ * until a future call to this function. If the RDP
  * session has not yet been established, the request will be delayed until the
  * session exists.
  *
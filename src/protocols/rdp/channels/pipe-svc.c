@@ -30,7 +30,9 @@
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 #include <winpr/stream.h>
+#include <winpr/synch.h>
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -148,21 +150,127 @@ int guac_rdp_pipe_svc_pipe_handler(guac_user* user, guac_stream* stream,
 
     /* Init stream data */
     stream->data = pipe_svc;
-    stream->blob_handler = guac_rdp_pipe_svc_blob_handler;
+    stream->base64_blob_handler = guac_rdp_pipe_svc_blob_handler;
 
     return 0;
 
 }
 
+/**
+ * Writes any data received from the Guacamole client and aggregated within the
+ * given pipe SVC to the underlying SVC. The lock of the pipe SVC must already
+ * be held.
+ *
+ * @param pipe_svc
+ *     The pipe SVC whose aggregated inbound data should be written.
+ */
+static void guac_rdp_pipe_svc_write_inbound(guac_rdp_pipe_svc* pipe_svc) {
+
+    if (pipe_svc->inbound == NULL)
+        return;
+
+    /* The stream is freed automatically once the write completes */
+    guac_rdp_common_svc_write(pipe_svc->svc, pipe_svc->inbound);
+    pipe_svc->inbound = NULL;
+
+}
+
+/**
+ * Sends any data received from within the RDP session and aggregated within
+ * the given pipe SVC along its output pipe as a single blob. The socket is not
+ * flushed. The lock of the pipe SVC must already be held.
+ *
+ * @param pipe_svc
+ *     The pipe SVC whose aggregated outbound data should be sent.
+ *
+ * @return
+ *     Non-zero if a blob was sent, zero if there was no data to send.
+ */
+static int guac_rdp_pipe_svc_send_outbound(guac_rdp_pipe_svc* pipe_svc) {
+
+    if (pipe_svc->outbound_length == 0)
+        return 0;
+
+    guac_protocol_send_blob(pipe_svc->svc->client->socket,
+            pipe_svc->output_pipe, pipe_svc->outbound,
+            pipe_svc->outbound_length);
+
+    pipe_svc->outbound_length = 0;
+    return 1;
+
+}
+
+void guac_rdp_pipe_svc_flush(guac_client* client) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    int sent = 0;
+
+    /* Send or write all aggregated data of each available SVC */
+    guac_common_list_lock(rdp_client->available_svc);
+    guac_common_list_element* current = rdp_client->available_svc->head;
+    while (current != NULL) {
+
+        guac_rdp_pipe_svc* pipe_svc = (guac_rdp_pipe_svc*) current->data;
+        if (pipe_svc->aggregate) {
+            pthread_mutex_lock(&(pipe_svc->lock));
+            guac_rdp_pipe_svc_write_inbound(pipe_svc);
+            sent |= guac_rdp_pipe_svc_send_outbound(pipe_svc);
+            pthread_mutex_unlock(&(pipe_svc->lock));
+        }
+
+        current = current->next;
+
+    }
+    guac_common_list_unlock(rdp_client->available_svc);
+
+    /* Flush once for all blobs sent */
+    if (sent)
+        guac_socket_flush(client->socket);
+
+}
+
 int guac_rdp_pipe_svc_blob_handler(guac_user* user, guac_stream* stream,
-        void* data, int length) {
+        const char* base64, int length) {
 
     guac_rdp_pipe_svc* pipe_svc = (guac_rdp_pipe_svc*) stream->data;
 
-    /* Write blob data to SVC directly */
-    wStream* output_stream = Stream_New(NULL, length);
-    Stream_Write(output_stream, data, length);
-    guac_rdp_common_svc_write(pipe_svc->svc, output_stream);
+    /* Decode blob data directly into the stream written to the SVC */
+    if (!pipe_svc->aggregate) {
+        wStream* output_stream = Stream_New(NULL, length);
+        length = guac_protocol_decode_base64_buffer(base64,
+                Stream_Pointer(output_stream), length);
+        Stream_Seek(output_stream, length);
+        guac_rdp_common_svc_write(pipe_svc->svc, output_stream);
+    }
+
+    /* Otherwise, append decoded data to the data awaiting a write, writing
+     * that data first if the decoded blob may not fit */
+    else {
+
+        guac_rdp_client* rdp_client = (guac_rdp_client*) user->client->data;
+
+        pthread_mutex_lock(&(pipe_svc->lock));
+
+        if (pipe_svc->inbound != NULL
+                && Stream_GetRemainingCapacity(pipe_svc->inbound) < (size_t) length)
+            guac_rdp_pipe_svc_write_inbound(pipe_svc);
+
+        if (pipe_svc->inbound == NULL)
+            pipe_svc->inbound = Stream_New(NULL,
+                    length > GUAC_RDP_PIPE_SVC_MAX_WRITE_LENGTH
+                    ? length : GUAC_RDP_PIPE_SVC_MAX_WRITE_LENGTH);
+
+        length = guac_protocol_decode_base64_buffer(base64,
+                Stream_Pointer(pipe_svc->inbound),
+                Stream_GetRemainingCapacity(pipe_svc->inbound));
+        Stream_Seek(pipe_svc->inbound, length);
+
+        pthread_mutex_unlock(&(pipe_svc->lock));
+
+        /* Remaining data will be written by the RDP client thread */
+        SetEvent(rdp_client->svc_data_queued);
+
+    }
 
     guac_protocol_send_ack(user->socket, stream, "OK (DATA RECEIVED)",
             GUAC_PROTOCOL_STATUS_SUCCESS);
@@ -174,9 +282,12 @@ int guac_rdp_pipe_svc_blob_handler(guac_user* user, guac_stream* stream,
 void guac_rdp_pipe_svc_process_connect(guac_rdp_common_svc* svc) {
 
     /* Associate SVC with new Guacamole pipe */
-    guac_rdp_pipe_svc* pipe_svc = guac_mem_alloc(sizeof(guac_rdp_pipe_svc));
+    guac_rdp_client* rdp_client = (guac_rdp_client*) svc->client->data;
+    guac_rdp_pipe_svc* pipe_svc = guac_mem_zalloc(sizeof(guac_rdp_pipe_svc));
     pipe_svc->svc = svc;
     pipe_svc->output_pipe = guac_client_alloc_stream(svc->client);
+    pipe_svc->aggregate = rdp_client->settings->svc_aggregation_enabled;
+    pthread_mutex_init(&(pipe_svc->lock), NULL);
     svc->data = pipe_svc;
 
     /* SVC may now receive data from client */
@@ -203,8 +314,39 @@ void guac_rdp_pipe_svc_process_receive(guac_rdp_common_svc* svc,
     }
 
     /* Send received data as blob */
-    guac_protocol_send_blob(svc->client->socket, pipe_svc->output_pipe, Stream_Buffer(input_stream), Stream_Length(input_stream));
-    guac_socket_flush(svc->client->socket);
+    if (!pipe_svc->aggregate) {
+        guac_protocol_send_blob(svc->client->socket, pipe_svc->output_pipe, Stream_Buffer(input_stream), Stream_Length(input_stream));
+        guac_socket_flush(svc->client->socket);
+        return;
+    }
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) svc->client->data;
+
+    const char* data = (const char*) Stream_Buffer(input_stream);
+    size_t length = Stream_Length(input_stream);
+
+    /* Otherwise, append received data to the data awaiting a blob, sending
+     * a full-sized blob each time no further data will fit */
+    pthread_mutex_lock(&(pipe_svc->lock));
+    while (length > 0) {
+
+        size_t available = sizeof(pipe_svc->outbound) - pipe_svc->outbound_length;
+        if (available > length)
+            available = length;
+
+        memcpy(pipe_svc->outbound + pipe_svc->outbound_length, data, available);
+        pipe_svc->outbound_length += available;
+        data += available;
+        length -= available;
+
+        if (pipe_svc->outbound_length == sizeof(pipe_svc->outbound))
+            guac_rdp_pipe_svc_send_outbound(pipe_svc);
+
+    }
+    pthread_mutex_unlock(&(pipe_svc->lock));
+
+    /* Remaining data will be sent and flushed by the RDP client thread */
+    SetEvent(rdp_client->svc_data_queued);
 
 }
 
@@ -214,8 +356,20 @@ void guac_rdp_pipe_svc_process_terminate(guac_rdp_common_svc* svc) {
     if (pipe_svc == NULL)
         return;
 
-    /* Remove and free SVC */
+    /* Remove SVC, such that no further aggregated data will be flushed */
     guac_rdp_pipe_svc_remove(svc->client, svc->name);
+
+    /* Send any remaining data received from within the RDP session, dropping
+     * any data that can no longer be written to the SVC */
+    pthread_mutex_lock(&(pipe_svc->lock));
+    if (guac_rdp_pipe_svc_send_outbound(pipe_svc))
+        guac_socket_flush(svc->client->socket);
+    if (pipe_svc->inbound != NULL)
+        Stream_Free(pipe_svc->inbound, TRUE);
+    pthread_mutex_unlock(&(pipe_svc->lock));
+
+    /* Free SVC */
+    pthread_mutex_destroy(&(pipe_svc->lock));
     guac_mem_free(pipe_svc);
 
 }
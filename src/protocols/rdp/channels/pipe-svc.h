@@ -25,17 +25,29 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/svc.h>
 #include <guacamole/client.h>
+#include <guacamole/protocol-constants.h>
 #include <guacamole/stream.h>
 #include <guacamole/socket.h>
 #include <guacamole/user.h>
+#include <winpr/stream.h>
 #include <winpr/wtsapi.h>
 
+#include <pthread.h>
+
 /**
  * The maximum number of bytes to allow within each channel name, including
  * null terminator.
  */
 #define GUAC_RDP_SVC_MAX_LENGTH 8
 
+/**
+ * The maximum number of bytes of data received from the Guacamole client that
+ * will be aggregated into a single write to a static virtual channel, if
+ * aggregation is enabled. Individual blobs larger than this are still written
+ * in their entirety.
+ */
+#define GUAC_RDP_PIPE_SVC_MAX_WRITE_LENGTH 65536
+
 /**
  * Structure describing a static virtual channel and a corresponding Guacamole
  * pipe stream;
@@ -56,6 +68,40 @@ typedef struct guac_rdp_pipe_svc {
      */
     guac_rdp_common_svc* svc;
 
+    /**
+     * Non-zero if data sent in either direction along this SVC should be
+     * aggregated into fewer, larger blobs and channel writes, zero if each
+     * message should be sent individually as soon as it is received.
+     */
+    int aggregate;
+
+    /**
+     * Lock which is acquired when accessing the aggregated data within
+     * outbound and inbound.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Data received from within the RDP session that has not yet been sent to
+     * the Guacamole client along output_pipe. This buffer is used only if
+     * aggregation is enabled, and is sent as a blob once full or when
+     * guac_rdp_pipe_svc_flush() is invoked.
+     */
+    char outbound[GUAC_PROTOCOL_BLOB_MAX_LENGTH];
+
+    /**
+     * The number of bytes currently stored within outbound.
+     */
+    int outbound_length;
+
+    /**
+     * Data received from the Guacamole client that has not yet been written
+     * to the SVC, or NULL if there is no such data. This stream is used only
+     * if aggregation is enabled, and is written to the SVC once it cannot
+     * contain a further blob or when guac_rdp_pipe_svc_flush() is invoked.
+     */
+    wStream* inbound;
+
 } guac_rdp_pipe_svc;
 
 /**
@@ -156,10 +202,26 @@ guac_rdp_pipe_svc* guac_rdp_pipe_svc_get(guac_client* client, const char* name);
 guac_rdp_pipe_svc* guac_rdp_pipe_svc_remove(guac_client* client, const char* name);
 
 /**
- * Handler for "blob" instructions which writes received data to the associated
- * SVC using guac_rdp_pipe_svc_write().
+ * Sends all aggregated data of all available static virtual channels, sending
+ * data received from within the RDP session along the corresponding pipe
+ * streams and writing data received from the Guacamole client to the
+ * corresponding SVCs. If any blobs are sent, the client socket is flushed.
+ * This function has no effect for SVCs that do not have aggregation enabled.
+ *
+ * @param client
+ *     The guac_client associated with the current RDP session.
+ */
+void guac_rdp_pipe_svc_flush(guac_client* client);
+
+/**
+ * Handler for "blob" instructions which decodes received data directly into
+ * a new wStream and writes that wStream to the associated SVC using
+ * guac_rdp_common_svc_write(). If aggregation is enabled for the SVC, the
+ * decoded data is instead appended to any data already awaiting a write,
+ * which is written once no further blob would fit or when
+ * guac_rdp_pipe_svc_flush() is invoked.
  */
-guac_user_blob_handler guac_rdp_pipe_svc_blob_handler;
+guac_user_base64_blob_handler guac_rdp_pipe_svc_blob_handler;
 
 /**
  * Handler for "pipe" instructions which prepares received pipe streams to
@@ -28,7 +28,9 @@
 #include <freerdp/rail.h>
 #include <freerdp/window.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/mem.h>
+#include <guacamole/rect.h>
 #include <winpr/wtypes.h>
 #include <winpr/wtsapi.h>
 
@@ -244,6 +246,180 @@ static UINT guac_rdp_rail_handshake_ex(RailClientContext* rail,
     return guac_rdp_rail_complete_handshake(rail);
 }
 
+/**
+ * Updates the last known position and size of the RAIL window described by
+ * the given window order. If the window has merely moved, the move is hinted
+ * to the display as a copy of the window's previous contents, such that the
+ * window's new position can be sent as a single copy when the RDP server
+ * redraws the window there, rather than being encoded anew.
+ *
+ * @param rdp_client
+ *     The RDP client associated with the RAIL session.
+ *
+ * @param orderInfo
+ *     The data structure that identifies the window and which of its
+ *     properties are being updated.
+ *
+ * @param windowState
+ *     The data structure that contains the updated properties of the window.
+ */
+static void guac_rdp_rail_track_window(guac_rdp_client* rdp_client,
+        RAIL_CONST WINDOW_ORDER_INFO* orderInfo,
+        RAIL_CONST WINDOW_STATE_ORDER* windowState) {
+
+    UINT32 fieldFlags = orderInfo->fieldFlags;
+    if (!(fieldFlags & (WINDOW_ORDER_FIELD_WND_OFFSET | WINDOW_ORDER_FIELD_WND_SIZE)))
+        return;
+
+    /* Locate the window, or an unused entry if the window is new */
+    guac_rdp_rail_window* window = NULL;
+    guac_rdp_rail_window* unused = NULL;
+    for (int i = 0; i < GUAC_RDP_RAIL_MAX_WINDOWS; i++) {
+
+        guac_rdp_rail_window* current = &rdp_client->rail_windows[i];
+        if (current->active && current->id == orderInfo->windowId) {
+            window = current;
+            break;
+        }
+
+        if (!current->active && unused == NULL)
+            unused = current;
+
+    }
+
+    /* Windows beyond the tracking limit are simply not tracked */
+    if (window == NULL) {
+
+        if (unused == NULL)
+            return;
+
+        window = unused;
+        window->active = 1;
+        window->id = orderInfo->windowId;
+        guac_rect_init(&window->rect, 0, 0, 0, 0);
+
+    }
+
+    guac_rect old_rect = window->rect;
+
+    /* Update the window's position and/or size, as reported */
+    int x = old_rect.left;
+    int y = old_rect.top;
+    int width = guac_rect_width(&old_rect);
+    int height = guac_rect_height(&old_rect);
+
+    if (fieldFlags & WINDOW_ORDER_FIELD_WND_OFFSET) {
+        x = windowState->windowOffsetX;
+        y = windowState->windowOffsetY;
+    }
+
+    if (fieldFlags & WINDOW_ORDER_FIELD_WND_SIZE) {
+        width = windowState->windowWidth;
+        height = windowState->windowHeight;
+    }
+
+    guac_rect_init(&window->rect, x, y, width, height);
+
+    /* Only a move of a window having known contents can be hinted */
+    int dx = x - old_rect.left;
+    int dy = y - old_rect.top;
+    if (guac_rect_is_empty(&old_rect) || (dx == 0 && dy == 0)
+            || width != guac_rect_width(&old_rect)
+            || height != guac_rect_height(&old_rect))
+        return;
+
+    guac_display_layer* default_layer = guac_display_default_layer(rdp_client->display);
+
+    guac_rect bounds;
+    guac_display_layer_get_bounds(default_layer, &bounds);
+
+    /* Limit the hinted copy to the portion of the window that is within the
+     * bounds of the display both before and after the move */
+    guac_rect dest = window->rect;
+    guac_rect_constrain(&dest, &bounds);
+
+    guac_rect src = old_rect;
+    guac_rect_constrain(&src, &bounds);
+    guac_rect_init(&src, src.left + dx, src.top + dy,
+            guac_rect_width(&src), guac_rect_height(&src));
+    guac_rect_constrain(&dest, &src);
+
+    guac_rect_init(&src, dest.left - dx, dest.top - dy,
+            guac_rect_width(&dest), guac_rect_height(&dest));
+
+    guac_display_layer_hint_copy(default_layer, &src, dest.left, dest.top);
+
+}
+
+/**
+ * A callback function that is executed when a new RAIL window is created by
+ * the RDP server.
+ *
+ * @param context
+ *     A pointer to the rdpContext structure used by FreeRDP to handle the
+ *     window creation.
+ *
+ * @param orderInfo
+ *     A pointer to the data structure that contains information about what
+ *     window was created.
+ *
+ * @param windowState
+ *     A pointer to the data structure that contains the initial properties of
+ *     the window, as indicated by flags in the orderInfo field.
+ *
+ * @return
+ *     TRUE if the client-side processing of the creation was successful;
+ *     otherwise FALSE. This implementation always returns TRUE.
+ */
+static BOOL guac_rdp_rail_window_create(rdpContext* context,
+        RAIL_CONST WINDOW_ORDER_INFO* orderInfo,
+        RAIL_CONST WINDOW_STATE_ORDER* windowState) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_client_log(client, GUAC_LOG_TRACE, "RAIL window create callback: %d", orderInfo->fieldFlags);
+
+    guac_rdp_rail_track_window(rdp_client, orderInfo, windowState);
+    return TRUE;
+
+}
+
+/**
+ * A callback function that is executed when a RAIL window is deleted by the
+ * RDP server.
+ *
+ * @param context
+ *     A pointer to the rdpContext structure used by FreeRDP to handle the
+ *     window deletion.
+ *
+ * @param orderInfo
+ *     A pointer to the data structure that contains information about what
+ *     window was deleted.
+ *
+ * @return
+ *     TRUE if the client-side processing of the deletion was successful;
+ *     otherwise FALSE. This implementation always returns TRUE.
+ */
+static BOOL guac_rdp_rail_window_delete(rdpContext* context,
+        RAIL_CONST WINDOW_ORDER_INFO* orderInfo) {
+
+    guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_client_log(client, GUAC_LOG_TRACE, "RAIL window delete callback.");
+
+    /* Stop tracking the window */
+    for (int i = 0; i < GUAC_RDP_RAIL_MAX_WINDOWS; i++) {
+        guac_rdp_rail_window* window = &rdp_client->rail_windows[i];
+        if (window->active && window->id == orderInfo->windowId)
+            window->active = 0;
+    }
+
+    return TRUE;
+
+}
+
 /**
  * A callback function that is executed when an update for a RAIL window is
  * received from the RDP server.
@@ -275,6 +451,9 @@ static BOOL guac_rdp_rail_window_update(rdpContext* context,
 
     UINT32 fieldFlags = orderInfo->fieldFlags;
 
+    /* Note any change in window position */
+    guac_rdp_rail_track_window(rdp_client, orderInfo, windowState);
+
     /* If the flag for window visibilty is set, check visibility. */
     if (fieldFlags & WINDOW_ORDER_FIELD_SHOW) {
         guac_client_log(client, GUAC_LOG_TRACE, "RAIL window visibility change: %d", windowState->showState);
@@ -335,7 +514,12 @@ static void guac_rdp_rail_channel_connected(rdpContext* context,
     rail->ServerExecuteResult = guac_rdp_rail_execute_result;
     rail->ServerHandshake = guac_rdp_rail_handshake;
     rail->ServerHandshakeEx = guac_rdp_rail_handshake_ex;
+    context->update->window->WindowCreate = guac_rdp_rail_window_create;
     context->update->window->WindowUpdate = guac_rdp_rail_window_update;
+    context->update->window->WindowDelete = guac_rdp_rail_window_delete;
+
+    /* No windows exist until created by the new session */
+    memset(rdp_client->rail_windows, 0, sizeof(rdp_client->rail_windows));
 
     guac_client_log(client, GUAC_LOG_DEBUG, "RAIL (RemoteApp) channel "
             "connected.");
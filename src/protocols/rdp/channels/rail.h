@@ -24,6 +24,8 @@
 
 #include <freerdp/freerdp.h>
 #include <freerdp/window.h>
+#include <guacamole/rect.h>
+#include <winpr/wtypes.h>
 
 #ifdef FREERDP_RAIL_CALLBACKS_REQUIRE_CONST
 /**
@@ -49,6 +51,38 @@
  */
 #define GUAC_RDP_RAIL_WINDOW_STATE_MINIMIZED 0x02
 
+/**
+ * The maximum number of RAIL windows whose position is tracked at any one
+ * time. Windows beyond this limit are still displayed, but moving them will
+ * not be hinted to the display as a copy.
+ */
+#define GUAC_RDP_RAIL_MAX_WINDOWS 64
+
+/**
+ * The last known position and size of a single RAIL window, as reported by
+ * the RDP server.
+ */
+typedef struct guac_rdp_rail_window {
+
+    /**
+     * Whether this entry currently tracks a window. If zero, all other
+     * members of this structure are undefined.
+     */
+    int active;
+
+    /**
+     * The ID assigned to the window by the RDP server.
+     */
+    UINT32 id;
+
+    /**
+     * The region of the remote desktop covered by the window, including any
+     * window decorations.
+     */
+    guac_rect rect;
+
+} guac_rdp_rail_window;
+
 /**
  * Initializes RemoteApp support for RDP and handling of the RAIL channel. If
  * failures occur, messages noting the specifics of those failures will be
@@ -0,0 +1,400 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "channels/common-svc.h"
+#include "channels/rdpdr/rdpdr-fs-io.h"
+#include "channels/rdpdr/rdpdr.h"
+#include "fs.h"
+#include "rdp.h"
+
+#include <guacamole/client.h>
+#include <guacamole/mem.h>
+#include <winpr/nt.h>
+#include <winpr/stream.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of nanoseconds in one second.
+ */
+#define NANOS_PER_SECOND 1000000000L
+
+/**
+ * Performs the given read or write, returning the I/O completion that should
+ * be sent in response. Any data to be written by the request is freed.
+ *
+ * @param request
+ *     The request to perform.
+ *
+ * @return
+ *     A new wStream containing the I/O completion for the given request.
+ */
+static wStream* guac_rdpdr_fs_io_perform(guac_rdpdr_fs_io_request* request) {
+
+    guac_rdpdr_device* device = request->device;
+    guac_rdp_fs* fs = (guac_rdp_fs*) device->data;
+    wStream* output_stream;
+
+    /* Read data, replying with the data read */
+    if (request->type == GUAC_RDPDR_FS_IO_READ) {
+
+        char* buffer = guac_mem_alloc(request->length);
+        int bytes_read = guac_rdp_fs_read(fs, request->file_id,
+                request->offset, buffer, request->length);
+
+        /* If error, return invalid parameter */
+        if (bytes_read < 0) {
+            output_stream = guac_rdpdr_new_io_completion(device,
+                    request->completion_id, guac_rdp_fs_get_status(bytes_read), 4);
+            Stream_Write_UINT32(output_stream, 0); /* Length */
+        }
+
+        /* Otherwise, send bytes read */
+        else {
+            output_stream = guac_rdpdr_new_io_completion(device,
+                    request->completion_id, STATUS_SUCCESS, 4+bytes_read);
+            Stream_Write_UINT32(output_stream, bytes_read);  /* Length */
+            Stream_Write(output_stream, buffer, bytes_read); /* ReadData */
+        }
+
+        guac_mem_free(buffer);
+
+    }
+
+    /* Write data, replying with the number of bytes written */
+    else {
+
+        int bytes_written = guac_rdp_fs_write(fs, request->file_id,
+                request->offset, request->data, request->length);
+
+        /* If error, return invalid parameter */
+        if (bytes_written < 0) {
+            output_stream = guac_rdpdr_new_io_completion(device,
+                    request->completion_id, guac_rdp_fs_get_status(bytes_written), 5);
+            Stream_Write_UINT32(output_stream, 0); /* Length */
+            Stream_Write_UINT8(output_stream, 0);  /* Padding */
+        }
+
+        /* Otherwise, send success */
+        else {
+            output_stream = guac_rdpdr_new_io_completion(device,
+                    request->completion_id, STATUS_SUCCESS, 5);
+            Stream_Write_UINT32(output_stream, bytes_written); /* Length */
+            Stream_Write_UINT8(output_stream, 0);              /* Padding */
+        }
+
+        guac_mem_free(request->data);
+
+    }
+
+    return output_stream;
+
+}
+
+/**
+ * Sends the I/O completions of all requests that have been performed but not
+ * yet completed, freeing those requests. The lock of the given I/O pool must
+ * be held, and the message_lock of the guac_rdp_client must either be held or
+ * be available without blocking, as the I/O completions are written to the
+ * RDPDR channel directly.
+ *
+ * @param io
+ *     The I/O pool whose completed requests should be sent.
+ */
+static void guac_rdpdr_fs_io_send_completed(guac_rdpdr_fs_io* io) {
+
+    guac_rdpdr_fs_io_request* request = io->completed;
+    io->completed = NULL;
+
+    while (request != NULL) {
+        guac_rdpdr_fs_io_request* next = request->next;
+        guac_rdp_common_svc_write(io->svc, request->output_stream);
+        guac_mem_free(request);
+        request = next;
+    }
+
+}
+
+/**
+ * Waits up to GUAC_RDPDR_FS_IO_SEND_INTERVAL milliseconds for the given I/O
+ * pool to be modified. The lock of the given I/O pool must be held.
+ *
+ * @param io
+ *     The I/O pool to wait for.
+ */
+static void guac_rdpdr_fs_io_timedwait(guac_rdpdr_fs_io* io) {
+
+    struct timespec ts_timeout;
+    clock_gettime(CLOCK_MONOTONIC, &ts_timeout);
+
+    uint64_t nsec_timeout = GUAC_RDPDR_FS_IO_SEND_INTERVAL * 1000000L
+        + ts_timeout.tv_nsec;
+    ts_timeout.tv_sec += nsec_timeout / NANOS_PER_SECOND;
+    ts_timeout.tv_nsec = nsec_timeout % NANOS_PER_SECOND;
+
+    pthread_cond_timedwait(&io->modified, &io->lock, &ts_timeout);
+
+}
+
+/**
+ * Performs queued requests of the given I/O pool until the pool is freed.
+ * Each I/O completion is sent by the thread that performed the request,
+ * unless the RDP client thread currently holds the message_lock, in which
+ * case sending is retried until either this thread or the thread handling
+ * inbound RDPDR messages succeeds. The message_lock is never waited for
+ * directly, as the RDPDR channel may be closed (and this pool freed) by a
+ * thread holding that lock.
+ *
+ * @param data
+ *     A pointer to the guac_rdpdr_fs_io whose requests should be performed.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdpdr_fs_io_thread(void* data) {
+
+    guac_rdpdr_fs_io* io = (guac_rdpdr_fs_io*) data;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) io->svc->client->data;
+
+    pthread_mutex_lock(&io->lock);
+
+    while (!io->stopping) {
+
+        /* Wait for requests */
+        guac_rdpdr_fs_io_request* request = io->queued_head;
+        if (request == NULL) {
+            pthread_cond_wait(&io->modified, &io->lock);
+            continue;
+        }
+
+        io->queued_head = request->next;
+        if (io->queued_head == NULL)
+            io->queued_tail = NULL;
+
+        /* Perform request without blocking other threads */
+        pthread_mutex_unlock(&io->lock);
+        request->output_stream = guac_rdpdr_fs_io_perform(request);
+        pthread_mutex_lock(&io->lock);
+
+        request->next = io->completed;
+        io->completed = request;
+
+        io->pending--;
+        pthread_cond_broadcast(&io->modified);
+
+        /* Send completion as soon as the RDP client thread allows */
+        while (io->completed != NULL && !io->stopping) {
+
+            if (!pthread_mutex_trylock(&(rdp_client->message_lock))) {
+                guac_rdpdr_fs_io_send_completed(io);
+                pthread_mutex_unlock(&(rdp_client->message_lock));
+                break;
+            }
+
+            guac_rdpdr_fs_io_timedwait(io);
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+
+}
+
+guac_rdpdr_fs_io* guac_rdpdr_fs_io_alloc(guac_rdp_common_svc* svc) {
+
+    guac_rdpdr_fs_io* io = guac_mem_zalloc(sizeof(guac_rdpdr_fs_io));
+    io->svc = svc;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->modified, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    /* Start as many threads as possible, falling back to performing each
+     * request synchronously if no threads can be started */
+    for (int i = 0; i < GUAC_RDPDR_FS_IO_THREADS; i++) {
+
+        if (pthread_create(&io->threads[io->thread_count], NULL,
+                    guac_rdpdr_fs_io_thread, io)) {
+            guac_client_log(svc->client, GUAC_LOG_WARNING, "Unable to start "
+                    "all threads for drive I/O. Only %i of %i threads will "
+                    "be used.", io->thread_count, GUAC_RDPDR_FS_IO_THREADS);
+            break;
+        }
+
+        io->thread_count++;
+
+    }
+
+    return io;
+
+}
+
+void guac_rdpdr_fs_io_free(guac_rdpdr_fs_io* io) {
+
+    /* Nothing to free if there is no pool */
+    if (io == NULL)
+        return;
+
+    pthread_mutex_lock(&io->lock);
+    io->stopping = 1;
+    pthread_cond_broadcast(&io->modified);
+    pthread_mutex_unlock(&io->lock);
+
+    for (int i = 0; i < io->thread_count; i++)
+        pthread_join(io->threads[i], NULL);
+
+    /* Discard all requests that were never performed */
+    guac_rdpdr_fs_io_request* request = io->queued_head;
+    while (request != NULL) {
+        guac_rdpdr_fs_io_request* next = request->next;
+        guac_mem_free(request->data);
+        guac_mem_free(request);
+        request = next;
+    }
+
+    /* Discard all completions that were never sent */
+    request = io->completed;
+    while (request != NULL) {
+        guac_rdpdr_fs_io_request* next = request->next;
+        Stream_Free(request->output_stream, TRUE);
+        guac_mem_free(request);
+        request = next;
+    }
+
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->modified);
+    guac_mem_free(io);
+
+}
+
+/**
+ * Performs the given request using the I/O pool of the given RDPDR channel,
+ * taking ownership of the request. If there is no such pool, or the pool has
+ * no threads, the request is performed and completed immediately. This
+ * function must only be invoked by the thread handling inbound RDPDR
+ * messages.
+ *
+ * @param svc
+ *     The guac_rdp_common_svc representing the static virtual channel being
+ *     used for RDPDR.
+ *
+ * @param request
+ *     The request to perform.
+ */
+static void guac_rdpdr_fs_io_submit(guac_rdp_common_svc* svc,
+        guac_rdpdr_fs_io_request* request) {
+
+    guac_rdpdr* rdpdr = (guac_rdpdr*) svc->data;
+    guac_rdpdr_fs_io* io = rdpdr->fs_io;
+
+    /* Perform request immediately if there are no threads to perform it */
+    if (io == NULL || io->thread_count == 0) {
+        guac_rdp_common_svc_write(svc, guac_rdpdr_fs_io_perform(request));
+        guac_mem_free(request);
+        return;
+    }
+
+    pthread_mutex_lock(&io->lock);
+
+    /* Limit the number of outstanding requests, sending any completions
+     * while waiting (the thread handling inbound RDPDR messages already holds
+     * the message_lock, and so the threads of the pool cannot) */
+    guac_rdpdr_fs_io_send_completed(io);
+    while (io->pending >= GUAC_RDPDR_FS_IO_MAX_PENDING) {
+        pthread_cond_wait(&io->modified, &io->lock);
+        guac_rdpdr_fs_io_send_completed(io);
+    }
+
+    if (io->queued_tail != NULL)
+        io->queued_tail->next = request;
+    else
+        io->queued_head = request;
+
+    io->queued_tail = request;
+    io->pending++;
+
+    pthread_cond_broadcast(&io->modified);
+    pthread_mutex_unlock(&io->lock);
+
+}
+
+void guac_rdpdr_fs_io_read(guac_rdp_common_svc* svc,
+        guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
+        uint64_t offset, int length) {
+
+    guac_rdpdr_fs_io_request* request = guac_mem_zalloc(sizeof(guac_rdpdr_fs_io_request));
+    request->type = GUAC_RDPDR_FS_IO_READ;
+    request->device = device;
+    request->file_id = iorequest->file_id;
+    request->completion_id = iorequest->completion_id;
+    request->offset = offset;
+    request->length = length;
+
+    guac_rdpdr_fs_io_submit(svc, request);
+
+}
+
+void guac_rdpdr_fs_io_write(guac_rdp_common_svc* svc,
+        guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
+        uint64_t offset, const void* data, int length) {
+
+    guac_rdpdr_fs_io_request* request = guac_mem_zalloc(sizeof(guac_rdpdr_fs_io_request));
+    request->type = GUAC_RDPDR_FS_IO_WRITE;
+    request->device = device;
+    request->file_id = iorequest->file_id;
+    request->completion_id = iorequest->completion_id;
+    request->offset = offset;
+    request->length = length;
+
+    request->data = guac_mem_alloc(length);
+    memcpy(request->data, data, length);
+
+    guac_rdpdr_fs_io_submit(svc, request);
+
+}
+
+void guac_rdpdr_fs_io_wait(guac_rdp_common_svc* svc) {
+
+    guac_rdpdr* rdpdr = (guac_rdpdr*) svc->data;
+    guac_rdpdr_fs_io* io = rdpdr->fs_io;
+
+    /* Requests are performed synchronously if there is no pool */
+    if (io == NULL)
+        return;
+
+    pthread_mutex_lock(&io->lock);
+
+    guac_rdpdr_fs_io_send_completed(io);
+    while (io->pending > 0) {
+        pthread_cond_wait(&io->modified, &io->lock);
+        guac_rdpdr_fs_io_send_completed(io);
+    }
+
+    pthread_mutex_unlock(&io->lock);
+
+}
@@ -0,0 +1,296 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_RDP_CHANNELS_RDPDR_FS_IO_H
+#define GUAC_RDP_CHANNELS_RDPDR_FS_IO_H
+
+/**
+ * Asynchronous handling of the read and write requests received for the
+ * filesystem redirected over RDPDR. Reads and writes are performed by a small
+ * pool of threads, such that several outstanding requests may proceed in
+ * parallel without blocking the thread handling inbound RDP messages, with
+ * each I/O completion sent as soon as its request has been performed. RDPDR
+ * does not require I/O completions to be sent in the order that the
+ * corresponding requests were received.
+ *
+ * @file rdpdr-fs-io.h
+ */
+
+#include "channels/common-svc.h"
+#include "channels/rdpdr/rdpdr.h"
+
+#include <winpr/stream.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The number of threads which perform reads and writes on behalf of the
+ * filesystem redirected over RDPDR.
+ */
+#define GUAC_RDPDR_FS_IO_THREADS 4
+
+/**
+ * The maximum number of reads and writes that may be outstanding at any one
+ * time. Once this many requests are outstanding, handling of further requests
+ * blocks until an outstanding request has been performed. As each outstanding
+ * read may require up to GUAC_RDP_MAX_READ_BUFFER bytes, this also bounds the
+ * memory used by outstanding requests.
+ */
+#define GUAC_RDPDR_FS_IO_MAX_PENDING 8
+
+/**
+ * The number of milliseconds to wait before retrying to send I/O completions
+ * if the RDP client thread was busy when those completions became ready.
+ */
+#define GUAC_RDPDR_FS_IO_SEND_INTERVAL 5
+
+/**
+ * The type of operation requested by a guac_rdpdr_fs_io_request.
+ */
+typedef enum guac_rdpdr_fs_io_request_type {
+
+    /**
+     * Read data from a file, replying with the data read.
+     */
+    GUAC_RDPDR_FS_IO_READ,
+
+    /**
+     * Write data to a file, replying with the number of bytes written.
+     */
+    GUAC_RDPDR_FS_IO_WRITE
+
+} guac_rdpdr_fs_io_request_type;
+
+/**
+ * A single read or write requested by the RDP server, along with the I/O
+ * completion that should be sent once that request has been performed.
+ */
+typedef struct guac_rdpdr_fs_io_request {
+
+    /**
+     * The type of operation requested.
+     */
+    guac_rdpdr_fs_io_request_type type;
+
+    /**
+     * The filesystem device receiving the request.
+     */
+    guac_rdpdr_device* device;
+
+    /**
+     * The ID of the file being read or written.
+     */
+    int file_id;
+
+    /**
+     * The completion ID of the I/O request, which must be included in the
+     * corresponding I/O completion.
+     */
+    int completion_id;
+
+    /**
+     * The offset within the file at which the read or write should begin.
+     */
+    uint64_t offset;
+
+    /**
+     * The number of bytes to read or write.
+     */
+    int length;
+
+    /**
+     * The data to write, if the request is a write. The request has its own
+     * copy of this data, which is freed once the write has been performed.
+     * This is NULL for reads.
+     */
+    void* data;
+
+    /**
+     * The I/O completion to send in response to this request, or NULL if the
+     * request has not yet been performed.
+     */
+    wStream* output_stream;
+
+    /**
+     * The next request in whichever list contains this request, or NULL if
+     * this is the last request in that list.
+     */
+    struct guac_rdpdr_fs_io_request* next;
+
+} guac_rdpdr_fs_io_request;
+
+struct guac_rdpdr_fs_io {
+
+    /**
+     * The guac_rdp_common_svc representing the static virtual channel being
+     * used for RDPDR.
+     */
+    guac_rdp_common_svc* svc;
+
+    /**
+     * Lock which must be acquired before accessing any other member of this
+     * structure, except svc, threads, and thread_count.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever a request is added, whenever a
+     * request has been performed, and when the I/O pool is being freed.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * The oldest request that has not yet been claimed by any thread, or NULL
+     * if no requests are waiting.
+     */
+    guac_rdpdr_fs_io_request* queued_head;
+
+    /**
+     * The newest request that has not yet been claimed by any thread, or NULL
+     * if no requests are waiting.
+     */
+    guac_rdpdr_fs_io_request* queued_tail;
+
+    /**
+     * The number of requests that have been received but not yet performed,
+     * including any requests currently being performed.
+     */
+    int pending;
+
+    /**
+     * All requests that have been performed but whose I/O completions have
+     * not yet been sent, in no particular order.
+     */
+    guac_rdpdr_fs_io_request* completed;
+
+    /**
+     * Non-zero if the I/O pool is being freed and no further requests should
+     * be performed or completed, zero otherwise.
+     */
+    int stopping;
+
+    /**
+     * The threads performing requests.
+     */
+    pthread_t threads[GUAC_RDPDR_FS_IO_THREADS];
+
+    /**
+     * The number of threads within the threads array that were successfully
+     * started. If zero, requests are performed synchronously as they are
+     * received.
+     */
+    int thread_count;
+
+};
+
+/**
+ * Allocates a new pool of threads which perform reads and writes for the
+ * filesystem redirected over the given RDPDR channel. If no threads can be
+ * started, the returned pool performs each request synchronously.
+ *
+ * @param svc
+ *     The guac_rdp_common_svc representing the static virtual channel being
+ *     used for RDPDR.
+ *
+ * @return
+ *     A newly-allocated I/O pool, which must eventually be freed with
+ *     guac_rdpdr_fs_io_free().
+ */
+guac_rdpdr_fs_io* guac_rdpdr_fs_io_alloc(guac_rdp_common_svc* svc);
+
+/**
+ * Stops all threads of the given I/O pool and frees the pool. Any requests
+ * which have not yet been completed are discarded, as the RDPDR channel is
+ * being closed.
+ *
+ * @param io
+ *     The I/O pool to free, or NULL if no pool exists.
+ */
+void guac_rdpdr_fs_io_free(guac_rdpdr_fs_io* io);
+
+/**
+ * Schedules a read on behalf of the given Device I/O Request, sending the
+ * corresponding I/O completion once the read has been performed. If the
+ * RDPDR channel has no I/O pool, the read is performed immediately.
+ *
+ * @param svc
+ *     The guac_rdp_common_svc representing the static virtual channel being
+ *     used for RDPDR.
+ *
+ * @param device
+ *     The filesystem device receiving the request.
+ *
+ * @param iorequest
+ *     The Device I/O Request requesting the read.
+ *
+ * @param offset
+ *     The offset within the file at which the read should begin.
+ *
+ * @param length
+ *     The number of bytes to read.
+ */
+void guac_rdpdr_fs_io_read(guac_rdp_common_svc* svc,
+        guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
+        uint64_t offset, int length);
+
+/**
+ * Schedules a write on behalf of the given Device I/O Request, sending the
+ * corresponding I/O completion once the write has been performed. The data
+ * to be written is copied, and need not remain valid after this function
+ * returns. If the RDPDR channel has no I/O pool, the write is performed
+ * immediately.
+ *
+ * @param svc
+ *     The guac_rdp_common_svc representing the static virtual channel being
+ *     used for RDPDR.
+ *
+ * @param device
+ *     The filesystem device receiving the request.
+ *
+ * @param iorequest
+ *     The Device I/O Request requesting the write.
+ *
+ * @param offset
+ *     The offset within the file at which the write should begin.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes to write.
+ */
+void guac_rdpdr_fs_io_write(guac_rdp_common_svc* svc,
+        guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
+        uint64_t offset, const void* data, int length);
+
+/**
+ * Waits for all outstanding reads and writes of the given RDPDR channel to be
+ * performed, sending their I/O completions. This must be invoked before
+ * handling any request that may depend on the state of a file (closing the
+ * file, querying its size, etc.), and must only be invoked by the thread
+ * handling inbound RDPDR messages.
+ *
+ * @param svc
+ *     The guac_rdp_common_svc representing the static virtual channel being
+ *     used for RDPDR.
+ */
+void guac_rdpdr_fs_io_wait(guac_rdp_common_svc* svc);
+
+#endif
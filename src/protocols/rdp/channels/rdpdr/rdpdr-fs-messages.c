@@ -18,6 +18,7 @@
  */
 
 #include "channels/common-svc.h"
+#include "channels/rdpdr/rdpdr-fs-io.h"
 #include "channels/rdpdr/rdpdr-fs-messages-dir-info.h"
 #include "channels/rdpdr/rdpdr-fs-messages-file-info.h"
 #include "channels/rdpdr/rdpdr-fs-messages-vol-info.h"
@@ -140,10 +141,6 @@ void guac_rdpdr_fs_process_read(guac_rdp_common_svc* svc,
 
     UINT32 length;
     UINT64 offset;
-    char* buffer;
-    int bytes_read;
-
-    wStream* output_stream;
 
     /* Check remaining bytes before reading stream. */
     if (Stream_GetRemainingLength(input_stream) < 12) {
@@ -165,30 +162,8 @@ void guac_rdpdr_fs_process_read(guac_rdp_common_svc* svc,
     if (length > GUAC_RDP_MAX_READ_BUFFER)
         length = GUAC_RDP_MAX_READ_BUFFER;
 
-    /* Allocate buffer */
-    buffer = guac_mem_alloc(length);
-
-    /* Attempt read */
-    bytes_read = guac_rdp_fs_read((guac_rdp_fs*) device->data,
-            iorequest->file_id, offset, buffer, length);
-
-    /* If error, return invalid parameter */
-    if (bytes_read < 0) {
-        output_stream = guac_rdpdr_new_io_completion(device,
-                iorequest->completion_id, guac_rdp_fs_get_status(bytes_read), 4);
-        Stream_Write_UINT32(output_stream, 0); /* Length */
-    }
-
-    /* Otherwise, send bytes read */
-    else {
-        output_stream = guac_rdpdr_new_io_completion(device,
-                iorequest->completion_id, STATUS_SUCCESS, 4+bytes_read);
-        Stream_Write_UINT32(output_stream, bytes_read);  /* Length */
-        Stream_Write(output_stream, buffer, bytes_read); /* ReadData */
-    }
-
-    guac_rdp_common_svc_write(svc, output_stream);
-    guac_mem_free(buffer);
+    /* Attempt read, replying once complete */
+    guac_rdpdr_fs_io_read(svc, device, iorequest, offset, length);
 
 }
 
@@ -198,9 +173,6 @@ void guac_rdpdr_fs_process_write(guac_rdp_common_svc* svc,
 
     UINT32 length;
     UINT64 offset;
-    int bytes_written;
-
-    wStream* output_stream;
 
     /* Check remaining length. */
     if (Stream_GetRemainingLength(input_stream) < 32) {
@@ -227,27 +199,9 @@ void guac_rdpdr_fs_process_write(guac_rdp_common_svc* svc,
         return;
     }
     
-    /* Attempt write */
-    bytes_written = guac_rdp_fs_write((guac_rdp_fs*) device->data,
-            iorequest->file_id, offset, Stream_Pointer(input_stream), length);
-
-    /* If error, return invalid parameter */
-    if (bytes_written < 0) {
-        output_stream = guac_rdpdr_new_io_completion(device,
-                iorequest->completion_id, guac_rdp_fs_get_status(bytes_written), 5);
-        Stream_Write_UINT32(output_stream, 0); /* Length */
-        Stream_Write_UINT8(output_stream, 0);  /* Padding */
-    }
-
-    /* Otherwise, send success */
-    else {
-        output_stream = guac_rdpdr_new_io_completion(device,
-                iorequest->completion_id, STATUS_SUCCESS, 5);
-        Stream_Write_UINT32(output_stream, bytes_written); /* Length */
-        Stream_Write_UINT8(output_stream, 0);              /* Padding */
-    }
-
-    guac_rdp_common_svc_write(svc, output_stream);
+    /* Attempt write, replying once complete */
+    guac_rdpdr_fs_io_write(svc, device, iorequest, offset,
+            Stream_Pointer(input_stream), length);
 
 }
 
@@ -524,39 +478,37 @@ void guac_rdpdr_fs_process_query_directory(guac_rdp_common_svc* svc,
         if (guac_rdp_fs_convert_path(file->absolute_path,
                     entry_name, entry_path) == 0) {
 
-            int entry_file_id;
+            guac_rdp_fs_file entry;
 
             /* Pattern defined and match fails, continue with next file */
             if (guac_rdp_fs_matches(entry_path, file->dir_pattern))
                 continue;
 
-            /* Open directory entry */
-            entry_file_id = guac_rdp_fs_open((guac_rdp_fs*) device->data,
-                    entry_path, FILE_READ_DATA, 0, FILE_OPEN, 0);
-
-            if (entry_file_id >= 0) {
+            /* Retrieve details of directory entry without opening it */
+            if (guac_rdp_fs_stat_dir_entry((guac_rdp_fs*) device->data,
+                        iorequest->file_id, entry_name, &entry) == 0) {
 
                 /* Dispatch to appropriate class-specific handler */
                 switch (fs_information_class) {
 
                     case FileDirectoryInformation:
                         guac_rdpdr_fs_process_query_directory_info(svc, device,
-                                iorequest, entry_name, entry_file_id);
+                                iorequest, entry_name, &entry);
                         break;
 
                     case FileFullDirectoryInformation:
                         guac_rdpdr_fs_process_query_full_directory_info(svc,
-                                device, iorequest, entry_name, entry_file_id);
+                                device, iorequest, entry_name, &entry);
                         break;
 
                     case FileBothDirectoryInformation:
                         guac_rdpdr_fs_process_query_both_directory_info(svc,
-                                device, iorequest, entry_name, entry_file_id);
+                                device, iorequest, entry_name, &entry);
                         break;
 
                     case FileNamesInformation:
                         guac_rdpdr_fs_process_query_names_info(svc, device,
-                                iorequest, entry_name, entry_file_id);
+                                iorequest, entry_name, &entry);
                         break;
 
                     default:
@@ -565,7 +517,6 @@ void guac_rdpdr_fs_process_query_directory(guac_rdp_common_svc* svc,
                                 fs_information_class);
                 }
 
-                guac_rdp_fs_close((guac_rdp_fs*) device->data, entry_file_id);
                 return;
 
             } /* end if file exists */
@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include "channels/rdpdr/rdpdr-fs-io.h"
 #include "channels/rdpdr/rdpdr-fs.h"
 #include "channels/rdpdr/rdpdr-fs-messages.h"
 #include "channels/rdpdr/rdpdr.h"
@@ -34,6 +35,12 @@ void guac_rdpdr_device_fs_iorequest_handler(guac_rdp_common_svc* svc,
         guac_rdpdr_device* device, guac_rdpdr_iorequest* iorequest,
         wStream* input_stream) {
 
+    /* Reads and writes are performed asynchronously, and all other requests
+     * must observe the results of any reads and writes that preceded them */
+    if (iorequest->major_func != IRP_MJ_READ
+            && iorequest->major_func != IRP_MJ_WRITE)
+        guac_rdpdr_fs_io_wait(svc);
+
     switch (iorequest->major_func) {
 
         /* File open */
@@ -111,6 +118,10 @@ void guac_rdpdr_device_fs_iorequest_handler(guac_rdp_common_svc* svc,
 void guac_rdpdr_device_fs_free_handler(guac_rdp_common_svc* svc,
         guac_rdpdr_device* device) {
 
+    guac_rdpdr* rdpdr = (guac_rdpdr*) svc->data;
+    guac_rdpdr_fs_io_free(rdpdr->fs_io);
+    rdpdr->fs_io = NULL;
+
     Stream_Free(device->device_announce, 1);
     
 }
@@ -150,5 +161,8 @@ void guac_rdpdr_register_fs(guac_rdp_common_svc* svc, char* drive_name) {
     /* Init data */
     device->data = rdp_client->filesystem;
 
+    /* Perform reads and writes in the background */
+    rdpdr->fs_io = guac_rdpdr_fs_io_alloc(svc);
+
 }
 
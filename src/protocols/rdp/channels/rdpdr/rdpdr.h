@@ -38,6 +38,12 @@
  */
 typedef struct guac_rdpdr_device guac_rdpdr_device;
 
+/**
+ * Pool of threads which perform reads and writes for the filesystem
+ * redirected over RDPDR. This structure is defined within rdpdr-fs-io.h.
+ */
+typedef struct guac_rdpdr_fs_io guac_rdpdr_fs_io;
+
 /**
  * The contents of the header common to all RDPDR Device I/O Requests. See:
  *
@@ -182,6 +188,12 @@ typedef struct guac_rdpdr {
      */
     guac_rdpdr_device devices[8];
 
+    /**
+     * The threads performing reads and writes for the redirected filesystem,
+     * or NULL if no filesystem has been registered.
+     */
+    guac_rdpdr_fs_io* fs_io;
+
 } guac_rdpdr;
 
 /**
@@ -27,10 +27,710 @@
 #include <freerdp/gdi/gfx.h>
 #include <freerdp/event.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/flag.h>
+#include <guacamole/mem.h>
+#include <guacamole/protocol.h>
+#include <guacamole/rect.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+guac_rdp_rdpgfx* guac_rdp_rdpgfx_alloc(guac_client* client) {
+
+    guac_rdp_rdpgfx* rdpgfx = guac_mem_zalloc(sizeof(guac_rdp_rdpgfx));
+    rdpgfx->client = client;
+
+    /* Not yet connected, and no H.264 video is being forwarded */
+    pthread_mutex_init(&(rdpgfx->lock), NULL);
+    guac_flag_init(&(rdpgfx->synced));
+
+    return rdpgfx;
+
+}
+
+void guac_rdp_rdpgfx_free(guac_rdp_rdpgfx* rdpgfx) {
+    guac_flag_destroy(&(rdpgfx->synced));
+    pthread_mutex_destroy(&(rdpgfx->lock));
+    guac_mem_free(rdpgfx);
+}
+
+int guac_rdp_rdpgfx_is_passthrough(guac_rdp_rdpgfx* rdpgfx,
+        const guac_rect* rect) {
+
+    pthread_mutex_lock(&(rdpgfx->lock));
+
+    int covered = rdpgfx->active && !rdpgfx->invalidated
+        && rect->left   >= rdpgfx->rect.left
+        && rect->top    >= rdpgfx->rect.top
+        && rect->right  <= rdpgfx->rect.right
+        && rect->bottom <= rdpgfx->rect.bottom;
+
+    pthread_mutex_unlock(&(rdpgfx->lock));
+
+    return covered;
+
+}
+
+void guac_rdp_rdpgfx_invalidate(guac_rdp_rdpgfx* rdpgfx) {
+    pthread_mutex_lock(&(rdpgfx->lock));
+    rdpgfx->invalidated = rdpgfx->active;
+    pthread_mutex_unlock(&(rdpgfx->lock));
+}
+
+/**
+ * Callback for guac_client_foreach_user() which clears the int pointed to by
+ * the given data if the given user has not declared support for H.264 video.
+ *
+ * @param user
+ *     The user to test.
+ *
+ * @param data
+ *     A pointer to an int which should be set to zero if the given user does
+ *     not support H.264 video.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_rdpgfx_check_user(guac_user* user, void* data) {
+
+    int* supported = (int*) data;
+
+    const char** mimetype = user->info.video_mimetypes;
+    if (mimetype != NULL) {
+        for (; *mimetype != NULL; mimetype++) {
+            if (strcmp(*mimetype, GUAC_RDP_RDPGFX_H264_MIMETYPE) == 0)
+                return NULL;
+        }
+    }
+
+    *supported = 0;
+    return NULL;
+
+}
+
+/**
+ * Ends the H.264 video stream being forwarded to connected users, if any,
+ * marking the region of the default layer that was covered by that stream as
+ * dirty such that its current contents are re-encoded and sent normally. The
+ * lock of the given guac_rdp_rdpgfx MUST be held.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module whose H.264 video stream should be ended.
+ */
+static void guac_rdp_rdpgfx_end_stream(guac_rdp_rdpgfx* rdpgfx) {
+
+    if (!rdpgfx->active)
+        return;
+
+    guac_client* client = rdpgfx->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    guac_protocol_send_end(client->socket, rdpgfx->stream);
+    guac_protocol_send_dispose(client->socket, rdpgfx->layer);
+
+    guac_client_free_stream(client, rdpgfx->stream);
+    guac_client_free_layer(client, rdpgfx->layer);
+
+    rdpgfx->stream = NULL;
+    rdpgfx->layer = NULL;
+    rdpgfx->active = 0;
+    rdpgfx->invalidated = 0;
+
+    /* The GDI surface has been kept up to date throughout, and need only be
+     * re-encoded now that the video is no longer covering it */
+    guac_display_layer* default_layer = guac_display_default_layer(rdp_client->display);
+    guac_display_layer_mark_dirty(default_layer, &rdpgfx->rect);
+
+    if (rdp_client->render_thread != NULL)
+        guac_display_render_thread_notify_modified(rdp_client->render_thread);
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "H.264 passthrough for RDPGFX "
+            "surface %u ended.", (unsigned int) rdpgfx->surface_id);
+
+}
+
+/**
+ * Returns whether modifying the given surface would affect the H.264 video
+ * stream being forwarded to connected users, either because the stream is
+ * for that surface or because the surface is drawn to the output beneath the
+ * layer playing the video. The lock of the given guac_rdp_rdpgfx MUST be
+ * held.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module whose H.264 video stream should be tested.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the surface.
+ *
+ * @param surface_id
+ *     The ID of the RDPGFX surface being modified.
+ *
+ * @return
+ *     Non-zero if modifying the given surface would affect the active H.264
+ *     video stream, zero otherwise or if no H.264 video stream is active.
+ */
+static int guac_rdp_rdpgfx_affects_stream(guac_rdp_rdpgfx* rdpgfx,
+        RdpgfxClientContext* context, uint16_t surface_id) {
+
+    if (!rdpgfx->active)
+        return 0;
+
+    if (rdpgfx->surface_id == surface_id)
+        return 1;
+
+    /* Surfaces not mapped to the output (offscreen surfaces) cannot be
+     * visible beneath the video */
+    gdiGfxSurface* surface = (gdiGfxSurface*) context->GetSurfaceData(context,
+            surface_id);
+    if (surface == NULL || !surface->outputMapped)
+        return 0;
+
+    guac_rect rect;
+    guac_rect_init(&rect, surface->outputOriginX, surface->outputOriginY,
+            surface->width, surface->height);
+
+    return guac_rect_intersects(&rect, &rdpgfx->rect);
+
+}
+
+/**
+ * Ends the H.264 video stream being forwarded to connected users if the
+ * given surface is about to be modified by something that is not part of
+ * that stream and would affect the stream.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module whose H.264 video stream should be ended.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the surface.
+ *
+ * @param surface_id
+ *     The ID of the RDPGFX surface about to be modified.
+ */
+static void guac_rdp_rdpgfx_surface_modified(guac_rdp_rdpgfx* rdpgfx,
+        RdpgfxClientContext* context, uint16_t surface_id) {
+
+    pthread_mutex_lock(&(rdpgfx->lock));
+
+    if (rdpgfx->invalidated
+            || guac_rdp_rdpgfx_affects_stream(rdpgfx, context, surface_id))
+        guac_rdp_rdpgfx_end_stream(rdpgfx);
+
+    pthread_mutex_unlock(&(rdpgfx->lock));
+
+}
+
+/**
+ * Locates the H.264 bitstream within the given AVC420 surface command,
+ * skipping the region rectangles and quantization values that precede it
+ * (the RDPGFX_AVC420_BITMAP_STREAM structure).
+ *
+ * @param cmd
+ *     The AVC420 surface command.
+ *
+ * @param length
+ *     A pointer to a size_t that should receive the length of the H.264
+ *     bitstream, in bytes.
+ *
+ * @return
+ *     A pointer to the start of the H.264 bitstream, or NULL if the command
+ *     is malformed or contains no bitstream.
+ */
+static const uint8_t* guac_rdp_rdpgfx_avc420_bitstream(
+        const RDPGFX_SURFACE_COMMAND* cmd, size_t* length) {
+
+    const uint8_t* data = cmd->data;
+    size_t remaining = cmd->length;
+
+    if (data == NULL || remaining < 4)
+        return NULL;
+
+    /* Each region rectangle is 8 bytes, with 2 bytes of quantization values
+     * for each rectangle following all rectangles */
+    uint32_t num_rects = data[0] | (data[1] << 8) | (data[2] << 16)
+                       | ((uint32_t) data[3] << 24);
+
+    remaining -= 4;
+    if (num_rects > remaining / 10)
+        return NULL;
+
+    size_t metablock_length = 4 + (size_t) num_rects * 10;
+    if (metablock_length >= cmd->length)
+        return NULL;
+
+    *length = cmd->length - metablock_length;
+    return data + metablock_length;
+
+}
+
+/**
+ * Returns whether the given H.264 bitstream, in Annex B format, contains an
+ * IDR picture, and thus may be decoded without any preceding data.
+ *
+ * @param data
+ *     The H.264 bitstream to test.
+ *
+ * @param length
+ *     The length of the H.264 bitstream, in bytes.
+ *
+ * @return
+ *     Non-zero if the bitstream contains an IDR picture, zero otherwise.
+ */
+static int guac_rdp_rdpgfx_h264_is_idr(const uint8_t* data, size_t length) {
+
+    /* Test the type of each NAL unit following an Annex B start code */
+    for (size_t i = 0; i + 3 < length; i++) {
+        if (data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x01) {
+            if ((data[i + 3] & 0x1F) == 5)
+                return 1;
+            i += 2;
+        }
+    }
+
+    return 0;
+
+}
+
+/**
+ * Begins forwarding H.264 video for the given surface to all connected users,
+ * if every connected user supports H.264 and the surface is mapped to the
+ * output. The lock of the given guac_rdp_rdpgfx MUST be held.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module that should begin forwarding H.264 video.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the surface.
+ *
+ * @param surface_id
+ *     The ID of the RDPGFX surface whose video should be forwarded.
+ *
+ * @return
+ *     Non-zero if H.264 video is now being forwarded, zero otherwise.
+ */
+static int guac_rdp_rdpgfx_begin_stream(guac_rdp_rdpgfx* rdpgfx,
+        RdpgfxClientContext* context, uint16_t surface_id) {
+
+    guac_client* client = rdpgfx->client;
+
+    /* Forward video only if every user can play it, as the video replaces
+     * the updates that would otherwise be sent for the surface */
+    int supported = 1;
+    guac_client_foreach_user(client, guac_rdp_rdpgfx_check_user, &supported);
+    if (!supported || client->connected_users == 0)
+        return 0;
+
+    /* Forward video only for surfaces drawn to the output at their original
+     * size */
+    gdiGfxSurface* surface = (gdiGfxSurface*) context->GetSurfaceData(context,
+            surface_id);
+    if (surface == NULL || !surface->outputMapped)
+        return 0;
+
+    guac_rect_init(&rdpgfx->rect, surface->outputOriginX,
+            surface->outputOriginY, surface->width, surface->height);
+
+    rdpgfx->layer = guac_client_alloc_layer(client);
+    rdpgfx->stream = guac_client_alloc_stream(client);
+    rdpgfx->surface_id = surface_id;
+    rdpgfx->active = 1;
+    rdpgfx->invalidated = 0;
+
+    /* Play video within a layer covering the surface */
+    guac_protocol_send_size(client->socket, rdpgfx->layer,
+            surface->width, surface->height);
+    guac_protocol_send_move(client->socket, rdpgfx->layer,
+            GUAC_DEFAULT_LAYER, surface->outputOriginX,
+            surface->outputOriginY, 0);
+    guac_protocol_send_video(client->socket, rdpgfx->stream,
+            rdpgfx->layer, GUAC_RDP_RDPGFX_H264_MIMETYPE);
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "H.264 passthrough for RDPGFX "
+            "surface %u started.", (unsigned int) surface_id);
+
+    return 1;
+
+}
+
+/**
+ * Handler for RDPGFX surface commands which forwards the H.264 bitstream of
+ * AVC420-encoded commands to connected users, if possible, before passing
+ * the command to the handler installed by FreeRDP's GDI. Other commands end
+ * any H.264 video stream for the surface being modified.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the surface command.
+ *
+ * @param cmd
+ *     The received surface command.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_surface_command(RdpgfxClientContext* context,
+        const RDPGFX_SURFACE_COMMAND* cmd) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_rdpgfx* rdpgfx = rdp_client->rdpgfx;
+
+    /* The surface must always be decoded by the GDI, such that its contents
+     * remain accurate should the video stream later end */
+    UINT status = rdpgfx->surface_command(context, cmd);
+    if (status != CHANNEL_RC_OK || !rdpgfx->h264_passthrough)
+        return status;
+
+    size_t length = 0;
+    const uint8_t* bitstream = NULL;
+    if (cmd->codecId == RDPGFX_CODECID_AVC420)
+        bitstream = guac_rdp_rdpgfx_avc420_bitstream(cmd, &length);
+
+    pthread_mutex_lock(&(rdpgfx->lock));
+
+    if (rdpgfx->invalidated)
+        guac_rdp_rdpgfx_end_stream(rdpgfx);
+
+    /* Any surface command other than H.264 for the surface being forwarded
+     * modifies the output in a way the video stream cannot represent */
+    if (bitstream == NULL || (rdpgfx->active
+                && rdpgfx->surface_id != cmd->surfaceId)) {
+        if (guac_rdp_rdpgfx_affects_stream(rdpgfx, context, cmd->surfaceId))
+            guac_rdp_rdpgfx_end_stream(rdpgfx);
+    }
+
+    /* A new stream can begin only with an IDR picture */
+    else if (rdpgfx->active || (guac_rdp_rdpgfx_h264_is_idr(bitstream, length)
+                && guac_rdp_rdpgfx_begin_stream(rdpgfx, context, cmd->surfaceId))) {
+        guac_protocol_send_blobs(client->socket, rdpgfx->stream,
+                bitstream, (int) length);
+        guac_socket_flush(client->socket);
+    }
+
+    pthread_mutex_unlock(&(rdpgfx->lock));
+
+    return status;
+
+}
+
+/**
+ * Handler for RDPGFX SolidFill PDUs which ends any H.264 video stream for the
+ * surface being filled before passing the PDU to the handler installed by
+ * FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param solid_fill
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_solid_fill(RdpgfxClientContext* context,
+        const RDPGFX_SOLID_FILL_PDU* solid_fill) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    guac_rdp_rdpgfx_surface_modified(rdpgfx, context,
+            solid_fill->surfaceId);
+    return rdpgfx->solid_fill(context, solid_fill);
+
+}
+
+/**
+ * Handler for RDPGFX SurfaceToSurface PDUs which ends any H.264 video stream
+ * for the destination surface and hints each copy to the guac_display (if
+ * both surfaces are drawn to the output) before passing the PDU to the
+ * handler installed by FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param surface_to_surface
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_surface_to_surface(RdpgfxClientContext* context,
+        const RDPGFX_SURFACE_TO_SURFACE_PDU* surface_to_surface) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    guac_rdp_rdpgfx_surface_modified(rdpgfx, context,
+            surface_to_surface->surfaceIdDest);
+
+    gdiGfxSurface* src = (gdiGfxSurface*) context->GetSurfaceData(context,
+            surface_to_surface->surfaceIdSrc);
+    gdiGfxSurface* dest = (gdiGfxSurface*) context->GetSurfaceData(context,
+            surface_to_surface->surfaceIdDest);
+
+    /* Copies involving offscreen surfaces will only later reach the output
+     * through other means, and cannot be hinted */
+    if (src != NULL && dest != NULL && src->outputMapped && dest->outputMapped) {
+
+        guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+        guac_display_layer* default_layer = guac_display_default_layer(rdp_client->display);
+
+        const RECTANGLE_16* rect = &surface_to_surface->rectSrc;
+
+        guac_rect src_rect;
+        guac_rect_init(&src_rect,
+                src->outputOriginX + rect->left,
+                src->outputOriginY + rect->top,
+                rect->right - rect->left,
+                rect->bottom - rect->top);
+
+        for (UINT16 i = 0; i < surface_to_surface->destPtsCount; i++) {
+            const RDPGFX_POINT16* point = &surface_to_surface->destPts[i];
+            guac_display_layer_hint_copy(default_layer, &src_rect,
+                    dest->outputOriginX + point->x,
+                    dest->outputOriginY + point->y);
+        }
+
+    }
+
+    return rdpgfx->surface_to_surface(context, surface_to_surface);
+
+}
+
+/**
+ * Handler for RDPGFX CacheToSurface PDUs which ends any H.264 video stream for
+ * the destination surface before passing the PDU to the handler installed by
+ * FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param cache_to_surface
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_cache_to_surface(RdpgfxClientContext* context,
+        const RDPGFX_CACHE_TO_SURFACE_PDU* cache_to_surface) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    guac_rdp_rdpgfx_surface_modified(rdpgfx, context,
+            cache_to_surface->surfaceId);
+    return rdpgfx->cache_to_surface(context, cache_to_surface);
+
+}
+
+/**
+ * Handler for RDPGFX MapSurfaceToOutput PDUs which ends any H.264 video stream
+ * for the surface being moved before passing the PDU to the handler installed
+ * by FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param map_surface_to_output
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_map_surface_to_output(RdpgfxClientContext* context,
+        const RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* map_surface_to_output) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    guac_rdp_rdpgfx_surface_modified(rdpgfx, context,
+            map_surface_to_output->surfaceId);
+    return rdpgfx->map_surface_to_output(context, map_surface_to_output);
+
+}
+
+/**
+ * Handler for RDPGFX DeleteSurface PDUs which ends any H.264 video stream for
+ * the surface being deleted before passing the PDU to the handler installed
+ * by FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param delete_surface
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_delete_surface(RdpgfxClientContext* context,
+        const RDPGFX_DELETE_SURFACE_PDU* delete_surface) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    guac_rdp_rdpgfx_surface_modified(rdpgfx, context,
+            delete_surface->surfaceId);
+    return rdpgfx->delete_surface(context, delete_surface);
+
+}
+
+/**
+ * Handler for RDPGFX ResetGraphics PDUs which ends any H.264 video stream
+ * before passing the PDU to the handler installed by FreeRDP's GDI.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param reset_graphics
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_reset_graphics(RdpgfxClientContext* context,
+        const RDPGFX_RESET_GRAPHICS_PDU* reset_graphics) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    pthread_mutex_lock(&(rdpgfx->lock));
+    guac_rdp_rdpgfx_end_stream(rdpgfx);
+    pthread_mutex_unlock(&(rdpgfx->lock));
+
+    return rdpgfx->reset_graphics(context, reset_graphics);
+
+}
+
+int guac_rdp_rdpgfx_sync_handler(guac_user* user, guac_timestamp timestamp) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) user->client->data;
+    guac_flag_set(&(rdp_client->rdpgfx->synced), GUAC_RDP_RDPGFX_SYNC_RECEIVED);
+
+    return 0;
+
+}
+
+/**
+ * Callback for guac_client_foreach_user() which updates the int pointed to by
+ * the given data with the amount of time that the given user has fallen
+ * behind the frames sent to them, if that user is further behind than any
+ * user seen thus far.
+ *
+ * @param user
+ *     The user to check.
+ *
+ * @param data
+ *     A pointer to an int containing the largest amount of time that any
+ *     user seen thus far has fallen behind, in milliseconds.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_rdpgfx_find_lag(guac_user* user, void* data) {
+
+    int* lag = (int*) data;
+
+    /* Frames sent but not yet confirmed, excluding those that are simply
+     * still in transit */
+    int user_lag = user->client->last_sent_timestamp
+        - user->last_received_timestamp - user->last_frame_duration;
+
+    if (user_lag > *lag)
+        *lag = user_lag;
+
+    return NULL;
+
+}
+
+/**
+ * Waits until all connected users have received nearly all frames already
+ * sent to them, or until GUAC_RDP_RDPGFX_MAX_ACK_DELAY milliseconds have
+ * elapsed, whichever happens first.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module of the connection whose users should be waited for.
+ */
+static void guac_rdp_rdpgfx_wait_for_users(guac_rdp_rdpgfx* rdpgfx) {
+
+    guac_client* client = rdpgfx->client;
+    guac_timestamp deadline = guac_timestamp_current()
+        + GUAC_RDP_RDPGFX_MAX_ACK_DELAY;
+
+    for (;;) {
+
+        /* Clear any previous sync notification BEFORE checking lag, such that
+         * confirmations received during the check are not missed */
+        guac_flag_clear(&(rdpgfx->synced), GUAC_RDP_RDPGFX_SYNC_RECEIVED);
+
+        int lag = 0;
+        guac_client_foreach_user(client, guac_rdp_rdpgfx_find_lag, &lag);
+
+        if (lag <= GUAC_RDP_RDPGFX_MAX_LAG || client->state != GUAC_CLIENT_RUNNING)
+            break;
+
+        int remaining = deadline - guac_timestamp_current();
+        if (remaining <= 0) {
+            guac_client_log(client, GUAC_LOG_TRACE, "Acknowledging RDPGFX "
+                    "frame while users remain %ims behind.", lag);
+            break;
+        }
+
+        if (!guac_flag_timedwait_and_lock(&(rdpgfx->synced),
+                    GUAC_RDP_RDPGFX_SYNC_RECEIVED, remaining))
+            break;
+
+        guac_flag_unlock(&(rdpgfx->synced));
+
+    }
+
+}
+
+/**
+ * Handler for RDPGFX EndFrame PDUs, which passes the PDU to the handler
+ * installed by FreeRDP's GDI and then waits for connected users to catch up
+ * with the frames already sent to them. FreeRDP sends the FrameAcknowledge
+ * PDU for each RDPGFX frame only after this handler returns, and the RDP
+ * server limits the number of frames that it has in flight, so this has the
+ * effect of throttling the server's encoder to the rate at which users are
+ * receiving frames.
+ *
+ * @param context
+ *     The RdpgfxClientContext associated with the PDU.
+ *
+ * @param end_frame
+ *     The received PDU.
+ *
+ * @return
+ *     The result of invoking the handler installed by FreeRDP's GDI.
+ */
+static UINT guac_rdp_rdpgfx_end_frame(RdpgfxClientContext* context,
+        const RDPGFX_END_FRAME_PDU* end_frame) {
+
+    rdpGdi* gdi = (rdpGdi*) context->custom;
+    guac_client* client = ((rdp_freerdp_context*) gdi->context)->client;
+    guac_rdp_rdpgfx* rdpgfx = ((guac_rdp_client*) client->data)->rdpgfx;
+
+    UINT status = rdpgfx->end_frame(context, end_frame);
+    if (status == CHANNEL_RC_OK)
+        guac_rdp_rdpgfx_wait_for_users(rdpgfx);
+
+    return status;
+
+}
+
 /**
  * Callback which associates handlers specific to Guacamole with the
  * RdpgfxClientContext instance allocated by FreeRDP to deal with received
@@ -53,6 +753,8 @@ static void guac_rdp_rdpgfx_channel_connected(rdpContext* context,
         ChannelConnectedEventArgs* args) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_rdpgfx* guac_rdpgfx = rdp_client->rdpgfx;
 
     /* Ignore connection event if it's not for the RDPGFX channel */
     if (strcmp(args->name, RDPGFX_DVC_CHANNEL_NAME) != 0)
@@ -62,12 +764,50 @@ static void guac_rdp_rdpgfx_channel_connected(rdpContext* context,
     RdpgfxClientContext* rdpgfx = (RdpgfxClientContext*) args->pInterface;
     rdpGdi* gdi = context->gdi;
 
-    if (!gdi_graphics_pipeline_init(gdi, rdpgfx))
+    if (!gdi_graphics_pipeline_init(gdi, rdpgfx)) {
         guac_client_log(client, GUAC_LOG_WARNING, "Rendering backend for RDPGFX "
                 "channel could not be loaded. Graphics may not render at all!");
-    else
-        guac_client_log(client, GUAC_LOG_DEBUG, "RDPGFX channel will be used for "
-                "the RDP Graphics Pipeline Extension.");
+        return;
+    }
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "RDPGFX channel will be used for "
+            "the RDP Graphics Pipeline Extension.");
+
+    guac_rdpgfx->rdpgfx = rdpgfx;
+    guac_rdpgfx->h264_passthrough = rdp_client->settings->enable_h264_passthrough;
+
+    /* H.264 video cannot be included within session recordings */
+    if (guac_rdpgfx->h264_passthrough && rdp_client->recording != NULL) {
+        guac_client_log(client, GUAC_LOG_INFO, "H.264 passthrough has been "
+                "disabled, as the session is being recorded.");
+        guac_rdpgfx->h264_passthrough = 0;
+    }
+
+    /* Intercept all messages that may modify surfaces, hinting copies to the
+     * guac_display and forwarding H.264 video on to connected users where
+     * possible, as well as the end of each frame, pacing acknowledgement of
+     * frames to the connected users */
+    guac_rdpgfx->surface_command = rdpgfx->SurfaceCommand;
+    guac_rdpgfx->solid_fill = rdpgfx->SolidFill;
+    guac_rdpgfx->surface_to_surface = rdpgfx->SurfaceToSurface;
+    guac_rdpgfx->cache_to_surface = rdpgfx->CacheToSurface;
+    guac_rdpgfx->map_surface_to_output = rdpgfx->MapSurfaceToOutput;
+    guac_rdpgfx->delete_surface = rdpgfx->DeleteSurface;
+    guac_rdpgfx->reset_graphics = rdpgfx->ResetGraphics;
+    guac_rdpgfx->end_frame = rdpgfx->EndFrame;
+
+    rdpgfx->SurfaceCommand = guac_rdp_rdpgfx_surface_command;
+    rdpgfx->SolidFill = guac_rdp_rdpgfx_solid_fill;
+    rdpgfx->SurfaceToSurface = guac_rdp_rdpgfx_surface_to_surface;
+    rdpgfx->CacheToSurface = guac_rdp_rdpgfx_cache_to_surface;
+    rdpgfx->MapSurfaceToOutput = guac_rdp_rdpgfx_map_surface_to_output;
+    rdpgfx->DeleteSurface = guac_rdp_rdpgfx_delete_surface;
+    rdpgfx->ResetGraphics = guac_rdp_rdpgfx_reset_graphics;
+    rdpgfx->EndFrame = guac_rdp_rdpgfx_end_frame;
+
+    if (guac_rdpgfx->h264_passthrough)
+        guac_client_log(client, GUAC_LOG_DEBUG, "H.264 video received via the "
+                "RDPGFX channel will be forwarded to users that support it.");
 
 }
 
@@ -91,11 +831,19 @@ static void guac_rdp_rdpgfx_channel_disconnected(rdpContext* context,
         ChannelDisconnectedEventArgs* args) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_rdpgfx* guac_rdpgfx = rdp_client->rdpgfx;
 
     /* Ignore disconnection event if it's not for the RDPGFX channel */
     if (strcmp(args->name, RDPGFX_DVC_CHANNEL_NAME) != 0)
         return;
 
+    /* End any H.264 video that was being forwarded */
+    pthread_mutex_lock(&(guac_rdpgfx->lock));
+    guac_rdp_rdpgfx_end_stream(guac_rdpgfx);
+    guac_rdpgfx->rdpgfx = NULL;
+    pthread_mutex_unlock(&(guac_rdpgfx->lock));
+
     /* Un-init GDI-backed support for the Graphics Pipeline */
     RdpgfxClientContext* rdpgfx = (RdpgfxClientContext*) args->pInterface;
     rdpGdi* gdi = context->gdi;
@@ -25,6 +25,251 @@
 #include <freerdp/client/rdpgfx.h>
 #include <freerdp/freerdp.h>
 #include <guacamole/client.h>
+#include <guacamole/flag.h>
+#include <guacamole/layer.h>
+#include <guacamole/rect.h>
+#include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The mimetype of the Guacamole video stream used to forward the H.264
+ * bitstream of AVC420-encoded RDPGFX surface commands to connected users.
+ */
+#define GUAC_RDP_RDPGFX_H264_MIMETYPE "video/h264"
+
+/**
+ * The maximum amount of time that connected users may fall behind the frames
+ * already sent to them, beyond their network round trip time, before the end
+ * of each RDPGFX frame is held back until those users catch up, in
+ * milliseconds.
+ */
+#define GUAC_RDP_RDPGFX_MAX_LAG 250
+
+/**
+ * The maximum amount of time that the end of any single RDPGFX frame may be
+ * held back waiting for connected users to catch up, in milliseconds.
+ */
+#define GUAC_RDP_RDPGFX_MAX_ACK_DELAY 1000
+
+/**
+ * Flag set on the synced flag of guac_rdp_rdpgfx whenever any connected user
+ * has confirmed receipt of a frame via a "sync" instruction.
+ */
+#define GUAC_RDP_RDPGFX_SYNC_RECEIVED 1
+
+/**
+ * The state of the RDPGFX channel, including the state of any H.264 video
+ * stream currently being forwarded to connected users as-is, rather than
+ * being decoded by FreeRDP and then re-encoded as images.
+ *
+ * Copies between surfaces (SurfaceToSurface) that are drawn to the output are
+ * additionally passed on to the guac_display as copy hints, such that the
+ * guac_display need not search for those copies itself.
+ *
+ * While such a stream is active, FreeRDP continues to decode each AVC420
+ * surface command into its GDI surface, such that the surface remains
+ * accurate, but the region of the default layer covered by the surface is
+ * not marked as dirty and is thus not re-encoded. Users instead see the
+ * decoded video within a layer above the default layer. The stream ends, and
+ * the default layer is again updated normally, as soon as the surface is
+ * modified by anything other than H.264, or as soon as a user joins who would
+ * not otherwise receive the stream.
+ *
+ * The end of each RDPGFX frame is additionally held back while connected
+ * users are far behind the frames already sent to them. As FreeRDP
+ * acknowledges each RDPGFX frame only once its EndFrame handler returns,
+ * this paces the RDP server's own encoder to the rate at which users are
+ * actually receiving frames, rather than frames being decoded only to be
+ * merged or dropped later.
+ */
+typedef struct guac_rdp_rdpgfx {
+
+    /**
+     * The guac_client instance handling the relevant RDP connection.
+     */
+    guac_client* client;
+
+    /**
+     * RDPGFX control interface, or NULL if the RDPGFX channel is not
+     * connected.
+     */
+    RdpgfxClientContext* rdpgfx;
+
+    /**
+     * Non-zero if H.264 video received via the RDPGFX channel may be
+     * forwarded to connected users as-is, zero otherwise.
+     */
+    int h264_passthrough;
+
+    /**
+     * The SurfaceCommand handler installed by FreeRDP's GDI, which is invoked
+     * for all surface commands after any H.264 bitstream has been forwarded.
+     */
+    pcRdpgfxSurfaceCommand surface_command;
+
+    /**
+     * The SolidFill handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxSolidFill solid_fill;
+
+    /**
+     * The SurfaceToSurface handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxSurfaceToSurface surface_to_surface;
+
+    /**
+     * The CacheToSurface handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxCacheToSurface cache_to_surface;
+
+    /**
+     * The MapSurfaceToOutput handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxMapSurfaceToOutput map_surface_to_output;
+
+    /**
+     * The DeleteSurface handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxDeleteSurface delete_surface;
+
+    /**
+     * The ResetGraphics handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxResetGraphics reset_graphics;
+
+    /**
+     * The EndFrame handler installed by FreeRDP's GDI.
+     */
+    pcRdpgfxEndFrame end_frame;
+
+    /**
+     * Flag which has GUAC_RDP_RDPGFX_SYNC_RECEIVED set whenever any
+     * connected user confirms receipt of a frame, waking the end of any
+     * RDPGFX frame that is being held back until users catch up.
+     */
+    guac_flag synced;
+
+    /**
+     * Lock which must be acquired before accessing the state of the H.264
+     * video stream, which may be read or invalidated outside the thread
+     * handling RDPGFX messages.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Non-zero if an H.264 video stream is currently being forwarded to all
+     * connected users, zero otherwise.
+     */
+    int active;
+
+    /**
+     * Non-zero if the current H.264 video stream must be ended before any
+     * further data is forwarded (for example, because a user has joined who
+     * has not received the beginning of the stream), zero otherwise.
+     */
+    int invalidated;
+
+    /**
+     * The ID of the RDPGFX surface whose H.264 bitstream is being forwarded.
+     * This value is only meaningful if active is non-zero.
+     */
+    uint16_t surface_id;
+
+    /**
+     * The region of the default layer covered by the surface whose H.264
+     * bitstream is being forwarded. This value is only meaningful if active
+     * is non-zero.
+     */
+    guac_rect rect;
+
+    /**
+     * The layer that the forwarded H.264 video is played within, or NULL if
+     * no video stream is active.
+     */
+    guac_layer* layer;
+
+    /**
+     * The Guacamole video stream carrying the forwarded H.264 bitstream, or
+     * NULL if no video stream is active.
+     */
+    guac_stream* stream;
+
+} guac_rdp_rdpgfx;
+
+/**
+ * Allocates a new RDPGFX module, which will ultimately control the RDPGFX
+ * channel once connected, forwarding H.264 video to connected users if
+ * enabled.
+ *
+ * @param client
+ *     The guac_client instance handling the relevant RDP connection.
+ *
+ * @return
+ *     A newly-allocated RDPGFX module.
+ */
+guac_rdp_rdpgfx* guac_rdp_rdpgfx_alloc(guac_client* client);
+
+/**
+ * Frees the resources associated with the given RDPGFX module. Any active
+ * H.264 video stream must already have been ended by disconnection of the
+ * RDPGFX channel.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module to free.
+ */
+void guac_rdp_rdpgfx_free(guac_rdp_rdpgfx* rdpgfx);
+
+/**
+ * Returns whether the given region of the default layer is entirely covered
+ * by an active H.264 video stream, and thus need not be re-encoded. This
+ * function may be safely called from any thread.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module to test.
+ *
+ * @param rect
+ *     The region of the default layer to test.
+ *
+ * @return
+ *     Non-zero if the given region is entirely covered by an active H.264
+ *     video stream, zero otherwise.
+ */
+int guac_rdp_rdpgfx_is_passthrough(guac_rdp_rdpgfx* rdpgfx,
+        const guac_rect* rect);
+
+/**
+ * Requests that any active H.264 video stream be ended before any further
+ * data is forwarded, such that the region of the default layer covered by
+ * that stream is again re-encoded and sent normally. This must be invoked
+ * whenever users join the connection, as those users will not have received
+ * the beginning of the stream. This function may be safely called from any
+ * thread.
+ *
+ * @param rdpgfx
+ *     The RDPGFX module whose H.264 video stream should be ended.
+ */
+void guac_rdp_rdpgfx_invalidate(guac_rdp_rdpgfx* rdpgfx);
+
+/**
+ * Handler for "sync" instructions received from any user, noting that the
+ * user may have caught up with the frames sent to them, such that the end of
+ * any RDPGFX frame being held back may proceed.
+ *
+ * @param user
+ *     The user that sent the "sync" instruction.
+ *
+ * @param timestamp
+ *     The timestamp of the frame whose receipt is being confirmed.
+ *
+ * @return
+ *     Zero if the "sync" instruction was handled successfully, non-zero
+ *     otherwise. This handler always succeeds.
+ */
+int guac_rdp_rdpgfx_sync_handler(guac_user* user, guac_timestamp timestamp);
 
 /**
  * Adds FreeRDP's "rdpgfx" plugin to the list of dynamic virtual channel plugins
@@ -23,6 +23,7 @@
 #include "channels/disp.h"
 #include "channels/pipe-svc.h"
 #include "channels/rail.h"
+#include "channels/rdpgfx.h"
 #include "config.h"
 #include "fs.h"
 #include "log.h"
@@ -130,6 +131,10 @@ static int guac_rdp_join_pending_handler(guac_client* client) {
     /* Bring user up to date with any registered static channels */
     guac_rdp_pipe_svc_send_pipes(client, broadcast_socket);
 
+    /* Pending users will not have received the start of any H.264 video
+     * being forwarded, and must instead see the underlying display */
+    guac_rdp_rdpgfx_invalidate(rdp_client->rdpgfx);
+
     /* Synchronize with current display */
     if (rdp_client->display != NULL) {
         guac_display_dup(rdp_client->display, broadcast_socket);
@@ -212,12 +217,18 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
 
     rdp_client->input_event_queued = CreateEvent(NULL, TRUE, FALSE, NULL);
 
+    /* Create handle signalling static virtual channel data awaiting flush */
+    rdp_client->svc_data_queued = CreateEvent(NULL, TRUE, FALSE, NULL);
+
     /* Init display update module */
     rdp_client->disp = guac_rdp_disp_alloc(client);
 
     /* Init multi-touch support module (RDPEI) */
     rdp_client->rdpei = guac_rdp_rdpei_alloc(client);
 
+    /* Init Graphics Pipeline support module (RDPGFX) */
+    rdp_client->rdpgfx = guac_rdp_rdpgfx_alloc(client);
+
     /* Redirect FreeRDP log messages to guac_client_log() */
     guac_rdp_redirect_wlog(client);
 
@@ -262,6 +273,7 @@ int guac_rdp_client_free_handler(guac_client* client) {
     /* Clean up event queue and associated signalling handle */
     guac_fifo_destroy(&rdp_client->input_events);
     CloseHandle(rdp_client->input_event_queued);
+    CloseHandle(rdp_client->svc_data_queued);
 
     /* Free parsed settings */
     if (rdp_client->settings != NULL)
@@ -276,6 +288,9 @@ int guac_rdp_client_free_handler(guac_client* client) {
     /* Free multi-touch support module (RDPEI) */
     guac_rdp_rdpei_free(rdp_client->rdpei);
 
+    /* Free Graphics Pipeline support module (RDPGFX) */
+    guac_rdp_rdpgfx_free(rdp_client->rdpgfx);
+
     /* Clean up filesystem, if allocated */
     if (rdp_client->filesystem != NULL)
         guac_rdp_fs_free(rdp_client->filesystem);
@@ -288,6 +303,10 @@ int guac_rdp_client_free_handler(guac_client* client) {
         rdp_client->active_job = NULL;
     }
 
+    /* Stop any print filter process kept ready for further print jobs */
+    guac_rdp_print_filter_free(rdp_client->idle_print_filter);
+    rdp_client->idle_print_filter = NULL;
+
 #ifdef ENABLE_COMMON_SSH
     /* Free SFTP filesystem, if loaded */
     if (rdp_client->sftp_filesystem)
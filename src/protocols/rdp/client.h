@@ -32,6 +32,20 @@
  */
 #define GUAC_RDP_MESSAGE_CHECK_INTERVAL 1000
 
+/**
+ * The maximum number of attempts made to resume an RDP session using the
+ * auto-reconnect cookie provided by the RDP server after the connection to
+ * that server is unexpectedly lost.
+ */
+#define GUAC_RDP_AUTO_RECONNECT_ATTEMPTS 5
+
+/**
+ * The amount of time to wait between consecutive failed attempts to resume an
+ * RDP session after the connection to the RDP server was lost, in
+ * milliseconds. The first attempt is made immediately.
+ */
+#define GUAC_RDP_AUTO_RECONNECT_INTERVAL 500
+
 /**
  * The native resolution of most RDP connections. As Windows and other systems
  * rely heavily on forced 96 DPI, we must assume 96 DPI.
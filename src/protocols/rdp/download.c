@@ -37,63 +37,126 @@
 
 #include <stdlib.h>
 
-int guac_rdp_download_ack_handler(guac_user* user, guac_stream* stream,
-        char* message, guac_protocol_status status) {
+/**
+ * Read handler for file downloads, reading the next blob of data from the
+ * file being downloaded. The data associated with the stream is expected to
+ * be the guac_rdp_download_status of the download.
+ *
+ * @param user
+ *     The user receiving the file.
+ *
+ * @param stream
+ *     The Guacamole protocol stream along which the file is being sent.
+ *
+ * @param data
+ *     The guac_rdp_download_status of the download.
+ *
+ * @param buffer
+ *     The buffer that should receive the data read from the file.
+ *
+ * @param length
+ *     The maximum number of bytes to read.
+ *
+ * @return
+ *     The number of bytes read, zero if the end of the file has been reached,
+ *     or a negative value on error.
+ */
+static int guac_rdp_download_read_handler(guac_user* user,
+        guac_stream* stream, void* data, char* buffer, int length) {
 
     guac_client* client = user->client;
     guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
-    guac_rdp_download_status* download_status = (guac_rdp_download_status*) stream->data;
+    guac_rdp_download_status* download_status = (guac_rdp_download_status*) data;
 
-    /* Get filesystem, return error if no filesystem */
+    /* Fail if filesystem has since been unloaded */
     guac_rdp_fs* fs = rdp_client->filesystem;
-    if (fs == NULL) {
-        guac_protocol_send_ack(user->socket, stream, "FAIL (NO FS)",
-                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
-        guac_socket_flush(user->socket);
-        return 0;
-    }
+    if (fs == NULL)
+        return -1;
 
-    /* If successful, read data */
-    if (status == GUAC_PROTOCOL_STATUS_SUCCESS) {
+    int bytes_read = guac_rdp_fs_read(fs, download_status->file_id,
+            download_status->offset, buffer, length);
 
-        /* Attempt read into buffer */
-        char buffer[4096];
-        int bytes_read = guac_rdp_fs_read(fs,
-                download_status->file_id,
-                download_status->offset, buffer, sizeof(buffer));
+    if (bytes_read > 0)
+        download_status->offset += bytes_read;
 
-        /* If bytes read, send as blob */
-        if (bytes_read > 0) {
-            download_status->offset += bytes_read;
-            guac_protocol_send_blob(user->socket, stream,
-                    buffer, bytes_read);
-        }
+    return bytes_read;
 
-        /* If EOF, send end */
-        else if (bytes_read == 0) {
-            guac_protocol_send_end(user->socket, stream);
-            guac_user_free_stream(user, stream);
-            guac_mem_free(download_status);
-        }
+}
 
-        /* Otherwise, fail stream */
-        else {
-            guac_user_log(user, GUAC_LOG_ERROR,
-                    "Error reading file for download");
-            guac_protocol_send_end(user->socket, stream);
-            guac_user_free_stream(user, stream);
-            guac_mem_free(download_status);
-        }
+/**
+ * Complete handler for file downloads, closing the file that was being
+ * downloaded and freeing the transfer status of the download.
+ *
+ * @param user
+ *     The user that was receiving the file.
+ *
+ * @param stream
+ *     The Guacamole protocol stream along which the file was being sent.
+ *
+ * @param data
+ *     The guac_rdp_download_status of the download.
+ *
+ * @param status
+ *     The final status of the transfer.
+ */
+static void guac_rdp_download_complete_handler(guac_user* user,
+        guac_stream* stream, void* data, guac_protocol_status status) {
 
-        guac_socket_flush(user->socket);
+    guac_client* client = user->client;
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+    guac_rdp_download_status* download_status = (guac_rdp_download_status*) data;
 
-    }
+    if (status == GUAC_PROTOCOL_STATUS_SERVER_ERROR)
+        guac_user_log(user, GUAC_LOG_ERROR,
+                "Error reading file for download");
 
-    /* Otherwise, return stream to user */
-    else
+    /* Close file if filesystem is still loaded */
+    guac_rdp_fs* fs = rdp_client->filesystem;
+    if (fs != NULL)
+        guac_rdp_fs_close(fs, download_status->file_id);
+
+    guac_mem_free(download_status);
+
+}
+
+/**
+ * Allocates a new stream which sends the contents of the file having the
+ * given ID to the given user, keeping multiple blobs in flight. The caller
+ * must begin the stream (with a "file" or "body" instruction) once it has
+ * been returned.
+ *
+ * @param user
+ *     The user that will receive the file.
+ *
+ * @param file_id
+ *     The ID of the open file to send.
+ *
+ * @return
+ *     The newly-allocated stream, or NULL if the stream could not be set up.
+ */
+static guac_stream* guac_rdp_download_alloc_stream(guac_user* user,
+        int file_id) {
+
+    guac_stream* stream = guac_user_alloc_stream(user);
+    if (stream == NULL)
+        return NULL;
+
+    /* Downloads receive only bandwidth not needed by the display */
+    stream->priority = GUAC_SOCKET_PRIORITY_BULK;
+
+    guac_rdp_download_status* download_status = guac_mem_alloc(sizeof(guac_rdp_download_status));
+    download_status->file_id = file_id;
+    download_status->offset = 0;
+
+    if (guac_user_stream_windowed(user, stream, GUAC_USER_STREAM_WINDOW_SIZE,
+                guac_rdp_download_read_handler,
+                guac_rdp_download_complete_handler, download_status)) {
+        guac_mem_free(download_status);
         guac_user_free_stream(user, stream);
+        return NULL;
+    }
 
-    return 0;
+    return stream;
 
 }
 
@@ -128,44 +191,31 @@ int guac_rdp_download_get_handler(guac_user* user, guac_object* object,
     /* If directory, send contents of directory */
     if (file->attributes & FILE_ATTRIBUTE_DIRECTORY) {
 
-        /* Create stream data */
-        guac_rdp_ls_status* ls_status = guac_mem_alloc(sizeof(guac_rdp_ls_status));
-        ls_status->fs = fs;
-        ls_status->file_id = file_id;
-        guac_strlcpy(ls_status->directory_name, name,
-                sizeof(ls_status->directory_name));
-
         /* Allocate stream for body */
-        guac_stream* stream = guac_user_alloc_stream(user);
-        stream->ack_handler = guac_rdp_ls_ack_handler;
-        stream->data = ls_status;
-
-        /* Init JSON object state */
-        guac_common_json_begin_object(user, stream,
-                &ls_status->json_state);
+        guac_stream* stream = guac_rdp_ls_alloc_stream(user, fs, file_id,
+                name);
 
         /* Associate new stream with get request */
-        guac_protocol_send_body(user->socket, object, stream,
-                GUAC_USER_STREAM_INDEX_MIMETYPE, name);
+        if (stream != NULL)
+            guac_protocol_send_body(user->socket, object, stream,
+                    GUAC_USER_STREAM_INDEX_MIMETYPE, name);
+        else
+            guac_rdp_fs_close(fs, file_id);
 
     }
 
     /* Otherwise, send file contents if downloads are allowed */
     else if (!fs->disable_download) {
 
-        /* Create stream data */
-        guac_rdp_download_status* download_status = guac_mem_alloc(sizeof(guac_rdp_download_status));
-        download_status->file_id = file_id;
-        download_status->offset = 0;
-
         /* Allocate stream for body */
-        guac_stream* stream = guac_user_alloc_stream(user);
-        stream->data = download_status;
-        stream->ack_handler = guac_rdp_download_ack_handler;
+        guac_stream* stream = guac_rdp_download_alloc_stream(user, file_id);
 
         /* Associate new stream with get request */
-        guac_protocol_send_body(user->socket, object, stream,
-                "application/octet-stream", name);
+        if (stream != NULL)
+            guac_protocol_send_body(user->socket, object, stream,
+                    "application/octet-stream", name);
+        else
+            guac_rdp_fs_close(fs, file_id);
 
     }
 
@@ -209,12 +259,13 @@ void* guac_rdp_download_to_user(guac_user* user, void* data) {
     if (file_id >= 0) {
 
         /* Associate stream with transfer status */
-        guac_stream* stream = guac_user_alloc_stream(user);
-        guac_rdp_download_status* download_status = guac_mem_alloc(sizeof(guac_rdp_download_status));
-        stream->data = download_status;
-        stream->ack_handler = guac_rdp_download_ack_handler;
-        download_status->file_id = file_id;
-        download_status->offset = 0;
+        guac_stream* stream = guac_rdp_download_alloc_stream(user, file_id);
+        if (stream == NULL) {
+            guac_user_log(user, GUAC_LOG_ERROR, "Unable to allocate stream "
+                    "for download of \"%s\"", path);
+            guac_rdp_fs_close(filesystem, file_id);
+            return NULL;
+        }
 
         guac_user_log(user, GUAC_LOG_DEBUG, "%s: Initiating download "
                 "of \"%s\"", __func__, path);
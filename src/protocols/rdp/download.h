@@ -45,11 +45,6 @@ typedef struct guac_rdp_download_status {
 
 } guac_rdp_download_status;
 
-/**
- * Handler for acknowledgements of receipt of data related to file downloads.
- */
-guac_user_ack_handler guac_rdp_download_ack_handler;
-
 /**
  * Handler for get messages. In context of downloads and the filesystem exposed
  * via the Guacamole protocol, get messages request the body of a file within
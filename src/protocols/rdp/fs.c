@@ -112,6 +112,48 @@ void* guac_rdp_fs_expose(guac_user* user, void* data) {
 
 }
 
+/**
+ * Loads the size, times, and attributes of the given file from the given
+ * stat structure, as populated by stat(), fstat(), etc. If no such
+ * information could be retrieved, placeholder values are used instead.
+ *
+ * @param file
+ *     The file whose size, times, and attributes should be loaded.
+ *
+ * @param file_stat
+ *     The information retrieved for the file, or NULL if no information
+ *     could be retrieved.
+ */
+static void guac_rdp_fs_load_stat(guac_rdp_fs_file* file,
+        const struct stat* file_stat) {
+
+    /* If information cannot be retrieved, fake it */
+    if (file_stat == NULL) {
+
+        /* Init information to 0, lacking any alternative */
+        file->size  = 0;
+        file->ctime = 0;
+        file->mtime = 0;
+        file->atime = 0;
+        file->attributes = FILE_ATTRIBUTE_NORMAL;
+        return;
+
+    }
+
+    /* Load size and times */
+    file->size  = file_stat->st_size;
+    file->ctime = WINDOWS_TIME(file_stat->st_ctime);
+    file->mtime = WINDOWS_TIME(file_stat->st_mtime);
+    file->atime = WINDOWS_TIME(file_stat->st_atime);
+
+    /* Set type */
+    if (S_ISDIR(file_stat->st_mode))
+        file->attributes = FILE_ATTRIBUTE_DIRECTORY;
+    else
+        file->attributes = FILE_ATTRIBUTE_NORMAL;
+
+}
+
 /**
  * Translates an absolute Windows path to an absolute path which is within the
  * "drive path" specified in the connection settings. No checking is performed
@@ -376,33 +418,10 @@ int guac_rdp_fs_open(guac_rdp_fs* fs, const char* path,
             __func__, normalized_path, file_id);
 
     /* Attempt to pull file information */
-    if (fstat(fd, &file_stat) == 0) {
-
-        /* Load size and times */
-        file->size  = file_stat.st_size;
-        file->ctime = WINDOWS_TIME(file_stat.st_ctime);
-        file->mtime = WINDOWS_TIME(file_stat.st_mtime);
-        file->atime = WINDOWS_TIME(file_stat.st_atime);
-
-        /* Set type */
-        if (S_ISDIR(file_stat.st_mode))
-            file->attributes = FILE_ATTRIBUTE_DIRECTORY;
-        else
-            file->attributes = FILE_ATTRIBUTE_NORMAL;
-
-    }
-
-    /* If information cannot be retrieved, fake it */
-    else {
-
-        /* Init information to 0, lacking any alternative */
-        file->size  = 0;
-        file->ctime = 0;
-        file->mtime = 0;
-        file->atime = 0;
-        file->attributes = FILE_ATTRIBUTE_NORMAL;
-
-    }
+    if (fstat(fd, &file_stat) == 0)
+        guac_rdp_fs_load_stat(file, &file_stat);
+    else
+        guac_rdp_fs_load_stat(file, NULL);
 
     fs->open_files++;
 
@@ -422,9 +441,8 @@ int guac_rdp_fs_read(guac_rdp_fs* fs, int file_id, uint64_t offset,
         return GUAC_RDP_FS_EINVAL;
     }
 
-    /* Attempt read */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_read = read(file->fd, buffer, length);
+    /* Attempt read (reads of the same file may occur concurrently) */
+    bytes_read = pread(file->fd, buffer, length, offset);
 
     /* Translate errno on error */
     if (bytes_read < 0)
@@ -446,9 +464,8 @@ int guac_rdp_fs_write(guac_rdp_fs* fs, int file_id, uint64_t offset,
         return GUAC_RDP_FS_EINVAL;
     }
 
-    /* Attempt write */
-    lseek(file->fd, offset, SEEK_SET);
-    bytes_written = write(file->fd, buffer, length);
+    /* Attempt write (writes to the same file may occur concurrently) */
+    bytes_written = pwrite(file->fd, buffer, length, offset);
 
     /* Translate errno on error */
     if (bytes_written < 0)
@@ -612,6 +629,32 @@ const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id) {
 
 }
 
+int guac_rdp_fs_stat_dir_entry(guac_rdp_fs* fs, int file_id,
+        const char* entry_name, guac_rdp_fs_file* entry) {
+
+    struct stat entry_stat;
+
+    guac_rdp_fs_file* file = guac_rdp_fs_get_file(fs, file_id);
+    if (file == NULL || file->dir == NULL) {
+        guac_client_log(fs->client, GUAC_LOG_DEBUG,
+                "%s: Entry of bad directory file_id: %i", __func__, file_id);
+        return GUAC_RDP_FS_EINVAL;
+    }
+
+    /* Reject any name that is not a single entry of the directory */
+    if (strchr(entry_name, '/') != NULL)
+        return GUAC_RDP_FS_ENOENT;
+
+    /* Stat relative to the directory being read, avoiding both the
+     * translation of paths and the need to open each entry */
+    if (fstatat(dirfd(file->dir), entry_name, &entry_stat, 0))
+        return guac_rdp_fs_get_errorcode(errno);
+
+    guac_rdp_fs_load_stat(entry, &entry_stat);
+    return 0;
+
+}
+
 const char* guac_rdp_fs_basename(const char* path) {
 
     for (const char* c = path; *c != '\0'; c++) {
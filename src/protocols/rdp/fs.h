@@ -37,6 +37,7 @@
 #include <guacamole/user.h>
 
 #include <dirent.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 /**
@@ -176,9 +177,10 @@ typedef struct guac_rdp_fs_file {
     uint64_t atime;
 
     /**
-     * The number of bytes written to the file.
+     * The number of bytes written to the file. This is updated atomically,
+     * as writes to the same file may be performed by several threads.
      */
-    uint64_t bytes_written;
+    atomic_uint_least64_t bytes_written;
 
 } guac_rdp_fs_file;
 
@@ -603,6 +605,36 @@ int guac_rdp_fs_convert_path(const char* parent, const char* rel_path,
  */
 const char* guac_rdp_fs_read_dir(guac_rdp_fs* fs, int file_id);
 
+/**
+ * Retrieves the size, times, and attributes of the given entry of the
+ * directory having the given file ID, storing them within the given
+ * guac_rdp_fs_file. Only those members of the guac_rdp_fs_file are populated.
+ * Unlike opening the entry with guac_rdp_fs_open(), this requires neither a
+ * file ID nor a file descriptor, and so is suitable for enumerating the
+ * contents of large directories.
+ *
+ * @param fs
+ *     The filesystem containing the directory.
+ *
+ * @param file_id
+ *     The ID of the directory, which must currently be being read with
+ *     guac_rdp_fs_read_dir().
+ *
+ * @param entry_name
+ *     The name of the entry, as returned by guac_rdp_fs_read_dir().
+ *
+ * @param entry
+ *     The guac_rdp_fs_file that should receive the size, times, and
+ *     attributes of the entry.
+ *
+ * @return
+ *     Zero on success, or an error code if the entry cannot be found or its
+ *     details cannot be retrieved. All error codes are negative values and
+ *     correspond to GUAC_RDP_FS constants, such as GUAC_RDP_FS_ENOENT.
+ */
+int guac_rdp_fs_stat_dir_entry(guac_rdp_fs* fs, int file_id,
+        const char* entry_name, guac_rdp_fs_file* entry);
+
 /**
  * Returns the file having the given ID, or NULL if no such file exists.
  *
@@ -83,6 +83,12 @@ BOOL guac_rdp_gdi_begin_paint(rdpContext* context) {
     guac_display_layer_raw_context* current_context = guac_display_layer_open_raw(default_layer);
     rdp_client->current_context = current_context;
 
+    /* FreeRDP's GDI renders directly into the pending frame of the default
+     * layer, which is only possible without conversion if the GDI buffer uses
+     * the same layout as guac_display's raw buffers (see gdi_init() within
+     * rdp.c) */
+    GUAC_ASSERT(gdi->dstFormat == guac_rdp_get_native_pixel_format(FALSE));
+
     /* Resynchronize default layer buffer details with FreeRDP's GDI */
     current_context->buffer = gdi->primary_buffer;
     current_context->stride = gdi->stride;
@@ -117,23 +123,46 @@ BOOL guac_rdp_gdi_end_paint(rdpContext* context) {
     if (gdi->primary->hdc->hwnd->invalid->null)
         goto paint_complete;
 
-    INT32 x = gdi->primary->hdc->hwnd->invalid->x;
-    INT32 y = gdi->primary->hdc->hwnd->invalid->y;
-    UINT32 w = gdi->primary->hdc->hwnd->invalid->w;
-    UINT32 h = gdi->primary->hdc->hwnd->invalid->h;
-
-    /* guac_rect uses signed arithmetic for all values. While FreeRDP
-     * definitely performs its own checks and ensures these values cannot get
-     * so large as to cause problems with signed arithmetic, it's worth
-     * checking and bailing out here if an external bug breaks that. */
-    GUAC_ASSERT(w <= INT_MAX && h <= INT_MAX);
-
-    /* Mark modified region as dirty, but only within the bounds of the
-     * rendering surface */
-    guac_rect dst_rect;
-    guac_rect_init(&dst_rect, x, y, w, h);
-    guac_rect_constrain(&dst_rect, &current_context->bounds);
-    guac_rect_extend(&current_context->dirty, &dst_rect);
+    /* Mark each individual modified region as dirty, falling back to the
+     * overall bounding rectangle of those regions if they are not available,
+     * such that only the parts of the display that were actually modified
+     * need be compared against the previous frame */
+    HGDI_WND hwnd = gdi->primary->hdc->hwnd;
+    HGDI_RGN invalid = hwnd->invalid;
+    int ninvalid = 1;
+
+    if (hwnd->ninvalid > 0 && hwnd->cinvalid != NULL) {
+        invalid = hwnd->cinvalid;
+        ninvalid = hwnd->ninvalid;
+    }
+
+    for (int i = 0; i < ninvalid; i++) {
+
+        INT32 x = invalid[i].x;
+        INT32 y = invalid[i].y;
+        UINT32 w = invalid[i].w;
+        UINT32 h = invalid[i].h;
+
+        /* guac_rect uses signed arithmetic for all values. While FreeRDP
+         * definitely performs its own checks and ensures these values cannot
+         * get so large as to cause problems with signed arithmetic, it's worth
+         * checking and bailing out here if an external bug breaks that. */
+        GUAC_ASSERT(w <= INT_MAX && h <= INT_MAX);
+
+        /* Mark modified region as dirty, but only within the bounds of the
+         * rendering surface */
+        guac_rect dst_rect;
+        guac_rect_init(&dst_rect, x, y, w, h);
+        guac_rect_constrain(&dst_rect, &current_context->bounds);
+
+        /* Regions covered by H.264 video forwarded as-is need not be
+         * re-encoded */
+        if (guac_rdp_rdpgfx_is_passthrough(rdp_client->rdpgfx, &dst_rect))
+            continue;
+
+        guac_display_layer_mark_dirty(default_layer, &dst_rect);
+
+    }
 
     rdp_client->gdi_modified = 1;
 
@@ -196,30 +196,24 @@ complete:
 }
 
 /**
- * Processes a single touch event, updating client state and sending any
- * associated RDP PDUs via the provided RDP client instance.
+ * Processes a batch of touch events, updating client state and sending any
+ * associated RDP PDUs via the provided RDP client instance. All touch events
+ * within the batch are forwarded to the RDPEI channel together, without
+ * allowing other RDP messages to be sent in between, such that the updated
+ * contacts are sent to the RDP server within the same RDPEI frame.
  *
  * @param rdp_client
  *     The RDP client instance that should be updated and used to send any PDUs
- *     associated with the event.
+ *     associated with the events.
  *
- * @param event
- *     The touch event to process.
+ * @param events
+ *     The touch events to process, in order.
+ *
+ * @param count
+ *     The number of touch events within the events array.
  */
-static void guac_rdp_handle_touch_event(guac_rdp_client* rdp_client,
-        const guac_rdp_input_event* event) {
-
-    /* This function exclusively processes touch. events, and it's on the
-     * caller to ensure only touch. events are provided */
-    GUAC_ASSERT(event->type == GUAC_RDP_INPUT_EVENT_TOUCH);
-
-    int id = event->details.touch.id;
-    int x = event->details.touch.x;
-    int y = event->details.touch.y;
-    int x_radius = event->details.touch.x_radius;
-    int y_radius = event->details.touch.y_radius;
-    double angle = event->details.touch.angle;
-    double force = event->details.touch.force;
+static void guac_rdp_handle_touch_events(guac_rdp_client* rdp_client,
+        const guac_rdp_input_event* events, int count) {
 
     guac_rwlock_acquire_read_lock(&(rdp_client->lock));
 
@@ -228,19 +222,95 @@ static void guac_rdp_handle_touch_event(guac_rdp_client* rdp_client,
     if (rdp_inst == NULL)
         goto complete;
 
-    /* Report touch event within recording */
-    if (rdp_client->recording != NULL)
-        guac_recording_report_touch(rdp_client->recording, id, x, y,
-                x_radius, y_radius, angle, force);
+    pthread_mutex_lock(&(rdp_client->message_lock));
+
+    for (int i = 0; i < count; i++) {
+
+        const guac_rdp_input_event* event = &events[i];
+
+        /* This function exclusively processes touch. events, and it's on the
+         * caller to ensure only touch. events are provided */
+        GUAC_ASSERT(event->type == GUAC_RDP_INPUT_EVENT_TOUCH);
 
-    /* Forward touch event along RDPEI channel */
-    guac_rdp_rdpei_touch_update(rdp_client->rdpei, id, x, y, force);
+        int id = event->details.touch.id;
+        int x = event->details.touch.x;
+        int y = event->details.touch.y;
+        int x_radius = event->details.touch.x_radius;
+        int y_radius = event->details.touch.y_radius;
+        double angle = event->details.touch.angle;
+        double force = event->details.touch.force;
+
+        /* Report touch event within recording */
+        if (rdp_client->recording != NULL)
+            guac_recording_report_touch(rdp_client->recording, id, x, y,
+                    x_radius, y_radius, angle, force);
+
+        /* Forward touch event along RDPEI channel */
+        guac_rdp_rdpei_touch_update(rdp_client->rdpei, id, x, y, force);
+
+    }
+
+    pthread_mutex_unlock(&(rdp_client->message_lock));
 
 complete:
     guac_rwlock_release_lock(&(rdp_client->lock));
 
 }
 
+/**
+ * Adds the given touch event to the given batch of touch events, replacing
+ * any earlier event within the batch that merely moved the same contact. A
+ * contact that is still touching the screen need only be sent to the RDP
+ * server at its latest position. Touch events that are not such a move
+ * (the end of a contact, or any event following the end of a contact) are
+ * never combined with other events of that contact, and cannot be added to a
+ * batch already containing that contact.
+ *
+ * @param batch
+ *     The batch of touch events to add the given event to. This array must
+ *     have room for GUAC_RDP_RDPEI_MAX_TOUCHES events.
+ *
+ * @param count
+ *     A pointer to the number of touch events within the batch, which will be
+ *     updated if the given event is added to the batch.
+ *
+ * @param event
+ *     The touch event to add.
+ *
+ * @return
+ *     Non-zero if the given event was added to the batch, zero if the batch
+ *     must first be processed. Adding an event to an empty batch always
+ *     succeeds.
+ */
+static int guac_rdp_touch_batch_add(guac_rdp_input_event* batch, int* count,
+        const guac_rdp_input_event* event) {
+
+    int id = event->details.touch.id;
+
+    /* Replace any earlier position of the same contact, unless the contact
+     * has ended or is ending */
+    for (int i = 0; i < *count; i++) {
+        if (batch[i].details.touch.id == id) {
+
+            if (batch[i].details.touch.force == 0.0
+                    || event->details.touch.force == 0.0)
+                return 0;
+
+            batch[i] = *event;
+            return 1;
+
+        }
+    }
+
+    /* Otherwise, add the contact if there is room */
+    if (*count >= GUAC_RDP_RDPEI_MAX_TOUCHES)
+        return 0;
+
+    batch[(*count)++] = *event;
+    return 1;
+
+}
+
 void guac_rdp_input_event_enqueue(guac_rdp_client* rdp_client,
         const guac_rdp_input_event* input_event) {
 
@@ -250,12 +320,74 @@ void guac_rdp_input_event_enqueue(guac_rdp_client* rdp_client,
 
 }
 
+/**
+ * Returns whether the given event is a mouse event that only moves the mouse,
+ * leaving the state of all mouse buttons unchanged relative to the most
+ * recently handled mouse event.
+ *
+ * @param rdp_client
+ *     The RDP client instance that will handle the event.
+ *
+ * @param event
+ *     The event to test.
+ *
+ * @return
+ *     Non-zero if the given event only moves the mouse, zero otherwise.
+ */
+static int guac_rdp_input_event_is_move(guac_rdp_client* rdp_client,
+        const guac_rdp_input_event* event) {
+    return event->type == GUAC_RDP_INPUT_EVENT_MOUSE
+        && event->details.mouse.mask == rdp_client->mouse_button_mask;
+}
+
 void guac_rdp_handle_input_events(guac_rdp_client* rdp_client) {
 
     guac_fifo_lock(&rdp_client->input_events);
 
+    /* Consecutive moves of the same user's mouse are collapsed into the
+     * latest of those moves, such that the server need not process each
+     * intermediate position in turn. All other events, including any change
+     * in button state, are handled in order. */
+    guac_rdp_input_event pending_move;
+    int move_pending = 0;
+
+    /* Consecutive touch events are similarly collected into a single batch
+     * containing the latest position of each contact, such that all contacts
+     * are updated together */
+    guac_rdp_input_event pending_touches[GUAC_RDP_RDPEI_MAX_TOUCHES];
+    int touches_pending = 0;
+
     guac_rdp_input_event input_event;
     while (guac_fifo_timed_dequeue(&rdp_client->input_events, &input_event, 0)) {
+
+        /* Any event other than touch must follow the touches that preceded
+         * it */
+        if (touches_pending && input_event.type != GUAC_RDP_INPUT_EVENT_TOUCH) {
+            guac_rdp_handle_touch_events(rdp_client, pending_touches, touches_pending);
+            touches_pending = 0;
+        }
+
+        if (guac_rdp_input_event_is_move(rdp_client, &input_event)
+                && (!move_pending || pending_move.user == input_event.user)) {
+            pending_move = input_event;
+            move_pending = 1;
+            continue;
+        }
+
+        /* Any other event must follow the move that preceded it */
+        if (move_pending) {
+            guac_rdp_handle_mouse_event(rdp_client, &pending_move);
+            move_pending = 0;
+        }
+
+        /* A move by a different user may itself be collapsed with later
+         * moves by that user */
+        if (guac_rdp_input_event_is_move(rdp_client, &input_event)) {
+            pending_move = input_event;
+            move_pending = 1;
+            continue;
+        }
+
         switch (input_event.type) {
 
             /* Mouse event */
@@ -268,14 +400,31 @@ void guac_rdp_handle_input_events(guac_rdp_client* rdp_client) {
                 guac_rdp_handle_key_event(rdp_client, &input_event);
                 break;
 
-            /* Touch event */
+            /* Touch event (batched with consecutive touch events, sending
+             * the current batch first if the event cannot be combined) */
             case GUAC_RDP_INPUT_EVENT_TOUCH:
-                guac_rdp_handle_touch_event(rdp_client, &input_event);
+                if (!guac_rdp_touch_batch_add(pending_touches,
+                            &touches_pending, &input_event)) {
+                    guac_rdp_handle_touch_events(rdp_client, pending_touches,
+                            touches_pending);
+                    touches_pending = 0;
+                    guac_rdp_touch_batch_add(pending_touches,
+                            &touches_pending, &input_event);
+                }
                 break;
 
         }
+
     }
 
+    /* Send the final position of the mouse */
+    if (move_pending)
+        guac_rdp_handle_mouse_event(rdp_client, &pending_move);
+
+    /* Send the final position of each contact */
+    if (touches_pending)
+        guac_rdp_handle_touch_events(rdp_client, pending_touches, touches_pending);
+
     ResetEvent(rdp_client->input_event_queued);
     guac_fifo_unlock(&rdp_client->input_events);
 
@@ -25,6 +25,7 @@
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/stream.h>
+#include <guacamole/string.h>
 #include <guacamole/user.h>
 #include <winpr/file.h>
 #include <winpr/nt.h>
@@ -33,92 +34,153 @@
 #include <stdlib.h>
 #include <string.h>
 
-int guac_rdp_ls_ack_handler(guac_user* user, guac_stream* stream,
-        char* message, guac_protocol_status status) {
+/**
+ * Writes the JSON property describing the given directory entry to the
+ * listing of the given directory listing operation, skipping any entry which
+ * cannot be listed.
+ *
+ * @param user
+ *     The user receiving the directory listing.
+ *
+ * @param ls_status
+ *     The state of the directory listing operation.
+ *
+ * @param filename
+ *     The name of the directory entry, relative to the directory being
+ *     listed.
+ *
+ * @return
+ *     Zero if the entry was written or skipped, non-zero if an error prevents
+ *     the listing from continuing.
+ */
+static int guac_rdp_ls_write_entry(guac_user* user,
+        guac_rdp_ls_status* ls_status, const char* filename) {
 
-    int blob_written = 0;
-    const char* filename;
+    char absolute_path[GUAC_RDP_FS_MAX_PATH];
 
-    guac_rdp_ls_status* ls_status = (guac_rdp_ls_status*) stream->data;
+    /* Skip current and parent directory entries */
+    if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
+        return 0;
+
+    /* Concatenate into absolute path - skip if invalid */
+    if (!guac_rdp_fs_append_filename(absolute_path,
+                ls_status->directory_name, filename)) {
+
+        guac_user_log(user, GUAC_LOG_DEBUG,
+                "Skipping filename \"%s\" - filename is invalid or "
+                "resulting path is too long", filename);
 
-    /* If unsuccessful, free stream and abort */
-    if (status != GUAC_PROTOCOL_STATUS_SUCCESS) {
-        guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
-        guac_user_free_stream(user, stream);
-        guac_mem_free(ls_status);
         return 0;
     }
 
-    /* While directory entries remain */
-    while ((filename = guac_rdp_fs_read_dir(ls_status->fs,
-                    ls_status->file_id)) != NULL
-            && !blob_written) {
+    /* Attempt to open file to determine type */
+    int file_id = guac_rdp_fs_open(ls_status->fs, absolute_path,
+            GENERIC_READ, 0, FILE_OPEN, 0);
+    if (file_id < 0)
+        return 0;
 
-        char absolute_path[GUAC_RDP_FS_MAX_PATH];
+    /* Get opened file */
+    guac_rdp_fs_file* file = guac_rdp_fs_get_file(ls_status->fs, file_id);
+    if (file == NULL) {
+        guac_user_log(user, GUAC_LOG_DEBUG, "%s: Successful open produced "
+                "bad file_id: %i", __func__, file_id);
+        return 1;
+    }
 
-        /* Skip current and parent directory entries */
-        if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
-            continue;
+    /* Determine mimetype */
+    const char* mimetype;
+    if (file->attributes & FILE_ATTRIBUTE_DIRECTORY)
+        mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
+    else
+        mimetype = "application/octet-stream";
 
-        /* Concatenate into absolute path - skip if invalid */
-        if (!guac_rdp_fs_append_filename(absolute_path,
-                    ls_status->directory_name, filename)) {
+    /* Write entry */
+    guac_common_json_writer_property(&ls_status->json_writer,
+            absolute_path, mimetype);
 
-            guac_user_log(user, GUAC_LOG_DEBUG,
-                    "Skipping filename \"%s\" - filename is invalid or "
-                    "resulting path is too long", filename);
+    guac_rdp_fs_close(ls_status->fs, file_id);
+    return 0;
 
-            continue;
-        }
+}
 
-        /* Attempt to open file to determine type */
-        int file_id = guac_rdp_fs_open(ls_status->fs, absolute_path,
-                GENERIC_READ, 0, FILE_OPEN, 0);
-        if (file_id < 0)
-            continue;
-
-        /* Get opened file */
-        guac_rdp_fs_file* file = guac_rdp_fs_get_file(ls_status->fs, file_id);
-        if (file == NULL) {
-            guac_user_log(user, GUAC_LOG_DEBUG, "%s: Successful open produced "
-                    "bad file_id: %i", __func__, file_id);
-            return 0;
-        }
+/**
+ * Read handler for directory listing streams, supplying the next blob of the
+ * JSON directory object and reading further directory entries only as
+ * needed to fill that blob.
+ *
+ * @see guac_user_stream_read_handler
+ */
+static int guac_rdp_ls_read_handler(guac_user* user, guac_stream* stream,
+        void* data, char* buffer, int length) {
 
-        /* Determine mimetype */
-        const char* mimetype;
-        if (file->attributes & FILE_ATTRIBUTE_DIRECTORY)
-            mimetype = GUAC_USER_STREAM_INDEX_MIMETYPE;
-        else
-            mimetype = "application/octet-stream";
+    guac_rdp_ls_status* ls_status = (guac_rdp_ls_status*) data;
 
-        /* Write entry */
-        blob_written |= guac_common_json_write_property(user, stream,
-                &ls_status->json_state, absolute_path, mimetype);
+    /* Read directory entries until enough JSON is pending to fill a blob */
+    while (!ls_status->complete && guac_common_json_writer_pending(
+                &ls_status->json_writer) < length) {
 
-        guac_rdp_fs_close(ls_status->fs, file_id);
+        const char* filename = guac_rdp_fs_read_dir(ls_status->fs,
+                ls_status->file_id);
+
+        /* Complete JSON object at end of directory */
+        if (filename == NULL) {
+            guac_common_json_writer_end(&ls_status->json_writer);
+            ls_status->complete = 1;
+        }
+
+        else if (guac_rdp_ls_write_entry(user, ls_status, filename))
+            return -1;
 
     }
 
-    /* Complete JSON and cleanup at end of directory */
-    if (filename == NULL) {
+    return guac_common_json_writer_read(&ls_status->json_writer,
+            buffer, length);
 
-        /* Complete JSON object */
-        guac_common_json_end_object(user, stream, &ls_status->json_state);
-        guac_common_json_flush(user, stream, &ls_status->json_state);
+}
 
-        /* Clean up resources */
-        guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
-        guac_mem_free(ls_status);
+/**
+ * Complete handler for directory listing streams, releasing the directory
+ * and all listing state.
+ *
+ * @see guac_user_stream_complete_handler
+ */
+static void guac_rdp_ls_complete_handler(guac_user* user,
+        guac_stream* stream, void* data, guac_protocol_status status) {
 
-        /* Signal of stream */
-        guac_protocol_send_end(user->socket, stream);
-        guac_user_free_stream(user, stream);
+    guac_rdp_ls_status* ls_status = (guac_rdp_ls_status*) data;
+
+    guac_rdp_fs_close(ls_status->fs, ls_status->file_id);
+    guac_common_json_writer_free(&ls_status->json_writer);
+    guac_mem_free(ls_status);
+
+}
+
+guac_stream* guac_rdp_ls_alloc_stream(guac_user* user, guac_rdp_fs* fs,
+        int file_id, const char* directory_name) {
+
+    guac_stream* stream = guac_user_alloc_stream(user);
+    if (stream == NULL)
+        return NULL;
+
+    /* Create stream data */
+    guac_rdp_ls_status* ls_status = guac_mem_alloc(sizeof(guac_rdp_ls_status));
+    ls_status->fs = fs;
+    ls_status->file_id = file_id;
+    ls_status->complete = 0;
+    guac_strlcpy(ls_status->directory_name, directory_name,
+            sizeof(ls_status->directory_name));
+
+    guac_common_json_writer_init(&ls_status->json_writer);
 
+    if (guac_user_stream_windowed(user, stream, GUAC_USER_STREAM_WINDOW_SIZE,
+                guac_rdp_ls_read_handler, guac_rdp_ls_complete_handler,
+                ls_status)) {
+        guac_common_json_writer_free(&ls_status->json_writer);
+        guac_mem_free(ls_status);
+        guac_user_free_stream(user, stream);
+        return NULL;
     }
 
-    guac_socket_flush(user->socket);
-    return 0;
+    return stream;
 
 }
-
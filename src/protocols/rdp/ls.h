@@ -50,17 +50,43 @@ typedef struct guac_rdp_ls_status {
     char directory_name[GUAC_RDP_FS_MAX_PATH];
 
     /**
-     * The current state of the JSON directory object being written.
+     * The JSON directory object being written.
      */
-    guac_common_json_state json_state;
+    guac_common_json_writer json_writer;
+
+    /**
+     * Whether every entry of the directory has been written to json_writer,
+     * including the end of the JSON object.
+     */
+    int complete;
 
 } guac_rdp_ls_status;
 
 /**
- * Handler for ack messages received due to receipt of a "body" or "blob"
- * instruction associated with a directory list operation.
+ * Allocates a new stream which sends a listing of the contents of the
+ * directory having the given file ID to the given user, keeping multiple
+ * blobs in flight. The directory file ID is closed automatically once the
+ * stream ends. The caller must begin the stream with a "body" instruction
+ * once it has been returned.
+ *
+ * @param user
+ *     The user that will receive the directory listing.
+ *
+ * @param fs
+ *     The filesystem containing the directory.
+ *
+ * @param file_id
+ *     The file ID of the open directory to list.
+ *
+ * @param directory_name
+ *     The absolute path of the directory being listed.
+ *
+ * @return
+ *     The newly-allocated stream, or NULL if the stream could not be set up,
+ *     in which case the directory file ID remains open.
  */
-guac_user_ack_handler guac_rdp_ls_ack_handler;
+guac_stream* guac_rdp_ls_alloc_stream(guac_user* user, guac_rdp_fs* fs,
+        int file_id, const char* directory_name);
 
 #endif
 
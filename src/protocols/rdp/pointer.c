@@ -98,6 +98,12 @@ BOOL guac_rdp_pointer_set(rdpContext* context, POINTER_SET_CONST rdpPointer* poi
     dst_context->hint_from = src_layer;
     guac_rect_extend(&dst_context->dirty, &ptr_rect);
 
+    /* The pointer image will typically already have been sent to the client
+     * within the buffer caching that pointer, in which case the cursor can be
+     * set using a copy of that buffer rather than by sending the same image
+     * again */
+    guac_display_layer_hint_copy_from(cursor_layer, src_layer, &ptr_rect, 0, 0);
+
     guac_display_set_cursor_hotspot(rdp_client->display, pointer->xPos, pointer->yPos);
 
     guac_display_layer_close_raw(cursor_layer, dst_context);
@@ -28,6 +28,7 @@
 #include <guacamole/user.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -79,36 +80,67 @@ static void guac_rdp_print_job_set_state(guac_rdp_print_job* job,
 
 /**
  * Suspends execution of the current thread until the state of the given print
- * job is not GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK. If the state of the print
- * job is GUAC_RDP_PRINT_JOB_ACK_RECEIVED, the state is automatically reset
- * back to GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK prior to returning.
+ * job is not GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK and fewer than
+ * GUAC_RDP_PRINT_JOB_MAX_UNACKNOWLEDGED blobs remain unacknowledged. If the
+ * state of the print job is GUAC_RDP_PRINT_JOB_ACK_RECEIVED, the number of
+ * unacknowledged blobs is automatically incremented prior to returning, as
+ * the caller is expected to send exactly one blob.
  *
  * @param job
  *     The print job to wait for.
  *
  * @return
  *     Zero if the state of the print job is GUAC_RDP_PRINT_JOB_CLOSED,
- *     non-zero if the state was GUAC_RDP_PRINT_JOB_ACK_RECEIVED and has been
- *     automatically reset to GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK.
+ *     non-zero if the state is GUAC_RDP_PRINT_JOB_ACK_RECEIVED and another
+ *     blob may be sent.
  */
 static int guac_rdp_print_job_wait_for_ack(guac_rdp_print_job* job) {
 
-    /* Wait for ack if stream open and not yet received */
+    /* Wait until the stream is open and has room for another blob */
     pthread_mutex_lock(&(job->state_lock));
-    if (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK)
+    while (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK
+            || (job->state == GUAC_RDP_PRINT_JOB_ACK_RECEIVED
+                && job->unacknowledged >= GUAC_RDP_PRINT_JOB_MAX_UNACKNOWLEDGED))
         pthread_cond_wait(&job->state_modified, &job->state_lock);
 
-    /* Reset state if ack received */
+    /* Account for the blob about to be sent */
     int got_ack = (job->state == GUAC_RDP_PRINT_JOB_ACK_RECEIVED);
     if (got_ack)
-        job->state = GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK;
+        job->unacknowledged++;
 
-    /* Return whether ack was successfully received */
+    /* Return whether another blob may be sent */
     pthread_mutex_unlock(&(job->state_lock));
     return got_ack;
 
 }
 
+/**
+ * Records receipt of a successful "ack" for the given print job. The first
+ * such "ack" confirms creation of the print stream, while each further "ack"
+ * confirms receipt of a previously-sent blob. Any threads currently blocked by
+ * a call to guac_rdp_print_job_wait_for_ack() are unblocked if another blob
+ * may now be sent.
+ *
+ * @param job
+ *     The print job that received the "ack".
+ */
+static void guac_rdp_print_job_ack_received(guac_rdp_print_job* job) {
+
+    pthread_mutex_lock(&(job->state_lock));
+
+    /* Acknowledgement of stream creation */
+    if (job->state == GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK)
+        job->state = GUAC_RDP_PRINT_JOB_ACK_RECEIVED;
+
+    /* Acknowledgement of a blob */
+    else if (job->unacknowledged > 0)
+        job->unacknowledged--;
+
+    pthread_cond_signal(&(job->state_modified));
+    pthread_mutex_unlock(&(job->state_lock));
+
+}
+
 /**
  * Sends a "file" instruction to the given user describing the PDF file that
  * will be sent using the output of the given print job. If the given user no
@@ -254,7 +286,7 @@ static int guac_rdp_print_filter_ack_handler(guac_user* user,
 
     /* Update state for successful acks */
     if (status == GUAC_PROTOCOL_STATUS_SUCCESS)
-        guac_rdp_print_job_set_state(job, GUAC_RDP_PRINT_JOB_ACK_RECEIVED);
+        guac_rdp_print_job_ack_received(job);
 
     /* Terminate stream if ack signals an error */
     else {
@@ -276,29 +308,24 @@ static int guac_rdp_print_filter_ack_handler(guac_user* user,
  * Forks a new print filtering process which accepts PostScript input and
  * produces PDF output. File descriptors for writing input and reading output
  * will automatically be allocated and must be manually closed when processing
- * is complete.
+ * is complete. These file descriptors are not inherited by other processes,
+ * such that a print filter process started in advance of a print job cannot
+ * prevent the filter process of the current print job from seeing the end of
+ * its input.
  *
  * @param client
  *     The guac_client associated with the print job for which this filter
  *     process is being created.
  *
- * @param input_fd
- *     A pointer to an int which should receive the input file descriptor of
- *     the filter process. PostScript input for the filter process should be
- *     written to this file descriptor.
- *
- * @param output_fd
- *     A pointer to an int which should receive the output file descriptor of
- *     the filter process. PDF output from the filter process must be
- *     continuously read from this file descriptor or the pipeline may block.
- *
  * @return
- *     The PID of the filter process, or -1 if the filter process could not be
- *     created. If the filter process could not be created, the values assigned
- *     through input_fd and output_fd are undefined.
+ *     A newly-allocated guac_rdp_print_filter describing the new filter
+ *     process and its file descriptors, or NULL if the filter process could
+ *     not be created. PDF output from the filter process must be
+ *     continuously read from the output file descriptor or the pipeline may
+ *     block.
  */
-static pid_t guac_rdp_create_filter_process(guac_client* client,
-        int* input_fd, int* output_fd) {
+static guac_rdp_print_filter* guac_rdp_create_filter_process(
+        guac_client* client) {
 
     int child_pid;
     int stdin_pipe[2];
@@ -308,7 +335,7 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
     if (pipe(stdin_pipe)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Unable to create STDIN "
                 "pipe for PDF filter process: %s", strerror(errno));
-        return -1;
+        return NULL;
     }
 
     /* Create STDOUT pipe */
@@ -317,12 +344,13 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
                 "pipe for PDF filter process: %s", strerror(errno));
         close(stdin_pipe[0]);
         close(stdin_pipe[1]);
-        return -1;
+        return NULL;
     }
 
-    /* Store parent side of stdin/stdout */
-    *input_fd = stdin_pipe[1];
-    *output_fd = stdout_pipe[0];
+    /* Parent side of stdin/stdout must not be inherited by any other filter
+     * process */
+    fcntl(stdin_pipe[1], F_SETFD, FD_CLOEXEC);
+    fcntl(stdout_pipe[0], F_SETFD, FD_CLOEXEC);
 
     /* Fork child process */
     child_pid = fork();
@@ -335,7 +363,7 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
         close(stdin_pipe[1]);
         close(stdout_pipe[0]);
         close(stdout_pipe[1]);
-        return -1;
+        return NULL;
     }
 
     /* Child process */
@@ -372,7 +400,64 @@ static pid_t guac_rdp_create_filter_process(guac_client* client,
     /* Close unneeded ends of pipe */
     close(stdin_pipe[0]);
     close(stdout_pipe[1]);
-    return child_pid;
+
+    /* Store parent side of stdin/stdout */
+    guac_rdp_print_filter* filter = guac_mem_alloc(sizeof(guac_rdp_print_filter));
+    filter->pid = child_pid;
+    filter->input_fd = stdin_pipe[1];
+    filter->output_fd = stdout_pipe[0];
+    return filter;
+
+}
+
+void guac_rdp_print_filter_free(guac_rdp_print_filter* filter) {
+
+    /* Nothing to stop if there is no filter process */
+    if (filter == NULL)
+        return;
+
+    kill(filter->pid, SIGKILL);
+    close(filter->input_fd);
+    close(filter->output_fd);
+    guac_mem_free(filter);
+
+}
+
+/**
+ * Returns a print filter process for a new print job, using the filter
+ * process kept ready by the previous print job if available. A new filter
+ * process is started to replace the one returned, such that the next print
+ * job need not wait for its filter process to start. Ghostscript must load
+ * and initialize its own resources each time it starts, and this cost is thus
+ * paid while the previous print job is idle rather than while the next print
+ * job is waiting.
+ *
+ * @param client
+ *     The guac_client associated with the print job for which a filter
+ *     process is needed.
+ *
+ * @return
+ *     A newly-allocated guac_rdp_print_filter describing the filter process
+ *     that should be used by the new print job, or NULL if no filter process
+ *     could be created.
+ */
+static guac_rdp_print_filter* guac_rdp_take_filter_process(
+        guac_client* client) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    /* Use the idle filter process, if any */
+    guac_rdp_print_filter* filter = rdp_client->idle_print_filter;
+    if (filter == NULL)
+        filter = guac_rdp_create_filter_process(client);
+
+    /* Keep another filter process ready for the next print job (failure to
+     * do so is not fatal, as that job can still start its own) */
+    rdp_client->idle_print_filter = NULL;
+    if (filter != NULL)
+        rdp_client->idle_print_filter = guac_rdp_create_filter_process(client);
+
+    return filter;
 
 }
 
@@ -454,6 +539,9 @@ void* guac_rdp_print_job_alloc(guac_user* user, void* data) {
     if (stream == NULL)
         return NULL;
 
+    /* Print jobs receive only bandwidth not needed by the display */
+    stream->priority = GUAC_SOCKET_PRIORITY_BULK;
+
     /* Bail early if allocation fails */
     guac_rdp_print_job* job = guac_mem_alloc(sizeof(guac_rdp_print_job));
     if (job == NULL)
@@ -472,19 +560,24 @@ void* guac_rdp_print_job_alloc(guac_user* user, void* data) {
     stream->ack_handler = guac_rdp_print_filter_ack_handler;
     stream->data = job;
 
-    /* Create print filter process */
-    job->filter_pid = guac_rdp_create_filter_process(job->client,
-            &job->input_fd, &job->output_fd);
+    /* Obtain print filter process */
+    guac_rdp_print_filter* filter = guac_rdp_take_filter_process(job->client);
 
     /* Abort if print filter process cannot be created */
-    if (job->filter_pid == -1) {
+    if (filter == NULL) {
         guac_user_free_stream(user, stream);
         guac_mem_free(job);
         return NULL;
     }
 
+    job->filter_pid = filter->pid;
+    job->input_fd = filter->input_fd;
+    job->output_fd = filter->output_fd;
+    guac_mem_free(filter);
+
     /* Init stream state signal and lock */
     job->state = GUAC_RDP_PRINT_JOB_WAITING_FOR_ACK;
+    job->unacknowledged = 0;
     pthread_cond_init(&job->state_modified, NULL);
     pthread_mutex_init(&job->state_lock, NULL);
 
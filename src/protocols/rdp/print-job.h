@@ -45,6 +45,39 @@
  */
 #define GUAC_RDP_PRINT_JOB_TITLE_SEARCH_LENGTH 2048
 
+/**
+ * The maximum number of blobs of PDF output that may be sent along the print
+ * stream without yet having been acknowledged by the Guacamole client.
+ * Allowing several blobs to be in flight at once avoids limiting the rate
+ * that print output is streamed to a single blob per round trip.
+ */
+#define GUAC_RDP_PRINT_JOB_MAX_UNACKNOWLEDGED 16
+
+/**
+ * A print filter process which converts PostScript data into PDF, along with
+ * the file descriptors used to communicate with that process.
+ */
+typedef struct guac_rdp_print_filter {
+
+    /**
+     * The PID of the print filter process.
+     */
+    pid_t pid;
+
+    /**
+     * File descriptor that should be written to when sending PostScript data
+     * to the print filter process.
+     */
+    int input_fd;
+
+    /**
+     * File descriptor that should be read from when receiving PDF output from
+     * the print filter process.
+     */
+    int output_fd;
+
+} guac_rdp_print_filter;
+
 /**
  * The current state of an RDP print job.
  */
@@ -59,8 +92,8 @@ typedef enum guac_rdp_print_job_state {
     /**
      * The print stream has been opened with the Guacamole client, and the
      * client has responded with an "ack", confirming that it is ready to
-     * receive data (or that data has been received and it is ready to receive
-     * more).
+     * receive data. Data may be sent so long as fewer than
+     * GUAC_RDP_PRINT_JOB_MAX_UNACKNOWLEDGED blobs remain unacknowledged.
      */
     GUAC_RDP_PRINT_JOB_ACK_RECEIVED,
 
@@ -125,14 +158,20 @@ typedef struct guac_rdp_print_job {
     guac_rdp_print_job_state state;
 
     /**
-     * Lock which is acquired prior to modifying the state property or waiting
-     * on the state_modified conditional.
+     * The number of blobs which have been sent along the print stream but
+     * have not yet been acknowledged by the Guacamole client.
+     */
+    int unacknowledged;
+
+    /**
+     * Lock which is acquired prior to modifying the state or unacknowledged
+     * properties or waiting on the state_modified conditional.
      */
     pthread_mutex_t state_lock;
 
     /**
-     * Conditional which signals modification to the state property of this
-     * structure.
+     * Conditional which signals modification to the state or unacknowledged
+     * properties of this structure.
      */
     pthread_cond_t state_modified;
 
@@ -171,7 +210,21 @@ typedef struct guac_rdp_print_blob {
 } guac_rdp_print_blob;
 
 /**
- * Allocates a new print job for the given user. It is expected that this
+ * Stops the given print filter process, closing its file descriptors, and
+ * frees the associated guac_rdp_print_filter. This is used to clean up the
+ * print filter process which is kept ready for the next print job.
+ *
+ * @param filter
+ *     The print filter process to stop and free, or NULL if there is no such
+ *     process.
+ */
+void guac_rdp_print_filter_free(guac_rdp_print_filter* filter);
+
+/**
+ * Allocates a new print job for the given user. The print filter process
+ * kept ready by the previous print job is used if available, and a new print
+ * filter process is started in its place such that later print jobs need not
+ * wait for the print filter to start. It is expected that this
  * function will be invoked via a call to guac_client_for_user() or
  * guac_client_for_owner().
  *
@@ -19,6 +19,7 @@
 
 #include "argv.h"
 #include "beep.h"
+#include "bitmap.h"
 #include "channels/audio-input/audio-buffer.h"
 #include "channels/audio-input/audio-input.h"
 #include "channels/cliprdr.h"
@@ -206,6 +207,19 @@ static BOOL rdp_freerdp_pre_connect(freerdp* instance) {
     pointer.SetDefault = guac_rdp_pointer_set_default;
     graphics_register_pointer(graphics, &pointer);
 
+    /* Mirror frequently-drawn cached bitmaps within off-screen buffers,
+     * retaining the GDI's own handling of those bitmaps */
+    rdp_client->gdi_bitmap = *graphics->Bitmap_Prototype;
+    rdpBitmap bitmap = *graphics->Bitmap_Prototype;
+    bitmap.size = sizeof(guac_rdp_bitmap);
+    bitmap.New = guac_rdp_bitmap_new;
+    bitmap.Free = guac_rdp_bitmap_free;
+    graphics_register_bitmap(graphics, &bitmap);
+
+    rdpPrimaryUpdate* primary = GUAC_RDP_CONTEXT(instance)->update->primary;
+    rdp_client->gdi_memblt = primary->MemBlt;
+    primary->MemBlt = guac_rdp_bitmap_memblt;
+
     /* Beep on receipt of Play Sound PDU */
     GUAC_RDP_CONTEXT(instance)->update->PlaySound = guac_rdp_beep_play_sound;
 
@@ -228,6 +242,8 @@ static BOOL rdp_freerdp_pre_connect(freerdp* instance) {
         rdp_freerdp_load_channels(instance);
     #endif
 
+    guac_client_startup_phase(client, "rdp_pre_connect");
+
     return TRUE;
 }
 
@@ -268,6 +284,10 @@ static BOOL rdp_freerdp_authenticate(freerdp* instance, char** username,
     guac_rdp_settings* settings = rdp_client->settings;
     char* params[4] = {NULL};
     int i = 0;
+
+    /* FreeRDP requests credentials only after the TCP connection and any
+     * TLS handshake */
+    guac_client_startup_phase(client, "rdp_negotiate");
     
     /* If the client does not support the "required" instruction, warn and
      * quit.
@@ -309,6 +329,7 @@ static BOOL rdp_freerdp_authenticate(freerdp* instance, char** username,
         /* Send required parameters to the owner and wait for the response. */
         guac_client_owner_send_required(client, (const char**) params);
         guac_argv_await((const char**) params);
+        guac_client_startup_phase(client, "credentials");
         
         /* Free old values and get new values from settings. */
         guac_mem_free(*username);
@@ -409,6 +430,10 @@ static DWORD rdp_freerdp_verify_certificate(freerdp* instance,
     guac_rdp_client* rdp_client =
         (guac_rdp_client*) client->data;
 
+    /* Certificates are verified by FreeRDP only once the TLS handshake has
+     * completed, and only if the certificate is not otherwise trusted */
+    guac_client_startup_phase(client, "tls_handshake");
+
     /* Bypass validation if ignore_certificate given */
     if (rdp_client->settings->ignore_certificate) {
         guac_client_log(client, GUAC_LOG_INFO, "Certificate validation bypassed");
@@ -442,7 +467,14 @@ static int rdp_guac_client_wait_for_events(guac_client* client,
     HANDLE handles[GUAC_RDP_MAX_FILE_DESCRIPTORS];
     int num_handles = 0;
 
-    handles[num_handles++] = rdp_client->input_event_queued;
+    /* Input events are handled here only if there is no dedicated thread to
+     * handle them as they arrive */
+    if (!rdp_client->input_thread_running)
+        handles[num_handles++] = rdp_client->input_event_queued;
+
+    /* Static virtual channel data awaiting flush is always flushed by the
+     * RDP client thread */
+    handles[num_handles++] = rdp_client->svc_data_queued;
 
     num_handles += freerdp_get_event_handles(GUAC_RDP_CONTEXT(rdp_inst),
             handles + num_handles, GUAC_RDP_MAX_FILE_DESCRIPTORS - num_handles);
@@ -451,7 +483,10 @@ static int rdp_guac_client_wait_for_events(guac_client* client,
     DWORD result = WaitForMultipleObjects(num_handles, handles, FALSE,
             timeout_msecs);
 
-    ResetEvent(rdp_client->input_event_queued);
+    if (!rdp_client->input_thread_running)
+        ResetEvent(rdp_client->input_event_queued);
+
+    ResetEvent(rdp_client->svc_data_queued);
 
     /* Translate WaitForMultipleObjects() return values */
     switch (result) {
@@ -495,6 +530,91 @@ static int guac_rdp_handle_events(guac_rdp_client* rdp_client) {
 
 }
 
+/**
+ * Attempts to resume an RDP session whose connection has been unexpectedly
+ * lost, making up to GUAC_RDP_AUTO_RECONNECT_ATTEMPTS attempts. FreeRDP
+ * reconnects in place, presenting the auto-reconnect cookie previously
+ * provided by the RDP server rather than performing full authentication, and
+ * keeping the existing GDI. As the guac_display retains the last frame sent
+ * to users, only the regions that actually differ after the server repaints
+ * are sent once the session has resumed.
+ *
+ * @param client
+ *     The guac_client associated with the RDP session.
+ *
+ * @param rdp_inst
+ *     The FreeRDP instance whose connection was lost.
+ *
+ * @return
+ *     Non-zero if the session was successfully resumed, zero otherwise.
+ */
+static int guac_rdp_resume_session(guac_client* client, freerdp* rdp_inst) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) client->data;
+
+    /* Do not attempt to resume sessions that the server itself ended */
+    if (freerdp_error_info(rdp_inst) != 0)
+        return 0;
+
+    for (int attempt = 1; attempt <= GUAC_RDP_AUTO_RECONNECT_ATTEMPTS; attempt++) {
+
+        if (client->state != GUAC_CLIENT_RUNNING)
+            return 0;
+
+        guac_client_log(client, GUAC_LOG_INFO, "Connection to RDP server "
+                "lost. Attempting to resume session (attempt %i of %i)...",
+                attempt, GUAC_RDP_AUTO_RECONNECT_ATTEMPTS);
+
+        pthread_mutex_lock(&(rdp_client->message_lock));
+        BOOL resumed = freerdp_reconnect(rdp_inst);
+        pthread_mutex_unlock(&(rdp_client->message_lock));
+
+        if (resumed) {
+            guac_client_log(client, GUAC_LOG_INFO, "RDP session resumed.");
+            return 1;
+        }
+
+        guac_timestamp_msleep(GUAC_RDP_AUTO_RECONNECT_INTERVAL);
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Sends each input event to the RDP server as soon as it has been queued,
+ * independently of the RDP client thread, until the input_thread_running flag
+ * of the given guac_rdp_client is cleared. Each event is still sent under
+ * message_lock, and thus only ever between the calls that the RDP client
+ * thread makes to handle inbound messages, but need not wait for all pending
+ * inbound messages to be handled.
+ *
+ * @param data
+ *     The guac_rdp_client of the RDP connection whose input events should be
+ *     handled.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_input_thread(void* data) {
+
+    guac_rdp_client* rdp_client = (guac_rdp_client*) data;
+
+    while (rdp_client->input_thread_running) {
+
+        if (WaitForSingleObject(rdp_client->input_event_queued,
+                    GUAC_RDP_MESSAGE_CHECK_INTERVAL) == WAIT_FAILED)
+            break;
+
+        guac_rdp_handle_input_events(rdp_client);
+
+    }
+
+    return NULL;
+
+}
+
 /**
  * Connects to an RDP server as described by the guac_rdp_settings structure
  * associated with the given client, allocating and freeing all objects
@@ -526,6 +646,8 @@ static int guac_rdp_handle_connection(guac_client* client) {
 
     /* Create display */
     rdp_client->display = guac_display_alloc(client);
+    guac_display_set_worker_threads(rdp_client->display,
+            settings->min_display_workers, settings->max_display_workers);
 
     guac_display_layer* default_layer = guac_display_default_layer(rdp_client->display);
     guac_display_layer_resize(default_layer, rdp_client->settings->width, rdp_client->settings->height);
@@ -586,11 +708,16 @@ static int guac_rdp_handle_connection(guac_client* client) {
     guac_rwlock_acquire_read_lock(&(rdp_client->lock));
 
     /* Connect to RDP server */
+    guac_client_startup_phase(client, "rdp_setup");
     if (!freerdp_connect(rdp_inst)) {
         guac_rdp_client_abort(client, rdp_inst);
         goto fail;
     }
 
+    /* FreeRDP does not expose the remainder of the connection sequence
+     * (NLA, licensing, capability exchange) separately */
+    guac_client_startup_phase(client, "rdp_connect");
+
     /* Upgrade to write lock again for further exclusive operations */
     guac_rwlock_release_lock(&(rdp_client->lock));
     guac_rwlock_acquire_write_lock(&(rdp_client->lock));
@@ -605,6 +732,21 @@ static int guac_rdp_handle_connection(guac_client* client) {
 
     rdp_client->render_thread = guac_display_render_thread_create(rdp_client->display);
 
+    /* Send input events from their own thread, if requested, falling back to
+     * handling input within the RDP client thread if that is not possible */
+    if (settings->enable_input_thread) {
+        rdp_client->input_thread_running = 1;
+        if (pthread_create(&(rdp_client->input_thread), NULL,
+                    guac_rdp_input_thread, rdp_client)) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Unable to start "
+                    "dedicated input thread. Input events will be handled "
+                    "by the RDP client thread.");
+            rdp_client->input_thread_running = 0;
+        }
+    }
+
+    guac_client_startup_complete(client);
+
     /* Handle messages from RDP server while client is running */
     while (client->state == GUAC_CLIENT_RUNNING
             && !guac_rdp_disp_reconnect_needed(rdp_client->disp)) {
@@ -636,6 +778,10 @@ static int guac_rdp_handle_connection(guac_client* client) {
         } while (!connection_closing &&
                 (wait_result = rdp_guac_client_wait_for_events(client, 0)) > 0);
 
+        /* Send any static virtual channel data aggregated while handling
+         * events/messages */
+        guac_rdp_pipe_svc_flush(client);
+
         /* Notify display of any changes to the GDI that may have occurred
          * while handling events/messages */
         if (rdp_client->gdi_modified) {
@@ -643,20 +789,32 @@ static int guac_rdp_handle_connection(guac_client* client) {
             rdp_client->gdi_modified = 0;
         }
 
-        /* Handle any input events that have been received */
-        guac_rdp_handle_input_events(rdp_client);
+        /* Handle any input events that have been received, unless already
+         * handled by the dedicated input thread */
+        if (!rdp_client->input_thread_running)
+            guac_rdp_handle_input_events(rdp_client);
 
         /* Close connection cleanly if server is disconnecting */
         if (connection_closing)
             guac_rdp_client_abort(client, rdp_inst);
 
-        /* If a low-level connection error occurred, fail */
-        else if (wait_result < 0)
+        /* If a low-level connection error occurred, fail unless the session
+         * can be resumed */
+        else if (wait_result < 0 && !guac_rdp_resume_session(client, rdp_inst))
             guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_UNAVAILABLE,
                     "Connection closed.");
 
     }
 
+    /* Stop the dedicated input thread, if any, before acquiring the write
+     * lock required by the remaining cleanup (handling of input events
+     * requires the read lock) */
+    if (rdp_client->input_thread_running) {
+        rdp_client->input_thread_running = 0;
+        SetEvent(rdp_client->input_event_queued);
+        pthread_join(rdp_client->input_thread, NULL);
+    }
+
     guac_rwlock_acquire_write_lock(&(rdp_client->lock));
 
     /* Clean up print job, if active */
@@ -737,7 +895,7 @@ void* guac_rdp_client_thread(void* data) {
          */
         if (settings->wol_wait_time > 0) {
             guac_client_log(client, GUAC_LOG_DEBUG, "Sending Wake-on-LAN packet, "
-                    "and pausing for %d seconds.", settings->wol_wait_time);
+                    "and waiting for the remote system to respond.");
 
             /* char representation of a port should be, at most, 5 digits plus terminator. */
             char* str_port = guac_mem_alloc(6);
@@ -747,8 +905,9 @@ void* guac_rdp_client_thread(void* data) {
                 return NULL;
             }
 
-            /* Send the Wake-on-LAN request and wait until the server is responsive. */
-            if (guac_wol_wake_and_wait(settings->wol_mac_addr,
+            /* Send the Wake-on-LAN request and wait until the server is
+             * responsive, keeping users informed while waiting. */
+            if (guac_wol_wake_and_probe(client, settings->wol_mac_addr,
                     settings->wol_broadcast_addr,
                     settings->wol_udp_port,
                     settings->wol_wait_time,
@@ -787,6 +946,12 @@ void* guac_rdp_client_thread(void* data) {
             guac_client_log(client, GUAC_LOG_INFO,
                     "No available audio encoding. Sound disabled.");
 
+        /* Otherwise, apply any requested compression parameters */
+        else {
+            rdp_client->audio->bitrate = settings->audio_bitrate;
+            rdp_client->audio->frame_duration = settings->audio_frame_duration;
+        }
+
     } /* end if audio enabled */
 
     /* Load filesystem if drive enabled */
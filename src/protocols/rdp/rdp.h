@@ -23,7 +23,9 @@
 #include "channels/audio-input/audio-buffer.h"
 #include "channels/cliprdr.h"
 #include "channels/disp.h"
+#include "channels/rail.h"
 #include "channels/rdpei.h"
+#include "channels/rdpgfx.h"
 #include "common/clipboard.h"
 #include "common/list.h"
 #include "config.h"
@@ -42,6 +44,8 @@
 #include <freerdp/codec/color.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/client/rail.h>
+#include <freerdp/graphics.h>
+#include <freerdp/primary.h>
 #include <guacamole/audio.h>
 #include <guacamole/client.h>
 #include <guacamole/display.h>
@@ -135,9 +139,10 @@ typedef struct guac_rdp_client {
 
     /**
      * Queue of mouse, keyboard, and touch events. These events are accumulated
-     * and flushed within the RDP client thread to avoid spending excessive
-     * time within Guacamole's event handlers. If an attempt to send an RDP
-     * event to the RDP server takes a noticable amount of time, that time will
+     * and flushed within the RDP client thread (or within input_thread, if
+     * enabled) to avoid spending excessive time within Guacamole's event
+     * handlers. If an attempt to send an RDP event to the RDP server takes a
+     * noticable amount of time, that time will
      * otherwise block handling of Guacamole events, including critical events
      * like "sync" (resulting in miscalculation of processing lag).
      */
@@ -155,6 +160,20 @@ typedef struct guac_rdp_client {
      */
     HANDLE input_event_queued;
 
+    /**
+     * The thread which sends queued input events to the RDP server as soon as
+     * they are received, if the "enable-input-thread" parameter is set. This
+     * thread only exists while input_thread_running is non-zero.
+     */
+    pthread_t input_thread;
+
+    /**
+     * Non-zero if input_thread has been started and should continue handling
+     * input events, zero if input events are instead handled by the RDP client
+     * thread between batches of inbound messages.
+     */
+    int input_thread_running;
+
     /**
      * The current state of the keyboard with respect to the RDP session.
      */
@@ -185,6 +204,13 @@ typedef struct guac_rdp_client {
      */
     guac_rdp_print_job* active_job;
 
+    /**
+     * A print filter process which has been started in advance and is ready
+     * to receive the data of the next print job, or NULL if no such process
+     * is running.
+     */
+    guac_rdp_print_filter* idle_print_filter;
+
 #ifdef ENABLE_COMMON_SSH
     /**
      * The user and credentials used to authenticate for SFTP.
@@ -218,11 +244,25 @@ typedef struct guac_rdp_client {
      */
     guac_rdp_rdpei* rdpei;
 
+    /**
+     * Graphics Pipeline support module (RDPGFX).
+     */
+    guac_rdp_rdpgfx* rdpgfx;
+
     /**
      * List of all available static virtual channels.
      */
     guac_common_list* available_svc;
 
+    /**
+     * FreeRDP event handle that is set with SetEvent() when data aggregated
+     * within any static virtual channel is awaiting a call to
+     * guac_rdp_pipe_svc_flush(). This event handle is cleared with
+     * ResetEvent() each time the RDP client thread waits for events, prior to
+     * that thread invoking guac_rdp_pipe_svc_flush().
+     */
+    HANDLE svc_data_queued;
+
     /**
      * Common attributes for locks.
      */
@@ -248,6 +288,24 @@ typedef struct guac_rdp_client {
      */
     RailClientContext* rail_interface;
 
+    /**
+     * The last known position and size of each RAIL window, used to
+     * recognize when a window has merely moved.
+     */
+    guac_rdp_rail_window rail_windows[GUAC_RDP_RAIL_MAX_WINDOWS];
+
+    /**
+     * The bitmap prototype originally registered by FreeRDP's GDI, whose
+     * handlers are invoked by the handlers that mirror cached bitmaps within
+     * off-screen buffers (see bitmap.h).
+     */
+    rdpBitmap gdi_bitmap;
+
+    /**
+     * The MemBlt handler originally installed by FreeRDP's GDI.
+     */
+    pMemBlt gdi_memblt;
+
 } guac_rdp_client;
 
 /**
@@ -309,7 +367,9 @@ void guac_rdp_input_event_enqueue(guac_rdp_client* rdp_client,
  * Processes all events that have been enqueued with
  * guac_rdp_input_event_enqueue(), clearing the event queue and the state of
  * the input_event_queued handle. Events are processed in the order they are
- * received.
+ * received, except that consecutive mouse movements by the same user that do
+ * not change the state of any mouse button are collapsed into the last of
+ * those movements.
  *
  * @param rdp_client
  *     The RDP client instance whose queued input events should be processed.
@@ -18,6 +18,7 @@
  */
 
 #include "argv.h"
+#include "client.h"
 #include "common/defaults.h"
 #include "common/string.h"
 #include "config.h"
@@ -25,6 +26,7 @@
 #include "resolution.h"
 #include "settings.h"
 
+#include <freerdp/codec/h264.h>
 #include <freerdp/constants.h>
 #include <freerdp/settings.h>
 #include <freerdp/freerdp.h>
@@ -66,6 +68,8 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "initial-program",
     "color-depth",
     "disable-audio",
+    "audio-bitrate",
+    "audio-frame-duration",
     "enable-printing",
     "printer-name",
     "enable-drive",
@@ -86,6 +90,7 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "remote-app-dir",
     "remote-app-args",
     "static-channels",
+    "enable-static-channel-aggregation",
     "client-name",
     "enable-wallpaper",
     "enable-theming",
@@ -97,6 +102,7 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "disable-offscreen-caching",
     "disable-glyph-caching",
     "disable-gfx",
+    "enable-h264-passthrough",
     "preconnection-id",
     "preconnection-blob",
     "timezone",
@@ -130,6 +136,7 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "resize-method",
     "enable-audio-input",
     "enable-touch",
+    "enable-input-thread",
     "read-only",
 
     "gateway-hostname",
@@ -151,6 +158,8 @@ const char* GUAC_RDP_CLIENT_ARGS[] = {
     "wol-wait-time",
 
     "force-lossless",
+    "min-display-workers",
+    "max-display-workers",
     "normalize-clipboard",
     NULL
 };
@@ -225,6 +234,21 @@ enum RDP_ARGS_IDX {
      */
     IDX_DISABLE_AUDIO,
 
+    /**
+     * The bitrate, in bits per second, that compressed audio sent to the user
+     * should target, or blank to use the default bitrate of the audio encoder.
+     * Raw PCM audio is unaffected.
+     */
+    IDX_AUDIO_BITRATE,
+
+    /**
+     * The duration of audio, in milliseconds, that should be encoded within
+     * each compressed audio frame sent to the user, or blank to use the
+     * default frame duration of the audio encoder. Shorter frames reduce
+     * latency at the cost of bandwidth.
+     */
+    IDX_AUDIO_FRAME_DURATION,
+
     /**
      * "true" if printing should be enabled, "false" or blank otherwise.
      */
@@ -348,6 +372,14 @@ enum RDP_ARGS_IDX {
      */
     IDX_STATIC_CHANNELS,
 
+    /**
+     * "true" if data sent along static virtual channels should be aggregated,
+     * sending many small messages within fewer, larger blobs and channel
+     * writes at the expense of message boundaries, "false" or blank if each
+     * message should be sent individually.
+     */
+    IDX_ENABLE_STATIC_CHANNEL_AGGREGATION,
+
     /**
      * The name of the client to submit to the RDP server upon connection.
      */
@@ -419,6 +451,14 @@ enum RDP_ARGS_IDX {
      */
     IDX_DISABLE_GFX,
 
+    /**
+     * "true" if H.264 video received via the RDP Graphics Pipeline Extension
+     * should be forwarded as-is to users that support H.264, rather than
+     * decoded and re-encoded as images, "false" or blank otherwise. This has
+     * no effect if the Graphics Pipeline Extension is disabled.
+     */
+    IDX_ENABLE_H264_PASSTHROUGH,
+
     /**
      * The preconnection ID to send within the preconnection PDU when
      * initiating an RDP connection, if any.
@@ -611,6 +651,14 @@ enum RDP_ARGS_IDX {
      */
     IDX_ENABLE_TOUCH,
 
+    /**
+     * "true" if input events should be sent to the RDP server from a
+     * dedicated thread as soon as they are received, rather than only between
+     * batches of messages handled by the RDP client thread, "false" or blank
+     * otherwise.
+     */
+    IDX_ENABLE_INPUT_THREAD,
+
     /**
      * "true" if this connection should be read-only (user input should be
      * dropped), "false" or blank otherwise.
@@ -719,6 +767,21 @@ enum RDP_ARGS_IDX {
      */
     IDX_FORCE_LOSSLESS,
 
+    /**
+     * The fewest worker threads that should be kept running to encode the
+     * graphical updates of this connection while the display is idle. If
+     * omitted, a single worker thread is kept running.
+     */
+    IDX_MIN_DISPLAY_WORKERS,
+
+    /**
+     * The most worker threads that may be used to encode the graphical updates
+     * of this connection. Worker threads are added as updates back up, up to
+     * this limit. If omitted, the limit is the number of worker threads guacd
+     * is configured to use for each connection.
+     */
+    IDX_MAX_DISPLAY_WORKERS,
+
     /**
      * Controls whether the text content of the clipboard should be
      * automatically normalized to use a particular line ending format. Valid
@@ -904,6 +967,15 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_FORCE_LOSSLESS, 0);
 
+    /* Bounds on display worker threads */
+    settings->min_display_workers =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_MIN_DISPLAY_WORKERS, 0);
+
+    settings->max_display_workers =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_MAX_DISPLAY_WORKERS, 0);
+
     /* Domain */
     settings->domain =
         guac_user_parse_args_string(user, GUAC_RDP_CLIENT_ARGS, argv,
@@ -954,6 +1026,11 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
     if (argv[IDX_STATIC_CHANNELS][0] != '\0')
         settings->svc_names = guac_split(argv[IDX_STATIC_CHANNELS], ',');
 
+    /* Static virtual channel aggregation */
+    settings->svc_aggregation_enabled =
+        guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_ENABLE_STATIC_CHANNEL_AGGREGATION, 0);
+
     /*
      * Performance flags
      */
@@ -1042,6 +1119,17 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         !guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_DISABLE_AUDIO, 0);
 
+    /* Bitrate of compressed audio (zero for encoder default) */
+    settings->audio_bitrate =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_AUDIO_BITRATE, 0);
+
+    /* Duration of each audio frame or packet (zero for client hint or
+     * encoder default) */
+    settings->audio_frame_duration =
+        guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_AUDIO_FRAME_DURATION, 0);
+
     /* Printing enable/disable */
     settings->printing_enabled =
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
@@ -1245,6 +1333,11 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         !guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_DISABLE_GFX, 0);
 
+    /* H.264 passthrough enable/disable (requires the Graphics Pipeline) */
+    settings->enable_h264_passthrough = settings->enable_gfx
+        && guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_ENABLE_H264_PASSTHROUGH, 0);
+
     /* Session color depth */
     settings->color_depth =
         guac_user_parse_args_int(user, GUAC_RDP_CLIENT_ARGS, argv,
@@ -1255,6 +1348,11 @@ guac_rdp_settings* guac_rdp_parse_args(guac_user* user,
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
                 IDX_ENABLE_TOUCH, 0);
 
+    /* Dedicated input thread enable/disable */
+    settings->enable_input_thread =
+        guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
+                IDX_ENABLE_INPUT_THREAD, 0);
+
     /* Audio input enable/disable */
     settings->enable_audio_input =
         guac_user_parse_args_boolean(user, GUAC_RDP_CLIENT_ARGS, argv,
@@ -1527,6 +1625,74 @@ int guac_rdp_get_depth(freerdp* rdp) {
 #endif
 }
 
+/**
+ * Returns whether FreeRDP is able to decode H.264 within the current
+ * environment. FreeRDP may have been built without any H.264 decoder, or the
+ * decoders it was built with (OpenH264, FFmpeg, etc.) may not be loadable, in
+ * which case H.264 must not be offered to the RDP server.
+ *
+ * @return
+ *     Non-zero if FreeRDP can decode H.264, zero otherwise.
+ */
+static int guac_rdp_h264_decoder_available() {
+
+    H264_CONTEXT* h264 = h264_context_new(FALSE);
+    if (h264 == NULL)
+        return 0;
+
+    h264_context_free(h264);
+    return 1;
+
+}
+
+/**
+ * Determines which codecs should be offered to the RDP server when the RDP
+ * Graphics Pipeline is in use. Planar and progressive RemoteFX are always
+ * offered, as both are inexpensive to decode. H.264 (AVC420) is offered only
+ * if FreeRDP can decode it and lossless updates have not been forced, as every
+ * H.264 frame is decoded and re-encoded unless passed through to users as-is.
+ * AVC444 roughly doubles the cost of decoding and cannot be passed through, so
+ * it is offered only when H.264 passthrough is disabled. This is evaluated
+ * each time settings are pushed to FreeRDP, including when reconnecting.
+ *
+ * @param client
+ *     The guac_client associated with the RDP connection.
+ *
+ * @param guac_settings
+ *     The settings of the RDP connection.
+ *
+ * @param avc420
+ *     Pointer to an int that should receive whether AVC420 should be offered.
+ *
+ * @param avc444
+ *     Pointer to an int that should receive whether AVC444 should be offered.
+ */
+static void guac_rdp_choose_gfx_codecs(guac_client* client,
+        guac_rdp_settings* guac_settings, int* avc420, int* avc444) {
+
+    *avc420 = 0;
+    *avc444 = 0;
+
+    if (guac_settings->lossless) {
+        guac_client_log(client, GUAC_LOG_DEBUG, "H.264 will not be offered "
+                "to the RDP server as lossless updates are required.");
+        return;
+    }
+
+    if (!guac_rdp_h264_decoder_available()) {
+        guac_client_log(client, GUAC_LOG_DEBUG, "H.264 will not be offered "
+                "to the RDP server as FreeRDP has no usable H.264 decoder.");
+        return;
+    }
+
+    *avc420 = 1;
+    *avc444 = !guac_settings->enable_h264_passthrough;
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Offering H.264 (AVC420%s) to "
+            "the RDP server.", *avc444 ? " and AVC444" : "");
+
+}
+
 void guac_rdp_push_settings(guac_client* client,
         guac_rdp_settings* guac_settings, freerdp* rdp) {
 
@@ -1571,6 +1737,15 @@ void guac_rdp_push_settings(guac_client* client,
         freerdp_settings_set_bool(rdp_settings, FreeRDP_SupportGraphicsPipeline, TRUE);
         freerdp_settings_set_bool(rdp_settings, FreeRDP_RemoteFxCodec, TRUE);
 
+        /* Offer only the codecs that can be handled efficiently */
+        int avc420, avc444;
+        guac_rdp_choose_gfx_codecs(client, guac_settings, &avc420, &avc444);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_GfxProgressive, TRUE);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_GfxPlanar, TRUE);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_GfxH264, avc420);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_GfxAVC444, avc444);
+        freerdp_settings_set_bool(rdp_settings, FreeRDP_GfxAVC444v2, avc444);
+
         if (freerdp_settings_get_uint32(rdp_settings, FreeRDP_ColorDepth) != RDP_GFX_REQUIRED_DEPTH) {
             guac_client_log(client, GUAC_LOG_WARNING, "Ignoring requested "
                     "color depth of %i bpp, as the RDP Graphics Pipeline "
@@ -1762,6 +1937,11 @@ void guac_rdp_push_settings(guac_client* client,
     freerdp_settings_set_uint32(rdp_settings, FreeRDP_OsMinorType, OSMINORTYPE_UNSPECIFIED);
     freerdp_settings_set_bool(rdp_settings, FreeRDP_DesktopResize, TRUE);
 
+    /* Request an auto-reconnect cookie, such that a lost connection can be
+     * resumed without full reauthentication */
+    freerdp_settings_set_bool(rdp_settings, FreeRDP_AutoReconnectionEnabled, TRUE);
+    freerdp_settings_set_uint32(rdp_settings, FreeRDP_AutoReconnectMaxRetries, GUAC_RDP_AUTO_RECONNECT_ATTEMPTS);
+
 #ifdef HAVE_RDPSETTINGS_ALLOWUNANOUNCEDORDERSFROMSERVER
     /* Do not consider server use of unannounced orders to be a fatal error */
     freerdp_settings_set_bool(rdp_settings, FreeRDP_AllowUnanouncedOrdersFromServer, TRUE);
@@ -1805,6 +1985,15 @@ void guac_rdp_push_settings(guac_client* client,
         rdp_settings->SupportGraphicsPipeline = TRUE;
         rdp_settings->RemoteFxCodec = TRUE;
 
+        /* Offer only the codecs that can be handled efficiently */
+        int avc420, avc444;
+        guac_rdp_choose_gfx_codecs(client, guac_settings, &avc420, &avc444);
+        rdp_settings->GfxProgressive = TRUE;
+        rdp_settings->GfxPlanar = TRUE;
+        rdp_settings->GfxH264 = avc420;
+        rdp_settings->GfxAVC444 = avc444;
+        rdp_settings->GfxAVC444v2 = avc444;
+
         if (rdp_settings->ColorDepth != RDP_GFX_REQUIRED_DEPTH) {
             guac_client_log(client, GUAC_LOG_WARNING, "Ignoring requested "
                     "color depth of %i bpp, as the RDP Graphics Pipeline "
@@ -1996,6 +2185,11 @@ void guac_rdp_push_settings(guac_client* client,
     rdp_settings->OsMinorType = OSMINORTYPE_UNSPECIFIED;
     rdp_settings->DesktopResize = TRUE;
 
+    /* Request an auto-reconnect cookie, such that a lost connection can be
+     * resumed without full reauthentication */
+    rdp_settings->AutoReconnectionEnabled = TRUE;
+    rdp_settings->AutoReconnectMaxRetries = GUAC_RDP_AUTO_RECONNECT_ATTEMPTS;
+
 #ifdef HAVE_RDPSETTINGS_ALLOWUNANOUNCEDORDERSFROMSERVER
     /* Do not consider server use of unannounced orders to be a fatal error */
     rdp_settings->AllowUnanouncedOrdersFromServer = TRUE;
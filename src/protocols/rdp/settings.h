@@ -218,11 +218,38 @@ typedef struct guac_rdp_settings {
      */
     int lossless;
 
+    /**
+     * The fewest worker threads to keep running to encode graphical updates
+     * while the display is idle, or zero to use the default.
+     */
+    int min_display_workers;
+
+    /**
+     * The most worker threads that may be used to encode graphical updates,
+     * or zero to use the default.
+     */
+    int max_display_workers;
+
     /**
      * Whether audio is enabled.
      */
     int audio_enabled;
 
+    /**
+     * The bitrate, in bits per second, that compressed audio should target,
+     * or zero to use the default bitrate of the audio encoder.
+     */
+    int audio_bitrate;
+
+    /**
+     * The duration of audio, in milliseconds, to encode within each audio
+     * frame or packet, or zero to use the frame duration hinted by the client
+     * or, failing that, the default frame duration of the audio encoder.
+     * Short durations (such as 20 ms) provide low-latency audio for
+     * interactive workloads at the cost of additional bandwidth.
+     */
+    int audio_frame_duration;
+
     /**
      * Whether printing is enabled.
      */
@@ -341,6 +368,13 @@ typedef struct guac_rdp_settings {
      */
     char** svc_names;
 
+    /**
+     * Whether data sent along static virtual channels should be aggregated
+     * into fewer, larger blobs and channel writes, rather than sending each
+     * message individually and preserving message boundaries.
+     */
+    int svc_aggregation_enabled;
+
     /**
      * The maximum number of bytes to allow within the clipboard.
      */
@@ -611,11 +645,24 @@ typedef struct guac_rdp_settings {
      */
     int enable_gfx;
 
+    /**
+     * Whether H.264 video received via the RDP Graphics Pipeline Extension
+     * should be forwarded as-is to users that support H.264.
+     */
+    int enable_h264_passthrough;
+
     /**
      * Whether multi-touch support is enabled.
      */
     int enable_touch;
 
+    /**
+     * Whether input events should be sent to the RDP server from a dedicated
+     * thread, rather than from the RDP client thread between batches of
+     * inbound messages.
+     */
+    int enable_input_thread;
+
     /**
      * The hostname of the remote desktop gateway that should be used as an
      * intermediary for the remote desktop connection. If no gateway should
@@ -30,7 +30,9 @@
 #include <guacamole/user.h>
 #include <winpr/nt.h>
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * Writes the given filename to the given upload path, sanitizing the filename
@@ -70,6 +72,173 @@ static void __generate_upload_path(const char* filename, char* path) {
 
 }
 
+/**
+ * Writes the given data to the given file in its entirety, retrying as
+ * necessary until all data has been written.
+ *
+ * @param fs
+ *     The filesystem containing the file being written to.
+ *
+ * @param file_id
+ *     The ID of the file being written to.
+ *
+ * @param offset
+ *     The offset within the file at which the data should be written.
+ *
+ * @param data
+ *     The data to write.
+ *
+ * @param length
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     Zero if all data was written successfully, non-zero otherwise.
+ */
+static int guac_rdp_upload_write(guac_rdp_fs* fs, int file_id,
+        uint64_t offset, char* data, int length) {
+
+    /* Write entire block */
+    while (length > 0) {
+
+        /* Attempt write */
+        int bytes_written = guac_rdp_fs_write(fs, file_id, offset, data,
+                length);
+
+        /* On error, abort */
+        if (bytes_written < 0)
+            return 1;
+
+        /* Update counters */
+        offset += bytes_written;
+        data += bytes_written;
+        length -= bytes_written;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes the pending buffer of the given upload to the file being uploaded,
+ * noting within the upload any failure to do so.
+ *
+ * @param data
+ *     A pointer to the guac_rdp_upload_status of the upload.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_rdp_upload_writer_thread(void* data) {
+
+    guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) data;
+
+    if (guac_rdp_upload_write(upload_status->fs, upload_status->file_id,
+                upload_status->pending_offset, upload_status->pending_buffer,
+                upload_status->pending_length))
+        upload_status->failed = 1;
+
+    return NULL;
+
+}
+
+/**
+ * Waits for the writer thread of the given upload to finish writing its
+ * pending buffer, if that thread is running.
+ *
+ * @param upload_status
+ *     The upload whose writer thread should be waited for.
+ */
+static void guac_rdp_upload_wait(guac_rdp_upload_status* upload_status) {
+
+    if (upload_status->writing) {
+        pthread_join(upload_status->writer, NULL);
+        upload_status->writing = 0;
+    }
+
+}
+
+/**
+ * Writes all data buffered for the given upload, beginning writes of full
+ * buffers in the background where possible. Only one buffer is written in the
+ * background at any time. If a buffer is already being written, this function
+ * blocks until that write completes.
+ *
+ * @param upload_status
+ *     The upload whose buffered data should be written.
+ *
+ * @param wait
+ *     Non-zero if this function should not return until all buffered data has
+ *     been written, zero if the data may be written in the background.
+ */
+static void guac_rdp_upload_flush(guac_rdp_upload_status* upload_status,
+        int wait) {
+
+    /* Only one buffer may be written at a time */
+    guac_rdp_upload_wait(upload_status);
+
+    if (upload_status->failed || upload_status->length == 0)
+        return;
+
+    /* Hand buffered data to a new writer thread */
+    char* buffer = upload_status->pending_buffer;
+    upload_status->pending_buffer = upload_status->buffer;
+    upload_status->pending_length = upload_status->length;
+    upload_status->pending_offset = upload_status->offset;
+    upload_status->buffer = buffer;
+
+    upload_status->offset += upload_status->length;
+    upload_status->length = 0;
+
+    /* Write directly if a background write is not wanted or not possible */
+    if (wait || pthread_create(&upload_status->writer, NULL,
+                guac_rdp_upload_writer_thread, upload_status))
+        guac_rdp_upload_writer_thread(upload_status);
+    else
+        upload_status->writing = 1;
+
+}
+
+/**
+ * Allocates the state of a new upload to the given file.
+ *
+ * @param fs
+ *     The filesystem containing the file being uploaded.
+ *
+ * @param file_id
+ *     The ID of the file being uploaded, as returned by guac_rdp_fs_open().
+ *
+ * @return
+ *     A newly-allocated guac_rdp_upload_status, which must eventually be
+ *     freed with guac_rdp_upload_status_free().
+ */
+static guac_rdp_upload_status* guac_rdp_upload_status_alloc(guac_rdp_fs* fs,
+        int file_id) {
+
+    guac_rdp_upload_status* upload_status = guac_mem_zalloc(sizeof(guac_rdp_upload_status));
+    upload_status->fs = fs;
+    upload_status->file_id = file_id;
+    upload_status->buffer = guac_mem_alloc(GUAC_RDP_UPLOAD_BUFFER_SIZE);
+    upload_status->pending_buffer = guac_mem_alloc(GUAC_RDP_UPLOAD_BUFFER_SIZE);
+
+    return upload_status;
+
+}
+
+/**
+ * Frees the given upload state, waiting for any in-progress write to
+ * complete.
+ *
+ * @param upload_status
+ *     The upload state to free.
+ */
+static void guac_rdp_upload_status_free(guac_rdp_upload_status* upload_status) {
+    guac_rdp_upload_wait(upload_status);
+    guac_mem_free(upload_status->buffer);
+    guac_mem_free(upload_status->pending_buffer);
+    guac_mem_free(upload_status);
+}
+
 int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
         char* mimetype, char* filename) {
 
@@ -114,9 +283,7 @@ int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
     }
 
     /* Init upload status */
-    guac_rdp_upload_status* upload_status = guac_mem_alloc(sizeof(guac_rdp_upload_status));
-    upload_status->offset = 0;
-    upload_status->file_id = file_id;
+    guac_rdp_upload_status* upload_status = guac_rdp_upload_status_alloc(fs, file_id);
     stream->data = upload_status;
     stream->blob_handler = guac_rdp_upload_blob_handler;
     stream->end_handler = guac_rdp_upload_end_handler;
@@ -131,8 +298,8 @@ int guac_rdp_upload_file_handler(guac_user* user, guac_stream* stream,
 int guac_rdp_upload_blob_handler(guac_user* user, guac_stream* stream,
         void* data, int length) {
 
-    int bytes_written;
     guac_rdp_upload_status* upload_status = (guac_rdp_upload_status*) stream->data;
+    char* buffer = (char*) data;
 
     /* Get filesystem, return error if no filesystem */
     guac_client* client = user->client;
@@ -145,29 +312,36 @@ int guac_rdp_upload_blob_handler(guac_user* user, guac_stream* stream,
         return 0;
     }
 
-    /* Write entire block */
-    while (length > 0) {
+    /* Buffer received data, writing each full buffer in the background such
+     * that receipt of data may be acknowledged without waiting for the
+     * disk (writes are still limited to one buffer at a time, bounding the
+     * amount of data that may be received but not yet written) */
+    while (length > 0 && !upload_status->failed) {
 
-        /* Attempt write */
-        bytes_written = guac_rdp_fs_write(fs, upload_status->file_id,
-                upload_status->offset, data, length);
+        int available = GUAC_RDP_UPLOAD_BUFFER_SIZE - upload_status->length;
+        if (available > length)
+            available = length;
 
-        /* On error, abort */
-        if (bytes_written < 0) {
-            guac_protocol_send_ack(user->socket, stream,
-                    "FAIL (BAD WRITE)",
-                    GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
-            guac_socket_flush(user->socket);
-            return 0;
-        }
+        memcpy(upload_status->buffer + upload_status->length, buffer, available);
+        upload_status->length += available;
+        buffer += available;
+        length -= available;
 
-        /* Update counters */
-        upload_status->offset += bytes_written;
-        data += bytes_written;
-        length -= bytes_written;
+        if (upload_status->length == GUAC_RDP_UPLOAD_BUFFER_SIZE)
+            guac_rdp_upload_flush(upload_status, 0);
 
     }
 
+    /* On error, abort (failures of background writes are reported with
+     * the acknowledgement of whichever blob follows) */
+    if (upload_status->failed) {
+        guac_protocol_send_ack(user->socket, stream,
+                "FAIL (BAD WRITE)",
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+        guac_socket_flush(user->socket);
+        return 0;
+    }
+
     guac_protocol_send_ack(user->socket, stream, "OK (DATA RECEIVED)",
             GUAC_PROTOCOL_STATUS_SUCCESS);
     guac_socket_flush(user->socket);
@@ -190,15 +364,24 @@ int guac_rdp_upload_end_handler(guac_user* user, guac_stream* stream) {
         return 0;
     }
 
+    /* Write any remaining data */
+    guac_rdp_upload_flush(upload_status, 1);
+    int failed = upload_status->failed;
+
     /* Close file */
     guac_rdp_fs_close(fs, upload_status->file_id);
+    guac_rdp_upload_status_free(upload_status);
 
-    /* Acknowledge stream end */
-    guac_protocol_send_ack(user->socket, stream, "OK (STREAM END)",
-            GUAC_PROTOCOL_STATUS_SUCCESS);
-    guac_socket_flush(user->socket);
+    /* Acknowledge stream end, reporting any failure to write the final
+     * buffers of data */
+    if (failed)
+        guac_protocol_send_ack(user->socket, stream, "FAIL (BAD WRITE)",
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+    else
+        guac_protocol_send_ack(user->socket, stream, "OK (STREAM END)",
+                GUAC_PROTOCOL_STATUS_SUCCESS);
 
-    guac_mem_free(upload_status);
+    guac_socket_flush(user->socket);
     return 0;
 
 }
@@ -243,9 +426,7 @@ int guac_rdp_upload_put_handler(guac_user* user, guac_object* object,
     }
 
     /* Init upload stream data */
-    guac_rdp_upload_status* upload_status = guac_mem_alloc(sizeof(guac_rdp_upload_status));
-    upload_status->offset = 0;
-    upload_status->file_id = file_id;
+    guac_rdp_upload_status* upload_status = guac_rdp_upload_status_alloc(fs, file_id);
 
     /* Allocate stream, init for file upload */
     stream->data = upload_status;
@@ -21,13 +21,23 @@
 #define GUAC_RDP_UPLOAD_H
 
 #include "common/json.h"
+#include "fs.h"
 
 #include <guacamole/protocol.h>
 #include <guacamole/stream.h>
 #include <guacamole/user.h>
 
+#include <pthread.h>
 #include <stdint.h>
 
+/**
+ * The number of bytes of received data to accumulate for each upload before
+ * writing that data to the file being uploaded. Up to twice this many bytes
+ * may be buffered for each upload, as the next block of data is received
+ * while the previous block is being written.
+ */
+#define GUAC_RDP_UPLOAD_BUFFER_SIZE 1048576
+
 /**
  * Structure which represents the current state of an upload.
  */
@@ -35,7 +45,7 @@ typedef struct guac_rdp_upload_status {
 
     /**
      * The overall offset within the file that the next write should
-     * occur at.
+     * occur at. This is the offset of the first byte within buffer.
      */
     uint64_t offset;
 
@@ -44,6 +54,58 @@ typedef struct guac_rdp_upload_status {
      */
     int file_id;
 
+    /**
+     * The filesystem containing the file being written to.
+     */
+    guac_rdp_fs* fs;
+
+    /**
+     * Received data which has not yet been written, and has not yet been
+     * handed to the writer thread. This buffer has room for exactly
+     * GUAC_RDP_UPLOAD_BUFFER_SIZE bytes.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes currently stored within buffer.
+     */
+    int length;
+
+    /**
+     * The block of data currently being written by the writer thread, if
+     * any. This buffer has room for exactly GUAC_RDP_UPLOAD_BUFFER_SIZE bytes.
+     */
+    char* pending_buffer;
+
+    /**
+     * The number of bytes within pending_buffer that are being written.
+     */
+    int pending_length;
+
+    /**
+     * The offset within the file at which pending_buffer is being written.
+     */
+    uint64_t pending_offset;
+
+    /**
+     * The thread writing pending_buffer, if writing is non-zero.
+     */
+    pthread_t writer;
+
+    /**
+     * Non-zero if the writer thread has been started and not yet joined,
+     * zero otherwise.
+     */
+    int writing;
+
+    /**
+     * Non-zero if any write has failed, in which case all further data
+     * received for the upload is rejected, zero otherwise. This is set by the
+     * writer thread, and must only be read by other threads after that thread
+     * has been joined.
+     */
+    int failed;
+
 } guac_rdp_upload_status;
 
 /**
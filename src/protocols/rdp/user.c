@@ -20,6 +20,7 @@
 #include "channels/audio-input/audio-input.h"
 #include "channels/cliprdr.h"
 #include "channels/pipe-svc.h"
+#include "channels/rdpgfx.h"
 #include "config.h"
 #include "input.h"
 #include "rdp.h"
@@ -85,6 +86,11 @@ int guac_rdp_user_join_handler(guac_user* user, int argc, char** argv) {
 
     }
 
+    /* Pace RDPGFX frames according to the frames confirmed by all users,
+     * including read-only users */
+    if (settings->enable_gfx)
+        user->sync_handler = guac_rdp_rdpgfx_sync_handler;
+
     /* Only handle events if not read-only */
     if (!settings->read_only) {
 
@@ -92,6 +98,10 @@ int guac_rdp_user_join_handler(guac_user* user, int argc, char** argv) {
         user->mouse_handler = guac_rdp_user_mouse_handler;
         user->key_handler = guac_rdp_user_key_handler;
 
+        /* Handle only the most recent position if mouse motion is
+         * received faster than it can be handled */
+        user->coalesce_mouse = 1;
+
         /* Multi-touch events */
         if (settings->enable_touch)
             user->touch_handler = guac_rdp_user_touch_handler;
@@ -91,6 +91,9 @@ int guac_client_init(guac_client* client) {
                 "not render correctly.");
     }
 
+    /* Begin loading fonts while awaiting the user */
+    guac_terminal_preload_fonts();
+
     /* Success */
     return 0;
 
@@ -120,11 +123,10 @@ int guac_ssh_client_free_handler(guac_client* client) {
     if (ssh_client->term_channel != NULL)
         libssh2_channel_free(ssh_client->term_channel);
 
-    /* Clean up the SFTP filesystem object and session */
-    if (ssh_client->sftp_filesystem) {
+    /* Clean up the SFTP filesystem object (the underlying SSH session is
+     * shared with the terminal and freed below) */
+    if (ssh_client->sftp_filesystem)
         guac_common_ssh_destroy_sftp_filesystem(ssh_client->sftp_filesystem);
-        guac_common_ssh_destroy_session(ssh_client->sftp_session);
-    }
 
     /* Clean up recording, if in progress */
     if (ssh_client->recording != NULL)
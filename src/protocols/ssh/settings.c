@@ -29,6 +29,7 @@
 #include <guacamole/mem.h>
 #include <guacamole/user.h>
 #include <guacamole/wol-constants.h>
+#include <libssh2.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -77,11 +78,15 @@ const char* GUAC_SSH_CLIENT_ARGS[] = {
     "clipboard-buffer-size",
     "disable-copy",
     "disable-paste",
+    "enable-text-stream",
+    "enable-glyph-atlas",
     "wol-send-packet",
     "wol-mac-addr",
     "wol-broadcast-addr",
     "wol-udp-port",
     "wol-wait-time",
+    "channel-window-size",
+    "channel-packet-size",
     NULL
 };
 
@@ -330,6 +335,24 @@ enum SSH_ARGS_IDX {
      * the clipboard. By default, clipboard access is not blocked.
      */
     IDX_DISABLE_PASTE,
+
+    /**
+     * Whether the contents of the terminal should be sent as text over a
+     * dedicated pipe stream, for clients which render terminal text
+     * themselves. If set to "true", characters are no longer sent as image
+     * data, substantially reducing bandwidth and processing. By default, the
+     * terminal is rendered entirely as images.
+     */
+    IDX_ENABLE_TEXT_STREAM,
+
+    /**
+     * Whether glyphs should be kept client-side within an off-screen glyph
+     * atlas, such that each character already sent is drawn by copying from
+     * that atlas rather than by sending image data. If set to "true", text
+     * output requires substantially less bandwidth and encoding. By default,
+     * the glyph atlas is not used.
+     */
+    IDX_ENABLE_GLYPH_ATLAS,
     
     /**
      * Whether the magic WoL packet should be sent prior to starting the
@@ -365,6 +388,20 @@ enum SSH_ARGS_IDX {
      */
     IDX_WOL_WAIT_TIME,
 
+    /**
+     * The size of the receive window to request for the terminal channel, in
+     * bytes. Larger windows allow more data to be in flight before the SSH
+     * server must wait for the window to be adjusted. By default, the libssh2
+     * default window size is used.
+     */
+    IDX_CHANNEL_WINDOW_SIZE,
+
+    /**
+     * The maximum size of each packet to request for the terminal channel, in
+     * bytes. By default, the libssh2 default packet size is used.
+     */
+    IDX_CHANNEL_PACKET_SIZE,
+
     SSH_ARGS_COUNT
 };
 
@@ -592,6 +629,16 @@ guac_ssh_settings* guac_ssh_parse_args(guac_user* user,
     settings->disable_paste =
         guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
                 IDX_DISABLE_PASTE, false);
+
+    /* Parse text stream enable flag */
+    settings->enable_text_stream =
+        guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_ENABLE_TEXT_STREAM, false);
+
+    /* Parse glyph atlas enable flag */
+    settings->enable_glyph_atlas =
+        guac_user_parse_args_boolean(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_ENABLE_GLYPH_ATLAS, false);
     
     /* Parse Wake-on-LAN (WoL) parameters. */
     settings->wol_send_packet =
@@ -624,6 +671,21 @@ guac_ssh_settings* guac_ssh_parse_args(guac_user* user,
         
     }
 
+    /* Parse terminal channel window and packet sizes */
+    settings->channel_window_size =
+        guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_CHANNEL_WINDOW_SIZE, LIBSSH2_CHANNEL_WINDOW_DEFAULT);
+
+    settings->channel_packet_size =
+        guac_user_parse_args_int(user, GUAC_SSH_CLIENT_ARGS, argv,
+                IDX_CHANNEL_PACKET_SIZE, LIBSSH2_CHANNEL_PACKET_DEFAULT);
+
+    if (settings->channel_window_size <= 0)
+        settings->channel_window_size = LIBSSH2_CHANNEL_WINDOW_DEFAULT;
+
+    if (settings->channel_packet_size <= 0)
+        settings->channel_packet_size = LIBSSH2_CHANNEL_PACKET_DEFAULT;
+
     /* Parsing was successful */
     return settings;
 
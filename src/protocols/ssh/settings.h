@@ -53,6 +53,13 @@
  */
 #define GUAC_SSH_DEFAULT_POLL_TIMEOUT 1000
 
+/**
+ * The size of the buffer receiving data from the terminal channel, in bytes.
+ * All data that is immediately available from the channel is read into this
+ * buffer (up to its size) before being written to the terminal at once.
+ */
+#define GUAC_SSH_READ_BUFFER_SIZE 65536
+
 /**
  * Settings for the SSH connection. The values for this structure are parsed
  * from the arguments given during the Guacamole protocol handshake using the
@@ -176,6 +183,18 @@ typedef struct guac_ssh_settings {
      */
     bool disable_paste;
 
+    /**
+     * Whether the contents of the terminal should be sent as text over a
+     * dedicated pipe stream rather than as rendered image data.
+     */
+    bool enable_text_stream;
+
+    /**
+     * Whether glyphs should be drawn by copying from a client-side glyph
+     * atlas rather than by sending image data wherever they are drawn.
+     */
+    bool enable_glyph_atlas;
+
     /**
      * Whether SFTP is enabled.
      */
@@ -331,6 +350,18 @@ typedef struct guac_ssh_settings {
      */
     int wol_wait_time;
 
+    /**
+     * The size of the receive window to request for the terminal channel, in
+     * bytes.
+     */
+    int channel_window_size;
+
+    /**
+     * The maximum size of each packet to request for the terminal channel, in
+     * bytes.
+     */
+    int channel_packet_size;
+
 } guac_ssh_settings;
 
 /**
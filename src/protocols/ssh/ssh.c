@@ -60,6 +60,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 /**
  * Produces a new user object containing a username and password or private
@@ -198,6 +199,30 @@ static char* guac_ssh_get_credential(guac_client *client, char* cred_name) {
 
 }
 
+/**
+ * Waits until the underlying socket of the given non-blocking SSH session is
+ * ready for whichever directions libssh2 was blocked on by the operation that
+ * most recently returned LIBSSH2_ERROR_EAGAIN, or until the default polling
+ * timeout elapses.
+ *
+ * @param session
+ *     The SSH session to wait for.
+ */
+static void guac_ssh_wait_session(guac_common_ssh_session* session) {
+
+    int directions = libssh2_session_block_directions(session->session);
+
+    struct pollfd fds[] = {{
+        .fd      = session->fd,
+        .events  = ((directions & LIBSSH2_SESSION_BLOCK_INBOUND)  ? POLLIN  : 0)
+                 | ((directions & LIBSSH2_SESSION_BLOCK_OUTBOUND) ? POLLOUT : 0),
+        .revents = 0,
+    }};
+
+    poll(fds, 1, GUAC_SSH_DEFAULT_POLL_TIMEOUT);
+
+}
+
 void* ssh_input_thread(void* data) {
 
     guac_client* client = (guac_client*) data;
@@ -208,9 +233,28 @@ void* ssh_input_thread(void* data) {
 
     /* Write all data read */
     while ((bytes_read = guac_terminal_read_stdin(ssh_client->term, buffer, sizeof(buffer))) > 0) {
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
-        libssh2_channel_write(ssh_client->term_channel, buffer, bytes_read);
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+
+        guac_common_ssh_session_lock(ssh_client->session);
+
+        /* Retry until all data is written, as a packet that libssh2 has only
+         * partially sent must be completed by the same call before the
+         * session may be used for anything else, such as SFTP */
+        int written = 0;
+        while (written < bytes_read && client->state != GUAC_CLIENT_STOPPING) {
+
+            int result = libssh2_channel_write(ssh_client->term_channel,
+                    buffer + written, bytes_read - written);
+
+            if (result == LIBSSH2_ERROR_EAGAIN)
+                guac_ssh_wait_session(ssh_client->session);
+            else if (result < 0)
+                break;
+            else
+                written += result;
+
+        }
+
+        guac_common_ssh_session_unlock(ssh_client->session);
 
         /* Make sure ssh_input_thread can be terminated anyway */
         if (client->state == GUAC_CLIENT_STOPPING)
@@ -229,10 +273,13 @@ void* ssh_client_thread(void* data) {
     guac_ssh_client* ssh_client = (guac_ssh_client*) client->data;
     guac_ssh_settings* settings = ssh_client->settings;
 
-    char buffer[8192];
+    char buffer[GUAC_SSH_READ_BUFFER_SIZE];
 
     pthread_t input_thread;
 
+    /* File descriptor signalled upon completion of each SFTP request */
+    int share_fd = -1;
+
     /* If Wake-on-LAN is enabled, attempt to wake. */
     if (settings->wol_send_packet) {
 
@@ -242,10 +289,11 @@ void* ssh_client_thread(void* data) {
          */
         if (settings->wol_wait_time > 0) {
             guac_client_log(client, GUAC_LOG_DEBUG, "Sending Wake-on-LAN packet, "
-                    "and pausing for %d seconds.", settings->wol_wait_time);
+                    "and waiting for the remote system to respond.");
 
-            /* Send the Wake-on-LAN request and wait until the server is responsive. */
-            if (guac_wol_wake_and_wait(settings->wol_mac_addr,
+            /* Send the Wake-on-LAN request and wait until the server is
+             * responsive, keeping users informed while waiting. */
+            if (guac_wol_wake_and_probe(client, settings->wol_mac_addr,
                     settings->wol_broadcast_addr,
                     settings->wol_udp_port,
                     settings->wol_wait_time,
@@ -301,6 +349,8 @@ void* ssh_client_thread(void* data) {
     options->font_size = settings->font_size;
     options->color_scheme = settings->color_scheme;
     options->backspace = settings->backspace;
+    options->text_stream = settings->enable_text_stream;
+    options->glyph_atlas = settings->enable_glyph_atlas;
 
     /* Create terminal */
     ssh_client->term = guac_terminal_create(client, options);
@@ -347,11 +397,11 @@ void* ssh_client_thread(void* data) {
         return NULL;
     }
 
-    pthread_mutex_init(&ssh_client->term_channel_lock, NULL);
-
     /* Open channel for terminal */
-    ssh_client->term_channel =
-        libssh2_channel_open_session(ssh_client->session->session);
+    ssh_client->term_channel = libssh2_channel_open_ex(
+            ssh_client->session->session, "session", sizeof("session") - 1,
+            settings->channel_window_size, settings->channel_packet_size,
+            NULL, 0);
     if (ssh_client->term_channel == NULL) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_ERROR,
                 "Unable to open terminal channel.");
@@ -384,44 +434,6 @@ void* ssh_client_thread(void* data) {
     ssh_client->auth_agent = NULL;
 #endif
 
-    /* Start SFTP session as well, if enabled */
-    if (settings->enable_sftp) {
-
-        /* Create SSH session specific for SFTP */
-        guac_client_log(client, GUAC_LOG_DEBUG, "Reconnecting for SFTP...");
-        ssh_client->sftp_session =
-            guac_common_ssh_create_session(client, settings->hostname,
-                    settings->port, ssh_client->user, settings->timeout,
-                    settings->server_alive_interval, settings->host_key, NULL);
-        if (ssh_client->sftp_session == NULL) {
-            /* Already aborted within guac_common_ssh_create_session() */
-            return NULL;
-        }
-
-        /* Request SFTP */
-        ssh_client->sftp_filesystem = guac_common_ssh_create_sftp_filesystem(
-                    ssh_client->sftp_session, settings->sftp_root_directory,
-                    NULL, settings->sftp_disable_download,
-                    settings->sftp_disable_upload);
-
-        /* Expose filesystem to connection owner */
-        guac_client_for_owner(client,
-                guac_common_ssh_expose_sftp_filesystem,
-                ssh_client->sftp_filesystem);
-
-        /* Init handlers for Guacamole-specific console codes */
-        if (!settings->sftp_disable_upload)
-            guac_terminal_set_upload_path_handler(ssh_client->term,
-                    guac_sftp_set_upload_path);
-
-        if (!settings->sftp_disable_download)
-            guac_terminal_set_file_download_handler(ssh_client->term,
-                    guac_sftp_download_file);
-
-        guac_client_log(client, GUAC_LOG_DEBUG, "SFTP session initialized");
-
-    }
-
     /* Set up the ttymode array prior to requesting the PTY */
     int ttymodeBytes = guac_ssh_ttymodes_init(ssh_ttymodes,
             GUAC_SSH_TTY_OP_VERASE, settings->backspace, GUAC_SSH_TTY_OP_END);
@@ -465,8 +477,53 @@ void* ssh_client_thread(void* data) {
         return NULL;
     }
 
+    /* Start SFTP session as well, if enabled (only once the terminal channel
+     * is fully set up, as SFTP requests may be made by other threads as soon
+     * as the filesystem is exposed) */
+    if (settings->enable_sftp) {
+
+        /* SFTP requests are made by other threads over the same SSH
+         * session as the terminal, waking the terminal after each request in
+         * case terminal data was received during that request */
+        share_fd = guac_common_ssh_session_share(ssh_client->session);
+        if (share_fd == -1)
+            guac_client_log(client, GUAC_LOG_WARNING, "Unable to create pipe "
+                    "for SFTP notifications. Terminal output may be delayed "
+                    "while files are transferred.");
+
+        /* Request SFTP */
+        ssh_client->sftp_filesystem = guac_common_ssh_create_sftp_filesystem(
+                    ssh_client->session, settings->sftp_root_directory,
+                    NULL, settings->sftp_disable_download,
+                    settings->sftp_disable_upload);
+        if (ssh_client->sftp_filesystem == NULL) {
+            guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_ERROR,
+                    "Unable to start SFTP session.");
+            return NULL;
+        }
+
+        /* Expose filesystem to connection owner */
+        guac_client_for_owner(client,
+                guac_common_ssh_expose_sftp_filesystem,
+                ssh_client->sftp_filesystem);
+
+        /* Init handlers for Guacamole-specific console codes */
+        if (!settings->sftp_disable_upload)
+            guac_terminal_set_upload_path_handler(ssh_client->term,
+                    guac_sftp_set_upload_path);
+
+        if (!settings->sftp_disable_download)
+            guac_terminal_set_file_download_handler(ssh_client->term,
+                    guac_sftp_download_file);
+
+        guac_client_log(client, GUAC_LOG_DEBUG, "SFTP session initialized");
+
+    }
+
     /* Logged in */
+    guac_client_startup_phase(client, "ssh_channel");
     guac_client_log(client, GUAC_LOG_INFO, "SSH connection successful.");
+    guac_client_startup_complete(client);
     guac_terminal_start(ssh_client->term);
 
     /* Start input thread */
@@ -488,17 +545,17 @@ void* ssh_client_thread(void* data) {
         /* Timeout for polling socket activity */
         int timeout;
 
-        pthread_mutex_lock(&(ssh_client->term_channel_lock));
+        guac_common_ssh_session_lock(ssh_client->session);
 
         /* Stop reading at EOF */
         if (libssh2_channel_eof(ssh_client->term_channel)) {
-            pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+            guac_common_ssh_session_unlock(ssh_client->session);
             break;
         }
 
         /* Client is stopping, break the loop */
         if (client->state == GUAC_CLIENT_STOPPING) {
-            pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+            guac_common_ssh_session_unlock(ssh_client->session);
             break;
         }
 
@@ -506,7 +563,7 @@ void* ssh_client_thread(void* data) {
         if (settings->server_alive_interval > 0) {
             timeout = 0;
             if (libssh2_keepalive_send(ssh_client->session->session, &timeout) > 0) {
-                pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+                guac_common_ssh_session_unlock(ssh_client->session);
                 break;
             }
             timeout *= 1000;
@@ -515,28 +572,39 @@ void* ssh_client_thread(void* data) {
         else
             timeout = GUAC_SSH_DEFAULT_POLL_TIMEOUT;
 
-        /* Read terminal data */
-        bytes_read = libssh2_channel_read(ssh_client->term_channel,
-                buffer, sizeof(buffer));
+        /* Read all terminal data that is immediately available, such that
+         * bursts of output are written to the terminal at once */
+        int buffered = 0;
+        do {
+
+            bytes_read = libssh2_channel_read(ssh_client->term_channel,
+                    buffer + buffered, sizeof(buffer) - buffered);
+
+            if (bytes_read > 0)
+                buffered += bytes_read;
+
+        } while (bytes_read > 0 && (size_t) buffered < sizeof(buffer));
 
-        pthread_mutex_unlock(&(ssh_client->term_channel_lock));
+        guac_common_ssh_session_unlock(ssh_client->session);
 
         /* Attempt to write data received. Exit on failure. */
-        if (bytes_read > 0) {
-            int written = guac_terminal_write(ssh_client->term, buffer, bytes_read);
+        if (buffered > 0) {
+            int written = guac_terminal_write(ssh_client->term, buffer, buffered);
             if (written < 0)
                 break;
 
-            total_read += bytes_read;
+            total_read += buffered;
         }
 
-        else if (bytes_read < 0 && bytes_read != LIBSSH2_ERROR_EAGAIN)
+        if (bytes_read < 0 && bytes_read != LIBSSH2_ERROR_EAGAIN)
             break;
 
 #ifdef ENABLE_SSH_AGENT
         /* If agent open, handle any agent packets */
         if (ssh_client->auth_agent != NULL) {
+            guac_common_ssh_session_lock(ssh_client->session);
             bytes_read = ssh_auth_agent_read(ssh_client->auth_agent);
+            guac_common_ssh_session_unlock(ssh_client->session);
             if (bytes_read > 0)
                 total_read += bytes_read;
             else if (bytes_read < 0 && bytes_read != LIBSSH2_ERROR_EAGAIN)
@@ -547,17 +615,30 @@ void* ssh_client_thread(void* data) {
         /* Wait for more data if reads turn up empty */
         if (total_read == 0) {
 
-            /* Wait on the SSH session file descriptor only */
+            /* Wait on the SSH session file descriptor, as well as for the
+             * completion of any SFTP request (poll() ignores negative file
+             * descriptors, such as when SFTP is disabled) */
             struct pollfd fds[] = {{
                 .fd      = ssh_client->session->fd,
                 .events  = POLLIN,
                 .revents = 0,
+            }, {
+                .fd      = share_fd,
+                .events  = POLLIN,
+                .revents = 0,
             }};
 
             /* Wait up to computed timeout */
-            if (poll(fds, 1, timeout) < 0)
+            if (poll(fds, 2, timeout) < 0)
                 break;
 
+            /* Discard SFTP notifications - the terminal channel is simply
+             * read again */
+            if (fds[1].revents & POLLIN) {
+                char discard[64];
+                while (read(share_fd, discard, sizeof(discard)) > 0);
+            }
+
         }
 
     }
@@ -566,8 +647,6 @@ void* ssh_client_thread(void* data) {
     guac_client_stop(client);
     pthread_join(input_thread, NULL);
 
-    pthread_mutex_destroy(&ssh_client->term_channel_lock);
-
     guac_client_log(client, GUAC_LOG_INFO, "SSH connection ended.");
     return NULL;
 
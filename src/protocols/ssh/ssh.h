@@ -66,15 +66,12 @@ typedef struct guac_ssh_client {
     guac_common_ssh_user* user;
 
     /**
-     * SSH session, used by the SSH client thread.
+     * SSH session, used by the SSH client thread and, if enabled, SFTP. The
+     * lock of this session (see guac_common_ssh_session_lock()) must be held
+     * while using any of its channels, including the terminal channel.
      */
     guac_common_ssh_session* session;
 
-    /**
-     * SFTP session, used by the SFTP client/filesystem.
-     */
-    guac_common_ssh_session* sftp_session;
-
     /**
      * The filesystem object exposed for the SFTP session.
      */
@@ -85,11 +82,6 @@ typedef struct guac_ssh_client {
      */
     LIBSSH2_CHANNEL* term_channel;
 
-    /**
-     * Lock dictating access to the SSH terminal channel.
-     */
-    pthread_mutex_t term_channel_lock;
-
     /**
      * The terminal which will render all output from the SSH client.
      */
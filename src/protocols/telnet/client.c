@@ -22,6 +22,7 @@
 #include "client.h"
 #include "settings.h"
 #include "telnet.h"
+#include "terminal/terminal.h"
 #include "user.h"
 
 #include <langinfo.h>
@@ -96,6 +97,9 @@ int guac_client_init(guac_client* client) {
                 "not render correctly.");
     }
 
+    /* Begin loading fonts while awaiting the user */
+    guac_terminal_preload_fonts();
+
     /* Success */
     return 0;
 
@@ -67,11 +67,14 @@ const char* GUAC_TELNET_CLIENT_ARGS[] = {
     "clipboard-buffer-size",
     "disable-copy",
     "disable-paste",
+    "enable-text-stream",
+    "enable-glyph-atlas",
     "wol-send-packet",
     "wol-mac-addr",
     "wol-broadcast-addr",
     "wol-udp-port",
     "wol-wait-time",
+    "receive-buffer-size",
     NULL
 };
 
@@ -268,6 +271,24 @@ enum TELNET_ARGS_IDX {
      * the clipboard. By default, clipboard access is not blocked.
      */
     IDX_DISABLE_PASTE,
+
+    /**
+     * Whether the contents of the terminal should be sent as text over a
+     * dedicated pipe stream, for clients which render terminal text
+     * themselves. If set to "true", characters are no longer sent as image
+     * data, substantially reducing bandwidth and processing. By default, the
+     * terminal is rendered entirely as images.
+     */
+    IDX_ENABLE_TEXT_STREAM,
+
+    /**
+     * Whether glyphs should be kept client-side within an off-screen glyph
+     * atlas, such that each character already sent is drawn by copying from
+     * that atlas rather than by sending image data. If set to "true", text
+     * output requires substantially less bandwidth and encoding. By default,
+     * the glyph atlas is not used.
+     */
+    IDX_ENABLE_GLYPH_ATLAS,
     
     /**
      * Whether to send the magic Wake-on-LAN (WoL) packet.  If set to "true"
@@ -300,6 +321,13 @@ enum TELNET_ARGS_IDX {
      */
     IDX_WOL_WAIT_TIME,
 
+    /**
+     * The size of the buffer receiving data from the telnet server, in bytes.
+     * Larger buffers allow large bursts of output to be handled with fewer
+     * reads and terminal writes. By default, a 64 KiB buffer is used.
+     */
+    IDX_RECEIVE_BUFFER_SIZE,
+
     TELNET_ARGS_COUNT
 };
 
@@ -557,6 +585,16 @@ guac_telnet_settings* guac_telnet_parse_args(guac_user* user,
     settings->disable_paste =
         guac_user_parse_args_boolean(user, GUAC_TELNET_CLIENT_ARGS, argv,
                 IDX_DISABLE_PASTE, false);
+
+    /* Parse text stream enable flag */
+    settings->enable_text_stream =
+        guac_user_parse_args_boolean(user, GUAC_TELNET_CLIENT_ARGS, argv,
+                IDX_ENABLE_TEXT_STREAM, false);
+
+    /* Parse glyph atlas enable flag */
+    settings->enable_glyph_atlas =
+        guac_user_parse_args_boolean(user, GUAC_TELNET_CLIENT_ARGS, argv,
+                IDX_ENABLE_GLYPH_ATLAS, false);
     
     /* Parse Wake-on-LAN (WoL) settings */
     settings->wol_send_packet =
@@ -594,6 +632,16 @@ guac_telnet_settings* guac_telnet_parse_args(guac_user* user,
         
     }
 
+    /* Parse receive buffer size, clamping to allowed range */
+    settings->receive_buffer_size =
+        guac_user_parse_args_int(user, GUAC_TELNET_CLIENT_ARGS, argv,
+                IDX_RECEIVE_BUFFER_SIZE, GUAC_TELNET_DEFAULT_RECEIVE_BUFFER_SIZE);
+
+    if (settings->receive_buffer_size < GUAC_TELNET_MIN_RECEIVE_BUFFER_SIZE)
+        settings->receive_buffer_size = GUAC_TELNET_MIN_RECEIVE_BUFFER_SIZE;
+    else if (settings->receive_buffer_size > GUAC_TELNET_MAX_RECEIVE_BUFFER_SIZE)
+        settings->receive_buffer_size = GUAC_TELNET_MAX_RECEIVE_BUFFER_SIZE;
+
     /* Parsing was successful */
     return settings;
 
@@ -61,6 +61,24 @@
  */
 #define GUAC_TELNET_DEFAULT_PASSWORD_REGEX "[Pp]assword:"
 
+/**
+ * The default size of the buffer receiving data from the telnet server, in
+ * bytes.
+ */
+#define GUAC_TELNET_DEFAULT_RECEIVE_BUFFER_SIZE 65536
+
+/**
+ * The smallest allowed size of the buffer receiving data from the telnet
+ * server, in bytes.
+ */
+#define GUAC_TELNET_MIN_RECEIVE_BUFFER_SIZE 1024
+
+/**
+ * The largest allowed size of the buffer receiving data from the telnet
+ * server, in bytes.
+ */
+#define GUAC_TELNET_MAX_RECEIVE_BUFFER_SIZE 1048576
+
 /**
  * Settings for the telnet connection. The values for this structure are parsed
  * from the arguments given during the Guacamole protocol handshake using the
@@ -184,6 +202,18 @@ typedef struct guac_telnet_settings {
      */
     bool disable_paste;
 
+    /**
+     * Whether the contents of the terminal should be sent as text over a
+     * dedicated pipe stream rather than as rendered image data.
+     */
+    bool enable_text_stream;
+
+    /**
+     * Whether glyphs should be drawn by copying from a client-side glyph
+     * atlas rather than by sending image data wherever they are drawn.
+     */
+    bool enable_glyph_atlas;
+
     /**
      * The path in which the typescript should be saved, if enabled. If no
      * typescript should be saved, this will be NULL.
@@ -297,6 +327,13 @@ typedef struct guac_telnet_settings {
      */
     int wol_wait_time;
 
+    /**
+     * The size of the buffer receiving data from the telnet server, in bytes.
+     * All data immediately available from the telnet server is read into
+     * this buffer, up to its size, before being handled.
+     */
+    int receive_buffer_size;
+
 } guac_telnet_settings;
 
 /**
@@ -387,6 +387,7 @@ static telnet_t* __guac_telnet_create_session(guac_client* client) {
     guac_telnet_settings* settings = telnet_client->settings;
 
     int fd = guac_tcp_connect(settings->hostname, settings->port, settings->timeout);
+    guac_client_startup_phase(client, "tcp_connect");
 
     /* Open telnet session */
     telnet_t* telnet = telnet_init(__telnet_options, __guac_telnet_event_handler, 0, client);
@@ -483,6 +484,52 @@ static int __guac_telnet_wait(int socket_fd) {
 
 }
 
+/**
+ * Reads all data immediately available from the given file descriptor, up to
+ * the size of the given buffer. At least one byte must already be available,
+ * as indicated by __guac_telnet_wait(). Reading continues without blocking
+ * until no further data is available or the buffer is full, such that large
+ * bursts of output can be handled all at once.
+ *
+ * @param socket_fd
+ *     The file descriptor to read from.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param size
+ *     The size of the buffer, in bytes.
+ *
+ * @return
+ *     The number of bytes read, or a value less than or equal to zero if the
+ *     connection has been closed or an error occurred before any data could
+ *     be read.
+ */
+static int __guac_telnet_read_available(int socket_fd, char* buffer,
+        int size) {
+
+    int length = read(socket_fd, buffer, size);
+    if (length <= 0)
+        return length;
+
+    /* Continue reading until the socket is drained or the buffer is full */
+    while (length < size) {
+
+        int bytes_read = recv(socket_fd, buffer + length, size - length,
+                MSG_DONTWAIT);
+
+        /* Any error or closure will be detected upon the next read */
+        if (bytes_read <= 0)
+            break;
+
+        length += bytes_read;
+
+    }
+
+    return length;
+
+}
+
 void* guac_telnet_client_thread(void* data) {
 
     guac_client* client = (guac_client*) data;
@@ -490,7 +537,7 @@ void* guac_telnet_client_thread(void* data) {
     guac_telnet_settings* settings = telnet_client->settings;
 
     pthread_t input_thread;
-    char buffer[8192];
+    char* buffer;
     int wait_result;
 
     /* If Wake-on-LAN is enabled, attempt to wake. */
@@ -502,10 +549,11 @@ void* guac_telnet_client_thread(void* data) {
          */
         if (settings->wol_wait_time > 0) {
             guac_client_log(client, GUAC_LOG_DEBUG, "Sending Wake-on-LAN packet, "
-                    "and pausing for %d seconds.", settings->wol_wait_time);
+                    "and waiting for the remote system to respond.");
 
-            /* Send the Wake-on-LAN request and wait until the server is responsive. */
-            if (guac_wol_wake_and_wait(settings->wol_mac_addr,
+            /* Send the Wake-on-LAN request and wait until the server is
+             * responsive, keeping users informed while waiting. */
+            if (guac_wol_wake_and_probe(client, settings->wol_mac_addr,
                     settings->wol_broadcast_addr,
                     settings->wol_udp_port,
                     settings->wol_wait_time,
@@ -552,6 +600,8 @@ void* guac_telnet_client_thread(void* data) {
     options->font_size = settings->font_size;
     options->color_scheme = settings->color_scheme;
     options->backspace = settings->backspace;
+    options->text_stream = settings->enable_text_stream;
+    options->glyph_atlas = settings->enable_glyph_atlas;
 
     /* Create terminal */
     telnet_client->term = guac_terminal_create(client, options);
@@ -588,6 +638,7 @@ void* guac_telnet_client_thread(void* data) {
 
     /* Logged in */
     guac_client_log(client, GUAC_LOG_INFO, "Telnet connection successful.");
+    guac_client_startup_complete(client);
 
     /* Allow terminal to render if login success/failure detection is not
      * enabled */
@@ -601,6 +652,8 @@ void* guac_telnet_client_thread(void* data) {
         return NULL;
     }
 
+    buffer = guac_mem_alloc(settings->receive_buffer_size);
+
     /* While data available, write to terminal */
     while ((wait_result = __guac_telnet_wait(telnet_client->socket_fd)) >= 0) {
 
@@ -608,14 +661,17 @@ void* guac_telnet_client_thread(void* data) {
         if (wait_result == 0)
             continue;
 
-        int bytes_read = read(telnet_client->socket_fd, buffer, sizeof(buffer));
-        if (bytes_read <= 0)
+        int length = __guac_telnet_read_available(telnet_client->socket_fd,
+                buffer, settings->receive_buffer_size);
+        if (length <= 0)
             break;
 
-        telnet_recv(telnet_client->telnet, buffer, bytes_read);
+        telnet_recv(telnet_client->telnet, buffer, length);
 
     }
 
+    guac_mem_free(buffer);
+
     /* Kill client and Wait for input thread to die */
     guac_client_stop(client);
     pthread_join(input_thread, NULL);
@@ -149,6 +149,9 @@ int guac_vnc_client_free_handler(guac_client* client) {
             rfb_client->frameBuffer = NULL;
         }
 
+        /* Free the other half of the double-buffered framebuffer */
+        guac_vnc_framebuffer_free(&vnc_client->framebuffer);
+
         if (rfb_client->raw_buffer != NULL) {
             free(rfb_client->raw_buffer);
             rfb_client->raw_buffer = NULL;
@@ -200,6 +203,14 @@ int guac_vnc_client_free_handler(guac_client* client) {
     if (vnc_client->display != NULL)
         guac_display_free(vnc_client->display);
 
+    /* Free pixel format conversion tables */
+    guac_vnc_pixel_table_free(vnc_client->pixel_table);
+
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+    /* Free any retained JPEG data */
+    guac_mem_free(vnc_client->jpeg.data);
+#endif
+
 #ifdef ENABLE_PULSE
     /* If audio enabled, stop streaming */
     if (vnc_client->audio)
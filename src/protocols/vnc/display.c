@@ -22,6 +22,7 @@
 #include "client.h"
 #include "display.h"
 #include "common/iconv.h"
+#include "framebuffer.h"
 #include "vnc.h"
 
 #include <cairo/cairo.h>
@@ -43,8 +44,110 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+
+/**
+ * Allocates and populates the lookup table which converts each possible value
+ * of a single color component of a VNC pixel to its contribution to a 32-bit
+ * ARGB pixel.
+ *
+ * @param max
+ *     The maximum value of the color component within the VNC pixel format.
+ *
+ * @param shift
+ *     The position of the color component within a 32-bit ARGB pixel, as a
+ *     number of bits to shift left.
+ *
+ * @return
+ *     A newly-allocated lookup table having max + 1 entries.
+ */
+static uint32_t* guac_vnc_pixel_table_alloc_component(int max, int shift) {
+
+    uint32_t* table = guac_mem_alloc(sizeof(uint32_t), max + 1);
+
+    for (int value = 0; value <= max; value++)
+        table[value] = (uint32_t) (value * 0x100 / (max + 1)) << shift;
+
+    return table;
+
+}
+
+void guac_vnc_pixel_table_free(guac_vnc_pixel_table* table) {
+
+    if (table == NULL)
+        return;
+
+    guac_mem_free(table->red);
+    guac_mem_free(table->green);
+    guac_mem_free(table->blue);
+    guac_mem_free(table->pixels);
+    guac_mem_free(table);
+
+}
+
+/**
+ * Returns lookup tables which convert pixels of the current pixel format of
+ * the given VNC client to the format expected by guac_display, rebuilding
+ * those tables only if the pixel format (or the red/blue swap setting) has
+ * changed since the tables were last built.
+ *
+ * @param vnc_client
+ *     The VNC client whose tables should be returned.
+ *
+ * @param client
+ *     The libvncclient client whose pixel format should be converted.
+ *
+ * @return
+ *     Lookup tables for the current pixel format of the given client.
+ */
+static guac_vnc_pixel_table* guac_vnc_get_pixel_table(
+        guac_vnc_client* vnc_client, rfbClient* client) {
+
+    const rfbPixelFormat* format = &client->format;
+    int swap_red_blue = vnc_client->settings->swap_red_blue;
+
+    /* Reuse existing tables if still applicable */
+    guac_vnc_pixel_table* table = vnc_client->pixel_table;
+    if (table != NULL
+            && table->swap_red_blue == swap_red_blue
+            && memcmp(&table->format, format, sizeof(rfbPixelFormat)) == 0)
+        return table;
+
+    guac_vnc_pixel_table_free(table);
+
+    table = guac_mem_zalloc(sizeof(guac_vnc_pixel_table));
+    table->format = *format;
+    table->swap_red_blue = swap_red_blue;
+
+    table->red   = guac_vnc_pixel_table_alloc_component(format->redMax,   swap_red_blue ? 0 : 16);
+    table->green = guac_vnc_pixel_table_alloc_component(format->greenMax, 8);
+    table->blue  = guac_vnc_pixel_table_alloc_component(format->blueMax,  swap_red_blue ? 16 : 0);
+
+    /* Low color depths can be converted with a single lookup per pixel */
+    if (format->bitsPerPixel <= GUAC_VNC_PIXEL_TABLE_MAX_BPP) {
+
+        int count = 1 << format->bitsPerPixel;
+        table->pixels = guac_mem_alloc(sizeof(uint32_t), count);
+
+        for (int v = 0; v < count; v++)
+            table->pixels[v] = 0xFF000000
+                | table->red[(v >> format->redShift) & format->redMax]
+                | table->green[(v >> format->greenShift) & format->greenMax]
+                | table->blue[(v >> format->blueShift) & format->blueMax];
+
+    }
+
+    vnc_client->pixel_table = table;
+    return table;
+
+}
+
 void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
 
     guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
@@ -59,69 +162,110 @@ void guac_vnc_update(rfbClient* client, int x, int y, int w, int h) {
     guac_rect op_bounds;
     guac_rect_init(&op_bounds, x, y, w, h);
 
-    /* Ensure operation bounds are within possibly updated bounds of the
-     * pending frame (now the RFB client framebuffer) */
-    guac_rect_constrain(&op_bounds, &context->bounds);
-
     /* NOTE: The guac_display will be pointed directly at the libvncclient
      * framebuffer if the pixel format used is identical to that expected by
-     * guac_display. No need to manually copy anything around in that case. */
-
-    /* All framebuffer formats must be manually converted if not identical to
-     * the format used by guac_display */
-    if (vnc_bpp != GUAC_DISPLAY_LAYER_RAW_BPP || vnc_client->settings->swap_red_blue) {
-
-        /* Ensure draw is within current bounds of the pending frame */
-        guac_rect_constrain(&op_bounds, &context->bounds);
+     * guac_display. No need to manually copy anything around in that case,
+     * but the update is only applied to the guac_display once the buffer
+     * decoded into is swapped with the buffer in use by the guac_display. */
+    if (guac_vnc_framebuffer_is_double_buffered(gc, client)) {
+
+        guac_rect framebuffer_bounds;
+        guac_rect_init(&framebuffer_bounds, 0, 0, client->width, client->height);
+        guac_rect_constrain(&op_bounds, &framebuffer_bounds);
+
+        guac_vnc_framebuffer_damage(&vnc_client->framebuffer, &op_bounds);
+
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+        /* Forward the original JPEG data if this update consisted of exactly
+         * the most recently received JPEG rectangle, swapping immediately as
+         * hinted image data must already be part of the pending frame */
+        const guac_rect* jpeg_rect = &vnc_client->jpeg.rect;
+        if (vnc_client->jpeg.length > 0
+                && op_bounds.left   == jpeg_rect->left
+                && op_bounds.top    == jpeg_rect->top
+                && op_bounds.right  == jpeg_rect->right
+                && op_bounds.bottom == jpeg_rect->bottom) {
+            guac_vnc_framebuffer_swap(gc);
+            guac_display_layer_hint_image(default_layer, &op_bounds, "image/jpeg",
+                    vnc_client->jpeg.data, vnc_client->jpeg.length);
+        }
 
-        const unsigned char* vnc_current_row = GUAC_RECT_CONST_BUFFER(op_bounds, client->frameBuffer, vnc_stride, vnc_bpp);
-        unsigned char* layer_current_row = GUAC_RECT_MUTABLE_BUFFER(op_bounds, context->buffer, context->stride, GUAC_DISPLAY_LAYER_RAW_BPP);
-        for (int dy = op_bounds.top; dy < op_bounds.bottom; dy++) {
+        vnc_client->jpeg.length = 0;
+#endif
 
-            /* Get current Guacamole buffer row, advance to next */
-            uint32_t* layer_current_pixel = (uint32_t*) layer_current_row;
-            layer_current_row += context->stride;
+        return;
 
-            /* Get current VNC framebuffer row, advance to next */
-            const unsigned char* vnc_current_pixel = vnc_current_row;
-            vnc_current_row += vnc_stride;
+    }
 
-            for (int dx = op_bounds.left; dx < op_bounds.right; dx++) {
+    /* Ensure operation bounds are within possibly updated bounds of the
+     * pending frame */
+    guac_rect_constrain(&op_bounds, &context->bounds);
 
-                /* Read current VNC pixel value */
-                uint32_t v;
-                switch (vnc_bpp) {
+    /* All framebuffer formats must otherwise be manually converted, as they
+     * are not identical to the format used by guac_display */
+    guac_vnc_pixel_table* table = guac_vnc_get_pixel_table(vnc_client, client);
+    const rfbPixelFormat* format = &table->format;
 
-                    case 2:
-                        v = *((uint16_t*) vnc_current_pixel);
-                        break;
+    const unsigned char* vnc_current_row = GUAC_RECT_CONST_BUFFER(op_bounds, client->frameBuffer, vnc_stride, vnc_bpp);
+    unsigned char* layer_current_row = GUAC_RECT_MUTABLE_BUFFER(op_bounds, context->buffer, context->stride, GUAC_DISPLAY_LAYER_RAW_BPP);
+    int width = guac_rect_width(&op_bounds);
 
-                    default:
-                        v = *((uint8_t*) vnc_current_pixel);
+    for (int dy = op_bounds.top; dy < op_bounds.bottom; dy++) {
 
-                }
+        /* Get current Guacamole buffer row, advance to next */
+        uint32_t* layer_current_pixel = (uint32_t*) layer_current_row;
+        layer_current_row += context->stride;
 
-                /* Translate value to 32-bit RGB */
-                uint8_t red   = (v >> client->format.redShift)   * 0x100 / (client->format.redMax   + 1);
-                uint8_t green = (v >> client->format.greenShift) * 0x100 / (client->format.greenMax + 1);
-                uint8_t blue  = (v >> client->format.blueShift)  * 0x100 / (client->format.blueMax  + 1);
+        /* Get current VNC framebuffer row, advance to next */
+        const unsigned char* vnc_current_pixel = vnc_current_row;
+        vnc_current_row += vnc_stride;
 
-                /* Output RGB */
-                if (vnc_client->settings->swap_red_blue)
-                    *(layer_current_pixel++) = 0xFF000000 | (blue << 16) | (green << 8) | red;
-                else
-                    *(layer_current_pixel++) = 0xFF000000 | (red  << 16) | (green << 8) | blue;
+        /* Translate each pixel with a single lookup for low color
+         * depths */
+        if (vnc_bpp == 2) {
+            const uint16_t* vnc_row = (const uint16_t*) vnc_current_pixel;
+            for (int dx = 0; dx < width; dx++)
+                layer_current_pixel[dx] = table->pixels[vnc_row[dx]];
+        }
 
-                /* Advance to next pixel in VNC framebuffer */
-                vnc_current_pixel += vnc_bpp;
+        else if (vnc_bpp == 1) {
+            for (int dx = 0; dx < width; dx++)
+                layer_current_pixel[dx] = table->pixels[vnc_current_pixel[dx]];
+        }
 
+        /* Translate each color component separately otherwise */
+        else {
+            const uint32_t* vnc_row = (const uint32_t*) vnc_current_pixel;
+            for (int dx = 0; dx < width; dx++) {
+                uint32_t v = vnc_row[dx];
+                layer_current_pixel[dx] = 0xFF000000
+                    | table->red[(v >> format->redShift) & format->redMax]
+                    | table->green[(v >> format->greenShift) & format->greenMax]
+                    | table->blue[(v >> format->blueShift) & format->blueMax];
             }
         }
 
-    } /* end manual convert */
+    }
 
-    /* Mark modified region as dirty */
-    guac_rect_extend(&context->dirty, &op_bounds);
+    /* Mark modified region as dirty (individually, rather than as part of
+     * the overall dirty rect of the context, as VNC updates are frequently
+     * small and scattered) */
+    guac_display_layer_mark_dirty(default_layer, &op_bounds);
+
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+    /* Forward the original JPEG data if this update consisted of exactly
+     * the most recently received JPEG rectangle */
+    const guac_rect* jpeg_rect = &vnc_client->jpeg.rect;
+    if (vnc_client->jpeg.length > 0
+            && op_bounds.left   == jpeg_rect->left
+            && op_bounds.top    == jpeg_rect->top
+            && op_bounds.right  == jpeg_rect->right
+            && op_bounds.bottom == jpeg_rect->bottom)
+        guac_display_layer_hint_image(default_layer, &op_bounds, "image/jpeg",
+                vnc_client->jpeg.data, vnc_client->jpeg.length);
+
+    vnc_client->jpeg.length = 0;
+#endif
 
     /* Hint at source of copied data if this update involved CopyRect */
     if (vnc_client->copy_rect_used) {
@@ -140,12 +284,183 @@ void guac_vnc_copyrect(rfbClient* client, int src_x, int src_y, int w, int h, in
 
     vnc_client->copy_rect_used = 1;
 
+    /* Record the exact copy performed by the server, such that it can be
+     * sent as a single copy rather than needing to be found by searching
+     * the modified region of the display (copies within a double-buffered
+     * framebuffer are hinted only once the buffers are swapped, such that
+     * each hint accompanies the frame containing the copy) */
+    guac_rect src;
+    guac_rect_init(&src, src_x, src_y, w, h);
+    if (guac_vnc_framebuffer_is_double_buffered(gc, client))
+        guac_vnc_framebuffer_hint_copy(&vnc_client->framebuffer, &src,
+                dest_x, dest_y);
+    else
+        guac_display_layer_hint_copy(guac_display_default_layer(vnc_client->display),
+                &src, dest_x, dest_y);
+
     /* Use original, wrapped proc to perform actual copy between regions of
      * libvncclient's display buffer */
     vnc_client->rfb_GotCopyRect(client, src_x, src_y, w, h, dest_x, dest_y);
 
 }
 
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+/**
+ * libjpeg error manager which returns control to guac_vnc_decode_jpeg() when
+ * an error occurs, rather than terminating the process.
+ */
+typedef struct guac_vnc_jpeg_error_mgr {
+
+    /**
+     * The standard libjpeg error manager.
+     */
+    struct jpeg_error_mgr base;
+
+    /**
+     * The point within guac_vnc_decode_jpeg() to return to if decoding
+     * fails.
+     */
+    jmp_buf jump;
+
+} guac_vnc_jpeg_error_mgr;
+
+/**
+ * libjpeg error handler which aborts decoding by returning control to
+ * guac_vnc_decode_jpeg().
+ *
+ * @param cinfo
+ *     The libjpeg decompression state of the failed decode.
+ */
+static void guac_vnc_jpeg_error_exit(j_common_ptr cinfo) {
+    guac_vnc_jpeg_error_mgr* error = (guac_vnc_jpeg_error_mgr*) cinfo->err;
+    longjmp(error->jump, 1);
+}
+
+/**
+ * Stores a single RGB pixel within the given libvncclient framebuffer
+ * pixel, converting that pixel to the framebuffer's pixel format.
+ *
+ * @param format
+ *     The pixel format of the libvncclient framebuffer.
+ *
+ * @param pixel
+ *     The location of the pixel within the libvncclient framebuffer.
+ *
+ * @param rgb
+ *     The red, green, and blue components of the pixel, in that order.
+ */
+static void guac_vnc_jpeg_store_pixel(const rfbPixelFormat* format,
+        unsigned char* pixel, const JSAMPLE* rgb) {
+
+    uint32_t v = ((uint32_t) (rgb[0] * format->redMax / 255) << format->redShift)
+               | ((uint32_t) (rgb[1] * format->greenMax / 255) << format->greenShift)
+               | ((uint32_t) (rgb[2] * format->blueMax / 255) << format->blueShift);
+
+    switch (format->bitsPerPixel) {
+
+        case 32:
+            *((uint32_t*) pixel) = v;
+            break;
+
+        case 16:
+            *((uint16_t*) pixel) = (uint16_t) v;
+            break;
+
+        default:
+            *pixel = (uint8_t) v;
+            break;
+
+    }
+
+}
+
+rfbBool guac_vnc_decode_jpeg(rfbClient* client, const uint8_t* buffer,
+        int length, int x, int y, int w, int h) {
+
+    guac_client* gc = rfbClientGetClientData(client, GUAC_VNC_CLIENT_KEY);
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+
+    if (length <= 0 || x < 0 || y < 0 || w <= 0 || h <= 0
+            || x + w > client->width || y + h > client->height)
+        return FALSE;
+
+    unsigned int vnc_bpp = client->format.bitsPerPixel / 8;
+    size_t vnc_stride = guac_mem_ckd_mul_or_die(vnc_bpp, client->width);
+
+    /* Allocated before decoding begins, as nothing allocated after the call
+     * to setjmp() can safely be freed if decoding fails */
+    JSAMPLE* row = guac_mem_alloc(w, 3);
+
+    struct jpeg_decompress_struct cinfo;
+    guac_vnc_jpeg_error_mgr error;
+
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = guac_vnc_jpeg_error_exit;
+
+    if (setjmp(error.jump)) {
+        guac_client_log(gc, GUAC_LOG_DEBUG, "Unable to decode JPEG "
+                "rectangle received from VNC server.");
+        jpeg_destroy_decompress(&cinfo);
+        guac_mem_free(row);
+        return FALSE;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*) buffer, length);
+    jpeg_read_header(&cinfo, TRUE);
+
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    /* The JPEG must cover exactly the rectangle being updated */
+    if (cinfo.output_width != (JDIMENSION) w
+            || cinfo.output_height != (JDIMENSION) h
+            || cinfo.output_components != 3)
+        longjmp(error.jump, 1);
+
+    guac_rect dst;
+    guac_rect_init(&dst, x, y, w, h);
+
+    unsigned char* vnc_current_row = GUAC_RECT_MUTABLE_BUFFER(dst,
+            client->frameBuffer, vnc_stride, vnc_bpp);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+
+        jpeg_read_scanlines(&cinfo, &row, 1);
+
+        unsigned char* vnc_current_pixel = vnc_current_row;
+        vnc_current_row += vnc_stride;
+
+        for (int dx = 0; dx < w; dx++) {
+            guac_vnc_jpeg_store_pixel(&client->format, vnc_current_pixel,
+                    row + dx * 3);
+            vnc_current_pixel += vnc_bpp;
+        }
+
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    guac_mem_free(row);
+
+    /* Retain the original JPEG data until the corresponding framebuffer
+     * update is received by guac_vnc_update() */
+    guac_vnc_jpeg* jpeg = &vnc_client->jpeg;
+    if (jpeg->size < (size_t) length) {
+        guac_mem_free(jpeg->data);
+        jpeg->data = guac_mem_alloc(length);
+        jpeg->size = length;
+    }
+
+    memcpy(jpeg->data, buffer, length);
+    jpeg->length = length;
+    jpeg->rect = dst;
+
+    return TRUE;
+
+}
+#endif // LIBVNC_CLIENT_HAS_GOT_JPEG
+
 #ifdef LIBVNC_HAS_RESIZE_SUPPORT
 /**
  * This function does the actual work of sending the message to the RFB/VNC
@@ -353,6 +668,18 @@ rfbBool guac_vnc_malloc_framebuffer(rfbClient* rfb_client) {
 
     /* Use original, wrapped proc to resize the buffer maintained by
      * libvncclient */
-    return vnc_client->rfb_MallocFrameBuffer(rfb_client);
+    if (!vnc_client->rfb_MallocFrameBuffer(rfb_client))
+        return FALSE;
+
+    /* The entire contents of a newly-allocated double-buffered framebuffer
+     * must be published with the next swap, regardless of whether the VNC
+     * server updates it */
+    if (guac_vnc_framebuffer_is_double_buffered(gc, rfb_client)) {
+        guac_rect bounds;
+        guac_rect_init(&bounds, 0, 0, rfb_client->width, rfb_client->height);
+        guac_vnc_framebuffer_damage(&vnc_client->framebuffer, &bounds);
+    }
+
+    return TRUE;
 
 }
@@ -22,10 +22,97 @@
 
 #include "config.h"
 
+#include <guacamole/rect.h>
 #include <guacamole/user.h>
 #include <rfb/rfbclient.h>
 #include <rfb/rfbproto.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The largest number of bits per pixel of any VNC pixel format that is
+ * converted using a lookup table covering every possible pixel value. Pixel
+ * formats having more bits per pixel are converted channel-by-channel.
+ */
+#define GUAC_VNC_PIXEL_TABLE_MAX_BPP 16
+
+/**
+ * A JPEG rectangle received within a Tight update, retained between its
+ * decoding and the framebuffer update that follows, such that the original
+ * JPEG data can be forwarded to connected users as-is.
+ */
+typedef struct guac_vnc_jpeg {
+
+    /**
+     * The region of the framebuffer that the JPEG data was decoded into.
+     */
+    guac_rect rect;
+
+    /**
+     * The JPEG data, or NULL if no JPEG data has yet been received.
+     */
+    unsigned char* data;
+
+    /**
+     * The number of bytes of JPEG data, or zero if no JPEG rectangle is
+     * awaiting its framebuffer update.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the JPEG data.
+     */
+    size_t size;
+
+} guac_vnc_jpeg;
+
+/**
+ * Precomputed lookup tables which convert pixels of a specific VNC pixel
+ * format to the 32-bit ARGB pixels expected by guac_display.
+ */
+typedef struct guac_vnc_pixel_table {
+
+    /**
+     * The VNC pixel format that these tables convert from.
+     */
+    rfbPixelFormat format;
+
+    /**
+     * Whether these tables swap the red and blue components of each pixel.
+     */
+    int swap_red_blue;
+
+    /**
+     * The 32-bit pixel value contributed by each possible value of the red
+     * component, with redMax + 1 entries. All other bits of each entry are
+     * zero.
+     */
+    uint32_t* red;
+
+    /**
+     * The 32-bit pixel value contributed by each possible value of the green
+     * component, with greenMax + 1 entries. All other bits of each entry are
+     * zero.
+     */
+    uint32_t* green;
+
+    /**
+     * The 32-bit pixel value contributed by each possible value of the blue
+     * component, with blueMax + 1 entries. All other bits of each entry are
+     * zero.
+     */
+    uint32_t* blue;
+
+    /**
+     * The complete, opaque 32-bit pixel for every possible value of a pixel
+     * in the VNC pixel format, or NULL if that format has more than
+     * GUAC_VNC_PIXEL_TABLE_MAX_BPP bits per pixel.
+     */
+    uint32_t* pixels;
+
+} guac_vnc_pixel_table;
+
 /**
  * Callback invoked by libVNCServer when it receives a new binary image data
  * from the VNC server. The image itself will be stored in the designated sub-
@@ -51,6 +138,45 @@
  */
 void guac_vnc_update(rfbClient* client, int x, int y, int w, int h);
 
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+/**
+ * Callback invoked by libVNCServer when it receives a JPEG rectangle within a
+ * Tight update, in place of decoding that rectangle itself. The JPEG data is
+ * decoded into the designated sub-rectangle of client->framebuffer, and is
+ * retained such that guac_vnc_update() can forward it to connected users
+ * as-is rather than encoding the same content again.
+ *
+ * @param client
+ *     The VNC client associated with the VNC session in which the JPEG
+ *     rectangle was received.
+ *
+ * @param buffer
+ *     The JPEG data.
+ *
+ * @param length
+ *     The number of bytes of JPEG data.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination rectangle
+ *     in which the image should be drawn, in pixels.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination rectangle
+ *     in which the image should be drawn, in pixels.
+ *
+ * @param w
+ *     The width of the image, in pixels.
+ *
+ * @param h
+ *     The height of the image, in pixels.
+ *
+ * @return
+ *     TRUE if the JPEG data was decoded successfully, FALSE otherwise.
+ */
+rfbBool guac_vnc_decode_jpeg(rfbClient* client, const uint8_t* buffer,
+        int length, int x, int y, int w, int h);
+#endif
+
 /**
  * Callback invoked by libVNCServer when it receives a CopyRect message.
  * CopyRect specified a rectangle of source data within the display and a
@@ -134,9 +260,21 @@ void guac_vnc_display_set_size(rfbClient* client, int requested_width, int reque
  */
 void guac_vnc_set_pixel_format(rfbClient* client, int color_depth);
 
+/**
+ * Frees the given pixel format conversion tables, as built automatically
+ * for the pixel format of the VNC session by guac_vnc_update().
+ *
+ * @param table
+ *     The pixel format conversion tables to free, or NULL if no such tables
+ *     have been built.
+ */
+void guac_vnc_pixel_table_free(guac_vnc_pixel_table* table);
+
 /**
  * Overridden implementation of the rfb_MallocFrameBuffer function invoked by
- * libVNCServer when the display is being resized (or initially allocated).
+ * libVNCServer when the display is being resized (or initially allocated). If
+ * the framebuffer is double-buffered, the entire newly-allocated framebuffer
+ * is marked as modified, such that it is published with the next swap.
  *
  * @param client
  *     The VNC client associated with the VNC session whose display needs to be
@@ -0,0 +1,196 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "framebuffer.h"
+#include "vnc.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/mem.h>
+#include <guacamole/rect.h>
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int guac_vnc_framebuffer_is_double_buffered(guac_client* client,
+        rfbClient* rfb_client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+
+    unsigned int vnc_bpp = rfb_client->format.bitsPerPixel / 8;
+    return vnc_bpp == GUAC_DISPLAY_LAYER_RAW_BPP
+        && !vnc_client->settings->swap_red_blue;
+
+}
+
+void guac_vnc_framebuffer_damage(guac_vnc_framebuffer* framebuffer,
+        const guac_rect* rect) {
+
+    if (guac_rect_is_empty(rect))
+        return;
+
+    /* Track further regions as part of a single region covering everything
+     * once there are too many to track individually */
+    if (framebuffer->damage_count == GUAC_VNC_FRAMEBUFFER_MAX_DAMAGE) {
+
+        for (int i = 1; i < framebuffer->damage_count; i++)
+            guac_rect_extend(&framebuffer->damage[0], &framebuffer->damage[i]);
+
+        framebuffer->damage_count = 1;
+
+    }
+
+    framebuffer->damage[framebuffer->damage_count++] = *rect;
+
+}
+
+void guac_vnc_framebuffer_hint_copy(guac_vnc_framebuffer* framebuffer,
+        const guac_rect* src, int x, int y) {
+
+    if (framebuffer->copy_count == GUAC_VNC_FRAMEBUFFER_MAX_COPIES)
+        return;
+
+    guac_vnc_framebuffer_copy* copy = &framebuffer->copies[framebuffer->copy_count++];
+    copy->src = *src;
+    copy->x = x;
+    copy->y = y;
+
+}
+
+void guac_vnc_framebuffer_swap(guac_client* client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    guac_vnc_framebuffer* framebuffer = &vnc_client->framebuffer;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    if (framebuffer->damage_count == 0 || rfb_client->frameBuffer == NULL)
+        return;
+
+    int width = rfb_client->width;
+    int height = rfb_client->height;
+    size_t stride = guac_mem_ckd_mul_or_die(GUAC_DISPLAY_LAYER_RAW_BPP, width);
+
+    guac_rect bounds;
+    guac_rect_init(&bounds, 0, 0, width, height);
+
+    /* The guac_display does not read its current buffer while a raw context
+     * is open, so that buffer may be freely replaced until the context is
+     * closed */
+    guac_display_layer* default_layer = guac_display_default_layer(vnc_client->display);
+    guac_display_layer_raw_context* context = guac_display_layer_open_raw(default_layer);
+
+    uint8_t* decoded = rfb_client->frameBuffer;
+    uint8_t* spare = framebuffer->spare;
+
+    /* Reallocate the spare buffer if the framebuffer has been resized since
+     * the last swap (including the first swap, as there is not yet any spare
+     * buffer), copying over the entire framebuffer rather than only the
+     * modified regions */
+    int resized = (framebuffer->width != width || framebuffer->height != height);
+    if (resized) {
+
+        free(spare);
+        spare = framebuffer->spare = malloc(guac_mem_ckd_mul_or_die(stride, height));
+        framebuffer->width = width;
+        framebuffer->height = height;
+
+        if (spare == NULL) {
+            framebuffer->width = 0;
+            framebuffer->height = 0;
+            guac_display_layer_close_raw(default_layer, context);
+            guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                    "Unable to allocate framebuffer.");
+            return;
+        }
+
+        framebuffer->damage[0] = bounds;
+        framebuffer->damage_count = 1;
+
+    }
+
+    /* Hand the newly-decoded buffer to the guac_display */
+    context->buffer = decoded;
+    context->stride = stride;
+    context->bounds = bounds;
+
+    if (resized)
+        guac_rect_extend(&context->dirty, &bounds);
+    else {
+        for (int i = 0; i < framebuffer->damage_count; i++)
+            guac_display_layer_mark_dirty(default_layer, &framebuffer->damage[i]);
+    }
+
+    for (int i = 0; i < framebuffer->copy_count; i++) {
+        guac_vnc_framebuffer_copy* copy = &framebuffer->copies[i];
+        guac_display_layer_hint_copy(default_layer, &copy->src, copy->x, copy->y);
+    }
+
+    /* Hint at source of copied data if this update involved CopyRect */
+    if (vnc_client->copy_rect_used) {
+        context->hint_from = default_layer;
+        vnc_client->copy_rect_used = 0;
+    }
+
+    /* Decode into the buffer previously used by the guac_display */
+    rfb_client->frameBuffer = spare;
+    framebuffer->spare = decoded;
+
+    guac_display_layer_close_raw(default_layer, context);
+
+    /* Bring the buffer that will be decoded into next up to date. The
+     * guac_display may now be reading the newly-decoded buffer, but never
+     * writes to it, so this copy need not wait for the frame to be flushed. */
+    for (int i = 0; i < framebuffer->damage_count; i++) {
+
+        guac_rect damage = framebuffer->damage[i];
+        guac_rect_constrain(&damage, &bounds);
+        if (guac_rect_is_empty(&damage))
+            continue;
+
+        const unsigned char* src = GUAC_RECT_CONST_BUFFER(damage, decoded,
+                stride, GUAC_DISPLAY_LAYER_RAW_BPP);
+        unsigned char* dst = GUAC_RECT_MUTABLE_BUFFER(damage, spare,
+                stride, GUAC_DISPLAY_LAYER_RAW_BPP);
+
+        size_t length = guac_mem_ckd_mul_or_die(guac_rect_width(&damage),
+                GUAC_DISPLAY_LAYER_RAW_BPP);
+
+        for (int y = damage.top; y < damage.bottom; y++) {
+            memcpy(dst, src, length);
+            src += stride;
+            dst += stride;
+        }
+
+    }
+
+    framebuffer->damage_count = 0;
+    framebuffer->copy_count = 0;
+
+    guac_display_render_thread_notify_modified(vnc_client->render_thread);
+
+}
+
+void guac_vnc_framebuffer_free(guac_vnc_framebuffer* framebuffer) {
+    free(framebuffer->spare);
+    framebuffer->spare = NULL;
+}
@@ -0,0 +1,200 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_VNC_FRAMEBUFFER_H
+#define GUAC_VNC_FRAMEBUFFER_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/rect.h>
+#include <rfb/rfbclient.h>
+
+#include <stdint.h>
+
+/**
+ * The maximum number of separate modified rectangles tracked between swaps
+ * of a double-buffered framebuffer. If more rectangles are modified, they are
+ * tracked as a single rectangle covering all of them.
+ */
+#define GUAC_VNC_FRAMEBUFFER_MAX_DAMAGE 128
+
+/**
+ * The maximum number of copies hinted by the VNC server (via CopyRect) that
+ * are tracked between swaps of a double-buffered framebuffer. Any further
+ * copies are simply found by the guac_display, if possible.
+ */
+#define GUAC_VNC_FRAMEBUFFER_MAX_COPIES 16
+
+/**
+ * A copy of one region of the framebuffer to another, as performed by the VNC
+ * server using CopyRect.
+ */
+typedef struct guac_vnc_framebuffer_copy {
+
+    /**
+     * The region copied.
+     */
+    guac_rect src;
+
+    /**
+     * The X coordinate of the upper-left corner of the destination.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the destination.
+     */
+    int y;
+
+} guac_vnc_framebuffer_copy;
+
+/**
+ * The state of the double-buffered framebuffer of a VNC connection. While the
+ * pixel format of the VNC connection matches that of guac_display, the
+ * default layer of the guac_display uses one of two buffers directly while
+ * libvncclient decodes into the other, such that messages from the VNC server
+ * can be decoded without waiting for the guac_display to finish diffing and
+ * flushing the previous frame. Once decoding of a message is complete, the
+ * buffers are swapped, and the regions modified by that message are copied
+ * into the buffer that libvncclient will decode into next.
+ */
+typedef struct guac_vnc_framebuffer {
+
+    /**
+     * The buffer currently in use by the default layer of the guac_display,
+     * or NULL if no buffers have yet been swapped. This buffer is allocated
+     * with malloc(), rather than guac_mem_alloc(), as it becomes the
+     * framebuffer of libvncclient with the next swap, and libvncclient will
+     * free() its framebuffer upon resize.
+     */
+    uint8_t* spare;
+
+    /**
+     * The width of the spare buffer, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the spare buffer, in pixels.
+     */
+    int height;
+
+    /**
+     * The regions of the framebuffer of libvncclient that have been modified
+     * since the last swap.
+     */
+    guac_rect damage[GUAC_VNC_FRAMEBUFFER_MAX_DAMAGE];
+
+    /**
+     * The number of entries within the damage array.
+     */
+    int damage_count;
+
+    /**
+     * The copies performed by the VNC server since the last swap.
+     */
+    guac_vnc_framebuffer_copy copies[GUAC_VNC_FRAMEBUFFER_MAX_COPIES];
+
+    /**
+     * The number of entries within the copies array.
+     */
+    int copy_count;
+
+} guac_vnc_framebuffer;
+
+/**
+ * Returns whether the framebuffer of the given VNC connection is currently
+ * double-buffered, which is the case only if the pixel format of the VNC
+ * connection matches that of guac_display (and the framebuffer of
+ * libvncclient could thus be used by the guac_display directly). If not
+ * double-buffered, each update must instead be converted into the buffer of
+ * the default layer of the guac_display while a raw context is open.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ *
+ * @param rfb_client
+ *     The rfbClient of the VNC connection, which may not yet be stored within
+ *     the guac_vnc_client if the connection is still being established.
+ *
+ * @return
+ *     Non-zero if the framebuffer is double-buffered, zero otherwise.
+ */
+int guac_vnc_framebuffer_is_double_buffered(guac_client* client,
+        rfbClient* rfb_client);
+
+/**
+ * Records that the given region of the framebuffer of libvncclient has been
+ * modified, such that the modification is applied to the guac_display when
+ * the framebuffer is next swapped with guac_vnc_framebuffer_swap().
+ *
+ * @param framebuffer
+ *     The double-buffered framebuffer that was modified.
+ *
+ * @param rect
+ *     The region modified.
+ */
+void guac_vnc_framebuffer_damage(guac_vnc_framebuffer* framebuffer,
+        const guac_rect* rect);
+
+/**
+ * Records that the VNC server copied the given region of the framebuffer to
+ * the given location, such that the copy is hinted to the guac_display when
+ * the framebuffer is next swapped with guac_vnc_framebuffer_swap().
+ *
+ * @param framebuffer
+ *     The double-buffered framebuffer that was copied within.
+ *
+ * @param src
+ *     The region copied.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination.
+ */
+void guac_vnc_framebuffer_hint_copy(guac_vnc_framebuffer* framebuffer,
+        const guac_rect* src, int x, int y);
+
+/**
+ * Swaps the framebuffer of libvncclient with the buffer in use by the default
+ * layer of the guac_display, such that all modifications recorded with
+ * guac_vnc_framebuffer_damage() become part of the pending frame, and
+ * libvncclient continues decoding into a buffer having identical contents.
+ * This function has no effect if nothing has been modified since the last
+ * swap. This must be invoked only by the thread handling inbound VNC
+ * messages, and only while the framebuffer is double-buffered.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ */
+void guac_vnc_framebuffer_swap(guac_client* client);
+
+/**
+ * Frees the spare buffer of the given double-buffered framebuffer, if any.
+ * The guac_display must no longer be referencing that buffer.
+ *
+ * @param framebuffer
+ *     The double-buffered framebuffer to free.
+ */
+void guac_vnc_framebuffer_free(guac_vnc_framebuffer* framebuffer);
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "quality.h"
+#include "vnc.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <guacamole/timestamp.h>
+#include <rfb/rfbclient.h>
+
+#include <pthread.h>
+
+/**
+ * Requests the Tight quality and compression levels corresponding to the
+ * current degradation from the VNC server, resending the pixel format and
+ * encodings of the client.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ *
+ * @return
+ *     Non-zero if the levels were sent successfully, zero otherwise.
+ */
+static int guac_vnc_quality_send(guac_client* client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    guac_vnc_quality* quality = &vnc_client->quality;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    int quality_level = quality->max_quality - quality->degradation;
+    int compress_level = quality->min_compress + quality->degradation;
+
+    if (quality_level < 0)
+        quality_level = 0;
+
+    if (compress_level > 9)
+        compress_level = 9;
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Requesting Tight quality level "
+            "%i and compression level %i.", quality_level, compress_level);
+
+    rfb_client->appData.qualityLevel = quality_level;
+    rfb_client->appData.compressLevel = compress_level;
+
+    pthread_mutex_lock(&(vnc_client->message_lock));
+    int result = SetFormatAndEncodings(rfb_client);
+    pthread_mutex_unlock(&(vnc_client->message_lock));
+
+    return result;
+
+}
+
+void guac_vnc_quality_adapt(guac_client* client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    guac_vnc_settings* settings = vnc_client->settings;
+    guac_vnc_quality* quality = &vnc_client->quality;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    /* Lossless connections never request JPEG, and thus have no quality
+     * level to adapt */
+    if (!settings->adaptive_quality || settings->lossless)
+        return;
+
+    guac_timestamp now = guac_timestamp_current();
+
+    /* Begin from the levels that were configured (or the defaults of
+     * libvncclient) */
+    if (quality->last_check == 0) {
+
+        quality->max_quality = rfb_client->appData.qualityLevel;
+        if (quality->max_quality < 0 || quality->max_quality > 9)
+            quality->max_quality = GUAC_VNC_QUALITY_DEFAULT_QUALITY;
+
+        quality->min_compress = rfb_client->appData.compressLevel;
+        if (quality->min_compress < 0 || quality->min_compress > 9)
+            quality->min_compress = GUAC_VNC_QUALITY_DEFAULT_COMPRESS;
+
+        quality->degradation = 0;
+        quality->last_check = now;
+        return;
+
+    }
+
+    if (now - quality->last_check < GUAC_VNC_QUALITY_INTERVAL)
+        return;
+
+    quality->last_check = now;
+
+    /* Users are behind if either they are slow to acknowledge frames or the
+     * render thread is waiting for them to catch up */
+    int lag = guac_client_get_processing_lag(client);
+    int delay = guac_display_render_thread_get_delay(vnc_client->render_thread);
+    if (delay > lag)
+        lag = delay;
+
+    int max_degradation = quality->max_quality;
+    if (9 - quality->min_compress > max_degradation)
+        max_degradation = 9 - quality->min_compress;
+
+    /* Trade quality for throughput while users are falling behind */
+    if (lag > GUAC_VNC_QUALITY_MAX_LAG
+            && quality->degradation < max_degradation) {
+        quality->degradation++;
+        guac_vnc_quality_send(client);
+    }
+
+    /* Restore quality once users have caught up */
+    else if (lag < GUAC_VNC_QUALITY_MIN_LAG && quality->degradation > 0) {
+        quality->degradation--;
+        guac_vnc_quality_send(client);
+    }
+
+}
@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_VNC_QUALITY_H
+#define GUAC_VNC_QUALITY_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The minimum amount of time between changes to the Tight quality and
+ * compression levels, in milliseconds. Each change is downgraded or upgraded
+ * by a single step, and must be given time to take effect before the
+ * resulting lag can be judged.
+ */
+#define GUAC_VNC_QUALITY_INTERVAL 1000
+
+/**
+ * The lag, in milliseconds, above which connected users are considered to be
+ * falling behind, such that quality should be reduced in favor of
+ * throughput.
+ */
+#define GUAC_VNC_QUALITY_MAX_LAG 200
+
+/**
+ * The lag, in milliseconds, below which connected users are considered to be
+ * keeping up, such that quality may be restored.
+ */
+#define GUAC_VNC_QUALITY_MIN_LAG 50
+
+/**
+ * The default Tight quality level of libvncclient, used as the best quality
+ * level if none was configured.
+ */
+#define GUAC_VNC_QUALITY_DEFAULT_QUALITY 5
+
+/**
+ * The default Tight compression level of libvncclient, used as the lowest
+ * compression level if none was configured.
+ */
+#define GUAC_VNC_QUALITY_DEFAULT_COMPRESS 3
+
+/**
+ * The state of the adaptive Tight quality and compression levels of a VNC
+ * connection.
+ */
+typedef struct guac_vnc_quality {
+
+    /**
+     * The best quality level that may be requested, as configured for the
+     * connection (0 to 9).
+     */
+    int max_quality;
+
+    /**
+     * The lowest compression level that may be requested, as configured for
+     * the connection (0 to 9).
+     */
+    int min_compress;
+
+    /**
+     * The number of steps that the quality and compression levels currently
+     * requested are degraded from the configured levels, or zero if the
+     * configured levels are currently requested.
+     */
+    int degradation;
+
+    /**
+     * The time that the quality and compression levels were last changed or
+     * judged to be appropriate, or zero if adaptive quality has not yet
+     * started.
+     */
+    guac_timestamp last_check;
+
+} guac_vnc_quality;
+
+/**
+ * Raises or lowers the Tight quality and compression levels requested from
+ * the VNC server depending on the lag experienced by connected users,
+ * resending the encodings supported by the client if the levels change. Each
+ * level moves by only one step at a time, between the configured levels and
+ * the lowest quality and highest compression. This has no effect unless
+ * adaptive quality has been enabled within the connection settings, and must
+ * be invoked only by the thread handling inbound VNC messages.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ */
+void guac_vnc_quality_adapt(guac_client* client);
+
+#endif
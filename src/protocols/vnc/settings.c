@@ -103,6 +103,10 @@ const char* GUAC_VNC_CLIENT_ARGS[] = {
     "force-lossless",
     "compress-level",
     "quality-level",
+    "disable-continuous-updates",
+    "adaptive-quality",
+    "min-display-workers",
+    "max-display-workers",
     NULL
 };
 
@@ -439,6 +443,36 @@ enum VNC_ARGS_IDX {
      */
     IDX_QUALITY_LEVEL,
 
+    /**
+     * "true" if continuous updates should not be requested from VNC servers
+     * that support them, such that each update is requested only after the
+     * previous update has been received, "false" or blank otherwise.
+     */
+    IDX_DISABLE_CONTINUOUS_UPDATES,
+
+    /**
+     * "true" if the Tight quality and compression levels should be lowered
+     * and raised during the connection depending on whether connected users
+     * are keeping up with the graphical updates received, "false" or blank
+     * otherwise. The configured levels are the best that will be requested.
+     */
+    IDX_ADAPTIVE_QUALITY,
+
+    /**
+     * The fewest worker threads that should be kept running to encode the
+     * graphical updates of this connection while the display is idle. If
+     * omitted, a single worker thread is kept running.
+     */
+    IDX_MIN_DISPLAY_WORKERS,
+
+    /**
+     * The most worker threads that may be used to encode the graphical updates
+     * of this connection. Worker threads are added as updates back up, up to
+     * this limit. If omitted, the limit is the number of worker threads guacd
+     * is configured to use for each connection.
+     */
+    IDX_MAX_DISPLAY_WORKERS,
+
     VNC_ARGS_COUNT
 };
 
@@ -523,6 +557,25 @@ guac_vnc_settings* guac_vnc_parse_args(guac_user* user,
         guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
                 IDX_QUALITY_LEVEL, -1);
 
+    /* Continuous updates */
+    settings->disable_continuous_updates =
+        guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_DISABLE_CONTINUOUS_UPDATES, false);
+
+    /* Adaptive quality */
+    settings->adaptive_quality =
+        guac_user_parse_args_boolean(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_ADAPTIVE_QUALITY, false);
+
+    /* Bounds on display worker threads */
+    settings->min_display_workers =
+        guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_MIN_DISPLAY_WORKERS, 0);
+
+    settings->max_display_workers =
+        guac_user_parse_args_int(user, GUAC_VNC_CLIENT_ARGS, argv,
+                IDX_MAX_DISPLAY_WORKERS, 0);
+
 #ifdef ENABLE_VNC_REPEATER
     /* Set repeater parameters if specified */
     settings->dest_host =
@@ -103,6 +103,30 @@ typedef struct guac_vnc_settings {
       */
     int quality_level;
 
+    /**
+     * Whether continuous updates should not be requested from VNC servers
+     * that support them.
+     */
+    bool disable_continuous_updates;
+
+    /**
+     * Whether the Tight quality and compression levels should be adapted
+     * during the connection to the lag experienced by connected users.
+     */
+    bool adaptive_quality;
+
+    /**
+     * The fewest worker threads to keep running to encode graphical updates
+     * while the display is idle, or zero to use the default.
+     */
+    int min_display_workers;
+
+    /**
+     * The most worker threads that may be used to encode graphical updates,
+     * or zero to use the default.
+     */
+    int max_display_workers;
+
 #ifdef ENABLE_VNC_REPEATER
     /**
      * The VNC host to connect to, if using a repeater.
@@ -0,0 +1,310 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "updates.h"
+#include "vnc.h"
+
+#include <guacamole/client.h>
+#include <guacamole/display.h>
+#include <rfb/rfbclient.h>
+#include <rfb/rfbproto.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Sends an EnableContinuousUpdates message to the VNC server, enabling or
+ * disabling continuous updates for the entire framebuffer.
+ *
+ * @param vnc_client
+ *     The guac_vnc_client of the VNC connection.
+ *
+ * @param enable
+ *     Non-zero if continuous updates should be enabled, zero if continuous
+ *     updates should be disabled.
+ *
+ * @return
+ *     Non-zero if the message was sent successfully, zero otherwise.
+ */
+static int guac_vnc_updates_send_enable(guac_vnc_client* vnc_client,
+        int enable) {
+
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    uint16_t width = rfb_client->width;
+    uint16_t height = rfb_client->height;
+
+    /* Message type, enable flag, and X, Y, width, and height of the area
+     * receiving continuous updates (all big-endian) */
+    uint8_t msg[GUAC_VNC_CONTINUOUS_UPDATES_MSG_SIZE] = {
+        GUAC_VNC_MSG_CONTINUOUS_UPDATES, enable ? 1 : 0,
+        0, 0, 0, 0,
+        width >> 8, width & 0xFF,
+        height >> 8, height & 0xFF
+    };
+
+    pthread_mutex_lock(&(vnc_client->message_lock));
+    int result = WriteToRFBServer(rfb_client, (char*) msg, sizeof(msg));
+    pthread_mutex_unlock(&(vnc_client->message_lock));
+
+    vnc_client->updates.width = width;
+    vnc_client->updates.height = height;
+
+    return result;
+
+}
+
+/**
+ * Handles a Fence message received from the VNC server, the message type of
+ * which has already been read. Fence requests are answered immediately, as
+ * all flags that this client supports are satisfied simply by handling
+ * messages in order.
+ *
+ * @param gc
+ *     The guac_client associated with the VNC connection.
+ *
+ * @param rfb_client
+ *     The rfbClient that received the message.
+ *
+ * @return
+ *     TRUE if the message was handled successfully, FALSE otherwise.
+ */
+static rfbBool guac_vnc_updates_handle_fence(guac_client* gc,
+        rfbClient* rfb_client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+
+    /* Padding, flags, and payload length */
+    uint8_t header[GUAC_VNC_FENCE_HEADER_SIZE];
+    if (!ReadFromRFBServer(rfb_client, (char*) header, sizeof(header)))
+        return FALSE;
+
+    uint32_t flags = ((uint32_t) header[3] << 24) | (header[4] << 16)
+                   | (header[5] << 8) | header[6];
+
+    uint8_t length = header[7];
+    if (length > GUAC_VNC_FENCE_MAX_PAYLOAD) {
+        guac_client_log(gc, GUAC_LOG_WARNING, "VNC server sent a fence "
+                "with an invalid payload length (%i bytes).", length);
+        return FALSE;
+    }
+
+    /* The payload is opaque and must be returned as-is */
+    uint8_t payload[GUAC_VNC_FENCE_MAX_PAYLOAD];
+    if (length > 0 && !ReadFromRFBServer(rfb_client, (char*) payload, length))
+        return FALSE;
+
+    if (!vnc_client->updates.fence_supported) {
+        guac_client_log(gc, GUAC_LOG_DEBUG, "VNC server supports fences.");
+        vnc_client->updates.fence_supported = 1;
+    }
+
+    /* Responses to fences are only expected for requests (this client does
+     * not itself send any requests) */
+    if (!(flags & GUAC_VNC_FENCE_REQUEST))
+        return TRUE;
+
+    flags &= GUAC_VNC_FENCE_SUPPORTED_FLAGS;
+
+    uint8_t response[1 + GUAC_VNC_FENCE_HEADER_SIZE + GUAC_VNC_FENCE_MAX_PAYLOAD] = {
+        GUAC_VNC_MSG_FENCE,
+        0, 0, 0,
+        flags >> 24, (flags >> 16) & 0xFF, (flags >> 8) & 0xFF, flags & 0xFF,
+        length
+    };
+
+    memcpy(response + 1 + GUAC_VNC_FENCE_HEADER_SIZE, payload, length);
+
+    pthread_mutex_lock(&(vnc_client->message_lock));
+    rfbBool result = WriteToRFBServer(rfb_client, (char*) response,
+            1 + GUAC_VNC_FENCE_HEADER_SIZE + length);
+    pthread_mutex_unlock(&(vnc_client->message_lock));
+
+    return result;
+
+}
+
+/**
+ * Handles an EndOfContinuousUpdates message received from the VNC server,
+ * the message type of which has already been read (the message has no other
+ * content). This message is sent once when continuous updates are first
+ * advertised, indicating that the server supports them, and again whenever
+ * continuous updates have been disabled.
+ *
+ * @param gc
+ *     The guac_client associated with the VNC connection.
+ *
+ * @param rfb_client
+ *     The rfbClient that received the message.
+ *
+ * @return
+ *     TRUE if the message was handled successfully, FALSE otherwise.
+ */
+static rfbBool guac_vnc_updates_handle_end(guac_client* gc,
+        rfbClient* rfb_client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) gc->data;
+    guac_vnc_continuous_updates_state previous = vnc_client->updates.state;
+
+    if (!vnc_client->updates.continuous_updates_supported) {
+        guac_client_log(gc, GUAC_LOG_DEBUG, "VNC server supports continuous "
+                "updates.");
+        vnc_client->updates.continuous_updates_supported = 1;
+    }
+
+    vnc_client->updates.state = GUAC_VNC_CONTINUOUS_UPDATES_DISABLED;
+
+    /* Resume requesting updates one at a time if the server was previously
+     * pushing updates, as there may be no request outstanding */
+    if (previous != GUAC_VNC_CONTINUOUS_UPDATES_DISABLED) {
+
+        pthread_mutex_lock(&(vnc_client->message_lock));
+        rfbBool result = SendIncrementalFramebufferUpdateRequest(rfb_client);
+        pthread_mutex_unlock(&(vnc_client->message_lock));
+
+        return result;
+
+    }
+
+    return TRUE;
+
+}
+
+/**
+ * Callback invoked by libvncclient for each server message that libvncclient
+ * does not itself handle, after only the message type has been read.
+ *
+ * @param rfb_client
+ *     The rfbClient that received the message.
+ *
+ * @param message
+ *     The received message, of which only the message type is valid.
+ *
+ * @return
+ *     TRUE if the message was recognized and handled successfully, FALSE
+ *     otherwise.
+ */
+static rfbBool guac_vnc_updates_handle_message(rfbClient* rfb_client,
+        rfbServerToClientMsg* message) {
+
+    guac_client* gc = rfbClientGetClientData(rfb_client, GUAC_VNC_CLIENT_KEY);
+
+    switch (message->type) {
+
+        case GUAC_VNC_MSG_FENCE:
+            return guac_vnc_updates_handle_fence(gc, rfb_client);
+
+        case GUAC_VNC_MSG_CONTINUOUS_UPDATES:
+            return guac_vnc_updates_handle_end(gc, rfb_client);
+
+    }
+
+    return FALSE;
+
+}
+
+/**
+ * The pseudo-encodings advertised to the VNC server, terminated by zero.
+ */
+static int guac_vnc_updates_encodings[] = {
+    GUAC_VNC_ENCODING_FENCE,
+    GUAC_VNC_ENCODING_CONTINUOUS_UPDATES,
+    0
+};
+
+/**
+ * The libvncclient extension advertising and handling continuous updates and
+ * fences.
+ */
+static rfbClientProtocolExtension guac_vnc_updates_extension = {
+    .encodings     = guac_vnc_updates_encodings,
+    .handleMessage = guac_vnc_updates_handle_message
+};
+
+/**
+ * Guard ensuring that the libvncclient extension is registered only once.
+ */
+static pthread_once_t guac_vnc_updates_registered = PTHREAD_ONCE_INIT;
+
+/**
+ * Registers the libvncclient extension, unconditionally. This function is
+ * invoked through pthread_once().
+ */
+static void guac_vnc_updates_register_once(void) {
+    rfbClientRegisterExtension(&guac_vnc_updates_extension);
+}
+
+void guac_vnc_updates_register(void) {
+    pthread_once(&guac_vnc_updates_registered, guac_vnc_updates_register_once);
+}
+
+void guac_vnc_updates_pace(guac_client* client) {
+
+    guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
+    guac_vnc_updates* updates = &vnc_client->updates;
+    rfbClient* rfb_client = vnc_client->rfb_client;
+
+    /* Servers which support continuous updates need not honor them unless
+     * fences are also supported */
+    if (vnc_client->settings->disable_continuous_updates
+            || !updates->fence_supported
+            || !updates->continuous_updates_supported)
+        return;
+
+    int delay = guac_display_render_thread_get_delay(vnc_client->render_thread);
+
+    switch (updates->state) {
+
+        /* Resume continuous updates only once clients have caught up */
+        case GUAC_VNC_CONTINUOUS_UPDATES_DISABLED:
+            if (delay == 0 && guac_vnc_updates_send_enable(vnc_client, 1))
+                updates->state = GUAC_VNC_CONTINUOUS_UPDATES_ENABLED;
+            break;
+
+        /* Pause continuous updates if clients are falling behind, falling
+         * back to requesting each update only after the previous update has
+         * been received */
+        case GUAC_VNC_CONTINUOUS_UPDATES_ENABLED:
+
+            if (delay > GUAC_VNC_UPDATES_MAX_DELAY) {
+                guac_client_log(client, GUAC_LOG_TRACE, "Pausing continuous "
+                        "updates (clients are %ims behind).", delay);
+                if (guac_vnc_updates_send_enable(vnc_client, 0))
+                    updates->state = GUAC_VNC_CONTINUOUS_UPDATES_STOPPING;
+            }
+
+            /* Continuous updates cover only the area that was requested, and
+             * must be requested again if the framebuffer is resized */
+            else if (updates->width != rfb_client->width
+                    || updates->height != rfb_client->height)
+                guac_vnc_updates_send_enable(vnc_client, 1);
+
+            break;
+
+        /* Nothing to do until the server confirms that continuous updates
+         * have stopped */
+        case GUAC_VNC_CONTINUOUS_UPDATES_STOPPING:
+            break;
+
+    }
+
+}
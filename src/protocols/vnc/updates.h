@@ -0,0 +1,192 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_VNC_UPDATES_H
+#define GUAC_VNC_UPDATES_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <rfb/rfbclient.h>
+
+/**
+ * The pseudo-encoding sent by clients that support the Fence message.
+ */
+#define GUAC_VNC_ENCODING_FENCE -312
+
+/**
+ * The pseudo-encoding sent by clients that support the
+ * EnableContinuousUpdates and EndOfContinuousUpdates messages.
+ */
+#define GUAC_VNC_ENCODING_CONTINUOUS_UPDATES -313
+
+/**
+ * The message type of both the EnableContinuousUpdates message (sent by the
+ * client) and the EndOfContinuousUpdates message (sent by the server).
+ */
+#define GUAC_VNC_MSG_CONTINUOUS_UPDATES 150
+
+/**
+ * The message type of the Fence message, sent by either side.
+ */
+#define GUAC_VNC_MSG_FENCE 248
+
+/**
+ * The size of an EnableContinuousUpdates message, in bytes.
+ */
+#define GUAC_VNC_CONTINUOUS_UPDATES_MSG_SIZE 10
+
+/**
+ * The size of the portion of a Fence message following its type and
+ * preceding its payload, in bytes.
+ */
+#define GUAC_VNC_FENCE_HEADER_SIZE 8
+
+/**
+ * The maximum size of the payload of a Fence message, in bytes.
+ */
+#define GUAC_VNC_FENCE_MAX_PAYLOAD 64
+
+/**
+ * Fence flag requiring that all messages preceding the fence be handled
+ * before the fence itself is handled.
+ */
+#define GUAC_VNC_FENCE_BLOCK_BEFORE (1 << 0)
+
+/**
+ * Fence flag requiring that no message following the fence be handled until
+ * the fence itself has been handled.
+ */
+#define GUAC_VNC_FENCE_BLOCK_AFTER (1 << 1)
+
+/**
+ * Fence flag requiring that the message following the fence be handled
+ * before the response to the fence is sent.
+ */
+#define GUAC_VNC_FENCE_SYNC_NEXT (1 << 2)
+
+/**
+ * Fence flag indicating that the fence is a request which must be answered
+ * with a response, rather than a response to an earlier request.
+ */
+#define GUAC_VNC_FENCE_REQUEST (1u << 31)
+
+/**
+ * The fence flags honored by this client. As inbound messages are handled
+ * strictly in order, one at a time, each of these flags is inherently
+ * satisfied.
+ */
+#define GUAC_VNC_FENCE_SUPPORTED_FLAGS \
+    (GUAC_VNC_FENCE_BLOCK_BEFORE | GUAC_VNC_FENCE_BLOCK_AFTER \
+     | GUAC_VNC_FENCE_SYNC_NEXT)
+
+/**
+ * The amount of time, in milliseconds, that the render thread may need to
+ * wait for connected clients to catch up before continuous updates are
+ * paused. While paused, each update is requested only after the previous
+ * update has been received, and continuous updates resume once clients have
+ * caught up.
+ */
+#define GUAC_VNC_UPDATES_MAX_DELAY 50
+
+/**
+ * The state of continuous updates for a VNC connection.
+ */
+typedef enum guac_vnc_continuous_updates_state {
+
+    /**
+     * Continuous updates are not currently in effect. Each update is
+     * requested only after the previous update has been received.
+     */
+    GUAC_VNC_CONTINUOUS_UPDATES_DISABLED,
+
+    /**
+     * Continuous updates have been enabled, and the server is pushing updates
+     * as the framebuffer changes.
+     */
+    GUAC_VNC_CONTINUOUS_UPDATES_ENABLED,
+
+    /**
+     * Continuous updates have been disabled, but the server has not yet
+     * confirmed that it has stopped pushing updates.
+     */
+    GUAC_VNC_CONTINUOUS_UPDATES_STOPPING
+
+} guac_vnc_continuous_updates_state;
+
+/**
+ * The state of the continuous updates and fence extensions for a VNC
+ * connection.
+ */
+typedef struct guac_vnc_updates {
+
+    /**
+     * Whether the VNC server has sent a Fence message, indicating that it
+     * supports fences.
+     */
+    int fence_supported;
+
+    /**
+     * Whether the VNC server has sent an EndOfContinuousUpdates message,
+     * indicating that it supports continuous updates.
+     */
+    int continuous_updates_supported;
+
+    /**
+     * The current state of continuous updates.
+     */
+    guac_vnc_continuous_updates_state state;
+
+    /**
+     * The width of the area for which continuous updates were most recently
+     * enabled, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the area for which continuous updates were most recently
+     * enabled, in pixels.
+     */
+    int height;
+
+} guac_vnc_updates;
+
+/**
+ * Registers the libvncclient extension which advertises and handles the
+ * continuous updates and fence extensions. This must be invoked before any
+ * connection to a VNC server is established, and may safely be invoked any
+ * number of times.
+ */
+void guac_vnc_updates_register(void);
+
+/**
+ * Enables, pauses, or resizes continuous updates for the given VNC
+ * connection depending on whether the connected clients are keeping up with
+ * the frames sent by the render thread. This has no effect if the VNC server
+ * does not support both continuous updates and fences, or if continuous
+ * updates have been disabled within the connection settings. This must be
+ * invoked only by the thread handling inbound VNC messages, and should be
+ * invoked regularly.
+ *
+ * @param client
+ *     The guac_client associated with the VNC connection.
+ */
+void guac_vnc_updates_pace(guac_client* client);
+
+#endif
@@ -83,6 +83,10 @@ int guac_vnc_user_join_handler(guac_user* user, int argc, char** argv) {
         user->mouse_handler = guac_vnc_user_mouse_handler;
         user->key_handler = guac_vnc_user_key_handler;
 
+        /* Handle only the most recent position if mouse motion is
+         * received faster than it can be handled */
+        user->coalesce_mouse = 1;
+
         /* Inbound (client to server) clipboard transfer */
         if (!settings->disable_paste)
             user->clipboard_handler = guac_vnc_clipboard_handler;
@@ -27,6 +27,8 @@
 #include "display.h"
 #include "log.h"
 #include "settings.h"
+#include "quality.h"
+#include "updates.h"
 #include "vnc.h"
 
 #ifdef ENABLE_PULSE
@@ -142,6 +144,12 @@ rfbClient* guac_vnc_get_client(guac_client* client) {
     vnc_client->rfb_GotCopyRect = rfb_client->GotCopyRect;
     rfb_client->GotCopyRect = guac_vnc_copyrect;
 
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+    /* Forward Tight JPEG rectangles as-is unless updates must be lossless */
+    if (!vnc_settings->lossless)
+        rfb_client->GotJpeg = guac_vnc_decode_jpeg;
+#endif
+
 #ifdef ENABLE_VNC_TLS_LOCKING
     /* TLS Locking and Unlocking */
     rfb_client->LockWriteToTLS = guac_vnc_lock_write_to_tls;
@@ -234,6 +242,12 @@ rfbClient* guac_vnc_get_client(guac_client* client) {
     if (vnc_settings->encodings)
         rfb_client->appData.encodingsString = strdup(vnc_settings->encodings);
 
+    /* Advertise continuous updates and fences, which are not handled by
+     * libvncclient itself */
+    guac_vnc_updates_register();
+    vnc_client->updates = (guac_vnc_updates) { 0 };
+    vnc_client->quality = (guac_vnc_quality) { 0 };
+
     /* Connect */
     if (rfbInitClient(rfb_client, NULL, NULL))
         return rfb_client;
@@ -286,32 +300,37 @@ static rfbBool guac_vnc_handle_messages(guac_client* client) {
     guac_vnc_client* vnc_client = (guac_vnc_client*) client->data;
     rfbClient* rfb_client = vnc_client->rfb_client;
     guac_display_layer* default_layer = guac_display_default_layer(vnc_client->display);
+    rfbBool retval;
+
+    /* If the buffer of libvncclient matches the guac_display format, decode
+     * without holding an open context, such that the guac_display may diff
+     * and flush the previous frame in parallel, publishing the result only
+     * once the message has been handled */
+    int double_buffered = guac_vnc_framebuffer_is_double_buffered(client,
+            rfb_client);
+    if (double_buffered) {
+        retval = HandleRFBServerMessage(rfb_client);
+        guac_vnc_framebuffer_swap(client);
+    }
 
-    /* All potential drawing operations must occur while holding an open context */
-    guac_display_layer_raw_context* context = guac_display_layer_open_raw(default_layer);
-    vnc_client->current_context = context;
-
-    /* Actually handle messages (this may result in drawing to the
-     * guac_display, resizing the display buffer, etc.) */
-    rfbBool retval = HandleRFBServerMessage(rfb_client);
+    /* Otherwise, all potential drawing operations must occur while holding an
+     * open context, as each update is converted into the buffer of the
+     * guac_display */
+    else {
 
-    /* Use the buffer of libvncclient directly if it matches the guac_display
-     * format */
-    unsigned int vnc_bpp = rfb_client->format.bitsPerPixel / 8;
-    if (vnc_bpp == GUAC_DISPLAY_LAYER_RAW_BPP && !vnc_client->settings->swap_red_blue) {
+        guac_display_layer_raw_context* context = guac_display_layer_open_raw(default_layer);
+        vnc_client->current_context = context;
 
-        context->buffer = rfb_client->frameBuffer;
-        context->stride = guac_mem_ckd_mul_or_die(vnc_bpp, rfb_client->width);
+        /* Actually handle messages (this may result in drawing to the
+         * guac_display, resizing the display buffer, etc.) */
+        retval = HandleRFBServerMessage(rfb_client);
 
-        /* Update bounds of pending frame to match those of RFB framebuffer */
-        guac_rect_init(&context->bounds, 0, 0, rfb_client->width, rfb_client->height);
+        /* There will be no further drawing operations */
+        guac_display_layer_close_raw(default_layer, context);
+        vnc_client->current_context = NULL;
 
     }
 
-    /* There will be no further drawing operations */
-    guac_display_layer_close_raw(default_layer, context);
-    vnc_client->current_context = NULL;
-
 #ifdef LIBVNC_HAS_RESIZE_SUPPORT
     // If screen was not previously initialized, check for it and set it.
     if (!vnc_client->rfb_screen_initialized 
@@ -339,8 +358,11 @@ static rfbBool guac_vnc_handle_messages(guac_client* client) {
 
     /* Resize the surface if VNC screen size has changed (this call
      * automatically deals with invalid dimensions and is a no-op
-     * if the size has not changed) */
-    guac_display_layer_resize(default_layer, rfb_client->width, rfb_client->height);
+     * if the size has not changed). A double-buffered framebuffer is instead
+     * resized only as its buffers are swapped, as the size of the layer must
+     * match that of the buffer in use. */
+    if (!double_buffered)
+        guac_display_layer_resize(default_layer, rfb_client->width, rfb_client->height);
 
     return retval;
 
@@ -361,7 +383,7 @@ void* guac_vnc_client_thread(void* data) {
          */
         if (settings->wol_wait_time > 0) {
             guac_client_log(client, GUAC_LOG_DEBUG, "Sending Wake-on-LAN packet, "
-                    "and pausing for %d seconds.", settings->wol_wait_time);
+                    "and waiting for the remote system to respond.");
 
             /* char representation of a port should be, at most, 5 characters plus terminator. */
             char* str_port = guac_mem_alloc(6);
@@ -371,8 +393,9 @@ void* guac_vnc_client_thread(void* data) {
                 return NULL;
             }
 
-            /* Send the Wake-on-LAN request and wait until the server is responsive. */
-            if (guac_wol_wake_and_wait(settings->wol_mac_addr,
+            /* Send the Wake-on-LAN request and wait until the server is
+             * responsive, keeping users informed while waiting. */
+            if (guac_wol_wake_and_probe(client, settings->wol_mac_addr,
                     settings->wol_broadcast_addr,
                     settings->wol_udp_port,
                     settings->wol_wait_time,
@@ -433,6 +456,10 @@ void* guac_vnc_client_thread(void* data) {
         return NULL;
     }
 
+    /* Includes TCP connection, VNC handshake, and authentication, all of
+     * which are performed within rfbInitClient() */
+    guac_client_startup_phase(client, "vnc_connect");
+
 #ifdef ENABLE_PULSE
     /* If audio is enabled, start streaming via PulseAudio */
     if (settings->audio_enabled)
@@ -592,6 +619,8 @@ void* guac_vnc_client_thread(void* data) {
 
     /* Create display */
     vnc_client->display = guac_display_alloc(client);
+    guac_display_set_worker_threads(vnc_client->display,
+            settings->min_display_workers, settings->max_display_workers);
     guac_display_layer_resize(guac_display_default_layer(vnc_client->display), rfb_client->width, rfb_client->height);
 
     /* Use lossless compression only if requested (otherwise, use default
@@ -623,6 +652,8 @@ void* guac_vnc_client_thread(void* data) {
     guac_display_end_frame(vnc_client->display);
 
     vnc_client->render_thread = guac_display_render_thread_create(vnc_client->display);
+    guac_client_startup_phase(client, "display_init");
+    guac_client_startup_complete(client);
 
     /* Handle messages from VNC server while client is running */
     while (client->state == GUAC_CLIENT_RUNNING) {
@@ -643,6 +674,12 @@ void* guac_vnc_client_thread(void* data) {
 
         }
 
+        /* Request updates only as quickly as they can be sent */
+        guac_vnc_updates_pace(client);
+
+        /* Trade image quality for throughput if users are falling behind */
+        guac_vnc_quality_adapt(client);
+
         /* If an error occurs, log it and fail */
         if (wait_result < 0)
             guac_client_abort(client, GUAC_PROTOCOL_STATUS_UPSTREAM_ERROR, "Connection closed.");
@@ -25,7 +25,10 @@
 #include "common/clipboard.h"
 #include "common/iconv.h"
 #include "display.h"
+#include "framebuffer.h"
 #include "settings.h"
+#include "quality.h"
+#include "updates.h"
 
 #include <guacamole/client.h>
 #include <guacamole/display.h>
@@ -97,6 +100,40 @@ typedef struct guac_vnc_client {
      */
     int copy_rect_used;
 
+    /**
+     * Lookup tables converting the pixel format of the VNC session to the
+     * format expected by guac_display, or NULL if no conversion has yet been
+     * needed. These tables are rebuilt whenever the pixel format changes.
+     */
+    guac_vnc_pixel_table* pixel_table;
+
+    /**
+     * The state of the double-buffered framebuffer, used while the pixel
+     * format of the VNC session matches the format expected by guac_display.
+     */
+    guac_vnc_framebuffer framebuffer;
+
+#ifdef LIBVNC_CLIENT_HAS_GOT_JPEG
+    /**
+     * The most recent JPEG rectangle received within a Tight update, which
+     * is forwarded to connected users as-is once the corresponding
+     * framebuffer update has been handled.
+     */
+    guac_vnc_jpeg jpeg;
+#endif
+
+    /**
+     * The state of continuous updates and fences for the current VNC
+     * connection.
+     */
+    guac_vnc_updates updates;
+
+    /**
+     * The state of the adaptive Tight quality and compression levels of the
+     * current VNC connection.
+     */
+    guac_vnc_quality quality;
+
     /**
      * Client settings, parsed from args.
      */
@@ -109,7 +146,9 @@ typedef struct guac_vnc_client {
 
     /**
      * The context of the current drawing (update) operation, if any. If no
-     * operation is in progress, this will be NULL.
+     * operation is in progress, or if the framebuffer is double-buffered
+     * (such that drawing occurs without holding a context), this will be
+     * NULL.
      */
     guac_display_layer_raw_context* current_context;
 
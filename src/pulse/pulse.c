@@ -27,35 +27,47 @@
 #include <guacamole/user.h>
 #include <pulse/pulseaudio.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
- * Returns whether the given buffer contains only silence (only null bytes).
+ * Returns whether the given buffer of signed 16-bit little-endian PCM data is
+ * silent or nearly silent, having a root-mean-square amplitude below
+ * GUAC_PULSE_SILENCE_THRESHOLD. The loop over samples has no branches and no
+ * dependencies between iterations other than the sum itself, such that the
+ * compiler can vectorize it.
  *
  * @param buffer
- *     The audio buffer to check.
+ *     The audio buffer to check. If NULL, the buffer is considered silent.
  *
  * @param length
- *     The length of the buffer to check.
+ *     The length of the buffer to check, in bytes.
  *
  * @return
- *     Non-zero if the audio buffer contains silence, zero otherwise.
+ *     Non-zero if the audio buffer contains only near-silence, zero
+ *     otherwise.
  */
 static int guac_pa_is_silence(const void* buffer, size_t length) {
 
-    int i;
+    /* Holes within the received audio are always silent */
+    if (buffer == NULL)
+        return 1;
 
     const unsigned char* current = (const unsigned char*) buffer;
-
-    /* For each byte in buffer */
-    for (i = 0; i < length; i++) {
-
-        /* If current value non-zero, then not silence */
-        if (*(current++))
-            return 0;
-
+    size_t samples = length / 2;
+
+    /* Sum the squares of all samples (the sum of squares of even a full
+     * fragment of full-scale samples fits easily within 64 bits) */
+    uint64_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        int32_t sample = (int16_t) (current[i * 2] | (current[i * 2 + 1] << 8));
+        sum += (uint32_t) (sample * sample);
     }
 
-    /* Otherwise, the buffer contains 100% silence */
-    return 1;
+    /* Compare mean square against square of threshold, avoiding both the
+     * division and the square root */
+    return sum < (uint64_t) GUAC_PULSE_SILENCE_THRESHOLD
+                * GUAC_PULSE_SILENCE_THRESHOLD * samples;
 
 }
 
@@ -84,13 +96,22 @@ static void __stream_read_callback(pa_stream* stream, size_t length,
     /* Read data */
     pa_stream_peek(stream, &buffer, &length);
 
-    /* Continuously write received PCM data */
+    /* Reset hangover whenever audio is not silent */
     if (!guac_pa_is_silence(buffer, length))
-        guac_audio_stream_write_pcm(audio, buffer, length);
+        guac_stream->silent_bytes = 0;
+
+    /* Stop streaming (flushing whatever remains) once audio has been silent
+     * for the full hangover time */
+    else if (guac_stream->silent_bytes < GUAC_PULSE_SILENCE_HANGOVER_BYTES) {
+        guac_stream->silent_bytes += length;
+        if (guac_stream->silent_bytes >= GUAC_PULSE_SILENCE_HANGOVER_BYTES)
+            guac_audio_stream_flush(audio);
+    }
 
-    /* Flush upon silence */
-    else
-        guac_audio_stream_flush(audio);
+    /* Continuously write received PCM data until the hangover has elapsed
+     * (holes within the received audio have no data to write) */
+    if (buffer != NULL && guac_stream->silent_bytes < GUAC_PULSE_SILENCE_HANGOVER_BYTES)
+        guac_audio_stream_write_pcm(audio, buffer, length);
 
     /* Advance buffer */
     pa_stream_drop(stream);
@@ -317,6 +338,7 @@ guac_pa_stream* guac_pa_stream_alloc(guac_client* client,
     stream->client = client;
     stream->audio = audio;
     stream->pa_mainloop = pa_threaded_mainloop_new();
+    stream->silent_bytes = 0;
 
     /* Create context */
     pa_context* context = pa_context_new(
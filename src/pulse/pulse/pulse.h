@@ -54,6 +54,30 @@
  */
 #define GUAC_PULSE_AUDIO_BPS 16
 
+/**
+ * The root-mean-square amplitude, in units of 16-bit samples, below which
+ * received audio is considered silent. This is roughly -66 dBFS, comfortably
+ * above the level of dithering noise and the noise floor of a typical idle
+ * desktop, yet far below any audible sound.
+ */
+#define GUAC_PULSE_SILENCE_THRESHOLD 16
+
+/**
+ * The amount of time, in milliseconds, that audio must remain continuously
+ * silent before streaming of that audio stops. Streaming resumes as soon as
+ * audio is no longer silent. This hangover avoids clipping the quiet tails of
+ * sounds, as well as the brief pauses within speech and music.
+ */
+#define GUAC_PULSE_SILENCE_HANGOVER 500
+
+/**
+ * The number of bytes of PCM data received from PulseAudio over the duration
+ * of GUAC_PULSE_SILENCE_HANGOVER.
+ */
+#define GUAC_PULSE_SILENCE_HANGOVER_BYTES \
+    (GUAC_PULSE_AUDIO_RATE * GUAC_PULSE_AUDIO_CHANNELS \
+     * (GUAC_PULSE_AUDIO_BPS / 8) / 1000 * GUAC_PULSE_SILENCE_HANGOVER)
+
 /**
  * An audio stream which connects to a PulseAudio server and streams the
  * received audio through a guac_client.
@@ -75,6 +99,14 @@ typedef struct guac_pa_stream {
      */
     pa_threaded_mainloop* pa_mainloop;
 
+    /**
+     * The number of bytes of continuously silent PCM data received since
+     * audio was last not silent. Once this reaches
+     * GUAC_PULSE_SILENCE_HANGOVER_BYTES, received PCM data is no longer
+     * streamed until audio is again not silent.
+     */
+    size_t silent_bytes;
+
 } guac_pa_stream;
 
 /**
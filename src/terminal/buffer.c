@@ -19,6 +19,7 @@
 
 #include "terminal/buffer.h"
 #include "terminal/common.h"
+#include "terminal/palette.h"
 #include "terminal/terminal.h"
 
 #include <guacamole/assert.h>
@@ -35,16 +36,72 @@
  */
 #define GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE 256
 
+/**
+ * A series of consecutive characters within a compacted row which all share
+ * the same attributes and width.
+ */
+typedef struct guac_terminal_buffer_run {
+
+    /**
+     * The attributes shared by all characters within this run.
+     */
+    guac_terminal_attributes attributes;
+
+    /**
+     * The width shared by all characters within this run, excluding any
+     * GUAC_CHAR_CONTINUATION characters (which always have a width of zero).
+     * If this run consists solely of GUAC_CHAR_CONTINUATION characters, this
+     * value is not applicable.
+     */
+    int width;
+
+    /**
+     * The number of characters within this run.
+     */
+    unsigned int length;
+
+} guac_terminal_buffer_run;
+
 /**
  * A single variable-length row of terminal data.
  */
 typedef struct guac_terminal_buffer_row {
 
     /**
-     * Array of guac_terminal_char representing the contents of the row.
+     * Array of guac_terminal_char representing the contents of the row, or
+     * NULL if no storage has yet been allocated for this row or the row is
+     * currently compacted.
      */
     guac_terminal_char* characters;
 
+    /**
+     * Whether this row is currently stored in compacted form, with its
+     * contents represented by the values and runs arrays rather than the
+     * characters array. Rows are compacted once they scroll out of the
+     * visible area of the terminal, and are restored to their full form only
+     * when modified.
+     */
+    bool compacted;
+
+    /**
+     * The codepoint of each character within this row, or NULL if the row is
+     * not compacted or is empty. This array contains exactly length values.
+     */
+    int* values;
+
+    /**
+     * The attributes and widths of all characters within this row as
+     * consecutive runs of identically-formatted characters, or NULL if the
+     * row is not compacted or is empty. All runs together contain exactly
+     * length characters.
+     */
+    guac_terminal_buffer_run* runs;
+
+    /**
+     * The number of runs within the runs array.
+     */
+    unsigned int run_count;
+
     /**
      * The length of this row in characters. This is the number of initialized
      * characters in the buffer, usually equal to the number of characters
@@ -99,8 +156,35 @@ struct guac_terminal_buffer {
      */
     unsigned int available;
 
+    /**
+     * Storage for the characters of any compacted row read with
+     * guac_terminal_buffer_get_columns(), such that compacted rows can be
+     * read without restoring them to their full form.
+     */
+    guac_terminal_char scratch[GUAC_TERMINAL_MAX_COLUMNS];
+
 };
 
+/**
+ * Returns the number of bytes of memory currently allocated for the contents
+ * of the given row, whether that row is compacted or in its full form.
+ *
+ * @param row
+ *     The row to measure.
+ *
+ * @return
+ *     The number of bytes allocated for the contents of the given row.
+ */
+static size_t guac_terminal_buffer_row_size(guac_terminal_buffer_row* row) {
+
+    if (row->compacted)
+        return sizeof(int) * row->length
+            + sizeof(guac_terminal_buffer_run) * row->run_count;
+
+    return sizeof(guac_terminal_char) * row->available;
+
+}
+
 guac_terminal_buffer* guac_terminal_buffer_alloc(int rows,
         const guac_terminal_char* default_character) {
 
@@ -118,15 +202,22 @@ guac_terminal_buffer* guac_terminal_buffer_alloc(int rows,
     buffer->length = 0;
     buffer->rows = guac_mem_alloc(sizeof(guac_terminal_buffer_row), buffer->available);
 
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_TERMINAL,
+            sizeof(guac_terminal_buffer_row) * buffer->available);
+
     /* Init scrollback rows */
     row = buffer->rows;
     for (i=0; i<rows; i++) {
 
-        /* Allocate row  */
-        row->available = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
+        /* Storage for each row is allocated only once the row is used */
+        row->available = 0;
         row->length = 0;
         row->wrapped_row = false;
-        row->characters = guac_mem_alloc(sizeof(guac_terminal_char), row->available);
+        row->characters = NULL;
+        row->compacted = false;
+        row->values = NULL;
+        row->runs = NULL;
+        row->run_count = 0;
 
         /* Next row */
         row++;
@@ -144,12 +235,18 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
 
     /* Free all rows */
     for (i=0; i<buffer->available; i++) {
+        guac_mem_account_free(GUAC_MEM_CATEGORY_TERMINAL,
+                guac_terminal_buffer_row_size(row));
         guac_mem_free(row->characters);
+        guac_mem_free(row->values);
+        guac_mem_free(row->runs);
         row++;
     }
 
     /* Free actual buffer */
     guac_mem_free(buffer->rows);
+    guac_mem_account_free(GUAC_MEM_CATEGORY_TERMINAL,
+            sizeof(guac_terminal_buffer_row) * buffer->available);
     guac_mem_free(buffer);
 
 }
@@ -160,8 +257,229 @@ void guac_terminal_buffer_reset(guac_terminal_buffer* buffer) {
 }
 
 /**
- * Returns the row at the given location. The row returned is guaranteed to be at least the given
- * width.
+ * Rounds the given value up to the nearest possible row length. To avoid
+ * unnecessary, repeated resizing of rows, each row length is rounded up to the
+ * nearest power of two.
+ *
+ * @param value
+ *     The value to round.
+ *
+ * @return
+ *     The power of two that is closest to the given value without exceeding
+ *     that value.
+ */
+static unsigned int guac_terminal_buffer_row_length(int value) {
+
+    GUAC_ASSERT(value >= 0);
+    GUAC_ASSERT(value <= GUAC_TERMINAL_MAX_COLUMNS);
+
+    unsigned int rounded = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
+    while (rounded < value)
+        rounded <<= 1;
+
+    return rounded;
+
+}
+
+/**
+ * Returns whether the given sets of attributes are identical.
+ *
+ * @param a
+ *     The first set of attributes to compare.
+ *
+ * @param b
+ *     The second set of attributes to compare.
+ *
+ * @return
+ *     true if the given attributes are identical, false otherwise.
+ */
+static bool guac_terminal_buffer_attributes_equal(
+        const guac_terminal_attributes* a, const guac_terminal_attributes* b) {
+
+    return a->bold        == b->bold
+        && a->half_bright == b->half_bright
+        && a->cursor      == b->cursor
+        && a->reverse     == b->reverse
+        && a->underscore  == b->underscore
+        && guac_terminal_colorcmp(&a->foreground, &b->foreground) == 0
+        && guac_terminal_colorcmp(&a->background, &b->background) == 0;
+
+}
+
+/**
+ * Returns whether the given character may be stored within the given run of
+ * a compacted row.
+ *
+ * @param run
+ *     The run that may receive the character.
+ *
+ * @param character
+ *     The character to test.
+ *
+ * @return
+ *     true if the given character has the same attributes and width as all
+ *     other characters within the given run, false otherwise.
+ */
+static bool guac_terminal_buffer_run_matches(const guac_terminal_buffer_run* run,
+        const guac_terminal_char* character) {
+
+    if (character->value != GUAC_CHAR_CONTINUATION
+            && run->width != -1 && run->width != character->width)
+        return false;
+
+    return guac_terminal_buffer_attributes_equal(&run->attributes,
+            &character->attributes);
+
+}
+
+/**
+ * Replaces the full contents of the given row with an equivalent compacted
+ * form, storing only the codepoint of each character together with runs of
+ * identically-formatted characters. The row is not modified if it is already
+ * compacted.
+ *
+ * @param row
+ *     The row to compact.
+ */
+static void guac_terminal_buffer_row_compact(guac_terminal_buffer_row* row) {
+
+    if (row->compacted)
+        return;
+
+    guac_mem_account_free(GUAC_MEM_CATEGORY_TERMINAL,
+            guac_terminal_buffer_row_size(row));
+
+    row->values = NULL;
+    row->runs = NULL;
+    row->run_count = 0;
+
+    if (row->length > 0) {
+
+        row->values = guac_mem_alloc(sizeof(int), row->length);
+
+        /* Count runs of identically-formatted characters */
+        guac_terminal_buffer_run run = { .width = -1, .length = 0 };
+        for (unsigned int i = 0; i < row->length; i++) {
+
+            guac_terminal_char* current = &(row->characters[i]);
+            if (run.length == 0 || !guac_terminal_buffer_run_matches(&run, current)) {
+                row->run_count++;
+                run.attributes = current->attributes;
+                run.width = -1;
+                run.length = 0;
+            }
+
+            if (current->value != GUAC_CHAR_CONTINUATION)
+                run.width = current->width;
+
+            run.length++;
+
+        }
+
+        row->runs = guac_mem_alloc(sizeof(guac_terminal_buffer_run), row->run_count);
+
+        /* Store codepoints and runs */
+        guac_terminal_buffer_run* current_run = row->runs - 1;
+        for (unsigned int i = 0; i < row->length; i++) {
+
+            guac_terminal_char* current = &(row->characters[i]);
+            if (i == 0 || !guac_terminal_buffer_run_matches(current_run, current)) {
+                current_run++;
+                current_run->attributes = current->attributes;
+                current_run->width = -1;
+                current_run->length = 0;
+            }
+
+            if (current->value != GUAC_CHAR_CONTINUATION)
+                current_run->width = current->width;
+
+            current_run->length++;
+            row->values[i] = current->value;
+
+        }
+
+    }
+
+    /* Full storage is no longer needed */
+    guac_mem_free(row->characters);
+    row->characters = NULL;
+    row->available = 0;
+    row->compacted = true;
+
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_TERMINAL,
+            guac_terminal_buffer_row_size(row));
+
+}
+
+/**
+ * Expands the contents of the given compacted row into the given array of
+ * characters, which must have space for at least as many characters as the
+ * length of the row.
+ *
+ * @param row
+ *     The compacted row to read.
+ *
+ * @param characters
+ *     The array that should receive the characters of the row.
+ */
+static void guac_terminal_buffer_row_decode(guac_terminal_buffer_row* row,
+        guac_terminal_char* characters) {
+
+    const int* value = row->values;
+    const guac_terminal_buffer_run* run = row->runs;
+
+    for (unsigned int i = 0; i < row->run_count; i++) {
+
+        for (unsigned int j = 0; j < run->length; j++) {
+            characters->value = *value;
+            characters->attributes = run->attributes;
+            characters->width = (*value == GUAC_CHAR_CONTINUATION) ? 0 : run->width;
+            characters++;
+            value++;
+        }
+
+        run++;
+
+    }
+
+}
+
+/**
+ * Restores the given compacted row to its full form, such that it may be
+ * modified. The row is not modified if it is not compacted.
+ *
+ * @param row
+ *     The row to restore.
+ */
+static void guac_terminal_buffer_row_uncompact(guac_terminal_buffer_row* row) {
+
+    if (!row->compacted)
+        return;
+
+    guac_mem_account_free(GUAC_MEM_CATEGORY_TERMINAL,
+            guac_terminal_buffer_row_size(row));
+
+    if (row->length > 0) {
+        row->available = guac_terminal_buffer_row_length(row->length);
+        row->characters = guac_mem_alloc(sizeof(guac_terminal_char), row->available);
+        guac_terminal_buffer_row_decode(row, row->characters);
+    }
+
+    guac_mem_free(row->values);
+    guac_mem_free(row->runs);
+    row->values = NULL;
+    row->runs = NULL;
+    row->run_count = 0;
+    row->compacted = false;
+
+    guac_mem_account_alloc(GUAC_MEM_CATEGORY_TERMINAL,
+            guac_terminal_buffer_row_size(row));
+
+}
+
+/**
+ * Returns the row at the given location, without restoring that row to its
+ * full form if it is compacted.
  *
  * @param buffer
  *     The buffer to retrieve a row from.
@@ -174,7 +492,7 @@ void guac_terminal_buffer_reset(guac_terminal_buffer* buffer) {
  * @return
  *     The buffer row at the given location, or NULL if there is no such row.
  */
-static guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row) {
+static guac_terminal_buffer_row* guac_terminal_buffer_locate_row(guac_terminal_buffer* buffer, int row) {
 
     if (abs(row) >= buffer->available)
         return NULL;
@@ -186,27 +504,27 @@ static guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buff
 }
 
 /**
- * Rounds the given value up to the nearest possible row length. To avoid
- * unnecessary, repeated resizing of rows, each row length is rounded up to the
- * nearest power of two.
+ * Returns the row at the given location, restoring that row to its full form
+ * if it is compacted such that it may be modified.
  *
- * @param value
- *     The value to round.
+ * @param buffer
+ *     The buffer to retrieve a row from.
+ *
+ * @param row
+ *     The index of the row to retrieve, where zero is the top-most row.
+ *     Negative indices represent rows in the scrollback buffer, above the
+ *     top-most row.
  *
  * @return
- *     The power of two that is closest to the given value without exceeding
- *     that value.
+ *     The buffer row at the given location, or NULL if there is no such row.
  */
-static unsigned int guac_terminal_buffer_row_length(int value) {
-
-    GUAC_ASSERT(value >= 0);
-    GUAC_ASSERT(value <= GUAC_TERMINAL_MAX_COLUMNS);
+static guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row) {
 
-    unsigned int rounded = GUAC_TERMINAL_BUFFER_ROW_MIN_SIZE;
-    while (rounded < value)
-        rounded <<= 1;
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_locate_row(buffer, row);
+    if (buffer_row != NULL)
+        guac_terminal_buffer_row_uncompact(buffer_row);
 
-    return rounded;
+    return buffer_row;
 
 }
 
@@ -239,9 +557,17 @@ static void guac_terminal_buffer_row_expand(guac_terminal_buffer_row* row, int l
     /* Expand allocated memory if there is otherwise insufficient space to fit
      * the provided length */
     if (length > row->available) {
+
+        guac_mem_account_free(GUAC_MEM_CATEGORY_TERMINAL,
+                guac_terminal_buffer_row_size(row));
+
         row->available = guac_terminal_buffer_row_length(length);
         row->characters = guac_mem_realloc_or_die(row->characters,
                 sizeof(guac_terminal_char), row->available);
+
+        guac_mem_account_alloc(GUAC_MEM_CATEGORY_TERMINAL,
+                guac_terminal_buffer_row_size(row));
+
     }
 
     /* Initialize new part of row */
@@ -412,8 +738,9 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
         guac_terminal_buffer_row_expand(dst_row, src_row->length, &buffer->default_character);
         GUAC_ASSERT(dst_row->length >= src_row->length);
 
-        /* Copy data */
-        memcpy(dst_row->characters, src_row->characters, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_char), src_row->length));
+        /* Copy data (storage for empty rows may not yet be allocated) */
+        if (src_row->length > 0)
+            memcpy(dst_row->characters, src_row->characters, guac_mem_ckd_mul_or_die(sizeof(guac_terminal_char), src_row->length));
         dst_row->length = src_row->length;
         dst_row->wrapped_row = src_row->wrapped_row;
 
@@ -427,6 +754,72 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
 
 }
 
+/**
+ * Reverses the order of the given range of rows within the given buffer,
+ * exchanging the storage of those rows rather than copying their contents.
+ *
+ * @param buffer
+ *     The buffer containing the rows to reverse.
+ *
+ * @param start_row
+ *     The first row of the range to reverse.
+ *
+ * @param end_row
+ *     The last row of the range to reverse, inclusive.
+ */
+static void guac_terminal_buffer_reverse_rows(guac_terminal_buffer* buffer,
+        int start_row, int end_row) {
+
+    while (start_row < end_row) {
+
+        guac_terminal_buffer_row* first = guac_terminal_buffer_locate_row(buffer, start_row++);
+        guac_terminal_buffer_row* last = guac_terminal_buffer_locate_row(buffer, end_row--);
+
+        guac_terminal_buffer_row swapped = *first;
+        *first = *last;
+        *last = swapped;
+
+    }
+
+}
+
+void guac_terminal_buffer_shift_rows(guac_terminal_buffer* buffer,
+        int start_row, int end_row, int offset) {
+
+    if (offset == 0 || start_row > end_row)
+        return;
+
+    /* Determine full extent of rows affected by the move */
+    int region_start = offset > 0 ? start_row : start_row + offset;
+    int region_end = offset > 0 ? end_row + offset : end_row;
+
+    /* Fall back to copying if the move cannot be represented by reordering
+     * rows within the buffer */
+    if (abs(region_start) >= buffer->available
+            || abs(region_end) >= buffer->available
+            || region_end - region_start + 1 > buffer->available) {
+        guac_terminal_buffer_copy_rows(buffer, start_row, end_row, offset);
+        return;
+    }
+
+    /* Rotate the affected rows by the requested offset, such that
+     * overwritten rows take the place of vacated rows */
+    int split = offset > 0 ? region_end - offset : region_start - offset - 1;
+    guac_terminal_buffer_reverse_rows(buffer, region_start, split);
+    guac_terminal_buffer_reverse_rows(buffer, split + 1, region_end);
+    guac_terminal_buffer_reverse_rows(buffer, region_start, region_end);
+
+    /* Empty all vacated rows, retaining their storage */
+    int vacated_start = offset > 0 ? start_row : end_row + offset + 1;
+    int vacated_end = offset > 0 ? start_row + offset - 1 : end_row;
+    for (int row = vacated_start; row <= vacated_end; row++) {
+        guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+        buffer_row->length = 0;
+        buffer_row->wrapped_row = false;
+    }
+
+}
+
 void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount) {
 
     if (amount <= 0)
@@ -438,6 +831,13 @@ void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int amount) {
     if (buffer->length > buffer->available)
         buffer->length = buffer->available;
 
+    /* Compact all rows which have just scrolled into the scrollback buffer */
+    if (amount >= buffer->available)
+        amount = buffer->available - 1;
+
+    for (int row = -amount; row < 0; row++)
+        guac_terminal_buffer_row_compact(guac_terminal_buffer_locate_row(buffer, row));
+
 }
 
 void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount) {
@@ -447,17 +847,33 @@ void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount)
 
     buffer->top = (buffer->top - amount) % buffer->available;
 
+    /* Restore all rows which have just scrolled back out of the scrollback
+     * buffer, as those rows are likely to be modified */
+    if (amount > buffer->available)
+        amount = buffer->available;
+
+    for (int row = 0; row < amount; row++)
+        guac_terminal_buffer_get_row(buffer, row);
+
 }
 
 unsigned int guac_terminal_buffer_get_columns(guac_terminal_buffer* buffer,
         guac_terminal_char** characters, bool* is_wrapped, int row) {
 
-    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_locate_row(buffer, row);
     if (buffer_row == NULL)
         return 0;
 
-    if (characters != NULL)
-        *characters = buffer_row->characters;
+    /* Read compacted rows without restoring their full form, as rows within
+     * the scrollback buffer are typically only ever read */
+    if (characters != NULL) {
+        if (buffer_row->compacted) {
+            guac_terminal_buffer_row_decode(buffer_row, buffer->scratch);
+            *characters = buffer->scratch;
+        }
+        else
+            *characters = buffer_row->characters;
+    }
 
     if (is_wrapped != NULL)
         *is_wrapped = buffer_row->wrapped_row;
@@ -519,6 +935,46 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
 
 }
 
+void guac_terminal_buffer_set_ascii(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes) {
+
+    /* Do nothing if there's nothing to do or if nothing sanely can be done
+     * (row is impossibly large) */
+    if (length <= 0 || row >= GUAC_TERMINAL_MAX_ROWS || row <= -GUAC_TERMINAL_MAX_ROWS)
+        return;
+
+    /* Do nothing if there is no such row within the buffer */
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+    if (buffer_row == NULL)
+        return;
+
+    int end_column = start_column + length - 1;
+    start_column = guac_terminal_fit_to_range(start_column, 0, GUAC_TERMINAL_MAX_COLUMNS - 1);
+    end_column = guac_terminal_fit_to_range(end_column, start_column, GUAC_TERMINAL_MAX_COLUMNS - 1);
+
+    guac_terminal_buffer_row_expand(buffer_row, end_column + 1, &buffer->default_character);
+    GUAC_ASSERT(buffer_row->length >= end_column + 1);
+
+    /* Every printable ASCII character occupies exactly one column */
+    guac_terminal_char* current = &(buffer_row->characters[start_column]);
+    for (int i = start_column; i <= end_column; i++) {
+        current->value = (unsigned char) *(text++);
+        current->attributes = *attributes;
+        current->width = 1;
+        current++;
+    }
+
+    /* Update length depending on row written */
+    if (row >= buffer->length)
+        buffer->length = row + 1;
+
+    /* Force breaks around destination region */
+    guac_terminal_buffer_force_break(buffer, row, start_column);
+    guac_terminal_buffer_force_break(buffer, row, end_column + 1);
+
+}
+
 void guac_terminal_buffer_set_cursor(guac_terminal_buffer* buffer, int row,
         int column, bool is_cursor) {
 
@@ -556,7 +1012,7 @@ unsigned int guac_terminal_buffer_effective_length(guac_terminal_buffer* buffer,
 
 void guac_terminal_buffer_set_wrapped(guac_terminal_buffer* buffer, int row, bool wrapped) {
 
-    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(buffer, row);
+    guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_locate_row(buffer, row);
     if (buffer_row == NULL)
         return;
 
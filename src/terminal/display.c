@@ -17,15 +17,17 @@
  * under the License.
  */
 
-#include "common/surface.h"
 #include "terminal/common.h"
 #include "terminal/display.h"
+#include "terminal/glyph-cache.h"
 #include "terminal/palette.h"
 #include "terminal/terminal.h"
 #include "terminal/terminal-priv.h"
 #include "terminal/types.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
@@ -34,9 +36,12 @@
 #include <glib-object.h>
 #include <guacamole/assert.h>
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/socket.h>
+#include <guacamole/unicode.h>
 #include <pango/pangocairo.h>
 
 /* Maps any codepoint onto a number between 0 and 511 inclusive */
@@ -99,13 +104,25 @@ int __guac_terminal_set_colors(guac_terminal_display* display,
 }
 
 /**
- * Sends the given character to the terminal at the given row and column,
- * rendering the character immediately. This bypasses the guac_terminal_display
- * mechanism and is intended for flushing of updates only.
+ * Renders the given character using the current font and the current glyph
+ * colors of the given display, adding the rendered glyph to the glyph cache
+ * of that display. If the display has a glyph atlas, the glyph is also drawn
+ * within its slot of that atlas.
+ *
+ * @param display
+ *     The display to render the character for.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character to render.
+ *
+ * @param width
+ *     The width of the character, in columns.
+ *
+ * @return
+ *     The newly-rendered glyph, as now stored within the glyph cache.
  */
-int __guac_terminal_set(guac_terminal_display* display, int row, int col, int codepoint) {
-
-    int width;
+static guac_terminal_glyph* guac_terminal_display_render_glyph(
+        guac_terminal_display* display, int codepoint, int width) {
 
     int bytes;
     char utf8[4];
@@ -124,15 +141,6 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     int layout_width, layout_height;
     int ideal_layout_width, ideal_layout_height;
 
-    /* Calculate width in columns */
-    width = wcwidth(codepoint);
-    if (width < 0)
-        width = 1;
-
-    /* Do nothing if glyph is empty */
-    if (width == 0)
-        return 0;
-
     /* Convert to UTF-8 */
     bytes = guac_terminal_encode_utf8(codepoint, utf8);
 
@@ -188,16 +196,98 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     cairo_move_to(cairo, 0.0, 0.0);
     pango_cairo_show_layout(cairo, layout);
 
-    /* Draw */
-    guac_common_surface_draw(display->display_surface,
-        display->char_width * col,
-        display->char_height * row,
-        surface);
-
-    /* Free all */
+    /* Free all but the rendered glyph */
     g_object_unref(layout);
     cairo_destroy(cairo);
-    cairo_surface_destroy(surface);
+    cairo_surface_flush(surface);
+
+    /* Keep rendered glyph for future draws of the same character */
+    guac_terminal_glyph* glyph = guac_terminal_glyph_cache_put(
+            display->glyph_cache, codepoint, color, background, surface);
+
+    /* Upload glyph to its slot within the atlas, replacing any glyph
+     * previously evicted from that slot */
+    if (display->glyph_atlas != NULL) {
+
+        guac_rect slot;
+        guac_rect_init(&slot,
+                GUAC_TERMINAL_GLYPH_ATLAS_X(display, glyph->slot),
+                GUAC_TERMINAL_GLYPH_ATLAS_Y(display, glyph->slot),
+                surface_width, surface_height);
+
+        guac_display_layer_raw_context* context =
+            guac_display_layer_open_raw(display->glyph_atlas);
+
+        guac_rect_constrain(&slot, &context->bounds);
+        guac_display_layer_raw_context_put(context, &slot,
+                cairo_image_surface_get_data(surface),
+                cairo_image_surface_get_stride(surface));
+
+        guac_display_layer_mark_dirty(display->glyph_atlas, &slot);
+        guac_display_layer_close_raw(display->glyph_atlas, context);
+
+    }
+
+    return glyph;
+
+}
+
+/**
+ * Draws the given character to the terminal at the given row and column,
+ * rendering the character immediately. This bypasses the guac_terminal_display
+ * mechanism and is intended for flushing of updates only.
+ */
+int __guac_terminal_set(guac_terminal_display* display,
+        guac_display_layer_raw_context* context, int row, int col,
+        int codepoint) {
+
+    /* Calculate width in columns */
+    int width = wcwidth(codepoint);
+    if (width < 0)
+        width = 1;
+
+    /* Do nothing if glyph is empty */
+    if (width == 0)
+        return 0;
+
+    /* Reuse the previous rendering of this glyph, if any */
+    guac_terminal_glyph* glyph = guac_terminal_glyph_cache_get(
+            display->glyph_cache, codepoint, &display->glyph_foreground,
+            &display->glyph_background);
+
+    if (glyph == NULL)
+        glyph = guac_terminal_display_render_glyph(display, codepoint, width);
+
+    guac_rect dst;
+    guac_rect_init(&dst,
+            display->char_width * col,
+            display->char_height * row,
+            width * display->char_width,
+            display->char_height);
+
+    /* Glyphs of wide characters may extend beyond the right edge */
+    guac_rect_constrain(&dst, &context->bounds);
+    if (guac_rect_is_empty(&dst))
+        return 0;
+
+    guac_display_layer_raw_context_put(context, &dst,
+            cairo_image_surface_get_data(glyph->surface),
+            cairo_image_surface_get_stride(glyph->surface));
+
+    guac_display_layer_mark_dirty(display->display_layer, &dst);
+
+    /* Hint that the glyph can be copied from its slot within the atlas. The
+     * hint is ignored by guac_display if that slot did not already contain
+     * this glyph as of the previous frame. */
+    if (display->glyph_atlas != NULL) {
+        guac_rect src;
+        guac_rect_init(&src,
+                GUAC_TERMINAL_GLYPH_ATLAS_X(display, glyph->slot),
+                GUAC_TERMINAL_GLYPH_ATLAS_Y(display, glyph->slot),
+                guac_rect_width(&dst), guac_rect_height(&dst));
+        guac_display_layer_hint_glyph(display->display_layer,
+                display->glyph_atlas, &src, dst.left, dst.top);
+    }
 
     return 0;
 
@@ -216,10 +306,370 @@ static int get_margin_by_dpi(int dpi) {
     return dpi * GUAC_TERMINAL_MARGINS / GUAC_TERMINAL_MM_PER_INCH;
 }
 
+/**
+ * Sends all text stream data buffered within the given display as a single
+ * blob over the given socket, emptying the buffer. If no data is buffered,
+ * this function has no effect.
+ *
+ * @param display
+ *     The display whose buffered text stream data should be sent.
+ *
+ * @param socket
+ *     The socket over which the data should be sent.
+ */
+static void guac_terminal_display_text_send(guac_terminal_display* display,
+        guac_socket* socket) {
+
+    if (display->text_length == 0)
+        return;
+
+    guac_protocol_send_blob(socket, display->text_stream,
+            display->text_buffer, display->text_length);
+
+    display->text_length = 0;
+
+}
+
+/**
+ * Appends the given line of text stream data to the buffer of the given
+ * display, first sending any data already buffered over the given socket if
+ * there is insufficient space for the line.
+ *
+ * @param display
+ *     The display whose text stream should receive the line.
+ *
+ * @param socket
+ *     The socket over which buffered data should be sent if the buffer is
+ *     full.
+ *
+ * @param line
+ *     The line to append, including its newline terminator.
+ *
+ * @param length
+ *     The length of the line, in bytes. This must not exceed
+ *     GUAC_TERMINAL_TEXT_BUFFER_SIZE.
+ */
+static void guac_terminal_display_text_append(guac_terminal_display* display,
+        guac_socket* socket, const char* line, int length) {
+
+    if (display->text_length + length > sizeof(display->text_buffer))
+        guac_terminal_display_text_send(display, socket);
+
+    memcpy(display->text_buffer + display->text_length, line, length);
+    display->text_length += length;
+
+}
+
+/**
+ * Appends a line to the text stream of the given display announcing the
+ * current dimensions of the display.
+ *
+ * @param display
+ *     The display whose dimensions should be sent.
+ *
+ * @param socket
+ *     The socket over which buffered data should be sent if the buffer is
+ *     full.
+ */
+static void guac_terminal_display_text_size(guac_terminal_display* display,
+        guac_socket* socket) {
+
+    char line[32];
+    int length = snprintf(line, sizeof(line), "S %i %i\n",
+            display->width, display->height);
+
+    guac_terminal_display_text_append(display, socket, line, length);
+
+}
+
+/**
+ * Appends lines to the text stream of the given display for the given range
+ * of cells, consisting of runs of identically-formatted characters, as
+ * currently stored within the cells of the text stream. Each wide character
+ * ends the run containing it.
+ *
+ * @param display
+ *     The display whose cells should be sent.
+ *
+ * @param socket
+ *     The socket over which buffered data should be sent if the buffer is
+ *     full.
+ *
+ * @param row
+ *     The row containing the cells to send.
+ *
+ * @param start_column
+ *     The first column of the range of cells to send.
+ *
+ * @param end_column
+ *     The last column of the range of cells to send, inclusive.
+ */
+static void guac_terminal_display_text_cells(guac_terminal_display* display,
+        guac_socket* socket, int row, int start_column, int end_column) {
+
+    /* Reserve room at the end of each line for one more character and the
+     * terminating newline */
+    char line[GUAC_TERMINAL_TEXT_BUFFER_SIZE];
+    int line_limit = sizeof(line) - 5;
+    int length = 0;
+
+    guac_terminal_color foreground = { 0 };
+    guac_terminal_color background = { 0 };
+    int flags = 0;
+
+    guac_terminal_char* current = &(display->text_cells[
+            guac_mem_ckd_add_or_die(guac_mem_ckd_mul_or_die(row, display->width),
+                start_column)]);
+
+    for (int col = start_column; col <= end_column; col++, current++) {
+
+        /* The leading column of a wide character covers its continuation */
+        if (current->value == GUAC_CHAR_CONTINUATION)
+            continue;
+
+        __guac_terminal_set_colors(display, &(current->attributes));
+
+        int current_flags =
+              (current->attributes.bold       ? GUAC_TERMINAL_TEXT_BOLD       : 0)
+            | (current->attributes.underscore ? GUAC_TERMINAL_TEXT_UNDERSCORE : 0);
+
+        /* End current run if formatting differs or the run is full */
+        if (length > 0 && (length > line_limit || current_flags != flags
+                    || guac_terminal_colorcmp(&display->glyph_foreground, &foreground)
+                    || guac_terminal_colorcmp(&display->glyph_background, &background))) {
+            line[length++] = '\n';
+            guac_terminal_display_text_append(display, socket, line, length);
+            length = 0;
+        }
+
+        /* Begin new run with the formatting of the current character */
+        if (length == 0) {
+            foreground = display->glyph_foreground;
+            background = display->glyph_background;
+            flags = current_flags;
+            length = snprintf(line, sizeof(line),
+                    "T %i %i %02x%02x%02x %02x%02x%02x %i ", row, col,
+                    foreground.red, foreground.green, foreground.blue,
+                    background.red, background.green, background.blue,
+                    flags);
+        }
+
+        int codepoint = current->value;
+        if (!guac_terminal_has_glyph(codepoint))
+            codepoint = ' ';
+
+        length += guac_utf8_write(codepoint, line + length, sizeof(line) - length);
+
+        /* Wide characters always end the run containing them */
+        if (current->width > 1) {
+            line[length++] = '\n';
+            guac_terminal_display_text_append(display, socket, line, length);
+            length = 0;
+        }
+
+    }
+
+    /* Send final run */
+    if (length > 0) {
+        line[length++] = '\n';
+        guac_terminal_display_text_append(display, socket, line, length);
+    }
+
+}
+
+/**
+ * Copies the given rectangle of cells within the text stream of the given
+ * display, appending a line describing the copy to the text stream. The
+ * rectangle and its destination must be within the bounds of the display.
+ *
+ * @param display
+ *     The display whose cells should be copied.
+ *
+ * @param src_row
+ *     The first row of the rectangle to copy.
+ *
+ * @param src_column
+ *     The first column of the rectangle to copy.
+ *
+ * @param width
+ *     The width of the rectangle, in columns.
+ *
+ * @param height
+ *     The height of the rectangle, in rows.
+ *
+ * @param dst_row
+ *     The row receiving the first row of the rectangle.
+ *
+ * @param dst_column
+ *     The column receiving the first column of the rectangle.
+ */
+static void guac_terminal_display_text_copy(guac_terminal_display* display,
+        int src_row, int src_column, int width, int height,
+        int dst_row, int dst_column) {
+
+    /* Copy from the bottom up if moving cells downward, such that
+     * overlapping rows are not overwritten before being copied */
+    int first = 0, last = height, step = 1;
+    if (dst_row > src_row) {
+        first = height - 1;
+        last = -1;
+        step = -1;
+    }
+
+    for (int i = first; i != last; i += step) {
+        memmove(&(display->text_cells[(dst_row + i) * display->width + dst_column]),
+                &(display->text_cells[(src_row + i) * display->width + src_column]),
+                sizeof(guac_terminal_char) * width);
+    }
+
+    char line[96];
+    int length = snprintf(line, sizeof(line), "C %i %i %i %i %i %i\n",
+            src_row, src_column, width, height, dst_row, dst_column);
+
+    guac_terminal_display_text_append(display, display->client->socket,
+            line, length);
+
+}
+
+/**
+ * Records that the given range of columns within the given row of the display
+ * may contain pending operations, such that the range is visited the next time
+ * the display is flushed. If the range is empty, this function has no effect.
+ *
+ * @param display
+ *     The display containing the row.
+ *
+ * @param row
+ *     The row containing the pending operations.
+ *
+ * @param start_column
+ *     The first column of the range, inclusive.
+ *
+ * @param end_column
+ *     The last column of the range, inclusive.
+ */
+static void guac_terminal_display_mark_dirty(guac_terminal_display* display,
+        int row, int start_column, int end_column) {
+
+    if (start_column > end_column)
+        return;
+
+    guac_terminal_display_dirty_row* dirty = &(display->dirty_rows[row]);
+
+    /* Extend range of columns within row */
+    if (dirty->left > dirty->right) {
+        dirty->left = start_column;
+        dirty->right = end_column;
+    }
+    else {
+        if (start_column < dirty->left)  dirty->left  = start_column;
+        if (end_column   > dirty->right) dirty->right = end_column;
+    }
+
+    /* Extend range of rows */
+    if (display->dirty_top > display->dirty_bottom) {
+        display->dirty_top = row;
+        display->dirty_bottom = row;
+    }
+    else {
+        if (row < display->dirty_top)    display->dirty_top    = row;
+        if (row > display->dirty_bottom) display->dirty_bottom = row;
+    }
+
+}
+
+/**
+ * Records that the display contains no pending operations. This must only be
+ * invoked once all operations have been flushed.
+ *
+ * @param display
+ *     The display whose dirty rows should be reset.
+ */
+static void guac_terminal_display_mark_clean(guac_terminal_display* display) {
+
+    for (int row = display->dirty_top; row <= display->dirty_bottom; row++) {
+        display->dirty_rows[row].left = 0;
+        display->dirty_rows[row].right = -1;
+    }
+
+    display->dirty_top = 0;
+    display->dirty_bottom = -1;
+
+}
+
+/**
+ * Stores the characters of all pending GUAC_CHAR_SET operations of the given
+ * display within the cells of the text stream, appending lines to the text
+ * stream for each run of updated cells. The operations themselves are left
+ * untouched, such that the backgrounds of those cells are still drawn.
+ *
+ * @param display
+ *     The display whose pending GUAC_CHAR_SET operations should be sent.
+ */
+static void guac_terminal_display_text_flush_set(guac_terminal_display* display) {
+
+    for (int row = display->dirty_top; row <= display->dirty_bottom; row++) {
+
+        int left = display->dirty_rows[row].left;
+        int right = display->dirty_rows[row].right;
+
+        size_t offset = (size_t) row * display->width + left;
+        guac_terminal_operation* current = &(display->operations[offset]);
+        guac_terminal_char* cell = &(display->text_cells[offset]);
+
+        int run_start = -1;
+        for (int col = left; col <= right + 1; col++) {
+
+            /* Update cells for each SET operation */
+            bool is_set = col <= right && current->type == GUAC_CHAR_SET;
+            if (is_set) {
+                *cell = current->character;
+                if (run_start == -1)
+                    run_start = col;
+            }
+
+            /* Send each run of updated cells */
+            else if (run_start != -1) {
+                guac_terminal_display_text_cells(display,
+                        display->client->socket, row, run_start, col - 1);
+                run_start = -1;
+            }
+
+            if (col <= right) {
+                current++;
+                cell++;
+            }
+
+        }
+
+    }
+
+}
+
+/**
+ * Returns whether the given character is drawn as a glyph within the display
+ * layer of the given display. If the text stream of the display is enabled,
+ * no character is drawn as a glyph, as clients render text themselves.
+ *
+ * @param display
+ *     The display that would draw the character.
+ *
+ * @param codepoint
+ *     The codepoint of the character.
+ *
+ * @return
+ *     true if the given character is drawn as a glyph, false if only the
+ *     background of its cell is drawn.
+ */
+static bool guac_terminal_display_draws_glyph(guac_terminal_display* display,
+        int codepoint) {
+    return display->text_stream == NULL && guac_terminal_has_glyph(codepoint);
+}
+
 guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
         const char* font_name, int font_size, int dpi,
         guac_terminal_color* foreground, guac_terminal_color* background,
-        guac_terminal_color (*palette)[256]) {
+        guac_terminal_color (*palette)[256], bool glyph_atlas) {
 
     /* Allocate display */
     guac_terminal_display* display = guac_mem_alloc(sizeof(guac_terminal_display));
@@ -229,26 +679,44 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     display->font_desc = NULL;
     display->char_width = 0;
     display->char_height = 0;
+    display->glyph_cache = guac_terminal_glyph_cache_alloc();
+
+    /* Updates are initially not suspended */
+    display->suspended = false;
 
-    /* Create default surface */
-    display->display_layer = guac_client_alloc_layer(client);
-    display->select_layer = guac_client_alloc_layer(client);
-    display->display_surface = guac_common_surface_alloc(client,
-            client->socket, display->display_layer, 0, 0);
+    /* Text stream is disabled unless explicitly enabled */
+    display->text_stream = NULL;
+    display->text_cells = NULL;
+    display->text_length = 0;
+
+    /* Create display and its layers */
+    display->graphical_display = guac_display_alloc(client);
+    display->display_layer = guac_display_alloc_layer(display->graphical_display, 1);
+    display->select_layer = guac_display_alloc_layer(display->graphical_display, 0);
 
     /* Never use lossy compression for terminal contents */
-    guac_common_surface_set_lossless(display->display_surface, 1);
+    guac_display_layer_set_lossless(
+            guac_display_default_layer(display->graphical_display), 1);
+    guac_display_layer_set_lossless(display->display_layer, 1);
 
     /* Select layer is a child of the display layer */
-    guac_protocol_send_move(client->socket, display->select_layer,
-            display->display_layer, 0, 0, 0);
+    guac_display_layer_set_parent(display->select_layer, display->display_layer);
+
+    /* Optionally draw all glyphs from an off-screen atlas, sized once the
+     * font (and thus the size of each glyph) is known */
+    display->glyph_atlas = NULL;
+    if (glyph_atlas) {
+        display->glyph_atlas = guac_display_alloc_buffer(
+                display->graphical_display, 1);
+        guac_display_layer_set_lossless(display->glyph_atlas, 1);
+    }
 
     /* Calculate margin size by DPI */
     display->margin = get_margin_by_dpi(dpi);
 
     /* Offset the Default Layer to make margins even on all sides */
-    guac_protocol_send_move(client->socket, display->display_layer,
-        GUAC_DEFAULT_LAYER, display->margin, display->margin, 0);
+    guac_display_layer_move(display->display_layer,
+            display->margin, display->margin);
 
     display->default_foreground = display->glyph_foreground = *foreground;
     display->default_background = display->glyph_background = *background;
@@ -258,6 +726,9 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     display->width = 0;
     display->height = 0;
     display->operations = NULL;
+    display->dirty_rows = NULL;
+    display->dirty_top = 0;
+    display->dirty_bottom = -1;
     display->unflushed_set = false;
 
     /* Initially nothing selected */
@@ -267,24 +738,44 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     if (guac_terminal_display_set_font(display, font_name, font_size, dpi)) {
         guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
                 "Unable to set initial font \"%s\"", font_name);
+        guac_terminal_glyph_cache_free(display->glyph_cache);
+        guac_display_free(display->graphical_display);
         guac_mem_free(display);
         return NULL;
     }
 
+    /* Send frames only once the display is fully initialized */
+    display->render_thread = guac_display_render_thread_create(
+            display->graphical_display);
+
     return display;
 
 }
 
 void guac_terminal_display_free(guac_terminal_display* display) {
 
-    /* Free font description */
+    /* Free font description and all glyphs rendered with that font */
     pango_font_description_free(display->font_desc);
+    guac_terminal_glyph_cache_free(display->glyph_cache);
+
+    /* Stop sending frames, freeing all layers only after the render thread
+     * (and any encoding of frames) has stopped */
+    guac_display_render_thread_destroy(display->render_thread);
+    guac_display_free(display->graphical_display);
 
     /* Free default palette. */
     guac_mem_free(display->default_palette);
 
     /* Free operations buffers */
     guac_mem_free(display->operations);
+    guac_mem_free(display->dirty_rows);
+
+    /* End text stream, if enabled */
+    if (display->text_stream != NULL) {
+        guac_protocol_send_end(display->client->socket, display->text_stream);
+        guac_client_free_stream(display->client, display->text_stream);
+        guac_mem_free(display->text_cells);
+    }
 
     /* Free display */
     guac_mem_free(display);
@@ -350,6 +841,10 @@ int guac_terminal_display_lookup_color(guac_terminal_display* display,
 void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, int offset) {
 
+    /* Drop all changes while updates are suspended */
+    if (display->suspended)
+        return;
+
     /* Ignore operations outside display bounds */
     if (row < 0 || row >= display->height)
         return;
@@ -399,11 +894,18 @@ void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
 
     }
 
+    guac_terminal_display_mark_dirty(display, row,
+            start_column + offset, end_column + offset);
+
 }
 
 void guac_terminal_display_copy_rows(guac_terminal_display* display,
         int start_row, int end_row, int offset) {
 
+    /* Drop all changes while updates are suspended */
+    if (display->suspended)
+        return;
+
     /* Fit relevant extents of operation within bounds (NOTE: Because this
      * operation is relative and represents the destination with an offset,
      * there's no need to recalculate the destination region - the offset
@@ -467,6 +969,9 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
         /* Next row */
         dst += display->width;
 
+        guac_terminal_display_mark_dirty(display,
+                dst_start_row + row - start_row, 0, display->width - 1);
+
     }
 
 }
@@ -474,6 +979,10 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
 void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, guac_terminal_char* character) {
 
+    /* Drop all changes while updates are suspended */
+    if (display->suspended)
+        return;
+
     /* Do nothing if glyph is empty */
     if (character->width == 0)
         return;
@@ -506,6 +1015,8 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
     }
 
+    guac_terminal_display_mark_dirty(display, row, start_column, end_column);
+
     /* Marks whether there are unflushed GUAC_CHAR_SET operations when the
      * operation is not on the first or last row because flushing new lines
      * added has a high performance cost. This flag is used to determine
@@ -515,6 +1026,54 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
 }
 
+void guac_terminal_display_set_ascii(guac_terminal_display* display, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes) {
+
+    /* Drop all changes while updates are suspended */
+    if (display->suspended)
+        return;
+
+    /* Ignore operations outside display bounds */
+    if (row < 0 || row >= display->height
+            || start_column < 0 || start_column >= display->width)
+        return;
+
+    /* Fit run within bounds */
+    if (length > display->width - start_column)
+        length = display->width - start_column;
+
+    size_t start_offset = guac_mem_ckd_add_or_die(guac_mem_ckd_mul_or_die(row, display->width), start_column);
+    guac_terminal_operation* current = &(display->operations[start_offset]);
+
+    for (int i = 0; i < length; i++) {
+
+        /* Flush pending copy operation before adding new SET operation (see
+         * guac_terminal_display_set_columns()) */
+        if (current->type == GUAC_CHAR_COPY)
+            guac_terminal_display_flush_operations(display);
+
+        /* Set operation */
+        current->type = GUAC_CHAR_SET;
+        current->character.value = (unsigned char) text[i];
+        current->character.attributes = *attributes;
+        current->character.width = 1;
+
+        /* Next character */
+        current++;
+
+    }
+
+    guac_terminal_display_mark_dirty(display, row,
+            start_column, start_column + length - 1);
+
+    /* Note unflushed GUAC_CHAR_SET operations (see
+     * guac_terminal_display_set_columns()) */
+    if (length > 0 && row > 0 && row < display->height - 1)
+        display->unflushed_set = true;
+
+}
+
 void guac_terminal_display_resize(guac_terminal_display* display, int width, int height) {
 
     /* Resize display only if dimensions have changed */
@@ -542,6 +1101,20 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
     display->operations = guac_mem_alloc(width, height,
             sizeof(guac_terminal_operation));
 
+    /* Alloc dirty rows, noting only newly-exposed cells as dirty (pending
+     * operations within the old buffer are discarded) */
+    guac_mem_free(display->dirty_rows);
+    display->dirty_rows = guac_mem_alloc(height,
+            sizeof(guac_terminal_display_dirty_row));
+
+    for (int y = 0; y < height; y++) {
+        display->dirty_rows[y].left = 0;
+        display->dirty_rows[y].right = -1;
+    }
+
+    display->dirty_top = 0;
+    display->dirty_bottom = -1;
+
     /* Init each operation buffer row */
     guac_terminal_operation* current = display->operations;
     for (int y = 0; y < height; y++) {
@@ -563,33 +1136,139 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
 
         }
 
+        /* Note initially-cleared portion of row */
+        if (y < display->height && display->width < width)
+            guac_terminal_display_mark_dirty(display, y, display->width, width - 1);
+        else if (y >= display->height)
+            guac_terminal_display_mark_dirty(display, y, 0, width - 1);
+
+    }
+
+    /* Preserve contents of text stream cells within the new dimensions */
+    if (display->text_stream != NULL) {
+
+        guac_terminal_char* text_cells = guac_mem_alloc(sizeof(guac_terminal_char),
+                width, height);
+
+        guac_terminal_char* current = text_cells;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (x < display->width && y < display->height)
+                    *current = display->text_cells[y * display->width + x];
+                else
+                    *current = fill;
+                current++;
+            }
+        }
+
+        guac_mem_free(display->text_cells);
+        display->text_cells = text_cells;
+
     }
 
     /* Set width and height */
     display->width = width;
     display->height = height;
 
-    /* Send display size */
-    guac_common_surface_resize(
-            display->display_surface,
+    if (display->text_stream != NULL)
+        guac_terminal_display_text_size(display, display->client->socket);
+
+    /* Resize layers to fit new character grid */
+    guac_display_layer_resize(display->display_layer,
             display->char_width  * width,
             display->char_height * height);
 
-    guac_protocol_send_size(display->client->socket,
-            display->select_layer,
+    guac_display_layer_resize(display->select_layer,
             display->char_width  * width,
             display->char_height * height);
 
 }
 
-void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
+/**
+ * Copies the image data within the given rectangle of the display layer of a
+ * terminal display to the given destination within that same layer. The
+ * source and destination may overlap. Both are clipped to the bounds of the
+ * layer.
+ *
+ * @param display
+ *     The terminal display being drawn to.
+ *
+ * @param context
+ *     The raw context of the display layer of the terminal display.
+ *
+ * @param src
+ *     The rectangle of image data to copy.
+ *
+ * @param dx
+ *     The X coordinate of the upper-left corner of the destination, in
+ *     pixels.
+ *
+ * @param dy
+ *     The Y coordinate of the upper-left corner of the destination, in
+ *     pixels.
+ */
+static void guac_terminal_display_copy_rect(guac_terminal_display* display,
+        guac_display_layer_raw_context* context, const guac_rect* src,
+        int dx, int dy) {
+
+    int offset_x = dx - src->left;
+    int offset_y = dy - src->top;
+
+    guac_rect src_rect = *src;
+    guac_rect_constrain(&src_rect, &context->bounds);
+
+    /* Clip destination, keeping the source aligned with what remains */
+    guac_rect dst_rect;
+    guac_rect_init(&dst_rect, src_rect.left + offset_x, src_rect.top + offset_y,
+            guac_rect_width(&src_rect), guac_rect_height(&src_rect));
+    guac_rect_constrain(&dst_rect, &context->bounds);
+
+    if (guac_rect_is_empty(&dst_rect))
+        return;
+
+    guac_rect_init(&src_rect, dst_rect.left - offset_x, dst_rect.top - offset_y,
+            guac_rect_width(&dst_rect), guac_rect_height(&dst_rect));
+
+    size_t length = guac_rect_width(&dst_rect) * GUAC_DISPLAY_LAYER_RAW_BPP;
+    int height = guac_rect_height(&dst_rect);
+
+    const unsigned char* src_row = GUAC_DISPLAY_LAYER_RAW_BUFFER(context, src_rect);
+    unsigned char* dst_row = GUAC_DISPLAY_LAYER_RAW_BUFFER(context, dst_rect);
+
+    /* Copy from the bottom up if moving image data downward, such that
+     * overlapping rows are not overwritten before being copied */
+    ptrdiff_t step = context->stride;
+    if (dst_rect.top > src_rect.top) {
+        src_row += (height - 1) * step;
+        dst_row += (height - 1) * step;
+        step = -step;
+    }
+
+    for (int y = 0; y < height; y++) {
+        memmove(dst_row, src_row, length);
+        src_row += step;
+        dst_row += step;
+    }
+
+    guac_display_layer_mark_dirty(display->display_layer, &dst_rect);
+
+}
+
+void __guac_terminal_display_flush_copy(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+    /* For each operation within each row that may contain pending operations */
+    for (row=display->dirty_top; row<=display->dirty_bottom; row++) {
+
+        int left = display->dirty_rows[row].left;
+        int right = display->dirty_rows[row].right;
+
+        guac_terminal_operation* current =
+            &(display->operations[(size_t) row * display->width + left]);
+
+        for (col=left; col<=right; col++) {
 
             /* If operation is a copy operation */
             if (current->type == GUAC_CHAR_COPY) {
@@ -684,41 +1363,55 @@ void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
 
                 }
 
-                /* Send copy */
-                guac_common_surface_copy(
-
-                        display->display_surface,
+                /* Copy image data (the copy itself is detected and sent
+                 * by the guac_display) */
+                guac_rect src;
+                guac_rect_init(&src,
                         current->column * display->char_width,
                         current->row * display->char_height,
                         rect_width * display->char_width,
-                        rect_height * display->char_height,
+                        rect_height * display->char_height);
 
-                        display->display_surface,
+                guac_terminal_display_copy_rect(display, context, &src,
                         col * display->char_width,
                         row * display->char_height);
 
+                if (display->text_stream != NULL)
+                    guac_terminal_display_text_copy(display,
+                            current->row, current->column,
+                            rect_width, rect_height, row, col);
+
             } /* end if copy operation */
 
             /* Next operation */
             current++;
 
         }
+
     }
 
 }
 
-void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
+void __guac_terminal_display_flush_clear(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+    /* For each operation within each row that may contain pending operations */
+    for (row=display->dirty_top; row<=display->dirty_bottom; row++) {
+
+        int left = display->dirty_rows[row].left;
+        int right = display->dirty_rows[row].right;
+
+        guac_terminal_operation* current =
+            &(display->operations[(size_t) row * display->width + left]);
+
+        for (col=left; col<=right; col++) {
 
             /* If operation is a clear operation (set to space) */
             if (current->type == GUAC_CHAR_SET &&
-                    !guac_terminal_has_glyph(current->character.value)) {
+                    !guac_terminal_display_draws_glyph(display,
+                        current->character.value)) {
 
                 /* The determined bounds of the rectangle of contiguous
                  * operations */
@@ -762,7 +1455,8 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
                         /* If not identical operation, stop */
                         if (rect_current->type != GUAC_CHAR_SET
-                                || guac_terminal_has_glyph(rect_current->character.value)
+                                || guac_terminal_display_draws_glyph(display,
+                                    rect_current->character.value)
                                 || guac_terminal_colorcmp(joining_color, &color) != 0)
                             break;
 
@@ -807,7 +1501,8 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
                         /* Mark clear operations as NOP */
                         if (rect_current->type == GUAC_CHAR_SET
-                                && !guac_terminal_has_glyph(rect_current->character.value)
+                                && !guac_terminal_display_draws_glyph(display,
+                                    rect_current->character.value)
                                 && guac_terminal_colorcmp(joining_color, &color) == 0)
                             rect_current->type = GUAC_CHAR_NOP;
 
@@ -821,15 +1516,18 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
                 }
 
-                /* Send rect */
-                guac_common_surface_set(
-                        display->display_surface,
+                /* Fill rect */
+                guac_rect rect;
+                guac_rect_init(&rect,
                         col * display->char_width,
                         row * display->char_height,
                         rect_width * display->char_width,
-                        rect_height * display->char_height,
-                        color.red, color.green, color.blue,
-                        0xFF);
+                        rect_height * display->char_height);
+
+                guac_rect_constrain(&rect, &context->bounds);
+                guac_display_layer_raw_context_set(context, &rect,
+                        GUAC_TERMINAL_RAW_COLOR(&color));
+                guac_display_layer_mark_dirty(display->display_layer, &rect);
 
             } /* end if clear operation */
 
@@ -837,18 +1535,26 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
             current++;
 
         }
+
     }
 
 }
 
-void __guac_terminal_display_flush_set(guac_terminal_display* display) {
+void __guac_terminal_display_flush_set(guac_terminal_display* display,
+        guac_display_layer_raw_context* context) {
 
-    guac_terminal_operation* current = display->operations;
     int row, col;
 
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+    /* For each operation within each row that may contain pending operations */
+    for (row=display->dirty_top; row<=display->dirty_bottom; row++) {
+
+        int left = display->dirty_rows[row].left;
+        int right = display->dirty_rows[row].right;
+
+        guac_terminal_operation* current =
+            &(display->operations[(size_t) row * display->width + left]);
+
+        for (col=left; col<=right; col++) {
 
             /* Perform given operation */
             if (current->type == GUAC_CHAR_SET) {
@@ -864,7 +1570,7 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
                         &(current->character.attributes));
 
                 /* Send character */
-                __guac_terminal_set(display, row, col, codepoint);
+                __guac_terminal_set(display, context, row, col, codepoint);
 
                 /* Mark operation as handled */
                 current->type = GUAC_CHAR_NOP;
@@ -875,18 +1581,36 @@ void __guac_terminal_display_flush_set(guac_terminal_display* display) {
             current++;
 
         }
+
     }
 
     /* Mark that all SET operations have been flushed */
     display->unflushed_set = 0;
 
 }
+
 void guac_terminal_display_flush_operations(guac_terminal_display* display) {
 
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->display_layer);
+
     /* Flush operations, copies first, then clears, then sets. */
-    __guac_terminal_display_flush_copy(display);
-    __guac_terminal_display_flush_clear(display);
-    __guac_terminal_display_flush_set(display);
+    __guac_terminal_display_flush_copy(display, context);
+
+    /* Send text of all updated cells before their operations are handled */
+    if (display->text_stream != NULL)
+        guac_terminal_display_text_flush_set(display);
+
+    __guac_terminal_display_flush_clear(display, context);
+    __guac_terminal_display_flush_set(display, context);
+
+    /* All pending operations have now been handled */
+    guac_terminal_display_mark_clean(display);
+
+    guac_display_layer_close_raw(display->display_layer, context);
+
+    if (display->text_stream != NULL)
+        guac_terminal_display_text_send(display, display->client->socket);
 
 }
 
@@ -895,38 +1619,105 @@ void guac_terminal_display_flush(guac_terminal_display* display) {
     /* Flush operations */
     guac_terminal_display_flush_operations(display);
 
-    /* Flush surface */
-    guac_common_surface_flush(display->display_surface);
-
 }
 
 void guac_terminal_display_dup(
         guac_terminal_display* display, guac_client* client, guac_socket* socket) {
 
-    /* Create default surface */
-    guac_common_surface_dup(display->display_surface, client, socket);
+    /* Send all layers as of the most recent frame */
+    guac_display_dup(display->graphical_display, socket);
 
-    /* Select layer is a child of the display layer */
-    guac_protocol_send_move(socket, display->select_layer,
-            display->display_layer, 0, 0, 0);
+    /* Synchronize text stream, if enabled, with the contents of all cells as
+     * of the most recent flush */
+    if (display->text_stream != NULL) {
 
-    /* Offset the Default Layer to make margins even on all sides */
-    guac_protocol_send_move(socket, display->display_layer,
-        GUAC_DEFAULT_LAYER, display->margin, display->margin, 0);
+        guac_terminal_display_text_send(display, client->socket);
+
+        guac_protocol_send_pipe(socket, display->text_stream,
+                GUAC_TERMINAL_TEXT_STREAM_MIMETYPE,
+                GUAC_TERMINAL_TEXT_STREAM_NAME);
 
-    /* Send select layer size */
-    guac_protocol_send_size(socket, display->select_layer,
-            display->char_width  * display->width,
-            display->char_height * display->height);
+        guac_terminal_display_text_size(display, socket);
+        for (int row = 0; row < display->height; row++)
+            guac_terminal_display_text_cells(display, socket, row,
+                    0, display->width - 1);
+
+        guac_terminal_display_text_send(display, socket);
+
+    }
+
+}
+
+void guac_terminal_display_enable_text_stream(guac_terminal_display* display) {
+
+    if (display->text_stream != NULL)
+        return;
+
+    guac_client* client = display->client;
+
+    /* All cells are initially blank */
+    guac_terminal_char blank = {
+        .value = 0,
+        .attributes = {
+            .foreground = display->default_background,
+            .background = display->default_background
+        },
+        .width = 1
+    };
+
+    display->text_cells = guac_mem_alloc(sizeof(guac_terminal_char),
+            display->width, display->height);
+
+    for (int i = 0; i < display->width * display->height; i++)
+        display->text_cells[i] = blank;
+
+    /* Begin text stream with current dimensions */
+    display->text_stream = guac_client_alloc_stream(client);
+    guac_protocol_send_pipe(client->socket, display->text_stream,
+            GUAC_TERMINAL_TEXT_STREAM_MIMETYPE,
+            GUAC_TERMINAL_TEXT_STREAM_NAME);
+
+    guac_terminal_display_text_size(display, client->socket);
+    guac_terminal_display_text_send(display, client->socket);
+
+}
+
+/**
+ * Highlights the given rectangle within the select layer of a terminal
+ * display, clipping the rectangle to the bounds of that layer.
+ *
+ * @param context
+ *     The raw context of the select layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the rectangle, in pixels.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the rectangle, in pixels.
+ *
+ * @param width
+ *     The width of the rectangle, in pixels.
+ *
+ * @param height
+ *     The height of the rectangle, in pixels.
+ */
+static void guac_terminal_display_select_rect(
+        guac_display_layer_raw_context* context,
+        int x, int y, int width, int height) {
+
+    guac_rect rect;
+    guac_rect_init(&rect, x, y, width, height);
+    guac_rect_constrain(&rect, &context->bounds);
+
+    if (!guac_rect_is_empty(&rect))
+        guac_display_layer_raw_context_set(context, &rect,
+                GUAC_TERMINAL_SELECTION_COLOR);
 
 }
 
 void guac_terminal_display_select(guac_terminal_display* display,
         int start_row, int start_col, int end_row, int end_col) {
 
-    guac_socket* socket = display->client->socket;
-    guac_layer* select_layer = display->select_layer;
-
     /* Do nothing if selection is unchanged */
     if (display->text_selected
             && display->selection_start_row    == start_row
@@ -943,6 +1734,16 @@ void guac_terminal_display_select(guac_terminal_display* display,
     display->selection_end_row = end_row;
     display->selection_end_column = end_col;
 
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->select_layer);
+
+    /* Erase old selection */
+    guac_display_layer_raw_context_set(context, &context->bounds, 0x00000000);
+    guac_rect_extend(&context->dirty, &context->bounds);
+
+    /* The selection is never scrolled or copied */
+    context->hint_from = NULL;
+
     /* If single row, just need one rectangle */
     if (start_row == end_row) {
 
@@ -954,7 +1755,7 @@ void guac_terminal_display_select(guac_terminal_display* display,
         }
 
         /* Select characters between columns */
-        guac_protocol_send_rect(socket, select_layer,
+        guac_terminal_display_select_rect(context,
 
                 start_col * display->char_width,
                 start_row * display->char_height,
@@ -983,7 +1784,7 @@ void guac_terminal_display_select(guac_terminal_display* display,
         }
 
         /* First row */
-        guac_protocol_send_rect(socket, select_layer,
+        guac_terminal_display_select_rect(context,
 
                 start_col * display->char_width,
                 start_row * display->char_height,
@@ -992,7 +1793,7 @@ void guac_terminal_display_select(guac_terminal_display* display,
                 display->char_height);
 
         /* Middle */
-        guac_protocol_send_rect(socket, select_layer,
+        guac_terminal_display_select_rect(context,
 
                 0,
                 (start_row + 1) * display->char_height,
@@ -1001,7 +1802,7 @@ void guac_terminal_display_select(guac_terminal_display* display,
                 (end_row - start_row - 1) * display->char_height);
 
         /* Last row */
-        guac_protocol_send_rect(socket, select_layer,
+        guac_terminal_display_select_rect(context,
 
                 0,
                 end_row * display->char_height,
@@ -1011,9 +1812,7 @@ void guac_terminal_display_select(guac_terminal_display* display,
 
     }
 
-    /* Draw new selection, erasing old */
-    guac_protocol_send_cfill(socket, GUAC_COMP_SRC, select_layer,
-            0x00, 0x80, 0xFF, 0x60);
+    guac_display_layer_close_raw(display->select_layer, context);
 
 }
 
@@ -1023,12 +1822,15 @@ void guac_terminal_display_clear_select(guac_terminal_display* display) {
     if (!display->text_selected)
         return;
 
-    guac_socket* socket = display->client->socket;
-    guac_layer* select_layer = display->select_layer;
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(display->select_layer);
+
+    /* Erase selection */
+    guac_display_layer_raw_context_set(context, &context->bounds, 0x00000000);
+    guac_rect_extend(&context->dirty, &context->bounds);
+    context->hint_from = NULL;
 
-    guac_protocol_send_rect(socket, select_layer, 0, 0, 1, 1);
-    guac_protocol_send_cfill(socket, GUAC_COMP_SRC, select_layer,
-            0x00, 0x00, 0x00, 0x00);
+    guac_display_layer_close_raw(display->select_layer, context);
 
     /* Text is no longer selected */
     display->text_selected = false;
@@ -1098,6 +1900,16 @@ int guac_terminal_display_set_font(guac_terminal_display* display,
     display->font_desc = font_desc;
     pango_font_description_free(old_font_desc);
 
+    /* Glyphs rendered with the old font no longer apply */
+    guac_terminal_glyph_cache_clear(display->glyph_cache);
+
+    /* Resize atlas such that each slot can hold a glyph of the new font */
+    if (display->glyph_atlas != NULL)
+        guac_display_layer_resize(display->glyph_atlas,
+                GUAC_TERMINAL_GLYPH_ATLAS_SLOT_WIDTH(display)
+                    * GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS,
+                display->char_height * GUAC_TERMINAL_GLYPH_ATLAS_ROWS);
+
     /* Recalculate dimensions which will fit within current surface */
     int new_width = pixel_width / display->char_width;
     int new_height = pixel_height / display->char_height;
@@ -1110,3 +1922,70 @@ int guac_terminal_display_set_font(guac_terminal_display* display,
     return 0;
 
 }
+
+/**
+ * Guarantees that fonts are preloaded by guac_terminal_preload_fonts() at most
+ * once per process.
+ */
+static pthread_once_t guac_terminal_preload_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Loads the default terminal font and its metrics, discarding the result. As
+ * fontconfig maintains its configuration and caches globally for the entire
+ * process, this forces that state to be populated such that later loads of
+ * terminal fonts by other threads are comparatively inexpensive.
+ *
+ * @param data
+ *     Ignored.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_terminal_preload_thread(void* data) {
+
+    PangoFontDescription* font_desc = pango_font_description_new();
+    pango_font_description_set_family(font_desc,
+            GUAC_TERMINAL_DEFAULT_FONT_NAME);
+    pango_font_description_set_weight(font_desc, PANGO_WEIGHT_NORMAL);
+    pango_font_description_set_size(font_desc,
+            GUAC_TERMINAL_DEFAULT_FONT_SIZE * PANGO_SCALE);
+
+    PangoFontMap* font_map = pango_cairo_font_map_get_default();
+    PangoContext* context = pango_font_map_create_context(font_map);
+
+    /* Load font and metrics solely for the side effect of populating the
+     * process-wide fontconfig state */
+    PangoFont* font = pango_font_map_load_font(font_map, context, font_desc);
+    if (font != NULL) {
+
+        PangoFontMetrics* metrics = pango_font_get_metrics(font, NULL);
+        if (metrics != NULL)
+            pango_font_metrics_unref(metrics);
+
+        g_object_unref(font);
+
+    }
+
+    g_object_unref(context);
+    pango_font_description_free(font_desc);
+
+    return NULL;
+
+}
+
+/**
+ * Starts a detached thread which preloads the default terminal font. This
+ * function is invoked via pthread_once() by guac_terminal_preload_fonts().
+ */
+static void guac_terminal_preload_start() {
+
+    pthread_t preload_thread;
+    if (pthread_create(&preload_thread, NULL,
+                guac_terminal_preload_thread, NULL) == 0)
+        pthread_detach(preload_thread);
+
+}
+
+void guac_terminal_preload_fonts() {
+    pthread_once(&guac_terminal_preload_once, guac_terminal_preload_start);
+}
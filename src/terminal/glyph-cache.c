@@ -0,0 +1,216 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "terminal/glyph-cache.h"
+#include "terminal/palette.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/mem.h>
+
+#include <stdint.h>
+
+/**
+ * Returns the hash bucket that should contain the glyph rendered for the
+ * given character and colors.
+ *
+ * @param cache
+ *     The glyph cache containing the hash bucket.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character.
+ *
+ * @param foreground
+ *     The color of the character itself.
+ *
+ * @param background
+ *     The color of the cell behind the character.
+ *
+ * @return
+ *     A pointer to the head pointer of the list of glyphs within the hash
+ *     bucket.
+ */
+static guac_terminal_glyph** guac_terminal_glyph_cache_bucket(
+        guac_terminal_glyph_cache* cache, int codepoint,
+        const guac_terminal_color* foreground,
+        const guac_terminal_color* background) {
+
+    uint32_t hash = (uint32_t) codepoint * 2654435761u;
+    hash ^= (foreground->red << 16) | (foreground->green << 8) | foreground->blue;
+    hash ^= ((background->red << 16) | (background->green << 8) | background->blue) * 40503u;
+
+    return &cache->buckets[(hash ^ (hash >> 16)) & (GUAC_TERMINAL_GLYPH_CACHE_BUCKETS - 1)];
+
+}
+
+/**
+ * Removes the given glyph from the most-recently-used ordering of the given
+ * cache, without removing that glyph from its hash bucket.
+ *
+ * @param cache
+ *     The glyph cache containing the glyph.
+ *
+ * @param glyph
+ *     The glyph to unlink.
+ */
+static void guac_terminal_glyph_cache_unlink(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph) {
+
+    if (glyph->prev != NULL)
+        glyph->prev->next = glyph->next;
+    else
+        cache->head = glyph->next;
+
+    if (glyph->next != NULL)
+        glyph->next->prev = glyph->prev;
+    else
+        cache->tail = glyph->prev;
+
+}
+
+/**
+ * Adds the given glyph to the given cache as the most recently used glyph,
+ * without adding that glyph to its hash bucket.
+ *
+ * @param cache
+ *     The glyph cache that should contain the glyph.
+ *
+ * @param glyph
+ *     The glyph to link.
+ */
+static void guac_terminal_glyph_cache_link(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph) {
+
+    glyph->prev = NULL;
+    glyph->next = cache->head;
+
+    if (cache->head != NULL)
+        cache->head->prev = glyph;
+    else
+        cache->tail = glyph;
+
+    cache->head = glyph;
+
+}
+
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc() {
+    return guac_mem_zalloc(sizeof(guac_terminal_glyph_cache));
+}
+
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache) {
+    guac_terminal_glyph_cache_clear(cache);
+    guac_mem_free(cache);
+}
+
+void guac_terminal_glyph_cache_clear(guac_terminal_glyph_cache* cache) {
+
+    guac_terminal_glyph* glyph = cache->head;
+    while (glyph != NULL) {
+        guac_terminal_glyph* next = glyph->next;
+        cairo_surface_destroy(glyph->surface);
+        guac_mem_free(glyph);
+        glyph = next;
+    }
+
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->length = 0;
+
+    for (int i = 0; i < GUAC_TERMINAL_GLYPH_CACHE_BUCKETS; i++)
+        cache->buckets[i] = NULL;
+
+}
+
+guac_terminal_glyph* guac_terminal_glyph_cache_get(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background) {
+
+    guac_terminal_glyph* glyph = *guac_terminal_glyph_cache_bucket(cache,
+            codepoint, foreground, background);
+
+    while (glyph != NULL) {
+
+        if (glyph->codepoint == codepoint
+                && guac_terminal_colorcmp(&glyph->foreground, foreground) == 0
+                && guac_terminal_colorcmp(&glyph->background, background) == 0) {
+
+            /* Move to front of cache */
+            if (glyph != cache->head) {
+                guac_terminal_glyph_cache_unlink(cache, glyph);
+                guac_terminal_glyph_cache_link(cache, glyph);
+            }
+
+            return glyph;
+
+        }
+
+        glyph = glyph->next_in_bucket;
+
+    }
+
+    return NULL;
+
+}
+
+guac_terminal_glyph* guac_terminal_glyph_cache_put(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background, cairo_surface_t* surface) {
+
+    /* Use the next unused slot, unless the cache is full */
+    int slot = cache->length;
+
+    /* Evict least recently used glyph if there is no room, reusing its slot */
+    if (cache->length >= GUAC_TERMINAL_GLYPH_CACHE_SIZE) {
+
+        guac_terminal_glyph* evicted = cache->tail;
+        guac_terminal_glyph_cache_unlink(cache, evicted);
+
+        guac_terminal_glyph** current = guac_terminal_glyph_cache_bucket(cache,
+                evicted->codepoint, &evicted->foreground, &evicted->background);
+
+        while (*current != evicted)
+            current = &(*current)->next_in_bucket;
+
+        *current = evicted->next_in_bucket;
+        slot = evicted->slot;
+
+        cairo_surface_destroy(evicted->surface);
+        guac_mem_free(evicted);
+        cache->length--;
+
+    }
+
+    guac_terminal_glyph* glyph = guac_mem_alloc(sizeof(guac_terminal_glyph));
+    glyph->codepoint = codepoint;
+    glyph->foreground = *foreground;
+    glyph->background = *background;
+    glyph->surface = surface;
+    glyph->slot = slot;
+
+    guac_terminal_glyph** bucket = guac_terminal_glyph_cache_bucket(cache,
+            codepoint, foreground, background);
+
+    glyph->next_in_bucket = *bucket;
+    *bucket = glyph;
+
+    guac_terminal_glyph_cache_link(cache, glyph);
+    cache->length++;
+
+    return glyph;
+
+}
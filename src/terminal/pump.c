@@ -0,0 +1,218 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "terminal/common.h"
+#include "terminal/pump.h"
+
+#include <guacamole/mem.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Frees all chunks within the queue of the given guac_terminal_pump, leaving
+ * the queue empty. The pump lock must be held.
+ *
+ * @param pump
+ *     The guac_terminal_pump whose queue should be emptied.
+ */
+static void guac_terminal_pump_discard(guac_terminal_pump* pump) {
+
+    guac_terminal_pump_chunk* current = pump->first;
+    while (current != NULL) {
+        guac_terminal_pump_chunk* next = current->next;
+        guac_mem_free(current->data);
+        guac_mem_free(current);
+        current = next;
+    }
+
+    pump->first = NULL;
+    pump->last = NULL;
+    pump->length = 0;
+
+}
+
+/**
+ * Writes the contents of the queue of the given guac_terminal_pump to STDIN
+ * in chunks of at most GUAC_TERMINAL_PUMP_CHUNK_SIZE bytes until the pump is
+ * stopped, closing the write end of the STDIN pipe upon termination.
+ *
+ * @param data
+ *     The guac_terminal_pump whose queue should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_terminal_pump_thread(void* data) {
+
+    guac_terminal_pump* pump = (guac_terminal_pump*) data;
+
+    pthread_mutex_lock(&(pump->lock));
+
+    for (;;) {
+
+        /* Wait for data to be queued */
+        while (!pump->stopped && pump->first == NULL)
+            pthread_cond_wait(&(pump->modified), &(pump->lock));
+
+        if (pump->stopped)
+            break;
+
+        /* Only this thread removes chunks, thus the chunk will remain valid
+         * while STDIN is written without holding the lock */
+        guac_terminal_pump_chunk* chunk = pump->first;
+        int length = chunk->length - chunk->offset;
+        if (length > GUAC_TERMINAL_PUMP_CHUNK_SIZE)
+            length = GUAC_TERMINAL_PUMP_CHUNK_SIZE;
+
+        pthread_mutex_unlock(&(pump->lock));
+        int result = guac_terminal_write_all(pump->fd,
+                chunk->data + chunk->offset, length);
+        pthread_mutex_lock(&(pump->lock));
+
+        /* Give up entirely if STDIN can no longer be written */
+        if (result < 0) {
+            pump->stopped = true;
+            break;
+        }
+
+        /* Remove written data from queue */
+        chunk->offset += length;
+        pump->length -= length;
+        if (chunk->offset == chunk->length) {
+
+            pump->first = chunk->next;
+            if (pump->first == NULL)
+                pump->last = NULL;
+
+            guac_mem_free(chunk->data);
+            guac_mem_free(chunk);
+
+        }
+
+        /* Notify any waiting writers of room within the queue */
+        pthread_cond_broadcast(&(pump->modified));
+
+    }
+
+    /* Release any writers still waiting on the queue */
+    guac_terminal_pump_discard(pump);
+    pthread_cond_broadcast(&(pump->modified));
+    pthread_mutex_unlock(&(pump->lock));
+
+    /* Signal end-of-file to whatever is reading STDIN */
+    close(pump->fd);
+    return NULL;
+
+}
+
+guac_terminal_pump* guac_terminal_pump_alloc(int fd) {
+
+    guac_terminal_pump* pump = guac_mem_zalloc(sizeof(guac_terminal_pump));
+    pump->fd = fd;
+
+    pthread_mutex_init(&(pump->lock), NULL);
+    pthread_cond_init(&(pump->modified), NULL);
+
+    if (pthread_create(&(pump->thread), NULL, guac_terminal_pump_thread,
+                (void*) pump)) {
+        pthread_cond_destroy(&(pump->modified));
+        pthread_mutex_destroy(&(pump->lock));
+        guac_mem_free(pump);
+        return NULL;
+    }
+
+    return pump;
+
+}
+
+void guac_terminal_pump_free(guac_terminal_pump* pump) {
+
+    guac_terminal_pump_stop(pump);
+    pthread_join(pump->thread, NULL);
+
+    pthread_cond_destroy(&(pump->modified));
+    pthread_mutex_destroy(&(pump->lock));
+    guac_mem_free(pump);
+
+}
+
+int guac_terminal_pump_write(guac_terminal_pump* pump, const char* data,
+        int length) {
+
+    if (length <= 0)
+        return 0;
+
+    pthread_mutex_lock(&(pump->lock));
+
+    /* Refuse further data once STDIN can no longer be written */
+    if (pump->stopped) {
+        pthread_mutex_unlock(&(pump->lock));
+        return -1;
+    }
+
+    guac_terminal_pump_chunk* chunk =
+        guac_mem_alloc(sizeof(guac_terminal_pump_chunk));
+
+    chunk->data = guac_mem_alloc(length);
+    chunk->length = length;
+    chunk->offset = 0;
+    chunk->next = NULL;
+    memcpy(chunk->data, data, length);
+
+    /* Add to end of queue */
+    if (pump->last != NULL)
+        pump->last->next = chunk;
+    else
+        pump->first = chunk;
+
+    pump->last = chunk;
+    pump->length += length;
+
+    pthread_cond_broadcast(&(pump->modified));
+    pthread_mutex_unlock(&(pump->lock));
+
+    return length;
+
+}
+
+int guac_terminal_pump_wait(guac_terminal_pump* pump) {
+
+    pthread_mutex_lock(&(pump->lock));
+
+    while (!pump->stopped && pump->length >= GUAC_TERMINAL_PUMP_MAX_LENGTH)
+        pthread_cond_wait(&(pump->modified), &(pump->lock));
+
+    bool stopped = pump->stopped;
+    pthread_mutex_unlock(&(pump->lock));
+
+    return stopped;
+
+}
+
+void guac_terminal_pump_stop(guac_terminal_pump* pump) {
+
+    pthread_mutex_lock(&(pump->lock));
+    pump->stopped = true;
+    pthread_cond_broadcast(&(pump->modified));
+    pthread_mutex_unlock(&(pump->lock));
+
+}
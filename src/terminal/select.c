@@ -277,17 +277,23 @@ void guac_terminal_select_resume(guac_terminal* terminal, int row, int column) {
  *     The last column of the text to be copied from the given row into the
  *     clipboard associated with the given terminal, where 0 is the first
  *     (left-most) column within the row.
+ *
+ * @return
+ *     true if the clipboard can accept further text, false if the clipboard
+ *     is now full.
  */
-static void guac_terminal_clipboard_append_characters(guac_terminal* terminal,
+static bool guac_terminal_clipboard_append_characters(guac_terminal* terminal,
         guac_terminal_char* characters, unsigned int length, int start, int end) {
 
-    char buffer[1024];
+    guac_common_clipboard* clipboard = terminal->clipboard;
+
+    char buffer[4096];
     int eol;
 
     /* If selection is entirely outside the bounds of the row, then there is
      * nothing to append */
     if (start < 0 || end < 0 || start >= length)
-        return;
+        return clipboard->length < clipboard->available;
 
     /* Ensure desired end column is within bounds */
     if (end >= length)
@@ -319,6 +325,13 @@ static void guac_terminal_clipboard_append_characters(guac_terminal* terminal,
             if (codepoint == 0 || codepoint == GUAC_CHAR_CONTINUATION)
                 continue;
 
+            /* ASCII maps directly onto single bytes of UTF-8 */
+            if (codepoint < 0x80 && remaining > 0) {
+                *(current++) = codepoint;
+                remaining--;
+                continue;
+            }
+
             /* Encode current codepoint as UTF-8 */
             int bytes = guac_utf8_write(codepoint, current, remaining);
             if (bytes == 0)
@@ -330,17 +343,20 @@ static void guac_terminal_clipboard_append_characters(guac_terminal* terminal,
         }
 
         /* Append converted buffer to clipboard */
-        guac_common_clipboard_append(terminal->clipboard, buffer, current - buffer);
+        guac_common_clipboard_append(clipboard, buffer, current - buffer);
+
+        /* Stop once no further text can be stored */
+        if (clipboard->length >= clipboard->available)
+            return false;
 
     }
 
+    return clipboard->length < clipboard->available;
+
 }
 
 void guac_terminal_select_end(guac_terminal* terminal) {
 
-    guac_client* client = terminal->client;
-    guac_socket* socket = client->socket;
-
     /* If no text is selected, nothing to do */
     if (!terminal->text_selected)
         return;
@@ -372,17 +388,17 @@ void guac_terminal_select_end(guac_terminal* terminal) {
          * With the exception of the start and end rows, all other rows are
          * copied in their entirety. */
         int length = guac_terminal_buffer_get_columns(terminal->current_buffer, &characters, &last_row_was_wrapped, row);
-        guac_terminal_clipboard_append_characters(terminal, characters, length,
-            (row == start_row) ? start_col : 0,
-            (row == end_row)   ? end_col   : length - 1);
+        if (!guac_terminal_clipboard_append_characters(terminal, characters, length,
+                (row == start_row) ? start_col : 0,
+                (row == end_row)   ? end_col   : length - 1))
+            break;
 
     }
 
-    /* Broadcast copied data to all connected users only if allowed */
-    if (!terminal->disable_copy) {
-        guac_common_clipboard_send(terminal->clipboard, client);
-        guac_socket_flush(socket);
-    }
+    /* Broadcast copied data to all connected users only if allowed, once
+     * the terminal is no longer locked (see guac_terminal_send_mouse()) */
+    if (!terminal->disable_copy)
+        terminal->clipboard_pending = true;
 
     guac_terminal_notify(terminal);
 
@@ -407,6 +407,59 @@ int guac_terminal_echo(guac_terminal* term, unsigned char c) {
 
 }
 
+/**
+ * Returns whether the given byte is a printable ASCII character, occupying
+ * exactly one column when drawn.
+ *
+ * @param c
+ *     The byte to test.
+ *
+ * @return
+ *     Non-zero if the given byte is a printable ASCII character, zero
+ *     otherwise.
+ */
+static int guac_terminal_is_printable_ascii(char c) {
+    return (unsigned char) c >= 0x20 && (unsigned char) c <= 0x7E;
+}
+
+int guac_terminal_echo_ascii(guac_terminal* term, const char* c, int length) {
+
+    /* Only plain, directly-drawn output may be handled in bulk */
+    if (term->pipe_stream != NULL || term->insert_mode
+            || term->char_mapping[term->active_char_set] != NULL)
+        return 0;
+
+    int handled = 0;
+    while (handled < length && guac_terminal_is_printable_ascii(c[handled])) {
+
+        /* Wrap if necessary */
+        if (term->cursor_col >= term->term_width) {
+
+            /* New line */
+            term->cursor_col = 0;
+            guac_terminal_linefeed(term, true);
+        }
+
+        /* Determine extent of run within the remainder of the row */
+        int available = term->term_width - term->cursor_col;
+        int run = 1;
+        while (run < available && handled + run < length
+                && guac_terminal_is_printable_ascii(c[handled + run]))
+            run++;
+
+        /* Write entire run and advance cursor */
+        guac_terminal_set_ascii(term, term->cursor_row, term->cursor_col,
+                c + handled, run);
+
+        term->cursor_col += run;
+        handled += run;
+
+    }
+
+    return handled;
+
+}
+
 int guac_terminal_escape(guac_terminal* term, unsigned char c) {
 
     switch (c) {
@@ -544,6 +597,7 @@ static bool* __guac_terminal_get_flag(guac_terminal* term, int num, char private
         switch (num) {
             case 1:  return &(term->application_cursor_keys); /* DECCKM */
             case 25: return &(term->cursor_visible); /* DECTECM */
+            case 2004: return &(term->bracketed_paste); /* Bracketed paste */
         }
     }
 
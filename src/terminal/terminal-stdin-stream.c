@@ -25,6 +25,8 @@
 #include <guacamole/socket.h>
 #include <guacamole/user.h>
 
+#include <string.h>
+
 /**
  * Handler for "blob" instructions which writes the data of received
  * blobs to STDIN of the terminal associated with the stream.
@@ -36,10 +38,12 @@ static int guac_terminal_input_stream_blob_handler(guac_user* user,
 
     guac_terminal* term = (guac_terminal*) stream->data;
 
-    /* Attempt to write received data */
-    guac_terminal_lock(term);
-    int result = guac_terminal_write_all(term->stdin_pipe_fd[1], data, length);
-    guac_terminal_unlock(term);
+    /* Wait for the pump to drain without holding the terminal lock, such
+     * that the remote side may continue to produce output (and thus read
+     * further input) while this stream is throttled */
+    int result = -1;
+    if (!guac_terminal_pump_wait(term->stdin_pump))
+        result = guac_terminal_pump_write(term->stdin_pump, data, length);
 
     /* Acknowledge receipt of data and result of write attempt */
     if (result <= 0) {
@@ -82,7 +86,13 @@ static int guac_terminal_input_stream_end_handler(guac_user* user,
 
     /* Reset input stream, unblocking user input */
     guac_terminal_lock(term);
+
+    if (term->input_stream_bracketed)
+        guac_terminal_pump_write(term->stdin_pump, GUAC_TERMINAL_PASTE_END,
+                strlen(GUAC_TERMINAL_PASTE_END));
+
     term->input_stream = NULL;
+    term->input_stream_bracketed = false;
     guac_terminal_unlock(term);
 
     guac_user_log(user, GUAC_LOG_DEBUG, "Inbound stream closed. User input "
@@ -144,6 +154,13 @@ static int __guac_terminal_send_stream(guac_terminal* term, guac_user* user,
     stream->end_handler = guac_terminal_input_stream_end_handler;
     stream->data = term;
 
+    /* Treat stream contents as pasted text if requested by the application
+     * running within the terminal */
+    term->input_stream_bracketed = term->bracketed_paste;
+    if (term->input_stream_bracketed)
+        guac_terminal_pump_write(term->stdin_pump, GUAC_TERMINAL_PASTE_START,
+                strlen(GUAC_TERMINAL_PASTE_START));
+
     /* Block user input until stream is ended */
     term->input_stream = stream;
 
@@ -18,7 +18,6 @@
  */
 
 #include "common/clipboard.h"
-#include "common/cursor.h"
 #include "common/iconv.h"
 #include "terminal/buffer.h"
 #include "terminal/color-scheme.h"
@@ -34,6 +33,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -44,10 +44,12 @@
 #include <wchar.h>
 
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/error.h>
 #include <guacamole/flag.h>
 #include <guacamole/mem.h>
 #include <guacamole/protocol.h>
+#include <guacamole/rect.h>
 #include <guacamole/socket.h>
 #include <guacamole/string.h>
 #include <guacamole/timestamp.h>
@@ -107,11 +109,11 @@ int guac_terminal_get_available_scroll(guac_terminal* term) {
 }
 
 int guac_terminal_get_rows(guac_terminal* term) {
-    return term->term_height;
+    return term->resize_pending ? term->pending_rows : term->term_height;
 }
 
 int guac_terminal_get_columns(guac_terminal* term) {
-    return term->term_width;
+    return term->resize_pending ? term->pending_columns : term->term_width;
 }
 
 void guac_terminal_reset(guac_terminal* term) {
@@ -143,6 +145,7 @@ void guac_terminal_reset(guac_terminal* term) {
     term->text_selected = false;
     term->selection_committed = false;
     term->application_cursor_keys = false;
+    term->bracketed_paste = false;
     term->automatic_carriage_return = false;
     term->insert_mode = false;
 
@@ -172,13 +175,8 @@ void guac_terminal_reset(guac_terminal* term) {
  *
  * @param terminal
  *     The terminal whose background should be painted or repainted.
- *
- * @param socket
- *     The socket over which instructions required to paint / repaint the
- *     terminal background should be send.
  */
-static void guac_terminal_repaint_default_layer(guac_terminal* terminal,
-        guac_socket* socket) {
+static void guac_terminal_repaint_default_layer(guac_terminal* terminal) {
 
     int width = terminal->width;
     int height = terminal->height;
@@ -188,12 +186,19 @@ static void guac_terminal_repaint_default_layer(guac_terminal* terminal,
     const guac_terminal_color* color = &display->default_background;
 
     /* Reset size */
-    guac_protocol_send_size(socket, GUAC_DEFAULT_LAYER, width, height);
+    guac_display_layer* default_layer =
+        guac_display_default_layer(display->graphical_display);
+    guac_display_layer_resize(default_layer, width, height);
 
     /* Paint background color */
-    guac_protocol_send_rect(socket, GUAC_DEFAULT_LAYER, 0, 0, width, height);
-    guac_protocol_send_cfill(socket, GUAC_COMP_OVER, GUAC_DEFAULT_LAYER,
-            color->red, color->green, color->blue, 0xFF);
+    guac_display_layer_raw_context* context =
+        guac_display_layer_open_raw(default_layer);
+
+    guac_display_layer_raw_context_set(context, &context->bounds,
+            GUAC_TERMINAL_RAW_COLOR(color));
+    guac_rect_extend(&context->dirty, &context->bounds);
+
+    guac_display_layer_close_raw(default_layer, context);
 
 }
 
@@ -220,8 +225,11 @@ void* guac_terminal_thread(void* data) {
         if (guac_terminal_render_frame(terminal))
             break;
 
-        /* Signal end of frame */
-        guac_client_end_frame(client);
+        /* Signal end of frame, sending any changes to the display */
+        guac_display_render_thread_notify_frame(terminal->display->render_thread);
+
+        /* Send any instructions written directly, such as scrollbar
+         * updates */
         guac_socket_flush(client->socket);
 
     }
@@ -249,6 +257,8 @@ guac_terminal_options* guac_terminal_options_create(
     options->font_size = GUAC_TERMINAL_DEFAULT_FONT_SIZE;
     options->color_scheme = GUAC_TERMINAL_DEFAULT_COLOR_SCHEME;
     options->backspace = GUAC_TERMINAL_DEFAULT_BACKSPACE;
+    options->text_stream = GUAC_TERMINAL_DEFAULT_TEXT_STREAM;
+    options->glyph_atlas = GUAC_TERMINAL_DEFAULT_GLYPH_ATLAS;
 
     return options;
 }
@@ -374,6 +384,9 @@ guac_terminal* guac_terminal_create(guac_client* client,
 
     guac_terminal* term = guac_mem_alloc(sizeof(guac_terminal));
     term->started = false;
+    term->clipboard_pending = false;
+    term->frame_bytes = 0;
+    term->flooded = false;
     term->client = client;
     term->upload_path_handler = NULL;
     term->file_download_handler = NULL;
@@ -405,7 +418,8 @@ guac_terminal* guac_terminal_create(guac_client* client,
             options->font_name, options->font_size, options->dpi,
             &default_char.attributes.foreground,
             &default_char.attributes.background,
-            (guac_terminal_color(*)[256]) default_palette);
+            (guac_terminal_color(*)[256]) default_palette,
+            options->glyph_atlas);
 
     /* Fail if display init failed */
     if (term->display == NULL) {
@@ -414,8 +428,9 @@ guac_terminal* guac_terminal_create(guac_client* client,
         return NULL;
     }
 
-    /* Init common cursor */
-    term->cursor = guac_common_cursor_alloc(client);
+    /* Send terminal contents as text if requested */
+    if (options->text_stream)
+        guac_terminal_display_enable_text_stream(term->display);
 
     /* Init terminal state */
     term->current_attributes = default_char.attributes;
@@ -441,6 +456,11 @@ guac_terminal* guac_terminal_create(guac_client* client,
     term->term_height = rows;
     term->term_width  = columns;
 
+    /* No resize is pending until the terminal is first resized */
+    term->resize_pending = false;
+    term->pending_rows = rows;
+    term->pending_columns = columns;
+
     /* Set pixel size */
     term->height = adjusted_height;
     term->width = adjusted_width;
@@ -453,8 +473,23 @@ guac_terminal* guac_terminal_create(guac_client* client,
         return NULL;
     }
 
+    /* Write all input to STDIN through a dedicated pump thread */
+    term->stdin_pump = guac_terminal_pump_alloc(term->stdin_pipe_fd[1]);
+    if (term->stdin_pump == NULL) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to start thread for STDIN";
+        close(term->stdin_pipe_fd[0]);
+        close(term->stdin_pipe_fd[1]);
+        guac_mem_free(term);
+        return NULL;
+    }
+
+    /* The write end of the STDIN pipe is now owned by the pump */
+    term->stdin_pipe_fd[1] = -1;
+
     /* Read input from keyboard by default */
     term->input_stream = NULL;
+    term->input_stream_bracketed = false;
 
     /* Init pipe stream (output to display by default) */
     term->pipe_stream = NULL;
@@ -466,7 +501,7 @@ guac_terminal* guac_terminal_create(guac_client* client,
     pthread_mutex_init(&(term->lock), NULL);
 
     /* Repaint and resize overall display */
-    guac_terminal_repaint_default_layer(term, term->client->socket);
+    guac_terminal_repaint_default_layer(term);
     guac_terminal_display_resize(term->display,
             term->term_width, term->term_height);
 
@@ -492,7 +527,8 @@ guac_terminal* guac_terminal_create(guac_client* client,
 
     /* Initialize mouse cursor */
     term->current_cursor = GUAC_TERMINAL_CURSOR_BLANK;
-    guac_common_cursor_set_blank(term->cursor);
+    guac_display_set_cursor(term->display->graphical_display,
+            GUAC_DISPLAY_CURSOR_NONE);
 
     /* Start terminal thread */
     if (pthread_create(&(term->thread), NULL,
@@ -519,11 +555,11 @@ void guac_terminal_start(guac_terminal* term) {
 
 void guac_terminal_stop(guac_terminal* term) {
 
-    /* Close input pipe and set fds to invalid */
-    if (term->stdin_pipe_fd[1] != -1) {
-        close(term->stdin_pipe_fd[1]);
-        term->stdin_pipe_fd[1] = -1;
-    }
+    /* Stop writing to input pipe, allowing the pump thread to close the
+     * write end */
+    guac_terminal_pump_stop(term->stdin_pump);
+
+    /* Close read end of input pipe and set fd to invalid */
     if (term->stdin_pipe_fd[0] != -1) {
         close(term->stdin_pipe_fd[0]);
         term->stdin_pipe_fd[0] = -1;
@@ -538,6 +574,9 @@ void guac_terminal_free(guac_terminal* term) {
     /* Wait for render thread to finish */
     pthread_join(term->thread, NULL);
 
+    /* Wait for any remaining writes to STDIN to be abandoned */
+    guac_terminal_pump_free(term->stdin_pump);
+
     /* Close and flush any open pipe stream */
     guac_terminal_pipe_stream_close(term);
 
@@ -610,12 +649,16 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
 
         guac_timestamp frame_start = client->last_sent_timestamp;
 
+        /* Render frames at a reduced rate while flooded with output */
+        int frame_duration = terminal->flooded
+                ? GUAC_TERMINAL_FLOOD_FRAME_DURATION
+                : GUAC_TERMINAL_FRAME_DURATION;
+
         do {
 
             /* Calculate time remaining in frame */
             guac_timestamp frame_end = guac_timestamp_current();
-            int frame_remaining = frame_start + GUAC_TERMINAL_FRAME_DURATION
-                                - frame_end;
+            int frame_remaining = frame_start + frame_duration - frame_end;
 
             /* Wait again if frame remaining */
             if (frame_remaining > 0 || !terminal->started)
@@ -752,6 +795,44 @@ int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint) {
 
 }
 
+void guac_terminal_set_ascii(guac_terminal* term, int row, int col,
+        const char* text, int length) {
+
+    if (length <= 0)
+        return;
+
+    int end_col = col + length - 1;
+
+    guac_terminal_display_set_ascii(term->display, row + term->scroll_offset,
+            col, text, length, &term->current_attributes);
+
+    guac_terminal_buffer_set_ascii(term->current_buffer, row,
+            col, text, length, &term->current_attributes);
+
+    /* Clear selection if region is modified */
+    guac_terminal_select_touch(term, row, col, row, end_col);
+
+    /* If visible cursor in modified region, preserve state */
+    if (row == term->visible_cursor_row
+            && term->visible_cursor_col >= col
+            && term->visible_cursor_col <= end_col) {
+
+        guac_terminal_char cursor_character = {
+            .value      = (unsigned char) text[term->visible_cursor_col - col],
+            .attributes = term->current_attributes,
+            .width      = 1
+        };
+
+        cursor_character.attributes.cursor = true;
+
+        __guac_terminal_set_columns(term, row,
+                term->visible_cursor_col, term->visible_cursor_col,
+                &cursor_character);
+
+    }
+
+}
+
 void guac_terminal_commit_cursor(guac_terminal* term) {
 
     /* If no change, done */
@@ -797,22 +878,45 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
 
 }
 
+/* Defined below, alongside the resize routines it shares */
+static void guac_terminal_apply_resize(guac_terminal* terminal);
+
 int guac_terminal_write(guac_terminal* term, const char* buffer, int length) {
 
     guac_terminal_lock(term);
-    for (int written = 0; written < length; written++) {
 
-        /* Read and advance to next character */
-        char current = *(buffer++);
+    /* Output must be interpreted using the dimensions most recently given
+     * to the remote side */
+    guac_terminal_apply_resize(term);
 
-        /* Write character to typescript, if any */
-        if (term->typescript != NULL)
-            guac_terminal_typescript_write(term->typescript, current);
+    /* Track amount of output received within current frame */
+    if (length > INT_MAX - term->frame_bytes)
+        term->frame_bytes = INT_MAX;
+    else
+        term->frame_bytes += length;
+
+    /* Write all data to typescript, if any */
+    if (term->typescript != NULL)
+        guac_terminal_typescript_write_buffer(term->typescript, buffer, length);
+
+    int written = 0;
+    while (written < length) {
+
+        /* Echo runs of printable text in bulk where possible */
+        if (term->char_handler == guac_terminal_echo) {
+            int handled = guac_terminal_echo_ascii(term, buffer + written,
+                    length - written);
+            if (handled > 0) {
+                written += handled;
+                continue;
+            }
+        }
 
-        /* Handle character and its meaning */
-        term->char_handler(term, current);
+        /* Otherwise, handle character and its meaning */
+        term->char_handler(term, buffer[written++]);
 
     }
+
     guac_terminal_unlock(term);
 
     guac_terminal_notify(term);
@@ -1129,7 +1233,7 @@ void guac_terminal_copy_rows(guac_terminal* terminal,
     guac_terminal_display_copy_rows(terminal->display,
             start_row + terminal->scroll_offset, end_row + terminal->scroll_offset, offset);
 
-    guac_terminal_buffer_copy_rows(terminal->current_buffer,
+    guac_terminal_buffer_shift_rows(terminal->current_buffer,
             start_row, end_row, offset);
 
     /* Clear selection if region is modified */
@@ -1317,34 +1421,38 @@ static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
 
 }
 
-int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
+/**
+ * Applies the most recent resize requested with guac_terminal_resize(), if
+ * that resize has not yet been applied, resizing the display and redrawing
+ * any affected rows. Intermediate dimensions of any series of resizes that
+ * occurred since the terminal was last resized are skipped entirely. The
+ * terminal must already be locked.
+ *
+ * @param terminal
+ *     The terminal to apply any pending resize to.
+ */
+static void guac_terminal_apply_resize(guac_terminal* terminal) {
 
-    guac_terminal_display* display = terminal->display;
-    guac_client* client = display->client;
+    if (!terminal->resize_pending)
+        return;
 
-    /* Acquire exclusive access to terminal */
-    guac_terminal_lock(terminal);
+    terminal->resize_pending = false;
 
-    /* Calculate available text display area by character size */
-    int rows, columns;
-    calculate_rows_and_columns(terminal, height, width, &rows, &columns);
+    int rows = terminal->pending_rows;
+    int columns = terminal->pending_columns;
 
     /* Calculate available display area in pixels */
-    int adjusted_height = height; 
-    int adjusted_width = width;
+    int adjusted_height = terminal->outer_height;
+    int adjusted_width = terminal->outer_width;
     calculate_height_and_width(terminal, rows, columns,
         &adjusted_height, &adjusted_width);
 
-    /* Set size of available screen area */
-    terminal->outer_height = height;
-    terminal->outer_width = width;
-
     /* Set pixel size */
     terminal->height = adjusted_height;
     terminal->width = adjusted_width;
 
     /* Resize default layer to given pixel dimensions */
-    guac_terminal_repaint_default_layer(terminal, client->socket);
+    guac_terminal_repaint_default_layer(terminal);
 
     /* Resize terminal if row/column dimensions have changed */
     if (columns != terminal->term_width || rows != terminal->term_height) {
@@ -1361,6 +1469,29 @@ int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
     guac_terminal_scrollbar_set_bounds(terminal->scrollbar,
             -guac_terminal_get_available_scroll(terminal), 0);
 
+}
+
+int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
+
+    /* Acquire exclusive access to terminal */
+    guac_terminal_lock(terminal);
+
+    /* Calculate available text display area by character size */
+    int rows, columns;
+    calculate_rows_and_columns(terminal, height, width, &rows, &columns);
+
+    /* Set size of available screen area */
+    terminal->outer_height = height;
+    terminal->outer_width = width;
+
+    /* Defer the resize itself until the terminal next receives output or
+     * renders a frame, such that the new dimensions are immediately known
+     * (see guac_terminal_get_rows() and guac_terminal_get_columns()) but
+     * are applied only once if further resizes follow */
+    terminal->pending_rows = rows;
+    terminal->pending_columns = columns;
+    terminal->resize_pending = true;
+
     /* Release terminal */
     guac_terminal_unlock(terminal);
 
@@ -1371,6 +1502,8 @@ int guac_terminal_resize(guac_terminal* terminal, int width, int height) {
 
 void guac_terminal_flush(guac_terminal* terminal) {
 
+    guac_terminal_apply_resize(terminal);
+
     /* Flush typescript if in use */
     if (terminal->typescript != NULL)
         guac_terminal_typescript_flush(terminal->typescript);
@@ -1379,12 +1512,25 @@ void guac_terminal_flush(guac_terminal* terminal) {
     if (terminal->pipe_stream_flags & GUAC_TERMINAL_PIPE_AUTOFLUSH)
         guac_terminal_pipe_stream_flush(terminal);
 
+    /* Redraw entire display from buffer if updates were suspended */
+    if (terminal->display->suspended) {
+        terminal->display->suspended = false;
+        __guac_terminal_redraw_rect(terminal, 0, 0,
+                terminal->term_height - 1, terminal->term_width - 1);
+    }
+
     /* Flush display state */
     guac_terminal_select_redraw(terminal);
     guac_terminal_commit_cursor(terminal);
     guac_terminal_display_flush(terminal->display);
     guac_terminal_scrollbar_flush(terminal->scrollbar);
 
+    /* Suspend display updates until the end of the next frame if flooded
+     * with output, such that intermediate states are never rendered */
+    terminal->flooded = (terminal->frame_bytes >= GUAC_TERMINAL_FLOOD_THRESHOLD);
+    terminal->display->suspended = terminal->flooded;
+    terminal->frame_bytes = 0;
+
 }
 
 void guac_terminal_lock(guac_terminal* terminal) {
@@ -1401,7 +1547,7 @@ int guac_terminal_send_data(guac_terminal* term, const char* data, int length) {
     if (term->input_stream != NULL)
         return 0;
 
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], data, length);
+    return guac_terminal_pump_write(term->stdin_pump, data, length);
 
 }
 
@@ -1411,7 +1557,38 @@ int guac_terminal_send_string(guac_terminal* term, const char* data) {
     if (term->input_stream != NULL)
         return 0;
 
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], data, strlen(data));
+    return guac_terminal_pump_write(term->stdin_pump, data, strlen(data));
+
+}
+
+/**
+ * Sends the current contents of the clipboard to STDIN as pasted text,
+ * surrounding that text with bracketed paste markers if bracketed paste mode
+ * has been enabled by the application running within the terminal.
+ *
+ * @param term
+ *     The terminal whose clipboard contents should be pasted.
+ *
+ * @return
+ *     The number of bytes of clipboard contents written, or a negative value
+ *     if an error occurs.
+ */
+static int guac_terminal_send_clipboard(guac_terminal* term) {
+
+    /* Block all other sources of input if input is coming from a stream */
+    if (term->input_stream != NULL)
+        return 0;
+
+    if (term->bracketed_paste)
+        guac_terminal_send_string(term, GUAC_TERMINAL_PASTE_START);
+
+    int result = guac_terminal_send_data(term, term->clipboard->buffer,
+            term->clipboard->length);
+
+    if (term->bracketed_paste)
+        guac_terminal_send_string(term, GUAC_TERMINAL_PASTE_END);
+
+    return result;
 
 }
 
@@ -1427,7 +1604,8 @@ static int __guac_terminal_send_key(guac_terminal* term, int keysym, int pressed
     /* Hide mouse cursor if not already hidden */
     if (term->current_cursor != GUAC_TERMINAL_CURSOR_BLANK) {
         term->current_cursor = GUAC_TERMINAL_CURSOR_BLANK;
-        guac_common_cursor_set_blank(term->cursor);
+        guac_display_set_cursor(term->display->graphical_display,
+                GUAC_DISPLAY_CURSOR_NONE);
         guac_terminal_notify(term);
     }
 
@@ -1446,7 +1624,7 @@ static int __guac_terminal_send_key(guac_terminal* term, int keysym, int pressed
 
         /* Ctrl+Shift+V or Cmd+v (mac style) shortcuts for paste */
         if ((keysym == 'V' && term->mod_ctrl) || (keysym == 'v' && term->mod_meta))
-            return guac_terminal_send_data(term, term->clipboard->buffer, term->clipboard->length);
+            return guac_terminal_send_clipboard(term);
 
         /*
          * Ctrl+Shift+C and Cmd+c shortcuts for copying are not handled, as
@@ -1734,7 +1912,8 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
     int pressed_mask  = ~term->mouse_mask &  mask;
 
     /* Store current mouse location/state */
-    guac_common_cursor_update(term->cursor, user, x, y, mask);
+    guac_display_render_thread_notify_user_moved_mouse(
+            term->display->render_thread, user, x, y, mask);
 
     /* Notify scrollbar, do not handle anything handled by scrollbar */
     if (guac_terminal_scrollbar_handle_mouse(term->scrollbar, x, y, mask)) {
@@ -1742,7 +1921,8 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
         /* Set pointer cursor if mouse is over scrollbar */
         if (term->current_cursor != GUAC_TERMINAL_CURSOR_POINTER) {
             term->current_cursor = GUAC_TERMINAL_CURSOR_POINTER;
-            guac_common_cursor_set_pointer(term->cursor);
+            guac_display_set_cursor(term->display->graphical_display,
+                    GUAC_DISPLAY_CURSOR_POINTER);
             guac_terminal_notify(term);
         }
 
@@ -1760,13 +1940,14 @@ static int __guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
     /* Show mouse cursor if not already shown */
     if (term->current_cursor != GUAC_TERMINAL_CURSOR_IBAR) {
         term->current_cursor = GUAC_TERMINAL_CURSOR_IBAR;
-        guac_common_cursor_set_ibar(term->cursor);
+        guac_display_set_cursor(term->display->graphical_display,
+                GUAC_DISPLAY_CURSOR_IBAR);
         guac_terminal_notify(term);
     }
 
     /* Paste contents of clipboard on right or middle mouse button up */
     if ((released_mask & GUAC_CLIENT_MOUSE_RIGHT) || (released_mask & GUAC_CLIENT_MOUSE_MIDDLE))
-        return guac_terminal_send_data(term, term->clipboard->buffer, term->clipboard->length);
+        return guac_terminal_send_clipboard(term);
 
     /* If left mouse button was just released, stop selection */
     if (released_mask & GUAC_CLIENT_MOUSE_LEFT)
@@ -1840,8 +2021,19 @@ int guac_terminal_send_mouse(guac_terminal* term, guac_user* user,
 
     guac_terminal_lock(term);
     result = __guac_terminal_send_mouse(term, user, x, y, mask);
+
+    bool clipboard_pending = term->clipboard_pending;
+    term->clipboard_pending = false;
+
     guac_terminal_unlock(term);
 
+    /* Broadcast any newly-selected text without holding the terminal lock
+     * (the clipboard is guarded by its own lock) */
+    if (clipboard_pending) {
+        guac_common_clipboard_send(term->clipboard, term->client);
+        guac_socket_flush(term->client->socket);
+    }
+
     return result;
 
 }
@@ -1884,7 +2076,7 @@ int guac_terminal_sendf(guac_terminal* term, const char* format, ...) {
         return written;
 
     /* Write to STDIN */
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], buffer, written);
+    return guac_terminal_pump_write(term->stdin_pump, buffer, written);
 
 }
 
@@ -2071,13 +2263,9 @@ int guac_terminal_create_typescript(guac_terminal* term, const char* path,
 static void __guac_terminal_sync_socket(
         guac_client* client, guac_terminal* term, guac_socket* socket) {
 
-    /* Synchronize display state with new user */
-    guac_terminal_repaint_default_layer(term, socket);
+    /* Synchronize display state (including the mouse cursor) with new user */
     guac_terminal_display_dup(term->display, client, socket);
 
-    /* Synchronize mouse cursor */
-    guac_common_cursor_dup(term->cursor, client, socket);
-
     /* Paint scrollbar for joining users */
     guac_terminal_scrollbar_dup(term->scrollbar, client, socket);
 
@@ -2106,6 +2294,10 @@ void guac_terminal_apply_color_scheme(guac_terminal* terminal,
     guac_terminal_char* default_char = &terminal->default_char;
     guac_terminal_display* display = terminal->display;
 
+    /* Acquire exclusive access to terminal, as the default colors and the
+     * display are also used while handling terminal output */
+    guac_terminal_lock(terminal);
+
     /* Reinitialize default terminal colors with values from color scheme */
     guac_terminal_parse_color_scheme(client, color_scheme,
         &default_char->attributes.foreground,
@@ -2120,9 +2312,6 @@ void guac_terminal_apply_color_scheme(guac_terminal* terminal,
     /* Redraw terminal text and background */
     guac_terminal_redraw_default_layer(terminal);
 
-    /* Acquire exclusive access to terminal */
-    guac_terminal_lock(terminal);
-
     /* Update stored copy of color scheme */
     guac_mem_free_const(terminal->color_scheme);
     terminal->color_scheme = guac_strdup(color_scheme);
@@ -2143,7 +2332,16 @@ void guac_terminal_apply_font(guac_terminal* terminal, const char* font_name,
 
     guac_terminal_display* display = terminal->display;
 
-    if (guac_terminal_display_set_font(display, font_name, font_size, dpi))
+    /* Acquire exclusive access to terminal, as the display is also used while
+     * handling terminal output */
+    guac_terminal_lock(terminal);
+
+    int font_changed = !guac_terminal_display_set_font(display, font_name,
+            font_size, dpi);
+
+    guac_terminal_unlock(terminal);
+
+    if (!font_changed)
         return;
 
     /* Resize terminal to fit available region, now that font metrics may be
@@ -2151,12 +2349,11 @@ void guac_terminal_apply_font(guac_terminal* terminal, const char* font_name,
     guac_terminal_resize(terminal, terminal->outer_width,
             terminal->outer_height);
 
-    /* Redraw terminal text and background */
-    guac_terminal_redraw_default_layer(terminal);
-
-    /* Acquire exclusive access to terminal */
     guac_terminal_lock(terminal);
 
+    /* Redraw terminal text and background, applying the resize above */
+    guac_terminal_redraw_default_layer(terminal);
+
     /* Update stored copy of font name, if changed */
     if (font_name != NULL)
         terminal->font_name = guac_strdup(font_name);
@@ -2218,14 +2415,16 @@ void guac_terminal_clipboard_append(guac_terminal* terminal,
 
 void guac_terminal_remove_user(guac_terminal* terminal, guac_user* user) {
 
-    /* Remove the user from the terminal cursor */
-    guac_common_cursor_remove_user(terminal->cursor, user);
+    /* Remove the user from the terminal display */
+    guac_display_notify_user_left(terminal->display->graphical_display, user);
 }
 
 void guac_terminal_redraw_default_layer(guac_terminal* terminal) {
 
+    guac_terminal_apply_resize(terminal);
+
     /* Redraw terminal text and background */
-    guac_terminal_repaint_default_layer(terminal, terminal->client->socket);
+    guac_terminal_repaint_default_layer(terminal);
     __guac_terminal_redraw_rect(terminal, 0, 0,
             terminal->term_height - 1,
             terminal->term_width - 1);
@@ -79,6 +79,31 @@ void guac_terminal_buffer_copy_columns(guac_terminal_buffer* buffer, int row,
 void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
         int start_row, int end_row, int offset);
 
+/**
+ * Moves the given range of rows to a new location, offset from the original
+ * by the given number of rows, as when scrolling a region of the terminal.
+ * Unlike guac_terminal_buffer_copy_rows(), the contents of each row are not
+ * copied. Rows are instead reordered within the buffer, with the rows that
+ * would otherwise be overwritten being moved into the space vacated by the
+ * range. Those vacated rows are left empty and should be cleared by the
+ * caller.
+ *
+ * @param buffer
+ *     The buffer containing the rows to move.
+ *
+ * @param start_row
+ *     The first row of the range to move.
+ *
+ * @param end_row
+ *     The last row of the range to move, inclusive.
+ *
+ * @param offset
+ *     The number of rows to move the range by. Positive values move the range
+ *     down, while negative values move the range up.
+ */
+void guac_terminal_buffer_shift_rows(guac_terminal_buffer* buffer,
+        int start_row, int end_row, int offset);
+
 /**
  * Scrolls the contents of the given buffer up by the given number of rows.
  * Here, "scrolling up" refers to moving the row contents upwards within the
@@ -116,6 +141,35 @@ void guac_terminal_buffer_scroll_down(guac_terminal_buffer* buffer, int amount);
 void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets consecutive columns within the given row to the characters of the
+ * given run of printable ASCII text, each character occupying exactly one
+ * column. This is equivalent to calling guac_terminal_buffer_set_columns()
+ * for each character of the run.
+ *
+ * @param buffer
+ *     The buffer to modify.
+ *
+ * @param row
+ *     The row containing the columns being set.
+ *
+ * @param start_column
+ *     The column that should receive the first character of the run.
+ *
+ * @param text
+ *     The run of printable ASCII text (characters 0x20 through 0x7E) to
+ *     store. This text need not be null-terminated.
+ *
+ * @param length
+ *     The number of characters within the run.
+ *
+ * @param attributes
+ *     The attributes to assign to every character of the run.
+ */
+void guac_terminal_buffer_set_ascii(guac_terminal_buffer* buffer, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes);
+
 /**
  * Get the char (int ASCII code) at a specific row/col of the display.
  *
@@ -130,6 +184,11 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
  * 
  * @return
  *     The ASCII code of the character at the given row/col.
+ *
+ * If the requested row is currently stored in compacted form (as is the case
+ * for rows within the scrollback buffer), the characters returned are a
+ * temporary copy stored within the buffer, valid only until the next call to
+ * this function. The returned characters must not be modified.
  */
 unsigned int guac_terminal_buffer_get_columns(guac_terminal_buffer* buffer,
         guac_terminal_char** characters, bool* is_wrapped, int row);
@@ -26,12 +26,14 @@
  * @file display.h
  */
 
-#include "common/surface.h"
+#include "glyph-cache.h"
 #include "palette.h"
 #include "types.h"
 
 #include <guacamole/client.h>
+#include <guacamole/display.h>
 #include <guacamole/layer.h>
+#include <guacamole/protocol-constants.h>
 #include <pango/pangocairo.h>
 
 #include <stdbool.h>
@@ -53,6 +55,104 @@
  */
 #define GUAC_TERMINAL_MM_PER_INCH 25.4
 
+/**
+ * The number of glyph slots within each row of the glyph atlas. The atlas has
+ * exactly enough rows of slots to hold every glyph within the glyph cache.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS 32
+
+/**
+ * The number of rows of glyph slots within the glyph atlas.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_ROWS \
+    ((GUAC_TERMINAL_GLYPH_CACHE_SIZE + GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS - 1) \
+     / GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS)
+
+/**
+ * The width of each slot within the glyph atlas of the given display, in
+ * pixels. Each slot is large enough to hold a glyph of the maximum possible
+ * width.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_SLOT_WIDTH(display) \
+    (GUAC_TERMINAL_MAX_CHAR_WIDTH * (display)->char_width)
+
+/**
+ * The X coordinate of the upper-left corner of the given slot within the
+ * glyph atlas of the given display.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_X(display, slot) \
+    (((slot) % GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS) \
+     * GUAC_TERMINAL_GLYPH_ATLAS_SLOT_WIDTH(display))
+
+/**
+ * The Y coordinate of the upper-left corner of the given slot within the
+ * glyph atlas of the given display.
+ */
+#define GUAC_TERMINAL_GLYPH_ATLAS_Y(display, slot) \
+    (((slot) / GUAC_TERMINAL_GLYPH_ATLAS_COLUMNS) * (display)->char_height)
+
+/**
+ * The color used to highlight selected text, as a premultiplied 32-bit ARGB
+ * value suitable for the raw image buffer of a non-opaque guac_display_layer.
+ * This is the color 0x0080FF at 0x60 (roughly 38%) opacity.
+ */
+#define GUAC_TERMINAL_SELECTION_COLOR 0x60003060
+
+/**
+ * Returns the given guac_terminal_color as an opaque 32-bit RGB value
+ * suitable for the raw image buffer of a guac_display_layer.
+ */
+#define GUAC_TERMINAL_RAW_COLOR(color) \
+    (0xFF000000 | ((color)->red << 16) | ((color)->green << 8) | (color)->blue)
+
+/**
+ * The name of the pipe stream over which the contents of the terminal display
+ * are sent as text, if enabled with guac_terminal_display_enable_text_stream().
+ */
+#define GUAC_TERMINAL_TEXT_STREAM_NAME "terminal-text"
+
+/**
+ * The mimetype of the data sent over the text stream of the terminal display.
+ * This data consists of newline-terminated lines of output, each beginning
+ * with a single letter denoting the type of line:
+ *
+ *     S <columns> <rows>
+ *         The display has been resized to the given number of columns and
+ *         rows, with any new cells being blank.
+ *
+ *     C <src_row> <src_column> <columns> <rows> <dst_row> <dst_column>
+ *         The given rectangle of cells has been copied to the given
+ *         destination.
+ *
+ *     T <row> <column> <foreground> <background> <flags> <text>
+ *         The UTF-8 text following the single space after flags has been
+ *         drawn in consecutive cells beginning at the given row and column.
+ *         The foreground and background colors are six-digit hexadecimal RGB
+ *         values with reverse video, bold, and half-bright already applied.
+ *         The flags are the decimal sum of GUAC_TERMINAL_TEXT_BOLD and
+ *         GUAC_TERMINAL_TEXT_UNDERSCORE, as applicable. Each character
+ *         occupies a single cell unless wider, in which case it occupies
+ *         exactly the cells it would occupy within the terminal.
+ */
+#define GUAC_TERMINAL_TEXT_STREAM_MIMETYPE "application/vnd.guacamole.terminal-text"
+
+/**
+ * Flag within a text line of the text stream denoting that the text is bold.
+ */
+#define GUAC_TERMINAL_TEXT_BOLD 1
+
+/**
+ * Flag within a text line of the text stream denoting that the text is
+ * underlined.
+ */
+#define GUAC_TERMINAL_TEXT_UNDERSCORE 2
+
+/**
+ * The number of bytes of text stream data that may be buffered before being
+ * sent as a blob, matching the maximum size of a single blob.
+ */
+#define GUAC_TERMINAL_TEXT_BUFFER_SIZE GUAC_PROTOCOL_BLOB_MAX_LENGTH
+
 /**
  * All available terminal operations which affect character cells.
  */
@@ -106,6 +206,26 @@ typedef struct guac_terminal_operation {
 
 } guac_terminal_operation;
 
+/**
+ * The range of columns within a single row of a guac_terminal_display that may
+ * contain pending operations. All operations outside this range are
+ * guaranteed to be GUAC_CHAR_NOP.
+ */
+typedef struct guac_terminal_display_dirty_row {
+
+    /**
+     * The leftmost column of the row that may contain a pending operation.
+     */
+    int left;
+
+    /**
+     * The rightmost column of the row that may contain a pending operation.
+     * If less than left, the row contains no pending operations.
+     */
+    int right;
+
+} guac_terminal_display_dirty_row;
+
 /**
  * Set of all pending operations for the currently-visible screen area, and the
  * contextual information necessary to interpret and render those changes.
@@ -122,6 +242,25 @@ typedef struct guac_terminal_display {
      */
     guac_terminal_operation* operations;
 
+    /**
+     * The range of columns of each row of the visible screen area that may
+     * contain pending operations, such that flushing the display need only
+     * visit the parts of the operations array that have actually changed.
+     */
+    guac_terminal_display_dirty_row* dirty_rows;
+
+    /**
+     * The topmost row of the visible screen area that may contain pending
+     * operations.
+     */
+    int dirty_top;
+
+    /**
+     * The bottommost row of the visible screen area that may contain pending
+     * operations. If less than dirty_top, there are no pending operations.
+     */
+    int dirty_bottom;
+
     /**
      * The width of the screen, in characters.
      */
@@ -142,6 +281,11 @@ typedef struct guac_terminal_display {
      */
     PangoFontDescription* font_desc;
 
+    /**
+     * Cache of all glyphs recently rendered using the current font.
+     */
+    guac_terminal_glyph_cache* glyph_cache;
+
     /**
      * The width of each character, in pixels.
      */
@@ -186,19 +330,35 @@ typedef struct guac_terminal_display {
     guac_terminal_color glyph_background;
 
     /**
-     * The surface containing the actual terminal.
+     * The guac_display which tracks the state of all layers of this terminal
+     * display, encoding changes to those layers for all connected users.
      */
-    guac_common_surface* display_surface;
+    guac_display* graphical_display;
+
+    /**
+     * The thread which determines when each frame of graphical_display is
+     * sent to connected users.
+     */
+    guac_display_render_thread* render_thread;
 
     /**
      * Layer which contains the actual terminal.
      */
-    guac_layer* display_layer;
+    guac_display_layer* display_layer;
 
     /**
      * Sub-layer of display layer which highlights selected text.
      */
-    guac_layer* select_layer;
+    guac_display_layer* select_layer;
+
+    /**
+     * Off-screen buffer containing a copy of each glyph within the glyph
+     * cache, drawn within the slot given by that glyph, or NULL if glyphs are
+     * not drawn from an atlas. Each character drawn is hinted to
+     * graphical_display as a copy from this buffer, such that each glyph need
+     * only be sent to the client once.
+     */
+    guac_display_layer* glyph_atlas;
 
     /**
      * Whether text is currently selected.
@@ -231,16 +391,64 @@ typedef struct guac_terminal_display {
      */
     bool unflushed_set;
 
+    /**
+     * Whether changes to the contents of this display are currently being
+     * ignored. While updates are suspended, all copy and set operations are
+     * silently dropped, and the display must be redrawn in its entirety once
+     * updates are resumed.
+     */
+    bool suspended;
+
+    /**
+     * The pipe stream over which the contents of this display are sent as
+     * text, or NULL if the text stream has not been enabled.
+     */
+    guac_stream* text_stream;
+
+    /**
+     * The contents of every cell of this display as of the most recent flush,
+     * in row-major order, or NULL if the text stream has not been enabled.
+     * This is used to synchronize users that join after the text stream has
+     * been enabled.
+     */
+    guac_terminal_char* text_cells;
+
+    /**
+     * Text stream data which has not yet been sent.
+     */
+    char text_buffer[GUAC_TERMINAL_TEXT_BUFFER_SIZE];
+
+    /**
+     * The number of bytes currently stored within text_buffer.
+     */
+    int text_length;
+
 } guac_terminal_display;
 
 /**
  * Allocates a new display having the given default foreground and background
- * colors.
+ * colors. All graphical updates to the display are sent by a dedicated render
+ * thread, which is started by this function. If glyph_atlas is true, each
+ * rendered glyph is sent to the client only once, within an off-screen atlas
+ * from which all later draws of that glyph are copied.
  */
 guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
         const char* font_name, int font_size, int dpi,
         guac_terminal_color* foreground, guac_terminal_color* background,
-        guac_terminal_color (*palette)[256]);
+        guac_terminal_color (*palette)[256], bool glyph_atlas);
+
+/**
+ * Begins sending the contents of the given display as text over a pipe stream
+ * named GUAC_TERMINAL_TEXT_STREAM_NAME, for clients which render terminal text
+ * themselves. While the text stream is enabled, characters are no longer
+ * rendered as images; only the background of each cell is drawn. The format
+ * of the text stream is described by GUAC_TERMINAL_TEXT_STREAM_MIMETYPE. This
+ * function has no effect if the text stream is already enabled.
+ *
+ * @param display
+ *     The display whose contents should be sent as text.
+ */
+void guac_terminal_display_enable_text_stream(guac_terminal_display* display);
 
 /**
  * Frees the given display.
@@ -317,6 +525,36 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
 void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets consecutive columns within the given row to the characters of the
+ * given run of printable ASCII text, each character occupying exactly one
+ * column. This is equivalent to calling guac_terminal_display_set_columns()
+ * for each character of the run. Any part of the run extending beyond the
+ * right edge of the display is ignored.
+ *
+ * @param display
+ *     The display to modify.
+ *
+ * @param row
+ *     The row containing the columns being set.
+ *
+ * @param start_column
+ *     The column that should receive the first character of the run.
+ *
+ * @param text
+ *     The run of printable ASCII text (characters 0x20 through 0x7E) to
+ *     draw. This text need not be null-terminated.
+ *
+ * @param length
+ *     The number of characters within the run.
+ *
+ * @param attributes
+ *     The attributes to assign to every character of the run.
+ */
+void guac_terminal_display_set_ascii(guac_terminal_display* display, int row,
+        int start_column, const char* text, int length,
+        const guac_terminal_attributes* attributes);
+
 /**
  * Resize the terminal to the given dimensions.
  */
@@ -332,7 +570,8 @@ void guac_terminal_display_flush_operations(guac_terminal_display* display);
 
 /**
  * Flushes all pending operations within the given guac_terminal_display,
- * then flushes the display surface.
+ * such that the resulting changes are sent to connected users once the
+ * current frame ends.
  *
  * @param display
  *     The terminal display to flush.
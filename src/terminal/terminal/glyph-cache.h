@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_TERMINAL_GLYPH_CACHE_H
+#define GUAC_TERMINAL_GLYPH_CACHE_H
+
+/**
+ * Structures and functions for caching glyphs that have already been
+ * rendered by the terminal display.
+ *
+ * @file glyph-cache.h
+ */
+
+#include "palette.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The maximum number of rendered glyphs that each terminal display will keep
+ * within its glyph cache.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_SIZE 512
+
+/**
+ * The number of hash buckets within each glyph cache. This MUST be a power of
+ * two.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_BUCKETS 1024
+
+/**
+ * A single glyph that has been rendered with a specific combination of
+ * foreground and background colors.
+ */
+typedef struct guac_terminal_glyph guac_terminal_glyph;
+
+struct guac_terminal_glyph {
+
+    /**
+     * The Unicode codepoint of the character rendered.
+     */
+    int codepoint;
+
+    /**
+     * The color used to render the character itself.
+     */
+    guac_terminal_color foreground;
+
+    /**
+     * The color used to fill the cell behind the character.
+     */
+    guac_terminal_color background;
+
+    /**
+     * The rendered glyph, covering the entire area of the character's
+     * cell(s).
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The index of the slot occupied by this glyph, between 0 and
+     * GUAC_TERMINAL_GLYPH_CACHE_SIZE - 1 inclusive. No two glyphs within the
+     * same cache ever occupy the same slot, and a slot is reused only once
+     * the glyph occupying it has been evicted, such that slots can be mapped
+     * directly onto regions of a glyph atlas.
+     */
+    int slot;
+
+    /**
+     * The previous (more recently used) glyph in the cache, or NULL if this
+     * is the most recently used glyph.
+     */
+    guac_terminal_glyph* prev;
+
+    /**
+     * The next (less recently used) glyph in the cache, or NULL if this is
+     * the least recently used glyph.
+     */
+    guac_terminal_glyph* next;
+
+    /**
+     * The next glyph within the same hash bucket, or NULL if there are no
+     * further glyphs within that bucket.
+     */
+    guac_terminal_glyph* next_in_bucket;
+
+};
+
+/**
+ * Least-recently-used cache of glyphs rendered by the terminal display, such
+ * that repeatedly drawing the same character with the same colors does not
+ * require that character to be shaped and rasterized each time. As every
+ * glyph depends on the current font, the cache must be cleared whenever the
+ * font changes.
+ */
+typedef struct guac_terminal_glyph_cache {
+
+    /**
+     * The number of glyphs currently in the cache.
+     */
+    int length;
+
+    /**
+     * The most recently used glyph, or NULL if the cache is empty.
+     */
+    guac_terminal_glyph* head;
+
+    /**
+     * The least recently used glyph, or NULL if the cache is empty.
+     */
+    guac_terminal_glyph* tail;
+
+    /**
+     * Hash table of all glyphs in the cache, where each bucket is a list of
+     * glyphs linked via next_in_bucket.
+     */
+    guac_terminal_glyph* buckets[GUAC_TERMINAL_GLYPH_CACHE_BUCKETS];
+
+} guac_terminal_glyph_cache;
+
+/**
+ * Allocates a new, empty glyph cache.
+ *
+ * @return
+ *     A newly-allocated glyph cache, which must eventually be freed with
+ *     guac_terminal_glyph_cache_free().
+ */
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc();
+
+/**
+ * Frees the given glyph cache, including all glyphs it contains.
+ *
+ * @param cache
+ *     The glyph cache to free.
+ */
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache);
+
+/**
+ * Removes and frees all glyphs within the given glyph cache.
+ *
+ * @param cache
+ *     The glyph cache to clear.
+ */
+void guac_terminal_glyph_cache_clear(guac_terminal_glyph_cache* cache);
+
+/**
+ * Returns the glyph previously rendered for the given character and colors,
+ * if any, marking that glyph as the most recently used. The returned glyph
+ * remains owned by the cache, and is valid only until the cache is next
+ * modified.
+ *
+ * @param cache
+ *     The glyph cache to search.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character.
+ *
+ * @param foreground
+ *     The color of the character itself.
+ *
+ * @param background
+ *     The color of the cell behind the character.
+ *
+ * @return
+ *     The rendered glyph, or NULL if no such glyph is cached.
+ */
+guac_terminal_glyph* guac_terminal_glyph_cache_get(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background);
+
+/**
+ * Adds the given rendered glyph to the given glyph cache as the most recently
+ * used glyph, evicting the least recently used glyph if the cache is full.
+ * The cache takes ownership of the given surface. No glyph for the same
+ * character and colors may already be present within the cache.
+ *
+ * @param cache
+ *     The glyph cache to add the glyph to.
+ *
+ * @param codepoint
+ *     The Unicode codepoint of the character.
+ *
+ * @param foreground
+ *     The color of the character itself.
+ *
+ * @param background
+ *     The color of the cell behind the character.
+ *
+ * @param surface
+ *     The rendered glyph.
+ *
+ * @return
+ *     The newly-added glyph, which remains owned by the cache, and which is
+ *     valid only until the cache is next modified.
+ */
+guac_terminal_glyph* guac_terminal_glyph_cache_put(guac_terminal_glyph_cache* cache,
+        int codepoint, const guac_terminal_color* foreground,
+        const guac_terminal_color* background, cairo_surface_t* surface);
+
+#endif
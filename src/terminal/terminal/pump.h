@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_TERMINAL_PUMP_H
+#define GUAC_TERMINAL_PUMP_H
+
+/**
+ * Constants, structures, and function definitions related to the queue and
+ * thread which feed all user input to STDIN of a terminal.
+ *
+ * @file pump.h
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * The number of bytes that may be queued within a guac_terminal_pump before
+ * guac_terminal_pump_wait() blocks. Sources of input which may provide
+ * arbitrarily large amounts of data, such as inbound streams, must wait for
+ * the queue to drain below this limit before queuing further data.
+ */
+#define GUAC_TERMINAL_PUMP_MAX_LENGTH 262144
+
+/**
+ * The maximum number of bytes that the pump thread of a guac_terminal_pump
+ * will write to STDIN with a single call to write().
+ */
+#define GUAC_TERMINAL_PUMP_CHUNK_SIZE 4096
+
+/**
+ * A single contiguous block of data queued within a guac_terminal_pump.
+ */
+typedef struct guac_terminal_pump_chunk {
+
+    /**
+     * The data queued within this chunk.
+     */
+    char* data;
+
+    /**
+     * The number of bytes of data within this chunk.
+     */
+    int length;
+
+    /**
+     * The offset of the first byte of data within this chunk which has not
+     * yet been written to STDIN.
+     */
+    int offset;
+
+    /**
+     * The next chunk within the queue, or NULL if this is the last chunk.
+     */
+    struct guac_terminal_pump_chunk* next;
+
+} guac_terminal_pump_chunk;
+
+/**
+ * A queue of user input awaiting delivery to STDIN of a terminal, along with
+ * the thread which performs that delivery. Queuing input never blocks on the
+ * STDIN pipe itself, such that threads which hold the terminal lock (or which
+ * handle input for a user) are never stalled behind a full pipe, and large
+ * pastes are delivered in chunks no faster than STDIN is read.
+ */
+typedef struct guac_terminal_pump {
+
+    /**
+     * The file descriptor of the write end of the STDIN pipe. This file
+     * descriptor is owned by the pump and is closed by its thread after the
+     * pump has been stopped.
+     */
+    int fd;
+
+    /**
+     * The thread which writes queued data to fd.
+     */
+    pthread_t thread;
+
+    /**
+     * Lock which guards access to the queue and all other pump state.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever data is added to or removed from
+     * the queue, or when the pump is stopped.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * The first (oldest) chunk within the queue, or NULL if the queue is
+     * empty.
+     */
+    guac_terminal_pump_chunk* first;
+
+    /**
+     * The last (newest) chunk within the queue, or NULL if the queue is
+     * empty.
+     */
+    guac_terminal_pump_chunk* last;
+
+    /**
+     * The total number of bytes within the queue which have not yet been
+     * written to STDIN.
+     */
+    int length;
+
+    /**
+     * Whether the pump has been stopped, either explicitly through
+     * guac_terminal_pump_stop() or because STDIN could no longer be written.
+     * Once stopped, all queued data is discarded and no further data is
+     * accepted.
+     */
+    bool stopped;
+
+} guac_terminal_pump;
+
+/**
+ * Allocates a new guac_terminal_pump which writes all queued data to the
+ * given file descriptor using a dedicated thread. Ownership of the file
+ * descriptor is transferred to the pump.
+ *
+ * @param fd
+ *     The file descriptor of the write end of the STDIN pipe.
+ *
+ * @return
+ *     A newly-allocated guac_terminal_pump, or NULL if the pump thread could
+ *     not be created. If NULL is returned, the file descriptor remains owned
+ *     by the caller.
+ */
+guac_terminal_pump* guac_terminal_pump_alloc(int fd);
+
+/**
+ * Stops the given guac_terminal_pump, discarding any queued data and waiting
+ * for its thread to terminate, and frees all associated resources.
+ *
+ * @param pump
+ *     The guac_terminal_pump to free.
+ */
+void guac_terminal_pump_free(guac_terminal_pump* pump);
+
+/**
+ * Adds a copy of the given data to the end of the queue of the given
+ * guac_terminal_pump. This function never blocks, regardless of the amount of
+ * data already queued.
+ *
+ * @param pump
+ *     The guac_terminal_pump to queue data within.
+ *
+ * @param data
+ *     The data to queue.
+ *
+ * @param length
+ *     The number of bytes of data to queue.
+ *
+ * @return
+ *     The number of bytes queued, which is always the given length, or a
+ *     negative value if the pump has been stopped.
+ */
+int guac_terminal_pump_write(guac_terminal_pump* pump, const char* data,
+        int length);
+
+/**
+ * Waits until fewer than GUAC_TERMINAL_PUMP_MAX_LENGTH bytes are queued
+ * within the given guac_terminal_pump. This function must NOT be invoked
+ * while holding the terminal lock, as the data queued within the pump may
+ * not be read from STDIN until output received in the meantime has been
+ * handled.
+ *
+ * @param pump
+ *     The guac_terminal_pump to wait on.
+ *
+ * @return
+ *     Zero if the queue has room for further data, non-zero if the pump has
+ *     been stopped.
+ */
+int guac_terminal_pump_wait(guac_terminal_pump* pump);
+
+/**
+ * Stops the given guac_terminal_pump, discarding any queued data. The pump
+ * thread will close the write end of the STDIN pipe as soon as possible,
+ * such that reads from STDIN will observe end-of-file. This function does not
+ * block and may safely be invoked multiple times.
+ *
+ * @param pump
+ *     The guac_terminal_pump to stop.
+ */
+void guac_terminal_pump_stop(guac_terminal_pump* pump);
+
+#endif
@@ -110,7 +110,9 @@ void guac_terminal_select_resume(guac_terminal* terminal, int row, int column);
  * more text is selected than can fit within the clipboard, text at the end of
  * the selected area will be dropped as necessary. This function should only be
  * invoked while the guac_terminal is locked through a call to
- * guac_terminal_lock().
+ * guac_terminal_lock(). The clipboard is not sent to connected users by this
+ * function. It is instead marked as pending, to be broadcast once the
+ * terminal has been unlocked.
  *
  * @param terminal
  *     The guac_terminal instance associated with the text being selected.
@@ -44,6 +44,34 @@
  */
 int guac_terminal_echo(guac_terminal* term, unsigned char c);
 
+/**
+ * Echoes the run of printable ASCII characters (0x20 through 0x7E) at the
+ * start of the given data to the terminal display in bulk, exactly as
+ * guac_terminal_echo() would for each character individually. Only the
+ * leading run of printable characters is handled, and only if the terminal is
+ * in a state where each such character is simply drawn without any mapping
+ * (no pipe stream is open, insert mode is off, and the active character set
+ * has no mapping). The remaining data must be handled by the current
+ * character handler as usual.
+ *
+ * This function may only be used while the current character handler is
+ * guac_terminal_echo().
+ *
+ * @param term
+ *     The terminal that received the given data.
+ *
+ * @param c
+ *     The data received by the given terminal.
+ *
+ * @param length
+ *     The number of bytes of data received.
+ *
+ * @return
+ *     The number of bytes of data handled, which may be zero if the data does
+ *     not begin with a printable character or cannot be handled in bulk.
+ */
+int guac_terminal_echo_ascii(guac_terminal* term, const char* c, int length);
+
 /**
  * Handles any characters which follow an ANSI ESC (0x1B) character.
  *
@@ -21,9 +21,9 @@
 #define GUAC_TERMINAL_PRIV_H
 
 #include "common/clipboard.h"
-#include "common/cursor.h"
 #include "buffer.h"
 #include "display.h"
+#include "pump.h"
 #include "scrollbar.h"
 #include "terminal.h"
 #include "typescript.h"
@@ -36,6 +36,18 @@
  */
 #define GUAC_TERMINAL_MODIFIED 1
 
+/**
+ * The sequence sent to STDIN prior to pasted text while bracketed paste mode
+ * is enabled.
+ */
+#define GUAC_TERMINAL_PASTE_START "\x1B[200~"
+
+/**
+ * The sequence sent to STDIN following pasted text while bracketed paste mode
+ * is enabled.
+ */
+#define GUAC_TERMINAL_PASTE_END "\x1B[201~"
+
 /**
  * Handler for characters printed to the terminal. When a character is printed,
  * the current char handler for the terminal is called and given that
@@ -69,6 +81,20 @@ struct guac_terminal {
      */
     bool started;
 
+    /**
+     * The number of bytes of output received by guac_terminal_write() since
+     * the last frame was flushed.
+     */
+    int frame_bytes;
+
+    /**
+     * Whether this terminal is currently flooded with output, having received
+     * at least GUAC_TERMINAL_FLOOD_THRESHOLD bytes within the last frame.
+     * While flooded, updates to the display are suspended until the end of
+     * each frame, and frames are rendered at a reduced rate.
+     */
+    bool flooded;
+
     /**
      * The terminal render thread.
      */
@@ -103,10 +129,17 @@ struct guac_terminal {
     /**
      * Pipe which will be the source of user input. When a terminal code
      * generates synthesized user input, that data will be written to
-     * this pipe.
+     * this pipe. The write end of this pipe is owned by stdin_pump, and is
+     * set to -1 once the pump has been allocated.
      */
     int stdin_pipe_fd[2];
 
+    /**
+     * The queue and thread through which all user input is written to the
+     * write end of stdin_pipe_fd.
+     */
+    guac_terminal_pump* stdin_pump;
+
     /**
      * The currently-open pipe stream from which all terminal input should be
      * read, if any. If no pipe stream is open, terminal input will be received
@@ -115,6 +148,13 @@ struct guac_terminal {
      */
     guac_stream* input_stream;
 
+    /**
+     * Whether the input received from input_stream is being surrounded by
+     * bracketed paste markers, as bracketed paste mode was enabled when the
+     * stream was opened.
+     */
+    bool input_stream_bracketed;
+
     /**
      * The currently-open pipe stream to which all terminal output should be
      * written, if any. If no pipe stream is open, terminal output will be
@@ -151,11 +191,6 @@ struct guac_terminal {
      */
     guac_terminal_typescript* typescript;
 
-    /**
-     * Terminal-wide mouse cursor, synchronized across all users.
-     */
-    guac_common_cursor* cursor;
-
     /**
      * Graphical representation of the current scroll state.
      */
@@ -202,6 +237,29 @@ struct guac_terminal {
      */
     int outer_height;
 
+    /**
+     * Whether the terminal has been resized with guac_terminal_resize() but
+     * that resize has not yet been applied. Resizes are applied only once
+     * the terminal next receives output or renders a frame, such that a rapid
+     * series of resizes (as when a user drags the edge of their browser
+     * window) is applied only once, using the most recent dimensions.
+     */
+    bool resize_pending;
+
+    /**
+     * The width of the terminal, in characters, that will take effect once
+     * any pending resize is applied. If no resize is pending, this is the
+     * same as term_width.
+     */
+    int pending_columns;
+
+    /**
+     * The height of the terminal, in characters, that will take effect once
+     * any pending resize is applied. If no resize is pending, this is the
+     * same as term_height.
+     */
+    int pending_rows;
+
     /**
      * The width of the terminal, in pixels.
      */
@@ -365,6 +423,14 @@ struct guac_terminal {
      */
     bool selection_committed;
 
+    /**
+     * Whether the contents of the clipboard have changed due to a completed
+     * selection and must be broadcast to all connected users. The clipboard
+     * is broadcast only after the terminal has been unlocked, such that
+     * sending large selections does not block the terminal.
+     */
+    bool clipboard_pending;
+
     /**
      * The row that the selection starts at.
      */
@@ -401,6 +467,13 @@ struct guac_terminal {
      */
     bool application_cursor_keys;
 
+    /**
+     * Whether pasted text should be surrounded by the bracketed paste markers
+     * GUAC_TERMINAL_PASTE_START and GUAC_TERMINAL_PASTE_END, as requested by
+     * the application running within the terminal (DECSET 2004).
+     */
+    bool bracketed_paste;
+
     /**
      * Whether a CR should automatically follow a LF, VT, or FF.
      */
@@ -535,6 +608,32 @@ void guac_terminal_reset(guac_terminal* term);
  */
 int guac_terminal_set(guac_terminal* term, int row, int col, int codepoint);
 
+/**
+ * Sets consecutive columns within the given row, starting at the given
+ * column, to the characters of the given run of printable ASCII text using
+ * the current attributes of the terminal. This is equivalent to calling
+ * guac_terminal_set() for each character of the run, but avoids the overhead
+ * of doing so for each character individually.
+ *
+ * @param term
+ *     The terminal to modify.
+ *
+ * @param row
+ *     The row containing the columns being set.
+ *
+ * @param col
+ *     The column that should receive the first character of the run.
+ *
+ * @param text
+ *     The run of printable ASCII text (characters 0x20 through 0x7E) to
+ *     write. This text need not be null-terminated.
+ *
+ * @param length
+ *     The number of characters within the run.
+ */
+void guac_terminal_set_ascii(guac_terminal* term, int row, int col,
+        const char* text, int length);
+
 /**
  * Clears the given region within a single row.
  */
@@ -672,7 +771,10 @@ void guac_terminal_copy_columns(guac_terminal* terminal, int row,
 
 /**
  * Copies the given range of rows to a new location, offset from the
- * original by the given number of rows.
+ * original by the given number of rows. Within the terminal buffer, rows are
+ * moved rather than copied (see guac_terminal_buffer_shift_rows()), and the
+ * rows vacated by the range are left empty. The caller is expected to clear
+ * those vacated rows.
  */
 void guac_terminal_copy_rows(guac_terminal* terminal,
         int start_row, int end_row, int offset);
@@ -683,7 +785,8 @@ void guac_terminal_copy_rows(guac_terminal* terminal,
 void guac_terminal_flush(guac_terminal* terminal);
 
 /**
- * Redraw default layer text and background.
+ * Redraw default layer text and background, first applying any pending resize
+ * (see guac_terminal_resize()). The terminal must already be locked.
  *
  * @param terminal
  *      The terminal to redraw.
@@ -64,6 +64,19 @@
  */
 #define GUAC_TERMINAL_DEFAULT_DISABLE_COPY false
 
+/**
+ * The default value for the "text stream" flag; by default the terminal is
+ * rendered entirely as images, without additionally sending its contents as
+ * text.
+ */
+#define GUAC_TERMINAL_DEFAULT_TEXT_STREAM false
+
+/**
+ * The default value for the "glyph atlas" flag; by default each rendered
+ * glyph is sent to the client as image data wherever it is drawn.
+ */
+#define GUAC_TERMINAL_DEFAULT_GLYPH_ATLAS false
+
 /**
  * The absolute maximum number of rows to allow within the display.
  */
@@ -86,6 +99,21 @@
  */
 #define GUAC_TERMINAL_FRAME_TIMEOUT 10
 
+/**
+ * The number of bytes of output that must be received within a single frame
+ * for the terminal to be considered flooded with output. While flooded,
+ * output is handled without updating the display, which is instead redrawn
+ * from the terminal buffer only once per frame, and frames are rendered at
+ * the reduced rate dictated by GUAC_TERMINAL_FLOOD_FRAME_DURATION.
+ */
+#define GUAC_TERMINAL_FLOOD_THRESHOLD 16384
+
+/**
+ * The maximum duration of a single frame while the terminal is flooded with
+ * output, in milliseconds.
+ */
+#define GUAC_TERMINAL_FLOOD_FRAME_DURATION 200
+
 /**
  * The maximum number of custom tab stops.
  */
@@ -243,8 +271,33 @@ typedef struct guac_terminal_options {
      */
     int backspace;
 
+    /**
+     * Whether the contents of the terminal should be sent as text over a
+     * dedicated pipe stream, with characters no longer rendered as images.
+     * See guac_terminal_display_enable_text_stream().
+     */
+    bool text_stream;
+
+    /**
+     * Whether rendered glyphs should be uploaded once to an off-screen atlas
+     * shared with the client, with each later draw of the same glyph sent as
+     * a "copy" from that atlas rather than as new image data.
+     */
+    bool glyph_atlas;
+
 } guac_terminal_options;
 
+/**
+ * Begins loading the fontconfig configuration, font caches, and default
+ * terminal font in the background, such that the first terminal created by
+ * the current process need not wait for fonts to be enumerated and loaded from
+ * disk. This function returns immediately and takes effect only once per
+ * process; subsequent calls have no effect. It is safe to call this function
+ * from any thread, and it is intended to be called as early as possible,
+ * such as from within the guac_client_init() of a protocol plugin.
+ */
+void guac_terminal_preload_fonts();
+
 /**
  * Creates a new guac_terminal, having the given width and height, and
  * rendering to the given client. As failover mechanisms and the Guacamole
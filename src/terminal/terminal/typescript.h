@@ -29,6 +29,8 @@
 
 #include <guacamole/timestamp.h>
 
+#include <pthread.h>
+
 /**
  * A NULL-terminated string of raw bytes which should be written at the
  * beginning of any typescript.
@@ -74,6 +76,27 @@
  */
 #define GUAC_TERMINAL_TYPESCRIPT_TIMING_SUFFIX "timing"
 
+/**
+ * The number of bytes of raw terminal output that may be waiting to be
+ * written to the data file by the background writer thread of a typescript.
+ * If this much output is already waiting, flushing the typescript will block
+ * until the writer thread has caught up.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE 262144
+
+/**
+ * The number of bytes of timing information that may be waiting to be
+ * written to the timing file by the background writer thread of a
+ * typescript. If this much timing information is already waiting, flushing
+ * the typescript will block until the writer thread has caught up.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_TIMING_BUFFER_SIZE 16384
+
+/**
+ * The maximum length of a single line of timing information, in bytes.
+ */
+#define GUAC_TERMINAL_TYPESCRIPT_MAX_TIMING_LENGTH 32
+
 /**
  * An active typescript, consisting of a data file (raw terminal output) and
  * timing file (related timestamps and byte counts).
@@ -122,6 +145,77 @@ typedef struct guac_terminal_typescript {
      */
     guac_timestamp last_flush;
 
+    /**
+     * Lock which guards access to all members of this structure that are
+     * shared with the writer thread.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition which is signalled whenever new data is waiting to be written
+     * or the writer thread should stop.
+     */
+    pthread_cond_t modified;
+
+    /**
+     * Condition which is signalled by the writer thread whenever waiting data
+     * has been written, making room for further data.
+     */
+    pthread_cond_t drained;
+
+    /**
+     * Flushed terminal output which is waiting to be written to the data file
+     * by the writer thread. This buffer has room for
+     * GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE bytes.
+     */
+    char* pending_data;
+
+    /**
+     * The number of bytes currently stored in pending_data.
+     */
+    int pending_data_length;
+
+    /**
+     * Timing information which is waiting to be written to the timing file by
+     * the writer thread. This buffer has room for
+     * GUAC_TERMINAL_TYPESCRIPT_TIMING_BUFFER_SIZE bytes.
+     */
+    char* pending_timing;
+
+    /**
+     * The number of bytes currently stored in pending_timing.
+     */
+    int pending_timing_length;
+
+    /**
+     * Buffer of terminal output currently being written to the data file by
+     * the writer thread. This buffer is exchanged with pending_data each time
+     * the writer thread begins writing, and is only accessed by the writer
+     * thread.
+     */
+    char* writing_data;
+
+    /**
+     * Buffer of timing information currently being written to the timing file
+     * by the writer thread. This buffer is exchanged with pending_timing each
+     * time the writer thread begins writing, and is only accessed by the
+     * writer thread.
+     */
+    char* writing_timing;
+
+    /**
+     * Non-zero if the writer thread should stop once all waiting data has
+     * been written, zero otherwise.
+     */
+    int stopping;
+
+    /**
+     * The thread which writes all flushed data and timing information to the
+     * data and timing files, such that slow storage does not delay the
+     * terminal.
+     */
+    pthread_t writer_thread;
+
 } guac_terminal_typescript;
 
 /**
@@ -171,9 +265,28 @@ guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
 void guac_terminal_typescript_write(guac_terminal_typescript* typescript,
         char c);
 
+/**
+ * Writes the given buffer of terminal data to the typescript, flushing and
+ * writing new timestamps as necessary. This is equivalent to calling
+ * guac_terminal_typescript_write() for each byte of the buffer.
+ *
+ * @param typescript
+ *     The typescript that the given raw terminal data should be written to.
+ *
+ * @param buffer
+ *     The raw terminal data to write to the typescript.
+ *
+ * @param length
+ *     The number of bytes within the given buffer.
+ */
+void guac_terminal_typescript_write_buffer(guac_terminal_typescript* typescript,
+        const char* buffer, int length);
+
 /**
  * Flushes any pending data to the typescript, writing a new timestamp to the
- * timing file if any data was flushed.
+ * timing file if any data was flushed. The data and timestamp are written to
+ * their respective files in the background. This function blocks only if
+ * more data is already waiting to be written than can be buffered.
  *
  * @param typescript
  *     The typescript which should be flushed.
@@ -24,8 +24,10 @@
 #include <guacamole/timestamp.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/types.h>
@@ -112,6 +114,63 @@ static int guac_terminal_typescript_open_data_file(const char* path,
 
 }
 
+/**
+ * Writes all flushed terminal output and timing information of the given
+ * typescript to its data and timing files as it becomes available, until the
+ * typescript is freed.
+ *
+ * @param data
+ *     A pointer to the guac_terminal_typescript being written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_terminal_typescript_writer_thread(void* data) {
+
+    guac_terminal_typescript* typescript = (guac_terminal_typescript*) data;
+
+    pthread_mutex_lock(&(typescript->lock));
+
+    for (;;) {
+
+        /* Wait for data to be flushed */
+        while (!typescript->stopping && typescript->pending_timing_length == 0)
+            pthread_cond_wait(&(typescript->modified), &(typescript->lock));
+
+        /* Stop only after all flushed data has been written */
+        if (typescript->pending_timing_length == 0)
+            break;
+
+        /* Take ownership of all waiting data, leaving empty buffers in its
+         * place such that the terminal can continue flushing */
+        char* timing = typescript->pending_timing;
+        int timing_length = typescript->pending_timing_length;
+        typescript->pending_timing = typescript->writing_timing;
+        typescript->pending_timing_length = 0;
+        typescript->writing_timing = timing;
+
+        char* output = typescript->pending_data;
+        int output_length = typescript->pending_data_length;
+        typescript->pending_data = typescript->writing_data;
+        typescript->pending_data_length = 0;
+        typescript->writing_data = output;
+
+        pthread_cond_broadcast(&(typescript->drained));
+        pthread_mutex_unlock(&(typescript->lock));
+
+        /* Write timestamps and data without blocking further flushes */
+        guac_common_write(typescript->timing_fd, timing, timing_length);
+        guac_common_write(typescript->data_fd, output, output_length);
+
+        pthread_mutex_lock(&(typescript->lock));
+
+    }
+
+    pthread_mutex_unlock(&(typescript->lock));
+    return NULL;
+
+}
+
 guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
         const char* name, int create_path, int allow_write_existing) {
 
@@ -160,10 +219,39 @@ guac_terminal_typescript* guac_terminal_typescript_alloc(const char* path,
     typescript->length = 0;
     typescript->last_flush = guac_timestamp_current();
 
+    /* Allocate buffers for data waiting to be written and being written */
+    typescript->pending_data = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE);
+    typescript->writing_data = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE);
+    typescript->pending_timing = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_TIMING_BUFFER_SIZE);
+    typescript->writing_timing = guac_mem_alloc(GUAC_TERMINAL_TYPESCRIPT_TIMING_BUFFER_SIZE);
+    typescript->pending_data_length = 0;
+    typescript->pending_timing_length = 0;
+    typescript->stopping = 0;
+
+    pthread_mutex_init(&(typescript->lock), NULL);
+    pthread_cond_init(&(typescript->modified), NULL);
+    pthread_cond_init(&(typescript->drained), NULL);
+
     /* Write header */
     guac_common_write(typescript->data_fd, GUAC_TERMINAL_TYPESCRIPT_HEADER,
             sizeof(GUAC_TERMINAL_TYPESCRIPT_HEADER) - 1);
 
+    /* Write all further data in the background */
+    if (pthread_create(&(typescript->writer_thread), NULL,
+                guac_terminal_typescript_writer_thread, typescript)) {
+        pthread_cond_destroy(&(typescript->drained));
+        pthread_cond_destroy(&(typescript->modified));
+        pthread_mutex_destroy(&(typescript->lock));
+        guac_mem_free(typescript->pending_data);
+        guac_mem_free(typescript->writing_data);
+        guac_mem_free(typescript->pending_timing);
+        guac_mem_free(typescript->writing_timing);
+        close(typescript->data_fd);
+        close(typescript->timing_fd);
+        guac_mem_free(typescript);
+        return NULL;
+    }
+
     return typescript;
 
 }
@@ -180,6 +268,29 @@ void guac_terminal_typescript_write(guac_terminal_typescript* typescript,
 
 }
 
+void guac_terminal_typescript_write_buffer(guac_terminal_typescript* typescript,
+        const char* buffer, int length) {
+
+    while (length > 0) {
+
+        /* Flush buffer if no space is available */
+        if (typescript->length == sizeof(typescript->buffer))
+            guac_terminal_typescript_flush(typescript);
+
+        /* Append as much as fits within the buffer */
+        int available = sizeof(typescript->buffer) - typescript->length;
+        int chunk = length < available ? length : available;
+
+        memcpy(typescript->buffer + typescript->length, buffer, chunk);
+        typescript->length += chunk;
+
+        buffer += chunk;
+        length -= chunk;
+
+    }
+
+}
+
 void guac_terminal_typescript_flush(guac_terminal_typescript* typescript) {
 
     /* Do nothing if nothing to flush */
@@ -196,7 +307,7 @@ void guac_terminal_typescript_flush(guac_terminal_typescript* typescript) {
         elapsed_time = GUAC_TERMINAL_TYPESCRIPT_MAX_DELAY;
 
     /* Produce single line of timestamp output */
-    char timestamp_buffer[32];
+    char timestamp_buffer[GUAC_TERMINAL_TYPESCRIPT_MAX_TIMING_LENGTH];
     int timestamp_length = snprintf(timestamp_buffer, sizeof(timestamp_buffer),
             "%0.6f %i\n", elapsed_time / 1000.0, typescript->length);
 
@@ -204,13 +315,27 @@ void guac_terminal_typescript_flush(guac_terminal_typescript* typescript) {
     if (timestamp_length > sizeof(timestamp_buffer))
         timestamp_length = sizeof(timestamp_buffer);
 
-    /* Write timestamp to timing file */
-    guac_common_write(typescript->timing_fd,
+    pthread_mutex_lock(&(typescript->lock));
+
+    /* Wait for the writer thread to catch up if there is no room for the
+     * timestamp and data */
+    while (typescript->pending_timing_length + timestamp_length
+                > GUAC_TERMINAL_TYPESCRIPT_TIMING_BUFFER_SIZE
+            || typescript->pending_data_length + typescript->length
+                > GUAC_TERMINAL_TYPESCRIPT_BUFFER_SIZE)
+        pthread_cond_wait(&(typescript->drained), &(typescript->lock));
+
+    /* Queue timestamp and data for writing to the timing and data files */
+    memcpy(typescript->pending_timing + typescript->pending_timing_length,
             timestamp_buffer, timestamp_length);
+    typescript->pending_timing_length += timestamp_length;
 
-    /* Empty buffer into data file */
-    guac_common_write(typescript->data_fd,
+    memcpy(typescript->pending_data + typescript->pending_data_length,
             typescript->buffer, typescript->length);
+    typescript->pending_data_length += typescript->length;
+
+    pthread_cond_signal(&(typescript->modified));
+    pthread_mutex_unlock(&(typescript->lock));
 
     /* Buffer is now flushed */
     typescript->length = 0;
@@ -227,6 +352,23 @@ void guac_terminal_typescript_free(guac_terminal_typescript* typescript) {
     /* Flush any pending data */
     guac_terminal_typescript_flush(typescript);
 
+    /* Wait for all flushed data to be written */
+    pthread_mutex_lock(&(typescript->lock));
+    typescript->stopping = 1;
+    pthread_cond_signal(&(typescript->modified));
+    pthread_mutex_unlock(&(typescript->lock));
+
+    pthread_join(typescript->writer_thread, NULL);
+
+    pthread_cond_destroy(&(typescript->drained));
+    pthread_cond_destroy(&(typescript->modified));
+    pthread_mutex_destroy(&(typescript->lock));
+
+    guac_mem_free(typescript->pending_data);
+    guac_mem_free(typescript->writing_data);
+    guac_mem_free(typescript->pending_timing);
+    guac_mem_free(typescript->writing_timing);
+
     /* Write footer */
     guac_common_write(typescript->data_fd, GUAC_TERMINAL_TYPESCRIPT_FOOTER,
             sizeof(GUAC_TERMINAL_TYPESCRIPT_FOOTER) - 1);